@@ -0,0 +1,164 @@
+/*
+ * alloc.c
+ *
+ * Userspace RCU library - Allocator hooks of the library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
+#include <urcu/arch.h>
+#include <urcu/cacheline.h>
+#include <urcu/alloc.h>
+
+/* Counters of each subsystem, on their own cache line. */
+struct alloc_counters {
+	unsigned long bytes;
+	unsigned long nr_allocs;
+	unsigned long nr_frees;
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+static const char *subsys_name[NR_URCU_ALLOC_SUBSYS] = {
+	[URCU_ALLOC_CALL_RCU] = "call_rcu",
+	[URCU_ALLOC_DEFER] = "defer",
+	[URCU_ALLOC_LFQUEUE] = "lfqueue",
+	[URCU_ALLOC_LFHT] = "lfht",
+	[URCU_ALLOC_BP_ARENA] = "bp_arena",
+};
+
+static struct alloc_counters counters[NR_URCU_ALLOC_SUBSYS];
+
+static
+void *default_alloc(size_t size, size_t align,
+		enum urcu_alloc_subsys subsys, void *priv)
+{
+	void *p;
+
+	if (!align)
+		return malloc(size);
+	if (posix_memalign(&p, align, size))
+		return NULL;
+	return p;
+}
+
+static
+void default_free(void *ptr, size_t size, enum urcu_alloc_subsys subsys,
+		void *priv)
+{
+	free(ptr);
+}
+
+static const struct urcu_alloc_ops default_ops = {
+	.alloc = default_alloc,
+	.free = default_free,
+};
+
+static const struct urcu_alloc_ops *alloc_ops = &default_ops;
+
+int urcu_alloc_set_ops(const struct urcu_alloc_ops *ops)
+{
+	unsigned long live = 0;
+	int i;
+
+	for (i = 0; i < NR_URCU_ALLOC_SUBSYS; i++)
+		live += uatomic_read(&counters[i].nr_allocs)
+			- uatomic_read(&counters[i].nr_frees);
+	if (live)
+		return -EBUSY;
+	CMM_STORE_SHARED(alloc_ops, ops ? ops : &default_ops);
+	return 0;
+}
+
+void *urcu_alloc_aligned(enum urcu_alloc_subsys subsys, size_t size,
+		size_t align)
+{
+	const struct urcu_alloc_ops *ops = CMM_LOAD_SHARED(alloc_ops);
+	void *p;
+
+	p = ops->alloc(size, align, subsys, ops->priv);
+	if (!p)
+		return NULL;
+	uatomic_add(&counters[subsys].bytes, size);
+	uatomic_inc(&counters[subsys].nr_allocs);
+	return p;
+}
+
+void *urcu_alloc(enum urcu_alloc_subsys subsys, size_t size)
+{
+	return urcu_alloc_aligned(subsys, size, 0);
+}
+
+void *urcu_zalloc(enum urcu_alloc_subsys subsys, size_t size)
+{
+	void *p;
+
+	p = urcu_alloc_aligned(subsys, size, 0);
+	if (p)
+		memset(p, 0, size);
+	return p;
+}
+
+void urcu_free(enum urcu_alloc_subsys subsys, void *ptr, size_t size)
+{
+	const struct urcu_alloc_ops *ops = CMM_LOAD_SHARED(alloc_ops);
+
+	if (!ptr)
+		return;
+	ops->free(ptr, size, subsys, ops->priv);
+	uatomic_add(&counters[subsys].bytes, -size);
+	uatomic_inc(&counters[subsys].nr_frees);
+}
+
+void *urcu_cacheline_zalloc(enum urcu_alloc_subsys subsys, size_t size)
+{
+	size_t len = caa_cacheline_stride(size);
+	void *p;
+
+	p = urcu_alloc_aligned(subsys, len, caa_cacheline_align());
+	if (p)
+		memset(p, 0, len);
+	return p;
+}
+
+void urcu_cacheline_free(enum urcu_alloc_subsys subsys, void *ptr,
+		size_t size)
+{
+	urcu_free(subsys, ptr, caa_cacheline_stride(size));
+}
+
+void urcu_alloc_account(enum urcu_alloc_subsys subsys, long bytes)
+{
+	uatomic_add(&counters[subsys].bytes, bytes);
+}
+
+void urcu_alloc_get_stats(enum urcu_alloc_subsys subsys,
+		struct urcu_alloc_stats *stats)
+{
+	stats->bytes = uatomic_read(&counters[subsys].bytes);
+	stats->nr_allocs = uatomic_read(&counters[subsys].nr_allocs);
+	stats->nr_frees = uatomic_read(&counters[subsys].nr_frees);
+}
+
+const char *urcu_alloc_subsys_name(enum urcu_alloc_subsys subsys)
+{
+	if (subsys >= NR_URCU_ALLOC_SUBSYS)
+		return "unknown";
+	return subsys_name[subsys];
+}
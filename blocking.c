@@ -0,0 +1,45 @@
+/*
+ * blocking.c
+ *
+ * Userspace RCU library - Quiescent states around blocking waits
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+
+#include <urcu/tls-compat.h>
+#include <urcu/blocking.h>
+
+static DEFINE_URCU_TLS(const struct urcu_blocking_ops *, blocking_ops);
+
+void urcu_blocking_set_ops(const struct urcu_blocking_ops *ops)
+{
+	URCU_TLS(blocking_ops) = ops;
+}
+
+int urcu_blocking_offline(void)
+{
+	const struct urcu_blocking_ops *ops = URCU_TLS(blocking_ops);
+
+	if (caa_likely(!ops))
+		return 0;
+	return ops->offline();
+}
+
+void urcu_blocking_online(void)
+{
+	URCU_TLS(blocking_ops)->online();
+}
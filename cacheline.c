@@ -0,0 +1,95 @@
+/*
+ * cacheline.c
+ *
+ * Userspace RCU library - Run time cache line size and aligned allocation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <urcu/system.h>
+#include <urcu/cacheline.h>
+
+#define SYSFS_CACHE_LINE_SIZE	\
+	"/sys/devices/system/cpu/cpu0/cache/index0/coherency_line_size"
+
+/* 0 until detected. Concurrent detections store the same value. */
+static size_t cache_line_size;
+
+static
+size_t sysfs_cache_line_size(void)
+{
+	unsigned long size;
+	FILE *fp;
+	int ret;
+
+	fp = fopen(SYSFS_CACHE_LINE_SIZE, "r");
+	if (!fp)
+		return 0;
+	ret = fscanf(fp, "%lu", &size);
+	fclose(fp);
+	if (ret != 1)
+		return 0;
+	return size;
+}
+
+size_t caa_cache_line_size(void)
+{
+	size_t size;
+
+	size = CMM_LOAD_SHARED(cache_line_size);
+	if (caa_likely(size))
+		return size;
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+	{
+		long ret;
+
+		ret = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+		if (ret > 0)
+			size = ret;
+	}
+#endif
+	if (!size)
+		size = sysfs_cache_line_size();
+	if (!size || (size & (size - 1)))
+		size = CAA_CACHE_LINE_SIZE;
+	CMM_STORE_SHARED(cache_line_size, size);
+	return size;
+}
+
+void *caa_cacheline_alloc(size_t size)
+{
+	void *p;
+
+	if (posix_memalign(&p, caa_cacheline_align(),
+			caa_cacheline_stride(size ? size : 1)))
+		return NULL;
+	return p;
+}
+
+void *caa_cacheline_zalloc(size_t size)
+{
+	void *p;
+
+	size = caa_cacheline_stride(size ? size : 1);
+	p = caa_cacheline_alloc(size);
+	if (p)
+		memset(p, 0, size);
+	return p;
+}
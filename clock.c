@@ -0,0 +1,91 @@
+/*
+ * clock.c
+ *
+ * Userspace RCU library - Cycle counter calibrated in nanoseconds
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <time.h>
+#include <pthread.h>
+
+#include <urcu/clock.h>
+
+/* Duration of the calibration. */
+#define CLOCK_CALIBRATION_NS	10000000ULL
+
+/* Coarsest counter resolution used by caa_clock_ns(). */
+#define CLOCK_CYCLES_MAX_NS	100.0
+
+static pthread_once_t clock_calibrate_once = PTHREAD_ONCE_INIT;
+
+/* Set once by clock_calibrate(). */
+static double clock_ns_per_cycle;	/* 0 if the counter is unusable */
+static int clock_use_cycles;
+static cycles_t clock_base_cycles;
+static uint64_t clock_base_ns;
+
+static
+uint64_t clock_monotonic_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static
+void clock_calibrate(void)
+{
+	uint64_t start_ns, end_ns;
+	cycles_t start_cycles, end_cycles;
+
+	start_ns = clock_monotonic_ns();
+	start_cycles = caa_get_cycles_ordered();
+	if (!start_ns)
+		return;
+	do {
+		end_cycles = caa_get_cycles_ordered();
+		end_ns = clock_monotonic_ns();
+	} while (end_ns && end_ns - start_ns < CLOCK_CALIBRATION_NS);
+	if (!end_ns || end_cycles <= start_cycles)
+		return;
+	clock_ns_per_cycle = (double) (end_ns - start_ns)
+		/ (double) (end_cycles - start_cycles);
+	clock_base_cycles = end_cycles;
+	clock_base_ns = end_ns;
+	clock_use_cycles = clock_ns_per_cycle < CLOCK_CYCLES_MAX_NS;
+}
+
+uint64_t caa_cycles_to_ns(cycles_t cycles)
+{
+	(void) pthread_once(&clock_calibrate_once, clock_calibrate);
+	return (uint64_t) ((double) cycles * clock_ns_per_cycle);
+}
+
+uint64_t caa_clock_ns(void)
+{
+	cycles_t cycles;
+
+	(void) pthread_once(&clock_calibrate_once, clock_calibrate);
+	if (!clock_use_cycles)
+		return clock_monotonic_ns();
+	cycles = caa_get_cycles_ordered();
+	if (caa_unlikely(cycles < clock_base_cycles))
+		return clock_base_ns;
+	return clock_base_ns + (uint64_t) ((double) (cycles - clock_base_cycles)
+		* clock_ns_per_cycle);
+}
@@ -27,39 +27,69 @@
 #include <errno.h>
 #include <poll.h>
 #include <stdint.h>
+#include <time.h>
 
 #include <urcu/arch.h>
 #include <urcu/futex.h>
+#include <urcu/blocking.h>
 
 /*
- * Using attribute "weak" for __urcu_compat_futex_lock and
- * __urcu_compat_futex_cond. Those are globally visible by the entire
- * program, even though many shared objects may have their own version.
- * The first version that gets loaded will be used by the entire program
- * (executable and all shared objects).
+ * Waiters are hashed by futex address into buckets, each with its own
+ * mutex and condition variable, so a wakeup only concerns the waiters
+ * of its bucket rather than every waiter of the program.
+ * COMPAT_FUTEX_HASH_SIZE must be a power of 2.
+ */
+#define COMPAT_FUTEX_HASH_SIZE	64
+
+struct urcu_compat_futex_bucket {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+/*
+ * Using attribute "weak" for __urcu_compat_futex_table. It is globally
+ * visible by the entire program, even though many shared objects may
+ * have their own version. The first version that gets loaded will be
+ * used by the entire program (executable and all shared objects).
  */
 
 __attribute__((weak))
-pthread_mutex_t __urcu_compat_futex_lock = PTHREAD_MUTEX_INITIALIZER;
-__attribute__((weak))
-pthread_cond_t __urcu_compat_futex_cond = PTHREAD_COND_INITIALIZER;
+struct urcu_compat_futex_bucket
+		__urcu_compat_futex_table[COMPAT_FUTEX_HASH_SIZE] = {
+	[0 ... COMPAT_FUTEX_HASH_SIZE - 1] = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+	},
+};
+
+static struct urcu_compat_futex_bucket *compat_futex_bucket(int32_t *uaddr)
+{
+	unsigned long hash = (unsigned long) uaddr >> 2;
+
+	/* Mix the address bits (Fibonacci hashing). */
+	hash *= 0x9E3779B9UL;
+	hash ^= hash >> 16;
+	return &__urcu_compat_futex_table[hash & (COMPAT_FUTEX_HASH_SIZE - 1)];
+}
 
 /*
  * _NOT SIGNAL-SAFE_. pthread_cond is not signal-safe anyway. Though.
- * For now, timeout, uaddr2 and val3 are unused.
+ * For now, uaddr2 and val3 are unused. As for sys_futex, timeout is
+ * relative, and -ETIMEDOUT is returned when it expires.
  * Waiter will relinquish the CPU until woken up.
  */
 
 int compat_futex_noasync(int32_t *uaddr, int op, int32_t val,
 	const struct timespec *timeout, int32_t *uaddr2, int32_t val3)
 {
-	int ret, gret = 0;
+	struct urcu_compat_futex_bucket *bucket = compat_futex_bucket(uaddr);
+	struct timespec abstime;
+	int ret, gret = 0, was_online = 0;
 
 	/*
 	 * Check if NULL. Don't let users expect that they are taken into
 	 * account. 
 	 */
-	assert(!timeout);
 	assert(!uaddr2);
 	assert(!val3);
 
@@ -68,43 +98,71 @@ int compat_futex_noasync(int32_t *uaddr, int op, int32_t val,
 	 */
 	cmm_smp_mb();
 
-	ret = pthread_mutex_lock(&__urcu_compat_futex_lock);
+	/*
+	 * Go offline before taking the bucket lock: doing so may wake up
+	 * a grace period through this bucket.
+	 */
+	if (op == FUTEX_WAIT)
+		was_online = urcu_blocking_begin();
+	ret = pthread_mutex_lock(&bucket->lock);
 	assert(!ret);
 	switch (op) {
 	case FUTEX_WAIT:
 		if (*uaddr != val)
 			goto end;
-		pthread_cond_wait(&__urcu_compat_futex_cond, &__urcu_compat_futex_lock);
+		if (!timeout) {
+			pthread_cond_wait(&bucket->cond, &bucket->lock);
+			break;
+		}
+		/* pthread_cond_timedwait() expects a CLOCK_REALTIME deadline. */
+		ret = clock_gettime(CLOCK_REALTIME, &abstime);
+		assert(!ret);
+		abstime.tv_sec += timeout->tv_sec;
+		abstime.tv_nsec += timeout->tv_nsec;
+		if (abstime.tv_nsec >= 1000000000L) {
+			abstime.tv_sec++;
+			abstime.tv_nsec -= 1000000000L;
+		}
+		if (pthread_cond_timedwait(&bucket->cond, &bucket->lock,
+				&abstime) == ETIMEDOUT)
+			gret = -ETIMEDOUT;
 		break;
 	case FUTEX_WAKE:
-		pthread_cond_broadcast(&__urcu_compat_futex_cond);
+		/* Other addresses may share the bucket: wake them all. */
+		pthread_cond_broadcast(&bucket->cond);
 		break;
 	default:
 		gret = -EINVAL;
 	}
 end:
-	ret = pthread_mutex_unlock(&__urcu_compat_futex_lock);
+	ret = pthread_mutex_unlock(&bucket->lock);
 	assert(!ret);
+	urcu_blocking_end(was_online);
 	return gret;
 }
 
 /*
  * _ASYNC SIGNAL-SAFE_.
- * For now, timeout, uaddr2 and val3 are unused.
+ * For now, uaddr2 and val3 are unused. As for sys_futex, timeout is
+ * relative, and -ETIMEDOUT is returned when it expires.
  * Waiter will busy-loop trying to read the condition.
  */
 
 int compat_futex_async(int32_t *uaddr, int op, int32_t val,
 	const struct timespec *timeout, int32_t *uaddr2, int32_t val3)
 {
+	long wait_ms = 0;
+
 	/*
 	 * Check if NULL. Don't let users expect that they are taken into
 	 * account. 
 	 */
-	assert(!timeout);
 	assert(!uaddr2);
 	assert(!val3);
 
+	if (timeout)
+		wait_ms = timeout->tv_sec * 1000
+			+ (timeout->tv_nsec + 999999) / 1000000;
 	/*
 	 * Ensure previous memory operations on uaddr have completed.
 	 */
@@ -112,9 +170,28 @@ int compat_futex_async(int32_t *uaddr, int op, int32_t val,
 
 	switch (op) {
 	case FUTEX_WAIT:
-		while (*uaddr == val)
-			poll(NULL, 0, 10);
-		break;
+	{
+		int was_online = 0, ret = 0;
+
+		if (*uaddr == val)
+			was_online = urcu_blocking_begin();
+		while (*uaddr == val) {
+			long delay_ms = 10;
+
+			if (timeout) {
+				if (!wait_ms) {
+					ret = -ETIMEDOUT;
+					break;
+				}
+				if (wait_ms < delay_ms)
+					delay_ms = wait_ms;
+				wait_ms -= delay_ms;
+			}
+			poll(NULL, 0, delay_ms);
+		}
+		urcu_blocking_end(was_online);
+		return ret;
+	}
 	case FUTEX_WAKE:
 		break;
 	default:
@@ -0,0 +1,376 @@
+/*
+ * freelist.c
+ *
+ * Userspace RCU library - scalable free list over lock-free stacks
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "config.h"
+#include <urcu/compiler.h>
+#include <urcu/uatomic.h>
+#include <urcu/list.h>
+#include <urcu/lfstack.h>
+#include <urcu/freelist.h>
+#include "urcu-die.h"
+
+struct freelist_magazine {
+	struct cds_lfs_node node;	/* in a depot stack */
+	unsigned int nr;
+	void *obj[];
+};
+
+/*
+ * Magazines of a thread, the value of the free list pthread key. The
+ * loaded magazine is used first, the previous one once the loaded one
+ * is empty (get) or full (put), so that a thread alternating gets and
+ * puts at a magazine boundary does not go back and forth to the depot.
+ */
+struct freelist_cache {
+	struct cds_freelist *fl;
+	struct freelist_magazine *loaded;
+	struct freelist_magazine *prev;
+	struct cds_list_head node;	/* in fl->caches */
+};
+
+struct cds_freelist {
+	struct __cds_lfs_stack full;	/* non-empty magazines */
+	struct __cds_lfs_stack empty;	/* empty magazines */
+	unsigned int magazine_size;
+	pthread_key_t key;
+
+	/* Statistics, updated on depot exchanges only. */
+	unsigned long nr_full;
+	unsigned long nr_empty;
+	unsigned long nr_magazines;
+	unsigned long nr_depot_get;
+	unsigned long nr_depot_put;
+	unsigned long nr_depot_miss;
+
+	pthread_mutex_t lock;		/* protects caches */
+	struct cds_list_head caches;	/* freelist_cache of each thread */
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+/*
+ * Same as cds_lfs_push(), for a chain of nodes linked from first to
+ * last.
+ */
+static
+void depot_push_chain(struct __cds_lfs_stack *s, struct cds_lfs_node *first,
+		struct cds_lfs_node *last)
+{
+	struct cds_lfs_head *head = NULL;
+	struct cds_lfs_head *new_head =
+		caa_container_of(first, struct cds_lfs_head, node);
+
+	for (;;) {
+		struct cds_lfs_head *old_head = head;
+
+		last->next = &head->node;
+		head = uatomic_cmpxchg(&s->head, old_head, new_head);
+		if (old_head == head)
+			break;
+	}
+}
+
+/*
+ * Take the top magazine of a depot stack: take the whole stack, which
+ * needs no synchronization with the other takers, and push the rest
+ * back with a single exchange. Other takers find the stack empty in
+ * the meantime.
+ */
+static
+struct freelist_magazine *depot_take(struct __cds_lfs_stack *s)
+{
+	struct cds_lfs_head *head;
+	struct cds_lfs_node *rest, *last;
+
+	head = __cds_lfs_pop_all(s);
+	if (!head)
+		return NULL;
+	rest = head->node.next;
+	if (rest) {
+		for (last = rest; last->next; last = last->next)
+			;
+		depot_push_chain(s, rest, last);
+	}
+	return caa_container_of(&head->node, struct freelist_magazine, node);
+}
+
+static
+void depot_give(struct cds_freelist *fl, struct freelist_magazine *mag)
+{
+	if (mag->nr) {
+		uatomic_inc(&fl->nr_full);
+		(void) cds_lfs_push(&fl->full, &mag->node);
+	} else {
+		uatomic_inc(&fl->nr_empty);
+		(void) cds_lfs_push(&fl->empty, &mag->node);
+	}
+}
+
+static
+struct freelist_magazine *depot_take_empty(struct cds_freelist *fl)
+{
+	struct freelist_magazine *mag;
+
+	mag = depot_take(&fl->empty);
+	if (mag) {
+		uatomic_dec(&fl->nr_empty);
+		return mag;
+	}
+	mag = malloc(sizeof(*mag) + fl->magazine_size * sizeof(mag->obj[0]));
+	if (!mag)
+		return NULL;
+	mag->nr = 0;
+	uatomic_inc(&fl->nr_magazines);
+	return mag;
+}
+
+static
+void freelist_cache_flush(struct freelist_cache *cache)
+{
+	if (cache->loaded) {
+		depot_give(cache->fl, cache->loaded);
+		cache->loaded = NULL;
+	}
+	if (cache->prev) {
+		depot_give(cache->fl, cache->prev);
+		cache->prev = NULL;
+	}
+}
+
+static
+void freelist_thread_exit(void *arg)
+{
+	struct freelist_cache *cache = arg;
+	struct cds_freelist *fl = cache->fl;
+
+	freelist_cache_flush(cache);
+	mutex_lock(&fl->lock);
+	cds_list_del(&cache->node);
+	mutex_unlock(&fl->lock);
+	free(cache);
+}
+
+static
+struct freelist_cache *freelist_get_cache(struct cds_freelist *fl)
+{
+	struct freelist_cache *cache;
+	int ret;
+
+	cache = pthread_getspecific(fl->key);
+	if (caa_likely(cache))
+		return cache;
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+	cache->fl = fl;
+	ret = pthread_setspecific(fl->key, cache);
+	if (ret) {
+		free(cache);
+		return NULL;
+	}
+	mutex_lock(&fl->lock);
+	cds_list_add(&cache->node, &fl->caches);
+	mutex_unlock(&fl->lock);
+	return cache;
+}
+
+struct cds_freelist *cds_freelist_create(unsigned int magazine_size)
+{
+	struct cds_freelist *fl;
+	int ret;
+
+	fl = calloc(1, sizeof(*fl));
+	if (!fl)
+		return NULL;
+	ret = pthread_key_create(&fl->key, freelist_thread_exit);
+	if (ret) {
+		free(fl);
+		return NULL;
+	}
+	ret = pthread_mutex_init(&fl->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	__cds_lfs_init(&fl->full);
+	__cds_lfs_init(&fl->empty);
+	fl->magazine_size = magazine_size ? magazine_size :
+		CDS_FREELIST_MAGAZINE_SIZE;
+	CDS_INIT_LIST_HEAD(&fl->caches);
+	return fl;
+}
+
+static
+void magazine_free(struct freelist_magazine *mag,
+		void (*free_obj)(void *obj, void *priv), void *priv)
+{
+	unsigned int i;
+
+	if (!mag)
+		return;
+	if (free_obj) {
+		for (i = 0; i < mag->nr; i++)
+			free_obj(mag->obj[i], priv);
+	}
+	free(mag);
+}
+
+static
+void depot_free(struct __cds_lfs_stack *s,
+		void (*free_obj)(void *obj, void *priv), void *priv)
+{
+	struct cds_lfs_head *head;
+	struct cds_lfs_node *node, *next;
+
+	head = __cds_lfs_pop_all(s);
+	cds_lfs_for_each_safe(head, node, next)
+		magazine_free(caa_container_of(node,
+				struct freelist_magazine, node),
+			free_obj, priv);
+}
+
+void cds_freelist_destroy(struct cds_freelist *fl,
+		void (*free_obj)(void *obj, void *priv), void *priv)
+{
+	struct freelist_cache *cache, *tmp;
+	int ret;
+
+	ret = pthread_key_delete(fl->key);
+	if (ret)
+		urcu_die(ret);
+	cds_list_for_each_entry_safe(cache, tmp, &fl->caches, node) {
+		magazine_free(cache->loaded, free_obj, priv);
+		magazine_free(cache->prev, free_obj, priv);
+		free(cache);
+	}
+	depot_free(&fl->full, free_obj, priv);
+	depot_free(&fl->empty, free_obj, priv);
+	ret = pthread_mutex_destroy(&fl->lock);
+	if (ret)
+		urcu_die(ret);
+	free(fl);
+}
+
+void *cds_freelist_get(struct cds_freelist *fl)
+{
+	struct freelist_cache *cache;
+	struct freelist_magazine *mag, *full;
+
+	cache = freelist_get_cache(fl);
+	if (caa_unlikely(!cache))
+		return NULL;
+	mag = cache->loaded;
+	if (caa_likely(mag && mag->nr))
+		return mag->obj[--mag->nr];
+	if (cache->prev && cache->prev->nr) {
+		cache->loaded = cache->prev;
+		cache->prev = mag;
+		mag = cache->loaded;
+		return mag->obj[--mag->nr];
+	}
+
+	/* Both empty: trade the previous one for a depot magazine. */
+	full = depot_take(&fl->full);
+	if (!full) {
+		uatomic_inc(&fl->nr_depot_miss);
+		return NULL;
+	}
+	uatomic_dec(&fl->nr_full);
+	uatomic_inc(&fl->nr_depot_get);
+	if (cache->prev)
+		depot_give(fl, cache->prev);
+	cache->prev = mag;
+	cache->loaded = full;
+	return full->obj[--full->nr];
+}
+
+int cds_freelist_put(struct cds_freelist *fl, void *obj)
+{
+	struct freelist_cache *cache;
+	struct freelist_magazine *mag, *empty;
+
+	cache = freelist_get_cache(fl);
+	if (caa_unlikely(!cache))
+		return -ENOMEM;
+	mag = cache->loaded;
+	if (caa_likely(mag && mag->nr < fl->magazine_size)) {
+		mag->obj[mag->nr++] = obj;
+		return 0;
+	}
+	if (cache->prev && cache->prev->nr < fl->magazine_size) {
+		cache->loaded = cache->prev;
+		cache->prev = mag;
+		mag = cache->loaded;
+		mag->obj[mag->nr++] = obj;
+		return 0;
+	}
+
+	/* Both full (or missing): trade the previous one for an empty one. */
+	empty = depot_take_empty(fl);
+	if (!empty)
+		return -ENOMEM;
+	if (cache->prev) {
+		uatomic_inc(&fl->nr_depot_put);
+		depot_give(fl, cache->prev);
+	}
+	cache->prev = mag;
+	cache->loaded = empty;
+	empty->obj[empty->nr++] = obj;
+	return 0;
+}
+
+void cds_freelist_flush(struct cds_freelist *fl)
+{
+	struct freelist_cache *cache;
+
+	cache = pthread_getspecific(fl->key);
+	if (cache)
+		freelist_cache_flush(cache);
+}
+
+void cds_freelist_get_stats(struct cds_freelist *fl,
+		struct cds_freelist_stats *stats)
+{
+	stats->nr_full = uatomic_read(&fl->nr_full);
+	stats->nr_empty = uatomic_read(&fl->nr_empty);
+	stats->nr_magazines = uatomic_read(&fl->nr_magazines);
+	stats->nr_depot_get = uatomic_read(&fl->nr_depot_get);
+	stats->nr_depot_put = uatomic_read(&fl->nr_depot_put);
+	stats->nr_depot_miss = uatomic_read(&fl->nr_depot_miss);
+}
@@ -0,0 +1,59 @@
+/*
+ * lfring.c
+ *
+ * Userspace RCU library - Bounded Lock-Free MPMC Ring Buffer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
+#undef _LGPL_SOURCE
+#include "urcu/lfring.h"
+#define _LGPL_SOURCE
+#include "urcu/static/lfring.h"
+
+/*
+ * library wrappers to be used by non-LGPL compatible source code.
+ */
+
+int cds_lfring_init(struct cds_lfring *ring, unsigned long size)
+{
+	return _cds_lfring_init(ring, size);
+}
+
+void cds_lfring_destroy(struct cds_lfring *ring)
+{
+	_cds_lfring_destroy(ring);
+}
+
+bool cds_lfring_enqueue(struct cds_lfring *ring, void *data)
+{
+	return _cds_lfring_enqueue(ring, data);
+}
+
+void *cds_lfring_dequeue(struct cds_lfring *ring)
+{
+	return _cds_lfring_dequeue(ring);
+}
+
+bool cds_lfring_empty(struct cds_lfring *ring)
+{
+	return _cds_lfring_empty(ring);
+}
+
+unsigned long cds_lfring_size(struct cds_lfring *ring)
+{
+	return _cds_lfring_size(ring);
+}
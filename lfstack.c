@@ -84,3 +84,31 @@ struct cds_lfs_head *__cds_lfs_pop_all(cds_lfs_stack_ptr_t s)
 {
 	return ___cds_lfs_pop_all(s);
 }
+
+#ifdef UATOMIC_HAS_CMPXCHG_DOUBLE
+void cds_lfs_tagged_init(struct cds_lfs_tagged_stack *s)
+{
+	_cds_lfs_tagged_init(s);
+}
+
+bool cds_lfs_tagged_empty(struct cds_lfs_tagged_stack *s)
+{
+	return _cds_lfs_tagged_empty(s);
+}
+
+bool cds_lfs_tagged_push(struct cds_lfs_tagged_stack *s,
+		struct cds_lfs_node *node)
+{
+	return _cds_lfs_tagged_push(s, node);
+}
+
+struct cds_lfs_node *cds_lfs_tagged_pop(struct cds_lfs_tagged_stack *s)
+{
+	return _cds_lfs_tagged_pop(s);
+}
+
+struct cds_lfs_head *cds_lfs_tagged_pop_all(struct cds_lfs_tagged_stack *s)
+{
+	return _cds_lfs_tagged_pop_all(s);
+}
+#endif
@@ -0,0 +1,221 @@
+/*
+ * percpu-ref.c
+ *
+ * Userspace RCU library - per-CPU reference counter
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "config.h"
+#include <urcu/rseq.h>
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+#include <urcu/compiler.h>
+#include <urcu/percpu-ref.h>
+
+/*
+ * Until the switch to atomic mode completes, the atomic count holds
+ * the bias on top of the references taken in atomic mode, so that
+ * puts of references taken on a per-CPU counter cannot bring it to
+ * zero. The bias is removed, and the per-CPU sums added, by the
+ * call_rcu callback.
+ */
+#define PERCPU_REF_BIAS		(1UL << (CAA_BITS_PER_LONG - 1))
+
+/* Number of per-CPU counters when the number of CPUs is unknown. */
+#define PERCPU_REF_DEFAULT_MASK	0xFUL
+
+struct urcu_percpu_ref_count {
+	unsigned long count;
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+static pthread_mutex_t percpu_ref_init_mutex = PTHREAD_MUTEX_INITIALIZER;
+static long percpu_ref_mask = -1;
+
+/*
+ * Per-CPU counters updated with restartable sequences rather than
+ * atomic instructions. Only enabled when each possible CPU has its own
+ * counter and the rseq area is registered, so a counter is never
+ * updated with both methods.
+ */
+#ifdef URCU_HAVE_RSEQ_PERCPU
+static int percpu_ref_rseq;
+#endif
+
+static void percpu_ref_init_mask(void)
+{
+	long maxcpus = -1;
+
+	pthread_mutex_lock(&percpu_ref_init_mutex);
+	if (percpu_ref_mask >= 0)
+		goto end;
+#if defined(HAVE_SYSCONF)
+	maxcpus = sysconf(_SC_NPROCESSORS_CONF);
+#endif
+	if (maxcpus <= 0) {
+		percpu_ref_mask = PERCPU_REF_DEFAULT_MASK;
+	} else {
+		unsigned long size = 1;
+
+		while (size < (unsigned long) maxcpus)
+			size <<= 1;
+		percpu_ref_mask = size - 1;
+#ifdef URCU_HAVE_RSEQ_PERCPU
+		percpu_ref_rseq = !!__rseq_size;
+#endif
+	}
+end:
+	pthread_mutex_unlock(&percpu_ref_init_mutex);
+}
+
+static unsigned long percpu_ref_index(void)
+{
+	int cpu;
+
+	cpu = urcu_rseq_cpu_id();
+#if defined(HAVE_SCHED_GETCPU)
+	if (caa_unlikely(cpu < 0))
+		cpu = sched_getcpu();
+#endif
+	if (caa_unlikely(cpu < 0))
+		return ((unsigned long) pthread_self() >> 8) & percpu_ref_mask;
+	return (unsigned long) cpu & percpu_ref_mask;
+}
+
+static void percpu_ref_count_add(struct urcu_percpu_ref *ref,
+		unsigned long v)
+{
+#ifdef URCU_HAVE_RSEQ_PERCPU
+	if (caa_likely(percpu_ref_rseq)) {
+		unsigned long newv;
+		int cpu;
+
+		do {
+			cpu = urcu_rseq_cpu_start();
+		} while (caa_unlikely(urcu_rseq_add_return(
+				&ref->percpu_count[cpu].count, v, cpu, &newv)));
+		return;
+	}
+#endif
+	uatomic_add(&ref->percpu_count[percpu_ref_index()].count, v);
+}
+
+int _urcu_percpu_ref_init(struct urcu_percpu_ref *ref,
+		void (*release)(struct urcu_percpu_ref *ref),
+		const struct rcu_flavor_struct *flavor)
+{
+	if (caa_unlikely(percpu_ref_mask < 0))
+		percpu_ref_init_mask();
+	if (posix_memalign((void **) &ref->percpu_count, CAA_CACHE_LINE_SIZE,
+			(percpu_ref_mask + 1) * sizeof(*ref->percpu_count)))
+		return -ENOMEM;
+	memset(ref->percpu_count, 0,
+		(percpu_ref_mask + 1) * sizeof(*ref->percpu_count));
+	ref->atomic_count = 1 + PERCPU_REF_BIAS;
+	ref->dead = 0;
+	ref->release = release;
+	ref->flavor = flavor;
+	return 0;
+}
+
+void urcu_percpu_ref_exit(struct urcu_percpu_ref *ref)
+{
+	free(ref->percpu_count);
+	ref->percpu_count = NULL;
+}
+
+void urcu_percpu_ref_get(struct urcu_percpu_ref *ref)
+{
+	ref->flavor->read_lock();
+	if (caa_likely(!CMM_LOAD_SHARED(ref->dead)))
+		percpu_ref_count_add(ref, 1);
+	else
+		uatomic_inc(&ref->atomic_count);
+	ref->flavor->read_unlock();
+}
+
+bool urcu_percpu_ref_tryget_live(struct urcu_percpu_ref *ref)
+{
+	bool ret = false;
+
+	ref->flavor->read_lock();
+	if (caa_likely(!CMM_LOAD_SHARED(ref->dead))) {
+		percpu_ref_count_add(ref, 1);
+		ret = true;
+	}
+	ref->flavor->read_unlock();
+	return ret;
+}
+
+void urcu_percpu_ref_put(struct urcu_percpu_ref *ref)
+{
+	int release = 0;
+
+	ref->flavor->read_lock();
+	if (caa_likely(!CMM_LOAD_SHARED(ref->dead)))
+		percpu_ref_count_add(ref, -1UL);
+	else if (!uatomic_sub_return(&ref->atomic_count, 1))
+		release = 1;
+	ref->flavor->read_unlock();
+	if (release)
+		ref->release(ref);
+}
+
+/*
+ * Called after a grace period following the switch to atomic mode:
+ * every get and put which saw the counter live has completed, and no
+ * per-CPU counter is updated anymore.
+ */
+static void percpu_ref_switch_to_atomic_rcu(struct rcu_head *head)
+{
+	struct urcu_percpu_ref *ref =
+		caa_container_of(head, struct urcu_percpu_ref, rcu_head);
+	unsigned long sum = 0;
+	long i;
+
+	for (i = 0; i <= percpu_ref_mask; i++)
+		sum += CMM_LOAD_SHARED(ref->percpu_count[i].count);
+	/* Remove the bias, and drop the initial reference. */
+	if (!uatomic_add_return(&ref->atomic_count,
+			sum - PERCPU_REF_BIAS - 1))
+		ref->release(ref);
+}
+
+void urcu_percpu_ref_kill(struct urcu_percpu_ref *ref)
+{
+	assert(!ref->dead);
+	/*
+	 * The full memory barriers of the grace period order this store
+	 * before the per-CPU counters are summed by the callback.
+	 */
+	CMM_STORE_SHARED(ref->dead, 1);
+	ref->flavor->update_call_rcu(&ref->rcu_head,
+			percpu_ref_switch_to_atomic_rcu);
+}
+
+bool urcu_percpu_ref_is_dying(struct urcu_percpu_ref *ref)
+{
+	return CMM_LOAD_SHARED(ref->dead);
+}
@@ -0,0 +1,350 @@
+/*
+ * percpu-rwsem.c
+ *
+ * Userspace RCU library - per-CPU reader/writer semaphore
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "config.h"
+#include <urcu/rseq.h>
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+#include <urcu/compiler.h>
+#include <urcu/percpu-rwsem.h>
+#include "urcu-die.h"
+
+/* Number of per-CPU counters when the number of CPUs is unknown. */
+#define PERCPU_RWSEM_DEFAULT_MASK	0xFUL
+
+/*
+ * States of the fast path switch, as the Linux kernel rcu_sync:
+ * IDLE: readers use the fast path.
+ * ENTER: the first writer switched readers to the slow path, and waits
+ *        for a grace period.
+ * PASSED: no reader uses the fast path.
+ * EXIT: the last writer left, the callback switching readers back to
+ *       the fast path is queued.
+ * REPLAY: as EXIT, but writers came and left meanwhile: the callback
+ *         waits for another grace period.
+ */
+enum percpu_rwsem_gp_state {
+	GP_IDLE = 0,
+	GP_ENTER,
+	GP_PASSED,
+	GP_EXIT,
+	GP_REPLAY,
+};
+
+struct urcu_percpu_rwsem_count {
+	unsigned long count;
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+static pthread_mutex_t percpu_rwsem_init_mutex = PTHREAD_MUTEX_INITIALIZER;
+static long percpu_rwsem_mask = -1;
+
+/*
+ * Per-CPU counters updated with restartable sequences rather than
+ * atomic instructions, under the same conditions as urcu_percpu_ref.
+ */
+#ifdef URCU_HAVE_RSEQ_PERCPU
+static int percpu_rwsem_rseq;
+#endif
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_cond_wait(cond, mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void cond_broadcast(pthread_cond_t *cond)
+{
+	int ret;
+
+	ret = pthread_cond_broadcast(cond);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void percpu_rwsem_init_mask(void)
+{
+	long maxcpus = -1;
+
+	mutex_lock(&percpu_rwsem_init_mutex);
+	if (percpu_rwsem_mask >= 0)
+		goto end;
+#if defined(HAVE_SYSCONF)
+	maxcpus = sysconf(_SC_NPROCESSORS_CONF);
+#endif
+	if (maxcpus <= 0) {
+		percpu_rwsem_mask = PERCPU_RWSEM_DEFAULT_MASK;
+	} else {
+		unsigned long size = 1;
+
+		while (size < (unsigned long) maxcpus)
+			size <<= 1;
+		percpu_rwsem_mask = size - 1;
+#ifdef URCU_HAVE_RSEQ_PERCPU
+		percpu_rwsem_rseq = !!__rseq_size;
+#endif
+	}
+end:
+	mutex_unlock(&percpu_rwsem_init_mutex);
+}
+
+static unsigned long percpu_rwsem_index(void)
+{
+	int cpu;
+
+	cpu = urcu_rseq_cpu_id();
+#if defined(HAVE_SCHED_GETCPU)
+	if (caa_unlikely(cpu < 0))
+		cpu = sched_getcpu();
+#endif
+	if (caa_unlikely(cpu < 0))
+		return ((unsigned long) pthread_self() >> 8) & percpu_rwsem_mask;
+	return (unsigned long) cpu & percpu_rwsem_mask;
+}
+
+/*
+ * A reader may be migrated between down and up: only the sum of the
+ * counters is meaningful.
+ */
+static void percpu_rwsem_count_add(struct urcu_percpu_rwsem *sem,
+		unsigned long v)
+{
+#ifdef URCU_HAVE_RSEQ_PERCPU
+	if (caa_likely(percpu_rwsem_rseq)) {
+		unsigned long newv;
+		int cpu;
+
+		do {
+			cpu = urcu_rseq_cpu_start();
+		} while (caa_unlikely(urcu_rseq_add_return(
+				&sem->read_count[cpu].count, v, cpu, &newv)));
+		return;
+	}
+#endif
+	uatomic_add(&sem->read_count[percpu_rwsem_index()].count, v);
+}
+
+static unsigned long percpu_rwsem_count_sum(struct urcu_percpu_rwsem *sem)
+{
+	unsigned long sum = 0;
+	long i;
+
+	for (i = 0; i <= percpu_rwsem_mask; i++)
+		sum += CMM_LOAD_SHARED(sem->read_count[i].count);
+	return sum;
+}
+
+int _urcu_percpu_rwsem_init(struct urcu_percpu_rwsem *sem,
+		const struct rcu_flavor_struct *flavor)
+{
+	if (caa_unlikely(percpu_rwsem_mask < 0))
+		percpu_rwsem_init_mask();
+	if (posix_memalign((void **) &sem->read_count, CAA_CACHE_LINE_SIZE,
+			(percpu_rwsem_mask + 1) * sizeof(*sem->read_count)))
+		return -ENOMEM;
+	memset(sem->read_count, 0,
+		(percpu_rwsem_mask + 1) * sizeof(*sem->read_count));
+	sem->slow = 0;
+	sem->writer = 0;
+	sem->gp_state = GP_IDLE;
+	sem->nr_writers = 0;
+	pthread_mutex_init(&sem->sync_lock, NULL);
+	pthread_cond_init(&sem->sync_cond, NULL);
+	pthread_mutex_init(&sem->writer_lock, NULL);
+	pthread_mutex_init(&sem->wait_lock, NULL);
+	pthread_cond_init(&sem->reader_cond, NULL);
+	pthread_cond_init(&sem->drain_cond, NULL);
+	sem->flavor = flavor;
+	return 0;
+}
+
+void urcu_percpu_rwsem_destroy(struct urcu_percpu_rwsem *sem)
+{
+	/* The callback can queue itself again: wait until it is done. */
+	for (;;) {
+		int state;
+
+		mutex_lock(&sem->sync_lock);
+		state = sem->gp_state;
+		mutex_unlock(&sem->sync_lock);
+		if (state == GP_IDLE)
+			break;
+		sem->flavor->barrier();
+	}
+	pthread_mutex_destroy(&sem->sync_lock);
+	pthread_cond_destroy(&sem->sync_cond);
+	pthread_mutex_destroy(&sem->writer_lock);
+	pthread_mutex_destroy(&sem->wait_lock);
+	pthread_cond_destroy(&sem->reader_cond);
+	pthread_cond_destroy(&sem->drain_cond);
+	free(sem->read_count);
+	sem->read_count = NULL;
+}
+
+void urcu_percpu_rwsem_down_read(struct urcu_percpu_rwsem *sem)
+{
+	sem->flavor->read_lock();
+	if (caa_likely(!CMM_LOAD_SHARED(sem->slow))) {
+		percpu_rwsem_count_add(sem, 1);
+		sem->flavor->read_unlock();
+		/* Order the critical section after the increment. */
+		cmm_smp_mb();
+		return;
+	}
+	sem->flavor->read_unlock();
+
+	mutex_lock(&sem->wait_lock);
+	while (sem->writer)
+		cond_wait(&sem->reader_cond, &sem->wait_lock);
+	percpu_rwsem_count_add(sem, 1);
+	mutex_unlock(&sem->wait_lock);
+}
+
+void urcu_percpu_rwsem_up_read(struct urcu_percpu_rwsem *sem)
+{
+	/* Order the critical section before the decrement. */
+	cmm_smp_mb();
+	sem->flavor->read_lock();
+	if (caa_likely(!CMM_LOAD_SHARED(sem->slow))) {
+		percpu_rwsem_count_add(sem, -1UL);
+		sem->flavor->read_unlock();
+		return;
+	}
+	sem->flavor->read_unlock();
+
+	percpu_rwsem_count_add(sem, -1UL);
+	/* A writer checks the sum with wait_lock held before waiting. */
+	mutex_lock(&sem->wait_lock);
+	if (sem->writer)
+		cond_broadcast(&sem->drain_cond);
+	mutex_unlock(&sem->wait_lock);
+}
+
+/*
+ * Switch readers back to the fast path, a grace period after the last
+ * writer left: readers seeing the fast path then also see the updates
+ * of the writers.
+ */
+static void percpu_rwsem_exit_rcu(struct rcu_head *head)
+{
+	struct urcu_percpu_rwsem *sem =
+		caa_container_of(head, struct urcu_percpu_rwsem, rcu_head);
+
+	mutex_lock(&sem->sync_lock);
+	if (sem->nr_writers) {
+		/* A writer came back: readers are still on the slow path. */
+		sem->gp_state = GP_PASSED;
+	} else if (sem->gp_state == GP_REPLAY) {
+		sem->gp_state = GP_EXIT;
+		sem->flavor->update_call_rcu(&sem->rcu_head,
+				percpu_rwsem_exit_rcu);
+	} else {
+		CMM_STORE_SHARED(sem->slow, 0);
+		sem->gp_state = GP_IDLE;
+	}
+	mutex_unlock(&sem->sync_lock);
+}
+
+static void percpu_rwsem_sync_enter(struct urcu_percpu_rwsem *sem)
+{
+	mutex_lock(&sem->sync_lock);
+	sem->nr_writers++;
+	if (sem->gp_state == GP_IDLE) {
+		sem->gp_state = GP_ENTER;
+		CMM_STORE_SHARED(sem->slow, 1);
+		mutex_unlock(&sem->sync_lock);
+		/* Every reader seeing the fast path has left it. */
+		sem->flavor->update_synchronize_rcu();
+		mutex_lock(&sem->sync_lock);
+		sem->gp_state = GP_PASSED;
+		cond_broadcast(&sem->sync_cond);
+	} else {
+		while (sem->gp_state == GP_ENTER)
+			cond_wait(&sem->sync_cond, &sem->sync_lock);
+	}
+	mutex_unlock(&sem->sync_lock);
+}
+
+static void percpu_rwsem_sync_exit(struct urcu_percpu_rwsem *sem)
+{
+	mutex_lock(&sem->sync_lock);
+	if (!--sem->nr_writers) {
+		if (sem->gp_state == GP_PASSED) {
+			sem->gp_state = GP_EXIT;
+			sem->flavor->update_call_rcu(&sem->rcu_head,
+					percpu_rwsem_exit_rcu);
+		} else if (sem->gp_state == GP_EXIT) {
+			sem->gp_state = GP_REPLAY;
+		}
+	}
+	mutex_unlock(&sem->sync_lock);
+}
+
+void urcu_percpu_rwsem_down_write(struct urcu_percpu_rwsem *sem)
+{
+	percpu_rwsem_sync_enter(sem);
+	mutex_lock(&sem->writer_lock);
+	mutex_lock(&sem->wait_lock);
+	sem->writer = 1;
+	/* New readers wait on reader_cond: drain the others. */
+	while (percpu_rwsem_count_sum(sem))
+		cond_wait(&sem->drain_cond, &sem->wait_lock);
+	mutex_unlock(&sem->wait_lock);
+	/* Order the reads of the counters before the critical section. */
+	cmm_smp_mb();
+}
+
+void urcu_percpu_rwsem_up_write(struct urcu_percpu_rwsem *sem)
+{
+	mutex_lock(&sem->wait_lock);
+	sem->writer = 0;
+	cond_broadcast(&sem->reader_cond);
+	mutex_unlock(&sem->wait_lock);
+	mutex_unlock(&sem->writer_lock);
+	percpu_rwsem_sync_exit(sem);
+}
@@ -0,0 +1,188 @@
+/*
+ * pubset.c
+ *
+ * Userspace RCU library - atomic publication of a set of RCU pointers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <urcu/arch.h>
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu-pointer.h>
+#include <urcu/pubset.h>
+#include "urcu-die.h"
+
+/*
+ * The pointers of a generation are followed by nr entries only written
+ * by the updater which replaces that generation: the objects to free
+ * with it, NULL for the slots it kept, and for all but the first slot
+ * of an object stored in several slots.
+ */
+static void **gen_retired(struct cds_pubset_gen *gen)
+{
+	return &gen->ptr[gen->nr];
+}
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static struct cds_pubset_gen *gen_alloc(struct cds_pubset *set)
+{
+	struct cds_pubset_gen *gen;
+
+	gen = calloc(1, sizeof(*gen) + 2 * set->nr * sizeof(void *));
+	if (!gen)
+		return NULL;
+	gen->set = set;
+	gen->nr = set->nr;
+	return gen;
+}
+
+static void gen_free(struct cds_pubset_gen *gen, void **objs)
+{
+	struct cds_pubset *set = gen->set;
+	unsigned int i;
+
+	if (set->free_ptr) {
+		for (i = 0; i < gen->nr; i++) {
+			if (objs[i])
+				set->free_ptr(i, objs[i]);
+		}
+	}
+	free(gen);
+}
+
+static void gen_free_rcu(struct rcu_head *head)
+{
+	struct cds_pubset_gen *gen =
+		caa_container_of(head, struct cds_pubset_gen, head);
+
+	gen_free(gen, gen_retired(gen));
+}
+
+int _cds_pubset_init(struct cds_pubset *set, unsigned int nr,
+		cds_pubset_free_fct free_ptr,
+		const struct rcu_flavor_struct *flavor)
+{
+	int ret;
+
+	memset(set, 0, sizeof(*set));
+	set->nr = nr;
+	set->free_ptr = free_ptr;
+	set->flavor = flavor;
+	set->gen = gen_alloc(set);
+	if (!set->gen)
+		return -ENOMEM;
+	ret = pthread_mutex_init(&set->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	return 0;
+}
+
+/* First slot of the generation holding the object, nr if none. */
+static unsigned int gen_find(struct cds_pubset_gen *gen, void *p)
+{
+	unsigned int i;
+
+	for (i = 0; i < gen->nr; i++) {
+		if (gen->ptr[i] == p)
+			break;
+	}
+	return i;
+}
+
+/*
+ * Record the objects to free with generation old, replaced by gen:
+ * the ones gen does not contain (all of them if gen is NULL), each
+ * once.
+ */
+static void gen_retire(struct cds_pubset_gen *old, struct cds_pubset_gen *gen)
+{
+	void **retired = gen_retired(old);
+	unsigned int i;
+
+	for (i = 0; i < old->nr; i++) {
+		void *p = old->ptr[i];
+
+		if (p && gen_find(old, p) != i)
+			p = NULL;
+		if (p && gen && gen_find(gen, p) != gen->nr)
+			p = NULL;
+		retired[i] = p;
+	}
+}
+
+void cds_pubset_destroy(struct cds_pubset *set)
+{
+	int ret;
+
+	gen_retire(set->gen, NULL);
+	gen_free(set->gen, gen_retired(set->gen));
+	ret = pthread_mutex_destroy(&set->lock);
+	if (ret)
+		urcu_die(ret);
+}
+
+struct cds_pubset_gen *cds_pubset_update_begin(struct cds_pubset *set)
+{
+	struct cds_pubset_gen *gen;
+
+	gen = gen_alloc(set);
+	if (!gen)
+		return NULL;
+	mutex_lock(&set->lock);
+	gen->version = set->gen->version + 1;
+	memcpy(gen->ptr, set->gen->ptr, set->nr * sizeof(void *));
+	return gen;
+}
+
+void cds_pubset_update_commit(struct cds_pubset_gen *gen)
+{
+	struct cds_pubset *set = gen->set;
+	struct cds_pubset_gen *old = set->gen;
+
+	gen_retire(old, gen);
+	rcu_assign_pointer(set->gen, gen);
+	mutex_unlock(&set->lock);
+	set->flavor->update_call_rcu(&old->head, gen_free_rcu);
+}
+
+void cds_pubset_update_abort(struct cds_pubset_gen *gen)
+{
+	mutex_unlock(&gen->set->lock);
+	free(gen);
+}
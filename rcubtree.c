@@ -0,0 +1,445 @@
+/*
+ * rcubtree.c
+ *
+ * Userspace RCU library - RCU B-tree (ordered map)
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <urcu-pointer.h>
+#include <urcu/rcubtree.h>
+#include "urcu-die.h"
+
+/*
+ * Nodes other than the root hold at least BT_MIN_ENTRIES entries:
+ * removals merge or rebalance smaller nodes with a sibling.
+ */
+#define BT_MIN_ENTRIES		(CDS_BT_ORDER / 4)
+
+/*
+ * Entry i of a leaf (level 0) has key[i] and points to a struct
+ * cds_bt_node, entry i of an interior node points to a child of the
+ * level below, and key[i] is the smallest key of that child subtree.
+ * Keys are sorted. Published nodes are immutable.
+ */
+struct cds_bt_inode {
+	unsigned int level;
+	unsigned int nr;
+	unsigned long key[CDS_BT_ORDER];
+	void *ptr[CDS_BT_ORDER];
+	struct rcu_head head;
+};
+
+/*
+ * Entries of a node being rebuilt by an update, which may temporarily
+ * exceed what a node can hold.
+ */
+struct bt_entries {
+	unsigned int nr;
+	unsigned long key[2 * CDS_BT_ORDER];
+	void *ptr[2 * CDS_BT_ORDER];
+};
+
+/*
+ * Nodes allocated and replaced by an update: each level replaces at
+ * most 2 nodes with at most 2 nodes, and a root split allocates 3.
+ */
+#define BT_MAX_UPDATE_NODES	(2 * CDS_BT_MAX_HEIGHT + 3)
+
+struct bt_update {
+	struct cds_bt_inode *alloc[BT_MAX_UPDATE_NODES];
+	unsigned int nr_alloc;
+	struct cds_bt_inode *old[BT_MAX_UPDATE_NODES];
+	unsigned int nr_old;
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+/* Index of the first key not smaller than key, nr if none. */
+static
+unsigned int bt_key_pos(const unsigned long *keys, unsigned int nr,
+		unsigned long key)
+{
+	unsigned int lo = 0, hi = nr;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) >> 1;
+
+		if (keys[mid] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Index of the child of an interior node whose subtree may hold key. */
+static
+unsigned int bt_child_pos(struct cds_bt_inode *inode, unsigned long key)
+{
+	unsigned int pos = bt_key_pos(inode->key, inode->nr, key);
+
+	if (pos < inode->nr && inode->key[pos] == key)
+		return pos;
+	return pos ? pos - 1 : 0;
+}
+
+static
+void free_inode_cb(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct cds_bt_inode, head));
+}
+
+static
+struct cds_bt_inode *bt_alloc(struct bt_update *update, unsigned int level,
+		const unsigned long *key, void * const *ptr, unsigned int nr)
+{
+	struct cds_bt_inode *inode;
+
+	assert(nr <= CDS_BT_ORDER);
+	assert(update->nr_alloc < BT_MAX_UPDATE_NODES);
+	inode = malloc(sizeof(*inode));
+	if (!inode)
+		return NULL;
+	inode->level = level;
+	inode->nr = nr;
+	memcpy(inode->key, key, nr * sizeof(*key));
+	memcpy(inode->ptr, ptr, nr * sizeof(*ptr));
+	update->alloc[update->nr_alloc++] = inode;
+	return inode;
+}
+
+static
+void bt_retire(struct bt_update *update, struct cds_bt_inode *inode)
+{
+	assert(update->nr_old < BT_MAX_UPDATE_NODES);
+	update->old[update->nr_old++] = inode;
+}
+
+static
+void bt_append(struct bt_entries *entries, const unsigned long *key,
+		void * const *ptr, unsigned int nr)
+{
+	memcpy(&entries->key[entries->nr], key, nr * sizeof(*key));
+	memcpy(&entries->ptr[entries->nr], ptr, nr * sizeof(*ptr));
+	entries->nr += nr;
+}
+
+/*
+ * Turn entries into zero, one, or two (split) new nodes of level, and
+ * append their entries to parent. Return -ENOMEM on allocation failure.
+ */
+static
+int bt_emit(struct bt_update *update, struct bt_entries *entries,
+		unsigned int level, struct bt_entries *parent)
+{
+	unsigned int start = 0, len;
+
+	while (start < entries->nr) {
+		struct cds_bt_inode *inode;
+
+		len = entries->nr - start;
+		if (entries->nr > CDS_BT_ORDER && !start)
+			len = entries->nr / 2;
+		inode = bt_alloc(update, level, &entries->key[start],
+				&entries->ptr[start], len);
+		if (!inode)
+			return -ENOMEM;
+		parent->key[parent->nr] = inode->key[0];
+		parent->ptr[parent->nr] = inode;
+		parent->nr++;
+		start += len;
+	}
+	return 0;
+}
+
+/*
+ * Replace the leaf of path[0] by the leaf entries "entries", copying
+ * the nodes of the path up to the root, and publish the new root.
+ * path[level] is the node of each level from the leaf to the root, and
+ * pos[level] the index of path[level - 1] in path[level].
+ */
+static
+int bt_commit(struct cds_bt *bt, struct cds_bt_inode **path,
+		unsigned int *pos, struct bt_entries *entries)
+{
+	struct bt_update update = { .nr_alloc = 0, .nr_old = 0 };
+	struct bt_entries buf, *cur = entries, *next = &buf, *tmp;
+	struct cds_bt_inode *root, *parent, *sib;
+	unsigned int height = bt->root->level, level, first, last, i;
+
+	bt_retire(&update, path[0]);
+	for (level = 0; level < height; level++) {
+		parent = path[level + 1];
+		i = pos[level + 1];
+		first = last = i;
+		/* Merge or rebalance with a sibling if too small. */
+		if (cur->nr && cur->nr < BT_MIN_ENTRIES && parent->nr > 1) {
+			if (i) {
+				first = i - 1;
+				sib = parent->ptr[first];
+				memmove(&cur->key[sib->nr], cur->key,
+					cur->nr * sizeof(*cur->key));
+				memmove(&cur->ptr[sib->nr], cur->ptr,
+					cur->nr * sizeof(*cur->ptr));
+				memcpy(cur->key, sib->key,
+					sib->nr * sizeof(*cur->key));
+				memcpy(cur->ptr, sib->ptr,
+					sib->nr * sizeof(*cur->ptr));
+				cur->nr += sib->nr;
+			} else {
+				last = i + 1;
+				sib = parent->ptr[last];
+				bt_append(cur, sib->key, sib->ptr, sib->nr);
+			}
+			bt_retire(&update, sib);
+		}
+		next->nr = 0;
+		bt_append(next, parent->key, parent->ptr, first);
+		if (bt_emit(&update, cur, level, next))
+			goto nomem;
+		bt_append(next, &parent->key[last + 1], &parent->ptr[last + 1],
+			parent->nr - last - 1);
+		bt_retire(&update, parent);
+		tmp = cur;
+		cur = next;
+		next = tmp;
+	}
+
+	if (cur->nr > CDS_BT_ORDER) {
+		/* Root split: grow the tree by one level. */
+		if (height + 1 >= CDS_BT_MAX_HEIGHT)
+			goto nomem;
+		next->nr = 0;
+		if (bt_emit(&update, cur, height, next))
+			goto nomem;
+		root = bt_alloc(&update, height + 1, next->key, next->ptr,
+				next->nr);
+	} else if (height && cur->nr == 1) {
+		/* Root with a single child: shrink the tree by one level. */
+		root = cur->ptr[0];
+	} else if (!cur->nr) {
+		root = bt_alloc(&update, 0, cur->key, cur->ptr, 0);
+	} else {
+		root = bt_alloc(&update, height, cur->key, cur->ptr, cur->nr);
+	}
+	if (!root)
+		goto nomem;
+
+	rcu_assign_pointer(bt->root, root);
+	for (i = 0; i < update.nr_old; i++)
+		bt->bt_call_rcu(&update.old[i]->head, free_inode_cb);
+	return 0;
+
+nomem:
+	/* Nothing was published. */
+	for (i = 0; i < update.nr_alloc; i++)
+		free(update.alloc[i]);
+	return -ENOMEM;
+}
+
+/*
+ * Walk down from the root to the leaf which may hold key, filling path
+ * and pos for bt_commit(). Called with the tree lock held.
+ */
+static
+struct cds_bt_inode *bt_walk(struct cds_bt *bt, unsigned long key,
+		struct cds_bt_inode **path, unsigned int *pos)
+{
+	struct cds_bt_inode *inode = bt->root;
+	unsigned int level;
+
+	for (level = inode->level; level > 0; level--) {
+		path[level] = inode;
+		pos[level] = bt_child_pos(inode, key);
+		inode = inode->ptr[pos[level]];
+	}
+	path[0] = inode;
+	return inode;
+}
+
+int cds_bt_init(struct cds_bt *bt,
+		void bt_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)))
+{
+	struct cds_bt_inode *root;
+	int ret;
+
+	root = calloc(1, sizeof(*root));
+	if (!root)
+		return -ENOMEM;
+	bt->root = root;
+	ret = pthread_mutex_init(&bt->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	bt->bt_call_rcu = bt_call_rcu;
+	return 0;
+}
+
+int cds_bt_destroy(struct cds_bt *bt)
+{
+	int ret;
+
+	if (bt->root->nr)
+		return -EPERM;
+	ret = pthread_mutex_destroy(&bt->lock);
+	if (ret)
+		urcu_die(ret);
+	free(bt->root);
+	return 0;
+}
+
+struct cds_bt_node *cds_bt_lookup(struct cds_bt *bt, unsigned long key)
+{
+	struct cds_bt_inode *inode = rcu_dereference(bt->root);
+	unsigned int pos;
+
+	while (inode->level)
+		inode = rcu_dereference(inode->ptr[bt_child_pos(inode, key)]);
+	pos = bt_key_pos(inode->key, inode->nr, key);
+	if (pos == inode->nr || inode->key[pos] != key)
+		return NULL;
+	return rcu_dereference(inode->ptr[pos]);
+}
+
+struct cds_bt_node *cds_bt_lower_bound(struct cds_bt *bt, unsigned long key,
+		struct cds_bt_iter *iter)
+{
+	struct cds_bt_inode *inode = rcu_dereference(bt->root);
+	unsigned int level;
+
+	iter->height = inode->level + 1;
+	for (level = inode->level; level > 0; level--) {
+		iter->inode[level] = inode;
+		iter->pos[level] = bt_child_pos(inode, key);
+		inode = rcu_dereference(inode->ptr[iter->pos[level]]);
+	}
+	iter->inode[0] = inode;
+	/* Positioned before the first key not smaller than key. */
+	iter->pos[0] = bt_key_pos(inode->key, inode->nr, key) - 1;
+	return cds_bt_next(iter);
+}
+
+struct cds_bt_node *cds_bt_next(struct cds_bt_iter *iter)
+{
+	struct cds_bt_inode *inode;
+	unsigned int level;
+
+	for (;;) {
+		inode = iter->inode[0];
+		if (++iter->pos[0] < inode->nr)
+			return rcu_dereference(inode->ptr[iter->pos[0]]);
+		/* Move up to the first ancestor with a next child. */
+		for (level = 1; level < iter->height; level++) {
+			if (++iter->pos[level] < iter->inode[level]->nr)
+				break;
+		}
+		if (level == iter->height)
+			return NULL;
+		/* And down to its leftmost leaf. */
+		for (; level > 0; level--) {
+			inode = iter->inode[level];
+			iter->inode[level - 1] =
+				rcu_dereference(inode->ptr[iter->pos[level]]);
+			iter->pos[level - 1] = 0;
+		}
+		iter->pos[0] = -1U;
+	}
+}
+
+int cds_bt_add(struct cds_bt *bt, unsigned long key,
+		struct cds_bt_node *node)
+{
+	struct cds_bt_inode *path[CDS_BT_MAX_HEIGHT];
+	unsigned int pos[CDS_BT_MAX_HEIGHT];
+	struct cds_bt_inode *leaf;
+	struct bt_entries entries;
+	unsigned int i;
+	int ret;
+
+	mutex_lock(&bt->lock);
+	leaf = bt_walk(bt, key, path, pos);
+	i = bt_key_pos(leaf->key, leaf->nr, key);
+	if (i < leaf->nr && leaf->key[i] == key) {
+		mutex_unlock(&bt->lock);
+		return -EEXIST;
+	}
+	node->key = key;
+	entries.nr = 0;
+	bt_append(&entries, leaf->key, leaf->ptr, i);
+	entries.key[i] = key;
+	entries.ptr[i] = node;
+	entries.nr++;
+	bt_append(&entries, &leaf->key[i], &leaf->ptr[i], leaf->nr - i);
+	ret = bt_commit(bt, path, pos, &entries);
+	mutex_unlock(&bt->lock);
+	return ret;
+}
+
+int cds_bt_del(struct cds_bt *bt, unsigned long key,
+		struct cds_bt_node **node)
+{
+	struct cds_bt_inode *path[CDS_BT_MAX_HEIGHT];
+	unsigned int pos[CDS_BT_MAX_HEIGHT];
+	struct cds_bt_inode *leaf;
+	struct cds_bt_node *removed;
+	struct bt_entries entries;
+	unsigned int i;
+	int ret;
+
+	mutex_lock(&bt->lock);
+	leaf = bt_walk(bt, key, path, pos);
+	i = bt_key_pos(leaf->key, leaf->nr, key);
+	if (i == leaf->nr || leaf->key[i] != key) {
+		mutex_unlock(&bt->lock);
+		return -ENOENT;
+	}
+	/* The old leaf is freed after a grace period once replaced. */
+	removed = leaf->ptr[i];
+	entries.nr = 0;
+	bt_append(&entries, leaf->key, leaf->ptr, i);
+	bt_append(&entries, &leaf->key[i + 1], &leaf->ptr[i + 1],
+		leaf->nr - i - 1);
+	ret = bt_commit(bt, path, pos, &entries);
+	if (!ret)
+		*node = removed;
+	mutex_unlock(&bt->lock);
+	return ret;
+}
@@ -0,0 +1,387 @@
+/*
+ * rcucache.c
+ *
+ * Userspace RCU library - RCU bounded cache on top of the lock-free
+ * resizable hash table
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "config.h"
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
+#include <urcu/rcucache.h>
+#include "urcu-die.h"
+
+/*
+ * Initial number of hash table buckets, without a limit in nodes, and
+ * at most when sized from that limit.
+ */
+#define CACHE_INIT_SIZE		64
+#define CACHE_MAX_INIT_SIZE	(1UL << 16)
+
+/* Node states, updated with the cache mutex held once queued. */
+enum cache_node_state {
+	CACHE_NODE_PENDING = 0,	/* in the pending queue */
+	CACHE_NODE_LINKED,	/* in the clock ring */
+	CACHE_NODE_REMOVED,	/* removed while in the pending queue */
+};
+
+struct cds_lfht_cache {
+	struct cds_lfht *ht;
+	cds_lfht_cache_match_fct match;
+	cds_lfht_cache_free_fct free_node;
+	const struct rcu_flavor_struct *flavor;
+
+	unsigned long max_count;
+	unsigned long max_bytes;
+	unsigned long count;
+	unsigned long bytes;
+	unsigned long nr_evictions;
+
+	/* Nodes added since the last eviction. */
+	struct cds_wfcq_head pending_head;
+	struct cds_wfcq_tail pending_tail;
+
+	pthread_mutex_t lock;		/* protects the fields below */
+	struct cds_list_head ring;	/* clock ring, in insertion order */
+	struct cds_list_head *hand;	/* next node to sweep, or &ring */
+	unsigned long ring_len;
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static
+int cache_match(struct cds_lfht_node *ht_node, const void *key)
+{
+	struct cds_lfht_cache_node *node =
+		caa_container_of(ht_node, struct cds_lfht_cache_node, node);
+
+	return node->cache->match(node, key);
+}
+
+static
+void cache_node_free_cb(struct rcu_head *head)
+{
+	struct cds_lfht_cache_node *node =
+		caa_container_of(head, struct cds_lfht_cache_node, head);
+
+	node->cache->free_node(node);
+}
+
+/*
+ * Account for a node removed from the hash table, and hand it to
+ * call_rcu. Called with the cache mutex held.
+ */
+static
+void cache_retire(struct cds_lfht_cache *cache,
+		struct cds_lfht_cache_node *node)
+{
+	uatomic_add(&cache->count, -1UL);
+	uatomic_add(&cache->bytes, -(unsigned long) node->size);
+	cache->flavor->update_call_rcu(&node->head, cache_node_free_cb);
+}
+
+/*
+ * Unlink a node of the clock ring, moving the hand past it. Called with
+ * the cache mutex held.
+ */
+static
+void cache_unlink(struct cds_lfht_cache *cache,
+		struct cds_lfht_cache_node *node)
+{
+	if (cache->hand == &node->clock)
+		cache->hand = node->clock.next;
+	cds_list_del(&node->clock);
+	cache->ring_len--;
+}
+
+/*
+ * Move the nodes added since the last call into the clock ring, just
+ * before the hand, so they are the last swept. Called with the cache
+ * mutex held.
+ */
+static
+void cache_drain_pending(struct cds_lfht_cache *cache)
+{
+	struct cds_wfcq_node *qnode, *n;
+	struct cds_wfcq_head head;
+	struct cds_wfcq_tail tail;
+	enum cds_wfcq_ret ret;
+
+	cds_wfcq_init(&head, &tail);
+	ret = __cds_wfcq_splice_blocking(&head, &tail,
+			&cache->pending_head, &cache->pending_tail);
+	if (ret == CDS_WFCQ_RET_SRC_EMPTY)
+		return;
+	__cds_wfcq_for_each_blocking_safe(&head, &tail, qnode, n) {
+		struct cds_lfht_cache_node *node =
+			caa_container_of(qnode, struct cds_lfht_cache_node,
+				pending);
+
+		if (node->state == CACHE_NODE_REMOVED) {
+			cache_retire(cache, node);
+			continue;
+		}
+		node->state = CACHE_NODE_LINKED;
+		cds_list_add_tail(&node->clock, cache->hand);
+		cache->ring_len++;
+	}
+}
+
+/*
+ * Return whether the cache exceeds its limits, or 31/32 of its limits
+ * if @low.
+ */
+static
+int cache_over(struct cds_lfht_cache *cache, int low)
+{
+	unsigned long max_count = CMM_LOAD_SHARED(cache->max_count);
+	unsigned long max_bytes = CMM_LOAD_SHARED(cache->max_bytes);
+
+	if (low) {
+		max_count -= max_count >> 5;
+		max_bytes -= max_bytes >> 5;
+	}
+	if (max_count && uatomic_read(&cache->count) > max_count)
+		return 1;
+	if (max_bytes && uatomic_read(&cache->bytes) > max_bytes)
+		return 1;
+	return 0;
+}
+
+/*
+ * Sweep the clock hand until the cache is below 31/32 of its limits.
+ * Called with the cache mutex held, within a read-side critical
+ * section.
+ */
+static
+void cache_evict(struct cds_lfht_cache *cache)
+{
+	unsigned long scanned = 0;
+
+	while (cache_over(cache, 1)) {
+		struct cds_lfht_cache_node *node;
+
+		/* Take the nodes added meanwhile at each turn of the hand. */
+		if (cache->hand == &cache->ring) {
+			cache_drain_pending(cache);
+			if (!cache->ring_len)
+				break;
+			cache->hand = cache->ring.next;
+		}
+		node = cds_list_entry(cache->hand, struct cds_lfht_cache_node,
+				clock);
+		cache->hand = node->clock.next;
+		/* Second chance, unless the ring was swept twice. */
+		if (CMM_LOAD_SHARED(node->referenced)
+				&& scanned++ < 2 * cache->ring_len) {
+			CMM_STORE_SHARED(node->referenced, 0);
+			continue;
+		}
+		cache_unlink(cache, node);
+		/* Cannot fail: cds_lfht_cache_del() unlinks under the mutex. */
+		(void) cds_lfht_del(cache->ht, &node->node);
+		uatomic_inc(&cache->nr_evictions);
+		cache_retire(cache, node);
+	}
+}
+
+struct cds_lfht_cache *_cds_lfht_cache_new(unsigned long max_count,
+		unsigned long max_bytes,
+		cds_lfht_cache_match_fct match,
+		cds_lfht_cache_free_fct free_node,
+		const struct rcu_flavor_struct *flavor)
+{
+	struct cds_lfht_cache *cache;
+	unsigned long init_size = CACHE_INIT_SIZE;
+	int ret;
+
+	/*
+	 * Size the table for its node limit right away: resizes go
+	 * through the call_rcu worker, also busy with the evicted nodes.
+	 */
+	if (max_count) {
+		init_size = 1;
+		while (init_size < max_count && init_size < CACHE_MAX_INIT_SIZE)
+			init_size <<= 1;
+	}
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+	cache->ht = _cds_lfht_new(init_size, 1, 0,
+			CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING,
+			NULL, flavor, NULL);
+	if (!cache->ht) {
+		free(cache);
+		return NULL;
+	}
+	ret = pthread_mutex_init(&cache->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	cache->match = match;
+	cache->free_node = free_node;
+	cache->flavor = flavor;
+	cache->max_count = max_count;
+	cache->max_bytes = max_bytes;
+	cds_wfcq_init(&cache->pending_head, &cache->pending_tail);
+	CDS_INIT_LIST_HEAD(&cache->ring);
+	cache->hand = &cache->ring;
+	return cache;
+}
+
+int cds_lfht_cache_destroy(struct cds_lfht_cache *cache)
+{
+	struct cds_lfht_cache_node *node, *n;
+	int ret;
+
+	cache->flavor->read_lock();
+	mutex_lock(&cache->lock);
+	cache_drain_pending(cache);
+	cds_list_for_each_entry_safe(node, n, &cache->ring, clock) {
+		cache_unlink(cache, node);
+		(void) cds_lfht_del(cache->ht, &node->node);
+		cache_retire(cache, node);
+	}
+	mutex_unlock(&cache->lock);
+	cache->flavor->read_unlock();
+	cache->flavor->barrier();
+	ret = cds_lfht_destroy(cache->ht, NULL);
+	if (ret)
+		return ret;
+	ret = pthread_mutex_destroy(&cache->lock);
+	if (ret)
+		urcu_die(ret);
+	free(cache);
+	return 0;
+}
+
+void cds_lfht_cache_node_init(struct cds_lfht_cache_node *node, size_t size)
+{
+	cds_lfht_node_init(&node->node);
+	cds_wfcq_node_init(&node->pending);
+	node->cache = NULL;
+	node->size = size;
+	node->referenced = 0;
+	node->state = CACHE_NODE_PENDING;
+}
+
+struct cds_lfht_cache_node *cds_lfht_cache_lookup(
+		struct cds_lfht_cache *cache, unsigned long hash,
+		const void *key)
+{
+	struct cds_lfht_cache_node *node;
+	struct cds_lfht_node *ht_node;
+	struct cds_lfht_iter iter;
+
+	cds_lfht_lookup(cache->ht, hash, cache_match, key, &iter);
+	ht_node = cds_lfht_iter_get_node(&iter);
+	if (!ht_node)
+		return NULL;
+	node = caa_container_of(ht_node, struct cds_lfht_cache_node, node);
+	/* Only write the bit when it changes, keeping hits read-only. */
+	if (!CMM_LOAD_SHARED(node->referenced))
+		CMM_STORE_SHARED(node->referenced, 1);
+	return node;
+}
+
+struct cds_lfht_cache_node *cds_lfht_cache_add(
+		struct cds_lfht_cache *cache, unsigned long hash,
+		const void *key, struct cds_lfht_cache_node *node)
+{
+	struct cds_lfht_node *ht_node;
+
+	node->cache = cache;
+	ht_node = cds_lfht_add_unique(cache->ht, hash, cache_match, key,
+			&node->node);
+	if (ht_node != &node->node)
+		return caa_container_of(ht_node, struct cds_lfht_cache_node,
+				node);
+	uatomic_inc(&cache->count);
+	uatomic_add(&cache->bytes, node->size);
+	cds_wfcq_enqueue(&cache->pending_head, &cache->pending_tail,
+			&node->pending);
+	/* Leave the eviction to the thread already sweeping. */
+	if (cache_over(cache, 0)
+			&& !pthread_mutex_trylock(&cache->lock)) {
+		cache_evict(cache);
+		mutex_unlock(&cache->lock);
+	}
+	return node;
+}
+
+int cds_lfht_cache_del(struct cds_lfht_cache *cache,
+		struct cds_lfht_cache_node *node)
+{
+	int ret;
+
+	mutex_lock(&cache->lock);
+	ret = cds_lfht_del(cache->ht, &node->node);
+	if (ret) {
+		ret = -ENOENT;
+		goto end;
+	}
+	/* Nodes still queued are retired when the queue is drained. */
+	if (node->state == CACHE_NODE_LINKED) {
+		cache_unlink(cache, node);
+		cache_retire(cache, node);
+	} else {
+		node->state = CACHE_NODE_REMOVED;
+	}
+end:
+	mutex_unlock(&cache->lock);
+	return ret;
+}
+
+void cds_lfht_cache_set_capacity(struct cds_lfht_cache *cache,
+		unsigned long max_count, unsigned long max_bytes)
+{
+	mutex_lock(&cache->lock);
+	CMM_STORE_SHARED(cache->max_count, max_count);
+	CMM_STORE_SHARED(cache->max_bytes, max_bytes);
+	if (cache_over(cache, 0))
+		cache_evict(cache);
+	mutex_unlock(&cache->lock);
+}
+
+void cds_lfht_cache_get_stats(struct cds_lfht_cache *cache,
+		struct cds_lfht_cache_stats *stats)
+{
+	stats->count = uatomic_read(&cache->count);
+	stats->bytes = uatomic_read(&cache->bytes);
+	stats->nr_evictions = uatomic_read(&cache->nr_evictions);
+}
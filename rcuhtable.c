@@ -0,0 +1,110 @@
+/*
+ * rcuhtable.c
+ *
+ * Userspace RCU library - RCU fixed-size hash table over hlists
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "config.h"
+#include <urcu-pointer.h>
+#include <urcu/rcuhtable.h>
+
+/* Number of locks when the number of CPUs is unknown. */
+#define DEFAULT_NR_LOCKS	16
+
+static
+unsigned long round_pow2(unsigned long v)
+{
+	unsigned long r = 1;
+
+	while (r < v)
+		r <<= 1;
+	return r;
+}
+
+static
+unsigned long default_nr_locks(void)
+{
+#ifdef HAVE_SYSCONF
+	long maxcpus;
+
+	maxcpus = sysconf(_SC_NPROCESSORS_CONF);
+	if (maxcpus > 0)
+		return maxcpus;
+#endif
+	return DEFAULT_NR_LOCKS;
+}
+
+struct cds_hlist_ht *cds_hlist_ht_new(unsigned long nr_buckets,
+		unsigned long nr_locks)
+{
+	struct cds_hlist_ht *ht;
+	unsigned long i;
+	int ret;
+
+	if (!nr_buckets)
+		return NULL;
+	nr_buckets = round_pow2(nr_buckets);
+	if (!nr_locks)
+		nr_locks = default_nr_locks();
+	nr_locks = round_pow2(nr_locks);
+	if (nr_locks > nr_buckets)
+		nr_locks = nr_buckets;
+
+	ht = calloc(1, sizeof(*ht));
+	if (!ht)
+		return NULL;
+	ht->buckets = calloc(nr_buckets, sizeof(*ht->buckets));
+	if (!ht->buckets)
+		goto error;
+	ret = posix_memalign((void **) &ht->locks, CAA_CACHE_LINE_SIZE,
+			nr_locks * sizeof(*ht->locks));
+	if (ret)
+		goto error;
+	for (i = 0; i < nr_locks; i++)
+		ht->locks[i].locked = 0;
+	for (i = 0; i < nr_buckets; i++)
+		CDS_INIT_HLIST_HEAD(&ht->buckets[i]);
+	ht->bucket_mask = nr_buckets - 1;
+	ht->lock_mask = nr_locks - 1;
+	return ht;
+
+error:
+	free(ht->buckets);
+	free(ht);
+	return NULL;
+}
+
+int cds_hlist_ht_destroy(struct cds_hlist_ht *ht)
+{
+	unsigned long i;
+
+	for (i = 0; i <= ht->bucket_mask; i++) {
+		if (ht->buckets[i].next)
+			return -EPERM;
+	}
+	free(ht->locks);
+	free(ht->buckets);
+	free(ht);
+	return 0;
+}
@@ -0,0 +1,331 @@
+/*
+ * rcuidr.c
+ *
+ * Userspace RCU library - RCU integer ID allocator
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "config.h"
+#include <urcu/compiler.h>
+#include <urcu/list.h>
+#include <urcu/rcuidr.h>
+#include "urcu-die.h"
+
+#define IDR_WORD_BITS		64
+#define IDR_MAX_LEVELS		\
+	((CDS_IDR_MAX_BITS + 5) / 6)
+
+/* Number of IDs moved between a thread cache and the bitmap at once. */
+#define IDR_BATCH		(CDS_IDR_CACHE_SIZE / 2)
+
+/* Free IDs of a thread, the value of the allocator pthread key. */
+struct idr_cache {
+	struct cds_idr *idr;
+	unsigned int nr;
+	unsigned long id[CDS_IDR_CACHE_SIZE];
+	struct cds_list_head node;	/* in idr->caches */
+};
+
+/*
+ * Bit i of level 0 is set when ID i is allocated or cached by a
+ * thread. Bit i of level n is set when word i of level n - 1 is full.
+ * Bits past the ID range are set. The last level has a single word.
+ */
+struct cds_idr {
+	struct cds_rdx rdx;
+	const struct rcu_flavor_struct *flavor;
+	pthread_key_t key;
+
+	pthread_mutex_t lock;		/* protects the fields below */
+	unsigned int nr_levels;
+	uint64_t *map[IDR_MAX_LEVELS];
+	struct cds_list_head caches;	/* idr_cache of each thread */
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+/* Called with idr lock held. */
+static
+void idr_bitmap_set(struct cds_idr *idr, unsigned long id)
+{
+	unsigned int lvl;
+	uint64_t *word;
+
+	for (lvl = 0; lvl < idr->nr_levels; lvl++) {
+		word = &idr->map[lvl][id / IDR_WORD_BITS];
+		*word |= 1ULL << (id % IDR_WORD_BITS);
+		if (~*word)
+			break;		/* the parent bits are unchanged */
+		id /= IDR_WORD_BITS;
+	}
+}
+
+/* Called with idr lock held. */
+static
+void idr_bitmap_clear(struct cds_idr *idr, unsigned long id)
+{
+	unsigned int lvl;
+	uint64_t *word;
+	int was_full;
+
+	for (lvl = 0; lvl < idr->nr_levels; lvl++) {
+		word = &idr->map[lvl][id / IDR_WORD_BITS];
+		was_full = !~*word;
+		*word &= ~(1ULL << (id % IDR_WORD_BITS));
+		if (!was_full)
+			break;
+		id /= IDR_WORD_BITS;
+	}
+}
+
+/*
+ * Reserve the lowest free ID, descending from the last level. Called
+ * with idr lock held. Returns 0 if all IDs are reserved.
+ */
+static
+int idr_bitmap_alloc(struct cds_idr *idr, unsigned long *id)
+{
+	unsigned long i = 0;
+	unsigned int lvl;
+	uint64_t word;
+
+	for (lvl = idr->nr_levels; lvl-- > 0; ) {
+		word = idr->map[lvl][i];
+		if (!~word)
+			return 0;
+		i = i * IDR_WORD_BITS + __builtin_ctzll(~word);
+	}
+	idr_bitmap_set(idr, i);
+	*id = i;
+	return 1;
+}
+
+/* Give the IDs cached by an exiting thread back to the bitmap. */
+static
+void idr_thread_exit(void *arg)
+{
+	struct idr_cache *cache = arg;
+	struct cds_idr *idr = cache->idr;
+
+	mutex_lock(&idr->lock);
+	while (cache->nr)
+		idr_bitmap_clear(idr, cache->id[--cache->nr]);
+	cds_list_del(&cache->node);
+	mutex_unlock(&idr->lock);
+	free(cache);
+}
+
+static
+struct idr_cache *idr_get_cache(struct cds_idr *idr)
+{
+	struct idr_cache *cache;
+	int ret;
+
+	cache = pthread_getspecific(idr->key);
+	if (caa_likely(cache))
+		return cache;
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+	cache->idr = idr;
+	ret = pthread_setspecific(idr->key, cache);
+	if (ret) {
+		free(cache);
+		return NULL;
+	}
+	mutex_lock(&idr->lock);
+	cds_list_add(&cache->node, &idr->caches);
+	mutex_unlock(&idr->lock);
+	return cache;
+}
+
+static
+void idr_free_map(struct cds_idr *idr)
+{
+	unsigned int lvl;
+
+	for (lvl = 0; lvl < idr->nr_levels; lvl++)
+		free(idr->map[lvl]);
+}
+
+static
+int idr_init_map(struct cds_idr *idr, unsigned int id_bits)
+{
+	unsigned long nr_bits = 1UL << id_bits, nr_words, i;
+	unsigned int lvl = 0;
+
+	do {
+		nr_words = (nr_bits + IDR_WORD_BITS - 1) / IDR_WORD_BITS;
+		/* Pages of zeroes from calloc() are only touched when used. */
+		idr->map[lvl] = calloc(nr_words, sizeof(uint64_t));
+		if (!idr->map[lvl])
+			return -ENOMEM;
+		idr->nr_levels = ++lvl;
+		for (i = nr_bits; i < nr_words * IDR_WORD_BITS; i++)
+			idr->map[lvl - 1][i / IDR_WORD_BITS] |=
+				1ULL << (i % IDR_WORD_BITS);
+		nr_bits = nr_words;
+	} while (nr_words > 1);
+	return 0;
+}
+
+struct cds_idr *_cds_idr_create(unsigned int id_bits,
+		const struct rcu_flavor_struct *flavor)
+{
+	struct cds_idr *idr;
+	int ret;
+
+	if (!id_bits || id_bits > CDS_IDR_MAX_BITS
+			|| id_bits >= CAA_BITS_PER_LONG)
+		return NULL;
+	idr = calloc(1, sizeof(*idr));
+	if (!idr)
+		return NULL;
+	if (idr_init_map(idr, id_bits))
+		goto error_map;
+	if (cds_rdx_init(&idr->rdx, id_bits, flavor->update_call_rcu))
+		goto error_map;
+	ret = pthread_key_create(&idr->key, idr_thread_exit);
+	if (ret)
+		goto error_rdx;
+	ret = pthread_mutex_init(&idr->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	idr->flavor = flavor;
+	CDS_INIT_LIST_HEAD(&idr->caches);
+	return idr;
+
+error_rdx:
+	(void) cds_rdx_destroy(&idr->rdx);
+error_map:
+	idr_free_map(idr);
+	free(idr);
+	return NULL;
+}
+
+int cds_idr_destroy(struct cds_idr *idr)
+{
+	struct idr_cache *cache, *tmp;
+	int ret;
+
+	ret = cds_rdx_destroy(&idr->rdx);
+	if (ret)
+		return ret;
+	ret = pthread_key_delete(idr->key);
+	if (ret)
+		urcu_die(ret);
+	cds_list_for_each_entry_safe(cache, tmp, &idr->caches, node)
+		free(cache);
+	idr_free_map(idr);
+	ret = pthread_mutex_destroy(&idr->lock);
+	if (ret)
+		urcu_die(ret);
+	free(idr);
+	return 0;
+}
+
+int cds_idr_alloc(struct cds_idr *idr, struct cds_rdx_node *node,
+		unsigned long *id)
+{
+	struct idr_cache *cache;
+	unsigned long new_id;
+	unsigned int i, j;
+	int ret;
+
+	cache = idr_get_cache(idr);
+	if (caa_unlikely(!cache))
+		return -ENOMEM;
+	if (caa_unlikely(!cache->nr)) {
+		/* Reserve a batch, handed out lowest ID first. */
+		mutex_lock(&idr->lock);
+		while (cache->nr < IDR_BATCH
+				&& idr_bitmap_alloc(idr, &cache->id[cache->nr]))
+			cache->nr++;
+		mutex_unlock(&idr->lock);
+		if (!cache->nr)
+			return -ENOSPC;
+		for (i = 0, j = cache->nr - 1; i < j; i++, j--) {
+			new_id = cache->id[i];
+			cache->id[i] = cache->id[j];
+			cache->id[j] = new_id;
+		}
+	}
+	new_id = cache->id[--cache->nr];
+	ret = cds_rdx_add(&idr->rdx, new_id, node);
+	if (caa_unlikely(ret)) {
+		cache->id[cache->nr++] = new_id;
+		return ret;
+	}
+	if (id)
+		*id = new_id;
+	return 0;
+}
+
+struct cds_rdx_node *cds_idr_find(struct cds_idr *idr, unsigned long id)
+{
+	return cds_rdx_lookup(&idr->rdx, id);
+}
+
+struct cds_rdx_node *cds_idr_remove(struct cds_idr *idr, unsigned long id)
+{
+	struct cds_rdx_node *node;
+	struct idr_cache *cache;
+	unsigned int i;
+
+	node = cds_rdx_del(&idr->rdx, id);
+	if (!node)
+		return NULL;
+	cache = idr_get_cache(idr);
+	if (caa_unlikely(!cache || cache->nr == CDS_IDR_CACHE_SIZE)) {
+		/* Give the oldest half of the cache back to the bitmap. */
+		mutex_lock(&idr->lock);
+		if (cache) {
+			for (i = 0; i < IDR_BATCH; i++)
+				idr_bitmap_clear(idr, cache->id[i]);
+			for (i = IDR_BATCH; i < cache->nr; i++)
+				cache->id[i - IDR_BATCH] = cache->id[i];
+			cache->nr -= IDR_BATCH;
+		} else {
+			idr_bitmap_clear(idr, id);
+		}
+		mutex_unlock(&idr->lock);
+		if (!cache)
+			return node;
+	}
+	cache->id[cache->nr++] = id;
+	return node;
+}
@@ -0,0 +1,482 @@
+/*
+ * rcuitree.c
+ *
+ * Userspace RCU library - RCU interval tree
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <urcu-pointer.h>
+#include <urcu/rcuitree.h>
+#include "urcu-die.h"
+
+/*
+ * Tree node of an interval: nodes are ordered by start, then last, then
+ * address of the struct cds_itree_node, so that equal intervals have a
+ * position. max_last is the largest last of the subtree. Published
+ * nodes are immutable; "fresh" marks the nodes allocated by the update
+ * in progress, which it may still modify.
+ */
+struct cds_itree_inode {
+	unsigned long start, last;
+	unsigned long max_last;
+	struct cds_itree_inode *left, *right;
+	struct cds_itree_node *node;
+	unsigned int height;
+	unsigned int fresh;
+	struct rcu_head head;
+};
+
+/*
+ * Nodes allocated and replaced by an update: each level of the path,
+ * and of the path to the successor of a removed node, is copied once,
+ * and rebalancing copies at most two more nodes per level.
+ */
+#define IT_MAX_UPDATE_NODES	(3 * CDS_ITREE_MAX_HEIGHT)
+
+struct it_update {
+	struct cds_itree_inode *alloc[IT_MAX_UPDATE_NODES];
+	unsigned int nr_alloc;
+	struct cds_itree_inode *old[IT_MAX_UPDATE_NODES];
+	unsigned int nr_old;
+	int nomem;
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static
+void free_inode_cb(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct cds_itree_inode, head));
+}
+
+/* Order of the interval of node relative to the one of inode. */
+static
+int it_cmp(unsigned long start, unsigned long last,
+		struct cds_itree_node *node, struct cds_itree_inode *inode)
+{
+	if (start != inode->start)
+		return start < inode->start ? -1 : 1;
+	if (last != inode->last)
+		return last < inode->last ? -1 : 1;
+	if (node != inode->node)
+		return (uintptr_t) node < (uintptr_t) inode->node ? -1 : 1;
+	return 0;
+}
+
+static inline
+unsigned int it_height(struct cds_itree_inode *inode)
+{
+	return inode ? inode->height : 0;
+}
+
+/* Recompute the height and max_last of a fresh node from its children. */
+static
+void it_fixup(struct cds_itree_inode *inode)
+{
+	unsigned int hl = it_height(inode->left), hr = it_height(inode->right);
+
+	assert(inode->fresh);
+	inode->height = (hl > hr ? hl : hr) + 1;
+	inode->max_last = inode->last;
+	if (inode->left && inode->left->max_last > inode->max_last)
+		inode->max_last = inode->left->max_last;
+	if (inode->right && inode->right->max_last > inode->max_last)
+		inode->max_last = inode->right->max_last;
+}
+
+static
+void it_retire(struct it_update *update, struct cds_itree_inode *inode)
+{
+	assert(!inode->fresh);
+	assert(update->nr_old < IT_MAX_UPDATE_NODES);
+	update->old[update->nr_old++] = inode;
+}
+
+static
+struct cds_itree_inode *it_alloc(struct it_update *update)
+{
+	struct cds_itree_inode *inode;
+
+	assert(update->nr_alloc < IT_MAX_UPDATE_NODES);
+	inode = malloc(sizeof(*inode));
+	if (!inode) {
+		update->nomem = 1;
+		return NULL;
+	}
+	inode->fresh = 1;
+	update->alloc[update->nr_alloc++] = inode;
+	return inode;
+}
+
+/*
+ * Return a copy of inode that the update can modify, retiring inode, or
+ * inode itself if already fresh. NULL on allocation failure.
+ */
+static
+struct cds_itree_inode *it_mut(struct it_update *update,
+		struct cds_itree_inode *inode)
+{
+	struct cds_itree_inode *copy;
+
+	if (inode->fresh)
+		return inode;
+	copy = it_alloc(update);
+	if (!copy)
+		return NULL;
+	copy->start = inode->start;
+	copy->last = inode->last;
+	copy->max_last = inode->max_last;
+	copy->left = inode->left;
+	copy->right = inode->right;
+	copy->node = inode->node;
+	copy->height = inode->height;
+	it_retire(update, inode);
+	return copy;
+}
+
+/* Rotations of a fresh node, copying the child moving up. */
+static
+struct cds_itree_inode *it_rotate_right(struct it_update *update,
+		struct cds_itree_inode *inode)
+{
+	struct cds_itree_inode *left = it_mut(update, inode->left);
+
+	if (!left)
+		return NULL;
+	inode->left = left->right;
+	left->right = inode;
+	it_fixup(inode);
+	it_fixup(left);
+	return left;
+}
+
+static
+struct cds_itree_inode *it_rotate_left(struct it_update *update,
+		struct cds_itree_inode *inode)
+{
+	struct cds_itree_inode *right = it_mut(update, inode->right);
+
+	if (!right)
+		return NULL;
+	inode->right = right->left;
+	right->left = inode;
+	it_fixup(inode);
+	it_fixup(right);
+	return right;
+}
+
+/*
+ * Restore the AVL balance of a fresh node whose subtrees differ in
+ * height by at most 2, and fix it up. Return the new subtree root, NULL
+ * on allocation failure.
+ */
+static
+struct cds_itree_inode *it_balance(struct it_update *update,
+		struct cds_itree_inode *inode)
+{
+	unsigned int hl = it_height(inode->left), hr = it_height(inode->right);
+	struct cds_itree_inode *child;
+
+	if (hl > hr + 1) {
+		child = inode->left;
+		if (it_height(child->left) < it_height(child->right)) {
+			child = it_mut(update, child);
+			if (!child)
+				return NULL;
+			child = it_rotate_left(update, child);
+			if (!child)
+				return NULL;
+			inode->left = child;
+		}
+		return it_rotate_right(update, inode);
+	}
+	if (hr > hl + 1) {
+		child = inode->right;
+		if (it_height(child->right) < it_height(child->left)) {
+			child = it_mut(update, child);
+			if (!child)
+				return NULL;
+			child = it_rotate_right(update, child);
+			if (!child)
+				return NULL;
+			inode->right = child;
+		}
+		return it_rotate_left(update, inode);
+	}
+	it_fixup(inode);
+	return inode;
+}
+
+/* Insert fresh leaf "new" in the subtree. NULL on allocation failure. */
+static
+struct cds_itree_inode *it_insert(struct it_update *update,
+		struct cds_itree_inode *inode, struct cds_itree_inode *new)
+{
+	struct cds_itree_inode *child;
+	int cmp;
+
+	if (!inode)
+		return new;
+	cmp = it_cmp(new->start, new->last, new->node, inode);
+	assert(cmp);
+	inode = it_mut(update, inode);
+	if (!inode)
+		return NULL;
+	if (cmp < 0) {
+		child = it_insert(update, inode->left, new);
+		if (!child)
+			return NULL;
+		inode->left = child;
+	} else {
+		child = it_insert(update, inode->right, new);
+		if (!child)
+			return NULL;
+		inode->right = child;
+	}
+	return it_balance(update, inode);
+}
+
+/*
+ * Remove the first node of a non-empty subtree, returned in *min, out
+ * of the tree but not retired. Return the new subtree root, check
+ * update->nomem for allocation failure.
+ */
+static
+struct cds_itree_inode *it_remove_min(struct it_update *update,
+		struct cds_itree_inode *inode, struct cds_itree_inode **min)
+{
+	struct cds_itree_inode *child;
+
+	if (!inode->left) {
+		*min = inode;
+		return inode->right;
+	}
+	inode = it_mut(update, inode);
+	if (!inode)
+		return NULL;
+	child = it_remove_min(update, inode->left, min);
+	if (update->nomem)
+		return NULL;
+	inode->left = child;
+	return it_balance(update, inode);
+}
+
+/*
+ * Remove the tree node of node from the subtree, setting *found.
+ * Return the new subtree root, check update->nomem for allocation
+ * failure.
+ */
+static
+struct cds_itree_inode *it_remove(struct it_update *update,
+		struct cds_itree_inode *inode, struct cds_itree_node *node,
+		int *found)
+{
+	struct cds_itree_inode *child, *min;
+	int cmp;
+
+	if (!inode)
+		return NULL;
+	cmp = it_cmp(node->start, node->last, node, inode);
+	if (!cmp) {
+		*found = 1;
+		if (!inode->left || !inode->right) {
+			it_retire(update, inode);
+			return inode->left ? inode->left : inode->right;
+		}
+		/* Replace by its successor, moved into a copy of it. */
+		inode = it_mut(update, inode);
+		if (!inode)
+			return NULL;
+		child = it_remove_min(update, inode->right, &min);
+		if (update->nomem)
+			return NULL;
+		it_retire(update, min);
+		inode->right = child;
+		inode->start = min->start;
+		inode->last = min->last;
+		inode->node = min->node;
+		return it_balance(update, inode);
+	}
+	child = it_remove(update, cmp < 0 ? inode->left : inode->right,
+			node, found);
+	if (update->nomem || !*found)
+		return inode;
+	inode = it_mut(update, inode);
+	if (!inode)
+		return NULL;
+	if (cmp < 0)
+		inode->left = child;
+	else
+		inode->right = child;
+	return it_balance(update, inode);
+}
+
+/*
+ * Publish the new root of a successful update, or free the nodes it
+ * allocated. Called with the tree lock held.
+ */
+static
+int it_commit(struct cds_itree *it, struct it_update *update,
+		struct cds_itree_inode *root)
+{
+	unsigned int i;
+
+	if (update->nomem) {
+		/* Nothing was published. */
+		for (i = 0; i < update->nr_alloc; i++)
+			free(update->alloc[i]);
+		return -ENOMEM;
+	}
+	for (i = 0; i < update->nr_alloc; i++)
+		update->alloc[i]->fresh = 0;
+	rcu_assign_pointer(it->root, root);
+	for (i = 0; i < update->nr_old; i++)
+		it->it_call_rcu(&update->old[i]->head, free_inode_cb);
+	return 0;
+}
+
+void cds_itree_init(struct cds_itree *it,
+		void it_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)))
+{
+	int ret;
+
+	it->root = NULL;
+	ret = pthread_mutex_init(&it->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	it->it_call_rcu = it_call_rcu;
+}
+
+int cds_itree_destroy(struct cds_itree *it)
+{
+	int ret;
+
+	if (it->root)
+		return -EPERM;
+	ret = pthread_mutex_destroy(&it->lock);
+	if (ret)
+		urcu_die(ret);
+	return 0;
+}
+
+int cds_itree_add(struct cds_itree *it, struct cds_itree_node *node,
+		unsigned long start, unsigned long last)
+{
+	struct it_update update = { .nr_alloc = 0, .nr_old = 0, .nomem = 0 };
+	struct cds_itree_inode *new, *root;
+	int ret;
+
+	if (start > last)
+		return -EINVAL;
+	node->start = start;
+	node->last = last;
+	mutex_lock(&it->lock);
+	new = it_alloc(&update);
+	if (new) {
+		new->start = start;
+		new->last = last;
+		new->left = new->right = NULL;
+		new->node = node;
+		it_fixup(new);
+	}
+	root = new ? it_insert(&update, it->root, new) : NULL;
+	ret = it_commit(it, &update, root);
+	mutex_unlock(&it->lock);
+	return ret;
+}
+
+int cds_itree_del(struct cds_itree *it, struct cds_itree_node *node)
+{
+	struct it_update update = { .nr_alloc = 0, .nr_old = 0, .nomem = 0 };
+	struct cds_itree_inode *root;
+	int found = 0, ret;
+
+	mutex_lock(&it->lock);
+	root = it_remove(&update, it->root, node, &found);
+	if (!found && !update.nomem)
+		ret = -ENOENT;
+	else
+		ret = it_commit(it, &update, root);
+	mutex_unlock(&it->lock);
+	return ret;
+}
+
+/*
+ * Push inode and its chain of left children, as long as their subtree
+ * may hold an interval ending at or after the query start.
+ */
+static
+void it_push_left(struct cds_itree_iter *iter, struct cds_itree_inode *inode)
+{
+	while (inode && inode->max_last >= iter->start) {
+		assert(iter->depth < CDS_ITREE_MAX_HEIGHT);
+		iter->stack[iter->depth++] = inode;
+		inode = rcu_dereference(inode->left);
+	}
+}
+
+struct cds_itree_node *cds_itree_first_overlap(struct cds_itree *it,
+		unsigned long start, unsigned long last,
+		struct cds_itree_iter *iter)
+{
+	iter->depth = 0;
+	iter->start = start;
+	iter->last = last;
+	it_push_left(iter, rcu_dereference(it->root));
+	return cds_itree_next_overlap(iter);
+}
+
+struct cds_itree_node *cds_itree_next_overlap(struct cds_itree_iter *iter)
+{
+	struct cds_itree_inode *inode;
+
+	while (iter->depth) {
+		inode = iter->stack[--iter->depth];
+		/* This node and the ones after it start after the query. */
+		if (inode->start > iter->last) {
+			iter->depth = 0;
+			break;
+		}
+		it_push_left(iter, rcu_dereference(inode->right));
+		if (inode->last >= iter->start)
+			return inode->node;
+	}
+	return NULL;
+}
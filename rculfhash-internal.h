@@ -25,6 +25,10 @@
  */
 
 #include <urcu/rculfhash.h>
+#include <urcu/cacheline.h>
+#include <urcu/alloc.h>
+#include <urcu/split-counter.h>
+#include "urcu-lock-stats.h"
 #include <stdio.h>
 
 #ifdef DEBUG
@@ -54,8 +58,6 @@ do {								\
 #define max(a, b)	((a) > (b) ? (a) : (b))
 #endif
 
-struct ht_items_count;
-
 /*
  * cds_lfht: Top-level data structure representing a lock-free hash
  * table. Defined in the implementation file to make it be an opaque
@@ -63,15 +65,19 @@ struct ht_items_count;
  *
  * The fields used in fast-paths are placed near the end of the
  * structure, because we need to have a variable-sized union to contain
- * the mm plugin fields, which are used in the fast path.
+ * the mm plugin fields, which are used in the fast path. The fields
+ * written concurrently by updaters and resize workers get cache lines
+ * of their own, so they do not bounce the read-mostly fast-path fields
+ * across CPUs.
  */
 struct cds_lfht {
 	/* Initial configuration items */
 	unsigned long max_nr_buckets;
 	const struct cds_lfht_mm_type *mm;	/* memory management plugin */
+	unsigned long alloc_size;	/* of this structure */
+	int tbl_fd;			/* cds_lfht_mm_file backing file */
 	const struct rcu_flavor_struct *flavor;	/* RCU flavor */
-
-	long count;			/* global approximate item count */
+	struct rcu_domain *domain;	/* RCU domain, NULL for flavor */
 
 	/*
 	 * We need to put the work threads offline (QSBR) when taking this
@@ -81,18 +87,55 @@ struct cds_lfht {
 	 * completion.
 	 */
 	pthread_mutex_t resize_mutex;	/* resize mutex: add/del mutex */
+	struct rcu_lock_stats_state resize_lock_stats;
 	pthread_attr_t *resize_attr;	/* Resize threads attributes */
+	/* Resize workers, see cds_lfht_set_resize_workers() */
+	struct cds_lfht_resize_pool *resize_pool;
+	unsigned int resize_max_workers;
+	unsigned int resize_nr_cpus;
+	int *resize_cpus;
 	unsigned int in_progress_resize, in_progress_destroy;
+	unsigned int in_progress_gc;	/* cds_lfht_gc_async() passes */
 	unsigned long resize_target;
 	int resize_initiated;
+	/* Resize statistics, see cds_lfht_get_resize_stats() */
+	unsigned long nr_resizes, resize_nr_levels;
+	uint64_t resize_helper_ns;
+	/* cds_lfht_destroy_free() callback */
+	void (*destroy_free_node)(struct cds_lfht_node *node, void *priv);
+	void *destroy_priv;
+	/* cds_lfht_set_reclaim() callback */
+	cds_lfht_reclaim_fct reclaim_node;
+	void *reclaim_priv;
+
+	/*
+	 * Written concurrently: the item count, whose global approximate
+	 * count starts a cache line, and the order being grown and next
+	 * slice to populate, claimed by resize workers and updaters.
+	 */
+	struct cds_split_counter split_count;
+	unsigned long resize_cursor;
+	unsigned long resize_slices_done;
+	/* Removal generation, with CDS_LFHT_LOOKUP_CACHE */
+	unsigned long cache_gen;
 
 	/*
 	 * Variables needed for add and remove fast-paths.
 	 */
-	int flags;
+	int flags __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 	unsigned long min_alloc_buckets_order;
 	unsigned long min_nr_alloc_buckets;
-	struct ht_items_count *split_count;	/* split item count */
+	unsigned long bucket_mem;	/* bytes of allocated bucket tables */
+	int split_count_order;		/* log2 of split_count slots */
+	/* Negative lookup filters, with CDS_LFHT_FILTER */
+	struct lfht_filter *filter, *filter_next, *filter_prev;
+	/* Per-CPU operation statistics, see cds_lfht_get_op_stats() */
+	struct cds_lfht_op_stats *op_stats;
+	unsigned long op_stats_mask;	/* number of slots - 1 */
+	size_t op_stats_stride;		/* bytes between slots */
+	/* Resize policy, see struct cds_lfht_resize_policy */
+	int target_load_order, grow_load_order, shrink_load_order;
+	unsigned int grow_chain_len, max_grow_order, max_shrink_order;
 
 	/*
 	 * Variables needed for the lookup, add and remove fast-paths.
@@ -158,6 +201,19 @@ extern int cds_lfht_get_count_order_ulong(unsigned long x);
 #define poison_free(ptr)	free(ptr)
 #endif
 
+/* Free memory allocated with urcu_alloc() for the hash tables. */
+#ifdef POISON_FREE
+#define poison_free_lfht(ptr, size)				\
+	do {							\
+		if (ptr) {					\
+			memset(ptr, 0x42, size);		\
+			urcu_free(URCU_ALLOC_LFHT, ptr, size);	\
+		}						\
+	} while (0)
+#else
+#define poison_free_lfht(ptr, size)	urcu_free(URCU_ALLOC_LFHT, ptr, size)
+#endif
+
 static inline
 struct cds_lfht *__default_alloc_cds_lfht(
 		const struct cds_lfht_mm_type *mm,
@@ -167,10 +223,11 @@ struct cds_lfht *__default_alloc_cds_lfht(
 {
 	struct cds_lfht *ht;
 
-	ht = calloc(1, cds_lfht_size);
+	ht = urcu_cacheline_zalloc(URCU_ALLOC_LFHT, cds_lfht_size);
 	assert(ht);
 
 	ht->mm = mm;
+	ht->alloc_size = cds_lfht_size;
 	ht->bucket_at = mm->bucket_at;
 	ht->min_nr_alloc_buckets = min_nr_alloc_buckets;
 	ht->min_alloc_buckets_order =
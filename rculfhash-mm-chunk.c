@@ -27,15 +27,16 @@ static
 void cds_lfht_alloc_bucket_table(struct cds_lfht *ht, unsigned long order)
 {
 	if (order == 0) {
-		ht->tbl_chunk[0] = calloc(ht->min_nr_alloc_buckets,
-			sizeof(struct cds_lfht_node));
+		ht->tbl_chunk[0] = urcu_zalloc(URCU_ALLOC_LFHT,
+			ht->min_nr_alloc_buckets * sizeof(struct cds_lfht_node));
 		assert(ht->tbl_chunk[0]);
 	} else if (order > ht->min_alloc_buckets_order) {
 		unsigned long i, len = 1UL << (order - 1 - ht->min_alloc_buckets_order);
 
 		for (i = len; i < 2 * len; i++) {
-			ht->tbl_chunk[i] = calloc(ht->min_nr_alloc_buckets,
-				sizeof(struct cds_lfht_node));
+			ht->tbl_chunk[i] = urcu_zalloc(URCU_ALLOC_LFHT,
+				ht->min_nr_alloc_buckets
+				* sizeof(struct cds_lfht_node));
 			assert(ht->tbl_chunk[i]);
 		}
 	}
@@ -51,12 +52,15 @@ static
 void cds_lfht_free_bucket_table(struct cds_lfht *ht, unsigned long order)
 {
 	if (order == 0)
-		poison_free(ht->tbl_chunk[0]);
+		poison_free_lfht(ht->tbl_chunk[0],
+			ht->min_nr_alloc_buckets * sizeof(struct cds_lfht_node));
 	else if (order > ht->min_alloc_buckets_order) {
 		unsigned long i, len = 1UL << (order - 1 - ht->min_alloc_buckets_order);
 
 		for (i = len; i < 2 * len; i++)
-			poison_free(ht->tbl_chunk[i]);
+			poison_free_lfht(ht->tbl_chunk[i],
+				ht->min_nr_alloc_buckets
+				* sizeof(struct cds_lfht_node));
 	}
 	/* Nothing to do for 0 < order && order <= ht->min_alloc_buckets_order */
 }
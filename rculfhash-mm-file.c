@@ -0,0 +1,240 @@
+/*
+ * rculfhash-mm-file.c
+ *
+ * File-backed memory management for Lock-Free RCU Hash Table
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "rculfhash-internal.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS		MAP_ANON
+#endif
+
+/*
+ * Same layout as the mmap plugin: the whole bucket table is reserved
+ * when the hash table is created, and populated as the table grows,
+ * but each populated range is a shared mapping of an unlinked file of
+ * the directory set with cds_lfht_mm_file_set_dir(), e.g. on a DAX
+ * file system or a disk-backed one, so that the bucket tables need not
+ * fit in DRAM. The file grows with the table, and is truncated as the
+ * table shrinks, which also zeroes the buckets populated again.
+ *
+ * Without a directory, or if the file cannot be created, the table
+ * falls back on anonymous memory, as the mmap plugin.
+ */
+static pthread_mutex_t mm_file_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *mm_file_dir;
+
+int cds_lfht_mm_file_set_dir(const char *dir)
+{
+	char *new_dir = NULL, *old_dir;
+
+	if (dir) {
+		new_dir = strdup(dir);
+		if (!new_dir)
+			return -ENOMEM;
+	}
+	pthread_mutex_lock(&mm_file_lock);
+	old_dir = mm_file_dir;
+	mm_file_dir = new_dir;
+	pthread_mutex_unlock(&mm_file_lock);
+	free(old_dir);
+	return 0;
+}
+
+/* Return an unlinked file of the directory, or -1. */
+static int file_create(void)
+{
+	char path[PATH_MAX];
+	int fd = -1;
+
+	pthread_mutex_lock(&mm_file_lock);
+	if (!mm_file_dir)
+		goto end;
+#ifdef O_TMPFILE
+	fd = open(mm_file_dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+	if (fd >= 0)
+		goto end;
+#endif
+	/* The file system does not support O_TMPFILE. */
+	if (snprintf(path, sizeof(path), "%s/lfht-XXXXXX", mm_file_dir)
+			>= (int) sizeof(path))
+		goto end;
+	fd = mkstemp(path);
+	if (fd >= 0)
+		(void) unlink(path);
+end:
+	pthread_mutex_unlock(&mm_file_lock);
+	return fd;
+}
+
+/* reserve inaccessible memory space without allocation any memory */
+static void *memory_map(size_t length)
+{
+	void *ret = mmap(NULL, length, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	assert(ret != MAP_FAILED);
+	return ret;
+}
+
+static void memory_unmap(void *ptr, size_t length)
+{
+	int ret __attribute__((unused));
+
+	ret = munmap(ptr, length);
+
+	assert(ret == 0);
+}
+
+static void memory_populate(struct cds_lfht *ht, void *ptr, size_t length)
+{
+	off_t offset = (char *) ptr - (char *) ht->tbl_mmap;
+	void *ret;
+
+	if (ht->tbl_fd >= 0) {
+		if (!ftruncate(ht->tbl_fd, offset + length)) {
+			ret = mmap(ptr, length, PROT_READ | PROT_WRITE,
+					MAP_FIXED | MAP_SHARED, ht->tbl_fd,
+					offset);
+			if (ret == ptr)
+				return;
+		}
+		/* Out of file space: fall back on anonymous memory. */
+	}
+	ret = mmap(ptr, length, PROT_READ | PROT_WRITE,
+			MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(ret == ptr);
+}
+
+/*
+ * Discard garbage memory, and the end of the file. Make it still
+ * reserved, inaccessible.
+ */
+static void memory_discard(struct cds_lfht *ht, void *ptr, size_t length)
+{
+	off_t offset = (char *) ptr - (char *) ht->tbl_mmap;
+	void *ret __attribute__((unused));
+
+	ret = mmap(ptr, length, PROT_NONE,
+			MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(ret == ptr);
+	if (ht->tbl_fd >= 0)
+		(void) ftruncate(ht->tbl_fd, offset);
+}
+
+static
+void cds_lfht_alloc_bucket_table(struct cds_lfht *ht, unsigned long order)
+{
+	if (order == 0) {
+		ht->tbl_fd = -1;
+		if (ht->min_nr_alloc_buckets == ht->max_nr_buckets) {
+			/* small table */
+			ht->tbl_mmap = calloc(ht->max_nr_buckets,
+					sizeof(*ht->tbl_mmap));
+			assert(ht->tbl_mmap);
+			return;
+		}
+		/* large table */
+		ht->tbl_fd = file_create();
+		ht->tbl_mmap = memory_map(ht->max_nr_buckets
+			* sizeof(*ht->tbl_mmap));
+		memory_populate(ht, ht->tbl_mmap,
+			ht->min_nr_alloc_buckets * sizeof(*ht->tbl_mmap));
+	} else if (order > ht->min_alloc_buckets_order) {
+		/* large table */
+		unsigned long len = 1UL << (order - 1);
+
+		assert(ht->min_nr_alloc_buckets < ht->max_nr_buckets);
+		memory_populate(ht, ht->tbl_mmap + len,
+				len * sizeof(*ht->tbl_mmap));
+	}
+	/* Nothing to do for 0 < order && order <= ht->min_alloc_buckets_order */
+}
+
+/*
+ * cds_lfht_free_bucket_table() should be called with decreasing order.
+ * When cds_lfht_free_bucket_table(0) is called, it means the whole
+ * lfht is destroyed.
+ */
+static
+void cds_lfht_free_bucket_table(struct cds_lfht *ht, unsigned long order)
+{
+	if (order == 0) {
+		if (ht->min_nr_alloc_buckets == ht->max_nr_buckets) {
+			/* small table */
+			poison_free(ht->tbl_mmap);
+			return;
+		}
+		/* large table */
+		memory_unmap(ht->tbl_mmap,
+			ht->max_nr_buckets * sizeof(*ht->tbl_mmap));
+		if (ht->tbl_fd >= 0)
+			(void) close(ht->tbl_fd);
+	} else if (order > ht->min_alloc_buckets_order) {
+		/* large table */
+		unsigned long len = 1UL << (order - 1);
+
+		assert(ht->min_nr_alloc_buckets < ht->max_nr_buckets);
+		memory_discard(ht, ht->tbl_mmap + len,
+				len * sizeof(*ht->tbl_mmap));
+	}
+	/* Nothing to do for 0 < order && order <= ht->min_alloc_buckets_order */
+}
+
+static
+struct cds_lfht_node *bucket_at(struct cds_lfht *ht, unsigned long index)
+{
+	return &ht->tbl_mmap[index];
+}
+
+static
+struct cds_lfht *alloc_cds_lfht(unsigned long min_nr_alloc_buckets,
+		unsigned long max_nr_buckets)
+{
+	unsigned long page_bucket_size;
+
+	page_bucket_size = getpagesize() / sizeof(struct cds_lfht_node);
+	if (max_nr_buckets <= page_bucket_size) {
+		/* small table */
+		min_nr_alloc_buckets = max_nr_buckets;
+	} else {
+		/* large table */
+		min_nr_alloc_buckets = max(min_nr_alloc_buckets,
+					page_bucket_size);
+	}
+
+	return __default_alloc_cds_lfht(
+			&cds_lfht_mm_file, sizeof(struct cds_lfht),
+			min_nr_alloc_buckets, max_nr_buckets);
+}
+
+const struct cds_lfht_mm_type cds_lfht_mm_file = {
+	.alloc_cds_lfht = alloc_cds_lfht,
+	.alloc_bucket_table = cds_lfht_alloc_bucket_table,
+	.free_bucket_table = cds_lfht_free_bucket_table,
+	.bucket_at = bucket_at,
+};
@@ -0,0 +1,231 @@
+/*
+ * rculfhash-mm-hugepage.c
+ *
+ * Huge page backed mmap/reservation based memory management for Lock-Free
+ * RCU Hash Table
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include "rculfhash-internal.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS		MAP_ANON
+#endif
+
+/*
+ * Same layout as the mmap plugin: the whole bucket table is reserved
+ * when the hash table is created, and populated as the table grows.
+ * The reservation is aligned on the huge page size, so that each order
+ * spanning whole huge pages gets populated with MAP_HUGETLB pages.
+ * Populations which are too small, or for which no huge page is
+ * available, fall back on normal pages, advising the kernel to back
+ * them with transparent huge pages.
+ */
+#define DEFAULT_HUGEPAGE_SIZE	(2UL << 20)
+
+static unsigned long hugepage_size;
+
+/* Read the default huge page size, fall back on 2MB if unknown. */
+static unsigned long get_hugepage_size(void)
+{
+	unsigned long size = 0;
+	char line[128];
+	FILE *fp;
+
+	if (hugepage_size)
+		return hugepage_size;
+	fp = fopen("/proc/meminfo", "r");
+	if (fp) {
+		while (fgets(line, sizeof(line), fp)) {
+			if (sscanf(line, "Hugepagesize: %lu kB", &size) == 1) {
+				size <<= 10;
+				break;
+			}
+		}
+		fclose(fp);
+	}
+	if (!size || (size & (size - 1)))
+		size = DEFAULT_HUGEPAGE_SIZE;
+	hugepage_size = size;
+	return size;
+}
+
+/*
+ * Reserve inaccessible memory space without allocation any memory,
+ * aligned on the huge page size.
+ */
+static void *memory_map(size_t length)
+{
+	unsigned long align = get_hugepage_size();
+	uintptr_t start, aligned;
+	void *ret;
+	int ret_unmap __attribute__((unused));
+
+	ret = mmap(NULL, length + align, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(ret != MAP_FAILED);
+	start = (uintptr_t) ret;
+	aligned = (start + align - 1) & ~(align - 1);
+	/* Trim the reservation around the aligned range. */
+	if (aligned != start) {
+		ret_unmap = munmap(ret, aligned - start);
+		assert(ret_unmap == 0);
+	}
+	ret_unmap = munmap((void *) (aligned + length),
+			align - (aligned - start));
+	assert(ret_unmap == 0);
+	return (void *) aligned;
+}
+
+static void memory_unmap(void *ptr, size_t length)
+{
+	int ret __attribute__((unused));
+
+	ret = munmap(ptr, length);
+
+	assert(ret == 0);
+}
+
+static void memory_populate(void *ptr, size_t length)
+{
+	void *ret;
+
+#ifdef MAP_HUGETLB
+	if (!(((uintptr_t) ptr | length) & (get_hugepage_size() - 1))) {
+		ret = mmap(ptr, length, PROT_READ | PROT_WRITE,
+				MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS
+					| MAP_HUGETLB, -1, 0);
+		if (ret == ptr)
+			return;
+		/* No huge page available: fall back on normal pages. */
+	}
+#endif
+	ret = mmap(ptr, length, PROT_READ | PROT_WRITE,
+			MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(ret == ptr);
+#ifdef MADV_HUGEPAGE
+	/* Best effort: transparent huge pages may be disabled. */
+	(void) madvise(ptr, length, MADV_HUGEPAGE);
+#endif
+}
+
+/*
+ * Discard garbage memory and avoid system save it when try to swap it out.
+ * Make it still reserved, inaccessible.
+ */
+static void memory_discard(void *ptr, size_t length)
+{
+	void *ret __attribute__((unused));
+
+	ret = mmap(ptr, length, PROT_NONE,
+			MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	assert(ret == ptr);
+}
+
+static
+void cds_lfht_alloc_bucket_table(struct cds_lfht *ht, unsigned long order)
+{
+	if (order == 0) {
+		if (ht->min_nr_alloc_buckets == ht->max_nr_buckets) {
+			/* small table */
+			ht->tbl_mmap = calloc(ht->max_nr_buckets,
+					sizeof(*ht->tbl_mmap));
+			assert(ht->tbl_mmap);
+			return;
+		}
+		/* large table */
+		ht->tbl_mmap = memory_map(ht->max_nr_buckets
+			* sizeof(*ht->tbl_mmap));
+		memory_populate(ht->tbl_mmap,
+			ht->min_nr_alloc_buckets * sizeof(*ht->tbl_mmap));
+	} else if (order > ht->min_alloc_buckets_order) {
+		/* large table */
+		unsigned long len = 1UL << (order - 1);
+
+		assert(ht->min_nr_alloc_buckets < ht->max_nr_buckets);
+		memory_populate(ht->tbl_mmap + len,
+				len * sizeof(*ht->tbl_mmap));
+	}
+	/* Nothing to do for 0 < order && order <= ht->min_alloc_buckets_order */
+}
+
+/*
+ * cds_lfht_free_bucket_table() should be called with decreasing order.
+ * When cds_lfht_free_bucket_table(0) is called, it means the whole
+ * lfht is destroyed.
+ */
+static
+void cds_lfht_free_bucket_table(struct cds_lfht *ht, unsigned long order)
+{
+	if (order == 0) {
+		if (ht->min_nr_alloc_buckets == ht->max_nr_buckets) {
+			/* small table */
+			poison_free(ht->tbl_mmap);
+			return;
+		}
+		/* large table */
+		memory_unmap(ht->tbl_mmap,
+			ht->max_nr_buckets * sizeof(*ht->tbl_mmap));
+	} else if (order > ht->min_alloc_buckets_order) {
+		/* large table */
+		unsigned long len = 1UL << (order - 1);
+
+		assert(ht->min_nr_alloc_buckets < ht->max_nr_buckets);
+		memory_discard(ht->tbl_mmap + len, len * sizeof(*ht->tbl_mmap));
+	}
+	/* Nothing to do for 0 < order && order <= ht->min_alloc_buckets_order */
+}
+
+static
+struct cds_lfht_node *bucket_at(struct cds_lfht *ht, unsigned long index)
+{
+	return &ht->tbl_mmap[index];
+}
+
+static
+struct cds_lfht *alloc_cds_lfht(unsigned long min_nr_alloc_buckets,
+		unsigned long max_nr_buckets)
+{
+	unsigned long page_bucket_size;
+
+	page_bucket_size = getpagesize() / sizeof(struct cds_lfht_node);
+	if (max_nr_buckets <= page_bucket_size) {
+		/* small table */
+		min_nr_alloc_buckets = max_nr_buckets;
+	} else {
+		/* large table */
+		min_nr_alloc_buckets = max(min_nr_alloc_buckets,
+					page_bucket_size);
+	}
+
+	return __default_alloc_cds_lfht(
+			&cds_lfht_mm_hugepage, sizeof(struct cds_lfht),
+			min_nr_alloc_buckets, max_nr_buckets);
+}
+
+const struct cds_lfht_mm_type cds_lfht_mm_hugepage = {
+	.alloc_cds_lfht = alloc_cds_lfht,
+	.alloc_bucket_table = cds_lfht_alloc_bucket_table,
+	.free_bucket_table = cds_lfht_free_bucket_table,
+	.bucket_at = bucket_at,
+};
@@ -77,8 +77,9 @@ void cds_lfht_alloc_bucket_table(struct cds_lfht *ht, unsigned long order)
 	if (order == 0) {
 		if (ht->min_nr_alloc_buckets == ht->max_nr_buckets) {
 			/* small table */
-			ht->tbl_mmap = calloc(ht->max_nr_buckets,
-					sizeof(*ht->tbl_mmap));
+			ht->tbl_mmap = urcu_zalloc(URCU_ALLOC_LFHT,
+					ht->max_nr_buckets
+					* sizeof(*ht->tbl_mmap));
 			assert(ht->tbl_mmap);
 			return;
 		}
@@ -87,6 +88,8 @@ void cds_lfht_alloc_bucket_table(struct cds_lfht *ht, unsigned long order)
 			* sizeof(*ht->tbl_mmap));
 		memory_populate(ht->tbl_mmap,
 			ht->min_nr_alloc_buckets * sizeof(*ht->tbl_mmap));
+		urcu_alloc_account(URCU_ALLOC_LFHT,
+			ht->min_nr_alloc_buckets * sizeof(*ht->tbl_mmap));
 	} else if (order > ht->min_alloc_buckets_order) {
 		/* large table */
 		unsigned long len = 1UL << (order - 1);
@@ -94,6 +97,8 @@ void cds_lfht_alloc_bucket_table(struct cds_lfht *ht, unsigned long order)
 		assert(ht->min_nr_alloc_buckets < ht->max_nr_buckets);
 		memory_populate(ht->tbl_mmap + len,
 				len * sizeof(*ht->tbl_mmap));
+		urcu_alloc_account(URCU_ALLOC_LFHT,
+				len * sizeof(*ht->tbl_mmap));
 	}
 	/* Nothing to do for 0 < order && order <= ht->min_alloc_buckets_order */
 }
@@ -109,18 +114,24 @@ void cds_lfht_free_bucket_table(struct cds_lfht *ht, unsigned long order)
 	if (order == 0) {
 		if (ht->min_nr_alloc_buckets == ht->max_nr_buckets) {
 			/* small table */
-			poison_free(ht->tbl_mmap);
+			poison_free_lfht(ht->tbl_mmap,
+				ht->max_nr_buckets * sizeof(*ht->tbl_mmap));
 			return;
 		}
 		/* large table */
 		memory_unmap(ht->tbl_mmap,
 			ht->max_nr_buckets * sizeof(*ht->tbl_mmap));
+		urcu_alloc_account(URCU_ALLOC_LFHT,
+			-(long) (ht->min_nr_alloc_buckets
+				* sizeof(*ht->tbl_mmap)));
 	} else if (order > ht->min_alloc_buckets_order) {
 		/* large table */
 		unsigned long len = 1UL << (order - 1);
 
 		assert(ht->min_nr_alloc_buckets < ht->max_nr_buckets);
 		memory_discard(ht->tbl_mmap + len, len * sizeof(*ht->tbl_mmap));
+		urcu_alloc_account(URCU_ALLOC_LFHT,
+			-(long) (len * sizeof(*ht->tbl_mmap)));
 	}
 	/* Nothing to do for 0 < order && order <= ht->min_alloc_buckets_order */
 }
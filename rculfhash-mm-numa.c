@@ -0,0 +1,186 @@
+/*
+ * rculfhash-mm-numa.c
+ *
+ * NUMA-interleaved chunk based memory management for Lock-Free RCU Hash Table
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <rculfhash-internal.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS		MAP_ANON
+#endif
+
+/*
+ * Same layout as the chunk plugin, but each chunk is mapped separately
+ * and bound to a NUMA node, chunk i going to node (i % nr_nodes). The
+ * bucket table is initialized by the resize worker, so without an
+ * explicit policy all chunks would end up on the node of that thread.
+ * The preferred policy is used, so allocation falls back on other nodes
+ * when the chosen one is out of memory. Without NUMA support, this
+ * behaves as the chunk plugin.
+ *
+ * Chunks are at least one page large, so they can be bound separately.
+ */
+#define NUMA_MAX_NODES		(sizeof(unsigned long) * CHAR_BIT)
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED		1
+#endif
+
+static unsigned long numa_nr_nodes;
+
+/* Number of NUMA nodes, 1 if unknown. */
+static unsigned long get_nr_nodes(void)
+{
+	unsigned long nr = 0;
+	char path[64];
+
+	if (numa_nr_nodes)
+		return numa_nr_nodes;
+	for (;;) {
+		snprintf(path, sizeof(path),
+			"/sys/devices/system/node/node%lu", nr);
+		if (access(path, F_OK))
+			break;
+		nr++;
+	}
+	nr = min(max(nr, 1UL), NUMA_MAX_NODES);
+	numa_nr_nodes = nr;
+	return nr;
+}
+
+static void chunk_bind(void *ptr, size_t length, unsigned long chunk)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	unsigned long nodemask;
+
+	if (get_nr_nodes() == 1)
+		return;
+	nodemask = 1UL << (chunk % get_nr_nodes());
+	/* Best effort: keep the default policy on failure. */
+	(void) syscall(SYS_mbind, ptr, length, MPOL_PREFERRED, &nodemask,
+			NUMA_MAX_NODES + 1, 0);
+#endif
+}
+
+static size_t chunk_len(struct cds_lfht *ht)
+{
+	return ht->min_nr_alloc_buckets * sizeof(struct cds_lfht_node);
+}
+
+static void chunk_alloc(struct cds_lfht *ht, unsigned long chunk)
+{
+	void *ret;
+
+	ret = mmap(NULL, chunk_len(ht), PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(ret != MAP_FAILED);
+	/* Bind before the pages are touched. */
+	chunk_bind(ret, chunk_len(ht), chunk);
+	ht->tbl_chunk[chunk] = ret;
+}
+
+static void chunk_free(struct cds_lfht *ht, unsigned long chunk)
+{
+	int ret __attribute__((unused));
+
+	ret = munmap(ht->tbl_chunk[chunk], chunk_len(ht));
+	assert(ret == 0);
+	ht->tbl_chunk[chunk] = NULL;
+}
+
+static
+void cds_lfht_alloc_bucket_table(struct cds_lfht *ht, unsigned long order)
+{
+	if (order == 0) {
+		chunk_alloc(ht, 0);
+	} else if (order > ht->min_alloc_buckets_order) {
+		unsigned long i, len = 1UL << (order - 1 - ht->min_alloc_buckets_order);
+
+		for (i = len; i < 2 * len; i++)
+			chunk_alloc(ht, i);
+	}
+	/* Nothing to do for 0 < order && order <= ht->min_alloc_buckets_order */
+}
+
+/*
+ * cds_lfht_free_bucket_table() should be called with decreasing order.
+ * When cds_lfht_free_bucket_table(0) is called, it means the whole
+ * lfht is destroyed.
+ */
+static
+void cds_lfht_free_bucket_table(struct cds_lfht *ht, unsigned long order)
+{
+	if (order == 0)
+		chunk_free(ht, 0);
+	else if (order > ht->min_alloc_buckets_order) {
+		unsigned long i, len = 1UL << (order - 1 - ht->min_alloc_buckets_order);
+
+		for (i = len; i < 2 * len; i++)
+			chunk_free(ht, i);
+	}
+	/* Nothing to do for 0 < order && order <= ht->min_alloc_buckets_order */
+}
+
+static
+struct cds_lfht_node *bucket_at(struct cds_lfht *ht, unsigned long index)
+{
+	unsigned long chunk, offset;
+
+	chunk = index >> ht->min_alloc_buckets_order;
+	offset = index & (ht->min_nr_alloc_buckets - 1);
+	return &ht->tbl_chunk[chunk][offset];
+}
+
+static
+struct cds_lfht *alloc_cds_lfht(unsigned long min_nr_alloc_buckets,
+		unsigned long max_nr_buckets)
+{
+	unsigned long nr_chunks, cds_lfht_size, page_bucket_size;
+
+	page_bucket_size = getpagesize() / sizeof(struct cds_lfht_node);
+	min_nr_alloc_buckets = max(min_nr_alloc_buckets,
+				max_nr_buckets / MAX_CHUNK_TABLE);
+	min_nr_alloc_buckets = max(min_nr_alloc_buckets, page_bucket_size);
+	min_nr_alloc_buckets = min(min_nr_alloc_buckets, max_nr_buckets);
+	nr_chunks = max_nr_buckets / min_nr_alloc_buckets;
+	cds_lfht_size = offsetof(struct cds_lfht, tbl_chunk) +
+			sizeof(struct cds_lfht_node *) * nr_chunks;
+	cds_lfht_size = max(cds_lfht_size, sizeof(struct cds_lfht));
+
+	return __default_alloc_cds_lfht(
+			&cds_lfht_mm_numa, cds_lfht_size,
+			min_nr_alloc_buckets, max_nr_buckets);
+}
+
+const struct cds_lfht_mm_type cds_lfht_mm_numa = {
+	.alloc_cds_lfht = alloc_cds_lfht,
+	.alloc_bucket_table = cds_lfht_alloc_bucket_table,
+	.free_bucket_table = cds_lfht_free_bucket_table,
+	.bucket_at = bucket_at,
+};
@@ -27,12 +27,12 @@ static
 void cds_lfht_alloc_bucket_table(struct cds_lfht *ht, unsigned long order)
 {
 	if (order == 0) {
-		ht->tbl_order[0] = calloc(ht->min_nr_alloc_buckets,
-			sizeof(struct cds_lfht_node));
+		ht->tbl_order[0] = urcu_zalloc(URCU_ALLOC_LFHT,
+			ht->min_nr_alloc_buckets * sizeof(struct cds_lfht_node));
 		assert(ht->tbl_order[0]);
 	} else if (order > ht->min_alloc_buckets_order) {
-		ht->tbl_order[order] = calloc(1UL << (order -1),
-			sizeof(struct cds_lfht_node));
+		ht->tbl_order[order] = urcu_zalloc(URCU_ALLOC_LFHT,
+			(1UL << (order - 1)) * sizeof(struct cds_lfht_node));
 		assert(ht->tbl_order[order]);
 	}
 	/* Nothing to do for 0 < order && order <= ht->min_alloc_buckets_order */
@@ -47,9 +47,11 @@ static
 void cds_lfht_free_bucket_table(struct cds_lfht *ht, unsigned long order)
 {
 	if (order == 0)
-		poison_free(ht->tbl_order[0]);
+		poison_free_lfht(ht->tbl_order[0],
+			ht->min_nr_alloc_buckets * sizeof(struct cds_lfht_node));
 	else if (order > ht->min_alloc_buckets_order)
-		poison_free(ht->tbl_order[order]);
+		poison_free_lfht(ht->tbl_order[order],
+			(1UL << (order - 1)) * sizeof(struct cds_lfht_node));
 	/* Nothing to do for 0 < order && order <= ht->min_alloc_buckets_order */
 }
 
@@ -0,0 +1,135 @@
+/*
+ * rculfhash-shard.c
+ *
+ * Userspace RCU library - Sharded Lock-Free RCU Hash Table
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <urcu/compiler.h>
+#include <urcu/rculfhash-shard.h>
+
+struct cds_lfht_shard *_cds_lfht_shard_new(unsigned long nr_shards,
+			unsigned long init_size,
+			unsigned long min_nr_alloc_buckets,
+			unsigned long max_nr_buckets,
+			int flags,
+			const struct cds_lfht_mm_type *mm,
+			const struct rcu_flavor_struct *flavor,
+			pthread_attr_t *attr)
+{
+	struct cds_lfht_shard *sh;
+	unsigned long i;
+
+	if (!nr_shards || (nr_shards & (nr_shards - 1)))
+		return NULL;
+	sh = calloc(1, sizeof(*sh) + nr_shards * sizeof(sh->ht[0]));
+	if (!sh)
+		return NULL;
+	sh->mask = nr_shards - 1;
+	sh->order = __builtin_ctzl(nr_shards);
+	for (i = 0; i < nr_shards; i++) {
+		sh->ht[i] = _cds_lfht_new(init_size, min_nr_alloc_buckets,
+				max_nr_buckets, flags, mm, flavor, attr);
+		if (!sh->ht[i])
+			goto error;
+	}
+	return sh;
+
+error:
+	while (i--)
+		(void) cds_lfht_destroy(sh->ht[i], NULL);
+	free(sh);
+	return NULL;
+}
+
+int cds_lfht_shard_destroy(struct cds_lfht_shard *sh, pthread_attr_t **attr)
+{
+	unsigned long i;
+	int ret;
+
+	for (i = 0; i <= sh->mask; i++) {
+		if (!sh->ht[i])
+			continue;	/* Destroyed by a failed call */
+		ret = cds_lfht_destroy(sh->ht[i], attr);
+		if (ret)
+			return ret;
+		sh->ht[i] = NULL;
+	}
+	free(sh);
+	return 0;
+}
+
+void cds_lfht_shard_first(struct cds_lfht_shard *sh,
+		struct cds_lfht_shard_iter *iter)
+{
+	iter->index = 0;
+	cds_lfht_first(sh->ht[0], &iter->iter);
+	while (!iter->iter.node && iter->index < sh->mask)
+		cds_lfht_first(sh->ht[++iter->index], &iter->iter);
+}
+
+void cds_lfht_shard_next(struct cds_lfht_shard *sh,
+		struct cds_lfht_shard_iter *iter)
+{
+	cds_lfht_next(sh->ht[iter->index], &iter->iter);
+	while (!iter->iter.node && iter->index < sh->mask)
+		cds_lfht_first(sh->ht[++iter->index], &iter->iter);
+}
+
+void cds_lfht_shard_count_nodes(struct cds_lfht_shard *sh,
+		long *split_count_before,
+		unsigned long *count,
+		long *split_count_after)
+{
+	long before, after;
+	unsigned long i, nr;
+
+	*split_count_before = *split_count_after = 0;
+	*count = 0;
+	for (i = 0; i <= sh->mask; i++) {
+		cds_lfht_count_nodes(sh->ht[i], &before, &nr, &after);
+		*split_count_before += before;
+		*count += nr;
+		*split_count_after += after;
+	}
+}
+
+int cds_lfht_shard_size_approx(struct cds_lfht_shard *sh,
+		unsigned long *approx)
+{
+	unsigned long i, nr;
+	int ret;
+
+	*approx = 0;
+	for (i = 0; i <= sh->mask; i++) {
+		ret = cds_lfht_size_approx(sh->ht[i], &nr);
+		if (ret)
+			return ret;
+		*approx += nr;
+	}
+	return 0;
+}
+
+void cds_lfht_shard_resize(struct cds_lfht_shard *sh, unsigned long new_size)
+{
+	unsigned long i;
+
+	for (i = 0; i <= sh->mask; i++)
+		cds_lfht_resize(sh->ht[i], new_size);
+}
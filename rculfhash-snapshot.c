@@ -0,0 +1,281 @@
+/*
+ * rculfhash-snapshot.c
+ *
+ * Userspace RCU library - Versioned Lock-Free RCU Hash Table snapshots
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <urcu/compiler.h>
+#include <urcu/uatomic.h>
+#include <urcu-flavor.h>
+#include <urcu/rculfhash-snapshot.h>
+#include "urcu-die.h"
+
+/*
+ * A node deleted at generation e belongs to the snapshots of the
+ * generations before e, so it is only removed from the table once no
+ * snapshot of such a generation is held.
+ *
+ * cds_lfht_snapshot_take() closes generation G (incrementing the
+ * generation) and waits for a grace period: updates tagged with a
+ * generation up to G are performed within read-side critical sections
+ * started before the increment, and are thus complete and visible when
+ * the traversal starts. Updates tagged after G are ignored by the
+ * snapshot whether the traversal sees them or not.
+ *
+ * cds_lfht_vdel() reads the number of snapshots after tagging the node:
+ * if it sees none, a snapshot taken concurrently closes a generation
+ * not before the deletion, and does not need the node either.
+ */
+
+struct vnode_match_key {
+	cds_lfht_match_fct match;
+	const void *key;
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static
+struct cds_lfht_vnode *to_vnode(struct cds_lfht_node *node)
+{
+	return caa_container_of(node, struct cds_lfht_vnode, node);
+}
+
+/* Match the nodes not deleted. */
+static
+int vnode_match(struct cds_lfht_node *node, const void *key)
+{
+	const struct vnode_match_key *mkey = key;
+
+	if (CMM_LOAD_SHARED(to_vnode(node)->del_gen))
+		return 0;
+	return mkey->match(node, mkey->key);
+}
+
+/*
+ * Remove a list of deleted nodes from the table, outside of vt->lock.
+ * Only the thread which tagged a node removes it.
+ */
+static
+void vnodes_remove(struct cds_lfht_versioned *vt, struct cds_lfht_vnode *list)
+{
+	struct cds_lfht_vnode *vnode, *next;
+	int ret;
+
+	if (!list)
+		return;
+	vt->flavor->read_lock();
+	for (vnode = list; vnode; vnode = next) {
+		next = vnode->retired_next;
+		ret = cds_lfht_del(vt->ht, &vnode->node);
+		assert(!ret);
+	}
+	vt->flavor->read_unlock();
+}
+
+/* Minimum generation of the snapshots held, with vt->lock held. */
+static
+unsigned long snapshots_min_gen(struct cds_lfht_versioned *vt)
+{
+	struct cds_lfht_snapshot *snap;
+	unsigned long min = ULONG_MAX;
+
+	cds_list_for_each_entry(snap, &vt->snapshots, node) {
+		if (snap->gen < min)
+			min = snap->gen;
+	}
+	return min;
+}
+
+void _cds_lfht_versioned_init(struct cds_lfht_versioned *vt,
+		struct cds_lfht *ht, const struct rcu_flavor_struct *flavor)
+{
+	int ret;
+
+	vt->ht = ht;
+	vt->flavor = flavor;
+	vt->gen = 1;
+	vt->nr_snapshots = 0;
+	ret = pthread_mutex_init(&vt->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	CDS_INIT_LIST_HEAD(&vt->snapshots);
+	vt->retired = NULL;
+	vt->nr_retired = 0;
+}
+
+int cds_lfht_versioned_fini(struct cds_lfht_versioned *vt)
+{
+	struct cds_lfht_vnode *list;
+	int ret;
+
+	mutex_lock(&vt->lock);
+	if (vt->nr_snapshots) {
+		mutex_unlock(&vt->lock);
+		return -EBUSY;
+	}
+	list = vt->retired;
+	vt->retired = NULL;
+	vt->nr_retired = 0;
+	mutex_unlock(&vt->lock);
+	vnodes_remove(vt, list);
+	ret = pthread_mutex_destroy(&vt->lock);
+	if (ret)
+		urcu_die(ret);
+	return 0;
+}
+
+void cds_lfht_vadd(struct cds_lfht_versioned *vt, unsigned long hash,
+		struct cds_lfht_vnode *vnode)
+{
+	vnode->ins_gen = CMM_LOAD_SHARED(vt->gen);
+	vnode->del_gen = 0;
+	cds_lfht_add(vt->ht, hash, &vnode->node);
+}
+
+struct cds_lfht_node *cds_lfht_vadd_unique(struct cds_lfht_versioned *vt,
+		unsigned long hash, cds_lfht_match_fct match, const void *key,
+		struct cds_lfht_vnode *vnode)
+{
+	struct vnode_match_key mkey = { match, key };
+
+	vnode->ins_gen = CMM_LOAD_SHARED(vt->gen);
+	vnode->del_gen = 0;
+	return cds_lfht_add_unique(vt->ht, hash, vnode_match, &mkey,
+			&vnode->node);
+}
+
+void cds_lfht_vlookup(struct cds_lfht_versioned *vt, unsigned long hash,
+		cds_lfht_match_fct match, const void *key,
+		struct cds_lfht_iter *iter)
+{
+	struct vnode_match_key mkey = { match, key };
+
+	cds_lfht_lookup(vt->ht, hash, vnode_match, &mkey, iter);
+}
+
+int cds_lfht_vdel(struct cds_lfht_versioned *vt, struct cds_lfht_vnode *vnode)
+{
+	unsigned long gen = CMM_LOAD_SHARED(vt->gen);
+	int ret;
+
+	/* The cmpxchg orders the tag before the load of nr_snapshots. */
+	if (CMM_LOAD_SHARED(vnode->del_gen)
+			|| uatomic_cmpxchg(&vnode->del_gen, 0, gen) != 0)
+		return -ENOENT;
+	if (caa_likely(!CMM_LOAD_SHARED(vt->nr_snapshots)))
+		goto remove;
+	mutex_lock(&vt->lock);
+	if (snapshots_min_gen(vt) < gen) {
+		vnode->retired_next = vt->retired;
+		vt->retired = vnode;
+		vt->nr_retired++;
+		mutex_unlock(&vt->lock);
+		return 0;
+	}
+	mutex_unlock(&vt->lock);
+remove:
+	ret = cds_lfht_del(vt->ht, &vnode->node);
+	assert(!ret);
+	return 0;
+}
+
+void cds_lfht_snapshot_take(struct cds_lfht_versioned *vt,
+		struct cds_lfht_snapshot *snap)
+{
+	mutex_lock(&vt->lock);
+	CMM_STORE_SHARED(vt->nr_snapshots, vt->nr_snapshots + 1);
+	cmm_smp_mb();
+	snap->gen = vt->gen;
+	cds_list_add(&snap->node, &vt->snapshots);
+	uatomic_set(&vt->gen, snap->gen + 1);
+	mutex_unlock(&vt->lock);
+	/* Wait for the updates tagged with snap->gen and before. */
+	vt->flavor->update_synchronize_rcu();
+}
+
+void cds_lfht_snapshot_release(struct cds_lfht_versioned *vt,
+		struct cds_lfht_snapshot *snap)
+{
+	struct cds_lfht_vnode *vnode, **pprev, *list = NULL;
+	unsigned long min;
+
+	mutex_lock(&vt->lock);
+	cds_list_del(&snap->node);
+	CMM_STORE_SHARED(vt->nr_snapshots, vt->nr_snapshots - 1);
+	min = snapshots_min_gen(vt);
+	pprev = &vt->retired;
+	while ((vnode = *pprev) != NULL) {
+		if (vnode->del_gen <= min) {
+			*pprev = vnode->retired_next;
+			vnode->retired_next = list;
+			list = vnode;
+			vt->nr_retired--;
+		} else {
+			pprev = &vnode->retired_next;
+		}
+	}
+	mutex_unlock(&vt->lock);
+	vnodes_remove(vt, list);
+}
+
+static
+void snapshot_skip(const struct cds_lfht_snapshot *snap,
+		struct cds_lfht *ht, struct cds_lfht_iter *iter)
+{
+	struct cds_lfht_node *node;
+
+	while ((node = cds_lfht_iter_get_node(iter)) != NULL
+			&& !cds_lfht_snapshot_visible(snap, to_vnode(node)))
+		cds_lfht_next(ht, iter);
+}
+
+void cds_lfht_snapshot_first(struct cds_lfht_versioned *vt,
+		const struct cds_lfht_snapshot *snap,
+		struct cds_lfht_iter *iter)
+{
+	cds_lfht_first(vt->ht, iter);
+	snapshot_skip(snap, vt->ht, iter);
+}
+
+void cds_lfht_snapshot_next(struct cds_lfht_versioned *vt,
+		const struct cds_lfht_snapshot *snap,
+		struct cds_lfht_iter *iter)
+{
+	cds_lfht_next(vt->ht, iter);
+	snapshot_skip(snap, vt->ht, iter);
+}
@@ -262,29 +262,115 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <limits.h>
 #include <string.h>
 #include <sched.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "config.h"
+#ifdef HAVE_MINCORE
+#include <sys/mman.h>
+#endif
+#include <urcu/rseq.h>
+#if defined(RCULFHASH_FLAVOR_QSBR)
+#include <urcu-qsbr.h>
+#elif defined(RCULFHASH_FLAVOR_BP)
+#include <urcu-bp.h>
+#else
 #include <urcu.h>
+#endif
 #include <urcu-call-rcu.h>
 #include <urcu-flavor.h>
+#include <urcu-domain.h>
 #include <urcu/arch.h>
+#include <urcu/cacheline.h>
+#include <urcu/split-counter.h>
 #include <urcu/uatomic.h>
 #include <urcu/compiler.h>
+#include <urcu/futex.h>
+#include <urcu/tls-compat.h>
 #include <urcu/rculfhash.h>
+#include <urcu/static/rculfhash.h>
 #include <rculfhash-internal.h>
+#include "urcu-tp.h"
+#include "urcu-die.h"
 #include <stdio.h>
 #include <pthread.h>
 
+/*
+ * The liburcu-cds-<flavor> libraries are built with RCULFHASH_FLAVOR
+ * and the flavor selection macros (RCULFHASH_FLAVOR_QSBR,
+ * RCULFHASH_FLAVOR_BP, or RCU_MB/RCU_SIGNAL for urcu.h), binding the
+ * flavor at compile time: the RCU primitives of urcu/static/ are then
+ * inlined rather than called through struct rcu_flavor_struct. Hash
+ * tables created with another flavor are refused by such libraries.
+ */
+#ifdef RCULFHASH_FLAVOR
+#define ht_flavor_read_lock(ht)	rcu_read_lock()
+#define ht_flavor_read_unlock(ht)	rcu_read_unlock()
+#define ht_read_ongoing(ht)		rcu_read_ongoing()
+#define ht_thread_online(ht)		rcu_thread_online()
+#define ht_thread_offline(ht)		rcu_thread_offline()
+#define ht_register_thread(ht)		rcu_register_thread()
+#define ht_unregister_thread(ht)	rcu_unregister_thread()
+#define ht_flavor_synchronize_rcu(ht)	synchronize_rcu()
+#define ht_call_rcu(ht, head, func)	call_rcu(head, func)
+#define ht_call_rcu_fct(ht)		call_rcu
+#else
+#define ht_flavor_read_lock(ht)	((ht)->flavor->read_lock())
+#define ht_flavor_read_unlock(ht)	((ht)->flavor->read_unlock())
+#define ht_read_ongoing(ht)		((ht)->flavor->read_ongoing())
+#define ht_thread_online(ht)		((ht)->flavor->thread_online())
+#define ht_thread_offline(ht)		((ht)->flavor->thread_offline())
+#define ht_register_thread(ht)		((ht)->flavor->register_thread())
+#define ht_unregister_thread(ht)	((ht)->flavor->unregister_thread())
+#define ht_flavor_synchronize_rcu(ht)	((ht)->flavor->update_synchronize_rcu())
+#define ht_call_rcu(ht, head, func)	((ht)->flavor->update_call_rcu(head, func))
+#define ht_call_rcu_fct(ht)		((ht)->flavor->update_call_rcu)
+#endif
+
+/*
+ * Tables bound to a RCU domain with cds_lfht_set_domain() protect their
+ * traversals and wait for grace periods within that domain rather than
+ * with the flavor.
+ */
+static inline
+int ht_read_lock(struct cds_lfht *ht)
+{
+	if (ht->domain)
+		return rcu_read_lock_domain(ht->domain);
+	ht_flavor_read_lock(ht);
+	return 0;
+}
+
+static inline
+void ht_read_unlock(struct cds_lfht *ht, int idx)
+{
+	if (ht->domain)
+		rcu_read_unlock_domain(ht->domain, idx);
+	else
+		ht_flavor_read_unlock(ht);
+}
+
+static inline
+void ht_synchronize_rcu(struct cds_lfht *ht)
+{
+	if (ht->domain)
+		synchronize_rcu_domain(ht->domain);
+	else
+		ht_flavor_synchronize_rcu(ht);
+}
+
 /*
  * Split-counters lazily update the global counter each 1024
  * addition/removal. It automatically keeps track of resize required.
  * We use the bucket length as indicator for need to expand for small
  * tables and machines lacking per-cpu data support.
+ * CHAIN_LEN_TARGET and CHAIN_LEN_RESIZE_THRESHOLD are the default
+ * resize policy, see struct cds_lfht_resize_policy.
  */
 #define COUNT_COMMIT_ORDER		10
-#define DEFAULT_SPLIT_COUNT_MASK	0xFUL
 #define CHAIN_LEN_TARGET		1
 #define CHAIN_LEN_RESIZE_THRESHOLD	3
 
@@ -300,6 +386,16 @@
 #define MIN_PARTITION_PER_THREAD_ORDER	12
 #define MIN_PARTITION_PER_THREAD	(1UL << MIN_PARTITION_PER_THREAD_ORDER)
 
+/*
+ * Number of bucket nodes populated at once by a grow, and removed at
+ * once by a CDS_LFHT_INCREMENTAL_RESIZE shrink. The resize cursor holds the order being populated in
+ * its top bits and the index of the next slice in its low bits.
+ */
+#define RESIZE_SLICE_ORDER		8
+#define RESIZE_SLICE			(1UL << RESIZE_SLICE_ORDER)
+#define RESIZE_CURSOR_ORDER_SHIFT	(CAA_BITS_PER_LONG - 8)
+#define RESIZE_CURSOR_SLICE_MASK	((1UL << RESIZE_CURSOR_ORDER_SHIFT) - 1)
+
 /*
  * The removed flag needs to be updated atomically with the pointer.
  * It indicates that no node must attach to the node scheduled for
@@ -312,28 +408,14 @@
  * iteract with the "removal owner" flag, because it validates that
  * the "removed" flag is not set before performing its cmpxchg.
  */
-#define REMOVED_FLAG		(1UL << 0)
-#define BUCKET_FLAG		(1UL << 1)
-#define REMOVAL_OWNER_FLAG	(1UL << 2)
-#define FLAGS_MASK		((1UL << 3) - 1)
+#define REMOVED_FLAG		_CDS_LFHT_REMOVED_FLAG
+#define BUCKET_FLAG		_CDS_LFHT_BUCKET_FLAG
+#define REMOVAL_OWNER_FLAG	_CDS_LFHT_REMOVAL_OWNER_FLAG
+#define FLAGS_MASK		_CDS_LFHT_FLAGS_MASK
 
 /* Value of the end pointer. Should not interact with flags. */
 #define END_VALUE		NULL
 
-/*
- * ht_items_count: Split-counters counting the number of node addition
- * and removal in the table. Only used if the CDS_LFHT_ACCOUNTING flag
- * is set at hash table creation.
- *
- * These are free-running counters, never reset to zero. They count the
- * number of add/remove, and trigger every (1 << COUNT_COMMIT_ORDER)
- * operations to update the global counter. We choose a power-of-2 value
- * for the trigger to deal with 32 or 64-bit overflow of the counter.
- */
-struct ht_items_count {
-	unsigned long add, del;
-} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
-
 /*
  * rcu_resize_work: Contains arguments passed to RCU worker thread
  * responsible for performing lazy resize.
@@ -341,19 +423,36 @@ struct ht_items_count {
 struct rcu_resize_work {
 	struct rcu_head head;
 	struct cds_lfht *ht;
+	cds_lfht_resize_done_fct done;	/* cds_lfht_resize_async() */
+	void *priv;
 };
 
 /*
- * partition_resize_work: Contains arguments passed to worker threads
- * executing the hash table resize on partitions of the hash table
- * assigned to each processor's worker thread.
+ * cds_lfht_resize_pool: Persistent worker threads executing the hash
+ * table resize on partitions of the hash table. They are created with
+ * the table resize_attr on the first resize needing them, and park on
+ * the gen futex between jobs. Jobs are submitted with the resize mutex
+ * held, or by the table destruction, so only one job runs at a time.
  */
-struct partition_resize_work {
+struct resize_pool_worker {
 	pthread_t thread_id;
+	struct cds_lfht_resize_pool *pool;
+	int cpu;			/* CPU affinity, -1 if none */
+};
+
+struct cds_lfht_resize_pool {
 	struct cds_lfht *ht;
-	unsigned long i, start, len;
+	int32_t gen;			/* job generation, futex */
+	int32_t running;		/* workers within the job, futex */
+	int stop;
+	pid_t pid;			/* process owning the workers */
+	/* Current job, written before gen is incremented. */
 	void (*fct)(struct cds_lfht *ht, unsigned long i,
 		    unsigned long start, unsigned long len);
+	unsigned long i, partition_len, nr_partitions;
+	unsigned long next_partition;	/* next partition to claim */
+	unsigned int nr_workers;
+	struct resize_pool_worker workers[];
 };
 
 /*
@@ -561,9 +660,11 @@ static
 void cds_lfht_resize_lazy_count(struct cds_lfht *ht, unsigned long size,
 				unsigned long count);
 
+static
+int resize_async_launch(struct cds_lfht *ht, cds_lfht_resize_done_fct done,
+		void *priv);
+
 static long nr_cpus_mask = -1;
-static long split_count_mask = -1;
-static int split_count_order = -1;
 
 #if defined(HAVE_SYSCONF)
 static void ht_init_nr_cpus_mask(void)
@@ -589,119 +690,396 @@ static void ht_init_nr_cpus_mask(void)
 }
 #endif /* #else #if defined(HAVE_SYSCONF) */
 
+/*
+ * The item count is a split counter, only used if the
+ * CDS_LFHT_ACCOUNTING flag is set at hash table creation. Its slots
+ * commit every (1 << COUNT_COMMIT_ORDER) operations to the global
+ * approximate count, which triggers resizes.
+ */
 static
 void alloc_split_items_count(struct cds_lfht *ht)
 {
-	if (nr_cpus_mask == -1)	{
-		ht_init_nr_cpus_mask();
-		if (nr_cpus_mask < 0)
-			split_count_mask = DEFAULT_SPLIT_COUNT_MASK;
-		else
-			split_count_mask = nr_cpus_mask;
-		split_count_order =
-			cds_lfht_get_count_order_ulong(split_count_mask + 1);
-	}
+	int ret;
 
-	assert(split_count_mask >= 0);
+	if (nr_cpus_mask == -1)
+		ht_init_nr_cpus_mask();
 
 	if (ht->flags & CDS_LFHT_ACCOUNTING) {
-		ht->split_count = calloc(split_count_mask + 1,
-					sizeof(struct ht_items_count));
-		assert(ht->split_count);
-	} else {
-		ht->split_count = NULL;
+		ret = cds_split_counter_init(&ht->split_count,
+				COUNT_COMMIT_ORDER,
+				(ht->flags & CDS_LFHT_LAZY_ACCOUNTING) ?
+					CDS_SPLIT_COUNTER_LAZY : 0);
+		assert(!ret);
+		ht->split_count_order = cds_lfht_get_count_order_ulong(
+				cds_split_counter_nr_slots(&ht->split_count));
 	}
 }
 
 static
 void free_split_items_count(struct cds_lfht *ht)
 {
-	poison_free(ht->split_count);
+	if (ht->flags & CDS_LFHT_ACCOUNTING)
+		cds_split_counter_destroy(&ht->split_count);
+}
+
+/*
+ * Operation statistics, counted per CPU with CONFIG_RCU_LFHT_STATS, see
+ * cds_lfht_get_op_stats(). Without it, the hooks compile to nothing,
+ * along with the local counts they are passed.
+ */
+#ifdef CONFIG_RCU_LFHT_STATS
+
+/* Number of slots when the number of CPUs is unknown. */
+#define OP_STATS_DEFAULT_MASK	0xFUL
+
+static
+void alloc_op_stats(struct cds_lfht *ht)
+{
+	ht->op_stats_mask = nr_cpus_mask >= 0 ?
+			(unsigned long) nr_cpus_mask : OP_STATS_DEFAULT_MASK;
+	ht->op_stats_stride =
+		caa_cacheline_stride(sizeof(struct cds_lfht_op_stats));
+	/* Left NULL on allocation failure: the table is not counted. */
+	ht->op_stats = caa_cacheline_zalloc((ht->op_stats_mask + 1)
+			* ht->op_stats_stride);
+}
+
+static
+void free_op_stats(struct cds_lfht *ht)
+{
+	free(ht->op_stats);
+}
+
+static inline
+struct cds_lfht_op_stats *op_stats_slot(struct cds_lfht *ht,
+		unsigned long index)
+{
+	return (struct cds_lfht_op_stats *)
+		((char *) ht->op_stats + index * ht->op_stats_stride);
 }
 
-#if defined(HAVE_SCHED_GETCPU)
 static
-int ht_get_split_count_index(unsigned long hash)
+struct cds_lfht_op_stats *op_stats_this_cpu(struct cds_lfht *ht)
 {
 	int cpu;
 
-	assert(split_count_mask >= 0);
-	cpu = sched_getcpu();
+	cpu = urcu_rseq_cpu_id();
+#if defined(HAVE_SCHED_GETCPU)
 	if (caa_unlikely(cpu < 0))
-		return hash & split_count_mask;
-	else
-		return cpu & split_count_mask;
+		cpu = sched_getcpu();
+#endif
+	if (caa_unlikely(cpu < 0))
+		return op_stats_slot(ht, ((unsigned long) pthread_self() >> 8)
+				& ht->op_stats_mask);
+	return op_stats_slot(ht, (unsigned long) cpu & ht->op_stats_mask);
+}
+
+#define ht_op_stats_add(ht, field, v)					\
+	do {								\
+		if (caa_likely((ht)->op_stats))				\
+			uatomic_add_mo(&op_stats_this_cpu(ht)->field,	\
+				(v), CMM_RELAXED);			\
+	} while (0)
+
+static
+int read_op_stats(struct cds_lfht *ht, struct cds_lfht_op_stats *stats)
+{
+	unsigned long i;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!ht->op_stats)
+		return -ENOMEM;
+	for (i = 0; i <= ht->op_stats_mask; i++) {
+		struct cds_lfht_op_stats *slot = op_stats_slot(ht, i);
+
+		stats->nr_lookups += uatomic_read(&slot->nr_lookups);
+		stats->nr_lookup_nodes += uatomic_read(&slot->nr_lookup_nodes);
+		stats->nr_adds += uatomic_read(&slot->nr_adds);
+		stats->nr_dels += uatomic_read(&slot->nr_dels);
+		stats->nr_cas_retries += uatomic_read(&slot->nr_cas_retries);
+		stats->nr_gc_passes += uatomic_read(&slot->nr_gc_passes);
+		stats->nr_gc_helps += uatomic_read(&slot->nr_gc_helps);
+	}
+	return 0;
+}
+
+#else /* #ifdef CONFIG_RCU_LFHT_STATS */
+
+static
+void alloc_op_stats(struct cds_lfht *ht)
+{
+}
+
+static
+void free_op_stats(struct cds_lfht *ht)
+{
+}
+
+#define ht_op_stats_add(ht, field, v)	do { (void) (v); } while (0)
+
+static
+int read_op_stats(struct cds_lfht *ht, struct cds_lfht_op_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	return -ENOSYS;
+}
+
+#endif /* #else #ifdef CONFIG_RCU_LFHT_STATS */
+
+/*
+ * Negative lookup filter of CDS_LFHT_FILTER tables: a blocked counting
+ * Bloom filter of the node hashes. Each hash maps to FILTER_NR_HASHES
+ * 8-bit counters of a single cache-line block, so a lookup of an absent
+ * hash usually stops after loading one block. Saturated counters are
+ * never decremented.
+ *
+ * Additions count their hash in the filter before linking the node,
+ * and removals uncount it once they own the removal, so the filter
+ * never misses a node. See filter_rebuild() for resizes.
+ */
+#define FILTER_NR_HASHES	4
+#define FILTER_BLOCK_WORDS	(64 / sizeof(uint32_t))
+/* Buckets per filter block, log2. */
+#define FILTER_BUCKETS_ORDER	3
+
+struct lfht_filter {
+	unsigned long mask;		/* number of blocks - 1 */
+	uint32_t block[][FILTER_BLOCK_WORDS]
+		__attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+};
+
+/* Filters an addition counted its hash in, to undo it. */
+struct lfht_filter_ref {
+	struct lfht_filter *f[3];
+};
+
+static
+struct lfht_filter *filter_alloc(unsigned long size)
+{
+	unsigned long nr_blocks = max(size >> FILTER_BUCKETS_ORDER, 1UL);
+	struct lfht_filter *filter;
+
+	filter = caa_cacheline_zalloc(sizeof(*filter)
+			+ nr_blocks * sizeof(filter->block[0]));
+	if (!filter)
+		return NULL;
+	filter->mask = nr_blocks - 1;
+	return filter;
+}
+
+/* Hash the low bits index the buckets with: remix them. */
+static inline
+uint64_t filter_mix(unsigned long hash)
+{
+	uint64_t h = hash;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* Return 0 if no node of the filter has this hash. */
+static inline
+int filter_test(struct lfht_filter *filter, unsigned long hash)
+{
+	uint64_t h = filter_mix(hash);
+	uint32_t *block = filter->block[h & filter->mask];
+	unsigned int i;
+
+	h >>= 40;
+	for (i = 0; i < FILTER_NR_HASHES; i++, h >>= 6) {
+		if (!((CMM_LOAD_SHARED(block[(h & 63) / 4]) >> (8 * (h & 3)))
+				& 0xFF))
+			return 0;
+	}
+	return 1;
+}
+
+static
+void filter_update(struct lfht_filter *filter, unsigned long hash, int inc)
+{
+	uint64_t h = filter_mix(hash);
+	uint32_t *block = filter->block[h & filter->mask];
+	unsigned int i;
+
+	h >>= 40;
+	for (i = 0; i < FILTER_NR_HASHES; i++, h >>= 6) {
+		uint32_t *word = &block[(h & 63) / 4];
+		unsigned int shift = 8 * (h & 3);
+		uint32_t old, new, ret;
+
+		old = uatomic_read(word);
+		for (;;) {
+			if (((old >> shift) & 0xFF) == 0xFF)
+				break;		/* saturated */
+			assert(inc || ((old >> shift) & 0xFF));
+			new = inc ? old + (1U << shift) : old - (1U << shift);
+			ret = uatomic_cmpxchg(word, old, new);
+			if (ret == old)
+				break;
+			old = ret;
+		}
+	}
+}
+
+/*
+ * Count a hash in the filter, and in those being rebuilt or retired
+ * while a resize swaps filters.
+ */
+static
+void filter_add(struct cds_lfht *ht, unsigned long hash,
+		struct lfht_filter_ref *ref)
+{
+	struct lfht_filter *f[3];
+	unsigned int i;
+
+	f[0] = rcu_dereference(ht->filter);
+	f[1] = rcu_dereference(ht->filter_next);
+	f[2] = rcu_dereference(ht->filter_prev);
+	if (f[1] == f[0])
+		f[1] = NULL;
+	if (f[2] == f[0] || f[2] == f[1])
+		f[2] = NULL;
+	for (i = 0; i < 3; i++) {
+		if (f[i])
+			filter_update(f[i], hash, 1);
+		if (ref)
+			ref->f[i] = f[i];
+	}
+}
+
+/* An addition which linked no node uncounts its hash. */
+static
+void filter_undo(struct lfht_filter_ref *ref, unsigned long hash)
+{
+	unsigned int i;
+
+	for (i = 0; i < 3; i++) {
+		if (ref->f[i])
+			filter_update(ref->f[i], hash, 0);
+	}
+}
+
+static
+void filter_del(struct cds_lfht *ht, unsigned long hash)
+{
+	struct lfht_filter *filter = rcu_dereference(ht->filter);
+
+	if (filter)
+		filter_update(filter, hash, 0);
+}
+
+/* Return 0 if the table has no node of this hash. */
+static inline
+int filter_lookup(struct cds_lfht *ht, unsigned long hash)
+{
+	struct lfht_filter *filter = rcu_dereference(ht->filter);
+
+	return !filter || filter_test(filter, hash);
 }
-#else /* #if defined(HAVE_SCHED_GETCPU) */
+
+/*
+ * Per-thread lookup cache of CDS_LFHT_LOOKUP_CACHE tables, direct-mapped
+ * by hash. An entry holds the removal generation of its table when the
+ * node was found: every removal increments the generation once it has
+ * flagged the node, before its grace period starts, so a cached node
+ * whose generation is current is not freed before the end of the
+ * read-side critical section. Generations start apart for each table,
+ * so the entries of a destroyed table do not match a table later
+ * allocated at the same address.
+ */
+#define LOOKUP_CACHE_ORDER	6
+
+struct lookup_cache_entry {
+	struct cds_lfht *ht;
+	unsigned long hash;
+	unsigned long gen;
+	struct cds_lfht_node *node;
+};
+
+struct lookup_cache {
+	struct lookup_cache_entry entry[1UL << LOOKUP_CACHE_ORDER];
+};
+
+static DEFINE_URCU_TLS(struct lookup_cache, lookup_cache);
+static unsigned long lookup_cache_gen_seed;
+
 static
-int ht_get_split_count_index(unsigned long hash)
+void lookup_cache_init(struct cds_lfht *ht)
+{
+	ht->cache_gen = uatomic_add_return(&lookup_cache_gen_seed,
+			1UL << (CAA_BITS_PER_LONG / 2));
+}
+
+/* Called once the removal flag of a node is set. */
+static inline
+void lookup_cache_invalidate(struct cds_lfht *ht)
 {
-	return hash & split_count_mask;
+	if (!(ht->flags & CDS_LFHT_LOOKUP_CACHE))
+		return;
+	cmm_smp_mb();
+	uatomic_inc(&ht->cache_gen);
+}
+
+static inline
+struct lookup_cache_entry *lookup_cache_entry(unsigned long hash)
+{
+	return &URCU_TLS(lookup_cache).entry[hash
+			& ((1UL << LOOKUP_CACHE_ORDER) - 1)];
 }
-#endif /* #else #if defined(HAVE_SCHED_GETCPU) */
 
 static
 void ht_count_add(struct cds_lfht *ht, unsigned long size, unsigned long hash)
 {
-	unsigned long split_count;
-	int index;
 	long count;
 
-	if (caa_unlikely(!ht->split_count))
+	if (caa_unlikely(!(ht->flags & CDS_LFHT_ACCOUNTING)))
 		return;
-	index = ht_get_split_count_index(hash);
-	split_count = uatomic_add_return(&ht->split_count[index].add, 1);
-	if (caa_likely(split_count & ((1UL << COUNT_COMMIT_ORDER) - 1)))
+	if (caa_likely(!cds_split_counter_add(&ht->split_count, 1, &count)))
 		return;
 	/* Only if number of add multiple of 1UL << COUNT_COMMIT_ORDER */
 
-	dbg_printf("add split count %lu\n", split_count);
-	count = uatomic_add_return(&ht->count,
-				   1UL << COUNT_COMMIT_ORDER);
 	if (caa_likely(count & (count - 1)))
 		return;
 	/* Only if global count is power of 2 */
 
-	if ((count >> CHAIN_LEN_RESIZE_THRESHOLD) < size)
+	if ((count >> ht->grow_load_order) < size)
 		return;
 	dbg_printf("add set global %ld\n", count);
 	cds_lfht_resize_lazy_count(ht, size,
-		count >> (CHAIN_LEN_TARGET - 1));
+		count >> ht->target_load_order);
 }
 
 static
 void ht_count_del(struct cds_lfht *ht, unsigned long size, unsigned long hash)
 {
-	unsigned long split_count;
-	int index;
 	long count;
 
-	if (caa_unlikely(!ht->split_count))
+	if (caa_unlikely(!(ht->flags & CDS_LFHT_ACCOUNTING)))
 		return;
-	index = ht_get_split_count_index(hash);
-	split_count = uatomic_add_return(&ht->split_count[index].del, 1);
-	if (caa_likely(split_count & ((1UL << COUNT_COMMIT_ORDER) - 1)))
+	if (caa_likely(!cds_split_counter_sub(&ht->split_count, 1, &count)))
 		return;
 	/* Only if number of deletes multiple of 1UL << COUNT_COMMIT_ORDER */
 
-	dbg_printf("del split count %lu\n", split_count);
-	count = uatomic_add_return(&ht->count,
-				   -(1UL << COUNT_COMMIT_ORDER));
 	if (caa_likely(count & (count - 1)))
 		return;
 	/* Only if global count is power of 2 */
 
-	if ((count >> CHAIN_LEN_RESIZE_THRESHOLD) >= size)
+	if ((count >> ht->shrink_load_order) >= size)
 		return;
 	dbg_printf("del set global %ld\n", count);
 	/*
 	 * Don't shrink table if the number of nodes is below a
 	 * certain threshold.
 	 */
-	if (count < (1UL << COUNT_COMMIT_ORDER) * (split_count_mask + 1))
+	if (count < (1UL << COUNT_COMMIT_ORDER)
+			* cds_split_counter_nr_slots(&ht->split_count))
 		return;
 	cds_lfht_resize_lazy_count(ht, size,
-		count >> (CHAIN_LEN_TARGET - 1));
+		count >> ht->target_load_order);
 }
 
 static
@@ -711,28 +1089,30 @@ void check_resize(struct cds_lfht *ht, unsigned long size, uint32_t chain_len)
 
 	if (!(ht->flags & CDS_LFHT_AUTO_RESIZE))
 		return;
-	count = uatomic_read(&ht->count);
+	count = cds_split_counter_read_approx(&ht->split_count);
 	/*
 	 * Use bucket-local length for small table expand and for
 	 * environments lacking per-cpu data support.
 	 */
-	if (count >= (1UL << (COUNT_COMMIT_ORDER + split_count_order)))
+	if (count >= (1UL << (COUNT_COMMIT_ORDER + ht->split_count_order)))
 		return;
 	if (chain_len > 100)
 		dbg_printf("WARNING: large chain length: %u.\n",
 			   chain_len);
-	if (chain_len >= CHAIN_LEN_RESIZE_THRESHOLD) {
+	if (chain_len >= ht->grow_chain_len) {
 		int growth;
 
 		/*
 		 * Ideal growth calculated based on chain length.
 		 */
-		growth = cds_lfht_get_count_order_u32(chain_len
-				- (CHAIN_LEN_TARGET - 1));
+		growth = cds_lfht_get_count_order_u32(chain_len)
+				- ht->target_load_order;
+		if (growth <= 0)
+			return;
 		if ((ht->flags & CDS_LFHT_ACCOUNTING)
 				&& (size << growth)
 					>= (1UL << (COUNT_COMMIT_ORDER
-						+ split_count_order))) {
+						+ ht->split_count_order))) {
 			/*
 			 * If ideal growth expands the hash table size
 			 * beyond the "small hash table" sizes, use the
@@ -742,7 +1122,7 @@ void check_resize(struct cds_lfht *ht, unsigned long size, uint32_t chain_len)
 			 * the chain length is used to expand the hash
 			 * table in every case.
 			 */
-			growth = COUNT_COMMIT_ORDER + split_count_order
+			growth = COUNT_COMMIT_ORDER + ht->split_count_order
 				- cds_lfht_get_count_order_ulong(size);
 			if (growth <= 0)
 				return;
@@ -820,10 +1200,27 @@ unsigned long _uatomic_xchg_monotonic_increase(unsigned long *ptr,
 	return old2;
 }
 
+/*
+ * Number of bucket nodes allocated by the memory management plugin
+ * for an order: orders up to min_alloc_buckets_order share the order 0
+ * allocation.
+ */
+static
+unsigned long bucket_table_len(struct cds_lfht *ht, unsigned long order)
+{
+	if (order == 0)
+		return ht->min_nr_alloc_buckets;
+	if (order > ht->min_alloc_buckets_order)
+		return 1UL << (order - 1);
+	return 0;
+}
+
 static
 void cds_lfht_alloc_bucket_table(struct cds_lfht *ht, unsigned long order)
 {
-	return ht->mm->alloc_bucket_table(ht, order);
+	ht->mm->alloc_bucket_table(ht, order);
+	CMM_STORE_SHARED(ht->bucket_mem, ht->bucket_mem
+		+ bucket_table_len(ht, order) * sizeof(struct cds_lfht_node));
 }
 
 /*
@@ -834,7 +1231,9 @@ void cds_lfht_alloc_bucket_table(struct cds_lfht *ht, unsigned long order)
 static
 void cds_lfht_free_bucket_table(struct cds_lfht *ht, unsigned long order)
 {
-	return ht->mm->free_bucket_table(ht, order);
+	ht->mm->free_bucket_table(ht, order);
+	CMM_STORE_SHARED(ht->bucket_mem, ht->bucket_mem
+		- bucket_table_len(ht, order) * sizeof(struct cds_lfht_node));
 }
 
 static inline
@@ -896,7 +1295,14 @@ void _cds_lfht_gc_bucket(struct cds_lfht_node *bucket, struct cds_lfht_node *nod
 			new_next = flag_bucket(clear_flag(next));
 		else
 			new_next = clear_flag(next);
-		(void) uatomic_cmpxchg(&iter_prev->next, iter, new_next);
+		/*
+		 * Unlinking logically removed nodes is not a commit point
+		 * of the update operations: release semantic is enough to
+		 * keep the next node initialization ordered for readers
+		 * reaching it through iter_prev.
+		 */
+		(void) uatomic_cmpxchg_mo(&iter_prev->next, iter, new_next,
+				CMM_RELEASE, CMM_RELAXED);
 	}
 }
 
@@ -955,8 +1361,10 @@ int _cds_lfht_replace(struct cds_lfht *ht, unsigned long size,
 			old_next, flag_removed_or_removal_owner(new_node));
 		if (ret_next == old_next)
 			break;		/* We performed the replacement. */
+		ht_op_stats_add(ht, nr_cas_retries, 1);
 		old_next = ret_next;
 	}
+	lookup_cache_invalidate(ht);
 
 	/*
 	 * Ensure that the old node is not visible to readers anymore:
@@ -965,14 +1373,28 @@ int _cds_lfht_replace(struct cds_lfht *ht, unsigned long size,
 	 */
 	bucket = lookup_bucket(ht, size, bit_reverse_ulong(old_node->reverse_hash));
 	_cds_lfht_gc_bucket(bucket, new_node);
+	ht_op_stats_add(ht, nr_gc_passes, 1);
 
 	assert(is_removed(CMM_LOAD_SHARED(old_node->next)));
 	return 0;
 }
 
+/*
+ * Node constructor of cds_lfht_lookup_or_add().
+ */
+struct lfht_create {
+	cds_lfht_create_fct create;
+	cds_lfht_discard_fct discard;
+	void *priv;
+	struct cds_lfht_node *node;	/* created node */
+};
+
 /*
  * A non-NULL unique_ret pointer uses the "add unique" (or uniquify) add
  * mode. A NULL unique_ret allows creation of duplicate keys.
+ * A non-NULL create (unique mode only) is called with a NULL node, which
+ * is created on the first insertion attempt, once the key is known to
+ * be absent.
  */
 static
 void _cds_lfht_add(struct cds_lfht *ht,
@@ -982,15 +1404,27 @@ void _cds_lfht_add(struct cds_lfht *ht,
 		unsigned long size,
 		struct cds_lfht_node *node,
 		struct cds_lfht_iter *unique_ret,
-		int bucket_flag)
+		int bucket_flag,
+		struct lfht_create *create)
 {
 	struct cds_lfht_node *iter_prev, *iter, *next, *new_node, *new_next,
 			*return_node;
 	struct cds_lfht_node *bucket;
+	struct lfht_filter_ref fref;
+	unsigned long reverse_hash;
 
-	assert(!is_bucket(node));
-	assert(!is_removed(node));
-	assert(!is_removal_owner(node));
+	/* With create, node is only created when reaching the insert. */
+	if (create) {
+		assert(unique_ret && !node);
+		reverse_hash = bit_reverse_ulong(hash);
+	} else {
+		assert(!is_bucket(node));
+		assert(!is_removed(node));
+		assert(!is_removal_owner(node));
+		reverse_hash = node->reverse_hash;
+	}
+	if (!bucket_flag)
+		filter_add(ht, hash, &fref);
 	bucket = lookup_bucket(ht, size, hash);
 	for (;;) {
 		uint32_t chain_len = 0;
@@ -1002,15 +1436,15 @@ void _cds_lfht_add(struct cds_lfht *ht,
 		iter_prev = bucket;
 		/* We can always skip the bucket node initially */
 		iter = rcu_dereference(iter_prev->next);
-		assert(iter_prev->reverse_hash <= node->reverse_hash);
+		assert(iter_prev->reverse_hash <= reverse_hash);
 		for (;;) {
 			if (caa_unlikely(is_end(iter)))
 				goto insert;
-			if (caa_likely(clear_flag(iter)->reverse_hash > node->reverse_hash))
+			if (caa_likely(clear_flag(iter)->reverse_hash > reverse_hash))
 				goto insert;
 
 			/* bucket node is the first node of the identical-hash-value chain */
-			if (bucket_flag && clear_flag(iter)->reverse_hash == node->reverse_hash)
+			if (bucket_flag && clear_flag(iter)->reverse_hash == reverse_hash)
 				goto insert;
 
 			next = rcu_dereference(clear_flag(iter)->next);
@@ -1020,8 +1454,10 @@ void _cds_lfht_add(struct cds_lfht *ht,
 			/* uniquely add */
 			if (unique_ret
 			    && !is_bucket(next)
-			    && clear_flag(iter)->reverse_hash == node->reverse_hash) {
-				struct cds_lfht_iter d_iter = { .node = node, .next = iter, };
+			    && clear_flag(iter)->reverse_hash == reverse_hash) {
+				struct cds_lfht_iter d_iter = {
+					.node = clear_flag(iter), .next = iter,
+				};
 
 				/*
 				 * uniquely adding inserts the node as the first
@@ -1036,6 +1472,10 @@ void _cds_lfht_add(struct cds_lfht *ht,
 				if (!d_iter.node)
 					goto insert;
 
+				/* Lost a race: the created node is unused. */
+				if (create && node)
+					create->discard(node, create->priv);
+				filter_undo(&fref, hash);
 				*unique_ret = d_iter;
 				return;
 			}
@@ -1049,6 +1489,17 @@ void _cds_lfht_add(struct cds_lfht *ht,
 		}
 
 	insert:
+		if (create && !node) {
+			node = create->create(key, create->priv);
+			create->node = node;
+			if (!node) {
+				filter_undo(&fref, hash);
+				unique_ret->node = NULL;
+				unique_ret->next = NULL;
+				return;
+			}
+			node->reverse_hash = reverse_hash;
+		}
 		assert(node != clear_flag(iter));
 		assert(!is_removed(iter_prev));
 		assert(!is_removal_owner(iter_prev));
@@ -1065,8 +1516,11 @@ void _cds_lfht_add(struct cds_lfht *ht,
 			new_node = node;
 		if (uatomic_cmpxchg(&iter_prev->next, iter,
 				    new_node) != iter) {
+			ht_op_stats_add(ht, nr_cas_retries, 1);
 			continue;	/* retry */
 		} else {
+			if (!bucket_flag)
+				ht_op_stats_add(ht, nr_adds, 1);
 			return_node = node;
 			goto end;
 		}
@@ -1078,7 +1532,9 @@ void _cds_lfht_add(struct cds_lfht *ht,
 			new_next = flag_bucket(clear_flag(next));
 		else
 			new_next = clear_flag(next);
-		(void) uatomic_cmpxchg(&iter_prev->next, iter, new_next);
+		(void) uatomic_cmpxchg_mo(&iter_prev->next, iter, new_next,
+				CMM_RELEASE, CMM_RELAXED);
+		ht_op_stats_add(ht, nr_gc_helps, 1);
 		/* retry */
 	}
 end:
@@ -1088,153 +1544,452 @@ end:
 	}
 }
 
+/*
+ * Insert nodes[0] and the following nodes of the array (sorted by
+ * reverse hash) which share its insertion point, linking them together
+ * and committing them with a single cmpxchg. Returns the number of
+ * nodes inserted.
+ */
 static
-int _cds_lfht_del(struct cds_lfht *ht, unsigned long size,
-		struct cds_lfht_node *node)
+unsigned long _cds_lfht_add_run(struct cds_lfht *ht,
+		unsigned long size,
+		struct cds_lfht_node **nodes,
+		unsigned long nr)
 {
-	struct cds_lfht_node *bucket, *next;
-
-	if (!node)	/* Return -ENOENT if asked to delete NULL node */
-		return -ENOENT;
-
-	/* logically delete the node */
-	assert(!is_bucket(node));
-	assert(!is_removed(node));
-	assert(!is_removal_owner(node));
-
-	/*
-	 * We are first checking if the node had previously been
-	 * logically removed (this check is not atomic with setting the
-	 * logical removal flag). Return -ENOENT if the node had
-	 * previously been removed.
-	 */
-	next = CMM_LOAD_SHARED(node->next);	/* next is not dereferenced */
-	if (caa_unlikely(is_removed(next)))
-		return -ENOENT;
-	assert(!is_bucket(next));
-	/*
-	 * The del operation semantic guarantees a full memory barrier
-	 * before the uatomic_or atomic commit of the deletion flag.
-	 */
-	cmm_smp_mb__before_uatomic_or();
-	/*
-	 * We set the REMOVED_FLAG unconditionally. Note that there may
-	 * be more than one concurrent thread setting this flag.
-	 * Knowing which wins the race will be known after the garbage
-	 * collection phase, stay tuned!
-	 */
-	uatomic_or(&node->next, REMOVED_FLAG);
-	/* We performed the (logical) deletion. */
+	struct cds_lfht_node *iter_prev, *iter, *next, *new_node, *new_next;
+	struct cds_lfht_node *bucket, *node = nodes[0];
+	unsigned long i;
 
-	/*
-	 * Ensure that the node is not visible to readers anymore: lookup for
-	 * the node, and remove it (along with any other logically removed node)
-	 * if found.
-	 */
 	bucket = lookup_bucket(ht, size, bit_reverse_ulong(node->reverse_hash));
-	_cds_lfht_gc_bucket(bucket, node);
+	for (;;) {
+		uint32_t chain_len = 0;
 
-	assert(is_removed(CMM_LOAD_SHARED(node->next)));
-	/*
-	 * Last phase: atomically exchange node->next with a version
-	 * having "REMOVAL_OWNER_FLAG" set. If the returned node->next
-	 * pointer did _not_ have "REMOVAL_OWNER_FLAG" set, we now own
-	 * the node and win the removal race.
-	 * It is interesting to note that all "add" paths are forbidden
-	 * to change the next pointer starting from the point where the
-	 * REMOVED_FLAG is set, so here using a read, followed by a
-	 * xchg() suffice to guarantee that the xchg() will ever only
-	 * set the "REMOVAL_OWNER_FLAG" (or change nothing if the flag
-	 * was already set).
-	 */
-	if (!is_removal_owner(uatomic_xchg(&node->next,
-			flag_removal_owner(node->next))))
-		return 0;
-	else
-		return -ENOENT;
+		/*
+		 * iter_prev points to the non-removed node prior to the
+		 * insert location.
+		 */
+		iter_prev = bucket;
+		/* We can always skip the bucket node initially */
+		iter = rcu_dereference(iter_prev->next);
+		assert(iter_prev->reverse_hash <= node->reverse_hash);
+		for (;;) {
+			if (caa_unlikely(is_end(iter)))
+				goto insert;
+			if (caa_likely(clear_flag(iter)->reverse_hash > node->reverse_hash))
+				goto insert;
+			next = rcu_dereference(clear_flag(iter)->next);
+			if (caa_unlikely(is_removed(next)))
+				goto gc_node;
+			/* Only account for identical reverse hash once */
+			if (iter_prev->reverse_hash != clear_flag(iter)->reverse_hash
+			    && !is_bucket(next))
+				check_resize(ht, size, ++chain_len);
+			iter_prev = clear_flag(iter);
+			iter = next;
+		}
+
+	insert:
+		assert(!is_removed(iter_prev));
+		assert(!is_removal_owner(iter_prev));
+		assert(!is_removed(iter));
+		assert(!is_removal_owner(iter));
+		/* Chain the following nodes sorting before iter. */
+		for (i = 1; i < nr; i++) {
+			if (!is_end(iter)
+			    && clear_flag(iter)->reverse_hash <= nodes[i]->reverse_hash)
+				break;
+			nodes[i - 1]->next = nodes[i];
+		}
+		nodes[i - 1]->next = clear_flag(iter);
+		if (is_bucket(iter))
+			new_node = flag_bucket(node);
+		else
+			new_node = node;
+		if (uatomic_cmpxchg(&iter_prev->next, iter,
+				    new_node) != iter) {
+			ht_op_stats_add(ht, nr_cas_retries, 1);
+			continue;	/* retry */
+		}
+		ht_op_stats_add(ht, nr_adds, i);
+		return i;
+
+	gc_node:
+		assert(!is_removed(iter));
+		assert(!is_removal_owner(iter));
+		if (is_bucket(iter))
+			new_next = flag_bucket(clear_flag(next));
+		else
+			new_next = clear_flag(next);
+		(void) uatomic_cmpxchg_mo(&iter_prev->next, iter, new_next,
+				CMM_RELEASE, CMM_RELAXED);
+		ht_op_stats_add(ht, nr_gc_helps, 1);
+		/* retry */
+	}
 }
 
+/*
+ * Logically delete a node. Return -ENOENT if the node had already been
+ * logically removed.
+ */
 static
-void *partition_resize_thread(void *arg)
+int _cds_lfht_del_mark(struct cds_lfht_node *node)
 {
-	struct partition_resize_work *work = arg;
+	struct cds_lfht_node *next;
 
-	work->ht->flavor->register_thread();
-	work->fct(work->ht, work->i, work->start, work->len);
-	work->ht->flavor->unregister_thread();
-	return NULL;
+	/* logically delete the node */
+	assert(!is_bucket(node));
+	assert(!is_removed(node));
+	assert(!is_removal_owner(node));
+
+	/*
+	 * We are first checking if the node had previously been
+	 * logically removed (this check is not atomic with setting the
+	 * logical removal flag). Return -ENOENT if the node had
+	 * previously been removed.
+	 */
+	next = CMM_LOAD_SHARED(node->next);	/* next is not dereferenced */
+	if (caa_unlikely(is_removed(next)))
+		return -ENOENT;
+	assert(!is_bucket(next));
+	/*
+	 * The del operation semantic guarantees a full memory barrier
+	 * before the uatomic_or atomic commit of the deletion flag.
+	 */
+	cmm_smp_mb__before_uatomic_or();
+	/*
+	 * We set the REMOVED_FLAG unconditionally. Note that there may
+	 * be more than one concurrent thread setting this flag.
+	 * Knowing which wins the race will be known after the garbage
+	 * collection phase, stay tuned!
+	 */
+	uatomic_or(&node->next, REMOVED_FLAG);
+	/* We performed the (logical) deletion. */
+	return 0;
 }
 
+/*
+ * Called on a logically deleted node, once it has been garbage
+ * collected from its bucket. Return 0 if we own the removal.
+ */
 static
-void partition_resize_helper(struct cds_lfht *ht, unsigned long i,
-		unsigned long len,
-		void (*fct)(struct cds_lfht *ht, unsigned long i,
-			unsigned long start, unsigned long len))
+int _cds_lfht_del_owner(struct cds_lfht_node *node)
+{
+	assert(is_removed(CMM_LOAD_SHARED(node->next)));
+	/*
+	 * Last phase: atomically exchange node->next with a version
+	 * having "REMOVAL_OWNER_FLAG" set. If the returned node->next
+	 * pointer did _not_ have "REMOVAL_OWNER_FLAG" set, we now own
+	 * the node and win the removal race.
+	 * It is interesting to note that all "add" paths are forbidden
+	 * to change the next pointer starting from the point where the
+	 * REMOVED_FLAG is set, so here using a read, followed by a
+	 * xchg() suffice to guarantee that the xchg() will ever only
+	 * set the "REMOVAL_OWNER_FLAG" (or change nothing if the flag
+	 * was already set).
+	 */
+	if (!is_removal_owner(uatomic_xchg(&node->next,
+			flag_removal_owner(node->next))))
+		return 0;
+	else
+		return -ENOENT;
+}
+
+static
+int _cds_lfht_del(struct cds_lfht *ht, unsigned long size,
+		struct cds_lfht_node *node)
 {
-	unsigned long partition_len, start = 0;
-	struct partition_resize_work *work;
-	int thread, ret;
-	unsigned long nr_threads;
+	struct cds_lfht_node *bucket;
+	int ret;
 
-	assert(nr_cpus_mask != -1);
-	if (nr_cpus_mask < 0 || len < 2 * MIN_PARTITION_PER_THREAD)
-		goto fallback;
+	if (!node)	/* Return -ENOENT if asked to delete NULL node */
+		return -ENOENT;
+
+	ret = _cds_lfht_del_mark(node);
+	if (ret)
+		return ret;
+	lookup_cache_invalidate(ht);
 
 	/*
-	 * Note: nr_cpus_mask + 1 is always power of 2.
-	 * We spawn just the number of threads we need to satisfy the minimum
-	 * partition size, up to the number of CPUs in the system.
+	 * Ensure that the node is not visible to readers anymore: lookup for
+	 * the node, and remove it (along with any other logically removed node)
+	 * if found.
 	 */
-	if (nr_cpus_mask > 0) {
-		nr_threads = min(nr_cpus_mask + 1,
-				 len >> MIN_PARTITION_PER_THREAD_ORDER);
-	} else {
-		nr_threads = 1;
+	bucket = lookup_bucket(ht, size, bit_reverse_ulong(node->reverse_hash));
+	_cds_lfht_gc_bucket(bucket, node);
+	ht_op_stats_add(ht, nr_gc_passes, 1);
+
+	ret = _cds_lfht_del_owner(node);
+	if (!ret) {
+		filter_del(ht, bit_reverse_ulong(node->reverse_hash));
+		ht_op_stats_add(ht, nr_dels, 1);
+	}
+	return ret;
+}
+
+/*
+ * Process the partitions of the current job until none is left to
+ * claim. Called by the pool workers and by the thread submitting the
+ * job, offline.
+ */
+static
+void resize_pool_run(struct cds_lfht_resize_pool *pool)
+{
+	struct cds_lfht *ht = pool->ht;
+	unsigned long part;
+
+	for (;;) {
+		part = uatomic_add_return(&pool->next_partition, 1) - 1;
+		if (part >= pool->nr_partitions)
+			break;
+		ht_thread_online(ht);
+		pool->fct(ht, pool->i, part * pool->partition_len,
+			pool->partition_len);
+		ht_thread_offline(ht);
+	}
+}
+
+#if HAVE_SCHED_SETAFFINITY
+static
+void resize_pool_set_affinity(int cpu)
+{
+	cpu_set_t mask;
+
+	if (cpu < 0 || cpu >= CPU_SETSIZE)
+		return;
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	(void) sched_setaffinity(0, &mask);
+#else
+	(void) sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+}
+#else
+static
+void resize_pool_set_affinity(int cpu)
+{
+}
+#endif
+
+static
+void *resize_pool_thread(void *arg)
+{
+	struct resize_pool_worker *worker = arg;
+	struct cds_lfht_resize_pool *pool = worker->pool;
+	int32_t gen = 0;
+
+	resize_pool_set_affinity(worker->cpu);
+	for (;;) {
+		/* Read gen before reading the job. */
+		while (uatomic_read(&pool->gen) == gen)
+			futex_async(&pool->gen, FUTEX_WAIT, gen,
+				NULL, NULL, 0);
+		cmm_smp_mb();
+		gen = uatomic_read(&pool->gen);
+		if (uatomic_read(&pool->stop))
+			break;
+
+		/*
+		 * Stay unregistered while parked, so we neither delay
+		 * grace periods (QSBR) nor leave stale registry entries
+		 * in the child of a fork.
+		 */
+		ht_register_thread(pool->ht);
+		ht_thread_offline(pool->ht);
+		resize_pool_run(pool);
+		ht_unregister_thread(pool->ht);
+
+		cmm_smp_mb__before_uatomic_dec();
+		if (!uatomic_sub_return(&pool->running, 1))
+			futex_async(&pool->running, FUTEX_WAKE, 1,
+				NULL, NULL, 0);
+	}
+	return NULL;
+}
+
+/*
+ * Kick the pool workers: either to process a new job, or to stop.
+ */
+static
+void resize_pool_kick(struct cds_lfht_resize_pool *pool)
+{
+	uatomic_set(&pool->running, pool->nr_workers);
+	/* Write job and running count before gen. */
+	cmm_smp_mb();
+	uatomic_inc(&pool->gen);
+	cmm_smp_mb();
+	futex_async(&pool->gen, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/*
+ * Maximum number of threads processing a resize job, including the
+ * thread submitting it.
+ */
+static
+unsigned long resize_pool_max_threads(struct cds_lfht *ht)
+{
+	if (ht->resize_max_workers)
+		return ht->resize_max_workers;
+	return nr_cpus_mask + 1;
+}
+
+static
+void resize_pool_destroy(struct cds_lfht *ht)
+{
+	struct cds_lfht_resize_pool *pool = ht->resize_pool;
+	unsigned int i;
+	int ret;
+
+	if (!pool)
+		return;
+	ht->resize_pool = NULL;
+	/* The workers of the parent process do not exist in a child. */
+	if (pool->pid == getpid()) {
+		uatomic_set(&pool->stop, 1);
+		resize_pool_kick(pool);
+		for (i = 0; i < pool->nr_workers; i++) {
+			ret = pthread_join(pool->workers[i].thread_id, NULL);
+			assert(!ret);
+		}
 	}
-	partition_len = len >> cds_lfht_get_count_order_ulong(nr_threads);
-	work = calloc(nr_threads, sizeof(*work));
-	if (!work) {
+	free(pool);
+}
+
+/*
+ * Get the resize pool of the table, creating its workers on first use.
+ * Returns NULL if the resize should be single-threaded.
+ */
+static
+struct cds_lfht_resize_pool *resize_pool_get(struct cds_lfht *ht)
+{
+	struct cds_lfht_resize_pool *pool = ht->resize_pool;
+	unsigned long nr_workers;
+	unsigned int i;
+	int ret;
+
+	if (pool && pool->pid != getpid())
+		resize_pool_destroy(ht);
+	if (ht->resize_pool)
+		return ht->resize_pool;
+	nr_workers = resize_pool_max_threads(ht) - 1;
+	if (!nr_workers)
+		return NULL;
+	pool = calloc(1, sizeof(*pool) + nr_workers * sizeof(pool->workers[0]));
+	if (!pool) {
 		dbg_printf("error allocating for resize, single-threading\n");
-		goto fallback;
+		return NULL;
 	}
-	for (thread = 0; thread < nr_threads; thread++) {
-		work[thread].ht = ht;
-		work[thread].i = i;
-		work[thread].len = partition_len;
-		work[thread].start = thread * partition_len;
-		work[thread].fct = fct;
-		ret = pthread_create(&(work[thread].thread_id), ht->resize_attr,
-			partition_resize_thread, &work[thread]);
+	pool->ht = ht;
+	pool->pid = getpid();
+	for (i = 0; i < nr_workers; i++) {
+		pool->workers[i].pool = pool;
+		if (ht->resize_nr_cpus)
+			pool->workers[i].cpu =
+				ht->resize_cpus[i % ht->resize_nr_cpus];
+		else
+			pool->workers[i].cpu = -1;
+		ret = pthread_create(&pool->workers[i].thread_id,
+				ht->resize_attr, resize_pool_thread,
+				&pool->workers[i]);
 		if (ret == EAGAIN) {
-			/*
-			 * Out of resources: wait and join the threads
-			 * we've created, then handle leftovers.
-			 */
-			dbg_printf("error spawning for resize, single-threading\n");
-			start = work[thread].start;
-			len -= start;
-			nr_threads = thread;
+			/* Out of resources: keep the workers we have. */
+			dbg_printf("error spawning for resize\n");
 			break;
 		}
 		assert(!ret);
 	}
-	for (thread = 0; thread < nr_threads; thread++) {
-		ret = pthread_join(work[thread].thread_id, NULL);
-		assert(!ret);
+	pool->nr_workers = i;
+	if (!pool->nr_workers) {
+		free(pool);
+		return NULL;
 	}
-	free(work);
+	ht->resize_pool = pool;
+	return pool;
+}
+
+static
+void do_partition_resize_helper(struct cds_lfht *ht, unsigned long i,
+		unsigned long len,
+		void (*fct)(struct cds_lfht *ht, unsigned long i,
+			unsigned long start, unsigned long len))
+{
+	struct cds_lfht_resize_pool *pool;
+	unsigned long start, nr_partitions;
+	int32_t running;
+
+	assert(nr_cpus_mask != -1);
+	if (ht->flags & CDS_LFHT_INCREMENTAL_RESIZE) {
+		/*
+		 * Process the level slice by slice, letting grace periods
+		 * and concurrent updates make progress in between.
+		 */
+		for (start = 0; start < len; start += RESIZE_SLICE) {
+			ht_thread_online(ht);
+			fct(ht, i, start, min(len - start, RESIZE_SLICE));
+			ht_thread_offline(ht);
+			(void) sched_yield();
+		}
+		return;
+	}
+	if (nr_cpus_mask < 0 || len < 2 * MIN_PARTITION_PER_THREAD)
+		goto fallback;
+	pool = resize_pool_get(ht);
+	if (!pool)
+		goto fallback;
 
 	/*
-	 * A pthread_create failure above will either lead in us having
-	 * no threads to join or starting at a non-zero offset,
-	 * fallback to single thread processing of leftovers.
+	 * We use just the number of partitions we need to satisfy the
+	 * minimum partition size, up to the number of threads processing
+	 * the job. Both len and nr_partitions are powers of two.
 	 */
-	if (start == 0 && nr_threads > 0)
-		return;
+	nr_partitions = min(resize_pool_max_threads(ht),
+			len >> MIN_PARTITION_PER_THREAD_ORDER);
+	nr_partitions = 1UL << cds_lfht_get_count_order_ulong(nr_partitions);
+	pool->fct = fct;
+	pool->i = i;
+	pool->nr_partitions = nr_partitions;
+	pool->partition_len = len >> cds_lfht_get_count_order_ulong(nr_partitions);
+	pool->next_partition = 0;
+	resize_pool_kick(pool);
+	resize_pool_run(pool);
+
+	/* Wait for the workers to complete the job. */
+	while ((running = uatomic_read(&pool->running)) != 0)
+		futex_async(&pool->running, FUTEX_WAIT, running,
+			NULL, NULL, 0);
+	cmm_smp_mb();
+	return;
 fallback:
-	ht->flavor->thread_online();
-	fct(ht, i, start, len);
-	ht->flavor->thread_offline();
+	ht_thread_online(ht);
+	fct(ht, i, 0, len);
+	ht_thread_offline(ht);
+}
+
+static
+uint64_t resize_clock_ns(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Resizes and destroy are serialized, so the statistics are updated
+ * without atomic operations, and read with CMM_LOAD_SHARED().
+ */
+static
+void partition_resize_helper(struct cds_lfht *ht, unsigned long i,
+		unsigned long len,
+		void (*fct)(struct cds_lfht *ht, unsigned long i,
+			unsigned long start, unsigned long len))
+{
+	uint64_t start = resize_clock_ns();
+
+	do_partition_resize_helper(ht, i, len, fct);
+	CMM_STORE_SHARED(ht->resize_helper_ns,
+		ht->resize_helper_ns + resize_clock_ns() - start);
+	CMM_STORE_SHARED(ht->resize_nr_levels, ht->resize_nr_levels + 1);
 }
 
 /*
@@ -1253,9 +2008,10 @@ void init_table_populate_partition(struct cds_lfht *ht, unsigned long i,
 				   unsigned long start, unsigned long len)
 {
 	unsigned long j, size = 1UL << (i - 1);
+	int idx;
 
 	assert(i > MIN_TABLE_ORDER);
-	ht->flavor->read_lock();
+	idx = ht_read_lock(ht);
 	for (j = size + start; j < size + start + len; j++) {
 		struct cds_lfht_node *new_node = bucket_at(ht, j);
 
@@ -1263,29 +2019,117 @@ void init_table_populate_partition(struct cds_lfht *ht, unsigned long i,
 		dbg_printf("init populate: order %lu index %lu hash %lu\n",
 			   i, j, j);
 		new_node->reverse_hash = bit_reverse_ulong(j);
-		_cds_lfht_add(ht, j, NULL, NULL, size, new_node, NULL, 1);
+		_cds_lfht_add(ht, j, NULL, NULL, size, new_node, NULL, 1, NULL);
 	}
-	ht->flavor->read_unlock();
+	ht_read_unlock(ht, idx);
 }
 
 static
-void init_table_populate(struct cds_lfht *ht, unsigned long i,
-			 unsigned long len)
+unsigned long resize_nr_slices(unsigned long order)
 {
-	partition_resize_helper(ht, i, len, init_table_populate_partition);
+	return max((1UL << (order - 1)) >> RESIZE_SLICE_ORDER, 1UL);
 }
 
+/*
+ * Claim and populate the next slice of the order being grown.
+ * Returns 0 if there is no slice left. Called by the resize workers and
+ * by updaters helping them.
+ */
 static
-void init_table(struct cds_lfht *ht,
-		unsigned long first_order, unsigned long last_order)
+int resize_populate_slice(struct cds_lfht *ht)
 {
-	unsigned long i;
+	unsigned long cursor, old, order, slice, len;
 
-	dbg_printf("init table: first_order %lu last_order %lu\n",
-		   first_order, last_order);
-	assert(first_order > MIN_TABLE_ORDER);
-	for (i = first_order; i <= last_order; i++) {
-		unsigned long len;
+	cursor = CMM_LOAD_SHARED(ht->resize_cursor);
+	do {
+		order = cursor >> RESIZE_CURSOR_ORDER_SHIFT;
+		if (!order)
+			return 0;
+		slice = cursor & RESIZE_CURSOR_SLICE_MASK;
+		if (slice >= resize_nr_slices(order))
+			return 0;
+		old = cursor;
+		/* Acquire pairs with the release publishing the cursor. */
+		cursor = uatomic_cmpxchg_mo(&ht->resize_cursor, old, old + 1,
+				CMM_ACQUIRE, CMM_RELAXED);
+	} while (cursor != old);
+
+	len = min(1UL << (order - 1), RESIZE_SLICE);
+	init_table_populate_partition(ht, order, slice * len, len);
+	/* populate slice before counting it as done */
+	uatomic_inc_mo(&ht->resize_slices_done, CMM_RELEASE);
+	return 1;
+}
+
+static inline
+void resize_help(struct cds_lfht *ht)
+{
+	if (caa_unlikely(CMM_LOAD_SHARED(ht->resize_cursor)))
+		(void) resize_populate_slice(ht);
+}
+
+/*
+ * Populate slices until none is left to claim. Used as partition
+ * resize function: the partition bounds are ignored, each resize
+ * worker claims slices from the cursor instead.
+ */
+static
+void init_table_populate_slices(struct cds_lfht *ht, unsigned long i,
+		unsigned long start, unsigned long len)
+{
+	while (resize_populate_slice(ht))
+		;
+}
+
+/*
+ * Populate order i slice by slice, from the resize workers and from
+ * add/del operations which help populate one slice each, until all
+ * slices are done. With CDS_LFHT_INCREMENTAL_RESIZE, the resize worker
+ * yields between slices. Otherwise, the resize worker pool claims the
+ * slices, and updaters seeing the order being populated help it
+ * complete before their own insertions lengthen the chains of the
+ * smaller table.
+ */
+static
+void init_table_populate(struct cds_lfht *ht, unsigned long i,
+			 unsigned long len)
+{
+	unsigned long nr_slices = resize_nr_slices(i);
+	int ret;
+
+	uatomic_set(&ht->resize_slices_done, 0);
+	/* bucket table allocation before publishing cursor */
+	uatomic_store(&ht->resize_cursor, i << RESIZE_CURSOR_ORDER_SHIFT,
+			CMM_RELEASE);
+	if (ht->flags & CDS_LFHT_INCREMENTAL_RESIZE) {
+		do {
+			ht_thread_online(ht);
+			ret = resize_populate_slice(ht);
+			ht_thread_offline(ht);
+			(void) sched_yield();
+		} while (ret);
+	} else {
+		partition_resize_helper(ht, i, len,
+			init_table_populate_slices);
+	}
+	/* Wait for helpers to complete the slices they claimed. */
+	/* Acquire orders the slices done before table size update. */
+	while (uatomic_load(&ht->resize_slices_done, CMM_ACQUIRE) != nr_slices)
+		(void) sched_yield();
+	uatomic_set(&ht->resize_cursor, 0);
+}
+
+static
+void init_table(struct cds_lfht *ht,
+		unsigned long first_order, unsigned long last_order)
+{
+	unsigned long i;
+
+	dbg_printf("init table: first_order %lu last_order %lu\n",
+		   first_order, last_order);
+	assert(first_order > MIN_TABLE_ORDER);
+	for (i = first_order; i <= last_order; i++) {
+		unsigned long len;
 
 		len = 1UL << (i - 1);
 		dbg_printf("init order %lu len: %lu\n", i, len);
@@ -1344,9 +2188,10 @@ void remove_table_partition(struct cds_lfht *ht, unsigned long i,
 			    unsigned long start, unsigned long len)
 {
 	unsigned long j, size = 1UL << (i - 1);
+	int idx;
 
 	assert(i > MIN_TABLE_ORDER);
-	ht->flavor->read_lock();
+	idx = ht_read_lock(ht);
 	for (j = size + start; j < size + start + len; j++) {
 		struct cds_lfht_node *fini_bucket = bucket_at(ht, j);
 		struct cds_lfht_node *parent_bucket = bucket_at(ht, j - size);
@@ -1358,7 +2203,7 @@ void remove_table_partition(struct cds_lfht *ht, unsigned long i,
 		uatomic_or(&fini_bucket->next, REMOVED_FLAG);
 		_cds_lfht_gc_bucket(parent_bucket, fini_bucket);
 	}
-	ht->flavor->read_unlock();
+	ht_read_unlock(ht, idx);
 }
 
 static
@@ -1401,7 +2246,7 @@ void fini_table(struct cds_lfht *ht,
 		 * releasing the old bucket nodes. Otherwise their lookup will
 		 * return a logically removed node as insert position.
 		 */
-		ht->flavor->update_synchronize_rcu();
+		ht_synchronize_rcu(ht);
 		if (free_by_rcu_order)
 			cds_lfht_free_bucket_table(ht, free_by_rcu_order);
 
@@ -1421,7 +2266,7 @@ void fini_table(struct cds_lfht *ht,
 	}
 
 	if (free_by_rcu_order) {
-		ht->flavor->update_synchronize_rcu();
+		ht_synchronize_rcu(ht);
 		cds_lfht_free_bucket_table(ht, free_by_rcu_order);
 	}
 }
@@ -1470,6 +2315,62 @@ void cds_lfht_create_bucket(struct cds_lfht *ht, unsigned long size)
 	}
 }
 
+/*
+ * Return the order of a resize policy load, the default order if load
+ * is 0, or -1 if load is not a power of two.
+ */
+static
+int resize_policy_load_order(unsigned long load, int default_order)
+{
+	if (!load)
+		return default_order;
+	if (load & (load - 1))
+		return -1;
+	return cds_lfht_get_count_order_ulong(load);
+}
+
+static
+int resize_policy_init(struct cds_lfht *ht,
+		const struct cds_lfht_resize_policy *policy)
+{
+	static const struct cds_lfht_resize_policy default_policy;
+
+	if (!policy)
+		policy = &default_policy;
+	if (policy->max_grow_order >= CAA_BITS_PER_LONG
+			|| policy->max_shrink_order >= CAA_BITS_PER_LONG)
+		return -EINVAL;
+	ht->target_load_order = resize_policy_load_order(policy->target_load,
+			CHAIN_LEN_TARGET - 1);
+	ht->grow_load_order = resize_policy_load_order(policy->grow_load,
+			CHAIN_LEN_RESIZE_THRESHOLD);
+	ht->shrink_load_order = resize_policy_load_order(policy->shrink_load,
+			CHAIN_LEN_RESIZE_THRESHOLD);
+	if (ht->target_load_order < 0 || ht->grow_load_order < 0
+			|| ht->shrink_load_order < 0)
+		return -EINVAL;
+	if (ht->target_load_order > ht->grow_load_order
+			|| ht->shrink_load_order > ht->grow_load_order)
+		return -EINVAL;
+	ht->grow_chain_len = policy->grow_chain_len ?
+			policy->grow_chain_len : CHAIN_LEN_RESIZE_THRESHOLD;
+	ht->max_grow_order = policy->max_grow_order;
+	ht->max_shrink_order = policy->max_shrink_order;
+	return 0;
+}
+
+/* Free the table structure allocated by the memory management plugin. */
+static
+void free_cds_lfht(struct cds_lfht *ht)
+{
+	unsigned long size = ht->alloc_size;
+
+#ifdef POISON_FREE
+	memset(ht, 0x42, sizeof(*ht));
+#endif
+	urcu_cacheline_free(URCU_ALLOC_LFHT, ht, size);
+}
+
 struct cds_lfht *_cds_lfht_new(unsigned long init_size,
 			unsigned long min_nr_alloc_buckets,
 			unsigned long max_nr_buckets,
@@ -1477,10 +2378,29 @@ struct cds_lfht *_cds_lfht_new(unsigned long init_size,
 			const struct cds_lfht_mm_type *mm,
 			const struct rcu_flavor_struct *flavor,
 			pthread_attr_t *attr)
+{
+	return _cds_lfht_new_policy(init_size, min_nr_alloc_buckets,
+			max_nr_buckets, flags, mm, flavor, NULL, attr);
+}
+
+struct cds_lfht *_cds_lfht_new_policy(unsigned long init_size,
+			unsigned long min_nr_alloc_buckets,
+			unsigned long max_nr_buckets,
+			int flags,
+			const struct cds_lfht_mm_type *mm,
+			const struct rcu_flavor_struct *flavor,
+			const struct cds_lfht_resize_policy *policy,
+			pthread_attr_t *attr)
 {
 	struct cds_lfht *ht;
 	unsigned long order;
 
+#ifdef RCULFHASH_FLAVOR
+	/* Built for a single flavor. */
+	if (flavor != &rcu_flavor)
+		return NULL;
+#endif
+
 	/* min_nr_alloc_buckets must be power of two */
 	if (!min_nr_alloc_buckets || (min_nr_alloc_buckets & (min_nr_alloc_buckets - 1)))
 		return NULL;
@@ -1531,28 +2451,72 @@ struct cds_lfht *_cds_lfht_new(unsigned long init_size,
 	assert(ht->mm == mm);
 	assert(ht->bucket_at == mm->bucket_at);
 
+	if (resize_policy_init(ht, policy)) {
+		/* No bucket table is allocated yet. */
+		free_cds_lfht(ht);
+		return NULL;
+	}
+	if (flags & CDS_LFHT_LAZY_ACCOUNTING)
+		flags |= CDS_LFHT_ACCOUNTING;
 	ht->flags = flags;
 	ht->flavor = flavor;
 	ht->resize_attr = attr;
 	alloc_split_items_count(ht);
+	alloc_op_stats(ht);
 	/* this mutex should not nest in read-side C.S. */
 	pthread_mutex_init(&ht->resize_mutex, NULL);
 	order = cds_lfht_get_count_order_ulong(init_size);
 	ht->resize_target = 1UL << order;
+	/*
+	 * Start from the buckets allocated anyway, and let the resize
+	 * worker grow the table to its initial size, with the partition
+	 * workers for large tables.
+	 */
+	if ((flags & CDS_LFHT_ASYNC_INIT) && init_size > min_nr_alloc_buckets)
+		order = cds_lfht_get_count_order_ulong(min_nr_alloc_buckets);
 	cds_lfht_create_bucket(ht, 1UL << order);
 	ht->size = 1UL << order;
+	lookup_cache_init(ht);
+	/* Without memory for the filter, lookups walk the chains. */
+	if (flags & CDS_LFHT_FILTER)
+		ht->filter = filter_alloc(ht->size);
+	if (ht->size != ht->resize_target
+			&& resize_async_launch(ht, NULL, NULL))
+		cds_lfht_resize(ht, ht->resize_target);
 	return ht;
 }
 
-void cds_lfht_lookup(struct cds_lfht *ht, unsigned long hash,
+/*
+ * Always inlined, so the match function gets inlined when it is known
+ * at compile time (e.g. cds_lfht_lookup_u64()).
+ */
+static inline __attribute__((always_inline))
+void _cds_lfht_lookup(struct cds_lfht *ht, unsigned long hash,
 		cds_lfht_match_fct match, const void *key,
 		struct cds_lfht_iter *iter)
 {
 	struct cds_lfht_node *node, *next, *bucket;
-	unsigned long reverse_hash, size;
+	unsigned long reverse_hash, size, nr_nodes = 0, gen = 0;
+	struct lookup_cache_entry *entry = NULL;
 
 	reverse_hash = bit_reverse_ulong(hash);
 
+	if (ht->flags & CDS_LFHT_LOOKUP_CACHE) {
+		entry = lookup_cache_entry(hash);
+		/* Read the generation before the nodes it validates. */
+		gen = uatomic_load(&ht->cache_gen, CMM_ACQUIRE);
+		if (entry->ht == ht && entry->hash == hash && entry->gen == gen) {
+			node = entry->node;
+			next = rcu_dereference(node->next);
+			if (caa_likely(!is_removed(next))
+			    && caa_likely(match(node, key)))
+				goto end;
+		}
+	}
+	if (caa_unlikely(!filter_lookup(ht, hash))) {
+		node = next = NULL;
+		goto end;
+	}
 	size = rcu_dereference(ht->size);
 	bucket = lookup_bucket(ht, size, hash);
 	/* We can always skip the bucket node initially */
@@ -1567,6 +2531,7 @@ void cds_lfht_lookup(struct cds_lfht *ht, unsigned long hash,
 			node = next = NULL;
 			break;
 		}
+		nr_nodes++;
 		next = rcu_dereference(node->next);
 		assert(node == clear_flag(node));
 		if (caa_likely(!is_removed(next))
@@ -1578,11 +2543,138 @@ void cds_lfht_lookup(struct cds_lfht *ht, unsigned long hash,
 		node = clear_flag(next);
 	}
 	assert(!node || !is_bucket(CMM_LOAD_SHARED(node->next)));
+	if (node && entry) {
+		entry->ht = ht;
+		entry->hash = hash;
+		entry->gen = gen;
+		entry->node = node;
+	}
+end:
 	iter->node = node;
 	iter->next = next;
+	ht_op_stats_add(ht, nr_lookups, 1);
+	ht_op_stats_add(ht, nr_lookup_nodes, nr_nodes);
 }
 
-void cds_lfht_next_duplicate(struct cds_lfht *ht, cds_lfht_match_fct match,
+void cds_lfht_lookup(struct cds_lfht *ht, unsigned long hash,
+		cds_lfht_match_fct match, const void *key,
+		struct cds_lfht_iter *iter)
+{
+	_cds_lfht_lookup(ht, hash, match, key, iter);
+}
+
+struct cds_lfht_node *_cds_lfht_lookup_chain(struct cds_lfht *ht,
+		unsigned long hash, unsigned long *reverse_hash)
+{
+	struct cds_lfht_node *bucket;
+	unsigned long size;
+
+	*reverse_hash = bit_reverse_ulong(hash);
+	if (caa_unlikely(!filter_lookup(ht, hash)))
+		return (struct cds_lfht_node *) END_VALUE;
+	size = rcu_dereference(ht->size);
+	bucket = lookup_bucket(ht, size, hash);
+	/* We can always skip the bucket node initially */
+	return clear_flag(rcu_dereference(bucket->next));
+}
+
+/*
+ * Number of lookups walked together by cds_lfht_lookup_multi().
+ */
+#define LOOKUP_MULTI_BATCH	16
+
+static
+void _cds_lfht_lookup_multi(struct cds_lfht *ht, unsigned long size,
+		unsigned long nr, const unsigned long *hashes,
+		cds_lfht_match_fct match, const void * const *keys,
+		struct cds_lfht_iter *iters)
+{
+	struct cds_lfht_node *cur[LOOKUP_MULTI_BATCH];
+	unsigned long reverse_hash[LOOKUP_MULTI_BATCH];
+	struct cds_lfht_node *node, *next;
+	unsigned long i, pending, nr_nodes = 0;
+	unsigned int finished = 0;	/* bit i set once lookup i is done */
+
+	assert(nr <= LOOKUP_MULTI_BATCH);
+	/*
+	 * Fetch all bucket nodes, then all first chain nodes, for the
+	 * lookups not stopped by the filter.
+	 */
+	pending = nr;
+	for (i = 0; i < nr; i++) {
+		if (caa_unlikely(!filter_lookup(ht, hashes[i]))) {
+			iters[i].node = iters[i].next = NULL;
+			finished |= 1U << i;
+			pending--;
+			continue;
+		}
+		reverse_hash[i] = bit_reverse_ulong(hashes[i]);
+		cur[i] = lookup_bucket(ht, size, hashes[i]);
+		caa_prefetch(cur[i]);
+	}
+	for (i = 0; i < nr; i++) {
+		if (finished & (1U << i))
+			continue;
+		/* We can always skip the bucket node initially */
+		cur[i] = clear_flag(rcu_dereference(cur[i]->next));
+		if (!is_end(cur[i]))
+			caa_prefetch(cur[i]);
+	}
+	/*
+	 * Walk the chains interleaved, one node of each lookup at a
+	 * time, fetching the next node of a chain while walking the
+	 * others. Same steps as cds_lfht_lookup().
+	 */
+	while (pending) {
+		for (i = 0; i < nr; i++) {
+			if (finished & (1U << i))
+				continue;
+			node = cur[i];
+			if (caa_unlikely(is_end(node))
+			    || caa_unlikely(node->reverse_hash > reverse_hash[i])) {
+				node = next = NULL;
+				goto done;
+			}
+			nr_nodes++;
+			next = rcu_dereference(node->next);
+			assert(node == clear_flag(node));
+			if (caa_likely(!is_removed(next))
+			    && !is_bucket(next)
+			    && node->reverse_hash == reverse_hash[i]
+			    && caa_likely(match(node, keys[i])))
+				goto done;
+			cur[i] = clear_flag(next);
+			if (!is_end(cur[i]))
+				caa_prefetch(cur[i]);
+			continue;
+		done:
+			assert(!node || !is_bucket(CMM_LOAD_SHARED(node->next)));
+			iters[i].node = node;
+			iters[i].next = next;
+			finished |= 1U << i;
+			pending--;
+		}
+	}
+	ht_op_stats_add(ht, nr_lookups, nr);
+	ht_op_stats_add(ht, nr_lookup_nodes, nr_nodes);
+}
+
+void cds_lfht_lookup_multi(struct cds_lfht *ht, unsigned long nr,
+		const unsigned long *hashes, cds_lfht_match_fct match,
+		const void * const *keys, struct cds_lfht_iter *iters)
+{
+	unsigned long size, i, len;
+
+	size = rcu_dereference(ht->size);
+	for (i = 0; i < nr; i += len) {
+		len = min(nr - i, LOOKUP_MULTI_BATCH);
+		_cds_lfht_lookup_multi(ht, size, len, &hashes[i], match,
+			&keys[i], &iters[i]);
+	}
+}
+
+static inline __attribute__((always_inline))
+void _cds_lfht_next_duplicate(struct cds_lfht *ht, cds_lfht_match_fct match,
 		const void *key, struct cds_lfht_iter *iter)
 {
 	struct cds_lfht_node *node, *next;
@@ -1615,6 +2707,31 @@ void cds_lfht_next_duplicate(struct cds_lfht *ht, cds_lfht_match_fct match,
 	iter->next = next;
 }
 
+void cds_lfht_next_duplicate(struct cds_lfht *ht, cds_lfht_match_fct match,
+		const void *key, struct cds_lfht_iter *iter)
+{
+	_cds_lfht_next_duplicate(ht, match, key, iter);
+}
+
+static inline
+int match_u64(struct cds_lfht_node *node, const void *key)
+{
+	return caa_container_of(node, struct cds_lfht_node_u64, node)->key
+		== *(const uint64_t *) key;
+}
+
+void cds_lfht_lookup_u64(struct cds_lfht *ht, unsigned long hash,
+		uint64_t key, struct cds_lfht_iter *iter)
+{
+	_cds_lfht_lookup(ht, hash, match_u64, &key, iter);
+}
+
+void cds_lfht_next_duplicate_u64(struct cds_lfht *ht, uint64_t key,
+		struct cds_lfht_iter *iter)
+{
+	_cds_lfht_next_duplicate(ht, match_u64, &key, iter);
+}
+
 void cds_lfht_next(struct cds_lfht *ht, struct cds_lfht_iter *iter)
 {
 	struct cds_lfht_node *node, *next;
@@ -1647,91 +2764,1474 @@ void cds_lfht_first(struct cds_lfht *ht, struct cds_lfht_iter *iter)
 	cds_lfht_next(ht, iter);
 }
 
-void cds_lfht_add(struct cds_lfht *ht, unsigned long hash,
-		struct cds_lfht_node *node)
+/* Bucket index of the bucket of rank @rank in the list. */
+static
+unsigned long prefetch_iter_bucket(struct cds_lfht_prefetch_iter *piter,
+		unsigned long rank)
+{
+	return bit_reverse_ulong(rank)
+		>> (CAA_BITS_PER_LONG - cds_lfht_get_count_order_ulong(piter->size));
+}
+
+/*
+ * Prefetch ahead of the bucket of rank @rank: the first node (and its
+ * data) @distance buckets ahead, and the bucket node twice as far.
+ */
+static
+void prefetch_iter_bucket_ahead(struct cds_lfht *ht,
+		struct cds_lfht_prefetch_iter *piter, unsigned long rank)
+{
+	struct cds_lfht_node *node;
+	unsigned long ahead;
+
+	ahead = rank + piter->distance;
+	if (ahead >= piter->size)
+		return;
+	node = clear_flag(rcu_dereference(bucket_at(ht,
+			prefetch_iter_bucket(piter, ahead))->next));
+	/* The node may be the next bucket node, if the bucket is empty. */
+	if (!is_end(node)) {
+		caa_prefetch(node);
+		caa_prefetch((char *) node + piter->offset);
+	}
+	ahead += piter->distance;
+	if (ahead < piter->size)
+		caa_prefetch(bucket_at(ht, prefetch_iter_bucket(piter, ahead)));
+}
+
+/* Prefetch ahead of the buckets reached since the previous node. */
+static
+void prefetch_iter_advance(struct cds_lfht *ht,
+		struct cds_lfht_prefetch_iter *piter)
+{
+	struct cds_lfht_node *node = piter->iter.node;
+	unsigned long rank;
+
+	if (!node || piter->size < 2)
+		return;
+	rank = node->reverse_hash >> (CAA_BITS_PER_LONG
+		- cds_lfht_get_count_order_ulong(piter->size));
+	while (piter->rank < rank)
+		prefetch_iter_bucket_ahead(ht, piter, ++piter->rank);
+}
+
+void cds_lfht_prefetch_first(struct cds_lfht *ht,
+		struct cds_lfht_prefetch_iter *piter, unsigned long distance,
+		long offset)
+{
+	unsigned long rank;
+
+	piter->size = rcu_dereference(ht->size);
+	piter->rank = 0;
+	piter->distance = distance ? distance : 1;
+	piter->offset = offset;
+	if (piter->size >= 2) {
+		/* Bucket nodes first, then the nodes they point to. */
+		for (rank = piter->distance;
+				rank < 2 * piter->distance && rank < piter->size;
+				rank++)
+			caa_prefetch(bucket_at(ht,
+				prefetch_iter_bucket(piter, rank)));
+		for (rank = 0; rank < piter->distance; rank++)
+			prefetch_iter_bucket_ahead(ht, piter, rank);
+	}
+	/* The first bucket node is the first node of the linked list. */
+	piter->iter.next = bucket_at(ht, 0)->next;
+	cds_lfht_next(ht, &piter->iter);
+	prefetch_iter_advance(ht, piter);
+}
+
+void cds_lfht_prefetch_next(struct cds_lfht *ht,
+		struct cds_lfht_prefetch_iter *piter)
+{
+	cds_lfht_next(ht, &piter->iter);
+	prefetch_iter_advance(ht, piter);
+}
+
+/*
+ * Partitions split the reverse hash space (i.e. the split-ordered list)
+ * in nr_partitions ranges of equal width, the last one being unbounded.
+ */
+static
+unsigned long partition_start(unsigned long index, unsigned long nr_partitions)
+{
+	return index * (ULONG_MAX / nr_partitions);
+}
+
+static
+void _cds_lfht_partition_next(struct cds_lfht_partition_iter *piter,
+		struct cds_lfht_node *node, unsigned long start)
+{
+	struct cds_lfht_node *next;
+
+	for (;;) {
+		if (caa_unlikely(is_end(node))) {
+			node = next = NULL;
+			break;
+		}
+		if (!piter->last && node->reverse_hash >= piter->end) {
+			node = next = NULL;
+			break;
+		}
+		next = rcu_dereference(node->next);
+		if (caa_likely(!is_removed(next))
+		    && !is_bucket(next)
+		    && node->reverse_hash >= start) {
+				break;
+		}
+		node = clear_flag(next);
+	}
+	assert(!node || !is_bucket(CMM_LOAD_SHARED(node->next)));
+	piter->iter.node = node;
+	piter->iter.next = next;
+}
+
+void cds_lfht_partition_first(struct cds_lfht *ht, unsigned long index,
+		unsigned long nr_partitions,
+		struct cds_lfht_partition_iter *piter)
+{
+	struct cds_lfht_node *bucket;
+	unsigned long start, size;
+
+	assert(index < nr_partitions);
+	start = partition_start(index, nr_partitions);
+	piter->end = partition_start(index + 1, nr_partitions);
+	piter->last = (index == nr_partitions - 1);
+	/*
+	 * Begin with the last bucket node sorting before the start of
+	 * the partition: its reverse hash is "start" with the bits below
+	 * the table order cleared.
+	 */
+	size = rcu_dereference(ht->size);
+	bucket = lookup_bucket(ht, size, bit_reverse_ulong(start));
+	_cds_lfht_partition_next(piter, clear_flag(rcu_dereference(bucket->next)),
+		start);
+}
+
+void cds_lfht_partition_next(struct cds_lfht *ht,
+		struct cds_lfht_partition_iter *piter)
+{
+	_cds_lfht_partition_next(piter, clear_flag(piter->iter.next), 0);
+}
+
+static
+void cursor_update(struct cds_lfht_cursor *cursor, struct cds_lfht_iter *iter)
+{
+	if (!iter->node) {
+		cursor->end = 1;
+	} else if (iter->node->reverse_hash != cursor->reverse_hash) {
+		cursor->reverse_hash = iter->node->reverse_hash;
+		cursor->skip = 0;
+	}
+}
+
+void cds_lfht_cursor_first(struct cds_lfht *ht,
+		struct cds_lfht_cursor *cursor,
+		struct cds_lfht_iter *iter)
+{
+	struct cds_lfht_partition_iter piter;
+	struct cds_lfht_node *bucket;
+	unsigned long size, skip;
+
+	if (cursor->end) {
+		iter->node = iter->next = NULL;
+		return;
+	}
+	/*
+	 * Lookup the first node sorting at or after the cursor reverse
+	 * hash, starting from the bucket node preceding it.
+	 */
+	size = rcu_dereference(ht->size);
+	bucket = lookup_bucket(ht, size, bit_reverse_ulong(cursor->reverse_hash));
+	piter.last = 1;
+	_cds_lfht_partition_next(&piter, clear_flag(rcu_dereference(bucket->next)),
+		cursor->reverse_hash);
+	*iter = piter.iter;
+	/* Skip the nodes of the same hash already visited. */
+	for (skip = cursor->skip; skip && iter->node
+			&& iter->node->reverse_hash == cursor->reverse_hash;
+			skip--)
+		cds_lfht_next(ht, iter);
+	cursor_update(cursor, iter);
+}
+
+void cds_lfht_cursor_next(struct cds_lfht *ht,
+		struct cds_lfht_cursor *cursor,
+		struct cds_lfht_iter *iter)
+{
+	assert(iter->node);
+	assert(iter->node->reverse_hash == cursor->reverse_hash);
+	cds_lfht_next(ht, iter);
+	cursor->skip++;
+	cursor_update(cursor, iter);
+}
+
+enum merge_phase {
+	MERGE_SORTED = 0,	/* nodes of different hashes */
+	MERGE_RUN_LEFT,		/* left nodes of a run of equal hashes */
+	MERGE_RUN_RIGHT,	/* right nodes of that run */
+};
+
+static
+int merge_in_run(struct cds_lfht_iter *iter, unsigned long run_hash)
+{
+	return iter->node && iter->node->reverse_hash == run_hash;
+}
+
+/* Node of the run beginning at @run matching @node, or NULL. */
+static
+struct cds_lfht_node *merge_run_find(struct cds_lfht *ht,
+		struct cds_lfht_iter run, unsigned long run_hash,
+		cds_lfht_merge_match_fct match, struct cds_lfht_node *node,
+		int node_is_left)
+{
+	for (; merge_in_run(&run, run_hash); cds_lfht_next(ht, &run)) {
+		if (node_is_left ? match(node, run.node) : match(run.node, node))
+			return run.node;
+	}
+	return NULL;
+}
+
+enum cds_lfht_merge_kind cds_lfht_merge_next(struct cds_lfht_merge_iter *miter)
+{
+	struct cds_lfht_node *l, *r;
+
+	for (;;) {
+		switch (miter->phase) {
+		case MERGE_SORTED:
+			l = miter->l.node;
+			r = miter->r.node;
+			if (!l && !r) {
+				miter->left = miter->right = NULL;
+				return CDS_LFHT_MERGE_END;
+			}
+			if (!r || (l && l->reverse_hash < r->reverse_hash)) {
+				cds_lfht_next(miter->left_ht, &miter->l);
+				miter->left = l;
+				miter->right = NULL;
+				return CDS_LFHT_MERGE_LEFT;
+			}
+			if (!l || r->reverse_hash < l->reverse_hash) {
+				cds_lfht_next(miter->right_ht, &miter->r);
+				miter->left = NULL;
+				miter->right = r;
+				return CDS_LFHT_MERGE_RIGHT;
+			}
+			miter->run_hash = l->reverse_hash;
+			miter->l_run = miter->l;
+			miter->r_run = miter->r;
+			miter->phase = MERGE_RUN_LEFT;
+			/* Fall-through */
+		case MERGE_RUN_LEFT:
+			if (merge_in_run(&miter->l, miter->run_hash)) {
+				l = miter->l.node;
+				cds_lfht_next(miter->left_ht, &miter->l);
+				miter->left = l;
+				miter->right = merge_run_find(miter->right_ht,
+					miter->r_run, miter->run_hash,
+					miter->match, l, 1);
+				return miter->right ? CDS_LFHT_MERGE_BOTH :
+					CDS_LFHT_MERGE_LEFT;
+			}
+			miter->phase = MERGE_RUN_RIGHT;
+			/* Fall-through */
+		case MERGE_RUN_RIGHT:
+			while (merge_in_run(&miter->r, miter->run_hash)) {
+				r = miter->r.node;
+				cds_lfht_next(miter->right_ht, &miter->r);
+				/* Matched nodes were returned with the left ones. */
+				if (!merge_run_find(miter->left_ht, miter->l_run,
+						miter->run_hash, miter->match, r, 0)) {
+					miter->left = NULL;
+					miter->right = r;
+					return CDS_LFHT_MERGE_RIGHT;
+				}
+			}
+			miter->phase = MERGE_SORTED;
+			break;
+		}
+	}
+}
+
+enum cds_lfht_merge_kind cds_lfht_merge_first(struct cds_lfht *left,
+		struct cds_lfht *right, cds_lfht_merge_match_fct match,
+		struct cds_lfht_merge_iter *miter)
+{
+	miter->left_ht = left;
+	miter->right_ht = right;
+	miter->match = match;
+	miter->phase = MERGE_SORTED;
+	cds_lfht_first(left, &miter->l);
+	cds_lfht_first(right, &miter->r);
+	return cds_lfht_merge_next(miter);
+}
+
+void cds_lfht_count_nodes_partition(struct cds_lfht *ht, unsigned long index,
+		unsigned long nr_partitions, unsigned long *count)
+{
+	struct cds_lfht_partition_iter piter;
+	struct cds_lfht_node *node;
+
+	*count = 0;
+	cds_lfht_for_each_partition(ht, index, nr_partitions, &piter, node)
+		(*count)++;
+}
+
+void cds_lfht_add(struct cds_lfht *ht, unsigned long hash,
+		struct cds_lfht_node *node)
+{
+	unsigned long size;
+
+	node->reverse_hash = bit_reverse_ulong(hash);
+	size = rcu_dereference(ht->size);
+	_cds_lfht_add(ht, hash, NULL, NULL, size, node, NULL, 0, NULL);
+	ht_count_add(ht, size, hash);
+	resize_help(ht);
+}
+
+static
+int cds_lfht_node_cmp(const void *a, const void *b)
+{
+	const struct cds_lfht_node *na = *(struct cds_lfht_node * const *) a;
+	const struct cds_lfht_node *nb = *(struct cds_lfht_node * const *) b;
+
+	if (na->reverse_hash < nb->reverse_hash)
+		return -1;
+	return na->reverse_hash > nb->reverse_hash;
+}
+
+static
+void cds_lfht_sort_nodes(const unsigned long *hashes,
+		struct cds_lfht_node **nodes, unsigned long nr)
+{
+	unsigned long i;
+
+	for (i = 0; i < nr; i++)
+		nodes[i]->reverse_hash = bit_reverse_ulong(hashes[i]);
+	qsort(nodes, nr, sizeof(*nodes), cds_lfht_node_cmp);
+}
+
+void cds_lfht_add_bulk(struct cds_lfht *ht, const unsigned long *hashes,
+		struct cds_lfht_node **nodes, unsigned long nr)
+{
+	unsigned long size, i;
+
+	cds_lfht_sort_nodes(hashes, nodes, nr);
+	for (i = 0; i < nr; i++)
+		filter_add(ht, hashes[i], NULL);
+	size = rcu_dereference(ht->size);
+	for (i = 0; i < nr; )
+		i += _cds_lfht_add_run(ht, size, &nodes[i], nr - i);
+	for (i = 0; i < nr; i++)
+		ht_count_add(ht, size, hashes[i]);
+	resize_help(ht);
+}
+
+/*
+ * Link node after *prev, in a table nobody else can access: plain
+ * stores suffice. Nodes must be merged in increasing reverse hash order,
+ * *prev starting at the first bucket node. Logically removed nodes met
+ * on the way are unlinked.
+ */
+static
+void bulk_merge_node(struct cds_lfht_node **prev, struct cds_lfht_node *node)
+{
+	struct cds_lfht_node *iter, *next;
+
+	for (;;) {
+		iter = (*prev)->next;
+		if (is_end(iter))
+			break;
+		next = clear_flag(iter)->next;
+		if (is_removed(next) && !is_bucket(next)) {
+			/* Unlink logically removed node. */
+			if (is_bucket(iter))
+				(*prev)->next = flag_bucket(clear_flag(next));
+			else
+				(*prev)->next = clear_flag(next);
+			continue;
+		}
+		if (clear_flag(iter)->reverse_hash > node->reverse_hash)
+			break;
+		*prev = clear_flag(iter);
+	}
+	node->next = clear_flag(iter);
+	if (is_bucket(iter))
+		(*prev)->next = flag_bucket(node);
+	else
+		(*prev)->next = node;
+	*prev = node;
+}
+
+void cds_lfht_bulk_load(struct cds_lfht *ht, const unsigned long *hashes,
+		struct cds_lfht_node **nodes, unsigned long nr)
+{
+	struct cds_lfht_node *prev;
+	unsigned long size, i;
+
+	/* Size the table for the new nodes before linking them. */
+	size = nr >> ht->target_load_order;
+	if ((ht->flags & CDS_LFHT_AUTO_RESIZE) && size > ht->size) {
+		/* Resize targets are powers of 2. */
+		cds_lfht_resize(ht,
+			1UL << cds_lfht_get_count_order_ulong(size));
+	}
+
+	cds_lfht_sort_nodes(hashes, nodes, nr);
+	for (i = 0; i < nr; i++)
+		filter_add(ht, hashes[i], NULL);
+	/*
+	 * Merge the sorted nodes into the split-ordered list in a single
+	 * pass.
+	 */
+	prev = bucket_at(ht, 0);
+	for (i = 0; i < nr; i++)
+		bulk_merge_node(&prev, nodes[i]);
+	size = ht->size;
+	for (i = 0; i < nr; i++)
+		ht_count_add(ht, size, hashes[i]);
+}
+
+/*
+ * Snapshot records are a 64-bit hash followed by the user record,
+ * padded to 8 bytes.
+ */
+#define SNAPSHOT_MAGIC		"CDSLFHT"
+#define SNAPSHOT_VERSION	1
+#define SNAPSHOT_BYTE_ORDER	0x01020304U
+
+static
+size_t snapshot_stride(uint64_t record_len)
+{
+	return sizeof(uint64_t) + ((record_len + 7) & ~(uint64_t) 7);
+}
+
+int cds_lfht_snapshot_save(struct cds_lfht *ht, FILE *fp, size_t record_len,
+		cds_lfht_snapshot_save_fct save, void *priv)
+{
+	struct cds_lfht_snapshot_header header;
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+	size_t stride = snapshot_stride(record_len);
+	unsigned long nr_nodes = 0;
+	char *record;
+	int ret = 0;
+
+	cds_lfht_for_each(ht, &iter, node)
+		nr_nodes++;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	header.version = SNAPSHOT_VERSION;
+	header.byte_order = SNAPSHOT_BYTE_ORDER;
+	header.long_size = sizeof(unsigned long);
+	header.record_len = record_len;
+	header.nr_nodes = nr_nodes;
+	header.nr_buckets = CMM_LOAD_SHARED(ht->size);
+	if (fwrite(&header, sizeof(header), 1, fp) != 1)
+		return -EIO;
+
+	record = calloc(1, stride);
+	if (!record)
+		return -ENOMEM;
+	/* Nodes are saved in the split-ordered list order. */
+	cds_lfht_for_each(ht, &iter, node) {
+		uint64_t hash = bit_reverse_ulong(node->reverse_hash);
+
+		if (!nr_nodes--) {
+			ret = -EBUSY;	/* table modified during save */
+			break;
+		}
+		memcpy(record, &hash, sizeof(hash));
+		ret = save(node, record + sizeof(hash), priv);
+		if (ret)
+			break;
+		if (fwrite(record, stride, 1, fp) != 1) {
+			ret = -EIO;
+			break;
+		}
+	}
+	if (!ret && nr_nodes)
+		ret = -EBUSY;
+	free(record);
+	return ret;
+}
+
+int cds_lfht_snapshot_load(struct cds_lfht *ht, const void *image,
+		size_t len, cds_lfht_snapshot_load_fct load, void *priv)
+{
+	const struct cds_lfht_snapshot_header *header = image;
+	struct cds_lfht_node *prev, *node;
+	unsigned long prev_reverse_hash = 0, size;
+	const char *record;
+	size_t stride;
+	uint64_t i;
+
+	if (len < sizeof(*header)
+			|| memcmp(header->magic, SNAPSHOT_MAGIC,
+				sizeof(SNAPSHOT_MAGIC))
+			|| header->version != SNAPSHOT_VERSION
+			|| header->byte_order != SNAPSHOT_BYTE_ORDER
+			|| header->long_size != sizeof(unsigned long))
+		return -EINVAL;
+	stride = snapshot_stride(header->record_len);
+	if (header->nr_nodes > (len - sizeof(*header)) / stride)
+		return -EINVAL;
+	if (!header->nr_buckets
+			|| (header->nr_buckets & (header->nr_buckets - 1)))
+		return -EINVAL;
+
+	/* Validate the order of the hashes before linking anything. */
+	record = (const char *) (header + 1);
+	for (i = 0; i < header->nr_nodes; i++, record += stride) {
+		uint64_t hash;
+		unsigned long reverse_hash;
+
+		memcpy(&hash, record, sizeof(hash));
+		reverse_hash = bit_reverse_ulong(hash);
+		if (reverse_hash < prev_reverse_hash)
+			return -EINVAL;
+		prev_reverse_hash = reverse_hash;
+	}
+
+	/* Restore the bucket sizing before linking the nodes. */
+	if (header->nr_buckets > ht->size)
+		cds_lfht_resize(ht, header->nr_buckets);
+
+	prev = bucket_at(ht, 0);
+	size = ht->size;
+	record = (const char *) (header + 1);
+	for (i = 0; i < header->nr_nodes; i++, record += stride) {
+		uint64_t hash;
+
+		memcpy(&hash, record, sizeof(hash));
+		node = load(record + sizeof(hash), priv);
+		if (!node)
+			return -ENOMEM;
+		node->reverse_hash = bit_reverse_ulong(hash);
+		bulk_merge_node(&prev, node);
+		ht_count_add(ht, size, hash);
+	}
+	return 0;
+}
+
+struct cds_lfht_node *cds_lfht_add_unique(struct cds_lfht *ht,
+				unsigned long hash,
+				cds_lfht_match_fct match,
+				const void *key,
+				struct cds_lfht_node *node)
+{
+	unsigned long size;
+	struct cds_lfht_iter iter;
+
+	node->reverse_hash = bit_reverse_ulong(hash);
+	size = rcu_dereference(ht->size);
+	_cds_lfht_add(ht, hash, match, key, size, node, &iter, 0, NULL);
+	if (iter.node == node)
+		ht_count_add(ht, size, hash);
+	resize_help(ht);
+	return iter.node;
+}
+
+struct cds_lfht_node *cds_lfht_lookup_or_add(struct cds_lfht *ht,
+				unsigned long hash,
+				cds_lfht_match_fct match,
+				const void *key,
+				cds_lfht_create_fct create,
+				cds_lfht_discard_fct discard,
+				void *priv)
+{
+	struct lfht_create c = {
+		.create = create,
+		.discard = discard,
+		.priv = priv,
+		.node = NULL,
+	};
+	unsigned long size;
+	struct cds_lfht_iter iter;
+
+	size = rcu_dereference(ht->size);
+	_cds_lfht_add(ht, hash, match, key, size, NULL, &iter, 0, &c);
+	if (iter.node && iter.node == c.node)
+		ht_count_add(ht, size, hash);
+	resize_help(ht);
+	return iter.node;
+}
+
+struct cds_lfht_node *cds_lfht_add_unique_u64(struct cds_lfht *ht,
+				unsigned long hash,
+				struct cds_lfht_node_u64 *node)
+{
+	return cds_lfht_add_unique(ht, hash, match_u64, &node->key,
+			&node->node);
+}
+
+/*
+ * Nodes removed from tables with a reclaim callback are collected per
+ * thread in blocks of RECLAIM_BATCH_SIZE bytes, each handed to call_rcu
+ * at once rather than with one call_rcu per node. A block only holds
+ * nodes removed from tables sharing the same callback, call_rcu and
+ * domain, and does not refer to the tables, which can be destroyed
+ * before its grace period ends.
+ */
+#define RECLAIM_BATCH_SIZE	4096
+
+struct reclaim_batch {
+	struct rcu_head head;
+	cds_lfht_reclaim_fct reclaim;
+	void *priv;
+	void (*call_rcu)(struct rcu_head *head,
+			void (*func)(struct rcu_head *head));
+	struct rcu_domain *domain;
+	unsigned long nr;
+	struct cds_lfht_node *nodes[];
+};
+
+#define RECLAIM_BATCH_NR_NODES	\
+	((RECLAIM_BATCH_SIZE - sizeof(struct reclaim_batch))	\
+		/ sizeof(struct cds_lfht_node *))
+
+static DEFINE_URCU_TLS(struct reclaim_batch *, reclaim_batch);
+
+/* Queues the partial block of exiting threads. */
+static pthread_key_t reclaim_batch_key;
+static pthread_once_t reclaim_batch_key_once = PTHREAD_ONCE_INIT;
+
+static
+void reclaim_batch_cb(struct rcu_head *head)
+{
+	struct reclaim_batch *batch =
+		caa_container_of(head, struct reclaim_batch, head);
+	unsigned long i;
+
+	/* As for sweep batches, also wait for the domain readers. */
+	if (batch->domain)
+		synchronize_rcu_domain(batch->domain);
+	for (i = 0; i < batch->nr; i++)
+		batch->reclaim(batch->nodes[i], batch->priv);
+	free(batch);
+}
+
+static
+void reclaim_batch_thread_exit(void *arg)
+{
+	struct reclaim_batch *batch = arg;
+
+	batch->call_rcu(&batch->head, reclaim_batch_cb);
+}
+
+static
+void reclaim_batch_key_create(void)
+{
+	int ret;
+
+	ret = pthread_key_create(&reclaim_batch_key,
+			reclaim_batch_thread_exit);
+	if (ret)
+		urcu_die(ret);
+}
+
+static
+void reclaim_batch_set(struct reclaim_batch *batch)
+{
+	int ret;
+
+	URCU_TLS(reclaim_batch) = batch;
+	ret = pthread_setspecific(reclaim_batch_key, batch);
+	if (ret)
+		urcu_die(ret);
+}
+
+static
+struct reclaim_batch *reclaim_batch_alloc(struct cds_lfht *ht)
+{
+	struct reclaim_batch *batch;
+	int ret;
+
+	ret = pthread_once(&reclaim_batch_key_once, reclaim_batch_key_create);
+	if (ret)
+		urcu_die(ret);
+	batch = malloc(RECLAIM_BATCH_SIZE);
+	if (!batch)
+		urcu_die(errno);
+	batch->reclaim = ht->reclaim_node;
+	batch->priv = ht->reclaim_priv;
+	batch->call_rcu = ht_call_rcu_fct(ht);
+	batch->domain = ht->domain;
+	batch->nr = 0;
+	reclaim_batch_set(batch);
+	return batch;
+}
+
+/* Hand a node removed from @ht to its reclaim callback. */
+static
+void ht_reclaim_node(struct cds_lfht *ht, struct cds_lfht_node *node)
+{
+	struct reclaim_batch *batch = URCU_TLS(reclaim_batch);
+
+	if (batch && (batch->reclaim != ht->reclaim_node
+			|| batch->priv != ht->reclaim_priv
+			|| batch->call_rcu != ht_call_rcu_fct(ht)
+			|| batch->domain != ht->domain)) {
+		cds_lfht_reclaim_flush();
+		batch = NULL;
+	}
+	if (caa_unlikely(!batch))
+		batch = reclaim_batch_alloc(ht);
+	batch->nodes[batch->nr++] = node;
+	if (caa_unlikely(batch->nr == RECLAIM_BATCH_NR_NODES))
+		cds_lfht_reclaim_flush();
+}
+
+void cds_lfht_reclaim_flush(void)
+{
+	struct reclaim_batch *batch = URCU_TLS(reclaim_batch);
+
+	if (!batch)
+		return;
+	reclaim_batch_set(NULL);
+	batch->call_rcu(&batch->head, reclaim_batch_cb);
+}
+
+void cds_lfht_set_reclaim(struct cds_lfht *ht, cds_lfht_reclaim_fct reclaim,
+		void *priv)
+{
+	ht->reclaim_node = reclaim;
+	ht->reclaim_priv = priv;
+}
+
+/* Removal of a node, without handing it to the reclaim callback. */
+static
+int lfht_del(struct cds_lfht *ht, struct cds_lfht_node *node)
+{
+	unsigned long size;
+	int ret;
+
+	size = rcu_dereference(ht->size);
+	ret = _cds_lfht_del(ht, size, node);
+	if (!ret) {
+		unsigned long hash;
+
+		hash = bit_reverse_ulong(node->reverse_hash);
+		ht_count_del(ht, size, hash);
+	}
+	resize_help(ht);
+	return ret;
+}
+
+int cds_lfht_del(struct cds_lfht *ht, struct cds_lfht_node *node)
+{
+	int ret;
+
+	ret = lfht_del(ht, node);
+	if (!ret && ht->reclaim_node)
+		ht_reclaim_node(ht, node);
+	return ret;
+}
+
+struct cds_lfht_node *cds_lfht_add_replace(struct cds_lfht *ht,
+				unsigned long hash,
+				cds_lfht_match_fct match,
+				const void *key,
+				struct cds_lfht_node *node)
+{
+	unsigned long size;
+	struct cds_lfht_iter iter;
+
+	node->reverse_hash = bit_reverse_ulong(hash);
+	size = rcu_dereference(ht->size);
+	for (;;) {
+		_cds_lfht_add(ht, hash, match, key, size, node, &iter, 0, NULL);
+		if (iter.node == node) {
+			ht_count_add(ht, size, hash);
+			resize_help(ht);
+			return NULL;
+		}
+
+		if (!_cds_lfht_replace(ht, size, iter.node, iter.next, node)) {
+			if (ht->reclaim_node)
+				ht_reclaim_node(ht, iter.node);
+			return iter.node;
+		}
+	}
+}
+
+struct cds_lfht_node *cds_lfht_add_replace_u64(struct cds_lfht *ht,
+				unsigned long hash,
+				struct cds_lfht_node_u64 *node)
+{
+	return cds_lfht_add_replace(ht, hash, match_u64, &node->key,
+			&node->node);
+}
+
+/*
+ * Duplicate groups: the chain holds one group node per distinct key,
+ * the match function of the group comparing the key of one of its
+ * duplicates, the key node.
+ */
+struct dup_match_key {
+	cds_lfht_dup_match_fct match;
+	const void *key;
+};
+
+static
+int dup_group_match(struct cds_lfht_node *node, const void *key)
+{
+	const struct dup_match_key *mkey = key;
+	struct cds_lfht_dup_group *group =
+		caa_container_of(node, struct cds_lfht_dup_group, node);
+
+	return mkey->match(rcu_dereference(group->key_node), mkey->key);
+}
+
+static
+void dup_group_free(struct cds_lfht_dup_group *group)
+{
+	(void) pthread_mutex_destroy(&group->lock);
+	free(group);
+}
+
+static
+void dup_group_free_rcu(struct rcu_head *head)
+{
+	struct cds_lfht_dup_group *group =
+		caa_container_of(head, struct cds_lfht_dup_group, head);
+
+	/* The flavor grace period does not cover domain readers. */
+	if (group->domain)
+		synchronize_rcu_domain(group->domain);
+	dup_group_free(group);
+}
+
+struct cds_lfht_dup_group *cds_lfht_lookup_group(struct cds_lfht *ht,
+		unsigned long hash, cds_lfht_dup_match_fct match,
+		const void *key)
+{
+	struct dup_match_key mkey = { match, key };
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+
+	cds_lfht_lookup(ht, hash, dup_group_match, &mkey, &iter);
+	node = cds_lfht_iter_get_node(&iter);
+	if (!node)
+		return NULL;
+	return caa_container_of(node, struct cds_lfht_dup_group, node);
+}
+
+int cds_lfht_add_dup(struct cds_lfht *ht, unsigned long hash,
+		cds_lfht_dup_match_fct match, const void *key,
+		struct cds_lfht_dup_node *node)
+{
+	struct dup_match_key mkey = { match, key };
+	struct cds_lfht_dup_group *group, *new_group = NULL;
+	struct cds_lfht_node *ret;
+
+	for (;;) {
+		group = cds_lfht_lookup_group(ht, hash, match, key);
+		if (!group) {
+			if (!new_group) {
+				new_group = calloc(1, sizeof(*new_group));
+				if (!new_group)
+					return -ENOMEM;
+				CDS_INIT_LIST_HEAD(&new_group->dups);
+				pthread_mutex_init(&new_group->lock, NULL);
+			}
+			/* The group is published before holding the node. */
+			new_group->key_node = node;
+			ret = cds_lfht_add_unique(ht, hash, dup_group_match,
+					&mkey, &new_group->node);
+			group = caa_container_of(ret,
+					struct cds_lfht_dup_group, node);
+			if (group == new_group)
+				new_group = NULL;
+		}
+		pthread_mutex_lock(&group->lock);
+		/* A group removed by its last cds_lfht_del_dup() is dead. */
+		if (!group->dead)
+			break;
+		pthread_mutex_unlock(&group->lock);
+	}
+	node->group = group;
+	cds_list_add_tail_rcu(&node->list, &group->dups);
+	group->nr_dups++;
+	pthread_mutex_unlock(&group->lock);
+	if (new_group)
+		dup_group_free(new_group);
+	return 0;
+}
+
+int cds_lfht_del_dup(struct cds_lfht *ht, struct cds_lfht_dup_node *node)
+{
+	struct cds_lfht_dup_group *group = CMM_LOAD_SHARED(node->group);
+	int ret;
+
+	if (!group)
+		return -ENOENT;
+	pthread_mutex_lock(&group->lock);
+	if (node->group != group) {
+		/* Concurrently removed. */
+		pthread_mutex_unlock(&group->lock);
+		return -ENOENT;
+	}
+	cds_list_del_rcu(&node->list);
+	CMM_STORE_SHARED(node->group, NULL);
+	if (!--group->nr_dups) {
+		group->dead = 1;
+		ret = lfht_del(ht, &group->node);
+		assert(!ret);
+		pthread_mutex_unlock(&group->lock);
+		group->domain = ht->domain;
+		ht_call_rcu(ht, &group->head, dup_group_free_rcu);
+		return 0;
+	}
+	if (group->key_node == node)
+		rcu_set_pointer(&group->key_node,
+			cds_list_entry(group->dups.next,
+				struct cds_lfht_dup_node, list));
+	pthread_mutex_unlock(&group->lock);
+	return 0;
+}
+
+struct cds_lfht_frozen *cds_lfht_freeze(struct cds_lfht *ht)
+{
+	struct cds_lfht_frozen_slot *collected = NULL, *tmp;
+	unsigned long nr = 0, alloc = 0, k, pos;
+	struct cds_lfht_frozen *frozen;
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+
+	/* Collect first: the table may change between two traversals. */
+	cds_lfht_for_each(ht, &iter, node) {
+		if (nr == alloc) {
+			alloc = alloc ? alloc << 1 : MIN_TABLE_SIZE;
+			tmp = realloc(collected, alloc * sizeof(*collected));
+			if (!tmp) {
+				free(collected);
+				return NULL;
+			}
+			collected = tmp;
+		}
+		collected[nr].hash = bit_reverse_ulong(node->reverse_hash);
+		collected[nr].node = node;
+		nr++;
+	}
+	alloc = 1UL << cds_lfht_get_count_order_ulong(max(nr << 1, 2UL));
+	frozen = calloc(1, sizeof(*frozen) + alloc * sizeof(frozen->slots[0]));
+	if (!frozen) {
+		free(collected);
+		return NULL;
+	}
+	frozen->mask = alloc - 1;
+	frozen->nr_nodes = nr;
+	/* Duplicates keep their table order along the probe sequence. */
+	for (k = 0; k < nr; k++) {
+		pos = collected[k].hash & frozen->mask;
+		while (frozen->slots[pos].node)
+			pos = (pos + 1) & frozen->mask;
+		frozen->slots[pos] = collected[k];
+	}
+	free(collected);
+	return frozen;
+}
+
+void cds_lfht_frozen_destroy(struct cds_lfht_frozen *frozen)
+{
+	free(frozen);
+}
+
+static
+void frozen_walk(const struct cds_lfht_frozen *frozen, unsigned long pos,
+		unsigned long hash, cds_lfht_match_fct match, const void *key,
+		struct cds_lfht_frozen_iter *iter)
+{
+	const struct cds_lfht_frozen_slot *slot;
+
+	for (;; pos = (pos + 1) & frozen->mask) {
+		slot = &frozen->slots[pos];
+		if (!slot->node)
+			break;
+		if (slot->hash == hash && match(slot->node, key)) {
+			iter->node = slot->node;
+			iter->pos = pos;
+			return;
+		}
+	}
+	iter->node = NULL;
+}
+
+void cds_lfht_frozen_lookup(const struct cds_lfht_frozen *frozen,
+		unsigned long hash, cds_lfht_match_fct match, const void *key,
+		struct cds_lfht_frozen_iter *iter)
+{
+	frozen_walk(frozen, hash & frozen->mask, hash, match, key, iter);
+}
+
+void cds_lfht_frozen_next_duplicate(const struct cds_lfht_frozen *frozen,
+		unsigned long hash, cds_lfht_match_fct match, const void *key,
+		struct cds_lfht_frozen_iter *iter)
+{
+	frozen_walk(frozen, (iter->pos + 1) & frozen->mask, hash, match, key,
+		iter);
+}
+
+/*
+ * Online rehash. The mutex serializes the moves of the rehash worker
+ * with removals: a node of the old table found removed under the mutex
+ * was moved, given that objects are removed at most once.
+ */
+struct cds_lfht_rehash {
+	struct cds_lfht *old_ht, *new_ht;
+	cds_lfht_rehash_fct rehash;
+	void *priv;
+	pthread_mutex_t lock;
+	int done;		/* old table is empty */
+};
+
+struct cds_lfht_rehash *cds_lfht_rehash_start(struct cds_lfht *old_ht,
+		struct cds_lfht *new_ht, cds_lfht_rehash_fct rehash,
+		void *priv)
+{
+	struct cds_lfht_rehash *rh;
+
+	rh = calloc(1, sizeof(*rh));
+	if (!rh)
+		return NULL;
+	rh->old_ht = old_ht;
+	rh->new_ht = new_ht;
+	rh->rehash = rehash;
+	rh->priv = priv;
+	pthread_mutex_init(&rh->lock, NULL);
+	return rh;
+}
+
+long cds_lfht_rehash_run(struct cds_lfht_rehash *rh)
+{
+	struct cds_lfht *old_ht = rh->old_ht, *new_ht = rh->new_ht;
+	struct cds_lfht_partition_iter piter;
+	struct cds_lfht_node *node, *new_node;
+	unsigned long index, nr_partitions, hash;
+	int old_idx, new_idx, ret;
+	long nr_moved = 0;
+
+	/* Partitions of about RESIZE_SLICE nodes. */
+	nr_partitions = max(CMM_LOAD_SHARED(old_ht->size) >> RESIZE_SLICE_ORDER,
+			1UL);
+	for (index = 0; index < nr_partitions; index++) {
+		old_idx = ht_read_lock(old_ht);
+		new_idx = ht_read_lock(new_ht);
+		cds_lfht_for_each_partition(old_ht, index, nr_partitions,
+				&piter, node) {
+			pthread_mutex_lock(&rh->lock);
+			if (cds_lfht_is_node_deleted(node)) {
+				pthread_mutex_unlock(&rh->lock);
+				continue;
+			}
+			new_node = rh->rehash(node, &hash, rh->priv);
+			/* Add before removal: lookups consult the old table first. */
+			cds_lfht_add(new_ht, hash, new_node);
+			/* The object lives on in the new table. */
+			ret = lfht_del(old_ht, node);
+			assert(!ret);
+			pthread_mutex_unlock(&rh->lock);
+			nr_moved++;
+		}
+		ht_read_unlock(new_ht, new_idx);
+		ht_read_unlock(old_ht, old_idx);
+		/* Quiescent state between partitions (QSBR). */
+		ht_thread_offline(old_ht);
+		ht_thread_online(old_ht);
+	}
+	uatomic_set(&rh->done, 1);
+	return nr_moved;
+}
+
+void cds_lfht_rehash_lookup(struct cds_lfht_rehash *rh,
+		unsigned long old_hash, cds_lfht_match_fct old_match,
+		unsigned long new_hash, cds_lfht_match_fct new_match,
+		const void *key, struct cds_lfht_rehash_iter *iter)
+{
+	if (!uatomic_read(&rh->done)) {
+		cds_lfht_lookup(rh->old_ht, old_hash, old_match, key,
+				&iter->iter);
+		if (cds_lfht_iter_get_node(&iter->iter)) {
+			iter->ht = rh->old_ht;
+			return;
+		}
+	}
+	cds_lfht_lookup(rh->new_ht, new_hash, new_match, key, &iter->iter);
+	iter->ht = rh->new_ht;
+}
+
+int cds_lfht_rehash_del(struct cds_lfht_rehash *rh,
+		struct cds_lfht_rehash_iter *iter)
+{
+	struct cds_lfht_node *node = cds_lfht_iter_get_node(&iter->iter);
+	unsigned long hash;
+	int ret;
+
+	if (!node)
+		return -ENOENT;
+	if (iter->ht == rh->new_ht)
+		return cds_lfht_del(rh->new_ht, node);
+	pthread_mutex_lock(&rh->lock);
+	if (!cds_lfht_is_node_deleted(node))
+		ret = cds_lfht_del(rh->old_ht, node);
+	else
+		ret = cds_lfht_del(rh->new_ht,
+				rh->rehash(node, &hash, rh->priv));
+	pthread_mutex_unlock(&rh->lock);
+	return ret;
+}
+
+void cds_lfht_rehash_destroy(struct cds_lfht_rehash *rh)
+{
+	(void) pthread_mutex_destroy(&rh->lock);
+	free(rh);
+}
+
+int cds_lfht_replace(struct cds_lfht *ht,
+		struct cds_lfht_iter *old_iter,
+		unsigned long hash,
+		cds_lfht_match_fct match,
+		const void *key,
+		struct cds_lfht_node *new_node)
+{
+	unsigned long size;
+	int ret;
+
+	new_node->reverse_hash = bit_reverse_ulong(hash);
+	if (!old_iter->node)
+		return -ENOENT;
+	if (caa_unlikely(old_iter->node->reverse_hash != new_node->reverse_hash))
+		return -EINVAL;
+	if (caa_unlikely(!match(old_iter->node, key)))
+		return -EINVAL;
+	size = rcu_dereference(ht->size);
+	ret = _cds_lfht_replace(ht, size, old_iter->node, old_iter->next,
+			new_node);
+	if (!ret && ht->reclaim_node)
+		ht_reclaim_node(ht, old_iter->node);
+	return ret;
+}
+
+/*
+ * Nodes removed by cds_lfht_sweep(), handed to the reclaim callback
+ * after a single grace period.
+ */
+struct sweep_batch {
+	struct rcu_head head;
+	cds_lfht_reclaim_fct reclaim;
+	void *priv;
+	struct rcu_domain *domain;
+	unsigned long nr, alloc;
+	struct cds_lfht_node *nodes[];
+};
+
+#define SWEEP_BATCH_INIT_ALLOC	64
+
+static
+void sweep_batch_cb(struct rcu_head *head)
+{
+	struct sweep_batch *batch =
+		caa_container_of(head, struct sweep_batch, head);
+	unsigned long i;
+
+	/*
+	 * The flavor grace period does not cover domain readers: wait for
+	 * them from the call_rcu worker.
+	 */
+	if (batch->domain)
+		synchronize_rcu_domain(batch->domain);
+	for (i = 0; i < batch->nr; i++)
+		batch->reclaim(batch->nodes[i], batch->priv);
+	free(batch);
+}
+
+/* Make room for one more node. Return -ENOMEM on failure. */
+static
+int sweep_batch_reserve(struct cds_lfht *ht, struct sweep_batch **batchp,
+		cds_lfht_reclaim_fct reclaim, void *priv)
+{
+	struct sweep_batch *batch = *batchp, *new_batch;
+	unsigned long alloc;
+
+	if (batch && batch->nr < batch->alloc)
+		return 0;
+	alloc = batch ? batch->alloc << 1 : SWEEP_BATCH_INIT_ALLOC;
+	new_batch = realloc(batch, sizeof(*batch)
+			+ alloc * sizeof(struct cds_lfht_node *));
+	if (!new_batch)
+		return -ENOMEM;
+	if (!batch) {
+		new_batch->reclaim = reclaim;
+		new_batch->priv = priv;
+		new_batch->domain = ht->domain;
+		new_batch->nr = 0;
+	}
+	new_batch->alloc = alloc;
+	*batchp = new_batch;
+	return 0;
+}
+
+/*
+ * Garbage collect the nodes marked in bucket, from batch->nodes[first]
+ * onwards, and keep those we own the removal of.
+ */
+static
+void sweep_gc_bucket(struct cds_lfht *ht, unsigned long size,
+		struct cds_lfht_node *bucket, struct sweep_batch *batch,
+		unsigned long first)
+{
+	unsigned long i, nr = first;
+
+	if (batch->nr == first)
+		return;
+	_cds_lfht_gc_bucket(bucket, batch->nodes[batch->nr - 1]);
+	ht_op_stats_add(ht, nr_gc_passes, 1);
+	for (i = first; i < batch->nr; i++) {
+		struct cds_lfht_node *node = batch->nodes[i];
+
+		if (_cds_lfht_del_owner(node))
+			continue;
+		filter_del(ht, bit_reverse_ulong(node->reverse_hash));
+		ht_count_del(ht, size, bit_reverse_ulong(node->reverse_hash));
+		batch->nodes[nr++] = node;
+	}
+	ht_op_stats_add(ht, nr_dels, nr - first);
+	batch->nr = nr;
+}
+
+long cds_lfht_sweep(struct cds_lfht *ht, unsigned long index,
+		unsigned long nr_partitions, cds_lfht_sweep_fct match,
+		cds_lfht_reclaim_fct reclaim, void *priv)
+{
+	struct cds_lfht_partition_iter piter;
+	struct cds_lfht_node *node, *bucket = NULL;
+	struct sweep_batch *batch = NULL;
+	unsigned long size, first = 0, nr;
+	long ret = 0;
+
+	size = rcu_dereference(ht->size);
+	cds_lfht_for_each_partition(ht, index, nr_partitions, &piter, node) {
+		struct cds_lfht_node *node_bucket;
+
+		if (!match(node, priv))
+			continue;
+		/*
+		 * Nodes of a bucket are contiguous in the split-ordered
+		 * list: garbage collect each bucket once, when leaving it.
+		 */
+		node_bucket = lookup_bucket(ht, size,
+				bit_reverse_ulong(node->reverse_hash));
+		if (node_bucket != bucket) {
+			if (bucket)
+				sweep_gc_bucket(ht, size, bucket, batch, first);
+			bucket = node_bucket;
+			first = batch ? batch->nr : 0;
+		}
+		ret = sweep_batch_reserve(ht, &batch, reclaim, priv);
+		if (ret)
+			break;
+		if (_cds_lfht_del_mark(node))
+			continue;
+		batch->nodes[batch->nr++] = node;
+	}
+	if (!batch)
+		goto end;
+	lookup_cache_invalidate(ht);
+	sweep_gc_bucket(ht, size, bucket, batch, first);
+	nr = batch->nr;
+	if (nr)
+		ht_call_rcu(ht, &batch->head, sweep_batch_cb);
+	else
+		free(batch);
+	if (!ret)
+		ret = nr;
+end:
+	resize_help(ht);
+	return ret;
+}
+
+long cds_lfht_gc(struct cds_lfht *ht, unsigned long index,
+		unsigned long nr_partitions)
+{
+	struct cds_lfht_node *node, *next, *bucket;
+	struct cds_lfht_node *gc_bucket = NULL, *gc_node = NULL;
+	unsigned long start, end, size;
+	long nr = 0;
+	int last;
+
+	assert(index < nr_partitions);
+	start = partition_start(index, nr_partitions);
+	end = partition_start(index + 1, nr_partitions);
+	last = (index == nr_partitions - 1);
+	size = rcu_dereference(ht->size);
+	bucket = lookup_bucket(ht, size, bit_reverse_ulong(start));
+	node = clear_flag(rcu_dereference(bucket->next));
+	for (;;) {
+		if (caa_unlikely(is_end(node)))
+			break;
+		if (!last && node->reverse_hash >= end)
+			break;
+		next = rcu_dereference(node->next);
+		if (is_removed(next) && !is_bucket(next)
+				&& node->reverse_hash >= start) {
+			/*
+			 * Nodes of a bucket are contiguous in the
+			 * split-ordered list: garbage collect each bucket
+			 * once, up to its last removed node.
+			 */
+			bucket = lookup_bucket(ht, size,
+					bit_reverse_ulong(node->reverse_hash));
+			if (bucket != gc_bucket) {
+				if (gc_bucket) {
+					_cds_lfht_gc_bucket(gc_bucket, gc_node);
+					ht_op_stats_add(ht, nr_gc_passes, 1);
+				}
+				gc_bucket = bucket;
+			}
+			gc_node = node;
+			nr++;
+		}
+		node = clear_flag(next);
+	}
+	if (gc_bucket) {
+		_cds_lfht_gc_bucket(gc_bucket, gc_node);
+		ht_op_stats_add(ht, nr_gc_passes, 1);
+	}
+	return nr;
+}
+
+/*
+ * Buckets garbage collected per read-side critical section by
+ * cds_lfht_gc_async(), so that the pass does not hold back grace
+ * periods for the whole table.
+ */
+#define GC_ASYNC_PARTITION_ORDER	10
+
+struct rcu_gc_work {
+	struct rcu_head head;
+	struct cds_lfht *ht;
+};
+
+static
+void do_gc_cb(struct rcu_head *head)
 {
-	unsigned long size;
+	struct rcu_gc_work *work =
+		caa_container_of(head, struct rcu_gc_work, head);
+	struct cds_lfht *ht = work->ht;
+	unsigned long i, nr_partitions;
+	int idx;
 
-	node->reverse_hash = bit_reverse_ulong(hash);
-	size = rcu_dereference(ht->size);
-	_cds_lfht_add(ht, hash, NULL, NULL, size, node, NULL, 0);
-	ht_count_add(ht, size, hash);
+	nr_partitions = CMM_LOAD_SHARED(ht->size) >> GC_ASYNC_PARTITION_ORDER;
+	if (!nr_partitions)
+		nr_partitions = 1;
+	for (i = 0; i < nr_partitions; i++) {
+		if (CMM_LOAD_SHARED(ht->in_progress_destroy))
+			break;
+		idx = ht_read_lock(ht);
+		(void) cds_lfht_gc(ht, i, nr_partitions);
+		ht_read_unlock(ht, idx);
+	}
+	poison_free(work);
+	cmm_smp_mb();	/* finish gc before decrement */
+	uatomic_dec(&ht->in_progress_gc);
 }
 
-struct cds_lfht_node *cds_lfht_add_unique(struct cds_lfht *ht,
-				unsigned long hash,
-				cds_lfht_match_fct match,
-				const void *key,
-				struct cds_lfht_node *node)
+int cds_lfht_gc_async(struct cds_lfht *ht)
 {
-	unsigned long size;
-	struct cds_lfht_iter iter;
-
-	node->reverse_hash = bit_reverse_ulong(hash);
-	size = rcu_dereference(ht->size);
-	_cds_lfht_add(ht, hash, match, key, size, node, &iter, 0);
-	if (iter.node == node)
-		ht_count_add(ht, size, hash);
-	return iter.node;
+	struct rcu_gc_work *work;
+
+	work = malloc(sizeof(*work));
+	if (!work)
+		return -ENOMEM;
+	work->ht = ht;
+	uatomic_inc(&ht->in_progress_gc);
+	cmm_smp_mb();	/* increment gc count before load destroy */
+	if (CMM_LOAD_SHARED(ht->in_progress_destroy)) {
+		uatomic_dec(&ht->in_progress_gc);
+		poison_free(work);
+		return -EBUSY;
+	}
+	ht_call_rcu(ht, &work->head, do_gc_cb);
+	return 0;
 }
 
-struct cds_lfht_node *cds_lfht_add_replace(struct cds_lfht *ht,
-				unsigned long hash,
-				cds_lfht_match_fct match,
-				const void *key,
-				struct cds_lfht_node *node)
+void cds_lfht_set_domain(struct cds_lfht *ht, struct rcu_domain *domain)
 {
-	unsigned long size;
-	struct cds_lfht_iter iter;
-
-	node->reverse_hash = bit_reverse_ulong(hash);
-	size = rcu_dereference(ht->size);
-	for (;;) {
-		_cds_lfht_add(ht, hash, match, key, size, node, &iter, 0);
-		if (iter.node == node) {
-			ht_count_add(ht, size, hash);
-			return NULL;
-		}
-
-		if (!_cds_lfht_replace(ht, size, iter.node, iter.next, node))
-			return iter.node;
-	}
+	ht->domain = domain;
 }
 
-int cds_lfht_replace(struct cds_lfht *ht,
-		struct cds_lfht_iter *old_iter,
-		unsigned long hash,
-		cds_lfht_match_fct match,
-		const void *key,
-		struct cds_lfht_node *new_node)
+/*
+ * The resize mutex keeps its contention statistics with
+ * CONFIG_RCU_LOCK_STATS.
+ */
+static
+void resize_mutex_lock(struct cds_lfht *ht)
 {
-	unsigned long size;
+	struct rcu_lock_stats_state *ls = &ht->resize_lock_stats;
+	uint64_t wait_start;
+	int ret;
 
-	new_node->reverse_hash = bit_reverse_ulong(hash);
-	if (!old_iter->node)
-		return -ENOENT;
-	if (caa_unlikely(old_iter->node->reverse_hash != new_node->reverse_hash))
-		return -EINVAL;
-	if (caa_unlikely(!match(old_iter->node, key)))
-		return -EINVAL;
-	size = rcu_dereference(ht->size);
-	return _cds_lfht_replace(ht, size, old_iter->node, old_iter->next,
-			new_node);
+	wait_start = rcu_lock_stats_trylock(ls, &ht->resize_mutex);
+	if (!wait_start)
+		return;
+	ret = pthread_mutex_lock(&ht->resize_mutex);
+	if (ret)
+		urcu_die(ret);
+	rcu_lock_stats_acquired(ls, wait_start);
 }
 
-int cds_lfht_del(struct cds_lfht *ht, struct cds_lfht_node *node)
+static
+void resize_mutex_unlock(struct cds_lfht *ht)
 {
-	unsigned long size;
 	int ret;
 
-	size = rcu_dereference(ht->size);
-	ret = _cds_lfht_del(ht, size, node);
-	if (!ret) {
-		unsigned long hash;
+	rcu_lock_stats_release(&ht->resize_lock_stats);
+	ret = pthread_mutex_unlock(&ht->resize_mutex);
+	if (ret)
+		urcu_die(ret);
+}
 
-		hash = bit_reverse_ulong(node->reverse_hash);
-		ht_count_del(ht, size, hash);
+int cds_lfht_set_resize_workers(struct cds_lfht *ht, unsigned int max_workers,
+		const int *cpus, unsigned int nr_cpus)
+{
+	int *resize_cpus = NULL;
+	int was_online, ret = 0;
+	unsigned int i;
+
+	if (nr_cpus && !cpus)
+		return -EINVAL;
+	for (i = 0; i < nr_cpus; i++) {
+		if (cpus[i] < 0)
+			return -EINVAL;
+	}
+	if (nr_cpus) {
+		resize_cpus = malloc(nr_cpus * sizeof(*resize_cpus));
+		if (!resize_cpus)
+			return -ENOMEM;
+		memcpy(resize_cpus, cpus, nr_cpus * sizeof(*resize_cpus));
 	}
+	was_online = ht_read_ongoing(ht);
+	if (was_online)
+		ht_thread_offline(ht);
+	/* Calling with RCU read-side held is an error. */
+	if (ht_read_ongoing(ht)) {
+		free(resize_cpus);
+		ret = -EINVAL;
+		goto end;
+	}
+	resize_mutex_lock(ht);
+	/* The next resize creates the workers with the new settings. */
+	resize_pool_destroy(ht);
+	free(ht->resize_cpus);
+	ht->resize_cpus = resize_cpus;
+	ht->resize_nr_cpus = nr_cpus;
+	ht->resize_max_workers = max_workers;
+	resize_mutex_unlock(ht);
+end:
+	if (was_online)
+		ht_thread_online(ht);
 	return ret;
 }
 
@@ -1775,41 +4275,347 @@ int cds_lfht_delete_bucket(struct cds_lfht *ht)
 }
 
 /*
- * Should only be called when no more concurrent readers nor writers can
- * possibly access the table.
+ * Free the nodes linked between the buckets found at list positions
+ * [start, start + len) and the bucket at position start + len, and
+ * link these buckets back together. The t-th bucket in list order is
+ * the bucket of index bit_reverse(t) over "order" bits.
  */
-int cds_lfht_destroy(struct cds_lfht *ht, pthread_attr_t **attr)
+static
+void free_nodes_partition(struct cds_lfht *ht, unsigned long order,
+		unsigned long start, unsigned long len)
+{
+	struct cds_lfht_node *bucket, *end, *iter, *next;
+
+	if (order == 0) {
+		bucket = bucket_at(ht, 0);
+		end = END_VALUE;
+	} else {
+		unsigned long shift = CAA_BITS_PER_LONG - order;
+
+		bucket = bucket_at(ht, bit_reverse_ulong(start) >> shift);
+		if (start + len == 1UL << order)
+			end = END_VALUE;
+		else
+			end = bucket_at(ht,
+				bit_reverse_ulong(start + len) >> shift);
+	}
+	iter = clear_flag(bucket->next);
+	while (iter != end) {
+		next = iter->next;
+		if (is_bucket(next)) {
+			bucket->next = flag_bucket(iter);
+			bucket = iter;
+		} else {
+			assert(!is_removed(next));
+			ht->destroy_free_node(iter, ht->destroy_priv);
+		}
+		iter = clear_flag(next);
+	}
+	bucket->next = flag_bucket(end);
+}
+
+/* Free the table once its bucket tables are freed. */
+static
+void ht_free(struct cds_lfht *ht, pthread_attr_t **attr)
+{
+	free_split_items_count(ht);
+	free_op_stats(ht);
+	free(ht->filter);
+	free(ht->resize_cpus);
+	if (attr)
+		*attr = ht->resize_attr;
+	free_cds_lfht(ht);
+}
+
+static
+int _cds_lfht_destroy(struct cds_lfht *ht,
+		void (*free_node)(struct cds_lfht_node *node, void *priv),
+		void *priv, pthread_attr_t **attr)
 {
 	int ret, was_online;
 
 	/* Wait for in-flight resize operations to complete */
 	_CMM_STORE_SHARED(ht->in_progress_destroy, 1);
 	cmm_smp_mb();	/* Store destroy before load resize */
-	was_online = ht->flavor->read_ongoing();
+	was_online = ht_read_ongoing(ht);
 	if (was_online)
-		ht->flavor->thread_offline();
+		ht_thread_offline(ht);
 	/* Calling with RCU read-side held is an error. */
-	if (ht->flavor->read_ongoing()) {
+	if (ht_read_ongoing(ht)) {
 		ret = -EINVAL;
 		if (was_online)
-			ht->flavor->thread_online();
+			ht_thread_online(ht);
 		goto end;
 	}
-	while (uatomic_read(&ht->in_progress_resize))
+	while (uatomic_read(&ht->in_progress_resize)
+			|| uatomic_read(&ht->in_progress_gc))
 		poll(NULL, 0, 100);	/* wait for 100ms */
+	if (free_node) {
+		unsigned long size = ht->size;
+
+		/* Free the nodes with the resize partition workers. */
+		ht->destroy_free_node = free_node;
+		ht->destroy_priv = priv;
+		partition_resize_helper(ht, cds_lfht_get_count_order_ulong(size),
+				size, free_nodes_partition);
+	}
+	resize_pool_destroy(ht);
 	if (was_online)
-		ht->flavor->thread_online();
+		ht_thread_online(ht);
 	ret = cds_lfht_delete_bucket(ht);
 	if (ret)
 		return ret;
-	free_split_items_count(ht);
-	if (attr)
-		*attr = ht->resize_attr;
-	poison_free(ht);
+	ht_free(ht, attr);
 end:
 	return ret;
 }
 
+/*
+ * Should only be called when no more concurrent readers nor writers can
+ * possibly access the table.
+ */
+int cds_lfht_destroy(struct cds_lfht *ht, pthread_attr_t **attr)
+{
+	return _cds_lfht_destroy(ht, NULL, NULL, attr);
+}
+
+/*
+ * Same as cds_lfht_destroy(), but the nodes left in the table are
+ * handed to free_node.
+ */
+int cds_lfht_destroy_free(struct cds_lfht *ht,
+		void (*free_node)(struct cds_lfht_node *node, void *priv),
+		void *priv, pthread_attr_t **attr)
+{
+	return _cds_lfht_destroy(ht, free_node, priv, attr);
+}
+
+struct rcu_destroy_work {
+	struct rcu_head head;
+	struct cds_lfht *ht;
+	cds_lfht_destroy_done_fct done;
+	void *priv;
+};
+
+static
+void do_destroy_cb(struct rcu_head *head)
+{
+	struct rcu_destroy_work *work =
+		caa_container_of(head, struct rcu_destroy_work, head);
+	struct cds_lfht *ht = work->ht;
+	pthread_attr_t *attr;
+	int ret __attribute__((unused));
+
+	/*
+	 * Resizes queued before the destroy bail out at once, but may be
+	 * queued on other call_rcu workers, and a synchronous resize
+	 * finishes its current step: check again after the next grace
+	 * period rather than wait here.
+	 */
+	if (uatomic_read(&ht->in_progress_resize)
+			|| uatomic_read(&ht->in_progress_gc)) {
+		ht_call_rcu(ht, &work->head, do_destroy_cb);
+		return;
+	}
+	cmm_smp_mb();	/* load resize count before freeing */
+	ht_thread_offline(ht);
+	resize_pool_destroy(ht);
+	ht_thread_online(ht);
+	ret = cds_lfht_delete_bucket(ht);
+	assert(!ret);	/* checked empty by cds_lfht_destroy_async() */
+	ht_free(ht, &attr);
+	if (work->done)
+		work->done(attr, work->priv);
+	free(work);
+}
+
+int cds_lfht_destroy_async(struct cds_lfht *ht,
+		cds_lfht_destroy_done_fct done, void *priv)
+{
+	struct rcu_destroy_work *work;
+	struct cds_lfht_node *node;
+
+	/* Check that the table is empty, as cds_lfht_delete_bucket(). */
+	node = bucket_at(ht, 0);
+	do {
+		node = clear_flag(node)->next;
+		if (!is_bucket(node))
+			return -EPERM;
+	} while (!is_end(node));
+	work = malloc(sizeof(*work));
+	if (!work)
+		return -ENOMEM;
+	work->ht = ht;
+	work->done = done;
+	work->priv = priv;
+	/* Cancel the pending lazy resizes, and prevent new ones. */
+	_CMM_STORE_SHARED(ht->in_progress_destroy, 1);
+	cmm_smp_mb();	/* Store destroy before load resize */
+	ht_call_rcu(ht, &work->head, do_destroy_cb);
+	return 0;
+}
+
+/* Sum of the split-counters, 0 without accounting. */
+static
+long ht_count_sum(struct cds_lfht *ht)
+{
+	if (!(ht->flags & CDS_LFHT_ACCOUNTING))
+		return 0;
+	return cds_split_counter_read(&ht->split_count);
+}
+
+static
+void stats_close_chain(struct cds_lfht_stats *stats, unsigned long chain_len)
+{
+	stats->chain_len_hist[min(chain_len,
+			(unsigned long) CDS_LFHT_STATS_CHAIN_HIST - 1)]++;
+	stats->max_chain_len = max(stats->max_chain_len, chain_len);
+}
+
+void cds_lfht_get_stats(struct cds_lfht *ht, struct cds_lfht_stats *stats)
+{
+	struct cds_lfht_node *node, *next;
+	unsigned long chain_len = 0;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->size = rcu_dereference(ht->size);
+	stats->resize_target = CMM_LOAD_SHARED(ht->resize_target);
+
+	node = bucket_at(ht, 0);
+	do {
+		next = rcu_dereference(node->next);
+		if (is_bucket(next)) {
+			unsigned long index = bit_reverse_ulong(node->reverse_hash);
+
+			if (stats->nr_buckets)
+				stats_close_chain(stats, chain_len);
+			chain_len = 0;
+			stats->nr_buckets++;
+			stats->buckets_per_order[index ?
+				cds_lfht_fls_ulong(index) : 0]++;
+		} else if (is_removed(next)) {
+			stats->nr_removed++;
+		} else {
+			stats->nr_nodes++;
+			chain_len++;
+		}
+		node = clear_flag(next);
+	} while (!is_end(node));
+	stats_close_chain(stats, chain_len);
+}
+
+unsigned long cds_lfht_bucket_memory(struct cds_lfht *ht)
+{
+	return CMM_LOAD_SHARED(ht->bucket_mem);
+}
+
+#ifdef HAVE_MINCORE
+/* Pages queried by each mincore() call. */
+#define RESIDENT_VEC_PAGES	1024
+
+/* Bytes of [start, end) within resident pages. */
+static
+unsigned long resident_bytes(uintptr_t start, uintptr_t end)
+{
+	unsigned char vec[RESIDENT_VEC_PAGES];
+	uintptr_t page_size = getpagesize(), addr, page_end;
+	unsigned long resident = 0, i, nr_pages;
+
+	for (addr = start & ~(page_size - 1); addr < end;
+			addr += nr_pages * page_size) {
+		nr_pages = min((end - addr + page_size - 1) / page_size,
+			(uintptr_t) RESIDENT_VEC_PAGES);
+		/* Unmapped by a concurrent shrink: not resident. */
+		if (mincore((void *) addr, nr_pages * page_size,
+				(void *) vec))
+			continue;
+		for (i = 0; i < nr_pages; i++) {
+			if (!(vec[i] & 1))
+				continue;
+			page_end = addr + (i + 1) * page_size;
+			resident += min(page_end, end)
+				- max(addr + i * page_size, start);
+		}
+	}
+	return resident;
+}
+
+/*
+ * The bucket tables of the library plugins are contiguous for each
+ * order, vs for each min_nr_alloc_buckets chunk with the chunk and numa
+ * plugins (and plugins of the application, which are not known). Walk
+ * the allocated buckets by those pieces, merging the pieces adjacent in
+ * memory, and query the residency of each range.
+ */
+unsigned long cds_lfht_bucket_resident_memory(struct cds_lfht *ht)
+{
+	const size_t node_size = sizeof(struct cds_lfht_node);
+	unsigned long nr_buckets, index, len, resident = 0;
+	uintptr_t start = 0, end = 0, piece;
+	int per_order;
+
+	per_order = ht->mm == &cds_lfht_mm_order
+		|| ht->mm == &cds_lfht_mm_mmap
+		|| ht->mm == &cds_lfht_mm_hugepage
+		|| ht->mm == &cds_lfht_mm_file;
+	nr_buckets = CMM_LOAD_SHARED(ht->bucket_mem) / node_size;
+	for (index = 0; index < nr_buckets; index += len) {
+		if (!index || !per_order)
+			len = ht->min_nr_alloc_buckets;
+		else
+			len = index;	/* order cds_lfht_fls_ulong(index) */
+		piece = (uintptr_t) bucket_at(ht, index);
+		if (piece != end) {
+			resident += resident_bytes(start, end);
+			start = piece;
+		}
+		end = piece + len * node_size;
+	}
+	return resident + resident_bytes(start, end);
+}
+#else /* #ifdef HAVE_MINCORE */
+unsigned long cds_lfht_bucket_resident_memory(struct cds_lfht *ht)
+{
+	return cds_lfht_bucket_memory(ht);
+}
+#endif /* #else #ifdef HAVE_MINCORE */
+
+int cds_lfht_resize_in_progress(struct cds_lfht *ht)
+{
+	return uatomic_read(&ht->in_progress_resize) != 0;
+}
+
+void cds_lfht_get_resize_stats(struct cds_lfht *ht,
+		struct cds_lfht_resize_stats *stats)
+{
+	stats->nr_resizes = CMM_LOAD_SHARED(ht->nr_resizes);
+	stats->nr_levels = CMM_LOAD_SHARED(ht->resize_nr_levels);
+	stats->helper_ns = CMM_LOAD_SHARED(ht->resize_helper_ns);
+}
+
+int cds_lfht_get_resize_lock_stats(struct cds_lfht *ht,
+		struct rcu_lock_stats *stats)
+{
+	return rcu_lock_stats_read(&ht->resize_lock_stats, stats);
+}
+
+int cds_lfht_get_op_stats(struct cds_lfht *ht, struct cds_lfht_op_stats *stats)
+{
+	return read_op_stats(ht, stats);
+}
+
+int cds_lfht_size_approx(struct cds_lfht *ht, unsigned long *approx)
+{
+	long sum;
+
+	if (!(ht->flags & CDS_LFHT_ACCOUNTING))
+		return -EINVAL;
+	sum = ht_count_sum(ht);
+	/* Concurrent add/del can make the sum transiently negative. */
+	*approx = sum < 0 ? 0 : sum;
+	return 0;
+}
+
 void cds_lfht_count_nodes(struct cds_lfht *ht,
 		long *approx_before,
 		unsigned long *count,
@@ -1818,15 +4624,7 @@ void cds_lfht_count_nodes(struct cds_lfht *ht,
 	struct cds_lfht_node *node, *next;
 	unsigned long nr_bucket = 0, nr_removed = 0;
 
-	*approx_before = 0;
-	if (ht->split_count) {
-		int i;
-
-		for (i = 0; i < split_count_mask + 1; i++) {
-			*approx_before += uatomic_read(&ht->split_count[i].add);
-			*approx_before -= uatomic_read(&ht->split_count[i].del);
-		}
-	}
+	*approx_before = ht_count_sum(ht);
 
 	*count = 0;
 
@@ -1847,15 +4645,7 @@ void cds_lfht_count_nodes(struct cds_lfht *ht,
 	} while (!is_end(node));
 	dbg_printf("number of logically removed nodes: %lu\n", nr_removed);
 	dbg_printf("number of bucket nodes: %lu\n", nr_bucket);
-	*approx_after = 0;
-	if (ht->split_count) {
-		int i;
-
-		for (i = 0; i < split_count_mask + 1; i++) {
-			*approx_after += uatomic_read(&ht->split_count[i].add);
-			*approx_after -= uatomic_read(&ht->split_count[i].del);
-		}
-	}
+	*approx_after = ht_count_sum(ht);
 }
 
 /* called with resize mutex held */
@@ -1892,6 +4682,54 @@ void _do_cds_lfht_shrink(struct cds_lfht *ht,
 }
 
 
+/*
+ * Replace the filter of a CDS_LFHT_FILTER table by one sized for the
+ * table, counting the hashes of the nodes found by a walk of the table.
+ * The walk starts once all additions also count in the new filter, and
+ * counts the logically removed nodes too. Removals keep uncounting in
+ * the old filter until no removal unknown to the walk is left, then the
+ * readers switch to the new filter. The old one is freed once no
+ * addition counts in it anymore. The new filter can thus only
+ * overcount, which the next rebuild drops.
+ *
+ * Called with resize mutex held, offline.
+ */
+static
+void filter_rebuild(struct cds_lfht *ht)
+{
+	struct lfht_filter *old = ht->filter, *new;
+	struct cds_lfht_node *node, *next;
+	int idx;
+
+	if (!(ht->flags & CDS_LFHT_FILTER))
+		return;
+	new = filter_alloc(ht->size);
+	if (!new)
+		return;		/* Keep the filter sized for the old size. */
+	rcu_set_pointer(&ht->filter_next, new);
+	ht_synchronize_rcu(ht);
+	ht_thread_online(ht);
+	idx = ht_read_lock(ht);
+	node = bucket_at(ht, 0);
+	do {
+		next = rcu_dereference(node->next);
+		if (!is_bucket(next))
+			filter_update(new, bit_reverse_ulong(node->reverse_hash),
+				1);
+		node = clear_flag(next);
+	} while (!is_end(node));
+	ht_read_unlock(ht, idx);
+	ht_thread_offline(ht);
+	ht_synchronize_rcu(ht);
+	rcu_set_pointer(&ht->filter_prev, old);
+	rcu_set_pointer(&ht->filter, new);
+	ht_synchronize_rcu(ht);
+	rcu_set_pointer(&ht->filter_next, NULL);
+	rcu_set_pointer(&ht->filter_prev, NULL);
+	ht_synchronize_rcu(ht);
+	free(old);
+}
+
 /* called with resize mutex held */
 static
 void _do_cds_lfht_resize(struct cds_lfht *ht)
@@ -1908,10 +4746,16 @@ void _do_cds_lfht_resize(struct cds_lfht *ht)
 		ht->resize_initiated = 1;
 		old_size = ht->size;
 		new_size = CMM_LOAD_SHARED(ht->resize_target);
+		urcu_tp3(lfht_resize_start, ht, old_size, new_size);
 		if (old_size < new_size)
 			_do_cds_lfht_grow(ht, old_size, new_size);
 		else if (old_size > new_size)
 			_do_cds_lfht_shrink(ht, old_size, new_size);
+		urcu_tp3(lfht_resize_end, ht, old_size, new_size);
+		if (ht->size != old_size) {
+			CMM_STORE_SHARED(ht->nr_resizes, ht->nr_resizes + 1);
+			filter_rebuild(ht);
+		}
 		ht->resize_initiated = 0;
 		/* write resize_initiated before read resize_target */
 		cmm_smp_mb();
@@ -1937,11 +4781,11 @@ void cds_lfht_resize(struct cds_lfht *ht, unsigned long new_size)
 {
 	int was_online;
 
-	was_online = ht->flavor->read_ongoing();
+	was_online = ht_read_ongoing(ht);
 	if (was_online)
-		ht->flavor->thread_offline();
+		ht_thread_offline(ht);
 	/* Calling with RCU read-side held is an error. */
-	if (ht->flavor->read_ongoing()) {
+	if (ht_read_ongoing(ht)) {
 		static int print_once;
 
 		if (!CMM_LOAD_SHARED(print_once))
@@ -1953,12 +4797,16 @@ void cds_lfht_resize(struct cds_lfht *ht, unsigned long new_size)
 	}
 	resize_target_update_count(ht, new_size);
 	CMM_STORE_SHARED(ht->resize_initiated, 1);
-	pthread_mutex_lock(&ht->resize_mutex);
+	uatomic_inc(&ht->in_progress_resize);
+	cmm_smp_mb();	/* increment resize count before resize */
+	resize_mutex_lock(ht);
 	_do_cds_lfht_resize(ht);
-	pthread_mutex_unlock(&ht->resize_mutex);
+	resize_mutex_unlock(ht);
+	cmm_smp_mb();	/* finish resize before decrement */
+	uatomic_dec(&ht->in_progress_resize);
 end:
 	if (was_online)
-		ht->flavor->thread_online();
+		ht_thread_online(ht);
 }
 
 static
@@ -1968,11 +4816,14 @@ void do_resize_cb(struct rcu_head *head)
 		caa_container_of(head, struct rcu_resize_work, head);
 	struct cds_lfht *ht = work->ht;
 
-	ht->flavor->thread_offline();
-	pthread_mutex_lock(&ht->resize_mutex);
+	ht_thread_offline(ht);
+	resize_mutex_lock(ht);
 	_do_cds_lfht_resize(ht);
-	pthread_mutex_unlock(&ht->resize_mutex);
-	ht->flavor->thread_online();
+	resize_mutex_unlock(ht);
+	ht_thread_online(ht);
+	/* Before the decrement, so that destroy waits for it. */
+	if (work->done)
+		work->done(ht, CMM_LOAD_SHARED(ht->size), work->priv);
 	poison_free(work);
 	cmm_smp_mb();	/* finish resize before decrement */
 	uatomic_dec(&ht->in_progress_resize);
@@ -1999,16 +4850,55 @@ void __cds_lfht_resize_lazy_launch(struct cds_lfht *ht)
 			return;
 		}
 		work->ht = ht;
-		ht->flavor->update_call_rcu(&work->head, do_resize_cb);
+		work->done = NULL;
+		ht_call_rcu(ht, &work->head, do_resize_cb);
 		CMM_STORE_SHARED(ht->resize_initiated, 1);
 	}
 }
 
+/*
+ * Unlike the lazy launch, always queue a resize work, even if one is
+ * already pending, so that each caller gets its completion callback.
+ */
+static
+int resize_async_launch(struct cds_lfht *ht, cds_lfht_resize_done_fct done,
+		void *priv)
+{
+	struct rcu_resize_work *work;
+
+	work = malloc(sizeof(*work));
+	if (!work)
+		return -ENOMEM;
+	work->ht = ht;
+	work->done = done;
+	work->priv = priv;
+	CMM_STORE_SHARED(ht->resize_initiated, 1);
+	uatomic_inc(&ht->in_progress_resize);
+	cmm_smp_mb();	/* increment resize count before load destroy */
+	if (CMM_LOAD_SHARED(ht->in_progress_destroy)) {
+		uatomic_dec(&ht->in_progress_resize);
+		poison_free(work);
+		return -EBUSY;
+	}
+	ht_call_rcu(ht, &work->head, do_resize_cb);
+	return 0;
+}
+
+int cds_lfht_resize_async(struct cds_lfht *ht, unsigned long new_size,
+		cds_lfht_resize_done_fct done, void *priv)
+{
+	resize_target_update_count(ht, new_size);
+	return resize_async_launch(ht, done, priv);
+}
+
 static
 void cds_lfht_resize_lazy_grow(struct cds_lfht *ht, unsigned long size, int growth)
 {
-	unsigned long target_size = size << growth;
+	unsigned long target_size;
 
+	if (ht->max_grow_order && growth > (int) ht->max_grow_order)
+		growth = ht->max_grow_order;
+	target_size = size << growth;
 	target_size = min(target_size, ht->max_nr_buckets);
 	if (resize_target_grow(ht, target_size) >= target_size)
 		return;
@@ -2029,6 +4919,10 @@ void cds_lfht_resize_lazy_count(struct cds_lfht *ht, unsigned long size,
 		return;
 	count = max(count, MIN_TABLE_SIZE);
 	count = min(count, ht->max_nr_buckets);
+	if (count > size && ht->max_grow_order)
+		count = min(count, size << ht->max_grow_order);
+	if (count < size && ht->max_shrink_order)
+		count = max(count, size >> ht->max_shrink_order);
 	if (count == size)
 		return;		/* Already the right size, no resize needed */
 	if (count > size) {	/* lazy grow */
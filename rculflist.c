@@ -0,0 +1,242 @@
+/*
+ * rculflist.c
+ *
+ * Userspace RCU library - Lock-Free RCU Ordered List
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <urcu-pointer.h>
+#include <urcu/uatomic.h>
+#include <urcu/rculflist.h>
+
+/*
+ * The two low bits of the next pointers hold the removal flags, as in
+ * rculfhash.c: REMOVED_FLAG marks the node as logically removed, no
+ * update can change its next pointer afterwards, and REMOVAL_OWNER_FLAG
+ * is set by the first of the concurrent removals of the node to finish
+ * unlinking it, which owns the removal.
+ */
+#define REMOVED_FLAG		(1UL << 0)
+#define REMOVAL_OWNER_FLAG	(1UL << 1)
+#define FLAGS_MASK		((1UL << 2) - 1)
+
+static
+struct cds_lflist_node *clear_flag(struct cds_lflist_node *node)
+{
+	return (struct cds_lflist_node *) (((unsigned long) node) & ~FLAGS_MASK);
+}
+
+static
+int is_removed(struct cds_lflist_node *node)
+{
+	return ((unsigned long) node) & REMOVED_FLAG;
+}
+
+static
+int is_removal_owner(struct cds_lflist_node *node)
+{
+	return ((unsigned long) node) & REMOVAL_OWNER_FLAG;
+}
+
+static
+struct cds_lflist_node *flag_removal_owner(struct cds_lflist_node *node)
+{
+	return (struct cds_lflist_node *) (((unsigned long) node) | REMOVAL_OWNER_FLAG);
+}
+
+/*
+ * Find the insert position of key: the last node not removed before it
+ * (prev, the head if none) and the node following it (iter, NULL at the
+ * end). With after_equal, the nodes of the same key are before the
+ * position, otherwise after it. Logically removed nodes met on the way
+ * are unlinked, and the walk restarts from the head when unlinking
+ * fails, prev having been removed or linked to another node meanwhile.
+ */
+static
+void lflist_find(struct cds_lflist *list, const void *key, int after_equal,
+		struct cds_lflist_node **prev_ret,
+		struct cds_lflist_node **iter_ret)
+{
+	struct cds_lflist_node *prev, *iter, *next;
+	int c;
+
+retry:
+	prev = &list->head;
+	iter = rcu_dereference(prev->next);
+	for (;;) {
+		if (!iter)
+			break;
+		next = rcu_dereference(iter->next);
+		if (caa_unlikely(is_removed(next))) {
+			/*
+			 * Unlinking is not a commit point of the update
+			 * operations, but the cmpxchg also fails if prev
+			 * is removed concurrently.
+			 */
+			if (uatomic_cmpxchg(&prev->next, iter,
+					clear_flag(next)) != iter)
+				goto retry;
+			iter = clear_flag(next);
+			continue;
+		}
+		c = list->cmp(iter, key);
+		if (c > 0 || (!after_equal && !c))
+			break;
+		prev = iter;
+		iter = next;
+	}
+	*prev_ret = prev;
+	*iter_ret = iter;
+}
+
+/* First node not removed from node on. */
+static
+struct cds_lflist_node *lflist_skip_removed(struct cds_lflist_node *node)
+{
+	struct cds_lflist_node *next;
+
+	while (node) {
+		next = rcu_dereference(node->next);
+		if (!is_removed(next))
+			break;
+		node = clear_flag(next);
+	}
+	return node;
+}
+
+void cds_lflist_init(struct cds_lflist *list, cds_lflist_cmp_fct cmp)
+{
+	list->head.next = NULL;
+	list->cmp = cmp;
+}
+
+int cds_lflist_destroy(struct cds_lflist *list)
+{
+	struct cds_lflist_node *node, *next;
+
+	for (node = list->head.next; node; node = clear_flag(next)) {
+		next = node->next;
+		if (!is_removed(next))
+			return -EPERM;
+	}
+	return 0;
+}
+
+struct cds_lflist_node *cds_lflist_lookup(struct cds_lflist *list,
+		const void *key)
+{
+	struct cds_lflist_node *node, *next;
+	int c;
+
+	for (node = rcu_dereference(list->head.next); node;
+			node = clear_flag(next)) {
+		next = rcu_dereference(node->next);
+		c = list->cmp(node, key);
+		if (c > 0)
+			break;
+		if (!c && !is_removed(next))
+			return node;
+	}
+	return NULL;
+}
+
+struct cds_lflist_node *cds_lflist_lower_bound(struct cds_lflist *list,
+		const void *key)
+{
+	struct cds_lflist_node *node, *next;
+
+	for (node = rcu_dereference(list->head.next); node;
+			node = clear_flag(next)) {
+		next = rcu_dereference(node->next);
+		if (!is_removed(next) && list->cmp(node, key) >= 0)
+			return node;
+	}
+	return NULL;
+}
+
+struct cds_lflist_node *cds_lflist_first(struct cds_lflist *list)
+{
+	return lflist_skip_removed(rcu_dereference(list->head.next));
+}
+
+struct cds_lflist_node *cds_lflist_next(struct cds_lflist_node *node)
+{
+	return lflist_skip_removed(clear_flag(rcu_dereference(node->next)));
+}
+
+void cds_lflist_add(struct cds_lflist *list, const void *key,
+		struct cds_lflist_node *node)
+{
+	struct cds_lflist_node *prev, *iter;
+
+	do {
+		lflist_find(list, key, 1, &prev, &iter);
+		node->next = iter;
+		/* The cmpxchg orders the node initialization before it. */
+	} while (uatomic_cmpxchg(&prev->next, iter, node) != iter);
+}
+
+struct cds_lflist_node *cds_lflist_add_unique(struct cds_lflist *list,
+		const void *key, struct cds_lflist_node *node)
+{
+	struct cds_lflist_node *prev, *iter;
+
+	do {
+		lflist_find(list, key, 0, &prev, &iter);
+		if (iter && !list->cmp(iter, key))
+			return iter;
+		node->next = iter;
+	} while (uatomic_cmpxchg(&prev->next, iter, node) != iter);
+	return node;
+}
+
+int cds_lflist_del(struct cds_lflist *list, const void *key,
+		struct cds_lflist_node *node)
+{
+	struct cds_lflist_node *next, *prev, *iter;
+
+	/*
+	 * The check of a previous removal is not atomic with setting the
+	 * flag: concurrent removals are arbitrated by the removal owner
+	 * flag below.
+	 */
+	next = CMM_LOAD_SHARED(node->next);
+	if (caa_unlikely(is_removed(next)))
+		return -ENOENT;
+	cmm_smp_mb__before_uatomic_or();
+	uatomic_or(&node->next, REMOVED_FLAG);
+	/*
+	 * Walk past the nodes of the same key: the node is unlinked once
+	 * the walk returns, by this walk or by a concurrent one.
+	 */
+	lflist_find(list, key, 1, &prev, &iter);
+	if (!is_removal_owner(uatomic_xchg(&node->next,
+			flag_removal_owner(node->next))))
+		return 0;
+	return -ENOENT;
+}
+
+int cds_lflist_is_node_deleted(struct cds_lflist_node *node)
+{
+	return is_removed(CMM_LOAD_SHARED(node->next));
+}
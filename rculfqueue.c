@@ -57,3 +57,10 @@ cds_lfq_dequeue_rcu(struct cds_lfq_queue_rcu *q)
 {
 	return _cds_lfq_dequeue_rcu(q);
 }
+
+unsigned int
+cds_lfq_dequeue_bulk_rcu(struct cds_lfq_queue_rcu *q,
+		struct cds_lfq_node_rcu **nodes, unsigned int max)
+{
+	return _cds_lfq_dequeue_bulk_rcu(q, nodes, max);
+}
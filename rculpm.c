@@ -0,0 +1,562 @@
+/*
+ * rculpm.c
+ *
+ * Userspace RCU library - RCU longest-prefix-match trie
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "config.h"
+#include <urcu/compiler.h>
+#include <urcu/cacheline.h>
+#include <urcu-pointer.h>
+#include <urcu/rculpm.h>
+#include "urcu-die.h"
+
+#define LPM_STRIDE		8
+#define LPM_FANOUT		(1U << LPM_STRIDE)
+#define LPM_WORDS		(LPM_FANOUT / 64)
+#define LPM_MAX_LEVELS		(CDS_LPM_MAX_BITS / LPM_STRIDE)
+
+/* Initial capacity of the prefix array of a trie node. */
+#define LPM_PFX_INIT_ALLOC	4
+
+/*
+ * Prefixes of a trie node, only used by the updaters: those of
+ * (depth * LPM_STRIDE) + 1 to (depth + 1) * LPM_STRIDE bits, unordered.
+ */
+struct lpm_pfx {
+	unsigned int nr, alloc;
+	struct cds_lpm_node *node[];
+};
+
+union lpm_slot {
+	struct lpm_inode *child;
+	struct cds_lpm_node *leaf;
+};
+
+/*
+ * Bit s of vec is set when slot s has a child. Slots are grouped in
+ * runs of the same longest prefix of the node, bit s of leafvec being
+ * set when a run starts at slot s. The children, then the prefix of
+ * each run (NULL when no prefix of the node covers the run), follow in
+ * slot order.
+ *
+ * A published trie node is only modified by replacing one of its
+ * children in place, or, when out of memory, the prefix of a run.
+ */
+struct lpm_inode {
+	uint64_t vec[LPM_WORDS];
+	uint64_t leafvec[LPM_WORDS];
+	unsigned int nr_children;
+	struct lpm_pfx *pfx;		/* updaters only */
+	struct rcu_head head;
+	union lpm_slot slot[];
+};
+
+struct cds_lpm {
+	struct lpm_inode *root;
+	struct cds_lpm_node *def;	/* zero-length prefix */
+	unsigned int key_bits;
+	const struct rcu_flavor_struct *flavor;
+	pthread_mutex_t lock;		/* serializes updates */
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static inline
+int lpm_test(const uint64_t *vec, unsigned int s)
+{
+	return (vec[s / 64] >> (s % 64)) & 1;
+}
+
+static inline
+void lpm_set(uint64_t *vec, unsigned int s)
+{
+	vec[s / 64] |= 1ULL << (s % 64);
+}
+
+/* Number of bits set in vec up to bit s included. */
+static inline
+unsigned int lpm_rank(const uint64_t *vec, unsigned int s)
+{
+	unsigned int i, w = s / 64, rank = 0;
+
+	for (i = 0; i < w; i++)
+		rank += __builtin_popcountll(vec[i]);
+	return rank + __builtin_popcountll(vec[w]
+			& ((2ULL << (s % 64)) - 1));
+}
+
+static inline
+union lpm_slot *lpm_leaf_slot(struct lpm_inode *inode, unsigned int s)
+{
+	return &inode->slot[inode->nr_children
+			+ lpm_rank(inode->leafvec, s) - 1];
+}
+
+static inline
+union lpm_slot *lpm_child_slot(struct lpm_inode *inode, unsigned int s)
+{
+	return &inode->slot[lpm_rank(inode->vec, s) - 1];
+}
+
+static
+void lpm_mask(uint8_t *dst, const uint8_t *src, unsigned int len)
+{
+	unsigned int nr_bytes = (len + 7) / 8;
+
+	memset(dst, 0, CDS_LPM_MAX_BITS / 8);
+	memcpy(dst, src, nr_bytes);
+	if (len % 8)
+		dst[nr_bytes - 1] &= 0xFF << (8 - len % 8);
+}
+
+static
+int lpm_pfx_add(struct lpm_pfx **pfxp, struct cds_lpm_node *node)
+{
+	struct lpm_pfx *pfx = *pfxp, *new_pfx;
+	unsigned int alloc;
+
+	if (!pfx || pfx->nr == pfx->alloc) {
+		alloc = pfx ? pfx->alloc << 1 : LPM_PFX_INIT_ALLOC;
+		new_pfx = realloc(pfx, sizeof(*pfx)
+				+ alloc * sizeof(pfx->node[0]));
+		if (!new_pfx)
+			return -ENOMEM;
+		if (!pfx)
+			new_pfx->nr = 0;
+		new_pfx->alloc = alloc;
+		*pfxp = pfx = new_pfx;
+	}
+	pfx->node[pfx->nr++] = node;
+	return 0;
+}
+
+static
+void lpm_pfx_remove(struct lpm_pfx *pfx, unsigned int i)
+{
+	pfx->node[i] = pfx->node[--pfx->nr];
+}
+
+static
+int lpm_pfx_find(struct lpm_pfx *pfx, const uint8_t *prefix,
+		unsigned int len)
+{
+	unsigned int i;
+
+	if (!pfx)
+		return -1;
+	for (i = 0; i < pfx->nr; i++) {
+		if (pfx->node[i]->len == len
+				&& !memcmp(pfx->node[i]->prefix, prefix,
+					(len + 7) / 8))
+			return i;
+	}
+	return -1;
+}
+
+static inline
+unsigned int lpm_pfx_nr(struct lpm_pfx *pfx)
+{
+	return pfx ? pfx->nr : 0;
+}
+
+/*
+ * Longest prefix of each slot of a trie node: expand the prefixes to
+ * their slots, shortest first.
+ */
+static
+void lpm_expand(struct lpm_pfx *pfx, unsigned int depth,
+		struct cds_lpm_node **best)
+{
+	unsigned int len, i, first, nr_slots, s;
+
+	memset(best, 0, LPM_FANOUT * sizeof(*best));
+	if (!pfx)
+		return;
+	for (len = 1; len <= LPM_STRIDE; len++) {
+		nr_slots = 1U << (LPM_STRIDE - len);
+		for (i = 0; i < pfx->nr; i++) {
+			struct cds_lpm_node *node = pfx->node[i];
+
+			if (node->len != depth * LPM_STRIDE + len)
+				continue;
+			first = node->prefix[depth] & ~(nr_slots - 1);
+			for (s = first; s < first + nr_slots; s++)
+				best[s] = node;
+		}
+	}
+}
+
+static
+void lpm_children(struct lpm_inode *inode, struct lpm_inode **child)
+{
+	unsigned int s, i = 0;
+
+	memset(child, 0, LPM_FANOUT * sizeof(*child));
+	if (!inode)
+		return;
+	for (s = 0; s < LPM_FANOUT; s++) {
+		if (lpm_test(inode->vec, s))
+			child[s] = inode->slot[i++].child;
+	}
+}
+
+/*
+ * Allocate the trie node of depth holding the prefixes of pfx and the
+ * children of child, indexed by slot.
+ */
+static
+struct lpm_inode *lpm_build(struct lpm_pfx *pfx, unsigned int depth,
+		struct lpm_inode **child)
+{
+	struct cds_lpm_node *best[LPM_FANOUT];
+	unsigned int s, i, nr_children = 0, nr_leaves = 0;
+	struct lpm_inode *inode;
+
+	lpm_expand(pfx, depth, best);
+	for (s = 0; s < LPM_FANOUT; s++) {
+		if (child[s])
+			nr_children++;
+		if (!s || best[s] != best[s - 1])
+			nr_leaves++;
+	}
+	inode = caa_cacheline_zalloc(sizeof(*inode)
+			+ (nr_children + nr_leaves) * sizeof(inode->slot[0]));
+	if (!inode)
+		return NULL;
+	inode->nr_children = nr_children;
+	inode->pfx = pfx;
+	i = 0;
+	for (s = 0; s < LPM_FANOUT; s++) {
+		if (!child[s])
+			continue;
+		lpm_set(inode->vec, s);
+		inode->slot[i++].child = child[s];
+	}
+	for (s = 0; s < LPM_FANOUT; s++) {
+		if (s && best[s] == best[s - 1])
+			continue;
+		lpm_set(inode->leafvec, s);
+		inode->slot[i++].leaf = best[s];
+	}
+	return inode;
+}
+
+static
+void lpm_inode_free_cb(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct lpm_inode, head));
+}
+
+/*
+ * Publish new in place of path[depth], and free the latter after a
+ * grace period. The parent of a trie node is replaced, rather than
+ * modified, when adding or removing the child.
+ */
+static
+void lpm_replace(struct cds_lpm *lpm, struct lpm_inode **path,
+		const uint8_t *prefix, unsigned int depth,
+		struct lpm_inode *new)
+{
+	struct lpm_inode *old = path[depth];
+
+	if (!depth) {
+		rcu_set_pointer(&lpm->root, new);
+	} else {
+		struct lpm_inode *parent = path[depth - 1];
+
+		rcu_set_pointer(&lpm_child_slot(parent,
+				prefix[depth - 1])->child, new);
+	}
+	path[depth] = new;
+	if (old)
+		lpm->flavor->update_call_rcu(&old->head, lpm_inode_free_cb);
+}
+
+/*
+ * Fill path with the trie nodes leading to the prefixes of len bits of
+ * prefix, and return the number of levels found.
+ */
+static
+unsigned int lpm_walk(struct cds_lpm *lpm, const uint8_t *prefix,
+		unsigned int len, struct lpm_inode **path)
+{
+	unsigned int depth, target = (len - 1) / LPM_STRIDE;
+
+	path[0] = lpm->root;
+	for (depth = 0; depth < target; depth++) {
+		if (!lpm_test(path[depth]->vec, prefix[depth]))
+			return depth + 1;
+		path[depth + 1] = lpm_child_slot(path[depth],
+				prefix[depth])->child;
+	}
+	return target + 1;
+}
+
+/* Free trie nodes never published, each having at most one child. */
+static
+void lpm_free_chain(struct lpm_inode *inode)
+{
+	struct lpm_inode *next;
+
+	while (inode) {
+		next = inode->nr_children ? inode->slot[0].child : NULL;
+		free(inode->pfx);
+		free(inode);
+		inode = next;
+	}
+}
+
+struct cds_lpm *_cds_lpm_create(unsigned int key_bits,
+		const struct rcu_flavor_struct *flavor)
+{
+	struct lpm_inode *child[LPM_FANOUT];
+	struct cds_lpm *lpm;
+	int ret;
+
+	if (!key_bits || key_bits > CDS_LPM_MAX_BITS)
+		return NULL;
+	lpm = calloc(1, sizeof(*lpm));
+	if (!lpm)
+		return NULL;
+	lpm_children(NULL, child);
+	lpm->root = lpm_build(NULL, 0, child);
+	if (!lpm->root) {
+		free(lpm);
+		return NULL;
+	}
+	ret = pthread_mutex_init(&lpm->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	lpm->key_bits = key_bits;
+	lpm->flavor = flavor;
+	return lpm;
+}
+
+int cds_lpm_destroy(struct cds_lpm *lpm)
+{
+	int ret;
+
+	if (lpm->def || lpm_pfx_nr(lpm->root->pfx) || lpm->root->nr_children)
+		return -EPERM;
+	free(lpm->root->pfx);
+	free(lpm->root);
+	ret = pthread_mutex_destroy(&lpm->lock);
+	if (ret)
+		urcu_die(ret);
+	free(lpm);
+	return 0;
+}
+
+int cds_lpm_add(struct cds_lpm *lpm, struct cds_lpm_node *node,
+		const void *prefix, unsigned int len)
+{
+	struct lpm_inode *path[LPM_MAX_LEVELS], *child[LPM_FANOUT];
+	struct lpm_inode *new, *chain = NULL;
+	unsigned int target, found;
+	struct lpm_pfx *pfx;
+	int depth, ret = 0;
+
+	if (len > lpm->key_bits)
+		return -EINVAL;
+	lpm_mask(node->prefix, prefix, len);
+	node->len = len;
+	mutex_lock(&lpm->lock);
+	if (!len) {
+		if (lpm->def)
+			ret = -EEXIST;
+		else
+			rcu_set_pointer(&lpm->def, node);
+		goto end;
+	}
+	target = (len - 1) / LPM_STRIDE;
+	found = lpm_walk(lpm, node->prefix, len, path);
+	if (found == target + 1) {
+		/* Copy the trie node of the prefix, with the prefix added. */
+		if (lpm_pfx_find(path[target]->pfx, node->prefix, len) >= 0) {
+			ret = -EEXIST;
+			goto end;
+		}
+		if (lpm_pfx_add(&path[target]->pfx, node)) {
+			ret = -ENOMEM;
+			goto end;
+		}
+		lpm_children(path[target], child);
+		new = lpm_build(path[target]->pfx, target, child);
+		if (!new) {
+			lpm_pfx_remove(path[target]->pfx,
+				path[target]->pfx->nr - 1);
+			ret = -ENOMEM;
+			goto end;
+		}
+		lpm_replace(lpm, path, node->prefix, target, new);
+		goto end;
+	}
+	/*
+	 * Build the missing trie nodes bottom-up, then publish them at
+	 * once by replacing the deepest existing one.
+	 */
+	for (depth = target; depth >= (int) found; depth--) {
+		pfx = NULL;
+		if (depth == target && lpm_pfx_add(&pfx, node))
+			goto nomem;
+		lpm_children(NULL, child);
+		child[node->prefix[depth]] = chain;
+		new = lpm_build(pfx, depth, child);
+		if (!new) {
+			free(pfx);
+			goto nomem;
+		}
+		chain = new;
+	}
+	lpm_children(path[found - 1], child);
+	child[node->prefix[found - 1]] = chain;
+	new = lpm_build(path[found - 1]->pfx, found - 1, child);
+	if (!new)
+		goto nomem;
+	lpm_replace(lpm, path, node->prefix, found - 1, new);
+end:
+	mutex_unlock(&lpm->lock);
+	return ret;
+
+nomem:
+	lpm_free_chain(chain);
+	mutex_unlock(&lpm->lock);
+	return -ENOMEM;
+}
+
+/*
+ * Out of memory: replace the removed prefix by the next longest prefix
+ * of the node, in place. All the slots of a run share the same next
+ * longest prefix, the one covering the removed prefix.
+ */
+static
+void lpm_del_in_place(struct lpm_inode *inode, unsigned int depth,
+		struct cds_lpm_node *node)
+{
+	struct cds_lpm_node *best[LPM_FANOUT];
+	unsigned int s;
+
+	lpm_expand(inode->pfx, depth, best);
+	for (s = 0; s < LPM_FANOUT; s++) {
+		union lpm_slot *slot;
+
+		if (!lpm_test(inode->leafvec, s))
+			continue;
+		slot = lpm_leaf_slot(inode, s);
+		if (slot->leaf == node)
+			rcu_set_pointer(&slot->leaf, best[s]);
+	}
+}
+
+struct cds_lpm_node *cds_lpm_del(struct cds_lpm *lpm, const void *prefix,
+		unsigned int len)
+{
+	struct lpm_inode *path[LPM_MAX_LEVELS], *child[LPM_FANOUT], *new;
+	uint8_t key[CDS_LPM_MAX_BITS / 8];
+	struct cds_lpm_node *node = NULL;
+	unsigned int target, depth, i;
+	int pos;
+
+	if (len > lpm->key_bits)
+		return NULL;
+	lpm_mask(key, prefix, len);
+	mutex_lock(&lpm->lock);
+	if (!len) {
+		node = lpm->def;
+		if (node)
+			rcu_set_pointer(&lpm->def, NULL);
+		goto end;
+	}
+	target = (len - 1) / LPM_STRIDE;
+	if (lpm_walk(lpm, key, len, path) != target + 1)
+		goto end;
+	pos = lpm_pfx_find(path[target]->pfx, key, len);
+	if (pos < 0)
+		goto end;
+	node = path[target]->pfx->node[pos];
+	lpm_pfx_remove(path[target]->pfx, pos);
+	/*
+	 * Find the deepest trie node left with prefixes or other
+	 * children: the trie nodes below it are unlinked.
+	 */
+	for (depth = target; depth > 0; depth--) {
+		if (lpm_pfx_nr(path[depth]->pfx)
+				|| path[depth]->nr_children
+					> (depth == target ? 0 : 1))
+			break;
+	}
+	lpm_children(path[depth], child);
+	if (depth < target)
+		child[key[depth]] = NULL;
+	new = lpm_build(path[depth]->pfx, depth, child);
+	if (!new) {
+		lpm_del_in_place(path[target], target, node);
+		goto end;
+	}
+	for (i = depth + 1; i <= target; i++) {
+		free(path[i]->pfx);
+		lpm->flavor->update_call_rcu(&path[i]->head, lpm_inode_free_cb);
+	}
+	lpm_replace(lpm, path, key, depth, new);
+end:
+	mutex_unlock(&lpm->lock);
+	return node;
+}
+
+struct cds_lpm_node *cds_lpm_lookup(struct cds_lpm *lpm, const void *key)
+{
+	const uint8_t *k = key;
+	struct cds_lpm_node *best, *leaf;
+	struct lpm_inode *inode;
+	unsigned int s;
+
+	best = rcu_dereference(lpm->def);
+	inode = rcu_dereference(lpm->root);
+	for (;;) {
+		s = *k++;
+		leaf = rcu_dereference(lpm_leaf_slot(inode, s)->leaf);
+		if (leaf)
+			best = leaf;
+		if (!lpm_test(inode->vec, s))
+			return best;
+		inode = rcu_dereference(lpm_child_slot(inode, s)->child);
+	}
+}
@@ -0,0 +1,346 @@
+/*
+ * rcupool.c
+ *
+ * Userspace RCU library - RCU object pool
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "config.h"
+#include <urcu/compiler.h>
+#include <urcu/list.h>
+#include <urcu/rcupool.h>
+#include "urcu-die.h"
+
+struct pool_magazine {
+	struct rcu_head head;
+	struct urcu_pool *pool;
+	struct pool_magazine *next;
+	unsigned int nr;
+	void *obj[URCU_POOL_MAGAZINE_SIZE];
+};
+
+/* Magazines of a thread, the value of the pool pthread key. */
+struct pool_cache {
+	struct urcu_pool *pool;
+	struct pool_magazine *loaded;	/* objects to allocate from */
+	struct pool_magazine *retired;	/* objects waiting for call_rcu */
+	struct cds_list_head node;	/* in pool->caches */
+};
+
+struct urcu_pool {
+	size_t obj_size;
+	unsigned long max_cached;
+	const struct rcu_flavor_struct *flavor;
+	pthread_key_t key;
+
+	pthread_mutex_t lock;		/* protects the fields below */
+	struct pool_magazine *full;	/* depot of non-empty magazines */
+	unsigned long nr_cached;	/* objects in the depot */
+	struct pool_magazine *empty;	/* empty magazines */
+	struct cds_list_head caches;	/* pool_cache of each thread */
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static
+void magazine_free_objs(struct pool_magazine *mag)
+{
+	unsigned int i;
+
+	for (i = 0; i < mag->nr; i++)
+		free(mag->obj[i]);
+	mag->nr = 0;
+}
+
+/*
+ * Put a magazine in the depot, or in the empty list if it holds no
+ * object. Objects beyond max_cached are freed: they have been through
+ * a grace period already, if ever retired. Called with pool lock held.
+ */
+static
+void depot_put(struct urcu_pool *pool, struct pool_magazine *mag)
+{
+	if (mag->nr && pool->max_cached
+			&& pool->nr_cached + mag->nr > pool->max_cached)
+		magazine_free_objs(mag);
+	if (!mag->nr) {
+		mag->next = pool->empty;
+		pool->empty = mag;
+		return;
+	}
+	mag->next = pool->full;
+	pool->full = mag;
+	pool->nr_cached += mag->nr;
+}
+
+/* Called with pool lock held. */
+static
+struct pool_magazine *depot_get_empty(struct urcu_pool *pool)
+{
+	struct pool_magazine *mag = pool->empty;
+
+	if (mag) {
+		pool->empty = mag->next;
+		return mag;
+	}
+	mag = malloc(sizeof(*mag));
+	if (mag)
+		mag->nr = 0;
+	return mag;
+}
+
+static
+void pool_magazine_recycle_cb(struct rcu_head *head)
+{
+	struct pool_magazine *mag =
+		caa_container_of(head, struct pool_magazine, head);
+	struct urcu_pool *pool = mag->pool;
+
+	mutex_lock(&pool->lock);
+	depot_put(pool, mag);
+	mutex_unlock(&pool->lock);
+}
+
+/*
+ * Hand the magazines of an exiting thread to the depot. The thread may
+ * not have a call_rcu worker anymore: wait for a grace period in place
+ * for the objects it retired.
+ */
+static
+void pool_thread_exit(void *arg)
+{
+	struct pool_cache *cache = arg;
+	struct urcu_pool *pool = cache->pool;
+
+	if (cache->retired && cache->retired->nr)
+		pool->flavor->update_synchronize_rcu();
+	mutex_lock(&pool->lock);
+	if (cache->retired)
+		depot_put(pool, cache->retired);
+	if (cache->loaded)
+		depot_put(pool, cache->loaded);
+	cds_list_del(&cache->node);
+	mutex_unlock(&pool->lock);
+	free(cache);
+}
+
+static
+struct pool_cache *pool_get_cache(struct urcu_pool *pool)
+{
+	struct pool_cache *cache;
+	int ret;
+
+	cache = pthread_getspecific(pool->key);
+	if (caa_likely(cache))
+		return cache;
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+	cache->pool = pool;
+	ret = pthread_setspecific(pool->key, cache);
+	if (ret) {
+		free(cache);
+		return NULL;
+	}
+	mutex_lock(&pool->lock);
+	cds_list_add(&cache->node, &pool->caches);
+	mutex_unlock(&pool->lock);
+	return cache;
+}
+
+struct urcu_pool *_urcu_pool_create(size_t obj_size,
+		unsigned long max_cached,
+		const struct rcu_flavor_struct *flavor)
+{
+	struct urcu_pool *pool;
+	int ret;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+	ret = pthread_key_create(&pool->key, pool_thread_exit);
+	if (ret) {
+		free(pool);
+		return NULL;
+	}
+	ret = pthread_mutex_init(&pool->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	pool->obj_size = obj_size ? obj_size : 1;
+	pool->max_cached = max_cached;
+	pool->flavor = flavor;
+	CDS_INIT_LIST_HEAD(&pool->caches);
+	return pool;
+}
+
+void urcu_pool_destroy(struct urcu_pool *pool)
+{
+	struct pool_cache *cache, *tmp;
+	struct pool_magazine *mag;
+	int ret;
+
+	/*
+	 * Objects of partial retired magazines need a grace period, and
+	 * the magazines queued to call_rcu must reach the depot.
+	 */
+	pool->flavor->update_synchronize_rcu();
+	pool->flavor->barrier();
+
+	ret = pthread_key_delete(pool->key);
+	if (ret)
+		urcu_die(ret);
+	cds_list_for_each_entry_safe(cache, tmp, &pool->caches, node) {
+		if (cache->loaded) {
+			magazine_free_objs(cache->loaded);
+			free(cache->loaded);
+		}
+		if (cache->retired) {
+			magazine_free_objs(cache->retired);
+			free(cache->retired);
+		}
+		free(cache);
+	}
+	while ((mag = pool->full) != NULL) {
+		pool->full = mag->next;
+		magazine_free_objs(mag);
+		free(mag);
+	}
+	while ((mag = pool->empty) != NULL) {
+		pool->empty = mag->next;
+		free(mag);
+	}
+	ret = pthread_mutex_destroy(&pool->lock);
+	if (ret)
+		urcu_die(ret);
+	free(pool);
+}
+
+void *urcu_pool_alloc(struct urcu_pool *pool)
+{
+	struct pool_cache *cache;
+	struct pool_magazine *mag, *full;
+
+	cache = pool_get_cache(pool);
+	if (caa_unlikely(!cache))
+		return malloc(pool->obj_size);
+	mag = cache->loaded;
+	if (caa_likely(mag && mag->nr))
+		return mag->obj[--mag->nr];
+
+	/* Swap the empty magazine for a full one of the depot. */
+	mutex_lock(&pool->lock);
+	full = pool->full;
+	if (!full) {
+		mutex_unlock(&pool->lock);
+		return malloc(pool->obj_size);
+	}
+	pool->full = full->next;
+	pool->nr_cached -= full->nr;
+	if (mag)
+		depot_put(pool, mag);
+	mutex_unlock(&pool->lock);
+	cache->loaded = full;
+	return full->obj[--full->nr];
+}
+
+void urcu_pool_free(struct urcu_pool *pool, void *obj)
+{
+	struct pool_cache *cache;
+	struct pool_magazine *mag;
+
+	if (!obj)
+		return;
+	cache = pool_get_cache(pool);
+	if (caa_unlikely(!cache))
+		goto free_obj;
+	mag = cache->loaded;
+	if (caa_unlikely(!mag || mag->nr == URCU_POOL_MAGAZINE_SIZE)) {
+		/* Move the full magazine to the depot. */
+		mutex_lock(&pool->lock);
+		if (mag)
+			depot_put(pool, mag);
+		mag = depot_get_empty(pool);
+		mutex_unlock(&pool->lock);
+		cache->loaded = mag;
+		if (!mag)
+			goto free_obj;
+	}
+	mag->obj[mag->nr++] = obj;
+	return;
+
+free_obj:
+	free(obj);
+}
+
+void urcu_pool_free_rcu(struct urcu_pool *pool, void *obj)
+{
+	struct pool_cache *cache;
+	struct pool_magazine *mag;
+
+	if (!obj)
+		return;
+	cache = pool_get_cache(pool);
+	if (caa_unlikely(!cache))
+		urcu_die(ENOMEM);
+	mag = cache->retired;
+	if (caa_unlikely(!mag)) {
+		mutex_lock(&pool->lock);
+		mag = depot_get_empty(pool);
+		mutex_unlock(&pool->lock);
+		if (!mag)
+			urcu_die(ENOMEM);
+		cache->retired = mag;
+	}
+	mag->obj[mag->nr++] = obj;
+	if (caa_unlikely(mag->nr == URCU_POOL_MAGAZINE_SIZE))
+		urcu_pool_flush(pool);
+}
+
+void urcu_pool_flush(struct urcu_pool *pool)
+{
+	struct pool_cache *cache;
+	struct pool_magazine *mag;
+
+	cache = pthread_getspecific(pool->key);
+	if (!cache)
+		return;
+	mag = cache->retired;
+	if (!mag || !mag->nr)
+		return;
+	cache->retired = NULL;
+	mag->pool = pool;
+	pool->flavor->update_call_rcu(&mag->head, pool_magazine_recycle_cb);
+}
@@ -0,0 +1,264 @@
+/*
+ * rcuprioq.c
+ *
+ * Userspace RCU library - RCU skip list priority queue
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <urcu-pointer.h>
+#include <urcu/uatomic.h>
+#include <urcu/rcuprioq.h>
+#include "urcu-die.h"
+
+/*
+ * Each level holds a quarter of the nodes of the level below.
+ */
+#define PRIOQ_LEVEL_SHIFT	2
+
+struct cds_prioq_tower {
+	struct rcu_head head;
+	unsigned int nr_levels;
+	struct cds_prioq_node *next[];	/* levels 1 to nr_levels */
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+/*
+ * Next pointer of node at level. A NULL node stands for the queue head.
+ * Only called at levels the node has.
+ */
+static
+struct cds_prioq_node **prioq_next(struct cds_prioq *q,
+		struct cds_prioq_node *node, unsigned int level)
+{
+	if (!node)
+		return &q->head[level];
+	if (!level)
+		return &node->next;
+	return &rcu_dereference(node->tower)->next[level - 1];
+}
+
+/* Random level, with a 1/4 probability of going up each level. */
+static
+unsigned int prioq_random_level(struct cds_prioq *q)
+{
+	unsigned long r = q->seed;
+	unsigned int level = 1;
+
+	/* xorshift */
+	r ^= r << 13;
+	r ^= r >> 7;
+	r ^= r << 17;
+	q->seed = r;
+	while (level < CDS_PRIOQ_MAX_LEVEL
+			&& !(r & ((1UL << PRIOQ_LEVEL_SHIFT) - 1))) {
+		level++;
+		r >>= PRIOQ_LEVEL_SHIFT;
+	}
+	return level;
+}
+
+static
+void free_tower_cb(struct rcu_head *head)
+{
+	struct cds_prioq_tower *tower =
+		caa_container_of(head, struct cds_prioq_tower, head);
+
+	free(tower);
+}
+
+static
+void prioq_reclaim(struct cds_prioq *q, struct cds_prioq_node *node)
+{
+	if (node->tower)
+		q->prioq_call_rcu(&node->tower->head, free_tower_cb);
+	q->prioq_call_rcu(&node->head, q->free_node);
+}
+
+/*
+ * Unlink the prefix of claimed nodes, with the mutex held. Insertions
+ * are excluded, so the prefix found at the bottom level is also a
+ * prefix at each level above. Heads move past it top-down, and the
+ * unlinked nodes keep their next pointers for concurrent walks.
+ */
+static
+void prioq_unlink_prefix(struct cds_prioq *q)
+{
+	struct cds_prioq_node *node, *first, *next;
+	int level;
+
+	first = q->head[0];
+	for (node = first; node && uatomic_read(&node->deleted);
+			node = node->next)
+		node->unlinking = 1;
+	if (node == first)
+		return;
+	for (level = (int) q->level - 1; level >= 0; level--) {
+		node = q->head[level];
+		while (node && node->unlinking)
+			node = *prioq_next(q, node, level);
+		CMM_STORE_SHARED(q->head[level], node);
+	}
+	for (node = first; node && node->unlinking; node = next) {
+		next = node->next;
+		prioq_reclaim(q, node);
+	}
+}
+
+void cds_prioq_init(struct cds_prioq *q, cds_prioq_cmp_fct cmp,
+		unsigned int batch,
+		void prioq_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)),
+		void (*free_node)(struct rcu_head *head))
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < CDS_PRIOQ_MAX_LEVEL; i++)
+		q->head[i] = NULL;
+	q->level = 0;
+	q->cmp = cmp;
+	q->batch = batch ? batch : CDS_PRIOQ_UNLINK_BATCH;
+	ret = pthread_mutex_init(&q->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	q->seed = (unsigned long) q | 1;
+	q->prioq_call_rcu = prioq_call_rcu;
+	q->free_node = free_node;
+}
+
+int cds_prioq_destroy(struct cds_prioq *q)
+{
+	struct cds_prioq_node *node, *next;
+	int ret;
+
+	for (node = q->head[0]; node; node = node->next) {
+		if (!node->deleted)
+			return -EPERM;
+	}
+	for (node = q->head[0]; node; node = next) {
+		next = node->next;
+		prioq_reclaim(q, node);
+	}
+	ret = pthread_mutex_destroy(&q->lock);
+	if (ret)
+		urcu_die(ret);
+	return 0;
+}
+
+int cds_prioq_insert(struct cds_prioq *q, struct cds_prioq_node *node)
+{
+	struct cds_prioq_node *preds[CDS_PRIOQ_MAX_LEVEL] = { NULL };
+	struct cds_prioq_node *prev = NULL, *iter;
+	struct cds_prioq_tower *tower = NULL;
+	unsigned int level, i;
+	int l;
+
+	mutex_lock(&q->lock);
+	/* Last node of each level whose priority is not greater. */
+	for (l = (int) q->level - 1; l >= 0; l--) {
+		for (;;) {
+			iter = *prioq_next(q, prev, l);
+			if (!iter || q->cmp(iter, node) > 0)
+				break;
+			prev = iter;
+		}
+		preds[l] = prev;
+	}
+	level = prioq_random_level(q);
+	if (level > 1) {
+		tower = malloc(sizeof(*tower)
+			+ (level - 1) * sizeof(struct cds_prioq_node *));
+		if (!tower) {
+			mutex_unlock(&q->lock);
+			return -ENOMEM;
+		}
+		tower->nr_levels = level - 1;
+	}
+	node->tower = tower;
+	node->deleted = 0;
+	node->unlinking = 0;
+	/* Levels above q->level have the head as predecessor. */
+	for (i = 0; i < level; i++)
+		*prioq_next(q, node, i) = *prioq_next(q, preds[i], i);
+	if (level > q->level)
+		CMM_STORE_SHARED(q->level, level);
+	/* Publish bottom-up: the node is in the queue before shortcuts. */
+	for (i = 0; i < level; i++)
+		rcu_assign_pointer(*prioq_next(q, preds[i], i), node);
+	mutex_unlock(&q->lock);
+	return 0;
+}
+
+struct cds_prioq_node *cds_prioq_delete_min(struct cds_prioq *q)
+{
+	struct cds_prioq_node *node;
+	unsigned int skipped = 0;
+
+	for (node = rcu_dereference(q->head[0]); node;
+			node = rcu_dereference(node->next)) {
+		if (!CMM_LOAD_SHARED(node->deleted)
+				&& !uatomic_xchg(&node->deleted, 1))
+			break;
+		skipped++;
+	}
+	if (caa_unlikely(skipped >= q->batch)
+			&& !pthread_mutex_trylock(&q->lock)) {
+		prioq_unlink_prefix(q);
+		mutex_unlock(&q->lock);
+	}
+	return node;
+}
+
+struct cds_prioq_node *cds_prioq_peek_min(struct cds_prioq *q)
+{
+	struct cds_prioq_node *node;
+
+	for (node = rcu_dereference(q->head[0]); node;
+			node = rcu_dereference(node->next)) {
+		if (!CMM_LOAD_SHARED(node->deleted))
+			break;
+	}
+	return node;
+}
+
+int cds_prioq_delete(struct cds_prioq *q, struct cds_prioq_node *node)
+{
+	if (CMM_LOAD_SHARED(node->deleted) || uatomic_xchg(&node->deleted, 1))
+		return -ENOENT;
+	return 0;
+}
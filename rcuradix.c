@@ -0,0 +1,319 @@
+/*
+ * rcuradix.c
+ *
+ * Userspace RCU library - RCU Radix Tree (integer keys)
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <urcu-pointer.h>
+#include <urcu/rcuradix.h>
+#include "urcu-die.h"
+
+#define RDX_FANOUT		(1UL << CDS_RDX_BITS)
+#define RDX_MASK		(RDX_FANOUT - 1)
+#define RDX_MAX_HEIGHT		\
+	((CAA_BITS_PER_LONG + CDS_RDX_BITS - 1) / CDS_RDX_BITS)
+
+/*
+ * Slots of level 0 interior nodes point to struct cds_rdx_node, slots
+ * of upper levels to interior nodes of the level below. The root is
+ * never freed. Other interior nodes are marked dead, with their parent
+ * and their own lock held, when they are unlinked: updaters which found
+ * them before that retry from the root.
+ */
+struct cds_rdx_inode {
+	void *slot[RDX_FANOUT];
+	pthread_mutex_t lock;		/* protects the fields below */
+	unsigned int count;		/* non-NULL slots */
+	int dead;
+	struct rcu_head head;
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static
+unsigned long rdx_index(unsigned long key, unsigned int level)
+{
+	return (key >> (level * CDS_RDX_BITS)) & RDX_MASK;
+}
+
+static
+struct cds_rdx_inode *alloc_inode(void)
+{
+	struct cds_rdx_inode *inode;
+	int ret;
+
+	inode = calloc(1, sizeof(*inode));
+	if (!inode)
+		return NULL;
+	ret = pthread_mutex_init(&inode->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	return inode;
+}
+
+static
+void free_inode(struct cds_rdx_inode *inode)
+{
+	int ret;
+
+	ret = pthread_mutex_destroy(&inode->lock);
+	if (ret)
+		urcu_die(ret);
+	free(inode);
+}
+
+static
+void free_inode_cb(struct rcu_head *head)
+{
+	free_inode(caa_container_of(head, struct cds_rdx_inode, head));
+}
+
+/*
+ * Walk down to the level 0 interior node of key, filling path with the
+ * interior node of each level if non-NULL. Return NULL if missing.
+ */
+static
+struct cds_rdx_inode *rdx_walk(struct cds_rdx *rdx, unsigned long key,
+		struct cds_rdx_inode **path)
+{
+	struct cds_rdx_inode *inode = rdx->root;
+	unsigned int level;
+
+	for (level = rdx->height - 1; level > 0; level--) {
+		if (path)
+			path[level] = inode;
+		inode = rcu_dereference(inode->slot[rdx_index(key, level)]);
+		if (!inode)
+			return NULL;
+	}
+	if (path)
+		path[0] = inode;
+	return inode;
+}
+
+/*
+ * First node under inode of the given level whose key is not smaller
+ * than key. Slots before the key index are skipped only as long as the
+ * walk follows the key path (bounded).
+ */
+static
+struct cds_rdx_node *rdx_lower_bound(struct cds_rdx_inode *inode,
+		unsigned int level, unsigned long key, int bounded)
+{
+	unsigned long i, start = bounded ? rdx_index(key, level) : 0;
+
+	for (i = start; i < RDX_FANOUT; i++) {
+		void *p = rcu_dereference(inode->slot[i]);
+		struct cds_rdx_node *node;
+
+		if (!p)
+			continue;
+		if (!level)
+			return p;
+		node = rdx_lower_bound(p, level - 1, key, bounded && i == start);
+		if (node)
+			return node;
+	}
+	return NULL;
+}
+
+int cds_rdx_init(struct cds_rdx *rdx, unsigned int key_bits,
+		void rdx_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)))
+{
+	if (!key_bits || key_bits > CAA_BITS_PER_LONG)
+		return -EINVAL;
+	rdx->root = alloc_inode();
+	if (!rdx->root)
+		return -ENOMEM;
+	rdx->height = (key_bits + CDS_RDX_BITS - 1) / CDS_RDX_BITS;
+	if (key_bits == CAA_BITS_PER_LONG)
+		rdx->max_key = ~0UL;
+	else
+		rdx->max_key = (1UL << key_bits) - 1;
+	rdx->rdx_call_rcu = rdx_call_rcu;
+	return 0;
+}
+
+int cds_rdx_destroy(struct cds_rdx *rdx)
+{
+	if (rdx->root->count)
+		return -EPERM;
+	free_inode(rdx->root);
+	return 0;
+}
+
+struct cds_rdx_node *cds_rdx_lookup(struct cds_rdx *rdx, unsigned long key)
+{
+	struct cds_rdx_inode *inode;
+
+	if (key > rdx->max_key)
+		return NULL;
+	inode = rdx_walk(rdx, key, NULL);
+	if (!inode)
+		return NULL;
+	return rcu_dereference(inode->slot[rdx_index(key, 0)]);
+}
+
+struct cds_rdx_node *cds_rdx_lower_bound(struct cds_rdx *rdx,
+		unsigned long key)
+{
+	if (key > rdx->max_key)
+		return NULL;
+	return rdx_lower_bound(rdx->root, rdx->height - 1, key, 1);
+}
+
+struct cds_rdx_node *cds_rdx_next(struct cds_rdx *rdx,
+		struct cds_rdx_node *node)
+{
+	if (node->key >= rdx->max_key)
+		return NULL;
+	return cds_rdx_lower_bound(rdx, node->key + 1);
+}
+
+int cds_rdx_add(struct cds_rdx *rdx, unsigned long key,
+		struct cds_rdx_node *node)
+{
+	struct cds_rdx_inode *inode, *child;
+	unsigned long idx;
+	unsigned int level;
+
+	if (key > rdx->max_key)
+		return -EINVAL;
+retry:
+	inode = rdx->root;
+	for (level = rdx->height - 1; level > 0; level--) {
+		idx = rdx_index(key, level);
+		child = rcu_dereference(inode->slot[idx]);
+		if (!child) {
+			mutex_lock(&inode->lock);
+			if (inode->dead) {
+				mutex_unlock(&inode->lock);
+				goto retry;
+			}
+			child = inode->slot[idx];
+			if (!child) {
+				child = alloc_inode();
+				if (!child) {
+					mutex_unlock(&inode->lock);
+					return -ENOMEM;
+				}
+				rcu_assign_pointer(inode->slot[idx], child);
+				inode->count++;
+			}
+			mutex_unlock(&inode->lock);
+		}
+		inode = child;
+	}
+
+	idx = rdx_index(key, 0);
+	mutex_lock(&inode->lock);
+	if (inode->dead) {
+		mutex_unlock(&inode->lock);
+		goto retry;
+	}
+	if (inode->slot[idx]) {
+		mutex_unlock(&inode->lock);
+		return -EEXIST;
+	}
+	node->key = key;
+	rcu_assign_pointer(inode->slot[idx], node);
+	inode->count++;
+	mutex_unlock(&inode->lock);
+	return 0;
+}
+
+struct cds_rdx_node *cds_rdx_del(struct cds_rdx *rdx, unsigned long key)
+{
+	struct cds_rdx_inode *path[RDX_MAX_HEIGHT];
+	struct cds_rdx_inode *inode, *parent;
+	struct cds_rdx_node *node;
+	unsigned long idx;
+	unsigned int level;
+	int empty, unlinked;
+
+	if (key > rdx->max_key)
+		return NULL;
+retry:
+	inode = rdx_walk(rdx, key, path);
+	if (!inode)
+		return NULL;
+	idx = rdx_index(key, 0);
+	mutex_lock(&inode->lock);
+	if (inode->dead) {
+		mutex_unlock(&inode->lock);
+		goto retry;
+	}
+	node = inode->slot[idx];
+	if (!node) {
+		mutex_unlock(&inode->lock);
+		return NULL;
+	}
+	/* The node is left untouched for concurrent readers. */
+	CMM_STORE_SHARED(inode->slot[idx], NULL);
+	empty = !--inode->count;
+	mutex_unlock(&inode->lock);
+
+	/*
+	 * Unlink the interior nodes left empty, bottom-up. Locks are taken
+	 * parent first, and the child is only unlinked if it is still
+	 * empty and linked, since concurrent updates may have refilled or
+	 * unlinked it meanwhile.
+	 */
+	for (level = 0; empty && level < rdx->height - 1; level++) {
+		inode = path[level];
+		parent = path[level + 1];
+		idx = rdx_index(key, level + 1);
+		empty = unlinked = 0;
+		mutex_lock(&parent->lock);
+		mutex_lock(&inode->lock);
+		if (!inode->dead && !inode->count
+				&& parent->slot[idx] == inode) {
+			inode->dead = unlinked = 1;
+			CMM_STORE_SHARED(parent->slot[idx], NULL);
+			empty = !--parent->count;
+		}
+		mutex_unlock(&inode->lock);
+		mutex_unlock(&parent->lock);
+		if (unlinked)
+			rdx->rdx_call_rcu(&inode->head, free_inode_cb);
+	}
+	return node;
+}
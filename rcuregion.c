@@ -0,0 +1,307 @@
+/*
+ * rcuregion.c
+ *
+ * Userspace RCU library - RCU region allocator
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "config.h"
+#include <urcu/compiler.h>
+#include <urcu/list.h>
+#include <urcu/uatomic.h>
+#include <urcu/rcuregion.h>
+#include "urcu-die.h"
+
+/*
+ * Arenas are aligned on their size, so an object finds its arena from
+ * its address. The arena header is at the beginning of the arena.
+ */
+struct region_arena {
+	struct rcu_head head;
+	struct urcu_region *region;
+	struct region_arena *next;	/* in region->free */
+	struct cds_list_head node;	/* in region->arenas */
+	/* Objects not retired yet, plus one while the thread allocates. */
+	unsigned long live;
+	size_t used;			/* bump offset, for the thread only */
+	unsigned long epoch;
+};
+
+#define REGION_ARENA_START	\
+	((sizeof(struct region_arena) + URCU_REGION_ALIGN - 1) \
+		& ~(URCU_REGION_ALIGN - 1))
+
+/* Arena of a thread, the value of the region pthread key. */
+struct region_cache {
+	struct urcu_region *region;
+	struct region_arena *arena;	/* to allocate from */
+	struct cds_list_head node;	/* in region->caches */
+};
+
+struct urcu_region {
+	size_t arena_size;
+	unsigned long max_cached;
+	const struct rcu_flavor_struct *flavor;
+	pthread_key_t key;
+	unsigned long epoch;
+
+	pthread_mutex_t lock;		/* protects the fields below */
+	struct region_arena *free;	/* recycled arenas */
+	unsigned long nr_free;
+	struct cds_list_head arenas;	/* all the arenas */
+	struct cds_list_head caches;	/* region_cache of each thread */
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static
+struct region_arena *region_arena_of(struct urcu_region *region, void *obj)
+{
+	return (struct region_arena *)
+		((uintptr_t) obj & ~((uintptr_t) region->arena_size - 1));
+}
+
+/* Called with region lock held. */
+static
+void region_arena_recycle(struct urcu_region *region,
+		struct region_arena *arena)
+{
+	if (region->max_cached && region->nr_free >= region->max_cached) {
+		cds_list_del(&arena->node);
+		free(arena);
+		return;
+	}
+	arena->next = region->free;
+	region->free = arena;
+	region->nr_free++;
+}
+
+static
+void region_arena_recycle_cb(struct rcu_head *head)
+{
+	struct region_arena *arena =
+		caa_container_of(head, struct region_arena, head);
+	struct urcu_region *region = arena->region;
+
+	mutex_lock(&region->lock);
+	region_arena_recycle(region, arena);
+	mutex_unlock(&region->lock);
+}
+
+/*
+ * Drop a reference to the arena: the last one queues it for recycling
+ * after a grace period.
+ */
+static
+void region_arena_put(struct region_arena *arena)
+{
+	if (!uatomic_sub_return(&arena->live, 1))
+		arena->region->flavor->update_call_rcu(&arena->head,
+				region_arena_recycle_cb);
+}
+
+static
+struct region_arena *region_arena_get(struct urcu_region *region)
+{
+	struct region_arena *arena;
+
+	mutex_lock(&region->lock);
+	arena = region->free;
+	if (arena) {
+		region->free = arena->next;
+		region->nr_free--;
+	}
+	mutex_unlock(&region->lock);
+	if (!arena) {
+		if (posix_memalign((void **) &arena, region->arena_size,
+				region->arena_size))
+			return NULL;
+		arena->region = region;
+		mutex_lock(&region->lock);
+		cds_list_add(&arena->node, &region->arenas);
+		mutex_unlock(&region->lock);
+	}
+	arena->live = 1;
+	arena->used = REGION_ARENA_START;
+	arena->epoch = CMM_LOAD_SHARED(region->epoch);
+	return arena;
+}
+
+/*
+ * Retire the arena of an exiting thread. The thread may not have a
+ * call_rcu worker anymore: wait for a grace period in place if the
+ * arena holds no object anymore.
+ */
+static
+void region_thread_exit(void *arg)
+{
+	struct region_cache *cache = arg;
+	struct urcu_region *region = cache->region;
+	struct region_arena *arena = cache->arena;
+
+	if (arena && !uatomic_sub_return(&arena->live, 1)) {
+		region->flavor->update_synchronize_rcu();
+		mutex_lock(&region->lock);
+		region_arena_recycle(region, arena);
+		mutex_unlock(&region->lock);
+	}
+	mutex_lock(&region->lock);
+	cds_list_del(&cache->node);
+	mutex_unlock(&region->lock);
+	free(cache);
+}
+
+static
+struct region_cache *region_get_cache(struct urcu_region *region)
+{
+	struct region_cache *cache;
+	int ret;
+
+	cache = pthread_getspecific(region->key);
+	if (caa_likely(cache))
+		return cache;
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+	cache->region = region;
+	ret = pthread_setspecific(region->key, cache);
+	if (ret) {
+		free(cache);
+		return NULL;
+	}
+	mutex_lock(&region->lock);
+	cds_list_add(&cache->node, &region->caches);
+	mutex_unlock(&region->lock);
+	return cache;
+}
+
+struct urcu_region *_urcu_region_create(size_t arena_size,
+		unsigned long max_cached,
+		const struct rcu_flavor_struct *flavor)
+{
+	struct urcu_region *region;
+	size_t size = 1;
+	int ret;
+
+	if (!arena_size)
+		arena_size = URCU_REGION_ARENA_SIZE;
+	if (arena_size < REGION_ARENA_START + URCU_REGION_ALIGN)
+		arena_size = REGION_ARENA_START + URCU_REGION_ALIGN;
+	while (size < arena_size)
+		size <<= 1;
+	region = calloc(1, sizeof(*region));
+	if (!region)
+		return NULL;
+	ret = pthread_key_create(&region->key, region_thread_exit);
+	if (ret) {
+		free(region);
+		return NULL;
+	}
+	ret = pthread_mutex_init(&region->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	region->arena_size = size;
+	region->max_cached = max_cached;
+	region->flavor = flavor;
+	CDS_INIT_LIST_HEAD(&region->arenas);
+	CDS_INIT_LIST_HEAD(&region->caches);
+	return region;
+}
+
+void urcu_region_destroy(struct urcu_region *region)
+{
+	struct region_cache *cache, *tmp_cache;
+	struct region_arena *arena, *tmp_arena;
+	int ret;
+
+	/* The arenas queued to call_rcu must reach the free list. */
+	region->flavor->barrier();
+
+	ret = pthread_key_delete(region->key);
+	if (ret)
+		urcu_die(ret);
+	cds_list_for_each_entry_safe(cache, tmp_cache, &region->caches, node)
+		free(cache);
+	cds_list_for_each_entry_safe(arena, tmp_arena, &region->arenas, node)
+		free(arena);
+	ret = pthread_mutex_destroy(&region->lock);
+	if (ret)
+		urcu_die(ret);
+	free(region);
+}
+
+void *urcu_region_alloc(struct urcu_region *region, size_t size)
+{
+	struct region_cache *cache;
+	struct region_arena *arena;
+	void *obj;
+
+	size = (size + URCU_REGION_ALIGN - 1) & ~(URCU_REGION_ALIGN - 1);
+	if (caa_unlikely(!size
+			|| size > region->arena_size - REGION_ARENA_START))
+		return NULL;
+	cache = region_get_cache(region);
+	if (caa_unlikely(!cache))
+		return NULL;
+	arena = cache->arena;
+	if (caa_unlikely(!arena
+			|| arena->epoch != CMM_LOAD_SHARED(region->epoch)
+			|| size > region->arena_size - arena->used)) {
+		if (arena)
+			region_arena_put(arena);
+		arena = region_arena_get(region);
+		cache->arena = arena;
+		if (!arena)
+			return NULL;
+	}
+	obj = (char *) arena + arena->used;
+	arena->used += size;
+	uatomic_inc(&arena->live);
+	return obj;
+}
+
+void urcu_region_free_rcu(struct urcu_region *region, void *obj)
+{
+	if (!obj)
+		return;
+	region_arena_put(region_arena_of(region, obj));
+}
+
+void urcu_region_new_epoch(struct urcu_region *region)
+{
+	uatomic_inc(&region->epoch);
+}
@@ -0,0 +1,256 @@
+/*
+ * rcuskiplist.c
+ *
+ * Userspace RCU library - RCU Skip List (ordered map)
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <urcu-pointer.h>
+#include <urcu/rcuskiplist.h>
+#include "urcu-die.h"
+
+/*
+ * Each level holds a quarter of the nodes of the level below.
+ */
+#define SKL_LEVEL_SHIFT		2
+
+struct cds_skl_tower {
+	struct rcu_head head;
+	unsigned int nr_levels;
+	struct cds_skl_node *next[];	/* levels 1 to nr_levels */
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+/*
+ * Next pointer of node at level. A NULL node stands for the list head.
+ * Only called at levels the node has.
+ */
+static
+struct cds_skl_node **skl_next(struct cds_skl *skl, struct cds_skl_node *node,
+		unsigned int level)
+{
+	if (!node)
+		return &skl->head[level];
+	if (!level)
+		return &node->next;
+	return &rcu_dereference(node->tower)->next[level - 1];
+}
+
+static
+unsigned int skl_node_levels(struct cds_skl_node *node)
+{
+	return node->tower ? node->tower->nr_levels + 1 : 1;
+}
+
+/*
+ * Return the first node whose key is not smaller than key. If preds is
+ * non-NULL, fill it with the last node smaller than key at each level
+ * in use (NULL for the head).
+ */
+static
+struct cds_skl_node *skl_search(struct cds_skl *skl, const void *key,
+		struct cds_skl_node **preds)
+{
+	struct cds_skl_node *prev = NULL, *node = NULL;
+	int level;
+
+	for (level = (int) CMM_LOAD_SHARED(skl->level) - 1; level >= 0;
+			level--) {
+		for (;;) {
+			node = rcu_dereference(*skl_next(skl, prev, level));
+			if (!node || skl->cmp(node, key) >= 0)
+				break;
+			prev = node;
+		}
+		if (preds)
+			preds[level] = prev;
+	}
+	return node;
+}
+
+/* Random level, with a 1/4 probability of going up each level. */
+static
+unsigned int skl_random_level(struct cds_skl *skl)
+{
+	unsigned long r = skl->seed;
+	unsigned int level = 1;
+
+	/* xorshift */
+	r ^= r << 13;
+	r ^= r >> 7;
+	r ^= r << 17;
+	skl->seed = r;
+	while (level < CDS_SKL_MAX_LEVEL
+			&& !(r & ((1UL << SKL_LEVEL_SHIFT) - 1))) {
+		level++;
+		r >>= SKL_LEVEL_SHIFT;
+	}
+	return level;
+}
+
+static
+void free_tower_cb(struct rcu_head *head)
+{
+	struct cds_skl_tower *tower =
+		caa_container_of(head, struct cds_skl_tower, head);
+
+	free(tower);
+}
+
+void cds_skl_init(struct cds_skl *skl, cds_skl_cmp_fct cmp,
+		void skl_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)))
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < CDS_SKL_MAX_LEVEL; i++)
+		skl->head[i] = NULL;
+	skl->level = 0;
+	skl->cmp = cmp;
+	ret = pthread_mutex_init(&skl->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	skl->seed = (unsigned long) skl | 1;
+	skl->skl_call_rcu = skl_call_rcu;
+}
+
+int cds_skl_destroy(struct cds_skl *skl)
+{
+	int ret;
+
+	if (skl->head[0])
+		return -EPERM;
+	ret = pthread_mutex_destroy(&skl->lock);
+	if (ret)
+		urcu_die(ret);
+	return 0;
+}
+
+struct cds_skl_node *cds_skl_lookup(struct cds_skl *skl, const void *key)
+{
+	struct cds_skl_node *node;
+
+	node = skl_search(skl, key, NULL);
+	if (!node || skl->cmp(node, key))
+		return NULL;
+	return node;
+}
+
+struct cds_skl_node *cds_skl_lower_bound(struct cds_skl *skl,
+		const void *key)
+{
+	return skl_search(skl, key, NULL);
+}
+
+struct cds_skl_node *cds_skl_first(struct cds_skl *skl)
+{
+	return rcu_dereference(skl->head[0]);
+}
+
+struct cds_skl_node *cds_skl_next(struct cds_skl_node *node)
+{
+	return rcu_dereference(node->next);
+}
+
+int cds_skl_add(struct cds_skl *skl, const void *key,
+		struct cds_skl_node *node)
+{
+	struct cds_skl_node *preds[CDS_SKL_MAX_LEVEL] = { NULL };
+	struct cds_skl_node *iter;
+	struct cds_skl_tower *tower = NULL;
+	unsigned int level, i;
+
+	mutex_lock(&skl->lock);
+	iter = skl_search(skl, key, preds);
+	if (iter && !skl->cmp(iter, key)) {
+		mutex_unlock(&skl->lock);
+		return -EEXIST;
+	}
+	level = skl_random_level(skl);
+	if (level > 1) {
+		tower = malloc(sizeof(*tower)
+			+ (level - 1) * sizeof(struct cds_skl_node *));
+		if (!tower) {
+			mutex_unlock(&skl->lock);
+			return -ENOMEM;
+		}
+		tower->nr_levels = level - 1;
+	}
+	node->tower = tower;
+	/* Levels above skl->level have the head as predecessor. */
+	for (i = 0; i < level; i++)
+		*skl_next(skl, node, i) = *skl_next(skl, preds[i], i);
+	if (level > skl->level)
+		CMM_STORE_SHARED(skl->level, level);
+	/* Publish bottom-up: the node is in the list before shortcuts. */
+	for (i = 0; i < level; i++)
+		rcu_assign_pointer(*skl_next(skl, preds[i], i), node);
+	mutex_unlock(&skl->lock);
+	return 0;
+}
+
+struct cds_skl_node *cds_skl_del(struct cds_skl *skl, const void *key)
+{
+	struct cds_skl_node *preds[CDS_SKL_MAX_LEVEL] = { NULL };
+	struct cds_skl_node *node;
+	int i;
+
+	mutex_lock(&skl->lock);
+	node = skl_search(skl, key, preds);
+	if (!node || skl->cmp(node, key)) {
+		mutex_unlock(&skl->lock);
+		return NULL;
+	}
+	/*
+	 * Unlink top-down, leaving node next pointers untouched for
+	 * concurrent readers.
+	 */
+	for (i = (int) skl_node_levels(node) - 1; i >= 0; i--) {
+		assert(*skl_next(skl, preds[i], i) == node);
+		CMM_STORE_SHARED(*skl_next(skl, preds[i], i),
+			*skl_next(skl, node, i));
+	}
+	if (node->tower)
+		skl->skl_call_rcu(&node->tower->head, free_tower_cb);
+	mutex_unlock(&skl->lock);
+	return node;
+}
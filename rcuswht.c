@@ -0,0 +1,409 @@
+/*
+ * rcuswht.c
+ *
+ * Userspace RCU library - RCU open-addressing hash map probed by groups
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <urcu/arch.h>
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu/cacheline.h>
+#include <urcu-pointer.h>
+#include <urcu-call-rcu.h>
+#include <urcu/rcuswht.h>
+#include "urcu-die.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define SWHT_GROUP_ORDER	4
+#define SWHT_GROUP_SIZE		(1UL << SWHT_GROUP_ORDER)
+
+/*
+ * Control bytes: 7 bits of the hash for used slots, or one of these
+ * values, which have their top bit set.
+ */
+#define SWHT_CTRL_EMPTY		0x80
+#define SWHT_CTRL_DELETED	0xFE
+
+struct swht_slot {
+	unsigned long hash;
+	void *item;
+};
+
+/*
+ * Tables are immutable in size: growing or dropping the deleted slots
+ * publishes a new table. The counters are only used by updaters.
+ */
+struct swht_table {
+	unsigned long group_mask;	/* number of groups - 1 */
+	unsigned long nr_items;
+	unsigned long growth_left;	/* empty slots left to fill */
+	struct rcu_head head;
+	struct swht_slot *slots;
+	uint8_t ctrl[] __attribute__((aligned(SWHT_GROUP_SIZE)));
+};
+
+struct cds_swht {
+	struct swht_table *table;
+	pthread_mutex_t lock;		/* serializes updates */
+	const struct rcu_flavor_struct *flavor;
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+/*
+ * Bit i of the result is set if control byte i of the group is @value.
+ * Control bytes may be concurrently updated one at a time: each byte
+ * read is either its old or its new value.
+ */
+#if defined(__SSE2__)
+static inline
+unsigned int group_match(const uint8_t *ctrl, uint8_t value)
+{
+	__m128i group = _mm_load_si128((const __m128i *) ctrl);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(group,
+			_mm_set1_epi8((char) value)));
+}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+static inline
+unsigned int group_match(const uint8_t *ctrl, uint8_t value)
+{
+	static const uint8_t bit[16] = {
+		1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+	};
+	uint8x16_t eq;
+
+	eq = vandq_u8(vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(value)),
+			vld1q_u8(bit));
+	return vaddv_u8(vget_low_u8(eq))
+		| (vaddv_u8(vget_high_u8(eq)) << 8);
+}
+#else
+static inline
+unsigned int group_match(const uint8_t *ctrl, uint8_t value)
+{
+	unsigned int i, mask = 0;
+
+	for (i = 0; i < SWHT_GROUP_SIZE; i++) {
+		if (CMM_LOAD_SHARED(ctrl[i]) == value)
+			mask |= 1U << i;
+	}
+	return mask;
+}
+#endif
+
+static inline
+uint8_t hash_ctrl(unsigned long hash)
+{
+	return hash & 0x7F;
+}
+
+/* First group of the probe sequence. */
+static inline
+unsigned long hash_group(const struct swht_table *table, unsigned long hash)
+{
+	return (hash >> 7) & table->group_mask;
+}
+
+/*
+ * Triangular probing visits every group once when the number of groups
+ * is a power of two.
+ */
+#define swht_for_each_group(table, hash, group, i)			\
+	for (group = hash_group(table, hash), i = 0;			\
+		i <= (table)->group_mask;				\
+		i++, group = (group + i) & (table)->group_mask)
+
+static
+struct swht_table *table_alloc(unsigned long nr_groups)
+{
+	unsigned long nr_slots = nr_groups << SWHT_GROUP_ORDER;
+	struct swht_table *table;
+
+	table = caa_cacheline_zalloc(sizeof(*table) + nr_slots
+			+ nr_slots * sizeof(struct swht_slot));
+	if (!table)
+		return NULL;
+	table->group_mask = nr_groups - 1;
+	/* Keep 1/8 of the slots empty to bound probe sequences. */
+	table->growth_left = nr_slots - (nr_slots >> 3);
+	table->slots = (struct swht_slot *) &table->ctrl[nr_slots];
+	memset(table->ctrl, SWHT_CTRL_EMPTY, nr_slots);
+	return table;
+}
+
+static
+void table_free_cb(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct swht_table, head));
+}
+
+/* Number of groups for @nr_items to fill less than half the slots. */
+static
+unsigned long table_nr_groups(unsigned long nr_items)
+{
+	unsigned long nr_groups = 1;
+
+	while ((nr_groups << SWHT_GROUP_ORDER) < (nr_items << 1))
+		nr_groups <<= 1;
+	return nr_groups;
+}
+
+/* Store an item in a slot, before publishing it with its control byte. */
+static
+void slot_set(struct swht_table *table, unsigned long index,
+		unsigned long hash, void *item)
+{
+	CMM_STORE_SHARED(table->slots[index].hash, hash);
+	rcu_set_pointer(&table->slots[index].item, item);
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(table->ctrl[index], hash_ctrl(hash));
+}
+
+/*
+ * First empty or deleted slot of the probe sequence of @hash. The
+ * table always has empty slots.
+ */
+static
+unsigned long table_find_free(struct swht_table *table, unsigned long hash)
+{
+	unsigned long group, i;
+	unsigned int mask;
+
+	swht_for_each_group(table, hash, group, i) {
+		uint8_t *ctrl = &table->ctrl[group << SWHT_GROUP_ORDER];
+
+		mask = group_match(ctrl, SWHT_CTRL_EMPTY)
+			| group_match(ctrl, SWHT_CTRL_DELETED);
+		if (mask)
+			return (group << SWHT_GROUP_ORDER)
+				+ __builtin_ctz(mask);
+	}
+	urcu_die(EINVAL);
+	return 0;
+}
+
+/*
+ * Slot index of the item of @key, or -1 if not found. Called by
+ * readers and by updaters. The item matched is returned in @item:
+ * readers must not read the slot again, as it can be reused meanwhile.
+ */
+static
+long table_find(struct swht_table *table, unsigned long hash,
+		cds_swht_match_fct match, const void *key, void **item)
+{
+	uint8_t tag = hash_ctrl(hash);
+	unsigned long group, i, index;
+	struct swht_slot *slot;
+	unsigned int mask;
+	void *p;
+
+	swht_for_each_group(table, hash, group, i) {
+		uint8_t *ctrl = &table->ctrl[group << SWHT_GROUP_ORDER];
+
+		mask = group_match(ctrl, tag);
+		if (mask) {
+			/* Read control bytes before their slots. */
+			cmm_smp_rmb();
+			do {
+				index = (group << SWHT_GROUP_ORDER)
+					+ __builtin_ctz(mask);
+				slot = &table->slots[index];
+				if (CMM_LOAD_SHARED(slot->hash) == hash) {
+					p = rcu_dereference(slot->item);
+					if (match(p, key)) {
+						*item = p;
+						return (long) index;
+					}
+				}
+				mask &= mask - 1;
+			} while (mask);
+		}
+		if (group_match(ctrl, SWHT_CTRL_EMPTY))
+			break;
+	}
+	return -1;
+}
+
+/*
+ * Publish a table sized for the items of the current one plus one, and
+ * free the current one after a grace period. Called with the mutex held.
+ */
+static
+int table_rebuild(struct cds_swht *ht)
+{
+	struct swht_table *old = ht->table, *table;
+	unsigned long i, index, nr_slots;
+
+	table = table_alloc(table_nr_groups(old->nr_items + 1));
+	if (!table)
+		return -ENOMEM;
+	nr_slots = (old->group_mask + 1) << SWHT_GROUP_ORDER;
+	for (i = 0; i < nr_slots; i++) {
+		if (old->ctrl[i] & 0x80)
+			continue;
+		index = table_find_free(table, old->slots[i].hash);
+		table->slots[index] = old->slots[i];
+		table->ctrl[index] = hash_ctrl(old->slots[i].hash);
+		table->growth_left--;
+	}
+	table->nr_items = old->nr_items;
+	/* Publish table content before the table. */
+	rcu_assign_pointer(ht->table, table);
+	ht->flavor->update_call_rcu(&old->head, table_free_cb);
+	return 0;
+}
+
+struct cds_swht *_cds_swht_new(unsigned long init_size,
+		const struct rcu_flavor_struct *flavor)
+{
+	struct cds_swht *ht;
+
+	ht = calloc(1, sizeof(*ht));
+	if (!ht)
+		return NULL;
+	ht->table = table_alloc(table_nr_groups(init_size));
+	if (!ht->table) {
+		free(ht);
+		return NULL;
+	}
+	pthread_mutex_init(&ht->lock, NULL);
+	ht->flavor = flavor;
+	return ht;
+}
+
+void cds_swht_destroy(struct cds_swht *ht)
+{
+	free(ht->table);
+	(void) pthread_mutex_destroy(&ht->lock);
+	free(ht);
+}
+
+void *cds_swht_lookup(struct cds_swht *ht, unsigned long hash,
+		cds_swht_match_fct match, const void *key)
+{
+	struct swht_table *table = rcu_dereference(ht->table);
+	void *item;
+
+	if (table_find(table, hash, match, key, &item) < 0)
+		return NULL;
+	return item;
+}
+
+int cds_swht_add(struct cds_swht *ht, unsigned long hash,
+		cds_swht_match_fct match, const void *key, void *item)
+{
+	struct swht_table *table;
+	unsigned long index;
+	void *found;
+	int ret = 0;
+
+	mutex_lock(&ht->lock);
+	table = ht->table;
+	if (table_find(table, hash, match, key, &found) >= 0) {
+		ret = -EEXIST;
+		goto end;
+	}
+	index = table_find_free(table, hash);
+	if (table->ctrl[index] == SWHT_CTRL_EMPTY) {
+		if (!table->growth_left) {
+			ret = table_rebuild(ht);
+			if (ret)
+				goto end;
+			table = ht->table;
+			index = table_find_free(table, hash);
+		}
+		table->growth_left--;
+	}
+	slot_set(table, index, hash, item);
+	table->nr_items++;
+end:
+	mutex_unlock(&ht->lock);
+	return ret;
+}
+
+void *cds_swht_del(struct cds_swht *ht, unsigned long hash,
+		cds_swht_match_fct match, const void *key)
+{
+	struct swht_table *table;
+	unsigned long group;
+	void *item = NULL;
+	long index;
+
+	mutex_lock(&ht->lock);
+	table = ht->table;
+	index = table_find(table, hash, match, key, &item);
+	if (index < 0)
+		goto end;
+	/*
+	 * Probe sequences stop at the first group with an empty slot:
+	 * if the group already has one, no probe sequence continues past
+	 * it, and the slot can become empty again.
+	 */
+	group = (unsigned long) index >> SWHT_GROUP_ORDER;
+	if (group_match(&table->ctrl[group << SWHT_GROUP_ORDER],
+			SWHT_CTRL_EMPTY)) {
+		CMM_STORE_SHARED(table->ctrl[index], SWHT_CTRL_EMPTY);
+		table->growth_left++;
+	} else {
+		CMM_STORE_SHARED(table->ctrl[index], SWHT_CTRL_DELETED);
+	}
+	table->nr_items--;
+end:
+	mutex_unlock(&ht->lock);
+	return item;
+}
+
+unsigned long cds_swht_count(struct cds_swht *ht)
+{
+	unsigned long count;
+
+	mutex_lock(&ht->lock);
+	count = ht->table->nr_items;
+	mutex_unlock(&ht->lock);
+	return count;
+}
@@ -0,0 +1,205 @@
+/*
+ * rcuvec.c
+ *
+ * Userspace RCU library - RCU vector (read-mostly array)
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <urcu-pointer.h>
+#include <urcu/rcuvec.h>
+#include "urcu-die.h"
+
+/* Capacity of the first array. */
+#define VEC_MIN_CAPACITY	4
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static
+void free_array_cb(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct cds_vec_array, head));
+}
+
+/*
+ * Allocate an array of the given capacity holding the len elements of
+ * elems.
+ */
+static
+struct cds_vec_array *vec_alloc(unsigned long capacity,
+		void * const *elems, unsigned long len)
+{
+	struct cds_vec_array *array;
+
+	array = malloc(sizeof(*array) + capacity * sizeof(array->elem[0]));
+	if (!array)
+		return NULL;
+	array->len = len;
+	array->capacity = capacity;
+	if (len)
+		memcpy(array->elem, elems, len * sizeof(array->elem[0]));
+	return array;
+}
+
+/*
+ * Publish array in place of the current one, which is freed after a
+ * grace period. Called with the vector lock held.
+ */
+static
+void vec_publish(struct cds_vec *vec, struct cds_vec_array *array)
+{
+	struct cds_vec_array *old;
+
+	old = rcu_xchg_pointer(&vec->array, array);
+	if (old)
+		vec->vec_call_rcu(&old->head, free_array_cb);
+}
+
+void cds_vec_init(struct cds_vec *vec,
+		void vec_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)))
+{
+	int ret;
+
+	vec->array = NULL;
+	ret = pthread_mutex_init(&vec->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	vec->vec_call_rcu = vec_call_rcu;
+}
+
+void cds_vec_destroy(struct cds_vec *vec)
+{
+	int ret;
+
+	ret = pthread_mutex_destroy(&vec->lock);
+	if (ret)
+		urcu_die(ret);
+	free(vec->array);
+}
+
+int cds_vec_append(struct cds_vec *vec, void *elem)
+{
+	struct cds_vec_array *array, *new_array;
+	unsigned long len, capacity;
+
+	mutex_lock(&vec->lock);
+	array = vec->array;
+	len = array ? array->len : 0;
+	if (array && len < array->capacity) {
+		/* Readers only look up to the published length. */
+		CMM_STORE_SHARED(array->elem[len], elem);
+		cmm_smp_wmb();
+		CMM_STORE_SHARED(array->len, len + 1);
+		mutex_unlock(&vec->lock);
+		return 0;
+	}
+	capacity = array ? array->capacity << 1 : VEC_MIN_CAPACITY;
+	new_array = vec_alloc(capacity, array ? array->elem : NULL, len);
+	if (!new_array) {
+		mutex_unlock(&vec->lock);
+		return -ENOMEM;
+	}
+	new_array->elem[len] = elem;
+	new_array->len = len + 1;
+	vec_publish(vec, new_array);
+	mutex_unlock(&vec->lock);
+	return 0;
+}
+
+void *cds_vec_set(struct cds_vec *vec, unsigned long index, void *elem)
+{
+	struct cds_vec_array *array;
+	void *old = NULL;
+
+	mutex_lock(&vec->lock);
+	array = vec->array;
+	if (array && index < array->len) {
+		old = array->elem[index];
+		rcu_assign_pointer(array->elem[index], elem);
+	}
+	mutex_unlock(&vec->lock);
+	return old;
+}
+
+int cds_vec_del(struct cds_vec *vec, unsigned long index)
+{
+	struct cds_vec_array *array, *new_array = NULL;
+	unsigned long len;
+
+	mutex_lock(&vec->lock);
+	array = vec->array;
+	len = array ? array->len : 0;
+	if (index >= len) {
+		mutex_unlock(&vec->lock);
+		return -EINVAL;
+	}
+	if (len > 1) {
+		new_array = vec_alloc(array->capacity, array->elem, index);
+		if (!new_array) {
+			mutex_unlock(&vec->lock);
+			return -ENOMEM;
+		}
+		memcpy(&new_array->elem[index], &array->elem[index + 1],
+			(len - index - 1) * sizeof(array->elem[0]));
+		new_array->len = len - 1;
+	}
+	vec_publish(vec, new_array);
+	mutex_unlock(&vec->lock);
+	return 0;
+}
+
+int cds_vec_replace(struct cds_vec *vec, void * const *elems,
+		unsigned long len)
+{
+	struct cds_vec_array *new_array = NULL;
+	unsigned long capacity = VEC_MIN_CAPACITY;
+
+	if (len) {
+		while (capacity < len)
+			capacity <<= 1;
+		new_array = vec_alloc(capacity, elems, len);
+		if (!new_array)
+			return -ENOMEM;
+	}
+	mutex_lock(&vec->lock);
+	vec_publish(vec, new_array);
+	mutex_unlock(&vec->lock);
+	return 0;
+}
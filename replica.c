@@ -0,0 +1,288 @@
+/*
+ * replica.c
+ *
+ * Userspace RCU library - NUMA-replicated RCU pointer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#define _LGPL_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "config.h"
+#include <urcu/arch.h>
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu-pointer.h>
+#include <urcu/replica.h>
+#include "urcu-die.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/* Overridden by the tests, to read a fake topology. */
+#ifndef NODE_SYSFS
+#define NODE_SYSFS		"/sys/devices/system/node"
+#endif
+#define REPLICA_MAX_NODES	(sizeof(unsigned long) * CHAR_BIT)
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED		1
+#endif
+
+/*
+ * Topology, read once: the NUMA node id of each replica, in increasing
+ * order, and the replica index of each CPU.
+ */
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+static int node_id[REPLICA_MAX_NODES];
+static unsigned int nr_nodes = 1;
+static unsigned int *cpu_node;
+static unsigned int nr_cpus;
+static long page_size;
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+/* Call fct on each CPU of a sysfs CPU list, e.g. "0-3,8-11". */
+static void cpulist_for_each(const char *list,
+		void (*fct)(unsigned long cpu, unsigned int node),
+		unsigned int node)
+{
+	const char *p = list;
+	unsigned long first, last;
+	char *end;
+
+	while (*p) {
+		first = strtoul(p, &end, 10);
+		if (end == p)
+			break;
+		last = first;
+		p = end;
+		if (*p == '-') {
+			last = strtoul(p + 1, &end, 10);
+			p = end;
+		}
+		for (; first <= last; first++)
+			fct(first, node);
+		if (*p != ',')
+			break;
+		p++;
+	}
+}
+
+static void cpu_count(unsigned long cpu, unsigned int node)
+{
+	(void) node;
+	if (cpu >= nr_cpus)
+		nr_cpus = cpu + 1;
+}
+
+static void cpu_set_node(unsigned long cpu, unsigned int node)
+{
+	cpu_node[cpu] = node;
+}
+
+static int read_cpulist(int id, char *list, size_t len)
+{
+	char path[64];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), NODE_SYSFS "/node%d/cpulist", id);
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+	if (!fgets(list, len, fp))
+		list[0] = '\0';
+	fclose(fp);
+	return list[0] >= '0' && list[0] <= '9' ? 0 : -1;
+}
+
+static int node_cmp(const void *a, const void *b)
+{
+	return *(const int *) a - *(const int *) b;
+}
+
+static void topology_init(void)
+{
+	struct dirent *entry;
+	char list[4096];
+	unsigned int i, n = 0;
+	DIR *dir;
+	int id;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (page_size <= 0)
+		page_size = 4096;
+	node_id[0] = 0;
+	dir = opendir(NODE_SYSFS);
+	if (dir) {
+		while ((entry = readdir(dir)) != NULL
+				&& n < REPLICA_MAX_NODES) {
+			if (sscanf(entry->d_name, "node%d", &id) != 1)
+				continue;
+			/* Memory-only nodes do not need a replica. */
+			if (read_cpulist(id, list, sizeof(list)))
+				continue;
+			node_id[n++] = id;
+			cpulist_for_each(list, cpu_count, 0);
+		}
+		closedir(dir);
+	}
+	if (n <= 1) {
+		/* A single replica: readers do not need the table. */
+		nr_cpus = 0;
+		return;
+	}
+	qsort(node_id, n, sizeof(node_id[0]), node_cmp);
+	cpu_node = calloc(nr_cpus, sizeof(*cpu_node));
+	if (!cpu_node) {
+		/* Degrade to a single replica. */
+		nr_cpus = 0;
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		if (!read_cpulist(node_id[i], list, sizeof(list)))
+			cpulist_for_each(list, cpu_set_node, i);
+	}
+	nr_nodes = n;
+}
+
+int rcu_replica_current_cpu(void)
+{
+#ifdef HAVE_SCHED_GETCPU
+	return sched_getcpu();
+#else
+	return -1;
+#endif
+}
+
+int _rcu_replica_init(struct rcu_replica *r,
+		void (*free_replica)(void *p),
+		const struct rcu_flavor_struct *flavor)
+{
+	int ret;
+
+	ret = pthread_once(&topology_once, topology_init);
+	if (ret)
+		urcu_die(ret);
+	memset(r, 0, sizeof(*r));
+	ret = posix_memalign((void **) &r->node, CAA_CACHE_LINE_SIZE,
+			nr_nodes * sizeof(*r->node));
+	if (ret)
+		return -ENOMEM;
+	memset(r->node, 0, nr_nodes * sizeof(*r->node));
+	r->nr_nodes = nr_nodes;
+	r->nr_cpus = nr_cpus;
+	r->cpu_node = cpu_node;
+	r->free_replica = free_replica;
+	r->flavor = flavor;
+	ret = pthread_mutex_init(&r->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	return 0;
+}
+
+void rcu_replica_exit(struct rcu_replica *r)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < r->nr_nodes; i++) {
+		if (r->node[i].ptr)
+			r->free_replica(r->node[i].ptr);
+	}
+	free(r->node);
+	ret = pthread_mutex_destroy(&r->lock);
+	if (ret)
+		urcu_die(ret);
+}
+
+int rcu_replica_update(struct rcu_replica *r,
+		rcu_replica_copy_fct copy, void *priv)
+{
+	void *replica[REPLICA_MAX_NODES];
+	unsigned int i;
+
+	mutex_lock(&r->lock);
+	for (i = 0; i < r->nr_nodes; i++) {
+		replica[i] = copy(node_id[i], priv);
+		if (!replica[i]) {
+			while (i-- > 0)
+				r->free_replica(replica[i]);
+			mutex_unlock(&r->lock);
+			return -ENOMEM;
+		}
+	}
+	/* Publish all replicas, keeping the previous ones. */
+	for (i = 0; i < r->nr_nodes; i++)
+		replica[i] = rcu_xchg_pointer(&r->node[i].ptr, replica[i]);
+	r->flavor->update_synchronize_rcu();
+	for (i = 0; i < r->nr_nodes; i++) {
+		if (replica[i])
+			r->free_replica(replica[i]);
+	}
+	mutex_unlock(&r->lock);
+	return 0;
+}
+
+void *rcu_replica_alloc(size_t len, int node)
+{
+	void *p;
+
+	(void) pthread_once(&topology_once, topology_init);
+	len = (len + page_size - 1) & ~((size_t) page_size - 1);
+	if (posix_memalign(&p, page_size, len))
+		return NULL;
+#if defined(__linux__) && defined(SYS_mbind)
+	if (nr_nodes > 1 && node >= 0
+			&& (unsigned int) node < REPLICA_MAX_NODES) {
+		unsigned long nodemask = 1UL << node;
+
+		/* Best effort: bind before the pages are touched. */
+		(void) syscall(SYS_mbind, p, len, MPOL_PREFERRED, &nodemask,
+				REPLICA_MAX_NODES + 1, 0);
+	}
+#else
+	(void) node;
+#endif
+	memset(p, 0, len);
+	return p;
+}
@@ -0,0 +1,179 @@
+/*
+ * seqlock.c
+ *
+ * Userspace RCU library - sequence-counted values with RCU fallback
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _LGPL_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <urcu/arch.h>
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
+#include <urcu-pointer.h>
+#include <urcu/seqlock.h>
+#include "urcu-die.h"
+
+/*
+ * Copy of the value, as of the (even) counter seq. Copies are only
+ * published in counter order, by writers holding the lock.
+ */
+struct cds_seqval_copy {
+	struct rcu_head head;
+	unsigned long seq;
+	char data[];
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void free_copy(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct cds_seqval_copy, head));
+}
+
+int _cds_seqval_init(struct cds_seqval *v, size_t len,
+		unsigned int max_retries,
+		const struct rcu_flavor_struct *flavor)
+{
+	int ret;
+
+	memset(v, 0, sizeof(*v));
+	v->data = calloc(1, len ? len : 1);
+	if (!v->data)
+		return -ENOMEM;
+	v->len = len;
+	v->max_retries = max_retries;
+	v->flavor = flavor;
+	ret = pthread_mutex_init(&v->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	return 0;
+}
+
+void cds_seqval_destroy(struct cds_seqval *v)
+{
+	int ret;
+
+	free(v->copy);
+	free(v->data);
+	ret = pthread_mutex_destroy(&v->lock);
+	if (ret)
+		urcu_die(ret);
+}
+
+/* One in-place read attempt: returns 0 on success. */
+static int read_in_place(struct cds_seqval *v, void *buf,
+		unsigned long *start)
+{
+	*start = CMM_LOAD_SHARED(v->seq.seq);
+	if (*start & 1)
+		return -1;
+	/* Read the counter before the value. */
+	cmm_smp_rmb();
+	memcpy(buf, v->data, v->len);
+	return cds_seqcount_read_retry(&v->seq, *start);
+}
+
+void cds_seqval_read(struct cds_seqval *v, void *buf)
+{
+	struct cds_seqval_copy *copy;
+	unsigned long start, seq;
+	unsigned int i;
+
+	for (i = 0; ; i++) {
+		if (!read_in_place(v, buf, &start))
+			return;
+		if (i >= v->max_retries)
+			break;
+		caa_cpu_relax();
+	}
+
+	/*
+	 * Fall back on a copy made since the first failed attempt:
+	 * writes keep failing the in-place reads, and the next one
+	 * publishes a copy. Avoid writing the flag if it is already set.
+	 */
+	if (!CMM_LOAD_SHARED(v->want_copy))
+		uatomic_set(&v->want_copy, 1);
+	for (;;) {
+		copy = rcu_dereference(v->copy);
+		if (copy && (long) (copy->seq - start) >= 0) {
+			memcpy(buf, copy->data, v->len);
+			return;
+		}
+		if (!read_in_place(v, buf, &seq))
+			return;
+		caa_cpu_relax();
+	}
+}
+
+void *cds_seqval_write_begin(struct cds_seqval *v)
+{
+	mutex_lock(&v->lock);
+	cds_seqcount_write_begin(&v->seq);
+	return v->data;
+}
+
+void cds_seqval_write_end(struct cds_seqval *v)
+{
+	struct cds_seqval_copy *copy, *old;
+
+	cds_seqcount_write_end(&v->seq);
+	if (caa_unlikely(CMM_LOAD_SHARED(v->want_copy))) {
+		/*
+		 * On allocation failure, readers keep attempting in-place
+		 * reads, and the next write retries.
+		 */
+		copy = malloc(sizeof(*copy) + v->len);
+		if (copy) {
+			uatomic_set(&v->want_copy, 0);
+			copy->seq = v->seq.seq;
+			memcpy(copy->data, v->data, v->len);
+			old = rcu_xchg_pointer(&v->copy, copy);
+			if (old)
+				v->flavor->update_call_rcu(&old->head,
+						free_copy);
+		}
+	}
+	mutex_unlock(&v->lock);
+}
+
+void cds_seqval_write(struct cds_seqval *v, const void *val)
+{
+	memcpy(cds_seqval_write_begin(v), val, v->len);
+	cds_seqval_write_end(v);
+}
@@ -0,0 +1,225 @@
+/*
+ * split-counter.c
+ *
+ * Userspace RCU library - scalable split counter
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "config.h"
+#include <urcu/rseq.h>
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+#include <urcu/compiler.h>
+#include <urcu/cacheline.h>
+#include <urcu/split-counter.h>
+
+/* Number of slots when the number of CPUs is unknown. */
+#define SPLIT_COUNTER_DEFAULT_MASK	0xFUL
+
+/*
+ * Additions and subtractions of a slot, only ever incremented: the
+ * number of batches to commit is the number of multiples of the batch
+ * crossed by an update, whatever the update method.
+ */
+struct cds_split_counter_slot {
+	unsigned long add;
+	unsigned long sub;
+};
+
+static pthread_mutex_t split_counter_init_mutex = PTHREAD_MUTEX_INITIALIZER;
+static long split_counter_mask = -1;
+/* Bytes between slots, at least the host cache line size. */
+static size_t split_counter_stride;
+
+/*
+ * Slots updated with restartable sequences rather than atomic
+ * instructions. Only enabled when each possible CPU has its own slot
+ * and the rseq area is registered, so a slot is never updated with
+ * both methods.
+ */
+#ifdef URCU_HAVE_RSEQ_PERCPU
+static int split_counter_rseq;
+#endif
+
+static void split_counter_init_mask(void)
+{
+	long maxcpus = -1;
+
+	pthread_mutex_lock(&split_counter_init_mutex);
+	if (split_counter_mask >= 0)
+		goto end;
+#if defined(HAVE_SYSCONF)
+	maxcpus = sysconf(_SC_NPROCESSORS_CONF);
+#endif
+	split_counter_stride =
+		caa_cacheline_stride(sizeof(struct cds_split_counter_slot));
+	if (maxcpus <= 0) {
+		CMM_STORE_SHARED(split_counter_mask,
+			SPLIT_COUNTER_DEFAULT_MASK);
+	} else {
+		unsigned long size = 1;
+
+		while (size < (unsigned long) maxcpus)
+			size <<= 1;
+#ifdef URCU_HAVE_RSEQ_PERCPU
+		split_counter_rseq = !!__rseq_size;
+#endif
+		CMM_STORE_SHARED(split_counter_mask, size - 1);
+	}
+end:
+	pthread_mutex_unlock(&split_counter_init_mutex);
+}
+
+static inline
+struct cds_split_counter_slot *split_counter_slot(
+		struct cds_split_counter *counter, unsigned long index)
+{
+	return (struct cds_split_counter_slot *)
+		((char *) counter->slots + index * split_counter_stride);
+}
+
+static unsigned long split_counter_index(struct cds_split_counter *counter)
+{
+	int cpu;
+
+	cpu = urcu_rseq_cpu_id();
+#if defined(HAVE_SCHED_GETCPU)
+	if (caa_unlikely(cpu < 0))
+		cpu = sched_getcpu();
+#endif
+	if (caa_unlikely(cpu < 0))
+		return ((unsigned long) pthread_self() >> 8) & counter->mask;
+	return (unsigned long) cpu & counter->mask;
+}
+
+/*
+ * Add v to the additions (or subtractions) of the slot of the current
+ * CPU, and return the new value.
+ */
+static unsigned long split_counter_slot_add(struct cds_split_counter *counter,
+		unsigned long v, int sub)
+{
+	struct cds_split_counter_slot *slot;
+	unsigned long *p;
+
+#ifdef URCU_HAVE_RSEQ_PERCPU
+	if (caa_likely(split_counter_rseq)) {
+		unsigned long newv;
+		int cpu;
+
+		do {
+			cpu = urcu_rseq_cpu_start();
+			slot = split_counter_slot(counter, cpu);
+		} while (caa_unlikely(urcu_rseq_add_return(
+				sub ? &slot->sub : &slot->add, v, cpu,
+				&newv)));
+		return newv;
+	}
+#endif
+	slot = split_counter_slot(counter, split_counter_index(counter));
+	p = sub ? &slot->sub : &slot->add;
+	if (counter->flags & CDS_SPLIT_COUNTER_LAZY) {
+		unsigned long newv;
+
+		/* Racy by design: no atomic operation on the fast path. */
+		newv = CMM_LOAD_SHARED(*p) + v;
+		CMM_STORE_SHARED(*p, newv);
+		return newv;
+	}
+	return uatomic_add_return_mo(p, v, CMM_RELAXED);
+}
+
+static bool split_counter_update(struct cds_split_counter *counter,
+		unsigned long v, int sub, long *count)
+{
+	unsigned long newv, batches;
+	long delta, ret;
+
+	newv = split_counter_slot_add(counter, v, sub);
+	batches = (newv >> counter->batch_order)
+		- ((newv - v) >> counter->batch_order);
+	if (caa_likely(!batches))
+		return false;
+	/* Only if the slot crossed a multiple of the batch. */
+	delta = (long) (batches << counter->batch_order);
+	ret = uatomic_add_return_mo(&counter->count, sub ? -delta : delta,
+			CMM_RELAXED);
+	if (count)
+		*count = ret;
+	return true;
+}
+
+int cds_split_counter_init(struct cds_split_counter *counter,
+		unsigned int batch_order, unsigned int flags)
+{
+	if (batch_order >= CAA_BITS_PER_LONG - 1)
+		return -EINVAL;
+	if (caa_unlikely(CMM_LOAD_SHARED(split_counter_mask) < 0))
+		split_counter_init_mask();
+	counter->slots = caa_cacheline_zalloc((split_counter_mask + 1)
+			* split_counter_stride);
+	if (!counter->slots)
+		return -ENOMEM;
+	counter->mask = split_counter_mask;
+	counter->batch_order = batch_order;
+	counter->flags = flags;
+	counter->count = 0;
+	return 0;
+}
+
+void cds_split_counter_destroy(struct cds_split_counter *counter)
+{
+	free(counter->slots);
+	counter->slots = NULL;
+}
+
+bool cds_split_counter_add(struct cds_split_counter *counter,
+		unsigned long v, long *count)
+{
+	return split_counter_update(counter, v, 0, count);
+}
+
+bool cds_split_counter_sub(struct cds_split_counter *counter,
+		unsigned long v, long *count)
+{
+	return split_counter_update(counter, v, 1, count);
+}
+
+long cds_split_counter_read_approx(struct cds_split_counter *counter)
+{
+	return uatomic_read(&counter->count);
+}
+
+long cds_split_counter_read(struct cds_split_counter *counter)
+{
+	unsigned long i, sum = 0;
+
+	for (i = 0; i <= counter->mask; i++) {
+		struct cds_split_counter_slot *slot =
+			split_counter_slot(counter, i);
+
+		sum += uatomic_read(&slot->add);
+		sum -= uatomic_read(&slot->sub);
+	}
+	return (long) sum;
+}
@@ -0,0 +1,70 @@
+/*
+ * spscring.c
+ *
+ * Userspace RCU library - Single-Producer/Single-Consumer Ring Buffer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
+#undef _LGPL_SOURCE
+#include "urcu/spscring.h"
+#define _LGPL_SOURCE
+#include "urcu/static/spscring.h"
+
+/*
+ * library wrappers to be used by non-LGPL compatible source code.
+ */
+
+int cds_spsc_ring_init(struct cds_spsc_ring *ring, unsigned long size,
+		size_t slot_size, unsigned long batch)
+{
+	return _cds_spsc_ring_init(ring, size, slot_size, batch);
+}
+
+void cds_spsc_ring_destroy(struct cds_spsc_ring *ring)
+{
+	_cds_spsc_ring_destroy(ring);
+}
+
+void *cds_spsc_ring_reserve(struct cds_spsc_ring *ring)
+{
+	return _cds_spsc_ring_reserve(ring);
+}
+
+void cds_spsc_ring_commit(struct cds_spsc_ring *ring)
+{
+	_cds_spsc_ring_commit(ring);
+}
+
+void cds_spsc_ring_publish(struct cds_spsc_ring *ring)
+{
+	_cds_spsc_ring_publish(ring);
+}
+
+void *cds_spsc_ring_peek(struct cds_spsc_ring *ring)
+{
+	return _cds_spsc_ring_peek(ring);
+}
+
+void cds_spsc_ring_release(struct cds_spsc_ring *ring)
+{
+	_cds_spsc_ring_release(ring);
+}
+
+void cds_spsc_ring_release_publish(struct cds_spsc_ring *ring)
+{
+	_cds_spsc_ring_release_publish(ring);
+}
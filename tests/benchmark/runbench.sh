@@ -0,0 +1,78 @@
+#!/bin/sh
+
+# Sweep reader/writer thread counts over the RCU flavors and gather the
+# machine-readable report of each run in a single file.
+#
+# usage: ./runbench.sh [-d duration] [-f csv|json] [-o output]
+#	[-t "thread counts"] [-w nr_writers] [-a] [-p placement] [flavor ...]
+#
+# -a pins the threads on CPUs 0..N-1 (positional -a option of the tests).
+# -p places the threads on the NUMA nodes with the given policy
+# (compact, scatter or remote-writers), instead of -a.
+# With csv format, a header line is only emitted when it changes.
+
+DURATION=10
+FORMAT=csv
+OUTPUT=""
+THREADS="1 2 4 8"
+NR_WRITERS=1
+AFFINITY=0
+PLACEMENT=""
+FLAVORS="test_urcu test_urcu_mb test_urcu_signal test_urcu_qsbr \
+	test_urcu_bp test_rwlock"
+
+while getopts "d:f:o:t:w:ap:" opt; do
+	case $opt in
+	d) DURATION=$OPTARG ;;
+	f) FORMAT=$OPTARG ;;
+	o) OUTPUT=$OPTARG ;;
+	t) THREADS=$OPTARG ;;
+	w) NR_WRITERS=$OPTARG ;;
+	a) AFFINITY=1 ;;
+	p) PLACEMENT="--placement=$OPTARG" ;;
+	*) echo "usage: $0 [-d duration] [-f csv|json] [-o output] [-t \"thread counts\"] [-w nr_writers] [-a] [-p placement] [flavor ...]" >&2
+	   exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+if [ $# -gt 0 ]; then
+	FLAVORS="$*"
+fi
+
+case $FORMAT in
+csv|json) ;;
+*) echo "$0: unknown format $FORMAT" >&2; exit 1 ;;
+esac
+
+if [ -n "$OUTPUT" ]; then
+	: > "$OUTPUT" || exit 1
+	exec > "$OUTPUT"
+fi
+
+URCU_BENCH_FORMAT=$FORMAT
+export URCU_BENCH_FORMAT
+
+last_header=""
+for flavor in $FLAVORS; do
+	for nr_readers in $THREADS; do
+		affinity=""
+		if [ $AFFINITY -eq 1 ]; then
+			cpu=0
+			while [ $cpu -lt $((nr_readers + NR_WRITERS)) ]; do
+				affinity="$affinity -a $cpu"
+				cpu=$((cpu + 1))
+			done
+		fi
+		echo "./${flavor} ${nr_readers} ${NR_WRITERS} ${DURATION}${affinity} ${PLACEMENT}" >&2
+		# The report is the last lines of the output, after SUMMARY.
+		report=$(./${flavor} ${nr_readers} ${NR_WRITERS} ${DURATION} \
+			${affinity} ${PLACEMENT} | sed -n '/^SUMMARY/,$p' | sed 1d) || exit 1
+		header=$(echo "$report" | sed -n 1p)
+		if [ "$FORMAT" = csv ] && [ "$header" = "$last_header" ]; then
+			echo "$report" | sed 1d
+		else
+			last_header=$header
+			echo "$report"
+		fi
+	done
+done
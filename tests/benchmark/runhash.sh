@@ -134,3 +134,17 @@ ${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
 # create long hash chains: using modulo 4 on keys as hash
 ${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
 	-U -C 4 ${EXTRA_PARAMS} || exit 1
+
+# ** GC test
+
+# gc test, 2 lookup, 2 update threads, add_unique and del randomly, auto resize.
+# max 1048576 buckets
+# removed nodes unlinked by cds_lfht_gc() passes, reclaimed by the table
+# key range: 10 stable keys, always found by the lookups
+# key range: updates: 100 even keys
+${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
+	-g -k 10 -N 100 ${EXTRA_PARAMS} || exit 1
+
+# gc test, long hash chains: using modulo 4 on keys as hash
+${TESTPROG} $((2*${THREAD_MUL})) $((2*${THREAD_MUL})) ${TIME_UNITS} -A \
+	-g -k 10 -N 100 -C 4 ${EXTRA_PARAMS} || exit 1
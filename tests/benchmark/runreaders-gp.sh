@@ -0,0 +1,18 @@
+#!/bin/sh
+#
+# Report synchronize_rcu() latency as the number of registered reader
+# threads grows.
+#
+# Usage: ./runreaders-gp.sh [duration (s)] [max nr_readers]
+
+DURATION=${1:-2}
+MAX_READERS=${2:-64}
+
+for a in test_urcu test_urcu_signal test_urcu_mb; do
+	nr=1
+	while [ $nr -le $MAX_READERS ]; do
+		echo "./${a} ${nr} 1 ${DURATION} -v"
+		./${a} ${nr} 1 ${DURATION} -v | grep "synchronize_rcu latency"
+		nr=$((nr * 2))
+	done
+done
@@ -0,0 +1,588 @@
+/*
+ * test_call_rcu.c
+ *
+ * Userspace RCU library - call_rcu enqueue and reclamation benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Enqueuer threads do nothing but allocate objects and free them with
+ * call_rcu(), for 1, 2, 4, ... up to nr_enqueuers threads, with the
+ * default call_rcu thread, one call_rcu thread per CPU, one per
+ * enqueuer, or one URCU_CALL_RCU_MANUAL call_rcu_data per enqueuer,
+ * which invokes its callbacks with call_rcu_data_poll(). Each run reports the enqueue throughput, the distribution
+ * of the delay between call_rcu() and the invocation of the callback,
+ * the objects awaiting reclamation, sampled over time, and the cost of
+ * rcu_barrier() once the enqueuers stopped, and with nothing queued.
+ * With -r, each callback queues its object again with call_rcu() that
+ * many times before freeing it, throttled by the queue length limit of
+ * -l as the enqueuers are: the call_rcu threads must keep invoking
+ * their callbacks.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <assert.h>
+
+#include <urcu/arch.h>
+#include <urcu/clock.h>
+#include <urcu/list.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+#include "bench.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+
+enum config {
+	CONFIG_DEFAULT,		/* default call_rcu thread */
+	CONFIG_PER_CPU,		/* create_all_cpu_call_rcu_data() */
+	CONFIG_PER_THREAD,	/* one call_rcu thread per enqueuer */
+	CONFIG_MANUAL,		/* one polled call_rcu_data per enqueuer */
+	NR_CONFIGS,
+};
+
+static const char *config_name[NR_CONFIGS] = {
+	[CONFIG_DEFAULT] = "default",
+	[CONFIG_PER_CPU] = "per-cpu",
+	[CONFIG_PER_THREAD] = "per-thread",
+	[CONFIG_MANUAL] = "manual",
+};
+
+struct test_node {
+	struct rcu_head head;
+	cycles_t enqueued;	/* call_rcu() time */
+	unsigned long requeue;	/* call_rcu() left from the callback */
+	char payload[];
+};
+
+/*
+ * Statistics of a thread invoking callbacks, allocated on its first
+ * callback.
+ */
+struct invoke_stats {
+	unsigned long long nr_invoked;
+	struct bench_hist hist;		/* enqueue to invoke delay */
+	struct cds_list_head list;
+};
+
+static volatile int test_go, test_stop;
+
+static enum config config;
+
+static unsigned long duration;
+
+/* delay between enqueues, in loops */
+static unsigned long edelay;
+
+/* size of the objects, payload included */
+static size_t node_size = sizeof(struct test_node);
+
+/* outstanding objects sampling period, in ms */
+static unsigned long sample_ms = 100;
+
+static unsigned int nr_enqueuers;
+
+/* call_rcu() of each object from its callback */
+static unsigned long nr_requeue;
+
+/* queue length limit of the call_rcu_data, 0 for none */
+static unsigned long qlen_limit;
+
+/* flags of the call_rcu threads created */
+static unsigned long crdp_flags;
+
+/* configurations selected with -c, all by default */
+static int config_selected[NR_CONFIGS];
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Objects queued by each enqueuer, read by the sampler. */
+static unsigned long long *nr_enqueued;
+
+static DEFINE_URCU_TLS(struct invoke_stats *, invoke_stats);
+static CDS_LIST_HEAD(invoke_stats_list);
+static pthread_mutex_t invoke_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static struct invoke_stats *get_invoke_stats(void)
+{
+	struct invoke_stats *stats = URCU_TLS(invoke_stats);
+
+	if (caa_likely(stats))
+		return stats;
+	stats = calloc(1, sizeof(*stats));
+	assert(stats);
+	pthread_mutex_lock(&invoke_stats_mutex);
+	cds_list_add(&stats->list, &invoke_stats_list);
+	pthread_mutex_unlock(&invoke_stats_mutex);
+	URCU_TLS(invoke_stats) = stats;
+	return stats;
+}
+
+static void free_node_cb(struct rcu_head *head)
+{
+	struct test_node *node = caa_container_of(head, struct test_node, head);
+	struct invoke_stats *stats;
+
+	if (node->requeue) {
+		node->requeue--;
+		call_rcu(&node->head, free_node_cb);
+		return;
+	}
+	stats = get_invoke_stats();
+	bench_hist_record(&stats->hist,
+		caa_cycles_to_ns(caa_get_cycles() - node->enqueued));
+	CMM_STORE_SHARED(stats->nr_invoked, stats->nr_invoked + 1);
+	free(node);
+}
+
+/*
+ * Objects queued and not reclaimed yet. Racy, as the counters are read
+ * one after the other, but good enough for sampling.
+ */
+static unsigned long long nr_outstanding(void)
+{
+	unsigned long long queued = 0, invoked = 0;
+	struct invoke_stats *stats;
+	unsigned int i;
+
+	for (i = 0; i < nr_enqueuers; i++)
+		queued += CMM_LOAD_SHARED(nr_enqueued[i]);
+	pthread_mutex_lock(&invoke_stats_mutex);
+	cds_list_for_each_entry(stats, &invoke_stats_list, list)
+		invoked += CMM_LOAD_SHARED(stats->nr_invoked);
+	pthread_mutex_unlock(&invoke_stats_mutex);
+	return queued > invoked ? queued - invoked : 0;
+}
+
+static void *thr_enqueuer(void *_count)
+{
+	unsigned long long *count = _count;
+	struct call_rcu_data *crdp = NULL;
+	struct call_rcu_data_stats stats;
+	struct test_node *node;
+
+	set_affinity();
+
+	rcu_register_thread();
+	if (config == CONFIG_PER_THREAD || config == CONFIG_MANUAL) {
+		crdp = create_call_rcu_data(crdp_flags
+			| (config == CONFIG_MANUAL ? URCU_CALL_RCU_MANUAL : 0),
+			-1);
+		assert(crdp);
+		call_rcu_data_set_qlen_limit(crdp, qlen_limit);
+		set_thread_call_rcu_data(crdp);
+	}
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		node = malloc(node_size);
+		assert(node);
+		node->enqueued = caa_get_cycles();
+		node->requeue = nr_requeue;
+		call_rcu(&node->head, free_node_cb);
+		CMM_STORE_SHARED(*count, *count + 1);
+		if (config == CONFIG_MANUAL)
+			(void) call_rcu_data_poll(crdp);
+		if (caa_unlikely(test_stop))
+			break;
+		if (caa_unlikely(edelay))
+			loop_sleep(edelay);
+	}
+
+	/* Nothing but ourself invokes the callbacks queued. */
+	if (config == CONFIG_MANUAL) {
+		for (;;) {
+			call_rcu_data_get_stats(crdp, &stats);
+			if (!stats.qlen)
+				break;
+			if (!call_rcu_data_poll(crdp))
+				poll(NULL, 0, 1);
+		}
+	}
+
+	rcu_unregister_thread();
+
+	/* Freed by the main thread, once rcu_barrier() is measured. */
+	return crdp;
+}
+
+/* Run the current configuration with nr_threads enqueuers. */
+static void run_test(unsigned int nr_threads)
+{
+	struct call_rcu_data **crdp;
+	struct invoke_stats *stats;
+	struct bench_hist hist;
+	unsigned long long tot_enqueued = 0, tot_invoked = 0;
+	unsigned long long outstanding, max_outstanding = 0;
+	unsigned long long sum_outstanding = 0, nr_samples = 0;
+	unsigned long elapsed_ms;
+	cycles_t time1, time2;
+	uint64_t barrier_ns, idle_barrier_ns;
+	pthread_t *tid_enqueuer;
+	unsigned int i;
+	int err;
+
+	if (config == CONFIG_PER_CPU) {
+		err = create_all_cpu_call_rcu_data(crdp_flags);
+		if (err)
+			fprintf(stderr, "Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+		rcu_read_lock();
+		for (i = 0; i < sysconf(_SC_NPROCESSORS_CONF); i++) {
+			struct call_rcu_data *cpu_crdp;
+
+			cpu_crdp = get_cpu_call_rcu_data(i);
+			if (cpu_crdp)
+				call_rcu_data_set_qlen_limit(cpu_crdp,
+					qlen_limit);
+		}
+		rcu_read_unlock();
+	}
+	call_rcu_data_set_qlen_limit(get_default_call_rcu_data(), qlen_limit);
+
+	tid_enqueuer = calloc(nr_threads, sizeof(*tid_enqueuer));
+	crdp = calloc(nr_threads, sizeof(*crdp));
+	nr_enqueued = calloc(nr_threads, sizeof(*nr_enqueued));
+	assert(tid_enqueuer && crdp && nr_enqueued);
+	nr_enqueuers = nr_threads;
+
+	test_go = 0;
+	test_stop = 0;
+	next_aff = 0;
+	cmm_smp_mb();
+
+	for (i = 0; i < nr_threads; i++) {
+		err = pthread_create(&tid_enqueuer[i], NULL, thr_enqueuer,
+				     &nr_enqueued[i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	bench_perf_start();
+	test_go = 1;
+
+	for (elapsed_ms = 0; elapsed_ms < duration * 1000;
+			elapsed_ms += sample_ms) {
+		usleep(sample_ms * 1000);
+		outstanding = nr_outstanding();
+		printf_verbose("%s %u threads: %lu ms: %llu outstanding\n",
+			config_name[config], nr_threads,
+			elapsed_ms + sample_ms, outstanding);
+		if (outstanding > max_outstanding)
+			max_outstanding = outstanding;
+		sum_outstanding += outstanding;
+		nr_samples++;
+	}
+
+	test_stop = 1;
+	bench_perf_stop();
+
+	for (i = 0; i < nr_threads; i++) {
+		err = pthread_join(tid_enqueuer[i], (void **) &crdp[i]);
+		if (err != 0)
+			exit(1);
+		tot_enqueued += nr_enqueued[i];
+	}
+
+	/* Wait for the callbacks left by the enqueuers. */
+	time1 = caa_get_cycles();
+	rcu_barrier();
+	time2 = caa_get_cycles();
+	barrier_ns = caa_cycles_to_ns(time2 - time1);
+	time1 = caa_get_cycles();
+	rcu_barrier();
+	time2 = caa_get_cycles();
+	idle_barrier_ns = caa_cycles_to_ns(time2 - time1);
+
+	for (i = 0; i < nr_threads; i++) {
+		if (crdp[i])
+			call_rcu_data_free(crdp[i]);
+	}
+	if (config == CONFIG_PER_CPU)
+		free_all_cpu_call_rcu_data();
+	call_rcu_data_set_qlen_limit(get_default_call_rcu_data(), 0);
+
+	memset(&hist, 0, sizeof(hist));
+	pthread_mutex_lock(&invoke_stats_mutex);
+	cds_list_for_each_entry(stats, &invoke_stats_list, list) {
+		bench_hist_merge(&hist, &stats->hist);
+		tot_invoked += stats->nr_invoked;
+		/* Reset, as call_rcu threads may outlive the run. */
+		stats->nr_invoked = 0;
+		memset(&stats->hist, 0, sizeof(stats->hist));
+	}
+	pthread_mutex_unlock(&invoke_stats_mutex);
+	assert(tot_invoked == tot_enqueued);
+
+	printf("%-10s %4u threads: %12.0f enqueues/s, outstanding max %llu avg %.0f, rcu_barrier %llu ns (idle %llu ns)\n",
+		config_name[config], nr_threads,
+		(double) tot_enqueued / duration, max_outstanding,
+		nr_samples ? (double) sum_outstanding / nr_samples : 0.0,
+		(unsigned long long) barrier_ns,
+		(unsigned long long) idle_barrier_ns);
+	bench_hist_print(&hist, "%-10s %4u threads: reclaim latency",
+		config_name[config], nr_threads);
+
+	bench_report_begin("test_call_rcu");
+	bench_report_string("config", config_name[config]);
+	bench_report_u64("duration_s", duration);
+	bench_report_u64("nr_enqueuers", nr_threads);
+	bench_report_u64("enqueue_delay_loops", edelay);
+	bench_report_u64("object_size", node_size);
+	bench_report_u64("nr_requeue", nr_requeue);
+	bench_report_u64("qlen_limit", qlen_limit);
+	bench_report_u64("nr_enqueued", tot_enqueued);
+	bench_report_double("enqueues_per_s",
+		(double) tot_enqueued / duration);
+	bench_report_hist("reclaim_latency", &hist);
+	bench_report_u64("outstanding_max", max_outstanding);
+	bench_report_double("outstanding_avg",
+		nr_samples ? (double) sum_outstanding / nr_samples : 0.0);
+	bench_report_u64("outstanding_max_bytes", max_outstanding * node_size);
+	bench_report_u64("barrier_ns", barrier_ns);
+	bench_report_u64("idle_barrier_ns", idle_barrier_ns);
+	bench_report_perf(tot_enqueued);
+	bench_report_end();
+
+	free(tid_enqueuer);
+	free(crdp);
+	free(nr_enqueued);
+	nr_enqueued = NULL;
+}
+
+static void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_enqueuers duration (s, per test) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-c config] [-c config]... (default, per-cpu, per-thread, manual; default all)\n");
+	printf("	[-d delay] (delay between enqueues, in loops)\n");
+	printf("	[-s size] (object size, in bytes)\n");
+	printf("	[-p period] (outstanding objects sampling period (ms), default 100)\n");
+	printf("	[-r count] (call_rcu() of each object from its callback)\n");
+	printf("	[-l limit] (call_rcu queue length limit)\n");
+	printf("	[-H] (throttled callers help the call_rcu threads created)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("	[--format=json|csv] (machine-readable report)\n");
+	printf("	[--perf] (hardware performance counters per operation)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int max_threads, nr_threads, c;
+	unsigned long size;
+	int nr_selected = 0;
+	int err, i, a;
+
+	if (argc < 3) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &max_threads);
+	if (err != 1 || !max_threads) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%lu", &duration);
+	if (err != 1 || !duration) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 3; i < argc; i++) {
+		if (bench_parse_option(argv[i]))
+			continue;
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			i++;
+			for (c = 0; c < NR_CONFIGS; c++) {
+				if (!strcmp(argv[i], config_name[c]))
+					break;
+			}
+			if (c == NR_CONFIGS) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			config_selected[c] = 1;
+			nr_selected++;
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			edelay = atol(argv[++i]);
+			break;
+		case 's':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			size = atol(argv[++i]);
+			if (size > node_size)
+				node_size = size;
+			break;
+		case 'p':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			sample_ms = atol(argv[++i]);
+			if (!sample_ms) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'r':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_requeue = atol(argv[++i]);
+			break;
+		case 'l':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			qlen_limit = atol(argv[++i]);
+			break;
+		case 'H':
+			crdp_flags |= URCU_CALL_RCU_LIMIT_HELP;
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+	if (!nr_selected) {
+		for (c = 0; c < NR_CONFIGS; c++)
+			config_selected[c] = 1;
+	}
+
+	printf_verbose("running each test for %lu seconds, up to %u enqueuers.\n",
+		duration, max_threads);
+	printf_verbose("Enqueue delay : %lu loops, object size : %zu bytes.\n",
+		edelay, node_size);
+	printf_verbose("Requeues : %lu, queue length limit : %lu.\n",
+		nr_requeue, qlen_limit);
+
+	/* The main thread calls rcu_barrier(). */
+	rcu_register_thread();
+	for (c = 0; c < NR_CONFIGS; c++) {
+		if (!config_selected[c])
+			continue;
+		config = c;
+		for (nr_threads = 1; ; nr_threads <<= 1) {
+			if (nr_threads > max_threads)
+				nr_threads = max_threads;
+			run_test(nr_threads);
+			if (nr_threads == max_threads)
+				break;
+		}
+	}
+	rcu_unregister_thread();
+	return 0;
+}
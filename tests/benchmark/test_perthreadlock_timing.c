@@ -33,6 +33,7 @@
 #include <errno.h>
 
 #include <urcu/arch.h>
+#include <urcu/clock.h>
 
 #include "thread-id.h"
 
@@ -77,7 +78,7 @@ void *thr_reader(void *arg)
 		"reader", urcu_get_thread_id());
 	sleep(2);
 
-	time1 = caa_get_cycles();
+	time1 = caa_get_cycles_ordered();
 	for (i = 0; i < OUTER_READ_LOOP; i++) {
 		for (j = 0; j < INNER_READ_LOOP; j++) {
 			pthread_mutex_lock(&per_thread_lock[tidx].lock);
@@ -85,7 +86,7 @@ void *thr_reader(void *arg)
 			pthread_mutex_unlock(&per_thread_lock[tidx].lock);
 		}
 	}
-	time2 = caa_get_cycles();
+	time2 = caa_get_cycles_ordered();
 
 	reader_time[tidx] = time2 - time1;
 
@@ -108,7 +109,7 @@ void *thr_writer(void *arg)
 
 	for (i = 0; i < OUTER_WRITE_LOOP; i++) {
 		for (j = 0; j < INNER_WRITE_LOOP; j++) {
-			time1 = caa_get_cycles();
+			time1 = caa_get_cycles_ordered();
 			for (tidx = 0; tidx < NR_READ; tidx++) {
 				pthread_mutex_lock(&per_thread_lock[tidx].lock);
 			}
@@ -116,7 +117,7 @@ void *thr_writer(void *arg)
 			for (tidx = NR_READ - 1; tidx >= 0; tidx--) {
 				pthread_mutex_unlock(&per_thread_lock[tidx].lock);
 			}
-			time2 = caa_get_cycles();
+			time2 = caa_get_cycles_ordered();
 			writer_time[(unsigned long)arg] += time2 - time1;
 			usleep(1);
 		}
@@ -183,10 +184,14 @@ int main(int argc, char **argv)
 			exit(1);
 		tot_wtime += writer_time[i];
 	}
-	printf("Time per read : %g cycles\n",
-	       (double)tot_rtime / ((double)NR_READ * (double)READ_LOOP));
-	printf("Time per write : %g cycles\n",
-	       (double)tot_wtime / ((double)NR_WRITE * (double)WRITE_LOOP));
+	printf("Time per read : %g cycles, %g ns\n",
+	       (double)tot_rtime / ((double)NR_READ * (double)READ_LOOP),
+	       (double)caa_cycles_to_ns(tot_rtime)
+			/ ((double)NR_READ * (double)READ_LOOP));
+	printf("Time per write : %g cycles, %g ns\n",
+	       (double)tot_wtime / ((double)NR_WRITE * (double)WRITE_LOOP),
+	       (double)caa_cycles_to_ns(tot_wtime)
+			/ ((double)NR_WRITE * (double)WRITE_LOOP));
 	free(per_thread_lock);
 
 	free(reader_time);
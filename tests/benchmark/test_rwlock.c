@@ -34,9 +34,11 @@
 #include <errno.h>
 
 #include <urcu/arch.h>
+#include <urcu/clock.h>
 #include <urcu/tls-compat.h>
 #include "cpuset.h"
 #include "thread-id.h"
+#include "bench.h"
 
 /* hardcoded number of CPUs */
 #define NR_CPUS 16384
@@ -135,6 +137,11 @@ static int test_duration_read(void)
 static DEFINE_URCU_TLS(unsigned long long, nr_writes);
 static DEFINE_URCU_TLS(unsigned long long, nr_reads);
 
+/* Write lock acquisition latency histogram, in nanoseconds */
+static DEFINE_URCU_TLS(struct bench_hist, wrlock_hist);
+static struct bench_hist tot_wrlock_hist;
+static pthread_mutex_t wrlock_hist_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static unsigned int nr_readers;
 static unsigned int nr_writers;
 
@@ -169,6 +176,7 @@ void *thr_reader(void *_count)
 			"reader", urcu_get_thread_id());
 
 	set_affinity();
+	bench_place_thread(BENCH_ROLE_READER);
 
 	while (!test_go)
 	{
@@ -195,11 +203,13 @@ void *thr_reader(void *_count)
 void *thr_writer(void *_count)
 {
 	unsigned long long *count = _count;
+	cycles_t time1, time2;
 
 	printf_verbose("thread_begin %s, tid %lu\n",
 			"writer", urcu_get_thread_id());
 
 	set_affinity();
+	bench_place_thread(BENCH_ROLE_WRITER);
 
 	while (!test_go)
 	{
@@ -207,7 +217,11 @@ void *thr_writer(void *_count)
 	cmm_smp_mb();
 
 	for (;;) {
+		time1 = caa_get_cycles();
 		pthread_rwlock_wrlock(&lock);
+		time2 = caa_get_cycles();
+		bench_hist_record(&URCU_TLS(wrlock_hist),
+			caa_cycles_to_ns(time2 - time1));
 		test_array.a = 0;
 		test_array.a = 8;
 		if (caa_unlikely(wduration))
@@ -223,6 +237,9 @@ void *thr_writer(void *_count)
 	printf_verbose("thread_end %s, tid %lu\n",
 			"writer", urcu_get_thread_id());
 	*count = URCU_TLS(nr_writes);
+	pthread_mutex_lock(&wrlock_hist_mutex);
+	bench_hist_merge(&tot_wrlock_hist, &URCU_TLS(wrlock_hist));
+	pthread_mutex_unlock(&wrlock_hist_mutex);
 	return ((void*)2);
 }
 
@@ -236,6 +253,9 @@ void show_usage(int argc, char **argv)
 	printf("	[-e duration] (writer C.S. duration (in loops))\n");
 	printf("	[-v] (verbose output)\n");
 	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("	[--format=json|csv] (machine-readable report)\n");
+	printf("	[--perf] (hardware performance counters per operation)\n");
+	printf("	[--placement=compact|scatter|remote-writers] (NUMA placement)\n");
 	printf("\n");
 }
 
@@ -275,6 +295,8 @@ int main(int argc, char **argv)
 	for (i = 4; i < argc; i++) {
 		if (argv[i][0] != '-')
 			continue;
+		if (bench_parse_option(argv[i]))
+			continue;
 		switch (argv[i][1]) {
 		case 'a':
 			if (argc < i + 2) {
@@ -326,6 +348,7 @@ int main(int argc, char **argv)
 	count_writer = calloc(nr_writers, sizeof(*count_writer));
 
 	next_aff = 0;
+	bench_placement_init(nr_readers, nr_writers);
 
 	for (i = 0; i < nr_readers; i++) {
 		err = pthread_create(&tid_reader[i], NULL, thr_reader,
@@ -342,11 +365,13 @@ int main(int argc, char **argv)
 
 	cmm_smp_mb();
 
+	bench_perf_start();
 	test_go = 1;
 
 	sleep(duration);
 
 	test_stop = 1;
+	bench_perf_stop();
 
 	for (i = 0; i < nr_readers; i++) {
 		err = pthread_join(tid_reader[i], &tret);
@@ -369,6 +394,21 @@ int main(int argc, char **argv)
 		argv[0], duration, nr_readers, rduration, wduration,
 		nr_writers, wdelay, tot_reads, tot_writes,
 		tot_reads + tot_writes);
+	bench_report_begin(argv[0]);
+	bench_report_u64("duration_s", duration);
+	bench_report_u64("nr_readers", nr_readers);
+	bench_report_u64("nr_writers", nr_writers);
+	bench_report_u64("rdur", rduration);
+	bench_report_u64("wdur", wduration);
+	bench_report_u64("wdelay", wdelay);
+	bench_report_u64("nr_reads", tot_reads);
+	bench_report_u64("nr_writes", tot_writes);
+	bench_report_double("reads_per_s", (double) tot_reads / duration);
+	bench_report_double("writes_per_s", (double) tot_writes / duration);
+	bench_report_hist("wrlock_latency", &tot_wrlock_hist);
+	bench_report_perf(tot_reads + tot_writes);
+	bench_report_placement();
+	bench_report_end();
 
 	free(tid_reader);
 	free(tid_writer);
@@ -34,6 +34,7 @@
 #include <errno.h>
 
 #include <urcu/arch.h>
+#include <urcu/clock.h>
 
 #include "thread-id.h"
 
@@ -73,7 +74,7 @@ void *thr_reader(void *arg)
 		"reader", urcu_get_thread_id());
 	sleep(2);
 
-	time1 = caa_get_cycles();
+	time1 = caa_get_cycles_ordered();
 	for (i = 0; i < OUTER_READ_LOOP; i++) {
 		for (j = 0; j < INNER_READ_LOOP; j++) {
 			pthread_rwlock_rdlock(&lock);
@@ -81,7 +82,7 @@ void *thr_reader(void *arg)
 			pthread_rwlock_unlock(&lock);
 		}
 	}
-	time2 = caa_get_cycles();
+	time2 = caa_get_cycles_ordered();
 
 	reader_time[(unsigned long)arg] = time2 - time1;
 
@@ -103,11 +104,11 @@ void *thr_writer(void *arg)
 
 	for (i = 0; i < OUTER_WRITE_LOOP; i++) {
 		for (j = 0; j < INNER_WRITE_LOOP; j++) {
-			time1 = caa_get_cycles();
+			time1 = caa_get_cycles_ordered();
 			pthread_rwlock_wrlock(&lock);
 			test_array.a = 8;
 			pthread_rwlock_unlock(&lock);
-			time2 = caa_get_cycles();
+			time2 = caa_get_cycles_ordered();
 			writer_time[(unsigned long)arg] += time2 - time1;
 			usleep(1);
 		}
@@ -169,10 +170,14 @@ int main(int argc, char **argv)
 			exit(1);
 		tot_wtime += writer_time[i];
 	}
-	printf("Time per read : %g cycles\n",
-	       (double)tot_rtime / ((double)NR_READ * (double)READ_LOOP));
-	printf("Time per write : %g cycles\n",
-	       (double)tot_wtime / ((double)NR_WRITE * (double)WRITE_LOOP));
+	printf("Time per read : %g cycles, %g ns\n",
+	       (double)tot_rtime / ((double)NR_READ * (double)READ_LOOP),
+	       (double)caa_cycles_to_ns(tot_rtime)
+			/ ((double)NR_READ * (double)READ_LOOP));
+	printf("Time per write : %g cycles, %g ns\n",
+	       (double)tot_wtime / ((double)NR_WRITE * (double)WRITE_LOOP),
+	       (double)caa_cycles_to_ns(tot_wtime)
+			/ ((double)NR_WRITE * (double)WRITE_LOOP));
 
 	free(reader_time);
 	free(writer_time);
@@ -0,0 +1,482 @@
+/*
+ * test_thread_churn.c
+ *
+ * Userspace RCU library - thread registration churn benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Thread-per-connection workload: spawner threads create short-lived
+ * threads, at a given rate or back to back, and join them. Each
+ * short-lived thread registers, runs one read-side critical section and
+ * unregisters, while a writer runs synchronize_rcu() continuously. With
+ * urcu-bp, registration is implicit in the first rcu_read_lock(), and
+ * unregistration happens at thread exit. Each flavor first runs the
+ * writer alone, to measure the grace period latency inflation caused by
+ * the churn.
+ *
+ * The registry memory is measured as the growth of the process virtual
+ * and resident sizes during the churn.
+ */
+
+#define _GNU_SOURCE
+#define _LGPL_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include <urcu/arch.h>
+#include <urcu/clock.h>
+#include <urcu-pointer.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+#include "cpuset.h"
+#include "thread-id.h"
+#include "bench.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+/* Flavor structures, as named by urcu/map/*.h. */
+extern const struct rcu_flavor_struct rcu_flavor_memb, rcu_flavor_mb,
+	rcu_flavor_sig, rcu_flavor_qsbr, rcu_flavor_bp;
+
+static const struct {
+	const char *name;
+	const struct rcu_flavor_struct *flavor;
+} flavors[] = {
+	{ "memb", &rcu_flavor_memb },
+	{ "mb", &rcu_flavor_mb },
+	{ "signal", &rcu_flavor_sig },
+	{ "qsbr", &rcu_flavor_qsbr },
+	{ "bp", &rcu_flavor_bp },
+};
+
+#define NR_FLAVORS	CAA_ARRAY_SIZE(flavors)
+
+/* Latencies measured by a spawner and the threads it created. */
+struct churn_stats {
+	struct bench_hist reg_hist;	/* registration */
+	struct bench_hist unreg_hist;	/* unregistration, except bp */
+	struct bench_hist life_hist;	/* pthread_create() to join */
+	unsigned long long nr_threads;
+};
+
+static volatile int test_go, test_stop;
+
+static const struct rcu_flavor_struct *flavor;
+
+static unsigned long duration;
+
+/* threads created per second by each spawner, 0: back to back */
+static unsigned long rate;
+
+static unsigned int nr_spawners;
+
+/* flavors selected with -f, all by default */
+static int flavor_selected[NR_FLAVORS];
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int *test_rcu_pointer;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/* Virtual and resident sizes of the process, in kB. */
+static void get_memory(unsigned long *vm_kb, unsigned long *rss_kb)
+{
+	unsigned long size = 0, resident = 0;
+	FILE *fp;
+
+	fp = fopen("/proc/self/statm", "r");
+	if (fp) {
+		if (fscanf(fp, "%lu %lu", &size, &resident) != 2)
+			size = resident = 0;
+		fclose(fp);
+	}
+	*vm_kb = size * (sysconf(_SC_PAGESIZE) / 1024);
+	*rss_kb = resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void *thr_short_lived(void *_stats)
+{
+	struct churn_stats *stats = _stats;
+	cycles_t time1, time2;
+	int *local_ptr;
+
+	time1 = caa_get_cycles();
+	flavor->register_thread();
+	if (flavor == &rcu_flavor_bp) {
+		/* Registers the thread. */
+		flavor->read_lock();
+		flavor->read_unlock();
+	}
+	time2 = caa_get_cycles();
+	bench_hist_record(&stats->reg_hist, caa_cycles_to_ns(time2 - time1));
+
+	flavor->read_lock();
+	local_ptr = rcu_dereference(test_rcu_pointer);
+	if (local_ptr)
+		assert(*local_ptr == 8);
+	flavor->read_unlock();
+
+	time1 = caa_get_cycles();
+	flavor->unregister_thread();
+	time2 = caa_get_cycles();
+	if (flavor != &rcu_flavor_bp)
+		bench_hist_record(&stats->unreg_hist,
+			caa_cycles_to_ns(time2 - time1));
+	return NULL;
+}
+
+static void *thr_spawner(void *_stats)
+{
+	struct churn_stats *stats = _stats;
+	cycles_t time1, time2;
+	uint64_t period_ns = rate ? 1000000000ULL / rate : 0, ns;
+	pthread_t tid;
+	int err;
+
+	set_affinity();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	while (!test_stop) {
+		time1 = caa_get_cycles();
+		err = pthread_create(&tid, NULL, thr_short_lived, stats);
+		if (err != 0)
+			exit(1);
+		err = pthread_join(tid, NULL);
+		if (err != 0)
+			exit(1);
+		time2 = caa_get_cycles();
+		ns = caa_cycles_to_ns(time2 - time1);
+		bench_hist_record(&stats->life_hist, ns);
+		stats->nr_threads++;
+		if (ns < period_ns)
+			usleep((period_ns - ns) / 1000);
+	}
+	return NULL;
+}
+
+static void *thr_writer(void *_hist)
+{
+	struct bench_hist *hist = _hist;
+	cycles_t time1, time2;
+	int *new, *old;
+
+	set_affinity();
+
+	flavor->register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	while (!test_stop) {
+		new = malloc(sizeof(*new));
+		assert(new);
+		*new = 8;
+		old = rcu_xchg_pointer(&test_rcu_pointer, new);
+		time1 = caa_get_cycles();
+		flavor->update_synchronize_rcu();
+		time2 = caa_get_cycles();
+		bench_hist_record(hist, caa_cycles_to_ns(time2 - time1));
+		if (old)
+			*old = 0;
+		free(old);
+	}
+
+	flavor->unregister_thread();
+	return NULL;
+}
+
+/*
+ * Run the writer with nr_threads spawners (none for the baseline), and
+ * gather their statistics in stats. Returns the growth of the process
+ * virtual and resident sizes, sampled every 100ms.
+ */
+static void run_test(unsigned int nr_threads, struct bench_hist *gp_hist,
+		struct churn_stats *stats,
+		unsigned long *vm_growth_kb, unsigned long *rss_growth_kb)
+{
+	struct churn_stats *spawner_stats;
+	unsigned long vm_base, rss_base, vm_kb, rss_kb;
+	unsigned long elapsed_ms;
+	pthread_t tid_writer, *tid_spawner;
+	unsigned int i;
+	int err;
+
+	test_rcu_pointer = malloc(sizeof(*test_rcu_pointer));
+	assert(test_rcu_pointer);
+	*test_rcu_pointer = 8;
+
+	tid_spawner = calloc(nr_threads, sizeof(*tid_spawner));
+	spawner_stats = calloc(nr_threads, sizeof(*spawner_stats));
+	assert(!nr_threads || (tid_spawner && spawner_stats));
+	memset(gp_hist, 0, sizeof(*gp_hist));
+	memset(stats, 0, sizeof(*stats));
+
+	test_go = 0;
+	test_stop = 0;
+	next_aff = 0;
+	cmm_smp_mb();
+
+	err = pthread_create(&tid_writer, NULL, thr_writer, gp_hist);
+	if (err != 0)
+		exit(1);
+	for (i = 0; i < nr_threads; i++) {
+		err = pthread_create(&tid_spawner[i], NULL, thr_spawner,
+				     &spawner_stats[i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	get_memory(&vm_base, &rss_base);
+	*vm_growth_kb = 0;
+	*rss_growth_kb = 0;
+
+	cmm_smp_mb();
+
+	bench_perf_start();
+	test_go = 1;
+
+	for (elapsed_ms = 0; elapsed_ms < duration * 1000; elapsed_ms += 100) {
+		usleep(100000);
+		get_memory(&vm_kb, &rss_kb);
+		if (vm_kb > vm_base && vm_kb - vm_base > *vm_growth_kb)
+			*vm_growth_kb = vm_kb - vm_base;
+		if (rss_kb > rss_base && rss_kb - rss_base > *rss_growth_kb)
+			*rss_growth_kb = rss_kb - rss_base;
+	}
+
+	test_stop = 1;
+	bench_perf_stop();
+
+	err = pthread_join(tid_writer, NULL);
+	if (err != 0)
+		exit(1);
+	for (i = 0; i < nr_threads; i++) {
+		err = pthread_join(tid_spawner[i], NULL);
+		if (err != 0)
+			exit(1);
+		bench_hist_merge(&stats->reg_hist, &spawner_stats[i].reg_hist);
+		bench_hist_merge(&stats->unreg_hist,
+			&spawner_stats[i].unreg_hist);
+		bench_hist_merge(&stats->life_hist,
+			&spawner_stats[i].life_hist);
+		stats->nr_threads += spawner_stats[i].nr_threads;
+	}
+
+	free(test_rcu_pointer);
+	test_rcu_pointer = NULL;
+	free(tid_spawner);
+	free(spawner_stats);
+}
+
+static void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_spawners duration (s, per test) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-f flavor] [-f flavor]... (memb, mb, signal, qsbr, bp; default all)\n");
+	printf("	[-r rate] (threads created per second by each spawner, default back to back)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("	[--format=json|csv] (machine-readable report)\n");
+	printf("	[--perf] (hardware performance counters per operation)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_hist base_gp_hist, gp_hist;
+	struct churn_stats stats;
+	unsigned long vm_kb, rss_kb;
+	uint64_t base_p50, p50;
+	int nr_selected = 0;
+	unsigned int f;
+	int err, i, a;
+
+	if (argc < 3) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_spawners);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%lu", &duration);
+	if (err != 1 || !duration) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 3; i < argc; i++) {
+		if (bench_parse_option(argv[i]))
+			continue;
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'f':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			i++;
+			for (f = 0; f < NR_FLAVORS; f++) {
+				if (!strcmp(argv[i], flavors[f].name))
+					break;
+			}
+			if (f == NR_FLAVORS) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			flavor_selected[f] = 1;
+			nr_selected++;
+			break;
+		case 'r':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rate = atol(argv[++i]);
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+	if (!nr_selected) {
+		for (f = 0; f < NR_FLAVORS; f++)
+			flavor_selected[f] = 1;
+	}
+
+	printf_verbose("running each test for %lu seconds, %u spawners.\n",
+		duration, nr_spawners);
+	printf_verbose("Thread creation rate : %lu/s per spawner.\n", rate);
+
+	for (f = 0; f < NR_FLAVORS; f++) {
+		if (!flavor_selected[f])
+			continue;
+		flavor = flavors[f].flavor;
+		printf_verbose("flavor %s, baseline\n", flavors[f].name);
+		run_test(0, &base_gp_hist, &stats, &vm_kb, &rss_kb);
+		printf_verbose("flavor %s, churn\n", flavors[f].name);
+		run_test(nr_spawners, &gp_hist, &stats, &vm_kb, &rss_kb);
+
+		base_p50 = bench_hist_percentile(&base_gp_hist, 50);
+		p50 = bench_hist_percentile(&gp_hist, 50);
+		printf("%-8s %12.0f threads/s, GP p50 %llu ns (baseline %llu ns), memory growth %lu kB virtual %lu kB resident\n",
+			flavors[f].name, (double) stats.nr_threads / duration,
+			(unsigned long long) p50,
+			(unsigned long long) base_p50, vm_kb, rss_kb);
+		bench_hist_print(&stats.reg_hist, "%-8s register",
+			flavors[f].name);
+		if (flavor != &rcu_flavor_bp)
+			bench_hist_print(&stats.unreg_hist, "%-8s unregister",
+				flavors[f].name);
+		bench_hist_print(&stats.life_hist, "%-8s thread lifetime",
+			flavors[f].name);
+		bench_hist_print(&base_gp_hist, "%-8s GP baseline",
+			flavors[f].name);
+		bench_hist_print(&gp_hist, "%-8s GP churn", flavors[f].name);
+
+		bench_report_begin(argv[0]);
+		bench_report_string("flavor", flavors[f].name);
+		bench_report_u64("duration_s", duration);
+		bench_report_u64("nr_spawners", nr_spawners);
+		bench_report_u64("rate_per_spawner", rate);
+		bench_report_double("threads_per_s",
+			(double) stats.nr_threads / duration);
+		bench_report_hist("register", &stats.reg_hist);
+		bench_report_hist("unregister", &stats.unreg_hist);
+		bench_report_hist("lifetime", &stats.life_hist);
+		bench_report_hist("gp_baseline", &base_gp_hist);
+		bench_report_hist("gp_churn", &gp_hist);
+		bench_report_double("gp_p50_inflation",
+			base_p50 ? (double) p50 / base_p50 : 0.0);
+		bench_report_u64("vm_growth_kb", vm_kb);
+		bench_report_u64("rss_growth_kb", rss_kb);
+		bench_report_perf(stats.nr_threads);
+		bench_report_end();
+	}
+	return 0;
+}
@@ -34,10 +34,12 @@
 #include <errno.h>
 
 #include <urcu/arch.h>
+#include <urcu/clock.h>
 #include <urcu/tls-compat.h>
 #include "cpuset.h"
 #include "thread-id.h"
 #include <../common/debug-yield.h>
+#include "bench.h"
 
 /* hardcoded number of CPUs */
 #define NR_CPUS 16384
@@ -47,6 +49,12 @@
 #endif
 #include <urcu.h>
 
+static const char *membarrier_mode_name[] = {
+	[RCU_MEMBARRIER_NONE] = "none",
+	[RCU_MEMBARRIER_SHARED] = "shared",
+	[RCU_MEMBARRIER_PRIVATE_EXPEDITED] = "private-expedited",
+};
+
 static volatile int test_go, test_stop;
 
 static unsigned long wdelay;
@@ -130,6 +138,17 @@ static int test_duration_read(void)
 static DEFINE_URCU_TLS(unsigned long long, nr_writes);
 static DEFINE_URCU_TLS(unsigned long long, nr_reads);
 
+/* synchronize_rcu() latency, in cycles */
+static DEFINE_URCU_TLS(unsigned long long, gp_cycles);
+static unsigned long long tot_gp_cycles;
+/* synchronize_rcu() latency histogram, in nanoseconds */
+static DEFINE_URCU_TLS(struct bench_hist, gp_hist);
+static struct bench_hist tot_gp_hist;
+/* Read-side critical section latency histogram, in nanoseconds */
+static DEFINE_URCU_TLS(struct bench_hist, read_hist);
+static struct bench_hist tot_read_hist;
+static pthread_mutex_t gp_cycles_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static unsigned int nr_readers;
 static unsigned int nr_writers;
 
@@ -160,11 +179,14 @@ void *thr_reader(void *_count)
 {
 	unsigned long long *count = _count;
 	int *local_ptr;
+	int latency = bench_latency;
+	cycles_t time1 = 0, time2;
 
 	printf_verbose("thread_begin %s, tid %lu\n",
 			"reader", urcu_get_thread_id());
 
 	set_affinity();
+	bench_place_thread(BENCH_ROLE_READER);
 
 	rcu_register_thread();
 	assert(!rcu_read_ongoing());
@@ -175,6 +197,8 @@ void *thr_reader(void *_count)
 	cmm_smp_mb();
 
 	for (;;) {
+		if (caa_unlikely(latency))
+			time1 = caa_get_cycles_ordered();
 		rcu_read_lock();
 		assert(rcu_read_ongoing());
 		local_ptr = rcu_dereference(test_rcu_pointer);
@@ -184,6 +208,11 @@ void *thr_reader(void *_count)
 		if (caa_unlikely(rduration))
 			loop_sleep(rduration);
 		rcu_read_unlock();
+		if (caa_unlikely(latency)) {
+			time2 = caa_get_cycles_ordered();
+			bench_hist_record(&URCU_TLS(read_hist),
+				caa_cycles_to_ns(time2 - time1));
+		}
 		URCU_TLS(nr_reads)++;
 		if (caa_unlikely(!test_duration_read()))
 			break;
@@ -196,6 +225,13 @@ void *thr_reader(void *_count)
 	rcu_unregister_thread();
 
 	*count = URCU_TLS(nr_reads);
+	if (latency) {
+		bench_hist_print(&URCU_TLS(read_hist),
+			"read latency, tid %lu", urcu_get_thread_id());
+		pthread_mutex_lock(&gp_cycles_mutex);
+		bench_hist_merge(&tot_read_hist, &URCU_TLS(read_hist));
+		pthread_mutex_unlock(&gp_cycles_mutex);
+	}
 	printf_verbose("thread_end %s, tid %lu\n",
 			"reader", urcu_get_thread_id());
 	return ((void*)1);
@@ -206,11 +242,13 @@ void *thr_writer(void *_count)
 {
 	unsigned long long *count = _count;
 	int *new, *old;
+	cycles_t time1, time2;
 
 	printf_verbose("thread_begin %s, tid %lu\n",
 			"writer", urcu_get_thread_id());
 
 	set_affinity();
+	bench_place_thread(BENCH_ROLE_WRITER);
 
 	while (!test_go)
 	{
@@ -224,7 +262,12 @@ void *thr_writer(void *_count)
 		old = rcu_xchg_pointer(&test_rcu_pointer, new);
 		if (caa_unlikely(wduration))
 			loop_sleep(wduration);
+		time1 = caa_get_cycles();
 		synchronize_rcu();
+		time2 = caa_get_cycles();
+		URCU_TLS(gp_cycles) += time2 - time1;
+		bench_hist_record(&URCU_TLS(gp_hist),
+			caa_cycles_to_ns(time2 - time1));
 		if (old)
 			*old = 0;
 		free(old);
@@ -238,6 +281,14 @@ void *thr_writer(void *_count)
 	printf_verbose("thread_end %s, tid %lu\n",
 			"writer", urcu_get_thread_id());
 	*count = URCU_TLS(nr_writes);
+	if (bench_latency)
+		bench_hist_print(&URCU_TLS(gp_hist),
+			"synchronize_rcu latency, tid %lu",
+			urcu_get_thread_id());
+	pthread_mutex_lock(&gp_cycles_mutex);
+	tot_gp_cycles += URCU_TLS(gp_cycles);
+	bench_hist_merge(&tot_gp_hist, &URCU_TLS(gp_hist));
+	pthread_mutex_unlock(&gp_cycles_mutex);
 	return ((void*)2);
 }
 
@@ -252,6 +303,10 @@ void show_usage(int argc, char **argv)
 	printf("	[-e duration] (writer C.S. duration (in loops))\n");
 	printf("	[-v] (verbose output)\n");
 	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("	[--format=json|csv] (machine-readable report)\n");
+	printf("	[--perf] (hardware performance counters per operation)\n");
+	printf("	[--placement=compact|scatter|remote-writers] (NUMA placement)\n");
+	printf("	[--latency] (read-side latency and per-thread percentiles)\n");
 	printf("\n");
 }
 
@@ -262,6 +317,7 @@ int main(int argc, char **argv)
 	void *tret;
 	unsigned long long *count_reader, *count_writer;
 	unsigned long long tot_reads = 0, tot_writes = 0;
+	struct rcu_gp_batch_stats gp_stats;
 	int i, a;
 
 	if (argc < 4) {
@@ -290,6 +346,8 @@ int main(int argc, char **argv)
 	for (i = 4; i < argc; i++) {
 		if (argv[i][0] != '-')
 			continue;
+		if (bench_parse_option(argv[i]))
+			continue;
 		switch (argv[i][1]) {
 		case 'r':
 			rcu_debug_yield_enable(RCU_YIELD_READ);
@@ -347,6 +405,7 @@ int main(int argc, char **argv)
 	count_writer = calloc(nr_writers, sizeof(*count_writer));
 
 	next_aff = 0;
+	bench_placement_init(nr_readers, nr_writers);
 
 	for (i = 0; i < nr_readers; i++) {
 		err = pthread_create(&tid_reader[i], NULL, thr_reader,
@@ -363,11 +422,13 @@ int main(int argc, char **argv)
 
 	cmm_smp_mb();
 
+	bench_perf_start();
 	test_go = 1;
 
 	sleep(duration);
 
 	test_stop = 1;
+	bench_perf_stop();
 
 	for (i = 0; i < nr_readers; i++) {
 		err = pthread_join(tid_reader[i], &tret);
@@ -384,12 +445,50 @@ int main(int argc, char **argv)
 	
 	printf_verbose("total number of reads : %llu, writes %llu\n", tot_reads,
 	       tot_writes);
+	rcu_gp_get_batch_stats(&gp_stats);
+	printf_verbose("grace periods : %lu, reader scans %lu, waiters %lu "
+		"(avg %.2f, max %lu per grace period)\n",
+		gp_stats.nr_gp, gp_stats.nr_reader_scans, gp_stats.nr_waiters,
+		gp_stats.nr_gp ?
+			(double) gp_stats.nr_waiters / gp_stats.nr_gp : 0.0,
+		gp_stats.max_batch_waiters);
+	printf_verbose("synchronize_rcu latency : %.1f cycles, %.1f ns "
+		"(avg over %llu writes, %u readers)\n",
+		tot_writes ? (double) tot_gp_cycles / tot_writes : 0.0,
+		tot_writes ? (double) caa_cycles_to_ns(tot_gp_cycles)
+			/ tot_writes : 0.0,
+		tot_writes, nr_readers);
+	printf_verbose("sys_membarrier : %s\n",
+		membarrier_mode_name[rcu_get_membarrier_mode()]);
+	if (bench_latency) {
+		bench_hist_print(&tot_read_hist, "read latency");
+		bench_hist_print(&tot_gp_hist, "synchronize_rcu latency");
+	}
 	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu wdur %6lu "
 		"nr_writers %3u "
 		"wdelay %6lu nr_reads %12llu nr_writes %12llu nr_ops %12llu\n",
 		argv[0], duration, nr_readers, rduration, wduration,
 		nr_writers, wdelay, tot_reads, tot_writes,
 		tot_reads + tot_writes);
+	bench_report_begin(argv[0]);
+	bench_report_u64("duration_s", duration);
+	bench_report_u64("nr_readers", nr_readers);
+	bench_report_u64("nr_writers", nr_writers);
+	bench_report_u64("rdur", rduration);
+	bench_report_u64("wdur", wduration);
+	bench_report_u64("wdelay", wdelay);
+	bench_report_string("membarrier",
+		membarrier_mode_name[rcu_get_membarrier_mode()]);
+	bench_report_u64("nr_reads", tot_reads);
+	bench_report_u64("nr_writes", tot_writes);
+	bench_report_double("reads_per_s", (double) tot_reads / duration);
+	bench_report_double("writes_per_s", (double) tot_writes / duration);
+	bench_report_hist("sync_latency", &tot_gp_hist);
+	if (bench_latency)
+		bench_report_hist("read_latency", &tot_read_hist);
+	bench_report_perf(tot_reads + tot_writes);
+	bench_report_placement();
+	bench_report_end();
 	free(test_rcu_pointer);
 	free(tid_reader);
 	free(tid_writer);
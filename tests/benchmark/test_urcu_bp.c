@@ -34,10 +34,12 @@
 #include <errno.h>
 
 #include <urcu/arch.h>
+#include <urcu/clock.h>
 #include <urcu/tls-compat.h>
 #include "cpuset.h"
 #include "thread-id.h"
 #include "../common/debug-yield.h"
+#include "bench.h"
 
 /* hardcoded number of CPUs */
 #define NR_CPUS 16384
@@ -130,6 +132,14 @@ static int test_duration_read(void)
 static DEFINE_URCU_TLS(unsigned long long, nr_writes);
 static DEFINE_URCU_TLS(unsigned long long, nr_reads);
 
+/* synchronize_rcu() latency histogram, in nanoseconds */
+static DEFINE_URCU_TLS(struct bench_hist, gp_hist);
+static struct bench_hist tot_gp_hist;
+/* Read-side critical section latency histogram, in nanoseconds */
+static DEFINE_URCU_TLS(struct bench_hist, read_hist);
+static struct bench_hist tot_read_hist;
+static pthread_mutex_t gp_hist_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static unsigned int nr_readers;
 static unsigned int nr_writers;
 
@@ -160,11 +170,14 @@ void *thr_reader(void *_count)
 {
 	unsigned long long *count = _count;
 	int *local_ptr;
+	int latency = bench_latency;
+	cycles_t time1 = 0, time2;
 
 	printf_verbose("thread_begin %s, tid %lu\n",
 			"reader", urcu_get_thread_id());
 
 	set_affinity();
+	bench_place_thread(BENCH_ROLE_READER);
 
 	rcu_register_thread();
 	assert(!rcu_read_ongoing());
@@ -175,6 +188,8 @@ void *thr_reader(void *_count)
 	cmm_smp_mb();
 
 	for (;;) {
+		if (caa_unlikely(latency))
+			time1 = caa_get_cycles_ordered();
 		rcu_read_lock();
 		assert(rcu_read_ongoing());
 		local_ptr = rcu_dereference(test_rcu_pointer);
@@ -184,6 +199,11 @@ void *thr_reader(void *_count)
 		if (caa_unlikely(rduration))
 			loop_sleep(rduration);
 		rcu_read_unlock();
+		if (caa_unlikely(latency)) {
+			time2 = caa_get_cycles_ordered();
+			bench_hist_record(&URCU_TLS(read_hist),
+				caa_cycles_to_ns(time2 - time1));
+		}
 		URCU_TLS(nr_reads)++;
 		if (caa_unlikely(!test_duration_read()))
 			break;
@@ -192,6 +212,13 @@ void *thr_reader(void *_count)
 	rcu_unregister_thread();
 
 	*count = URCU_TLS(nr_reads);
+	if (latency) {
+		bench_hist_print(&URCU_TLS(read_hist),
+			"read latency, tid %lu", urcu_get_thread_id());
+		pthread_mutex_lock(&gp_hist_mutex);
+		bench_hist_merge(&tot_read_hist, &URCU_TLS(read_hist));
+		pthread_mutex_unlock(&gp_hist_mutex);
+	}
 	printf_verbose("thread_end %s, tid %lu\n",
 			"reader", urcu_get_thread_id());
 	return ((void*)1);
@@ -202,11 +229,13 @@ void *thr_writer(void *_count)
 {
 	unsigned long long *count = _count;
 	int *new, *old;
+	cycles_t time1, time2;
 
 	printf_verbose("thread_begin %s, tid %lu\n",
 			"writer", urcu_get_thread_id());
 
 	set_affinity();
+	bench_place_thread(BENCH_ROLE_WRITER);
 
 	while (!test_go)
 	{
@@ -219,7 +248,11 @@ void *thr_writer(void *_count)
 		old = rcu_xchg_pointer(&test_rcu_pointer, new);
 		if (caa_unlikely(wduration))
 			loop_sleep(wduration);
+		time1 = caa_get_cycles();
 		synchronize_rcu();
+		time2 = caa_get_cycles();
+		bench_hist_record(&URCU_TLS(gp_hist),
+			caa_cycles_to_ns(time2 - time1));
 		if (old)
 			*old = 0;
 		free(old);
@@ -233,6 +266,13 @@ void *thr_writer(void *_count)
 	printf_verbose("thread_end %s, tid %lu\n",
 			"writer", urcu_get_thread_id());
 	*count = URCU_TLS(nr_writes);
+	if (bench_latency)
+		bench_hist_print(&URCU_TLS(gp_hist),
+			"synchronize_rcu latency, tid %lu",
+			urcu_get_thread_id());
+	pthread_mutex_lock(&gp_hist_mutex);
+	bench_hist_merge(&tot_gp_hist, &URCU_TLS(gp_hist));
+	pthread_mutex_unlock(&gp_hist_mutex);
 	return ((void*)2);
 }
 
@@ -247,6 +287,10 @@ void show_usage(int argc, char **argv)
 	printf("	[-e duration] (writer C.S. duration (in loops))\n");
 	printf("	[-v] (verbose output)\n");
 	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("	[--format=json|csv] (machine-readable report)\n");
+	printf("	[--perf] (hardware performance counters per operation)\n");
+	printf("	[--placement=compact|scatter|remote-writers] (NUMA placement)\n");
+	printf("	[--latency] (read-side latency and per-thread percentiles)\n");
 	printf("\n");
 }
 
@@ -285,6 +329,8 @@ int main(int argc, char **argv)
 	for (i = 4; i < argc; i++) {
 		if (argv[i][0] != '-')
 			continue;
+		if (bench_parse_option(argv[i]))
+			continue;
 		switch (argv[i][1]) {
 		case 'r':
 			rcu_debug_yield_enable(RCU_YIELD_READ);
@@ -342,6 +388,7 @@ int main(int argc, char **argv)
 	count_writer = calloc(nr_writers, sizeof(*count_writer));
 
 	next_aff = 0;
+	bench_placement_init(nr_readers, nr_writers);
 
 	for (i = 0; i < nr_readers; i++) {
 		err = pthread_create(&tid_reader[i], NULL, thr_reader,
@@ -358,11 +405,13 @@ int main(int argc, char **argv)
 
 	cmm_smp_mb();
 
+	bench_perf_start();
 	test_go = 1;
 
 	sleep(duration);
 
 	test_stop = 1;
+	bench_perf_stop();
 
 	for (i = 0; i < nr_readers; i++) {
 		err = pthread_join(tid_reader[i], &tret);
@@ -379,12 +428,33 @@ int main(int argc, char **argv)
 	
 	printf_verbose("total number of reads : %llu, writes %llu\n", tot_reads,
 	       tot_writes);
+	if (bench_latency) {
+		bench_hist_print(&tot_read_hist, "read latency");
+		bench_hist_print(&tot_gp_hist, "synchronize_rcu latency");
+	}
 	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu wdur %6lu "
 		"nr_writers %3u "
 		"wdelay %6lu nr_reads %12llu nr_writes %12llu nr_ops %12llu\n",
 		argv[0], duration, nr_readers, rduration, wduration,
 		nr_writers, wdelay, tot_reads, tot_writes,
 		tot_reads + tot_writes);
+	bench_report_begin(argv[0]);
+	bench_report_u64("duration_s", duration);
+	bench_report_u64("nr_readers", nr_readers);
+	bench_report_u64("nr_writers", nr_writers);
+	bench_report_u64("rdur", rduration);
+	bench_report_u64("wdur", wduration);
+	bench_report_u64("wdelay", wdelay);
+	bench_report_u64("nr_reads", tot_reads);
+	bench_report_u64("nr_writes", tot_writes);
+	bench_report_double("reads_per_s", (double) tot_reads / duration);
+	bench_report_double("writes_per_s", (double) tot_writes / duration);
+	bench_report_hist("sync_latency", &tot_gp_hist);
+	if (bench_latency)
+		bench_report_hist("read_latency", &tot_read_hist);
+	bench_report_perf(tot_reads + tot_writes);
+	bench_report_placement();
+	bench_report_end();
 	free(test_rcu_pointer);
 	free(tid_reader);
 	free(tid_writer);
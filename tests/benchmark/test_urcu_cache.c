@@ -0,0 +1,469 @@
+/*
+ * test_urcu_cache.c
+ *
+ * Userspace RCU library - RCU bounded cache test program
+ *
+ * Copyright February 2009 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/rcucache.h>
+
+static volatile int test_go, test_stop;
+
+static unsigned long wdelay;
+
+struct test {
+	unsigned long key;
+	unsigned long magic;
+	struct cds_lfht_cache_node node;
+};
+
+#define TEST_MAGIC	0x600DBEEFUL
+
+static struct cds_lfht_cache *cache;
+static unsigned long nr_keys = 65536;
+static unsigned long max_count = 16384;
+static unsigned long max_bytes;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long rduration;
+
+/* write-side C.S. duration, in loops */
+static unsigned long wduration;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_writes);
+static DEFINE_URCU_TLS(unsigned long long, nr_reads);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+static unsigned long long nr_hits, nr_bad;
+
+static unsigned long test_hash(unsigned long key)
+{
+	return key * 0x9E3779B97F4A7C15ULL;
+}
+
+static int test_match(struct cds_lfht_cache_node *node, const void *key)
+{
+	struct test *t = caa_container_of(node, struct test, node);
+
+	return t->key == *(const unsigned long *) key;
+}
+
+static void test_free(struct cds_lfht_cache_node *node)
+{
+	struct test *t = caa_container_of(node, struct test, node);
+
+	/* A reader still seeing a freed object catches the poison. */
+	t->magic = 0;
+	free(t);
+}
+
+static void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	unsigned long long hits = 0, bad = 0;
+	struct cds_lfht_cache_node *node;
+	struct test *t;
+	unsigned long key;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		key = rand_r(&seed) % nr_keys;
+		rcu_read_lock();
+		node = cds_lfht_cache_lookup(cache, test_hash(key), &key);
+		if (node) {
+			hits++;
+		} else {
+			/* Miss: fill the cache, as a lookup through it would. */
+			t = malloc(sizeof(*t));
+			assert(t);
+			t->key = key;
+			t->magic = TEST_MAGIC;
+			cds_lfht_cache_node_init(&t->node, sizeof(*t));
+			node = cds_lfht_cache_add(cache, test_hash(key), &key,
+					&t->node);
+			if (node != &t->node)
+				free(t);
+		}
+		t = caa_container_of(node, struct test, node);
+		if (t->key != key || CMM_LOAD_SHARED(t->magic) != TEST_MAGIC)
+			bad++;
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		rcu_read_unlock();
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	uatomic_add(&nr_hits, hits);
+	uatomic_add(&nr_bad, bad);
+	*count = URCU_TLS(nr_reads);
+	printf_verbose("thread_end %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+	return ((void*)1);
+
+}
+
+static void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	struct cds_lfht_cache_node *node;
+	unsigned long key;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		key = rand_r(&seed) % nr_keys;
+		rcu_read_lock();
+		node = cds_lfht_cache_lookup(cache, test_hash(key), &key);
+		if (node)
+			(void) cds_lfht_cache_del(cache, node);
+		if (caa_unlikely(wduration))
+			loop_sleep(wduration);
+		rcu_read_unlock();
+		URCU_TLS(nr_writes)++;
+		if (caa_unlikely(!test_duration_write()))
+			break;
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+	}
+
+	rcu_unregister_thread();
+
+	printf_verbose("thread_end %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+	*count = URCU_TLS(nr_writes);
+	return ((void*)2);
+}
+
+static void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-c duration] (reader C.S. duration (in loops))\n");
+	printf("	[-e duration] (writer C.S. duration (in loops))\n");
+	printf("	[-k keys] (number of keys looked up, default 65536)\n");
+	printf("	[-n count] (cache capacity in nodes, default 16384, 0 for no limit)\n");
+	printf("	[-b bytes] (cache capacity in bytes, default no limit)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader, *count_writer;
+	unsigned long long tot_reads = 0, tot_writes = 0;
+	struct cds_lfht_cache_stats stats;
+	int i, a;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'e':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wduration = atol(argv[++i]);
+			break;
+		case 'k':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_keys = atol(argv[++i]);
+			if (!nr_keys) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'n':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			max_count = atol(argv[++i]);
+			break;
+		case 'b':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			max_bytes = atol(argv[++i]);
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, %u writers.\n",
+		duration, nr_readers, nr_writers);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("Keys : %lu, capacity %lu nodes, %lu bytes.\n",
+		nr_keys, max_count, max_bytes);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	rcu_register_thread();
+	cache = cds_lfht_cache_new(max_count, max_bytes, test_match, test_free);
+	if (!cache)
+		exit(1);
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, sizeof(*count_reader));
+	count_writer = calloc(nr_writers, sizeof(*count_writer));
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	sleep(duration);
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_reads += count_reader[i];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_writes += count_writer[i];
+	}
+
+	cds_lfht_cache_get_stats(cache, &stats);
+	printf_verbose("total number of reads : %llu, writes %llu\n", tot_reads,
+	       tot_writes);
+	printf_verbose("cache : %lu nodes, %lu bytes, %lu evictions\n",
+		stats.count, stats.bytes, stats.nr_evictions);
+	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu wdur %6lu "
+		"nr_writers %3u "
+		"wdelay %6lu nr_reads %12llu nr_writes %12llu nr_ops %12llu "
+		"hit_rate %5.1f%%\n",
+		argv[0], duration, nr_readers, rduration, wduration,
+		nr_writers, wdelay, tot_reads, tot_writes,
+		tot_reads + tot_writes,
+		tot_reads ? 100.0 * nr_hits / tot_reads : 0.0);
+	if (nr_bad)
+		printf("WARNING! %llu lookups of a freed or wrong node.\n",
+			nr_bad);
+
+	err = cds_lfht_cache_destroy(cache);
+	if (err)
+		printf("WARNING! cache destroy error %d\n", err);
+	rcu_unregister_thread();
+	free(tid_reader);
+	free(tid_writer);
+	free(count_reader);
+	free(count_writer);
+	return nr_bad ? 1 : 0;
+}
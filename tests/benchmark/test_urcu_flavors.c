@@ -0,0 +1,598 @@
+/*
+ * test_urcu_flavors.c
+ *
+ * Userspace RCU library - compare the RCU flavors on identical workloads
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * All the flavors are linked into this program, and the workloads only
+ * use them through their struct rcu_flavor_struct: the code run for
+ * each flavor is the same, except for the flavor functions, which are
+ * called through function pointers rather than inlined.
+ */
+
+#define _GNU_SOURCE
+#define _LGPL_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include <urcu/arch.h>
+#include <urcu-pointer.h>
+#include <urcu/rculfhash.h>
+#include "cpuset.h"
+#include "thread-id.h"
+#include "bench.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+/* Flavor structures, as named by urcu/map/*.h. */
+extern const struct rcu_flavor_struct rcu_flavor_memb, rcu_flavor_mb,
+	rcu_flavor_sig, rcu_flavor_qsbr, rcu_flavor_bp;
+
+static const struct {
+	const char *name;
+	const struct rcu_flavor_struct *flavor;
+} flavors[] = {
+	{ "memb", &rcu_flavor_memb },
+	{ "mb", &rcu_flavor_mb },
+	{ "signal", &rcu_flavor_sig },
+	{ "qsbr", &rcu_flavor_qsbr },
+	{ "bp", &rcu_flavor_bp },
+};
+
+#define NR_FLAVORS	CAA_ARRAY_SIZE(flavors)
+
+enum workload {
+	WORKLOAD_READ,	/* readers, writers updating a pointer every delay */
+	WORKLOAD_WRITE,	/* readers, writers updating a pointer back to back */
+	WORKLOAD_HASH,	/* hash table lookups, adds and removals */
+	NR_WORKLOADS,
+};
+
+static const char *workload_name[NR_WORKLOADS] = {
+	[WORKLOAD_READ] = "read-heavy",
+	[WORKLOAD_WRITE] = "write-heavy",
+	[WORKLOAD_HASH] = "hash",
+};
+
+/* Read-side operations between quiescent states (qsbr flavor). */
+#define QS_PERIOD	1024
+
+struct test_node {
+	struct cds_lfht_node_u64 node;
+	struct rcu_head head;
+};
+
+static volatile int test_go, test_stop;
+
+static const struct rcu_flavor_struct *flavor;
+static enum workload workload;
+
+static int *test_rcu_pointer;
+static struct cds_lfht *test_ht;
+
+static unsigned long duration;
+
+/* read-heavy writer period, in us */
+static unsigned long wdelay = 1000;
+
+/* hash table key range */
+static unsigned long nr_keys = 65536;
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+/* flavors selected with -f, all by default */
+static int flavor_selected[NR_FLAVORS];
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+static unsigned long test_hash(uint64_t key)
+{
+	/* Fibonacci hashing: spreads consecutive keys over the table. */
+	return (unsigned long) (key * 0x9E3779B97F4A7C15ULL);
+}
+
+static void free_node_cb(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct test_node, head));
+}
+
+static void test_read(unsigned int *seed)
+{
+	struct cds_lfht_iter iter;
+	int *local_ptr;
+	uint64_t key;
+
+	flavor->read_lock();
+	if (workload == WORKLOAD_HASH) {
+		key = rand_r(seed) % nr_keys;
+		cds_lfht_lookup_u64(test_ht, test_hash(key), key, &iter);
+	} else {
+		local_ptr = rcu_dereference(test_rcu_pointer);
+		if (local_ptr)
+			assert(*local_ptr == 8);
+	}
+	flavor->read_unlock();
+}
+
+static void test_update_pointer(void)
+{
+	int *new, *old;
+
+	new = malloc(sizeof(*new));
+	assert(new);
+	*new = 8;
+	old = rcu_xchg_pointer(&test_rcu_pointer, new);
+	flavor->update_synchronize_rcu();
+	if (old)
+		*old = 0;
+	free(old);
+}
+
+/* Remove the key if present, add it otherwise. */
+static void test_update_hash(unsigned int *seed)
+{
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *ht_node;
+	struct test_node *node;
+	uint64_t key;
+
+	key = rand_r(seed) % nr_keys;
+	flavor->read_lock();
+	cds_lfht_lookup_u64(test_ht, test_hash(key), key, &iter);
+	ht_node = cds_lfht_iter_get_node(&iter);
+	if (ht_node) {
+		if (!cds_lfht_del(test_ht, ht_node)) {
+			node = caa_container_of(ht_node, struct test_node,
+					node.node);
+			flavor->update_call_rcu(&node->head, free_node_cb);
+		}
+	} else {
+		node = malloc(sizeof(*node));
+		assert(node);
+		cds_lfht_node_init(&node->node.node);
+		node->node.key = key;
+		ht_node = cds_lfht_add_unique_u64(test_ht, test_hash(key),
+				&node->node);
+		if (ht_node != &node->node.node)
+			free(node);
+	}
+	flavor->read_unlock();
+}
+
+static void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned long long nr_reads = 0;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+
+	set_affinity();
+
+	flavor->register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		test_read(&seed);
+		nr_reads++;
+		if (caa_unlikely((nr_reads & (QS_PERIOD - 1)) == 0)) {
+			flavor->read_quiescent_state();
+			if (caa_unlikely(test_stop))
+				break;
+		}
+	}
+
+	flavor->unregister_thread();
+
+	*count = nr_reads;
+	return ((void*)1);
+}
+
+static void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned long long nr_writes = 0;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+
+	set_affinity();
+
+	flavor->register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		if (workload == WORKLOAD_HASH)
+			test_update_hash(&seed);
+		else
+			test_update_pointer();
+		nr_writes++;
+		if (caa_unlikely(test_stop))
+			break;
+		if (workload == WORKLOAD_READ && wdelay) {
+			/* Do not hold back qsbr grace periods while idle. */
+			flavor->thread_offline();
+			usleep(wdelay);
+			flavor->thread_online();
+		} else if (workload == WORKLOAD_HASH
+				&& (nr_writes & (QS_PERIOD - 1)) == 0) {
+			flavor->read_quiescent_state();
+		}
+	}
+
+	flavor->unregister_thread();
+
+	*count = nr_writes;
+	return ((void*)2);
+}
+
+static void test_setup(void)
+{
+	struct test_node *node;
+	unsigned long i;
+
+	if (workload != WORKLOAD_HASH) {
+		test_rcu_pointer = malloc(sizeof(*test_rcu_pointer));
+		assert(test_rcu_pointer);
+		*test_rcu_pointer = 8;
+		return;
+	}
+	test_ht = _cds_lfht_new(1024, 1, 0,
+			CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING,
+			NULL, flavor, NULL);
+	if (!test_ht) {
+		fprintf(stderr, "Error allocating hash table\n");
+		exit(1);
+	}
+	/* Half of the keys are present. */
+	flavor->register_thread();
+	flavor->read_lock();
+	for (i = 0; i < nr_keys; i += 2) {
+		node = malloc(sizeof(*node));
+		assert(node);
+		cds_lfht_node_init(&node->node.node);
+		node->node.key = i;
+		(void) cds_lfht_add_unique_u64(test_ht, test_hash(i),
+				&node->node);
+	}
+	flavor->read_unlock();
+	flavor->unregister_thread();
+}
+
+static void test_teardown(void)
+{
+	struct cds_lfht_iter iter;
+	struct test_node *node;
+	int ret;
+
+	if (workload != WORKLOAD_HASH) {
+		free(test_rcu_pointer);
+		test_rcu_pointer = NULL;
+		return;
+	}
+	flavor->register_thread();
+	flavor->read_lock();
+	cds_lfht_for_each_entry(test_ht, &iter, node, node.node) {
+		ret = cds_lfht_del(test_ht, &node->node.node);
+		assert(!ret);
+		flavor->update_call_rcu(&node->head, free_node_cb);
+	}
+	flavor->read_unlock();
+	flavor->unregister_thread();
+	flavor->barrier();
+	ret = cds_lfht_destroy(test_ht, NULL);
+	if (ret) {
+		fprintf(stderr, "Error destroying hash table\n");
+		exit(1);
+	}
+	test_ht = NULL;
+}
+
+/* Run the current workload with the current flavor. */
+static void run_test(unsigned long long *tot_reads,
+		unsigned long long *tot_writes)
+{
+	pthread_t *tid_reader, *tid_writer;
+	unsigned long long *count_reader, *count_writer;
+	void *tret;
+	unsigned int i;
+	int err;
+
+	test_setup();
+
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, sizeof(*count_reader));
+	count_writer = calloc(nr_writers, sizeof(*count_writer));
+
+	test_go = 0;
+	test_stop = 0;
+	next_aff = 0;
+	cmm_smp_mb();
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	bench_perf_start();
+	test_go = 1;
+
+	sleep(duration);
+
+	test_stop = 1;
+	bench_perf_stop();
+
+	*tot_reads = 0;
+	*tot_writes = 0;
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		*tot_reads += count_reader[i];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		*tot_writes += count_writer[i];
+	}
+
+	test_teardown();
+
+	free(tid_reader);
+	free(tid_writer);
+	free(count_reader);
+	free(count_writer);
+}
+
+static void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s, per test) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-f flavor] [-f flavor]... (memb, mb, signal, qsbr, bp; default all)\n");
+	printf("	[-d delay] (read-heavy writer period (us), default 1000)\n");
+	printf("	[-k nr_keys] (hash table key range, default 65536)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("	[--format=json|csv] (machine-readable report)\n");
+	printf("	[--perf] (hardware performance counters per operation)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long reads[NR_FLAVORS][NR_WORKLOADS];
+	unsigned long long writes[NR_FLAVORS][NR_WORKLOADS];
+	int nr_selected = 0;
+	unsigned int f, w;
+	int err, i, a;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1 || !duration) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (bench_parse_option(argv[i]))
+			continue;
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'f':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			i++;
+			for (f = 0; f < NR_FLAVORS; f++) {
+				if (!strcmp(argv[i], flavors[f].name))
+					break;
+			}
+			if (f == NR_FLAVORS) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			flavor_selected[f] = 1;
+			nr_selected++;
+			break;
+		case 'k':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_keys = atol(argv[++i]);
+			if (!nr_keys) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+	if (!nr_selected) {
+		for (f = 0; f < NR_FLAVORS; f++)
+			flavor_selected[f] = 1;
+	}
+
+	printf_verbose("running each test for %lu seconds, %u readers, %u writers.\n",
+		duration, nr_readers, nr_writers);
+	printf_verbose("Read-heavy writer delay : %lu us.\n", wdelay);
+	printf_verbose("Hash table keys : %lu.\n", nr_keys);
+
+	for (f = 0; f < NR_FLAVORS; f++) {
+		if (!flavor_selected[f])
+			continue;
+		flavor = flavors[f].flavor;
+		for (w = 0; w < NR_WORKLOADS; w++) {
+			workload = w;
+			printf_verbose("flavor %s, workload %s\n",
+				flavors[f].name, workload_name[w]);
+			run_test(&reads[f][w], &writes[f][w]);
+			bench_perf_print(reads[f][w] + writes[f][w],
+				"%-8s %s perf", flavors[f].name,
+				workload_name[w]);
+		}
+	}
+
+	printf("%-8s", "flavor");
+	for (w = 0; w < NR_WORKLOADS; w++)
+		printf(" %25s", workload_name[w]);
+	printf("\n%-8s", "");
+	for (w = 0; w < NR_WORKLOADS; w++)
+		printf(" %12s %12s", "reads/s", "updates/s");
+	printf("\n");
+	for (f = 0; f < NR_FLAVORS; f++) {
+		if (!flavor_selected[f])
+			continue;
+		printf("%-8s", flavors[f].name);
+		for (w = 0; w < NR_WORKLOADS; w++)
+			printf(" %12.0f %12.0f",
+				(double) reads[f][w] / duration,
+				(double) writes[f][w] / duration);
+		printf("\n");
+	}
+
+	for (f = 0; f < NR_FLAVORS; f++) {
+		if (!flavor_selected[f])
+			continue;
+		bench_report_begin(argv[0]);
+		bench_report_string("flavor", flavors[f].name);
+		bench_report_u64("duration_s", duration);
+		bench_report_u64("nr_readers", nr_readers);
+		bench_report_u64("nr_writers", nr_writers);
+		bench_report_double("read_heavy_reads_per_s",
+			(double) reads[f][WORKLOAD_READ] / duration);
+		bench_report_double("read_heavy_updates_per_s",
+			(double) writes[f][WORKLOAD_READ] / duration);
+		bench_report_double("write_heavy_reads_per_s",
+			(double) reads[f][WORKLOAD_WRITE] / duration);
+		bench_report_double("write_heavy_updates_per_s",
+			(double) writes[f][WORKLOAD_WRITE] / duration);
+		bench_report_double("hash_lookups_per_s",
+			(double) reads[f][WORKLOAD_HASH] / duration);
+		bench_report_double("hash_updates_per_s",
+			(double) writes[f][WORKLOAD_HASH] / duration);
+		bench_report_end();
+	}
+	return 0;
+}
@@ -0,0 +1,532 @@
+/*
+ * test_urcu_freelist.c
+ *
+ * Userspace RCU library - example magazine free list
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include <urcu/uatomic.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu/wfcqueue.h>
+#include <urcu/freelist.h>
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, ## args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_get(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_put(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_gets);
+static DEFINE_URCU_TLS(unsigned long long, nr_successful_gets);
+static DEFINE_URCU_TLS(unsigned long long, nr_local_puts);
+static DEFINE_URCU_TLS(unsigned long long, nr_puts);
+static DEFINE_URCU_TLS(unsigned long long, nr_successful_puts);
+
+static unsigned int nr_getters;
+static unsigned int nr_putters;
+
+static unsigned long nr_objs = 65536;
+static unsigned int magazine_size;
+/* Out of 8 objects got, those put back by the getter itself. */
+static unsigned int local_put = 2;
+
+enum obj_state {
+	OBJ_FREE,	/* in the free list */
+	OBJ_USED,	/* handed out by cds_freelist_get() */
+	OBJ_DESTROYED,	/* returned by cds_freelist_destroy() */
+};
+
+struct test_obj {
+	struct cds_wfcq_node node;	/* handoff to the putters */
+	int state;
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+static struct test_obj *objs;
+static struct cds_freelist *fl;
+
+/* Objects got by the getters, to be put back by the putters. */
+static struct cds_wfcq_head __attribute__((aligned(CAA_CACHE_LINE_SIZE))) head;
+static struct cds_wfcq_tail __attribute__((aligned(CAA_CACHE_LINE_SIZE))) tail;
+
+/* Objects found in an unexpected state, put failures. */
+static unsigned long nr_errors, nr_put_enomem;
+
+static
+void set_state(struct test_obj *obj, int old, int new)
+{
+	if (uatomic_cmpxchg(&obj->state, old, new) != old) {
+		if (!uatomic_read(&nr_errors))
+			printf("[ERROR] object %lu in state %d, %d expected\n",
+				(unsigned long) (obj - objs),
+				uatomic_read(&obj->state), old);
+		uatomic_inc(&nr_errors);
+	}
+}
+
+static
+int put_obj(struct test_obj *obj)
+{
+	set_state(obj, OBJ_USED, OBJ_FREE);
+	if (cds_freelist_put(fl, obj)) {
+		set_state(obj, OBJ_FREE, OBJ_USED);
+		uatomic_inc(&nr_put_enomem);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void *thr_getter(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	struct test_obj *obj;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"getter", urcu_get_thread_id());
+
+	set_affinity();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		obj = cds_freelist_get(fl);
+		URCU_TLS(nr_gets)++;
+		if (!obj)
+			goto next;
+		set_state(obj, OBJ_FREE, OBJ_USED);
+		URCU_TLS(nr_successful_gets)++;
+		if ((rand_r(&seed) & 7) < local_put && !put_obj(obj)) {
+			URCU_TLS(nr_local_puts)++;
+		} else {
+			cds_wfcq_node_init(&obj->node);
+			cds_wfcq_enqueue(&head, &tail, &obj->node);
+		}
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+next:
+		if (caa_unlikely(!test_duration_get()))
+			break;
+	}
+
+	count[0] = URCU_TLS(nr_gets);
+	count[1] = URCU_TLS(nr_successful_gets);
+	count[2] = URCU_TLS(nr_local_puts);
+	printf_verbose("getter thread_end, tid %lu, "
+			"gets %llu, successful_gets %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_gets), URCU_TLS(nr_successful_gets));
+	/* The magazines of the thread are flushed to the depot on exit. */
+	return ((void*)1);
+}
+
+static void *thr_putter(void *_count)
+{
+	unsigned long long *count = _count;
+	struct cds_wfcq_node *node;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"putter", urcu_get_thread_id());
+
+	set_affinity();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		node = cds_wfcq_dequeue_blocking(&head, &tail);
+		URCU_TLS(nr_puts)++;
+		if (node) {
+			struct test_obj *obj = caa_container_of(node,
+					struct test_obj, node);
+
+			if (!put_obj(obj)) {
+				URCU_TLS(nr_successful_puts)++;
+			} else {
+				cds_wfcq_node_init(&obj->node);
+				cds_wfcq_enqueue(&head, &tail, &obj->node);
+			}
+		}
+		if (caa_unlikely(!test_duration_put()))
+			break;
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+	}
+
+	count[0] = URCU_TLS(nr_puts);
+	count[1] = URCU_TLS(nr_successful_puts);
+	printf_verbose("putter thread_end, tid %lu, "
+			"puts %llu, successful_puts %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_puts), URCU_TLS(nr_successful_puts));
+	return ((void*)2);
+}
+
+/* Put back the objects left in the handoff queue. */
+static void test_end(unsigned long long *nr_end)
+{
+	struct cds_wfcq_node *node;
+
+	while ((node = cds_wfcq_dequeue_blocking(&head, &tail)) != NULL) {
+		if (put_obj(caa_container_of(node, struct test_obj, node)))
+			exit(1);
+		(*nr_end)++;
+	}
+}
+
+static void destroy_obj(void *_obj, void *priv)
+{
+	struct test_obj *obj = _obj;
+
+	set_state(obj, OBJ_FREE, OBJ_DESTROYED);
+	(*(unsigned long *) priv)++;
+}
+
+static void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_getters nr_putters duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (getter period (in loops))\n");
+	printf("	[-c duration] (putter period (in loops))\n");
+	printf("	[-n objects] (number of objects, default 65536)\n");
+	printf("	[-m size] (objects per magazine)\n");
+	printf("	[-l n] (getters put back n objects out of 8, default 2)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_getter, *tid_putter;
+	void *tret;
+	unsigned long long *count_getter, *count_putter;
+	unsigned long long tot_gets = 0, tot_successful_gets = 0,
+		tot_local_puts = 0;
+	unsigned long long tot_puts = 0, tot_successful_puts = 0;
+	unsigned long long end_puts = 0;
+	struct cds_freelist_stats stats;
+	unsigned long n, nr_destroyed = 0;
+	int i, a, retval = 0;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_getters);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_putters);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'n':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_objs = atol(argv[++i]);
+			break;
+		case 'm':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			magazine_size = atoi(argv[++i]);
+			break;
+		case 'l':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			local_put = atoi(argv[++i]);
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u getters, "
+		       "%u putters, %lu objects.\n",
+		       duration, nr_getters, nr_putters, nr_objs);
+	printf_verbose("Getter delay : %lu loops.\n", wdelay);
+	printf_verbose("Putter delay : %lu loops.\n", rduration);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	tid_getter = calloc(nr_getters, sizeof(*tid_getter));
+	tid_putter = calloc(nr_putters, sizeof(*tid_putter));
+	count_getter = calloc(nr_getters, 3 * sizeof(*count_getter));
+	count_putter = calloc(nr_putters, 2 * sizeof(*count_putter));
+	err = posix_memalign((void **) &objs, CAA_CACHE_LINE_SIZE,
+			(nr_objs ? nr_objs : 1) * sizeof(*objs));
+	if (err)
+		exit(1);
+
+	cds_wfcq_init(&head, &tail);
+	fl = cds_freelist_create(magazine_size);
+	if (!fl)
+		exit(1);
+	for (n = 0; n < nr_objs; n++) {
+		objs[n].state = OBJ_USED;
+		if (put_obj(&objs[n]))
+			exit(1);
+	}
+	/* Hand the objects cached by main over to the depot. */
+	cds_freelist_flush(fl);
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_getters; i++) {
+		err = pthread_create(&tid_getter[i], NULL, thr_getter,
+				     &count_getter[3 * i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_putters; i++) {
+		err = pthread_create(&tid_putter[i], NULL, thr_putter,
+				     &count_putter[2 * i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_getters; i++) {
+		err = pthread_join(tid_getter[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_gets += count_getter[3 * i];
+		tot_successful_gets += count_getter[3 * i + 1];
+		tot_local_puts += count_getter[3 * i + 2];
+	}
+	for (i = 0; i < nr_putters; i++) {
+		err = pthread_join(tid_putter[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_puts += count_putter[2 * i];
+		tot_successful_puts += count_putter[2 * i + 1];
+	}
+
+	test_end(&end_puts);
+	cds_freelist_get_stats(fl, &stats);
+	/* Every object must come back exactly once. */
+	cds_freelist_destroy(fl, destroy_obj, &nr_destroyed);
+	for (n = 0; n < nr_objs; n++) {
+		if (objs[n].state != OBJ_DESTROYED) {
+			printf("WARNING! Object %lu lost, in state %d.\n",
+			       n, objs[n].state);
+			retval = 1;
+			break;
+		}
+	}
+
+	printf_verbose("total number of gets : %llu, puts %llu\n",
+		       tot_gets, tot_puts);
+	printf_verbose("depot : %lu full, %lu empty, %lu magazines, "
+		       "%lu gets, %lu puts, %lu misses\n",
+		       stats.nr_full, stats.nr_empty, stats.nr_magazines,
+		       stats.nr_depot_get, stats.nr_depot_put,
+		       stats.nr_depot_miss);
+	printf("SUMMARY %-25s testdur %4lu nr_getters %3u wdelay %6lu "
+		"nr_putters %3u rdur %6lu nr_objs %lu "
+		"nr_gets %12llu nr_puts %12llu "
+		"successful gets %12llu successful puts %12llu "
+		"local puts %12llu end_puts %llu nr_destroyed %lu "
+		"nr_ops %12llu\n",
+		argv[0], duration, nr_getters, wdelay,
+		nr_putters, rduration, nr_objs,
+		tot_gets, tot_puts,
+		tot_successful_gets, tot_successful_puts,
+		tot_local_puts, end_puts, nr_destroyed,
+		tot_gets + tot_puts);
+	if (tot_successful_gets
+			!= tot_local_puts + tot_successful_puts + end_puts) {
+		printf("WARNING! Discrepancy between nr succ. gets %llu vs "
+		       "local + succ. puts + end puts %llu.\n",
+		       tot_successful_gets,
+		       tot_local_puts + tot_successful_puts + end_puts);
+		retval = 1;
+	}
+	if (nr_destroyed != nr_objs) {
+		printf("WARNING! %lu objects destroyed, %lu created.\n",
+		       nr_destroyed, nr_objs);
+		retval = 1;
+	}
+	if (nr_errors) {
+		printf("WARNING! %lu objects in an unexpected state.\n",
+		       nr_errors);
+		retval = 1;
+	}
+	if (nr_put_enomem)
+		printf("WARNING! %lu puts out of memory.\n", nr_put_enomem);
+	free(objs);
+	free(count_getter);
+	free(count_putter);
+	free(tid_getter);
+	free(tid_putter);
+	return retval;
+}
@@ -0,0 +1,657 @@
+/*
+ * test_urcu_gp_latency.c
+ *
+ * Userspace RCU library - grace period latency under adversarial readers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * A writer measures the latency of synchronize_rcu() (or of
+ * synchronize_rcu_expedited() with -e), and the time from call_rcu() to
+ * the invocation of the callback, while the readers follow one of the
+ * reader behavior profiles below. Each selected profile is run with
+ * each selected flavor, through its struct rcu_flavor_struct.
+ *
+ * uniform: short read-side critical sections, with a quiescent state
+ *          every QS_PERIOD of them (qsbr), as test_urcu_flavors. This
+ *          is the baseline of the other profiles.
+ * nested:  critical sections nested -n deep, held for -l us.
+ * migrate: the reader moves to the next CPU it is allowed on in the
+ *          middle of each critical section: with the percpu flavor,
+ *          its unlock is counted on another CPU than its lock.
+ * offline: qsbr-style idle churn: the reader goes offline and back
+ *          online around each critical section.
+ * mixed:   reader i follows the profile i modulo 4 of the above.
+ */
+
+#define _GNU_SOURCE
+#define _LGPL_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sched.h>
+
+#include <urcu/arch.h>
+#include <urcu/clock.h>
+#include <urcu-pointer.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+#include "cpuset.h"
+#include "thread-id.h"
+#include "bench.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+/* Read-side operations between quiescent states (qsbr flavor). */
+#define QS_PERIOD	1024
+
+/* Flavor structures, as named by urcu/map/*.h. */
+extern const struct rcu_flavor_struct rcu_flavor_memb, rcu_flavor_mb,
+	rcu_flavor_sig, rcu_flavor_qsbr, rcu_flavor_bp, rcu_flavor_percpu;
+
+static const struct {
+	const char *name;
+	const struct rcu_flavor_struct *flavor;
+} flavors[] = {
+	{ "memb", &rcu_flavor_memb },
+	{ "mb", &rcu_flavor_mb },
+	{ "signal", &rcu_flavor_sig },
+	{ "qsbr", &rcu_flavor_qsbr },
+	{ "bp", &rcu_flavor_bp },
+	{ "percpu", &rcu_flavor_percpu },
+};
+
+#define NR_FLAVORS	CAA_ARRAY_SIZE(flavors)
+
+enum profile {
+	PROFILE_UNIFORM = 0,
+	PROFILE_NESTED,
+	PROFILE_MIGRATE,
+	PROFILE_OFFLINE,
+	PROFILE_MIXED,
+	NR_PROFILES,
+};
+
+/* Profiles followed by a single reader, mixed excluded. */
+#define NR_READER_PROFILES	PROFILE_MIXED
+
+static const char *profile_name[NR_PROFILES] = {
+	[PROFILE_UNIFORM] = "uniform",
+	[PROFILE_NESTED] = "nested",
+	[PROFILE_MIGRATE] = "migrate",
+	[PROFILE_OFFLINE] = "offline",
+	[PROFILE_MIXED] = "mixed",
+};
+
+struct test_data {
+	int a;
+	uint64_t queued_ns;	/* call_rcu() time */
+	struct rcu_head head;
+};
+
+struct reader_args {
+	unsigned int index;
+	unsigned long long nr_reads;
+};
+
+struct writer_stats {
+	unsigned long long nr_writes;
+	struct bench_hist gp_hist;	/* synchronize_rcu() latency */
+};
+
+static volatile int test_go, test_stop;
+
+static const struct rcu_flavor_struct *flavor;
+static enum profile profile;
+
+static unsigned long duration;
+
+static unsigned int nr_readers;
+
+/* nesting depth and duration of the nested profile critical sections */
+static unsigned int nest_depth = 8;
+static unsigned long nest_us = 100;
+
+/* delay between updates, in us */
+static unsigned long wdelay;
+
+static int use_expedited;
+
+/* flavors and profiles selected with -f and -p, all by default */
+static int flavor_selected[NR_FLAVORS];
+static int profile_selected[NR_PROFILES];
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* CPUs the process may run on, visited in turn by the migrate profile. */
+static unsigned int migrate_cpus[NR_CPUS];
+static unsigned int nr_migrate_cpus;
+
+static struct test_data *test_rcu_pointer;
+
+/* call_rcu() latency, recorded by the callbacks. */
+static struct bench_hist call_rcu_hist;
+static pthread_mutex_t call_rcu_hist_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+static void get_migrate_cpus(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	unsigned int cpu;
+	int ret;
+
+	CPU_ZERO(&mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	ret = sched_getaffinity(0, &mask);
+#else
+	ret = sched_getaffinity(0, sizeof(mask), &mask);
+#endif
+	if (ret)
+		return;
+	for (cpu = 0; cpu < CPU_SETSIZE && nr_migrate_cpus < NR_CPUS; cpu++) {
+		if (CPU_ISSET(cpu, &mask))
+			migrate_cpus[nr_migrate_cpus++] = cpu;
+	}
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/* Move the calling thread to the CPU following *pos in migrate_cpus. */
+static void migrate(unsigned int *pos)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+
+	if (nr_migrate_cpus < 2)
+		return;
+	*pos = (*pos + 1) % nr_migrate_cpus;
+	CPU_ZERO(&mask);
+	CPU_SET(migrate_cpus[*pos], &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+static void test_read(void)
+{
+	struct test_data *local_ptr;
+
+	local_ptr = rcu_dereference(test_rcu_pointer);
+	if (local_ptr)
+		assert(local_ptr->a == 8);
+}
+
+/* Busy-wait for nest_us within the read-side critical section. */
+static void test_read_long(void)
+{
+	cycles_t start = caa_get_cycles();
+
+	do {
+		test_read();
+		caa_cpu_relax();
+	} while (caa_cycles_to_ns(caa_get_cycles() - start)
+			< nest_us * 1000ULL);
+}
+
+static void *thr_reader(void *_args)
+{
+	struct reader_args *args = _args;
+	unsigned long long nr_reads = 0;
+	enum profile p = profile;
+	unsigned int i, cpu_pos = args->index;
+
+	if (p == PROFILE_MIXED)
+		p = args->index % NR_READER_PROFILES;
+
+	set_affinity();
+
+	flavor->register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		switch (p) {
+		case PROFILE_UNIFORM:
+			flavor->read_lock();
+			test_read();
+			flavor->read_unlock();
+			break;
+		case PROFILE_NESTED:
+			for (i = 0; i < nest_depth; i++)
+				flavor->read_lock();
+			test_read_long();
+			for (i = 0; i < nest_depth; i++)
+				flavor->read_unlock();
+			break;
+		case PROFILE_MIGRATE:
+			flavor->read_lock();
+			test_read();
+			migrate(&cpu_pos);
+			test_read();
+			flavor->read_unlock();
+			break;
+		case PROFILE_OFFLINE:
+			flavor->thread_offline();
+			flavor->thread_online();
+			flavor->read_lock();
+			test_read();
+			flavor->read_unlock();
+			break;
+		default:
+			abort();
+		}
+		nr_reads++;
+		/* Long sections are rare enough for one state each. */
+		if (p != PROFILE_UNIFORM
+				|| caa_unlikely((nr_reads & (QS_PERIOD - 1)) == 0)) {
+			flavor->read_quiescent_state();
+			if (caa_unlikely(test_stop))
+				break;
+		}
+	}
+
+	flavor->unregister_thread();
+
+	args->nr_reads = nr_reads;
+	return ((void*)1);
+}
+
+static void free_node_cb(struct rcu_head *head)
+{
+	struct test_data *node =
+		caa_container_of(head, struct test_data, head);
+	uint64_t ns = caa_clock_ns() - node->queued_ns;
+	int ret;
+
+	ret = pthread_mutex_lock(&call_rcu_hist_mutex);
+	if (ret)
+		abort();
+	bench_hist_record(&call_rcu_hist, ns);
+	ret = pthread_mutex_unlock(&call_rcu_hist_mutex);
+	if (ret)
+		abort();
+	node->a = 0;
+	free(node);
+}
+
+static struct test_data *test_update(void)
+{
+	struct test_data *new;
+
+	new = malloc(sizeof(*new));
+	assert(new);
+	new->a = 8;
+	return rcu_xchg_pointer(&test_rcu_pointer, new);
+}
+
+static void *thr_writer(void *_stats)
+{
+	struct writer_stats *stats = _stats;
+	unsigned long long nr_writes = 0;
+	struct test_data *old;
+	cycles_t time1, time2;
+
+	set_affinity();
+
+	flavor->register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	while (!test_stop) {
+		/* synchronize_rcu() latency. */
+		old = test_update();
+		time1 = caa_get_cycles();
+		if (use_expedited && flavor->update_synchronize_rcu_expedited)
+			flavor->update_synchronize_rcu_expedited();
+		else
+			flavor->update_synchronize_rcu();
+		time2 = caa_get_cycles();
+		bench_hist_record(&stats->gp_hist,
+			caa_cycles_to_ns(time2 - time1));
+		if (old)
+			old->a = 0;
+		free(old);
+
+		/* call_rcu() latency, recorded by the callback. */
+		old = test_update();
+		if (old) {
+			old->queued_ns = caa_clock_ns();
+			flavor->update_call_rcu(&old->head, free_node_cb);
+		}
+		nr_writes += 2;
+		if (wdelay) {
+			/* Do not hold back qsbr grace periods while idle. */
+			flavor->thread_offline();
+			usleep(wdelay);
+			flavor->thread_online();
+		}
+	}
+	/* Wait for the callbacks to record their latency. */
+	flavor->barrier();
+
+	flavor->unregister_thread();
+
+	stats->nr_writes = nr_writes;
+	return ((void*)2);
+}
+
+static void run_test(struct writer_stats *wstats,
+		unsigned long long *nr_reads)
+{
+	struct reader_args *rargs;
+	pthread_t tid_writer, *tid_reader;
+	unsigned int i;
+	int err;
+
+	test_rcu_pointer = malloc(sizeof(*test_rcu_pointer));
+	assert(test_rcu_pointer);
+	test_rcu_pointer->a = 8;
+
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	rargs = calloc(nr_readers, sizeof(*rargs));
+	assert(!nr_readers || (tid_reader && rargs));
+	memset(wstats, 0, sizeof(*wstats));
+	memset(&call_rcu_hist, 0, sizeof(call_rcu_hist));
+	*nr_reads = 0;
+
+	test_go = 0;
+	test_stop = 0;
+	next_aff = 0;
+	cmm_smp_mb();
+
+	for (i = 0; i < nr_readers; i++) {
+		rargs[i].index = i;
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &rargs[i]);
+		if (err != 0)
+			exit(1);
+	}
+	err = pthread_create(&tid_writer, NULL, thr_writer, wstats);
+	if (err != 0)
+		exit(1);
+
+	cmm_smp_mb();
+
+	bench_perf_start();
+	test_go = 1;
+
+	sleep(duration);
+
+	test_stop = 1;
+	bench_perf_stop();
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], NULL);
+		if (err != 0)
+			exit(1);
+		*nr_reads += rargs[i].nr_reads;
+	}
+	err = pthread_join(tid_writer, NULL);
+	if (err != 0)
+		exit(1);
+
+	free(test_rcu_pointer);
+	test_rcu_pointer = NULL;
+	free(tid_reader);
+	free(rargs);
+}
+
+static void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers duration (s, per test) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-f flavor] [-f flavor]... (memb, mb, signal, qsbr, bp, percpu; default all)\n");
+	printf("	[-p profile] [-p profile]... (uniform, nested, migrate, offline, mixed; default all)\n");
+	printf("	[-n depth] (nested profile nesting depth, default 8)\n");
+	printf("	[-l us] (nested profile critical section duration, default 100)\n");
+	printf("	[-d delay] (writer period (us))\n");
+	printf("	[-e] (use synchronize_rcu_expedited())\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("	[--format=json|csv] (machine-readable report)\n");
+	printf("	[--perf] (hardware performance counters per operation)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct writer_stats wstats;
+	unsigned long long nr_reads;
+	int nr_flavors = 0, nr_profiles = 0;
+	unsigned int f, p;
+	int err, i, a;
+
+	if (argc < 3) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%lu", &duration);
+	if (err != 1 || !duration) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 3; i < argc; i++) {
+		if (bench_parse_option(argv[i]))
+			continue;
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'f':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			i++;
+			for (f = 0; f < NR_FLAVORS; f++) {
+				if (!strcmp(argv[i], flavors[f].name))
+					break;
+			}
+			if (f == NR_FLAVORS) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			flavor_selected[f] = 1;
+			nr_flavors++;
+			break;
+		case 'p':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			i++;
+			for (p = 0; p < NR_PROFILES; p++) {
+				if (!strcmp(argv[i], profile_name[p]))
+					break;
+			}
+			if (p == NR_PROFILES) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			profile_selected[p] = 1;
+			nr_profiles++;
+			break;
+		case 'n':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nest_depth = atoi(argv[++i]);
+			if (!nest_depth) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'l':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nest_us = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'e':
+			use_expedited = 1;
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+	if (!nr_flavors) {
+		for (f = 0; f < NR_FLAVORS; f++)
+			flavor_selected[f] = 1;
+	}
+	if (!nr_profiles) {
+		for (p = 0; p < NR_PROFILES; p++)
+			profile_selected[p] = 1;
+	}
+
+	get_migrate_cpus();
+
+	printf_verbose("running each test for %lu seconds, %u readers.\n",
+		duration, nr_readers);
+	printf_verbose("nested: depth %u, %lu us. migrate: %u CPUs.\n",
+		nest_depth, nest_us, nr_migrate_cpus);
+	printf_verbose("Writer delay : %lu us, %s grace periods.\n",
+		wdelay, use_expedited ? "expedited" : "normal");
+
+	for (f = 0; f < NR_FLAVORS; f++) {
+		if (!flavor_selected[f])
+			continue;
+		flavor = flavors[f].flavor;
+		for (p = 0; p < NR_PROFILES; p++) {
+			if (!profile_selected[p])
+				continue;
+			profile = p;
+			printf_verbose("flavor %s, profile %s\n",
+				flavors[f].name, profile_name[p]);
+			run_test(&wstats, &nr_reads);
+
+			printf("%-8s %-8s %12.0f reads/s %12.0f updates/s\n",
+				flavors[f].name, profile_name[p],
+				(double) nr_reads / duration,
+				(double) wstats.nr_writes / duration);
+			bench_hist_print(&wstats.gp_hist, "%-8s %-8s %s",
+				flavors[f].name, profile_name[p],
+				use_expedited ? "synchronize_rcu_expedited"
+					: "synchronize_rcu");
+			bench_hist_print(&call_rcu_hist, "%-8s %-8s call_rcu",
+				flavors[f].name, profile_name[p]);
+
+			bench_report_begin(argv[0]);
+			bench_report_string("flavor", flavors[f].name);
+			bench_report_string("profile", profile_name[p]);
+			bench_report_u64("duration_s", duration);
+			bench_report_u64("nr_readers", nr_readers);
+			bench_report_u64("nest_depth", nest_depth);
+			bench_report_u64("nest_us", nest_us);
+			bench_report_u64("wdelay_us", wdelay);
+			bench_report_u64("expedited", use_expedited);
+			bench_report_double("reads_per_s",
+				(double) nr_reads / duration);
+			bench_report_double("updates_per_s",
+				(double) wstats.nr_writes / duration);
+			bench_report_hist("synchronize_rcu", &wstats.gp_hist);
+			bench_report_hist("call_rcu", &call_rcu_hist);
+			bench_report_perf(nr_reads + wstats.nr_writes);
+			bench_report_end();
+		}
+	}
+	return 0;
+}
@@ -26,6 +26,8 @@
 enum test_hash {
 	TEST_HASH_RW,
 	TEST_HASH_UNIQUE,
+	TEST_HASH_RESIZE,
+	TEST_HASH_GC,
 };
 
 struct test_hash_cb {
@@ -52,6 +54,20 @@ struct test_hash_cb test_hash_cb[] = {
 		test_hash_unique_thr_writer,
 		test_hash_unique_populate_hash,
 	},
+	[TEST_HASH_RESIZE] = {
+		test_hash_resize_sigusr1_handler,
+		test_hash_resize_sigusr2_handler,
+		test_hash_resize_thr_reader,
+		test_hash_resize_thr_writer,
+		test_hash_resize_populate_hash,
+	},
+	[TEST_HASH_GC] = {
+		test_hash_gc_sigusr1_handler,
+		test_hash_gc_sigusr2_handler,
+		test_hash_gc_thr_reader,
+		test_hash_gc_thr_writer,
+		test_hash_gc_populate_hash,
+	},
 
 };
 
@@ -105,7 +121,13 @@ unsigned long init_hash_size = DEFAULT_HASH_SIZE;
 unsigned long min_hash_alloc_size = DEFAULT_MIN_ALLOC_SIZE;
 unsigned long max_hash_buckets_size = (1UL << 20);
 unsigned long init_populate;
+int opt_bulk_populate;
 int opt_auto_resize;
+int opt_incremental_resize;
+int opt_lazy_accounting;
+int opt_reclaim;
+unsigned long nr_reclaimed;
+int opt_print_stats;
 int add_only, add_unique, add_replace;
 const struct cds_lfht_mm_type *memory_backend;
 
@@ -129,6 +151,11 @@ pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
 DEFINE_URCU_TLS(unsigned long long, nr_writes);
 DEFINE_URCU_TLS(unsigned long long, nr_reads);
 
+DEFINE_URCU_TLS(struct bench_hist, add_hist);
+DEFINE_URCU_TLS(struct bench_hist, call_rcu_hist);
+static struct bench_hist tot_add_hist, tot_call_rcu_hist;
+static pthread_mutex_t latency_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 unsigned int nr_readers;
 unsigned int nr_writers;
 
@@ -166,6 +193,30 @@ void set_affinity(void)
 #endif /* HAVE_SCHED_SETAFFINITY */
 }
 
+void test_hash_latency_thread_end(void)
+{
+	int ret;
+
+	if (!bench_latency)
+		return;
+	bench_hist_print(&URCU_TLS(add_hist),
+		"add latency, tid %lu", urcu_get_thread_id());
+	bench_hist_print(&URCU_TLS(call_rcu_hist),
+		"call_rcu latency, tid %lu", urcu_get_thread_id());
+	ret = pthread_mutex_lock(&latency_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	bench_hist_merge(&tot_add_hist, &URCU_TLS(add_hist));
+	bench_hist_merge(&tot_call_rcu_hist, &URCU_TLS(call_rcu_hist));
+	ret = pthread_mutex_unlock(&latency_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+}
+
 void rcu_copy_mutex_lock(void)
 {
 	int ret;
@@ -246,6 +297,13 @@ void free_node_cb(struct rcu_head *head)
 	free(node);
 }
 
+static
+void test_reclaim_node(struct cds_lfht_node *node, void *priv)
+{
+	free(to_test_node(node));
+	uatomic_inc(&nr_reclaimed);
+}
+
 static
 void test_delete_all_nodes(struct cds_lfht *ht)
 {
@@ -258,12 +316,40 @@ void test_delete_all_nodes(struct cds_lfht *ht)
 
 		ret = cds_lfht_del(test_ht, cds_lfht_iter_get_node(&iter));
 		assert(!ret);
-		call_rcu(&node->head, free_node_cb);
+		if (!opt_reclaim)
+			call_rcu(&node->head, free_node_cb);
 		count++;
 	}
 	printf("deleted %lu nodes.\n", count);
 }
 
+static
+void print_stats(struct cds_lfht *ht)
+{
+	struct cds_lfht_stats stats;
+	int i;
+
+	cds_lfht_get_stats(ht, &stats);
+	printf("Hash table size: %lu buckets (target %lu), %lu nodes, "
+		"%lu removed nodes not yet unlinked.\n",
+		stats.size, stats.resize_target, stats.nr_nodes,
+		stats.nr_removed);
+	printf("Bucket nodes: %lu, per order:", stats.nr_buckets);
+	for (i = 0; i <= CAA_BITS_PER_LONG; i++) {
+		if (stats.buckets_per_order[i])
+			printf(" %d:%lu", i, stats.buckets_per_order[i]);
+	}
+	printf("\nChain length histogram (max %lu):",
+		stats.max_chain_len);
+	for (i = 0; i < CDS_LFHT_STATS_CHAIN_HIST; i++) {
+		if (stats.chain_len_hist[i])
+			printf(" %d%s:%lu", i,
+				i == CDS_LFHT_STATS_CHAIN_HIST - 1 ? "+" : "",
+				stats.chain_len_hist[i]);
+	}
+	printf("\n");
+}
+
 void show_usage(int argc, char **argv)
 {
 	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
@@ -282,8 +368,13 @@ printf("        [not -u nor -s] Add entries (supports redundant keys).\n");
 	printf("        [-s] Replace (swap) entries.\n");
 	printf("        [-i] Add only (no removal).\n");
 	printf("        [-k nr_nodes] Number of nodes to insert initially.\n");
+	printf("        [-K] Insert initial nodes with cds_lfht_bulk_load().\n");
 	printf("        [-A] Automatically resize hash table.\n");
-	printf("        [-B order|chunk|mmap] Specify the memory backend.\n");
+	printf("        [-I] Resize hash table incrementally.\n");
+	printf("        [-L] Count nodes without atomic operations.\n");
+	printf("        [-F] Reclaim removed nodes with cds_lfht_set_reclaim().\n");
+	printf("        [-H] Print hash table chain length statistics.\n");
+	printf("        [-B order|chunk|mmap|hugepage|numa|file=DIR] Specify the memory backend.\n");
 	printf("        [-R offset] Lookup pool offset.\n");
 	printf("        [-S offset] Write pool offset.\n");
 	printf("        [-T offset] Init pool offset.\n");
@@ -295,6 +386,21 @@ printf("        [not -u nor -s] Add entries (supports redundant keys).\n");
 	printf("		with different write range)\n");
 	printf("	[-U] Uniqueness test.\n");
 	printf("	[-C] Number of hash chains.\n");
+	printf("	[-G] Resize test: fill the write pool, then drain it, with -A\n");
+	printf("		(duration is a time limit, e.g. -G -h 1 -n 67108864 -N 67108864)\n");
+	printf("	[-g] GC test: remove nodes with cds_lfht_gc() passes, implies -F\n");
+	printf("		(-k stable nodes always found by the lookups)\n");
+	printf("	[--format=json|csv] (machine-readable report)\n");
+	printf("	[--perf] (hardware performance counters per operation)\n");
+	printf("	[--placement=compact|scatter|remote-writers] (NUMA placement)\n");
+	printf("	[--call-rcu-per-node] (one call_rcu worker per NUMA node)\n");
+	printf("	[--latency] (add and call_rcu latency percentiles)\n");
+	printf("	[--keys=uniform|zipf[:THETA]|hotspot[:FRACTION[:PROB]]] (key distribution\n");
+	printf("		of lookups and updates, default zipf theta 0.99, hotspot 0.01:0.9)\n");
+	printf("	[--key-shift=MS] (move the hot keys every MS ms)\n");
+	printf("	[--mix=LOOKUP:ADD:DEL:REPLACE] (update thread operation weights, rw test)\n");
+	printf("	[--value-size=BYTES] (value carried by each node, read on lookup hits)\n");
+	printf("	[--record=FILE] (trace the rw test operations for test_urcu_replay)\n");
 	printf("\n");
 }
 
@@ -306,7 +412,8 @@ int main(int argc, char **argv)
 	unsigned long long *count_reader;
 	struct wr_count *count_writer;
 	unsigned long long tot_reads = 0, tot_writes = 0,
-		tot_add = 0, tot_add_exist = 0, tot_remove = 0;
+		tot_add = 0, tot_add_exist = 0, tot_remove = 0,
+		tot_writer_lookup = 0;
 	unsigned long count;
 	long approx_before, approx_after;
 	int i, a, ret, err, mainret = 0;
@@ -345,6 +452,10 @@ int main(int argc, char **argv)
 	for (i = 4; i < argc; i++) {
 		if (argv[i][0] != '-')
 			continue;
+		if (bench_parse_option(argv[i]))
+			continue;
+		if (test_hash_parse_workload_option(argv[i]))
+			continue;
 		switch (argv[i][1]) {
 		case 'r':
 			rcu_debug_yield_enable(RCU_YIELD_READ);
@@ -426,9 +537,24 @@ int main(int argc, char **argv)
 		case 'k':
 			init_populate = atol(argv[++i]);
 			break;
+		case 'K':
+			opt_bulk_populate = 1;
+			break;
 		case 'A':
 			opt_auto_resize = 1;
 			break;
+		case 'I':
+			opt_incremental_resize = 1;
+			break;
+		case 'L':
+			opt_lazy_accounting = 1;
+			break;
+		case 'F':
+			opt_reclaim = 1;
+			break;
+		case 'H':
+			opt_print_stats = 1;
+			break;
 		case 'B':
 			if (argc < i + 2) {
 				show_usage(argc, argv);
@@ -442,8 +568,15 @@ int main(int argc, char **argv)
 				memory_backend = &cds_lfht_mm_chunk;
 			else if (!strcmp("mmap", argv[i]))
 				memory_backend = &cds_lfht_mm_mmap;
+			else if (!strcmp("hugepage", argv[i]))
+				memory_backend = &cds_lfht_mm_hugepage;
+			else if (!strcmp("numa", argv[i]))
+				memory_backend = &cds_lfht_mm_numa;
+			else if (!strncmp("file=", argv[i], 5)
+					&& !cds_lfht_mm_file_set_dir(argv[i] + 5))
+				memory_backend = &cds_lfht_mm_file;
 			else {
-				printf("Please specify memory backend with order|chunk|mmap.\n");
+				printf("Please specify memory backend with order|chunk|mmap|hugepage|numa|file=DIR.\n");
 				mainret = 1;
 				goto end;
 			}
@@ -475,6 +608,14 @@ int main(int argc, char **argv)
 		case 'C':
 			nr_hash_chains = atol(argv[++i]);
 			break;
+		case 'G':
+			test_choice = TEST_HASH_RESIZE;
+			opt_auto_resize = 1;
+			break;
+		case 'g':
+			test_choice = TEST_HASH_GC;
+			opt_reclaim = 1;
+			break;
 		}
 	}
 
@@ -543,6 +684,7 @@ int main(int argc, char **argv)
 		write_pool_offset, write_pool_size);
 	printf_verbose("Number of hash chains: %lu.\n",
 		nr_hash_chains);
+	test_hash_workload_print();
 	printf_verbose("thread %-6s, tid %lu\n",
 			"main", urcu_get_thread_id());
 
@@ -567,21 +709,36 @@ int main(int argc, char **argv)
 		goto end_free_count_reader;
 	}
 
-	err = create_all_cpu_call_rcu_data(0);
-	if (err) {
-		printf("Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+	if (bench_call_rcu_per_node) {
+		err = create_all_node_call_rcu_data(0);
+		if (err) {
+			printf("Per-node call_rcu() worker threads unavailable. Using default global worker thread.\n");
+		}
+	} else {
+		err = create_all_cpu_call_rcu_data(0);
+		if (err) {
+			printf("Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+		}
 	}
 
 	if (memory_backend) {
 		test_ht = _cds_lfht_new(init_hash_size, min_hash_alloc_size,
 				max_hash_buckets_size,
 				(opt_auto_resize ? CDS_LFHT_AUTO_RESIZE : 0) |
+				(opt_incremental_resize ?
+					CDS_LFHT_INCREMENTAL_RESIZE : 0) |
+				(opt_lazy_accounting ?
+					CDS_LFHT_LAZY_ACCOUNTING : 0) |
 				CDS_LFHT_ACCOUNTING, memory_backend,
 				&rcu_flavor, NULL);
 	} else {
 		test_ht = cds_lfht_new(init_hash_size, min_hash_alloc_size,
 				max_hash_buckets_size,
 				(opt_auto_resize ? CDS_LFHT_AUTO_RESIZE : 0) |
+				(opt_incremental_resize ?
+					CDS_LFHT_INCREMENTAL_RESIZE : 0) |
+				(opt_lazy_accounting ?
+					CDS_LFHT_LAZY_ACCOUNTING : 0) |
 				CDS_LFHT_ACCOUNTING, NULL);
 	}
 	if (!test_ht) {
@@ -589,6 +746,8 @@ int main(int argc, char **argv)
 		mainret = 1;
 		goto end_free_call_rcu_data;
 	}
+	if (opt_reclaim)
+		cds_lfht_set_reclaim(test_ht, test_reclaim_node, NULL);
 
 	/*
 	 * Hash Population needs to be seen as a RCU reader
@@ -598,9 +757,13 @@ int main(int argc, char **argv)
 	ret = (get_populate_hash_cb())();
 	assert(!ret);
 
+	/* Initial nodes are spread uniformly over the init pool. */
+	test_hash_workload_init();
+
 	rcu_thread_offline();
 
 	next_aff = 0;
+	bench_placement_init(nr_readers, nr_writers);
 
 	ret = pipe(count_pipe);
 	if (ret == -1) {
@@ -646,14 +809,20 @@ int main(int argc, char **argv)
 
 	cmm_smp_mb();
 
+	bench_perf_start();
 	test_go = 1;
 
-	remain = duration;
-	do {
-		remain = sleep(remain);
-	} while (remain > 0);
+	if (test_choice == TEST_HASH_RESIZE) {
+		test_hash_resize_wait();
+	} else {
+		remain = duration;
+		do {
+			remain = sleep(remain);
+		} while (remain > 0);
+	}
 
 	test_stop = 1;
+	bench_perf_stop();
 
 end_pthread_join:
 	for (i = 0; i < nr_readers_created; i++) {
@@ -676,7 +845,9 @@ end_pthread_join:
 		tot_add += count_writer[i].add;
 		tot_add_exist += count_writer[i].add_exist;
 		tot_remove += count_writer[i].remove;
+		tot_writer_lookup += count_writer[i].lookup;
 	}
+	bench_trace_close();
 
 	/* teardown counter thread */
 	act.sa_handler = SIG_IGN;
@@ -712,12 +883,17 @@ end_close_pipe:
 	fflush(stdout);
 end_online:
 	rcu_thread_online();
+	if (test_choice == TEST_HASH_RESIZE)
+		test_hash_resize_end();
 	rcu_read_lock();
+	if (opt_print_stats)
+		print_stats(test_ht);
 	printf("Counting nodes... ");
 	cds_lfht_count_nodes(test_ht, &approx_before, &count, &approx_after);
 	printf("done.\n");
 	test_delete_all_nodes(test_ht);
 	rcu_read_unlock();
+	cds_lfht_reclaim_flush();
 	rcu_thread_offline();
 	if (count) {
 		printf("Approximation before node accounting: %ld nodes.\n",
@@ -736,9 +912,16 @@ end_online:
 	} else {
 		printf_verbose("final delete success\n");
 	}
+	if (test_choice == TEST_HASH_GC
+			&& test_hash_gc_end(tot_add + init_populate))
+		mainret = 1;
 	printf_verbose("total number of reads : %llu, writes %llu\n", tot_reads,
 	       tot_writes);
 	nr_leaked = (long long) tot_add + init_populate - tot_remove - count;
+	if (bench_latency) {
+		bench_hist_print(&tot_add_hist, "add latency");
+		bench_hist_print(&tot_call_rcu_hist, "call_rcu latency");
+	}
 	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu "
 		"nr_writers %3u "
 		"wdelay %6lu nr_reads %12llu nr_writes %12llu nr_ops %12llu "
@@ -747,6 +930,31 @@ end_online:
 		nr_writers, wdelay, tot_reads, tot_writes,
 		tot_reads + tot_writes, tot_add, tot_add_exist, tot_remove,
 		nr_leaked);
+	bench_report_begin(argv[0]);
+	bench_report_u64("duration_s", duration);
+	bench_report_u64("nr_readers", nr_readers);
+	bench_report_u64("nr_writers", nr_writers);
+	bench_report_u64("rdur", rduration);
+	bench_report_u64("wdelay", wdelay);
+	bench_report_u64("nr_reads", tot_reads);
+	bench_report_u64("nr_writes", tot_writes);
+	bench_report_u64("nr_add", tot_add);
+	bench_report_u64("nr_add_fail", tot_add_exist);
+	bench_report_u64("nr_remove", tot_remove);
+	if (op_mix_total)
+		bench_report_u64("nr_writer_lookup", tot_writer_lookup);
+	test_hash_workload_report();
+	bench_report_double("reads_per_s", (double) tot_reads / duration);
+	bench_report_double("writes_per_s", (double) tot_writes / duration);
+	if (bench_latency) {
+		bench_report_hist("add_latency", &tot_add_hist);
+		bench_report_hist("call_rcu_latency", &tot_call_rcu_hist);
+	}
+	if (test_choice == TEST_HASH_RESIZE)
+		test_hash_resize_report();
+	bench_report_perf(tot_reads + tot_writes);
+	bench_report_placement();
+	bench_report_end();
 	if (nr_leaked != 0) {
 		mainret = 1;
 		printf("WARNING: %lld nodes were leaked!\n", nr_leaked);
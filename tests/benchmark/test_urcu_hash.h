@@ -36,10 +36,13 @@
 #include <errno.h>
 #include <signal.h>
 
+#include <urcu/arch.h>
+#include <urcu/clock.h>
 #include <urcu/tls-compat.h>
 #include <urcu/rand-compat.h>
 #include "cpuset.h"
 #include "thread-id.h"
+#include "bench.h"
 #include "../common/debug-yield.h"
 
 #define DEFAULT_HASH_SIZE	32
@@ -74,6 +77,7 @@
 #endif
 #include <urcu-qsbr.h>
 #include <urcu/rculfhash.h>
+#include <urcu/hash.h>
 #include <urcu-call-rcu.h>
 
 struct wr_count {
@@ -81,6 +85,7 @@ struct wr_count {
 	unsigned long add;
 	unsigned long add_exist;
 	unsigned long remove;
+	unsigned long lookup;
 };
 
 extern DECLARE_URCU_TLS(unsigned int, rand_lookup);
@@ -104,6 +109,7 @@ struct lfht_test_node {
 	unsigned int key_len;
 	/* cache-cold for iteration */
 	struct rcu_head head;
+	unsigned char value[];	/* value_size bytes */
 };
 
 static inline struct lfht_test_node *
@@ -140,7 +146,11 @@ extern unsigned long init_hash_size;
 extern unsigned long min_hash_alloc_size;
 extern unsigned long max_hash_buckets_size;
 extern unsigned long init_populate;
+extern int opt_bulk_populate;
 extern int opt_auto_resize;
+extern int opt_reclaim;
+/* Nodes handed to the reclaim callback of the table, with -F. */
+extern unsigned long nr_reclaimed;
 extern int add_only, add_unique, add_replace;
 extern const struct cds_lfht_mm_type *memory_backend;
 
@@ -154,6 +164,84 @@ extern unsigned long nr_hash_chains;
 
 extern int count_pipe[2];
 
+/*
+ * Workload of the rw and unique tests (test_urcu_hash_workload.c): key
+ * distribution within the pools, operation mix of the update threads,
+ * and size of the value carried by each node.
+ */
+enum test_key_dist {
+	KEY_DIST_UNIFORM = 0,
+	KEY_DIST_ZIPF,
+	KEY_DIST_HOTSPOT,
+};
+
+enum test_op {
+	TEST_OP_LOOKUP = 0,
+	TEST_OP_ADD,
+	TEST_OP_DEL,
+	TEST_OP_REPLACE,
+	NR_TEST_OPS,
+};
+
+extern enum test_key_dist key_dist;
+extern unsigned long key_shift_ms;
+extern unsigned int op_mix[NR_TEST_OPS];
+extern unsigned int op_mix_total;	/* 0: no --mix option */
+extern unsigned long value_size;
+
+int test_hash_parse_workload_option(const char *arg);
+void test_hash_workload_init(void);
+void test_hash_workload_print(void);
+void test_hash_workload_report(void);
+void *test_skewed_key(unsigned long pool_size, unsigned long pool_offset);
+
+/* Draw a key of a pool, following the key distribution. */
+static inline
+void *test_pool_key(unsigned long pool_size, unsigned long pool_offset)
+{
+	if (caa_likely(key_dist == KEY_DIST_UNIFORM && !key_shift_ms))
+		return (void *) (((unsigned long) rand_r(&URCU_TLS(rand_lookup))
+				% pool_size) + pool_offset);
+	return test_skewed_key(pool_size, pool_offset);
+}
+
+/* Draw an operation of the --mix option. */
+static inline
+enum test_op test_draw_op(void)
+{
+	unsigned int r = (unsigned int) rand_r(&URCU_TLS(rand_lookup))
+		% op_mix_total;
+	int op;
+
+	for (op = 0; op < NR_TEST_OPS - 1; op++) {
+		if (r < op_mix[op])
+			break;
+		r -= op_mix[op];
+	}
+	return op;
+}
+
+static inline
+struct lfht_test_node *test_node_alloc(void)
+{
+	struct lfht_test_node *node;
+
+	node = malloc(sizeof(*node) + value_size);
+	if (node && value_size)
+		memset(node->value, 0x5a, value_size);
+	return node;
+}
+
+/* Touch each cache line of the value of a node found by a lookup. */
+static inline
+void test_read_value(struct lfht_test_node *node)
+{
+	unsigned long i;
+
+	for (i = 0; i < value_size; i += CAA_CACHE_LINE_SIZE)
+		(void) CMM_LOAD_SHARED(node->value[i]);
+}
+
 static inline void loop_sleep(unsigned long loops)
 {
 	while (loops-- != 0)
@@ -192,141 +280,61 @@ static inline int test_duration_read(void)
 extern DECLARE_URCU_TLS(unsigned long long, nr_writes);
 extern DECLARE_URCU_TLS(unsigned long long, nr_reads);
 
-extern unsigned int nr_readers;
-extern unsigned int nr_writers;
-
-void rcu_copy_mutex_lock(void);
-void rcu_copy_mutex_unlock(void);
-
 /*
- * Hash function
- * Source: http://burtleburtle.net/bob/c/lookup3.c
- * Originally Public Domain
+ * Latency histograms of the add operations (including concurrent
+ * resize, with -A) and of call_rcu() enqueue, sampled in the update
+ * threads with the --latency option.
  */
+extern DECLARE_URCU_TLS(struct bench_hist, add_hist);
+extern DECLARE_URCU_TLS(struct bench_hist, call_rcu_hist);
 
-#define rot(x, k) (((x) << (k)) | ((x) >> (32 - (k))))
-
-#define mix(a, b, c) \
-do { \
-	a -= c; a ^= rot(c,  4); c += b; \
-	b -= a; b ^= rot(a,  6); a += c; \
-	c -= b; c ^= rot(b,  8); b += a; \
-	a -= c; a ^= rot(c, 16); c += b; \
-	b -= a; b ^= rot(a, 19); a += c; \
-	c -= b; c ^= rot(b,  4); b += a; \
-} while (0)
-
-#define final(a, b, c) \
-{ \
-	c ^= b; c -= rot(b, 14); \
-	a ^= c; a -= rot(c, 11); \
-	b ^= a; b -= rot(a, 25); \
-	c ^= b; c -= rot(b, 16); \
-	a ^= c; a -= rot(c,  4);\
-	b ^= a; b -= rot(a, 14); \
-	c ^= b; c -= rot(b, 24); \
-}
+/* Print and merge the latency histograms of the current update thread. */
+void test_hash_latency_thread_end(void);
 
-static inline __attribute__((unused))
-uint32_t hash_u32(
-	const uint32_t *k,	/* the key, an array of uint32_t values */
-	size_t length,		/* the length of the key, in uint32_ts */
-	uint32_t initval)	/* the previous hash, or an arbitrary value */
+static inline
+cycles_t test_latency_begin(void)
 {
-	uint32_t a, b, c;
-
-	/* Set up the internal state */
-	a = b = c = 0xdeadbeef + (((uint32_t) length) << 2) + initval;
-
-	/*----------------------------------------- handle most of the key */
-	while (length > 3) {
-		a += k[0];
-		b += k[1];
-		c += k[2];
-		mix(a, b, c);
-		length -= 3;
-		k += 3;
-	}
-
-	/*----------------------------------- handle the last 3 uint32_t's */
-	switch (length) {	/* all the case statements fall through */
-	case 3: c += k[2];
-	case 2: b += k[1];
-	case 1: a += k[0];
-		final(a, b, c);
-	case 0:			/* case 0: nothing left to add */
-		break;
-	}
-	/*---------------------------------------------- report the result */
-	return c;
+	if (caa_likely(!bench_latency))
+		return 0;
+	return caa_get_cycles_ordered();
 }
 
 static inline
-void hashword2(
-	const uint32_t *k,	/* the key, an array of uint32_t values */
-	size_t length,		/* the length of the key, in uint32_ts */
-	uint32_t *pc,		/* IN: seed OUT: primary hash value */
-	uint32_t *pb)		/* IN: more seed OUT: secondary hash value */
+void test_latency_end(struct bench_hist *hist, cycles_t begin)
 {
-	uint32_t a, b, c;
-
-	/* Set up the internal state */
-	a = b = c = 0xdeadbeef + ((uint32_t) (length << 2)) + *pc;
-	c += *pb;
-
-	/*----------------------------------------- handle most of the key */
-	while (length > 3) {
-		a += k[0];
-		b += k[1];
-		c += k[2];
-		mix(a, b, c);
-		length -= 3;
-		k += 3;
-	}
-
-	/*----------------------------------- handle the last 3 uint32_t's */
-	switch (length) {	/* all the case statements fall through */
-	case 3: c += k[2];
-	case 2: b += k[1];
-	case 1: a += k[0];
-		final(a, b, c);
-	case 0:			/* case 0: nothing left to add */
-		break;
-	}
-	/*---------------------------------------------- report the result */
-	*pc = c;
-	*pb = b;
+	if (caa_likely(!bench_latency))
+		return;
+	bench_hist_record(hist,
+		caa_cycles_to_ns(caa_get_cycles_ordered() - begin));
 }
 
-#if (CAA_BITS_PER_LONG == 32)
 static inline
-unsigned long test_hash_mix(const void *_key, size_t length, unsigned long seed)
+void test_call_rcu(struct rcu_head *head,
+		void (*func)(struct rcu_head *head))
 {
-	unsigned int key = (unsigned int) _key;
-
-	assert(length == sizeof(unsigned int));
-	return hash_u32(&key, 1, seed);
+	cycles_t begin;
+
+	/* Nodes already handed to the reclaim callback of the table. */
+	if (opt_reclaim)
+		return;
+	begin = test_latency_begin();
+	call_rcu(head, func);
+	test_latency_end(&URCU_TLS(call_rcu_hist), begin);
 }
-#else
+
+extern unsigned int nr_readers;
+extern unsigned int nr_writers;
+
+void rcu_copy_mutex_lock(void);
+void rcu_copy_mutex_unlock(void);
+
+/* Hash function, from the library, mixing the key into all bits. */
 static inline
 unsigned long test_hash_mix(const void *_key, size_t length, unsigned long seed)
 {
-	union {
-		uint64_t v64;
-		uint32_t v32[2];
-	} v;
-	union {
-		uint64_t v64;
-		uint32_t v32[2];
-	} key;
-
 	assert(length == sizeof(unsigned long));
-	v.v64 = (uint64_t) seed;
-	key.v64 = (uint64_t) _key;
-	hashword2(key.v32, 2, &v.v32[0], &v.v32[1]);
-	return v.v64;
+	return cds_hash_u64((unsigned long) _key, seed);
 }
-#endif
 
 /*
  * Hash function with nr_hash_chains != 0 for testing purpose only!
@@ -373,6 +381,16 @@ void cds_lfht_test_lookup(struct cds_lfht *ht, void *key, size_t key_len,
 			test_match, key, iter);
 }
 
+/* Record an operation on key with --record. */
+static inline
+void test_trace(enum bench_trace_op op, void *key)
+{
+	if (caa_unlikely(bench_trace))
+		bench_trace_record_op(op,
+			test_hash(key, sizeof(void *), TEST_HASH_SEED),
+			(unsigned long) key);
+}
+
 void free_node_cb(struct rcu_head *head);
 
 /* rw test */
@@ -389,4 +407,22 @@ void *test_hash_unique_thr_reader(void *_count);
 void *test_hash_unique_thr_writer(void *_count);
 int test_hash_unique_populate_hash(void);
 
+/* resize test */
+void test_hash_resize_sigusr1_handler(int signo);
+void test_hash_resize_sigusr2_handler(int signo);
+void *test_hash_resize_thr_reader(void *_count);
+void *test_hash_resize_thr_writer(void *_count);
+int test_hash_resize_populate_hash(void);
+void test_hash_resize_wait(void);
+void test_hash_resize_end(void);
+void test_hash_resize_report(void);
+
+/* gc test */
+void test_hash_gc_sigusr1_handler(int signo);
+void test_hash_gc_sigusr2_handler(int signo);
+void *test_hash_gc_thr_reader(void *_count);
+void *test_hash_gc_thr_writer(void *_count);
+int test_hash_gc_populate_hash(void);
+int test_hash_gc_end(unsigned long long nr_published);
+
 #endif /* _TEST_URCU_HASH_H */
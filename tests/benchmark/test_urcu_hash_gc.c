@@ -0,0 +1,292 @@
+/*
+ * test_urcu_hash_gc.c
+ *
+ * Userspace RCU library - test program
+ *
+ * Copyright 2009-2012 - Mathieu Desnoyers <mathieu.desnoyers@polymtl.ca>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * GC test: the writers add and remove the even keys of the write pool,
+ * with the reclaim callback of the table, and queue cds_lfht_gc_async()
+ * passes, while the readers run cds_lfht_gc() on random partitions
+ * between their lookups. The -k initial nodes hold odd keys, which are
+ * never removed: the lookups of those keys must always succeed whatever
+ * the garbage collection unlinks around them, and any node found must
+ * hold the key looked up. Once the table is destroyed, every published
+ * node must have been handed to the reclaim callback.
+ */
+
+#define _GNU_SOURCE
+#include "test_urcu_hash.h"
+
+/* Read-side cds_lfht_gc() passes split the table in partitions. */
+#define GC_NR_PARTITIONS	16
+
+static DEFINE_URCU_TLS(unsigned long, nr_gc_async);
+static DEFINE_URCU_TLS(unsigned long, nr_gc);
+static DEFINE_URCU_TLS(unsigned long, nr_gc_found);
+
+static unsigned long tot_gc_async, tot_gc_async_fail, tot_gc, tot_gc_found;
+static unsigned long nr_lookup_errors;
+
+static
+void *gc_stable_key(void)
+{
+	return (void *) (2 * ((unsigned long) rand_r(&URCU_TLS(rand_lookup))
+			% init_populate) + 1);
+}
+
+static
+void *gc_write_key(void)
+{
+	return (void *) (2 * ((unsigned long) rand_r(&URCU_TLS(rand_lookup))
+			% write_pool_size));
+}
+
+void test_hash_gc_sigusr1_handler(int signo)
+{
+}
+
+void test_hash_gc_sigusr2_handler(int signo)
+{
+	char msg[1] = { 0x42 };
+	ssize_t ret;
+
+	do {
+		ret = write(count_pipe[1], msg, 1);	/* wakeup thread */
+	} while (ret == -1L && errno == EINTR);
+}
+
+void *test_hash_gc_thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	URCU_TLS(rand_lookup) = urcu_get_thread_id() ^ time(NULL);
+
+	set_affinity();
+	bench_place_thread(BENCH_ROLE_READER);
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		struct lfht_test_node *node;
+		struct cds_lfht_iter iter;
+		int stable = init_populate && (URCU_TLS(nr_reads) & 1);
+		void *key = stable ? gc_stable_key() : gc_write_key();
+		long found;
+
+		rcu_read_lock();
+		cds_lfht_test_lookup(test_ht, key, sizeof(void *), &iter);
+		node = cds_lfht_iter_get_test_node(&iter);
+		if (node == NULL) {
+			if (stable) {
+				printf("[ERROR] Lookup of stable key %lu failed\n",
+					(unsigned long) key);
+				uatomic_inc(&nr_lookup_errors);
+			}
+			URCU_TLS(lookup_fail)++;
+		} else {
+			if (node->key != key) {
+				printf("[ERROR] Lookup of key %lu found key %lu\n",
+					(unsigned long) key,
+					(unsigned long) node->key);
+				uatomic_inc(&nr_lookup_errors);
+			}
+			URCU_TLS(lookup_ok)++;
+		}
+		if (caa_unlikely((URCU_TLS(nr_reads) & ((1 << 10) - 1)) == 0)) {
+			found = cds_lfht_gc(test_ht,
+				rand_r(&URCU_TLS(rand_lookup))
+					% GC_NR_PARTITIONS,
+				GC_NR_PARTITIONS);
+			URCU_TLS(nr_gc)++;
+			URCU_TLS(nr_gc_found) += found;
+		}
+		rcu_read_unlock();
+		rcu_debug_yield_read();
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+		if (caa_unlikely((URCU_TLS(nr_reads) & ((1 << 10) - 1)) == 0))
+			rcu_quiescent_state();
+	}
+
+	rcu_unregister_thread();
+	uatomic_add(&tot_gc, URCU_TLS(nr_gc));
+	uatomic_add(&tot_gc_found, URCU_TLS(nr_gc_found));
+
+	*count = URCU_TLS(nr_reads);
+	printf_verbose("thread_end %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+	printf_verbose("read tid : %lu, lookupfail %lu, lookupok %lu, "
+			"gc passes %lu\n",
+			urcu_get_thread_id(), URCU_TLS(lookup_fail),
+			URCU_TLS(lookup_ok), URCU_TLS(nr_gc));
+	return ((void*)1);
+}
+
+void *test_hash_gc_thr_writer(void *_count)
+{
+	struct lfht_test_node *node;
+	struct cds_lfht_node *ret_node;
+	struct cds_lfht_iter iter;
+	struct wr_count *count = _count;
+	int ret;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	URCU_TLS(rand_lookup) = urcu_get_thread_id() ^ time(NULL);
+
+	set_affinity();
+	bench_place_thread(BENCH_ROLE_WRITER);
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		if (add_only || rand_r(&URCU_TLS(rand_lookup)) & 1) {
+			node = test_node_alloc();
+			lfht_test_node_init(node, gc_write_key(),
+				sizeof(void *));
+			rcu_read_lock();
+			ret_node = cds_lfht_add_unique(test_ht,
+				test_hash(node->key, node->key_len, TEST_HASH_SEED),
+				test_match, node->key, &node->node);
+			rcu_read_unlock();
+			if (ret_node != &node->node) {
+				free(node);
+				URCU_TLS(nr_addexist)++;
+			} else {
+				URCU_TLS(nr_add)++;
+			}
+		} else {
+			/* Reclaimed by the table once removed. */
+			rcu_read_lock();
+			cds_lfht_test_lookup(test_ht, gc_write_key(),
+				sizeof(void *), &iter);
+			ret = cds_lfht_del(test_ht, cds_lfht_iter_get_node(&iter));
+			rcu_read_unlock();
+			if (ret == 0)
+				URCU_TLS(nr_del)++;
+			else
+				URCU_TLS(nr_delnoent)++;
+		}
+		URCU_TLS(nr_writes)++;
+		if (caa_unlikely((URCU_TLS(nr_writes) & ((1 << 10) - 1)) == 0)) {
+			if (cds_lfht_gc_async(test_ht))
+				uatomic_inc(&tot_gc_async_fail);
+			else
+				URCU_TLS(nr_gc_async)++;
+		}
+		if (caa_unlikely(!test_duration_write()))
+			break;
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+		if (caa_unlikely((URCU_TLS(nr_writes) & ((1 << 10) - 1)) == 0))
+			rcu_quiescent_state();
+	}
+
+	cds_lfht_reclaim_flush();
+	rcu_unregister_thread();
+	uatomic_add(&tot_gc_async, URCU_TLS(nr_gc_async));
+
+	printf_verbose("thread_end %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+	printf_verbose("info tid %lu: nr_add %lu, nr_addexist %lu, nr_del %lu, "
+			"nr_delnoent %lu, gc passes queued %lu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_add),
+			URCU_TLS(nr_addexist),
+			URCU_TLS(nr_del),
+			URCU_TLS(nr_delnoent),
+			URCU_TLS(nr_gc_async));
+	count->update_ops = URCU_TLS(nr_writes);
+	count->add = URCU_TLS(nr_add);
+	count->add_exist = URCU_TLS(nr_addexist);
+	count->remove = URCU_TLS(nr_del);
+	return ((void*)2);
+}
+
+/* Add the stable odd keys, 1 to 2 * init_populate - 1. */
+int test_hash_gc_populate_hash(void)
+{
+	struct lfht_test_node *node;
+	unsigned long i;
+
+	printf("Starting GC test: %lu stable keys, %lu write keys.\n",
+		init_populate, write_pool_size);
+	if (init_pool_offset || lookup_pool_offset || write_pool_offset)
+		printf("Ignoring pool offsets (-R, -S, -T) in GC test.\n");
+
+	for (i = 0; i < init_populate; i++) {
+		node = test_node_alloc();
+		lfht_test_node_init(node, (void *) (2 * i + 1),
+			sizeof(void *));
+		rcu_read_lock();
+		cds_lfht_add(test_ht,
+			test_hash(node->key, node->key_len, TEST_HASH_SEED),
+			&node->node);
+		rcu_read_unlock();
+		URCU_TLS(nr_writes)++;
+	}
+	return 0;
+}
+
+/*
+ * Called once the table is destroyed, offline. Return nonzero if a
+ * published node was not reclaimed, or a lookup was inconsistent.
+ */
+int test_hash_gc_end(unsigned long long nr_published)
+{
+	int ret = 0;
+
+	/* Wait for the reclaim of the last removed nodes. */
+	rcu_barrier();
+	printf("GC: %lu passes queued (%lu failed), %lu partition passes, "
+		"%lu removed nodes found, %lu nodes reclaimed, "
+		"%llu published\n",
+		tot_gc_async, tot_gc_async_fail, tot_gc, tot_gc_found,
+		uatomic_read(&nr_reclaimed), nr_published);
+	if (uatomic_read(&nr_reclaimed) != nr_published) {
+		printf("WARNING: %lld published nodes not reclaimed!\n",
+			(long long) nr_published
+				- (long long) uatomic_read(&nr_reclaimed));
+		ret = 1;
+	}
+	if (nr_lookup_errors) {
+		printf("WARNING: %lu inconsistent lookups!\n",
+			nr_lookup_errors);
+		ret = 1;
+	}
+	return ret;
+}
@@ -0,0 +1,460 @@
+/*
+ * test_urcu_hash_resize.c
+ *
+ * Userspace RCU library - test program
+ *
+ * Copyright 2009-2012 - Mathieu Desnoyers <mathieu.desnoyers@polymtl.ca>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Resize test: the writers fill the table with the write_pool_size
+ * keys of the write pool, each writer adding its own stripe of keys,
+ * then drain it, while the readers look up random keys of the pool.
+ * With automatic resize, the table grows by every order up to the
+ * maximum number of buckets, then shrinks back. The latency of each
+ * lookup, add and removal is recorded in one histogram when a resize
+ * is in progress, and in another otherwise. The main thread samples
+ * the bucket memory of the table and the process RSS each time the
+ * table size or the number of nodes changes order.
+ *
+ * The duration is a time limit: the test ends when the table is
+ * drained.
+ */
+
+#define _GNU_SOURCE
+#include "test_urcu_hash.h"
+#include <poll.h>
+
+enum resize_op {
+	RESIZE_OP_LOOKUP,
+	RESIZE_OP_ADD,
+	RESIZE_OP_DEL,
+	NR_RESIZE_OPS,
+};
+
+static const char *resize_op_name[NR_RESIZE_OPS] = {
+	[RESIZE_OP_LOOKUP] = "lookup",
+	[RESIZE_OP_ADD] = "add",
+	[RESIZE_OP_DEL] = "del",
+};
+
+/* Latency of each operation, without and with a resize in progress. */
+struct resize_hist {
+	struct bench_hist op[NR_RESIZE_OPS][2];
+};
+
+static struct resize_hist tot_resize_hist;
+static pthread_mutex_t resize_hist_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long next_writer_id, nr_writers_filled, nr_writers_done;
+
+static struct cds_lfht_resize_stats resize_stats;
+static unsigned long peak_nodes, peak_bucket_mem, peak_rss_kb, end_rss_kb;
+static unsigned long end_bucket_resident;
+static unsigned long start_rss_kb;
+static uint64_t fill_ns, drain_ns;
+
+static
+uint64_t resize_test_ns(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static
+unsigned long read_rss_kb(void)
+{
+	unsigned long size, resident = 0;
+	FILE *fp;
+
+	fp = fopen("/proc/self/statm", "r");
+	if (fp) {
+		if (fscanf(fp, "%lu %lu", &size, &resident) != 2)
+			resident = 0;
+		fclose(fp);
+	}
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static
+const char *memory_backend_name(void)
+{
+	if (memory_backend == &cds_lfht_mm_order)
+		return "order";
+	if (memory_backend == &cds_lfht_mm_chunk)
+		return "chunk";
+	if (memory_backend == &cds_lfht_mm_mmap)
+		return "mmap";
+	if (memory_backend == &cds_lfht_mm_hugepage)
+		return "hugepage";
+	if (memory_backend == &cds_lfht_mm_numa)
+		return "numa";
+	if (memory_backend == &cds_lfht_mm_file)
+		return "file";
+	return "default";
+}
+
+static inline
+void resize_op_record(struct resize_hist *hist, enum resize_op op,
+		int resizing, cycles_t begin)
+{
+	bench_hist_record(&hist->op[op][resizing],
+		caa_cycles_to_ns(caa_get_cycles_ordered() - begin));
+}
+
+static
+void resize_hist_merge(struct resize_hist *hist)
+{
+	int i, j, ret;
+
+	ret = pthread_mutex_lock(&resize_hist_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	for (i = 0; i < NR_RESIZE_OPS; i++)
+		for (j = 0; j < 2; j++)
+			bench_hist_merge(&tot_resize_hist.op[i][j],
+				&hist->op[i][j]);
+	ret = pthread_mutex_unlock(&resize_hist_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+}
+
+void test_hash_resize_sigusr1_handler(int signo)
+{
+}
+
+void test_hash_resize_sigusr2_handler(int signo)
+{
+	char msg[1] = { 0x42 };
+	ssize_t ret;
+
+	do {
+		ret = write(count_pipe[1], msg, 1);	/* wakeup thread */
+	} while (ret == -1L && errno == EINTR);
+}
+
+void *test_hash_resize_thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	struct resize_hist *hist;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	hist = calloc(1, sizeof(*hist));
+	if (!hist) {
+		perror("calloc");
+		exit(-1);
+	}
+	URCU_TLS(rand_lookup) = urcu_get_thread_id() ^ time(NULL);
+
+	set_affinity();
+	bench_place_thread(BENCH_ROLE_READER);
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		struct cds_lfht_iter iter;
+		cycles_t begin;
+		int resizing;
+
+		resizing = cds_lfht_resize_in_progress(test_ht);
+		begin = caa_get_cycles_ordered();
+		rcu_read_lock();
+		cds_lfht_test_lookup(test_ht,
+			(void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % write_pool_size) + write_pool_offset),
+			sizeof(void *), &iter);
+		if (cds_lfht_iter_get_test_node(&iter) == NULL)
+			URCU_TLS(lookup_fail)++;
+		else
+			URCU_TLS(lookup_ok)++;
+		rcu_read_unlock();
+		resize_op_record(hist, RESIZE_OP_LOOKUP, resizing, begin);
+		rcu_debug_yield_read();
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+		if (caa_unlikely((URCU_TLS(nr_reads) & ((1 << 10) - 1)) == 0))
+			rcu_quiescent_state();
+	}
+
+	rcu_unregister_thread();
+	resize_hist_merge(hist);
+	free(hist);
+
+	*count = URCU_TLS(nr_reads);
+	printf_verbose("thread_end %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+	printf_verbose("read tid : %lu, lookupfail %lu, lookupok %lu\n",
+			urcu_get_thread_id(), URCU_TLS(lookup_fail),
+			URCU_TLS(lookup_ok));
+	return ((void*)1);
+}
+
+/* Returns 0 if the test should end. */
+static
+int resize_writer_step(void)
+{
+	URCU_TLS(nr_writes)++;
+	if (caa_unlikely(!test_duration_write()))
+		return 0;
+	if (caa_unlikely(wdelay))
+		loop_sleep(wdelay);
+	if (caa_unlikely((URCU_TLS(nr_writes) & ((1 << 10) - 1)) == 0))
+		rcu_quiescent_state();
+	return 1;
+}
+
+void *test_hash_resize_thr_writer(void *_count)
+{
+	struct wr_count *count = _count;
+	struct resize_hist *hist;
+	unsigned long id, key;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	hist = calloc(1, sizeof(*hist));
+	if (!hist) {
+		perror("calloc");
+		exit(-1);
+	}
+	id = uatomic_add_return(&next_writer_id, 1) - 1;
+
+	set_affinity();
+	bench_place_thread(BENCH_ROLE_WRITER);
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	/* Fill: add the keys of the stripe of this writer. */
+	for (key = id; key < write_pool_size; key += nr_writers) {
+		struct lfht_test_node *node;
+		cycles_t begin;
+		int resizing;
+
+		node = malloc(sizeof(struct lfht_test_node));
+		lfht_test_node_init(node, (void *) (key + write_pool_offset),
+			sizeof(void *));
+		resizing = cds_lfht_resize_in_progress(test_ht);
+		begin = caa_get_cycles_ordered();
+		rcu_read_lock();
+		cds_lfht_add(test_ht,
+			test_hash(node->key, node->key_len, TEST_HASH_SEED),
+			&node->node);
+		rcu_read_unlock();
+		resize_op_record(hist, RESIZE_OP_ADD, resizing, begin);
+		URCU_TLS(nr_add)++;
+		if (!resize_writer_step())
+			goto end;
+	}
+
+	/* Wait for the table to be full before draining it. */
+	uatomic_inc(&nr_writers_filled);
+	rcu_thread_offline();
+	while (uatomic_read(&nr_writers_filled) < nr_writers
+			&& test_duration_write())
+		(void) poll(NULL, 0, 1);
+	rcu_thread_online();
+
+	/* Drain: remove the keys of the stripe, in the same order. */
+	for (key = id; key < write_pool_size; key += nr_writers) {
+		struct cds_lfht_iter iter;
+		cycles_t begin;
+		int resizing, ret;
+
+		if (!test_duration_write())
+			break;
+		resizing = cds_lfht_resize_in_progress(test_ht);
+		begin = caa_get_cycles_ordered();
+		rcu_read_lock();
+		cds_lfht_test_lookup(test_ht, (void *) (key + write_pool_offset),
+			sizeof(void *), &iter);
+		ret = cds_lfht_del(test_ht, cds_lfht_iter_get_node(&iter));
+		rcu_read_unlock();
+		resize_op_record(hist, RESIZE_OP_DEL, resizing, begin);
+		if (ret == 0) {
+			test_call_rcu(&cds_lfht_iter_get_test_node(&iter)->head,
+					free_node_cb);
+			URCU_TLS(nr_del)++;
+		} else {
+			URCU_TLS(nr_delnoent)++;
+		}
+		if (!resize_writer_step())
+			break;
+	}
+end:
+	/* The last writer done ends the test. */
+	if (uatomic_add_return(&nr_writers_done, 1) == nr_writers)
+		test_stop = 1;
+
+	cds_lfht_reclaim_flush();
+	rcu_unregister_thread();
+	resize_hist_merge(hist);
+	free(hist);
+
+	printf_verbose("thread_end %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+	printf_verbose("info tid %lu: nr_add %lu, nr_addexist %lu, nr_del %lu, "
+			"nr_delnoent %lu\n", urcu_get_thread_id(),
+			URCU_TLS(nr_add),
+			URCU_TLS(nr_addexist),
+			URCU_TLS(nr_del),
+			URCU_TLS(nr_delnoent));
+	count->update_ops = URCU_TLS(nr_writes);
+	count->add = URCU_TLS(nr_add);
+	count->add_exist = URCU_TLS(nr_addexist);
+	count->remove = URCU_TLS(nr_del);
+	return ((void*)2);
+}
+
+int test_hash_resize_populate_hash(void)
+{
+	printf("Starting resize test: %lu keys, memory backend %s.\n",
+		write_pool_size, memory_backend_name());
+	if (init_populate) {
+		printf("Ignoring initial population (-k) in resize test.\n");
+		init_populate = 0;
+	}
+	start_rss_kb = read_rss_kb();
+	return 0;
+}
+
+/*
+ * Sample the table memory until the writers drain the table, or the
+ * duration elapses.
+ */
+void test_hash_resize_wait(void)
+{
+	uint64_t start, filled = 0, now;
+	unsigned long last_bucket_mem = 0, last_nodes_order = ~0UL;
+
+	start = resize_test_ns();
+	printf("%10s %12s %14s %14s %10s %9s\n", "time (ms)", "nodes",
+		"bucket mem", "resident", "RSS (kB)", "resizing");
+	for (;;) {
+		unsigned long nodes = 0, bucket_mem, nodes_order, rss_kb;
+		int stop = test_stop;
+
+		now = resize_test_ns();
+		if (!filled && uatomic_read(&nr_writers_filled) == nr_writers) {
+			filled = now;
+			fill_ns = filled - start;
+		}
+		(void) cds_lfht_size_approx(test_ht, &nodes);
+		bucket_mem = cds_lfht_bucket_memory(test_ht);
+		nodes_order = nodes ? CAA_BITS_PER_LONG - __builtin_clzl(nodes) : 0;
+		if (bucket_mem != last_bucket_mem
+				|| nodes_order != last_nodes_order || stop) {
+			rss_kb = read_rss_kb();
+			if (nodes > peak_nodes)
+				peak_nodes = nodes;
+			if (bucket_mem > peak_bucket_mem)
+				peak_bucket_mem = bucket_mem;
+			if (rss_kb > peak_rss_kb)
+				peak_rss_kb = rss_kb;
+			printf("%10llu %12lu %14lu %14lu %10lu %9d\n",
+				(unsigned long long) (now - start) / 1000000,
+				nodes, bucket_mem,
+				cds_lfht_bucket_resident_memory(test_ht),
+				rss_kb,
+				cds_lfht_resize_in_progress(test_ht));
+			last_bucket_mem = bucket_mem;
+			last_nodes_order = nodes_order;
+		}
+		if (stop)
+			break;
+		if (now - start >= (uint64_t) duration * 1000000000ULL) {
+			printf("Resize test stopped after %lu seconds.\n",
+				duration);
+			test_stop = 1;
+			break;
+		}
+		(void) poll(NULL, 0, 10);
+	}
+	if (filled)
+		drain_ns = now - filled;
+}
+
+/* Called with the writers joined, before the table is destroyed. */
+void test_hash_resize_end(void)
+{
+	int i, j;
+
+	cds_lfht_get_resize_stats(test_ht, &resize_stats);
+	end_rss_kb = read_rss_kb();
+	end_bucket_resident = cds_lfht_bucket_resident_memory(test_ht);
+	for (i = 0; i < NR_RESIZE_OPS; i++)
+		for (j = 0; j < 2; j++)
+			bench_hist_print(&tot_resize_hist.op[i][j],
+				"%s latency, %s", resize_op_name[i],
+				j ? "resizing" : "idle");
+	printf("Resize: fill %llu ms, drain %llu ms, %lu resizes, "
+		"%lu levels, %llu ms in partition_resize_helper\n",
+		(unsigned long long) fill_ns / 1000000,
+		(unsigned long long) drain_ns / 1000000,
+		resize_stats.nr_resizes, resize_stats.nr_levels,
+		(unsigned long long) resize_stats.helper_ns / 1000000);
+	printf("Memory (%s backend): peak %lu nodes, peak bucket memory "
+		"%lu bytes, %lu bytes resident at end, "
+		"RSS start %lu kB peak %lu kB end %lu kB\n",
+		memory_backend_name(), peak_nodes, peak_bucket_mem,
+		end_bucket_resident, start_rss_kb, peak_rss_kb, end_rss_kb);
+}
+
+void test_hash_resize_report(void)
+{
+	char key[32];
+	int i, j;
+
+	bench_report_string("memory_backend", memory_backend_name());
+	bench_report_u64("fill_ms", fill_ns / 1000000);
+	bench_report_u64("drain_ms", drain_ns / 1000000);
+	bench_report_u64("nr_resizes", resize_stats.nr_resizes);
+	bench_report_u64("nr_resize_levels", resize_stats.nr_levels);
+	bench_report_u64("resize_helper_ms", resize_stats.helper_ns / 1000000);
+	bench_report_u64("peak_nodes", peak_nodes);
+	bench_report_u64("peak_bucket_mem", peak_bucket_mem);
+	bench_report_u64("end_bucket_resident", end_bucket_resident);
+	bench_report_u64("start_rss_kb", start_rss_kb);
+	bench_report_u64("peak_rss_kb", peak_rss_kb);
+	bench_report_u64("end_rss_kb", end_rss_kb);
+	for (i = 0; i < NR_RESIZE_OPS; i++) {
+		for (j = 0; j < 2; j++) {
+			snprintf(key, sizeof(key), "%s_%s", resize_op_name[i],
+				j ? "resizing" : "idle");
+			bench_report_hist(key, &tot_resize_hist.op[i][j]);
+		}
+	}
+}
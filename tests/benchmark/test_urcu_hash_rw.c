@@ -64,6 +64,7 @@ void *test_hash_rw_thr_reader(void *_count)
 	unsigned long long *count = _count;
 	struct lfht_test_node *node;
 	struct cds_lfht_iter iter;
+	void *key;
 
 	printf_verbose("thread_begin %s, tid %lu\n",
 			"reader", urcu_get_thread_id());
@@ -71,6 +72,7 @@ void *test_hash_rw_thr_reader(void *_count)
 	URCU_TLS(rand_lookup) = urcu_get_thread_id() ^ time(NULL);
 
 	set_affinity();
+	bench_place_thread(BENCH_ROLE_READER);
 
 	rcu_register_thread();
 
@@ -80,10 +82,10 @@ void *test_hash_rw_thr_reader(void *_count)
 	cmm_smp_mb();
 
 	for (;;) {
+		key = test_pool_key(lookup_pool_size, lookup_pool_offset);
+		test_trace(BENCH_TRACE_LFHT_LOOKUP, key);
 		rcu_read_lock();
-		cds_lfht_test_lookup(test_ht,
-			(void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % lookup_pool_size) + lookup_pool_offset),
-			sizeof(void *), &iter);
+		cds_lfht_test_lookup(test_ht, key, sizeof(void *), &iter);
 		node = cds_lfht_iter_get_test_node(&iter);
 		if (node == NULL) {
 			if (validate_lookup) {
@@ -92,6 +94,7 @@ void *test_hash_rw_thr_reader(void *_count)
 			}
 			URCU_TLS(lookup_fail)++;
 		} else {
+			test_read_value(node);
 			URCU_TLS(lookup_ok)++;
 		}
 		rcu_debug_yield_read();
@@ -105,6 +108,7 @@ void *test_hash_rw_thr_reader(void *_count)
 			rcu_quiescent_state();
 	}
 
+	bench_trace_thread_end();
 	rcu_unregister_thread();
 
 	*count = URCU_TLS(nr_reads);
@@ -124,6 +128,10 @@ void *test_hash_rw_thr_writer(void *_count)
 	struct cds_lfht_node *ret_node;
 	struct cds_lfht_iter iter;
 	struct wr_count *count = _count;
+	unsigned long nr_lookup = 0;
+	cycles_t add_begin;
+	enum test_op op;
+	void *key;
 	int ret;
 
 	printf_verbose("thread_begin %s, tid %lu\n",
@@ -132,6 +140,7 @@ void *test_hash_rw_thr_writer(void *_count)
 	URCU_TLS(rand_lookup) = urcu_get_thread_id() ^ time(NULL);
 
 	set_affinity();
+	bench_place_thread(BENCH_ROLE_WRITER);
 
 	rcu_register_thread();
 
@@ -141,19 +150,41 @@ void *test_hash_rw_thr_writer(void *_count)
 	cmm_smp_mb();
 
 	for (;;) {
-		if ((addremove == AR_ADD || add_only)
-				|| (addremove == AR_RANDOM && rand_r(&URCU_TLS(rand_lookup)) & 1)) {
-			node = malloc(sizeof(struct lfht_test_node));
+		if (op_mix_total)
+			op = test_draw_op();
+		else if ((addremove == AR_ADD || add_only)
+				|| (addremove == AR_RANDOM && rand_r(&URCU_TLS(rand_lookup)) & 1))
+			op = add_replace && !add_unique ?
+				TEST_OP_REPLACE : TEST_OP_ADD;
+		else
+			op = TEST_OP_DEL;
+
+		if (op == TEST_OP_LOOKUP) {
+			key = test_pool_key(write_pool_size, write_pool_offset);
+			test_trace(BENCH_TRACE_LFHT_LOOKUP, key);
+			rcu_read_lock();
+			cds_lfht_test_lookup(test_ht, key, sizeof(void *), &iter);
+			node = cds_lfht_iter_get_test_node(&iter);
+			if (node)
+				test_read_value(node);
+			rcu_read_unlock();
+			nr_lookup++;
+		} else if (op != TEST_OP_DEL) {
+			node = test_node_alloc();
 			lfht_test_node_init(node,
-				(void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % write_pool_size) + write_pool_offset),
+				test_pool_key(write_pool_size, write_pool_offset),
 				sizeof(void *));
+			test_trace(op == TEST_OP_REPLACE ? BENCH_TRACE_LFHT_ADD_REPLACE :
+				(add_unique ? BENCH_TRACE_LFHT_ADD_UNIQUE :
+					BENCH_TRACE_LFHT_ADD), node->key);
+			add_begin = test_latency_begin();
 			rcu_read_lock();
-			if (add_unique) {
+			if (op == TEST_OP_ADD && add_unique) {
 				ret_node = cds_lfht_add_unique(test_ht,
 					test_hash(node->key, node->key_len, TEST_HASH_SEED),
 					test_match, node->key, &node->node);
 			} else {
-				if (add_replace)
+				if (op == TEST_OP_REPLACE)
 					ret_node = cds_lfht_add_replace(test_ht,
 							test_hash(node->key, node->key_len, TEST_HASH_SEED),
 							test_match, node->key, &node->node);
@@ -163,12 +194,13 @@ void *test_hash_rw_thr_writer(void *_count)
 						&node->node);
 			}
 			rcu_read_unlock();
-			if (add_unique && ret_node != &node->node) {
+			test_latency_end(&URCU_TLS(add_hist), add_begin);
+			if (op == TEST_OP_ADD && add_unique && ret_node != &node->node) {
 				free(node);
 				URCU_TLS(nr_addexist)++;
 			} else {
-				if (add_replace && ret_node) {
-					call_rcu(&to_test_node(ret_node)->head,
+				if (op == TEST_OP_REPLACE && ret_node) {
+					test_call_rcu(&to_test_node(ret_node)->head,
 							free_node_cb);
 					URCU_TLS(nr_addexist)++;
 				} else {
@@ -177,15 +209,15 @@ void *test_hash_rw_thr_writer(void *_count)
 			}
 		} else {
 			/* May delete */
+			key = test_pool_key(write_pool_size, write_pool_offset);
+			test_trace(BENCH_TRACE_LFHT_DEL, key);
 			rcu_read_lock();
-			cds_lfht_test_lookup(test_ht,
-				(void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % write_pool_size) + write_pool_offset),
-				sizeof(void *), &iter);
+			cds_lfht_test_lookup(test_ht, key, sizeof(void *), &iter);
 			ret = cds_lfht_del(test_ht, cds_lfht_iter_get_node(&iter));
 			rcu_read_unlock();
 			if (ret == 0) {
 				node = cds_lfht_iter_get_test_node(&iter);
-				call_rcu(&node->head, free_node_cb);
+				test_call_rcu(&node->head, free_node_cb);
 				URCU_TLS(nr_del)++;
 			} else
 				URCU_TLS(nr_delnoent)++;
@@ -211,6 +243,9 @@ void *test_hash_rw_thr_writer(void *_count)
 			rcu_quiescent_state();
 	}
 
+	test_hash_latency_thread_end();
+	bench_trace_thread_end();
+	cds_lfht_reclaim_flush();
 	rcu_unregister_thread();
 
 	printf_verbose("thread_end %s, tid %lu\n",
@@ -225,9 +260,42 @@ void *test_hash_rw_thr_writer(void *_count)
 	count->add = URCU_TLS(nr_add);
 	count->add_exist = URCU_TLS(nr_addexist);
 	count->remove = URCU_TLS(nr_del);
+	count->lookup = nr_lookup;
 	return ((void*)2);
 }
 
+static
+int test_hash_rw_bulk_populate_hash(void)
+{
+	struct lfht_test_node *node;
+	struct cds_lfht_node **nodes;
+	unsigned long *hashes;
+	unsigned long i;
+
+	nodes = malloc(sizeof(*nodes) * init_populate);
+	hashes = malloc(sizeof(*hashes) * init_populate);
+	if (!nodes || !hashes) {
+		perror("malloc");
+		exit(-1);
+	}
+	for (i = 0; i < init_populate; i++) {
+		node = test_node_alloc();
+		lfht_test_node_init(node,
+			(void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % init_pool_size) + init_pool_offset),
+			sizeof(void *));
+		nodes[i] = &node->node;
+		hashes[i] = test_hash(node->key, node->key_len, TEST_HASH_SEED);
+		test_trace(BENCH_TRACE_LFHT_ADD, node->key);
+	}
+	/* The hash table is not visible to the test threads yet. */
+	cds_lfht_bulk_load(test_ht, hashes, nodes, init_populate);
+	URCU_TLS(nr_add) += init_populate;
+	URCU_TLS(nr_writes) += init_populate;
+	free(hashes);
+	free(nodes);
+	return 0;
+}
+
 int test_hash_rw_populate_hash(void)
 {
 	struct lfht_test_node *node;
@@ -246,11 +314,17 @@ int test_hash_rw_populate_hash(void)
 "larger random pool (-p option). This may take a while...\n", init_populate, init_pool_size);
 	}
 
+	if (opt_bulk_populate && !add_unique && !add_replace)
+		return test_hash_rw_bulk_populate_hash();
+
 	while (URCU_TLS(nr_add) < init_populate) {
-		node = malloc(sizeof(struct lfht_test_node));
+		node = test_node_alloc();
 		lfht_test_node_init(node,
 			(void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % init_pool_size) + init_pool_offset),
 			sizeof(void *));
+		test_trace(add_unique ? BENCH_TRACE_LFHT_ADD_UNIQUE :
+			(add_replace ? BENCH_TRACE_LFHT_ADD_REPLACE :
+				BENCH_TRACE_LFHT_ADD), node->key);
 		rcu_read_lock();
 		if (add_unique) {
 			ret_node = cds_lfht_add_unique(test_ht,
@@ -272,7 +346,9 @@ int test_hash_rw_populate_hash(void)
 			URCU_TLS(nr_addexist)++;
 		} else {
 			if (add_replace && ret_node) {
-				call_rcu(&to_test_node(ret_node)->head, free_node_cb);
+				if (!opt_reclaim)
+					call_rcu(&to_test_node(ret_node)->head,
+							free_node_cb);
 				URCU_TLS(nr_addexist)++;
 			} else {
 				URCU_TLS(nr_add)++;
@@ -0,0 +1,649 @@
+/*
+ * test_urcu_hash_shard.c
+ *
+ * Userspace RCU library - example sharded RCU-based lock-free hash table
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/hash.h>
+#include <urcu/rculfhash-shard.h>
+
+#define TEST_HASH_SEED	0x42UL
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_lookups);
+static DEFINE_URCU_TLS(unsigned long long, nr_hits);
+static DEFINE_URCU_TLS(unsigned long long, nr_iterations);
+static DEFINE_URCU_TLS(unsigned long long, nr_adds);
+static DEFINE_URCU_TLS(unsigned long long, nr_replaces);
+static DEFINE_URCU_TLS(unsigned long long, nr_dels);
+static DEFINE_URCU_TLS(unsigned long long, nr_resizes);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+static unsigned long nr_shards = 16;
+static unsigned long init_size = 64;	/* buckets per shard */
+static unsigned long key_range = 65536;
+static unsigned long iterate_period;	/* lookups per iteration, 0: none */
+static unsigned long resize_period;	/* writes per resize, 0: none */
+static int auto_resize;
+
+/* Published nodes freed, and inconsistencies seen. */
+static unsigned long nr_freed, nr_errors;
+
+struct test_node {
+	struct cds_lfht_node node;
+	unsigned long key;
+	int a;
+	struct rcu_head head;
+};
+
+static struct cds_lfht_shard *test_sh;
+
+static
+unsigned long test_hash(unsigned long key)
+{
+	return cds_hash_u64(key, TEST_HASH_SEED);
+}
+
+static
+int test_match(struct cds_lfht_node *node, const void *key)
+{
+	struct test_node *tn = caa_container_of(node, struct test_node, node);
+
+	return tn->key == *(const unsigned long *) key;
+}
+
+static
+void free_node_cb(struct rcu_head *head)
+{
+	struct test_node *tn = caa_container_of(head, struct test_node, head);
+
+	tn->a = 0;
+	free(tn);
+	uatomic_inc(&nr_freed);
+}
+
+static
+void test_error(const char *msg, unsigned long key)
+{
+	if (!uatomic_read(&nr_errors))
+		printf("[ERROR] %s, key %lu\n", msg, key);
+	uatomic_inc(&nr_errors);
+}
+
+/* A node found must be alive, and linked in the shard of its hash. */
+static
+void check_node(struct cds_lfht_node *node)
+{
+	struct test_node *tn = caa_container_of(node, struct test_node, node);
+
+	if (CMM_LOAD_SHARED(tn->a) != 8)
+		test_error("node freed while reachable", tn->key);
+	if (cds_lfht_shard_of_node(test_sh, node)
+			!= cds_lfht_shard_of(test_sh, test_hash(tn->key)))
+		test_error("node in the wrong shard", tn->key);
+}
+
+void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		struct cds_lfht_shard_iter shard_iter;
+		struct cds_lfht_node *node;
+		struct cds_lfht_iter iter;
+		unsigned long key = rand_r(&seed) % key_range;
+
+		rcu_read_lock();
+		cds_lfht_shard_lookup(test_sh, test_hash(key), test_match,
+				&key, &iter);
+		node = cds_lfht_iter_get_node(&iter);
+		if (node) {
+			if (caa_container_of(node, struct test_node,
+					node)->key != key)
+				test_error("lookup of a different key", key);
+			check_node(node);
+			URCU_TLS(nr_hits)++;
+		}
+		if (iterate_period && !(URCU_TLS(nr_lookups)
+				% iterate_period)) {
+			cds_lfht_shard_for_each(test_sh, &shard_iter, node)
+				check_node(node);
+			URCU_TLS(nr_iterations)++;
+		}
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		rcu_read_unlock();
+
+		URCU_TLS(nr_lookups)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_unregister_thread();
+	printf_verbose("reader thread_end, tid %lu, "
+			"lookups %llu, hits %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_lookups),
+			URCU_TLS(nr_hits));
+	count[0] = URCU_TLS(nr_lookups);
+	count[1] = URCU_TLS(nr_hits);
+	count[2] = URCU_TLS(nr_iterations);
+	return ((void*)1);
+}
+
+void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	unsigned long long nr_writes = 0;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		unsigned long key = rand_r(&seed) % key_range;
+		struct cds_lfht_node *ret_node;
+		struct cds_lfht_iter iter;
+		struct test_node *tn;
+
+		switch (rand_r(&seed) % 3) {
+		case 0:		/* add unique */
+		case 1:		/* add replace */
+			tn = malloc(sizeof(*tn));
+			if (!tn)
+				break;
+			cds_lfht_node_init(&tn->node);
+			tn->key = key;
+			tn->a = 8;
+			rcu_read_lock();
+			if (rand_r(&seed) & 1) {
+				ret_node = cds_lfht_shard_add_unique(test_sh,
+						test_hash(key), test_match,
+						&key, &tn->node);
+				if (ret_node != &tn->node) {
+					free(tn);
+				} else {
+					URCU_TLS(nr_adds)++;
+				}
+			} else {
+				ret_node = cds_lfht_shard_add_replace(test_sh,
+						test_hash(key), test_match,
+						&key, &tn->node);
+				if (ret_node) {
+					call_rcu(&caa_container_of(ret_node,
+						struct test_node, node)->head,
+						free_node_cb);
+					URCU_TLS(nr_replaces)++;
+				} else {
+					URCU_TLS(nr_adds)++;
+				}
+			}
+			rcu_read_unlock();
+			break;
+		case 2:		/* del */
+			rcu_read_lock();
+			cds_lfht_shard_lookup(test_sh, test_hash(key),
+					test_match, &key, &iter);
+			ret_node = cds_lfht_iter_get_node(&iter);
+			if (ret_node && !cds_lfht_shard_del(test_sh,
+					ret_node)) {
+				call_rcu(&caa_container_of(ret_node,
+					struct test_node, node)->head,
+					free_node_cb);
+				URCU_TLS(nr_dels)++;
+			}
+			rcu_read_unlock();
+			break;
+		}
+		nr_writes++;
+		if (resize_period && !(nr_writes % resize_period)) {
+			cds_lfht_shard_resize(test_sh,
+				1UL << (rand_r(&seed) % 12));
+			URCU_TLS(nr_resizes)++;
+		}
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+		if (caa_unlikely(!test_duration_write()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	count[0] = URCU_TLS(nr_adds);
+	count[1] = URCU_TLS(nr_replaces);
+	count[2] = URCU_TLS(nr_dels);
+	count[3] = URCU_TLS(nr_resizes);
+	printf_verbose("writer thread_end, tid %lu, "
+			"adds %llu replaces %llu dels %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_adds), URCU_TLS(nr_replaces),
+			URCU_TLS(nr_dels));
+	return ((void*)2);
+}
+
+/*
+ * Check that each key is present at most once, and in its shard, then
+ * empty the table.
+ */
+void test_end(unsigned long *nr_end)
+{
+	struct cds_lfht_shard_iter shard_iter;
+	struct cds_lfht_node *node;
+	struct test_node *tn;
+	char *seen;
+
+	seen = calloc(key_range, 1);
+	if (!seen)
+		exit(1);
+	rcu_read_lock();
+	cds_lfht_shard_for_each(test_sh, &shard_iter, node) {
+		tn = caa_container_of(node, struct test_node, node);
+		check_node(node);
+		if (seen[tn->key]++)
+			test_error("duplicate key", tn->key);
+		if (!cds_lfht_shard_del(test_sh, node)) {
+			call_rcu(&tn->head, free_node_cb);
+			(*nr_end)++;
+		}
+	}
+	rcu_read_unlock();
+	free(seen);
+}
+
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-c duration] (reader C.S. duration (in loops))\n");
+	printf("	[-s shards] (number of shards, power of two, default 16)\n");
+	printf("	[-h size] (initial buckets per shard, default 64)\n");
+	printf("	[-k range] (key range, default 65536)\n");
+	printf("	[-A] (automatic resize of the shards)\n");
+	printf("	[-R period] (resize all shards every period writes)\n");
+	printf("	[-I period] (iterate the table every period lookups)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader, *count_writer;
+	unsigned long long tot_lookups = 0, tot_hits = 0, tot_iterations = 0;
+	unsigned long long tot_adds = 0, tot_replaces = 0, tot_dels = 0,
+		tot_resizes = 0;
+	unsigned long count, end_dels = 0;
+	long before, after;
+	int i, a, retval = 0;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 's':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_shards = atol(argv[++i]);
+			break;
+		case 'h':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			init_size = atol(argv[++i]);
+			break;
+		case 'k':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			key_range = atol(argv[++i]);
+			if (!key_range) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'A':
+			auto_resize = 1;
+			break;
+		case 'R':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			resize_period = atol(argv[++i]);
+			break;
+		case 'I':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			iterate_period = atol(argv[++i]);
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, "
+		       "%u writers.\n",
+		       duration, nr_readers, nr_writers);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("Shards : %lu, initial size %lu, key range %lu.\n",
+		       nr_shards, init_size, key_range);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, 3 * sizeof(*count_reader));
+	count_writer = calloc(nr_writers, 4 * sizeof(*count_writer));
+
+	err = create_all_cpu_call_rcu_data(0);
+	if (err) {
+		printf("Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+	}
+
+	test_sh = cds_lfht_shard_new(nr_shards, init_size, 1, 0,
+			CDS_LFHT_ACCOUNTING
+			| (auto_resize ? CDS_LFHT_AUTO_RESIZE : 0), NULL);
+	if (!test_sh) {
+		printf("Error allocating %lu shards of %lu buckets.\n",
+			nr_shards, init_size);
+		return -1;
+	}
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[3 * i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[4 * i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_lookups += count_reader[3 * i];
+		tot_hits += count_reader[3 * i + 1];
+		tot_iterations += count_reader[3 * i + 2];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_adds += count_writer[4 * i];
+		tot_replaces += count_writer[4 * i + 1];
+		tot_dels += count_writer[4 * i + 2];
+		tot_resizes += count_writer[4 * i + 3];
+	}
+
+	rcu_register_thread();
+	rcu_read_lock();
+	cds_lfht_shard_count_nodes(test_sh, &before, &count, &after);
+	rcu_read_unlock();
+	if (count != tot_adds - tot_dels) {
+		printf("WARNING! %lu nodes in the table, %llu adds - "
+		       "%llu dels.\n", count, tot_adds, tot_dels);
+		retval = 1;
+	}
+	test_end(&end_dels);
+	rcu_unregister_thread();
+
+	err = cds_lfht_shard_destroy(test_sh, NULL);
+	if (err) {
+		printf("WARNING! cds_lfht_shard_destroy: %d\n", err);
+		retval = 1;
+	}
+	/* Flush the reclaim of the removed nodes. */
+	rcu_barrier();
+
+	printf_verbose("total number of lookups : %llu, hits %llu\n",
+		       tot_lookups, tot_hits);
+	printf_verbose("total number of adds : %llu, replaces %llu, "
+		       "dels %llu\n", tot_adds, tot_replaces, tot_dels);
+	printf("SUMMARY %-25s testdur %4lu nr_writers %3u wdelay %6lu "
+		"nr_readers %3u rdur %6lu nr_shards %lu key_range %lu "
+		"nr_lookups %12llu nr_hits %12llu nr_iterations %llu "
+		"nr_adds %12llu nr_replaces %12llu nr_dels %12llu "
+		"nr_resizes %llu end_dels %lu nr_ops %12llu\n",
+		argv[0], duration, nr_writers, wdelay,
+		nr_readers, rduration, nr_shards, key_range,
+		tot_lookups, tot_hits, tot_iterations,
+		tot_adds, tot_replaces, tot_dels, tot_resizes, end_dels,
+		tot_lookups + tot_adds + tot_replaces + tot_dels);
+	if (end_dels != tot_adds - tot_dels) {
+		printf("WARNING! Discrepancy between nr adds - dels %llu vs "
+		       "end dels %lu.\n", tot_adds - tot_dels, end_dels);
+		retval = 1;
+	}
+	if (nr_freed != tot_adds + tot_replaces) {
+		printf("WARNING! %lu nodes freed, %llu published.\n",
+		       nr_freed, tot_adds + tot_replaces);
+		retval = 1;
+	}
+	if (nr_errors) {
+		printf("WARNING! %lu inconsistent nodes seen.\n", nr_errors);
+		retval = 1;
+	}
+	free_all_cpu_call_rcu_data();
+	free(count_reader);
+	free(count_writer);
+	free(tid_reader);
+	free(tid_writer);
+	return retval;
+}
@@ -0,0 +1,750 @@
+/*
+ * test_urcu_hash_snapshot.c
+ *
+ * Userspace RCU library - example versioned RCU-based hash table
+ *                         snapshots
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/hash.h>
+#include <urcu/rculfhash.h>
+#include <urcu/rculfhash-snapshot.h>
+
+#define TEST_HASH_SEED	0x42UL
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+/* snapshot hold duration, in loops */
+static unsigned long sduration;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_lookups);
+static DEFINE_URCU_TLS(unsigned long long, nr_hits);
+static DEFINE_URCU_TLS(unsigned long long, nr_snapshots);
+static DEFINE_URCU_TLS(unsigned long long, nr_moves);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+static unsigned int nr_snapshotters = 1;
+
+static unsigned long init_size = 64;
+
+/*
+ * Writer w owns the keys w * key_range to (w + 1) * key_range - 1, half
+ * of them in the table. Each move adds one of its absent keys, then
+ * deletes one of its present keys: a snapshot holds key_range / 2 keys
+ * of each writer, or one more when it closes a generation between the
+ * two updates of a move.
+ */
+static unsigned long key_range = 128;
+
+struct test_node {
+	struct cds_lfht_vnode vnode;
+	unsigned long key;
+};
+
+static struct cds_lfht *test_ht;
+static struct cds_lfht_versioned test_vt;
+
+/* Nodes of each writer, by key, NULL for the absent keys. */
+static struct test_node **writer_nodes;
+static unsigned int next_writer;
+
+/* Nodes allocated and reclaimed, inconsistencies. */
+static unsigned long nr_allocated, nr_reclaimed, nr_errors;
+
+static
+unsigned long test_hash(unsigned long key)
+{
+	return cds_hash_u64(key, TEST_HASH_SEED);
+}
+
+static
+int test_match(struct cds_lfht_node *node, const void *key)
+{
+	struct test_node *tn = caa_container_of(node, struct test_node,
+			vnode.node);
+
+	return tn->key == *(const unsigned long *) key;
+}
+
+static
+void reclaim_node(struct cds_lfht_node *node, void *priv)
+{
+	struct test_node *tn = caa_container_of(node, struct test_node,
+			vnode.node);
+
+	free(tn);
+	uatomic_inc(&nr_reclaimed);
+}
+
+static
+void report_error(const char *msg, unsigned long a, unsigned long b)
+{
+	if (!uatomic_read(&nr_errors))
+		printf("[ERROR] %s: %lu, %lu\n", msg, a, b);
+	uatomic_inc(&nr_errors);
+}
+
+static
+struct test_node *add_node(unsigned long key)
+{
+	struct test_node *tn;
+	struct cds_lfht_node *ret;
+
+	tn = malloc(sizeof(*tn));
+	if (!tn)
+		exit(1);
+	tn->key = key;
+	uatomic_inc(&nr_allocated);
+	rcu_read_lock();
+	ret = cds_lfht_vadd_unique(&test_vt, test_hash(key), test_match,
+			&key, &tn->vnode);
+	rcu_read_unlock();
+	/* The deleted nodes still linked must not count as present. */
+	if (ret != &tn->vnode.node) {
+		report_error("key already present (key, generation)",
+			key, CMM_LOAD_SHARED(test_vt.gen));
+		free(tn);
+		uatomic_dec(&nr_allocated);
+		return NULL;
+	}
+	return tn;
+}
+
+static
+void del_node(struct test_node *tn)
+{
+	rcu_read_lock();
+	if (cds_lfht_vdel(&test_vt, &tn->vnode))
+		report_error("node already deleted (key, generation)",
+			tn->key, tn->vnode.del_gen);
+	else if (cds_lfht_vdel(&test_vt, &tn->vnode) != -ENOENT)
+		report_error("node deleted twice (key, generation)",
+			tn->key, tn->vnode.del_gen);
+	rcu_read_unlock();
+}
+
+static
+unsigned long pick_key(struct test_node **nodes, unsigned int *seed,
+		bool present)
+{
+	unsigned long i;
+
+	do {
+		i = rand_r(seed) % key_range;
+	} while ((nodes[i] != NULL) != present);
+	return i;
+}
+
+void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+	struct test_node *tn;
+	unsigned long key;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		key = rand_r(&seed) % key_range;
+		if (nr_writers)
+			key += (rand_r(&seed) % nr_writers) * key_range;
+		rcu_read_lock();
+		cds_lfht_vlookup(&test_vt, test_hash(key), test_match, &key,
+				&iter);
+		node = cds_lfht_iter_get_node(&iter);
+		if (node) {
+			tn = caa_container_of(node, struct test_node,
+					vnode.node);
+			if (tn->key != key)
+				report_error("lookup mismatch (key, found)",
+					key, tn->key);
+			URCU_TLS(nr_hits)++;
+		}
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		rcu_read_unlock();
+		URCU_TLS(nr_lookups)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_unregister_thread();
+	printf_verbose("reader thread_end, tid %lu, "
+			"lookups %llu, hits %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_lookups), URCU_TLS(nr_hits));
+	count[0] = URCU_TLS(nr_lookups);
+	count[1] = URCU_TLS(nr_hits);
+	return ((void*)1);
+}
+
+/*
+ * Traverse a snapshot, counting its keys per writer and checking for
+ * duplicates. Returns a checksum of the keys.
+ */
+static
+unsigned long snapshot_count(struct cds_lfht_snapshot *snap,
+		unsigned char *seen, unsigned long *counts)
+{
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+	struct test_node *tn;
+	unsigned long sum = 0;
+
+	memset(seen, 0, key_range * nr_writers);
+	memset(counts, 0, nr_writers * sizeof(*counts));
+	rcu_read_lock();
+	cds_lfht_for_each_snapshot(&test_vt, snap, &iter, node) {
+		tn = caa_container_of(node, struct test_node, vnode.node);
+		if (!cds_lfht_snapshot_visible(snap, &tn->vnode)) {
+			report_error("node not in the snapshot (key, "
+				"generation)", tn->key, snap->gen);
+			continue;
+		}
+		if (tn->key >= key_range * nr_writers) {
+			report_error("unknown key (key, generation)",
+				tn->key, snap->gen);
+			continue;
+		}
+		if (seen[tn->key]++)
+			report_error("duplicate key (key, generation)",
+				tn->key, snap->gen);
+		counts[tn->key / key_range]++;
+		sum += test_hash(tn->key);
+	}
+	rcu_read_unlock();
+	return sum;
+}
+
+void *thr_snapshot(void *_count)
+{
+	unsigned long long *count = _count;
+	struct cds_lfht_snapshot snap;
+	unsigned long *counts, *recounts, sum;
+	unsigned char *seen;
+	unsigned int i;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"snapshot", urcu_get_thread_id());
+
+	set_affinity();
+
+	seen = malloc(key_range * nr_writers);
+	counts = calloc(nr_writers, sizeof(*counts));
+	recounts = calloc(nr_writers, sizeof(*recounts));
+	if (!seen || !counts || !recounts)
+		exit(1);
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		cds_lfht_snapshot_take(&test_vt, &snap);
+		sum = snapshot_count(&snap, seen, counts);
+		for (i = 0; i < nr_writers; i++) {
+			if (counts[i] != key_range / 2
+					&& counts[i] != key_range / 2 + 1)
+				report_error("wrong key count (writer, count)",
+					i, counts[i]);
+		}
+		/* Let the deletions of later generations pile up. */
+		if (caa_unlikely(sduration))
+			loop_sleep(sduration);
+		/* A snapshot does not change while it is held. */
+		if (snapshot_count(&snap, seen, recounts) != sum
+				|| memcmp(counts, recounts,
+					nr_writers * sizeof(*counts)))
+			report_error("snapshot changed (generation, sum)",
+				snap.gen, sum);
+		cds_lfht_snapshot_release(&test_vt, &snap);
+		URCU_TLS(nr_snapshots)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_unregister_thread();
+	free(recounts);
+	free(counts);
+	free(seen);
+	printf_verbose("snapshot thread_end, tid %lu, snapshots %llu\n",
+			urcu_get_thread_id(), URCU_TLS(nr_snapshots));
+	count[0] = URCU_TLS(nr_snapshots);
+	return ((void*)1);
+}
+
+void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	struct test_node **nodes, *tn;
+	unsigned long base, add, del;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	base = (uatomic_add_return(&next_writer, 1) - 1) * key_range;
+	nodes = &writer_nodes[base];
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		add = pick_key(nodes, &seed, false);
+		del = pick_key(nodes, &seed, true);
+		tn = add_node(base + add);
+		if (tn) {
+			nodes[add] = tn;
+			del_node(nodes[del]);
+			nodes[del] = NULL;
+		}
+		URCU_TLS(nr_moves)++;
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+		if (caa_unlikely(!test_duration_write()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	count[0] = URCU_TLS(nr_moves);
+	printf_verbose("writer thread_end, tid %lu, moves %llu\n",
+			urcu_get_thread_id(), URCU_TLS(nr_moves));
+	return ((void*)2);
+}
+
+/* Check the final table and remove its nodes, with a last snapshot. */
+static
+void test_end(unsigned long *nr_end)
+{
+	struct cds_lfht_snapshot snap;
+	unsigned char *seen;
+	unsigned long *counts, i;
+	int ret;
+
+	seen = malloc(key_range * nr_writers);
+	counts = calloc(nr_writers, sizeof(*counts));
+	if (!seen || !counts)
+		exit(1);
+	cds_lfht_snapshot_take(&test_vt, &snap);
+	for (i = 0; i < key_range * nr_writers; i++) {
+		if (writer_nodes[i]) {
+			del_node(writer_nodes[i]);
+			(*nr_end)++;
+		}
+	}
+	/* The snapshot holds the deleted nodes. */
+	ret = cds_lfht_versioned_fini(&test_vt);
+	if (ret != -EBUSY)
+		report_error("versioned mode left with a snapshot (ret, "
+			"generation)", (unsigned long) ret, snap.gen);
+	(void) snapshot_count(&snap, seen, counts);
+	for (i = 0; i < nr_writers; i++) {
+		if (counts[i] != key_range / 2)
+			report_error("wrong final key count (writer, count)",
+				i, counts[i]);
+	}
+	cds_lfht_snapshot_release(&test_vt, &snap);
+	ret = cds_lfht_versioned_fini(&test_vt);
+	if (ret)
+		report_error("versioned mode not left (ret, generation)",
+			(unsigned long) ret, snap.gen);
+	free(counts);
+	free(seen);
+}
+
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-c duration] (reader C.S. duration (in loops))\n");
+	printf("	[-s nr] (snapshot threads, default 1)\n");
+	printf("	[-S duration] (snapshot hold duration (in loops))\n");
+	printf("	[-k range] (keys per writer, default 128)\n");
+	printf("	[-h size] (initial number of buckets, default 64)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer, *tid_snapshot;
+	void *tret;
+	unsigned long long *count_reader, *count_writer, *count_snapshot;
+	unsigned long long tot_lookups = 0, tot_hits = 0, tot_moves = 0,
+		tot_snapshots = 0;
+	unsigned long n, nr_end = 0;
+	unsigned int w;
+	int i, a, retval = 0;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 's':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_snapshotters = atoi(argv[++i]);
+			break;
+		case 'S':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			sduration = atol(argv[++i]);
+			break;
+		case 'k':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			key_range = atol(argv[++i]);
+			/* Each move needs a present and an absent key. */
+			if (key_range < 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'h':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			init_size = atol(argv[++i]);
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, "
+		       "%u writers, %u snapshot threads.\n",
+		       duration, nr_readers, nr_writers, nr_snapshotters);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("Snapshot hold duration : %lu loops.\n", sduration);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	tid_snapshot = calloc(nr_snapshotters, sizeof(*tid_snapshot));
+	count_reader = calloc(nr_readers, 2 * sizeof(*count_reader));
+	count_writer = calloc(nr_writers, sizeof(*count_writer));
+	count_snapshot = calloc(nr_snapshotters, sizeof(*count_snapshot));
+	writer_nodes = calloc(key_range * nr_writers, sizeof(*writer_nodes));
+	if ((nr_writers && !writer_nodes) || !tid_snapshot || !count_snapshot)
+		exit(1);
+
+	err = create_all_cpu_call_rcu_data(0);
+	if (err) {
+		printf("Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+	}
+
+	test_ht = cds_lfht_new(init_size, 1, 0,
+			CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING, NULL);
+	if (!test_ht)
+		exit(1);
+	cds_lfht_set_reclaim(test_ht, reclaim_node, NULL);
+	cds_lfht_versioned_init(&test_vt, test_ht);
+
+	/* Populate the even keys of each writer. */
+	rcu_register_thread();
+	for (w = 0; w < nr_writers; w++) {
+		for (n = 0; n < key_range / 2; n++) {
+			unsigned long key = w * key_range + 2 * n;
+
+			writer_nodes[key] = add_node(key);
+		}
+	}
+	rcu_unregister_thread();
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[2 * i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_snapshotters; i++) {
+		err = pthread_create(&tid_snapshot[i], NULL, thr_snapshot,
+				     &count_snapshot[i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_lookups += count_reader[2 * i];
+		tot_hits += count_reader[2 * i + 1];
+	}
+	for (i = 0; i < nr_snapshotters; i++) {
+		err = pthread_join(tid_snapshot[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_snapshots += count_snapshot[i];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_moves += count_writer[i];
+	}
+
+	rcu_register_thread();
+	test_end(&nr_end);
+	cds_lfht_reclaim_flush();
+	err = cds_lfht_destroy(test_ht, NULL);
+	if (err) {
+		printf("WARNING! cds_lfht_destroy: %d\n", err);
+		retval = 1;
+	}
+	rcu_unregister_thread();
+	/* Flush the reclaim of the removed nodes. */
+	rcu_barrier();
+
+	printf_verbose("total number of lookups : %llu, hits %llu\n",
+		       tot_lookups, tot_hits);
+	printf("SUMMARY %-25s testdur %4lu nr_writers %3u wdelay %6lu "
+		"nr_readers %3u rdur %6lu nr_snapshotters %3u sdur %6lu "
+		"key_range %lu nr_lookups %12llu nr_hits %12llu "
+		"nr_snapshots %12llu nr_moves %12llu end_dels %lu "
+		"nr_ops %12llu\n",
+		argv[0], duration, nr_writers, wdelay,
+		nr_readers, rduration, nr_snapshotters, sduration,
+		key_range, tot_lookups, tot_hits,
+		tot_snapshots, tot_moves, nr_end,
+		tot_lookups + tot_snapshots + tot_moves);
+	if (nr_end != nr_writers * (key_range / 2)) {
+		printf("WARNING! %lu nodes left, %lu expected.\n",
+		       nr_end, nr_writers * (key_range / 2));
+		retval = 1;
+	}
+	if (nr_reclaimed != nr_allocated) {
+		printf("WARNING! %lu nodes reclaimed, %lu allocated.\n",
+		       nr_reclaimed, nr_allocated);
+		retval = 1;
+	}
+	if (nr_errors) {
+		printf("WARNING! %lu inconsistencies seen.\n", nr_errors);
+		retval = 1;
+	}
+	free_all_cpu_call_rcu_data();
+	free(writer_nodes);
+	free(count_snapshot);
+	free(count_reader);
+	free(count_writer);
+	free(tid_snapshot);
+	free(tid_reader);
+	free(tid_writer);
+	return retval;
+}
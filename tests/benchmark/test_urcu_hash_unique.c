@@ -69,6 +69,7 @@ void *test_hash_unique_thr_reader(void *_count)
 	URCU_TLS(rand_lookup) = urcu_get_thread_id() ^ time(NULL);
 
 	set_affinity();
+	bench_place_thread(BENCH_ROLE_READER);
 
 	rcu_register_thread();
 
@@ -125,6 +126,7 @@ void *test_hash_unique_thr_writer(void *_count)
 	struct cds_lfht_node *ret_node;
 	struct cds_lfht_iter iter;
 	struct wr_count *count = _count;
+	cycles_t add_begin;
 	int ret;
 	int loc_add_unique;
 
@@ -134,6 +136,7 @@ void *test_hash_unique_thr_writer(void *_count)
 	URCU_TLS(rand_lookup) = urcu_get_thread_id() ^ time(NULL);
 
 	set_affinity();
+	bench_place_thread(BENCH_ROLE_WRITER);
 
 	rcu_register_thread();
 
@@ -148,10 +151,11 @@ void *test_hash_unique_thr_writer(void *_count)
 		 */
 		if (1 || (addremove == AR_ADD || add_only)
 				|| (addremove == AR_RANDOM && rand_r(&URCU_TLS(rand_lookup)) & 1)) {
-			node = malloc(sizeof(struct lfht_test_node));
+			node = test_node_alloc();
 			lfht_test_node_init(node,
-				(void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % write_pool_size) + write_pool_offset),
+				test_pool_key(write_pool_size, write_pool_offset),
 				sizeof(void *));
+			add_begin = test_latency_begin();
 			rcu_read_lock();
 			loc_add_unique = rand_r(&URCU_TLS(rand_lookup)) & 1;
 			if (loc_add_unique) {
@@ -170,6 +174,7 @@ void *test_hash_unique_thr_writer(void *_count)
 #endif //0
 			}
 			rcu_read_unlock();
+			test_latency_end(&URCU_TLS(add_hist), add_begin);
 			if (loc_add_unique) {
 				if (ret_node != &node->node) {
 					free(node);
@@ -179,7 +184,7 @@ void *test_hash_unique_thr_writer(void *_count)
 				}
 			} else {
 				if (ret_node) {
-					call_rcu(&to_test_node(ret_node)->head,
+					test_call_rcu(&to_test_node(ret_node)->head,
 							free_node_cb);
 					URCU_TLS(nr_addexist)++;
 				} else {
@@ -190,13 +195,13 @@ void *test_hash_unique_thr_writer(void *_count)
 			/* May delete */
 			rcu_read_lock();
 			cds_lfht_test_lookup(test_ht,
-				(void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % write_pool_size) + write_pool_offset),
+				test_pool_key(write_pool_size, write_pool_offset),
 				sizeof(void *), &iter);
 			ret = cds_lfht_del(test_ht, cds_lfht_iter_get_node(&iter));
 			rcu_read_unlock();
 			if (ret == 0) {
 				node = cds_lfht_iter_get_test_node(&iter);
-				call_rcu(&node->head, free_node_cb);
+				test_call_rcu(&node->head, free_node_cb);
 				URCU_TLS(nr_del)++;
 			} else
 				URCU_TLS(nr_delnoent)++;
@@ -222,6 +227,8 @@ void *test_hash_unique_thr_writer(void *_count)
 			rcu_quiescent_state();
 	}
 
+	test_hash_latency_thread_end();
+	cds_lfht_reclaim_flush();
 	rcu_unregister_thread();
 
 	printf_verbose("thread_end %s, tid %lu\n",
@@ -258,7 +265,7 @@ int test_hash_unique_populate_hash(void)
 	}
 
 	while (URCU_TLS(nr_add) < init_populate) {
-		node = malloc(sizeof(struct lfht_test_node));
+		node = test_node_alloc();
 		lfht_test_node_init(node,
 			(void *)(((unsigned long) rand_r(&URCU_TLS(rand_lookup)) % init_pool_size) + init_pool_offset),
 			sizeof(void *));
@@ -268,7 +275,9 @@ int test_hash_unique_populate_hash(void)
 				test_match, node->key, &node->node);
 		rcu_read_unlock();
 		if (ret_node) {
-			call_rcu(&to_test_node(ret_node)->head, free_node_cb);
+			if (!opt_reclaim)
+				call_rcu(&to_test_node(ret_node)->head,
+						free_node_cb);
 			URCU_TLS(nr_addexist)++;
 		} else {
 			URCU_TLS(nr_add)++;
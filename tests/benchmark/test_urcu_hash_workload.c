@@ -0,0 +1,334 @@
+/*
+ * test_urcu_hash_workload.c
+ *
+ * Userspace RCU library - test program, key distributions and
+ * operation mixes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <math.h>
+#include "test_urcu_hash.h"
+
+/*
+ * Skewed distributions draw a rank within the pool, rank 0 being the
+ * most accessed key, mapped to the key offset + rank. With --key-shift,
+ * the mapping is rotated by 1/KEY_SHIFT_STEPS of the pool every period,
+ * so the hot keys of a period become cold ones.
+ */
+#define KEY_SHIFT_STEPS		16
+
+/* Draws between two reads of the clock by a thread, with --key-shift. */
+#define KEY_SHIFT_CLOCK_DRAWS	256
+
+/* Pool size from which zeta(n) is approximated by an integral. */
+#define ZETA_EXACT_MAX		(1UL << 20)
+
+enum test_key_dist key_dist;
+unsigned long key_shift_ms;
+static double zipf_theta = 0.99;
+static double hotspot_fraction = 0.01, hotspot_prob = 0.9;
+static uint64_t key_shift_start_ns;
+
+unsigned int op_mix[NR_TEST_OPS];
+unsigned int op_mix_total;
+static const char *op_name[NR_TEST_OPS] = {
+	[TEST_OP_LOOKUP] = "lookup",
+	[TEST_OP_ADD] = "add",
+	[TEST_OP_DEL] = "del",
+	[TEST_OP_REPLACE] = "replace",
+};
+
+unsigned long value_size;
+
+/* Constants of the zipf distribution of the init, lookup and write pools. */
+struct zipf_pool {
+	unsigned long size;
+	double zetan, eta, alpha, half_pow_theta;
+};
+
+static struct zipf_pool zipf_pools[3];
+
+static DEFINE_URCU_TLS(unsigned long, key_shift_draws);
+static DEFINE_URCU_TLS(unsigned long, key_shift_epoch);
+
+static
+void usage_error(const char *arg)
+{
+	fprintf(stderr, "Invalid workload option: %s\n", arg);
+	exit(-1);
+}
+
+/*
+ * Options of the key distributions, operation mix and values:
+ *   --keys=uniform|zipf[:THETA]|hotspot[:FRACTION[:PROB]]
+ *   --key-shift=MS
+ *   --mix=LOOKUP:ADD:DEL:REPLACE
+ *   --value-size=BYTES
+ * Return 1 if @arg is one of those, 0 otherwise.
+ */
+int test_hash_parse_workload_option(const char *arg)
+{
+	const char *v;
+	char *end;
+	int i;
+
+	if (!strncmp(arg, "--keys=", strlen("--keys="))) {
+		v = arg + strlen("--keys=");
+		if (!strcmp(v, "uniform")) {
+			key_dist = KEY_DIST_UNIFORM;
+		} else if (!strncmp(v, "zipf", strlen("zipf"))) {
+			key_dist = KEY_DIST_ZIPF;
+			v += strlen("zipf");
+			if (*v == ':') {
+				zipf_theta = strtod(v + 1, &end);
+				if (*end || zipf_theta <= 0 || zipf_theta >= 1)
+					usage_error(arg);
+			} else if (*v) {
+				usage_error(arg);
+			}
+		} else if (!strncmp(v, "hotspot", strlen("hotspot"))) {
+			key_dist = KEY_DIST_HOTSPOT;
+			v += strlen("hotspot");
+			if (*v == ':') {
+				hotspot_fraction = strtod(v + 1, &end);
+				if (*end == ':')
+					hotspot_prob = strtod(end + 1, &end);
+				if (*end || hotspot_fraction <= 0
+						|| hotspot_fraction > 1
+						|| hotspot_prob < 0 || hotspot_prob > 1)
+					usage_error(arg);
+			} else if (*v) {
+				usage_error(arg);
+			}
+		} else {
+			usage_error(arg);
+		}
+		return 1;
+	}
+	if (!strncmp(arg, "--key-shift=", strlen("--key-shift="))) {
+		key_shift_ms = strtoul(arg + strlen("--key-shift="), &end, 0);
+		if (*end)
+			usage_error(arg);
+		return 1;
+	}
+	if (!strncmp(arg, "--mix=", strlen("--mix="))) {
+		v = arg + strlen("--mix=");
+		op_mix_total = 0;
+		for (i = 0; i < NR_TEST_OPS; i++) {
+			op_mix[i] = strtoul(v, &end, 0);
+			op_mix_total += op_mix[i];
+			if (i < NR_TEST_OPS - 1 && *end != ':')
+				usage_error(arg);
+			v = end + 1;
+		}
+		if (*end || !op_mix_total)
+			usage_error(arg);
+		return 1;
+	}
+	if (!strncmp(arg, "--value-size=", strlen("--value-size="))) {
+		value_size = strtoul(arg + strlen("--value-size="), &end, 0);
+		if (*end)
+			usage_error(arg);
+		return 1;
+	}
+	return 0;
+}
+
+static
+double zeta(unsigned long n, double theta)
+{
+	unsigned long i, exact = n < ZETA_EXACT_MAX ? n : ZETA_EXACT_MAX;
+	double sum = 0;
+
+	for (i = 1; i <= exact; i++)
+		sum += pow((double) i, -theta);
+	if (n > exact)
+		sum += (pow(n + 0.5, 1 - theta) - pow(exact + 0.5, 1 - theta))
+			/ (1 - theta);
+	return sum;
+}
+
+static
+void zipf_pool_init(struct zipf_pool *zp, unsigned long size)
+{
+	double theta = zipf_theta;
+
+	zp->size = size;
+	zp->zetan = zeta(size, theta);
+	zp->alpha = 1 / (1 - theta);
+	zp->eta = (1 - pow(2.0 / size, 1 - theta))
+		/ (1 - zeta(2, theta) / zp->zetan);
+	zp->half_pow_theta = pow(0.5, theta);
+}
+
+/* Precompute the zipf constants of the pools, before the test threads. */
+void test_hash_workload_init(void)
+{
+	unsigned long sizes[3] = {
+		init_pool_size, lookup_pool_size, write_pool_size,
+	};
+	int i, j;
+
+	key_shift_start_ns = caa_clock_ns();
+	if (key_dist != KEY_DIST_ZIPF)
+		return;
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < i; j++) {
+			if (zipf_pools[j].size == sizes[i])
+				break;
+		}
+		if (j < i)
+			zipf_pools[i] = zipf_pools[j];
+		else
+			zipf_pool_init(&zipf_pools[i], sizes[i]);
+	}
+}
+
+void test_hash_workload_print(void)
+{
+	int i;
+
+	switch (key_dist) {
+	case KEY_DIST_UNIFORM:
+		printf_verbose("Key distribution: uniform.\n");
+		break;
+	case KEY_DIST_ZIPF:
+		printf_verbose("Key distribution: zipf, theta %g.\n",
+			zipf_theta);
+		break;
+	case KEY_DIST_HOTSPOT:
+		printf_verbose("Key distribution: hotspot, %g of the draws in %g of the pool.\n",
+			hotspot_prob, hotspot_fraction);
+		break;
+	}
+	if (key_shift_ms)
+		printf_verbose("Hot keys shifted every %lu ms.\n", key_shift_ms);
+	if (op_mix_total) {
+		printf_verbose("Writer operation mix:");
+		for (i = 0; i < NR_TEST_OPS; i++)
+			printf_verbose(" %s %u", op_name[i], op_mix[i]);
+		printf_verbose(".\n");
+	}
+	if (value_size)
+		printf_verbose("Value size: %lu bytes.\n", value_size);
+}
+
+/* Workload fields of the --format report. */
+void test_hash_workload_report(void)
+{
+	static const char *dist_name[] = {
+		[KEY_DIST_UNIFORM] = "uniform",
+		[KEY_DIST_ZIPF] = "zipf",
+		[KEY_DIST_HOTSPOT] = "hotspot",
+	};
+
+	char param[32];
+
+	bench_report_string("keys", dist_name[key_dist]);
+	if (key_dist == KEY_DIST_ZIPF) {
+		snprintf(param, sizeof(param), "%g", zipf_theta);
+		bench_report_string("zipf_theta", param);
+	} else if (key_dist == KEY_DIST_HOTSPOT) {
+		snprintf(param, sizeof(param), "%g:%g", hotspot_fraction,
+			hotspot_prob);
+		bench_report_string("hotspot", param);
+	}
+	if (key_shift_ms)
+		bench_report_u64("key_shift_ms", key_shift_ms);
+	bench_report_u64("value_size", value_size);
+}
+
+/* Uniform double in [0, 1). */
+static
+double rand_unit(void)
+{
+	return (double) rand_r(&URCU_TLS(rand_lookup)) / ((double) RAND_MAX + 1);
+}
+
+static
+unsigned long zipf_rank(unsigned long pool_size)
+{
+	struct zipf_pool *zp;
+	double u, uz;
+	unsigned long rank;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (zipf_pools[i].size == pool_size)
+			break;
+	}
+	zp = &zipf_pools[i];
+	assert(zp->size == pool_size);
+	u = rand_unit();
+	uz = u * zp->zetan;
+	if (uz < 1)
+		return 0;
+	if (uz < 1 + zp->half_pow_theta)
+		return 1;
+	rank = (unsigned long) (pool_size
+		* pow(zp->eta * u - zp->eta + 1, zp->alpha));
+	return rank < pool_size ? rank : pool_size - 1;
+}
+
+static
+unsigned long hotspot_rank(unsigned long pool_size)
+{
+	unsigned long hot = (unsigned long) (pool_size * hotspot_fraction);
+
+	if (!hot)
+		hot = 1;
+	if (hot >= pool_size || rand_unit() < hotspot_prob)
+		return (unsigned long) rand_r(&URCU_TLS(rand_lookup)) % hot;
+	return hot + (unsigned long) rand_r(&URCU_TLS(rand_lookup))
+		% (pool_size - hot);
+}
+
+/* Rotation of the ranks of a pool, updated every few draws. */
+static
+unsigned long key_shift(unsigned long pool_size)
+{
+	unsigned long step;
+
+	if (!key_shift_ms)
+		return 0;
+	if (!(URCU_TLS(key_shift_draws)++ % KEY_SHIFT_CLOCK_DRAWS))
+		URCU_TLS(key_shift_epoch) = (caa_clock_ns() - key_shift_start_ns)
+			/ (key_shift_ms * 1000000ULL);
+	step = pool_size / KEY_SHIFT_STEPS;
+	if (!step)
+		step = 1;
+	return URCU_TLS(key_shift_epoch) * step;
+}
+
+void *test_skewed_key(unsigned long pool_size, unsigned long pool_offset)
+{
+	unsigned long rank;
+
+	switch (key_dist) {
+	case KEY_DIST_ZIPF:
+		rank = zipf_rank(pool_size);
+		break;
+	case KEY_DIST_HOTSPOT:
+		rank = hotspot_rank(pool_size);
+		break;
+	default:
+		rank = (unsigned long) rand_r(&URCU_TLS(rand_lookup)) % pool_size;
+		break;
+	}
+	rank = (rank + key_shift(pool_size)) % pool_size;
+	return (void *) (rank + pool_offset);
+}
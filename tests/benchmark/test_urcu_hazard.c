@@ -0,0 +1,444 @@
+/*
+ * test_urcu_hazard.c
+ *
+ * Userspace RCU library - hazard pointer domain test program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include <urcu/uatomic.h>
+#include <urcu/system.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#include <urcu-hazard.h>
+
+struct test_obj {
+	int a;
+	struct rcu_hp_head head;
+};
+
+static volatile int test_go, test_stop;
+
+/* One shared object per hazard slot: readers protect all of them. */
+static struct test_obj *test_hp_pointer[RCU_HP_NR_SLOTS];
+
+static struct rcu_hp_domain *test_domain;
+
+static unsigned long wdelay;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long rduration;
+
+/* write-side C.S. duration, in loops */
+static unsigned long wduration;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, ## args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_writes);
+static DEFINE_URCU_TLS(unsigned long long, nr_reads);
+/* Largest number of objects queued on a writer after rcu_hp_retire(). */
+static DEFINE_URCU_TLS(unsigned long, max_retired);
+
+/* Objects reclaimed, from any thread retiring or unregistering. */
+static unsigned long long nr_reclaimed;
+/* Protected objects seen freed by a reader. */
+static unsigned long long nr_errors;
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+static void free_obj(struct rcu_hp_head *head)
+{
+	struct test_obj *obj = caa_container_of(head, struct test_obj, head);
+
+	obj->a = 0;
+	free(obj);
+	uatomic_inc(&nr_reclaimed);
+}
+
+static void check_obj(struct test_obj *obj)
+{
+	if (obj && CMM_LOAD_SHARED(obj->a) != 8)
+		uatomic_inc(&nr_errors);
+}
+
+void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	struct test_obj *local_ptr[RCU_HP_NR_SLOTS];
+	struct rcu_hp_reader *reader;
+	unsigned int i;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	reader = rcu_hp_register(test_domain);
+	if (!reader)
+		exit(1);
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		for (i = 0; i < RCU_HP_NR_SLOTS; i++) {
+			local_ptr[i] = rcu_hp_protect(reader, i,
+					(void **) &test_hp_pointer[i]);
+			check_obj(local_ptr[i]);
+		}
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		/* Still alive while protected, whatever the writers did. */
+		for (i = 0; i < RCU_HP_NR_SLOTS; i++) {
+			check_obj(local_ptr[i]);
+			rcu_hp_clear(reader, i);
+		}
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_hp_unregister(reader);
+
+	/* test extra thread registration */
+	reader = rcu_hp_register(test_domain);
+	if (!reader)
+		exit(1);
+	rcu_hp_unregister(reader);
+
+	*count = URCU_TLS(nr_reads);
+	printf_verbose("thread_end %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+	return ((void*)1);
+
+}
+
+void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	struct test_obj *new, *old;
+	struct rcu_hp_reader *reader;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	/* Retired objects are queued on the registered writer. */
+	reader = rcu_hp_register(test_domain);
+	if (!reader)
+		exit(1);
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		new = malloc(sizeof(*new));
+		assert(new);
+		new->a = 8;
+		old = uatomic_xchg(&test_hp_pointer[URCU_TLS(nr_writes)
+				% RCU_HP_NR_SLOTS], new);
+		if (caa_unlikely(wduration))
+			loop_sleep(wduration);
+		if (old)
+			rcu_hp_retire(reader, old, &old->head, free_obj);
+		if (reader->nr_retired > URCU_TLS(max_retired))
+			URCU_TLS(max_retired) = reader->nr_retired;
+		URCU_TLS(nr_writes)++;
+		if (caa_unlikely(!test_duration_write()))
+			break;
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+	}
+
+	rcu_hp_unregister(reader);
+
+	printf_verbose("thread_end %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+	*count = URCU_TLS(nr_writes);
+	/* Bound documented by rcu_hp_retire(). */
+	if (URCU_TLS(max_retired)
+			> 2 * RCU_HP_NR_SLOTS * (nr_readers + nr_writers)) {
+		printf("WARNING! writer tid %lu queued %lu retired objects.\n",
+			urcu_get_thread_id(), URCU_TLS(max_retired));
+		uatomic_inc(&nr_errors);
+	}
+	return ((void*)2);
+}
+
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-c duration] (reader C.S. duration (in loops))\n");
+	printf("	[-e duration] (writer C.S. duration (in loops))\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader, *count_writer;
+	unsigned long long tot_reads = 0, tot_writes = 0, nr_retired;
+	int i, a, retval = 0;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'e':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wduration = atol(argv[++i]);
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, %u writers.\n",
+		duration, nr_readers, nr_writers);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	test_domain = rcu_hp_domain_create();
+	if (!test_domain)
+		exit(1);
+
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, sizeof(*count_reader));
+	count_writer = calloc(nr_writers, sizeof(*count_writer));
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	sleep(duration);
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_reads += count_reader[i];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_writes += count_writer[i];
+	}
+
+	/* Reclaim the objects handed over by unregistered threads. */
+	rcu_hp_domain_destroy(test_domain);
+
+	/* Every write but the first on each slot retired an object. */
+	nr_retired = 0;
+	for (i = 0; i < RCU_HP_NR_SLOTS; i++) {
+		if (test_hp_pointer[i])
+			nr_retired--;
+		free(test_hp_pointer[i]);
+	}
+	nr_retired += tot_writes;
+
+	printf_verbose("total number of reads : %llu, writes %llu\n", tot_reads,
+	       tot_writes);
+	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu wdur %6lu "
+		"nr_writers %3u "
+		"wdelay %6lu nr_reads %12llu nr_writes %12llu nr_ops %12llu "
+		"nr_reclaimed %12llu\n",
+		argv[0], duration, nr_readers, rduration, wduration,
+		nr_writers, wdelay, tot_reads, tot_writes,
+		tot_reads + tot_writes, nr_reclaimed);
+	if (nr_reclaimed != nr_retired) {
+		printf("WARNING! Discrepancy between nr retired %llu vs "
+		       "nr reclaimed %llu.\n", nr_retired, nr_reclaimed);
+		retval = 1;
+	}
+	if (nr_errors) {
+		printf("WARNING! %llu protected objects found reclaimed "
+		       "or retired queue over its bound.\n", nr_errors);
+		retval = 1;
+	}
+	free(tid_reader);
+	free(tid_writer);
+	free(count_reader);
+	free(count_writer);
+	return retval;
+}
@@ -0,0 +1,630 @@
+/*
+ * test_urcu_hlist_ht.c
+ *
+ * Userspace RCU library - example RCU hlist hash table, compared
+ *                            with the RCU lock-free hash table
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/cds.h>
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_reads);
+static DEFINE_URCU_TLS(unsigned long long, nr_found);
+static DEFINE_URCU_TLS(unsigned long long, nr_adds);
+static DEFINE_URCU_TLS(unsigned long long, nr_dels);
+static DEFINE_URCU_TLS(unsigned long long, nr_successful_adds);
+static DEFINE_URCU_TLS(unsigned long long, nr_successful_dels);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+static unsigned long key_range = 1048576;	/* keys in [0, key_range) */
+static unsigned long nr_buckets = 65536;
+static unsigned long nr_locks;			/* 0: one per CPU */
+static int use_lfht;				/* compare with cds_lfht */
+static int use_swht;				/* compare with cds_swht */
+
+struct test {
+	struct cds_hlist_node hnode;
+	struct cds_lfht_node lnode;
+	unsigned long key;
+	struct rcu_head rcu;
+};
+
+static struct cds_hlist_ht *hlist_ht;
+static struct cds_lfht *lfht;
+static struct cds_swht *swht;
+
+static
+unsigned long test_hash(unsigned long key)
+{
+	return key * 0x9E3779B97F4A7C15ULL;
+}
+
+static
+int test_hlist_match(struct cds_hlist_node *node, const void *key)
+{
+	struct test *test = caa_container_of(node, struct test, hnode);
+
+	return test->key == *(const unsigned long *) key;
+}
+
+static
+int test_lfht_match(struct cds_lfht_node *node, const void *key)
+{
+	struct test *test = caa_container_of(node, struct test, lnode);
+
+	return test->key == *(const unsigned long *) key;
+}
+
+static
+int test_swht_match(void *item, const void *key)
+{
+	return ((struct test *) item)->key == *(const unsigned long *) key;
+}
+
+static
+struct test *test_lookup(unsigned long key)
+{
+	if (use_swht) {
+		return cds_swht_lookup(swht, test_hash(key), test_swht_match,
+				&key);
+	} else if (use_lfht) {
+		struct cds_lfht_iter iter;
+		struct cds_lfht_node *node;
+
+		cds_lfht_lookup(lfht, test_hash(key), test_lfht_match, &key,
+				&iter);
+		node = cds_lfht_iter_get_node(&iter);
+		return node ? caa_container_of(node, struct test, lnode) : NULL;
+	} else {
+		struct cds_hlist_node *node;
+
+		node = cds_hlist_ht_lookup(hlist_ht, test_hash(key),
+				test_hlist_match, &key);
+		return node ? caa_container_of(node, struct test, hnode) : NULL;
+	}
+}
+
+/* Return 0 if added, -EEXIST if already present. Call with read lock. */
+static
+int test_add(struct test *node)
+{
+	if (use_swht) {
+		return cds_swht_add(swht, test_hash(node->key),
+				test_swht_match, &node->key, node);
+	} else if (use_lfht) {
+		struct cds_lfht_node *ret;
+
+		ret = cds_lfht_add_unique(lfht, test_hash(node->key),
+				test_lfht_match, &node->key, &node->lnode);
+		return ret == &node->lnode ? 0 : -EEXIST;
+	} else {
+		struct cds_hlist_node *ret;
+
+		ret = cds_hlist_ht_add_unique(hlist_ht, test_hash(node->key),
+				test_hlist_match, &node->key, &node->hnode);
+		return ret == &node->hnode ? 0 : -EEXIST;
+	}
+}
+
+/* Return the removed node, or NULL. Call with read lock. */
+static
+struct test *test_del(unsigned long key)
+{
+	if (use_swht) {
+		return cds_swht_del(swht, test_hash(key), test_swht_match,
+				&key);
+	} else if (use_lfht) {
+		struct cds_lfht_iter iter;
+		struct cds_lfht_node *node;
+
+		cds_lfht_lookup(lfht, test_hash(key), test_lfht_match, &key,
+				&iter);
+		node = cds_lfht_iter_get_node(&iter);
+		if (!node || cds_lfht_del(lfht, node))
+			return NULL;
+		return caa_container_of(node, struct test, lnode);
+	} else {
+		struct cds_hlist_node *node;
+
+		node = cds_hlist_ht_del_key(hlist_ht, test_hash(key),
+				test_hlist_match, &key);
+		return node ? caa_container_of(node, struct test, hnode) : NULL;
+	}
+}
+
+static
+void free_node_cb(struct rcu_head *head)
+{
+	struct test *node =
+		caa_container_of(head, struct test, rcu);
+	free(node);
+}
+
+void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		struct test *node;
+		unsigned long key;
+
+		key = rand_r(&seed) % key_range;
+		rcu_read_lock();
+		node = test_lookup(key);
+		if (node) {
+			assert(node->key == key);
+			URCU_TLS(nr_found)++;
+		}
+		rcu_read_unlock();
+
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+	}
+
+	rcu_unregister_thread();
+	printf_verbose("reader thread_end, tid %lu, "
+			"reads %llu, found %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_reads),
+			URCU_TLS(nr_found));
+	count[0] = URCU_TLS(nr_reads);
+	count[1] = URCU_TLS(nr_found);
+	return ((void*)1);
+}
+
+void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		unsigned long key = rand_r(&seed) % key_range;
+
+		if (rand_r(&seed) & 1) {
+			struct test *node = malloc(sizeof(*node));
+
+			int ret;
+
+			if (!node)
+				goto next;
+			node->key = key;
+			rcu_read_lock();
+			ret = test_add(node);
+			rcu_read_unlock();
+			if (!ret)
+				URCU_TLS(nr_successful_adds)++;
+			else
+				free(node);
+			URCU_TLS(nr_adds)++;
+		} else {
+			struct test *node;
+
+			rcu_read_lock();
+			node = test_del(key);
+			rcu_read_unlock();
+			if (node) {
+				call_rcu(&node->rcu, free_node_cb);
+				URCU_TLS(nr_successful_dels)++;
+			}
+			URCU_TLS(nr_dels)++;
+		}
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+next:
+		if (caa_unlikely(!test_duration_write()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	count[0] = URCU_TLS(nr_adds);
+	count[1] = URCU_TLS(nr_dels);
+	count[2] = URCU_TLS(nr_successful_adds);
+	count[3] = URCU_TLS(nr_successful_dels);
+	printf_verbose("writer thread_end, tid %lu, "
+			"adds %llu dels %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_adds),
+			URCU_TLS(nr_dels));
+	return ((void*)2);
+}
+
+void test_end(unsigned long long *nr_dels)
+{
+	unsigned long key;
+
+	rcu_read_lock();
+	for (key = 0; key < key_range; key++) {
+		struct test *node = test_del(key);
+
+		if (node) {
+			free(node);	/* no more concurrent access */
+			(*nr_dels)++;
+		}
+	}
+	rcu_read_unlock();
+	/* Flush the reclaim of the removed hash table nodes. */
+	rcu_barrier();
+}
+
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-c duration] (reader period (in loops))\n");
+	printf("	[-k range] (key range)\n");
+	printf("	[-B buckets] (number of buckets)\n");
+	printf("	[-s locks] (number of bucket locks, 0 for one per CPU)\n");
+	printf("	[-L] (use the RCU lock-free hash table instead)\n");
+	printf("	[-W] (use the RCU open-addressing hash map instead)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader, *count_writer;
+	unsigned long long tot_reads = 0, tot_found = 0;
+	unsigned long long tot_adds = 0, tot_dels = 0;
+	unsigned long long tot_successful_adds = 0, tot_successful_dels = 0;
+	unsigned long long end_dels = 0;
+	int i, a;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'k':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			key_range = atol(argv[++i]);
+			if (!key_range) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'B':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_buckets = atol(argv[++i]);
+			break;
+		case 's':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_locks = atol(argv[++i]);
+			break;
+		case 'L':
+			use_lfht = 1;
+			break;
+		case 'W':
+			use_swht = 1;
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, "
+		       "%u writers.\n",
+		       duration, nr_readers, nr_writers);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, 2 * sizeof(*count_reader));
+	count_writer = calloc(nr_writers, 4 * sizeof(*count_writer));
+	if (use_swht) {
+		swht = cds_swht_new(nr_buckets);
+		err = !swht;
+	} else if (use_lfht) {
+		/* Fixed size, as the hlist hash table. */
+		lfht = cds_lfht_new(nr_buckets, nr_buckets, nr_buckets, 0, NULL);
+		err = !lfht;
+	} else {
+		hlist_ht = cds_hlist_ht_new(nr_buckets, nr_locks);
+		err = !hlist_ht;
+	}
+	if (err) {
+		printf("Invalid number of buckets %lu.\n", nr_buckets);
+		return -1;
+	}
+	err = create_all_cpu_call_rcu_data(0);
+	if (err) {
+		printf("Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+	}
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[2 * i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[4 * i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_reads += count_reader[2 * i];
+		tot_found += count_reader[2 * i + 1];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_adds += count_writer[4 * i];
+		tot_dels += count_writer[4 * i + 1];
+		tot_successful_adds += count_writer[4 * i + 2];
+		tot_successful_dels += count_writer[4 * i + 3];
+	}
+
+	rcu_register_thread();
+	test_end(&end_dels);
+	rcu_unregister_thread();
+	if (use_swht) {
+		cds_swht_destroy(swht);
+		err = 0;
+	} else if (use_lfht) {
+		err = cds_lfht_destroy(lfht, NULL);
+	} else {
+		err = cds_hlist_ht_destroy(hlist_ht);
+	}
+	assert(!err);
+
+	printf_verbose("total number of reads : %llu, found %llu\n",
+		       tot_reads, tot_found);
+	printf_verbose("total number of adds : %llu, dels %llu\n",
+		       tot_adds, tot_dels);
+	printf("SUMMARY %-25s testdur %4lu nr_writers %3u wdelay %6lu "
+		"nr_readers %3u "
+		"rdur %6lu nr_reads %12llu nr_found %12llu "
+		"nr_adds %12llu nr_dels %12llu "
+		"successful adds %12llu successful dels %12llu "
+		"end_dels %llu nr_ops %12llu\n",
+		argv[0], duration, nr_writers, wdelay,
+		nr_readers, rduration, tot_reads, tot_found,
+		tot_adds, tot_dels,
+		tot_successful_adds, tot_successful_dels, end_dels,
+		tot_reads + tot_adds + tot_dels);
+	if (tot_successful_adds != tot_successful_dels + end_dels)
+		printf("WARNING! Discrepancy between nr succ. adds %llu vs "
+		       "succ. dels + end dels %llu.\n",
+		       tot_successful_adds,
+		       tot_successful_dels + end_dels);
+
+	free_all_cpu_call_rcu_data();
+	free(count_reader);
+	free(count_writer);
+	free(tid_reader);
+	free(tid_writer);
+	return 0;
+}
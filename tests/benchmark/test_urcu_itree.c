@@ -0,0 +1,573 @@
+/*
+ * test_urcu_itree.c
+ *
+ * Userspace RCU library - example RCU interval tree
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/rcuitree.h>
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_reads);
+static DEFINE_URCU_TLS(unsigned long long, nr_overlaps);
+static DEFINE_URCU_TLS(unsigned long long, nr_adds);
+static DEFINE_URCU_TLS(unsigned long long, nr_dels);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+static unsigned long key_range = 1048576;	/* starts in [0, key_range) */
+static unsigned long max_len = 64;		/* interval lengths */
+static unsigned long query_len = 64;		/* query interval length */
+static unsigned long nr_slots = 4096;		/* intervals per writer */
+
+/*
+ * With use_rwlock, the tree is a plain locked tree: readers hold the
+ * read lock, updates the write lock, and the old tree nodes need no
+ * grace period, to compare with RCU readers.
+ */
+static int use_rwlock;
+static pthread_rwlock_t tree_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+
+struct test {
+	struct cds_itree_node node;
+	struct rcu_head rcu;
+};
+
+static struct cds_itree itree;
+
+/* nr_slots intervals of each writer, NULL for free slots */
+static struct test **all_slots;
+static unsigned long long *count_writer;
+
+static
+void free_node_cb(struct rcu_head *head)
+{
+	struct test *node =
+		caa_container_of(head, struct test, rcu);
+	free(node);
+}
+
+/* Tree nodes replaced under the write lock are not visible anymore. */
+static
+void rwlock_call_rcu(struct rcu_head *head,
+		void (*func)(struct rcu_head *head))
+{
+	func(head);
+}
+
+static
+void read_lock(void)
+{
+	if (use_rwlock) {
+		if (pthread_rwlock_rdlock(&tree_rwlock))
+			abort();
+	} else {
+		rcu_read_lock();
+	}
+}
+
+static
+void read_unlock(void)
+{
+	if (use_rwlock) {
+		if (pthread_rwlock_unlock(&tree_rwlock))
+			abort();
+	} else {
+		rcu_read_unlock();
+	}
+}
+
+static
+void write_lock(void)
+{
+	if (use_rwlock && pthread_rwlock_wrlock(&tree_rwlock))
+		abort();
+}
+
+static
+void write_unlock(void)
+{
+	if (use_rwlock && pthread_rwlock_unlock(&tree_rwlock))
+		abort();
+}
+
+void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		struct cds_itree_iter iter;
+		struct cds_itree_node *rnode;
+		unsigned long start, last, prev = 0, n = 0;
+
+		start = rand_r(&seed) % key_range;
+		last = start + query_len - 1;
+		read_lock();
+		cds_itree_for_each_overlap(&itree, start, last, &iter, rnode) {
+			assert(rnode->start <= last && rnode->last >= start);
+			assert(rnode->start >= prev);
+			prev = rnode->start;
+			n++;
+		}
+		read_unlock();
+		URCU_TLS(nr_overlaps) += n;
+
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+	}
+
+	rcu_unregister_thread();
+	printf_verbose("reader thread_end, tid %lu, "
+			"reads %llu, overlaps %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_reads),
+			URCU_TLS(nr_overlaps));
+	count[0] = URCU_TLS(nr_reads);
+	count[1] = URCU_TLS(nr_overlaps);
+	return ((void*)1);
+}
+
+/*
+ * Each writer adds and removes the intervals of its own slots: a random
+ * slot is filled if empty, emptied otherwise.
+ */
+void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	struct test **slots = &all_slots[(count - count_writer) / 2 * nr_slots];
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		unsigned long slot = rand_r(&seed) % nr_slots;
+		struct test *node = slots[slot];
+		int ret;
+
+		if (!node) {
+			unsigned long start = rand_r(&seed) % key_range;
+
+			node = malloc(sizeof(*node));
+			if (!node)
+				goto next;
+			write_lock();
+			ret = cds_itree_add(&itree, &node->node, start,
+					start + rand_r(&seed) % max_len);
+			write_unlock();
+			if (!ret)
+				slots[slot] = node;
+			else
+				free(node);
+			URCU_TLS(nr_adds)++;
+		} else {
+			write_lock();
+			ret = cds_itree_del(&itree, &node->node);
+			write_unlock();
+			if (!ret) {
+				slots[slot] = NULL;
+				if (use_rwlock)
+					free(node);
+				else
+					call_rcu(&node->rcu, free_node_cb);
+			}
+			URCU_TLS(nr_dels)++;
+		}
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+next:
+		if (caa_unlikely(!test_duration_write()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	count[0] = URCU_TLS(nr_adds);
+	count[1] = URCU_TLS(nr_dels);
+	printf_verbose("writer thread_end, tid %lu, "
+			"adds %llu dels %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_adds),
+			URCU_TLS(nr_dels));
+	return ((void*)2);
+}
+
+void test_end(struct cds_itree *it, unsigned long long *nr_dels)
+{
+	unsigned long i;
+
+	for (i = 0; i < nr_writers * nr_slots; i++) {
+		int ret;
+
+		if (!all_slots[i])
+			continue;
+		ret = cds_itree_del(it, &all_slots[i]->node);
+		assert(!ret);
+		free(all_slots[i]);	/* no more concurrent access */
+		(*nr_dels)++;
+	}
+	/* Flush the reclaim of the replaced tree nodes. */
+	rcu_barrier();
+}
+
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-c duration] (reader period (in loops))\n");
+	printf("	[-k range] (interval start range)\n");
+	printf("	[-m len] (maximum interval length)\n");
+	printf("	[-q len] (query interval length)\n");
+	printf("	[-s slots] (intervals per writer)\n");
+	printf("	[-R] (rwlock-protected tree instead of RCU readers)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader;
+	unsigned long long tot_reads = 0, tot_overlaps = 0;
+	unsigned long long tot_adds = 0, tot_dels = 0;
+	unsigned long long end_dels = 0;
+	int i, a;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'k':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			key_range = atol(argv[++i]);
+			if (!key_range) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'm':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			max_len = atol(argv[++i]);
+			if (!max_len) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'q':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			query_len = atol(argv[++i]);
+			if (!query_len) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 's':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_slots = atol(argv[++i]);
+			if (!nr_slots) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'R':
+			use_rwlock = 1;
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, "
+		       "%u writers.\n",
+		       duration, nr_readers, nr_writers);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("Readers : %s.\n", use_rwlock ? "rwlock" : "RCU");
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, 2 * sizeof(*count_reader));
+	count_writer = calloc(nr_writers, 2 * sizeof(*count_writer));
+	all_slots = calloc(nr_writers * nr_slots, sizeof(*all_slots));
+	cds_itree_init(&itree, use_rwlock ? rwlock_call_rcu : call_rcu);
+	err = create_all_cpu_call_rcu_data(0);
+	if (err) {
+		printf("Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+	}
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[2 * i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[2 * i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_reads += count_reader[2 * i];
+		tot_overlaps += count_reader[2 * i + 1];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_adds += count_writer[2 * i];
+		tot_dels += count_writer[2 * i + 1];
+	}
+
+	test_end(&itree, &end_dels);
+	err = cds_itree_destroy(&itree);
+	assert(!err);
+
+	printf_verbose("total number of reads : %llu, overlaps %llu\n",
+		       tot_reads, tot_overlaps);
+	printf_verbose("total number of adds : %llu, dels %llu\n",
+		       tot_adds, tot_dels);
+	printf("SUMMARY %-25s testdur %4lu nr_writers %3u wdelay %6lu "
+		"nr_readers %3u "
+		"rdur %6lu nr_reads %12llu nr_overlaps %12llu "
+		"nr_adds %12llu nr_dels %12llu "
+		"end_dels %llu nr_ops %12llu %s\n",
+		argv[0], duration, nr_writers, wdelay,
+		nr_readers, rduration, tot_reads, tot_overlaps,
+		tot_adds, tot_dels, end_dels,
+		tot_reads + tot_adds + tot_dels,
+		use_rwlock ? "rwlock" : "rcu");
+
+	free_all_cpu_call_rcu_data();
+	free(all_slots);
+	free(count_reader);
+	free(count_writer);
+	free(tid_reader);
+	free(tid_writer);
+	return 0;
+}
@@ -0,0 +1,650 @@
+/*
+ * test_urcu_lflist.c
+ *
+ * Userspace RCU library - example lock-free RCU sorted linked list
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/rculflist.h>
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_lookups);
+static DEFINE_URCU_TLS(unsigned long long, nr_hits);
+static DEFINE_URCU_TLS(unsigned long long, nr_iterations);
+static DEFINE_URCU_TLS(unsigned long long, nr_adds);
+static DEFINE_URCU_TLS(unsigned long long, nr_dels);
+static DEFINE_URCU_TLS(unsigned long long, nr_del_races);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+static unsigned int nr_removers = 1;
+
+static unsigned long key_range = 1024;
+static unsigned long iterate_period = 16;	/* lookups per iteration */
+static unsigned long remove_batch = 4;	/* nodes removed per walk */
+
+/* Published nodes freed, and inconsistencies seen. */
+static unsigned long nr_freed, nr_errors;
+
+struct test_node {
+	struct cds_lflist_node node;
+	unsigned long key;
+	int a;
+	struct rcu_head head;
+};
+
+static struct cds_lflist test_list;
+
+static
+int test_cmp(struct cds_lflist_node *node, const void *key)
+{
+	struct test_node *tn = caa_container_of(node, struct test_node, node);
+	unsigned long k = *(const unsigned long *) key;
+
+	return tn->key < k ? -1 : tn->key > k;
+}
+
+static
+void free_node_cb(struct rcu_head *head)
+{
+	struct test_node *tn = caa_container_of(head, struct test_node, head);
+
+	tn->a = 0;
+	free(tn);
+	uatomic_inc(&nr_freed);
+}
+
+static
+void test_error(const char *msg, unsigned long key)
+{
+	if (!uatomic_read(&nr_errors))
+		printf("[ERROR] %s, key %lu\n", msg, key);
+	uatomic_inc(&nr_errors);
+}
+
+/* A node found must not be freed yet. */
+static
+struct test_node *check_node(struct cds_lflist_node *node)
+{
+	struct test_node *tn = caa_container_of(node, struct test_node, node);
+
+	if (CMM_LOAD_SHARED(tn->a) != 8)
+		test_error("node freed while reachable", tn->key);
+	return tn;
+}
+
+/*
+ * Remove a node found within the current read-side critical section.
+ * Concurrent removals of a node have a single winner.
+ */
+static
+void remove_node(struct test_node *tn)
+{
+	if (!cds_lflist_del(&test_list, &tn->key, &tn->node)) {
+		if (!cds_lflist_is_node_deleted(&tn->node))
+			test_error("removed node not flagged", tn->key);
+		call_rcu(&tn->head, free_node_cb);
+		URCU_TLS(nr_dels)++;
+	} else {
+		URCU_TLS(nr_del_races)++;
+	}
+}
+
+void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		struct cds_lflist_node *node;
+		struct test_node *tn;
+		unsigned long key = rand_r(&seed) % key_range, prev;
+		bool first = true;
+
+		rcu_read_lock();
+		node = cds_lflist_lookup(&test_list, &key);
+		if (node) {
+			if (check_node(node)->key != key)
+				test_error("lookup of a different key", key);
+			URCU_TLS(nr_hits)++;
+		}
+		/* Traversals see the keys in strictly increasing order. */
+		if (iterate_period && !(URCU_TLS(nr_lookups)
+				% iterate_period)) {
+			cds_lflist_for_each_from(&test_list, &key, node) {
+				tn = check_node(node);
+				if (tn->key < key)
+					test_error("walk before its lower bound",
+						tn->key);
+				if (!first && tn->key <= prev)
+					test_error("walk out of order",
+						tn->key);
+				prev = tn->key;
+				first = false;
+			}
+			URCU_TLS(nr_iterations)++;
+		}
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		rcu_read_unlock();
+
+		URCU_TLS(nr_lookups)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_unregister_thread();
+	printf_verbose("reader thread_end, tid %lu, "
+			"lookups %llu, hits %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_lookups),
+			URCU_TLS(nr_hits));
+	count[0] = URCU_TLS(nr_lookups);
+	count[1] = URCU_TLS(nr_hits);
+	count[2] = URCU_TLS(nr_iterations);
+	return ((void*)1);
+}
+
+/* Writers add the keys and remove them by lookup. */
+void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		unsigned long key = rand_r(&seed) % key_range;
+		struct cds_lflist_node *ret_node;
+		struct test_node *tn;
+
+		if (rand_r(&seed) & 1) {
+			tn = malloc(sizeof(*tn));
+			if (!tn)
+				exit(1);
+			cds_lflist_node_init(&tn->node);
+			tn->key = key;
+			tn->a = 8;
+			rcu_read_lock();
+			ret_node = cds_lflist_add_unique(&test_list, &key,
+					&tn->node);
+			if (ret_node != &tn->node) {
+				if (check_node(ret_node)->key != key)
+					test_error("add_unique of a different "
+						"key", key);
+				free(tn);
+			} else {
+				URCU_TLS(nr_adds)++;
+			}
+			rcu_read_unlock();
+		} else {
+			rcu_read_lock();
+			ret_node = cds_lflist_lookup(&test_list, &key);
+			if (ret_node)
+				remove_node(check_node(ret_node));
+			rcu_read_unlock();
+		}
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+		if (caa_unlikely(!test_duration_write()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	count[0] = URCU_TLS(nr_adds);
+	count[1] = URCU_TLS(nr_dels);
+	count[2] = URCU_TLS(nr_del_races);
+	printf_verbose("writer thread_end, tid %lu, "
+			"adds %llu dels %llu del races %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_adds), URCU_TLS(nr_dels),
+			URCU_TLS(nr_del_races));
+	return ((void*)2);
+}
+
+/*
+ * Removers walk the list from a random key, removing the nodes they
+ * cross, concurrently with the walks of the readers and the removals
+ * of the writers.
+ */
+void *thr_remover(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"remover", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		unsigned long key = rand_r(&seed) % key_range, n = 0;
+		struct cds_lflist_node *node;
+
+		rcu_read_lock();
+		cds_lflist_for_each_from(&test_list, &key, node) {
+			if (n++ == remove_batch)
+				break;
+			remove_node(check_node(node));
+		}
+		rcu_read_unlock();
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+		if (caa_unlikely(!test_duration_write()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	count[0] = 0;
+	count[1] = URCU_TLS(nr_dels);
+	count[2] = URCU_TLS(nr_del_races);
+	printf_verbose("remover thread_end, tid %lu, "
+			"dels %llu del races %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_dels), URCU_TLS(nr_del_races));
+	return ((void*)2);
+}
+
+/*
+ * Check that the keys are unique and in order, then empty the list.
+ */
+void test_end(unsigned long *nr_end)
+{
+	struct cds_lflist_node *node;
+	struct test_node *tn;
+	unsigned long prev = 0;
+	bool first = true;
+
+	rcu_read_lock();
+	cds_lflist_for_each(&test_list, node) {
+		tn = check_node(node);
+		if (tn->key >= key_range)
+			test_error("unknown key", tn->key);
+		if (!first && tn->key <= prev)
+			test_error("duplicate or unordered key", tn->key);
+		prev = tn->key;
+		first = false;
+		if (!cds_lflist_del(&test_list, &tn->key, node)) {
+			call_rcu(&tn->head, free_node_cb);
+			(*nr_end)++;
+		}
+	}
+	rcu_read_unlock();
+}
+
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer and remover period (in loops))\n");
+	printf("	[-c duration] (reader C.S. duration (in loops))\n");
+	printf("	[-r nr] (remover threads, default 1)\n");
+	printf("	[-b nr] (nodes removed per remover walk, default 4)\n");
+	printf("	[-k range] (key range, default 1024)\n");
+	printf("	[-I period] (walk the list every period lookups, default 16, 0: never)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader, *count_writer;
+	unsigned long long tot_lookups = 0, tot_hits = 0, tot_iterations = 0;
+	unsigned long long tot_adds = 0, tot_dels = 0, tot_del_races = 0;
+	unsigned long end_dels = 0;
+	unsigned int nr_updaters;
+	int i, a, retval = 0;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'r':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_removers = atoi(argv[++i]);
+			break;
+		case 'b':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			remove_batch = atol(argv[++i]);
+			break;
+		case 'k':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			key_range = atol(argv[++i]);
+			if (!key_range) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'I':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			iterate_period = atol(argv[++i]);
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, "
+		       "%u writers, %u removers.\n",
+		       duration, nr_readers, nr_writers, nr_removers);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("Key range : %lu.\n", key_range);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	/* The removers follow the writers in tid_writer and count_writer. */
+	nr_updaters = nr_writers + nr_removers;
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_updaters, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, 3 * sizeof(*count_reader));
+	count_writer = calloc(nr_updaters, 3 * sizeof(*count_writer));
+
+	err = create_all_cpu_call_rcu_data(0);
+	if (err) {
+		printf("Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+	}
+
+	cds_lflist_init(&test_list, test_cmp);
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[3 * i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_updaters; i++) {
+		err = pthread_create(&tid_writer[i], NULL,
+				     i < nr_writers ? thr_writer : thr_remover,
+				     &count_writer[3 * i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_lookups += count_reader[3 * i];
+		tot_hits += count_reader[3 * i + 1];
+		tot_iterations += count_reader[3 * i + 2];
+	}
+	for (i = 0; i < nr_updaters; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_adds += count_writer[3 * i];
+		tot_dels += count_writer[3 * i + 1];
+		tot_del_races += count_writer[3 * i + 2];
+	}
+
+	rcu_register_thread();
+	test_end(&end_dels);
+	rcu_unregister_thread();
+
+	err = cds_lflist_destroy(&test_list);
+	if (err) {
+		printf("WARNING! cds_lflist_destroy: %d\n", err);
+		retval = 1;
+	}
+	/* Flush the reclaim of the removed nodes. */
+	rcu_barrier();
+
+	printf_verbose("total number of lookups : %llu, hits %llu\n",
+		       tot_lookups, tot_hits);
+	printf_verbose("total number of adds : %llu, dels %llu, "
+		       "del races %llu\n", tot_adds, tot_dels, tot_del_races);
+	printf("SUMMARY %-25s testdur %4lu nr_writers %3u wdelay %6lu "
+		"nr_readers %3u rdur %6lu nr_removers %3u key_range %lu "
+		"nr_lookups %12llu nr_hits %12llu nr_iterations %llu "
+		"nr_adds %12llu nr_dels %12llu nr_del_races %llu "
+		"end_dels %lu nr_ops %12llu\n",
+		argv[0], duration, nr_writers, wdelay,
+		nr_readers, rduration, nr_removers, key_range,
+		tot_lookups, tot_hits, tot_iterations,
+		tot_adds, tot_dels, tot_del_races, end_dels,
+		tot_lookups + tot_adds + tot_dels);
+	if (end_dels != tot_adds - tot_dels) {
+		printf("WARNING! Discrepancy between nr adds - dels %llu vs "
+		       "end dels %lu.\n", tot_adds - tot_dels, end_dels);
+		retval = 1;
+	}
+	if (nr_freed != tot_adds) {
+		printf("WARNING! %lu nodes freed, %llu added.\n",
+		       nr_freed, tot_adds);
+		retval = 1;
+	}
+	if (nr_errors) {
+		printf("WARNING! %lu inconsistent nodes seen.\n", nr_errors);
+		retval = 1;
+	}
+	free_all_cpu_call_rcu_data();
+	free(count_reader);
+	free(count_writer);
+	free(tid_reader);
+	free(tid_writer);
+	return retval;
+}
@@ -67,6 +67,9 @@ static inline void loop_sleep(unsigned long loops)
 
 static int verbose_mode;
 
+/* Nodes per cds_lfq_dequeue_bulk_rcu(), 0: single dequeue. */
+static unsigned int dequeue_bulk;
+
 #define printf_verbose(fmt, args...)		\
 	do {					\
 		if (verbose_mode)		\
@@ -199,12 +202,18 @@ void free_node_cb(struct rcu_head *head)
 void *thr_dequeuer(void *_count)
 {
 	unsigned long long *count = _count;
+	struct cds_lfq_node_rcu **bulk = NULL;
 
 	printf_verbose("thread_begin %s, tid %lu\n",
 			"dequeuer", urcu_get_thread_id());
 
 	set_affinity();
 
+	if (dequeue_bulk) {
+		bulk = calloc(dequeue_bulk, sizeof(*bulk));
+		assert(bulk);
+	}
+
 	rcu_register_thread();
 
 	while (!test_go)
@@ -213,16 +222,23 @@ void *thr_dequeuer(void *_count)
 	cmm_smp_mb();
 
 	for (;;) {
-		struct cds_lfq_node_rcu *qnode;
+		struct cds_lfq_node_rcu *qnode, **qnodes = &qnode;
+		unsigned int i, nr;
 
 		rcu_read_lock();
-		qnode = cds_lfq_dequeue_rcu(&q);
+		if (dequeue_bulk) {
+			qnodes = bulk;
+			nr = cds_lfq_dequeue_bulk_rcu(&q, qnodes, dequeue_bulk);
+		} else {
+			qnode = cds_lfq_dequeue_rcu(&q);
+			nr = !!qnode;
+		}
 		rcu_read_unlock();
 
-		if (qnode) {
+		for (i = 0; i < nr; i++) {
 			struct test *node;
 
-			node = caa_container_of(qnode, struct test, list);
+			node = caa_container_of(qnodes[i], struct test, list);
 			call_rcu(&node->rcu, free_node_cb);
 			URCU_TLS(nr_successful_dequeues)++;
 		}
@@ -235,6 +251,7 @@ void *thr_dequeuer(void *_count)
 	}
 
 	rcu_unregister_thread();
+	free(bulk);
 	printf_verbose("dequeuer thread_end, tid %lu, "
 			"dequeues %llu, successful_dequeues %llu\n",
 			urcu_get_thread_id(),
@@ -270,6 +287,7 @@ void show_usage(int argc, char **argv)
 	printf("	[-c duration] (dequeuer period (in loops))\n");
 	printf("	[-v] (verbose output)\n");
 	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("	[-n nodes] (dequeue up to nodes per bulk dequeue)\n");
 	printf("\n");
 }
 
@@ -339,6 +357,13 @@ int main(int argc, char **argv)
 		case 'v':
 			verbose_mode = 1;
 			break;
+		case 'n':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			dequeue_bulk = atoi(argv[++i]);
+			break;
 		}
 	}
 
@@ -0,0 +1,540 @@
+/*
+ * test_urcu_lpm.c
+ *
+ * Userspace RCU library - RCU longest-prefix-match trie benchmark
+ *
+ * Copyright February 2009 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/rculpm.h>
+
+static volatile int test_go, test_stop;
+
+static unsigned long wdelay;
+
+struct route {
+	unsigned long magic;
+	struct cds_lpm_node node;
+	struct rcu_head head;
+};
+
+#define ROUTE_MAGIC	0x600DBEEFUL
+
+/* Prefix of the pool, added and removed by the writers. */
+struct pool_prefix {
+	uint8_t prefix[CDS_LPM_MAX_BITS / 8];
+	unsigned int len;
+};
+
+static struct cds_lpm *lpm;
+static struct pool_prefix *pool;
+static unsigned long nr_prefixes = 1UL << 16;
+static int ipv6;
+static unsigned int key_bytes = 4;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long rduration;
+
+/* write-side C.S. duration, in loops */
+static unsigned long wduration;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_writes);
+static DEFINE_URCU_TLS(unsigned long long, nr_reads);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+static unsigned long long nr_found, nr_bad;
+
+/*
+ * Prefix lengths of a routing table: mostly /24 and /16 to /23 for
+ * IPv4, /48 and /32 to /47 for IPv6, then longer and shorter ones.
+ */
+static unsigned int random_len(unsigned int *seed)
+{
+	unsigned int r = rand_r(seed) % 100;
+
+	if (!ipv6) {
+		if (r < 55)
+			return 24;
+		if (r < 90)
+			return 16 + rand_r(seed) % 8;
+		if (r < 97)
+			return 25 + rand_r(seed) % 8;
+		return 8 + rand_r(seed) % 8;
+	}
+	if (r < 45)
+		return 48;
+	if (r < 85)
+		return 32 + rand_r(seed) % 16;
+	if (r < 95)
+		return 49 + rand_r(seed) % 16;
+	return 65 + rand_r(seed) % 64;
+}
+
+static void init_pool(void)
+{
+	unsigned int seed = 1;
+	unsigned long i;
+	unsigned int j;
+
+	pool = calloc(nr_prefixes, sizeof(*pool));
+	assert(pool);
+	for (i = 0; i < nr_prefixes; i++) {
+		for (j = 0; j < key_bytes; j++)
+			pool[i].prefix[j] = rand_r(&seed);
+		if (ipv6) {
+			/* Global unicast, 2000::/3 */
+			pool[i].prefix[0] = 0x20 | (pool[i].prefix[0] & 0x1F);
+		}
+		pool[i].len = random_len(&seed);
+	}
+}
+
+/* Whether the len first bits of a and b match. */
+static int prefix_match(const uint8_t *a, const uint8_t *b, unsigned int len)
+{
+	unsigned int nr_bytes = len / 8;
+
+	if (memcmp(a, b, nr_bytes))
+		return 0;
+	if (len % 8)
+		return !((a[nr_bytes] ^ b[nr_bytes]) & (0xFF << (8 - len % 8)));
+	return 1;
+}
+
+static void route_free_cb(struct rcu_head *head)
+{
+	struct route *r = caa_container_of(head, struct route, head);
+
+	/* A reader still seeing a freed route catches the poison. */
+	r->magic = 0;
+	free(r);
+}
+
+static int route_add(struct pool_prefix *p)
+{
+	struct route *r;
+	int ret;
+
+	r = malloc(sizeof(*r));
+	assert(r);
+	r->magic = ROUTE_MAGIC;
+	ret = cds_lpm_add(lpm, &r->node, p->prefix, p->len);
+	if (ret)
+		free(r);
+	return ret;
+}
+
+static void route_del(struct pool_prefix *p)
+{
+	struct cds_lpm_node *node;
+
+	node = cds_lpm_del(lpm, p->prefix, p->len);
+	if (node)
+		call_rcu(&caa_container_of(node, struct route, node)->head,
+			route_free_cb);
+}
+
+static void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	unsigned long long found = 0, bad = 0;
+	uint8_t key[CDS_LPM_MAX_BITS / 8];
+	struct cds_lpm_node *node;
+	struct pool_prefix *p;
+	struct route *r;
+	unsigned int j;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		/* An address of a random prefix of the pool. */
+		p = &pool[rand_r(&seed) % nr_prefixes];
+		for (j = 0; j < key_bytes; j++)
+			key[j] = rand_r(&seed);
+		for (j = 0; j < p->len / 8; j++)
+			key[j] = p->prefix[j];
+		if (p->len % 8)
+			key[j] = (p->prefix[j] & (0xFF << (8 - p->len % 8)))
+				| (key[j] & (0xFF >> (p->len % 8)));
+		rcu_read_lock();
+		node = cds_lpm_lookup(lpm, key);
+		if (node) {
+			r = caa_container_of(node, struct route, node);
+			if (!prefix_match(node->prefix, key, node->len)
+					|| CMM_LOAD_SHARED(r->magic) != ROUTE_MAGIC)
+				bad++;
+			found++;
+		}
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		rcu_read_unlock();
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	uatomic_add(&nr_found, found);
+	uatomic_add(&nr_bad, bad);
+	*count = URCU_TLS(nr_reads);
+	printf_verbose("thread_end %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+	return ((void*)1);
+
+}
+
+static void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	struct pool_prefix *p;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		/* Withdraw a random route, or announce it if absent. */
+		p = &pool[rand_r(&seed) % nr_prefixes];
+		if (route_add(p) == -EEXIST)
+			route_del(p);
+		if (caa_unlikely(wduration))
+			loop_sleep(wduration);
+		URCU_TLS(nr_writes)++;
+		if (caa_unlikely(!test_duration_write()))
+			break;
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+	}
+
+	rcu_unregister_thread();
+
+	printf_verbose("thread_end %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+	*count = URCU_TLS(nr_writes);
+	return ((void*)2);
+}
+
+static void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-c duration] (reader C.S. duration (in loops))\n");
+	printf("	[-e duration] (writer C.S. duration (in loops))\n");
+	printf("	[-n prefixes] (prefixes of the pool, default 65536)\n");
+	printf("	[-6] (IPv6 prefixes and addresses, default IPv4)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader, *count_writer;
+	unsigned long long tot_reads = 0, tot_writes = 0;
+	unsigned long j, nr_routes = 0;
+	int i, a;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'e':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wduration = atol(argv[++i]);
+			break;
+		case 'n':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_prefixes = atol(argv[++i]);
+			break;
+		case '6':
+			ipv6 = 1;
+			key_bytes = 16;
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+	if (!nr_prefixes) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, %u writers.\n",
+		duration, nr_readers, nr_writers);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("%s, pool of %lu prefixes.\n",
+		ipv6 ? "IPv6" : "IPv4", nr_prefixes);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	rcu_register_thread();
+	lpm = cds_lpm_create(key_bytes * 8);
+	if (!lpm)
+		exit(1);
+	init_pool();
+	/* Start with about half of the pool announced. */
+	for (j = 0; j < nr_prefixes; j += 2) {
+		if (!route_add(&pool[j]))
+			nr_routes++;
+	}
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, sizeof(*count_reader));
+	count_writer = calloc(nr_writers, sizeof(*count_writer));
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	sleep(duration);
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_reads += count_reader[i];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_writes += count_writer[i];
+	}
+
+	printf_verbose("total number of reads : %llu, writes %llu\n", tot_reads,
+	       tot_writes);
+	printf_verbose("%lu routes initially\n", nr_routes);
+	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu wdur %6lu "
+		"nr_writers %3u "
+		"wdelay %6lu nr_reads %12llu nr_writes %12llu nr_ops %12llu "
+		"found %5.1f%%\n",
+		argv[0], duration, nr_readers, rduration, wduration,
+		nr_writers, wdelay, tot_reads, tot_writes,
+		tot_reads + tot_writes,
+		tot_reads ? 100.0 * nr_found / tot_reads : 0.0);
+	if (nr_bad)
+		printf("WARNING! %llu lookups of a freed or wrong route.\n",
+			nr_bad);
+
+	for (j = 0; j < nr_prefixes; j++)
+		route_del(&pool[j]);
+	rcu_barrier();
+	err = cds_lpm_destroy(lpm);
+	if (err)
+		printf("WARNING! trie destroy error %d\n", err);
+	rcu_unregister_thread();
+	free(pool);
+	free(tid_reader);
+	free(tid_writer);
+	free(count_reader);
+	free(count_writer);
+	return nr_bad ? 1 : 0;
+}
@@ -0,0 +1,463 @@
+/*
+ * test_urcu_percpu_ref.c
+ *
+ * Userspace RCU library - example per-CPU reference counter
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/percpu-ref.h>
+
+/* Time allowed for the release of a killed object, in ms. */
+#define RELEASE_TIMEOUT_MS	10000
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* object lifetime before kill, in us */
+static unsigned long round_us = 1000;
+
+/* references taken by each holder */
+static unsigned long nr_nested = 4;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_holds);
+static DEFINE_URCU_TLS(unsigned long long, nr_tryget_fail);
+static DEFINE_URCU_TLS(unsigned long long, nr_gets);
+static DEFINE_URCU_TLS(unsigned long long, nr_puts);
+
+static unsigned int nr_holders;
+
+/*
+ * The main thread publishes one object per round, kills it after
+ * round_us, and waits for its release. The holders take a first
+ * reference with tryget_live, then nr_nested - 1 more with get, and
+ * put them all, so the references taken on the per-CPU counters are
+ * put before or after the kill, and the ones taken after the kill are
+ * taken in atomic mode. The release function must be called exactly
+ * once, after the last put, and the atomic count must stay at zero:
+ * an extra put would wrap it around.
+ */
+struct test_obj {
+	struct urcu_percpu_ref ref;
+	unsigned long nr_released;
+	unsigned long nr_holding;	/* holders with references */
+	struct rcu_head rcu_head;
+};
+
+static struct test_obj *cur_obj;
+
+/* Inconsistencies seen by the holders and the main thread. */
+static unsigned long nr_errors;
+
+static
+void report_error(const char *msg, unsigned long a, unsigned long b)
+{
+	if (!uatomic_read(&nr_errors))
+		printf("[ERROR] %s: %lu, %lu\n", msg, a, b);
+	uatomic_inc(&nr_errors);
+}
+
+static
+void test_release(struct urcu_percpu_ref *ref)
+{
+	struct test_obj *obj = caa_container_of(ref, struct test_obj, ref);
+	unsigned long nr;
+
+	nr = uatomic_read(&obj->nr_holding);
+	if (nr)
+		report_error("released with holders (holders, dying)",
+			nr, urcu_percpu_ref_is_dying(ref));
+	/* Write nr_released after reading nr_holding. */
+	cmm_smp_mb();
+	uatomic_inc(&obj->nr_released);
+}
+
+static
+void free_obj_cb(struct rcu_head *head)
+{
+	struct test_obj *obj = caa_container_of(head, struct test_obj,
+			rcu_head);
+
+	urcu_percpu_ref_exit(&obj->ref);
+	free(obj);
+}
+
+void *thr_holder(void *_count)
+{
+	unsigned long long *count = _count;
+	struct test_obj *obj;
+	unsigned long i;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"holder", urcu_get_thread_id());
+
+	set_affinity();
+
+	/* get and put run within read-side critical sections. */
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		/* The object is freed after a grace period. */
+		rcu_read_lock();
+		obj = rcu_dereference(cur_obj);
+		if (!obj || !urcu_percpu_ref_tryget_live(&obj->ref)) {
+			rcu_read_unlock();
+			URCU_TLS(nr_tryget_fail)++;
+			goto next;
+		}
+		rcu_read_unlock();
+		URCU_TLS(nr_gets)++;
+		uatomic_inc(&obj->nr_holding);
+		for (i = 1; i < nr_nested; i++) {
+			urcu_percpu_ref_get(&obj->ref);
+			URCU_TLS(nr_gets)++;
+			if (caa_unlikely(rduration))
+				loop_sleep(rduration);
+		}
+		if (uatomic_read(&obj->nr_released))
+			report_error("reference to a released object "
+				"(released, holds)",
+				uatomic_read(&obj->nr_released),
+				(unsigned long) URCU_TLS(nr_holds));
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		for (i = 1; i < nr_nested; i++) {
+			urcu_percpu_ref_put(&obj->ref);
+			URCU_TLS(nr_puts)++;
+		}
+		uatomic_dec(&obj->nr_holding);
+		/* The last put may release the object. */
+		urcu_percpu_ref_put(&obj->ref);
+		URCU_TLS(nr_puts)++;
+		URCU_TLS(nr_holds)++;
+next:
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_unregister_thread();
+	printf_verbose("holder thread_end, tid %lu, holds %llu, "
+			"tryget failures %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_holds), URCU_TLS(nr_tryget_fail));
+	count[0] = URCU_TLS(nr_holds);
+	count[1] = URCU_TLS(nr_tryget_fail);
+	count[2] = URCU_TLS(nr_gets);
+	count[3] = URCU_TLS(nr_puts);
+	return ((void*)1);
+}
+
+/*
+ * Run one object lifetime: publish, kill after round_us, and wait for
+ * the release. Returns nonzero if the release did not come in time.
+ */
+static int run_round(void)
+{
+	struct test_obj *obj;
+	unsigned long ms;
+
+	obj = calloc(1, sizeof(*obj));
+	if (!obj || urcu_percpu_ref_init(&obj->ref, test_release))
+		exit(1);
+	rcu_assign_pointer(cur_obj, obj);
+	usleep(round_us);
+	urcu_percpu_ref_kill(&obj->ref);
+	if (!urcu_percpu_ref_is_dying(&obj->ref))
+		report_error("not dying after kill (obj, round)",
+			(unsigned long) obj, 0);
+	for (ms = 0; !uatomic_read(&obj->nr_released); ms++) {
+		if (ms == RELEASE_TIMEOUT_MS) {
+			printf("WARNING! Object not released %d ms after "
+			       "kill, atomic count %lu.\n",
+			       RELEASE_TIMEOUT_MS,
+			       uatomic_read(&obj->ref.atomic_count));
+			return 1;
+		}
+		usleep(1000);
+	}
+	rcu_assign_pointer(cur_obj, NULL);
+	/* Puts following the release have completed. */
+	synchronize_rcu();
+	if (uatomic_read(&obj->nr_released) != 1)
+		report_error("released more than once (count, obj)",
+			uatomic_read(&obj->nr_released), (unsigned long) obj);
+	if (uatomic_read(&obj->ref.atomic_count))
+		report_error("extra puts (atomic count, obj)",
+			uatomic_read(&obj->ref.atomic_count),
+			(unsigned long) obj);
+	call_rcu(&obj->rcu_head, free_obj_cb);
+	return 0;
+}
+
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_holders duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-r us] (object lifetime before kill (us), default 1000)\n");
+	printf("	[-n refs] (references taken by each holder, default 4)\n");
+	printf("	[-c duration] (reference hold duration (in loops))\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_holder;
+	void *tret;
+	unsigned long long *count_holder;
+	unsigned long long tot_holds = 0, tot_tryget_fail = 0;
+	unsigned long long tot_gets = 0, tot_puts = 0, nr_rounds = 0;
+	time_t end;
+	int i, a, retval = 0;
+
+	if (argc < 3) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_holders);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 3; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'r':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			round_us = atol(argv[++i]);
+			break;
+		case 'n':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_nested = atol(argv[++i]);
+			if (!nr_nested) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u holders.\n",
+		duration, nr_holders);
+	printf_verbose("Object lifetime : %lu us, %lu references per hold.\n",
+		round_us, nr_nested);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	tid_holder = calloc(nr_holders, sizeof(*tid_holder));
+	count_holder = calloc(nr_holders, 4 * sizeof(*count_holder));
+
+	err = create_all_cpu_call_rcu_data(0);
+	if (err) {
+		printf("Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+	}
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_holders; i++) {
+		err = pthread_create(&tid_holder[i], NULL, thr_holder,
+				     &count_holder[4 * i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	/* Kill queues the switch to atomic mode with call_rcu. */
+	rcu_register_thread();
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	end = time(NULL) + duration;
+	do {
+		if (run_round()) {
+			retval = 1;
+			break;
+		}
+		nr_rounds++;
+		if (verbose_mode && !(nr_rounds % 1000))
+			(void) write(1, ".", 1);
+	} while (time(NULL) < end);
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_holders; i++) {
+		err = pthread_join(tid_holder[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_holds += count_holder[4 * i];
+		tot_tryget_fail += count_holder[4 * i + 1];
+		tot_gets += count_holder[4 * i + 2];
+		tot_puts += count_holder[4 * i + 3];
+	}
+
+	rcu_unregister_thread();
+	rcu_barrier();
+
+	printf_verbose("total number of holds : %llu, tryget failures %llu, "
+		       "rounds %llu\n", tot_holds, tot_tryget_fail, nr_rounds);
+	printf("SUMMARY %-25s testdur %4lu nr_holders %3u rdur %6lu "
+		"round_us %6lu nr_nested %lu nr_rounds %10llu "
+		"nr_holds %12llu nr_tryget_fail %12llu nr_ops %12llu\n",
+		argv[0], duration, nr_holders, rduration,
+		round_us, nr_nested, nr_rounds,
+		tot_holds, tot_tryget_fail, tot_gets + tot_puts);
+	if (tot_gets != tot_puts) {
+		printf("WARNING! %llu gets, %llu puts.\n", tot_gets, tot_puts);
+		retval = 1;
+	}
+	if (nr_errors) {
+		printf("WARNING! %lu early or repeated releases, or extra "
+		       "puts.\n", nr_errors);
+		retval = 1;
+	}
+	free_all_cpu_call_rcu_data();
+	free(count_holder);
+	free(tid_holder);
+	return retval;
+}
@@ -0,0 +1,484 @@
+/*
+ * test_urcu_percpu_rwsem.c
+ *
+ * Userspace RCU library - example per-CPU reader/writer semaphore
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/percpu-rwsem.h>
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+/* write-side C.S. duration, in loops */
+static unsigned long wduration;
+
+/* sleep between writes, in us */
+static unsigned long wsleep;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_reads);
+static DEFINE_URCU_TLS(unsigned long long, nr_writes);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+/*
+ * The data is nr_words words updated in place, all holding the number
+ * of writes done when it was written: a reader overlapping a writer
+ * sees different words, and each reader must see the number of writes
+ * grow.
+ */
+static unsigned long nr_words = 8;
+static unsigned long *data;
+
+static struct urcu_percpu_rwsem sem;
+
+/* Threads holding the semaphore, for the exclusion checks. */
+static unsigned long readers_inside;
+static unsigned long writers_inside;
+
+/* Exclusion violations, torn or out of order data seen by readers. */
+static unsigned long nr_errors;
+
+static
+void report_error(const char *msg, unsigned long a, unsigned long b)
+{
+	if (!uatomic_read(&nr_errors))
+		printf("[ERROR] %s: %lu, %lu\n", msg, a, b);
+	uatomic_inc(&nr_errors);
+}
+
+static
+void check_data(unsigned long *prev)
+{
+	unsigned long i, v0 = CMM_LOAD_SHARED(data[0]), v;
+
+	for (i = 1; i < nr_words; i++) {
+		v = CMM_LOAD_SHARED(data[i]);
+		if (v != v0) {
+			report_error("torn read (word, value)", i, v);
+			return;
+		}
+	}
+	if (v0 < *prev)
+		report_error("out of order read (value, previous)",
+			v0, *prev);
+	*prev = v0;
+}
+
+void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned long prev = 0, nr;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	/* The fast path runs within a read-side critical section. */
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		urcu_percpu_rwsem_down_read(&sem);
+		uatomic_inc(&readers_inside);
+		nr = uatomic_read(&writers_inside);
+		if (nr)
+			report_error("reader with writers (writers, reads)",
+				nr, (unsigned long) URCU_TLS(nr_reads));
+		check_data(&prev);
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		check_data(&prev);
+		uatomic_dec(&readers_inside);
+		urcu_percpu_rwsem_up_read(&sem);
+
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_unregister_thread();
+	printf_verbose("reader thread_end, tid %lu, reads %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_reads));
+	count[0] = URCU_TLS(nr_reads);
+	return ((void*)1);
+}
+
+void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned long i, gen, nr;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	/* The last writer switches back to the fast path with call_rcu. */
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		urcu_percpu_rwsem_down_write(&sem);
+		nr = uatomic_add_return(&writers_inside, 1);
+		if (nr != 1)
+			report_error("concurrent writers (writers, writes)",
+				nr, (unsigned long) URCU_TLS(nr_writes));
+		nr = uatomic_read(&readers_inside);
+		if (nr)
+			report_error("writer with readers (readers, writes)",
+				nr, (unsigned long) URCU_TLS(nr_writes));
+		gen = data[0] + 1;
+		for (i = 0; i < nr_words; i++) {
+			CMM_STORE_SHARED(data[i], gen);
+			if (caa_unlikely(wduration) && !i)
+				loop_sleep(wduration);
+		}
+		uatomic_dec(&writers_inside);
+		urcu_percpu_rwsem_up_write(&sem);
+
+		URCU_TLS(nr_writes)++;
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+		if (caa_unlikely(wsleep))
+			usleep(wsleep);
+		if (caa_unlikely(!test_duration_write()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	count[0] = URCU_TLS(nr_writes);
+	printf_verbose("writer thread_end, tid %lu, writes %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_writes));
+	return ((void*)2);
+}
+
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-w delay] (writer sleep between writes (us))\n");
+	printf("	[-c duration] (reader C.S. duration (in loops))\n");
+	printf("	[-e duration] (writer C.S. duration (in loops))\n");
+	printf("	[-l words] (data size, in words, default 8)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader, *count_writer;
+	unsigned long long tot_reads = 0, tot_writes = 0;
+	int i, a, retval = 0;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'w':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wsleep = atol(argv[++i]);
+			break;
+		case 'e':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wduration = atol(argv[++i]);
+			break;
+		case 'l':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_words = atol(argv[++i]);
+			if (!nr_words) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, %u writers.\n",
+		duration, nr_readers, nr_writers);
+	printf_verbose("Writer delay : %lu loops, %lu us.\n", wdelay, wsleep);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, sizeof(*count_reader));
+	count_writer = calloc(nr_writers, sizeof(*count_writer));
+	data = calloc(nr_words, sizeof(*data));
+	if (!data)
+		exit(1);
+
+	err = create_all_cpu_call_rcu_data(0);
+	if (err) {
+		printf("Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+	}
+
+	if (urcu_percpu_rwsem_init(&sem))
+		exit(1);
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_reads += count_reader[i];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_writes += count_writer[i];
+	}
+
+	/* The final data counts every write. */
+	for (i = 0; i < nr_words; i++) {
+		if (data[i] != tot_writes) {
+			printf("WARNING! Final data word %d is %lu, "
+			       "%llu writes.\n", i, data[i], tot_writes);
+			retval = 1;
+			break;
+		}
+	}
+
+	/* Waits for the switch back to the fast path. */
+	urcu_percpu_rwsem_destroy(&sem);
+
+	printf_verbose("total number of reads : %llu, writes %llu\n",
+		       tot_reads, tot_writes);
+	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu "
+		"wdur %6lu nr_writers %3u wdelay %6lu wsleep %6lu "
+		"nr_words %lu nr_reads %12llu nr_writes %12llu "
+		"nr_ops %12llu\n",
+		argv[0], duration, nr_readers, rduration,
+		wduration, nr_writers, wdelay, wsleep,
+		nr_words, tot_reads, tot_writes,
+		tot_reads + tot_writes);
+	if (nr_errors) {
+		printf("WARNING! %lu exclusion violations, torn or out of "
+		       "order reads.\n", nr_errors);
+		retval = 1;
+	}
+	free_all_cpu_call_rcu_data();
+	free(data);
+	free(count_reader);
+	free(count_writer);
+	free(tid_reader);
+	free(tid_writer);
+	return retval;
+}
@@ -0,0 +1,483 @@
+/*
+ * test_urcu_pool.c
+ *
+ * Userspace RCU library - RCU object pool and region test program
+ *
+ * Copyright February 2009 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/rcupool.h>
+#include <urcu/rcuregion.h>
+
+static volatile int test_go, test_stop;
+
+static unsigned long wdelay;
+
+struct test {
+	unsigned long magic;
+	struct rcu_head head;
+	char payload[48];
+};
+
+#define TEST_MAGIC	0x600DBEEFUL
+
+static struct test **slots;
+static unsigned long nr_slots = 1024;
+
+static struct urcu_pool *pool;
+static struct urcu_region *region;
+static int use_malloc;
+static unsigned long epoch_writes;	/* writes per region epoch */
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long rduration;
+
+/* write-side C.S. duration, in loops */
+static unsigned long wduration;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_writes);
+static DEFINE_URCU_TLS(unsigned long long, nr_reads);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+static unsigned long long nr_bad;
+
+static struct test *test_alloc(void)
+{
+	struct test *node;
+
+	if (use_malloc)
+		node = malloc(sizeof(*node));
+	else if (region)
+		node = urcu_region_alloc(region, sizeof(*node));
+	else
+		node = urcu_pool_alloc(pool);
+	assert(node);
+	/* A reader still seeing a recycled object catches the poison. */
+	node->magic = 0;
+	cmm_smp_wmb();
+	memset(node->payload, 0, sizeof(node->payload));
+	node->magic = TEST_MAGIC;
+	return node;
+}
+
+static void test_free_cb(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct test, head));
+}
+
+static void test_retire(struct test *node)
+{
+	if (!node)
+		return;
+	if (use_malloc)
+		call_rcu(&node->head, test_free_cb);
+	else if (region)
+		urcu_region_free_rcu(region, node);
+	else
+		urcu_pool_free_rcu(pool, node);
+}
+
+static void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	unsigned long long bad = 0;
+	struct test *local_ptr;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		rcu_read_lock();
+		local_ptr = rcu_dereference(slots[rand_r(&seed) % nr_slots]);
+		if (local_ptr && CMM_LOAD_SHARED(local_ptr->magic) != TEST_MAGIC)
+			bad++;
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		rcu_read_unlock();
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	uatomic_add(&nr_bad, bad);
+	*count = URCU_TLS(nr_reads);
+	printf_verbose("thread_end %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+	return ((void*)1);
+
+}
+
+static void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	struct test *new, *old;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		new = test_alloc();
+		old = rcu_xchg_pointer(&slots[rand_r(&seed) % nr_slots], new);
+		if (caa_unlikely(wduration))
+			loop_sleep(wduration);
+		test_retire(old);
+		URCU_TLS(nr_writes)++;
+		if (caa_unlikely(epoch_writes)
+				&& !(URCU_TLS(nr_writes) % epoch_writes))
+			urcu_region_new_epoch(region);
+		if (caa_unlikely(!test_duration_write()))
+			break;
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+	}
+
+	rcu_unregister_thread();
+
+	printf_verbose("thread_end %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+	*count = URCU_TLS(nr_writes);
+	return ((void*)2);
+}
+
+static void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-c duration] (reader C.S. duration (in loops))\n");
+	printf("	[-e duration] (writer C.S. duration (in loops))\n");
+	printf("	[-s slots] (number of RCU pointers, default 1024)\n");
+	printf("	[-M] (use malloc and call_rcu rather than the pool)\n");
+	printf("	[-R] (use a region allocator rather than the pool)\n");
+	printf("	[-E writes] (with -R, writes of each writer per epoch)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader, *count_writer;
+	unsigned long long tot_reads = 0, tot_writes = 0;
+	unsigned long j;
+	int use_region = 0;
+	int i, a;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'e':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wduration = atol(argv[++i]);
+			break;
+		case 's':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_slots = atol(argv[++i]);
+			if (!nr_slots) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'M':
+			use_malloc = 1;
+			break;
+		case 'R':
+			use_region = 1;
+			break;
+		case 'E':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			epoch_writes = atol(argv[++i]);
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, %u writers.\n",
+		duration, nr_readers, nr_writers);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("Allocator : %s, %lu slots.\n",
+		use_malloc ? "malloc/call_rcu" :
+			use_region ? "urcu_region" : "urcu_pool", nr_slots);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	pool = urcu_pool_create(sizeof(struct test), 0);
+	if (!pool)
+		exit(1);
+	if (use_region) {
+		region = urcu_region_create(0, 0);
+		if (!region)
+			exit(1);
+	} else {
+		epoch_writes = 0;
+	}
+	slots = calloc(nr_slots, sizeof(*slots));
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, sizeof(*count_reader));
+	count_writer = calloc(nr_writers, sizeof(*count_writer));
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	sleep(duration);
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_reads += count_reader[i];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_writes += count_writer[i];
+	}
+
+	printf_verbose("total number of reads : %llu, writes %llu\n", tot_reads,
+	       tot_writes);
+	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu wdur %6lu "
+		"nr_writers %3u "
+		"wdelay %6lu nr_reads %12llu nr_writes %12llu nr_ops %12llu\n",
+		argv[0], duration, nr_readers, rduration, wduration,
+		nr_writers, wdelay, tot_reads, tot_writes,
+		tot_reads + tot_writes);
+	if (nr_bad)
+		printf("WARNING! %llu reads of a recycled object.\n", nr_bad);
+
+	/* No reader left: objects still published are freed at once. */
+	for (j = 0; j < nr_slots; j++) {
+		if (!slots[j])
+			continue;
+		if (use_malloc)
+			free(slots[j]);
+		else if (region)
+			urcu_region_free_rcu(region, slots[j]);
+		else
+			urcu_pool_free(pool, slots[j]);
+	}
+	rcu_barrier();
+	urcu_pool_destroy(pool);
+	if (region)
+		urcu_region_destroy(region);
+	free(slots);
+	free(tid_reader);
+	free(tid_writer);
+	free(count_reader);
+	free(count_writer);
+	return nr_bad ? 1 : 0;
+}
@@ -0,0 +1,498 @@
+/*
+ * test_urcu_prioq.c
+ *
+ * Userspace RCU library - example RCU skip list priority queue
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/cds.h>
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_reads);
+static DEFINE_URCU_TLS(unsigned long long, nr_empty_reads);
+static DEFINE_URCU_TLS(unsigned long long, nr_inserts);
+static DEFINE_URCU_TLS(unsigned long long, nr_delete_mins);
+static DEFINE_URCU_TLS(unsigned long long, nr_successful_inserts);
+static DEFINE_URCU_TLS(unsigned long long, nr_successful_delete_mins);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+static unsigned long prio_range = 1048576;	/* priorities in [0, range) */
+static unsigned int unlink_batch;
+static unsigned long nr_freed;
+
+struct test {
+	struct cds_prioq_node node;
+	unsigned long prio;
+};
+
+static struct cds_prioq q;
+
+static
+int test_cmp(struct cds_prioq_node *a, struct cds_prioq_node *b)
+{
+	unsigned long pa = caa_container_of(a, struct test, node)->prio;
+	unsigned long pb = caa_container_of(b, struct test, node)->prio;
+
+	return pa < pb ? -1 : pa > pb;
+}
+
+static
+void free_node_cb(struct rcu_head *head)
+{
+	struct test *node =
+		caa_container_of(head, struct test, node.head);
+
+	free(node);
+	uatomic_inc(&nr_freed);
+}
+
+void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		struct cds_prioq_node *qnode;
+
+		rcu_read_lock();
+		qnode = cds_prioq_peek_min(&q);
+		if (qnode)
+			assert(caa_container_of(qnode, struct test, node)->prio
+				< prio_range);
+		else
+			URCU_TLS(nr_empty_reads)++;
+		rcu_read_unlock();
+
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+	}
+
+	rcu_unregister_thread();
+	printf_verbose("reader thread_end, tid %lu, "
+			"reads %llu, empty reads %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_reads),
+			URCU_TLS(nr_empty_reads));
+	count[0] = URCU_TLS(nr_reads);
+	count[1] = URCU_TLS(nr_empty_reads);
+	return ((void*)1);
+}
+
+void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		if (rand_r(&seed) & 1) {
+			struct test *node = malloc(sizeof(*node));
+
+			if (!node)
+				goto next;
+			cds_prioq_node_init(&node->node);
+			node->prio = rand_r(&seed) % prio_range;
+			if (!cds_prioq_insert(&q, &node->node))
+				URCU_TLS(nr_successful_inserts)++;
+			else
+				free(node);
+			URCU_TLS(nr_inserts)++;
+		} else {
+			rcu_read_lock();
+			if (cds_prioq_delete_min(&q))
+				URCU_TLS(nr_successful_delete_mins)++;
+			rcu_read_unlock();
+			URCU_TLS(nr_delete_mins)++;
+		}
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+next:
+		if (caa_unlikely(!test_duration_write()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	count[0] = URCU_TLS(nr_inserts);
+	count[1] = URCU_TLS(nr_delete_mins);
+	count[2] = URCU_TLS(nr_successful_inserts);
+	count[3] = URCU_TLS(nr_successful_delete_mins);
+	printf_verbose("writer thread_end, tid %lu, "
+			"inserts %llu delete_mins %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_inserts),
+			URCU_TLS(nr_delete_mins));
+	return ((void*)2);
+}
+
+/* Drain the queue, checking that priorities come out in order. */
+void test_end(struct cds_prioq *q, unsigned long long *nr_end)
+{
+	struct cds_prioq_node *qnode;
+	unsigned long prev = 0;
+
+	rcu_register_thread();
+	for (;;) {
+		struct test *node;
+
+		rcu_read_lock();
+		qnode = cds_prioq_delete_min(q);
+		if (qnode) {
+			node = caa_container_of(qnode, struct test, node);
+			if (node->prio < prev)
+				printf("[ERROR] priority %lu dequeued after %lu\n",
+					node->prio, prev);
+			prev = node->prio;
+		}
+		rcu_read_unlock();
+		if (!qnode)
+			break;
+		(*nr_end)++;
+	}
+	rcu_unregister_thread();
+}
+
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-c duration] (reader period (in loops))\n");
+	printf("	[-k range] (priority range)\n");
+	printf("	[-b batch] (claimed nodes skipped before unlinking them)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader, *count_writer;
+	unsigned long long tot_reads = 0, tot_empty_reads = 0;
+	unsigned long long tot_inserts = 0, tot_delete_mins = 0;
+	unsigned long long tot_successful_inserts = 0,
+		tot_successful_delete_mins = 0;
+	unsigned long long end_delete_mins = 0;
+	int i, a;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'k':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			prio_range = atol(argv[++i]);
+			if (!prio_range) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'b':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			unlink_batch = atoi(argv[++i]);
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, "
+		       "%u writers.\n",
+		       duration, nr_readers, nr_writers);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, 2 * sizeof(*count_reader));
+	count_writer = calloc(nr_writers, 4 * sizeof(*count_writer));
+	cds_prioq_init(&q, test_cmp, unlink_batch, call_rcu, free_node_cb);
+	err = create_all_cpu_call_rcu_data(0);
+	if (err) {
+		printf("Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+	}
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[2 * i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[4 * i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_reads += count_reader[2 * i];
+		tot_empty_reads += count_reader[2 * i + 1];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_inserts += count_writer[4 * i];
+		tot_delete_mins += count_writer[4 * i + 1];
+		tot_successful_inserts += count_writer[4 * i + 2];
+		tot_successful_delete_mins += count_writer[4 * i + 3];
+	}
+
+	test_end(&q, &end_delete_mins);
+	err = cds_prioq_destroy(&q);
+	assert(!err);
+	/* Flush the reclaim of the unlinked nodes. */
+	rcu_barrier();
+
+	printf_verbose("total number of reads : %llu, empty reads %llu\n",
+		       tot_reads, tot_empty_reads);
+	printf_verbose("total number of inserts : %llu, delete_mins %llu\n",
+		       tot_inserts, tot_delete_mins);
+	printf("SUMMARY %-25s testdur %4lu nr_writers %3u wdelay %6lu "
+		"nr_readers %3u "
+		"rdur %6lu nr_reads %12llu nr_empty_reads %12llu "
+		"nr_inserts %12llu nr_delete_mins %12llu "
+		"successful inserts %12llu successful delete_mins %12llu "
+		"end_delete_mins %llu nr_ops %12llu\n",
+		argv[0], duration, nr_writers, wdelay,
+		nr_readers, rduration, tot_reads, tot_empty_reads,
+		tot_inserts, tot_delete_mins,
+		tot_successful_inserts, tot_successful_delete_mins,
+		end_delete_mins,
+		tot_reads + tot_inserts + tot_delete_mins);
+	if (tot_successful_inserts
+			!= tot_successful_delete_mins + end_delete_mins)
+		printf("WARNING! Discrepancy between nr succ. inserts %llu vs "
+		       "succ. delete_mins + end delete_mins %llu.\n",
+		       tot_successful_inserts,
+		       tot_successful_delete_mins + end_delete_mins);
+	if (nr_freed != tot_successful_inserts)
+		printf("WARNING! %lu nodes freed, %llu inserted.\n",
+		       nr_freed, tot_successful_inserts);
+
+	free_all_cpu_call_rcu_data();
+	free(count_reader);
+	free(count_writer);
+	free(tid_reader);
+	free(tid_writer);
+	return 0;
+}
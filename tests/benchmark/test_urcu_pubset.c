@@ -0,0 +1,554 @@
+/*
+ * test_urcu_pubset.c
+ *
+ * Userspace RCU library - example RCU publish set
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/pubset.h>
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_reads);
+static DEFINE_URCU_TLS(unsigned long long, nr_writes);
+static DEFINE_URCU_TLS(unsigned long long, nr_aborts);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+/* slots of the set */
+static unsigned int nr_slots = 8;
+
+#define OBJ_ALIVE	0x600DUL
+#define OBJ_FREED	0xDEADUL
+
+/*
+ * Each update replaces a random subset of the slots with new objects,
+ * holding the version of the generation it builds and the number of
+ * new objects, some of them stored in two slots. It may also copy an
+ * object to a slot it does not replace, leaving it in two slots, or
+ * abort. A generation thus holds the nr_new objects of its version,
+ * and older objects, all alive: the free function poisons the objects,
+ * and frees them after a grace period.
+ */
+struct test_obj {
+	unsigned long state;
+	unsigned long version;		/* of the generation adding it */
+	unsigned int nr_new;		/* new objects of that generation */
+	struct rcu_head rcu_head;
+};
+
+static struct cds_pubset set;
+
+/* Objects allocated and freed, inconsistencies. */
+static unsigned long nr_allocated, nr_freed, nr_errors;
+
+static
+void report_error(const char *msg, unsigned long a, unsigned long b)
+{
+	if (!uatomic_read(&nr_errors))
+		printf("[ERROR] %s: %lu, %lu\n", msg, a, b);
+	uatomic_inc(&nr_errors);
+}
+
+static
+struct test_obj *alloc_obj(unsigned long version)
+{
+	struct test_obj *obj;
+
+	obj = malloc(sizeof(*obj));
+	if (!obj)
+		exit(1);
+	obj->state = OBJ_ALIVE;
+	obj->version = version;
+	obj->nr_new = 0;
+	uatomic_inc(&nr_allocated);
+	return obj;
+}
+
+static
+void free_obj_cb(struct rcu_head *head)
+{
+	struct test_obj *obj = caa_container_of(head, struct test_obj,
+			rcu_head);
+
+	free(obj);
+	uatomic_inc(&nr_freed);
+}
+
+static
+void test_free_ptr(unsigned int slot, void *p)
+{
+	struct test_obj *obj = p;
+	unsigned long state;
+
+	state = uatomic_xchg(&obj->state, OBJ_FREED);
+	if (state != OBJ_ALIVE) {
+		report_error("object freed twice (slot, version)",
+			slot, obj->version);
+		return;
+	}
+	/* Keep the memory for the checks of the free function. */
+	call_rcu(&obj->rcu_head, free_obj_cb);
+}
+
+static
+void check_gen(struct cds_pubset_gen *gen, unsigned long *prev)
+{
+	struct test_obj *obj, *first = NULL;
+	unsigned int i, j, nr_new = 0;
+
+	if (gen->version < *prev)
+		report_error("generation going back (version, previous)",
+			gen->version, *prev);
+	*prev = gen->version;
+	for (i = 0; i < nr_slots; i++) {
+		obj = cds_pubset_get(gen, i);
+		if (!obj)
+			continue;
+		if (CMM_LOAD_SHARED(obj->state) != OBJ_ALIVE) {
+			report_error("freed object (slot, version)",
+				i, gen->version);
+			continue;
+		}
+		if (obj->version > gen->version)
+			report_error("object newer than generation "
+				"(object, generation)",
+				obj->version, gen->version);
+		if (obj->version != gen->version)
+			continue;
+		for (j = 0; j < i; j++) {
+			if (cds_pubset_get(gen, j) == obj)
+				break;
+		}
+		if (j == i)
+			nr_new++;
+		first = obj;
+	}
+	if (first && first->nr_new != nr_new)
+		report_error("partial generation (objects, expected)",
+			nr_new, first->nr_new);
+}
+
+void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	struct cds_pubset_gen *gen;
+	unsigned long prev = 0;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		rcu_read_lock();
+		gen = cds_pubset_read(&set);
+		check_gen(gen, &prev);
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		/* Still alive until the end of the critical section. */
+		check_gen(gen, &prev);
+		rcu_read_unlock();
+
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_unregister_thread();
+	printf_verbose("reader thread_end, tid %lu, reads %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_reads));
+	count[0] = URCU_TLS(nr_reads);
+	return ((void*)1);
+}
+
+void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	struct test_obj **added, *obj;
+	struct cds_pubset_gen *gen;
+	unsigned int i, j, nr_added;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	/* The free function uses call_rcu. */
+	rcu_register_thread();
+
+	added = calloc(nr_slots, sizeof(*added));
+	if (!added)
+		exit(1);
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		gen = cds_pubset_update_begin(&set);
+		if (!gen)
+			exit(1);
+		nr_added = 0;
+		obj = NULL;
+		for (i = 0; i < nr_slots; i++) {
+			if (rand_r(&seed) & 1)
+				continue;
+			/* Store some new objects in two slots. */
+			if (!obj || (rand_r(&seed) & 3))
+				obj = added[nr_added++] =
+					alloc_obj(gen->version);
+			cds_pubset_update_set(gen, i, obj);
+		}
+		for (i = 0; i < nr_added; i++)
+			added[i]->nr_new = nr_added;
+		/* Copy an object to a slot not replaced. */
+		if (!(rand_r(&seed) & 3)) {
+			i = rand_r(&seed) % nr_slots;
+			j = rand_r(&seed) % nr_slots;
+			obj = cds_pubset_get(gen, j);
+			if (!obj || obj->version != gen->version)
+				cds_pubset_update_set(gen, j,
+					cds_pubset_get(gen, i));
+		}
+		if (!(rand_r(&seed) & 7)) {
+			cds_pubset_update_abort(gen);
+			for (i = 0; i < nr_added; i++) {
+				free(added[i]);
+				uatomic_inc(&nr_freed);
+			}
+			URCU_TLS(nr_aborts)++;
+		} else {
+			cds_pubset_update_commit(gen);
+		}
+
+		URCU_TLS(nr_writes)++;
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+		if (caa_unlikely(!test_duration_write()))
+			break;
+	}
+
+	free(added);
+	rcu_unregister_thread();
+
+	count[0] = URCU_TLS(nr_writes);
+	count[1] = URCU_TLS(nr_aborts);
+	printf_verbose("writer thread_end, tid %lu, writes %llu, "
+			"aborts %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_writes), URCU_TLS(nr_aborts));
+	return ((void*)2);
+}
+
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-c duration] (reader C.S. duration (in loops))\n");
+	printf("	[-s slots] (slots of the set, default 8)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader, *count_writer;
+	unsigned long long tot_reads = 0, tot_writes = 0, tot_aborts = 0;
+	int i, a, retval = 0;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 's':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_slots = atoi(argv[++i]);
+			if (!nr_slots) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, %u writers.\n",
+		duration, nr_readers, nr_writers);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops, %u slots.\n",
+		rduration, nr_slots);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, sizeof(*count_reader));
+	count_writer = calloc(nr_writers, 2 * sizeof(*count_writer));
+
+	err = create_all_cpu_call_rcu_data(0);
+	if (err) {
+		printf("Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+	}
+
+	if (cds_pubset_init(&set, nr_slots, test_free_ptr))
+		exit(1);
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[2 * i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_reads += count_reader[i];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_writes += count_writer[2 * i];
+		tot_aborts += count_writer[2 * i + 1];
+	}
+
+	/* Generations replaced, then their objects. */
+	rcu_barrier();
+	rcu_barrier();
+	/* The free function uses call_rcu. */
+	rcu_register_thread();
+	cds_pubset_destroy(&set);
+	rcu_unregister_thread();
+	rcu_barrier();
+
+	printf_verbose("total number of reads : %llu, writes %llu, "
+		       "aborts %llu\n", tot_reads, tot_writes, tot_aborts);
+	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu "
+		"nr_writers %3u wdelay %6lu nr_slots %u "
+		"nr_reads %12llu nr_writes %12llu nr_aborts %12llu "
+		"nr_ops %12llu\n",
+		argv[0], duration, nr_readers, rduration,
+		nr_writers, wdelay, nr_slots,
+		tot_reads, tot_writes, tot_aborts,
+		tot_reads + tot_writes);
+	if (nr_freed != nr_allocated) {
+		printf("WARNING! %lu objects allocated, %lu freed.\n",
+			nr_allocated, nr_freed);
+		retval = 1;
+	}
+	if (nr_errors) {
+		printf("WARNING! %lu inconsistent generations or double "
+		       "frees.\n", nr_errors);
+		retval = 1;
+	}
+	free_all_cpu_call_rcu_data();
+	free(count_reader);
+	free(count_writer);
+	free(tid_reader);
+	free(tid_writer);
+	return retval;
+}
@@ -32,6 +32,7 @@
 #include <errno.h>
 
 #include <urcu/arch.h>
+#include <urcu/clock.h>
 #include "thread-id.h"
 
 #define _LGPL_SOURCE
@@ -95,7 +96,7 @@ void *thr_reader(void *arg)
 
 	rcu_register_thread();
 
-	time1 = caa_get_cycles();
+	time1 = caa_get_cycles_ordered();
 	for (i = 0; i < OUTER_READ_LOOP; i++) {
 		for (j = 0; j < INNER_READ_LOOP; j++) {
 			_rcu_read_lock();
@@ -107,7 +108,7 @@ void *thr_reader(void *arg)
 		}
 		_rcu_quiescent_state();
 	}
-	time2 = caa_get_cycles();
+	time2 = caa_get_cycles_ordered();
 
 	rcu_unregister_thread();
 
@@ -132,7 +133,7 @@ void *thr_writer(void *arg)
 
 	for (i = 0; i < OUTER_WRITE_LOOP; i++) {
 		for (j = 0; j < INNER_WRITE_LOOP; j++) {
-			time1 = caa_get_cycles();
+			time1 = caa_get_cycles_ordered();
 			new = malloc(sizeof(struct test_array));
 			rcu_copy_mutex_lock();
 			old = test_rcu_pointer;
@@ -148,7 +149,7 @@ void *thr_writer(void *arg)
 				old->a = 0;
 			}
 			free(old);
-			time2 = caa_get_cycles();
+			time2 = caa_get_cycles_ordered();
 			writer_time[(unsigned long)arg] += time2 - time1;
 			usleep(1);
 		}
@@ -211,10 +212,14 @@ int main(int argc, char **argv)
 		tot_wtime += writer_time[i];
 	}
 	free(test_rcu_pointer);
-	printf("Time per read : %g cycles\n",
-	       (double)tot_rtime / ((double)NR_READ * (double)READ_LOOP));
-	printf("Time per write : %g cycles\n",
-	       (double)tot_wtime / ((double)NR_WRITE * (double)WRITE_LOOP));
+	printf("Time per read : %g cycles, %g ns\n",
+	       (double)tot_rtime / ((double)NR_READ * (double)READ_LOOP),
+	       (double)caa_cycles_to_ns(tot_rtime)
+			/ ((double)NR_READ * (double)READ_LOOP));
+	printf("Time per write : %g cycles, %g ns\n",
+	       (double)tot_wtime / ((double)NR_WRITE * (double)WRITE_LOOP),
+	       (double)caa_cycles_to_ns(tot_wtime)
+			/ ((double)NR_WRITE * (double)WRITE_LOOP));
 
 	free(reader_time);
 	free(writer_time);
@@ -0,0 +1,546 @@
+/*
+ * test_urcu_replay.c
+ *
+ * Userspace RCU library - replay of recorded cds_lfht and wfcqueue
+ * operation traces
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Replays a trace recorded with --record=FILE (see bench.h) on a hash
+ * table and a queue: each traced thread is replayed by a thread of its
+ * own (or by thread number modulo -t), issuing its operations in order,
+ * at the time they were recorded (scaled by -s) or as fast as possible
+ * with -s 0. The throughput and the latency percentiles of each kind of
+ * operation are reported. Keys and hashes are those of the trace, so a
+ * change of the library (e.g. of the bucket layout or of the
+ * synchronization) is measured on the recorded access pattern.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#define _LGPL_SOURCE
+#include <urcu.h>
+#include <urcu/rculfhash.h>
+#include <urcu/wfcqueue.h>
+#include <urcu/clock.h>
+#include "bench.h"
+
+/* Waits longer than this sleep, shorter ones spin. */
+#define REPLAY_SPIN_NS		100000ULL
+
+struct replay_node {
+	struct cds_lfht_node node;
+	uint64_t key;
+	struct rcu_head head;
+};
+
+struct replay_qnode {
+	struct cds_wfcq_node node;
+};
+
+struct replay_op {
+	struct bench_trace_record rec;
+	uint64_t seq;		/* position in the trace */
+};
+
+struct replay_thread {
+	pthread_t tid;
+	struct replay_op *op;
+	size_t nr, alloc;
+
+	/* Results. */
+	struct bench_hist hist[NR_BENCH_TRACE_OPS];
+	unsigned long long nr_lookup_hit, nr_lfht_fail, nr_dequeue_empty;
+	uint64_t max_lag_ns;	/* behind schedule, with timing */
+};
+
+static struct cds_lfht *replay_ht;
+static struct cds_wfcq_head qhead;
+static struct cds_wfcq_tail qtail;
+
+static struct replay_thread *threads;
+static unsigned int nr_threads;
+static double speed = 1.0;
+static uint64_t trace_base_ns;	/* first timestamp of the trace */
+
+static volatile int test_go;
+static uint64_t replay_start_ns;
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, ## args);	\
+	} while (0)
+
+static
+int replay_match(struct cds_lfht_node *node, const void *key)
+{
+	struct replay_node *rnode =
+		caa_container_of(node, struct replay_node, node);
+
+	return rnode->key == *(const uint64_t *) key;
+}
+
+static
+void free_replay_node_cb(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct replay_node, head));
+}
+
+static
+struct replay_node *replay_node_alloc(uint64_t key)
+{
+	struct replay_node *node;
+
+	node = malloc(sizeof(*node));
+	if (!node) {
+		perror("malloc");
+		exit(-1);
+	}
+	cds_lfht_node_init(&node->node);
+	node->key = key;
+	return node;
+}
+
+static
+void replay_one(struct replay_thread *t, const struct bench_trace_record *rec)
+{
+	struct cds_lfht_node *ret_node;
+	struct cds_lfht_iter iter;
+	struct replay_node *node;
+	struct replay_qnode *qnode;
+	struct cds_wfcq_node *qret;
+	int ret;
+
+	switch (rec->op) {
+	case BENCH_TRACE_LFHT_LOOKUP:
+		rcu_read_lock();
+		cds_lfht_lookup(replay_ht, rec->hash, replay_match, &rec->key,
+			&iter);
+		if (cds_lfht_iter_get_node(&iter))
+			t->nr_lookup_hit++;
+		rcu_read_unlock();
+		break;
+	case BENCH_TRACE_LFHT_ADD:
+		node = replay_node_alloc(rec->key);
+		rcu_read_lock();
+		cds_lfht_add(replay_ht, rec->hash, &node->node);
+		rcu_read_unlock();
+		break;
+	case BENCH_TRACE_LFHT_ADD_UNIQUE:
+		node = replay_node_alloc(rec->key);
+		rcu_read_lock();
+		ret_node = cds_lfht_add_unique(replay_ht, rec->hash,
+			replay_match, &rec->key, &node->node);
+		rcu_read_unlock();
+		if (ret_node != &node->node) {
+			free(node);
+			t->nr_lfht_fail++;
+		}
+		break;
+	case BENCH_TRACE_LFHT_ADD_REPLACE:
+		node = replay_node_alloc(rec->key);
+		rcu_read_lock();
+		ret_node = cds_lfht_add_replace(replay_ht, rec->hash,
+			replay_match, &rec->key, &node->node);
+		rcu_read_unlock();
+		if (ret_node)
+			call_rcu(&caa_container_of(ret_node,
+					struct replay_node, node)->head,
+				free_replay_node_cb);
+		break;
+	case BENCH_TRACE_LFHT_DEL:
+		rcu_read_lock();
+		cds_lfht_lookup(replay_ht, rec->hash, replay_match, &rec->key,
+			&iter);
+		ret = cds_lfht_del(replay_ht, cds_lfht_iter_get_node(&iter));
+		rcu_read_unlock();
+		if (!ret)
+			call_rcu(&caa_container_of(cds_lfht_iter_get_node(&iter),
+					struct replay_node, node)->head,
+				free_replay_node_cb);
+		else
+			t->nr_lfht_fail++;
+		break;
+	case BENCH_TRACE_WFCQ_ENQUEUE:
+		qnode = malloc(sizeof(*qnode));
+		if (!qnode) {
+			perror("malloc");
+			exit(-1);
+		}
+		cds_wfcq_node_init(&qnode->node);
+		(void) cds_wfcq_enqueue(&qhead, &qtail, &qnode->node);
+		break;
+	case BENCH_TRACE_WFCQ_DEQUEUE:
+		qret = cds_wfcq_dequeue_blocking(&qhead, &qtail);
+		if (qret)
+			free(caa_container_of(qret, struct replay_qnode, node));
+		else
+			t->nr_dequeue_empty++;
+		break;
+	}
+}
+
+/* Wait for the time of a record, scaled by speed. */
+static
+void replay_wait(struct replay_thread *t, const struct bench_trace_record *rec)
+{
+	uint64_t due, now;
+	struct timespec ts;
+
+	due = replay_start_ns + (uint64_t) ((rec->ns - trace_base_ns) / speed);
+	now = caa_clock_ns();
+	if (now > due) {
+		if (now - due > t->max_lag_ns)
+			t->max_lag_ns = now - due;
+		return;
+	}
+	if (due - now > REPLAY_SPIN_NS) {
+		ts.tv_sec = (due - now - REPLAY_SPIN_NS) / 1000000000ULL;
+		ts.tv_nsec = (due - now - REPLAY_SPIN_NS) % 1000000000ULL;
+		(void) nanosleep(&ts, NULL);
+	}
+	while (caa_clock_ns() < due)
+		caa_cpu_relax();
+}
+
+static
+void *thr_replay(void *arg)
+{
+	struct replay_thread *t = arg;
+	size_t i;
+	cycles_t begin;
+	int op;
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (i = 0; i < t->nr; i++) {
+		const struct bench_trace_record *rec = &t->op[i].rec;
+
+		if (speed > 0)
+			replay_wait(t, rec);
+		op = rec->op;
+		begin = caa_get_cycles_ordered();
+		replay_one(t, rec);
+		bench_hist_record(&t->hist[op],
+			caa_cycles_to_ns(caa_get_cycles_ordered() - begin));
+	}
+
+	rcu_unregister_thread();
+	return NULL;
+}
+
+static
+int replay_op_cmp(const void *a, const void *b)
+{
+	const struct replay_op *x = a, *y = b;
+
+	if (x->rec.ns != y->rec.ns)
+		return x->rec.ns < y->rec.ns ? -1 : 1;
+	return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+static
+void replay_add_op(struct replay_thread *t,
+		const struct bench_trace_record *rec, uint64_t seq)
+{
+	if (t->nr == t->alloc) {
+		t->alloc = t->alloc ? 2 * t->alloc : 1024;
+		t->op = realloc(t->op, t->alloc * sizeof(*t->op));
+		if (!t->op) {
+			perror("realloc");
+			exit(-1);
+		}
+	}
+	t->op[t->nr].rec = *rec;
+	t->op[t->nr].seq = seq;
+	t->nr++;
+}
+
+/*
+ * Load the trace, and give the records of each traced thread to replay
+ * thread number modulo nr_threads (0: one per traced thread). Returns
+ * the number of records.
+ */
+static
+uint64_t load_trace(const char *path, unsigned int *nr_traced)
+{
+	struct bench_trace_header header;
+	struct bench_trace_record rec;
+	uint64_t seq = 0;
+	unsigned int i;
+	size_t nr_rec = 0, j;
+	struct bench_trace_record *all = NULL;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(-1);
+	}
+	if (fread(&header, sizeof(header), 1, f) != 1
+			|| memcmp(header.magic, BENCH_TRACE_MAGIC,
+				sizeof(header.magic))
+			|| header.record_size != sizeof(rec)) {
+		fprintf(stderr, "%s: not a trace of this version\n", path);
+		exit(-1);
+	}
+	*nr_traced = 0;
+	trace_base_ns = UINT64_MAX;
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (rec.op >= NR_BENCH_TRACE_OPS) {
+			fprintf(stderr, "%s: unknown operation %u\n", path,
+				rec.op);
+			exit(-1);
+		}
+		if (rec.thread >= *nr_traced)
+			*nr_traced = rec.thread + 1;
+		if (rec.ns < trace_base_ns)
+			trace_base_ns = rec.ns;
+		if (!(nr_rec & (nr_rec - 1))) {
+			all = realloc(all, (nr_rec ? 2 * nr_rec : 1)
+				* sizeof(*all));
+			if (!all) {
+				perror("realloc");
+				exit(-1);
+			}
+		}
+		all[nr_rec++] = rec;
+	}
+	if (ferror(f)) {
+		perror(path);
+		exit(-1);
+	}
+	fclose(f);
+
+	if (!nr_threads || nr_threads > *nr_traced)
+		nr_threads = *nr_traced;
+	if (!nr_threads)
+		nr_threads = 1;
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads) {
+		perror("calloc");
+		exit(-1);
+	}
+	for (j = 0; j < nr_rec; j++)
+		replay_add_op(&threads[all[j].thread % nr_threads], &all[j],
+			seq++);
+	free(all);
+
+	/* Threads replaying several traced threads interleave them in time. */
+	if (nr_threads < *nr_traced) {
+		for (i = 0; i < nr_threads; i++)
+			qsort(threads[i].op, threads[i].nr,
+				sizeof(threads[i].op[0]), replay_op_cmp);
+	}
+	return nr_rec;
+}
+
+static
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s trace_file <OPTIONS>\n", argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-t nr] (replay threads, default one per traced thread)\n");
+	printf("	[-s speed] (time scale, default 1: recorded timing, 0: as fast as possible)\n");
+	printf("	[-h size] (initial number of buckets, default 1024)\n");
+	printf("	[-A] (automatically resize the hash table)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[--format=json|csv] (machine-readable report)\n");
+	printf("	[--perf] (hardware performance counters per operation)\n");
+	printf("\n");
+	printf("Traces are recorded with the --record=FILE option of test_urcu_hash and\n");
+	printf("test_urcu_wfcq.\n");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long init_hash_size = 1024;
+	struct bench_hist tot_hist[NR_BENCH_TRACE_OPS];
+	unsigned long long nr_lookup_hit = 0, nr_lfht_fail = 0,
+		nr_dequeue_empty = 0;
+	uint64_t nr_ops, duration_ns, max_lag_ns = 0;
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+	struct cds_wfcq_node *qnode;
+	unsigned int nr_traced, t;
+	int i, flags = 0, op, err;
+
+	if (argc < 2 || argv[1][0] == '-') {
+		show_usage(argc, argv);
+		return -1;
+	}
+	for (i = 2; i < argc; i++) {
+		if (bench_parse_option(argv[i]))
+			continue;
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 't':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_threads = strtoul(argv[++i], NULL, 0);
+			break;
+		case 's':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			speed = strtod(argv[++i], NULL);
+			if (speed < 0) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'h':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			init_hash_size = strtoul(argv[++i], NULL, 0);
+			break;
+		case 'A':
+			flags |= CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING;
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		default:
+			show_usage(argc, argv);
+			return -1;
+		}
+	}
+
+	nr_ops = load_trace(argv[1], &nr_traced);
+	printf_verbose("%llu operations of %u threads, replayed by %u threads.\n",
+		(unsigned long long) nr_ops, nr_traced, nr_threads);
+
+	replay_ht = cds_lfht_new(init_hash_size, 1, 0, flags, NULL);
+	if (!replay_ht) {
+		fprintf(stderr, "Error allocating hash table.\n");
+		return -1;
+	}
+	cds_wfcq_init(&qhead, &qtail);
+
+	for (t = 0; t < nr_threads; t++) {
+		err = pthread_create(&threads[t].tid, NULL, thr_replay,
+			&threads[t]);
+		if (err) {
+			errno = err;
+			perror("pthread_create");
+			exit(-1);
+		}
+	}
+
+	bench_perf_start();
+	replay_start_ns = caa_clock_ns();
+	cmm_smp_mb();
+	test_go = 1;
+
+	memset(tot_hist, 0, sizeof(tot_hist));
+	for (t = 0; t < nr_threads; t++) {
+		err = pthread_join(threads[t].tid, NULL);
+		if (err) {
+			errno = err;
+			perror("pthread_join");
+			exit(-1);
+		}
+		for (op = 0; op < NR_BENCH_TRACE_OPS; op++)
+			bench_hist_merge(&tot_hist[op], &threads[t].hist[op]);
+		nr_lookup_hit += threads[t].nr_lookup_hit;
+		nr_lfht_fail += threads[t].nr_lfht_fail;
+		nr_dequeue_empty += threads[t].nr_dequeue_empty;
+		if (threads[t].max_lag_ns > max_lag_ns)
+			max_lag_ns = threads[t].max_lag_ns;
+		free(threads[t].op);
+	}
+	free(threads);
+	duration_ns = caa_clock_ns() - replay_start_ns;
+	bench_perf_stop();
+
+	/* Teardown: the replay threads are done, nothing reads the table. */
+	rcu_register_thread();
+	rcu_read_lock();
+	cds_lfht_for_each(replay_ht, &iter, node) {
+		if (!cds_lfht_del(replay_ht, node))
+			call_rcu(&caa_container_of(node,
+					struct replay_node, node)->head,
+				free_replay_node_cb);
+	}
+	rcu_read_unlock();
+	rcu_barrier();
+	rcu_unregister_thread();
+	if (cds_lfht_destroy(replay_ht, NULL))
+		fprintf(stderr, "Error destroying hash table.\n");
+	while ((qnode = __cds_wfcq_dequeue_blocking(&qhead, &qtail)))
+		free(caa_container_of(qnode, struct replay_qnode, node));
+
+	for (op = 0; op < NR_BENCH_TRACE_OPS; op++) {
+		if (tot_hist[op].count)
+			bench_hist_print(&tot_hist[op], "%-16s latency",
+				bench_trace_op_name(op));
+	}
+	printf("SUMMARY %-25s nr_threads %3u nr_traced %3u speed %g "
+		"nr_ops %12llu duration_ms %8llu ops_per_s %12.0f "
+		"lookup_hit %12llu lfht_fail %12llu dequeue_empty %12llu "
+		"max_lag_us %8llu\n",
+		argv[0], nr_threads, nr_traced, speed,
+		(unsigned long long) nr_ops,
+		(unsigned long long) duration_ns / 1000000,
+		duration_ns ? nr_ops * 1e9 / duration_ns : 0,
+		nr_lookup_hit, nr_lfht_fail, nr_dequeue_empty,
+		(unsigned long long) max_lag_ns / 1000);
+
+	bench_report_begin(argv[0]);
+	bench_report_u64("nr_threads", nr_threads);
+	bench_report_u64("nr_traced", nr_traced);
+	bench_report_double("speed", speed);
+	bench_report_u64("nr_ops", nr_ops);
+	bench_report_u64("duration_ns", duration_ns);
+	bench_report_double("ops_per_s",
+		duration_ns ? nr_ops * 1e9 / duration_ns : 0);
+	bench_report_u64("lookup_hit", nr_lookup_hit);
+	bench_report_u64("lfht_fail", nr_lfht_fail);
+	bench_report_u64("dequeue_empty", nr_dequeue_empty);
+	if (speed > 0)
+		bench_report_u64("max_lag_ns", max_lag_ns);
+	for (op = 0; op < NR_BENCH_TRACE_OPS; op++) {
+		if (tot_hist[op].count)
+			bench_report_hist(bench_trace_op_name(op),
+				&tot_hist[op]);
+	}
+	bench_report_perf(nr_ops);
+	bench_report_end();
+	return 0;
+}
@@ -0,0 +1,758 @@
+/*
+ * test_urcu_replica.c
+ *
+ * Userspace RCU library - example NUMA-replicated RCU pointer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The replicated pointer is built in this program, reading the fake
+ * NUMA topology main() creates in a temporary directory: two nodes
+ * with CPUs, splitting the CPUs of the system, a memory-only node, and
+ * a node without cpulist. Its static functions are checked directly.
+ */
+#define _GNU_SOURCE
+#define _LGPL_SOURCE
+#include "config.h"
+#include <urcu.h>
+
+#define NODE_SYSFS	"node"
+#include "../../replica.c"
+
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_reads);
+static DEFINE_URCU_TLS(unsigned long long, nr_local_checks);
+static DEFINE_URCU_TLS(unsigned long long, nr_writes);
+static DEFINE_URCU_TLS(unsigned long long, nr_failed);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+#define REPLICA_ALIVE	0x600DUL
+#define REPLICA_FREED	0xDEADUL
+#define REPLICA_WORDS	64
+
+/*
+ * Each update builds the replicas of a new version, all words of which
+ * hold that version. The free function poisons the replicas, and frees
+ * them after a grace period.
+ */
+struct test_replica {
+	unsigned long state;
+	unsigned long version;
+	unsigned int index;		/* replica index of its node */
+	unsigned long word[REPLICA_WORDS];
+	struct rcu_head rcu_head;
+};
+
+/* An update, within rcu_replica_update(). */
+struct test_update {
+	unsigned long version;
+	unsigned long sync_base;	/* grace periods before the update */
+	unsigned long prev_version;	/* published before the update */
+	unsigned int nr_built, nr_freed;
+	int fail_at;			/* replica not built, -1 for none */
+};
+
+static struct rcu_replica replica;
+static struct rcu_flavor_struct test_flavor;
+
+/* Protected by the update lock of the replicated pointer. */
+static struct test_update *cur_update;
+static unsigned long last_version, nr_syncs;
+
+/* Last version published within a grace period, read by the readers. */
+static unsigned long committed;
+
+/* Replicas allocated and freed, inconsistencies. */
+static unsigned long nr_allocated, nr_freed, nr_errors;
+
+static
+void report_error(const char *msg, unsigned long a, unsigned long b)
+{
+	if (!uatomic_read(&nr_errors))
+		printf("[ERROR] %s: %lu, %lu\n", msg, a, b);
+	uatomic_inc(&nr_errors);
+}
+
+/* Replica index of a NUMA node id. */
+static
+unsigned int node_index(int id)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_nodes; i++) {
+		if (node_id[i] == id)
+			return i;
+	}
+	report_error("unknown node (node, nodes)", id, nr_nodes);
+	return 0;
+}
+
+static
+void *test_copy(int node, void *priv)
+{
+	struct test_update *u = priv;
+	struct test_replica *rep;
+	unsigned int i;
+
+	if (!u->nr_built) {
+		u->version = ++last_version;
+		u->sync_base = nr_syncs;
+		u->prev_version = CMM_LOAD_SHARED(committed);
+		cur_update = u;
+	}
+	if ((int) u->nr_built == u->fail_at)
+		return NULL;
+	rep = rcu_replica_alloc(sizeof(*rep), node);
+	if (!rep)
+		exit(1);
+	rep->state = REPLICA_ALIVE;
+	rep->version = u->version;
+	rep->index = node_index(node);
+	if (rep->index != u->nr_built)
+		report_error("replicas out of node order (index, built)",
+			rep->index, u->nr_built);
+	for (i = 0; i < REPLICA_WORDS; i++)
+		rep->word[i] = u->version;
+	u->nr_built++;
+	uatomic_inc(&nr_allocated);
+	return rep;
+}
+
+static
+void test_synchronize_rcu(void)
+{
+	synchronize_rcu();
+	nr_syncs++;
+	/* All replicas of the update are published. */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(committed, cur_update->version);
+}
+
+static
+void free_replica_cb(struct rcu_head *head)
+{
+	struct test_replica *rep = caa_container_of(head,
+			struct test_replica, rcu_head);
+
+	free(rep);
+	uatomic_inc(&nr_freed);
+}
+
+static
+void test_free_replica(void *p)
+{
+	struct test_replica *rep = p;
+	struct test_update *u = cur_update;
+
+	if (uatomic_xchg(&rep->state, REPLICA_FREED) != REPLICA_ALIVE) {
+		report_error("replica freed twice (version, index)",
+			rep->version, rep->index);
+		return;
+	}
+	if (!u) {
+		/* rcu_replica_exit() */
+	} else if (rep->version == u->version) {
+		/* Built by a failed update: never published. */
+		if (u->fail_at < 0 || nr_syncs != u->sync_base)
+			report_error("published replica freed on error "
+				"(version, index)", rep->version, rep->index);
+	} else {
+		/* Replaced: freed after the single grace period. */
+		if (nr_syncs != u->sync_base + 1)
+			report_error("replica freed without one grace period "
+				"(grace periods, version)",
+				nr_syncs - u->sync_base, rep->version);
+		if (rep->version != u->prev_version)
+			report_error("freed replica not current "
+				"(version, current)",
+				rep->version, u->prev_version);
+		u->nr_freed++;
+	}
+	/* Keep the memory for the checks of the readers. */
+	call_rcu(&rep->rcu_head, free_replica_cb);
+}
+
+static
+void check_replica(struct test_replica *rep, unsigned long version)
+{
+	unsigned int i;
+
+	if (!rep) {
+		report_error("no replica (version, nodes)", version,
+			replica.nr_nodes);
+		return;
+	}
+	if (CMM_LOAD_SHARED(rep->state) != REPLICA_ALIVE)
+		report_error("freed replica (version, index)",
+			rep->version, rep->index);
+	if (rep->version < version)
+		report_error("old replica (version, committed)",
+			rep->version, version);
+	for (i = 0; i < REPLICA_WORDS; i++) {
+		if (rep->word[i] != rep->version) {
+			report_error("partial replica (word, version)",
+				rep->word[i], rep->version);
+			break;
+		}
+	}
+}
+
+void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	struct test_replica *rep;
+	unsigned long version;
+	int cpu, cpu_after, rseq_cpu;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		rcu_read_lock();
+		version = CMM_LOAD_SHARED(committed);
+		cmm_smp_rmb();
+		cpu = rcu_replica_current_cpu();
+		rseq_cpu = urcu_rseq_cpu_id();
+		rep = rcu_dereference_replica(&replica);
+		cpu_after = rcu_replica_current_cpu();
+		check_replica(rep, version);
+		/* Not migrated: the replica is the one of the CPU. */
+		if (rep && cpu >= 0 && cpu == cpu_after) {
+			if (rseq_cpu >= 0 && rseq_cpu != cpu)
+				report_error("rseq CPU mismatch (rseq, cpu)",
+					rseq_cpu, cpu);
+			if (rep->index != ((unsigned int) cpu < replica.nr_cpus
+					? replica.cpu_node[cpu] : 0))
+				report_error("replica of another node "
+					"(index, cpu)", rep->index, cpu);
+			URCU_TLS(nr_local_checks)++;
+		}
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		/* Still alive until the end of the critical section. */
+		check_replica(rep, version);
+		rcu_read_unlock();
+
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_unregister_thread();
+	printf_verbose("reader thread_end, tid %lu, reads %llu, "
+			"local checks %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_reads), URCU_TLS(nr_local_checks));
+	count[0] = URCU_TLS(nr_reads);
+	count[1] = URCU_TLS(nr_local_checks);
+	return ((void*)1);
+}
+
+void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	struct test_update u;
+	int ret;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	/* The free function uses call_rcu. */
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		memset(&u, 0, sizeof(u));
+		/* Fail to build one of the replicas, sometimes. */
+		u.fail_at = (rand_r(&seed) & 15) ? -1
+			: (int) (rand_r(&seed) % replica.nr_nodes);
+		ret = rcu_replica_update(&replica, test_copy, &u);
+		if (u.fail_at >= 0) {
+			if (ret != -ENOMEM)
+				report_error("failed update returned (ret, "
+					"index)", ret, u.fail_at);
+			if (u.nr_freed)
+				report_error("failed update freed replicas "
+					"(freed, index)", u.nr_freed,
+					u.fail_at);
+			URCU_TLS(nr_failed)++;
+		} else {
+			if (ret)
+				report_error("update failed (ret, version)",
+					ret, u.version);
+			/* main() publishes the first replicas. */
+			if (u.nr_freed != replica.nr_nodes)
+				report_error("replicas not freed by the update "
+					"(freed, nodes)", u.nr_freed,
+					replica.nr_nodes);
+		}
+
+		URCU_TLS(nr_writes)++;
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+		if (caa_unlikely(!test_duration_write()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	count[0] = URCU_TLS(nr_writes);
+	count[1] = URCU_TLS(nr_failed);
+	printf_verbose("writer thread_end, tid %lu, writes %llu, "
+			"failed %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_writes), URCU_TLS(nr_failed));
+	return ((void*)2);
+}
+
+static
+void write_file(const char *path, const char *content)
+{
+	FILE *fp;
+
+	fp = fopen(path, "w");
+	if (!fp || fputs(content, fp) == EOF || fclose(fp)) {
+		perror(path);
+		exit(1);
+	}
+}
+
+static
+void make_dir(const char *path)
+{
+	if (mkdir(path, 0700)) {
+		perror(path);
+		exit(1);
+	}
+}
+
+/* First CPU of the second node, and its last CPU but one. */
+static unsigned int topo_half, topo_last;
+
+/*
+ * Node 0 holds the CPUs from 0 to topo_half - 1, node 2 the CPUs from
+ * topo_half to topo_last and the offline CPU topo_last + 2. Node 1 has
+ * no CPU, node 3 no cpulist.
+ */
+static
+void topology_create(char *dir)
+{
+	unsigned int nr = sysconf(_SC_NPROCESSORS_CONF) > 0 ?
+		sysconf(_SC_NPROCESSORS_CONF) : 1;
+	char list[64];
+
+	topo_half = (nr + 1) / 2;
+	topo_last = nr - 1 > topo_half ? nr - 1 : topo_half;
+	if (!mkdtemp(dir) || chdir(dir)) {
+		perror(dir);
+		exit(1);
+	}
+	make_dir("node");
+	make_dir("node/node0");
+	make_dir("node/node1");
+	make_dir("node/node2");
+	make_dir("node/node3");
+	if (topo_half == 1)
+		snprintf(list, sizeof(list), "0\n");
+	else
+		snprintf(list, sizeof(list), "0-%u\n", topo_half - 1);
+	write_file("node/node0/cpulist", list);
+	write_file("node/node1/cpulist", "\n");
+	snprintf(list, sizeof(list), "%u-%u,%u\n", topo_half, topo_last,
+		topo_last + 2);
+	write_file("node/node2/cpulist", list);
+	write_file("node/possible", "0-3\n");
+}
+
+static
+void topology_remove(const char *dir)
+{
+	(void) unlink("node/node0/cpulist");
+	(void) unlink("node/node1/cpulist");
+	(void) unlink("node/node2/cpulist");
+	(void) unlink("node/possible");
+	(void) rmdir("node/node0");
+	(void) rmdir("node/node1");
+	(void) rmdir("node/node2");
+	(void) rmdir("node/node3");
+	(void) rmdir("node");
+	if (chdir("/") || rmdir(dir))
+		perror(dir);
+}
+
+static unsigned long long cpulist_mask;
+
+static
+void cpulist_collect(unsigned long cpu, unsigned int node)
+{
+	if (node != 42 || cpu >= 64)
+		report_error("cpulist callback (cpu, node)", cpu, node);
+	else
+		cpulist_mask |= 1ULL << cpu;
+}
+
+static const struct {
+	const char *list;
+	unsigned long long mask;
+} cpulist_tests[] = {
+	{ "0-3,8-11\n", 0xf0fULL },
+	{ "5", 1ULL << 5 },
+	{ "1,3-3,7\n", (1ULL << 1) | (1ULL << 3) | (1ULL << 7) },
+	{ "62-63", 3ULL << 62 },
+	{ "2-4,x", 0x1cULL },
+	{ "", 0 },
+	{ "\n", 0 },
+};
+
+static
+void check_topology(void)
+{
+	unsigned int i, cpu, expected;
+
+	for (i = 0; i < CAA_ARRAY_SIZE(cpulist_tests); i++) {
+		cpulist_mask = 0;
+		cpulist_for_each(cpulist_tests[i].list, cpulist_collect, 42);
+		if (cpulist_mask != cpulist_tests[i].mask)
+			report_error("cpulist parsed (test, mask)", i,
+				(unsigned long) cpulist_mask);
+	}
+	if (rcu_replica_nr_nodes(&replica) != 2)
+		report_error("nodes with CPUs (nodes, expected)",
+			rcu_replica_nr_nodes(&replica), 2);
+	if (node_id[0] != 0 || node_id[1] != 2)
+		report_error("node ids (first, second)",
+			node_id[0], node_id[1]);
+	if (replica.nr_cpus != topo_last + 3)
+		report_error("CPUs of the topology (CPUs, expected)",
+			replica.nr_cpus, topo_last + 3);
+	if (replica.nr_nodes != 2 || replica.nr_cpus != topo_last + 3)
+		return;
+	for (cpu = 0; cpu < replica.nr_cpus; cpu++) {
+		expected = cpu >= topo_half && cpu != topo_last + 1;
+		if (replica.cpu_node[cpu] != expected)
+			report_error("node of CPU (cpu, index)", cpu,
+				replica.cpu_node[cpu]);
+	}
+}
+
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-c duration] (reader C.S. duration (in loops))\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader, *count_writer;
+	unsigned long long tot_reads = 0, tot_local_checks = 0;
+	unsigned long long tot_writes = 0, tot_failed = 0;
+	char topology_dir[] = "/tmp/test_urcu_replica.XXXXXX";
+	struct test_update u;
+	int i, a, retval = 0;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, %u writers.\n",
+		duration, nr_readers, nr_writers);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, 2 * sizeof(*count_reader));
+	count_writer = calloc(nr_writers, 2 * sizeof(*count_writer));
+
+	err = create_all_cpu_call_rcu_data(0);
+	if (err) {
+		printf("Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+	}
+
+	/* Count the grace periods of the updates. */
+	test_flavor = rcu_flavor;
+	test_flavor.update_synchronize_rcu = test_synchronize_rcu;
+	topology_create(topology_dir);
+	if (_rcu_replica_init(&replica, test_free_replica, &test_flavor))
+		exit(1);
+	topology_remove(topology_dir);
+	check_topology();
+	printf_verbose("%u replicas, %u CPUs, rseq %s.\n",
+		replica.nr_nodes, replica.nr_cpus,
+		urcu_rseq_cpu_id() >= 0 ? "available" : "unavailable");
+
+	/* The readers always find replicas. */
+	rcu_register_thread();
+	memset(&u, 0, sizeof(u));
+	u.fail_at = -1;
+	if (rcu_replica_update(&replica, test_copy, &u) || u.nr_freed)
+		report_error("first update (freed, nodes)", u.nr_freed,
+			replica.nr_nodes);
+	rcu_unregister_thread();
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[2 * i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[2 * i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_reads += count_reader[2 * i];
+		tot_local_checks += count_reader[2 * i + 1];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_writes += count_writer[2 * i];
+		tot_failed += count_writer[2 * i + 1];
+	}
+
+	/* The free function uses call_rcu. */
+	rcu_register_thread();
+	cur_update = NULL;
+	rcu_replica_exit(&replica);
+	rcu_unregister_thread();
+	rcu_barrier();
+
+	printf_verbose("total number of reads : %llu, local checks %llu, "
+		       "writes %llu, failed %llu\n", tot_reads,
+		       tot_local_checks, tot_writes, tot_failed);
+	printf("SUMMARY %-25s testdur %4lu nr_readers %3u rdur %6lu "
+		"nr_writers %3u wdelay %6lu nr_replicas %u "
+		"nr_reads %12llu nr_writes %12llu nr_failed %12llu "
+		"nr_ops %12llu\n",
+		argv[0], duration, nr_readers, rduration,
+		nr_writers, wdelay, replica.nr_nodes,
+		tot_reads, tot_writes, tot_failed,
+		tot_reads + tot_writes);
+	if (nr_freed != nr_allocated) {
+		printf("WARNING! %lu replicas allocated, %lu freed.\n",
+			nr_allocated, nr_freed);
+		retval = 1;
+	}
+	if (nr_errors) {
+		printf("WARNING! %lu topology errors or inconsistent "
+		       "replicas.\n", nr_errors);
+		retval = 1;
+	}
+	free_all_cpu_call_rcu_data();
+	free(count_reader);
+	free(count_writer);
+	free(tid_reader);
+	free(tid_writer);
+	return retval;
+}
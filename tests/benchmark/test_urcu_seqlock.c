@@ -0,0 +1,512 @@
+/*
+ * test_urcu_seqlock.c
+ *
+ * Userspace RCU library - example sequence lock and sequence-counted
+ *                         value with RCU fallback
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/seqlock.h>
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+/* write-side C.S. duration, in loops */
+static unsigned long wduration;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_reads);
+static DEFINE_URCU_TLS(unsigned long long, nr_read_retries);
+static DEFINE_URCU_TLS(unsigned long long, nr_writes);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+/*
+ * The value is nr_words words all holding the number of writes done
+ * when it was written: a torn read shows different words, and each
+ * reader must see the number of writes grow.
+ */
+static unsigned long nr_words = 8;
+static unsigned int max_retries = 8;
+static int test_seqlock;	/* plain sequence lock instead of seqval */
+
+static struct cds_seqlock sl = CDS_SEQLOCK_INIT;
+static unsigned long *sl_data;
+static struct cds_seqval v;
+
+/* Torn or out of order values seen by readers. */
+static unsigned long nr_errors;
+
+static
+void check_value(unsigned long *buf, unsigned long *prev)
+{
+	unsigned long i;
+
+	for (i = 1; i < nr_words; i++) {
+		if (buf[i] != buf[0]) {
+			if (!uatomic_read(&nr_errors))
+				printf("[ERROR] torn read: word %lu is %lu, "
+					"word 0 is %lu\n", i, buf[i], buf[0]);
+			uatomic_inc(&nr_errors);
+			return;
+		}
+	}
+	if (buf[0] < *prev) {
+		if (!uatomic_read(&nr_errors))
+			printf("[ERROR] value %lu read after %lu\n",
+				buf[0], *prev);
+		uatomic_inc(&nr_errors);
+	}
+	*prev = buf[0];
+}
+
+static
+void fill_value(unsigned long *data)
+{
+	unsigned long i, gen = data[0] + 1;
+
+	for (i = 0; i < nr_words; i++) {
+		CMM_STORE_SHARED(data[i], gen);
+		if (caa_unlikely(wduration) && !i)
+			loop_sleep(wduration);
+	}
+}
+
+void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned long *buf, prev = 0;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	buf = calloc(nr_words, sizeof(*buf));
+	if (!buf)
+		exit(1);
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		if (test_seqlock) {
+			unsigned long start, i;
+
+			for (;;) {
+				start = cds_seqcount_read_begin(&sl.seq);
+				for (i = 0; i < nr_words; i++)
+					buf[i] = CMM_LOAD_SHARED(sl_data[i]);
+				if (caa_unlikely(rduration))
+					loop_sleep(rduration);
+				if (!cds_seqcount_read_retry(&sl.seq, start))
+					break;
+				URCU_TLS(nr_read_retries)++;
+			}
+		} else {
+			rcu_read_lock();
+			cds_seqval_read(&v, buf);
+			if (caa_unlikely(rduration))
+				loop_sleep(rduration);
+			rcu_read_unlock();
+		}
+		check_value(buf, &prev);
+
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_unregister_thread();
+	free(buf);
+	printf_verbose("reader thread_end, tid %lu, "
+			"reads %llu, read retries %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_reads),
+			URCU_TLS(nr_read_retries));
+	count[0] = URCU_TLS(nr_reads);
+	count[1] = URCU_TLS(nr_read_retries);
+	return ((void*)1);
+}
+
+void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	/* Writers of the seqval free replaced copies with call_rcu. */
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		if (test_seqlock) {
+			cds_seqlock_write_lock(&sl);
+			fill_value(sl_data);
+			cds_seqlock_write_unlock(&sl);
+		} else {
+			fill_value(cds_seqval_write_begin(&v));
+			cds_seqval_write_end(&v);
+		}
+		URCU_TLS(nr_writes)++;
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+		if (caa_unlikely(!test_duration_write()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	count[0] = URCU_TLS(nr_writes);
+	printf_verbose("writer thread_end, tid %lu, writes %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_writes));
+	return ((void*)2);
+}
+
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-c duration] (reader C.S. duration (in loops))\n");
+	printf("	[-e duration] (writer C.S. duration (in loops))\n");
+	printf("	[-l words] (value size, in words, default 8)\n");
+	printf("	[-r retries] (in-place reads before the RCU copy fallback)\n");
+	printf("	[-s] (plain sequence lock, no RCU fallback)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader, *count_writer;
+	unsigned long long tot_reads = 0, tot_read_retries = 0;
+	unsigned long long tot_writes = 0;
+	unsigned long *buf;
+	int i, a, retval = 0;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'e':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wduration = atol(argv[++i]);
+			break;
+		case 'l':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_words = atol(argv[++i]);
+			if (!nr_words) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'r':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			max_retries = atoi(argv[++i]);
+			break;
+		case 's':
+			test_seqlock = 1;
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, "
+		       "%u writers.\n",
+		       duration, nr_readers, nr_writers);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("Mode : %s, %lu words.\n",
+		       test_seqlock ? "seqlock" : "seqval", nr_words);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, 2 * sizeof(*count_reader));
+	count_writer = calloc(nr_writers, sizeof(*count_writer));
+	sl_data = calloc(nr_words, sizeof(*sl_data));
+	buf = calloc(nr_words, sizeof(*buf));
+	if (!sl_data || !buf)
+		exit(1);
+
+	err = cds_seqval_init(&v, nr_words * sizeof(unsigned long),
+			max_retries);
+	if (err)
+		exit(1);
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[2 * i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_reads += count_reader[2 * i];
+		tot_read_retries += count_reader[2 * i + 1];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_writes += count_writer[i];
+	}
+
+	/* The final value counts every write. */
+	rcu_register_thread();
+	if (test_seqlock) {
+		memcpy(buf, sl_data, nr_words * sizeof(*buf));
+	} else {
+		rcu_read_lock();
+		cds_seqval_read(&v, buf);
+		rcu_read_unlock();
+	}
+	rcu_unregister_thread();
+	for (i = 0; i < nr_words; i++) {
+		if (buf[i] != tot_writes) {
+			printf("WARNING! Final value word %d is %lu, "
+			       "%llu writes.\n", i, buf[i], tot_writes);
+			retval = 1;
+			break;
+		}
+	}
+
+	/* Flush the reclaim of the replaced copies. */
+	rcu_barrier();
+	cds_seqval_destroy(&v);
+
+	printf_verbose("total number of reads : %llu, read retries %llu\n",
+		       tot_reads, tot_read_retries);
+	printf("SUMMARY %-25s testdur %4lu nr_writers %3u wdelay %6lu "
+		"nr_readers %3u rdur %6lu mode %s nr_words %lu "
+		"nr_reads %12llu nr_read_retries %12llu "
+		"nr_writes %12llu nr_ops %12llu\n",
+		argv[0], duration, nr_writers, wdelay,
+		nr_readers, rduration,
+		test_seqlock ? "seqlock" : "seqval", nr_words,
+		tot_reads, tot_read_retries, tot_writes,
+		tot_reads + tot_writes);
+	if (nr_errors) {
+		printf("WARNING! %lu torn or out of order values read.\n",
+		       nr_errors);
+		retval = 1;
+	}
+	free(buf);
+	free(sl_data);
+	free(count_reader);
+	free(count_writer);
+	free(tid_reader);
+	free(tid_writer);
+	return retval;
+}
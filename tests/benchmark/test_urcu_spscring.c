@@ -0,0 +1,454 @@
+/*
+ * test_urcu_spscring.c
+ *
+ * Userspace RCU library - example single-producer/single-consumer ring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include <urcu/uatomic.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu/spscring.h>
+
+static volatile int test_go, test_stop_enqueue, test_stop_dequeue;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+static int test_wait_empty;
+static int test_enqueue_stopped;
+static unsigned long ring_size = 1024;
+static unsigned long batch = 32;
+static size_t slot_size = 64;
+/* explicit publication every publish_period commits, 0: none */
+static unsigned long publish_period;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, ## args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_dequeue(void)
+{
+	return !test_stop_dequeue;
+}
+
+static int test_duration_enqueue(void)
+{
+	return !test_stop_enqueue;
+}
+
+static unsigned long long nr_enqueues, nr_successful_enqueues;
+static unsigned long long nr_dequeues, nr_successful_dequeues;
+/* Slots received out of order or with a corrupted payload. */
+static unsigned long long nr_errors;
+/* Sequence number expected by the consumer. */
+static unsigned long long next_seq;
+
+static struct cds_spsc_ring ring;
+
+/*
+ * Slot layout: sequence number, then slot_size - 8 bytes of the low
+ * byte of the sequence number.
+ */
+static void fill_slot(void *slot, unsigned long long seq)
+{
+	memcpy(slot, &seq, sizeof(seq));
+	memset((char *) slot + sizeof(seq), (unsigned char) seq,
+		slot_size - sizeof(seq));
+}
+
+static void check_slot(void *slot)
+{
+	unsigned long long seq;
+	unsigned char *p = (unsigned char *) slot + sizeof(seq);
+	size_t i;
+
+	memcpy(&seq, slot, sizeof(seq));
+	if (seq != next_seq) {
+		if (!nr_errors)
+			printf("[ERROR] slot %llu received, %llu expected\n",
+				seq, next_seq);
+		nr_errors++;
+	}
+	for (i = 0; i < slot_size - sizeof(seq); i++) {
+		if (p[i] != (unsigned char) seq) {
+			if (!nr_errors)
+				printf("[ERROR] slot %llu corrupted at byte %zu\n",
+					seq, i + sizeof(seq));
+			nr_errors++;
+			break;
+		}
+	}
+	next_seq = seq + 1;
+}
+
+static void *thr_enqueuer(void *_count)
+{
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"enqueuer", urcu_get_thread_id());
+
+	set_affinity();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		void *slot = cds_spsc_ring_reserve(&ring);
+
+		if (!slot)
+			goto fail;	/* ring full */
+		fill_slot(slot, nr_successful_enqueues);
+		cds_spsc_ring_commit(&ring);
+		nr_successful_enqueues++;
+		if (publish_period
+				&& !(nr_successful_enqueues % publish_period))
+			cds_spsc_ring_publish(&ring);
+
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+fail:
+		nr_enqueues++;
+		if (caa_unlikely(!test_duration_enqueue()))
+			break;
+	}
+	/* Hand the last batch to the consumer. */
+	cds_spsc_ring_publish(&ring);
+
+	uatomic_inc(&test_enqueue_stopped);
+	printf_verbose("enqueuer thread_end, tid %lu, "
+			"enqueues %llu successful_enqueues %llu\n",
+			urcu_get_thread_id(),
+			nr_enqueues, nr_successful_enqueues);
+	return ((void*)1);
+
+}
+
+static void *thr_dequeuer(void *_count)
+{
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"dequeuer", urcu_get_thread_id());
+
+	set_affinity();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		void *slot = cds_spsc_ring_peek(&ring);
+
+		if (slot) {
+			check_slot(slot);
+			cds_spsc_ring_release(&ring);
+			nr_successful_dequeues++;
+		}
+		nr_dequeues++;
+		if (caa_unlikely(!test_duration_dequeue()))
+			break;
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+	}
+
+	printf_verbose("dequeuer thread_end, tid %lu, "
+			"dequeues %llu, successful_dequeues %llu\n",
+			urcu_get_thread_id(),
+			nr_dequeues, nr_successful_dequeues);
+	return ((void*)2);
+}
+
+/* Consume the published slots left, as the consumer. */
+static void test_end(unsigned long long *nr_end)
+{
+	void *slot;
+
+	while ((slot = cds_spsc_ring_peek(&ring)) != NULL) {
+		check_slot(slot);
+		cds_spsc_ring_release(&ring);
+		(*nr_end)++;
+	}
+	cds_spsc_ring_release_publish(&ring);
+}
+
+static void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (enqueuer period (in loops))\n");
+	printf("	[-c duration] (dequeuer period (in loops))\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("	[-r size] (ring size, power of two, default 1024)\n");
+	printf("	[-b batch] (slots per publication, default 32)\n");
+	printf("	[-s size] (slot size in bytes, default 64)\n");
+	printf("	[-p period] (explicit publication every period commits)\n");
+	printf("	[-w] Wait for dequeuer to empty queue\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t tid_enqueuer, tid_dequeuer;
+	void *tret;
+	unsigned long long end_dequeues = 0;
+	int i, a, retval = 0;
+
+	if (argc < 2) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 2; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'r':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			ring_size = atol(argv[++i]);
+			break;
+		case 'b':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			batch = atol(argv[++i]);
+			break;
+		case 's':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			slot_size = atol(argv[++i]);
+			break;
+		case 'p':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			publish_period = atol(argv[++i]);
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		case 'w':
+			test_wait_empty = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, ring size %lu, "
+		       "batch %lu, slot size %zu.\n",
+		       duration, ring_size, batch, slot_size);
+	if (test_wait_empty)
+		printf_verbose("Wait for dequeuer to empty queue.\n");
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	if (slot_size < sizeof(unsigned long long)
+			|| cds_spsc_ring_init(&ring, ring_size, slot_size,
+				batch)) {
+		fprintf(stderr, "Invalid ring size %lu or slot size %zu\n",
+			ring_size, slot_size);
+		return -1;
+	}
+
+	next_aff = 0;
+
+	err = pthread_create(&tid_enqueuer, NULL, thr_enqueuer, NULL);
+	if (err != 0)
+		exit(1);
+	err = pthread_create(&tid_dequeuer, NULL, thr_dequeuer, NULL);
+	if (err != 0)
+		exit(1);
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop_enqueue = 1;
+
+	if (test_wait_empty) {
+		while (!uatomic_read(&test_enqueue_stopped))
+			sleep(1);
+		while (uatomic_read(&nr_successful_dequeues)
+				!= nr_successful_enqueues)
+			sleep(1);
+	}
+
+	test_stop_dequeue = 1;
+
+	err = pthread_join(tid_enqueuer, &tret);
+	if (err != 0)
+		exit(1);
+	err = pthread_join(tid_dequeuer, &tret);
+	if (err != 0)
+		exit(1);
+
+	test_end(&end_dequeues);
+
+	printf_verbose("total number of enqueues : %llu, dequeues %llu\n",
+		       nr_enqueues, nr_dequeues);
+	printf_verbose("total number of successful enqueues : %llu, "
+		       "successful dequeues %llu\n",
+		       nr_successful_enqueues, nr_successful_dequeues);
+	printf("SUMMARY %-25s testdur %4lu wdelay %6lu "
+		"rdur %6lu ring_size %lu batch %lu slot_size %zu "
+		"nr_enqueues %12llu nr_dequeues %12llu "
+		"successful enqueues %12llu successful dequeues %12llu "
+		"end_dequeues %llu errors %llu nr_ops %12llu\n",
+		argv[0], duration, wdelay, rduration, ring_size, batch,
+		slot_size, nr_enqueues, nr_dequeues,
+		nr_successful_enqueues, nr_successful_dequeues,
+		end_dequeues, nr_errors, nr_enqueues + nr_dequeues);
+	if (nr_successful_enqueues != nr_successful_dequeues + end_dequeues) {
+		printf("WARNING! Discrepancy between nr succ. enqueues %llu vs "
+		       "succ. dequeues + end dequeues %llu.\n",
+		       nr_successful_enqueues,
+		       nr_successful_dequeues + end_dequeues);
+		retval = 1;
+	}
+	if (nr_errors) {
+		printf("WARNING! %llu slots out of order or corrupted.\n",
+			nr_errors);
+		retval = 1;
+	}
+	cds_spsc_ring_destroy(&ring);
+	return retval;
+}
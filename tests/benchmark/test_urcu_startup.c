@@ -0,0 +1,244 @@
+/*
+ * test_urcu_startup.c
+ *
+ * Userspace RCU library - process startup cost of linking the flavors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * All the flavors are linked into this program, which executes itself
+ * as a child process exiting at once, or after registering and
+ * unregistering a thread with one flavor. The libraries are initialized
+ * by the first registration rather than at load time, so a child which
+ * does not use RCU issues none of their system calls. The system calls
+ * of each child are counted by tracing it with ptrace(): those of a
+ * child registering with a flavor, beyond those of the child which does
+ * not, are those of the registration, including the initialization
+ * formerly run at startup by every process. The average time to run a
+ * child measures the startup cost.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/ptrace.h>
+#endif
+
+#include <urcu/arch.h>
+#include <urcu/clock.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+#include "bench.h"
+
+/* Flavor structures, as named by urcu/map/*.h. */
+extern const struct rcu_flavor_struct rcu_flavor_memb, rcu_flavor_mb,
+	rcu_flavor_sig, rcu_flavor_qsbr, rcu_flavor_bp;
+
+static const struct {
+	const char *name;
+	const struct rcu_flavor_struct *flavor;
+} flavors[] = {
+	{ "none", NULL },
+	{ "memb", &rcu_flavor_memb },
+	{ "mb", &rcu_flavor_mb },
+	{ "signal", &rcu_flavor_sig },
+	{ "qsbr", &rcu_flavor_qsbr },
+	{ "bp", &rcu_flavor_bp },
+};
+
+#define NR_FLAVORS	CAA_ARRAY_SIZE(flavors)
+
+#define CHILD_ARG	"--child"
+
+static int run_child(const char *name)
+{
+	const struct rcu_flavor_struct *flavor = NULL;
+	unsigned int f;
+
+	for (f = 0; f < NR_FLAVORS; f++) {
+		if (!strcmp(name, flavors[f].name))
+			flavor = flavors[f].flavor;
+	}
+	if (flavor) {
+		flavor->register_thread();
+		flavor->read_lock();
+		flavor->read_unlock();
+		flavor->unregister_thread();
+	}
+	return 0;
+}
+
+static void exec_child(const char *name, int traced)
+{
+	char *args[4];
+
+#ifdef __linux__
+	if (traced && ptrace(PTRACE_TRACEME, 0, NULL, NULL))
+		_exit(1);
+#endif
+	args[0] = (char *) "test_urcu_startup";
+	args[1] = (char *) CHILD_ARG;
+	args[2] = (char *) name;
+	args[3] = NULL;
+	execv("/proc/self/exe", args);
+	_exit(1);
+}
+
+/*
+ * Number of system calls of a child, from the execve() return, or -1 if
+ * processes cannot be traced.
+ */
+static long count_syscalls(const char *name)
+{
+#ifdef __linux__
+	long nr_stops = 0;
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (!pid)
+		exec_child(name, 1);
+	/* Stopped by SIGTRAP on execve(). */
+	if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status))
+		return -1;
+	for (;;) {
+		if (ptrace(PTRACE_SYSCALL, pid, NULL, NULL)) {
+			kill(pid, SIGKILL);
+			(void) waitpid(pid, &status, 0);
+			return -1;
+		}
+		if (waitpid(pid, &status, 0) < 0)
+			return -1;
+		if (WIFEXITED(status) || WIFSIGNALED(status))
+			break;
+		nr_stops++;
+	}
+	/* One stop on entry and one on exit, none on exit_group() exit. */
+	return (nr_stops + 1) / 2;
+#else
+	return -1;
+#endif
+}
+
+/* Average time to run a child, in ns. */
+static uint64_t time_children(const char *name, unsigned long nr)
+{
+	uint64_t start;
+	unsigned long i;
+	int status;
+	pid_t pid;
+
+	start = caa_clock_ns();
+	for (i = 0; i < nr; i++) {
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			exit(-1);
+		}
+		if (!pid)
+			exec_child(name, 0);
+		if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)
+				|| WEXITSTATUS(status)) {
+			fprintf(stderr, "child error\n");
+			exit(-1);
+		}
+	}
+	return (caa_clock_ns() - start) / nr;
+}
+
+static void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s <OPTIONS>\n", argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-n nr] (children run per flavor for timing, default 200)\n");
+	printf("	[--format=json|csv] (machine-readable report)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long nr_children = 200;
+	long base_syscalls = -1, syscalls;
+	uint64_t ns;
+	unsigned int f;
+	int i;
+
+	if (argc == 3 && !strcmp(argv[1], CHILD_ARG))
+		return run_child(argv[2]);
+
+	for (i = 1; i < argc; i++) {
+		if (bench_parse_option(argv[i]))
+			continue;
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'n':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_children = strtoul(argv[++i], NULL, 0);
+			if (!nr_children) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		default:
+			show_usage(argc, argv);
+			return -1;
+		}
+	}
+
+	for (f = 0; f < NR_FLAVORS; f++) {
+		syscalls = count_syscalls(flavors[f].name);
+		if (!f)
+			base_syscalls = syscalls;
+		ns = time_children(flavors[f].name, nr_children);
+		if (syscalls < 0)
+			printf("%-8s syscalls n/a, %8llu ns per process\n",
+				flavors[f].name, (unsigned long long) ns);
+		else if (!f)
+			printf("%-8s %4ld syscalls at startup, %8llu ns per process\n",
+				flavors[f].name, syscalls,
+				(unsigned long long) ns);
+		else
+			printf("%-8s %4ld syscalls, %3ld more than none, %8llu ns per process\n",
+				flavors[f].name, syscalls,
+				syscalls - base_syscalls,
+				(unsigned long long) ns);
+
+		bench_report_begin(argv[0]);
+		bench_report_string("flavor", flavors[f].name);
+		bench_report_u64("nr_children", nr_children);
+		if (syscalls >= 0) {
+			bench_report_u64("syscalls", syscalls);
+			if (f && base_syscalls >= 0)
+				bench_report_u64("syscalls_registration",
+					syscalls - base_syscalls);
+		}
+		bench_report_u64("ns_per_process", ns);
+		bench_report_end();
+	}
+	return 0;
+}
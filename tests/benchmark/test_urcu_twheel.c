@@ -0,0 +1,555 @@
+/*
+ * test_urcu_twheel.c
+ *
+ * Userspace RCU library - example timer wheel
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include <urcu/uatomic.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#include <urcu/twheel.h>
+
+static volatile int test_go, test_stop_add, test_stop_advance;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, ## args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_add(void)
+{
+	return !test_stop_add;
+}
+
+static int test_duration_advance(void)
+{
+	return !test_stop_advance;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_adds);
+static DEFINE_URCU_TLS(unsigned long long, nr_cancels);
+static DEFINE_URCU_TLS(unsigned long long, nr_cancel_races);
+static DEFINE_URCU_TLS(unsigned long long, nr_touches);
+static DEFINE_URCU_TLS(unsigned long long, nr_advances);
+
+static unsigned int nr_adders;
+static unsigned int nr_advancers;
+
+static unsigned long nr_nodes = 1024;
+static unsigned long max_delay = 4096;	/* ticks */
+
+/* Starts close to the wrap around of the tick counter. */
+static unsigned long test_clk = -(1UL << 20);
+
+/* Expired nodes, and early, late or unexpected expiries. */
+static unsigned long long nr_expired, nr_errors;
+
+enum test_state {
+	TEST_IDLE,
+	TEST_ARMED,
+};
+
+/*
+ * Each node is armed and cancelled by a single adder. Its mutex
+ * serializes the adder bookkeeping with the expire callback.
+ */
+struct test_timer {
+	struct cds_twheel_node node;
+	pthread_mutex_t lock;
+	int state;
+	bool touched;
+	unsigned long delay;		/* at cds_twheel_add() */
+	unsigned long slack;		/* ticks elapsed while adding */
+	unsigned long expires;		/* at cds_twheel_add() */
+	unsigned long touch_expires;	/* latest touch */
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+static struct test_timer *timers;
+static struct cds_twheel wheel;
+
+static
+void test_error(const char *msg, struct test_timer *t, unsigned long now)
+{
+	if (!uatomic_read(&nr_errors))
+		printf("[ERROR] %s: expires %lu delay %lu touched %d, "
+			"now %lu\n", msg, t->expires, t->delay,
+			(int) t->touched, now);
+	uatomic_inc(&nr_errors);
+}
+
+/* @priv points to the tick passed to cds_twheel_advance(). */
+static
+void test_expire(struct cds_twheel_node *node, void *priv)
+{
+	struct test_timer *t = caa_container_of(node, struct test_timer, node);
+	unsigned long now = *(unsigned long *) priv;
+
+	pthread_mutex_lock(&t->lock);
+	if (t->state != TEST_ARMED) {
+		test_error("expiry of a node not armed", t, now);
+		goto end;
+	}
+	/* The clock is at or after the tick which collected the node. */
+	if ((long) (uatomic_read(&test_clk) - t->expires) < 0)
+		test_error("early expiry", t, uatomic_read(&test_clk));
+	/*
+	 * A node is queued in a slot at most 8/63 of its delay coarse,
+	 * plus the ticks processed while it was added; touched nodes are
+	 * requeued from their slot instead.
+	 */
+	if (!t->touched && (long) (now - t->expires)
+			> (long) (t->delay * 8 / 63 + t->slack + 1))
+		test_error("late expiry", t, now);
+	CMM_STORE_SHARED(t->state, TEST_IDLE);
+	uatomic_inc(&nr_expired);
+end:
+	pthread_mutex_unlock(&t->lock);
+}
+
+static
+void test_op(struct test_timer *t, unsigned int *seed)
+{
+	unsigned long now = uatomic_read(&test_clk);
+	unsigned long expires;
+
+	pthread_mutex_lock(&t->lock);
+	if (t->state == TEST_IDLE) {
+		t->delay = rand_r(seed) % max_delay;
+		t->expires = t->touch_expires = now + t->delay;
+		t->touched = false;
+		t->state = TEST_ARMED;
+		cds_twheel_add(&wheel, &t->node, t->expires);
+		t->slack = uatomic_read(&test_clk) - now;
+		URCU_TLS(nr_adds)++;
+		goto unlock;
+	}
+	switch (rand_r(seed) % 4) {
+	case 0:
+		if (cds_twheel_cancel(&wheel, &t->node)) {
+			t->state = TEST_IDLE;
+			URCU_TLS(nr_cancels)++;
+			break;
+		}
+		/* The expire callback is called or about to be. */
+		URCU_TLS(nr_cancel_races)++;
+		pthread_mutex_unlock(&t->lock);
+		while (CMM_LOAD_SHARED(t->state) != TEST_IDLE)
+			caa_cpu_relax();
+		return;
+	case 1:
+		expires = now + rand_r(seed) % max_delay;
+		if ((long) (expires - t->touch_expires) > 0) {
+			t->touch_expires = expires;
+			t->touched = true;
+			cds_twheel_touch(&t->node, expires);
+			URCU_TLS(nr_touches)++;
+		}
+		break;
+	default:
+		break;	/* let it expire */
+	}
+unlock:
+	pthread_mutex_unlock(&t->lock);
+}
+
+static void *thr_adder(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+	unsigned long id = count[0], nr_own;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"adder", urcu_get_thread_id());
+
+	set_affinity();
+
+	/* This thread owns nodes id, id + nr_adders, ... */
+	nr_own = (nr_nodes - id + nr_adders - 1) / nr_adders;
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		if (nr_own)
+			test_op(&timers[id + nr_adders
+					* (rand_r(&seed) % nr_own)], &seed);
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		if (caa_unlikely(!test_duration_add()))
+			break;
+	}
+
+	count[0] = URCU_TLS(nr_adds);
+	count[1] = URCU_TLS(nr_cancels);
+	count[2] = URCU_TLS(nr_cancel_races);
+	count[3] = URCU_TLS(nr_touches);
+	printf_verbose("adder thread_end, tid %lu, "
+			"adds %llu cancels %llu touches %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_adds), URCU_TLS(nr_cancels),
+			URCU_TLS(nr_touches));
+	return ((void*)1);
+}
+
+/*
+ * The first advancer moves the clock one tick at a time; the others
+ * process the current tick concurrently, sharing the due nodes.
+ */
+static void *thr_advancer(void *_count)
+{
+	unsigned long long *count = _count;
+	bool ticker = !count[0];
+	unsigned long now;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"advancer", urcu_get_thread_id());
+
+	set_affinity();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		if (ticker) {
+			now = uatomic_read(&test_clk) + 1;
+			uatomic_set(&test_clk, now);
+		} else {
+			now = uatomic_read(&test_clk);
+		}
+		(void) cds_twheel_advance(&wheel, now, test_expire, &now);
+		URCU_TLS(nr_advances)++;
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+		if (caa_unlikely(!test_duration_advance()))
+			break;
+	}
+
+	count[0] = URCU_TLS(nr_advances);
+	printf_verbose("advancer thread_end, tid %lu, advances %llu\n",
+			urcu_get_thread_id(), URCU_TLS(nr_advances));
+	return ((void*)2);
+}
+
+/* Expire the nodes still pending, moving the clock as needed. */
+static void test_end(unsigned long long *nr_end)
+{
+	unsigned long now, next;
+
+	now = uatomic_read(&test_clk);
+	while (cds_twheel_next_expiry(&wheel, &next)) {
+		if ((long) (next - now) > 0)
+			now = next;
+		uatomic_set(&test_clk, now);
+		*nr_end += cds_twheel_advance(&wheel, now, test_expire, &now);
+	}
+}
+
+static void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_adders nr_advancers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (advancer period (in loops))\n");
+	printf("	[-c duration] (adder period (in loops))\n");
+	printf("	[-n nodes] (number of timer nodes, default 1024)\n");
+	printf("	[-k ticks] (maximum expiry delay, default 4096)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_adder, *tid_advancer;
+	void *tret;
+	unsigned long long *count_adder, *count_advancer;
+	unsigned long long tot_adds = 0, tot_cancels = 0,
+		tot_cancel_races = 0, tot_touches = 0, tot_advances = 0;
+	unsigned long long end_expired = 0;
+	unsigned long n;
+	int i, a, retval = 0;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_adders);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_advancers);
+	if (err != 1 || !nr_advancers) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'n':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_nodes = atol(argv[++i]);
+			break;
+		case 'k':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			max_delay = atol(argv[++i]);
+			if (!max_delay) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u adders, "
+		       "%u advancers, %lu nodes, max delay %lu.\n",
+		       duration, nr_adders, nr_advancers, nr_nodes,
+		       max_delay);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	tid_adder = calloc(nr_adders, sizeof(*tid_adder));
+	tid_advancer = calloc(nr_advancers, sizeof(*tid_advancer));
+	count_adder = calloc(nr_adders, 4 * sizeof(*count_adder));
+	count_advancer = calloc(nr_advancers, sizeof(*count_advancer));
+	err = posix_memalign((void **) &timers, CAA_CACHE_LINE_SIZE,
+			(nr_nodes ? nr_nodes : 1) * sizeof(*timers));
+	if (err)
+		exit(1);
+
+	cds_twheel_init(&wheel, test_clk);
+	for (n = 0; n < nr_nodes; n++) {
+		cds_twheel_node_init(&timers[n].node);
+		pthread_mutex_init(&timers[n].lock, NULL);
+		timers[n].state = TEST_IDLE;
+	}
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_adders; i++) {
+		count_adder[4 * i] = i;
+		err = pthread_create(&tid_adder[i], NULL, thr_adder,
+				     &count_adder[4 * i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_advancers; i++) {
+		count_advancer[i] = i;
+		err = pthread_create(&tid_advancer[i], NULL, thr_advancer,
+				     &count_advancer[i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	/* Adders may wait for racing expiries: advance until they end. */
+	test_stop_add = 1;
+	for (i = 0; i < nr_adders; i++) {
+		err = pthread_join(tid_adder[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_adds += count_adder[4 * i];
+		tot_cancels += count_adder[4 * i + 1];
+		tot_cancel_races += count_adder[4 * i + 2];
+		tot_touches += count_adder[4 * i + 3];
+	}
+	test_stop_advance = 1;
+	for (i = 0; i < nr_advancers; i++) {
+		err = pthread_join(tid_advancer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_advances += count_advancer[i];
+	}
+
+	test_end(&end_expired);
+	for (n = 0; n < nr_nodes; n++) {
+		if (timers[n].state != TEST_IDLE
+				|| cds_twheel_pending(&timers[n].node)) {
+			printf("WARNING! Node %lu still pending.\n", n);
+			retval = 1;
+			break;
+		}
+		pthread_mutex_destroy(&timers[n].lock);
+	}
+	cds_twheel_destroy(&wheel);
+
+	printf_verbose("total number of adds : %llu, cancels %llu, "
+		       "cancel races %llu, touches %llu\n",
+		       tot_adds, tot_cancels, tot_cancel_races, tot_touches);
+	printf("SUMMARY %-25s testdur %4lu nr_adders %3u rdur %6lu "
+		"nr_advancers %3u wdelay %6lu nr_nodes %lu max_delay %lu "
+		"nr_adds %12llu nr_cancels %12llu nr_cancel_races %12llu "
+		"nr_touches %12llu nr_advances %12llu nr_expired %12llu "
+		"end_expired %llu nr_ops %12llu\n",
+		argv[0], duration, nr_adders, rduration,
+		nr_advancers, wdelay, nr_nodes, max_delay,
+		tot_adds, tot_cancels, tot_cancel_races, tot_touches,
+		tot_advances, nr_expired, end_expired,
+		tot_adds + tot_cancels + tot_touches + tot_advances);
+	if (tot_adds != tot_cancels + nr_expired) {
+		printf("WARNING! Discrepancy between nr adds %llu vs "
+		       "cancels + expiries %llu.\n",
+		       tot_adds, tot_cancels + nr_expired);
+		retval = 1;
+	}
+	if (nr_errors) {
+		printf("WARNING! %llu early, late or unexpected expiries.\n",
+		       nr_errors);
+		retval = 1;
+	}
+	free(timers);
+	free(count_adder);
+	free(count_advancer);
+	free(tid_adder);
+	free(tid_advancer);
+	return retval;
+}
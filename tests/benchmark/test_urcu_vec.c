@@ -0,0 +1,608 @@
+/*
+ * test_urcu_vec.c
+ *
+ * Userspace RCU library - example RCU-based read-mostly vector
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/cds.h>
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* read-side C.S. duration, in loops */
+static unsigned long wdelay;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration_read(void)
+{
+	return !test_stop;
+}
+
+static int test_duration_write(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_reads);
+static DEFINE_URCU_TLS(unsigned long long, nr_read_elems);
+static DEFINE_URCU_TLS(unsigned long long, nr_appends);
+static DEFINE_URCU_TLS(unsigned long long, nr_sets);
+static DEFINE_URCU_TLS(unsigned long long, nr_dels);
+static DEFINE_URCU_TLS(unsigned long long, nr_replaces);
+
+static unsigned int nr_readers;
+static unsigned int nr_writers;
+
+static unsigned long max_len = 1024;	/* appends delete beyond this */
+static unsigned long replace_len = 16;	/* max elements per replace */
+
+/* Elements allocated, retired with call_rcu, and freed. */
+static unsigned long nr_alloc, nr_retired, nr_freed;
+/* Dead or NULL elements seen by readers. */
+static unsigned long nr_errors;
+
+struct test {
+	int a;
+	struct rcu_head head;
+};
+
+static struct cds_vec vec;
+
+/*
+ * Updaters need to know which elements cds_vec_del() and
+ * cds_vec_replace() drop to free them, so they are serialized with
+ * respect to each other. Readers run concurrently with all of them.
+ */
+static pthread_mutex_t update_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static
+struct test *alloc_elem(void)
+{
+	struct test *elem = malloc(sizeof(*elem));
+
+	if (elem) {
+		elem->a = 8;
+		uatomic_inc(&nr_alloc);
+	}
+	return elem;
+}
+
+static
+void free_elem_cb(struct rcu_head *head)
+{
+	struct test *elem = caa_container_of(head, struct test, head);
+
+	elem->a = 0;
+	free(elem);
+	uatomic_inc(&nr_freed);
+}
+
+static
+void retire_elem(struct test *elem)
+{
+	uatomic_inc(&nr_retired);
+	call_rcu(&elem->head, free_elem_cb);
+}
+
+static
+void check_elem(struct test *elem)
+{
+	if (!elem || CMM_LOAD_SHARED(elem->a) != 8)
+		uatomic_inc(&nr_errors);
+}
+
+void *thr_reader(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"reader", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		struct cds_vec_array *array;
+		unsigned long len, index;
+		struct test *elem;
+
+		rcu_read_lock();
+		cds_vec_for_each(&vec, array, len, index, elem) {
+			check_elem(elem);
+			URCU_TLS(nr_read_elems)++;
+		}
+		if (array && len > array->capacity)
+			uatomic_inc(&nr_errors);
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+		/* Elements of the snapshot stay valid until unlock. */
+		if (len) {
+			elem = cds_vec_array_get(array, rand_r(&seed) % len);
+			check_elem(elem);
+		}
+		elem = cds_vec_get(&vec, rand_r(&seed) % max_len);
+		if (elem)
+			check_elem(elem);
+		rcu_read_unlock();
+
+		URCU_TLS(nr_reads)++;
+		if (caa_unlikely(!test_duration_read()))
+			break;
+	}
+
+	rcu_unregister_thread();
+	printf_verbose("reader thread_end, tid %lu, "
+			"reads %llu, elements read %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_reads),
+			URCU_TLS(nr_read_elems));
+	count[0] = URCU_TLS(nr_reads);
+	count[1] = URCU_TLS(nr_read_elems);
+	return ((void*)1);
+}
+
+static
+void do_del(unsigned int *seed)
+{
+	struct cds_vec_array *array;
+	unsigned long len, index;
+	struct test *elem;
+
+	array = cds_vec_read(&vec);
+	len = cds_vec_array_len(array);
+	if (!len)
+		return;
+	index = rand_r(seed) % len;
+	elem = cds_vec_array_get(array, index);
+	if (!cds_vec_del(&vec, index)) {
+		retire_elem(elem);
+		URCU_TLS(nr_dels)++;
+	}
+}
+
+static
+void do_replace(unsigned int *seed)
+{
+	struct cds_vec_array *array;
+	struct test **elems, **old = NULL;
+	unsigned long i, len, old_len, index;
+	struct test *elem;
+
+	len = rand_r(seed) % (replace_len + 1);
+	elems = calloc(len ? len : 1, sizeof(*elems));
+	if (!elems)
+		return;
+	for (i = 0; i < len; i++) {
+		elems[i] = alloc_elem();
+		if (!elems[i])
+			goto end;
+	}
+	array = cds_vec_read(&vec);
+	old_len = cds_vec_array_len(array);
+	if (old_len) {
+		old = malloc(old_len * sizeof(*old));
+		if (!old)
+			goto end;
+		cds_vec_for_each(&vec, array, old_len, index, elem)
+			old[index] = elem;
+	}
+	if (cds_vec_replace(&vec, (void * const *) elems, len))
+		goto end;
+	for (i = 0; i < old_len; i++)
+		retire_elem(old[i]);
+	URCU_TLS(nr_replaces)++;
+	len = 0;	/* now owned by the vector */
+end:
+	for (i = 0; i < len && elems[i]; i++) {
+		free(elems[i]);
+		uatomic_dec(&nr_alloc);
+	}
+	free(old);
+	free(elems);
+}
+
+void *thr_writer(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"writer", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		unsigned int op = rand_r(&seed) % 1024;
+		struct test *elem, *old;
+		unsigned long len;
+
+		pthread_mutex_lock(&update_mutex);
+		if (op == 0) {
+			do_replace(&seed);
+		} else if (op < 512) {
+			if (cds_vec_array_len(cds_vec_read(&vec)) >= max_len) {
+				do_del(&seed);
+				goto unlock;
+			}
+			elem = alloc_elem();
+			if (!elem)
+				goto unlock;
+			if (!cds_vec_append(&vec, elem)) {
+				URCU_TLS(nr_appends)++;
+			} else {
+				free(elem);
+				uatomic_dec(&nr_alloc);
+			}
+		} else if (op < 768) {
+			len = cds_vec_array_len(cds_vec_read(&vec));
+			if (!len)
+				goto unlock;
+			elem = alloc_elem();
+			if (!elem)
+				goto unlock;
+			old = cds_vec_set(&vec, rand_r(&seed) % len, elem);
+			if (old) {
+				retire_elem(old);
+				URCU_TLS(nr_sets)++;
+			} else {
+				free(elem);
+				uatomic_dec(&nr_alloc);
+			}
+		} else {
+			do_del(&seed);
+		}
+unlock:
+		pthread_mutex_unlock(&update_mutex);
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+		if (caa_unlikely(!test_duration_write()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	count[0] = URCU_TLS(nr_appends);
+	count[1] = URCU_TLS(nr_sets);
+	count[2] = URCU_TLS(nr_dels);
+	count[3] = URCU_TLS(nr_replaces);
+	printf_verbose("writer thread_end, tid %lu, "
+			"appends %llu sets %llu dels %llu replaces %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_appends), URCU_TLS(nr_sets),
+			URCU_TLS(nr_dels), URCU_TLS(nr_replaces));
+	return ((void*)2);
+}
+
+/* Free the elements left, checking they are all alive. */
+void test_end(struct cds_vec *vec, unsigned long *nr_end)
+{
+	struct cds_vec_array *array;
+	unsigned long len, index;
+	struct test *elem;
+
+	cds_vec_for_each(vec, array, len, index, elem) {
+		check_elem(elem);
+		free(elem);
+		(*nr_end)++;
+	}
+}
+
+void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_readers nr_writers duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (writer period (in loops))\n");
+	printf("	[-c duration] (reader C.S. duration (in loops))\n");
+	printf("	[-k len] (vector length above which appends delete)\n");
+	printf("	[-R len] (max elements per whole-vector replace)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_reader, *tid_writer;
+	void *tret;
+	unsigned long long *count_reader, *count_writer;
+	unsigned long long tot_reads = 0, tot_read_elems = 0;
+	unsigned long long tot_appends = 0, tot_sets = 0, tot_dels = 0,
+		tot_replaces = 0;
+	unsigned long end_elems = 0;
+	int i, a, retval = 0;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_readers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_writers);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'k':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			max_len = atol(argv[++i]);
+			if (!max_len) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			break;
+		case 'R':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			replace_len = atol(argv[++i]);
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u readers, "
+		       "%u writers.\n",
+		       duration, nr_readers, nr_writers);
+	printf_verbose("Writer delay : %lu loops.\n", wdelay);
+	printf_verbose("Reader duration : %lu loops.\n", rduration);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	tid_reader = calloc(nr_readers, sizeof(*tid_reader));
+	tid_writer = calloc(nr_writers, sizeof(*tid_writer));
+	count_reader = calloc(nr_readers, 2 * sizeof(*count_reader));
+	count_writer = calloc(nr_writers, 4 * sizeof(*count_writer));
+
+	cds_vec_init(&vec, call_rcu);
+	err = create_all_cpu_call_rcu_data(0);
+	if (err) {
+		printf("Per-CPU call_rcu() worker threads unavailable. Using default global worker thread.\n");
+	}
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_create(&tid_reader[i], NULL, thr_reader,
+				     &count_reader[2 * i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_create(&tid_writer[i], NULL, thr_writer,
+				     &count_writer[4 * i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_readers; i++) {
+		err = pthread_join(tid_reader[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_reads += count_reader[2 * i];
+		tot_read_elems += count_reader[2 * i + 1];
+	}
+	for (i = 0; i < nr_writers; i++) {
+		err = pthread_join(tid_writer[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_appends += count_writer[4 * i];
+		tot_sets += count_writer[4 * i + 1];
+		tot_dels += count_writer[4 * i + 2];
+		tot_replaces += count_writer[4 * i + 3];
+	}
+
+	/* Flush the reclaim of the retired elements and arrays. */
+	rcu_barrier();
+	test_end(&vec, &end_elems);
+	cds_vec_destroy(&vec);
+
+	printf_verbose("total number of reads : %llu, elements read %llu\n",
+		       tot_reads, tot_read_elems);
+	printf_verbose("total number of appends : %llu, sets %llu, "
+		       "dels %llu, replaces %llu\n",
+		       tot_appends, tot_sets, tot_dels, tot_replaces);
+	printf("SUMMARY %-25s testdur %4lu nr_writers %3u wdelay %6lu "
+		"nr_readers %3u "
+		"rdur %6lu nr_reads %12llu nr_read_elems %12llu "
+		"nr_appends %12llu nr_sets %12llu nr_dels %12llu "
+		"nr_replaces %12llu end_elems %lu nr_ops %12llu\n",
+		argv[0], duration, nr_writers, wdelay,
+		nr_readers, rduration, tot_reads, tot_read_elems,
+		tot_appends, tot_sets, tot_dels, tot_replaces,
+		end_elems,
+		tot_reads + tot_appends + tot_sets + tot_dels + tot_replaces);
+	if (nr_alloc != nr_retired + end_elems) {
+		printf("WARNING! Discrepancy between nr elements allocated "
+		       "%lu vs retired + end elements %lu.\n",
+		       nr_alloc, nr_retired + end_elems);
+		retval = 1;
+	}
+	if (nr_freed != nr_retired) {
+		printf("WARNING! %lu elements freed, %lu retired.\n",
+		       nr_freed, nr_retired);
+		retval = 1;
+	}
+	if (nr_errors) {
+		printf("WARNING! %lu dead elements or bad lengths seen "
+		       "by readers.\n", nr_errors);
+		retval = 1;
+	}
+	free_all_cpu_call_rcu_data();
+	free(count_reader);
+	free(count_writer);
+	free(tid_reader);
+	free(tid_writer);
+	return retval;
+}
@@ -41,6 +41,7 @@
 #include <urcu/uatomic.h>
 #include "cpuset.h"
 #include "thread-id.h"
+#include "bench.h"
 
 /* hardcoded number of CPUs */
 #define NR_CPUS 16384
@@ -49,6 +50,7 @@
 #define _LGPL_SOURCE
 #endif
 #include <urcu/wfcqueue.h>
+#include <urcu/wfcqlanes.h>
 
 enum test_sync {
 	TEST_SYNC_NONE = 0,
@@ -79,6 +81,15 @@ static int verbose_mode;
 static int test_dequeue, test_splice, test_wait_empty;
 static int test_enqueue_stopped;
 
+/* Number of nodes per cds_wfcq_enqueue_chain(), 0: single enqueue. */
+static unsigned long enqueue_batch;
+
+/* Nodes per cds_wfcq_dequeue_bulk_blocking(), 0: single dequeue. */
+static unsigned int dequeue_bulk;
+
+/* Number of lanes of the sharded queue, 0: single queue. */
+static unsigned long nr_lanes;
+
 #define printf_verbose(fmt, args...)		\
 	do {					\
 		if (verbose_mode)		\
@@ -151,10 +162,27 @@ static unsigned int nr_dequeuers;
 
 static struct cds_wfcq_head __attribute__((aligned(CAA_CACHE_LINE_SIZE))) head;
 static struct cds_wfcq_tail __attribute__((aligned(CAA_CACHE_LINE_SIZE))) tail;
+static struct cds_wfcq_lanes lanes;
+
+static bool test_enqueue(struct cds_wfcq_node *node)
+{
+	if (nr_lanes)
+		return cds_wfcq_lanes_enqueue(&lanes, node);
+	return cds_wfcq_enqueue(&head, &tail, node);
+}
+
+static bool test_enqueue_chain(struct cds_wfcq_chain *chain)
+{
+	if (nr_lanes)
+		return cds_wfcq_lanes_enqueue_chain(&lanes, chain);
+	return cds_wfcq_enqueue_chain(&head, &tail, chain);
+}
 
 static void *thr_enqueuer(void *_count)
 {
 	unsigned long long *count = _count;
+	struct cds_wfcq_chain chain;
+	unsigned long chain_len = 0;
 	bool was_nonempty;
 
 	printf_verbose("thread_begin %s, tid %lu\n",
@@ -167,13 +195,26 @@ static void *thr_enqueuer(void *_count)
 	}
 	cmm_smp_mb();
 
+	cds_wfcq_chain_init(&chain);
+
 	for (;;) {
 		struct cds_wfcq_node *node = malloc(sizeof(*node));
 		if (!node)
 			goto fail;
 		cds_wfcq_node_init(node);
-		was_nonempty = cds_wfcq_enqueue(&head, &tail, node);
-		URCU_TLS(nr_successful_enqueues)++;
+		if (enqueue_batch) {
+			cds_wfcq_chain_add(&chain, node);
+			bench_trace_record(BENCH_TRACE_WFCQ_ENQUEUE, 0, 0);
+			URCU_TLS(nr_successful_enqueues)++;
+			if (++chain_len < enqueue_batch)
+				goto fail;
+			was_nonempty = test_enqueue_chain(&chain);
+			chain_len = 0;
+		} else {
+			was_nonempty = test_enqueue(node);
+			bench_trace_record(BENCH_TRACE_WFCQ_ENQUEUE, 0, 0);
+			URCU_TLS(nr_successful_enqueues)++;
+		}
 		if (!was_nonempty)
 			URCU_TLS(nr_empty_dest_enqueues)++;
 
@@ -185,6 +226,13 @@ fail:
 			break;
 	}
 
+	/* Publish the partial chain so dequeuers account for every node. */
+	if (!cds_wfcq_chain_empty(&chain)) {
+		if (!test_enqueue_chain(&chain))
+			URCU_TLS(nr_empty_dest_enqueues)++;
+	}
+
+	bench_trace_thread_end();
 	uatomic_inc(&test_enqueue_stopped);
 	count[0] = URCU_TLS(nr_enqueues);
 	count[1] = URCU_TLS(nr_successful_enqueues);
@@ -200,12 +248,41 @@ fail:
 
 }
 
-static void do_test_dequeue(enum test_sync sync)
+static void do_test_dequeue_bulk(enum test_sync sync,
+		struct cds_wfcq_node **nodes)
 {
-	struct cds_wfcq_node *node;
-	int state;
+	unsigned int i, nr;
 
 	if (sync == TEST_SYNC_MUTEX)
+		nr = cds_wfcq_dequeue_bulk_blocking(&head, &tail, nodes,
+				dequeue_bulk);
+	else
+		nr = __cds_wfcq_dequeue_bulk_blocking(&head, &tail, nodes,
+				dequeue_bulk);
+
+	for (i = 0; i < nr; i++) {
+		free(nodes[i]);
+		bench_trace_record(BENCH_TRACE_WFCQ_DEQUEUE, 0, 1);
+		URCU_TLS(nr_successful_dequeues)++;
+	}
+	URCU_TLS(nr_dequeues)++;
+}
+
+static void do_test_dequeue(enum test_sync sync,
+		struct cds_wfcq_node **nodes)
+{
+	struct cds_wfcq_node *node;
+	int state = 0;
+
+	if (nodes) {
+		do_test_dequeue_bulk(sync, nodes);
+		return;
+	}
+
+	/* The lanes take their dequeue lock, and keep no state. */
+	if (nr_lanes)
+		node = cds_wfcq_lanes_dequeue_blocking(&lanes);
+	else if (sync == TEST_SYNC_MUTEX)
 		node = cds_wfcq_dequeue_with_state_blocking(&head, &tail,
 				&state);
 	else
@@ -219,6 +296,7 @@ static void do_test_dequeue(enum test_sync sync)
 		free(node);
 		URCU_TLS(nr_successful_dequeues)++;
 	}
+	bench_trace_record(BENCH_TRACE_WFCQ_DEQUEUE, 0, !!node);
 	URCU_TLS(nr_dequeues)++;
 }
 
@@ -231,7 +309,10 @@ static void do_test_splice(enum test_sync sync)
 
 	cds_wfcq_init(&tmp_head, &tmp_tail);
 
-	if (sync == TEST_SYNC_MUTEX)
+	if (nr_lanes)
+		ret = cds_wfcq_lanes_splice_blocking(&tmp_head, &tmp_tail,
+			&lanes);
+	else if (sync == TEST_SYNC_MUTEX)
 		ret = cds_wfcq_splice_blocking(&tmp_head, &tmp_tail,
 			&head, &tail);
 	else
@@ -265,6 +346,7 @@ static void do_test_splice(enum test_sync sync)
 static void *thr_dequeuer(void *_count)
 {
 	unsigned long long *count = _count;
+	struct cds_wfcq_node **bulk = NULL;
 	unsigned int counter = 0;
 
 	printf_verbose("thread_begin %s, tid %lu\n",
@@ -272,6 +354,12 @@ static void *thr_dequeuer(void *_count)
 
 	set_affinity();
 
+	/* Lanes only provide single-node dequeue. */
+	if (dequeue_bulk && !nr_lanes) {
+		bulk = calloc(dequeue_bulk, sizeof(*bulk));
+		assert(bulk);
+	}
+
 	while (!test_go)
 	{
 	}
@@ -280,13 +368,13 @@ static void *thr_dequeuer(void *_count)
 	for (;;) {
 		if (test_dequeue && test_splice) {
 			if (counter & 1)
-				do_test_dequeue(test_sync);
+				do_test_dequeue(test_sync, bulk);
 			else
 				do_test_splice(test_sync);
 			counter++;
 		} else {
 			if (test_dequeue)
-				do_test_dequeue(test_sync);
+				do_test_dequeue(test_sync, bulk);
 			else
 				do_test_splice(test_sync);
 		}
@@ -296,6 +384,8 @@ static void *thr_dequeuer(void *_count)
 			loop_sleep(rduration);
 	}
 
+	free(bulk);
+	bench_trace_thread_end();
 	printf_verbose("dequeuer thread_end, tid %lu, "
 			"dequeues %llu, successful_dequeues %llu, "
 			"nr_splice %llu\n",
@@ -313,11 +403,14 @@ static void test_end(unsigned long long *nr_dequeues,
 		unsigned long long *nr_dequeue_last)
 {
 	struct cds_wfcq_node *node;
-	int state;
+	int state = 0;
 
 	do {
-		node = cds_wfcq_dequeue_with_state_blocking(&head, &tail,
-				&state);
+		if (nr_lanes)
+			node = cds_wfcq_lanes_dequeue_blocking(&lanes);
+		else
+			node = cds_wfcq_dequeue_with_state_blocking(&head, &tail,
+					&state);
 		if (node) {
 			if (state & CDS_WFCQ_STATE_LAST)
 				(*nr_dequeue_last)++;
@@ -342,6 +435,12 @@ static void show_usage(int argc, char **argv)
 	printf("		Note: default: no external synchronization used.\n");
 	printf("	[-f] (force user-provided synchronization)\n");
 	printf("	[-w] Wait for dequeuer to empty queue\n");
+	printf("	[-b batch] (enqueue chains of batch nodes with a single xchg)\n");
+	printf("	[-n nodes] (with -q, dequeue up to nodes per bulk dequeue)\n");
+	printf("	[-l lanes] (sharded queue with per-CPU lanes, 0: one per CPU)\n");
+	printf("	[--format=json|csv] (machine-readable report)\n");
+	printf("	[--perf] (hardware performance counters per operation)\n");
+	printf("	[--record=FILE] (trace enqueues and dequeues for test_urcu_replay)\n");
 	printf("\n");
 }
 
@@ -385,6 +484,8 @@ int main(int argc, char **argv)
 	for (i = 4; i < argc; i++) {
 		if (argv[i][0] != '-')
 			continue;
+		if (bench_parse_option(argv[i]))
+			continue;
 		switch (argv[i][1]) {
 		case 'a':
 			if (argc < i + 2) {
@@ -428,6 +529,33 @@ int main(int argc, char **argv)
 		case 'f':
 			test_force_sync = 1;
 			break;
+		case 'b':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			enqueue_batch = atol(argv[++i]);
+			break;
+		case 'n':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			dequeue_bulk = atoi(argv[++i]);
+			break;
+		case 'l':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			nr_lanes = atol(argv[++i]);
+			/* 0 lets cds_wfcq_lanes_init() pick one per CPU. */
+			if (cds_wfcq_lanes_init(&lanes, nr_lanes)) {
+				perror("cds_wfcq_lanes_init");
+				return -1;
+			}
+			nr_lanes = lanes.nr_lanes;
+			break;
 		}
 	}
 
@@ -435,7 +563,8 @@ int main(int argc, char **argv)
 	if (!test_dequeue && !test_splice)
 		test_splice = 1;
 
-	if (test_sync == TEST_SYNC_NONE && nr_dequeuers > 1 && test_dequeue) {
+	if (test_sync == TEST_SYNC_NONE && nr_dequeuers > 1 && test_dequeue
+			&& !nr_lanes) {
 		if (test_force_sync) {
 			fprintf(stderr, "[WARNING] Using dequeue concurrently "
 				"with other dequeue or splice without external "
@@ -459,6 +588,10 @@ int main(int argc, char **argv)
 		printf_verbose("External sync: none.\n");
 	if (test_wait_empty)
 		printf_verbose("Wait for dequeuers to empty queue.\n");
+	if (enqueue_batch)
+		printf_verbose("Enqueue batch : %lu nodes.\n", enqueue_batch);
+	if (nr_lanes)
+		printf_verbose("Lanes : %lu.\n", nr_lanes);
 	printf_verbose("Writer delay : %lu loops.\n", rduration);
 	printf_verbose("Reader duration : %lu loops.\n", wdelay);
 	printf_verbose("thread %-6s, tid %lu\n",
@@ -487,6 +620,7 @@ int main(int argc, char **argv)
 
 	cmm_smp_mb();
 
+	bench_perf_start();
 	test_go = 1;
 
 	for (i = 0; i < duration; i++) {
@@ -501,12 +635,14 @@ int main(int argc, char **argv)
 		while (nr_enqueuers != uatomic_read(&test_enqueue_stopped)) {
 			sleep(1);
 		}
-		while (!cds_wfcq_empty(&head, &tail)) {
+		while (nr_lanes ? !cds_wfcq_lanes_empty(&lanes)
+				: !cds_wfcq_empty(&head, &tail)) {
 			sleep(1);
 		}
 	}
 
 	test_stop_dequeue = 1;
+	bench_perf_stop();
 
 	for (i = 0; i < nr_enqueuers; i++) {
 		err = pthread_join(tid_enqueuer[i], &tret);
@@ -525,6 +661,7 @@ int main(int argc, char **argv)
 		tot_splice += count_dequeuer[4 * i + 2];
 		tot_dequeue_last += count_dequeuer[4 * i + 3];
 	}
+	bench_trace_close();
 	
 	test_end(&end_dequeues, &tot_dequeue_last);
 
@@ -538,6 +675,10 @@ int main(int argc, char **argv)
 		       tot_empty_dest_enqueues,
 		       tot_successful_dequeues,
 		       tot_splice, tot_dequeue_last);
+	if (tot_enqueues)
+		printf_verbose("enqueue cost : %llu ns per enqueue per thread\n",
+			       duration * 1000000000ULL * nr_enqueuers
+				/ tot_enqueues);
 	printf("SUMMARY %-25s testdur %4lu nr_enqueuers %3u wdelay %6lu "
 		"nr_dequeuers %3u "
 		"rdur %6lu nr_enqueues %12llu nr_dequeues %12llu "
@@ -552,6 +693,22 @@ int main(int argc, char **argv)
 		tot_successful_dequeues, tot_splice, tot_dequeue_last,
 		end_dequeues,
 		tot_enqueues + tot_dequeues);
+	bench_report_begin(argv[0]);
+	bench_report_u64("duration_s", duration);
+	bench_report_u64("nr_enqueuers", nr_enqueuers);
+	bench_report_u64("nr_dequeuers", nr_dequeuers);
+	bench_report_u64("wdelay", wdelay);
+	bench_report_u64("rdur", rduration);
+	bench_report_u64("nr_enqueues", tot_enqueues);
+	bench_report_u64("nr_dequeues", tot_dequeues);
+	bench_report_u64("nr_successful_enqueues", tot_successful_enqueues);
+	bench_report_u64("nr_successful_dequeues", tot_successful_dequeues);
+	bench_report_u64("nr_splice", tot_splice);
+	bench_report_u64("nr_lanes", nr_lanes);
+	bench_report_double("enqueues_per_s", (double) tot_enqueues / duration);
+	bench_report_double("dequeues_per_s", (double) tot_dequeues / duration);
+	bench_report_perf(tot_enqueues + tot_dequeues);
+	bench_report_end();
 
 	if (tot_successful_enqueues != tot_successful_dequeues + end_dequeues) {
 		printf("WARNING! Discrepancy between nr succ. enqueues %llu vs "
@@ -564,15 +721,20 @@ int main(int argc, char **argv)
 	/*
 	 * If only using splice to dequeue, the enqueuer should see
 	 * exactly as many empty queues than the number of non-empty
-	 * src splice.
+	 * src splice. Lanes report empty per lane, and splice
+	 * per queue, and bulk dequeue keeps no state, so they are
+	 * not compared.
 	 */
-	if (tot_empty_dest_enqueues != tot_dequeue_last) {
+	if (!nr_lanes && !dequeue_bulk
+			&& tot_empty_dest_enqueues != tot_dequeue_last) {
 		printf("WARNING! Discrepancy between empty enqueue (%llu) and "
 			"number of dequeue of last element (%llu)\n",
 			tot_empty_dest_enqueues,
 			tot_dequeue_last);
 		retval = 1;
 	}
+	if (nr_lanes)
+		cds_wfcq_lanes_destroy(&lanes);
 	free(count_enqueuer);
 	free(count_dequeuer);
 	free(tid_enqueuer);
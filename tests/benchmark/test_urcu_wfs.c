@@ -82,6 +82,12 @@ static int verbose_mode;
 static int test_pop, test_pop_all, test_wait_empty;
 static int test_enqueue_stopped;
 
+/* Number of nodes per cds_wfs_push_chain(), 0: single push. */
+static unsigned long enqueue_batch;
+
+/* Walk the nodes returned by pop_all in push order. */
+static int test_pop_all_reverse;
+
 #define printf_verbose(fmt, args...)		\
 	do {					\
 		if (verbose_mode)		\
@@ -157,6 +163,8 @@ static struct cds_wfs_stack s;
 static void *thr_enqueuer(void *_count)
 {
 	unsigned long long *count = _count;
+	struct cds_wfs_chain chain;
+	unsigned long chain_len = 0;
 	bool was_nonempty;
 
 	printf_verbose("thread_begin %s, tid %lu\n",
@@ -169,13 +177,24 @@ static void *thr_enqueuer(void *_count)
 	}
 	cmm_smp_mb();
 
+	cds_wfs_chain_init(&chain);
+
 	for (;;) {
 		struct cds_wfs_node *node = malloc(sizeof(*node));
 		if (!node)
 			goto fail;
 		cds_wfs_node_init(node);
-		was_nonempty = cds_wfs_push(&s, node);
-		URCU_TLS(nr_successful_enqueues)++;
+		if (enqueue_batch) {
+			cds_wfs_chain_add(&chain, node);
+			URCU_TLS(nr_successful_enqueues)++;
+			if (++chain_len < enqueue_batch)
+				goto fail;
+			was_nonempty = cds_wfs_push_chain(&s, &chain);
+			chain_len = 0;
+		} else {
+			was_nonempty = cds_wfs_push(&s, node);
+			URCU_TLS(nr_successful_enqueues)++;
+		}
 		if (!was_nonempty)
 			URCU_TLS(nr_empty_dest_enqueues)++;
 
@@ -187,6 +206,12 @@ fail:
 			break;
 	}
 
+	/* Publish the partial chain so dequeuers account for every node. */
+	if (!cds_wfs_chain_empty(&chain)) {
+		if (!cds_wfs_push_chain(&s, &chain))
+			URCU_TLS(nr_empty_dest_enqueues)++;
+	}
+
 	uatomic_inc(&test_enqueue_stopped);
 	count[0] = URCU_TLS(nr_enqueues);
 	count[1] = URCU_TLS(nr_successful_enqueues);
@@ -229,7 +254,10 @@ static void do_test_pop_all(enum test_sync sync)
 
 	if (sync == TEST_SYNC_MUTEX)
 		cds_wfs_pop_lock(&s);
-	head = __cds_wfs_pop_all(&s);
+	if (test_pop_all_reverse)
+		head = __cds_wfs_pop_all_reverse_blocking(&s);
+	else
+		head = __cds_wfs_pop_all(&s);
 	if (sync == TEST_SYNC_MUTEX)
 		cds_wfs_pop_unlock(&s);
 
@@ -330,6 +358,8 @@ static void show_usage(int argc, char **argv)
 	printf("		Note: default: no external synchronization used.\n");
 	printf("	[-f] (force user-provided synchronization)\n");
 	printf("	[-w] Wait for dequeuer to empty stack\n");
+	printf("	[-b batch] (push chains of batch nodes with a single xchg)\n");
+	printf("	[-r] (pop_all in push order)\n");
 	printf("\n");
 }
 
@@ -416,6 +446,16 @@ int main(int argc, char **argv)
 		case 'f':
 			test_force_sync = 1;
 			break;
+		case 'b':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			enqueue_batch = atol(argv[++i]);
+			break;
+		case 'r':
+			test_pop_all_reverse = 1;
+			break;
 		}
 	}
 
@@ -0,0 +1,432 @@
+/*
+ * test_urcu_wsdq.c
+ *
+ * Userspace RCU library - work-stealing deque benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <urcu/arch.h>
+#include <urcu/tls-compat.h>
+#include <urcu/uatomic.h>
+#include "cpuset.h"
+#include "thread-id.h"
+
+/* hardcoded number of CPUs */
+#define NR_CPUS 16384
+
+#ifndef DYNAMIC_LINK_TEST
+#define _LGPL_SOURCE
+#endif
+#include <urcu.h>
+#include <urcu/wsdeque.h>
+
+static volatile int test_go, test_stop;
+
+static unsigned long rduration;
+
+static unsigned long duration;
+
+/* owner delay between bursts, in loops */
+static unsigned long wdelay;
+
+static inline void loop_sleep(unsigned long loops)
+{
+	while (loops-- != 0)
+		caa_cpu_relax();
+}
+
+static int verbose_mode;
+
+static unsigned long burst = 16;	/* pushes before popping back */
+
+#define printf_verbose(fmt, args...)		\
+	do {					\
+		if (verbose_mode)		\
+			printf(fmt, ## args);	\
+	} while (0)
+
+static unsigned int cpu_affinities[NR_CPUS];
+static unsigned int next_aff = 0;
+static int use_affinity = 0;
+
+pthread_mutex_t affinity_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_affinity(void)
+{
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+	int cpu, ret;
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+	if (!use_affinity)
+		return;
+
+#if HAVE_SCHED_SETAFFINITY
+	ret = pthread_mutex_lock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex lock");
+		exit(-1);
+	}
+	cpu = cpu_affinities[next_aff++];
+	ret = pthread_mutex_unlock(&affinity_mutex);
+	if (ret) {
+		perror("Error in pthread mutex unlock");
+		exit(-1);
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+/*
+ * returns 0 if test should end.
+ */
+static int test_duration(void)
+{
+	return !test_stop;
+}
+
+static DEFINE_URCU_TLS(unsigned long long, nr_pushes);
+static DEFINE_URCU_TLS(unsigned long long, nr_pops);
+static DEFINE_URCU_TLS(unsigned long long, nr_steals);
+static DEFINE_URCU_TLS(unsigned long long, nr_successful_steals);
+
+static unsigned int nr_owners;
+static unsigned int nr_thieves;
+
+/* One deque per owner. */
+static struct cds_wsdq *deques;
+
+struct test {
+	unsigned long long seq;
+};
+
+static unsigned long long *count_owner, *count_thief;
+
+static void *thr_owner(void *_count)
+{
+	unsigned long long *count = _count;
+	struct cds_wsdq *q = &deques[(count - count_owner) / 2];
+	unsigned long i;
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"owner", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		struct test *node;
+
+		/* Spawn a burst of tasks, then run them back, LIFO. */
+		for (i = 0; i < burst; i++) {
+			node = malloc(sizeof(*node));
+			if (!node)
+				break;
+			node->seq = URCU_TLS(nr_pushes);
+			if (cds_wsdq_push(q, node)) {
+				free(node);
+				break;
+			}
+			URCU_TLS(nr_pushes)++;
+		}
+		while ((node = cds_wsdq_pop(q)) != NULL) {
+			free(node);
+			URCU_TLS(nr_pops)++;
+		}
+		if (caa_unlikely(wdelay))
+			loop_sleep(wdelay);
+		if (caa_unlikely(!test_duration()))
+			break;
+	}
+
+	rcu_unregister_thread();
+
+	count[0] = URCU_TLS(nr_pushes);
+	count[1] = URCU_TLS(nr_pops);
+	printf_verbose("owner thread_end, tid %lu, "
+			"pushes %llu pops %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_pushes),
+			URCU_TLS(nr_pops));
+	return ((void*)1);
+}
+
+static void *thr_thief(void *_count)
+{
+	unsigned long long *count = _count;
+	unsigned int seed = (unsigned int) urcu_get_thread_id();
+
+	printf_verbose("thread_begin %s, tid %lu\n",
+			"thief", urcu_get_thread_id());
+
+	set_affinity();
+
+	rcu_register_thread();
+
+	while (!test_go)
+	{
+	}
+	cmm_smp_mb();
+
+	for (;;) {
+		struct test *node;
+
+		rcu_read_lock();
+		node = cds_wsdq_steal(&deques[rand_r(&seed) % nr_owners]);
+		rcu_read_unlock();
+		if (node) {
+			free(node);
+			URCU_TLS(nr_successful_steals)++;
+		}
+		URCU_TLS(nr_steals)++;
+		if (caa_unlikely(!test_duration()))
+			break;
+		if (caa_unlikely(rduration))
+			loop_sleep(rduration);
+	}
+
+	rcu_unregister_thread();
+
+	count[0] = URCU_TLS(nr_steals);
+	count[1] = URCU_TLS(nr_successful_steals);
+	printf_verbose("thief thread_end, tid %lu, "
+			"steals %llu, successful_steals %llu\n",
+			urcu_get_thread_id(),
+			URCU_TLS(nr_steals), URCU_TLS(nr_successful_steals));
+	return ((void*)2);
+}
+
+static void test_end(unsigned long long *nr_pops)
+{
+	struct test *node;
+	unsigned int i;
+
+	for (i = 0; i < nr_owners; i++) {
+		while ((node = cds_wsdq_pop(&deques[i])) != NULL) {
+			free(node);
+			(*nr_pops)++;
+		}
+	}
+}
+
+static void show_usage(int argc, char **argv)
+{
+	printf("Usage : %s nr_thieves nr_owners duration (s) <OPTIONS>\n",
+		argv[0]);
+	printf("OPTIONS:\n");
+	printf("	[-d delay] (owner period between bursts (in loops))\n");
+	printf("	[-c duration] (thief period (in loops))\n");
+	printf("	[-b burst] (pushes per burst, default 16)\n");
+	printf("	[-v] (verbose output)\n");
+	printf("	[-a cpu#] [-a cpu#]... (affinity)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	pthread_t *tid_owner, *tid_thief;
+	void *tret;
+	unsigned long long tot_pushes = 0, tot_pops = 0;
+	unsigned long long tot_steals = 0, tot_successful_steals = 0;
+	unsigned long long end_pops = 0;
+	int i, a, retval = 0;
+
+	if (argc < 4) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[1], "%u", &nr_thieves);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[2], "%u", &nr_owners);
+	if (err != 1 || !nr_owners) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	err = sscanf(argv[3], "%lu", &duration);
+	if (err != 1) {
+		show_usage(argc, argv);
+		return -1;
+	}
+
+	for (i = 4; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'a':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			a = atoi(argv[++i]);
+			cpu_affinities[next_aff++] = a;
+			use_affinity = 1;
+			printf_verbose("Adding CPU %d affinity\n", a);
+			break;
+		case 'b':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			burst = atol(argv[++i]);
+			break;
+		case 'c':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			rduration = atol(argv[++i]);
+			break;
+		case 'd':
+			if (argc < i + 2) {
+				show_usage(argc, argv);
+				return -1;
+			}
+			wdelay = atol(argv[++i]);
+			break;
+		case 'v':
+			verbose_mode = 1;
+			break;
+		}
+	}
+
+	printf_verbose("running test for %lu seconds, %u owners, "
+		       "%u thieves, burst %lu.\n",
+		       duration, nr_owners, nr_thieves, burst);
+	printf_verbose("Owner delay : %lu loops.\n", wdelay);
+	printf_verbose("Thief duration : %lu loops.\n", rduration);
+	printf_verbose("thread %-6s, tid %lu\n",
+			"main", urcu_get_thread_id());
+
+	deques = calloc(nr_owners, sizeof(*deques));
+	for (i = 0; i < nr_owners; i++)
+		cds_wsdq_init(&deques[i], call_rcu);
+
+	tid_owner = calloc(nr_owners, sizeof(*tid_owner));
+	tid_thief = calloc(nr_thieves, sizeof(*tid_thief));
+	count_owner = calloc(nr_owners, 2 * sizeof(*count_owner));
+	count_thief = calloc(nr_thieves, 2 * sizeof(*count_thief));
+
+	next_aff = 0;
+
+	for (i = 0; i < nr_owners; i++) {
+		err = pthread_create(&tid_owner[i], NULL, thr_owner,
+				     &count_owner[2 * i]);
+		if (err != 0)
+			exit(1);
+	}
+	for (i = 0; i < nr_thieves; i++) {
+		err = pthread_create(&tid_thief[i], NULL, thr_thief,
+				     &count_thief[2 * i]);
+		if (err != 0)
+			exit(1);
+	}
+
+	cmm_smp_mb();
+
+	test_go = 1;
+
+	for (i = 0; i < duration; i++) {
+		sleep(1);
+		if (verbose_mode)
+			(void) write(1, ".", 1);
+	}
+
+	test_stop = 1;
+
+	for (i = 0; i < nr_owners; i++) {
+		err = pthread_join(tid_owner[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_pushes += count_owner[2 * i];
+		tot_pops += count_owner[2 * i + 1];
+	}
+	for (i = 0; i < nr_thieves; i++) {
+		err = pthread_join(tid_thief[i], &tret);
+		if (err != 0)
+			exit(1);
+		tot_steals += count_thief[2 * i];
+		tot_successful_steals += count_thief[2 * i + 1];
+	}
+
+	test_end(&end_pops);
+
+	printf_verbose("total number of pushes : %llu, pops %llu\n",
+		       tot_pushes, tot_pops);
+	printf_verbose("total number of steals : %llu, "
+		       "successful steals %llu\n",
+		       tot_steals, tot_successful_steals);
+	printf("SUMMARY %-25s testdur %4lu nr_owners %3u wdelay %6lu "
+		"nr_thieves %3u "
+		"rdur %6lu burst %lu nr_pushes %12llu "
+		"nr_pops %12llu "
+		"nr_steals %12llu successful steals %12llu "
+		"end_pops %llu nr_ops %12llu\n",
+		argv[0], duration, nr_owners, wdelay,
+		nr_thieves, rduration, burst, tot_pushes,
+		tot_pops, tot_steals,
+		tot_successful_steals, end_pops,
+		tot_pushes + tot_pops + tot_steals);
+	if (tot_pushes != tot_pops + tot_successful_steals + end_pops) {
+		printf("WARNING! Discrepancy between nr pushes %llu vs "
+		       "pops + successful steals + end pops %llu.\n",
+		       tot_pushes,
+		       tot_pops + tot_successful_steals + end_pops);
+		retval = 1;
+	}
+	/* Flush the reclaim of the replaced deque buffers. */
+	rcu_barrier();
+	for (i = 0; i < nr_owners; i++)
+		cds_wsdq_destroy(&deques[i]);
+	free(deques);
+	free(count_owner);
+	free(count_thief);
+	free(tid_owner);
+	free(tid_thief);
+	return retval;
+}
@@ -0,0 +1,248 @@
+/*
+ * bench-perf.c
+ *
+ * Userspace RCU library tests - Benchmark hardware performance counters
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "bench.h"
+
+enum bench_perf_event {
+	BENCH_PERF_CYCLES = 0,
+	BENCH_PERF_INSTRUCTIONS,
+	BENCH_PERF_LLC_MISSES,
+	BENCH_PERF_HITM,
+	NR_BENCH_PERF_EVENTS,
+};
+
+static const char *perf_event_name[NR_BENCH_PERF_EVENTS] = {
+	[BENCH_PERF_CYCLES] = "cycles",
+	[BENCH_PERF_INSTRUCTIONS] = "instructions",
+	[BENCH_PERF_LLC_MISSES] = "llc_misses",
+	[BENCH_PERF_HITM] = "hitm",
+};
+
+int bench_perf;
+
+static int perf_fd[NR_BENCH_PERF_EVENTS] = { -1, -1, -1, -1 };
+static double perf_count[NR_BENCH_PERF_EVENTS];
+static double perf_base[NR_BENCH_PERF_EVENTS];
+static int perf_stopped;
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+
+static
+int perf_open(uint32_t type, uint64_t config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.inherit = 1;	/* count the threads created afterwards */
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+		| PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void bench_perf_open(void)
+{
+	const char *hitm;
+	int i;
+
+	perf_fd[BENCH_PERF_CYCLES] = perf_open(PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_CPU_CYCLES);
+	if (perf_fd[BENCH_PERF_CYCLES] < 0) {
+		fprintf(stderr, "Hardware performance counters unavailable: %s\n",
+			strerror(errno));
+		return;
+	}
+	perf_fd[BENCH_PERF_INSTRUCTIONS] = perf_open(PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_INSTRUCTIONS);
+	perf_fd[BENCH_PERF_LLC_MISSES] = perf_open(PERF_TYPE_HW_CACHE,
+		PERF_COUNT_HW_CACHE_LL
+		| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	if (perf_fd[BENCH_PERF_LLC_MISSES] < 0)
+		perf_fd[BENCH_PERF_LLC_MISSES] = perf_open(PERF_TYPE_HARDWARE,
+			PERF_COUNT_HW_CACHE_MISSES);
+	/* No generic event: the raw PMU event counting remote HITM loads. */
+	hitm = getenv("URCU_BENCH_PERF_HITM");
+	if (hitm)
+		perf_fd[BENCH_PERF_HITM] = perf_open(PERF_TYPE_RAW,
+			strtoull(hitm, NULL, 0));
+	for (i = 1; i < NR_BENCH_PERF_EVENTS; i++) {
+		if (perf_fd[i] < 0 && (i != BENCH_PERF_HITM || hitm))
+			fprintf(stderr, "Performance counter %s unavailable\n",
+				perf_event_name[i]);
+	}
+}
+
+static
+void perf_ioctl(unsigned long request)
+{
+	int i;
+
+	for (i = 0; i < NR_BENCH_PERF_EVENTS; i++)
+		if (perf_fd[i] >= 0)
+			(void) ioctl(perf_fd[i], request, 0);
+}
+
+static
+void perf_read(void)
+{
+	uint64_t v[3];	/* value, time enabled, time running */
+	int i;
+
+	for (i = 0; i < NR_BENCH_PERF_EVENTS; i++) {
+		perf_count[i] = -1;
+		if (perf_fd[i] < 0)
+			continue;
+		if (read(perf_fd[i], v, sizeof(v)) != sizeof(v))
+			continue;
+		/* Scale the counters multiplexed on the PMU. */
+		perf_count[i] = v[2] ? (double) v[0] * v[1] / v[2] : 0;
+	}
+}
+
+#else /* HAVE_LINUX_PERF_EVENT_H */
+
+void bench_perf_open(void)
+{
+	fprintf(stderr, "Hardware performance counters unavailable\n");
+}
+
+static
+void perf_ioctl(unsigned long request)
+{
+}
+
+static
+void perf_read(void)
+{
+	int i;
+
+	for (i = 0; i < NR_BENCH_PERF_EVENTS; i++)
+		perf_count[i] = -1;
+}
+
+#define PERF_EVENT_IOC_ENABLE	0
+#define PERF_EVENT_IOC_DISABLE	0
+
+#endif /* HAVE_LINUX_PERF_EVENT_H */
+
+/*
+ * The counts of the threads which exited are kept by the counters of
+ * the main thread, and are not cleared by a reset: programs running
+ * several measurements get the difference between the counts at
+ * bench_perf_stop() and at bench_perf_start().
+ */
+void bench_perf_start(void)
+{
+	if (!bench_perf)
+		return;
+	perf_read();
+	memcpy(perf_base, perf_count, sizeof(perf_base));
+	perf_stopped = 0;
+	perf_ioctl(PERF_EVENT_IOC_ENABLE);
+}
+
+void bench_perf_stop(void)
+{
+	int i;
+
+	if (!bench_perf)
+		return;
+	perf_ioctl(PERF_EVENT_IOC_DISABLE);
+	perf_read();
+	for (i = 0; i < NR_BENCH_PERF_EVENTS; i++)
+		if (perf_count[i] >= 0 && perf_base[i] >= 0)
+			perf_count[i] -= perf_base[i];
+	perf_stopped = 1;
+}
+
+static
+int perf_available(unsigned long long nr_ops)
+{
+	if (!bench_perf || perf_fd[BENCH_PERF_CYCLES] < 0 || !nr_ops)
+		return 0;
+	if (!perf_stopped)
+		bench_perf_stop();
+	return 1;
+}
+
+void bench_perf_print(unsigned long long nr_ops, const char *fmt, ...)
+{
+	va_list ap;
+	int i;
+
+	if (!perf_available(nr_ops))
+		return;
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf(":");
+	for (i = 0; i < NR_BENCH_PERF_EVENTS; i++) {
+		if (perf_count[i] >= 0)
+			printf(" %s/op %.2f", perf_event_name[i],
+				perf_count[i] / nr_ops);
+	}
+	if (perf_count[BENCH_PERF_CYCLES] > 0
+			&& perf_count[BENCH_PERF_INSTRUCTIONS] >= 0)
+		printf(" IPC %.2f", perf_count[BENCH_PERF_INSTRUCTIONS]
+			/ perf_count[BENCH_PERF_CYCLES]);
+	printf(" (%llu ops)\n", nr_ops);
+}
+
+void bench_report_perf(unsigned long long nr_ops)
+{
+	char key[32];
+	int i;
+
+	if (!perf_available(nr_ops))
+		return;
+	for (i = 0; i < NR_BENCH_PERF_EVENTS; i++) {
+		if (perf_count[i] < 0)
+			continue;
+		/* Key names live until exit, as the report is printed once. */
+		snprintf(key, sizeof(key), "perf_%s", perf_event_name[i]);
+		bench_report_u64(strdup(key), perf_count[i]);
+		snprintf(key, sizeof(key), "perf_%s_per_op", perf_event_name[i]);
+		bench_report_double(strdup(key), perf_count[i] / nr_ops);
+	}
+	if (bench_get_format() == BENCH_FORMAT_TEXT)
+		bench_perf_print(nr_ops, "perf");
+}
@@ -0,0 +1,361 @@
+/*
+ * bench-placement.c
+ *
+ * Userspace RCU library tests - Benchmark thread placement on NUMA nodes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <urcu/compiler.h>
+#include "cpuset.h"
+#include "bench.h"
+
+#define NODE_SYSFS	"/sys/devices/system/node"
+
+struct bench_node {
+	int id;			/* node number */
+	unsigned int nr_cpus;
+	int *cpus;
+};
+
+enum bench_placement bench_placement;
+int bench_call_rcu_per_node;
+
+static struct bench_node *nodes;
+static unsigned int nr_nodes;
+
+static unsigned int placement_nr_readers;
+static unsigned int placement_nr_writers;
+static pthread_mutex_t placement_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int placed[2];		/* threads placed, per role */
+static int *placed_node[2];		/* node of each thread, per role */
+
+static const char *placement_name[] = {
+	[BENCH_PLACEMENT_NONE] = "none",
+	[BENCH_PLACEMENT_COMPACT] = "compact",
+	[BENCH_PLACEMENT_SCATTER] = "scatter",
+	[BENCH_PLACEMENT_REMOTE_WRITERS] = "remote-writers",
+};
+
+static
+void *zmalloc_or_die(size_t len)
+{
+	void *p = calloc(1, len);
+
+	if (!p) {
+		perror("calloc");
+		exit(-1);
+	}
+	return p;
+}
+
+static
+void node_add_cpu(struct bench_node *node, int cpu)
+{
+	node->cpus = realloc(node->cpus, (node->nr_cpus + 1) * sizeof(int));
+	if (!node->cpus) {
+		perror("realloc");
+		exit(-1);
+	}
+	node->cpus[node->nr_cpus++] = cpu;
+}
+
+/* Parse a sysfs CPU list, e.g. "0-3,8-11". */
+static
+void node_parse_cpulist(struct bench_node *node, const char *list)
+{
+	const char *p = list;
+	char *end;
+	long first, last;
+
+	while (*p) {
+		first = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		last = first;
+		p = end;
+		if (*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			p = end;
+		}
+		for (; first <= last; first++)
+			node_add_cpu(node, (int) first);
+		if (*p != ',')
+			break;
+		p++;
+	}
+}
+
+static
+int node_cmp(const void *a, const void *b)
+{
+	return ((const struct bench_node *) a)->id
+		- ((const struct bench_node *) b)->id;
+}
+
+static
+void topology_read_sysfs(void)
+{
+	char path[256], list[4096];
+	struct dirent *entry;
+	struct bench_node *node;
+	DIR *dir;
+	FILE *fp;
+	int id;
+
+	dir = opendir(NODE_SYSFS);
+	if (!dir)
+		return;
+	while ((entry = readdir(dir)) != NULL) {
+		if (sscanf(entry->d_name, "node%d", &id) != 1)
+			continue;
+		snprintf(path, sizeof(path), NODE_SYSFS "/node%d/cpulist", id);
+		fp = fopen(path, "r");
+		if (!fp)
+			continue;
+		if (!fgets(list, sizeof(list), fp))
+			list[0] = '\0';
+		fclose(fp);
+		nodes = realloc(nodes, (nr_nodes + 1) * sizeof(*nodes));
+		if (!nodes) {
+			perror("realloc");
+			exit(-1);
+		}
+		node = &nodes[nr_nodes];
+		memset(node, 0, sizeof(*node));
+		node->id = id;
+		node_parse_cpulist(node, list);
+		/* Memory-only nodes cannot run threads. */
+		if (node->nr_cpus)
+			nr_nodes++;
+	}
+	closedir(dir);
+	qsort(nodes, nr_nodes, sizeof(*nodes), node_cmp);
+}
+
+static
+void topology_init_once(void)
+{
+	long nr_cpus, cpu;
+
+	topology_read_sysfs();
+	if (nr_nodes)
+		return;
+	/* No NUMA information: a single node holding all the CPUs. */
+	nodes = zmalloc_or_die(sizeof(*nodes));
+	nr_nodes = 1;
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_cpus < 1)
+		nr_cpus = 1;
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		node_add_cpu(&nodes[0], (int) cpu);
+}
+
+static
+void topology_init(void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	(void) pthread_once(&once, topology_init_once);
+}
+
+unsigned int bench_nr_nodes(void)
+{
+	topology_init();
+	return nr_nodes;
+}
+
+int bench_node_id(unsigned int node)
+{
+	topology_init();
+	return nodes[node].id;
+}
+
+unsigned int bench_node_nr_cpus(unsigned int node)
+{
+	topology_init();
+	return nodes[node].nr_cpus;
+}
+
+int bench_node_cpu(unsigned int node, unsigned int i)
+{
+	topology_init();
+	return nodes[node].cpus[i % nodes[node].nr_cpus];
+}
+
+int bench_parse_placement(const char *policy)
+{
+	unsigned int i;
+
+	for (i = 0; i < CAA_ARRAY_SIZE(placement_name); i++) {
+		if (!strcmp(policy, placement_name[i])) {
+			bench_placement = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+void bench_placement_init(unsigned int nr_readers, unsigned int nr_writers)
+{
+	unsigned int i;
+
+	placement_nr_readers = nr_readers;
+	placement_nr_writers = nr_writers;
+	placed[BENCH_ROLE_READER] = 0;
+	placed[BENCH_ROLE_WRITER] = 0;
+	free(placed_node[BENCH_ROLE_READER]);
+	free(placed_node[BENCH_ROLE_WRITER]);
+	placed_node[BENCH_ROLE_READER] =
+		zmalloc_or_die((nr_readers + 1) * sizeof(int));
+	placed_node[BENCH_ROLE_WRITER] =
+		zmalloc_or_die((nr_writers + 1) * sizeof(int));
+	/* Threads not placed (yet) are on no node. */
+	for (i = 0; i < nr_readers; i++)
+		placed_node[BENCH_ROLE_READER][i] = -1;
+	for (i = 0; i < nr_writers; i++)
+		placed_node[BENCH_ROLE_WRITER][i] = -1;
+}
+
+/*
+ * Slot of a thread among all threads, in the order readers then
+ * writers, mapped to a node and a CPU of that node.
+ */
+static
+void placement_cpu(enum bench_role role, unsigned int index,
+		unsigned int *node, int *cpu)
+{
+	unsigned int slot, nr_slot_nodes, first_node = 0, n, i;
+
+	slot = index;
+	if (role == BENCH_ROLE_WRITER)
+		slot += placement_nr_readers;
+
+	switch (bench_placement) {
+	case BENCH_PLACEMENT_SCATTER:
+		*node = slot % nr_nodes;
+		*cpu = bench_node_cpu(*node, slot / nr_nodes);
+		return;
+	case BENCH_PLACEMENT_REMOTE_WRITERS:
+		/* Readers on all nodes but the last, writers on the last. */
+		if (nr_nodes > 1) {
+			slot = index;
+			if (role == BENCH_ROLE_WRITER) {
+				first_node = nr_nodes - 1;
+				nr_slot_nodes = 1;
+			} else {
+				nr_slot_nodes = nr_nodes - 1;
+			}
+			break;
+		}
+		/* Fall-through */
+	case BENCH_PLACEMENT_COMPACT:
+	default:
+		nr_slot_nodes = nr_nodes;
+		break;
+	}
+
+	/* Compact: fill the CPUs of each node in turn, wrapping around. */
+	n = 0;
+	for (i = 0; i < nr_slot_nodes; i++)
+		n += nodes[first_node + i].nr_cpus;
+	slot %= n;
+	for (i = first_node; slot >= nodes[i].nr_cpus; i++)
+		slot -= nodes[i].nr_cpus;
+	*node = i;
+	*cpu = nodes[i].cpus[slot];
+}
+
+int bench_place_thread(enum bench_role role)
+{
+	const char *role_name = role == BENCH_ROLE_READER ? "reader" : "writer";
+	unsigned int index, node;
+	int cpu;
+#if HAVE_SCHED_SETAFFINITY
+	cpu_set_t mask;
+#endif
+
+	if (bench_placement == BENCH_PLACEMENT_NONE)
+		return -1;
+	topology_init();
+	pthread_mutex_lock(&placement_lock);
+	index = placed[role]++;
+	placement_cpu(role, index, &node, &cpu);
+	if (placed_node[role] && index < (role == BENCH_ROLE_READER ?
+			placement_nr_readers : placement_nr_writers))
+		placed_node[role][index] = nodes[node].id;
+	pthread_mutex_unlock(&placement_lock);
+
+#if HAVE_SCHED_SETAFFINITY
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+#if SCHED_SETAFFINITY_ARGS == 2
+	sched_setaffinity(0, &mask);
+#else
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+#endif /* HAVE_SCHED_SETAFFINITY */
+	printf("placement %s: %s %u on cpu %d, node %d\n",
+		placement_name[bench_placement], role_name, index, cpu,
+		nodes[node].id);
+	return cpu;
+}
+
+/* Number of threads of a role on each node, e.g. "0:4;1:4". */
+static
+void placement_node_summary(enum bench_role role, unsigned int nr,
+		char *buf, size_t len)
+{
+	unsigned int i, j, count;
+	size_t pos = 0;
+
+	buf[0] = '\0';
+	for (i = 0; i < nr_nodes && pos < len; i++) {
+		count = 0;
+		for (j = 0; j < nr; j++) {
+			if (placed_node[role][j] == nodes[i].id)
+				count++;
+		}
+		if (!count)
+			continue;
+		pos += snprintf(buf + pos, len - pos, "%s%d:%u",
+			pos ? ";" : "", nodes[i].id, count);
+	}
+}
+
+void bench_report_placement(void)
+{
+	char buf[64];
+
+	bench_report_string("placement", placement_name[bench_placement]);
+	if (bench_placement == BENCH_PLACEMENT_NONE
+			|| !placed_node[BENCH_ROLE_READER])
+		return;
+	bench_report_u64("nr_nodes", nr_nodes);
+	placement_node_summary(BENCH_ROLE_READER, placement_nr_readers,
+		buf, sizeof(buf));
+	bench_report_string("reader_nodes", buf);
+	placement_node_summary(BENCH_ROLE_WRITER, placement_nr_writers,
+		buf, sizeof(buf));
+	bench_report_string("writer_nodes", buf);
+}
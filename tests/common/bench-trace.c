@@ -0,0 +1,167 @@
+/*
+ * bench-trace.c
+ *
+ * Userspace RCU library tests - Benchmark operation trace recording
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <urcu/compiler.h>
+#include <urcu/tls-compat.h>
+
+#include "bench.h"
+
+/* Records buffered by each thread between two writes to the file. */
+#define TRACE_BUF_RECORDS	4096
+
+struct trace_buf {
+	uint32_t thread;
+	unsigned int nr;
+	struct bench_trace_record rec[TRACE_BUF_RECORDS];
+};
+
+static const char *op_name[NR_BENCH_TRACE_OPS] = {
+	[BENCH_TRACE_LFHT_LOOKUP] = "lfht_lookup",
+	[BENCH_TRACE_LFHT_ADD] = "lfht_add",
+	[BENCH_TRACE_LFHT_ADD_UNIQUE] = "lfht_add_unique",
+	[BENCH_TRACE_LFHT_ADD_REPLACE] = "lfht_add_replace",
+	[BENCH_TRACE_LFHT_DEL] = "lfht_del",
+	[BENCH_TRACE_WFCQ_ENQUEUE] = "wfcq_enqueue",
+	[BENCH_TRACE_WFCQ_DEQUEUE] = "wfcq_dequeue",
+};
+
+int bench_trace;
+
+static FILE *trace_file;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t trace_start_ns;
+static uint32_t trace_nr_threads;
+
+static DEFINE_URCU_TLS(struct trace_buf *, trace_buf);
+
+/*
+ * CLOCK_MONOTONIC rather than caa_clock_ns(), which would make all the
+ * programs using this library depend on liburcu-common.
+ */
+static
+uint64_t trace_clock_ns(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+const char *bench_trace_op_name(enum bench_trace_op op)
+{
+	if (op >= NR_BENCH_TRACE_OPS)
+		return "unknown";
+	return op_name[op];
+}
+
+int bench_trace_open(const char *path)
+{
+	struct bench_trace_header header;
+
+	trace_file = fopen(path, "w");
+	if (!trace_file) {
+		perror(path);
+		return -1;
+	}
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BENCH_TRACE_MAGIC, sizeof(header.magic));
+	header.record_size = sizeof(struct bench_trace_record);
+	if (fwrite(&header, sizeof(header), 1, trace_file) != 1) {
+		perror(path);
+		fclose(trace_file);
+		trace_file = NULL;
+		return -1;
+	}
+	trace_start_ns = trace_clock_ns();
+	bench_trace = 1;
+	return 0;
+}
+
+static
+void trace_buf_write(struct trace_buf *buf)
+{
+	pthread_mutex_lock(&trace_lock);
+	if (trace_file && fwrite(buf->rec, sizeof(buf->rec[0]), buf->nr,
+			trace_file) != buf->nr) {
+		perror("trace write");
+		exit(-1);
+	}
+	pthread_mutex_unlock(&trace_lock);
+	buf->nr = 0;
+}
+
+void bench_trace_record_op(enum bench_trace_op op, uint64_t hash,
+		uint64_t key)
+{
+	struct trace_buf *buf = URCU_TLS(trace_buf);
+	struct bench_trace_record *rec;
+
+	if (caa_unlikely(!buf)) {
+		buf = malloc(sizeof(*buf));
+		if (!buf) {
+			perror("malloc");
+			exit(-1);
+		}
+		pthread_mutex_lock(&trace_lock);
+		buf->thread = trace_nr_threads++;
+		pthread_mutex_unlock(&trace_lock);
+		buf->nr = 0;
+		URCU_TLS(trace_buf) = buf;
+	}
+	rec = &buf->rec[buf->nr++];
+	rec->ns = trace_clock_ns() - trace_start_ns;
+	rec->hash = hash;
+	rec->key = key;
+	rec->thread = buf->thread;
+	rec->op = op;
+	if (buf->nr == TRACE_BUF_RECORDS)
+		trace_buf_write(buf);
+}
+
+void bench_trace_thread_end(void)
+{
+	struct trace_buf *buf = URCU_TLS(trace_buf);
+
+	if (!buf)
+		return;
+	trace_buf_write(buf);
+	free(buf);
+	URCU_TLS(trace_buf) = NULL;
+}
+
+void bench_trace_close(void)
+{
+	if (!trace_file)
+		return;
+	bench_trace_thread_end();
+	bench_trace = 0;
+	pthread_mutex_lock(&trace_lock);
+	if (fclose(trace_file))
+		perror("trace close");
+	trace_file = NULL;
+	pthread_mutex_unlock(&trace_lock);
+}
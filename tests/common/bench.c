@@ -0,0 +1,299 @@
+/*
+ * bench.c
+ *
+ * Userspace RCU library tests - Benchmark report and latency histogram
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define BENCH_REPORT_MAX	64
+
+struct bench_value {
+	const char *key;
+	char str[64];
+	int quote;	/* string value, quoted in JSON */
+};
+
+int bench_latency;
+
+static enum bench_format bench_format;
+static int bench_format_set;
+
+static struct {
+	char test[64];
+	unsigned int nr;
+	struct bench_value value[BENCH_REPORT_MAX];
+} report;
+
+static
+int bench_format_from_str(const char *str, enum bench_format *format)
+{
+	if (!strcmp(str, "text"))
+		*format = BENCH_FORMAT_TEXT;
+	else if (!strcmp(str, "json"))
+		*format = BENCH_FORMAT_JSON;
+	else if (!strcmp(str, "csv"))
+		*format = BENCH_FORMAT_CSV;
+	else
+		return -1;
+	return 0;
+}
+
+int bench_parse_option(const char *arg)
+{
+	enum bench_format format;
+
+	if (!strcmp(arg, "--latency")) {
+		bench_latency = 1;
+		return 1;
+	}
+	if (!strcmp(arg, "--perf")) {
+		/* Before the benchmark threads are created. */
+		bench_perf = 1;
+		bench_perf_open();
+		return 1;
+	}
+	if (!strcmp(arg, "--call-rcu-per-node")) {
+		bench_call_rcu_per_node = 1;
+		return 1;
+	}
+	if (!strncmp(arg, "--placement=", strlen("--placement="))) {
+		if (bench_parse_placement(arg + strlen("--placement="))) {
+			fprintf(stderr, "Unknown placement policy: %s\n", arg);
+			exit(-1);
+		}
+		return 1;
+	}
+	if (!strncmp(arg, "--record=", strlen("--record="))) {
+		if (bench_trace_open(arg + strlen("--record=")))
+			exit(-1);
+		return 1;
+	}
+	if (strncmp(arg, "--format=", strlen("--format=")))
+		return 0;
+	if (bench_format_from_str(arg + strlen("--format="), &format)) {
+		fprintf(stderr, "Unknown benchmark format: %s\n", arg);
+		exit(-1);
+	}
+	bench_format = format;
+	bench_format_set = 1;
+	return 1;
+}
+
+enum bench_format bench_get_format(void)
+{
+	const char *env;
+
+	if (bench_format_set)
+		return bench_format;
+	env = getenv("URCU_BENCH_FORMAT");
+	if (env && bench_format_from_str(env, &bench_format))
+		fprintf(stderr, "Unknown URCU_BENCH_FORMAT: %s\n", env);
+	bench_format_set = 1;
+	return bench_format;
+}
+
+void bench_hist_merge(struct bench_hist *dst, const struct bench_hist *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < BENCH_HIST_BUCKETS; i++)
+		dst->bucket[i] += src->bucket[i];
+	dst->count += src->count;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+/* Largest value counted by bucket i. */
+static
+uint64_t bench_hist_bucket_max(unsigned int i)
+{
+	unsigned int shift;
+
+	if (i < BENCH_HIST_SUB)
+		return i;
+	shift = i / BENCH_HIST_SUB - 1;
+	return (((uint64_t) BENCH_HIST_SUB + i % BENCH_HIST_SUB) << shift)
+		+ ((1ULL << shift) - 1);
+}
+
+uint64_t bench_hist_percentile(const struct bench_hist *hist, double p)
+{
+	unsigned long long rank, sum = 0;
+	unsigned int i;
+	uint64_t value;
+
+	if (!hist->count)
+		return 0;
+	rank = (unsigned long long) ((double) hist->count * p / 100.0);
+	if (rank >= hist->count)
+		rank = hist->count - 1;
+	for (i = 0; i < BENCH_HIST_BUCKETS - 1; i++) {
+		sum += hist->bucket[i];
+		if (sum > rank)
+			break;
+	}
+	value = bench_hist_bucket_max(i);
+	return value > hist->max ? hist->max : value;
+}
+
+void bench_hist_print(const struct bench_hist *hist, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf(": count %llu p50 %llu p90 %llu p99 %llu p999 %llu max %llu ns\n",
+		hist->count,
+		(unsigned long long) bench_hist_percentile(hist, 50.0),
+		(unsigned long long) bench_hist_percentile(hist, 90.0),
+		(unsigned long long) bench_hist_percentile(hist, 99.0),
+		(unsigned long long) bench_hist_percentile(hist, 99.9),
+		(unsigned long long) hist->max);
+}
+
+static
+struct bench_value *bench_report_add(const char *key)
+{
+	if (report.nr == BENCH_REPORT_MAX) {
+		fprintf(stderr, "Too many benchmark report values\n");
+		exit(-1);
+	}
+	report.value[report.nr].key = key;
+	report.value[report.nr].quote = 0;
+	return &report.value[report.nr++];
+}
+
+void bench_report_begin(const char *test)
+{
+	const char *name = strrchr(test, '/');
+
+	/* Strip the directory, e.g. the libtool .libs/ */
+	name = name ? name + 1 : test;
+	strncpy(report.test, name, sizeof(report.test) - 1);
+	report.test[sizeof(report.test) - 1] = '\0';
+	report.nr = 0;
+}
+
+void bench_report_u64(const char *key, unsigned long long value)
+{
+	snprintf(bench_report_add(key)->str, sizeof(report.value[0].str),
+		"%llu", value);
+}
+
+void bench_report_double(const char *key, double value)
+{
+	snprintf(bench_report_add(key)->str, sizeof(report.value[0].str),
+		"%.1f", value);
+}
+
+void bench_report_string(const char *key, const char *value)
+{
+	struct bench_value *v = bench_report_add(key);
+
+	snprintf(v->str, sizeof(v->str), "%s", value);
+	v->quote = 1;
+}
+
+/* Key names live until exit, as the report is printed once. */
+static
+void bench_report_hist_value(const char *key, const char *suffix,
+		unsigned long long value)
+{
+	char *name;
+
+	name = malloc(strlen(key) + strlen(suffix) + 2);
+	if (!name) {
+		perror("malloc");
+		exit(-1);
+	}
+	sprintf(name, "%s_%s", key, suffix);
+	bench_report_u64(name, value);
+}
+
+void bench_report_hist(const char *key, const struct bench_hist *hist)
+{
+	bench_report_hist_value(key, "count", hist->count);
+	bench_report_hist_value(key, "p50_ns",
+		bench_hist_percentile(hist, 50.0));
+	bench_report_hist_value(key, "p90_ns",
+		bench_hist_percentile(hist, 90.0));
+	bench_report_hist_value(key, "p99_ns",
+		bench_hist_percentile(hist, 99.0));
+	bench_report_hist_value(key, "p999_ns",
+		bench_hist_percentile(hist, 99.9));
+	bench_report_hist_value(key, "max_ns", hist->max);
+}
+
+/*
+ * Successive CSV reports of a program with the same keys only print
+ * the header line once.
+ */
+static
+int bench_csv_same_header(void)
+{
+	static char prev[BENCH_REPORT_MAX * 32];
+	char header[sizeof(prev)];
+	size_t len = 0;
+	unsigned int i;
+
+	header[0] = '\0';
+	for (i = 0; i < report.nr && len < sizeof(header); i++)
+		len += snprintf(header + len, sizeof(header) - len, ",%s",
+			report.value[i].key);
+	if (prev[0] && !strcmp(header, prev))
+		return 1;
+	strcpy(prev, header);
+	return 0;
+}
+
+void bench_report_end(void)
+{
+	unsigned int i;
+
+	switch (bench_get_format()) {
+	case BENCH_FORMAT_TEXT:
+		break;
+	case BENCH_FORMAT_JSON:
+		printf("{\"test\": \"%s\"", report.test);
+		for (i = 0; i < report.nr; i++)
+			printf(report.value[i].quote ? ", \"%s\": \"%s\""
+					: ", \"%s\": %s",
+				report.value[i].key, report.value[i].str);
+		printf("}\n");
+		break;
+	case BENCH_FORMAT_CSV:
+		if (!bench_csv_same_header()) {
+			printf("test");
+			for (i = 0; i < report.nr; i++)
+				printf(",%s", report.value[i].key);
+			printf("\n");
+		}
+		printf("%s", report.test);
+		for (i = 0; i < report.nr; i++)
+			printf(",%s", report.value[i].str);
+		printf("\n");
+		break;
+	}
+	fflush(stdout);
+}
@@ -0,0 +1,277 @@
+#ifndef URCU_TESTS_BENCH_H
+#define URCU_TESTS_BENCH_H
+
+/*
+ * bench.h
+ *
+ * Userspace RCU library tests - Benchmark report and latency histogram
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * The benchmarks take the same positional arguments (thread counts,
+ * then duration in seconds) and the same -a cpu# option for affinity.
+ * Besides their text output, they describe each run with a report of
+ * key/value pairs, printed as a single JSON object or as CSV header
+ * and values lines, selected with the --format=json|csv option or the
+ * URCU_BENCH_FORMAT environment variable. The text format (default)
+ * prints no report. --latency enables the latency histograms which
+ * are not always sampled.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum bench_format {
+	BENCH_FORMAT_TEXT = 0,
+	BENCH_FORMAT_JSON,
+	BENCH_FORMAT_CSV,
+};
+
+/*
+ * Latency histogram, in nanoseconds, log-bucketed in the manner of HDR
+ * histograms: each power of two range [2^n, 2^(n+1)) is split in
+ * 2^BENCH_HIST_SUB_BITS linear sub-buckets, so the value reported for
+ * a percentile is within 1/2^BENCH_HIST_SUB_BITS (6%) of the samples,
+ * whatever their magnitude. Values below 2^BENCH_HIST_SUB_BITS have a
+ * bucket each.
+ */
+#define BENCH_HIST_SUB_BITS	4
+#define BENCH_HIST_SUB		(1U << BENCH_HIST_SUB_BITS)
+#define BENCH_HIST_BUCKETS	((64 - BENCH_HIST_SUB_BITS + 1) * BENCH_HIST_SUB)
+
+struct bench_hist {
+	unsigned long long bucket[BENCH_HIST_BUCKETS];
+	unsigned long long count;
+	uint64_t max;
+};
+
+static inline
+unsigned int bench_hist_index(uint64_t ns)
+{
+	unsigned int order;
+
+	if (ns < BENCH_HIST_SUB)
+		return ns;
+	order = 63 - __builtin_clzll(ns);
+	return (order - BENCH_HIST_SUB_BITS + 1) * BENCH_HIST_SUB
+		+ ((ns >> (order - BENCH_HIST_SUB_BITS)) & (BENCH_HIST_SUB - 1));
+}
+
+static inline
+void bench_hist_record(struct bench_hist *hist, uint64_t ns)
+{
+	hist->bucket[bench_hist_index(ns)]++;
+	hist->count++;
+	if (ns > hist->max)
+		hist->max = ns;
+}
+
+extern void bench_hist_merge(struct bench_hist *dst,
+		const struct bench_hist *src);
+
+/*
+ * bench_hist_percentile: upper bound of the bucket holding percentile
+ * p (0 to 100) of the samples, capped to the largest sample.
+ */
+extern uint64_t bench_hist_percentile(const struct bench_hist *hist,
+		double p);
+
+/*
+ * bench_hist_print: print the number of samples and the percentiles of
+ * hist on one line of text, prefixed by the printf-style fmt.
+ */
+extern void bench_hist_print(const struct bench_hist *hist,
+		const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/*
+ * bench_parse_option: handle the benchmark options common to all
+ * programs. Returns 1 if arg is one of them, 0 otherwise.
+ */
+extern int bench_parse_option(const char *arg);
+
+/*
+ * bench_latency: set by the --latency option. The latency of the
+ * operations cheap enough for timing to perturb the benchmark (e.g.
+ * read-side critical sections) is only sampled when set, and the
+ * percentiles of each thread are printed.
+ */
+extern int bench_latency;
+
+extern enum bench_format bench_get_format(void);
+
+/*
+ * Hardware performance counters, selected with the --perf option:
+ * cycles, instructions, last level cache read misses and, with the raw
+ * PMU event counting loads hitting a modified line in a remote cache
+ * given in URCU_BENCH_PERF_HITM (e.g. 0x04d3 for Intel Skylake server
+ * MEM_LOAD_L3_MISS_RETIRED.REMOTE_HITM), cross-socket HITM. The
+ * counters are opened when the option is parsed, and are inherited by
+ * all threads created afterwards, including call_rcu and resize
+ * workers. They count between bench_perf_start() and bench_perf_stop(),
+ * called by the programs around the measured interval, and
+ * bench_report_perf() reports them divided by the number of
+ * operations, counted by all threads (e.g. reads and updates). Counters the PMU lacks are left out of the report.
+ */
+extern int bench_perf;
+
+extern void bench_perf_open(void);
+extern void bench_perf_start(void);
+extern void bench_perf_stop(void);
+extern void bench_report_perf(unsigned long long nr_ops);
+
+/*
+ * bench_perf_print: print the counters divided by nr_ops on one line of
+ * text, prefixed by the printf-style fmt, for programs reporting
+ * several measurements at once.
+ */
+extern void bench_perf_print(unsigned long long nr_ops, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/*
+ * Report of a run: bench_report_begin(), then one call per value, then
+ * bench_report_end() to print it in the selected format. A program may
+ * print several reports: the CSV header line is only repeated when the
+ * keys change.
+ */
+extern void bench_report_begin(const char *test);
+extern void bench_report_u64(const char *key, unsigned long long value);
+extern void bench_report_double(const char *key, double value);
+extern void bench_report_string(const char *key, const char *value);
+
+/*
+ * bench_report_hist: report the number of samples, the 50th, 90th,
+ * 99th and 99.9th percentiles and the maximum of hist, as key_count,
+ * key_p50_ns, ..., key_max_ns.
+ */
+extern void bench_report_hist(const char *key, const struct bench_hist *hist);
+extern void bench_report_end(void);
+
+/*
+ * Operation traces, recorded with the --record=FILE option by the
+ * programs calling bench_trace_record() (test_urcu_hash rw test and
+ * test_urcu_wfcq), and replayed by test_urcu_replay. The file is a
+ * header followed by fixed-size records in host byte order. Each thread
+ * buffers its records, in order, and appends them to the file when its
+ * buffer is full and at bench_trace_thread_end(): records of a thread
+ * are in order in the file, but interleaved with the other threads by
+ * blocks. Timestamps are from CLOCK_MONOTONIC, in ns relative to the
+ * opening of the trace.
+ */
+#define BENCH_TRACE_MAGIC	"URCUTRC1"
+
+enum bench_trace_op {
+	BENCH_TRACE_LFHT_LOOKUP = 0,
+	BENCH_TRACE_LFHT_ADD,
+	BENCH_TRACE_LFHT_ADD_UNIQUE,
+	BENCH_TRACE_LFHT_ADD_REPLACE,
+	BENCH_TRACE_LFHT_DEL,
+	BENCH_TRACE_WFCQ_ENQUEUE,
+	BENCH_TRACE_WFCQ_DEQUEUE,
+	NR_BENCH_TRACE_OPS,
+};
+
+struct bench_trace_header {
+	char magic[8];
+	uint32_t record_size;
+	uint32_t reserved;
+};
+
+struct bench_trace_record {
+	uint64_t ns;
+	uint64_t hash;
+	uint64_t key;
+	uint32_t thread;	/* in order of first record */
+	uint32_t op;		/* enum bench_trace_op */
+};
+
+extern int bench_trace;		/* set while recording */
+
+extern int bench_trace_open(const char *path);
+extern void bench_trace_record_op(enum bench_trace_op op, uint64_t hash,
+		uint64_t key);
+/* Write the records of the current thread, before it exits. */
+extern void bench_trace_thread_end(void);
+/* Write the records of the current thread and close the trace. */
+extern void bench_trace_close(void);
+extern const char *bench_trace_op_name(enum bench_trace_op op);
+
+static inline
+void bench_trace_record(enum bench_trace_op op, uint64_t hash, uint64_t key)
+{
+	if (__builtin_expect(bench_trace, 0))
+		bench_trace_record_op(op, hash, key);
+}
+
+/*
+ * Thread placement on the NUMA nodes (from /sys/devices/system/node,
+ * a single node otherwise), selected with --placement=policy:
+ *
+ * compact: threads fill the CPUs of the first node, then of the next.
+ * scatter: threads are spread round-robin over the nodes.
+ * remote-writers: readers fill the CPUs of all nodes but the last, and
+ *                 writers the CPUs of the last node (compact with a
+ *                 single node).
+ *
+ * Threads are numbered readers first, then writers. With
+ * --call-rcu-per-node, programs using call_rcu create one call_rcu
+ * worker thread per node (create_all_node_call_rcu_data()).
+ */
+enum bench_placement {
+	BENCH_PLACEMENT_NONE = 0,
+	BENCH_PLACEMENT_COMPACT,
+	BENCH_PLACEMENT_SCATTER,
+	BENCH_PLACEMENT_REMOTE_WRITERS,
+};
+
+enum bench_role {
+	BENCH_ROLE_READER = 0,
+	BENCH_ROLE_WRITER,
+};
+
+extern enum bench_placement bench_placement;
+extern int bench_call_rcu_per_node;
+
+extern int bench_parse_placement(const char *policy);
+
+/* Topology: nodes are numbered 0 to bench_nr_nodes() - 1 here. */
+extern unsigned int bench_nr_nodes(void);
+extern int bench_node_id(unsigned int node);	/* system node number */
+extern unsigned int bench_node_nr_cpus(unsigned int node);
+extern int bench_node_cpu(unsigned int node, unsigned int i);
+
+/*
+ * bench_placement_init: number of reader and writer threads the
+ * policy places, to call before creating them.
+ */
+extern void bench_placement_init(unsigned int nr_readers,
+		unsigned int nr_writers);
+
+/*
+ * bench_place_thread: bind the current thread to the CPU the placement
+ * policy gives to the next thread of this role, and print it with its
+ * node. Returns the CPU, or -1 without placement policy.
+ */
+extern int bench_place_thread(enum bench_role role);
+
+/*
+ * bench_report_placement: report the placement policy, and the number
+ * of reader and writer threads on each node, e.g. "0:4;1:4".
+ */
+extern void bench_report_placement(void);
+
+#endif /* URCU_TESTS_BENCH_H */
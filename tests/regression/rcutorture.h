@@ -27,12 +27,28 @@
  * lists the average duration of each type of operation in nanoseconds,
  * or "nan" if the corresponding type of operation was not performed.
  *
+ * 	./rcu <nreaders> gpperf [ <cpustride> [ <baseline> [ <regression> ] ] ]
+ * 		Run readers, one updater and call_rcu() users together,
+ * 		and print read and update costs, and grace-period and
+ * 		callback latency percentiles, as "gpperf" lines.  Exit
+ * 		non-zero if one of them is more than <regression> percent
+ * 		(default 20) above its value in the <baseline> file, the
+ * 		output of a previous run.
+ *
  * 	./rcu <nreaders> stress
  * 		Run a stress test with the specified number of readers and
  * 		one updater.  None of the threads are affinitied to any
  * 		particular CPU.
  *
- * This test produces output as follows:
+ * 	./rcu <nupdaters> gpstress
+ * 		Run a grace-period stress test with the specified number
+ * 		of updaters, each publishing its own element and waiting
+ * 		for a grace period with synchronize_rcu() or
+ * 		synchronize_rcu_expedited() before poisoning the previous
+ * 		one, while readers check they never see a poisoned element.
+ * 		Exit non-zero if an updater stays stuck in a grace period.
+ *
+ * The stress test produces output as follows:
  *
  * n_reads: 114633217  n_updates: 3903415  n_mberror: 0
  * rcu_stress_count: 114618391 14826 0 0 0 0 0 0 0 0 0
@@ -162,6 +178,10 @@ void *rcu_update_perf_test(void *arg)
 		if (crdp != NULL) {
 			fprintf(stderr,
 				"Using per-thread call_rcu() worker.\n");
+			if ((random() & 0x1000)
+					&& !call_rcu_data_create_pool(crdp, 2))
+				fprintf(stderr,
+					"Using call_rcu() worker pool.\n");
 			set_thread_call_rcu_data(crdp);
 		}
 	}
@@ -259,6 +279,204 @@ void uperftest(int nupdaters, int cpustride)
 	perftestrun(i, 0, nupdaters);
 }
 
+/*
+ * Grace-period performance test: readers, one updater timing
+ * synchronize_rcu() and GPPERF_CALLERS threads timing call_rcu() from
+ * enqueue to callback invocation, all together. The results are
+ * printed as "gpperf <flavor> <metric> <value>" lines, each metric
+ * being lower for better performance, so that the output of one run
+ * can be stored as the baseline file of the next runs, which then fail
+ * if a metric of their flavor exceeds its baseline by more than the
+ * allowed regression (percents). The baseline file may hold the lines
+ * of all flavors.
+ */
+
+#define GPPERF_DURATION		5	/* seconds */
+#define GPPERF_CALLERS		2
+#define GPPERF_MAX_OUTSTANDING	1000	/* callbacks per call_rcu thread */
+#define GPPERF_REGRESSION	20	/* percents */
+
+struct gpperf_head {
+	struct rcu_head head;
+	uint64_t enqueue_ns;
+	long *outstanding;
+};
+
+static struct bench_hist gpperf_gp_hist, gpperf_cb_hist;
+static pthread_mutex_t gpperf_cb_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t gpperf_now_ns(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void *rcu_update_gpperf_test(void *arg)
+{
+	long long n_updates_local = 0;
+	uint64_t begin;
+
+	run_on((long)arg);
+	uatomic_inc(&nthreadsrunning);
+	while (goflag == GOFLAG_INIT)
+		poll(NULL, 0, 1);
+	while (goflag == GOFLAG_RUN) {
+		begin = gpperf_now_ns();
+		synchronize_rcu();
+		bench_hist_record(&gpperf_gp_hist, gpperf_now_ns() - begin);
+		n_updates_local++;
+	}
+	__get_thread_var(n_updates_pt) += n_updates_local;
+	return NULL;
+}
+
+void rcu_gpperf_cb(struct rcu_head *head)
+{
+	struct gpperf_head *p = caa_container_of(head, struct gpperf_head,
+			head);
+	uint64_t ns = gpperf_now_ns() - p->enqueue_ns;
+
+	if (pthread_mutex_lock(&gpperf_cb_mutex) != 0) {
+		perror("pthread_mutex_lock");
+		exit(-1);
+	}
+	bench_hist_record(&gpperf_cb_hist, ns);
+	if (pthread_mutex_unlock(&gpperf_cb_mutex) != 0) {
+		perror("pthread_mutex_unlock");
+		exit(-1);
+	}
+	uatomic_dec(p->outstanding);
+	free(p);
+}
+
+void *rcu_call_rcu_gpperf_test(void *arg)
+{
+	long outstanding = 0;
+	struct gpperf_head *p;
+
+	run_on((long)arg);
+	uatomic_inc(&nthreadsrunning);
+	while (goflag == GOFLAG_INIT)
+		poll(NULL, 0, 1);
+	while (goflag == GOFLAG_RUN) {
+		/* Bound the callbacks queued when they lag behind. */
+		if (uatomic_read(&outstanding) >= GPPERF_MAX_OUTSTANDING) {
+			poll(NULL, 0, 1);
+			continue;
+		}
+		p = malloc(sizeof(*p));
+		if (!p) {
+			perror("malloc");
+			exit(-1);
+		}
+		p->outstanding = &outstanding;
+		uatomic_inc(&outstanding);
+		p->enqueue_ns = gpperf_now_ns();
+		call_rcu(&p->head, rcu_gpperf_cb);
+	}
+	/* The callbacks reference the counter on the stack. */
+	while (uatomic_read(&outstanding))
+		poll(NULL, 0, 1);
+	return NULL;
+}
+
+/*
+ * Returns the number of metrics of the flavor exceeding their baseline
+ * by more than regression percents.
+ */
+int gpperf_check_baseline(const char *path, const char *metric[],
+		double value[], int nr_metrics, double regression)
+{
+	char line[256], flavor[32], name[32];
+	int i, nr_regressions = 0, nr_found = 0;
+	double base;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		perror(path);
+		exit(-1);
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "gpperf %31s %31s %lf", flavor, name, &base) != 3
+				|| strcmp(flavor, TORTURE_FLAVOR))
+			continue;
+		for (i = 0; i < nr_metrics; i++) {
+			if (strcmp(name, metric[i]))
+				continue;
+			nr_found++;
+			if (value[i] > base * (1.0 + regression / 100.0)) {
+				printf("REGRESSION %s %s: %g, baseline %g (+%.1f%%)\n",
+					TORTURE_FLAVOR, metric[i], value[i], base,
+					base ? (value[i] / base - 1.0) * 100.0 : 0.0);
+				nr_regressions++;
+			}
+		}
+	}
+	fclose(fp);
+	if (!nr_found)
+		fprintf(stderr, "No %s baseline in %s\n", TORTURE_FLAVOR, path);
+	return nr_regressions;
+}
+
+void gpperftest(int nreaders, int cpustride, const char *baseline,
+		double regression)
+{
+	const char *metric[] = {
+		"ns_per_read", "ns_per_update",
+		"gp_p50_ns", "gp_p99_ns", "cb_p50_ns", "cb_p99_ns",
+	};
+	double value[CAA_ARRAY_SIZE(metric)];
+	int duration = GPPERF_DURATION;
+	int i, t, nthreads = 0;
+
+	perftestinit();
+	for (i = 0; i < nreaders; i++)
+		create_thread(rcu_read_perf_test,
+			(void *)(long)(nthreads++ * cpustride));
+	create_thread(rcu_update_gpperf_test,
+		(void *)(long)(nthreads++ * cpustride));
+	for (i = 0; i < GPPERF_CALLERS; i++)
+		create_thread(rcu_call_rcu_gpperf_test,
+			(void *)(long)(nthreads++ * cpustride));
+	cmm_smp_mb();
+	while (uatomic_read(&nthreadsrunning) < nthreads)
+		poll(NULL, 0, 1);
+	goflag = GOFLAG_RUN;
+	cmm_smp_mb();
+	sleep(duration);
+	cmm_smp_mb();
+	goflag = GOFLAG_STOP;
+	cmm_smp_mb();
+	wait_all_threads();
+	for_each_thread(t) {
+		n_reads += per_thread(n_reads_pt, t);
+		n_updates += per_thread(n_updates_pt, t);
+	}
+	printf("n_reads: %lld  n_updates: %ld  nreaders: %d  nupdaters: 1  ncallers: %d duration: %d\n",
+	       n_reads, n_updates, nreaders, GPPERF_CALLERS, duration);
+	bench_hist_print(&gpperf_gp_hist, "synchronize_rcu latency");
+	bench_hist_print(&gpperf_cb_hist, "call_rcu callback latency");
+	value[0] = n_reads ? duration * 1e9 * nreaders / n_reads : 0;
+	value[1] = n_updates ? duration * 1e9 / n_updates : 0;
+	value[2] = bench_hist_percentile(&gpperf_gp_hist, 50.0);
+	value[3] = bench_hist_percentile(&gpperf_gp_hist, 99.0);
+	value[4] = bench_hist_percentile(&gpperf_cb_hist, 50.0);
+	value[5] = bench_hist_percentile(&gpperf_cb_hist, 99.0);
+	for (i = 0; i < CAA_ARRAY_SIZE(metric); i++)
+		printf("gpperf %s %s %.3f\n", TORTURE_FLAVOR, metric[i], value[i]);
+	if (get_cpu_call_rcu_data(0)) {
+		fprintf(stderr, "Deallocating per-CPU call_rcu threads.\n");
+		free_all_cpu_call_rcu_data();
+	}
+	if (baseline && gpperf_check_baseline(baseline, metric, value,
+			CAA_ARRAY_SIZE(metric), regression))
+		exit(1);
+	exit(0);
+}
+
 /*
  * Stress test.
  */
@@ -453,6 +671,141 @@ void stresstest(int nreaders)
 	exit(0);
 }
 
+/*
+ * Grace-period stress test: many concurrent updaters, so that grace
+ * period leaders and their waiters are batched together, with readers
+ * checking that no grace period completes early.
+ */
+
+#define GPSTRESS_READERS	2
+#define GPSTRESS_DURATION	10	/* seconds */
+#define GPSTRESS_TIMEOUT	30	/* seconds */
+#define GPSTRESS_POISON		0
+#define GPSTRESS_ALIVE		1
+
+struct gpstress_elem {
+	int state;
+};
+
+struct gpstress_elem *gpstress_slot[NR_THREADS];
+struct gpstress_elem gpstress_elem[NR_THREADS][2];
+int gpstress_nupdaters;
+int gpstress_errors;
+int gpstress_done;
+
+void *rcu_read_gpstress_test(void *arg)
+{
+	struct gpstress_elem *p;
+	unsigned int seed = (unsigned int)(long)arg;
+	int itercnt = 0;
+
+	rcu_register_thread();
+	uatomic_inc(&nthreadsrunning);
+	put_thread_offline();
+	while (goflag == GOFLAG_INIT)
+		poll(NULL, 0, 1);
+	put_thread_online();
+	while (goflag == GOFLAG_RUN) {
+		rcu_read_lock();
+		p = rcu_dereference(gpstress_slot[rand_r(&seed)
+				% gpstress_nupdaters]);
+		if (CMM_LOAD_SHARED(p->state) != GPSTRESS_ALIVE)
+			uatomic_inc(&gpstress_errors);
+		caa_cpu_relax();
+		if (CMM_LOAD_SHARED(p->state) != GPSTRESS_ALIVE)
+			uatomic_inc(&gpstress_errors);
+		rcu_read_unlock();
+		__get_thread_var(n_reads_pt)++;
+		mark_rcu_quiescent_state();
+		if ((++itercnt % 0x1000) == 0) {
+			put_thread_offline();
+			put_thread_online();
+		}
+	}
+	put_thread_offline();
+	rcu_unregister_thread();
+	uatomic_inc(&gpstress_done);
+	return NULL;
+}
+
+void *rcu_update_gpstress_test(void *arg)
+{
+	long me = (long)arg;
+	long long n_updates_local = 0;
+	struct gpstress_elem *old, *p;
+
+	uatomic_inc(&nthreadsrunning);
+	while (goflag == GOFLAG_INIT)
+		poll(NULL, 0, 1);
+	while (goflag == GOFLAG_RUN) {
+		old = gpstress_slot[me];
+		p = &gpstress_elem[me][old == &gpstress_elem[me][0]];
+		CMM_STORE_SHARED(p->state, GPSTRESS_ALIVE);
+		rcu_assign_pointer(gpstress_slot[me], p);
+		if ((n_updates_local & 0x7) == 0x7)
+			synchronize_rcu_expedited();
+		else
+			synchronize_rcu();
+		CMM_STORE_SHARED(old->state, GPSTRESS_POISON);
+		n_updates_local++;
+	}
+	__get_thread_var(n_updates_pt) += n_updates_local;
+	uatomic_inc(&gpstress_done);
+	return NULL;
+}
+
+void gpstresstest(int nupdaters)
+{
+	int i, t, nthreads = 0;
+
+	if (nupdaters < 1 || nupdaters > NR_THREADS - GPSTRESS_READERS - 1) {
+		fprintf(stderr, "gpstress: 1 to %d updaters\n",
+			NR_THREADS - GPSTRESS_READERS - 1);
+		exit(-1);
+	}
+	perftestinit();
+	gpstress_nupdaters = nupdaters;
+	for (i = 0; i < nupdaters; i++) {
+		gpstress_elem[i][0].state = GPSTRESS_ALIVE;
+		gpstress_slot[i] = &gpstress_elem[i][0];
+	}
+	for (i = 0; i < GPSTRESS_READERS; i++, nthreads++)
+		create_thread(rcu_read_gpstress_test, (void *)(long)i);
+	for (i = 0; i < nupdaters; i++, nthreads++)
+		create_thread(rcu_update_gpstress_test, (void *)(long)i);
+	cmm_smp_mb();
+	while (uatomic_read(&nthreadsrunning) < nthreads)
+		poll(NULL, 0, 1);
+	goflag = GOFLAG_RUN;
+	cmm_smp_mb();
+	sleep(GPSTRESS_DURATION);
+	cmm_smp_mb();
+	goflag = GOFLAG_STOP;
+	cmm_smp_mb();
+	/* A lost grace period completion leaves its updater stuck. */
+	for (i = 0; uatomic_read(&gpstress_done) < nthreads; i++) {
+		if (i == GPSTRESS_TIMEOUT * 10) {
+			printf("gpstress: %d threads stuck after %d seconds\n",
+				nthreads - uatomic_read(&gpstress_done),
+				GPSTRESS_TIMEOUT);
+			exit(1);
+		}
+		poll(NULL, 0, 100);
+	}
+	wait_all_threads();
+	for_each_thread(t) {
+		n_reads += per_thread(n_reads_pt, t);
+		n_updates += per_thread(n_updates_pt, t);
+	}
+	printf("n_reads: %lld  n_updates: %ld  nupdaters: %d  n_poisoned: %d\n",
+	       n_reads, n_updates, nupdaters, gpstress_errors);
+	if (get_cpu_call_rcu_data(0)) {
+		fprintf(stderr, "Deallocating per-CPU call_rcu threads.\n");
+		free_all_cpu_call_rcu_data();
+	}
+	exit(gpstress_errors ? 1 : 0);
+}
+
 /*
  * Mainprogram.
  */
@@ -460,6 +813,9 @@ void stresstest(int nreaders)
 void usage(int argc, char *argv[])
 {
 	fprintf(stderr, "Usage: %s [nreaders [ perf | stress ] ]\n", argv[0]);
+	fprintf(stderr, "       %s nupdaters gpstress\n", argv[0]);
+	fprintf(stderr, "       %s nreaders gpperf [ cpustride [ baseline [ regression%% ] ] ]\n",
+		argv[0]);
 	exit(-1);
 }
 
@@ -471,9 +827,22 @@ int main(int argc, char *argv[])
 	smp_init();
 	//rcu_init();
 	srandom(time(NULL));
-	if (random() & 0x100) {
+	/* Keep the call_rcu setup of performance baselines reproducible. */
+	if (argc > 2 && !strcmp(argv[2], "gpperf"))
+		;
+	else if (random() & 0x100) {
+		unsigned long flags = 0;
+
+		if (random() & 0x200) {
+			fprintf(stderr, "Sharing call_rcu grace periods.\n");
+			flags |= URCU_CALL_RCU_SHARED_GP;
+		}
+		if (random() & 0x400) {
+			fprintf(stderr, "Using adaptive call_rcu threads.\n");
+			flags |= URCU_CALL_RCU_ADAPTIVE;
+		}
 		fprintf(stderr, "Allocating per-CPU call_rcu threads.\n");
-		if (create_all_cpu_call_rcu_data(0))
+		if (create_all_cpu_call_rcu_data(flags))
 			perror("create_all_cpu_call_rcu_data");
 	}
 
@@ -496,6 +865,13 @@ int main(int argc, char *argv[])
 			uperftest(nreaders, cpustride);
 		else if (strcmp(argv[2], "stress") == 0)
 			stresstest(nreaders);
+		else if (strcmp(argv[2], "gpstress") == 0)
+			gpstresstest(nreaders);
+		else if (strcmp(argv[2], "gpperf") == 0)
+			gpperftest(nreaders, cpustride,
+				argc > 4 ? argv[4] : NULL,
+				argc > 5 ? strtod(argv[5], NULL)
+					: GPPERF_REGRESSION);
 		usage(argc, argv);
 	}
 	perftest(nreaders, cpustride);
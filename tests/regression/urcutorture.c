@@ -1,6 +1,7 @@
 #define _GNU_SOURCE
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
 #include <poll.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -11,20 +12,30 @@
 
 #ifdef RCU_MEMBARRIER
 #include <urcu.h>
+#define TORTURE_FLAVOR "memb"
 #endif
 #ifdef RCU_SIGNAL
 #include <urcu.h>
+#define TORTURE_FLAVOR "signal"
 #endif
 #ifdef RCU_MB
 #include <urcu.h>
+#define TORTURE_FLAVOR "mb"
 #endif
 #ifdef RCU_QSBR
 #include <urcu-qsbr.h>
+#define TORTURE_FLAVOR "qsbr"
 #endif
 #ifdef RCU_BP
 #include <urcu-bp.h>
+#define TORTURE_FLAVOR "bp"
+#endif
+#ifdef RCU_PERCPU
+#include <urcu-percpu.h>
+#define TORTURE_FLAVOR "percpu"
 #endif
 
 #include <urcu/uatomic.h>
 #include <urcu/rculist.h>
+#include "bench.h"
 #include "rcutorture.h"
@@ -22,6 +22,8 @@
 
 #include <stdio.h>
 #include <assert.h>
+#include <pthread.h>
+#include <time.h>
 #include <urcu/uatomic.h>
 
 struct testvals {
@@ -75,6 +77,58 @@ do {						\
 	assert(uatomic_read(ptr) == 1);		\
 } while (0)
 
+/*
+ * Contended read-modify-write operations: each thread increments the
+ * same counter with add_return, xchg and cmpxchg loops. These are the
+ * operations which are single LSE instructions on ARMv8.1.
+ */
+#define NR_CONTEND_THREADS	4
+#define NR_CONTEND_LOOPS	100000
+
+static unsigned long contend_count;
+static unsigned long contend_token;
+
+static void *contend_thread(void *arg)
+{
+	unsigned long i, old;
+
+	for (i = 0; i < NR_CONTEND_LOOPS; i++) {
+		(void) uatomic_add_return(&contend_count, 1);
+		(void) uatomic_xchg(&contend_token, i);
+		do {
+			old = uatomic_read(&contend_count);
+		} while (uatomic_cmpxchg(&contend_count, old, old + 1) != old);
+	}
+	return NULL;
+}
+
+static void test_contended(void)
+{
+	pthread_t tid[NR_CONTEND_THREADS];
+	struct timespec begin, end;
+	unsigned long long nsec;
+	int i, ret;
+
+	ret = clock_gettime(CLOCK_MONOTONIC, &begin);
+	assert(!ret);
+	for (i = 0; i < NR_CONTEND_THREADS; i++) {
+		ret = pthread_create(&tid[i], NULL, contend_thread, NULL);
+		assert(!ret);
+	}
+	for (i = 0; i < NR_CONTEND_THREADS; i++) {
+		ret = pthread_join(tid[i], NULL);
+		assert(!ret);
+	}
+	ret = clock_gettime(CLOCK_MONOTONIC, &end);
+	assert(!ret);
+	assert(uatomic_read(&contend_count)
+		== 2UL * NR_CONTEND_THREADS * NR_CONTEND_LOOPS);
+	nsec = (end.tv_sec - begin.tv_sec) * 1000000000ULL
+		+ end.tv_nsec - begin.tv_nsec;
+	printf("Contended atomic ops: %llu ns per operation\n",
+		nsec / (3ULL * NR_CONTEND_THREADS * NR_CONTEND_LOOPS));
+}
+
 int main(int argc, char **argv)
 {
 #ifdef UATOMIC_HAS_ATOMIC_BYTE
@@ -85,6 +139,7 @@ int main(int argc, char **argv)
 #endif
 	do_test(&vals.i);
 	do_test(&vals.l);
+	test_contended();
 	printf("Atomic ops test OK\n");
 
 	return 0;
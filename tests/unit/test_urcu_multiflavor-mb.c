@@ -20,6 +20,8 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <poll.h>
+
 #ifndef DYNAMIC_LINK_TEST
 #define _LGPL_SOURCE
 #endif
@@ -30,10 +32,17 @@
 
 int test_mf_mb(void)
 {
+	struct urcu_gp_poll_state state;
+
 	rcu_register_thread();
 	rcu_read_lock();
 	rcu_read_unlock();
 	synchronize_rcu();
+	synchronize_rcu_expedited();
 	rcu_unregister_thread();
+
+	state = start_poll_synchronize_rcu();
+	while (!poll_state_synchronize_rcu(state))
+		(void) poll(NULL, 0, 1);
 	return 0;
 }
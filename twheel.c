@@ -0,0 +1,324 @@
+/*
+ * twheel.c
+ *
+ * Userspace RCU library - Hierarchical timer wheel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "config.h"
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu/twheel.h>
+#include "urcu-die.h"
+
+/*
+ * Level n slots hold nodes expiring LVL_START(n) to LVL_START(n + 1)
+ * ticks ahead, in slots of LVL_GRAN(n) ticks. The pending bitmap of a
+ * level is a uint64_t: CDS_TWHEEL_LVL_SIZE must be 64.
+ */
+#define LVL_CLK_DIV	(1UL << CDS_TWHEEL_LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_MASK	(CDS_TWHEEL_LVL_SIZE - 1)
+#define LVL_SHIFT(n)	((n) * CDS_TWHEEL_LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+#define LVL_OFFS(n)	((n) * CDS_TWHEEL_LVL_SIZE)
+#define LVL_START(n)	((unsigned long) (CDS_TWHEEL_LVL_SIZE - 1) \
+				<< (((n) - 1) * CDS_TWHEEL_LVL_CLK_SHIFT))
+
+/* Farther expiries are clamped to the range of the last level. */
+#define WHEEL_TIMEOUT_CUTOFF	LVL_START(CDS_TWHEEL_DEPTH)
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF \
+				- LVL_GRAN(CDS_TWHEEL_DEPTH - 1))
+
+/* Node slot values besides the wheel slots. */
+#define TWHEEL_SLOT_EXPIRED	CDS_TWHEEL_NR_SLOTS	/* in wheel->expired */
+#define TWHEEL_SLOT_IDLE	(CDS_TWHEEL_NR_SLOTS + 1)
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+/*
+ * Slot of a level for an expiry. Coarser levels round up to the next
+ * slot, so nodes never expire early.
+ */
+static
+unsigned int twheel_calc_index(unsigned long expires, unsigned int lvl)
+{
+	if (lvl)
+		expires = (expires >> LVL_SHIFT(lvl)) + 1;
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static
+unsigned int twheel_wheel_index(unsigned long expires, unsigned long clk)
+{
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	if ((long) delta < 0)
+		return clk & LVL_MASK;
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		expires = clk + WHEEL_TIMEOUT_MAX;
+		delta = WHEEL_TIMEOUT_MAX;
+	}
+	for (lvl = 0; lvl < CDS_TWHEEL_DEPTH - 1; lvl++) {
+		if (delta < LVL_START(lvl + 1))
+			break;
+	}
+	return twheel_calc_index(expires, lvl);
+}
+
+/* Called with the wheel mutex held. */
+static
+void twheel_enqueue(struct cds_twheel *wheel, struct cds_twheel_node *node,
+		unsigned long expires)
+{
+	unsigned int idx;
+
+	idx = twheel_wheel_index(expires, wheel->clk);
+	cds_list_add_tail(&node->list, &wheel->slots[idx]);
+	wheel->pending_map[idx / CDS_TWHEEL_LVL_SIZE] |=
+		1ULL << (idx % CDS_TWHEEL_LVL_SIZE);
+	node->slot = idx;
+}
+
+/* Called with the wheel mutex held. */
+static
+bool twheel_detach(struct cds_twheel *wheel, struct cds_twheel_node *node)
+{
+	unsigned int idx = node->slot;
+
+	if (idx == TWHEEL_SLOT_IDLE)
+		return false;
+	cds_list_del(&node->list);
+	if (idx < CDS_TWHEEL_NR_SLOTS && cds_list_empty(&wheel->slots[idx]))
+		wheel->pending_map[idx / CDS_TWHEEL_LVL_SIZE] &=
+			~(1ULL << (idx % CDS_TWHEEL_LVL_SIZE));
+	CMM_STORE_SHARED(node->slot, TWHEEL_SLOT_IDLE);
+	return true;
+}
+
+/*
+ * Distance from slot @start to the next pending slot of a level,
+ * wrapping around, or -1 if the level is empty.
+ */
+static
+int twheel_next_pending(uint64_t map, unsigned int start)
+{
+	if (!map)
+		return -1;
+	if (start)
+		map = (map >> start) | (map << (CDS_TWHEEL_LVL_SIZE - start));
+	return __builtin_ctzll(map);
+}
+
+/*
+ * First tick at which a pending slot is processed, as
+ * __next_timer_interrupt() of the Linux kernel. Called with the wheel
+ * mutex held.
+ */
+static
+bool twheel_next(struct cds_twheel *wheel, unsigned long *next)
+{
+	unsigned long clk = wheel->clk, lvl_clk, tick;
+	bool found = false;
+	unsigned int lvl;
+	int pos;
+
+	for (lvl = 0; lvl < CDS_TWHEEL_DEPTH; lvl++) {
+		pos = twheel_next_pending(wheel->pending_map[lvl],
+				clk & LVL_MASK);
+		lvl_clk = clk & LVL_CLK_MASK;
+		if (pos >= 0) {
+			tick = (clk + (unsigned long) pos) << LVL_SHIFT(lvl);
+			if (!found || (long) (tick - *next) < 0)
+				*next = tick;
+			found = true;
+			/* Expires before this level clock reaches the next. */
+			if ((unsigned long) pos
+					<= ((LVL_CLK_DIV - lvl_clk) & LVL_CLK_MASK))
+				break;
+		}
+		/* Clock of the next level, rounded up to its next slot. */
+		clk >>= CDS_TWHEEL_LVL_CLK_SHIFT;
+		clk += lvl_clk ? 1 : 0;
+	}
+	return found;
+}
+
+/*
+ * Move the slots due at tick wheel->clk to @due. Called with the wheel
+ * mutex held.
+ */
+static
+void twheel_collect(struct cds_twheel *wheel, struct cds_list_head *due)
+{
+	unsigned long clk = wheel->clk;
+	unsigned int lvl, idx;
+	uint64_t bit;
+
+	for (lvl = 0; lvl < CDS_TWHEEL_DEPTH; lvl++) {
+		idx = LVL_OFFS(lvl) + (clk & LVL_MASK);
+		bit = 1ULL << (clk & LVL_MASK);
+		if (wheel->pending_map[lvl] & bit) {
+			wheel->pending_map[lvl] &= ~bit;
+			cds_list_splice(&wheel->slots[idx], due);
+			CDS_INIT_LIST_HEAD(&wheel->slots[idx]);
+		}
+		/* Coarser levels only turn every LVL_CLK_DIV ticks. */
+		if (clk & LVL_CLK_MASK)
+			break;
+		clk >>= CDS_TWHEEL_LVL_CLK_SHIFT;
+	}
+}
+
+void cds_twheel_init(struct cds_twheel *wheel, unsigned long now)
+{
+	unsigned int i;
+	int ret;
+
+	ret = pthread_mutex_init(&wheel->lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	wheel->clk = now;
+	for (i = 0; i < CDS_TWHEEL_DEPTH; i++)
+		wheel->pending_map[i] = 0;
+	CDS_INIT_LIST_HEAD(&wheel->expired);
+	for (i = 0; i < CDS_TWHEEL_NR_SLOTS; i++)
+		CDS_INIT_LIST_HEAD(&wheel->slots[i]);
+}
+
+void cds_twheel_destroy(struct cds_twheel *wheel)
+{
+	int ret;
+
+	ret = pthread_mutex_destroy(&wheel->lock);
+	if (ret)
+		urcu_die(ret);
+}
+
+void cds_twheel_node_init(struct cds_twheel_node *node)
+{
+	node->expires = 0;
+	node->slot = TWHEEL_SLOT_IDLE;
+}
+
+bool cds_twheel_pending(struct cds_twheel_node *node)
+{
+	return CMM_LOAD_SHARED(node->slot) != TWHEEL_SLOT_IDLE;
+}
+
+void cds_twheel_add(struct cds_twheel *wheel, struct cds_twheel_node *node,
+		unsigned long expires)
+{
+	mutex_lock(&wheel->lock);
+	(void) twheel_detach(wheel, node);
+	CMM_STORE_SHARED(node->expires, expires);
+	twheel_enqueue(wheel, node, expires);
+	mutex_unlock(&wheel->lock);
+}
+
+bool cds_twheel_cancel(struct cds_twheel *wheel, struct cds_twheel_node *node)
+{
+	bool ret;
+
+	mutex_lock(&wheel->lock);
+	ret = twheel_detach(wheel, node);
+	mutex_unlock(&wheel->lock);
+	return ret;
+}
+
+unsigned long cds_twheel_advance(struct cds_twheel *wheel,
+		unsigned long now, cds_twheel_expire_fct expire, void *priv)
+{
+	struct cds_twheel_node *node, *n;
+	struct cds_list_head due;
+	unsigned long next, tick, expires, nr_expired = 0;
+
+	mutex_lock(&wheel->lock);
+	while ((long) (now - wheel->clk) >= 0) {
+		/* Skip the ticks without pending slots. */
+		if (!twheel_next(wheel, &next) || (long) (next - now) > 0) {
+			wheel->clk = now + 1;
+			break;
+		}
+		if ((long) (next - wheel->clk) > 0)
+			wheel->clk = next;
+		tick = wheel->clk;
+		CDS_INIT_LIST_HEAD(&due);
+		twheel_collect(wheel, &due);
+		wheel->clk++;
+		cds_list_for_each_entry_safe(node, n, &due, list) {
+			expires = CMM_LOAD_SHARED(node->expires);
+			if ((long) (expires - tick) > 0) {
+				/* Postponed by cds_twheel_touch(). */
+				cds_list_del(&node->list);
+				twheel_enqueue(wheel, node, expires);
+				continue;
+			}
+			node->slot = TWHEEL_SLOT_EXPIRED;
+			cds_list_move(&node->list, wheel->expired.prev);
+		}
+	}
+	/*
+	 * Nodes stay in wheel->expired until their callback, so a
+	 * concurrent cancellation still finds them.
+	 */
+	while (!cds_list_empty(&wheel->expired)) {
+		node = cds_list_first_entry(&wheel->expired,
+				struct cds_twheel_node, list);
+		(void) twheel_detach(wheel, node);
+		mutex_unlock(&wheel->lock);
+		expire(node, priv);
+		nr_expired++;
+		mutex_lock(&wheel->lock);
+	}
+	mutex_unlock(&wheel->lock);
+	return nr_expired;
+}
+
+bool cds_twheel_next_expiry(struct cds_twheel *wheel, unsigned long *next)
+{
+	bool ret;
+
+	mutex_lock(&wheel->lock);
+	if (!cds_list_empty(&wheel->expired)) {
+		*next = wheel->clk;
+		ret = true;
+	} else {
+		ret = twheel_next(wheel, next);
+	}
+	mutex_unlock(&wheel->lock);
+	return ret;
+}
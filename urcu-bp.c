@@ -31,18 +31,24 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <errno.h>
 #include <poll.h>
 #include <unistd.h>
 #include <sys/mman.h>
 
+#include "config.h"
+
 #include "urcu/wfcqueue.h"
 #include "urcu/map/urcu-bp.h"
 #include "urcu/static/urcu-bp.h"
 #include "urcu-pointer.h"
 #include "urcu/tls-compat.h"
+#include "urcu/alloc.h"
 
 #include "urcu-die.h"
+#include "urcu-wait.h"
+#include "urcu-tp.h"
 
 /* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
 #undef _LGPL_SOURCE
@@ -53,6 +59,20 @@
 #define MAP_ANONYMOUS MAP_ANON
 #endif
 
+#ifdef __linux__
+#include <urcu/syscall-compat.h>
+#endif
+
+#ifdef SYS_membarrier
+# define membarrier(...)		syscall(SYS_membarrier, __VA_ARGS__)
+#else
+# define membarrier(...)		-ENOSYS
+#endif
+
+#define MEMBARRIER_CMD_QUERY				0
+#define MEMBARRIER_CMD_PRIVATE_EXPEDITED		(1 << 3)
+#define MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED	(1 << 4)
+
 #ifdef __linux__
 static
 void *mremap_wrapper(void *old_address, size_t old_size,
@@ -86,18 +106,15 @@ void *mremap_wrapper(void *old_address, size_t old_size,
 	sizeof(struct registry_chunk)	\
 	+ INIT_NR_THREADS * sizeof(struct rcu_reader)
 
-/*
- * Active attempts to check for reader Q.S. before calling sleep().
- */
-#define RCU_QS_ACTIVE_ATTEMPTS 100
-
 static
 int rcu_bp_refcount;
 
 static
-void __attribute__((constructor)) rcu_bp_init(void);
+void rcu_bp_init(void);
+static
+void rcu_bp_exit(void);
 static
-void __attribute__((destructor)) rcu_bp_exit(void);
+void __attribute__((destructor)) rcu_bp_lib_exit(void);
 
 static pthread_mutex_t rcu_gp_lock = PTHREAD_MUTEX_INITIALIZER;
 
@@ -113,6 +130,12 @@ DEFINE_URCU_TLS(unsigned int, rcu_rand_yield);
 
 struct rcu_gp rcu_gp = { .ctr = RCU_GP_COUNT };
 
+/*
+ * Set before the first reader registers, with init_lock held, if
+ * private expedited sys_membarrier is available.
+ */
+int rcu_has_sys_membarrier;
+
 /*
  * Pointer to registry elements. Written to only by each individual reader. Read
  * by both the reader and the writers.
@@ -121,28 +144,62 @@ DEFINE_URCU_TLS(struct rcu_reader *, rcu_reader);
 
 static CDS_LIST_HEAD(registry);
 
+/*
+ * Grace period sequence number, used by the grace period polling API.
+ * Incremented at the beginning and at the end of each grace period, with
+ * rcu_gp_lock held: an odd value means a grace period is in progress.
+ */
+static unsigned long rcu_gp_seq;
+
+/*
+ * Running estimate of the grace period duration, sizing the spin phase
+ * of the grace period leader waiting for readers. Updated
+ * with rcu_gp_lock held.
+ */
+static struct urcu_wait_estimate gp_wait_estimate;
+
 struct registry_chunk {
 	size_t data_len;		/* data length */
-	size_t used;			/* amount of data used */
+	size_t nr_alloc;		/* allocated slots */
+	size_t used_slots;		/* slots from used_slots on are free */
 	struct cds_list_head node;	/* chunk_list node */
 	char data[];
 };
 
+/*
+ * Free rcu_reader slots are chained in free_list through their registry
+ * node, so allocating and releasing a slot are O(1). The arena is
+ * protected by its own lock, so threads registering and exiting do not
+ * serialize with grace periods on rcu_gp_lock.
+ */
 struct registry_arena {
 	struct cds_list_head chunk_list;
+	struct cds_list_head free_list;
+	pthread_mutex_t lock;
 };
 
 static struct registry_arena registry_arena = {
 	.chunk_list = CDS_LIST_HEAD_INIT(registry_arena.chunk_list),
+	.free_list = CDS_LIST_HEAD_INIT(registry_arena.free_list),
+	.lock = PTHREAD_MUTEX_INITIALIZER,
 };
 
 /* Saved fork signal mask, protected by rcu_gp_lock */
 static sigset_t saved_fork_signal_mask;
 
+#include "urcu-lock-stats-impl.h"
+
 static void mutex_lock(pthread_mutex_t *mutex)
 {
+	struct rcu_lock_stats_state *ls =
+		rcu_lock_stats_of(mutex, &rcu_gp_lock, RCU_LOCK_GP);
+	uint64_t wait_start;
 	int ret;
 
+	wait_start = rcu_lock_stats_trylock(ls, mutex);
+	if (!wait_start)
+		return;
+
 #ifndef DISTRUST_SIGNALS_EXTREME
 	ret = pthread_mutex_lock(mutex);
 	if (ret)
@@ -154,23 +211,48 @@ static void mutex_lock(pthread_mutex_t *mutex)
 		poll(NULL,0,10);
 	}
 #endif /* #else #ifndef DISTRUST_SIGNALS_EXTREME */
+	rcu_lock_stats_acquired(ls, wait_start);
 }
 
 static void mutex_unlock(pthread_mutex_t *mutex)
 {
 	int ret;
 
+	rcu_lock_stats_release(rcu_lock_stats_of(mutex, &rcu_gp_lock,
+			RCU_LOCK_GP));
 	ret = pthread_mutex_unlock(mutex);
 	if (ret)
 		urcu_die(ret);
 }
 
+static void smp_mb_master(void)
+{
+	if (caa_likely(rcu_has_sys_membarrier))
+		(void) membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+	else
+		cmm_smp_mb();
+}
+
+#include "urcu-stall-impl.h"
+#include "urcu-stats-impl.h"
+
+/*
+ * In expedited mode, busy-wait on the readers without ever falling back
+ * to sleeping: trades CPU time for grace period latency.
+ */
 static void wait_for_readers(struct cds_list_head *input_readers,
 			struct cds_list_head *cur_snap_readers,
-			struct cds_list_head *qsreaders)
+			struct cds_list_head *qsreaders,
+			int expedited)
 {
-	unsigned int wait_loops = 0;
+	struct urcu_wait_spin spin;
+	int sleeping = 0;
 	struct rcu_reader *index, *tmp;
+	struct rcu_stall_state stall;
+
+	rcu_stall_start(&stall);
+	urcu_wait_spin_start(&spin, &gp_wait_estimate);
+	urcu_tp2(wait_for_readers, input_readers, expedited);
 
 	/*
 	 * Wait for each thread URCU_TLS(rcu_reader).ctr to either
@@ -178,8 +260,8 @@ static void wait_for_readers(struct cds_list_head *input_readers,
 	 * rcu_gp.ctr value.
 	 */
 	for (;;) {
-		if (wait_loops < RCU_QS_ACTIVE_ATTEMPTS)
-			wait_loops++;
+		if (!expedited && !sleeping)
+			sleeping = urcu_wait_spin_expired(&spin);
 
 		cds_list_for_each_entry_safe(index, tmp, input_readers, node) {
 			switch (rcu_reader_state(&index->ctr)) {
@@ -207,27 +289,37 @@ static void wait_for_readers(struct cds_list_head *input_readers,
 		if (cds_list_empty(input_readers)) {
 			break;
 		} else {
-			if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS)
+			rcu_stall_check(&stall, input_readers);
+			if (sleeping) {
+				rcu_stats_gp_sleep();
 				(void) poll(NULL, 0, RCU_SLEEP_DELAY_MS);
+			}
 			else
 				caa_cpu_relax();
 		}
 	}
 }
 
-void synchronize_rcu(void)
+static void do_synchronize_rcu(int expedited)
 {
 	CDS_LIST_HEAD(cur_snap_readers);
 	CDS_LIST_HEAD(qsreaders);
 	sigset_t newmask, oldmask;
+	uint64_t start_ns;
 	int ret;
 
+	urcu_tp1(synchronize_rcu, expedited);
 	ret = sigfillset(&newmask);
 	assert(!ret);
 	ret = pthread_sigmask(SIG_BLOCK, &newmask, &oldmask);
 	assert(!ret);
 
 	mutex_lock(&rcu_gp_lock);
+	start_ns = urcu_wait_now_ns();
+
+	/* Grace period begins. Pairs with start_poll_synchronize_rcu(). */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_tp1(gp_begin, rcu_gp_seq);
 
 	if (cds_list_empty(&registry))
 		goto out;
@@ -235,12 +327,12 @@ void synchronize_rcu(void)
 	/* All threads should read qparity before accessing data structure
 	 * where new ptr points to. */
 	/* Write new ptr before changing the qparity */
-	cmm_smp_mb();
+	smp_mb_master();
 
 	/*
 	 * Wait for readers to observe original parity or be quiescent.
 	 */
-	wait_for_readers(&registry, &cur_snap_readers, &qsreaders);
+	wait_for_readers(&registry, &cur_snap_readers, &qsreaders, expedited);
 
 	/*
 	 * Adding a cmm_smp_mb() which is _not_ formally required, but makes the
@@ -269,7 +361,7 @@ void synchronize_rcu(void)
 	/*
 	 * Wait for readers to observe new parity or be quiescent.
 	 */
-	wait_for_readers(&cur_snap_readers, NULL, &qsreaders);
+	wait_for_readers(&cur_snap_readers, NULL, &qsreaders, expedited);
 
 	/*
 	 * Put quiescent reader list back into registry.
@@ -280,13 +372,33 @@ void synchronize_rcu(void)
 	 * Finish waiting for reader threads before letting the old ptr being
 	 * freed.
 	 */
-	cmm_smp_mb();
+	smp_mb_master();
 out:
+	rcu_stats_gp_end(urcu_wait_estimate_end(&gp_wait_estimate,
+			start_ns));
+	rcu_stats_add_waiters(1);
+	/* Grace period ends. Pairs with poll_state_synchronize_rcu(). */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_tp1(gp_end, rcu_gp_seq);
 	mutex_unlock(&rcu_gp_lock);
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
 	assert(!ret);
 }
 
+void synchronize_rcu(void)
+{
+	do_synchronize_rcu(0);
+}
+
+/*
+ * Expedited grace period: busy-wait on readers until they report a
+ * quiescent state, without sleeping.
+ */
+void synchronize_rcu_expedited(void)
+{
+	do_synchronize_rcu(1);
+}
+
 /*
  * library wrappers to be used by non-LGPL compatible source code.
  */
@@ -307,12 +419,28 @@ int rcu_read_ongoing(void)
 }
 
 /*
- * Only grow for now. If empty, allocate a ARENA_INIT_ALLOC sized chunk.
- * Else, try expanding the last chunk. If this fails, allocate a new
- * chunk twice as big as the last chunk.
- * Memory used by chunks _never_ moves. A chunk could theoretically be
- * freed when all "used" slots are released, but we don't do it at this
- * point.
+ * Add the slots of chunk from offset old_data_len to its end to the free
+ * list.
+ */
+static
+void arena_add_free_slots(struct registry_arena *arena,
+		struct registry_chunk *chunk, size_t old_data_len)
+{
+	struct rcu_reader *rcu_reader_reg;
+
+	for (rcu_reader_reg = (struct rcu_reader *) &chunk->data[0]
+				+ old_data_len / sizeof(struct rcu_reader);
+			rcu_reader_reg + 1 <= (struct rcu_reader *) &chunk->data[chunk->data_len];
+			rcu_reader_reg++)
+		cds_list_add_tail(&rcu_reader_reg->node, &arena->free_list);
+}
+
+/*
+ * If empty, allocate a ARENA_INIT_ALLOC sized chunk. Else, try
+ * expanding the last chunk. If this fails, allocate a new chunk twice
+ * as big as the last chunk.
+ * Memory used by chunks _never_ moves: the arena only shrinks by
+ * trimming free slots at the end of the last chunk, see shrink_arena().
  */
 static
 void expand_arena(struct registry_arena *arena)
@@ -333,9 +461,11 @@ void expand_arena(struct registry_arena *arena)
 		if (new_chunk == MAP_FAILED)
 			abort();
 		bzero(new_chunk, new_chunk_len);
+		urcu_alloc_account(URCU_ALLOC_BP_ARENA, new_chunk_len);
 		new_chunk->data_len =
 			new_chunk_len - sizeof(struct registry_chunk);
 		cds_list_add_tail(&new_chunk->node, &arena->chunk_list);
+		arena_add_free_slots(arena, new_chunk, 0);
 		return;		/* We're done. */
 	}
 
@@ -354,8 +484,12 @@ void expand_arena(struct registry_arena *arena)
 		assert(new_chunk == last_chunk);
 		bzero((char *) last_chunk + old_chunk_len,
 			new_chunk_len - old_chunk_len);
+		urcu_alloc_account(URCU_ALLOC_BP_ARENA,
+			new_chunk_len - old_chunk_len);
 		last_chunk->data_len =
 			new_chunk_len - sizeof(struct registry_chunk);
+		arena_add_free_slots(arena, last_chunk,
+			old_chunk_len - sizeof(struct registry_chunk));
 		return;		/* We're done. */
 	}
 
@@ -367,107 +501,188 @@ void expand_arena(struct registry_arena *arena)
 	if (new_chunk == MAP_FAILED)
 		abort();
 	bzero(new_chunk, new_chunk_len);
+	urcu_alloc_account(URCU_ALLOC_BP_ARENA, new_chunk_len);
 	new_chunk->data_len =
 		new_chunk_len - sizeof(struct registry_chunk);
 	cds_list_add_tail(&new_chunk->node, &arena->chunk_list);
+	arena_add_free_slots(arena, new_chunk, 0);
 }
 
 static
-struct rcu_reader *arena_alloc(struct registry_arena *arena)
+size_t chunk_nr_slots(struct registry_chunk *chunk)
+{
+	return chunk->data_len / sizeof(struct rcu_reader);
+}
+
+static
+struct rcu_reader *chunk_slot(struct registry_chunk *chunk, size_t i)
+{
+	return (struct rcu_reader *) &chunk->data[0] + i;
+}
+
+/* Called with arena lock held */
+static
+struct registry_chunk *arena_find_chunk(struct registry_arena *arena,
+		struct rcu_reader *rcu_reader_reg, size_t *index)
 {
 	struct registry_chunk *chunk;
-	struct rcu_reader *rcu_reader_reg;
-	int expand_done = 0;	/* Only allow to expand once per alloc */
-	size_t len = sizeof(struct rcu_reader);
+	char *p = (char *) rcu_reader_reg;
 
-retry:
 	cds_list_for_each_entry(chunk, &arena->chunk_list, node) {
-		if (chunk->data_len - chunk->used < len)
-			continue;
-		/* Find spot */
-		for (rcu_reader_reg = (struct rcu_reader *) &chunk->data[0];
-				rcu_reader_reg < (struct rcu_reader *) &chunk->data[chunk->data_len];
-				rcu_reader_reg++) {
-			if (!rcu_reader_reg->alloc) {
-				rcu_reader_reg->alloc = 1;
-				chunk->used += len;
-				return rcu_reader_reg;
-			}
+		if (p >= &chunk->data[0] && p < &chunk->data[chunk->data_len]) {
+			*index = rcu_reader_reg - chunk_slot(chunk, 0);
+			return chunk;
 		}
 	}
-
-	if (!expand_done) {
-		expand_arena(arena);
-		expand_done = 1;
-		goto retry;
-	}
-
-	return NULL;
+	abort();
 }
 
-/* Called with signals off and mutex locked */
+/* Called with arena lock held */
 static
-void add_thread(void)
+struct rcu_reader *arena_alloc(struct registry_arena *arena)
 {
+	struct registry_chunk *chunk;
 	struct rcu_reader *rcu_reader_reg;
-	int ret;
-
-	rcu_reader_reg = arena_alloc(&registry_arena);
-	if (!rcu_reader_reg)
-		abort();
-	ret = pthread_setspecific(urcu_bp_key, rcu_reader_reg);
-	if (ret)
-		abort();
+	size_t index;
 
-	/* Add to registry */
-	rcu_reader_reg->tid = pthread_self();
-	assert(rcu_reader_reg->ctr == 0);
-	cds_list_add(&rcu_reader_reg->node, &registry);
+	if (cds_list_empty(&arena->free_list))
+		expand_arena(arena);
+	if (cds_list_empty(&arena->free_list))
+		return NULL;
+	rcu_reader_reg = cds_list_first_entry(&arena->free_list,
+			struct rcu_reader, node);
 	/*
-	 * Reader threads are pointing to the reader registry. This is
-	 * why its memory should never be relocated.
+	 * Keep the node self-linked until it is added to the registry, so
+	 * a fork() in between can prune it.
 	 */
-	URCU_TLS(rcu_reader) = rcu_reader_reg;
+	cds_list_del_init(&rcu_reader_reg->node);
+	rcu_reader_reg->alloc = 1;
+	chunk = arena_find_chunk(arena, rcu_reader_reg, &index);
+	chunk->nr_alloc++;
+	if (index >= chunk->used_slots)
+		chunk->used_slots = index + 1;
+	return rcu_reader_reg;
 }
 
-/* Called with mutex locked */
+/*
+ * Called with arena lock held. Slots of the upper half of the last
+ * chunk are queued at the end of the free list, so they are reused last
+ * and the end of the arena can drain.
+ */
 static
-void cleanup_thread(struct registry_chunk *chunk,
+void arena_free(struct registry_arena *arena,
 		struct rcu_reader *rcu_reader_reg)
 {
+	struct registry_chunk *chunk;
+	size_t index;
+
 	rcu_reader_reg->ctr = 0;
-	cds_list_del(&rcu_reader_reg->node);
 	rcu_reader_reg->tid = 0;
 	rcu_reader_reg->alloc = 0;
-	chunk->used -= sizeof(struct rcu_reader);
+	chunk = arena_find_chunk(arena, rcu_reader_reg, &index);
+	chunk->nr_alloc--;
+	if (index + 1 == chunk->used_slots) {
+		while (chunk->used_slots
+				&& !chunk_slot(chunk, chunk->used_slots - 1)->alloc)
+			chunk->used_slots--;
+	}
+	if (chunk->node.next == &arena->chunk_list
+			&& index >= chunk_nr_slots(chunk) / 2)
+		cds_list_add_tail(&rcu_reader_reg->node, &arena->free_list);
+	else
+		cds_list_add(&rcu_reader_reg->node, &arena->free_list);
 }
 
+/*
+ * Called with arena lock held. Release the memory of free slots at the
+ * end of the arena: an empty last chunk is unmapped, and the upper half
+ * of the last chunk is trimmed while it only holds free slots. Freed
+ * slots have already been removed from the registry with rcu_gp_lock
+ * held, so no grace period can still be accessing them, and allocated
+ * slots never move. The arena shrinks only when the remaining slots
+ * would be at most half used, so a thread count oscillating around a
+ * chunk boundary does not map and unmap memory at each registration.
+ */
 static
-struct registry_chunk *find_chunk(struct rcu_reader *rcu_reader_reg)
+void shrink_arena(struct registry_arena *arena)
 {
-	struct registry_chunk *chunk;
-
-	cds_list_for_each_entry(chunk, &registry_arena.chunk_list, node) {
-		if (rcu_reader_reg < (struct rcu_reader *) &chunk->data[0])
-			continue;
-		if (rcu_reader_reg >= (struct rcu_reader *) &chunk->data[chunk->data_len])
+	struct registry_chunk *chunk, *prev;
+	size_t chunk_len, new_chunk_len, new_nr_slots, i;
+	long page_size;
+	char *start, *end;
+
+	page_size = sysconf(_SC_PAGE_SIZE);
+	if (page_size <= 0)
+		return;
+	while (!cds_list_empty(&arena->chunk_list)) {
+		chunk = cds_list_entry(arena->chunk_list.prev,
+			struct registry_chunk, node);
+		chunk_len = chunk->data_len + sizeof(struct registry_chunk);
+		if (!chunk->nr_alloc
+				&& chunk->node.prev != &arena->chunk_list) {
+			prev = cds_list_entry(chunk->node.prev,
+				struct registry_chunk, node);
+			if (prev->nr_alloc > chunk_nr_slots(prev) / 2)
+				return;
+			for (i = 0; i < chunk_nr_slots(chunk); i++)
+				cds_list_del(&chunk_slot(chunk, i)->node);
+			cds_list_del(&chunk->node);
+			munmap(chunk, chunk_len);
+			urcu_alloc_account(URCU_ALLOC_BP_ARENA,
+				-(long) chunk_len);
 			continue;
-		return chunk;
+		}
+		/* Chunk lengths are ARENA_INIT_ALLOC times a power of two. */
+		if (chunk_len <= ARENA_INIT_ALLOC)
+			return;
+		new_chunk_len = chunk_len >> 1;
+		new_nr_slots = (new_chunk_len - sizeof(struct registry_chunk))
+				/ sizeof(struct rcu_reader);
+		if (chunk->used_slots > new_nr_slots
+				|| chunk->nr_alloc > new_nr_slots / 2)
+			return;
+		for (i = new_nr_slots; i < chunk_nr_slots(chunk); i++)
+			cds_list_del(&chunk_slot(chunk, i)->node);
+		chunk->data_len = new_chunk_len - sizeof(struct registry_chunk);
+		urcu_alloc_account(URCU_ALLOC_BP_ARENA,
+			-(long) (chunk_len - new_chunk_len));
+		/* Unmap the pages which no longer hold any part of the chunk. */
+		start = (char *) chunk + new_chunk_len;
+		start = (char *) (((uintptr_t) start + page_size - 1)
+				& ~((uintptr_t) page_size - 1));
+		end = (char *) chunk + chunk_len;
+		end = (char *) (((uintptr_t) end + page_size - 1)
+				& ~((uintptr_t) page_size - 1));
+		if (start < end)
+			munmap(start, end - start);
 	}
-	return NULL;
 }
 
-/* Called with signals off and mutex locked */
+/* Called with signals off and rcu_gp_lock held */
 static
-void remove_thread(struct rcu_reader *rcu_reader_reg)
+void add_thread(struct rcu_reader *rcu_reader_reg)
 {
-	cleanup_thread(find_chunk(rcu_reader_reg), rcu_reader_reg);
-	URCU_TLS(rcu_reader) = NULL;
+	int ret;
+
+	ret = pthread_setspecific(urcu_bp_key, rcu_reader_reg);
+	if (ret)
+		abort();
+
+	/* Add to registry */
+	rcu_reader_reg->tid = pthread_self();
+	assert(rcu_reader_reg->ctr == 0);
+	cds_list_add(&rcu_reader_reg->node, &registry);
+	/*
+	 * Reader threads are pointing to the reader registry. This is
+	 * why its memory should never be relocated.
+	 */
+	URCU_TLS(rcu_reader) = rcu_reader_reg;
 }
 
 /* Disable signals, take mutex, add to registry */
 void rcu_bp_register(void)
 {
+	struct rcu_reader *rcu_reader_reg;
 	sigset_t newmask, oldmask;
 	int ret;
 
@@ -485,13 +700,17 @@ void rcu_bp_register(void)
 	if (URCU_TLS(rcu_reader))
 		goto end;
 
-	/*
-	 * Take care of early registration before urcu_bp constructor.
-	 */
+	/* First registration initializes the library. */
 	rcu_bp_init();
 
+	mutex_lock(&registry_arena.lock);
+	rcu_reader_reg = arena_alloc(&registry_arena);
+	mutex_unlock(&registry_arena.lock);
+	if (!rcu_reader_reg)
+		abort();
+
 	mutex_lock(&rcu_gp_lock);
-	add_thread();
+	add_thread(rcu_reader_reg);
 	mutex_unlock(&rcu_gp_lock);
 end:
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
@@ -514,8 +733,13 @@ void rcu_bp_unregister(struct rcu_reader *rcu_reader_reg)
 		abort();
 
 	mutex_lock(&rcu_gp_lock);
-	remove_thread(rcu_reader_reg);
+	cds_list_del(&rcu_reader_reg->node);
+	URCU_TLS(rcu_reader) = NULL;
 	mutex_unlock(&rcu_gp_lock);
+	mutex_lock(&registry_arena.lock);
+	arena_free(&registry_arena, rcu_reader_reg);
+	shrink_arena(&registry_arena);
+	mutex_unlock(&registry_arena.lock);
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
 	if (ret)
 		abort();
@@ -532,6 +756,13 @@ void urcu_bp_thread_exit_notifier(void *rcu_key)
 	rcu_bp_unregister(rcu_key);
 }
 
+/*
+ * Each registered thread holds a reference. The library is initialized
+ * by the first registration rather than by a constructor, so processes
+ * linking it without using RCU skip the sys_membarrier detection; it
+ * then keeps a reference until its destructor, so the key and registry
+ * are kept across threads registering one after the other.
+ */
 static
 void rcu_bp_init(void)
 {
@@ -543,6 +774,13 @@ void rcu_bp_init(void)
 				urcu_bp_thread_exit_notifier);
 		if (ret)
 			abort();
+		ret = membarrier(MEMBARRIER_CMD_QUERY, 0);
+		if (ret >= 0 && (ret & MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+				&& !membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0))
+			rcu_has_sys_membarrier = 1;
+	}
+	if (!initialized) {
+		rcu_bp_refcount++;
 		initialized = 1;
 	}
 	mutex_unlock(&init_lock);
@@ -558,9 +796,14 @@ void rcu_bp_exit(void)
 
 		cds_list_for_each_entry_safe(chunk, tmp,
 				&registry_arena.chunk_list, node) {
+			urcu_alloc_account(URCU_ALLOC_BP_ARENA,
+				-(long) (chunk->data_len
+					+ sizeof(struct registry_chunk)));
 			munmap(chunk, chunk->data_len
 					+ sizeof(struct registry_chunk));
 		}
+		CDS_INIT_LIST_HEAD(&registry_arena.chunk_list);
+		CDS_INIT_LIST_HEAD(&registry_arena.free_list);
 		ret = pthread_key_delete(urcu_bp_key);
 		if (ret)
 			abort();
@@ -568,10 +811,23 @@ void rcu_bp_exit(void)
 	mutex_unlock(&init_lock);
 }
 
+static
+void rcu_bp_lib_exit(void)
+{
+	int lib_ref;
+
+	mutex_lock(&init_lock);
+	lib_ref = initialized;
+	initialized = 0;
+	mutex_unlock(&init_lock);
+	if (lib_ref)
+		rcu_bp_exit();
+}
+
 /*
- * Holding the rcu_gp_lock across fork will make sure we fork() don't race with
- * a concurrent thread executing with this same lock held. This ensures that the
- * registry is in a coherent state in the child.
+ * Holding the arena lock and rcu_gp_lock across fork will make sure we fork()
+ * don't race with a concurrent thread executing with these same locks held.
+ * This ensures that the registry is in a coherent state in the child.
  */
 void rcu_bp_before_fork(void)
 {
@@ -582,6 +838,7 @@ void rcu_bp_before_fork(void)
 	assert(!ret);
 	ret = pthread_sigmask(SIG_BLOCK, &newmask, &oldmask);
 	assert(!ret);
+	mutex_lock(&registry_arena.lock);
 	mutex_lock(&rcu_gp_lock);
 	saved_fork_signal_mask = oldmask;
 }
@@ -593,13 +850,14 @@ void rcu_bp_after_fork_parent(void)
 
 	oldmask = saved_fork_signal_mask;
 	mutex_unlock(&rcu_gp_lock);
+	mutex_unlock(&registry_arena.lock);
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
 	assert(!ret);
 }
 
 /*
  * Prune all entries from registry except our own thread. Fits the Linux
- * fork behavior. Called with rcu_gp_lock held.
+ * fork behavior. Called with arena lock and rcu_gp_lock held.
  */
 static
 void urcu_bp_prune_registry(void)
@@ -609,15 +867,17 @@ void urcu_bp_prune_registry(void)
 
 	cds_list_for_each_entry(chunk, &registry_arena.chunk_list, node) {
 		for (rcu_reader_reg = (struct rcu_reader *) &chunk->data[0];
-				rcu_reader_reg < (struct rcu_reader *) &chunk->data[chunk->data_len];
+				rcu_reader_reg + 1 <= (struct rcu_reader *) &chunk->data[chunk->data_len];
 				rcu_reader_reg++) {
 			if (!rcu_reader_reg->alloc)
 				continue;
 			if (rcu_reader_reg->tid == pthread_self())
 				continue;
-			cleanup_thread(chunk, rcu_reader_reg);
+			cds_list_del(&rcu_reader_reg->node);
+			arena_free(&registry_arena, rcu_reader_reg);
 		}
 	}
+	shrink_arena(&registry_arena);
 }
 
 void rcu_bp_after_fork_child(void)
@@ -626,8 +886,11 @@ void rcu_bp_after_fork_child(void)
 	int ret;
 
 	urcu_bp_prune_registry();
+	if (rcu_has_sys_membarrier)
+		(void) membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0);
 	oldmask = saved_fork_signal_mask;
 	mutex_unlock(&rcu_gp_lock);
+	mutex_unlock(&registry_arena.lock);
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
 	assert(!ret);
 }
@@ -646,8 +909,7 @@ void *rcu_set_pointer_sym_bp(void **p, void *v)
 
 void *rcu_xchg_pointer_sym_bp(void **p, void *v)
 {
-	cmm_wmb();
-	return uatomic_xchg(p, v);
+	return uatomic_xchg_mo(p, v, CMM_ACQ_REL);
 }
 
 void *rcu_cmpxchg_pointer_sym_bp(void **p, void *old, void *_new)
@@ -660,3 +922,4 @@ DEFINE_RCU_FLAVOR(rcu_flavor);
 
 #include "urcu-call-rcu-impl.h"
 #include "urcu-defer-impl.h"
+#include "urcu-poll-impl.h"
@@ -136,6 +136,13 @@ extern void *rcu_set_pointer_sym_bp(void **p, void *v);
 
 extern void synchronize_rcu(void);
 
+/*
+ * synchronize_rcu_expedited() waits for a grace period like
+ * synchronize_rcu(), busy-waiting on readers rather than sleeping.
+ * Lowers grace period latency at the expense of CPU time.
+ */
+extern void synchronize_rcu_expedited(void);
+
 /*
  * rcu_bp_before_fork, rcu_bp_after_fork_parent and rcu_bp_after_fork_child
  * should be called around fork() system calls when the child process is not
@@ -181,6 +188,12 @@ static inline void rcu_thread_online(void)
 #endif
 
 #include <urcu-call-rcu.h>
+#ifdef _LGPL_SOURCE
+#include <urcu/static/urcu-call-rcu.h>
+#endif
+#include <urcu-poll.h>
+#include <urcu-stall.h>
+#include <urcu-stats.h>
 #include <urcu-defer.h>
 #include <urcu-flavor.h>
 
@@ -0,0 +1,263 @@
+/*
+ * urcu-brlock.c
+ *
+ * Userspace RCU library - scalable per-thread reader-writer locks
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <assert.h>
+
+#include <urcu/arch.h>
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
+#include <urcu/futex.h>
+#include <urcu/list.h>
+#include "urcu-brlock.h"
+#include "urcu-registry.h"
+#include "urcu-die.h"
+
+/*
+ * Active attempts to check for a reader unlock before sleeping.
+ */
+#define BRLOCK_ACTIVE_ATTEMPTS		100
+
+/* Values of the writer field, also the futex readers wait on. */
+#define BRLOCK_NO_WRITER		0
+#define BRLOCK_WRITER			1	/* writer holds or waits */
+#define BRLOCK_WRITER_READERS_WAIT	2	/* ...and readers sleep */
+
+struct rcu_brlock {
+	int32_t writer;
+	int32_t futex;			/* -1 while a writer sleeps */
+	pthread_mutex_t writer_lock;	/* serializes writers */
+	pthread_mutex_t registry_lock;
+	struct rcu_registry_shard registry[RCU_REGISTRY_NR_SHARDS];
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+struct rcu_brlock *rcu_brlock_create(void)
+{
+	struct rcu_brlock *lock;
+	struct rcu_registry_shard *shard;
+	int ret;
+
+	lock = calloc(1, sizeof(*lock));
+	if (!lock)
+		return NULL;
+	rcu_registry_for_each_shard(lock->registry, shard)
+		CDS_INIT_LIST_HEAD(&shard->head);
+	ret = pthread_mutex_init(&lock->writer_lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	ret = pthread_mutex_init(&lock->registry_lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	return lock;
+}
+
+void rcu_brlock_destroy(struct rcu_brlock *lock)
+{
+	int ret;
+
+	assert(rcu_registry_empty(lock->registry));
+	ret = pthread_mutex_destroy(&lock->writer_lock);
+	if (ret)
+		urcu_die(ret);
+	ret = pthread_mutex_destroy(&lock->registry_lock);
+	if (ret)
+		urcu_die(ret);
+	free(lock);
+}
+
+struct rcu_brlock_reader *rcu_brlock_register(struct rcu_brlock *lock)
+{
+	struct rcu_brlock_reader *reader;
+	int ret;
+
+	ret = posix_memalign((void **) &reader, CAA_CACHE_LINE_SIZE,
+			sizeof(*reader));
+	if (ret)
+		return NULL;
+	memset(reader, 0, sizeof(*reader));
+	reader->lock = lock;
+
+	mutex_lock(&lock->registry_lock);
+	cds_list_add(&reader->node,
+		&rcu_registry_local_shard(lock->registry)->head);
+	mutex_unlock(&lock->registry_lock);
+	return reader;
+}
+
+void rcu_brlock_unregister(struct rcu_brlock_reader *reader)
+{
+	struct rcu_brlock *lock = reader->lock;
+
+	assert(!reader->nesting);
+	mutex_lock(&lock->registry_lock);
+	cds_list_del(&reader->node);
+	mutex_unlock(&lock->registry_lock);
+	free(reader);
+}
+
+static void wake_up_writer(struct rcu_brlock *lock)
+{
+	if (caa_unlikely(uatomic_read(&lock->futex) == -1)) {
+		uatomic_set(&lock->futex, 0);
+		(void) futex_async(&lock->futex, FUTEX_WAKE, 1,
+				NULL, NULL, 0);
+	}
+}
+
+/* Sleep until the writer releases the lock. */
+static void wait_for_writer(struct rcu_brlock *lock)
+{
+	int32_t writer;
+
+	while ((writer = uatomic_read(&lock->writer)) != BRLOCK_NO_WRITER) {
+		if (writer == BRLOCK_WRITER
+				&& uatomic_cmpxchg(&lock->writer, BRLOCK_WRITER,
+					BRLOCK_WRITER_READERS_WAIT)
+					!= BRLOCK_WRITER)
+			continue;
+		(void) futex_async(&lock->writer, FUTEX_WAIT,
+				BRLOCK_WRITER_READERS_WAIT, NULL, NULL, 0);
+	}
+}
+
+void rcu_brlock_read_lock(struct rcu_brlock_reader *reader)
+{
+	struct rcu_brlock *lock = reader->lock;
+
+	if (reader->nesting) {
+		/* The writer waits for us: no need to check for it. */
+		reader->nesting++;
+		return;
+	}
+	for (;;) {
+		CMM_STORE_SHARED(reader->nesting, 1);
+		/*
+		 * Publish the read lock before checking for a writer, which
+		 * flags the lock before reading the reader slots.
+		 */
+		cmm_smp_mb();
+		if (caa_likely(CMM_LOAD_SHARED(lock->writer)
+				== BRLOCK_NO_WRITER))
+			return;
+		/* Back off, letting the writer through. */
+		CMM_STORE_SHARED(reader->nesting, 0);
+		cmm_smp_mb();
+		wake_up_writer(lock);
+		wait_for_writer(lock);
+	}
+}
+
+void rcu_brlock_read_unlock(struct rcu_brlock_reader *reader)
+{
+	struct rcu_brlock *lock = reader->lock;
+
+	assert(reader->nesting);
+	if (reader->nesting > 1) {
+		reader->nesting--;
+		return;
+	}
+	/* Critical section before the release of the read lock. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(reader->nesting, 0);
+	/* Release the read lock before reading the futex. */
+	cmm_smp_mb();
+	wake_up_writer(lock);
+}
+
+static void wait_for_reader(struct rcu_brlock *lock,
+		struct rcu_brlock_reader *reader)
+{
+	unsigned int wait_loops = 0;
+
+	while (CMM_LOAD_SHARED(reader->nesting)) {
+		if (wait_loops < BRLOCK_ACTIVE_ATTEMPTS) {
+			wait_loops++;
+			caa_cpu_relax();
+			continue;
+		}
+		uatomic_dec(&lock->futex);
+		/* Write futex before reading the reader slot. */
+		cmm_smp_mb();
+		if (CMM_LOAD_SHARED(reader->nesting))
+			(void) futex_async(&lock->futex, FUTEX_WAIT, -1,
+					NULL, NULL, 0);
+		uatomic_set(&lock->futex, 0);
+	}
+}
+
+void rcu_brlock_write_lock(struct rcu_brlock *lock)
+{
+	struct rcu_registry_shard *shard;
+	struct rcu_brlock_reader *reader;
+
+	mutex_lock(&lock->writer_lock);
+	uatomic_set(&lock->writer, BRLOCK_WRITER);
+	/* Flag the lock before reading the reader slots. */
+	cmm_smp_mb();
+	/*
+	 * Readers registering meanwhile see the flag when taking the
+	 * read lock.
+	 */
+	mutex_lock(&lock->registry_lock);
+	rcu_registry_for_each_shard(lock->registry, shard) {
+		cds_list_for_each_entry(reader, &shard->head, node)
+			wait_for_reader(lock, reader);
+	}
+	mutex_unlock(&lock->registry_lock);
+	/* Readers released before the write-side critical section. */
+	cmm_smp_mb();
+}
+
+void rcu_brlock_write_unlock(struct rcu_brlock *lock)
+{
+	/* Write-side critical section before the release. */
+	cmm_smp_mb();
+	if (uatomic_xchg(&lock->writer, BRLOCK_NO_WRITER)
+			== BRLOCK_WRITER_READERS_WAIT)
+		(void) futex_async(&lock->writer, FUTEX_WAKE, INT_MAX,
+				NULL, NULL, 0);
+	mutex_unlock(&lock->writer_lock);
+}
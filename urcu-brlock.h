@@ -0,0 +1,93 @@
+#ifndef _URCU_BRLOCK_H
+#define _URCU_BRLOCK_H
+
+/*
+ * urcu-brlock.h
+ *
+ * Userspace RCU header - scalable per-thread reader-writer locks
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <urcu/arch.h>
+#include <urcu/compiler.h>
+#include <urcu/list.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A brlock ("big reader" lock) is a reader-writer lock for code which
+ * cannot use RCU, because its readers block or must see updates as soon
+ * as the write lock is released. Each registered reader has its own
+ * cache line, the only one it writes to take and release the read lock
+ * while no writer is around: readers do not bounce a shared cache line,
+ * at the cost of a memory barrier per read lock. Writers are expensive
+ * instead: they flag the lock, walk the registry of readers and wait
+ * for each to release its read lock, sleeping on a futex. Readers
+ * arriving while a writer holds or waits for the lock sleep until it
+ * releases it, so writers are not starved. Brlocks can be used along
+ * with any flavor, they are provided by liburcu-common.
+ */
+struct rcu_brlock;
+
+/*
+ * A reader is registered by a single thread, the only one to take the
+ * read lock through it.
+ */
+struct rcu_brlock_reader {
+	unsigned long nesting;		/* read lock held if non-zero */
+	struct rcu_brlock *lock;
+	struct cds_list_head node;	/* lock registry node */
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+/*
+ * Exported functions
+ *
+ * rcu_brlock_create() returns a new lock, or NULL if out of memory.
+ * rcu_brlock_destroy() frees a lock, which must not have registered
+ * readers anymore.
+ *
+ * rcu_brlock_register() registers the calling thread as a reader of the
+ * lock, and returns its reader, or NULL if out of memory.
+ * rcu_brlock_unregister() frees it, read lock released.
+ *
+ * rcu_brlock_read_lock() takes the read lock, and can nest.
+ * rcu_brlock_read_unlock() releases it. rcu_brlock_write_lock() takes
+ * the write lock, excluding readers and other writers, and
+ * rcu_brlock_write_unlock() releases it. A thread must not take the
+ * write lock while holding the read lock of the same brlock.
+ */
+struct rcu_brlock *rcu_brlock_create(void);
+void rcu_brlock_destroy(struct rcu_brlock *lock);
+
+struct rcu_brlock_reader *rcu_brlock_register(struct rcu_brlock *lock);
+void rcu_brlock_unregister(struct rcu_brlock_reader *reader);
+
+void rcu_brlock_read_lock(struct rcu_brlock_reader *reader);
+void rcu_brlock_read_unlock(struct rcu_brlock_reader *reader);
+
+void rcu_brlock_write_lock(struct rcu_brlock *lock);
+void rcu_brlock_write_unlock(struct rcu_brlock *lock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_BRLOCK_H */
@@ -30,20 +30,84 @@
 #include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 #include <poll.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sched.h>
 
 #include "config.h"
 #include "urcu/wfcqueue.h"
+#include "urcu/cacheline.h"
+#include "urcu/alloc.h"
 #include "urcu-call-rcu.h"
+#include "urcu/static/urcu-call-rcu.h"
 #include "urcu-pointer.h"
 #include "urcu/list.h"
 #include "urcu/futex.h"
 #include "urcu/tls-compat.h"
-#include "urcu/ref.h"
 #include "urcu-die.h"
+#include "urcu-wait.h"
+#include <urcu/rseq.h>
+
+/* Batching delay of call_rcu threads, in milliseconds. */
+#define CALL_RCU_BATCH_DELAY_MS		10
+/* Maximum back off delay of idle adaptive call_rcu threads. */
+#define CALL_RCU_IDLE_DELAY_MAX_MS	160
+/* Number of queue checks per delay in adaptive mode. */
+#define CALL_RCU_DELAY_SLICES		10
+/* Default adaptive mode queue length high-water mark. */
+#define CALL_RCU_DEFAULT_HIGH_WATERMARK	1024
+/* Default polling window and pause of real-time call_rcu threads. */
+#define CALL_RCU_RT_DEFAULT_SPIN_US	100
+#define CALL_RCU_RT_DEFAULT_PAUSE_US	1000
+/* Queue checks of real-time call_rcu threads before yielding the CPU. */
+#define CALL_RCU_RT_SPIN_ATTEMPTS	100
+/* Grace period polling period of call_rcu threads in fork-fast mode. */
+#define CALL_RCU_FORK_FAST_POLL_MS	1
+/*
+ * Default memory pressure monitor: a PSI trigger firing when tasks are
+ * stalled on memory for 100ms within a 2s window, the shortest window
+ * allowed to unprivileged processes.
+ */
+#define CALL_RCU_PRESSURE_PATH		"/proc/pressure/memory"
+#define CALL_RCU_PRESSURE_TRIGGER	"some 100000 2000000"
+
+/*
+ * Call_rcu threads created with URCU_CALL_RCU_SHARED_GP share grace
+ * periods: rather than performing a grace period right after splicing
+ * their callbacks, they record the grace period sequence and wait for
+ * their next batching delay to elapse. By then, a grace period started
+ * by another call_rcu thread (or any synchronize_rcu() caller) has
+ * most likely completed, so the number of grace periods performed is
+ * driven by the batching delay rather than by the number of call_rcu
+ * threads.
+ */
+struct call_rcu_gp_batch {
+	struct cds_wfcq_head head;
+	struct cds_wfcq_tail tail;
+	struct urcu_gp_poll_state gp_state;
+};
+
+/*
+ * Pool of threads sharing the invocation of the callbacks of a
+ * call_rcu_data, see call_rcu_data_create_pool(). Each batch is
+ * dequeued by chunks of CALL_RCU_POOL_CHUNK callbacks.
+ */
+#define CALL_RCU_POOL_CHUNK		32
+
+struct call_rcu_pool {
+	struct cds_wfcq_head cbs_head;		/* batch being invoked */
+	struct cds_wfcq_tail cbs_tail;
+	unsigned long cbcount;		/* callbacks invoked by the pool */
+	unsigned long cb_cpu_ns;	/* CPU time of the pool threads */
+	int32_t gen;			/* batch generation, futex */
+	int32_t running;		/* pool threads in batch, futex */
+	int stop;
+	unsigned int nr_threads;
+	pthread_t *tids;
+};
 
 /* Data structure that identifies a call_rcu thread. */
 
@@ -59,23 +123,128 @@ struct call_rcu_data {
 	struct cds_wfcq_head cbs_head;
 	unsigned long flags;
 	int32_t futex;
-	unsigned long qlen; /* maintained for debugging. */
+	unsigned long nr_queued;	/* callbacks queued, see rcu_barrier() */
+	unsigned long qlen_high_watermark;	/* cut batching delay short */
+	unsigned int delay_ms;		/* current delay (adaptive mode) */
+	unsigned long rt_spin_us;	/* polling window (real-time mode) */
+	unsigned long rt_pause_us;	/* pause after window (real-time mode) */
+	unsigned long qlen_limit;	/* throttle call_rcu(), 0: unbounded */
+	unsigned long qlen_max;		/* statistics */
+	unsigned long nr_throttled;	/* statistics */
+	unsigned long nr_invoked;	/* callbacks invoked, see rcu_barrier() */
+	unsigned long nr_throttling;	/* throttled callers using crdp */
+	/*
+	 * call_rcu_expedited() callbacks, with their own sequences as
+	 * they are not invoked in order with the other callbacks.
+	 */
+	struct cds_wfcq_tail exp_cbs_tail;
+	struct cds_wfcq_head exp_cbs_head;
+	unsigned long nr_exp_queued;
+	unsigned long nr_exp_invoked;
+	int32_t delay_futex;		/* cut batching delay short */
+	int32_t pressure;		/* no batching delay, memory pressure */
+	pthread_mutex_t batch_mutex;	/* serialize callback batches */
+	struct call_rcu_gp_batch gp_batch;	/* shared GP and fork-fast modes */
+	struct call_rcu_pool *pool;	/* protected by batch_mutex */
+	/*
+	 * URCU_CALL_RCU_STEAL: a batch stolen from crdp is being invoked,
+	 * and the callbacks invoked meanwhile by crdp wait for it to be
+	 * accounted in nr_invoked. Protected by call_rcu_steal_mutex.
+	 */
+	int steal_active;
+	unsigned long nr_steal_deferred;
+	struct cds_list_head steal_list;	/* call_rcu_steal_list */
+	unsigned long nr_stolen;	/* statistics */
+	unsigned long long cb_cpu_ns;	/* statistics, under batch_mutex */
 	pthread_t tid;
 	int cpu_affinity;
+	int node_affinity;		/* NUMA node, -1 if none */
+	int llc_affinity;		/* CPU sharing the LLC, -1 if none */
 	struct cds_list_head list;
 } __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 
-struct call_rcu_completion {
-	int barrier_count;
-	int32_t futex;
-	struct urcu_ref ref;
+/*
+ * Incremented by call_rcu threads when they acknowledge a pause or its
+ * end, or stop, and by call_rcu_after_fork_parent() when it ends the
+ * pause. call_rcu_before_fork() and the paused call_rcu
+ * threads wait on it as a futex, so all threads pause in parallel.
+ */
+static int32_t call_rcu_pause_gen;
+
+/*
+ * call_rcu threads notified of memory pressure skip their batching
+ * delays until their queue length is at most call_rcu_pressure_qlen.
+ */
+static unsigned long call_rcu_pressure_qlen;
+
+/*
+ * Memory pressure monitor thread, waiting for the PSI trigger opened as
+ * fd, or for stop_fd to be written to. Protected by
+ * call_rcu_pressure_mutex.
+ */
+static struct call_rcu_pressure_monitor {
+	pthread_t tid;
+	int fd;
+	int stop_fd[2];
+	int active;
+} call_rcu_pressure_monitor;
+
+static pthread_mutex_t call_rcu_pressure_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * rcu_barrier() waits for the nr_invoked sequence of each call_rcu_data
+ * to catch up with its nr_queued sequence, sleeping on
+ * call_rcu_barrier_futex, which is shared by all rcu_barrier() callers.
+ * call_rcu_data_free() is excluded from running concurrently with
+ * rcu_barrier(), so the call_rcu_data structures can be walked without
+ * holding call_rcu_mutex across the wait. Both counters are protected
+ * by call_rcu_mutex.
+ */
+static int32_t call_rcu_barrier_futex;
+static int call_rcu_barrier_active;	/* rcu_barrier() in progress */
+static int call_rcu_free_active;	/* call_rcu_data_free() in progress */
+static unsigned long call_rcu_free_gen;	/* call_rcu_data_free() calls */
+
+/*
+ * Callbacks queued by the current thread, for rcu_barrier_thread(): the
+ * queued sequences of the last callbacks the thread queued on each of
+ * the (up to CALL_RCU_THREAD_TICKETS) call_rcu_data it used. Tickets are
+ * only valid as long as call_rcu_free_gen did not change since the
+ * first one was taken: call_rcu_data_free() moves the callbacks of the
+ * call_rcu_data it frees to the default call_rcu_data.
+ */
+#define CALL_RCU_THREAD_TICKETS		4
+
+struct call_rcu_ticket {
+	struct call_rcu_data *crdp;
+	unsigned long seq;
+	unsigned long exp_seq;
 };
 
-struct call_rcu_completion_work {
-	struct rcu_head head;
-	struct call_rcu_completion *completion;
+struct call_rcu_thread_tickets {
+	unsigned long free_gen;
+	unsigned int nr;
+	int overflow;		/* more call_rcu_data than tickets */
+	struct call_rcu_ticket ticket[CALL_RCU_THREAD_TICKETS];
 };
 
+static DEFINE_URCU_TLS(struct call_rcu_thread_tickets, call_rcu_tickets);
+
+/*
+ * Queue of the last call_rcu() of the thread, for the inline
+ * _call_rcu(). Invalidated for all threads by changing
+ * call_rcu_cache_gen, protected by call_rcu_mutex.
+ */
+static unsigned long call_rcu_cache_gen;
+
+DEFINE_URCU_TLS(struct urcu_call_rcu_cache, call_rcu_cache);
+
+/* Called with call_rcu_mutex held. */
+static void call_rcu_cache_invalidate_all(void)
+{
+	CMM_STORE_SHARED(call_rcu_cache_gen, call_rcu_cache_gen + 1);
+}
+
 /*
  * List of all call_rcu_data structures to keep valgrind happy.
  * Protected by call_rcu_mutex.
@@ -87,6 +256,14 @@ static CDS_LIST_HEAD(call_rcu_data_list);
 
 static DEFINE_URCU_TLS(struct call_rcu_data *, thread_call_rcu_data);
 
+/*
+ * Nonzero while the current thread invokes callbacks: call_rcu()
+ * callers within a callback are never throttled, as the batch_mutex of
+ * the call_rcu_data invoking them is held, by the current thread or by
+ * the call_rcu thread waiting for its pool threads.
+ */
+static DEFINE_URCU_TLS(int, call_rcu_invoking);
+
 /*
  * Guard call_rcu thread creation and atfork handlers.
  */
@@ -96,6 +273,19 @@ static pthread_mutex_t call_rcu_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static struct call_rcu_data *default_call_rcu_data;
 
+/*
+ * URCU_CALL_RCU_STEAL call_rcu_data. Never held while waiting, nor by
+ * paused call_rcu threads, so call_rcu threads can take it.
+ */
+static CDS_LIST_HEAD(call_rcu_steal_list);
+static pthread_mutex_t call_rcu_steal_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Queue length from which the batches of a URCU_CALL_RCU_STEAL
+ * call_rcu_data are stolen by the idle ones.
+ */
+#define CALL_RCU_STEAL_QLEN		1024
+
 /*
  * If the sched_getcpu() and sysconf(_SC_NPROCESSORS_CONF) calls are
  * available, then we can have call_rcu threads assigned to individual
@@ -106,6 +296,12 @@ static struct call_rcu_data *default_call_rcu_data;
 
 static int urcu_sched_getcpu(void)
 {
+	int cpu;
+
+	/* Read from the rseq area when available, without system call. */
+	cpu = urcu_rseq_cpu_id();
+	if (caa_likely(cpu >= 0))
+		return cpu;
 	return sched_getcpu();
 }
 
@@ -149,9 +345,9 @@ static void alloc_cpu_call_rcu_data(void)
 	if (maxcpus <= 0) {
 		return;
 	}
-	p = malloc(maxcpus * sizeof(*per_cpu_call_rcu_data));
+	p = urcu_zalloc(URCU_ALLOC_CALL_RCU,
+			maxcpus * sizeof(*per_cpu_call_rcu_data));
 	if (p != NULL) {
-		memset(p, '\0', maxcpus * sizeof(*per_cpu_call_rcu_data));
 		rcu_set_pointer(&per_cpu_call_rcu_data, p);
 	} else {
 		if (!warned) {
@@ -185,11 +381,18 @@ static void alloc_cpu_call_rcu_data(void)
 
 static void call_rcu_lock(pthread_mutex_t *pmp)
 {
+	struct rcu_lock_stats_state *ls =
+		rcu_lock_stats_of(pmp, &call_rcu_mutex, RCU_LOCK_CALL_RCU);
+	uint64_t wait_start;
 	int ret;
 
+	wait_start = rcu_lock_stats_trylock(ls, pmp);
+	if (!wait_start)
+		return;
 	ret = pthread_mutex_lock(pmp);
 	if (ret)
 		urcu_die(ret);
+	rcu_lock_stats_acquired(ls, wait_start);
 }
 
 /* Release the specified pthread mutex. */
@@ -198,22 +401,119 @@ static void call_rcu_unlock(pthread_mutex_t *pmp)
 {
 	int ret;
 
+	rcu_lock_stats_release(rcu_lock_stats_of(pmp, &call_rcu_mutex,
+			RCU_LOCK_CALL_RCU));
 	ret = pthread_mutex_unlock(pmp);
 	if (ret)
 		urcu_die(ret);
 }
 
+/*
+ * Call fct for each CPU of a sysfs CPU list file (e.g. "0-3,8-11").
+ * Returns -1 if the file does not exist, 0 otherwise.
+ */
+static int call_rcu_cpulist_for_each_cpu(const char *path,
+		void (*fct)(int cpu, void *priv), void *priv)
+{
+	FILE *fp;
+	int first, last, c;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+	while (fscanf(fp, "%d", &first) == 1) {
+		last = first;
+		c = fgetc(fp);
+		if (c == '-') {
+			if (fscanf(fp, "%d", &last) != 1)
+				break;
+			c = fgetc(fp);
+		}
+		for (; first <= last; first++)
+			fct(first, priv);
+		if (c != ',')
+			break;
+	}
+	fclose(fp);
+	return 0;
+}
+
+/*
+ * Call fct for each CPU of a NUMA node. Returns -1 if the node is
+ * unknown, 0 otherwise.
+ */
+static int call_rcu_node_for_each_cpu(int node,
+		void (*fct)(int cpu, void *priv), void *priv)
+{
+	char path[64];
+
+	snprintf(path, sizeof(path),
+		"/sys/devices/system/node/node%d/cpulist", node);
+	return call_rcu_cpulist_for_each_cpu(path, fct, priv);
+}
+
+/*
+ * Call fct for each CPU sharing the last level cache of cpu, i.e. the
+ * highest level cache listed by sysfs for cpu. Returns -1 if the cache
+ * topology of cpu is unknown, 0 otherwise.
+ */
+static int call_rcu_llc_for_each_cpu(int cpu,
+		void (*fct)(int cpu, void *priv), void *priv)
+{
+	char path[96];
+	int index, level, llc_index = -1, llc_level = 0;
+	FILE *fp;
+
+	for (index = 0; ; index++) {
+		snprintf(path, sizeof(path),
+			"/sys/devices/system/cpu/cpu%d/cache/index%d/level",
+			cpu, index);
+		fp = fopen(path, "r");
+		if (!fp)
+			break;
+		if (fscanf(fp, "%d", &level) == 1 && level > llc_level) {
+			llc_level = level;
+			llc_index = index;
+		}
+		fclose(fp);
+	}
+	if (llc_index < 0)
+		return -1;
+	snprintf(path, sizeof(path),
+		"/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",
+		cpu, llc_index);
+	return call_rcu_cpulist_for_each_cpu(path, fct, priv);
+}
+
 #if HAVE_SCHED_SETAFFINITY
+static void node_cpu_set(int cpu, void *priv)
+{
+	cpu_set_t *mask = priv;
+
+	if (cpu < CPU_SETSIZE)
+		CPU_SET(cpu, mask);
+}
+
 static
 int set_thread_cpu_affinity(struct call_rcu_data *crdp)
 {
 	cpu_set_t mask;
 
-	if (crdp->cpu_affinity < 0)
-		return 0;
-
 	CPU_ZERO(&mask);
-	CPU_SET(crdp->cpu_affinity, &mask);
+	if (crdp->node_affinity >= 0) {
+		/* Keep the default affinity if the node is unknown. */
+		if (call_rcu_node_for_each_cpu(crdp->node_affinity,
+				node_cpu_set, &mask))
+			return 0;
+	} else if (crdp->llc_affinity >= 0) {
+		if (call_rcu_llc_for_each_cpu(crdp->llc_affinity,
+				node_cpu_set, &mask))
+			return 0;
+	} else if (crdp->cpu_affinity >= 0) {
+		CPU_SET(crdp->cpu_affinity, &mask);
+	} else {
+		return 0;
+	}
 #if SCHED_SETAFFINITY_ARGS == 2
 	return sched_setaffinity(0, &mask);
 #else
@@ -232,9 +532,11 @@ static void call_rcu_wait(struct call_rcu_data *crdp)
 {
 	/* Read call_rcu list before read futex */
 	cmm_smp_mb();
-	if (uatomic_read(&crdp->futex) == -1)
+	if (uatomic_read(&crdp->futex) == -1) {
+		urcu_tp1(call_rcu_futex_wait, crdp);
 		futex_async(&crdp->futex, FUTEX_WAIT, -1,
 		      NULL, NULL, 0);
+	}
 }
 
 static void call_rcu_wake_up(struct call_rcu_data *crdp)
@@ -243,436 +545,2107 @@ static void call_rcu_wake_up(struct call_rcu_data *crdp)
 	cmm_smp_mb();
 	if (caa_unlikely(uatomic_read(&crdp->futex) == -1)) {
 		uatomic_set(&crdp->futex, 0);
+		urcu_tp1(call_rcu_futex_wake, crdp);
 		futex_async(&crdp->futex, FUTEX_WAKE, 1,
 		      NULL, NULL, 0);
 	}
 }
 
-static void call_rcu_completion_wait(struct call_rcu_completion *completion)
+static void call_rcu_barrier_wait(const struct timespec *timeout)
 {
-	/* Read completion barrier count before read futex */
+	/* Read nr_invoked before read futex */
 	cmm_smp_mb();
-	if (uatomic_read(&completion->futex) == -1)
-		futex_async(&completion->futex, FUTEX_WAIT, -1,
-		      NULL, NULL, 0);
+	if (uatomic_read(&call_rcu_barrier_futex) == -1)
+		futex_async(&call_rcu_barrier_futex, FUTEX_WAIT, -1,
+		      timeout, NULL, 0);
 }
 
-static void call_rcu_completion_wake_up(struct call_rcu_completion *completion)
+static void call_rcu_barrier_wake_up(void)
 {
-	/* Write to completion barrier count before reading/writing futex */
+	/* Write to nr_invoked before reading/writing futex */
 	cmm_smp_mb();
-	if (caa_unlikely(uatomic_read(&completion->futex) == -1)) {
-		uatomic_set(&completion->futex, 0);
-		futex_async(&completion->futex, FUTEX_WAKE, 1,
+	if (caa_unlikely(uatomic_read(&call_rcu_barrier_futex) == -1)) {
+		uatomic_set(&call_rcu_barrier_futex, 0);
+		futex_async(&call_rcu_barrier_futex, FUTEX_WAKE, INT_MAX,
 		      NULL, NULL, 0);
 	}
 }
 
-/* This is the code run by each call_rcu thread. */
-
-static void *call_rcu_thread(void *arg)
+/* Number of callbacks queued on crdp and not invoked yet. */
+static unsigned long call_rcu_qlen(struct call_rcu_data *crdp)
 {
-	unsigned long cbcount;
-	struct call_rcu_data *crdp = (struct call_rcu_data *) arg;
-	int rt = !!(uatomic_read(&crdp->flags) & URCU_CALL_RCU_RT);
-	int ret;
-
-	ret = set_thread_cpu_affinity(crdp);
-	if (ret)
-		urcu_die(errno);
-
-	/*
-	 * If callbacks take a read-side lock, we need to be registered.
-	 */
-	rcu_register_thread();
-
-	URCU_TLS(thread_call_rcu_data) = crdp;
-	if (!rt) {
-		uatomic_dec(&crdp->futex);
-		/* Decrement futex before reading call_rcu list */
-		cmm_smp_mb();
-	}
-	for (;;) {
-		struct cds_wfcq_head cbs_tmp_head;
-		struct cds_wfcq_tail cbs_tmp_tail;
-		struct cds_wfcq_node *cbs, *cbs_tmp_n;
-		enum cds_wfcq_ret splice_ret;
-
-		if (uatomic_read(&crdp->flags) & URCU_CALL_RCU_PAUSE) {
-			/*
-			 * Pause requested. Become quiescent: remove
-			 * ourself from all global lists, and don't
-			 * process any callback. The callback lists may
-			 * still be non-empty though.
-			 */
-			rcu_unregister_thread();
-			cmm_smp_mb__before_uatomic_or();
-			uatomic_or(&crdp->flags, URCU_CALL_RCU_PAUSED);
-			while ((uatomic_read(&crdp->flags) & URCU_CALL_RCU_PAUSE) != 0)
-				poll(NULL, 0, 1);
-			uatomic_and(&crdp->flags, ~URCU_CALL_RCU_PAUSED);
-			cmm_smp_mb__after_uatomic_and();
-			rcu_register_thread();
-		}
+	return uatomic_read(&crdp->nr_queued) - uatomic_read(&crdp->nr_invoked)
+		+ uatomic_read(&crdp->nr_exp_queued)
+		- uatomic_read(&crdp->nr_exp_invoked);
+}
 
-		cds_wfcq_init(&cbs_tmp_head, &cbs_tmp_tail);
-		splice_ret = __cds_wfcq_splice_blocking(&cbs_tmp_head,
-			&cbs_tmp_tail, &crdp->cbs_head, &crdp->cbs_tail);
-		assert(splice_ret != CDS_WFCQ_RET_WOULDBLOCK);
-		assert(splice_ret != CDS_WFCQ_RET_DEST_NON_EMPTY);
-		if (splice_ret != CDS_WFCQ_RET_SRC_EMPTY) {
-			synchronize_rcu();
+/*
+ * Account for a batch of cbcount callbacks, and exp_cbcount expedited
+ * callbacks, of crdp which have all been invoked, waking up
+ * rcu_barrier() callers.
+ */
+static void call_rcu_batch_done(struct call_rcu_data *crdp,
+		unsigned long cbcount, unsigned long exp_cbcount)
+{
+	if (exp_cbcount)
+		uatomic_add(&crdp->nr_exp_invoked, exp_cbcount);
+	/* The stolen batch is older: account after it, see call_rcu_steal(). */
+	if (caa_unlikely(uatomic_read(&crdp->steal_active))) {
+		call_rcu_lock(&call_rcu_steal_mutex);
+		if (crdp->steal_active) {
+			crdp->nr_steal_deferred += cbcount;
 			cbcount = 0;
-			__cds_wfcq_for_each_blocking_safe(&cbs_tmp_head,
-					&cbs_tmp_tail, cbs, cbs_tmp_n) {
-				struct rcu_head *rhp;
-
-				rhp = caa_container_of(cbs,
-					struct rcu_head, next);
-				rhp->func(rhp);
-				cbcount++;
-			}
-			uatomic_sub(&crdp->qlen, cbcount);
-		}
-		if (uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOP)
-			break;
-		rcu_thread_offline();
-		if (!rt) {
-			if (cds_wfcq_empty(&crdp->cbs_head,
-					&crdp->cbs_tail)) {
-				call_rcu_wait(crdp);
-				poll(NULL, 0, 10);
-				uatomic_dec(&crdp->futex);
-				/*
-				 * Decrement futex before reading
-				 * call_rcu list.
-				 */
-				cmm_smp_mb();
-			} else {
-				poll(NULL, 0, 10);
-			}
-		} else {
-			poll(NULL, 0, 10);
 		}
-		rcu_thread_online();
-	}
-	if (!rt) {
-		/*
-		 * Read call_rcu list before write futex.
-		 */
-		cmm_smp_mb();
-		uatomic_set(&crdp->futex, 0);
+		call_rcu_unlock(&call_rcu_steal_mutex);
 	}
-	uatomic_or(&crdp->flags, URCU_CALL_RCU_STOPPED);
-	rcu_unregister_thread();
-	return NULL;
+	uatomic_add(&crdp->nr_invoked, cbcount);
+	call_rcu_barrier_wake_up();
+}
+
+static int call_rcu_exp_pending(struct call_rcu_data *crdp)
+{
+	return !cds_wfcq_empty(&crdp->exp_cbs_head, &crdp->exp_cbs_tail);
 }
 
 /*
- * Create both a call_rcu thread and the corresponding call_rcu_data
- * structure, linking the structure in as specified.  Caller must hold
- * call_rcu_mutex.
+ * Return whether crdp is notified of memory pressure, leaving that mode
+ * once its queue length is at most call_rcu_pressure_qlen.
  */
+static int call_rcu_pressured(struct call_rcu_data *crdp)
+{
+	if (caa_likely(!uatomic_read(&crdp->pressure)))
+		return 0;
+	if (call_rcu_qlen(crdp) > CMM_LOAD_SHARED(call_rcu_pressure_qlen))
+		return 1;
+	uatomic_set(&crdp->pressure, 0);
+	return 0;
+}
 
-static void call_rcu_data_init(struct call_rcu_data **crdpp,
-			       unsigned long flags,
-			       int cpu_affinity)
+/*
+ * Sleep for up to delay_ms, unless expedited callbacks are queued, the
+ * call_rcu thread is requested to pause or stop, or it is notified of
+ * memory pressure.
+ */
+static void call_rcu_delay_wait(struct call_rcu_data *crdp,
+		unsigned int delay_ms)
 {
-	struct call_rcu_data *crdp;
-	int ret;
+	struct timespec ts;
 
-	crdp = malloc(sizeof(*crdp));
-	if (crdp == NULL)
-		urcu_die(errno);
-	memset(crdp, '\0', sizeof(*crdp));
-	cds_wfcq_init(&crdp->cbs_head, &crdp->cbs_tail);
-	crdp->qlen = 0;
-	crdp->futex = 0;
-	crdp->flags = flags;
-	cds_list_add(&crdp->list, &call_rcu_data_list);
-	crdp->cpu_affinity = cpu_affinity;
-	cmm_smp_mb();  /* Structure initialized before pointer is planted. */
-	*crdpp = crdp;
-	ret = pthread_create(&crdp->tid, NULL, call_rcu_thread, crdp);
-	if (ret)
-		urcu_die(ret);
+	uatomic_set(&crdp->delay_futex, -1);
+	/* Write futex before read expedited queue */
+	cmm_smp_mb();
+	if (call_rcu_exp_pending(crdp) || (uatomic_read(&crdp->flags)
+			& (URCU_CALL_RCU_STOP | URCU_CALL_RCU_PAUSE))
+			|| call_rcu_pressured(crdp)) {
+		uatomic_set(&crdp->delay_futex, 0);
+		return;
+	}
+	ts.tv_sec = delay_ms / 1000;
+	ts.tv_nsec = (delay_ms % 1000) * 1000000L;
+	futex_async(&crdp->delay_futex, FUTEX_WAIT, -1, &ts, NULL, 0);
+	uatomic_set(&crdp->delay_futex, 0);
+}
+
+static void call_rcu_delay_wake_up(struct call_rcu_data *crdp)
+{
+	/* Write expedited queue before reading/writing futex */
+	cmm_smp_mb();
+	if (caa_unlikely(uatomic_read(&crdp->delay_futex) == -1)) {
+		uatomic_set(&crdp->delay_futex, 0);
+		futex_async(&crdp->delay_futex, FUTEX_WAKE, 1,
+		      NULL, NULL, 0);
+	}
 }
 
 /*
- * Return a pointer to the call_rcu_data structure for the specified
- * CPU, returning NULL if there is none.  We cannot automatically
- * created it because the platform we are running on might not define
- * urcu_sched_getcpu().
+ * Wait for callbacks to accumulate before processing the next batch.
  *
- * The call to this function and use of the returned call_rcu_data
- * should be protected by RCU read-side lock.
+ * In adaptive mode (URCU_CALL_RCU_ADAPTIVE), the wait is cut short as
+ * soon as the queue length reaches the high-water mark, and the delay
+ * doubles after each pass finding no callbacks, up to
+ * CALL_RCU_IDLE_DELAY_MAX_MS. Only call_rcu threads polling for
+ * callbacks (URCU_CALL_RCU_RT) are idle while waiting: the others wait
+ * on their futex when idle. In all modes, call_rcu_expedited() and
+ * call_rcu_memory_pressure() cut the wait short.
  */
-
-struct call_rcu_data *get_cpu_call_rcu_data(int cpu)
+static void call_rcu_delay(struct call_rcu_data *crdp, int idle)
 {
-	static int warned = 0;
-	struct call_rcu_data **pcpu_crdp;
+	unsigned int waited, slice;
+	unsigned long hwm;
 
-	pcpu_crdp = rcu_dereference(per_cpu_call_rcu_data);
-	if (pcpu_crdp == NULL)
-		return NULL;
-	if (!warned && maxcpus > 0 && (cpu < 0 || maxcpus <= cpu)) {
-		fprintf(stderr, "[error] liburcu: get CPU # out of range\n");
-		warned = 1;
+	if (!(uatomic_read(&crdp->flags) & URCU_CALL_RCU_ADAPTIVE)) {
+		call_rcu_delay_wait(crdp, CALL_RCU_BATCH_DELAY_MS);
+		return;
+	}
+
+	if (!idle)
+		crdp->delay_ms = CALL_RCU_BATCH_DELAY_MS;
+	else if (crdp->delay_ms < CALL_RCU_IDLE_DELAY_MAX_MS)
+		crdp->delay_ms = caa_min(crdp->delay_ms << 1,
+				(unsigned int) CALL_RCU_IDLE_DELAY_MAX_MS);
+	slice = caa_max(crdp->delay_ms / CALL_RCU_DELAY_SLICES, 1U);
+
+	for (waited = 0; waited < crdp->delay_ms; waited += slice) {
+		hwm = CMM_LOAD_SHARED(crdp->qlen_high_watermark);
+		if (hwm && call_rcu_qlen(crdp) >= hwm)
+			break;
+		if (uatomic_read(&crdp->flags)
+				& (URCU_CALL_RCU_STOP | URCU_CALL_RCU_PAUSE))
+			break;
+		if (call_rcu_exp_pending(crdp) || call_rcu_pressured(crdp))
+			break;
+		call_rcu_delay_wait(crdp, slice);
 	}
-	if (cpu < 0 || maxcpus <= cpu)
-		return NULL;
-	return rcu_dereference(pcpu_crdp[cpu]);
 }
 
 /*
- * Return the tid corresponding to the call_rcu thread whose
- * call_rcu_data structure is specified.
+ * Wait for callbacks in real-time mode without relying on futexes, as
+ * call_rcu() does not wake up real-time call_rcu threads: check the
+ * queues while spinning, then yielding the CPU, for rt_spin_us after
+ * each batch, then sleep for rt_pause_us before the next pass. The
+ * wait ends as soon as callbacks are queued, or the grace period of
+ * the batch kept in shared grace period mode has elapsed.
  */
-
-pthread_t get_call_rcu_thread(struct call_rcu_data *crdp)
+static void call_rcu_rt_wait(struct call_rcu_data *crdp)
 {
-	return crdp->tid;
+	unsigned long spin_us = CMM_LOAD_SHARED(crdp->rt_spin_us);
+	unsigned long pause_us = CMM_LOAD_SHARED(crdp->rt_pause_us);
+	uint64_t deadline_ns = urcu_wait_now_ns() + spin_us * 1000ULL;
+	unsigned int attempts = 0;
+	struct timespec ts;
+
+	for (;;) {
+		if (!cds_wfcq_empty(&crdp->cbs_head, &crdp->cbs_tail)
+				|| call_rcu_exp_pending(crdp))
+			return;
+		if (uatomic_read(&crdp->flags)
+				& (URCU_CALL_RCU_STOP | URCU_CALL_RCU_PAUSE))
+			return;
+		if (!cds_wfcq_empty(&crdp->gp_batch.head, &crdp->gp_batch.tail)
+				&& poll_state_synchronize_rcu(
+					crdp->gp_batch.gp_state))
+			return;
+		if (urcu_wait_now_ns() >= deadline_ns)
+			break;
+		if (attempts < CALL_RCU_RT_SPIN_ATTEMPTS) {
+			attempts++;
+			caa_cpu_relax();
+		} else {
+			(void) sched_yield();
+		}
+	}
+	if (!pause_us || call_rcu_pressured(crdp))
+		return;
+	ts.tv_sec = pause_us / 1000000;
+	ts.tv_nsec = (pause_us % 1000000) * 1000L;
+	(void) nanosleep(&ts, NULL);
 }
 
+/* Defined in urcu-poll-impl.h. */
+static struct urcu_gp_poll_state urcu_poll_get_state(void);
+
 /*
- * Create a call_rcu_data structure (with thread) and return a pointer.
+ * In fork-fast mode, wait for the grace period of the batch kept in
+ * crdp->gp_batch without blocking within the flavor, where the locks of
+ * a grace period would be held across a fork: the grace period is
+ * driven by the default call_rcu thread, and polled for, so pause and
+ * stop requests cut the wait short.
  */
-
-static struct call_rcu_data *__create_call_rcu_data(unsigned long flags,
-						    int cpu_affinity)
+static void call_rcu_fork_fast_wait_gp(struct call_rcu_data *crdp)
 {
-	struct call_rcu_data *crdp;
+	struct call_rcu_gp_batch *batch = &crdp->gp_batch;
 
-	call_rcu_data_init(&crdp, flags, cpu_affinity);
-	return crdp;
+	if (cds_wfcq_empty(&batch->head, &batch->tail))
+		return;
+	while (!poll_state_synchronize_rcu(batch->gp_state)) {
+		if (uatomic_read(&crdp->flags)
+				& (URCU_CALL_RCU_STOP | URCU_CALL_RCU_PAUSE))
+			return;
+		(void) synchronize_rcu_timeout(CALL_RCU_FORK_FAST_POLL_MS);
+	}
 }
 
-struct call_rcu_data *create_call_rcu_data(unsigned long flags,
-					   int cpu_affinity)
+static void call_rcu_pause_wake_up(void)
 {
-	struct call_rcu_data *crdp;
-
-	call_rcu_lock(&call_rcu_mutex);
-	crdp = __create_call_rcu_data(flags, cpu_affinity);
-	call_rcu_unlock(&call_rcu_mutex);
-	return crdp;
+	/* Write flags before incrementing the generation */
+	cmm_smp_mb__before_uatomic_inc();
+	uatomic_inc(&call_rcu_pause_gen);
+	futex_async(&call_rcu_pause_gen, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
 }
 
 /*
- * Set the specified CPU to use the specified call_rcu_data structure.
- *
- * Use NULL to remove a CPU's call_rcu_data structure, but it is
- * the caller's responsibility to dispose of the removed structure.
- * Use get_cpu_call_rcu_data() to obtain a pointer to the old structure
- * (prior to NULLing it out, of course).
- *
- * The caller must wait for a grace-period to pass between return from
- * set_cpu_call_rcu_data() and call to call_rcu_data_free() passing the
- * previous call rcu data as argument.
+ * Wait until the flags of crdp selected by mask match value, or its
+ * call_rcu thread stopped.
  */
+static void call_rcu_pause_wait(struct call_rcu_data *crdp,
+		unsigned long mask, unsigned long value)
+{
+	unsigned long flags;
+	int32_t gen;
 
-int set_cpu_call_rcu_data(int cpu, struct call_rcu_data *crdp)
+	for (;;) {
+		gen = uatomic_read(&call_rcu_pause_gen);
+		/* Read generation before flags */
+		cmm_smp_mb();
+		flags = uatomic_read(&crdp->flags);
+		if ((flags & mask) == value || (flags & URCU_CALL_RCU_STOPPED))
+			return;
+		futex_async(&call_rcu_pause_gen, FUTEX_WAIT, gen,
+			NULL, NULL, 0);
+	}
+}
+
+/* CPU time of the current thread, 0 if unavailable. */
+static unsigned long long call_rcu_thread_cpu_ns(void)
 {
-	static int warned = 0;
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	struct timespec ts;
 
-	call_rcu_lock(&call_rcu_mutex);
-	alloc_cpu_call_rcu_data();
-	if (cpu < 0 || maxcpus <= cpu) {
-		if (!warned) {
-			fprintf(stderr, "[error] liburcu: set CPU # out of range\n");
-			warned = 1;
+	if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+		return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+	return 0;
+}
+
+/*
+ * Invoke the callbacks queued on a call_rcu_pool, chunk by chunk.
+ * Returns the number of callbacks invoked.
+ */
+static unsigned long call_rcu_pool_invoke(struct call_rcu_pool *pool)
+{
+	struct cds_wfcq_node *chunk[CALL_RCU_POOL_CHUNK];
+	unsigned long cbcount = 0;
+	unsigned int i, nr;
+
+	URCU_TLS(call_rcu_invoking)++;
+	do {
+		nr = cds_wfcq_dequeue_bulk_blocking(&pool->cbs_head,
+				&pool->cbs_tail, chunk, CALL_RCU_POOL_CHUNK);
+
+		for (i = 0; i < nr; i++) {
+			struct rcu_head *rhp;
+
+			rhp = caa_container_of(chunk[i], struct rcu_head, next);
+			rhp->func(rhp);
+			cbcount++;
 		}
-		call_rcu_unlock(&call_rcu_mutex);
-		errno = EINVAL;
-		return -EINVAL;
+	} while (nr == CALL_RCU_POOL_CHUNK);
+	URCU_TLS(call_rcu_invoking)--;
+	return cbcount;
+}
+
+/* This is the code run by each call_rcu pool thread. */
+
+static void *call_rcu_pool_thread(void *arg)
+{
+	struct call_rcu_pool *pool = arg;
+	int32_t gen = 0;
+
+	for (;;) {
+		unsigned long cbcount, cpu_ns;
+
+		/* Read gen before reading the pool queue. */
+		while (uatomic_read(&pool->gen) == gen)
+			futex_async(&pool->gen, FUTEX_WAIT, gen,
+				NULL, NULL, 0);
+		cmm_smp_mb();
+		gen = uatomic_read(&pool->gen);
+		if (uatomic_read(&pool->stop))
+			break;
+
+		/*
+		 * If callbacks take a read-side lock, we need to be
+		 * registered. Stay unregistered while idle, so we
+		 * neither delay grace periods (QSBR) nor leave stale
+		 * registry entries in the child of a fork.
+		 */
+		rcu_register_thread();
+		cpu_ns = call_rcu_thread_cpu_ns();
+		cbcount = call_rcu_pool_invoke(pool);
+		cpu_ns = call_rcu_thread_cpu_ns() - cpu_ns;
+		rcu_unregister_thread();
+
+		uatomic_add(&pool->cb_cpu_ns, cpu_ns);
+		uatomic_add(&pool->cbcount, cbcount);
+		cmm_smp_mb__before_uatomic_dec();
+		if (!uatomic_sub_return(&pool->running, 1))
+			futex_async(&pool->running, FUTEX_WAKE, 1,
+				NULL, NULL, 0);
 	}
+	return NULL;
+}
 
-	if (per_cpu_call_rcu_data == NULL) {
-		call_rcu_unlock(&call_rcu_mutex);
-		errno = ENOMEM;
-		return -ENOMEM;
+/*
+ * Kick the pool threads: either to invoke a new batch, or to stop.
+ */
+static void call_rcu_pool_kick(struct call_rcu_pool *pool)
+{
+	uatomic_set(&pool->running, pool->nr_threads);
+	/* Write pool queue and running count before gen. */
+	cmm_smp_mb();
+	uatomic_inc(&pool->gen);
+	cmm_smp_mb();
+	futex_async(&pool->gen, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/*
+ * Invoke a batch of callbacks using the call_rcu thread and its pool
+ * threads. Returns once the whole batch is invoked, so rcu_barrier()
+ * only considers the batch invoked once all its callbacks completed.
+ */
+static unsigned long call_rcu_pool_invoke_batch(struct call_rcu_data *crdp,
+		struct cds_wfcq_head *head, struct cds_wfcq_tail *tail)
+{
+	struct call_rcu_pool *pool = crdp->pool;
+	unsigned long cbcount;
+	int32_t running;
+
+	(void) cds_wfcq_splice_blocking(&pool->cbs_head, &pool->cbs_tail,
+			head, tail);
+	call_rcu_pool_kick(pool);
+	cbcount = call_rcu_pool_invoke(pool);
+
+	/* Wait for the pool threads to complete the batch. */
+	while ((running = uatomic_read(&pool->running)) != 0)
+		futex_async(&pool->running, FUTEX_WAIT, running,
+			NULL, NULL, 0);
+	cmm_smp_mb();
+	cbcount += uatomic_xchg(&pool->cbcount, 0);
+	CMM_STORE_SHARED(crdp->cb_cpu_ns,
+		crdp->cb_cpu_ns + uatomic_xchg(&pool->cb_cpu_ns, 0));
+	return cbcount;
+}
+
+/*
+ * Invoke the callbacks of a batch whose grace period has elapsed.
+ * Called with batch_mutex held. Returns the number of callbacks
+ * invoked.
+ */
+static unsigned long call_rcu_invoke_batch(struct call_rcu_data *crdp,
+		struct cds_wfcq_head *head, struct cds_wfcq_tail *tail)
+{
+	struct cds_wfcq_node *cbs, *cbs_tmp_n;
+	unsigned long long cpu_ns;
+	unsigned long cbcount = 0;
+
+	urcu_tp1(call_rcu_batch_start, crdp);
+	cpu_ns = call_rcu_thread_cpu_ns();
+	if (crdp->pool) {
+		cbcount = call_rcu_pool_invoke_batch(crdp, head, tail);
+		goto end;
 	}
 
-	if (per_cpu_call_rcu_data[cpu] != NULL && crdp != NULL) {
-		call_rcu_unlock(&call_rcu_mutex);
-		errno = EEXIST;
-		return -EEXIST;
+	URCU_TLS(call_rcu_invoking)++;
+	__cds_wfcq_for_each_blocking_safe(head, tail, cbs, cbs_tmp_n) {
+		struct rcu_head *rhp;
+
+		rhp = caa_container_of(cbs, struct rcu_head, next);
+		rhp->func(rhp);
+		cbcount++;
 	}
+	URCU_TLS(call_rcu_invoking)--;
+end:
+	CMM_STORE_SHARED(crdp->cb_cpu_ns,
+		crdp->cb_cpu_ns + call_rcu_thread_cpu_ns() - cpu_ns);
+	urcu_tp2(call_rcu_batch_end, crdp, cbcount);
+	return cbcount;
+}
 
-	rcu_set_pointer(&per_cpu_call_rcu_data[cpu], crdp);
-	call_rcu_unlock(&call_rcu_mutex);
-	return 0;
+/*
+ * Invoke the callbacks of the batch kept by a call_rcu thread in
+ * shared grace period mode, waiting for a grace period only if none
+ * elapsed since the batch was spliced. Called with batch_mutex held.
+ */
+static void call_rcu_flush_gp_batch(struct call_rcu_data *crdp)
+{
+	struct call_rcu_gp_batch *batch = &crdp->gp_batch;
+	unsigned long cbcount;
+
+	if (cds_wfcq_empty(&batch->head, &batch->tail))
+		return;
+	if (!poll_state_synchronize_rcu(batch->gp_state))
+		synchronize_rcu();
+	cbcount = call_rcu_invoke_batch(crdp, &batch->head, &batch->tail);
+	call_rcu_batch_done(crdp, cbcount, 0);
+	cds_wfcq_init(&batch->head, &batch->tail);
+}
+
+/*
+ * Splice the callbacks queued on crdp, and invoke them after a grace
+ * period. With defer_gp (shared grace period mode), the batch is
+ * rather kept in crdp->gp_batch, to be invoked by the next pass. The
+ * batch mutex keeps the callbacks of a call_rcu_data invoked in order
+ * when throttled call_rcu() callers help the call_rcu thread.
+ * Expedited callbacks are never deferred, and are invoked first.
+ * Returns 0 if no callback was queued.
+ */
+static int call_rcu_process_batch(struct call_rcu_data *crdp, int defer_gp)
+{
+	struct cds_wfcq_head cbs_tmp_head, exp_tmp_head;
+	struct cds_wfcq_tail cbs_tmp_tail, exp_tmp_tail;
+	enum cds_wfcq_ret splice_ret, exp_splice_ret;
+	unsigned long cbcount, exp_cbcount = 0;
+
+	call_rcu_lock(&crdp->batch_mutex);
+	/* Complete the batch spliced by the previous pass. */
+	call_rcu_flush_gp_batch(crdp);
+	cds_wfcq_init(&exp_tmp_head, &exp_tmp_tail);
+	exp_splice_ret = __cds_wfcq_splice_blocking(&exp_tmp_head,
+		&exp_tmp_tail, &crdp->exp_cbs_head, &crdp->exp_cbs_tail);
+	assert(exp_splice_ret != CDS_WFCQ_RET_WOULDBLOCK);
+	assert(exp_splice_ret != CDS_WFCQ_RET_DEST_NON_EMPTY);
+	if (exp_splice_ret != CDS_WFCQ_RET_SRC_EMPTY)
+		defer_gp = 0;
+	if (defer_gp) {
+		splice_ret = __cds_wfcq_splice_blocking(&crdp->gp_batch.head,
+			&crdp->gp_batch.tail, &crdp->cbs_head,
+			&crdp->cbs_tail);
+		assert(splice_ret != CDS_WFCQ_RET_WOULDBLOCK);
+		assert(splice_ret != CDS_WFCQ_RET_DEST_NON_EMPTY);
+		if (splice_ret != CDS_WFCQ_RET_SRC_EMPTY)
+			crdp->gp_batch.gp_state = urcu_poll_get_state();
+	} else {
+		cds_wfcq_init(&cbs_tmp_head, &cbs_tmp_tail);
+		splice_ret = __cds_wfcq_splice_blocking(&cbs_tmp_head,
+			&cbs_tmp_tail, &crdp->cbs_head, &crdp->cbs_tail);
+		assert(splice_ret != CDS_WFCQ_RET_WOULDBLOCK);
+		assert(splice_ret != CDS_WFCQ_RET_DEST_NON_EMPTY);
+		if (splice_ret != CDS_WFCQ_RET_SRC_EMPTY
+				|| exp_splice_ret != CDS_WFCQ_RET_SRC_EMPTY) {
+			if (!(uatomic_read(&crdp->flags)
+					& URCU_CALL_RCU_WORKQUEUE))
+				synchronize_rcu();
+			if (exp_splice_ret != CDS_WFCQ_RET_SRC_EMPTY)
+				exp_cbcount = call_rcu_invoke_batch(crdp,
+					&exp_tmp_head, &exp_tmp_tail);
+			cbcount = 0;
+			if (splice_ret != CDS_WFCQ_RET_SRC_EMPTY)
+				cbcount = call_rcu_invoke_batch(crdp,
+					&cbs_tmp_head, &cbs_tmp_tail);
+			call_rcu_batch_done(crdp, cbcount, exp_cbcount);
+		}
+	}
+	call_rcu_unlock(&crdp->batch_mutex);
+	return splice_ret != CDS_WFCQ_RET_SRC_EMPTY
+		|| exp_splice_ret != CDS_WFCQ_RET_SRC_EMPTY;
+}
+
+/*
+ * Steal the batch awaiting its grace period of another
+ * URCU_CALL_RCU_STEAL call_rcu_data whose queue is at least
+ * CALL_RCU_STEAL_QLEN long, and invoke it from the call_rcu thread of
+ * crdp once its grace period has elapsed. The victim
+ * keeps invoking its newer batches meanwhile, but only accounts them as
+ * invoked once the stolen batch is, so rcu_barrier() and the tickets of
+ * rcu_barrier_thread() still see its callbacks invoked in queue order.
+ * Returns whether a batch was stolen.
+ */
+static int call_rcu_steal(struct call_rcu_data *crdp)
+{
+	struct call_rcu_data *victim = NULL, *iter;
+	struct urcu_gp_poll_state gp_state;
+	struct cds_wfcq_head head;
+	struct cds_wfcq_tail tail;
+	unsigned long cbcount;
+
+	cds_wfcq_init(&head, &tail);
+	call_rcu_lock(&call_rcu_steal_mutex);
+	cds_list_for_each_entry(iter, &call_rcu_steal_list, steal_list) {
+		struct call_rcu_gp_batch *batch = &iter->gp_batch;
+
+		if (iter == crdp || iter->steal_active
+				|| call_rcu_qlen(iter) < CALL_RCU_STEAL_QLEN)
+			continue;
+		/* Busy invoking a batch: try the next one. */
+		if (pthread_mutex_trylock(&iter->batch_mutex))
+			continue;
+		if (!cds_wfcq_empty(&batch->head, &batch->tail)) {
+			(void) __cds_wfcq_splice_blocking(&head, &tail,
+				&batch->head, &batch->tail);
+			gp_state = batch->gp_state;
+			uatomic_set(&iter->steal_active, 1);
+			victim = iter;
+		}
+		call_rcu_unlock(&iter->batch_mutex);
+		if (victim)
+			break;
+	}
+	call_rcu_unlock(&call_rcu_steal_mutex);
+	if (!victim)
+		return 0;
+
+	/* The victim would otherwise wait for it in its next pass. */
+	if (!poll_state_synchronize_rcu(gp_state))
+		synchronize_rcu();
+	call_rcu_lock(&crdp->batch_mutex);
+	cbcount = call_rcu_invoke_batch(crdp, &head, &tail);
+	call_rcu_unlock(&crdp->batch_mutex);
+	uatomic_add(&crdp->nr_stolen, cbcount);
+
+	call_rcu_lock(&call_rcu_steal_mutex);
+	uatomic_add(&victim->nr_invoked, cbcount + victim->nr_steal_deferred);
+	victim->nr_steal_deferred = 0;
+	uatomic_set(&victim->steal_active, 0);
+	call_rcu_unlock(&call_rcu_steal_mutex);
+	call_rcu_barrier_wake_up();
+	return 1;
+}
+
+/*
+ * Wake up an idle URCU_CALL_RCU_STEAL call_rcu thread, other than the
+ * one of the overloaded crdp, to steal its next batch.
+ */
+static void call_rcu_steal_kick(struct call_rcu_data *crdp)
+{
+	struct cds_list_head *pos;
+
+	call_rcu_lock(&call_rcu_steal_mutex);
+	for (pos = crdp->steal_list.next; pos != &crdp->steal_list;
+			pos = pos->next) {
+		struct call_rcu_data *iter;
+
+		if (pos == &call_rcu_steal_list)
+			continue;
+		iter = cds_list_entry(pos, struct call_rcu_data, steal_list);
+		/* Only the futex of waiting non-RT call_rcu threads is -1. */
+		if (uatomic_read(&iter->futex) == -1) {
+			call_rcu_wake_up(iter);
+			call_rcu_delay_wake_up(iter);
+			break;
+		}
+	}
+	call_rcu_unlock(&call_rcu_steal_mutex);
+}
+
+/* This is the code run by each call_rcu thread. */
+
+static void *call_rcu_thread(void *arg)
+{
+	struct call_rcu_data *crdp = (struct call_rcu_data *) arg;
+	int rt = !!(uatomic_read(&crdp->flags) & URCU_CALL_RCU_RT);
+	int shared_gp = !!(uatomic_read(&crdp->flags)
+				& URCU_CALL_RCU_SHARED_GP);
+	/* The default call_rcu thread drives the polled grace periods. */
+	int fork_fast = (uatomic_read(&crdp->flags) & URCU_CALL_RCU_FORK_FAST)
+			&& crdp != CMM_LOAD_SHARED(default_call_rcu_data);
+	/* Work queues invoke their work items without any delay. */
+	int workqueue = !!(uatomic_read(&crdp->flags)
+				& URCU_CALL_RCU_WORKQUEUE);
+	/* Stolen batches are those awaiting a shared grace period. */
+	int steal = !!(uatomic_read(&crdp->flags) & URCU_CALL_RCU_STEAL);
+	int ret;
+
+	ret = set_thread_cpu_affinity(crdp);
+	if (ret)
+		urcu_die(errno);
+	if (workqueue)
+		shared_gp = fork_fast = steal = 0;
+	if (steal)
+		shared_gp = 1;
+
+	/*
+	 * If callbacks take a read-side lock, we need to be registered.
+	 */
+	rcu_register_thread();
+
+	URCU_TLS(thread_call_rcu_data) = crdp;
+	if (!rt) {
+		uatomic_dec(&crdp->futex);
+		/* Decrement futex before reading call_rcu list */
+		cmm_smp_mb();
+	}
+	for (;;) {
+		int idle;
+
+		if (uatomic_read(&crdp->flags) & URCU_CALL_RCU_PAUSE) {
+			if (fork_fast) {
+				/*
+				 * Keep the spliced callbacks and the
+				 * registration across the fork, as
+				 * unregistering waits for the grace period
+				 * in progress. The child invokes the
+				 * callbacks from its default call_rcu
+				 * thread.
+				 */
+				rcu_thread_offline();
+			} else {
+				/*
+				 * Don't keep spliced callbacks across a
+				 * fork.
+				 */
+				call_rcu_lock(&crdp->batch_mutex);
+				call_rcu_flush_gp_batch(crdp);
+				call_rcu_unlock(&crdp->batch_mutex);
+				/*
+				 * Pause requested. Become quiescent:
+				 * remove ourself from all global lists,
+				 * and don't process any callback. The
+				 * callback lists may still be non-empty
+				 * though.
+				 */
+				rcu_unregister_thread();
+			}
+			cmm_smp_mb__before_uatomic_or();
+			uatomic_or(&crdp->flags, URCU_CALL_RCU_PAUSED);
+			call_rcu_pause_wake_up();
+			call_rcu_pause_wait(crdp, URCU_CALL_RCU_PAUSE, 0);
+			uatomic_and(&crdp->flags, ~URCU_CALL_RCU_PAUSED);
+			call_rcu_pause_wake_up();
+			if (fork_fast)
+				rcu_thread_online();
+			else
+				rcu_register_thread();
+		}
+
+		idle = !call_rcu_process_batch(crdp, shared_gp || fork_fast);
+		if (steal && !idle) {
+			if (call_rcu_qlen(crdp) >= CALL_RCU_STEAL_QLEN
+					&& !uatomic_read(&crdp->steal_active))
+				call_rcu_steal_kick(crdp);
+		} else if (steal) {
+			while (!(uatomic_read(&crdp->flags)
+					& (URCU_CALL_RCU_PAUSE | URCU_CALL_RCU_STOP))
+					&& call_rcu_steal(crdp))
+				;
+		}
+		if (uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOP) {
+			call_rcu_lock(&crdp->batch_mutex);
+			call_rcu_flush_gp_batch(crdp);
+			call_rcu_unlock(&crdp->batch_mutex);
+			break;
+		}
+		rcu_thread_offline();
+		if (fork_fast)
+			call_rcu_fork_fast_wait_gp(crdp);
+		if (!rt) {
+			/*
+			 * Don't sleep on the futex while holding a
+			 * batch awaiting its grace period.
+			 */
+			if (cds_wfcq_empty(&crdp->cbs_head,
+					&crdp->cbs_tail)
+					&& !call_rcu_exp_pending(crdp)
+					&& cds_wfcq_empty(&crdp->gp_batch.head,
+						&crdp->gp_batch.tail)) {
+				call_rcu_wait(crdp);
+				if (!workqueue)
+					call_rcu_delay(crdp, 0);
+				uatomic_dec(&crdp->futex);
+				/*
+				 * Decrement futex before reading
+				 * call_rcu list.
+				 */
+				cmm_smp_mb();
+			} else if (!workqueue) {
+				call_rcu_delay(crdp, 0);
+			}
+		} else if (uatomic_read(&crdp->flags) & URCU_CALL_RCU_ADAPTIVE) {
+			call_rcu_delay(crdp, idle);
+		} else {
+			call_rcu_rt_wait(crdp);
+		}
+		rcu_thread_online();
+	}
+	if (!rt) {
+		/*
+		 * Read call_rcu list before write futex.
+		 */
+		cmm_smp_mb();
+		uatomic_set(&crdp->futex, 0);
+	}
+	/*
+	 * Unregister before setting STOPPED, so a fork waiting for us
+	 * does not happen with the flavor locks held, and don't touch
+	 * crdp afterwards: it may be freed as soon as STOPPED is set.
+	 */
+	rcu_unregister_thread();
+	uatomic_or(&crdp->flags, URCU_CALL_RCU_STOPPED);
+	call_rcu_pause_wake_up();
+	return NULL;
+}
+
+/*
+ * Create both a call_rcu thread and the corresponding call_rcu_data
+ * structure, linking the structure in as specified.  Caller must hold
+ * call_rcu_mutex.
+ */
+
+static void call_rcu_data_init(struct call_rcu_data **crdpp,
+			       unsigned long flags,
+			       int cpu_affinity,
+			       int node_affinity,
+			       int llc_affinity)
+{
+	struct call_rcu_data *crdp;
+	int ret;
+
+	crdp = urcu_cacheline_zalloc(URCU_ALLOC_CALL_RCU, sizeof(*crdp));
+	if (crdp == NULL)
+		urcu_die(ENOMEM);
+	cds_wfcq_init(&crdp->cbs_head, &crdp->cbs_tail);
+	cds_wfcq_init(&crdp->exp_cbs_head, &crdp->exp_cbs_tail);
+	crdp->futex = 0;
+	crdp->flags = flags;
+	crdp->qlen_high_watermark = CALL_RCU_DEFAULT_HIGH_WATERMARK;
+	crdp->delay_ms = CALL_RCU_BATCH_DELAY_MS;
+	crdp->rt_spin_us = CALL_RCU_RT_DEFAULT_SPIN_US;
+	crdp->rt_pause_us = CALL_RCU_RT_DEFAULT_PAUSE_US;
+	ret = pthread_mutex_init(&crdp->batch_mutex, NULL);
+	if (ret)
+		urcu_die(ret);
+	cds_wfcq_init(&crdp->gp_batch.head, &crdp->gp_batch.tail);
+	cds_list_add(&crdp->list, &call_rcu_data_list);
+	CDS_INIT_LIST_HEAD(&crdp->steal_list);
+	if ((flags & URCU_CALL_RCU_STEAL) && !(flags
+			& (URCU_CALL_RCU_MANUAL | URCU_CALL_RCU_WORKQUEUE))) {
+		call_rcu_lock(&call_rcu_steal_mutex);
+		cds_list_add_tail(&crdp->steal_list, &call_rcu_steal_list);
+		call_rcu_unlock(&call_rcu_steal_mutex);
+	}
+	crdp->cpu_affinity = cpu_affinity;
+	crdp->node_affinity = node_affinity;
+	crdp->llc_affinity = llc_affinity;
+	cmm_smp_mb();  /* Structure initialized before pointer is planted. */
+	*crdpp = crdp;
+	/* The application invokes the callbacks, see call_rcu_data_poll(). */
+	if (flags & URCU_CALL_RCU_MANUAL)
+		return;
+	ret = pthread_create(&crdp->tid, NULL, call_rcu_thread, crdp);
+	if (ret)
+		urcu_die(ret);
+}
+
+/*
+ * Return a pointer to the call_rcu_data structure for the specified
+ * CPU, returning NULL if there is none.  We cannot automatically
+ * created it because the platform we are running on might not define
+ * urcu_sched_getcpu().
+ *
+ * The call to this function and use of the returned call_rcu_data
+ * should be protected by RCU read-side lock.
+ */
+
+struct call_rcu_data *get_cpu_call_rcu_data(int cpu)
+{
+	static int warned = 0;
+	struct call_rcu_data **pcpu_crdp;
+
+	pcpu_crdp = rcu_dereference(per_cpu_call_rcu_data);
+	if (pcpu_crdp == NULL)
+		return NULL;
+	if (!warned && maxcpus > 0 && (cpu < 0 || maxcpus <= cpu)) {
+		fprintf(stderr, "[error] liburcu: get CPU # out of range\n");
+		warned = 1;
+	}
+	if (cpu < 0 || maxcpus <= cpu)
+		return NULL;
+	return rcu_dereference(pcpu_crdp[cpu]);
+}
+
+/*
+ * Return the tid corresponding to the call_rcu thread whose
+ * call_rcu_data structure is specified.
+ */
+
+pthread_t get_call_rcu_thread(struct call_rcu_data *crdp)
+{
+	return crdp->tid;
+}
+
+/*
+ * Create a call_rcu_data structure (with thread, unless
+ * URCU_CALL_RCU_MANUAL) and return a pointer.
+ */
+
+static struct call_rcu_data *__create_call_rcu_data(unsigned long flags,
+						    int cpu_affinity)
+{
+	struct call_rcu_data *crdp;
+
+	call_rcu_data_init(&crdp, flags, cpu_affinity, -1, -1);
+	return crdp;
+}
+
+struct call_rcu_data *create_call_rcu_data(unsigned long flags,
+					   int cpu_affinity)
+{
+	struct call_rcu_data *crdp;
+
+	call_rcu_lock(&call_rcu_mutex);
+	crdp = __create_call_rcu_data(flags, cpu_affinity);
+	call_rcu_unlock(&call_rcu_mutex);
+	return crdp;
+}
+
+/*
+ * Set the queue length from which a call_rcu thread created with
+ * URCU_CALL_RCU_ADAPTIVE stops waiting for more callbacks to
+ * accumulate. Zero disables this early wakeup.
+ */
+
+void call_rcu_data_set_high_watermark(struct call_rcu_data *crdp,
+				      unsigned long qlen)
+{
+	CMM_STORE_SHARED(crdp->qlen_high_watermark, qlen);
+}
+
+/*
+ * Set the specified CPU to use the specified call_rcu_data structure.
+ *
+ * Use NULL to remove a CPU's call_rcu_data structure, but it is
+ * the caller's responsibility to dispose of the removed structure.
+ * Use get_cpu_call_rcu_data() to obtain a pointer to the old structure
+ * (prior to NULLing it out, of course).
+ *
+ * The caller must wait for a grace-period to pass between return from
+ * set_cpu_call_rcu_data() and call to call_rcu_data_free() passing the
+ * previous call rcu data as argument.
+ */
+
+int set_cpu_call_rcu_data(int cpu, struct call_rcu_data *crdp)
+{
+	static int warned = 0;
+
+	call_rcu_lock(&call_rcu_mutex);
+	alloc_cpu_call_rcu_data();
+	if (cpu < 0 || maxcpus <= cpu) {
+		if (!warned) {
+			fprintf(stderr, "[error] liburcu: set CPU # out of range\n");
+			warned = 1;
+		}
+		call_rcu_unlock(&call_rcu_mutex);
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	if (per_cpu_call_rcu_data == NULL) {
+		call_rcu_unlock(&call_rcu_mutex);
+		errno = ENOMEM;
+		return -ENOMEM;
+	}
+
+	/* Work queues are not for call_rcu() callbacks. */
+	if (crdp && (uatomic_read(&crdp->flags) & URCU_CALL_RCU_WORKQUEUE)) {
+		call_rcu_unlock(&call_rcu_mutex);
+		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	if (per_cpu_call_rcu_data[cpu] != NULL && crdp != NULL) {
+		call_rcu_unlock(&call_rcu_mutex);
+		errno = EEXIST;
+		return -EEXIST;
+	}
+
+	rcu_set_pointer(&per_cpu_call_rcu_data[cpu], crdp);
+	/*
+	 * Caches of the previous call_rcu_data are stale before the
+	 * grace period awaited by the caller to free it.
+	 */
+	cmm_smp_wmb();
+	call_rcu_cache_invalidate_all();
+	call_rcu_unlock(&call_rcu_mutex);
+	return 0;
+}
+
+/*
+ * Return a pointer to the default call_rcu_data structure, creating
+ * one if need be.  Because we never free call_rcu_data structures,
+ * we don't need to be in an RCU read-side critical section.
+ */
+
+struct call_rcu_data *get_default_call_rcu_data(void)
+{
+	if (default_call_rcu_data != NULL)
+		return rcu_dereference(default_call_rcu_data);
+	call_rcu_lock(&call_rcu_mutex);
+	if (default_call_rcu_data != NULL) {
+		call_rcu_unlock(&call_rcu_mutex);
+		return default_call_rcu_data;
+	}
+	call_rcu_data_init(&default_call_rcu_data, 0, -1, -1, -1);
+	call_rcu_unlock(&call_rcu_mutex);
+	return default_call_rcu_data;
+}
+
+/*
+ * Return the call_rcu_data structure that applies to the currently
+ * running thread.  Any call_rcu_data structure assigned specifically
+ * to this thread has first priority, followed by any call_rcu_data
+ * structure assigned to the CPU on which the thread is running,
+ * followed by the default call_rcu_data structure.  If there is not
+ * yet a default call_rcu_data structure, one will be created.
+ *
+ * Calls to this function and use of the returned call_rcu_data should
+ * be protected by RCU read-side lock.
+ */
+struct call_rcu_data *get_call_rcu_data(void)
+{
+	struct call_rcu_data *crd;
+
+	if (URCU_TLS(thread_call_rcu_data) != NULL)
+		return URCU_TLS(thread_call_rcu_data);
+
+	if (maxcpus > 0) {
+		crd = get_cpu_call_rcu_data(urcu_sched_getcpu());
+		if (crd)
+			return crd;
+	}
+
+	return get_default_call_rcu_data();
+}
+
+/*
+ * Return a pointer to this task's call_rcu_data if there is one.
+ */
+
+struct call_rcu_data *get_thread_call_rcu_data(void)
+{
+	return URCU_TLS(thread_call_rcu_data);
+}
+
+/*
+ * Set this task's call_rcu_data structure as specified, regardless
+ * of whether or not this task already had one.  (This allows switching
+ * to and from real-time call_rcu threads, for example.)
+ *
+ * Use NULL to remove a thread's call_rcu_data structure, but it is
+ * the caller's responsibility to dispose of the removed structure.
+ * Use get_thread_call_rcu_data() to obtain a pointer to the old structure
+ * (prior to NULLing it out, of course).
+ */
+
+void set_thread_call_rcu_data(struct call_rcu_data *crdp)
+{
+	URCU_TLS(thread_call_rcu_data) = crdp;
+	URCU_TLS(call_rcu_cache).gen = NULL;
+}
+
+/*
+ * Create a separate call_rcu thread for each CPU.  This does not
+ * replace a pre-existing call_rcu thread -- use the set_cpu_call_rcu_data()
+ * function if you want that behavior. Should be paired with
+ * free_all_cpu_call_rcu_data() to teardown these call_rcu worker
+ * threads.
+ */
+
+int create_all_cpu_call_rcu_data(unsigned long flags)
+{
+	int i;
+	struct call_rcu_data *crdp;
+	int ret;
+
+	call_rcu_lock(&call_rcu_mutex);
+	alloc_cpu_call_rcu_data();
+	call_rcu_unlock(&call_rcu_mutex);
+	if (maxcpus <= 0) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	if (per_cpu_call_rcu_data == NULL) {
+		errno = ENOMEM;
+		return -ENOMEM;
+	}
+	for (i = 0; i < maxcpus; i++) {
+		call_rcu_lock(&call_rcu_mutex);
+		if (get_cpu_call_rcu_data(i)) {
+			call_rcu_unlock(&call_rcu_mutex);
+			continue;
+		}
+		crdp = __create_call_rcu_data(flags, i);
+		if (crdp == NULL) {
+			call_rcu_unlock(&call_rcu_mutex);
+			errno = ENOMEM;
+			return -ENOMEM;
+		}
+		call_rcu_unlock(&call_rcu_mutex);
+		if ((ret = set_cpu_call_rcu_data(i, crdp)) != 0) {
+			call_rcu_data_free(crdp);
+
+			/* it has been created by other thread */
+			if (ret == -EEXIST)
+				continue;
+
+			return ret;
+		}
+	}
+	return 0;
+}
+
+struct node_call_rcu_data {
+	unsigned long flags;
+	int cpu;		/* CPU affinity, -1 if none */
+	int node;		/* NUMA node affinity, -1 if none */
+	int llc;		/* LLC affinity (CPU), -1 if none */
+	struct call_rcu_data *crdp;
+	int used;		/* crdp planted for a CPU */
+	int ret;
+};
+
+/*
+ * Use the call_rcu_data of a NUMA node (or last level cache) for one of
+ * its CPUs, creating it on first use.
+ */
+static void node_cpu_set_call_rcu_data(int cpu, void *priv)
+{
+	struct node_call_rcu_data *ncrd = priv;
+	int ret;
+
+	if (ncrd->ret || cpu >= maxcpus)
+		return;
+	call_rcu_lock(&call_rcu_mutex);
+	if (get_cpu_call_rcu_data(cpu)) {
+		call_rcu_unlock(&call_rcu_mutex);
+		return;
+	}
+	if (!ncrd->crdp)
+		call_rcu_data_init(&ncrd->crdp, ncrd->flags, ncrd->cpu,
+			ncrd->node, ncrd->llc);
+	call_rcu_unlock(&call_rcu_mutex);
+	ret = set_cpu_call_rcu_data(cpu, ncrd->crdp);
+	if (!ret)
+		ncrd->used = 1;
+	else if (ret != -EEXIST)	/* -EEXIST: created by other thread */
+		ncrd->ret = ret;
+}
+
+/* Free the call_rcu_data of a node if it did not get used. */
+static void node_call_rcu_data_put(struct node_call_rcu_data *ncrd)
+{
+	if (ncrd->crdp && !ncrd->used)
+		call_rcu_data_free(ncrd->crdp);
+	ncrd->crdp = NULL;
+	ncrd->used = 0;
+}
+
+/*
+ * Create a separate call_rcu thread for each NUMA node, bound to the
+ * CPUs of that node, and use it for each of its CPUs: get_call_rcu_data()
+ * then routes call_rcu() to the thread of the caller's node. CPUs which
+ * already have a call_rcu thread keep it. Without NUMA topology
+ * information, a single call_rcu thread serves all CPUs. Should be
+ * paired with free_all_cpu_call_rcu_data() to teardown these call_rcu
+ * worker threads.
+ */
+
+int create_all_node_call_rcu_data(unsigned long flags)
+{
+	struct node_call_rcu_data ncrd;
+	int cpu;
+
+	call_rcu_lock(&call_rcu_mutex);
+	alloc_cpu_call_rcu_data();
+	call_rcu_unlock(&call_rcu_mutex);
+	if (maxcpus <= 0) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	if (per_cpu_call_rcu_data == NULL) {
+		errno = ENOMEM;
+		return -ENOMEM;
+	}
+	ncrd.flags = flags;
+	ncrd.cpu = -1;
+	ncrd.llc = -1;
+	ncrd.crdp = NULL;
+	ncrd.used = 0;
+	ncrd.ret = 0;
+	for (ncrd.node = 0; ; ncrd.node++) {
+		if (call_rcu_node_for_each_cpu(ncrd.node,
+				node_cpu_set_call_rcu_data, &ncrd))
+			break;
+		node_call_rcu_data_put(&ncrd);
+		if (ncrd.ret)
+			return ncrd.ret;
+	}
+	if (ncrd.node == 0) {
+		/* No NUMA topology information: a single node. */
+		ncrd.node = -1;
+		for (cpu = 0; cpu < maxcpus; cpu++)
+			node_cpu_set_call_rcu_data(cpu, &ncrd);
+		node_call_rcu_data_put(&ncrd);
+	}
+	return ncrd.ret;
+}
+
+/*
+ * Create a separate call_rcu thread for each group of CPUs sharing a
+ * last level cache, allowed to run on all of them, and use it for each
+ * of these CPUs: callbacks are invoked, and their memory freed, within
+ * the cache domain of the CPU which queued them, and the scheduler
+ * moves the thread to whichever CPU of the domain is idle. CPUs which
+ * already have a call_rcu thread keep it, and CPUs with unknown cache
+ * topology get a call_rcu thread bound to them. Should be paired with
+ * free_all_cpu_call_rcu_data() to teardown these call_rcu worker
+ * threads.
+ */
+
+int create_all_llc_call_rcu_data(unsigned long flags)
+{
+	struct node_call_rcu_data ncrd;
+	int cpu;
+
+	call_rcu_lock(&call_rcu_mutex);
+	alloc_cpu_call_rcu_data();
+	call_rcu_unlock(&call_rcu_mutex);
+	if (maxcpus <= 0) {
+		errno = EINVAL;
+		return -EINVAL;
+	}
+	if (per_cpu_call_rcu_data == NULL) {
+		errno = ENOMEM;
+		return -ENOMEM;
+	}
+	ncrd.flags = flags;
+	ncrd.node = -1;
+	ncrd.crdp = NULL;
+	ncrd.used = 0;
+	ncrd.ret = 0;
+	for (cpu = 0; cpu < maxcpus; cpu++) {
+		if (get_cpu_call_rcu_data(cpu))
+			continue;
+		ncrd.cpu = -1;
+		ncrd.llc = cpu;
+		if (call_rcu_llc_for_each_cpu(cpu,
+				node_cpu_set_call_rcu_data, &ncrd)) {
+			ncrd.cpu = cpu;
+			ncrd.llc = -1;
+			node_cpu_set_call_rcu_data(cpu, &ncrd);
+		}
+		node_call_rcu_data_put(&ncrd);
+		if (ncrd.ret)
+			return ncrd.ret;
+	}
+	return 0;
+}
+
+/*
+ * Wake up the call_rcu thread corresponding to the specified
+ * call_rcu_data structure.
+ */
+static void wake_call_rcu_thread(struct call_rcu_data *crdp)
+{
+	if (!(_CMM_LOAD_SHARED(crdp->flags)
+			& (URCU_CALL_RCU_RT | URCU_CALL_RCU_MANUAL)))
+		call_rcu_wake_up(crdp);
+}
+
+/*
+ * Wake up the call_rcu thread of crdp after callbacks were enqueued,
+ * bringing its queue length to qlen, and track the queue length
+ * high-water mark.
+ */
+static void call_rcu_queued(struct call_rcu_data *crdp, unsigned long qlen)
+{
+	unsigned long qlen_max;
+
+	wake_call_rcu_thread(crdp);
+	qlen_max = uatomic_read(&crdp->qlen_max);
+	while (caa_unlikely(qlen > qlen_max)) {
+		unsigned long old;
+
+		old = uatomic_cmpxchg(&crdp->qlen_max, qlen_max, qlen);
+		if (old == qlen_max)
+			break;
+		qlen_max = old;
+	}
+}
+
+/*
+ * Record that the current thread queued callbacks on crdp up to the
+ * nr_queued sequence seq, or up to the nr_exp_queued sequence seq if
+ * expedited. Called with crdp protected from call_rcu_data_free(), e.g.
+ * within a RCU read-side critical section.
+ */
+static void call_rcu_ticket_take(struct call_rcu_data *crdp,
+		unsigned long seq, int expedited)
+{
+	struct call_rcu_thread_tickets *tickets = &URCU_TLS(call_rcu_tickets);
+	struct call_rcu_ticket *ticket;
+	unsigned int i;
+
+	if (caa_unlikely(!tickets->nr && !tickets->overflow))
+		tickets->free_gen = CMM_LOAD_SHARED(call_rcu_free_gen);
+	for (i = 0; i < tickets->nr; i++) {
+		ticket = &tickets->ticket[i];
+		if (caa_likely(ticket->crdp == crdp))
+			goto found;
+	}
+	if (caa_unlikely(i == CALL_RCU_THREAD_TICKETS)) {
+		tickets->overflow = 1;
+		return;
+	}
+	ticket = &tickets->ticket[tickets->nr++];
+	ticket->crdp = crdp;
+	/* Sequences already reached. */
+	ticket->seq = uatomic_read(&crdp->nr_invoked);
+	ticket->exp_seq = uatomic_read(&crdp->nr_exp_invoked);
+found:
+	if (expedited)
+		ticket->exp_seq = seq;
+	else
+		ticket->seq = seq;
+}
+
+/*
+ * Enqueue a callback, on the expedited queue if expedited is set.
+ * Callbacks of a URCU_CALL_RCU_MANUAL call_rcu_data are invoked when
+ * the application polls, so they all go on the same queue.
+ * Returns the new queue length.
+ */
+static unsigned long __call_rcu(struct rcu_head *head,
+		      void (*func)(struct rcu_head *head),
+		      struct call_rcu_data *crdp, int expedited)
+{
+	unsigned long qlen, seq;
+
+	cds_wfcq_node_init(&head->next);
+	head->func = func;
+	/*
+	 * Count the callback before enqueuing it: the callbacks counted
+	 * by nr_queued include all those preceding them in the queue.
+	 * An rcu_barrier() waiting for nr_invoked to reach nr_queued
+	 * therefore waits for all the callbacks enqueued before it read
+	 * nr_queued. Likewise for the expedited queue.
+	 */
+	if (caa_unlikely(expedited) && !(_CMM_LOAD_SHARED(crdp->flags)
+			& URCU_CALL_RCU_MANUAL)) {
+		call_rcu_ticket_take(crdp,
+			uatomic_add_return(&crdp->nr_exp_queued, 1), 1);
+		qlen = call_rcu_qlen(crdp);
+		cds_wfcq_enqueue(&crdp->exp_cbs_head, &crdp->exp_cbs_tail,
+			&head->next);
+		call_rcu_delay_wake_up(crdp);
+	} else {
+		seq = uatomic_add_return(&crdp->nr_queued, 1);
+		call_rcu_ticket_take(crdp, seq, 0);
+		qlen = seq - uatomic_read(&crdp->nr_invoked);
+		cds_wfcq_enqueue(&crdp->cbs_head, &crdp->cbs_tail,
+			&head->next);
+	}
+	urcu_tp3(call_rcu, head, func, crdp);
+	call_rcu_queued(crdp, qlen);
+	return qlen;
+}
+
+static unsigned long call_rcu_enqueue(struct rcu_head *head,
+		      void (*func)(struct rcu_head *head),
+		      struct call_rcu_data *crdp)
+{
+	return __call_rcu(head, func, crdp, 0);
+}
+
+/*
+ * Apply backpressure on a call_rcu() caller which brought the queue
+ * length of crdp above its limit: either help the call_rcu thread by
+ * processing a batch of callbacks (URCU_CALL_RCU_LIMIT_HELP), or wait
+ * for the call_rcu thread to bring the queue length back under the
+ * limit. Callers of a URCU_CALL_RCU_MANUAL call_rcu_data always help,
+ * as there is no call_rcu thread to wait for, except from the callbacks
+ * invoked by call_rcu_data_poll(), see call_rcu_throttle_get(). Both
+ * wait for grace periods, so the caller needs to be outside of any RCU
+ * read-side critical section (it is put offline in QSBR): callers
+ * within a read-side critical section are not throttled. The caller
+ * holds a nr_throttling reference on crdp.
+ */
+static void call_rcu_throttle(struct call_rcu_data *crdp)
+{
+	int was_online;
+
+	/* Put in offline state in QSBR. */
+	was_online = rcu_read_ongoing();
+	if (was_online)
+		rcu_thread_offline();
+	if (rcu_read_ongoing())
+		goto online;
+
+	uatomic_inc(&crdp->nr_throttled);
+	if (uatomic_read(&crdp->flags)
+			& (URCU_CALL_RCU_LIMIT_HELP | URCU_CALL_RCU_MANUAL)) {
+		(void) call_rcu_process_batch(crdp, 0);
+	} else {
+		while (call_rcu_qlen(crdp)
+				> CMM_LOAD_SHARED(crdp->qlen_limit))
+			(void) poll(NULL, 0, 1);
+	}
+online:
+	if (was_online)
+		rcu_thread_online();
+	/* Release crdp after we are done using it. */
+	cmm_smp_mb__before_uatomic_dec();
+	uatomic_dec(&crdp->nr_throttling);
+}
+
+/*
+ * Return whether a caller which brought the queue length of crdp to
+ * qlen must be throttled, in which case it holds a nr_throttling
+ * reference on crdp. Callbacks are never throttled: helping or waiting
+ * for the call_rcu thread would deadlock on the batch being invoked.
+ * Called within a RCU read-side critical section.
+ */
+static int call_rcu_throttle_get(struct call_rcu_data *crdp,
+		unsigned long qlen)
+{
+	unsigned long limit;
+
+	limit = CMM_LOAD_SHARED(crdp->qlen_limit);
+	if (caa_likely(!limit || qlen <= limit))
+		return 0;
+	if (URCU_TLS(call_rcu_invoking))
+		return 0;
+	/*
+	 * Keep crdp alive after leaving the read-side critical section:
+	 * call_rcu_data_free() waits for throttled callers.
+	 */
+	uatomic_inc(&crdp->nr_throttling);
+	return 1;
+}
+
+/*
+ * Cache crdp, resolved by get_call_rcu_data() after reading the cache
+ * generation gen, for the inline _call_rcu() of the current thread.
+ * Nothing is cached when the tracepoints of call_rcu() are enabled, if
+ * the thread ran out of rcu_barrier_thread() tickets, or if crdp
+ * depends on the current CPU and rseq cannot tell it. Called within a
+ * RCU read-side critical section.
+ */
+static void call_rcu_cache_fill(struct call_rcu_data *crdp,
+		unsigned long gen)
+{
+#ifndef RCU_USDT_PROBES
+	struct urcu_call_rcu_cache *cache = &URCU_TLS(call_rcu_cache);
+	struct call_rcu_thread_tickets *tickets = &URCU_TLS(call_rcu_tickets);
+	struct call_rcu_data *cpu_crdp;
+	unsigned int i;
+	int cpu = -1;
+
+	cache->gen = NULL;
+	if (URCU_TLS(thread_call_rcu_data) == NULL && maxcpus > 0
+			&& rcu_dereference(per_cpu_call_rcu_data)) {
+		cpu = urcu_rseq_cpu_id();
+		if (cpu < 0)
+			return;
+		cpu_crdp = get_cpu_call_rcu_data(cpu);
+		if (cpu_crdp != crdp && (cpu_crdp
+				|| crdp != rcu_dereference(default_call_rcu_data)))
+			return;
+	}
+	for (i = 0; i < tickets->nr; i++) {
+		if (tickets->ticket[i].crdp == crdp)
+			break;
+	}
+	if (i == tickets->nr)
+		return;
+	cache->gen_val = gen;
+	cache->cpu = cpu;
+	cache->crdp = crdp;
+	cache->head = &crdp->cbs_head;
+	cache->tail = &crdp->cbs_tail;
+	cache->nr_queued = &crdp->nr_queued;
+	cache->nr_invoked = &crdp->nr_invoked;
+	cache->qlen_max = &crdp->qlen_max;
+	cache->qlen_limit = &crdp->qlen_limit;
+	cache->futex = &crdp->futex;
+	cache->ticket_seq = &tickets->ticket[i].seq;
+	cache->gen = &call_rcu_cache_gen;
+#else
+	(void) crdp;
+	(void) gen;
+#endif
+}
+
+void call_rcu_cache_queued(struct call_rcu_data *crdp, unsigned long qlen)
+{
+	call_rcu_queued(crdp, qlen);
+}
+
+/*
+ * Queue a callback on the call_rcu_data of the current thread, and
+ * throttle the caller if it is above its queue length limit.
+ */
+static void _call_rcu_throttled(struct rcu_head *head,
+	      void (*func)(struct rcu_head *head), int expedited)
+{
+	struct call_rcu_data *crdp;
+	unsigned long qlen, gen;
+	int throttle;
+
+	/* Holding rcu read-side lock across use of per-cpu crdp */
+	rcu_read_lock();
+	gen = CMM_LOAD_SHARED(call_rcu_cache_gen);
+	/* Read the generation before the call_rcu_data pointers. */
+	cmm_smp_rmb();
+	crdp = get_call_rcu_data();
+	qlen = __call_rcu(head, func, crdp, expedited);
+	throttle = call_rcu_throttle_get(crdp, qlen);
+	if (!expedited && !throttle)
+		call_rcu_cache_fill(crdp, gen);
+	rcu_read_unlock();
+	if (caa_unlikely(throttle))
+		call_rcu_throttle(crdp);
+}
+
+/*
+ * Threads which enabled local batching with call_rcu_set_local_batch()
+ * collect their call_rcu() callbacks in a private chain, without any
+ * atomic operation nor access to a shared cache line. The chain is
+ * enqueued on the call_rcu_data of the thread with a single append
+ * once nr_max callbacks are collected, on call_rcu_local_flush(), by
+ * rcu_barrier() called from the thread, and when the thread exits.
+ */
+struct call_rcu_local {
+	struct cds_wfcq_chain chain;
+	unsigned long nr;
+	unsigned long nr_max;
+};
+
+static DEFINE_URCU_TLS(struct call_rcu_local *, call_rcu_local);
+
+/* Flushes the chain of exiting threads. */
+static pthread_key_t call_rcu_local_key;
+static pthread_once_t call_rcu_local_key_once = PTHREAD_ONCE_INIT;
+
+static void call_rcu_local_thread_exit(void *arg)
+{
+	struct call_rcu_local *local = arg;
+	struct call_rcu_data *crdp;
+	unsigned long qlen;
+
+	/*
+	 * The thread may not be registered as RCU reader anymore: queue
+	 * on the default call_rcu_data, which is never freed.
+	 */
+	if (local->nr) {
+		crdp = get_default_call_rcu_data();
+		qlen = uatomic_add_return(&crdp->nr_queued, local->nr)
+			- uatomic_read(&crdp->nr_invoked);
+		(void) cds_wfcq_enqueue_chain(&crdp->cbs_head,
+			&crdp->cbs_tail, &local->chain);
+		call_rcu_queued(crdp, qlen);
+	}
+	urcu_free(URCU_ALLOC_CALL_RCU, local, sizeof(*local));
+}
+
+static void call_rcu_local_key_create(void)
+{
+	int ret;
+
+	ret = pthread_key_create(&call_rcu_local_key,
+		call_rcu_local_thread_exit);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void call_rcu_local_set(struct call_rcu_local *local)
+{
+	int ret;
+
+	URCU_TLS(call_rcu_local) = local;
+	ret = pthread_setspecific(call_rcu_local_key, local);
+	if (ret)
+		urcu_die(ret);
+}
+
+/*
+ * Enqueue the chain of callbacks collected by the current thread. The
+ * callbacks are accounted for rcu_barrier() and the queue length limit
+ * as a whole.
+ */
+static void call_rcu_local_queue(struct call_rcu_local *local)
+{
+	struct call_rcu_data *crdp;
+	unsigned long qlen, seq;
+	int throttle;
+
+	if (!local->nr)
+		return;
+	/* Holding rcu read-side lock across use of per-cpu crdp */
+	rcu_read_lock();
+	crdp = get_call_rcu_data();
+	seq = uatomic_add_return(&crdp->nr_queued, local->nr);
+	call_rcu_ticket_take(crdp, seq, 0);
+	qlen = seq - uatomic_read(&crdp->nr_invoked);
+	(void) cds_wfcq_enqueue_chain(&crdp->cbs_head, &crdp->cbs_tail,
+		&local->chain);
+	local->nr = 0;
+	call_rcu_queued(crdp, qlen);
+	throttle = call_rcu_throttle_get(crdp, qlen);
+	rcu_read_unlock();
+	if (caa_unlikely(throttle))
+		call_rcu_throttle(crdp);
+}
+
+static void call_rcu_local_add(struct call_rcu_local *local,
+		struct rcu_head *head, void (*func)(struct rcu_head *head))
+{
+	cds_wfcq_node_init(&head->next);
+	head->func = func;
+	/* The call_rcu_data is only known when the chain is queued. */
+	urcu_tp3(call_rcu, head, func, NULL);
+	cds_wfcq_chain_add(&local->chain, &head->next);
+	if (caa_unlikely(++local->nr >= local->nr_max))
+		call_rcu_local_queue(local);
+}
+
+/*
+ * Collect up to nr call_rcu() callbacks of the current thread before
+ * queuing them at once. Zero queues the callbacks collected so far and
+ * disables local batching, the default.
+ */
+void call_rcu_set_local_batch(unsigned long nr)
+{
+	struct call_rcu_local *local;
+	int ret;
+
+	local = URCU_TLS(call_rcu_local);
+	if (!nr) {
+		if (!local)
+			return;
+		call_rcu_local_queue(local);
+		call_rcu_local_set(NULL);
+		urcu_free(URCU_ALLOC_CALL_RCU, local, sizeof(*local));
+		return;
+	}
+	if (!local) {
+		ret = pthread_once(&call_rcu_local_key_once,
+			call_rcu_local_key_create);
+		if (ret)
+			urcu_die(ret);
+		local = urcu_alloc(URCU_ALLOC_CALL_RCU, sizeof(*local));
+		if (!local)
+			urcu_die(ENOMEM);
+		cds_wfcq_chain_init(&local->chain);
+		local->nr = 0;
+		call_rcu_local_set(local);
+		URCU_TLS(call_rcu_cache).gen = NULL;
+	}
+	local->nr_max = nr;
+	if (local->nr >= nr)
+		call_rcu_local_queue(local);
+}
+
+/*
+ * Queue the callbacks collected so far by call_rcu() in the current
+ * thread, when local batching is enabled.
+ */
+void call_rcu_local_flush(void)
+{
+	struct call_rcu_local *local;
+
+	local = URCU_TLS(call_rcu_local);
+	if (local)
+		call_rcu_local_queue(local);
+}
+
+/*
+ * Schedule a function to be invoked after a following grace period.
+ * This is the only function that must be called -- the others are
+ * only present to allow applications to tune their use of RCU for
+ * maximum performance.
+ *
+ * Note that unless a call_rcu thread has not already been created,
+ * the first invocation of call_rcu() will create one.  So, if you
+ * need the first invocation of call_rcu() to be fast, make sure
+ * to create a call_rcu thread first.  One way to accomplish this is
+ * "get_call_rcu_data();", and another is create_all_cpu_call_rcu_data().
+ *
+ * call_rcu must be called by registered RCU read-side threads.
+ */
+void call_rcu(struct rcu_head *head,
+	      void (*func)(struct rcu_head *head))
+{
+	struct call_rcu_local *local = URCU_TLS(call_rcu_local);
+
+	if (caa_unlikely(local)) {
+		call_rcu_local_add(local, head, func);
+		return;
+	}
+	_call_rcu_throttled(head, func, 0);
+}
+
+/*
+ * Like call_rcu(), but the callback is queued apart from the others:
+ * the call_rcu thread is woken up without waiting for callbacks to
+ * accumulate, and invokes it first after the next grace period.
+ */
+void call_rcu_expedited(struct rcu_head *head,
+	      void (*func)(struct rcu_head *head))
+{
+	_call_rcu_throttled(head, func, 1);
+}
+
+/*
+ * free_rcu() collects the pointers to free in per-thread blocks of
+ * FREE_RCU_BLOCK_SIZE bytes. A full block is queued with a single
+ * call_rcu(), and its callback frees all the pointers it holds in one
+ * loop, without any indirect call per object.
+ */
+#define FREE_RCU_BLOCK_SIZE	4096
+
+struct free_rcu_block {
+	struct rcu_head head;
+	unsigned long nr;
+	void *ptrs[];
+};
+
+#define FREE_RCU_BLOCK_NR_PTRS	\
+	((FREE_RCU_BLOCK_SIZE - sizeof(struct free_rcu_block)) / sizeof(void *))
+
+static DEFINE_URCU_TLS(struct free_rcu_block *, free_rcu_block);
+
+/* Flushes the partial block of exiting threads. */
+static pthread_key_t free_rcu_key;
+static pthread_once_t free_rcu_key_once = PTHREAD_ONCE_INIT;
+
+static void free_rcu_block_cb(struct rcu_head *head)
+{
+	struct free_rcu_block *block =
+		caa_container_of(head, struct free_rcu_block, head);
+	unsigned long i;
+
+	for (i = 0; i < block->nr; i++)
+		free(block->ptrs[i]);
+	urcu_free(URCU_ALLOC_CALL_RCU, block, FREE_RCU_BLOCK_SIZE);
+}
+
+static void free_rcu_thread_exit(void *arg)
+{
+	struct free_rcu_block *block = arg;
+
+	/*
+	 * The thread may not be registered as RCU reader anymore: queue
+	 * on the default call_rcu_data, which is never freed.
+	 */
+	call_rcu_enqueue(&block->head, free_rcu_block_cb,
+		get_default_call_rcu_data());
+}
+
+static void free_rcu_key_create(void)
+{
+	int ret;
+
+	ret = pthread_key_create(&free_rcu_key, free_rcu_thread_exit);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void free_rcu_set_block(struct free_rcu_block *block)
+{
+	int ret;
+
+	URCU_TLS(free_rcu_block) = block;
+	ret = pthread_setspecific(free_rcu_key, block);
+	if (ret)
+		urcu_die(ret);
+}
+
+static struct free_rcu_block *free_rcu_alloc_block(void)
+{
+	struct free_rcu_block *block;
+	int ret;
+
+	ret = pthread_once(&free_rcu_key_once, free_rcu_key_create);
+	if (ret)
+		urcu_die(ret);
+	block = urcu_alloc(URCU_ALLOC_CALL_RCU, FREE_RCU_BLOCK_SIZE);
+	if (!block)
+		urcu_die(errno);
+	block->nr = 0;
+	free_rcu_set_block(block);
+	return block;
+}
+
+/*
+ * Free the memory pointed to by ptr, which must have been allocated by
+ * malloc(), after a grace period. The pointers are queued to the
+ * call_rcu worker by blocks: call free_rcu_flush() (or rcu_barrier())
+ * to queue the pointers collected by the current thread so far.
+ *
+ * free_rcu must be called by registered RCU read-side threads.
+ */
+void free_rcu(void *ptr)
+{
+	struct free_rcu_block *block;
+
+	if (!ptr)
+		return;
+	block = URCU_TLS(free_rcu_block);
+	if (caa_unlikely(!block))
+		block = free_rcu_alloc_block();
+	block->ptrs[block->nr++] = ptr;
+	if (caa_unlikely(block->nr == FREE_RCU_BLOCK_NR_PTRS))
+		free_rcu_flush();
+}
+
+/*
+ * Queue the pointers collected by free_rcu() in the current thread for
+ * reclamation after a grace period.
+ */
+void free_rcu_flush(void)
+{
+	struct free_rcu_block *block;
+
+	block = URCU_TLS(free_rcu_block);
+	if (!block || !block->nr)
+		return;
+	free_rcu_set_block(NULL);
+	call_rcu(&block->head, free_rcu_block_cb);
+}
+
+/*
+ * Typed callback queue: the heads queued by call_rcu_typed() are
+ * spliced into a batch by the kick callback, queued with call_rcu(),
+ * which hands them to the batch handler when it runs again, after the
+ * next grace period, while splicing the next batch. A single kick is
+ * queued at a time, so the kick callbacks are the only dequeuers.
+ */
+#define CALL_RCU_TYPED_CHUNK		64	/* heads per handler call */
+
+struct call_rcu_typed_queue {
+	struct cds_wfcq_tail tail;	/* call_rcu_typed() callers */
+	unsigned long nr_queued;	/* see call_rcu_typed_barrier() */
+	int pending;			/* kick queued */
+	struct cds_wfcq_head head __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+	struct cds_wfcq_head batch_head;	/* awaiting the grace period */
+	struct cds_wfcq_tail batch_tail;
+	unsigned long nr_invoked;
+	void (*handler)(struct rcu_typed_head **heads, size_t nr);
+	struct rcu_head kick;
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+static void call_rcu_typed_kick_cb(struct rcu_head *head)
+{
+	struct call_rcu_typed_queue *q =
+		caa_container_of(head, struct call_rcu_typed_queue, kick);
+	struct rcu_typed_head *heads[CALL_RCU_TYPED_CHUNK];
+	struct cds_wfcq_node *node, *next;
+	enum cds_wfcq_ret splice_ret;
+	unsigned long cbcount = 0;
+	size_t nr = 0;
+
+	/* The batch was spliced before the grace period which elapsed. */
+	__cds_wfcq_for_each_blocking_safe(&q->batch_head, &q->batch_tail,
+			node, next) {
+		heads[nr++] = caa_container_of(node, struct rcu_typed_head,
+				next);
+		if (nr == CALL_RCU_TYPED_CHUNK) {
+			q->handler(heads, nr);
+			cbcount += nr;
+			nr = 0;
+		}
+	}
+	if (nr) {
+		q->handler(heads, nr);
+		cbcount += nr;
+	}
+	cds_wfcq_init(&q->batch_head, &q->batch_tail);
+	if (cbcount)
+		uatomic_add(&q->nr_invoked, cbcount);
+
+	splice_ret = __cds_wfcq_splice_blocking(&q->batch_head,
+		&q->batch_tail, &q->head, &q->tail);
+	assert(splice_ret != CDS_WFCQ_RET_WOULDBLOCK);
+	assert(splice_ret != CDS_WFCQ_RET_DEST_NON_EMPTY);
+	if (splice_ret != CDS_WFCQ_RET_SRC_EMPTY) {
+		call_rcu(&q->kick, call_rcu_typed_kick_cb);
+		return;
+	}
+	uatomic_set(&q->pending, 0);
+	/* Clear pending before reading the queue. */
+	cmm_smp_mb();
+	if (!cds_wfcq_empty(&q->head, &q->tail)
+			&& !uatomic_xchg(&q->pending, 1))
+		call_rcu(&q->kick, call_rcu_typed_kick_cb);
+}
+
+/*
+ * Create a typed callback queue, whose heads are handed to handler by
+ * arrays of up to CALL_RCU_TYPED_CHUNK heads, from the call_rcu thread
+ * of the call_rcu_typed() caller. Returns NULL on allocation failure.
+ */
+struct call_rcu_typed_queue *call_rcu_typed_queue_create(
+		void (*handler)(struct rcu_typed_head **heads, size_t nr))
+{
+	struct call_rcu_typed_queue *q;
+
+	q = urcu_cacheline_zalloc(URCU_ALLOC_CALL_RCU, sizeof(*q));
+	if (!q)
+		return NULL;
+	cds_wfcq_init(&q->head, &q->tail);
+	cds_wfcq_init(&q->batch_head, &q->batch_tail);
+	q->handler = handler;
+	return q;
+}
+
+/*
+ * Wait for the heads queued on q before the call to be handed to its
+ * handler.
+ */
+void call_rcu_typed_barrier(struct call_rcu_typed_queue *q)
+{
+	unsigned long seq = uatomic_read(&q->nr_queued);
+
+	/* Each rcu_barrier() waits for the kick in flight. */
+	while ((long) (uatomic_read(&q->nr_invoked) - seq) < 0)
+		rcu_barrier();
+}
+
+/*
+ * Free q, once no call_rcu_typed() call on it can happen anymore.
+ */
+void call_rcu_typed_queue_destroy(struct call_rcu_typed_queue *q)
+{
+	call_rcu_typed_barrier(q);
+	while (uatomic_read(&q->pending))
+		rcu_barrier();
+	/* The kick callback clearing pending may still be running. */
+	rcu_barrier();
+	urcu_cacheline_free(URCU_ALLOC_CALL_RCU, q, sizeof(*q));
+}
+
+/*
+ * Queue head on q, to be handed to the handler of q after the end of a
+ * future grace period. The usage restrictions of call_rcu() apply.
+ */
+void call_rcu_typed(struct call_rcu_typed_queue *q,
+		    struct rcu_typed_head *head)
+{
+	cds_wfcq_node_init(&head->next);
+	uatomic_inc(&q->nr_queued);
+	/* The enqueue implies a full barrier before reading pending. */
+	(void) cds_wfcq_enqueue(&q->head, &q->tail, &head->next);
+	if (!uatomic_read(&q->pending) && !uatomic_xchg(&q->pending, 1))
+		call_rcu(&q->kick, call_rcu_typed_kick_cb);
+}
+
+/*
+ * Set the queue length above which call_rcu() callers are throttled.
+ * Zero (the default) leaves the queue unbounded.
+ */
+void call_rcu_data_set_qlen_limit(struct call_rcu_data *crdp,
+				  unsigned long limit)
+{
+	CMM_STORE_SHARED(crdp->qlen_limit, limit);
+}
+
+/*
+ * Set the polling window and the pause of a real-time call_rcu thread,
+ * in microseconds.
+ */
+void call_rcu_data_set_rt_delay(struct call_rcu_data *crdp,
+				unsigned long spin_us, unsigned long pause_us)
+{
+	CMM_STORE_SHARED(crdp->rt_spin_us, spin_us);
+	CMM_STORE_SHARED(crdp->rt_pause_us, pause_us);
 }
 
 /*
- * Return a pointer to the default call_rcu_data structure, creating
- * one if need be.  Because we never free call_rcu_data structures,
- * we don't need to be in an RCU read-side critical section.
+ * Have all call_rcu threads invoke their callbacks without batching
+ * delay until their queue length is at most the threshold set by
+ * call_rcu_set_memory_pressure_qlen().
  */
-
-struct call_rcu_data *get_default_call_rcu_data(void)
+void call_rcu_memory_pressure(void)
 {
-	if (default_call_rcu_data != NULL)
-		return rcu_dereference(default_call_rcu_data);
+	struct call_rcu_data *crdp;
+
 	call_rcu_lock(&call_rcu_mutex);
-	if (default_call_rcu_data != NULL) {
-		call_rcu_unlock(&call_rcu_mutex);
-		return default_call_rcu_data;
+	cds_list_for_each_entry(crdp, &call_rcu_data_list, list) {
+		uatomic_set(&crdp->pressure, 1);
+		/* Write pressure before reading/writing futexes */
+		cmm_smp_mb();
+		wake_call_rcu_thread(crdp);
+		call_rcu_delay_wake_up(crdp);
 	}
-	call_rcu_data_init(&default_call_rcu_data, 0, -1);
 	call_rcu_unlock(&call_rcu_mutex);
-	return default_call_rcu_data;
 }
 
-/*
- * Return the call_rcu_data structure that applies to the currently
- * running thread.  Any call_rcu_data structure assigned specifically
- * to this thread has first priority, followed by any call_rcu_data
- * structure assigned to the CPU on which the thread is running,
- * followed by the default call_rcu_data structure.  If there is not
- * yet a default call_rcu_data structure, one will be created.
- *
- * Calls to this function and use of the returned call_rcu_data should
- * be protected by RCU read-side lock.
- */
-struct call_rcu_data *get_call_rcu_data(void)
+void call_rcu_set_memory_pressure_qlen(unsigned long qlen)
 {
-	struct call_rcu_data *crd;
+	CMM_STORE_SHARED(call_rcu_pressure_qlen, qlen);
+}
 
-	if (URCU_TLS(thread_call_rcu_data) != NULL)
-		return URCU_TLS(thread_call_rcu_data);
+static void *call_rcu_pressure_thread(void *arg)
+{
+	struct pollfd fds[2];
+	int ret;
 
-	if (maxcpus > 0) {
-		crd = get_cpu_call_rcu_data(urcu_sched_getcpu());
-		if (crd)
-			return crd;
+	(void) arg;
+	fds[0].fd = call_rcu_pressure_monitor.fd;
+	fds[0].events = POLLPRI;
+	fds[1].fd = call_rcu_pressure_monitor.stop_fd[0];
+	fds[1].events = POLLIN;
+	for (;;) {
+		ret = poll(fds, 2, -1);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			urcu_die(errno);
+		}
+		if (fds[1].revents)
+			break;
+		/* The trigger is gone, e.g. its cgroup was removed. */
+		if (fds[0].revents & POLLERR)
+			break;
+		if (fds[0].revents & POLLPRI)
+			call_rcu_memory_pressure();
 	}
+	return NULL;
+}
 
-	return get_default_call_rcu_data();
+static void call_rcu_pressure_monitor_close(void)
+{
+	(void) close(call_rcu_pressure_monitor.fd);
+	(void) close(call_rcu_pressure_monitor.stop_fd[0]);
+	(void) close(call_rcu_pressure_monitor.stop_fd[1]);
+	call_rcu_pressure_monitor.active = 0;
 }
 
 /*
- * Return a pointer to this task's call_rcu_data if there is one.
+ * Start a thread calling call_rcu_memory_pressure() each time the PSI
+ * trigger written to path fires: path defaults to the system-wide
+ * memory pressure file, and can be the memory.pressure file of a cgroup.
+ * Returns 0 on success, -EBUSY if the monitor is already running, or
+ * the negated errno of the failed open() or write() of the trigger
+ * (e.g. -ENOENT without PSI support).
  */
+int call_rcu_memory_pressure_monitor_start(const char *path,
+		const char *trigger)
+{
+	ssize_t len;
+	int fd, ret = 0;
+
+	if (!path)
+		path = CALL_RCU_PRESSURE_PATH;
+	if (!trigger)
+		trigger = CALL_RCU_PRESSURE_TRIGGER;
+	call_rcu_lock(&call_rcu_pressure_mutex);
+	if (call_rcu_pressure_monitor.active) {
+		ret = -EBUSY;
+		goto end;
+	}
+	fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		ret = -errno;
+		goto end;
+	}
+	len = write(fd, trigger, strlen(trigger) + 1);
+	if (len < 0 || pipe(call_rcu_pressure_monitor.stop_fd)) {
+		ret = -errno;
+		(void) close(fd);
+		goto end;
+	}
+	call_rcu_pressure_monitor.fd = fd;
+	ret = pthread_create(&call_rcu_pressure_monitor.tid, NULL,
+			call_rcu_pressure_thread, NULL);
+	if (ret)
+		urcu_die(ret);
+	call_rcu_pressure_monitor.active = 1;
+end:
+	call_rcu_unlock(&call_rcu_pressure_mutex);
+	return ret;
+}
 
-struct call_rcu_data *get_thread_call_rcu_data(void)
+void call_rcu_memory_pressure_monitor_stop(void)
 {
-	return URCU_TLS(thread_call_rcu_data);
+	ssize_t len;
+	int ret;
+
+	call_rcu_lock(&call_rcu_pressure_mutex);
+	if (!call_rcu_pressure_monitor.active)
+		goto end;
+	do {
+		len = write(call_rcu_pressure_monitor.stop_fd[1], "", 1);
+	} while (len < 0 && errno == EINTR);
+	if (len < 0)
+		urcu_die(errno);
+	ret = pthread_join(call_rcu_pressure_monitor.tid, NULL);
+	if (ret)
+		urcu_die(ret);
+	call_rcu_pressure_monitor_close();
+end:
+	call_rcu_unlock(&call_rcu_pressure_mutex);
 }
 
 /*
- * Set this task's call_rcu_data structure as specified, regardless
- * of whether or not this task already had one.  (This allows switching
- * to and from real-time call_rcu threads, for example.)
- *
- * Use NULL to remove a thread's call_rcu_data structure, but it is
- * the caller's responsibility to dispose of the removed structure.
- * Use get_thread_call_rcu_data() to obtain a pointer to the old structure
- * (prior to NULLing it out, of course).
+ * Fetch the queue length statistics of crdp.
  */
-
-void set_thread_call_rcu_data(struct call_rcu_data *crdp)
+void call_rcu_data_get_stats(struct call_rcu_data *crdp,
+			     struct call_rcu_data_stats *stats)
 {
-	URCU_TLS(thread_call_rcu_data) = crdp;
+	stats->nr_invoked = uatomic_read(&crdp->nr_invoked)
+		+ uatomic_read(&crdp->nr_exp_invoked);
+	stats->nr_queued = uatomic_read(&crdp->nr_queued)
+		+ uatomic_read(&crdp->nr_exp_queued);
+	stats->qlen = stats->nr_queued - stats->nr_invoked;
+	stats->qlen_max = uatomic_read(&crdp->qlen_max);
+	stats->nr_throttled = uatomic_read(&crdp->nr_throttled);
+	stats->nr_stolen = uatomic_read(&crdp->nr_stolen);
+	stats->cb_cpu_ns = CMM_LOAD_SHARED(crdp->cb_cpu_ns);
 }
 
 /*
- * Create a separate call_rcu thread for each CPU.  This does not
- * replace a pre-existing call_rcu thread -- use the set_cpu_call_rcu_data()
- * function if you want that behavior. Should be paired with
- * free_all_cpu_call_rcu_data() to teardown these call_rcu worker
- * threads.
+ * Create nr_threads threads sharing the invocation of the callbacks of
+ * crdp with its call_rcu thread, once their grace period has elapsed.
+ * Returns 0 on success, -EINVAL if nr_threads is 0, and -EEXIST if
+ * crdp already has a pool.
  */
-
-int create_all_cpu_call_rcu_data(unsigned long flags)
+int call_rcu_data_create_pool(struct call_rcu_data *crdp,
+			      unsigned int nr_threads)
 {
-	int i;
-	struct call_rcu_data *crdp;
+	struct call_rcu_pool *pool;
+	unsigned int i;
 	int ret;
 
-	call_rcu_lock(&call_rcu_mutex);
-	alloc_cpu_call_rcu_data();
-	call_rcu_unlock(&call_rcu_mutex);
-	if (maxcpus <= 0) {
-		errno = EINVAL;
+	if (!nr_threads)
 		return -EINVAL;
+	call_rcu_lock(&crdp->batch_mutex);
+	if (crdp->pool) {
+		call_rcu_unlock(&crdp->batch_mutex);
+		return -EEXIST;
 	}
-	if (per_cpu_call_rcu_data == NULL) {
-		errno = ENOMEM;
-		return -ENOMEM;
-	}
-	for (i = 0; i < maxcpus; i++) {
-		call_rcu_lock(&call_rcu_mutex);
-		if (get_cpu_call_rcu_data(i)) {
-			call_rcu_unlock(&call_rcu_mutex);
-			continue;
-		}
-		crdp = __create_call_rcu_data(flags, i);
-		if (crdp == NULL) {
-			call_rcu_unlock(&call_rcu_mutex);
-			errno = ENOMEM;
-			return -ENOMEM;
-		}
-		call_rcu_unlock(&call_rcu_mutex);
-		if ((ret = set_cpu_call_rcu_data(i, crdp)) != 0) {
-			call_rcu_data_free(crdp);
-
-			/* it has been created by other thread */
-			if (ret == -EEXIST)
-				continue;
-
-			return ret;
-		}
+	pool = urcu_zalloc(URCU_ALLOC_CALL_RCU, sizeof(*pool));
+	if (!pool)
+		urcu_die(ENOMEM);
+	pool->tids = urcu_zalloc(URCU_ALLOC_CALL_RCU,
+			nr_threads * sizeof(*pool->tids));
+	if (!pool->tids)
+		urcu_die(ENOMEM);
+	cds_wfcq_init(&pool->cbs_head, &pool->cbs_tail);
+	pool->nr_threads = nr_threads;
+	for (i = 0; i < nr_threads; i++) {
+		ret = pthread_create(&pool->tids[i], NULL,
+				call_rcu_pool_thread, pool);
+		if (ret)
+			urcu_die(ret);
 	}
+	crdp->pool = pool;
+	call_rcu_unlock(&crdp->batch_mutex);
 	return 0;
 }
 
-/*
- * Wake up the call_rcu thread corresponding to the specified
- * call_rcu_data structure.
- */
-static void wake_call_rcu_thread(struct call_rcu_data *crdp)
-{
-	if (!(_CMM_LOAD_SHARED(crdp->flags) & URCU_CALL_RCU_RT))
-		call_rcu_wake_up(crdp);
-}
-
-static void _call_rcu(struct rcu_head *head,
-		      void (*func)(struct rcu_head *head),
-		      struct call_rcu_data *crdp)
+static void call_rcu_pool_free(struct call_rcu_pool *pool)
 {
-	cds_wfcq_node_init(&head->next);
-	head->func = func;
-	cds_wfcq_enqueue(&crdp->cbs_head, &crdp->cbs_tail, &head->next);
-	uatomic_inc(&crdp->qlen);
-	wake_call_rcu_thread(crdp);
+	urcu_free(URCU_ALLOC_CALL_RCU, pool->tids,
+		pool->nr_threads * sizeof(*pool->tids));
+	urcu_free(URCU_ALLOC_CALL_RCU, pool, sizeof(*pool));
 }
 
 /*
- * Schedule a function to be invoked after a following grace period.
- * This is the only function that must be called -- the others are
- * only present to allow applications to tune their use of RCU for
- * maximum performance.
- *
- * Note that unless a call_rcu thread has not already been created,
- * the first invocation of call_rcu() will create one.  So, if you
- * need the first invocation of call_rcu() to be fast, make sure
- * to create a call_rcu thread first.  One way to accomplish this is
- * "get_call_rcu_data();", and another is create_all_cpu_call_rcu_data().
- *
- * call_rcu must be called by registered RCU read-side threads.
+ * Stop and free the pool threads of a call_rcu_data.
  */
-void call_rcu(struct rcu_head *head,
-	      void (*func)(struct rcu_head *head))
+static void call_rcu_pool_destroy(struct call_rcu_pool *pool)
 {
-	struct call_rcu_data *crdp;
+	unsigned int i;
+	int ret;
 
-	/* Holding rcu read-side lock across use of per-cpu crdp */
-	rcu_read_lock();
-	crdp = get_call_rcu_data();
-	_call_rcu(head, func, crdp);
-	rcu_read_unlock();
+	uatomic_set(&pool->stop, 1);
+	call_rcu_pool_kick(pool);
+	for (i = 0; i < pool->nr_threads; i++) {
+		ret = pthread_join(pool->tids[i], NULL);
+		if (ret)
+			urcu_die(ret);
+	}
+	call_rcu_pool_free(pool);
 }
 
 /*
@@ -706,28 +2679,130 @@ void call_rcu_data_free(struct call_rcu_data *crdp)
 	if (crdp == NULL || crdp == default_call_rcu_data) {
 		return;
 	}
-	if ((uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOPPED) == 0) {
+	/* Wait for concurrent rcu_barrier() to complete. */
+	call_rcu_lock(&call_rcu_mutex);
+	while (call_rcu_barrier_active) {
+		call_rcu_unlock(&call_rcu_mutex);
+		(void) poll(NULL, 0, 1);
+		call_rcu_lock(&call_rcu_mutex);
+	}
+	call_rcu_free_active++;
+	call_rcu_free_gen++;
+	call_rcu_cache_invalidate_all();
+	call_rcu_unlock(&call_rcu_mutex);
+	/* Wait for throttled call_rcu() callers to release crdp. */
+	while (uatomic_read(&crdp->nr_throttling))
+		poll(NULL, 0, 1);
+	/* Wait for the batch stolen from crdp to be invoked. */
+	call_rcu_lock(&call_rcu_steal_mutex);
+	cds_list_del_init(&crdp->steal_list);
+	call_rcu_unlock(&call_rcu_steal_mutex);
+	while (uatomic_read(&crdp->steal_active))
+		poll(NULL, 0, 1);
+	if (uatomic_read(&crdp->flags) & URCU_CALL_RCU_MANUAL) {
+		/* No thread: complete the batch awaiting its grace period. */
+		call_rcu_lock(&crdp->batch_mutex);
+		call_rcu_flush_gp_batch(crdp);
+		call_rcu_unlock(&crdp->batch_mutex);
+	} else if ((uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOPPED) == 0) {
 		uatomic_or(&crdp->flags, URCU_CALL_RCU_STOP);
 		wake_call_rcu_thread(crdp);
 		while ((uatomic_read(&crdp->flags) & URCU_CALL_RCU_STOPPED) == 0)
 			poll(NULL, 0, 1);
 	}
-	if (!cds_wfcq_empty(&crdp->cbs_head, &crdp->cbs_tail)) {
+	if (!cds_wfcq_empty(&crdp->cbs_head, &crdp->cbs_tail)
+			|| call_rcu_exp_pending(crdp)
+			|| !cds_wfcq_empty(&crdp->gp_batch.head,
+				&crdp->gp_batch.tail)) {
 		/* Create default call rcu data if need be */
 		(void) get_default_call_rcu_data();
+		uatomic_add(&default_call_rcu_data->nr_queued,
+			    uatomic_read(&crdp->nr_queued)
+			    - uatomic_read(&crdp->nr_invoked));
+		/*
+		 * Batch kept across a fork in fork-fast mode, older than
+		 * the queued callbacks.
+		 */
+		__cds_wfcq_splice_blocking(&default_call_rcu_data->cbs_head,
+			&default_call_rcu_data->cbs_tail,
+			&crdp->gp_batch.head, &crdp->gp_batch.tail);
 		__cds_wfcq_splice_blocking(&default_call_rcu_data->cbs_head,
 			&default_call_rcu_data->cbs_tail,
 			&crdp->cbs_head, &crdp->cbs_tail);
-		uatomic_add(&default_call_rcu_data->qlen,
-			    uatomic_read(&crdp->qlen));
+		uatomic_add(&default_call_rcu_data->nr_exp_queued,
+			    uatomic_read(&crdp->nr_exp_queued)
+			    - uatomic_read(&crdp->nr_exp_invoked));
+		__cds_wfcq_splice_blocking(&default_call_rcu_data->exp_cbs_head,
+			&default_call_rcu_data->exp_cbs_tail,
+			&crdp->exp_cbs_head, &crdp->exp_cbs_tail);
+		call_rcu_delay_wake_up(default_call_rcu_data);
 		wake_call_rcu_thread(default_call_rcu_data);
 	}
 
 	call_rcu_lock(&call_rcu_mutex);
 	cds_list_del(&crdp->list);
+	call_rcu_free_active--;
 	call_rcu_unlock(&call_rcu_mutex);
 
-	free(crdp);
+	if (crdp->pool)
+		call_rcu_pool_destroy(crdp->pool);
+	urcu_cacheline_free(URCU_ALLOC_CALL_RCU, crdp, sizeof(*crdp));
+}
+
+/*
+ * Invoke the callbacks of a URCU_CALL_RCU_MANUAL call_rcu_data whose
+ * grace period has completed, and start a grace period for the
+ * callbacks queued since the previous batch. Never waits for a grace
+ * period: the grace periods are driven by the default call_rcu thread,
+ * as for start_poll_synchronize_rcu(), while the callbacks run in the
+ * caller. Returns the number of callbacks invoked.
+ */
+unsigned long call_rcu_data_poll(struct call_rcu_data *crdp)
+{
+	struct call_rcu_gp_batch *batch = &crdp->gp_batch;
+	enum cds_wfcq_ret splice_ret;
+	unsigned long cbcount = 0;
+
+	if (uatomic_read(&crdp->flags) & URCU_CALL_RCU_WORKQUEUE) {
+		/* No grace period to wait for. */
+		cbcount = uatomic_read(&crdp->nr_invoked);
+		(void) call_rcu_process_batch(crdp, 0);
+		return uatomic_read(&crdp->nr_invoked) - cbcount;
+	}
+	call_rcu_lock(&crdp->batch_mutex);
+	if (!cds_wfcq_empty(&batch->head, &batch->tail)) {
+		if (!poll_state_synchronize_rcu(batch->gp_state))
+			goto end;
+		cbcount = call_rcu_invoke_batch(crdp, &batch->head,
+			&batch->tail);
+		call_rcu_batch_done(crdp, cbcount, 0);
+		cds_wfcq_init(&batch->head, &batch->tail);
+	}
+	splice_ret = __cds_wfcq_splice_blocking(&batch->head, &batch->tail,
+		&crdp->cbs_head, &crdp->cbs_tail);
+	assert(splice_ret != CDS_WFCQ_RET_WOULDBLOCK);
+	assert(splice_ret != CDS_WFCQ_RET_DEST_NON_EMPTY);
+	if (splice_ret != CDS_WFCQ_RET_SRC_EMPTY)
+		batch->gp_state = start_poll_synchronize_rcu();
+end:
+	call_rcu_unlock(&crdp->batch_mutex);
+	return cbcount;
+}
+
+/*
+ * Queue a work item on a URCU_CALL_RCU_WORKQUEUE call_rcu_data, to be
+ * invoked without waiting for a grace period. The caller keeps crdp
+ * alive, and is throttled as call_rcu() callers are.
+ */
+void call_rcu_data_queue_work(struct call_rcu_data *crdp,
+			      struct rcu_head *head,
+			      void (*func)(struct rcu_head *head))
+{
+	unsigned long qlen;
+
+	qlen = __call_rcu(head, func, crdp, 0);
+	if (caa_unlikely(call_rcu_throttle_get(crdp, qlen)))
+		call_rcu_throttle(crdp);
 }
 
 /*
@@ -742,7 +2817,7 @@ void free_all_cpu_call_rcu_data(void)
 	if (maxcpus <= 0)
 		return;
 
-	crdp = malloc(sizeof(*crdp) * maxcpus);
+	crdp = urcu_alloc(URCU_ALLOC_CALL_RCU, sizeof(*crdp) * maxcpus);
 	if (!crdp) {
 		if (!warned) {
 			fprintf(stderr, "[error] liburcu: unable to allocate per-CPU pointer array\n");
@@ -752,10 +2827,19 @@ void free_all_cpu_call_rcu_data(void)
 	}
 
 	for (cpu = 0; cpu < maxcpus; cpu++) {
+		int i;
+
 		crdp[cpu] = get_cpu_call_rcu_data(cpu);
 		if (crdp[cpu] == NULL)
 			continue;
 		set_cpu_call_rcu_data(cpu, NULL);
+		/* Per-node call_rcu_data are shared by several CPUs. */
+		for (i = 0; i < cpu; i++) {
+			if (crdp[i] == crdp[cpu]) {
+				crdp[cpu] = NULL;
+				break;
+			}
+		}
 	}
 	/*
 	 * Wait for call_rcu sites acting as RCU readers of the
@@ -767,41 +2851,102 @@ void free_all_cpu_call_rcu_data(void)
 			continue;
 		call_rcu_data_free(crdp[cpu]);
 	}
-	free(crdp);
+	urcu_free(URCU_ALLOC_CALL_RCU, crdp, sizeof(*crdp) * maxcpus);
 }
 
+/*
+ * Wait for the callbacks queued on crdp up to the seq and exp_seq
+ * sequences to be invoked, or until deadline_ns is reached if timed.
+ * Returns 0 on completion, -ETIMEDOUT on timeout.
+ */
 static
-void free_completion(struct urcu_ref *ref)
+int call_rcu_data_wait(struct call_rcu_data *crdp, unsigned long seq,
+		unsigned long exp_seq, int timed, uint64_t deadline_ns)
 {
-	struct call_rcu_completion *completion;
+	for (;;) {
+		struct timespec ts;
+
+		uatomic_set(&call_rcu_barrier_futex, -1);
+		/* Set futex before reading nr_invoked */
+		cmm_smp_mb();
+		if ((long) (uatomic_read(&crdp->nr_invoked) - seq) >= 0
+				&& (long) (uatomic_read(&crdp->nr_exp_invoked)
+					- exp_seq) >= 0)
+			return 0;
+		if (!timed) {
+			call_rcu_barrier_wait(NULL);
+			continue;
+		}
+		if (!urcu_wait_deadline_ts(deadline_ns, &ts))
+			return -ETIMEDOUT;
+		call_rcu_barrier_wait(&ts);
+	}
+}
 
-	completion = caa_container_of(ref, struct call_rcu_completion, ref);
-	free(completion);
+/* Wait for the callbacks queued on crdp so far. */
+static
+int call_rcu_data_wait_queued(struct call_rcu_data *crdp, int timed,
+		uint64_t deadline_ns)
+{
+	return call_rcu_data_wait(crdp, uatomic_read(&crdp->nr_queued),
+		uatomic_read(&crdp->nr_exp_queued), timed, deadline_ns);
 }
 
+/*
+ * Wait for the callbacks of the tickets of the current thread, if they
+ * are still valid. Returns -EAGAIN if they are not. Called with
+ * call_rcu_barrier_active set.
+ */
 static
-void _rcu_barrier_complete(struct rcu_head *head)
+int call_rcu_thread_wait(int timed, uint64_t deadline_ns)
 {
-	struct call_rcu_completion_work *work;
-	struct call_rcu_completion *completion;
+	struct call_rcu_thread_tickets *tickets = &URCU_TLS(call_rcu_tickets);
+	struct call_rcu_ticket *ticket;
+	unsigned int i;
+	int ret;
 
-	work = caa_container_of(head, struct call_rcu_completion_work, head);
-	completion = work->completion;
-	if (!uatomic_sub_return(&completion->barrier_count, 1))
-		call_rcu_completion_wake_up(completion);
-	urcu_ref_put(&completion->ref, free_completion);
-	free(work);
+	call_rcu_lock(&call_rcu_mutex);
+	ret = tickets->overflow
+		|| tickets->free_gen != call_rcu_free_gen;
+	call_rcu_unlock(&call_rcu_mutex);
+	if (ret && tickets->nr)
+		return -EAGAIN;
+	for (i = 0; i < tickets->nr; i++) {
+		ticket = &tickets->ticket[i];
+		ret = call_rcu_data_wait(ticket->crdp, ticket->seq,
+			ticket->exp_seq, timed, deadline_ns);
+		if (ret)
+			return ret;
+	}
+	return 0;
 }
 
 /*
- * Wait for all in-flight call_rcu callbacks to complete execution.
+ * Wait for in-flight call_rcu callbacks to complete execution, or
+ * until deadline_ns (from urcu_wait_now_ns()) is reached if timed:
+ * those of scope if non-NULL, those queued by the current thread if
+ * thread is set, all of them otherwise. Returns 0 on completion,
+ * -ETIMEDOUT on timeout.
+ *
+ * Rather than queuing a callback on each call_rcu_data, compare the
+ * queued and invoked callback sequences of each of them: neither
+ * memory allocation nor queue traffic is needed.
  */
-void rcu_barrier(void)
+static
+int _rcu_barrier(struct call_rcu_data *scope, int thread, int timed,
+		uint64_t deadline_ns)
 {
+	struct call_rcu_thread_tickets *tickets = &URCU_TLS(call_rcu_tickets);
 	struct call_rcu_data *crdp;
-	struct call_rcu_completion *completion;
-	int count = 0;
-	int was_online;
+	int was_online, ret = 0;
+
+	urcu_tp(rcu_barrier_begin);
+	/*
+	 * Queue the pointers collected by free_rcu() and the callbacks
+	 * collected by call_rcu() in this thread.
+	 */
+	free_rcu_flush();
+	call_rcu_local_flush();
 
 	/* Put in offline state in QSBR. */
 	was_online = rcu_read_ongoing();
@@ -818,47 +2963,102 @@ void rcu_barrier(void)
 			fprintf(stderr, "[error] liburcu: rcu_barrier() called from within RCU read-side critical section.\n");
 		}
 		warned = 1;
+		ret = -EINVAL;
 		goto online;
 	}
 
-	completion = calloc(sizeof(*completion), 1);
-	if (!completion)
-		urcu_die(errno);
-
+	/*
+	 * Wait for concurrent call_rcu_data_free() to move the callbacks
+	 * of the call_rcu_data it frees to the default call_rcu_data.
+	 */
 	call_rcu_lock(&call_rcu_mutex);
-	cds_list_for_each_entry(crdp, &call_rcu_data_list, list)
-		count++;
-
-	/* Referenced by rcu_barrier() and each call_rcu thread. */
-	urcu_ref_set(&completion->ref, count + 1);
-	completion->barrier_count = count;
-
-	cds_list_for_each_entry(crdp, &call_rcu_data_list, list) {
-		struct call_rcu_completion_work *work;
-
-		work = calloc(sizeof(*work), 1);
-		if (!work)
-			urcu_die(errno);
-		work->completion = completion;
-		_call_rcu(&work->head, _rcu_barrier_complete, crdp);
+	while (call_rcu_free_active) {
+		call_rcu_unlock(&call_rcu_mutex);
+		if (timed && urcu_wait_now_ns() >= deadline_ns) {
+			ret = -ETIMEDOUT;
+			goto online;
+		}
+		(void) poll(NULL, 0, 1);
+		call_rcu_lock(&call_rcu_mutex);
 	}
-	call_rcu_unlock(&call_rcu_mutex);
+	call_rcu_barrier_active++;
 
-	/* Wait for them */
-	for (;;) {
-		uatomic_dec(&completion->futex);
-		/* Decrement futex before reading barrier_count */
-		cmm_smp_mb();
-		if (!uatomic_read(&completion->barrier_count))
+	/*
+	 * The call_rcu_data structures cannot be freed while
+	 * call_rcu_barrier_active is set: only hold call_rcu_mutex to
+	 * walk the list, not while waiting.
+	 */
+	if (scope) {
+		call_rcu_unlock(&call_rcu_mutex);
+		ret = call_rcu_data_wait_queued(scope, timed, deadline_ns);
+		call_rcu_lock(&call_rcu_mutex);
+		goto end;
+	}
+	if (thread) {
+		call_rcu_unlock(&call_rcu_mutex);
+		ret = call_rcu_thread_wait(timed, deadline_ns);
+		call_rcu_lock(&call_rcu_mutex);
+		if (ret != -EAGAIN)
+			goto thread_end;
+		/* The tickets are stale: wait for all callbacks. */
+		ret = 0;
+	}
+	cds_list_for_each_entry(crdp, &call_rcu_data_list, list) {
+		call_rcu_unlock(&call_rcu_mutex);
+		ret = call_rcu_data_wait_queued(crdp, timed, deadline_ns);
+		call_rcu_lock(&call_rcu_mutex);
+		if (ret)
 			break;
-		call_rcu_completion_wait(completion);
 	}
-
-	urcu_ref_put(&completion->ref, free_completion);
+thread_end:
+	/* Callbacks queued by this thread so far have been invoked. */
+	if (!ret) {
+		tickets->nr = 0;
+		tickets->overflow = 0;
+		/* The cache points to a ticket. */
+		URCU_TLS(call_rcu_cache).gen = NULL;
+	}
+end:
+	call_rcu_barrier_active--;
+	call_rcu_unlock(&call_rcu_mutex);
 
 online:
 	if (was_online)
 		rcu_thread_online();
+	urcu_tp(rcu_barrier_end);
+	return ret;
+}
+
+void rcu_barrier(void)
+{
+	(void) _rcu_barrier(NULL, 0, 0, 0);
+}
+
+/*
+ * Wait for the callbacks queued on crdp before the call to complete
+ * execution, including those collected by free_rcu() and call_rcu() in
+ * the current thread.
+ */
+void call_rcu_data_barrier(struct call_rcu_data *crdp)
+{
+	(void) _rcu_barrier(crdp, 0, 0, 0);
+}
+
+/*
+ * Wait for the callbacks queued by the current thread to complete
+ * execution. Falls back to rcu_barrier() if the thread queued callbacks
+ * on more call_rcu_data than it keeps track of, or if a call_rcu_data
+ * was freed since (its callbacks then moved to the default one).
+ */
+void rcu_barrier_thread(void)
+{
+	(void) _rcu_barrier(NULL, 1, 0, 0);
+}
+
+int rcu_barrier_timeout(unsigned long timeout_ms)
+{
+	return _rcu_barrier(NULL, 0, 1,
+		urcu_wait_now_ns() + timeout_ms * 1000000ULL);
 }
 
 /*
@@ -874,14 +3074,21 @@ void call_rcu_before_fork(void)
 	call_rcu_lock(&call_rcu_mutex);
 
 	cds_list_for_each_entry(crdp, &call_rcu_data_list, list) {
+		if (uatomic_read(&crdp->flags) & URCU_CALL_RCU_MANUAL)
+			continue;
 		uatomic_or(&crdp->flags, URCU_CALL_RCU_PAUSE);
 		cmm_smp_mb__after_uatomic_or();
 		wake_call_rcu_thread(crdp);
+		call_rcu_delay_wake_up(crdp);
 	}
 	cds_list_for_each_entry(crdp, &call_rcu_data_list, list) {
-		while ((uatomic_read(&crdp->flags) & URCU_CALL_RCU_PAUSED) == 0)
-			poll(NULL, 0, 1);
+		if (uatomic_read(&crdp->flags) & URCU_CALL_RCU_MANUAL)
+			continue;
+		call_rcu_pause_wait(crdp, URCU_CALL_RCU_PAUSED,
+			URCU_CALL_RCU_PAUSED);
 	}
+	/* Also taken by call_rcu_data_free() and throttled callers. */
+	call_rcu_lock(&call_rcu_steal_mutex);
 }
 
 /*
@@ -893,12 +3100,12 @@ void call_rcu_after_fork_parent(void)
 {
 	struct call_rcu_data *crdp;
 
+	call_rcu_unlock(&call_rcu_steal_mutex);
 	cds_list_for_each_entry(crdp, &call_rcu_data_list, list)
 		uatomic_and(&crdp->flags, ~URCU_CALL_RCU_PAUSE);
-	cds_list_for_each_entry(crdp, &call_rcu_data_list, list) {
-		while ((uatomic_read(&crdp->flags) & URCU_CALL_RCU_PAUSED) != 0)
-			poll(NULL, 0, 1);
-	}
+	call_rcu_pause_wake_up();
+	cds_list_for_each_entry(crdp, &call_rcu_data_list, list)
+		call_rcu_pause_wait(crdp, URCU_CALL_RCU_PAUSED, 0);
 	call_rcu_unlock(&call_rcu_mutex);
 }
 
@@ -911,8 +3118,15 @@ void call_rcu_after_fork_child(void)
 {
 	struct call_rcu_data *crdp, *next;
 
-	/* Release the mutex. */
+	/* Release the mutexes. */
+	call_rcu_unlock(&call_rcu_steal_mutex);
 	call_rcu_unlock(&call_rcu_mutex);
+	/* Concurrent rcu_barrier() and call_rcu_data_free() did not survive. */
+	call_rcu_barrier_active = 0;
+	call_rcu_free_active = 0;
+	/* Neither did the memory pressure monitor thread. */
+	if (call_rcu_pressure_monitor.active)
+		call_rcu_pressure_monitor_close();
 
 	/* Do nothing when call_rcu() has not been used */
 	if (cds_list_empty(&call_rcu_data_list))
@@ -926,10 +3140,13 @@ void call_rcu_after_fork_child(void)
 	(void)get_default_call_rcu_data();
 
 	/* Cleanup call_rcu_data pointers before use */
+	urcu_free(URCU_ALLOC_CALL_RCU, per_cpu_call_rcu_data,
+		maxcpus * sizeof(*per_cpu_call_rcu_data));
 	maxcpus_reset();
-	free(per_cpu_call_rcu_data);
 	rcu_set_pointer(&per_cpu_call_rcu_data, NULL);
 	URCU_TLS(thread_call_rcu_data) = NULL;
+	URCU_TLS(call_rcu_cache).gen = NULL;
+	call_rcu_cache_invalidate_all();
 
 	/*
 	 * Dispose of all of the rest of the call_rcu_data structures.
@@ -939,7 +3156,14 @@ void call_rcu_after_fork_child(void)
 	cds_list_for_each_entry_safe(crdp, next, &call_rcu_data_list, list) {
 		if (crdp == default_call_rcu_data)
 			continue;
-		uatomic_set(&crdp->flags, URCU_CALL_RCU_STOPPED);
+		uatomic_set(&crdp->flags, URCU_CALL_RCU_STOPPED
+			| (uatomic_read(&crdp->flags) & URCU_CALL_RCU_MANUAL));
+		/* Throttled callers and pool threads did not survive. */
+		uatomic_set(&crdp->nr_throttling, 0);
+		if (crdp->pool) {
+			call_rcu_pool_free(crdp->pool);
+			crdp->pool = NULL;
+		}
 		call_rcu_data_free(crdp);
 	}
 }
@@ -50,6 +50,13 @@ struct call_rcu_data;
 #define URCU_CALL_RCU_STOPPED	(1U << 3)
 #define URCU_CALL_RCU_PAUSE	(1U << 4)
 #define URCU_CALL_RCU_PAUSED	(1U << 5)
+#define URCU_CALL_RCU_SHARED_GP	(1U << 6)
+#define URCU_CALL_RCU_ADAPTIVE	(1U << 7)
+#define URCU_CALL_RCU_LIMIT_HELP	(1U << 8)
+#define URCU_CALL_RCU_MANUAL	(1U << 9)
+#define URCU_CALL_RCU_FORK_FAST	(1U << 10)
+#define URCU_CALL_RCU_WORKQUEUE	(1U << 11)
+#define URCU_CALL_RCU_STEAL	(1U << 12)
 
 /*
  * The rcu_head data structure is placed in the structure to be freed
@@ -61,6 +68,35 @@ struct rcu_head {
 	void (*func)(struct rcu_head *head);
 };
 
+/*
+ * The rcu_typed_head data structure is placed in the structures queued
+ * on a typed callback queue, see call_rcu_typed_queue_create(): the
+ * batch handler of the queue is known, so it only holds the link.
+ */
+
+struct rcu_typed_head {
+	struct cds_wfcq_node next;
+};
+
+/* Note that struct call_rcu_typed_queue is opaque to callers. */
+
+struct call_rcu_typed_queue;
+
+/*
+ * Queue length and worker statistics of a call_rcu_data, see
+ * call_rcu_data_get_stats().
+ */
+
+struct call_rcu_data_stats {
+	unsigned long qlen;		/* current queue length */
+	unsigned long qlen_max;		/* queue length high-water mark */
+	unsigned long nr_throttled;	/* throttled call_rcu() calls */
+	unsigned long nr_queued;	/* callbacks queued */
+	unsigned long nr_invoked;	/* callbacks invoked */
+	unsigned long nr_stolen;	/* invoked for other call_rcu_data */
+	unsigned long long cb_cpu_ns;	/* CPU time invoking callbacks */
+};
+
 /*
  * Exported functions
  *
@@ -71,10 +107,45 @@ struct rcu_head {
 
 void call_rcu(struct rcu_head *head,
 	      void (*func)(struct rcu_head *head));
+void call_rcu_expedited(struct rcu_head *head,
+	      void (*func)(struct rcu_head *head));
 
 struct call_rcu_data *create_call_rcu_data(unsigned long flags,
 					   int cpu_affinity);
 void call_rcu_data_free(struct call_rcu_data *crdp);
+void call_rcu_data_set_high_watermark(struct call_rcu_data *crdp,
+				      unsigned long qlen);
+void call_rcu_data_set_qlen_limit(struct call_rcu_data *crdp,
+				  unsigned long limit);
+void call_rcu_data_set_rt_delay(struct call_rcu_data *crdp,
+				unsigned long spin_us, unsigned long pause_us);
+void call_rcu_data_get_stats(struct call_rcu_data *crdp,
+			     struct call_rcu_data_stats *stats);
+int call_rcu_data_create_pool(struct call_rcu_data *crdp,
+			      unsigned int nr_threads);
+unsigned long call_rcu_data_poll(struct call_rcu_data *crdp);
+void call_rcu_data_queue_work(struct call_rcu_data *crdp,
+			      struct rcu_head *head,
+			      void (*func)(struct rcu_head *head));
+
+void call_rcu_memory_pressure(void);
+void call_rcu_set_memory_pressure_qlen(unsigned long qlen);
+int call_rcu_memory_pressure_monitor_start(const char *path,
+					   const char *trigger);
+void call_rcu_memory_pressure_monitor_stop(void);
+
+void call_rcu_set_local_batch(unsigned long nr);
+void call_rcu_local_flush(void);
+
+void free_rcu(void *ptr);
+void free_rcu_flush(void);
+
+struct call_rcu_typed_queue *call_rcu_typed_queue_create(
+		void (*handler)(struct rcu_typed_head **heads, size_t nr));
+void call_rcu_typed_queue_destroy(struct call_rcu_typed_queue *q);
+void call_rcu_typed(struct call_rcu_typed_queue *q,
+		    struct rcu_typed_head *head);
+void call_rcu_typed_barrier(struct call_rcu_typed_queue *q);
 
 struct call_rcu_data *get_default_call_rcu_data(void);
 struct call_rcu_data *get_cpu_call_rcu_data(int cpu);
@@ -86,6 +157,8 @@ void set_thread_call_rcu_data(struct call_rcu_data *crdp);
 int set_cpu_call_rcu_data(int cpu, struct call_rcu_data *crdp);
 
 int create_all_cpu_call_rcu_data(unsigned long flags);
+int create_all_node_call_rcu_data(unsigned long flags);
+int create_all_llc_call_rcu_data(unsigned long flags);
 void free_all_cpu_call_rcu_data(void);
 
 void call_rcu_before_fork(void);
@@ -93,6 +166,9 @@ void call_rcu_after_fork_parent(void);
 void call_rcu_after_fork_child(void);
 
 void rcu_barrier(void);
+int rcu_barrier_timeout(unsigned long timeout_ms);
+void call_rcu_data_barrier(struct call_rcu_data *crdp);
+void rcu_barrier_thread(void);
 
 #ifdef __cplusplus 
 }
@@ -41,21 +41,22 @@
 #include <unistd.h>
 #include <stdint.h>
 
-#include "urcu/futex.h"
-
 #include <urcu/compiler.h>
 #include <urcu/arch.h>
 #include <urcu/uatomic.h>
 #include <urcu/list.h>
 #include <urcu/system.h>
 #include <urcu/tls-compat.h>
+#include <urcu/alloc.h>
 #include "urcu-die.h"
 
 /*
- * Number of entries in the per-thread defer queue. Must be power of 2.
+ * Initial number of entries in the per-thread defer queue. Must be power
+ * of 2. The queue grows on demand by chaining rings of twice the size
+ * of the last one, up to DEFER_QUEUE_MAX_SIZE entries.
  */
 #define DEFER_QUEUE_SIZE	(1 << 12)
-#define DEFER_QUEUE_MASK	(DEFER_QUEUE_SIZE - 1)
+#define DEFER_QUEUE_MAX_SIZE	(1 << 24)
 
 /*
  * Typically, data is aligned at least on the architecture size.
@@ -90,6 +91,22 @@
 #define rcu_assert(args...)
 #endif
 
+/*
+ * defer ring.
+ * Circular buffer indexed by the defer queue head and tail. When a ring
+ * is full, its owner thread sets "end" to the head index, publishes a
+ * larger ring in "next", and queues the following elements in the new
+ * ring. The reclamation thread frees a ring once it has consumed the
+ * elements up to "end" and moved on to the next ring.
+ */
+struct defer_ring {
+	unsigned long mask;		/* number of entries - 1 */
+	unsigned long first;		/* index of the first element */
+	unsigned long end;		/* index past the last element */
+	struct defer_ring *next;	/* next ring, NULL if current */
+	void *q[];
+};
+
 /*
  * defer queue.
  * Contains pointers. Encoded to save space when same callback is often used.
@@ -106,7 +123,13 @@ struct defer_queue {
 	void *last_fct_in;	/* last fct pointer encoded */
 	unsigned long tail;	/* next element to remove at tail */
 	void *last_fct_out;	/* last fct pointer encoded */
-	void **q;
+	struct defer_ring *head_ring;	/* ring written by owner */
+	struct defer_ring *tail_ring;	/* ring read by reclamation */
+	pthread_mutex_t lock;	/* protects tail, tail_ring, last_fct_out */
+	/* drain by the call_rcu worker threads */
+	struct rcu_head rcu_head;
+	unsigned long drain_target;	/* drain up to this head */
+	int32_t drain_pending;		/* rcu_head queued */
 	/* registry information */
 	unsigned long last_head;
 	struct cds_list_head list;	/* list of thread queues */
@@ -120,26 +143,30 @@ void __attribute__((destructor)) rcu_defer_exit(void);
 extern void synchronize_rcu(void);
 
 /*
- * rcu_defer_mutex nests inside defer_thread_mutex.
+ * The defer queues are drained by the call_rcu worker threads, sharing
+ * their grace periods: expects to be included after
+ * urcu-call-rcu-impl.h. rcu_defer_mutex protects the registry, walked
+ * by rcu_defer_barrier(). Each queue lock nests inside rcu_defer_mutex.
  */
 static pthread_mutex_t rcu_defer_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t defer_thread_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-static int32_t defer_thread_futex;
-static int32_t defer_thread_stop;
 
 /*
  * Written to only by each individual deferer. Read by both the deferer and
- * the reclamation tread.
+ * the reclamation threads.
  */
 static DEFINE_URCU_TLS(struct defer_queue, defer_queue);
 static CDS_LIST_HEAD(registry_defer);
-static pthread_t tid_defer;
 
 static void mutex_lock_defer(pthread_mutex_t *mutex)
 {
+	struct rcu_lock_stats_state *ls =
+		rcu_lock_stats_of(mutex, &rcu_defer_mutex, RCU_LOCK_DEFER);
+	uint64_t wait_start;
 	int ret;
 
+	wait_start = rcu_lock_stats_trylock(ls, mutex);
+	if (!wait_start)
+		return;
 #ifndef DISTRUST_SIGNALS_EXTREME
 	ret = pthread_mutex_lock(mutex);
 	if (ret)
@@ -151,57 +178,36 @@ static void mutex_lock_defer(pthread_mutex_t *mutex)
 		poll(NULL,0,10);
 	}
 #endif /* #else #ifndef DISTRUST_SIGNALS_EXTREME */
+	rcu_lock_stats_acquired(ls, wait_start);
 }
 
-/*
- * Wake-up any waiting defer thread. Called from many concurrent threads.
- */
-static void wake_up_defer(void)
+static void mutex_unlock_defer(pthread_mutex_t *mutex)
 {
-	if (caa_unlikely(uatomic_read(&defer_thread_futex) == -1)) {
-		uatomic_set(&defer_thread_futex, 0);
-		futex_noasync(&defer_thread_futex, FUTEX_WAKE, 1,
-		      NULL, NULL, 0);
-	}
+	rcu_lock_stats_release(rcu_lock_stats_of(mutex, &rcu_defer_mutex,
+			RCU_LOCK_DEFER));
+	mutex_unlock(mutex);
 }
 
-static unsigned long rcu_defer_num_callbacks(void)
+static struct defer_ring *alloc_defer_ring(unsigned long size,
+		unsigned long first)
 {
-	unsigned long num_items = 0, head;
-	struct defer_queue *index;
-
-	mutex_lock_defer(&rcu_defer_mutex);
-	cds_list_for_each_entry(index, &registry_defer, list) {
-		head = CMM_LOAD_SHARED(index->head);
-		num_items += head - index->tail;
-	}
-	mutex_unlock(&rcu_defer_mutex);
-	return num_items;
+	struct defer_ring *ring;
+
+	ring = urcu_alloc(URCU_ALLOC_DEFER,
+			sizeof(*ring) + sizeof(void *) * size);
+	if (!ring)
+		return NULL;
+	ring->mask = size - 1;
+	ring->first = first;
+	ring->end = 0;
+	ring->next = NULL;
+	return ring;
 }
 
-/*
- * Defer thread waiting. Single thread.
- */
-static void wait_defer(void)
+static void free_defer_ring(struct defer_ring *ring)
 {
-	uatomic_dec(&defer_thread_futex);
-	/* Write futex before read queue */
-	/* Write futex before read defer_thread_stop */
-	cmm_smp_mb();
-	if (_CMM_LOAD_SHARED(defer_thread_stop)) {
-		uatomic_set(&defer_thread_futex, 0);
-		pthread_exit(0);
-	}
-	if (rcu_defer_num_callbacks()) {
-		cmm_smp_mb();	/* Read queue before write futex */
-		/* Callbacks are queued, don't wait. */
-		uatomic_set(&defer_thread_futex, 0);
-	} else {
-		cmm_smp_rmb();	/* Read queue before read futex */
-		if (uatomic_read(&defer_thread_futex) == -1)
-			futex_noasync(&defer_thread_futex, FUTEX_WAIT, -1,
-			      NULL, NULL, 0);
-	}
+	urcu_free(URCU_ALLOC_DEFER, ring,
+		sizeof(*ring) + sizeof(void *) * (ring->mask + 1));
 }
 
 /*
@@ -213,23 +219,41 @@ static void rcu_defer_barrier_queue(struct defer_queue *queue,
 	unsigned long i;
 	void (*fct)(void *p);
 	void *p;
+	struct defer_ring *ring, *next;
+	unsigned long mask;
 
 	/*
-	 * Tail is only modified when lock is held.
-	 * Head is only modified by owner thread.
+	 * Tail and tail_ring are only modified when the queue lock is
+	 * held. Head, head_ring and ring "end" and "next" are only
+	 * modified by owner thread.
 	 */
 
+	rcu_stats_defer_qlen(head - queue->tail);
+	ring = queue->tail_ring;
+	mask = ring->mask;
 	for (i = queue->tail; i != head;) {
-		cmm_smp_rmb();       /* read head before q[]. */
-		p = CMM_LOAD_SHARED(queue->q[i++ & DEFER_QUEUE_MASK]);
+		cmm_smp_rmb();       /* read head before q[] and next. */
+		next = CMM_LOAD_SHARED(ring->next);
+		if (caa_unlikely(next)) {
+			cmm_smp_rmb();	/* read next before end. */
+			if (i == CMM_LOAD_SHARED(ring->end)) {
+				/* Owner thread moved on to the next ring. */
+				free_defer_ring(ring);
+				ring = next;
+				mask = ring->mask;
+				queue->tail_ring = ring;
+				continue;
+			}
+		}
+		p = CMM_LOAD_SHARED(ring->q[i++ & mask]);
 		if (caa_unlikely(DQ_IS_FCT_BIT(p))) {
 			DQ_CLEAR_FCT_BIT(p);
 			queue->last_fct_out = p;
-			p = CMM_LOAD_SHARED(queue->q[i++ & DEFER_QUEUE_MASK]);
+			p = CMM_LOAD_SHARED(ring->q[i++ & mask]);
 		} else if (caa_unlikely(p == DQ_FCT_MARK)) {
-			p = CMM_LOAD_SHARED(queue->q[i++ & DEFER_QUEUE_MASK]);
+			p = CMM_LOAD_SHARED(ring->q[i++ & mask]);
 			queue->last_fct_out = p;
-			p = CMM_LOAD_SHARED(queue->q[i++ & DEFER_QUEUE_MASK]);
+			p = CMM_LOAD_SHARED(ring->q[i++ & mask]);
 		}
 		fct = queue->last_fct_out;
 		fct(p);
@@ -238,23 +262,73 @@ static void rcu_defer_barrier_queue(struct defer_queue *queue,
 	CMM_STORE_SHARED(queue->tail, i);
 }
 
+/*
+ * Execute the callbacks of queue up to head, unless already executed.
+ * Must be called after Q.S. is reached.
+ */
+static void defer_queue_drain(struct defer_queue *queue, unsigned long head)
+{
+	mutex_lock_defer(&queue->lock);
+	if ((long) (head - queue->tail) > 0)
+		rcu_defer_barrier_queue(queue, head);
+	mutex_unlock_defer(&queue->lock);
+}
+
+static void defer_queue_drain_cb(struct rcu_head *head);
+
+/*
+ * Queue the drain of queue up to its current head after a grace
+ * period on crdp, unless a drain is already pending. Called by the
+ * owner thread, with the default call_rcu_data, and by the drain
+ * callback.
+ */
+static void defer_queue_schedule_drain(struct defer_queue *queue,
+		struct call_rcu_data *crdp)
+{
+	if (uatomic_read(&queue->drain_pending)
+			|| uatomic_cmpxchg(&queue->drain_pending, 0, 1))
+		return;
+	queue->drain_target = CMM_LOAD_SHARED(queue->head);
+	call_rcu_enqueue(&queue->rcu_head, defer_queue_drain_cb, crdp);
+}
+
+/*
+ * Invoked by a call_rcu worker thread after the grace period following
+ * defer_queue_schedule_drain(). Callbacks queued in the meantime need
+ * another grace period: re-arm if needed. The queue lock is only
+ * released once the queue is not used anymore, see
+ * rcu_defer_unregister_thread().
+ */
+static void defer_queue_drain_cb(struct rcu_head *head)
+{
+	struct defer_queue *queue =
+		caa_container_of(head, struct defer_queue, rcu_head);
+
+	mutex_lock_defer(&queue->lock);
+	if ((long) (queue->drain_target - queue->tail) > 0)
+		rcu_defer_barrier_queue(queue, queue->drain_target);
+	uatomic_set(&queue->drain_pending, 0);
+	cmm_smp_mb();	/* Write drain_pending before read head */
+	if (CMM_LOAD_SHARED(queue->head) != queue->tail)
+		defer_queue_schedule_drain(queue, get_call_rcu_data());
+	mutex_unlock_defer(&queue->lock);
+}
+
 static void _rcu_defer_barrier_thread(void)
 {
 	unsigned long head, num_items;
 
 	head = URCU_TLS(defer_queue).head;
-	num_items = head - URCU_TLS(defer_queue).tail;
+	num_items = head - CMM_LOAD_SHARED(URCU_TLS(defer_queue).tail);
 	if (caa_unlikely(!num_items))
 		return;
 	synchronize_rcu();
-	rcu_defer_barrier_queue(&URCU_TLS(defer_queue), head);
+	defer_queue_drain(&URCU_TLS(defer_queue), head);
 }
 
 void rcu_defer_barrier_thread(void)
 {
-	mutex_lock_defer(&rcu_defer_mutex);
 	_rcu_defer_barrier_thread();
-	mutex_unlock(&rcu_defer_mutex);
 }
 
 /*
@@ -281,7 +355,7 @@ void rcu_defer_barrier(void)
 	mutex_lock_defer(&rcu_defer_mutex);
 	cds_list_for_each_entry(index, &registry_defer, list) {
 		index->last_head = CMM_LOAD_SHARED(index->head);
-		num_items += index->last_head - index->tail;
+		num_items += index->last_head - CMM_LOAD_SHARED(index->tail);
 	}
 	if (caa_likely(!num_items)) {
 		/*
@@ -292,9 +366,33 @@ void rcu_defer_barrier(void)
 	}
 	synchronize_rcu();
 	cds_list_for_each_entry(index, &registry_defer, list)
-		rcu_defer_barrier_queue(index, index->last_head);
+		defer_queue_drain(index, index->last_head);
 end:
-	mutex_unlock(&rcu_defer_mutex);
+	mutex_unlock_defer(&rcu_defer_mutex);
+}
+
+/*
+ * Chain a new ring, twice as large as the current one, to the defer
+ * queue of the current thread. Returns the new ring, or NULL if the
+ * queue cannot grow.
+ */
+static struct defer_ring *grow_defer_queue(unsigned long head)
+{
+	struct defer_ring *ring, *new_ring;
+	unsigned long size;
+
+	ring = URCU_TLS(defer_queue).head_ring;
+	size = (ring->mask + 1) << 1;
+	if (size > DEFER_QUEUE_MAX_SIZE)
+		return NULL;
+	new_ring = alloc_defer_ring(size, head);
+	if (!new_ring)
+		return NULL;
+	CMM_STORE_SHARED(ring->end, head);
+	cmm_smp_wmb();	/* Write end before next */
+	CMM_STORE_SHARED(ring->next, new_ring);
+	URCU_TLS(defer_queue).head_ring = new_ring;
+	return new_ring;
 }
 
 /*
@@ -303,22 +401,35 @@ end:
 static void _defer_rcu(void (*fct)(void *p), void *p)
 {
 	unsigned long head, tail;
+	struct defer_ring *ring;
 
 	/*
-	 * Head is only modified by ourself. Tail can be modified by reclamation
-	 * thread.
+	 * Head and head_ring are only modified by ourself. Tail can be
+	 * modified by reclamation threads.
 	 */
 	head = URCU_TLS(defer_queue).head;
 	tail = CMM_LOAD_SHARED(URCU_TLS(defer_queue).tail);
+	ring = URCU_TLS(defer_queue).head_ring;
+
+	/*
+	 * Elements queued in previous rings do not use the current ring.
+	 */
+	if ((long) (tail - ring->first) < 0)
+		tail = ring->first;
 
 	/*
-	 * If queue is full, or reached threshold. Empty queue ourself.
+	 * If ring is full, or reached threshold, chain a larger ring. If
+	 * the queue cannot grow, empty queue ourself.
 	 * Worse-case: must allow 2 supplementary entries for fct pointer.
 	 */
-	if (caa_unlikely(head - tail >= DEFER_QUEUE_SIZE - 2)) {
-		assert(head - tail <= DEFER_QUEUE_SIZE);
-		rcu_defer_barrier_thread();
-		assert(head - CMM_LOAD_SHARED(URCU_TLS(defer_queue).tail) == 0);
+	if (caa_unlikely(head - tail >= ring->mask + 1 - 2)) {
+		assert(head - tail <= ring->mask + 1);
+		ring = grow_defer_queue(head);
+		if (caa_unlikely(!ring)) {
+			rcu_defer_barrier_thread();
+			assert(head - CMM_LOAD_SHARED(URCU_TLS(defer_queue).tail) == 0);
+			ring = URCU_TLS(defer_queue).head_ring;
+		}
 	}
 
 	/*
@@ -342,42 +453,30 @@ static void _defer_rcu(void (*fct)(void *p), void *p)
 			|| p == DQ_FCT_MARK)) {
 		URCU_TLS(defer_queue).last_fct_in = fct;
 		if (caa_unlikely(DQ_IS_FCT_BIT(fct) || fct == DQ_FCT_MARK)) {
-			_CMM_STORE_SHARED(URCU_TLS(defer_queue).q[head++ & DEFER_QUEUE_MASK],
+			_CMM_STORE_SHARED(ring->q[head++ & ring->mask],
 				      DQ_FCT_MARK);
-			_CMM_STORE_SHARED(URCU_TLS(defer_queue).q[head++ & DEFER_QUEUE_MASK],
+			_CMM_STORE_SHARED(ring->q[head++ & ring->mask],
 				      fct);
 		} else {
 			DQ_SET_FCT_BIT(fct);
-			_CMM_STORE_SHARED(URCU_TLS(defer_queue).q[head++ & DEFER_QUEUE_MASK],
+			_CMM_STORE_SHARED(ring->q[head++ & ring->mask],
 				      fct);
 		}
 	}
-	_CMM_STORE_SHARED(URCU_TLS(defer_queue).q[head++ & DEFER_QUEUE_MASK], p);
+	_CMM_STORE_SHARED(ring->q[head++ & ring->mask], p);
 	cmm_smp_wmb();	/* Publish new pointer before head */
 			/* Write q[] before head. */
 	CMM_STORE_SHARED(URCU_TLS(defer_queue).head, head);
-	cmm_smp_mb();	/* Write queue head before read futex */
+	cmm_smp_mb();	/* Write queue head before read drain_pending */
 	/*
-	 * Wake-up any waiting defer thread.
+	 * Have the call_rcu worker threads drain the queue, unless a
+	 * drain is already pending: it will re-arm itself. The default
+	 * call_rcu_data is never freed, so it is used without the
+	 * read-side critical section call_rcu() needs, and defer_rcu()
+	 * callers need not be registered RCU reader threads.
 	 */
-	wake_up_defer();
-}
-
-static void *thr_defer(void *args)
-{
-	for (;;) {
-		/*
-		 * "Be green". Don't wake up the CPU if there is no RCU work
-		 * to perform whatsoever. Aims at saving laptop battery life by
-		 * leaving the processor in sleep state when idle.
-		 */
-		wait_defer();
-		/* Sleeping after wait_defer to let many callbacks enqueue */
-		poll(NULL,0,100);	/* wait for 100ms */
-		rcu_defer_barrier();
-	}
-
-	return NULL;
+	defer_queue_schedule_drain(&URCU_TLS(defer_queue),
+		get_default_call_rcu_data());
 }
 
 /*
@@ -389,70 +488,57 @@ void defer_rcu(void (*fct)(void *p), void *p)
 	_defer_rcu(fct, p);
 }
 
-static void start_defer_thread(void)
-{
-	int ret;
-
-	ret = pthread_create(&tid_defer, NULL, thr_defer, NULL);
-	assert(!ret);
-}
-
-static void stop_defer_thread(void)
-{
-	int ret;
-	void *tret;
-
-	_CMM_STORE_SHARED(defer_thread_stop, 1);
-	/* Store defer_thread_stop before testing futex */
-	cmm_smp_mb();
-	wake_up_defer();
-
-	ret = pthread_join(tid_defer, &tret);
-	assert(!ret);
-
-	CMM_STORE_SHARED(defer_thread_stop, 0);
-	/* defer thread should always exit when futex value is 0 */
-	assert(uatomic_read(&defer_thread_futex) == 0);
-}
-
 int rcu_defer_register_thread(void)
 {
-	int was_empty;
+	struct defer_ring *ring;
+	int ret;
 
 	assert(URCU_TLS(defer_queue).last_head == 0);
-	assert(URCU_TLS(defer_queue).q == NULL);
-	URCU_TLS(defer_queue).q = malloc(sizeof(void *) * DEFER_QUEUE_SIZE);
-	if (!URCU_TLS(defer_queue).q)
+	assert(URCU_TLS(defer_queue).head_ring == NULL);
+	ring = alloc_defer_ring(DEFER_QUEUE_SIZE, URCU_TLS(defer_queue).head);
+	if (!ring)
 		return -ENOMEM;
+	ret = pthread_mutex_init(&URCU_TLS(defer_queue).lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	URCU_TLS(defer_queue).head_ring = ring;
+	URCU_TLS(defer_queue).tail_ring = ring;
 
-	mutex_lock_defer(&defer_thread_mutex);
 	mutex_lock_defer(&rcu_defer_mutex);
-	was_empty = cds_list_empty(&registry_defer);
 	cds_list_add(&URCU_TLS(defer_queue).list, &registry_defer);
-	mutex_unlock(&rcu_defer_mutex);
-
-	if (was_empty)
-		start_defer_thread();
-	mutex_unlock(&defer_thread_mutex);
+	mutex_unlock_defer(&rcu_defer_mutex);
 	return 0;
 }
 
 void rcu_defer_unregister_thread(void)
 {
-	int is_empty;
+	struct defer_ring *ring, *next;
+	int was_online;
 
-	mutex_lock_defer(&defer_thread_mutex);
 	mutex_lock_defer(&rcu_defer_mutex);
 	cds_list_del(&URCU_TLS(defer_queue).list);
+	mutex_unlock_defer(&rcu_defer_mutex);
 	_rcu_defer_barrier_thread();
-	free(URCU_TLS(defer_queue).q);
-	URCU_TLS(defer_queue).q = NULL;
-	is_empty = cds_list_empty(&registry_defer);
-	mutex_unlock(&rcu_defer_mutex);
-
-	if (is_empty)
-		stop_defer_thread();
-	mutex_unlock(&defer_thread_mutex);
+	/*
+	 * Wait for the pending drain, if any, to release the queue: it
+	 * clears drain_pending with the queue lock held. Its grace
+	 * period needs us to be offline in QSBR.
+	 */
+	was_online = rcu_read_ongoing();
+	if (was_online)
+		rcu_thread_offline();
+	while (uatomic_read(&URCU_TLS(defer_queue).drain_pending))
+		(void) poll(NULL, 0, 1);
+	if (was_online)
+		rcu_thread_online();
+	mutex_lock_defer(&URCU_TLS(defer_queue).lock);
+	mutex_unlock_defer(&URCU_TLS(defer_queue).lock);
+	for (ring = URCU_TLS(defer_queue).tail_ring; ring; ring = next) {
+		next = ring->next;
+		free_defer_ring(ring);
+	}
+	URCU_TLS(defer_queue).head_ring = NULL;
+	URCU_TLS(defer_queue).tail_ring = NULL;
 }
 
 void rcu_defer_exit(void)
@@ -44,7 +44,9 @@ extern "C" {
  *
  * Each thread queuing memory reclamation must be registered with
  * rcu_defer_register_thread(). rcu_defer_unregister_thread() should be
- * called before the thread exits.
+ * called before the thread exits. The queues are drained by the call_rcu
+ * worker threads, but threads using defer_rcu() need not be registered
+ * as RCU reader threads.
  *
  * *NEVER* use defer_rcu() within a RCU read-side critical section, because this
  * primitive need to call synchronize_rcu() if the thread queue is full.
@@ -0,0 +1,543 @@
+/*
+ * urcu-domain.c
+ *
+ * Userspace RCU library - independent RCU domains
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sched.h>
+#include <poll.h>
+
+#include "config.h"
+#include <urcu/rseq.h>
+#include <urcu/arch.h>
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
+#include <urcu/futex.h>
+#include <urcu/syscall-compat.h>
+#include "urcu-domain.h"
+#include "urcu-die.h"
+
+/*
+ * Active attempts to check for reader Q.S. before sleeping.
+ */
+#define RCU_QS_ACTIVE_ATTEMPTS		100
+
+/* Number of counters when the number of CPUs is unknown. */
+#define DEFAULT_NR_COUNTS		16
+
+/*
+ * Read-side critical sections entered with phase i increment lock[i]
+ * when they begin, and unlock[i] when they end, possibly on counters of
+ * different CPUs. The sums over all CPUs are equal when no reader of
+ * phase i remains.
+ */
+struct rcu_domain_count {
+	unsigned long lock[2];
+	unsigned long unlock[2];
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+struct rcu_domain {
+	unsigned long phase;		/* readers use phase & 1 */
+	unsigned long nr_counts_mask;
+	struct rcu_domain_count *count;
+	pthread_mutex_t gp_lock;	/* serializes grace periods */
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static unsigned long nr_counts(void)
+{
+	unsigned long nr = DEFAULT_NR_COUNTS;
+#ifdef HAVE_SYSCONF
+	long maxcpus;
+
+	maxcpus = sysconf(_SC_NPROCESSORS_CONF);
+	if (maxcpus > 0) {
+		/* Round up to a power of two. */
+		for (nr = 1; nr < (unsigned long) maxcpus; nr <<= 1)
+			;
+	}
+#endif
+	return nr;
+}
+
+static struct rcu_domain_count *domain_local_count(struct rcu_domain *domain)
+{
+	int cpu;
+
+	cpu = urcu_rseq_cpu_id();
+#ifdef HAVE_SCHED_GETCPU
+	if (caa_unlikely(cpu < 0))
+		cpu = sched_getcpu();
+#endif
+	if (caa_unlikely(cpu < 0))
+		cpu = 0;
+	return &domain->count[cpu & domain->nr_counts_mask];
+}
+
+struct rcu_domain *rcu_domain_create(void)
+{
+	struct rcu_domain *domain;
+	unsigned long nr = nr_counts();
+	int ret;
+
+	domain = calloc(1, sizeof(*domain));
+	if (!domain)
+		return NULL;
+	domain->count = calloc(nr, sizeof(*domain->count));
+	if (!domain->count) {
+		free(domain);
+		return NULL;
+	}
+	domain->nr_counts_mask = nr - 1;
+	ret = pthread_mutex_init(&domain->gp_lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	return domain;
+}
+
+void rcu_domain_destroy(struct rcu_domain *domain)
+{
+	int ret;
+
+	ret = pthread_mutex_destroy(&domain->gp_lock);
+	if (ret)
+		urcu_die(ret);
+	free(domain->count);
+	free(domain);
+}
+
+int rcu_read_lock_domain(struct rcu_domain *domain)
+{
+	int idx;
+
+	idx = CMM_LOAD_SHARED(domain->phase) & 1;
+	uatomic_inc(&domain_local_count(domain)->lock[idx]);
+	/* Increment lock count before the critical section. */
+	cmm_smp_mb__after_uatomic_inc();
+	return idx;
+}
+
+void rcu_read_unlock_domain(struct rcu_domain *domain, int idx)
+{
+	/* Critical section before the increment of the unlock count. */
+	cmm_smp_mb__before_uatomic_inc();
+	uatomic_inc(&domain_local_count(domain)->unlock[idx]);
+}
+
+/*
+ * Return whether all readers of phase idx are done. Unlock counts are
+ * summed first: a reader counted as unlocked had its lock counted in
+ * the second sum, so the sums are only equal if no reader of that phase
+ * is active. Readers which loaded the phase before its last change but
+ * increment lock[idx] afterwards may be missed by the second sum: the
+ * grace period handles those by waiting for both phases.
+ */
+static int readers_done(struct rcu_domain *domain, int idx)
+{
+	unsigned long i, locks = 0, unlocks = 0;
+
+	for (i = 0; i <= domain->nr_counts_mask; i++)
+		unlocks += CMM_LOAD_SHARED(domain->count[i].unlock[idx]);
+	/* Read unlock counts before lock counts. */
+	cmm_smp_mb();
+	for (i = 0; i <= domain->nr_counts_mask; i++)
+		locks += CMM_LOAD_SHARED(domain->count[i].lock[idx]);
+	return locks == unlocks;
+}
+
+static void wait_for_readers(struct rcu_domain *domain, int idx)
+{
+	unsigned int wait_loops = 0;
+
+	while (!readers_done(domain, idx)) {
+		if (wait_loops < RCU_QS_ACTIVE_ATTEMPTS) {
+			wait_loops++;
+			caa_cpu_relax();
+		} else {
+			(void) poll(NULL, 0, 1);
+		}
+	}
+}
+
+/*
+ * Grace period: wait for the readers of the inactive phase, which can
+ * only be stragglers of the previous grace period, flip the phase, and
+ * wait for the readers of the previously active phase.
+ */
+void synchronize_rcu_domain(struct rcu_domain *domain)
+{
+	/* Order prior memory accesses before the grace period. */
+	cmm_smp_mb();
+
+	mutex_lock(&domain->gp_lock);
+	wait_for_readers(domain, (domain->phase & 1) ^ 1);
+	/* Readers of the inactive phase done before the flip. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(domain->phase, domain->phase + 1);
+	/* Flip before waiting for readers of the previous phase. */
+	cmm_smp_mb();
+	wait_for_readers(domain, (domain->phase & 1) ^ 1);
+	mutex_unlock(&domain->gp_lock);
+
+	/* Order following memory accesses after the grace period. */
+	cmm_smp_mb();
+}
+
+/*
+ * Shared domains. Readers nest as in urcu-mb: the low half of the
+ * reader counter is the nesting count, and the high half the phase of
+ * the domain counter when the outermost critical section began.
+ */
+#define RCU_SHM_MAGIC		0x52435553U	/* "RCUS" */
+#define RCU_SHM_GP_COUNT	(1UL << 0)
+#define RCU_SHM_GP_CTR_PHASE	(1UL << (sizeof(unsigned long) << 2))
+#define RCU_SHM_GP_CTR_NEST_MASK	(RCU_SHM_GP_CTR_PHASE - 1)
+
+/* Sleep of the grace period between checks of the reader liveness. */
+#define RCU_SHM_WAIT_NS		10000000L
+
+struct rcu_shm_reader {
+	unsigned long ctr;
+	int32_t tid;			/* owner thread, 0 if free */
+	int32_t pid;			/* owner process, 0 while taking it */
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+/*
+ * Only offsets within the mapping and process-shared objects: each
+ * process may map the domain at a different address.
+ */
+struct rcu_shm_domain {
+	uint32_t magic;			/* set once initialized */
+	int32_t futex;			/* -1 while the grace period sleeps */
+	unsigned long ctr;
+	unsigned long nr_readers;
+	pthread_mutex_t gp_lock;	/* process-shared, robust */
+	struct rcu_shm_reader reader[];
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+static int32_t shm_gettid(void)
+{
+#if defined(__linux__) && defined(SYS_gettid)
+	return (int32_t) syscall(SYS_gettid);
+#else
+	return (int32_t) getpid();
+#endif
+}
+
+/*
+ * Whether the owner of a reader slot is known dead. A slot still being
+ * taken (no pid yet) is considered alive, as are threads we are not
+ * allowed to signal.
+ */
+static int shm_reader_dead(struct rcu_shm_reader *reader, int32_t tid)
+{
+	int32_t pid = CMM_LOAD_SHARED(reader->pid);
+	int ret;
+
+	if (!tid || !pid)
+		return 0;
+#if defined(__linux__) && defined(SYS_tgkill)
+	ret = syscall(SYS_tgkill, pid, tid, 0);
+#else
+	ret = kill(pid, 0);
+#endif
+	return ret < 0 && errno == ESRCH;
+}
+
+/*
+ * Release the slot of a dead thread, unless it was released and taken
+ * again meanwhile.
+ */
+static void shm_reader_prune(struct rcu_shm_reader *reader, int32_t tid)
+{
+	CMM_STORE_SHARED(reader->ctr, 0);
+	/* Clear the critical section before releasing the slot. */
+	cmm_smp_mb();
+	if (uatomic_cmpxchg(&reader->tid, tid, 0) == tid)
+		CMM_STORE_SHARED(reader->pid, 0);
+}
+
+size_t rcu_shm_domain_size(unsigned long nr_readers)
+{
+	return sizeof(struct rcu_shm_domain)
+		+ nr_readers * sizeof(struct rcu_shm_reader);
+}
+
+struct rcu_shm_domain *rcu_shm_domain_init(void *mem, size_t size)
+{
+	struct rcu_shm_domain *domain = mem;
+	pthread_mutexattr_t attr;
+	int ret;
+
+	if (size < rcu_shm_domain_size(1)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	domain->nr_readers = (size - sizeof(*domain))
+		/ sizeof(struct rcu_shm_reader);
+	domain->ctr = RCU_SHM_GP_COUNT;
+	ret = pthread_mutexattr_init(&attr);
+	if (ret)
+		urcu_die(ret);
+	ret = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	if (ret)
+		urcu_die(ret);
+	ret = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	if (ret)
+		urcu_die(ret);
+	ret = pthread_mutex_init(&domain->gp_lock, &attr);
+	if (ret)
+		urcu_die(ret);
+	ret = pthread_mutexattr_destroy(&attr);
+	if (ret)
+		urcu_die(ret);
+	/* Initialize the domain before publishing it. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(domain->magic, RCU_SHM_MAGIC);
+	return domain;
+}
+
+struct rcu_shm_domain *rcu_shm_domain_attach(void *mem)
+{
+	struct rcu_shm_domain *domain = mem;
+
+	if (CMM_LOAD_SHARED(domain->magic) != RCU_SHM_MAGIC) {
+		errno = EAGAIN;
+		return NULL;
+	}
+	/* Read the magic before the domain. */
+	cmm_smp_mb();
+	return domain;
+}
+
+void rcu_shm_domain_fini(struct rcu_shm_domain *domain)
+{
+	int ret;
+
+	domain->magic = 0;
+	ret = pthread_mutex_destroy(&domain->gp_lock);
+	if (ret)
+		urcu_die(ret);
+}
+
+static struct rcu_shm_reader *shm_reader_take(struct rcu_shm_domain *domain,
+		int prune)
+{
+	int32_t tid = shm_gettid(), owner;
+	struct rcu_shm_reader *reader;
+	unsigned long i;
+
+	for (i = 0; i < domain->nr_readers; i++) {
+		reader = &domain->reader[i];
+		owner = CMM_LOAD_SHARED(reader->tid);
+		if (owner && prune && shm_reader_dead(reader, owner))
+			shm_reader_prune(reader, owner);
+		if (uatomic_cmpxchg(&reader->tid, 0, tid) != 0)
+			continue;
+		CMM_STORE_SHARED(reader->pid, (int32_t) getpid());
+		return reader;
+	}
+	return NULL;
+}
+
+struct rcu_shm_reader *rcu_shm_reader_register(struct rcu_shm_domain *domain)
+{
+	struct rcu_shm_reader *reader;
+
+	reader = shm_reader_take(domain, 0);
+	if (!reader)
+		reader = shm_reader_take(domain, 1);
+	if (!reader)
+		errno = ENOSPC;
+	return reader;
+}
+
+void rcu_shm_reader_unregister(struct rcu_shm_domain *domain,
+		struct rcu_shm_reader *reader)
+{
+	(void) domain;
+	CMM_STORE_SHARED(reader->ctr, 0);
+	CMM_STORE_SHARED(reader->pid, 0);
+	/* Release the slot after clearing it. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(reader->tid, 0);
+}
+
+static void shm_wake_up_gp(struct rcu_shm_domain *domain)
+{
+	if (caa_unlikely(uatomic_read(&domain->futex) == -1)) {
+		uatomic_set(&domain->futex, 0);
+		/* Not FUTEX_PRIVATE: the waiter may be another process. */
+		(void) futex_async(&domain->futex, FUTEX_WAKE, 1,
+				NULL, NULL, 0);
+	}
+}
+
+void rcu_read_lock_shm(struct rcu_shm_domain *domain,
+		struct rcu_shm_reader *reader)
+{
+	unsigned long tmp;
+
+	tmp = reader->ctr;
+	if (caa_likely(!(tmp & RCU_SHM_GP_CTR_NEST_MASK))) {
+		CMM_STORE_SHARED(reader->ctr, CMM_LOAD_SHARED(domain->ctr));
+		/* Publish the reader counter before the critical section. */
+		cmm_smp_mb();
+	} else {
+		CMM_STORE_SHARED(reader->ctr, tmp + RCU_SHM_GP_COUNT);
+	}
+}
+
+void rcu_read_unlock_shm(struct rcu_shm_domain *domain,
+		struct rcu_shm_reader *reader)
+{
+	unsigned long tmp;
+
+	tmp = reader->ctr;
+	if (caa_likely((tmp & RCU_SHM_GP_CTR_NEST_MASK) == RCU_SHM_GP_COUNT)) {
+		/* Critical section before the reader counter. */
+		cmm_smp_mb();
+		CMM_STORE_SHARED(reader->ctr, tmp - RCU_SHM_GP_COUNT);
+		/* Reader counter before the futex. */
+		cmm_smp_mb();
+		shm_wake_up_gp(domain);
+	} else {
+		CMM_STORE_SHARED(reader->ctr, tmp - RCU_SHM_GP_COUNT);
+	}
+}
+
+/* Whether the reader is within a critical section of the previous phase. */
+static int shm_reader_ongoing(struct rcu_shm_domain *domain,
+		struct rcu_shm_reader *reader)
+{
+	unsigned long v = CMM_LOAD_SHARED(reader->ctr);
+
+	return (v & RCU_SHM_GP_CTR_NEST_MASK)
+		&& ((v ^ domain->ctr) & RCU_SHM_GP_CTR_PHASE);
+}
+
+/*
+ * Sleep until a reader leaves its critical section, or for at most
+ * RCU_SHM_WAIT_NS, since a dead reader never wakes us up.
+ */
+static void shm_wait_gp(struct rcu_shm_domain *domain,
+		struct rcu_shm_reader *reader)
+{
+	const struct timespec timeout = { 0, RCU_SHM_WAIT_NS };
+
+	uatomic_dec(&domain->futex);
+	/* Write futex before reading the reader counter. */
+	cmm_smp_mb();
+	if (shm_reader_ongoing(domain, reader))
+		(void) futex_async(&domain->futex, FUTEX_WAIT, -1,
+				&timeout, NULL, 0);
+	uatomic_set(&domain->futex, 0);
+}
+
+static void shm_wait_for_readers(struct rcu_shm_domain *domain)
+{
+	struct rcu_shm_reader *reader;
+	unsigned int wait_loops;
+	unsigned long i;
+	int32_t tid;
+
+	for (i = 0; i < domain->nr_readers; i++) {
+		reader = &domain->reader[i];
+		wait_loops = 0;
+		while (shm_reader_ongoing(domain, reader)) {
+			if (wait_loops < RCU_QS_ACTIVE_ATTEMPTS) {
+				wait_loops++;
+				caa_cpu_relax();
+				continue;
+			}
+			shm_wait_gp(domain, reader);
+			tid = CMM_LOAD_SHARED(reader->tid);
+			if (shm_reader_ongoing(domain, reader)
+					&& shm_reader_dead(reader, tid))
+				shm_reader_prune(reader, tid);
+		}
+	}
+}
+
+static void shm_gp_lock(struct rcu_shm_domain *domain)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(&domain->gp_lock);
+	if (ret == EOWNERDEAD) {
+		/*
+		 * The owner died within a grace period, which left the
+		 * domain consistent: the counter flip is a single store.
+		 */
+		ret = pthread_mutex_consistent(&domain->gp_lock);
+	}
+	if (ret)
+		urcu_die(ret);
+}
+
+/*
+ * Grace period: flip the phase twice, each time waiting for the readers
+ * of the previous phase, as in urcu-mb.
+ */
+void synchronize_rcu_shm(struct rcu_shm_domain *domain)
+{
+	/* Order prior memory accesses before the grace period. */
+	cmm_smp_mb();
+
+	shm_gp_lock(domain);
+	CMM_STORE_SHARED(domain->ctr, domain->ctr ^ RCU_SHM_GP_CTR_PHASE);
+	/* Flip before waiting for readers of the previous phase. */
+	cmm_smp_mb();
+	shm_wait_for_readers(domain);
+	/* Readers of the previous phase done before the second flip. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(domain->ctr, domain->ctr ^ RCU_SHM_GP_CTR_PHASE);
+	cmm_smp_mb();
+	shm_wait_for_readers(domain);
+	mutex_unlock(&domain->gp_lock);
+
+	/* Order following memory accesses after the grace period. */
+	cmm_smp_mb();
+}
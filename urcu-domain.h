@@ -0,0 +1,125 @@
+#ifndef _URCU_DOMAIN_H
+#define _URCU_DOMAIN_H
+
+/*
+ * urcu-domain.h
+ *
+ * Userspace RCU header - independent RCU domains
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * An RCU domain has its own readers and grace periods, independent from
+ * the RCU flavors and from other domains: synchronize_rcu_domain() only
+ * waits for the read-side critical sections of its domain, so a slow
+ * reader of one subsystem does not delay the updates of another.
+ *
+ * Domains follow the SRCU design: readers increment per-CPU lock and
+ * unlock counters of the current domain phase, so threads do not need
+ * to register, read-side critical sections can nest, and can migrate
+ * or block. This comes at the cost of an atomic increment and a memory
+ * barrier in rcu_read_lock_domain() and rcu_read_unlock_domain().
+ * Domains can be used along with any flavor, they are provided by
+ * liburcu-common.
+ */
+struct rcu_domain;
+
+/*
+ * Exported functions
+ *
+ * rcu_domain_create() returns a new domain, or NULL if out of memory.
+ * rcu_domain_destroy() frees a domain, which must not have readers nor
+ * synchronize_rcu_domain() callers anymore.
+ *
+ * rcu_read_lock_domain() enters a read-side critical section of the
+ * domain, and returns a value to pass to the matching
+ * rcu_read_unlock_domain().
+ *
+ * synchronize_rcu_domain() waits for all pre-existing read-side
+ * critical sections of the domain to complete. It must not be called
+ * from within a read-side critical section of the same domain.
+ */
+struct rcu_domain *rcu_domain_create(void);
+void rcu_domain_destroy(struct rcu_domain *domain);
+
+int rcu_read_lock_domain(struct rcu_domain *domain);
+void rcu_read_unlock_domain(struct rcu_domain *domain, int idx);
+
+void synchronize_rcu_domain(struct rcu_domain *domain);
+
+/*
+ * Shared RCU domains
+ *
+ * A shared domain is laid out wholly in memory provided by the caller,
+ * e.g. a MAP_SHARED mapping, so that the processes mapping it share its
+ * grace periods: synchronize_rcu_shm() waits for the read-side critical
+ * sections of the readers of every process, whatever the address each
+ * process maps the domain at. Readers have slots in the domain, taken
+ * by rcu_shm_reader_register(), holding the nesting count and phase of
+ * their critical section. The grace period sleeps on a process-shared
+ * futex of the domain, woken up by the readers leaving their critical
+ * section, and prunes the slots of threads found dead, so a process
+ * killed within a read-side critical section does not stall the grace
+ * periods. The processes must be in the same PID namespace, and a dead
+ * process is only detected once reaped.
+ *
+ * rcu_shm_domain_size() returns the size of a domain with @nr_readers
+ * reader slots. rcu_shm_domain_init() initializes a domain in @mem,
+ * which must be zeroed, at least @size bytes long and aligned on a
+ * cache line (mmap() memory is), and returns it, or NULL with errno
+ * set to EINVAL if @size is too small. rcu_shm_domain_attach() returns
+ * the domain initialized in @mem by another process, or NULL with
+ * errno set to EAGAIN if it is not initialized yet. rcu_shm_domain_fini()
+ * releases the domain once no process uses it anymore.
+ *
+ * rcu_shm_reader_register() takes a reader slot for the calling thread,
+ * which is the only one to use it, and returns it, or NULL with errno
+ * set to ENOSPC if all slots are taken by live threads.
+ * rcu_shm_reader_unregister() releases it, outside of read-side
+ * critical sections. Critical sections can nest.
+ */
+struct rcu_shm_domain;
+struct rcu_shm_reader;
+
+size_t rcu_shm_domain_size(unsigned long nr_readers);
+struct rcu_shm_domain *rcu_shm_domain_init(void *mem, size_t size);
+struct rcu_shm_domain *rcu_shm_domain_attach(void *mem);
+void rcu_shm_domain_fini(struct rcu_shm_domain *domain);
+
+struct rcu_shm_reader *rcu_shm_reader_register(struct rcu_shm_domain *domain);
+void rcu_shm_reader_unregister(struct rcu_shm_domain *domain,
+		struct rcu_shm_reader *reader);
+
+void rcu_read_lock_shm(struct rcu_shm_domain *domain,
+		struct rcu_shm_reader *reader);
+void rcu_read_unlock_shm(struct rcu_shm_domain *domain,
+		struct rcu_shm_reader *reader);
+
+void synchronize_rcu_shm(struct rcu_shm_domain *domain);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_DOMAIN_H */
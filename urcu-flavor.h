@@ -27,6 +27,9 @@
 extern "C" {
 #endif
 
+struct rcu_head;
+struct urcu_gp_notifier;
+
 struct rcu_flavor_struct {
 	void (*read_lock)(void);
 	void (*read_unlock)(void);
@@ -43,6 +46,12 @@ struct rcu_flavor_struct {
 	void (*unregister_thread)(void);
 
 	void (*barrier)(void);
+
+	struct urcu_gp_poll_state (*update_start_poll_synchronize_rcu)(void);
+	int (*update_poll_state_synchronize_rcu)(struct urcu_gp_poll_state state);
+	void (*update_synchronize_rcu_expedited)(void);
+	struct urcu_gp_poll_state (*update_start_poll_synchronize_rcu_notify)(
+			struct urcu_gp_notifier *notifier);
 };
 
 #define DEFINE_RCU_FLAVOR(x)				\
@@ -59,6 +68,11 @@ const struct rcu_flavor_struct x = {			\
 	.register_thread	= rcu_register_thread,	\
 	.unregister_thread	= rcu_unregister_thread,\
 	.barrier		= rcu_barrier,		\
+	.update_start_poll_synchronize_rcu = start_poll_synchronize_rcu, \
+	.update_poll_state_synchronize_rcu = poll_state_synchronize_rcu, \
+	.update_synchronize_rcu_expedited = synchronize_rcu_expedited, \
+	.update_start_poll_synchronize_rcu_notify = \
+		start_poll_synchronize_rcu_notify, \
 }
 
 extern const struct rcu_flavor_struct rcu_flavor;
@@ -0,0 +1,291 @@
+/*
+ * urcu-hazard.c
+ *
+ * Userspace RCU library - hazard pointer domains
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <assert.h>
+
+#include <urcu/arch.h>
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu/list.h>
+#include "urcu-hazard.h"
+#include "urcu-registry.h"
+#include "urcu-die.h"
+
+struct rcu_hp_domain {
+	pthread_mutex_t registry_lock;	/* protects the fields below */
+	struct rcu_registry_shard registry[RCU_REGISTRY_NR_SHARDS];
+	unsigned long nr_readers;
+	void **hazards;			/* scan buffer, one entry per slot */
+	struct rcu_hp_head *orphans;	/* retired by unregistered readers */
+};
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static int compare_ptr(const void *a, const void *b)
+{
+	const void *pa = *(void * const *) a, *pb = *(void * const *) b;
+
+	if (pa < pb)
+		return -1;
+	return pa > pb;
+}
+
+/*
+ * Move the objects of *list which are not in the sorted hazards array
+ * to *reclaim. Return the number of objects left in *list.
+ */
+static unsigned long filter_retired(struct rcu_hp_head **list,
+		struct rcu_hp_head **reclaim,
+		void **hazards, unsigned long nr_hazards)
+{
+	struct rcu_hp_head **prev = list, *head;
+	unsigned long nr = 0;
+
+	while ((head = *prev) != NULL) {
+		if (nr_hazards && bsearch(&head->ptr, hazards, nr_hazards,
+				sizeof(*hazards), compare_ptr)) {
+			prev = &head->next;
+			nr++;
+		} else {
+			*prev = head->next;
+			head->next = *reclaim;
+			*reclaim = head;
+		}
+	}
+	return nr;
+}
+
+static void invoke_reclaim(struct rcu_hp_head *head)
+{
+	struct rcu_hp_head *next;
+
+	for (; head; head = next) {
+		next = head->next;
+		head->func(head);
+	}
+}
+
+/*
+ * Registry scan: gather the hazard slots of all registered readers,
+ * and reclaim the objects of *list and of the domain orphans which none
+ * of them protects. Like wait_for_readers(), this only looks at each
+ * reader once, so it completes in bounded time even if readers stall.
+ * Callbacks are invoked outside of the registry lock, they may retire
+ * objects themselves.
+ */
+static unsigned long hp_scan(struct rcu_hp_domain *domain,
+		struct rcu_hp_head **list)
+{
+	struct rcu_registry_shard *shard;
+	struct rcu_hp_reader *reader;
+	struct rcu_hp_head *reclaim = NULL;
+	unsigned long nr_hazards = 0, nr;
+	unsigned int i;
+
+	/*
+	 * Retired objects are unlinked before the slots are read. Pairs
+	 * with the memory barrier of rcu_hp_protect().
+	 */
+	cmm_smp_mb();
+
+	mutex_lock(&domain->registry_lock);
+	rcu_registry_for_each_shard(domain->registry, shard) {
+		cds_list_for_each_entry(reader, &shard->head, node) {
+			for (i = 0; i < RCU_HP_NR_SLOTS; i++) {
+				void *p = CMM_LOAD_SHARED(reader->slot[i]);
+
+				if (p)
+					domain->hazards[nr_hazards++] = p;
+			}
+		}
+	}
+	if (nr_hazards)
+		qsort(domain->hazards, nr_hazards, sizeof(*domain->hazards),
+			compare_ptr);
+	nr = filter_retired(list, &reclaim, domain->hazards, nr_hazards);
+	(void) filter_retired(&domain->orphans, &reclaim,
+			domain->hazards, nr_hazards);
+	mutex_unlock(&domain->registry_lock);
+
+	/* Slots read before reclaiming the objects. */
+	cmm_smp_mb();
+	invoke_reclaim(reclaim);
+	return nr;
+}
+
+struct rcu_hp_domain *rcu_hp_domain_create(void)
+{
+	struct rcu_hp_domain *domain;
+	struct rcu_registry_shard *shard;
+	int ret;
+
+	domain = calloc(1, sizeof(*domain));
+	if (!domain)
+		return NULL;
+	rcu_registry_for_each_shard(domain->registry, shard)
+		CDS_INIT_LIST_HEAD(&shard->head);
+	ret = pthread_mutex_init(&domain->registry_lock, NULL);
+	if (ret)
+		urcu_die(ret);
+	return domain;
+}
+
+void rcu_hp_domain_destroy(struct rcu_hp_domain *domain)
+{
+	int ret;
+
+	assert(rcu_registry_empty(domain->registry));
+	invoke_reclaim(domain->orphans);
+	ret = pthread_mutex_destroy(&domain->registry_lock);
+	if (ret)
+		urcu_die(ret);
+	free(domain->hazards);
+	free(domain);
+}
+
+struct rcu_hp_reader *rcu_hp_register(struct rcu_hp_domain *domain)
+{
+	struct rcu_hp_reader *reader;
+	void **hazards;
+	int ret;
+
+	ret = posix_memalign((void **) &reader, CAA_CACHE_LINE_SIZE,
+			sizeof(*reader));
+	if (ret)
+		return NULL;
+	memset(reader, 0, sizeof(*reader));
+	reader->domain = domain;
+
+	mutex_lock(&domain->registry_lock);
+	/* Grow the scan buffer so scans never need to allocate. */
+	hazards = realloc(domain->hazards, (domain->nr_readers + 1)
+			* RCU_HP_NR_SLOTS * sizeof(*hazards));
+	if (!hazards) {
+		mutex_unlock(&domain->registry_lock);
+		free(reader);
+		return NULL;
+	}
+	domain->hazards = hazards;
+	cds_list_add(&reader->node,
+		&rcu_registry_local_shard(domain->registry)->head);
+	CMM_STORE_SHARED(domain->nr_readers, domain->nr_readers + 1);
+	mutex_unlock(&domain->registry_lock);
+	return reader;
+}
+
+void rcu_hp_unregister(struct rcu_hp_reader *reader)
+{
+	struct rcu_hp_domain *domain = reader->domain;
+	struct rcu_hp_head *head;
+	unsigned int i;
+
+	for (i = 0; i < RCU_HP_NR_SLOTS; i++)
+		rcu_hp_clear(reader, i);
+
+	mutex_lock(&domain->registry_lock);
+	cds_list_del(&reader->node);
+	CMM_STORE_SHARED(domain->nr_readers, domain->nr_readers - 1);
+	mutex_unlock(&domain->registry_lock);
+
+	(void) hp_scan(domain, &reader->retired);
+
+	/* Objects still protected by other readers. */
+	if (reader->retired) {
+		mutex_lock(&domain->registry_lock);
+		for (head = reader->retired; head->next; head = head->next)
+			;
+		head->next = domain->orphans;
+		domain->orphans = reader->retired;
+		mutex_unlock(&domain->registry_lock);
+	}
+	free(reader);
+}
+
+void *rcu_hp_protect(struct rcu_hp_reader *reader, unsigned int slot,
+		void **pp)
+{
+	void *p, *check;
+
+	assert(slot < RCU_HP_NR_SLOTS);
+	p = CMM_LOAD_SHARED(*pp);
+	for (;;) {
+		CMM_STORE_SHARED(reader->slot[slot], p);
+		/*
+		 * Publish the slot before checking that the object is still
+		 * reachable: if it is, a scan reading the slot after it has
+		 * been unlinked sees it protected.
+		 */
+		cmm_smp_mb();
+		check = CMM_LOAD_SHARED(*pp);
+		if (check == p)
+			return p;
+		p = check;
+	}
+}
+
+void rcu_hp_clear(struct rcu_hp_reader *reader, unsigned int slot)
+{
+	assert(slot < RCU_HP_NR_SLOTS);
+	/* Accesses to the object before clearing its slot. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(reader->slot[slot], NULL);
+}
+
+void rcu_hp_retire(struct rcu_hp_reader *reader, void *ptr,
+		struct rcu_hp_head *head,
+		void (*func)(struct rcu_hp_head *head))
+{
+	struct rcu_hp_domain *domain = reader->domain;
+
+	head->ptr = ptr;
+	head->func = func;
+	head->next = reader->retired;
+	reader->retired = head;
+	if (++reader->nr_retired >= 2 * RCU_HP_NR_SLOTS
+			* CMM_LOAD_SHARED(domain->nr_readers))
+		rcu_hp_reclaim(reader);
+}
+
+void rcu_hp_reclaim(struct rcu_hp_reader *reader)
+{
+	reader->nr_retired = hp_scan(reader->domain, &reader->retired);
+}
@@ -0,0 +1,113 @@
+#ifndef _URCU_HAZARD_H
+#define _URCU_HAZARD_H
+
+/*
+ * urcu-hazard.h
+ *
+ * Userspace RCU header - hazard pointer domains
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <urcu/compiler.h>
+#include <urcu/list.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A hazard pointer domain protects individual objects instead of
+ * read-side critical sections: a reader publishes the address of each
+ * object it uses in one of its hazard slots, and a retired object is
+ * only reclaimed once no slot of the domain holds its address. A
+ * stalled or long-running reader therefore only holds back the few
+ * objects it protects, and never delays grace periods of the RCU
+ * flavors nor the reclamation of other objects. The cost is a memory
+ * barrier for each protected pointer. Hazard pointer domains can be
+ * used along with any flavor, they are provided by liburcu-common.
+ *
+ * Number of hazard slots of each registered reader.
+ */
+#define RCU_HP_NR_SLOTS		4
+
+struct rcu_hp_domain;
+
+struct rcu_hp_head {
+	struct rcu_hp_head *next;
+	void *ptr;
+	void (*func)(struct rcu_hp_head *head);
+};
+
+/*
+ * A reader is registered by a single thread, which owns its slots and
+ * its list of retired objects.
+ */
+struct rcu_hp_reader {
+	void *slot[RCU_HP_NR_SLOTS];
+	struct rcu_hp_domain *domain;
+	struct rcu_hp_head *retired;	/* objects awaiting reclamation */
+	unsigned long nr_retired;
+	struct cds_list_head node;	/* domain registry node */
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+/*
+ * Exported functions
+ *
+ * rcu_hp_domain_create() returns a new domain, or NULL if out of
+ * memory. rcu_hp_domain_destroy() reclaims the objects still retired to
+ * the domain, which must not have registered readers anymore.
+ *
+ * rcu_hp_register() registers the calling thread as a reader of the
+ * domain, and returns its reader, or NULL if out of memory.
+ * rcu_hp_unregister() clears the slots of the reader, reclaims what it
+ * can of its retired objects, and hands the others over to the domain.
+ *
+ * rcu_hp_protect() loads the pointer at *pp, publishes it in slot
+ * "slot" of the reader, and returns it once it is stable: the object it
+ * points to cannot be reclaimed until the slot is cleared by
+ * rcu_hp_clear() or reused. The pointer must be read from a location
+ * updated with rcu_assign_pointer() or equivalent, and be unlinked from
+ * it before being retired.
+ *
+ * rcu_hp_retire() is a call_rcu() counterpart: "func" is invoked on
+ * "head" once no hazard slot of the domain holds "ptr". Objects are
+ * queued on the reader, and reclaimed in batches when their number
+ * exceeds twice the number of slots of the domain, so at most that
+ * many objects per reader await reclamation, whatever the readers do.
+ * rcu_hp_reclaim() reclaims all of them which are not protected anymore.
+ */
+struct rcu_hp_domain *rcu_hp_domain_create(void);
+void rcu_hp_domain_destroy(struct rcu_hp_domain *domain);
+
+struct rcu_hp_reader *rcu_hp_register(struct rcu_hp_domain *domain);
+void rcu_hp_unregister(struct rcu_hp_reader *reader);
+
+void *rcu_hp_protect(struct rcu_hp_reader *reader, unsigned int slot,
+		void **pp);
+void rcu_hp_clear(struct rcu_hp_reader *reader, unsigned int slot);
+
+void rcu_hp_retire(struct rcu_hp_reader *reader, void *ptr,
+		struct rcu_hp_head *head,
+		void (*func)(struct rcu_hp_head *head));
+void rcu_hp_reclaim(struct rcu_hp_reader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_HAZARD_H */
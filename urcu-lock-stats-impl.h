@@ -0,0 +1,54 @@
+#ifndef _URCU_LOCK_STATS_IMPL_H
+#define _URCU_LOCK_STATS_IMPL_H
+
+/*
+ * urcu-lock-stats-impl.h
+ *
+ * Userspace RCU library - contention statistics of the flavor mutexes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Expects to be included before the mutex wrappers of the flavor, which
+ * look up the statistics of their mutex with rcu_lock_stats_of(), as do
+ * the wrappers of urcu-call-rcu-impl.h and urcu-defer-impl.h.
+ */
+
+#include "urcu-lock-stats.h"
+
+#ifdef CONFIG_RCU_LOCK_STATS
+static struct rcu_lock_stats_state rcu_lock_stats[RCU_NR_LOCKS];
+
+/* Statistics of mutex if it is the tracked mutex, NULL otherwise. */
+#define rcu_lock_stats_of(mutex, tracked, id)				\
+	((mutex) == (tracked) ? &rcu_lock_stats[id] : NULL)
+#else
+#define rcu_lock_stats_of(mutex, tracked, id)				\
+	((struct rcu_lock_stats_state *) NULL)
+#endif
+
+int rcu_get_lock_stats(enum rcu_lock_id lock, struct rcu_lock_stats *stats)
+{
+	if ((unsigned int) lock >= RCU_NR_LOCKS)
+		return -EINVAL;
+#ifdef CONFIG_RCU_LOCK_STATS
+	return rcu_lock_stats_read(&rcu_lock_stats[lock], stats);
+#else
+	return rcu_lock_stats_read(NULL, stats);
+#endif
+}
+
+#endif /* _URCU_LOCK_STATS_IMPL_H */
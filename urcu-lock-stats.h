@@ -0,0 +1,164 @@
+#ifndef _URCU_LOCK_STATS_H
+#define _URCU_LOCK_STATS_H
+
+/*
+ * urcu-lock-stats.h
+ *
+ * Userspace RCU library - mutex contention statistics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Hooks of the mutex wrappers of the library, maintaining a
+ * struct rcu_lock_stats for the mutexes tracked. The wrappers first
+ * call rcu_lock_stats_trylock(), which returns 0 once the mutex is
+ * acquired without waiting, or the wait start otherwise: they then
+ * acquire the mutex as usual, and call rcu_lock_stats_acquired(). Any
+ * other successful acquisition calls rcu_lock_stats_acquired() with a
+ * zero wait start. Releases call rcu_lock_stats_release() before
+ * unlocking.
+ *
+ * The statistics are written with the mutex held, and read without it
+ * by snapshots. Without CONFIG_RCU_LOCK_STATS, the hooks compile to
+ * nothing, and the wrappers acquire the mutex as usual.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <urcu/clock.h>
+#include <urcu/system.h>
+#include "urcu-stats.h"
+#include "urcu-die.h"
+
+struct rcu_lock_stats_state {
+	struct rcu_lock_stats stats;
+	uint64_t acquired_ns;		/* Protected by the mutex */
+};
+
+#ifdef CONFIG_RCU_LOCK_STATS
+
+static inline void rcu_lock_stats_account(unsigned long *hist,
+		uint64_t *total_ns, uint64_t *max_ns, uint64_t ns)
+{
+	unsigned int bucket = 0;
+
+	if ((int64_t) ns < 0)
+		ns = 0;		/* Migrated to a CPU with an earlier clock. */
+	if (ns)
+		bucket = 64 - __builtin_clzll(ns);
+	if (bucket >= RCU_LOCK_STATS_NR_BUCKETS)
+		bucket = RCU_LOCK_STATS_NR_BUCKETS - 1;
+	CMM_STORE_SHARED(hist[bucket], hist[bucket] + 1);
+	CMM_STORE_SHARED(*total_ns, *total_ns + ns);
+	if (ns > *max_ns)
+		CMM_STORE_SHARED(*max_ns, ns);
+}
+
+static inline void rcu_lock_stats_acquired(struct rcu_lock_stats_state *ls,
+		uint64_t wait_start)
+{
+	struct rcu_lock_stats *stats;
+	uint64_t now;
+
+	if (!ls)
+		return;
+	stats = &ls->stats;
+	now = caa_clock_ns();
+	CMM_STORE_SHARED(stats->nr_acquired, stats->nr_acquired + 1);
+	if (wait_start) {
+		CMM_STORE_SHARED(stats->nr_contended, stats->nr_contended + 1);
+		rcu_lock_stats_account(stats->wait_hist, &stats->wait_total_ns,
+			&stats->wait_max_ns, now - wait_start);
+	}
+	ls->acquired_ns = now;
+}
+
+static inline uint64_t rcu_lock_stats_trylock(struct rcu_lock_stats_state *ls,
+		pthread_mutex_t *mutex)
+{
+	uint64_t now;
+	int ret;
+
+	if (!ls)
+		return 1;
+	ret = pthread_mutex_trylock(mutex);
+	if (ret == EBUSY) {
+		now = caa_clock_ns();
+		return now ? now : 1;
+	}
+	if (ret)
+		urcu_die(ret);
+	rcu_lock_stats_acquired(ls, 0);
+	return 0;
+}
+
+static inline void rcu_lock_stats_release(struct rcu_lock_stats_state *ls)
+{
+	struct rcu_lock_stats *stats;
+
+	if (!ls)
+		return;
+	stats = &ls->stats;
+	rcu_lock_stats_account(stats->hold_hist, &stats->hold_total_ns,
+		&stats->hold_max_ns, caa_clock_ns() - ls->acquired_ns);
+}
+
+static inline int rcu_lock_stats_read(struct rcu_lock_stats_state *ls,
+		struct rcu_lock_stats *stats)
+{
+	unsigned int i;
+
+	stats->nr_acquired = CMM_LOAD_SHARED(ls->stats.nr_acquired);
+	stats->nr_contended = CMM_LOAD_SHARED(ls->stats.nr_contended);
+	stats->wait_total_ns = CMM_LOAD_SHARED(ls->stats.wait_total_ns);
+	stats->wait_max_ns = CMM_LOAD_SHARED(ls->stats.wait_max_ns);
+	stats->hold_total_ns = CMM_LOAD_SHARED(ls->stats.hold_total_ns);
+	stats->hold_max_ns = CMM_LOAD_SHARED(ls->stats.hold_max_ns);
+	for (i = 0; i < RCU_LOCK_STATS_NR_BUCKETS; i++) {
+		stats->wait_hist[i] = CMM_LOAD_SHARED(ls->stats.wait_hist[i]);
+		stats->hold_hist[i] = CMM_LOAD_SHARED(ls->stats.hold_hist[i]);
+	}
+	return 0;
+}
+
+#else /* #ifdef CONFIG_RCU_LOCK_STATS */
+
+static inline void rcu_lock_stats_acquired(struct rcu_lock_stats_state *ls,
+		uint64_t wait_start)
+{
+}
+
+static inline uint64_t rcu_lock_stats_trylock(struct rcu_lock_stats_state *ls,
+		pthread_mutex_t *mutex)
+{
+	return 1;
+}
+
+static inline void rcu_lock_stats_release(struct rcu_lock_stats_state *ls)
+{
+}
+
+static inline int rcu_lock_stats_read(struct rcu_lock_stats_state *ls,
+		struct rcu_lock_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	return -ENOSYS;
+}
+
+#endif /* #else #ifdef CONFIG_RCU_LOCK_STATS */
+
+#endif /* _URCU_LOCK_STATS_H */
@@ -0,0 +1,403 @@
+/*
+ * urcu-percpu.c
+ *
+ * Userspace RCU library, per-CPU counters version.
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#define _LGPL_SOURCE
+#include <stdio.h>
+#include <pthread.h>
+#include <signal.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "urcu/wfcqueue.h"
+#include "urcu/map/urcu-percpu.h"
+#include "urcu/static/urcu-percpu.h"
+#include "urcu-pointer.h"
+#include "urcu/tls-compat.h"
+
+#include "urcu-die.h"
+#include "urcu-wait.h"
+#include "urcu-tp.h"
+
+/* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
+#undef _LGPL_SOURCE
+#include "urcu-percpu.h"
+#define _LGPL_SOURCE
+
+#ifdef __linux__
+#include <urcu/syscall-compat.h>
+#endif
+
+#ifdef SYS_membarrier
+# define membarrier(...)		syscall(SYS_membarrier, __VA_ARGS__)
+#else
+# define membarrier(...)		-ENOSYS
+#endif
+
+#define MEMBARRIER_CMD_QUERY				0
+#define MEMBARRIER_CMD_PRIVATE_EXPEDITED		(1 << 3)
+#define MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED	(1 << 4)
+
+/* Sleep delay in ms */
+#define RCU_SLEEP_DELAY_MS	10
+
+/* Number of per-CPU counters when the number of CPUs is unknown. */
+#define DEFAULT_NR_CPUS		16
+
+static
+void __attribute__((constructor)) rcu_percpu_init(void);
+static
+void init_counts(void);
+
+static pthread_mutex_t rcu_gp_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef DEBUG_YIELD
+unsigned int rcu_yield_active;
+DEFINE_URCU_TLS(unsigned int, rcu_rand_yield);
+#endif
+
+struct rcu_gp rcu_gp;
+
+/*
+ * Phase and nesting count of the current read-side critical section.
+ * Only accessed by each individual reader.
+ */
+DEFINE_URCU_TLS(unsigned long, rcu_reader);
+
+/*
+ * Grace period sequence number, used by the grace period polling API.
+ * Incremented at the beginning and at the end of each grace period, with
+ * rcu_gp_lock held: an odd value means a grace period is in progress.
+ */
+static unsigned long rcu_gp_seq;
+
+/*
+ * Running estimate of the grace period duration, sizing the spin phase
+ * of the grace period leader waiting for readers. Updated
+ * with rcu_gp_lock held.
+ */
+static struct urcu_wait_estimate gp_wait_estimate;
+
+#include "urcu-lock-stats-impl.h"
+
+static void mutex_lock(pthread_mutex_t *mutex)
+{
+	struct rcu_lock_stats_state *ls =
+		rcu_lock_stats_of(mutex, &rcu_gp_lock, RCU_LOCK_GP);
+	uint64_t wait_start;
+	int ret;
+
+	wait_start = rcu_lock_stats_trylock(ls, mutex);
+	if (!wait_start)
+		return;
+
+#ifndef DISTRUST_SIGNALS_EXTREME
+	ret = pthread_mutex_lock(mutex);
+	if (ret)
+		urcu_die(ret);
+#else /* #ifndef DISTRUST_SIGNALS_EXTREME */
+	while ((ret = pthread_mutex_trylock(mutex)) != 0) {
+		if (ret != EBUSY && ret != EINTR)
+			urcu_die(ret);
+		poll(NULL,0,10);
+	}
+#endif /* #else #ifndef DISTRUST_SIGNALS_EXTREME */
+	rcu_lock_stats_acquired(ls, wait_start);
+}
+
+static void mutex_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	rcu_lock_stats_release(rcu_lock_stats_of(mutex, &rcu_gp_lock,
+			RCU_LOCK_GP));
+	ret = pthread_mutex_unlock(mutex);
+	if (ret)
+		urcu_die(ret);
+}
+
+static void smp_mb_master(void)
+{
+	if (caa_likely(rcu_gp.has_membarrier))
+		(void) membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+	else
+		cmm_smp_mb();
+}
+
+#include "urcu-stats-impl.h"
+
+/*
+ * Return whether all read-side critical sections of phase are done.
+ * Unlock counts are summed first: a reader counted as unlocked had its
+ * lock counted in the second sum, so the sums are only equal if no
+ * reader of that phase is active. Readers which loaded the phase before
+ * it was last flipped, but increment their lock count afterwards, may be
+ * missed by the second sum: they observe the updates done before the
+ * grace period, and are waited for by the next grace period.
+ */
+static int readers_done(unsigned long phase)
+{
+	struct rcu_percpu_counts *counts = rcu_gp.counts;
+	unsigned long locks, unlocks;
+	unsigned int i;
+
+	unlocks = CMM_LOAD_SHARED(rcu_gp.shared.unlock[phase]);
+	for (i = 0; i < counts->nr_cpus; i++)
+		unlocks += CMM_LOAD_SHARED(counts->cpu[i].unlock[phase]);
+	/* Read unlock counts before lock counts. */
+	smp_mb_master();
+	locks = CMM_LOAD_SHARED(rcu_gp.shared.lock[phase]);
+	for (i = 0; i < counts->nr_cpus; i++)
+		locks += CMM_LOAD_SHARED(counts->cpu[i].lock[phase]);
+	return locks == unlocks;
+}
+
+/*
+ * In expedited mode, busy-wait on the readers without ever falling back
+ * to sleeping: trades CPU time for grace period latency.
+ */
+static void wait_for_readers(unsigned long phase, int expedited)
+{
+	struct urcu_wait_spin spin;
+	int sleeping = 0;
+
+	urcu_tp2(wait_for_readers, phase, expedited);
+	urcu_wait_spin_start(&spin, &gp_wait_estimate);
+	while (!readers_done(phase)) {
+		if (!expedited && !sleeping)
+			sleeping = urcu_wait_spin_expired(&spin);
+		if (sleeping) {
+			rcu_stats_gp_sleep();
+			(void) poll(NULL, 0, RCU_SLEEP_DELAY_MS);
+		} else
+			caa_cpu_relax();
+	}
+}
+
+static void do_synchronize_rcu(int expedited)
+{
+	uint64_t start_ns;
+
+	urcu_tp1(synchronize_rcu, expedited);
+	mutex_lock(&rcu_gp_lock);
+	start_ns = urcu_wait_now_ns();
+
+	/* Take care of grace periods before urcu_percpu constructor. */
+	if (caa_unlikely(!rcu_gp.counts))
+		init_counts();
+
+	/* Grace period begins. Pairs with start_poll_synchronize_rcu(). */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_tp1(gp_begin, rcu_gp_seq);
+
+	/*
+	 * Write new ptr before reading the counters. Pairs with the
+	 * read-side barrier following the lock count increment.
+	 */
+	smp_mb_master();
+
+	/*
+	 * Wait for the stragglers of the previous grace period, which
+	 * loaded the phase before its flip.
+	 */
+	wait_for_readers(rcu_gp.ctr ^ RCU_GP_CTR_PHASE, expedited);
+
+	/* Switch parity: 0 -> 1, 1 -> 0 */
+	CMM_STORE_SHARED(rcu_gp.ctr, rcu_gp.ctr ^ RCU_GP_CTR_PHASE);
+
+	/* Commit the phase flip before waiting for the old phase. */
+	cmm_smp_mb();
+
+	wait_for_readers(rcu_gp.ctr ^ RCU_GP_CTR_PHASE, expedited);
+
+	/*
+	 * Finish waiting for reader threads before letting the old ptr being
+	 * freed. Pairs with the read-side barrier preceding the unlock
+	 * count increment.
+	 */
+	smp_mb_master();
+
+	rcu_stats_gp_end(urcu_wait_estimate_end(&gp_wait_estimate,
+			start_ns));
+	rcu_stats_add_waiters(1);
+	/* Grace period ends. Pairs with poll_state_synchronize_rcu(). */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_tp1(gp_end, rcu_gp_seq);
+	mutex_unlock(&rcu_gp_lock);
+}
+
+void synchronize_rcu(void)
+{
+	do_synchronize_rcu(0);
+}
+
+/*
+ * Expedited grace period: busy-wait on readers until they report a
+ * quiescent state, without sleeping.
+ */
+void synchronize_rcu_expedited(void)
+{
+	do_synchronize_rcu(1);
+}
+
+/*
+ * library wrappers to be used by non-LGPL compatible source code.
+ */
+
+void rcu_read_lock(void)
+{
+	_rcu_read_lock();
+}
+
+void rcu_read_unlock(void)
+{
+	_rcu_read_unlock();
+}
+
+int rcu_read_ongoing(void)
+{
+	return _rcu_read_ongoing();
+}
+
+static unsigned int nr_cpus(void)
+{
+	unsigned int nr = DEFAULT_NR_CPUS;
+#ifdef HAVE_SYSCONF
+	long maxcpus;
+
+	maxcpus = sysconf(_SC_NPROCESSORS_CONF);
+	if (maxcpus > 0)
+		nr = maxcpus;
+#endif
+	return nr;
+}
+
+/* Called with rcu_gp_lock held. */
+static
+void init_counts(void)
+{
+	struct rcu_percpu_counts *counts;
+	unsigned int nr = nr_cpus();
+	size_t len;
+	int ret;
+
+	len = sizeof(*counts) + nr * sizeof(struct rcu_percpu_count);
+	ret = posix_memalign((void **) &counts, CAA_CACHE_LINE_SIZE, len);
+	if (ret)
+		urcu_die(ret);
+	memset(counts, 0, len);
+	counts->nr_cpus = nr;
+	/*
+	 * Readers which started before initialization use the shared
+	 * counters, which are summed along with the per-CPU counters.
+	 */
+	rcu_set_pointer(&rcu_gp.counts, counts);
+
+	/*
+	 * Grace periods only rely on sys_membarrier once it is
+	 * registered, and set has_membarrier with rcu_gp_lock held.
+	 */
+	ret = membarrier(MEMBARRIER_CMD_QUERY, 0);
+	if (ret >= 0 && (ret & MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+			&& !membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0))
+		CMM_STORE_SHARED(rcu_gp.has_membarrier, 1);
+}
+
+static
+void rcu_percpu_init(void)
+{
+	mutex_lock(&rcu_gp_lock);
+	if (!rcu_gp.counts)
+		init_counts();
+	mutex_unlock(&rcu_gp_lock);
+}
+
+/*
+ * Holding the rcu_gp_lock across fork will make sure we fork() don't race with
+ * a concurrent thread executing with this same lock held.
+ */
+void rcu_percpu_before_fork(void)
+{
+	mutex_lock(&rcu_gp_lock);
+}
+
+void rcu_percpu_after_fork_parent(void)
+{
+	mutex_unlock(&rcu_gp_lock);
+}
+
+/*
+ * Only the thread calling fork() exists in the child: discard the
+ * read-side critical sections of the other threads by resetting the
+ * counters, accounting for the critical section of the current thread,
+ * if any. Called with rcu_gp_lock held.
+ */
+void rcu_percpu_after_fork_child(void)
+{
+	struct rcu_percpu_counts *counts = rcu_gp.counts;
+	unsigned long tmp = URCU_TLS(rcu_reader);
+
+	if (counts)
+		memset(counts->cpu, 0,
+			counts->nr_cpus * sizeof(struct rcu_percpu_count));
+	memset(&rcu_gp.shared, 0, sizeof(rcu_gp.shared));
+	if (tmp)
+		rcu_gp.shared.lock[tmp & RCU_GP_CTR_PHASE] = 1;
+	if (rcu_gp.has_membarrier)
+		(void) membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0);
+	mutex_unlock(&rcu_gp_lock);
+}
+
+void *rcu_dereference_sym_percpu(void *p)
+{
+	return _rcu_dereference(p);
+}
+
+void *rcu_set_pointer_sym_percpu(void **p, void *v)
+{
+	cmm_wmb();
+	uatomic_set(p, v);
+	return v;
+}
+
+void *rcu_xchg_pointer_sym_percpu(void **p, void *v)
+{
+	return uatomic_xchg_mo(p, v, CMM_ACQ_REL);
+}
+
+void *rcu_cmpxchg_pointer_sym_percpu(void **p, void *old, void *_new)
+{
+	cmm_wmb();
+	return uatomic_cmpxchg(p, old, _new);
+}
+
+DEFINE_RCU_FLAVOR(rcu_flavor);
+
+#include "urcu-call-rcu-impl.h"
+#include "urcu-defer-impl.h"
+#include "urcu-poll-impl.h"
@@ -46,8 +46,7 @@ void *rcu_set_pointer_sym(void **p, void *v)
 
 void *rcu_xchg_pointer_sym(void **p, void *v)
 {
-	cmm_wmb();
-	return uatomic_xchg(p, v);
+	return uatomic_xchg_mo(p, v, CMM_ACQ_REL);
 }
 
 void *rcu_cmpxchg_pointer_sym(void **p, void *old, void *_new)
@@ -0,0 +1,246 @@
+#ifndef _URCU_POLL_IMPL_H
+#define _URCU_POLL_IMPL_H
+
+/*
+ * urcu-poll-impl.h
+ *
+ * Userspace RCU library - Grace period polling API
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Expects to be included after urcu-call-rcu-impl.h, and expects the
+ * including flavor to increment rcu_gp_seq (with rcu_gp_lock held) at
+ * the beginning and at the end of each grace period. An odd sequence
+ * number therefore means a grace period is in progress.
+ *
+ * Flavors with a different sequence numbering can override
+ * URCU_GP_SEQ_SNAP(), which returns the sequence number marking the end
+ * of the first grace period beginning after the sequence number passed
+ * as parameter was read.
+ */
+
+#include "urcu-poll.h"
+
+#define URCU_GP_SEQ_CMP_GE(a, b)	((long) ((a) - (b)) >= 0)
+
+#ifndef URCU_GP_SEQ_SNAP
+/* Skip the grace period in progress, if any. */
+#define URCU_GP_SEQ_SNAP(seq)		(((seq) + 3) & ~1UL)
+#endif
+
+/*
+ * The poll worker piggy-backs on the default call_rcu thread to make
+ * sure grace periods keep being performed until the latest requested
+ * target is reached. Only a single rcu_head is ever in flight.
+ * Notifiers are queued in increasing grace period order.
+ */
+struct urcu_poll_worker_state {
+	struct urcu_gp_poll_state latest_target;
+	struct rcu_head rcu_head;
+	pthread_mutex_t lock;
+	int active;
+	int32_t futex;		/* synchronize_rcu_timeout() waiters */
+	struct cds_list_head notifiers;
+};
+
+static struct urcu_poll_worker_state poll_worker_gp_state = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.notifiers = CDS_LIST_HEAD_INIT(poll_worker_gp_state.notifiers),
+};
+
+static void urcu_poll_notify(struct urcu_gp_notifier *notifier)
+{
+	uint64_t one = 1;
+	ssize_t ret;
+
+	if (notifier->func) {
+		notifier->func(notifier);
+		return;
+	}
+	do {
+		ret = write(notifier->fd, &one, sizeof(one));
+	} while (ret < 0 && errno == EINTR);
+	/*
+	 * EAGAIN means the eventfd counter is saturated or the pipe is
+	 * full: fd is readable already.
+	 */
+	if (ret < 0 && errno != EAGAIN)
+		urcu_die(errno);
+}
+
+static void urcu_poll_wake_up(void)
+{
+	/* Write to rcu_gp_seq before reading/writing futex */
+	cmm_smp_mb();
+	if (caa_unlikely(uatomic_read(&poll_worker_gp_state.futex) == -1)) {
+		uatomic_set(&poll_worker_gp_state.futex, 0);
+		futex_async(&poll_worker_gp_state.futex, FUTEX_WAKE, INT_MAX,
+			NULL, NULL, 0);
+	}
+}
+
+static void urcu_poll_worker_cb(struct rcu_head *head)
+{
+	struct urcu_gp_notifier *notifier, *tmp;
+	CDS_LIST_HEAD(completed);
+
+	/* A grace period completed since the callback was queued. */
+	urcu_poll_wake_up();
+	call_rcu_lock(&poll_worker_gp_state.lock);
+	cds_list_for_each_entry_safe(notifier, tmp,
+			&poll_worker_gp_state.notifiers, node) {
+		if (!URCU_GP_SEQ_CMP_GE(CMM_LOAD_SHARED(rcu_gp_seq),
+				notifier->state.grace_period_id))
+			break;
+		cds_list_move(&notifier->node, completed.prev);
+	}
+	if (!URCU_GP_SEQ_CMP_GE(CMM_LOAD_SHARED(rcu_gp_seq),
+			poll_worker_gp_state.latest_target.grace_period_id)) {
+		/* A newer target was requested: re-arm. */
+		call_rcu_enqueue(head, urcu_poll_worker_cb,
+			get_default_call_rcu_data());
+	} else {
+		poll_worker_gp_state.active = 0;
+	}
+	call_rcu_unlock(&poll_worker_gp_state.lock);
+
+	if (cds_list_empty(&completed))
+		return;
+	/* Order end of grace period before notification. */
+	cmm_smp_mb();
+	cds_list_for_each_entry_safe(notifier, tmp, &completed, node)
+		urcu_poll_notify(notifier);
+}
+
+/*
+ * Return the state identifying the first grace period beginning after
+ * this call, without starting it.
+ */
+static struct urcu_gp_poll_state urcu_poll_get_state(void)
+{
+	struct urcu_gp_poll_state state;
+	unsigned long seq;
+
+	/*
+	 * Order prior memory accesses (e.g. removal of the object to
+	 * reclaim) before reading the grace period sequence.
+	 */
+	cmm_smp_mb();
+	seq = CMM_LOAD_SHARED(rcu_gp_seq);
+	/*
+	 * Wait for the end of the first grace period that begins after
+	 * this point.
+	 */
+	state.grace_period_id = URCU_GP_SEQ_SNAP(seq);
+	return state;
+}
+
+struct urcu_gp_poll_state start_poll_synchronize_rcu(void)
+{
+	struct urcu_gp_poll_state new_target;
+
+	new_target = urcu_poll_get_state();
+
+	call_rcu_lock(&poll_worker_gp_state.lock);
+	if (URCU_GP_SEQ_CMP_GE(new_target.grace_period_id,
+			poll_worker_gp_state.latest_target.grace_period_id))
+		poll_worker_gp_state.latest_target = new_target;
+	if (!poll_worker_gp_state.active) {
+		poll_worker_gp_state.active = 1;
+		call_rcu_enqueue(&poll_worker_gp_state.rcu_head,
+			urcu_poll_worker_cb, get_default_call_rcu_data());
+	}
+	call_rcu_unlock(&poll_worker_gp_state.lock);
+	return new_target;
+}
+
+struct urcu_gp_poll_state start_poll_synchronize_rcu_notify(
+		struct urcu_gp_notifier *notifier)
+{
+	struct urcu_gp_poll_state new_target;
+
+	call_rcu_lock(&poll_worker_gp_state.lock);
+	/*
+	 * Taking the state with the lock held keeps the notifier list
+	 * sorted.
+	 */
+	new_target = urcu_poll_get_state();
+	notifier->state = new_target;
+	cds_list_add_tail(&notifier->node, &poll_worker_gp_state.notifiers);
+	if (URCU_GP_SEQ_CMP_GE(new_target.grace_period_id,
+			poll_worker_gp_state.latest_target.grace_period_id))
+		poll_worker_gp_state.latest_target = new_target;
+	if (!poll_worker_gp_state.active) {
+		poll_worker_gp_state.active = 1;
+		call_rcu_enqueue(&poll_worker_gp_state.rcu_head,
+			urcu_poll_worker_cb, get_default_call_rcu_data());
+	}
+	call_rcu_unlock(&poll_worker_gp_state.lock);
+	return new_target;
+}
+
+int poll_state_synchronize_rcu(struct urcu_gp_poll_state state)
+{
+	if (!URCU_GP_SEQ_CMP_GE(CMM_LOAD_SHARED(rcu_gp_seq),
+			state.grace_period_id))
+		return 0;
+	/* Order end of grace period before following memory accesses. */
+	cmm_smp_mb();
+	return 1;
+}
+
+/*
+ * Waiters share the futex: each of them sets it to -1 before checking
+ * the grace period sequence, and urcu_poll_wake_up() wakes them all.
+ * A waiter giving up on timeout therefore leaves nothing behind.
+ */
+int synchronize_rcu_timeout(unsigned long timeout_ms)
+{
+	struct urcu_gp_poll_state state;
+	struct timespec ts;
+	uint64_t deadline_ns;
+	int was_online, ret = 0;
+
+	deadline_ns = urcu_wait_now_ns() + timeout_ms * 1000000ULL;
+	state = start_poll_synchronize_rcu();
+
+	/* Put in offline state in QSBR. */
+	was_online = rcu_read_ongoing();
+	if (was_online)
+		rcu_thread_offline();
+	for (;;) {
+		uatomic_set(&poll_worker_gp_state.futex, -1);
+		/* Write futex before reading rcu_gp_seq */
+		cmm_smp_mb();
+		if (poll_state_synchronize_rcu(state))
+			break;
+		if (!urcu_wait_deadline_ts(deadline_ns, &ts)) {
+			ret = -ETIMEDOUT;
+			break;
+		}
+		if (uatomic_read(&poll_worker_gp_state.futex) == -1)
+			futex_async(&poll_worker_gp_state.futex, FUTEX_WAIT, -1,
+				&ts, NULL, 0);
+	}
+	if (was_online)
+		rcu_thread_online();
+	return ret;
+}
+
+#endif /* _URCU_POLL_IMPL_H */
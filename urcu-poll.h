@@ -0,0 +1,101 @@
+#ifndef _URCU_POLL_H
+#define _URCU_POLL_H
+
+/*
+ * urcu-poll.h
+ *
+ * Userspace RCU header - grace period polling
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <urcu/list.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Grace period cookie returned by start_poll_synchronize_rcu(). It should
+ * be considered opaque by the caller: only pass it to
+ * poll_state_synchronize_rcu() of the same RCU flavor.
+ */
+struct urcu_gp_poll_state {
+	unsigned long grace_period_id;
+};
+
+/*
+ * Grace period completion notifier, for event loops which cannot block
+ * in synchronize_rcu(). With a NULL func, 1 is added to the counter of
+ * the eventfd (or written to the pipe) fd once the grace period
+ * completes, so the loop can poll fd alongside its other file
+ * descriptors. Otherwise, func is called instead, from a call_rcu worker
+ * thread. The notifier is owned by the library from
+ * start_poll_synchronize_rcu_notify() until it is notified, and can be
+ * reused from then on, including from func.
+ */
+struct urcu_gp_notifier {
+	void (*func)(struct urcu_gp_notifier *notifier);
+	int fd;
+	/* Private. */
+	struct urcu_gp_poll_state state;
+	struct cds_list_head node;
+};
+
+/*
+ * Exported functions
+ *
+ * start_poll_synchronize_rcu() returns a cookie identifying a grace
+ * period starting after the call, and makes sure such a grace period
+ * will eventually be performed by the call_rcu worker threads. It never
+ * blocks on the grace period.
+ *
+ * poll_state_synchronize_rcu() returns non-zero if the grace period
+ * identified by the cookie has completed. It is lock-free and can be
+ * called at any rate. When it returns non-zero, it issues a memory
+ * barrier: memory accesses following the call (e.g. free()) are
+ * ordered after the end of the grace period.
+ *
+ * start_poll_synchronize_rcu_notify() behaves like
+ * start_poll_synchronize_rcu(), and also notifies the notifier once the
+ * grace period identified by the returned cookie has completed.
+ * Notifiers are invoked in the order they were started. When fd becomes
+ * readable, poll_state_synchronize_rcu() on the returned cookie returns
+ * non-zero.
+ *
+ * synchronize_rcu_timeout() waits for a grace period like
+ * synchronize_rcu(), but returns -ETIMEDOUT if it does not complete
+ * within timeout_ms milliseconds, 0 otherwise. The grace period is
+ * driven by the call_rcu worker threads, as for
+ * start_poll_synchronize_rcu().
+ *
+ * Those functions may be called from threads which are not registered
+ * as RCU readers, but must not be called from within a RCU read-side
+ * critical section when expecting progress (QSBR threads should be
+ * offline or report quiescent states while polling).
+ */
+struct urcu_gp_poll_state start_poll_synchronize_rcu(void);
+int poll_state_synchronize_rcu(struct urcu_gp_poll_state state);
+struct urcu_gp_poll_state start_poll_synchronize_rcu_notify(
+		struct urcu_gp_notifier *notifier);
+int synchronize_rcu_timeout(unsigned long timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_POLL_H */
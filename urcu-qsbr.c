@@ -34,6 +34,7 @@
 #include <string.h>
 #include <errno.h>
 #include <poll.h>
+#include <unistd.h>
 
 #include "urcu/wfcqueue.h"
 #include "urcu/map/urcu-qsbr.h"
@@ -41,25 +42,42 @@
 #include "urcu/static/urcu-qsbr.h"
 #include "urcu-pointer.h"
 #include "urcu/tls-compat.h"
+#include "urcu/blocking.h"
 
 #include "urcu-die.h"
+#include "urcu-tp.h"
 #include "urcu-wait.h"
+#include "urcu-registry.h"
 
 /* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
 #undef _LGPL_SOURCE
 #include "urcu-qsbr.h"
 #define _LGPL_SOURCE
 
+#ifdef __linux__
+#include <urcu/syscall-compat.h>
+#endif
+
+#ifdef SYS_membarrier
+# define membarrier(...)		syscall(SYS_membarrier, __VA_ARGS__)
+#else
+# define membarrier(...)		-ENOSYS
+#endif
+
+#define MEMBARRIER_CMD_QUERY				0
+#define MEMBARRIER_CMD_PRIVATE_EXPEDITED		(1 << 3)
+#define MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED	(1 << 4)
+
+static int init_done;
+int rcu_has_sys_membarrier;
+
+static
+void rcu_qsbr_init_locked(void);
 void __attribute__((destructor)) rcu_exit(void);
 
 static pthread_mutex_t rcu_gp_lock = PTHREAD_MUTEX_INITIALIZER;
 struct rcu_gp rcu_gp = { .ctr = RCU_GP_ONLINE };
 
-/*
- * Active attempts to check for reader Q.S. before calling futex().
- */
-#define RCU_QS_ACTIVE_ATTEMPTS 100
-
 /*
  * Written to only by each individual reader. Read by both the reader and the
  * writers.
@@ -71,7 +89,22 @@ unsigned int rcu_yield_active;
 DEFINE_URCU_TLS(unsigned int, rcu_rand_yield);
 #endif
 
-static CDS_LIST_HEAD(registry);
+static DEFINE_RCU_REGISTRY(registry);
+
+/*
+ * Grace period sequence number, used by the grace period polling API.
+ * Incremented at the beginning and at the end of each grace period, with
+ * rcu_gp_lock held: an odd value means a grace period is in progress.
+ */
+static unsigned long rcu_gp_seq;
+
+/*
+ * Running estimate of the grace period duration, sizing the spin phase
+ * of the grace period leader waiting for readers and of the batched
+ * synchronize_rcu() callers. Updated
+ * with rcu_gp_lock held.
+ */
+static struct urcu_wait_estimate gp_wait_estimate;
 
 /*
  * Queue keeping threads awaiting to wait for a grace period. Contains
@@ -79,10 +112,19 @@ static CDS_LIST_HEAD(registry);
  */
 static DEFINE_URCU_WAIT_QUEUE(gp_waiters);
 
+#include "urcu-lock-stats-impl.h"
+
 static void mutex_lock(pthread_mutex_t *mutex)
 {
+	struct rcu_lock_stats_state *ls =
+		rcu_lock_stats_of(mutex, &rcu_gp_lock, RCU_LOCK_GP);
+	uint64_t wait_start;
 	int ret;
 
+	wait_start = rcu_lock_stats_trylock(ls, mutex);
+	if (!wait_start)
+		return;
+
 #ifndef DISTRUST_SIGNALS_EXTREME
 	ret = pthread_mutex_lock(mutex);
 	if (ret)
@@ -94,97 +136,238 @@ static void mutex_lock(pthread_mutex_t *mutex)
 		poll(NULL,0,10);
 	}
 #endif /* #else #ifndef DISTRUST_SIGNALS_EXTREME */
+	rcu_lock_stats_acquired(ls, wait_start);
 }
 
 static void mutex_unlock(pthread_mutex_t *mutex)
 {
 	int ret;
 
+	rcu_lock_stats_release(rcu_lock_stats_of(mutex, &rcu_gp_lock,
+			RCU_LOCK_GP));
 	ret = pthread_mutex_unlock(mutex);
 	if (ret)
 		urcu_die(ret);
 }
 
+static void smp_mb_master(void)
+{
+	if (caa_likely(rcu_has_sys_membarrier))
+		(void) membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+	else
+		cmm_smp_mb();
+}
+
+#include "urcu-stall-impl.h"
+#include "urcu-stats-impl.h"
+
 /*
- * synchronize_rcu() waiting. Single thread.
+ * synchronize_rcu() waiting. Single thread. A non-NULL timeout bounds
+ * the wait for the stall detector.
  */
-static void wait_gp(void)
+static void wait_gp(const struct timespec *timeout)
 {
 	/* Read reader_gp before read futex */
 	cmm_smp_rmb();
-	if (uatomic_read(&rcu_gp.futex) == -1)
+	if (uatomic_read(&rcu_gp.futex) != -1)
+		return;
+	rcu_stats_gp_sleep();
+	urcu_tp(gp_futex_wait);
+	if (caa_likely(!timeout)) {
 		futex_noasync(&rcu_gp.futex, FUTEX_WAIT, -1,
 		      NULL, NULL, 0);
+		urcu_tp(gp_futex_wake);
+		return;
+	}
+#ifdef CONFIG_RCU_HAVE_FUTEX
+	(void) futex_noasync(&rcu_gp.futex, FUTEX_WAIT, -1,
+		      timeout, NULL, 0);
+#else
+	(void) poll(NULL, 0, timeout->tv_sec * 1000
+		+ timeout->tv_nsec / 1000000);
+#endif
+	urcu_tp(gp_futex_wake);
 }
 
-static void wait_for_readers(struct cds_list_head *input_readers,
-			struct cds_list_head *cur_snap_readers,
-			struct cds_list_head *qsreaders)
+/*
+ * Hierarchical quiescent state reporting, after the Linux kernel Tree
+ * RCU. Readers are spread over leaf nodes, RCU_QS_SHARD_LEAVES per
+ * registry shard. A grace period arms the readers it waits for, each
+ * armed reader holding a reference on its leaf, and each leaf holding
+ * armed readers holding a reference on the root. Readers report their
+ * quiescent state to their leaf, the last reporter of a leaf reports
+ * to the root, and the grace period only waits for the root count to
+ * drop to zero. Readers thus only touch shared cache lines when a grace
+ * period waits for them, and the grace period only polls the root.
+ *
+ * RCU_QS_NR_LEAVES must be a multiple of RCU_REGISTRY_NR_SHARDS.
+ */
+#define RCU_QS_NR_LEAVES	64
+#define RCU_QS_SHARD_LEAVES	(RCU_QS_NR_LEAVES / RCU_REGISTRY_NR_SHARDS)
+
+struct rcu_qs_node {
+	long pending;		/* References held by the children */
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+static struct rcu_qs_node qs_root;
+static struct rcu_qs_node qs_leaves[RCU_QS_NR_LEAVES];
+
+/* Next leaf assigned in each registry shard. */
+static unsigned int qs_next_leaf[RCU_REGISTRY_NR_SHARDS];
+
+static void rcu_qs_root_report(void)
 {
-	unsigned int wait_loops = 0;
-	struct rcu_reader *index, *tmp;
+	if (uatomic_add_return(&qs_root.pending, -1))
+		return;
+	/* Last quiescent state awaited: wake up the grace period. */
+	if (uatomic_read(&rcu_gp.futex) != -1)
+		return;
+	uatomic_set(&rcu_gp.futex, 0);
+	futex_noasync(&rcu_gp.futex, FUTEX_WAKE, 1,
+	      NULL, NULL, 0);
+}
+
+static void rcu_qs_leaf_report(struct rcu_qs_node *leaf)
+{
+	if (!uatomic_add_return(&leaf->pending, -1))
+		rcu_qs_root_report();
+}
+
+/*
+ * Report a quiescent state, unless the grace period already took it
+ * into account. The exchange on waiting orders the prior store of
+ * URCU_TLS(rcu_reader).ctr before the report.
+ */
+void rcu_qs_report(void)
+{
+	if (!uatomic_xchg(&URCU_TLS(rcu_reader).waiting, 0))
+		return;
+	rcu_qs_leaf_report(&qs_leaves[URCU_TLS(rcu_reader).qs_leaf]);
+}
+
+/*
+ * Report the readers armed by the grace period once the stall timeout
+ * is reached. Called with rcu_gp_lock held.
+ */
+static void rcu_qs_stall_check(struct rcu_stall_state *stall)
+{
+	struct rcu_registry_shard *shard;
+	rcu_stall_report_fct report;
+	struct rcu_reader *index;
+	unsigned long stall_ms;
+
+	report = rcu_stall_due(stall, &stall_ms);
+	if (caa_likely(!report))
+		return;
+	rcu_registry_for_each_shard(registry, shard) {
+		cds_list_for_each_entry(index, &shard->head, node) {
+			if (CMM_LOAD_SHARED(index->waiting))
+				report(index->tid, stall_ms,
+					CMM_LOAD_SHARED(rcu_gp_seq));
+		}
+	}
+}
+
+/*
+ * Wait for the online readers which did not observe the current
+ * rcu_gp.ctr value to report a quiescent state.
+ *
+ * In expedited mode, busy-wait on the readers without ever falling back
+ * to the futex sleep: trades CPU time for grace period latency.
+ */
+static void wait_for_readers(int expedited)
+{
+	char leaf_armed[RCU_QS_NR_LEAVES] = { 0 };
+	struct rcu_registry_shard *shard;
+	struct urcu_wait_spin spin;
+	int sleeping = 0;
+	struct rcu_reader *index;
+	struct rcu_stall_state stall;
+	struct timespec stall_ts;
+	unsigned int i;
+
+	rcu_stall_start(&stall);
+	urcu_wait_spin_start(&spin, &gp_wait_estimate);
+	urcu_tp2(wait_for_readers, registry, expedited);
 
 	/*
-	 * Wait for each thread URCU_TLS(rcu_reader).ctr to either
-	 * indicate quiescence (offline), or for them to observe the
-	 * current rcu_gp.ctr value.
+	 * Arm each reader which did not observe the current rcu_gp.ctr
+	 * value nor is offline. The grace period holds a reference on
+	 * the root, and on each leaf with armed readers, until all
+	 * readers are armed, so concurrent reports cannot complete it
+	 * early. A leaf reference is taken before arming its reader.
 	 */
-	for (;;) {
-		if (wait_loops < RCU_QS_ACTIVE_ATTEMPTS)
-			wait_loops++;
-		if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS) {
-			uatomic_set(&rcu_gp.futex, -1);
-			/*
-			 * Write futex before write waiting (the other side
-			 * reads them in the opposite order).
-			 */
-			cmm_smp_wmb();
-			cds_list_for_each_entry(index, input_readers, node) {
-				_CMM_STORE_SHARED(index->waiting, 1);
+	uatomic_set(&qs_root.pending, 1);
+	rcu_registry_for_each_shard(registry, shard) {
+		cds_list_for_each_entry(index, &shard->head, node) {
+			struct rcu_qs_node *leaf = &qs_leaves[index->qs_leaf];
+
+			if (rcu_reader_state(&index->ctr) != RCU_READER_ACTIVE_OLD)
+				continue;
+			if (!leaf_armed[index->qs_leaf]) {
+				leaf_armed[index->qs_leaf] = 1;
+				uatomic_inc(&qs_root.pending);
+				uatomic_set(&leaf->pending, 1);
 			}
-			/* Write futex before read reader_gp */
-			cmm_smp_mb();
+			uatomic_inc(&leaf->pending);
+			cmm_smp_mb__after_uatomic_inc();
+			_CMM_STORE_SHARED(index->waiting, 1);
 		}
-		cds_list_for_each_entry_safe(index, tmp, input_readers, node) {
-			switch (rcu_reader_state(&index->ctr)) {
-			case RCU_READER_ACTIVE_CURRENT:
-				if (cur_snap_readers) {
-					cds_list_move(&index->node,
-						cur_snap_readers);
-					break;
-				}
-				/* Fall-through */
-			case RCU_READER_INACTIVE:
-				cds_list_move(&index->node, qsreaders);
-				break;
-			case RCU_READER_ACTIVE_OLD:
-				/*
-				 * Old snapshot. Leaving node in
-				 * input_readers will make us busy-loop
-				 * until the snapshot becomes current or
-				 * the reader becomes inactive.
-				 */
-				break;
-			}
+	}
+
+	/*
+	 * Write waiting before reading reader_gp again: a reader which
+	 * stored its URCU_TLS(rcu_reader).ctr without seeing it armed is
+	 * seen quiescent here, and its report is done on its behalf.
+	 */
+	smp_mb_master();
+	rcu_registry_for_each_shard(registry, shard) {
+		cds_list_for_each_entry(index, &shard->head, node) {
+			if (!_CMM_LOAD_SHARED(index->waiting)
+					|| rcu_reader_state(&index->ctr)
+						== RCU_READER_ACTIVE_OLD)
+				continue;
+			if (uatomic_xchg(&index->waiting, 0))
+				rcu_qs_leaf_report(&qs_leaves[index->qs_leaf]);
 		}
+	}
+
+	/* Drop the references of the grace period. */
+	for (i = 0; i < RCU_QS_NR_LEAVES; i++) {
+		if (leaf_armed[i])
+			rcu_qs_leaf_report(&qs_leaves[i]);
+	}
+	rcu_qs_root_report();
 
-		if (cds_list_empty(input_readers)) {
-			if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS) {
-				/* Read reader_gp before write futex */
+	/*
+	 * Wait for the root to account for the quiescent state of all
+	 * armed readers.
+	 */
+	for (;;) {
+		if (!expedited && !sleeping)
+			sleeping = urcu_wait_spin_expired(&spin);
+		if (sleeping) {
+			uatomic_set(&rcu_gp.futex, -1);
+			/* Write futex before read root pending */
+			cmm_smp_mb();
+		}
+		if (!uatomic_read(&qs_root.pending)) {
+			if (sleeping) {
+				/* Read root pending before write futex */
 				cmm_smp_mb();
 				uatomic_set(&rcu_gp.futex, 0);
 			}
 			break;
+		}
+		rcu_qs_stall_check(&stall);
+		if (sleeping) {
+			wait_gp(rcu_stall_wait_timeout(&stall, &stall_ts));
 		} else {
-			if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS) {
-				wait_gp();
-			} else {
 #ifndef HAS_INCOHERENT_CACHES
-				caa_cpu_relax();
+			caa_cpu_relax();
 #else /* #ifndef HAS_INCOHERENT_CACHES */
-				cmm_smp_mb();
+			cmm_smp_mb();
 #endif /* #else #ifndef HAS_INCOHERENT_CACHES */
-			}
 		}
 	}
 }
@@ -195,14 +378,14 @@ static void wait_for_readers(struct cds_list_head *input_readers,
  */
 
 #if (CAA_BITS_PER_LONG < 64)
-void synchronize_rcu(void)
+static void do_synchronize_rcu(int expedited)
 {
-	CDS_LIST_HEAD(cur_snap_readers);
-	CDS_LIST_HEAD(qsreaders);
 	unsigned long was_online;
 	DEFINE_URCU_WAIT_NODE(wait, URCU_WAIT_WAITING);
 	struct urcu_waiters waiters;
+	uint64_t start_ns;
 
+	urcu_tp1(synchronize_rcu, expedited);
 	was_online = rcu_read_ongoing();
 
 	/* All threads should read qparity before accessing data structure
@@ -218,6 +401,16 @@ void synchronize_rcu(void)
 	else
 		cmm_smp_mb();
 
+	/*
+	 * Expedited grace periods bypass the waiter queue, leaving
+	 * queued waiters to their own leader.
+	 */
+	if (expedited) {
+		waiters.head = NULL;
+		mutex_lock(&rcu_gp_lock);
+		goto gp_begin;
+	}
+
 	/*
 	 * Add ourself to gp_waiters queue of threads awaiting to wait
 	 * for a grace period. Proceed to perform the grace period only
@@ -225,7 +418,7 @@ void synchronize_rcu(void)
 	 */
 	if (urcu_wait_add(&gp_waiters, &wait) != 0) {
 		/* Not first in queue: will be awakened by another thread. */
-		urcu_adaptative_busy_wait(&wait);
+		urcu_adaptative_busy_wait(&wait, &gp_wait_estimate);
 		goto gp_end;
 	}
 	/* We won't need to wake ourself up */
@@ -237,14 +430,30 @@ void synchronize_rcu(void)
 	 * Move all waiters into our local queue.
 	 */
 	urcu_move_waiters(&waiters, &gp_waiters);
+gp_begin:
+	start_ns = urcu_wait_now_ns();
+
+	/* Grace period begins. Pairs with start_poll_synchronize_rcu(). */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_tp1(gp_begin, rcu_gp_seq);
 
-	if (cds_list_empty(&registry))
+	/* Readers registered while rcu_gp_lock was held. */
+	rcu_registry_merge_pending(registry, NULL);
+	if (rcu_registry_empty(registry))
 		goto out;
 
+	/*
+	 * Removals performed before the grace period, by this thread or
+	 * by the waiters moved to our queue, before reading reader
+	 * states. Pairs with the barrier following the store of
+	 * URCU_TLS(rcu_reader).ctr by the readers.
+	 */
+	smp_mb_master();
+
 	/*
 	 * Wait for readers to observe original parity or be quiescent.
 	 */
-	wait_for_readers(&registry, &cur_snap_readers, &qsreaders);
+	wait_for_readers(expedited);
 
 	/*
 	 * Must finish waiting for quiescent state for original parity
@@ -285,15 +494,23 @@ void synchronize_rcu(void)
 	/*
 	 * Wait for readers to observe new parity or be quiescent.
 	 */
-	wait_for_readers(&cur_snap_readers, NULL, &qsreaders);
-
+	wait_for_readers(expedited);
+out:
 	/*
-	 * Put quiescent reader list back into registry.
+	 * Grace period ends. Pairs with poll_state_synchronize_rcu().
+	 * Order reads of reader state before the sequence update, and
+	 * before freeing. Pairs with the barrier preceding the store of
+	 * URCU_TLS(rcu_reader).ctr by the readers.
 	 */
-	cds_list_splice(&qsreaders, &registry);
-out:
+	smp_mb_master();
+	rcu_stats_gp_end(urcu_wait_estimate_end(&gp_wait_estimate,
+			start_ns));
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_tp1(gp_end, rcu_gp_seq);
 	mutex_unlock(&rcu_gp_lock);
-	urcu_wake_all_waiters(&waiters);
+	/* Expedited grace periods only serve their caller. */
+	rcu_stats_add_waiters(urcu_wake_all_waiters(&waiters)
+		+ (expedited ? 1 : 0));
 gp_end:
 	/*
 	 * Finish waiting for reader threads before letting the old ptr being
@@ -305,13 +522,14 @@ gp_end:
 		cmm_smp_mb();
 }
 #else /* !(CAA_BITS_PER_LONG < 64) */
-void synchronize_rcu(void)
+static void do_synchronize_rcu(int expedited)
 {
-	CDS_LIST_HEAD(qsreaders);
 	unsigned long was_online;
 	DEFINE_URCU_WAIT_NODE(wait, URCU_WAIT_WAITING);
 	struct urcu_waiters waiters;
+	uint64_t start_ns;
 
+	urcu_tp1(synchronize_rcu, expedited);
 	was_online = rcu_read_ongoing();
 
 	/*
@@ -324,6 +542,16 @@ void synchronize_rcu(void)
 	else
 		cmm_smp_mb();
 
+	/*
+	 * Expedited grace periods bypass the waiter queue, leaving
+	 * queued waiters to their own leader.
+	 */
+	if (expedited) {
+		waiters.head = NULL;
+		mutex_lock(&rcu_gp_lock);
+		goto gp_begin;
+	}
+
 	/*
 	 * Add ourself to gp_waiters queue of threads awaiting to wait
 	 * for a grace period. Proceed to perform the grace period only
@@ -331,7 +559,7 @@ void synchronize_rcu(void)
 	 */
 	if (urcu_wait_add(&gp_waiters, &wait) != 0) {
 		/* Not first in queue: will be awakened by another thread. */
-		urcu_adaptative_busy_wait(&wait);
+		urcu_adaptative_busy_wait(&wait, &gp_wait_estimate);
 		goto gp_end;
 	}
 	/* We won't need to wake ourself up */
@@ -343,10 +571,26 @@ void synchronize_rcu(void)
 	 * Move all waiters into our local queue.
 	 */
 	urcu_move_waiters(&waiters, &gp_waiters);
+gp_begin:
+	start_ns = urcu_wait_now_ns();
+
+	/* Grace period begins. Pairs with start_poll_synchronize_rcu(). */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_tp1(gp_begin, rcu_gp_seq);
 
-	if (cds_list_empty(&registry))
+	/* Readers registered while rcu_gp_lock was held. */
+	rcu_registry_merge_pending(registry, NULL);
+	if (rcu_registry_empty(registry))
 		goto out;
 
+	/*
+	 * Removals performed before the grace period, by this thread or
+	 * by the waiters moved to our queue, before reading reader
+	 * states. Pairs with the barrier following the store of
+	 * URCU_TLS(rcu_reader).ctr by the readers.
+	 */
+	smp_mb_master();
+
 	/* Increment current G.P. */
 	CMM_STORE_SHARED(rcu_gp.ctr, rcu_gp.ctr + RCU_GP_CTR);
 
@@ -369,15 +613,23 @@ void synchronize_rcu(void)
 	/*
 	 * Wait for readers to observe new count of be quiescent.
 	 */
-	wait_for_readers(&registry, NULL, &qsreaders);
-
+	wait_for_readers(expedited);
+out:
 	/*
-	 * Put quiescent reader list back into registry.
+	 * Grace period ends. Pairs with poll_state_synchronize_rcu().
+	 * Order reads of reader state before the sequence update, and
+	 * before freeing. Pairs with the barrier preceding the store of
+	 * URCU_TLS(rcu_reader).ctr by the readers.
 	 */
-	cds_list_splice(&qsreaders, &registry);
-out:
+	smp_mb_master();
+	rcu_stats_gp_end(urcu_wait_estimate_end(&gp_wait_estimate,
+			start_ns));
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_tp1(gp_end, rcu_gp_seq);
 	mutex_unlock(&rcu_gp_lock);
-	urcu_wake_all_waiters(&waiters);
+	/* Expedited grace periods only serve their caller. */
+	rcu_stats_add_waiters(urcu_wake_all_waiters(&waiters)
+		+ (expedited ? 1 : 0));
 gp_end:
 	if (was_online)
 		rcu_thread_online();
@@ -386,6 +638,20 @@ gp_end:
 }
 #endif  /* !(CAA_BITS_PER_LONG < 64) */
 
+void synchronize_rcu(void)
+{
+	do_synchronize_rcu(0);
+}
+
+/*
+ * Expedited grace period: bypass the waiter queue and busy-wait on
+ * readers until they report a quiescent state.
+ */
+void synchronize_rcu_expedited(void)
+{
+	do_synchronize_rcu(1);
+}
+
 /*
  * library wrappers to be used by non-LGPL compatible source code.
  */
@@ -410,6 +676,11 @@ void rcu_quiescent_state(void)
 	_rcu_quiescent_state();
 }
 
+void rcu_quiescent_state_maybe(void)
+{
+	_rcu_quiescent_state_maybe();
+}
+
 void rcu_thread_offline(void)
 {
 	_rcu_thread_offline();
@@ -420,14 +691,65 @@ void rcu_thread_online(void)
 	_rcu_thread_online();
 }
 
+static int blocking_offline(void)
+{
+	if (!URCU_TLS(rcu_reader).ctr)
+		return 0;
+	_rcu_thread_offline();
+	return 1;
+}
+
+static void blocking_online(void)
+{
+	_rcu_thread_online();
+}
+
+static const struct urcu_blocking_ops blocking_ops = {
+	.offline = blocking_offline,
+	.online = blocking_online,
+};
+
+void rcu_thread_set_auto_offline(int enable)
+{
+	urcu_blocking_set_ops(enable ? &blocking_ops : NULL);
+}
+
+/*
+ * Registration does not wait for a grace period holding rcu_gp_lock:
+ * the reader is rather pushed on the pending stack of its shard, and
+ * merged by the next grace period.
+ */
 void rcu_register_thread(void)
 {
+	struct rcu_registry_shard *shard;
+	unsigned int i;
+	int ret;
+
 	URCU_TLS(rcu_reader).tid = pthread_self();
 	assert(URCU_TLS(rcu_reader).ctr == 0);
 
-	mutex_lock(&rcu_gp_lock);
-	cds_list_add(&URCU_TLS(rcu_reader).node, &registry);
-	mutex_unlock(&rcu_gp_lock);
+	if (CMM_LOAD_SHARED(init_done)) {
+		ret = pthread_mutex_trylock(&rcu_gp_lock);
+		if (ret && ret != EBUSY)
+			urcu_die(ret);
+		if (!ret)
+			rcu_lock_stats_acquired(rcu_lock_stats_of(&rcu_gp_lock,
+					&rcu_gp_lock, RCU_LOCK_GP), 0);
+	} else {
+		mutex_lock(&rcu_gp_lock);
+		rcu_qsbr_init_locked();	/* First registration initializes the library. */
+		ret = 0;
+	}
+	shard = rcu_registry_local_shard(registry);
+	i = shard - registry;
+	URCU_TLS(rcu_reader).qs_leaf = i * RCU_QS_SHARD_LEAVES
+		+ uatomic_add_return(&qs_next_leaf[i], 1) % RCU_QS_SHARD_LEAVES;
+	if (ret) {
+		rcu_registry_add_pending(shard, &URCU_TLS(rcu_reader).node);
+	} else {
+		cds_list_add(&URCU_TLS(rcu_reader).node, &shard->head);
+		mutex_unlock(&rcu_gp_lock);
+	}
 	_rcu_thread_online();
 }
 
@@ -438,17 +760,39 @@ void rcu_unregister_thread(void)
 	 * with a waiting writer.
 	 */
 	_rcu_thread_offline();
+	urcu_blocking_set_ops(NULL);
 	mutex_lock(&rcu_gp_lock);
+	rcu_registry_merge_pending(registry, NULL);	/* In case we are still pending */
 	cds_list_del(&URCU_TLS(rcu_reader).node);
 	mutex_unlock(&rcu_gp_lock);
 }
 
+/*
+ * Detect sys_membarrier when the first reader registers, rather than
+ * from a constructor, so processes linking the library without using
+ * RCU do not issue the system calls. Grace periods without registered
+ * readers do not need it. Called with rcu_gp_lock held.
+ */
+static
+void rcu_qsbr_init_locked(void)
+{
+	int ret;
+
+	if (init_done)
+		return;
+	ret = membarrier(MEMBARRIER_CMD_QUERY, 0);
+	if (ret >= 0 && (ret & MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+			&& !membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0))
+		rcu_has_sys_membarrier = 1;
+	CMM_STORE_SHARED(init_done, 1);
+}
+
 void rcu_exit(void)
 {
 	/*
 	 * Assertion disabled because call_rcu threads are now rcu
 	 * readers, and left running at exit.
-	 * assert(cds_list_empty(&registry));
+	 * assert(rcu_registry_empty(registry));
 	 */
 }
 
@@ -456,3 +800,4 @@ DEFINE_RCU_FLAVOR(rcu_flavor);
 
 #include "urcu-call-rcu-impl.h"
 #include "urcu-defer-impl.h"
+#include "urcu-poll-impl.h"
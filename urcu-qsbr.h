@@ -73,6 +73,7 @@ extern "C" {
 #define rcu_read_ongoing_qsbr		_rcu_read_ongoing
 
 #define rcu_quiescent_state_qsbr	_rcu_quiescent_state
+#define rcu_quiescent_state_maybe_qsbr	_rcu_quiescent_state_maybe
 #define rcu_thread_offline_qsbr		_rcu_thread_offline
 #define rcu_thread_online_qsbr		_rcu_thread_online
 
@@ -110,6 +111,7 @@ extern void rcu_read_unlock(void);
 
 extern int rcu_read_ongoing(void);
 extern void rcu_quiescent_state(void);
+extern void rcu_quiescent_state_maybe(void);
 extern void rcu_thread_offline(void);
 extern void rcu_thread_online(void);
 
@@ -117,17 +119,42 @@ extern void rcu_thread_online(void);
 
 extern void synchronize_rcu(void);
 
+/*
+ * synchronize_rcu_expedited() waits for a grace period like
+ * synchronize_rcu(), busy-waiting on readers rather than sleeping.
+ * Lowers grace period latency at the expense of CPU time.
+ */
+extern void synchronize_rcu_expedited(void);
+
 /*
  * Reader thread registration.
  */
 extern void rcu_register_thread(void);
 extern void rcu_unregister_thread(void);
 
+/*
+ * rcu_thread_set_auto_offline(1) makes the blocking waits of the
+ * library (contended wfcqueue dequeue mutex, cds_wfcq_wait_nonempty(),
+ * compat futex waits) take the calling registered thread offline while
+ * they block, and back online afterwards, so they do not delay grace
+ * periods. Only enable it in threads which never call those waits while
+ * using RCU-protected data, as when calling rcu_thread_offline()
+ * explicitly. rcu_thread_set_auto_offline(0), or unregistration,
+ * disables it.
+ */
+extern void rcu_thread_set_auto_offline(int enable);
+
 #ifdef __cplusplus 
 }
 #endif
 
 #include <urcu-call-rcu.h>
+#ifdef _LGPL_SOURCE
+#include <urcu/static/urcu-call-rcu.h>
+#endif
+#include <urcu-poll.h>
+#include <urcu-stall.h>
+#include <urcu-stats.h>
 #include <urcu-defer.h>
 #include <urcu-flavor.h>
 
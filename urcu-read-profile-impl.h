@@ -0,0 +1,142 @@
+#ifndef _URCU_READ_PROFILE_IMPL_H
+#define _URCU_READ_PROFILE_IMPL_H
+
+/*
+ * urcu-read-profile-impl.h
+ *
+ * Userspace RCU library - read-side critical section duration profiler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Expects to be included after the definition of struct rcu_reader,
+ * of rcu_gp_lock, of the reader registry and of
+ * merge_pending_readers(). The flavor calls rcu_read_profile_init()
+ * when registering a reader thread.
+ *
+ * The read-side fast paths only count down the sections until the next
+ * sample (see urcu/static/urcu.h): the clock is only read by sampled
+ * sections. Each thread writes its own profile, which
+ * rcu_read_profile_for_each() reads concurrently.
+ */
+
+#include <errno.h>
+#include <urcu/clock.h>
+#include "urcu-read-profile.h"
+
+#ifdef CONFIG_RCU_READ_PROFILE
+
+/* Sections between two reads of the period while sampling is stopped. */
+#define RCU_READ_PROFILE_RECHECK	1024
+
+/* Written with rcu_gp_lock held, read by sampled readers. */
+static unsigned long rcu_read_profile_period;
+
+static inline void rcu_read_profile_init(void)
+{
+	memset(&URCU_TLS(rcu_reader).profile, 0,
+		sizeof(URCU_TLS(rcu_reader).profile));
+	URCU_TLS(rcu_reader).profile_countdown = 0;
+	URCU_TLS(rcu_reader).profile_start = 0;
+}
+
+void rcu_read_profile_start(void)
+{
+	unsigned long period = CMM_LOAD_SHARED(rcu_read_profile_period);
+	uint64_t now;
+
+	if (!period) {
+		URCU_TLS(rcu_reader).profile_countdown =
+			RCU_READ_PROFILE_RECHECK - 1;
+		return;
+	}
+	URCU_TLS(rcu_reader).profile_countdown = period - 1;
+	now = caa_clock_ns();
+	URCU_TLS(rcu_reader).profile_start = now ? now : 1;
+}
+
+void rcu_read_profile_record(void)
+{
+	struct rcu_read_profile *profile = &URCU_TLS(rcu_reader).profile;
+	unsigned int bucket = 0;
+	uint64_t ns;
+
+	ns = caa_clock_ns() - URCU_TLS(rcu_reader).profile_start;
+	URCU_TLS(rcu_reader).profile_start = 0;
+	if ((int64_t) ns < 0)
+		ns = 0;		/* Migrated to a CPU with an earlier clock. */
+	if (ns)
+		bucket = 64 - __builtin_clzll(ns);
+	if (bucket >= RCU_READ_PROFILE_NR_BUCKETS)
+		bucket = RCU_READ_PROFILE_NR_BUCKETS - 1;
+	CMM_STORE_SHARED(profile->hist[bucket], profile->hist[bucket] + 1);
+	CMM_STORE_SHARED(profile->total_ns, profile->total_ns + ns);
+	if (ns > profile->max_ns)
+		CMM_STORE_SHARED(profile->max_ns, ns);
+	CMM_STORE_SHARED(profile->nr_samples, profile->nr_samples + 1);
+}
+
+int rcu_set_read_profile(unsigned long period)
+{
+	mutex_lock(&rcu_gp_lock);
+	CMM_STORE_SHARED(rcu_read_profile_period, period);
+	mutex_unlock(&rcu_gp_lock);
+	return 0;
+}
+
+void rcu_read_profile_for_each(rcu_read_profile_fct fct, void *priv)
+{
+	struct rcu_registry_shard *shard;
+	struct rcu_read_profile profile;
+	struct rcu_reader *index;
+	unsigned int i;
+
+	mutex_lock(&rcu_gp_lock);
+	merge_pending_readers();
+	rcu_registry_for_each_shard(registry, shard) {
+		cds_list_for_each_entry(index, &shard->head, node) {
+			profile.nr_samples =
+				CMM_LOAD_SHARED(index->profile.nr_samples);
+			profile.total_ns =
+				CMM_LOAD_SHARED(index->profile.total_ns);
+			profile.max_ns = CMM_LOAD_SHARED(index->profile.max_ns);
+			for (i = 0; i < RCU_READ_PROFILE_NR_BUCKETS; i++)
+				profile.hist[i] =
+					CMM_LOAD_SHARED(index->profile.hist[i]);
+			fct(index->tid, &profile, priv);
+		}
+	}
+	mutex_unlock(&rcu_gp_lock);
+}
+
+#else /* #ifdef CONFIG_RCU_READ_PROFILE */
+
+static inline void rcu_read_profile_init(void)
+{
+}
+
+int rcu_set_read_profile(unsigned long period)
+{
+	return -ENOSYS;
+}
+
+void rcu_read_profile_for_each(rcu_read_profile_fct fct, void *priv)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_READ_PROFILE */
+
+#endif /* _URCU_READ_PROFILE_IMPL_H */
@@ -0,0 +1,79 @@
+#ifndef _URCU_READ_PROFILE_H
+#define _URCU_READ_PROFILE_H
+
+/*
+ * urcu-read-profile.h
+ *
+ * Userspace RCU header - read-side critical section duration profiler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bucket 0 of the histogram counts the sections shorter than 1 ns,
+ * bucket i the sections of 2^(i-1) to 2^i - 1 ns, and the last bucket
+ * the sections of 2^(RCU_READ_PROFILE_NR_BUCKETS - 2) ns or more.
+ */
+#define RCU_READ_PROFILE_NR_BUCKETS	32
+
+/*
+ * Durations of the outermost read-side critical sections sampled in a
+ * reader thread, see rcu_set_read_profile().
+ */
+struct rcu_read_profile {
+	unsigned long nr_samples;	/* Sections sampled */
+	uint64_t total_ns;		/* Total duration of the samples */
+	uint64_t max_ns;		/* Longest sample */
+	unsigned long hist[RCU_READ_PROFILE_NR_BUCKETS];
+};
+
+/*
+ * Called by rcu_read_profile_for_each() for each registered reader
+ * thread, with the grace period lock held: it must not wait for a
+ * grace period, nor register or unregister threads.
+ */
+typedef void (*rcu_read_profile_fct)(pthread_t tid,
+		const struct rcu_read_profile *profile, void *priv);
+
+/*
+ * Exported functions
+ *
+ * rcu_set_read_profile() samples one outermost read-side critical
+ * section out of period in each reader thread, and records its
+ * duration in the profile of the thread. A zero period stops sampling,
+ * which is the default. Threads notice a change of period within
+ * their next period (or 1024 when stopped) sections. Returns 0, or
+ * -ENOSYS if the library is not configured with
+ * --enable-rcu-read-profile.
+ *
+ * rcu_read_profile_for_each() calls fct with a snapshot of the profile
+ * of each registered reader thread. Profiles accumulate from the
+ * registration of the thread: compare snapshots to profile a phase.
+ */
+int rcu_set_read_profile(unsigned long period);
+void rcu_read_profile_for_each(rcu_read_profile_fct fct, void *priv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_READ_PROFILE_H */
@@ -0,0 +1,250 @@
+#ifndef _URCU_REGISTRY_H
+#define _URCU_REGISTRY_H
+
+/*
+ * urcu-registry.h
+ *
+ * Userspace RCU library - sharded reader registry
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <urcu/config.h>
+#include <urcu/compiler.h>
+#include <urcu/list.h>
+#include <urcu/uatomic.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/*
+ * The reader registry is split in shards, one per NUMA node (modulo
+ * the number of shards). Readers are added to the shard of the node
+ * they are running on when they register, so they keep their registry
+ * node and rcu_reader.ctr cache lines within that node's shard. Grace
+ * periods scan the registry shard by shard, keeping the cache lines
+ * pulled across nodes grouped by origin.
+ *
+ * RCU_REGISTRY_NR_SHARDS must be a power of 2, and must match the
+ * number of entries initialized by DEFINE_RCU_REGISTRY().
+ */
+#define RCU_REGISTRY_NR_SHARDS		8
+
+#ifdef CONFIG_RCU_READER_ARRAY
+/*
+ * With CONFIG_RCU_READER_ARRAY, each shard also owns the counters of
+ * its readers, in chunks of cache-line-padded slots which never move
+ * once allocated. Grace periods sweep the slots of each chunk linearly
+ * rather than following the registry list through each reader's TLS.
+ * Slots are allocated and freed with the registry lock held. Free slots
+ * hold a zero (inactive) counter, so sweeps do not need to skip them.
+ */
+#define RCU_READER_CHUNK_SLOTS		64
+
+struct rcu_reader;
+
+struct rcu_reader_slot {
+	unsigned long ctr;
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+struct rcu_reader_chunk {
+	struct rcu_reader_slot slot[RCU_READER_CHUNK_SLOTS];
+	struct rcu_reader *owner[RCU_READER_CHUNK_SLOTS];	/* NULL if free */
+	unsigned int nr_slots;		/* Slots to sweep: last owned + 1 */
+	struct rcu_reader_chunk *next;
+};
+#endif /* CONFIG_RCU_READER_ARRAY */
+
+struct rcu_registry_shard {
+	struct cds_list_head head;
+	struct cds_list_head *pending;	/* Registrations awaiting the lock */
+#ifdef CONFIG_RCU_READER_ARRAY
+	struct rcu_reader_chunk *chunks;
+#endif
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+#define RCU_REGISTRY_SHARD_INIT(name, i)		\
+	[i] = { .head = CDS_LIST_HEAD_INIT(name[i].head) }
+
+#define DEFINE_RCU_REGISTRY(name)					\
+	struct rcu_registry_shard name[RCU_REGISTRY_NR_SHARDS] = {	\
+		RCU_REGISTRY_SHARD_INIT(name, 0),			\
+		RCU_REGISTRY_SHARD_INIT(name, 1),			\
+		RCU_REGISTRY_SHARD_INIT(name, 2),			\
+		RCU_REGISTRY_SHARD_INIT(name, 3),			\
+		RCU_REGISTRY_SHARD_INIT(name, 4),			\
+		RCU_REGISTRY_SHARD_INIT(name, 5),			\
+		RCU_REGISTRY_SHARD_INIT(name, 6),			\
+		RCU_REGISTRY_SHARD_INIT(name, 7),			\
+	}
+
+#define rcu_registry_for_each_shard(registry, shard)			\
+	for (shard = &(registry)[0];					\
+		shard < &(registry)[RCU_REGISTRY_NR_SHARDS]; shard++)
+
+/*
+ * Return the NUMA node the current thread is running on, or 0 if
+ * unknown.
+ */
+static inline
+unsigned int rcu_registry_current_node(void)
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+	unsigned int cpu, node;
+
+	if (!syscall(SYS_getcpu, &cpu, &node, NULL))
+		return node;
+#endif
+	return 0;
+}
+
+/*
+ * Return the registry shard of the current thread's NUMA node.
+ */
+static inline
+struct rcu_registry_shard *rcu_registry_local_shard(
+		struct rcu_registry_shard *registry)
+{
+	return &registry[rcu_registry_current_node()
+			& (RCU_REGISTRY_NR_SHARDS - 1)];
+}
+
+static inline
+int rcu_registry_empty(struct rcu_registry_shard *registry)
+{
+	struct rcu_registry_shard *shard;
+
+	rcu_registry_for_each_shard(registry, shard) {
+		if (!cds_list_empty(&shard->head))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Threads may register without the registry lock, which grace periods
+ * hold while they wait for readers: their node is pushed on the pending
+ * stack of their shard, linked through its next pointer, and moved to
+ * the shard list by the next rcu_registry_merge_pending(), with the
+ * lock held. A grace period merges the pending readers before reading
+ * the reader states. A reader pushed after that merge started its
+ * read-side critical sections after the removals preceding the grace
+ * period: the full barriers of the push and of the merge order them.
+ */
+static inline
+void rcu_registry_add_pending(struct rcu_registry_shard *shard,
+		struct cds_list_head *node)
+{
+	struct cds_list_head *old, *cur;
+
+	cur = uatomic_read(&shard->pending);
+	do {
+		old = cur;
+		node->next = old;
+		cur = uatomic_cmpxchg(&shard->pending, old, node);
+	} while (cur != old);
+}
+
+/*
+ * Move the pending readers to their shard list, calling merged() on
+ * each node if non-NULL. Called with the registry lock held.
+ */
+static inline
+void rcu_registry_merge_pending(struct rcu_registry_shard *registry,
+		void (*merged)(struct cds_list_head *node))
+{
+	struct rcu_registry_shard *shard;
+	struct cds_list_head *node, *next;
+
+	/* Removals before reading the pending stacks. */
+	cmm_smp_mb();
+	rcu_registry_for_each_shard(registry, shard) {
+		if (!CMM_LOAD_SHARED(shard->pending))
+			continue;
+		node = uatomic_xchg(&shard->pending, NULL);
+		for (; node; node = next) {
+			next = node->next;
+			cds_list_add(node, &shard->head);
+			if (merged)
+				merged(node);
+		}
+	}
+}
+
+#ifdef CONFIG_RCU_READER_ARRAY
+/*
+ * Allocate a counter slot of the shard for reader. Return NULL on
+ * memory allocation failure.
+ */
+static inline
+unsigned long *rcu_registry_slot_alloc(struct rcu_registry_shard *shard,
+		struct rcu_reader *reader)
+{
+	struct rcu_reader_chunk *chunk, **prev = &shard->chunks;
+	unsigned int i;
+
+	for (chunk = shard->chunks; chunk; chunk = chunk->next) {
+		for (i = 0; i < RCU_READER_CHUNK_SLOTS; i++) {
+			if (!chunk->owner[i])
+				goto found;
+		}
+		prev = &chunk->next;
+	}
+	if (posix_memalign((void **) &chunk, CAA_CACHE_LINE_SIZE,
+			sizeof(*chunk)))
+		return NULL;
+	memset(chunk, 0, sizeof(*chunk));
+	*prev = chunk;
+	i = 0;
+found:
+	chunk->owner[i] = reader;
+	chunk->slot[i].ctr = 0;
+	if (i >= chunk->nr_slots)
+		chunk->nr_slots = i + 1;
+	return &chunk->slot[i].ctr;
+}
+
+/* Free a counter slot allocated by rcu_registry_slot_alloc(). */
+static inline
+void rcu_registry_slot_free(struct rcu_registry_shard *registry,
+		unsigned long *ctr)
+{
+	struct rcu_registry_shard *shard;
+	struct rcu_reader_chunk *chunk;
+	unsigned int i;
+
+	rcu_registry_for_each_shard(registry, shard) {
+		for (chunk = shard->chunks; chunk; chunk = chunk->next) {
+			if (ctr < &chunk->slot[0].ctr
+					|| ctr > &chunk->slot[RCU_READER_CHUNK_SLOTS - 1].ctr)
+				continue;
+			i = (struct rcu_reader_slot *) ctr - chunk->slot;
+			chunk->owner[i] = NULL;
+			/* Shorten the sweep past trailing free slots. */
+			while (chunk->nr_slots && !chunk->owner[chunk->nr_slots - 1])
+				chunk->nr_slots--;
+			return;
+		}
+	}
+}
+#endif /* CONFIG_RCU_READER_ARRAY */
+
+#endif /* _URCU_REGISTRY_H */
@@ -0,0 +1,143 @@
+#ifndef _URCU_STALL_IMPL_H
+#define _URCU_STALL_IMPL_H
+
+/*
+ * urcu-stall-impl.h
+ *
+ * Userspace RCU library - Grace period stall detector
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Expects to be included after the definition of struct rcu_reader,
+ * which must have tid and node fields, of rcu_gp_lock, and of
+ * rcu_gp_seq (see urcu-poll-impl.h). The flavor calls
+ * rcu_stall_start() before waiting for readers, and rcu_stall_check()
+ * on the readers left to wait for each time it waits for them again.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <urcu/list.h>
+#include "urcu-stall.h"
+
+/* Written with rcu_gp_lock held, read by grace periods. */
+static unsigned long rcu_stall_timeout_ms;
+static rcu_stall_report_fct rcu_stall_report;
+
+struct rcu_stall_state {
+	unsigned long timeout_ms;	/* 0: detector disabled */
+	unsigned long start_ms;		/* beginning of the wait */
+	unsigned long next_ms;		/* next report */
+};
+
+static inline unsigned long rcu_stall_now_ms(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (unsigned long) ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+static void rcu_stall_report_stderr(pthread_t tid, unsigned long stall_ms,
+		unsigned long gp_seq)
+{
+	fprintf(stderr, "[liburcu %d] Grace period %lu stalled for %lu ms "
+		"by reader thread %lu\n", (int) getpid(), gp_seq, stall_ms,
+		(unsigned long) tid);
+}
+
+/* Called with rcu_gp_lock held. */
+static inline void rcu_stall_start(struct rcu_stall_state *state)
+{
+	state->timeout_ms = rcu_stall_timeout_ms;
+	state->start_ms = state->next_ms = 0;
+	if (caa_likely(!state->timeout_ms))
+		return;
+	state->start_ms = rcu_stall_now_ms();
+	state->next_ms = state->start_ms + state->timeout_ms;
+}
+
+/*
+ * Maximum time to sleep while waiting for readers, so the next report
+ * is not delayed. Returns NULL if the detector is disabled.
+ */
+static inline const struct timespec *rcu_stall_wait_timeout(
+		struct rcu_stall_state *state, struct timespec *ts)
+{
+	unsigned long now, delay_ms = 0;
+
+	if (caa_likely(!state->timeout_ms))
+		return NULL;
+	now = rcu_stall_now_ms();
+	if ((long) (state->next_ms - now) > 0)
+		delay_ms = state->next_ms - now;
+	ts->tv_sec = delay_ms / 1000UL;
+	ts->tv_nsec = (delay_ms % 1000UL) * 1000000UL;
+	return ts;
+}
+
+/*
+ * Once the stall timeout is reached, schedule the next report, and
+ * return the reporting function along with the stall duration in
+ * stall_ms. Return NULL otherwise. Called with rcu_gp_lock held.
+ */
+static inline rcu_stall_report_fct rcu_stall_due(struct rcu_stall_state *state,
+		unsigned long *stall_ms)
+{
+	unsigned long now;
+
+	if (caa_likely(!state->timeout_ms))
+		return NULL;
+	now = rcu_stall_now_ms();
+	if ((long) (now - state->next_ms) < 0)
+		return NULL;
+	state->next_ms = now + state->timeout_ms;
+	*stall_ms = now - state->start_ms;
+	return rcu_stall_report ? : rcu_stall_report_stderr;
+}
+
+/*
+ * Report the readers of the input_readers list once the stall timeout
+ * is reached. Called with rcu_gp_lock held.
+ */
+static inline void rcu_stall_check(struct rcu_stall_state *state,
+		struct cds_list_head *input_readers)
+{
+	rcu_stall_report_fct report;
+	struct rcu_reader *index;
+	unsigned long stall_ms;
+
+	report = rcu_stall_due(state, &stall_ms);
+	if (caa_likely(!report))
+		return;
+	cds_list_for_each_entry(index, input_readers, node)
+		report(index->tid, stall_ms, CMM_LOAD_SHARED(rcu_gp_seq));
+}
+
+void rcu_set_stall_detector(unsigned long timeout_ms,
+		rcu_stall_report_fct report)
+{
+	mutex_lock(&rcu_gp_lock);
+	rcu_stall_timeout_ms = timeout_ms;
+	rcu_stall_report = report;
+	mutex_unlock(&rcu_gp_lock);
+}
+
+#endif /* _URCU_STALL_IMPL_H */
@@ -0,0 +1,69 @@
+#ifndef _URCU_STALL_H
+#define _URCU_STALL_H
+
+/*
+ * urcu-stall.h
+ *
+ * Userspace RCU header - grace period stall detector
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Stall report callback, called by the grace period for each registered
+ * reader thread which has been delaying it for at least the stall
+ * timeout: tid is the reader thread, stall_ms is how long the grace
+ * period has been waiting for it, and gp_seq is the grace period
+ * sequence number (see urcu-poll.h).
+ *
+ * The callback is called with the grace period lock held: it must not
+ * wait for a grace period, nor call rcu_register_thread(),
+ * rcu_unregister_thread() or rcu_set_stall_detector().
+ */
+typedef void (*rcu_stall_report_fct)(pthread_t tid, unsigned long stall_ms,
+		unsigned long gp_seq);
+
+/*
+ * Exported functions
+ *
+ * rcu_set_stall_detector() enables the grace period stall detector of
+ * the RCU flavor: once a grace period has been waiting for a reader
+ * thread for timeout_ms milliseconds, each reader still delaying it is
+ * reported to the report callback, and reported again every timeout_ms
+ * milliseconds while it keeps delaying the grace period. A NULL report
+ * callback prints the reports on stderr. A zero timeout_ms disables the
+ * stall detector, which is the default.
+ *
+ * Reader threads are only reported when they delay the grace period,
+ * which covers readers staying within a read-side critical section, as
+ * well as QSBR threads which stay online without reporting quiescent
+ * states.
+ */
+void rcu_set_stall_detector(unsigned long timeout_ms,
+		rcu_stall_report_fct report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_STALL_H */
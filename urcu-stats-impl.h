@@ -0,0 +1,103 @@
+#ifndef _URCU_STATS_IMPL_H
+#define _URCU_STATS_IMPL_H
+
+/*
+ * urcu-stats-impl.h
+ *
+ * Userspace RCU library - statistics counters
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Expects to be included after the definition of rcu_gp_lock. The
+ * flavor calls rcu_stats_gp_end() with rcu_gp_lock held when a grace
+ * period completes, passing its duration, rcu_stats_gp_sleep() with rcu_gp_lock held each time it
+ * sleeps waiting for readers, and rcu_stats_add_waiters() with the
+ * number of synchronize_rcu() calls served by each grace period.
+ * The defer_rcu() implementation reports its queue lengths with
+ * rcu_stats_defer_qlen(), with rcu_defer_mutex held.
+ *
+ * The statistics are only updated on the grace period and reclamation
+ * slow paths, never by readers.
+ */
+
+#include <string.h>
+#include "urcu-stats.h"
+
+/*
+ * Protected by rcu_gp_lock, except nr_waiters, updated atomically, and
+ * defer_qlen_max, protected by rcu_defer_mutex.
+ */
+static struct rcu_stats rcu_stats;
+
+#ifdef CONFIG_RCU_STATS
+
+static inline void rcu_stats_gp_end(uint64_t duration)
+{
+	CMM_STORE_SHARED(rcu_stats.nr_gp, rcu_stats.nr_gp + 1);
+	rcu_stats.gp_total_ns += duration;
+	if (duration > rcu_stats.gp_max_ns)
+		rcu_stats.gp_max_ns = duration;
+}
+
+static inline void rcu_stats_gp_sleep(void)
+{
+	rcu_stats.nr_gp_sleeps++;
+}
+
+static inline void rcu_stats_add_waiters(unsigned long count)
+{
+	uatomic_add(&rcu_stats.nr_waiters, count);
+}
+
+static inline void rcu_stats_defer_qlen(unsigned long qlen)
+{
+	if (qlen > rcu_stats.defer_qlen_max)
+		CMM_STORE_SHARED(rcu_stats.defer_qlen_max, qlen);
+}
+
+#else /* #ifdef CONFIG_RCU_STATS */
+
+static inline void rcu_stats_gp_end(uint64_t duration)
+{
+}
+
+static inline void rcu_stats_gp_sleep(void)
+{
+}
+
+static inline void rcu_stats_add_waiters(unsigned long count)
+{
+}
+
+static inline void rcu_stats_defer_qlen(unsigned long qlen)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_STATS */
+
+void rcu_get_stats(struct rcu_stats *stats)
+{
+	mutex_lock(&rcu_gp_lock);
+	memcpy(stats, &rcu_stats, sizeof(*stats));
+	stats->nr_waiters = uatomic_read(&rcu_stats.nr_waiters);
+	stats->defer_qlen_max = CMM_LOAD_SHARED(rcu_stats.defer_qlen_max);
+	mutex_unlock(&rcu_gp_lock);
+}
+
+#endif /* _URCU_STATS_IMPL_H */
@@ -0,0 +1,99 @@
+#ifndef _URCU_STATS_H
+#define _URCU_STATS_H
+
+/*
+ * urcu-stats.h
+ *
+ * Userspace RCU header - statistics counters
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Grace period and deferred reclamation statistics of an RCU flavor,
+ * see rcu_get_stats(). The mean grace period duration is
+ * gp_total_ns / nr_gp. The call_rcu statistics are kept per
+ * call_rcu_data, see call_rcu_data_get_stats().
+ */
+struct rcu_stats {
+	unsigned long nr_gp;		/* Grace periods completed */
+	unsigned long nr_waiters;	/* synchronize_rcu() calls served */
+	unsigned long nr_gp_sleeps;	/* Sleeps waiting for readers */
+	uint64_t gp_total_ns;		/* Total grace period duration */
+	uint64_t gp_max_ns;		/* Longest grace period */
+	unsigned long defer_qlen_max;	/* defer_rcu() queue high-water mark */
+};
+
+/*
+ * Internal mutexes of an RCU flavor, see rcu_get_lock_stats().
+ */
+enum rcu_lock_id {
+	RCU_LOCK_GP,		/* rcu_gp_lock: grace periods, registry */
+	RCU_LOCK_CALL_RCU,	/* call_rcu_mutex: call_rcu_data lists */
+	RCU_LOCK_DEFER,		/* rcu_defer_mutex: defer_rcu() queues */
+	RCU_NR_LOCKS,
+};
+
+/*
+ * Bucket 0 of the histograms counts the durations shorter than 1 ns,
+ * bucket i the durations of 2^(i-1) to 2^i - 1 ns, and the last bucket
+ * the durations of 2^(RCU_LOCK_STATS_NR_BUCKETS - 2) ns or more.
+ */
+#define RCU_LOCK_STATS_NR_BUCKETS	32
+
+/*
+ * Contention statistics of a mutex. Waits are only measured for the
+ * acquisitions finding the mutex held (nr_contended), holds for all
+ * acquisitions.
+ */
+struct rcu_lock_stats {
+	unsigned long nr_acquired;	/* Acquisitions */
+	unsigned long nr_contended;	/* Acquisitions which waited */
+	uint64_t wait_total_ns;		/* Total wait duration */
+	uint64_t wait_max_ns;		/* Longest wait */
+	uint64_t hold_total_ns;		/* Total hold duration */
+	uint64_t hold_max_ns;		/* Longest hold */
+	unsigned long wait_hist[RCU_LOCK_STATS_NR_BUCKETS];
+	unsigned long hold_hist[RCU_LOCK_STATS_NR_BUCKETS];
+};
+
+/*
+ * Exported functions
+ *
+ * rcu_get_stats() fetches a snapshot of the statistics of the RCU
+ * flavor. The counters are maintained unless the library is configured
+ * with --disable-rcu-stats, in which case they stay zero.
+ *
+ * rcu_get_lock_stats() fetches a snapshot of the contention statistics
+ * of an internal mutex of the RCU flavor. Returns 0 on success, -EINVAL
+ * if lock is out of range, or -ENOSYS if the library is not configured
+ * with --enable-rcu-lock-stats.
+ */
+void rcu_get_stats(struct rcu_stats *stats);
+int rcu_get_lock_stats(enum rcu_lock_id lock, struct rcu_lock_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_STATS_H */
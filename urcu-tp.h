@@ -0,0 +1,58 @@
+#ifndef _URCU_TP_H
+#define _URCU_TP_H
+
+/*
+ * urcu-tp.h
+ *
+ * Userspace RCU library - static tracepoint probes
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * USDT probes of the "urcu" provider, for tracers such as SystemTap,
+ * bpftrace, perf or LTTng (through uprobes), on the grace period and
+ * callback lifecycle. Only emitted when configured with
+ * --enable-usdt-probes, which requires <sys/sdt.h>: each probe then
+ * costs a nop instruction until a tracer attaches to it. Otherwise,
+ * probes compile to nothing.
+ *
+ * urcu_tp(name) and urcu_tpN(name, args...) fire probe "name" with N
+ * integer or pointer arguments.
+ */
+
+#include "config.h"
+
+#ifdef RCU_USDT_PROBES
+
+#include <sys/sdt.h>
+
+#define urcu_tp(name)			DTRACE_PROBE(urcu, name)
+#define urcu_tp1(name, a)		DTRACE_PROBE1(urcu, name, a)
+#define urcu_tp2(name, a, b)		DTRACE_PROBE2(urcu, name, a, b)
+#define urcu_tp3(name, a, b, c)		DTRACE_PROBE3(urcu, name, a, b, c)
+
+#else /* #ifdef RCU_USDT_PROBES */
+
+#define urcu_tp(name)
+#define urcu_tp1(name, a)
+#define urcu_tp2(name, a, b)
+#define urcu_tp3(name, a, b, c)
+
+#endif /* #else #ifdef RCU_USDT_PROBES */
+
+#endif /* _URCU_TP_H */
@@ -23,15 +23,44 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdint.h>
+#include <time.h>
 #include <urcu/uatomic.h>
+#include <urcu/futex.h>
+#include <urcu/blocking.h>
 #include <urcu/wfstack.h>
 
 /*
- * Number of busy-loop attempts before waiting on futex for grace period
- * batching.
+ * Number of busy-loop attempts before waiting for teardown.
  */
 #define URCU_WAIT_ATTEMPTS 1000
 
+/*
+ * Bounds of the adaptative spin phase preceding a sleep: waits expected
+ * to last longer than URCU_WAIT_SPIN_MAX_NS only spin for
+ * URCU_WAIT_SPIN_MIN_NS before sleeping, shorter waits spin for twice
+ * their expected duration. The clock is read every
+ * URCU_WAIT_SPIN_CLOCK_LOOPS spin iterations.
+ */
+#define URCU_WAIT_SPIN_MIN_NS		1000UL
+#define URCU_WAIT_SPIN_MAX_NS		100000UL
+#define URCU_WAIT_SPIN_CLOCK_LOOPS	16
+
+/*
+ * Running estimate of a wait duration, e.g. of the grace periods of a
+ * flavor, updated by the grace period leader and read concurrently
+ * by the waiters.
+ */
+struct urcu_wait_estimate {
+	unsigned long avg_ns;
+};
+
+/* Spin phase in progress, see urcu_wait_spin_start(). */
+struct urcu_wait_spin {
+	uint64_t deadline_ns;
+	unsigned int loops;
+};
+
 enum urcu_wait_state {
 	/* URCU_WAIT_WAITING is compared directly (futex compares it). */
 	URCU_WAIT_WAITING =	0,
@@ -39,6 +68,7 @@ enum urcu_wait_state {
 	URCU_WAIT_WAKEUP =	(1 << 0),
 	URCU_WAIT_RUNNING =	(1 << 1),
 	URCU_WAIT_TEARDOWN =	(1 << 2),
+	URCU_WAIT_COMPLETED =	(1 << 3),
 };
 
 struct urcu_wait_node {
@@ -95,6 +125,92 @@ void urcu_move_waiters(struct urcu_waiters *waiters,
 	waiters->head = __cds_wfs_pop_all(&queue->stack);
 }
 
+static inline
+uint64_t urcu_wait_now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Store the time left until deadline_ns (from urcu_wait_now_ns()) into
+ * ts, as expected by a relative FUTEX_WAIT timeout. Returns 0 if the
+ * deadline has passed.
+ */
+static inline
+int urcu_wait_deadline_ts(uint64_t deadline_ns, struct timespec *ts)
+{
+	uint64_t now_ns = urcu_wait_now_ns();
+
+	if (now_ns >= deadline_ns)
+		return 0;
+	ts->tv_sec = (deadline_ns - now_ns) / 1000000000ULL;
+	ts->tv_nsec = (deadline_ns - now_ns) % 1000000000ULL;
+	return 1;
+}
+
+/*
+ * Account for a wait of duration_ns in the estimate: exponentially
+ * weighted moving average, with a weight of 1/8 for the new sample.
+ */
+static inline
+void urcu_wait_estimate_update(struct urcu_wait_estimate *estimate,
+		uint64_t duration_ns)
+{
+	unsigned long avg = CMM_LOAD_SHARED(estimate->avg_ns);
+
+	if (duration_ns > URCU_WAIT_SPIN_MAX_NS << 3)
+		duration_ns = URCU_WAIT_SPIN_MAX_NS << 3;
+	avg = avg - (avg >> 3) + ((unsigned long) duration_ns >> 3);
+	CMM_STORE_SHARED(estimate->avg_ns, avg);
+}
+
+/*
+ * Account for a wait which began at start_ns (from urcu_wait_now_ns())
+ * in the estimate. Returns the duration of the wait.
+ */
+static inline
+uint64_t urcu_wait_estimate_end(struct urcu_wait_estimate *estimate,
+		uint64_t start_ns)
+{
+	uint64_t duration_ns = urcu_wait_now_ns() - start_ns;
+
+	urcu_wait_estimate_update(estimate, duration_ns);
+	return duration_ns;
+}
+
+/*
+ * Start a spin phase sized from the estimate of the wait duration.
+ */
+static inline
+void urcu_wait_spin_start(struct urcu_wait_spin *spin,
+		struct urcu_wait_estimate *estimate)
+{
+	unsigned long budget = CMM_LOAD_SHARED(estimate->avg_ns) << 1;
+
+	if (budget > URCU_WAIT_SPIN_MAX_NS)
+		budget = URCU_WAIT_SPIN_MIN_NS;
+	else if (budget < URCU_WAIT_SPIN_MIN_NS)
+		budget = URCU_WAIT_SPIN_MIN_NS;
+	spin->deadline_ns = urcu_wait_now_ns() + budget;
+	spin->loops = 0;
+}
+
+/*
+ * Return whether the spin phase is over, and the caller should sleep.
+ */
+static inline
+bool urcu_wait_spin_expired(struct urcu_wait_spin *spin)
+{
+	if (++spin->loops < URCU_WAIT_SPIN_CLOCK_LOOPS)
+		return false;
+	spin->loops = 0;
+	return (int64_t) (urcu_wait_now_ns() - spin->deadline_ns) >= 0;
+}
+
 static inline
 void urcu_wait_set_state(struct urcu_wait_node *node,
 		enum urcu_wait_state state)
@@ -102,6 +218,20 @@ void urcu_wait_set_state(struct urcu_wait_node *node,
 	node->state = state;
 }
 
+/*
+ * Flag a waiter which found the queue empty as running, before it takes
+ * the lock to lead its grace period. Fails if the node was already
+ * moved and woken up by another leader, which completed its batch: the
+ * caller must then wait for the teardown with
+ * urcu_adaptative_busy_wait(), as any other waiter.
+ */
+static inline
+bool urcu_wait_set_running(struct urcu_wait_node *node)
+{
+	return uatomic_cmpxchg(&node->state, URCU_WAIT_WAITING,
+			URCU_WAIT_RUNNING) == URCU_WAIT_WAITING;
+}
+
 static inline
 void urcu_wait_node_init(struct urcu_wait_node *node,
 		enum urcu_wait_state state)
@@ -130,22 +260,29 @@ void urcu_adaptative_wake_up(struct urcu_wait_node *wait)
 
 /*
  * Caller must initialize "value" to URCU_WAIT_WAITING before passing its
- * memory to waker thread.
+ * memory to waker thread. The spin phase preceding the futex wait is
+ * sized from the estimate of the wait duration.
  */
 static inline
-void urcu_adaptative_busy_wait(struct urcu_wait_node *wait)
+void urcu_adaptative_busy_wait(struct urcu_wait_node *wait,
+		struct urcu_wait_estimate *estimate)
 {
+	struct urcu_wait_spin spin;
 	unsigned int i;
+	int was_online;
 
 	/* Load and test condition before read state */
 	cmm_smp_rmb();
-	for (i = 0; i < URCU_WAIT_ATTEMPTS; i++) {
+	urcu_wait_spin_start(&spin, estimate);
+	do {
 		if (uatomic_read(&wait->state) != URCU_WAIT_WAITING)
 			goto skip_futex_wait;
 		caa_cpu_relax();
-	}
+	} while (!urcu_wait_spin_expired(&spin));
+	was_online = urcu_blocking_begin();
 	futex_noasync(&wait->state, FUTEX_WAIT,
 		URCU_WAIT_WAITING, NULL, NULL, 0);
+	urcu_blocking_end(was_online);
 skip_futex_wait:
 
 	/* Tell waker thread than we are running. */
@@ -165,21 +302,64 @@ skip_futex_wait:
 	assert(uatomic_read(&wait->state) & URCU_WAIT_TEARDOWN);
 }
 
+/*
+ * Wake all waiters in our stack head, the oldest first. Returns the
+ * number of waiters, including the ones already running.
+ */
 static inline
-void urcu_wake_all_waiters(struct urcu_waiters *waiters)
+unsigned long urcu_wake_all_waiters(struct urcu_waiters *waiters)
 {
 	struct cds_wfs_node *iter, *iter_n;
+	unsigned long count = 0;
 
-	/* Wake all waiters in our stack head */
+	/* Wake all waiters in our stack head, in arrival order */
+	waiters->head = cds_wfs_reverse_blocking(waiters->head);
 	cds_wfs_for_each_blocking_safe(waiters->head, iter, iter_n) {
 		struct urcu_wait_node *wait_node =
 			caa_container_of(iter, struct urcu_wait_node, node);
 
+		count++;
 		/* Don't wake already running threads */
 		if (wait_node->state & URCU_WAIT_RUNNING)
 			continue;
 		urcu_adaptative_wake_up(wait_node);
 	}
+	return count;
+}
+
+/*
+ * Wake all waiters in our stack head, the oldest first, and flag the
+ * waiters which are already running (e.g. grace period leaders
+ * awaiting a mutex) as completed. Returns the number of waiters.
+ */
+static inline
+unsigned long urcu_complete_all_waiters(struct urcu_waiters *waiters)
+{
+	struct cds_wfs_node *iter, *iter_n;
+	unsigned long count = 0;
+
+	waiters->head = cds_wfs_reverse_blocking(waiters->head);
+	cds_wfs_for_each_blocking_safe(waiters->head, iter, iter_n) {
+		struct urcu_wait_node *wait_node =
+			caa_container_of(iter, struct urcu_wait_node, node);
+
+		count++;
+		/*
+		 * A leader may flag itself running concurrently, see
+		 * urcu_wait_set_running(): the wakeup must not race with
+		 * it.
+		 */
+		cmm_smp_mb();
+		if (uatomic_cmpxchg(&wait_node->state, URCU_WAIT_WAITING,
+				URCU_WAIT_WAKEUP) != URCU_WAIT_WAITING) {
+			uatomic_or(&wait_node->state, URCU_WAIT_COMPLETED);
+			continue;
+		}
+		futex_noasync(&wait_node->state, FUTEX_WAKE, 1, NULL, NULL, 0);
+		/* Allow teardown of struct urcu_wait memory. */
+		uatomic_or(&wait_node->state, URCU_WAIT_TEARDOWN);
+	}
+	return count;
 }
 
 #endif /* _URCU_WAIT_H */
@@ -26,6 +26,7 @@
 #define _BSD_SOURCE
 #define _GNU_SOURCE
 #define _LGPL_SOURCE
+#include "config.h"
 #include <stdio.h>
 #include <pthread.h>
 #include <signal.h>
@@ -37,13 +38,17 @@
 #include <poll.h>
 
 #include "urcu/wfcqueue.h"
+#include "urcu/cacheline.h"
 #include "urcu/map/urcu.h"
 #include "urcu/static/urcu.h"
 #include "urcu-pointer.h"
 #include "urcu/tls-compat.h"
 
 #include "urcu-die.h"
+#include "urcu-tp.h"
 #include "urcu-wait.h"
+#include "urcu-registry.h"
+#include "urcu/rseq.h"
 
 /* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
 #undef _LGPL_SOURCE
@@ -63,9 +68,10 @@
 #define RCU_QS_ACTIVE_ATTEMPTS 100
 
 /*
- * RCU_MEMBARRIER is only possibly available on Linux.
+ * sys_membarrier is only possibly available on Linux. Besides
+ * RCU_MEMBARRIER, RCU_SIGNAL uses it instead of signals when available.
  */
-#if defined(RCU_MEMBARRIER) && defined(__linux__)
+#if (defined(RCU_MEMBARRIER) || defined(RCU_SIGNAL)) && defined(__linux__)
 #include <urcu/syscall-compat.h>
 #endif
 
@@ -76,18 +82,47 @@
 # define membarrier(...)		-ENOSYS
 #endif
 
-#define MEMBARRIER_EXPEDITED		(1 << 0)
-#define MEMBARRIER_DELAYED		(1 << 1)
-#define MEMBARRIER_QUERY		(1 << 16)
+#define MEMBARRIER_CMD_QUERY				0
+#define MEMBARRIER_CMD_SHARED				(1 << 0)
+#define MEMBARRIER_CMD_PRIVATE_EXPEDITED		(1 << 3)
+#define MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED	(1 << 4)
+#define MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ		(1 << 7)
+#define MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_RSEQ	(1 << 8)
+#define MEMBARRIER_CMD_FLAG_CPU				(1 << 0)
+
+#if defined(RCU_MEMBARRIER) || defined(RCU_SIGNAL)
+/* sys_membarrier command of the master barrier, set by rcu_init(). */
+static enum rcu_membarrier_mode rcu_membarrier_mode;
+#endif
 
 #ifdef RCU_MEMBARRIER
 static int init_done;
 int rcu_has_sys_membarrier;
 
-void __attribute__((constructor)) rcu_init(void);
+static void rcu_init_locked(void);
+
+/*
+ * The rcu_read_lock() and rcu_read_unlock() wrappers are resolved with
+ * ifunc where the sys_membarrier system call can be issued without
+ * going through the C library.
+ */
+#if defined(HAVE_FUNC_ATTRIBUTE_IFUNC) && defined(SYS_membarrier) \
+		&& (defined(__x86_64__) || defined(__aarch64__))
+#define RCU_READ_IFUNC
+
+/*
+ * Set when the read-side wrappers were resolved to the variants relying
+ * on sys_membarrier, the kernel supporting the private expedited command.
+ */
+static int read_ifunc_membarrier;
 #endif
+#endif /* #ifdef RCU_MEMBARRIER */
 
 #ifdef RCU_MB
+static void rcu_init_locked(void)
+{
+}
+
 void rcu_init(void)
 {
 }
@@ -96,7 +131,17 @@ void rcu_init(void)
 #ifdef RCU_SIGNAL
 static int init_done;
 
-void __attribute__((constructor)) rcu_init(void);
+/*
+ * Number of readers which have not yet executed the memory barrier
+ * requested by force_mb_all_readers(). The last signal handler wakes up
+ * the grace period waiting on this futex.
+ */
+static int32_t force_mb_pending;
+
+/* Delay before signaling again readers which did not acknowledge. */
+#define FORCE_MB_RESEND_DELAY_NS	1000000
+
+static void rcu_init_locked(void);
 void __attribute__((destructor)) rcu_exit(void);
 #endif
 
@@ -109,7 +154,51 @@ struct rcu_gp rcu_gp = { .ctr = RCU_GP_COUNT };
  */
 DEFINE_URCU_TLS(struct rcu_reader, rcu_reader);
 
-static CDS_LIST_HEAD(registry);
+static DEFINE_RCU_REGISTRY(registry);
+
+/*
+ * Readers registered with rcu_register_thread(), which need barriers from
+ * the grace periods, and number of readers registered with
+ * rcu_register_thread_quiescent(). Protected by rcu_gp_lock.
+ */
+static CDS_LIST_HEAD(barrier_readers);
+static unsigned int nr_quiescent_readers;
+
+/*
+ * Largest number of readers signaled, or interrupted, one by one while
+ * a grace period waits for them (see smp_mb_lagging()).
+ */
+#define RCU_MB_LAGGING_MAX	16
+
+/* Pending readers are barrier-based readers. */
+static void merged_reader(struct cds_list_head *node)
+{
+	struct rcu_reader *reader;
+
+	reader = caa_container_of(node, struct rcu_reader, node);
+	cds_list_add(&reader->barrier_node, &barrier_readers);
+}
+
+/* Called with rcu_gp_lock held. */
+static void merge_pending_readers(void)
+{
+	rcu_registry_merge_pending(registry, merged_reader);
+}
+
+/*
+ * Grace period sequence number, used by the grace period polling API.
+ * Incremented at the beginning and at the end of each reader scan, with
+ * rcu_gp_lock held: an odd value means a reader scan is in progress.
+ */
+static unsigned long rcu_gp_seq;
+
+/*
+ * Running estimate of the grace period duration, sizing the spin phase
+ * of the grace period leader waiting for readers and of the batched
+ * synchronize_rcu() callers. Updated
+ * with rcu_gp_lock held.
+ */
+static struct urcu_wait_estimate gp_wait_estimate;
 
 /*
  * Queue keeping threads awaiting to wait for a grace period. Contains
@@ -117,10 +206,19 @@ static CDS_LIST_HEAD(registry);
  */
 static DEFINE_URCU_WAIT_QUEUE(gp_waiters);
 
+#include "urcu-lock-stats-impl.h"
+
 static void mutex_lock(pthread_mutex_t *mutex)
 {
+	struct rcu_lock_stats_state *ls =
+		rcu_lock_stats_of(mutex, &rcu_gp_lock, RCU_LOCK_GP);
+	uint64_t wait_start;
 	int ret;
 
+	wait_start = rcu_lock_stats_trylock(ls, mutex);
+	if (!wait_start)
+		return;
+
 #ifndef DISTRUST_SIGNALS_EXTREME
 	ret = pthread_mutex_lock(mutex);
 	if (ret)
@@ -137,22 +235,137 @@ static void mutex_lock(pthread_mutex_t *mutex)
 		poll(NULL,0,10);
 	}
 #endif /* #else #ifndef DISTRUST_SIGNALS_EXTREME */
+	rcu_lock_stats_acquired(ls, wait_start);
 }
 
 static void mutex_unlock(pthread_mutex_t *mutex)
 {
 	int ret;
 
+	rcu_lock_stats_release(rcu_lock_stats_of(mutex, &rcu_gp_lock,
+			RCU_LOCK_GP));
 	ret = pthread_mutex_unlock(mutex);
 	if (ret)
 		urcu_die(ret);
 }
 
+#if defined(RCU_MEMBARRIER) || defined(RCU_SIGNAL)
+/*
+ * Detect the sys_membarrier commands supported by the kernel, preferring
+ * the private expedited command, registered for the process, over the
+ * shared command when allow_shared is set.
+ */
+static enum rcu_membarrier_mode membarrier_detect(int allow_shared)
+{
+	int mask;
+
+	mask = membarrier(MEMBARRIER_CMD_QUERY, 0);
+	if (mask < 0)
+		return RCU_MEMBARRIER_NONE;
+	if ((mask & MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+			&& !membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0))
+		return RCU_MEMBARRIER_PRIVATE_EXPEDITED;
+	if (allow_shared && (mask & MEMBARRIER_CMD_SHARED))
+		return RCU_MEMBARRIER_SHARED;
+	return RCU_MEMBARRIER_NONE;
+}
+
+/*
+ * Whether the rseq membarrier command, which can target a single CPU,
+ * is registered: 0 if not tried yet, 1 if registered, -1 if the kernel
+ * does not support it. Protected by rcu_gp_lock.
+ */
+static int membarrier_cpu_mode;
+
+/* Called with rcu_gp_lock held. */
+static void membarrier_cpu_register(void)
+{
+	int mask;
+
+	if (membarrier_cpu_mode)
+		return;
+	membarrier_cpu_mode = -1;
+	if (rcu_membarrier_mode != RCU_MEMBARRIER_PRIVATE_EXPEDITED)
+		return;
+	mask = membarrier(MEMBARRIER_CMD_QUERY, 0);
+	if (mask < 0 || !(mask & MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ))
+		return;
+	if (!membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_RSEQ, 0))
+		membarrier_cpu_mode = 1;
+}
+
+/*
+ * Interrupt only the CPUs running the readers which need barriers,
+ * sparing the CPUs of the quiescent-state readers. The CPU numbers are
+ * read from the rseq areas of the readers, and read again after the
+ * barriers to detect readers which migrated meanwhile. Return 0 on
+ * success, or -1 if the process-wide command is needed. Called with
+ * rcu_gp_lock held.
+ */
+static int membarrier_reader_cpu(struct rcu_reader *index)
+{
+	int32_t cpu;
+
+	if (!index->rseq_cpu_id)
+		return -1;
+	cpu = (int32_t) CMM_LOAD_SHARED(*index->rseq_cpu_id);
+	if (cpu < 0 || membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ,
+			MEMBARRIER_CMD_FLAG_CPU, cpu))
+		return -1;
+	if ((int32_t) CMM_LOAD_SHARED(*index->rseq_cpu_id) != cpu)
+		return -1;
+	return 0;
+}
+
+static int membarrier_cpus(void)
+{
+	struct rcu_reader *index;
+
+	if (membarrier_cpu_mode != 1)
+		return -1;
+	cds_list_for_each_entry(index, &barrier_readers, barrier_node) {
+		if (membarrier_reader_cpu(index))
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Issue the sys_membarrier command detected by rcu_init(). The private
+ * expedited registration does not survive fork() on all kernels:
+ * register again if the kernel refuses the command.
+ */
+static void membarrier_master(void)
+{
+	if (nr_quiescent_readers && !membarrier_cpus())
+		return;
+	if (rcu_membarrier_mode == RCU_MEMBARRIER_SHARED) {
+		(void) membarrier(MEMBARRIER_CMD_SHARED, 0);
+		return;
+	}
+	if (caa_likely(!membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0)))
+		return;
+	if (membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0)
+			|| membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0))
+		urcu_die(errno);
+}
+
+enum rcu_membarrier_mode rcu_get_membarrier_mode(void)
+{
+	return rcu_membarrier_mode;
+}
+#else /* #if defined(RCU_MEMBARRIER) || defined(RCU_SIGNAL) */
+enum rcu_membarrier_mode rcu_get_membarrier_mode(void)
+{
+	return RCU_MEMBARRIER_NONE;
+}
+#endif /* #else #if defined(RCU_MEMBARRIER) || defined(RCU_SIGNAL) */
+
 #ifdef RCU_MEMBARRIER
 static void smp_mb_master(int group)
 {
 	if (caa_likely(rcu_has_sys_membarrier))
-		(void) membarrier(MEMBARRIER_EXPEDITED);
+		membarrier_master();
 	else
 		cmm_smp_mb();
 }
@@ -166,124 +379,506 @@ static void smp_mb_master(int group)
 #endif
 
 #ifdef RCU_SIGNAL
-static void force_mb_all_readers(void)
+/*
+ * Signal again the readers which did not execute their memory barrier
+ * yet. Return the number of readers signaled.
+ */
+static unsigned int force_mb_resend(void)
 {
+	struct rcu_registry_shard *shard;
 	struct rcu_reader *index;
+	unsigned int nr = 0;
 
-	/*
-	 * Ask for each threads to execute a cmm_smp_mb() so we can consider the
-	 * compiler barriers around rcu read lock as real memory barriers.
-	 */
-	if (cds_list_empty(&registry))
-		return;
-	/*
-	 * pthread_kill has a cmm_smp_mb(). But beware, we assume it performs
-	 * a cache flush on architectures with non-coherent cache. Let's play
-	 * safe and don't assume anything : we use cmm_smp_mc() to make sure the
-	 * cache flush is enforced.
-	 */
-	cds_list_for_each_entry(index, &registry, node) {
-		CMM_STORE_SHARED(index->need_mb, 1);
-		pthread_kill(index->tid, SIGRCU);
+	rcu_registry_for_each_shard(registry, shard) {
+		cds_list_for_each_entry(index, &shard->head, node) {
+			if (!CMM_LOAD_SHARED(index->need_mb))
+				continue;
+			pthread_kill(index->tid, SIGRCU);
+			nr++;
+		}
 	}
+	return nr;
+}
+
+/*
+ * pthread_kill has a cmm_smp_mb(). But beware, we assume it performs
+ * a cache flush on architectures with non-coherent cache. Let's play
+ * safe and don't assume anything : we use cmm_smp_mc() to make sure the
+ * cache flush is enforced.
+ *
+ * All signals are sent before waiting for any acknowledgement, and
+ * each reader is accounted in force_mb_pending before it is asked
+ * for a memory barrier.
+ */
+static void force_mb_reader(struct rcu_reader *index)
+{
+	uatomic_inc(&force_mb_pending);
+	cmm_smp_mb__after_uatomic_inc();
+	CMM_STORE_SHARED(index->need_mb, 1);
+	pthread_kill(index->tid, SIGRCU);
+}
+
+static void force_mb_wait(void)
+{
+	unsigned int wait_loops = 0;
+
 	/*
 	 * Wait for sighandler (and thus mb()) to execute on every thread.
+	 * The last thread to acknowledge wakes us up.
 	 *
-	 * Note that the pthread_kill() will never be executed on systems
-	 * that correctly deliver signals in a timely manner.  However, it
-	 * is not uncommon for kernels to have bugs that can result in
-	 * lost or unduly delayed signals.
+	 * Note that the pthread_kill() will never be executed again on
+	 * systems that correctly deliver signals in a timely manner.
+	 * However, it is not uncommon for kernels to have bugs that can
+	 * result in lost or unduly delayed signals.
 	 *
 	 * If you are seeing the below pthread_kill() executing much at
 	 * all, we suggest testing the underlying kernel and filing the
 	 * relevant bug report.  For Linux kernels, we recommend getting
 	 * the Linux Test Project (LTP).
 	 */
-	cds_list_for_each_entry(index, &registry, node) {
-		while (CMM_LOAD_SHARED(index->need_mb)) {
-			pthread_kill(index->tid, SIGRCU);
-			poll(NULL, 0, 1);
+	for (;;) {
+		int32_t pending = uatomic_read(&force_mb_pending);
+
+		if (!pending)
+			break;
+		if (wait_loops < RCU_QS_ACTIVE_ATTEMPTS) {
+			wait_loops++;
+			caa_cpu_relax();
+			continue;
+		}
+#ifdef CONFIG_RCU_HAVE_FUTEX
+		{
+			struct timespec timeout = {
+				.tv_sec = 0,
+				.tv_nsec = FORCE_MB_RESEND_DELAY_NS,
+			};
+
+			if (futex_async(&force_mb_pending, FUTEX_WAIT, pending,
+					&timeout, NULL, 0) == 0
+					|| errno != ETIMEDOUT)
+				continue;
+		}
+#else
+		(void) poll(NULL, 0, FORCE_MB_RESEND_DELAY_NS / 1000000);
+		if (uatomic_read(&force_mb_pending) != pending)
+			continue;
+#endif
+		/*
+		 * Readers acknowledging from mutex_lock() with
+		 * DISTRUST_SIGNALS_EXTREME do not decrement the pending
+		 * count: stop once no reader needs a barrier anymore.
+		 */
+		if (!force_mb_resend()) {
+			uatomic_set(&force_mb_pending, 0);
+			break;
 		}
 	}
 	cmm_smp_mb();	/* read ->need_mb before ending the barrier */
 }
 
+static void force_mb_all_readers(void)
+{
+	struct rcu_registry_shard *shard;
+	struct rcu_reader *index;
+
+	/*
+	 * Ask for each threads to execute a cmm_smp_mb() so we can consider the
+	 * compiler barriers around rcu read lock as real memory barriers.
+	 */
+	if (rcu_registry_empty(registry))
+		return;
+	rcu_registry_for_each_shard(registry, shard) {
+		cds_list_for_each_entry(index, &shard->head, node) {
+			/* Quiescent-state readers issue their own barriers. */
+			if (index->quiescent)
+				continue;
+			force_mb_reader(index);
+		}
+	}
+	force_mb_wait();
+}
+
 static void smp_mb_master(int group)
 {
-	force_mb_all_readers();
+	if (caa_likely(rcu_membarrier_mode != RCU_MEMBARRIER_NONE))
+		membarrier_master();
+	else
+		force_mb_all_readers();
 }
 #endif /* #ifdef RCU_SIGNAL */
 
+#include "urcu-stall-impl.h"
+#include "urcu-stats-impl.h"
+#include "urcu-read-profile-impl.h"
+
+#ifdef CONFIG_RCU_READER_ARRAY
+/*
+ * Position of a reader scan within the counter slots of a registry
+ * shard. The slots before it hold quiescent readers or readers which
+ * observed the current parity, and need not be scanned again.
+ */
+struct reader_scan {
+	struct rcu_reader_chunk *chunk;
+	unsigned int slot;
+};
+
+static void reader_scan_init(struct reader_scan *scan,
+		struct rcu_registry_shard *shard)
+{
+	scan->chunk = shard->chunks;
+	scan->slot = 0;
+}
+
+/*
+ * Sweep the counter slots from the scan position, stopping at the first
+ * reader still using the old parity. Return 1 if there is none left.
+ */
+static int reader_scan(struct reader_scan *scan,
+		struct rcu_registry_shard *shard)
+{
+	for (; scan->chunk; scan->chunk = scan->chunk->next, scan->slot = 0) {
+		struct rcu_reader_chunk *chunk = scan->chunk;
+
+		for (; scan->slot < chunk->nr_slots; scan->slot++) {
+			if (rcu_reader_state(&chunk->slot[scan->slot].ctr)
+					== RCU_READER_ACTIVE_OLD)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/* Number of readers of the shard still using the old parity. */
+static long reader_scan_count(struct reader_scan *scan,
+		struct rcu_registry_shard *shard)
+{
+	struct rcu_reader_chunk *chunk = scan->chunk;
+	unsigned int slot = scan->slot;
+	long nr = 0;
+
+	for (; chunk; chunk = chunk->next, slot = 0) {
+		for (; slot < chunk->nr_slots; slot++) {
+			if (rcu_reader_state(&chunk->slot[slot].ctr)
+					== RCU_READER_ACTIVE_OLD)
+				nr++;
+		}
+	}
+	return nr;
+}
+
+#ifndef RCU_MB
+/*
+ * Barrier-based readers from the scan position, as many as fit in
+ * readers[RCU_MB_LAGGING_MAX]. Return their number, or
+ * RCU_MB_LAGGING_MAX + 1 if there are more.
+ */
+static unsigned int reader_scan_pending(struct reader_scan *scan,
+		struct rcu_registry_shard *shard, struct rcu_reader **readers)
+{
+	struct rcu_reader_chunk *chunk = scan->chunk;
+	unsigned int slot = scan->slot, nr = 0;
+
+	for (; chunk; chunk = chunk->next, slot = 0) {
+		for (; slot < chunk->nr_slots; slot++) {
+			struct rcu_reader *index = chunk->owner[slot];
+
+			if (!index || index->quiescent)
+				continue;
+			if (nr == RCU_MB_LAGGING_MAX)
+				return nr + 1;
+			readers[nr++] = index;
+		}
+	}
+	return nr;
+}
+#endif
+
+static void reader_scan_fini(struct reader_scan *scan,
+		struct rcu_registry_shard *shard)
+{
+}
+
+static void reader_scan_stall_check(struct reader_scan *scan,
+		struct rcu_registry_shard *shard, struct rcu_stall_state *stall)
+{
+	struct rcu_reader_chunk *chunk = scan->chunk;
+	unsigned int slot = scan->slot;
+	rcu_stall_report_fct report;
+	unsigned long stall_ms;
+
+	report = rcu_stall_due(stall, &stall_ms);
+	if (caa_likely(!report))
+		return;
+	for (; chunk; chunk = chunk->next, slot = 0) {
+		for (; slot < chunk->nr_slots; slot++) {
+			if (rcu_reader_state(&chunk->slot[slot].ctr)
+					!= RCU_READER_ACTIVE_OLD)
+				continue;
+			report(chunk->owner[slot]->tid, stall_ms,
+				CMM_LOAD_SHARED(rcu_gp_seq));
+		}
+	}
+}
+#else /* #ifdef CONFIG_RCU_READER_ARRAY */
+/*
+ * Readers of a registry shard found quiescent or observing the current
+ * parity are moved to qsreaders, and put back into the shard at the end
+ * of the scan. The readers left in the shard use the old parity.
+ */
+struct reader_scan {
+	struct cds_list_head qsreaders;
+};
+
+static void reader_scan_init(struct reader_scan *scan,
+		struct rcu_registry_shard *shard)
+{
+	CDS_INIT_LIST_HEAD(&scan->qsreaders);
+}
+
+/* Return 1 if no reader of the shard uses the old parity anymore. */
+static int reader_scan(struct reader_scan *scan,
+		struct rcu_registry_shard *shard)
+{
+	struct rcu_reader *index, *tmp;
+
+	cds_list_for_each_entry_safe(index, tmp, &shard->head, node) {
+		switch (rcu_reader_state(&index->ctr)) {
+		case RCU_READER_ACTIVE_CURRENT:
+		case RCU_READER_INACTIVE:
+			cds_list_move(&index->node, &scan->qsreaders);
+			break;
+		case RCU_READER_ACTIVE_OLD:
+			/*
+			 * Old snapshot. Leaving node in the shard will
+			 * make us busy-loop until the snapshot becomes
+			 * current or the reader becomes inactive.
+			 */
+			break;
+		}
+	}
+	return cds_list_empty(&shard->head);
+}
+
+/* Number of readers left in the shard by the last scan. */
+static long reader_scan_count(struct reader_scan *scan,
+		struct rcu_registry_shard *shard)
+{
+	struct rcu_reader *index;
+	long nr = 0;
+
+	cds_list_for_each_entry(index, &shard->head, node)
+		nr++;
+	return nr;
+}
+
+#ifndef RCU_MB
 /*
- * synchronize_rcu() waiting. Single thread.
+ * Barrier-based readers left in the shard, as many as fit in
+ * readers[RCU_MB_LAGGING_MAX]. Return their number, or
+ * RCU_MB_LAGGING_MAX + 1 if there are more.
  */
-static void wait_gp(void)
+static unsigned int reader_scan_pending(struct reader_scan *scan,
+		struct rcu_registry_shard *shard, struct rcu_reader **readers)
+{
+	struct rcu_reader *index;
+	unsigned int nr = 0;
+
+	cds_list_for_each_entry(index, &shard->head, node) {
+		if (index->quiescent)
+			continue;
+		if (nr == RCU_MB_LAGGING_MAX)
+			return nr + 1;
+		readers[nr++] = index;
+	}
+	return nr;
+}
+#endif
+
+static void reader_scan_fini(struct reader_scan *scan,
+		struct rcu_registry_shard *shard)
+{
+	/* Put quiescent reader list back into its registry shard. */
+	cds_list_splice(&scan->qsreaders, &shard->head);
+}
+
+static void reader_scan_stall_check(struct reader_scan *scan,
+		struct rcu_registry_shard *shard, struct rcu_stall_state *stall)
+{
+	rcu_stall_check(stall, &shard->head);
+}
+#endif /* #else #ifdef CONFIG_RCU_READER_ARRAY */
+
+/*
+ * Memory barrier on the readers the scan waits for. The barriers of the
+ * futex wait protocol only pair with the readers the next scan may find
+ * using the old parity: either the scan sees such a reader leave, or
+ * the reader sees the futex decrement and wakes us up. The readers the
+ * scan is done with are spared the signal or interrupt, which matters
+ * when most threads are idle and a few critical sections hold up the
+ * grace period. The barriers which begin and end the reader scan still
+ * apply to all readers: an idle reader could otherwise enter a critical
+ * section with its counter store still buffered, or have the accesses
+ * of a critical section reordered after its counter store. Falls back
+ * to smp_mb_master() past RCU_MB_LAGGING_MAX readers, or when the
+ * CPUs of the readers cannot be targeted.
+ */
+#ifdef RCU_MB
+static void smp_mb_lagging(struct reader_scan *scan,
+		struct rcu_registry_shard *shard)
+{
+	cmm_smp_mb();
+}
+#else
+/* Called with rcu_gp_lock held. */
+static int membarrier_lagging(struct rcu_reader **readers, unsigned int nr)
+{
+	unsigned int i;
+
+	membarrier_cpu_register();
+	if (membarrier_cpu_mode != 1)
+		return -1;
+	for (i = 0; i < nr; i++) {
+		if (membarrier_reader_cpu(readers[i]))
+			return -1;
+	}
+	return 0;
+}
+
+static void smp_mb_lagging(struct reader_scan *scan,
+		struct rcu_registry_shard *shard)
+{
+	struct rcu_reader *readers[RCU_MB_LAGGING_MAX];
+	unsigned int nr;
+
+#ifdef RCU_MEMBARRIER
+	if (caa_unlikely(!rcu_has_sys_membarrier)) {
+		cmm_smp_mb();
+		return;
+	}
+#endif
+	nr = reader_scan_pending(scan, shard, readers);
+	if (nr > RCU_MB_LAGGING_MAX) {
+		smp_mb_master(RCU_MB_GROUP);
+		return;
+	}
+	cmm_smp_mb();
+	if (!nr)
+		return;
+#ifdef RCU_SIGNAL
+	if (rcu_membarrier_mode == RCU_MEMBARRIER_NONE) {
+		unsigned int i;
+
+		for (i = 0; i < nr; i++)
+			force_mb_reader(readers[i]);
+		force_mb_wait();
+		return;
+	}
+#endif
+	if (membarrier_lagging(readers, nr))
+		membarrier_master();
+}
+#endif
+
+/*
+ * synchronize_rcu() waiting. Single thread. A non-NULL timeout bounds
+ * the wait for the stall detector.
+ *
+ * nr_blocking is the number of readers using the old parity found by
+ * the scan following the futex decrement: each of them counts down
+ * rcu_gp.countdown when leaving, so that only the last one wakes us up.
+ * Readers leaving before the count is added may have counted down
+ * already, as well as readers the scan did not find blocking anymore,
+ * which only makes us wake up early and scan again.
+ */
+static void wait_gp(struct reader_scan *scan, struct rcu_registry_shard *shard,
+		long nr_blocking, const struct timespec *timeout)
 {
 	/* Read reader_gp before read futex */
-	smp_mb_master(RCU_MB_GROUP);
-	if (uatomic_read(&rcu_gp.futex) == -1)
+	smp_mb_lagging(scan, shard);
+	if (uatomic_read(&rcu_gp.futex) != -1)
+		return;
+	if (uatomic_add_return(&rcu_gp.countdown, nr_blocking) <= 0) {
+		/* They all left already: scan again rather than sleep. */
+		(void) uatomic_cmpxchg(&rcu_gp.futex, -1, 0);
+		return;
+	}
+	rcu_stats_gp_sleep();
+	urcu_tp(gp_futex_wait);
+	if (caa_likely(!timeout)) {
 		futex_async(&rcu_gp.futex, FUTEX_WAIT, -1,
 		      NULL, NULL, 0);
+		urcu_tp(gp_futex_wake);
+		return;
+	}
+#ifdef CONFIG_RCU_HAVE_FUTEX
+	(void) futex_async(&rcu_gp.futex, FUTEX_WAIT, -1,
+		      timeout, NULL, 0);
+#else
+	(void) poll(NULL, 0, timeout->tv_sec * 1000
+		+ timeout->tv_nsec / 1000000);
+#endif
+	urcu_tp(gp_futex_wake);
+	/*
+	 * If no reader woke us up, undo the futex decrement, which
+	 * wait_for_readers() performs again before its next scan.
+	 */
+	(void) uatomic_cmpxchg(&rcu_gp.futex, -1, 0);
 }
 
-static void wait_for_readers(struct cds_list_head *input_readers,
-			struct cds_list_head *cur_snap_readers,
-			struct cds_list_head *qsreaders)
+/*
+ * Wait for the readers of a registry shard to be quiescent or observe
+ * the current parity.
+ *
+ * In expedited mode, busy-wait on the readers without ever falling back
+ * to the futex sleep: trades CPU time for grace period latency.
+ */
+static void wait_for_readers(struct rcu_registry_shard *shard, int expedited)
 {
-	unsigned int wait_loops = 0;
-	struct rcu_reader *index, *tmp;
+	struct urcu_wait_spin spin;
+	int sleeping = 0;
+	struct reader_scan scan;
+	struct rcu_stall_state stall;
+	struct timespec stall_ts;
 #ifdef HAS_INCOHERENT_CACHES
 	unsigned int wait_gp_loops = 0;
 #endif /* HAS_INCOHERENT_CACHES */
 
+	rcu_stall_start(&stall);
+	urcu_wait_spin_start(&spin, &gp_wait_estimate);
+	urcu_tp2(wait_for_readers, &shard->head, expedited);
+	reader_scan_init(&scan, shard);
+
 	/*
 	 * Wait for each thread URCU_TLS(rcu_reader).ctr to either
 	 * indicate quiescence (not nested), or observe the current
 	 * rcu_gp.ctr value.
 	 */
 	for (;;) {
-		if (wait_loops < RCU_QS_ACTIVE_ATTEMPTS)
-			wait_loops++;
-		if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS) {
+		if (!expedited && !sleeping)
+			sleeping = urcu_wait_spin_expired(&spin);
+		if (sleeping) {
+			/* Before readers can see the futex decrement. */
+			uatomic_set(&rcu_gp.countdown, 0);
 			uatomic_dec(&rcu_gp.futex);
 			/* Write futex before read reader_gp */
-			smp_mb_master(RCU_MB_GROUP);
-		}
-
-		cds_list_for_each_entry_safe(index, tmp, input_readers, node) {
-			switch (rcu_reader_state(&index->ctr)) {
-			case RCU_READER_ACTIVE_CURRENT:
-				if (cur_snap_readers) {
-					cds_list_move(&index->node,
-						cur_snap_readers);
-					break;
-				}
-				/* Fall-through */
-			case RCU_READER_INACTIVE:
-				cds_list_move(&index->node, qsreaders);
-				break;
-			case RCU_READER_ACTIVE_OLD:
-				/*
-				 * Old snapshot. Leaving node in
-				 * input_readers will make us busy-loop
-				 * until the snapshot becomes current or
-				 * the reader becomes inactive.
-				 */
-				break;
-			}
+			smp_mb_lagging(&scan, shard);
 		}
 
 #ifndef HAS_INCOHERENT_CACHES
-		if (cds_list_empty(input_readers)) {
-			if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS) {
+		if (reader_scan(&scan, shard)) {
+			if (sleeping) {
 				/* Read reader_gp before write futex */
-				smp_mb_master(RCU_MB_GROUP);
+				smp_mb_lagging(&scan, shard);
 				uatomic_set(&rcu_gp.futex, 0);
 			}
 			break;
 		} else {
-			if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS)
-				wait_gp();
+			reader_scan_stall_check(&scan, shard, &stall);
+			if (sleeping)
+				wait_gp(&scan, shard,
+					reader_scan_count(&scan, shard),
+					rcu_stall_wait_timeout(&stall,
+						&stall_ts));
 			else
 				caa_cpu_relax();
 		}
@@ -293,20 +888,27 @@ static void wait_for_readers(struct cds_list_head *input_readers,
 		 * URCU_TLS(rcu_reader).ctr update to memory if we wait
 		 * for too long.
 		 */
-		if (cds_list_empty(input_readers)) {
-			if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS) {
+		if (reader_scan(&scan, shard)) {
+			if (sleeping) {
 				/* Read reader_gp before write futex */
-				smp_mb_master(RCU_MB_GROUP);
+				smp_mb_lagging(&scan, shard);
 				uatomic_set(&rcu_gp.futex, 0);
 			}
 			break;
 		} else {
+			reader_scan_stall_check(&scan, shard, &stall);
 			if (wait_gp_loops == KICK_READER_LOOPS) {
-				smp_mb_master(RCU_MB_GROUP);
+				smp_mb_lagging(&scan, shard);
 				wait_gp_loops = 0;
 			}
-			if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS) {
-				wait_gp();
+			if (expedited) {
+				/* Kick readers on every scan. */
+				smp_mb_lagging(&scan, shard);
+			} else if (sleeping) {
+				wait_gp(&scan, shard,
+					reader_scan_count(&scan, shard),
+					rcu_stall_wait_timeout(&stall,
+						&stall_ts));
 				wait_gp_loops++;
 			} else {
 				caa_cpu_relax();
@@ -314,54 +916,101 @@ static void wait_for_readers(struct cds_list_head *input_readers,
 		}
 #endif /* #else #ifndef HAS_INCOHERENT_CACHES */
 	}
+	reader_scan_fini(&scan, shard);
 }
 
-void synchronize_rcu(void)
+/*
+ * Grace period engine.
+ *
+ * A grace period is made of a reader scan, waiting for each reader to
+ * either be quiescent or observe the current rcu_gp.ctr parity, followed
+ * by a parity flip, followed by another reader scan. The first scan
+ * ensures no reader with a stale parity remains by the time we flip,
+ * while the second scan waits for readers which observed the old parity.
+ *
+ * Both scans wait for the same condition, so the second scan of a batch
+ * of waiters can be used as the first scan of the following batch. The
+ * grace period leader therefore pipelines batches: each reader scan
+ * completes the batch which went through a previous scan and flip, and
+ * acts as the first scan for the waiters collected right before it.
+ * This allows completing one grace period per reader scan under heavy
+ * synchronize_rcu() load.
+ *
+ * A parity flip is performed after every reader scan, so the sequence
+ * of operations is always alternating scans and flips.
+ */
+
+/*
+ * Batch of waiters which went through a reader scan and a parity flip,
+ * and only awaits a last reader scan to complete their grace period.
+ * Handed over from one grace period leader to the next. The first
+ * waiter added to this batch is a leader awaiting rcu_gp_lock, which
+ * will take care of completing it. Protected by rcu_gp_lock.
+ */
+static struct urcu_waiters gp_pending_waiters;
+
+/*
+ * Beginning of the first reader scan of gp_pending_waiters, for
+ * statistics. Protected by rcu_gp_lock.
+ */
+static uint64_t gp_pending_start_ns;
+
+/* Grace period batching statistics. Protected by rcu_gp_lock. */
+static struct rcu_gp_batch_stats gp_batch_stats;
+
+/*
+ * Wait for readers to be quiescent or observe the current parity.
+ * Called with rcu_gp_lock held.
+ */
+static void gp_reader_scan(int expedited)
 {
-	CDS_LIST_HEAD(cur_snap_readers);
-	CDS_LIST_HEAD(qsreaders);
-	DEFINE_URCU_WAIT_NODE(wait, URCU_WAIT_WAITING);
-	struct urcu_waiters waiters;
+	struct rcu_registry_shard *shard;
 
-	/*
-	 * Add ourself to gp_waiters queue of threads awaiting to wait
-	 * for a grace period. Proceed to perform the grace period only
-	 * if we are the first thread added into the queue.
-	 * The implicit memory barrier before urcu_wait_add()
-	 * orders prior memory accesses of threads put into the wait
-	 * queue before their insertion into the wait queue.
-	 */
-	if (urcu_wait_add(&gp_waiters, &wait) != 0) {
-		/* Not first in queue: will be awakened by another thread. */
-		urcu_adaptative_busy_wait(&wait);
-		/* Order following memory accesses after grace period. */
-		cmm_smp_mb();
-		return;
-	}
-	/* We won't need to wake ourself up */
-	urcu_wait_set_state(&wait, URCU_WAIT_RUNNING);
+	/* Reader scan begins. Pairs with start_poll_synchronize_rcu(). */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_tp1(gp_begin, rcu_gp_seq);
+	gp_batch_stats.nr_reader_scans++;
 
-	mutex_lock(&rcu_gp_lock);
+	/* Readers registered while rcu_gp_lock was held. */
+	merge_pending_readers();
+	if (rcu_registry_empty(registry))
+		goto end;
 
 	/*
-	 * Move all waiters into our local queue.
+	 * All threads should read qparity before accessing data structure
+	 * where new ptr points to. Must be done within rcu_gp_lock because
+	 * it iterates on reader threads.
+	 * Write new ptr before changing the qparity.
 	 */
-	urcu_move_waiters(&waiters, &gp_waiters);
-
-	if (cds_list_empty(&registry))
-		goto out;
-
-	/* All threads should read qparity before accessing data structure
-	 * where new ptr points to. Must be done within rcu_gp_lock because it
-	 * iterates on reader threads.*/
-	/* Write new ptr before changing the qparity */
 	smp_mb_master(RCU_MB_GROUP);
 
 	/*
-	 * Wait for readers to observe original parity or be quiescent.
+	 * Scan the registry one shard at a time, so the reader cache
+	 * lines of a NUMA node are pulled together.
 	 */
-	wait_for_readers(&registry, &cur_snap_readers, &qsreaders);
+	rcu_registry_for_each_shard(registry, shard) {
+		if (cds_list_empty(&shard->head))
+			continue;
+		wait_for_readers(shard, expedited);
+	}
+
+	/*
+	 * Finish waiting for reader threads before letting the old ptr
+	 * being freed. Must be done within rcu_gp_lock because it iterates
+	 * on reader threads.
+	 */
+	smp_mb_master(RCU_MB_GROUP);
+end:
+	/* Reader scan ends. Pairs with poll_state_synchronize_rcu(). */
+	CMM_STORE_SHARED(rcu_gp_seq, rcu_gp_seq + 1);
+	urcu_tp1(gp_end, rcu_gp_seq);
+}
 
+/*
+ * Switch rcu_gp.ctr parity. Called with rcu_gp_lock held.
+ */
+static void gp_parity_flip(void)
+{
 	/*
 	 * Must finish waiting for quiescent state for original parity before
 	 * committing next rcu_gp.ctr update to memory. Failure to do so could
@@ -396,36 +1045,272 @@ void synchronize_rcu(void)
 	 * anyway, given this is the write-side.
 	 */
 	cmm_smp_mb();
+}
+
+/*
+ * Wake up a batch of waiters whose grace period, which began at
+ * start_ns, has completed. Called with rcu_gp_lock held.
+ */
+static void gp_complete_batch(struct urcu_waiters *batch, uint64_t start_ns)
+{
+	unsigned long count;
+
+	if (!batch->head)
+		return;
+	count = urcu_complete_all_waiters(batch);
+	batch->head = NULL;
+
+	rcu_stats_gp_end(urcu_wait_estimate_end(&gp_wait_estimate,
+			start_ns));
+	rcu_stats_add_waiters(count);
+
+	gp_batch_stats.nr_gp++;
+	gp_batch_stats.nr_waiters += count;
+	gp_batch_stats.last_batch_waiters = count;
+	if (count > gp_batch_stats.max_batch_waiters)
+		gp_batch_stats.max_batch_waiters = count;
+}
+
+void synchronize_rcu(void)
+{
+	DEFINE_URCU_WAIT_NODE(wait, URCU_WAIT_WAITING);
+	struct urcu_waiters pending, waiters;
+	uint64_t start_ns;
 
+	urcu_tp1(synchronize_rcu, 0);
+
+	/*
+	 * Add ourself to gp_waiters queue of threads awaiting to wait
+	 * for a grace period. Proceed to perform the grace period only
+	 * if we are the first thread added into the queue.
+	 * The implicit memory barrier before urcu_wait_add()
+	 * orders prior memory accesses of threads put into the wait
+	 * queue before their insertion into the wait queue.
+	 */
+	if (urcu_wait_add(&gp_waiters, &wait) != 0) {
+		/* Not first in queue: will be awakened by another thread. */
+		urcu_adaptative_busy_wait(&wait, &gp_wait_estimate);
+		/* Order following memory accesses after grace period. */
+		cmm_smp_mb();
+		return;
+	}
 	/*
-	 * Wait for readers to observe new parity or be quiescent.
+	 * We won't need to wake ourself up, unless the pipeline of
+	 * another leader already moved our node and completed its batch
+	 * before we flagged it running.
 	 */
-	wait_for_readers(&cur_snap_readers, NULL, &qsreaders);
+	if (!urcu_wait_set_running(&wait)) {
+		urcu_adaptative_busy_wait(&wait, &gp_wait_estimate);
+		/* Order following memory accesses after grace period. */
+		cmm_smp_mb();
+		return;
+	}
+
+	mutex_lock(&rcu_gp_lock);
 
 	/*
-	 * Put quiescent reader list back into registry.
+	 * Our batch may have been completed by the pipeline of another
+	 * leader while we were waiting for rcu_gp_lock.
 	 */
-	cds_list_splice(&qsreaders, &registry);
+	while (!(uatomic_read(&wait.state)
+			& (URCU_WAIT_COMPLETED | URCU_WAIT_TEARDOWN))) {
+		/* Batch awaiting its last reader scan. */
+		pending = gp_pending_waiters;
+		gp_pending_waiters.head = NULL;
+
+		/*
+		 * Move all waiters into our local queue: the following
+		 * reader scan is their first one.
+		 */
+		urcu_move_waiters(&waiters, &gp_waiters);
+
+		start_ns = urcu_wait_now_ns();
+		gp_reader_scan(0);
+
+		/*
+		 * Wakeup waiters only after we have completed the grace
+		 * period and have ensured the memory barriers at the end
+		 * of the grace period have been issued.
+		 */
+		gp_complete_batch(&pending, gp_pending_start_ns);
+
+		gp_parity_flip();
+
+		/*
+		 * The next reader scan, either performed by ourself or by
+		 * the leader of this batch, completes its grace period.
+		 */
+		gp_pending_waiters = waiters;
+		gp_pending_start_ns = start_ns;
+	}
 
-	/* Finish waiting for reader threads before letting the old ptr being
-	 * freed. Must be done within rcu_gp_lock because it iterates on reader
-	 * threads. */
-	smp_mb_master(RCU_MB_GROUP);
-out:
 	mutex_unlock(&rcu_gp_lock);
+	/* Order following memory accesses after grace period. */
+	cmm_smp_mb();
+}
+
+/*
+ * Expedited grace period: bypass the waiter queue and perform a full
+ * grace period as soon as rcu_gp_lock is acquired, busy-waiting on
+ * readers. Synchronize_rcu() callers already queued are served by this
+ * grace period too.
+ */
+void synchronize_rcu_expedited(void)
+{
+	struct urcu_waiters pending, waiters;
+	uint64_t start_ns;
+
+	urcu_tp1(synchronize_rcu, 1);
 
 	/*
-	 * Wakeup waiters only after we have completed the grace period
-	 * and have ensured the memory barriers at the end of the grace
-	 * period have been issued.
+	 * Order prior memory accesses before the beginning of the grace
+	 * period.
 	 */
-	urcu_wake_all_waiters(&waiters);
+	cmm_smp_mb();
+
+	mutex_lock(&rcu_gp_lock);
+
+	/* Batch awaiting its last reader scan. */
+	pending = gp_pending_waiters;
+	gp_pending_waiters.head = NULL;
+	urcu_move_waiters(&waiters, &gp_waiters);
+
+	start_ns = urcu_wait_now_ns();
+	gp_reader_scan(1);
+	gp_complete_batch(&pending, gp_pending_start_ns);
+	gp_parity_flip();
+	gp_reader_scan(1);
+	/* Our own grace period, shared with the queued waiters if any. */
+	if (!waiters.head)
+		rcu_stats_gp_end(urcu_wait_estimate_end(&gp_wait_estimate,
+			start_ns));
+	gp_complete_batch(&waiters, start_ns);
+	rcu_stats_add_waiters(1);
+	/* Keep alternating scans and parity flips. */
+	gp_parity_flip();
+
+	mutex_unlock(&rcu_gp_lock);
+	/* Order following memory accesses after grace period. */
+	cmm_smp_mb();
+}
+
+/*
+ * Fetch a snapshot of the grace period batching statistics.
+ */
+void rcu_gp_get_batch_stats(struct rcu_gp_batch_stats *stats)
+{
+	mutex_lock(&rcu_gp_lock);
+	*stats = gp_batch_stats;
+	mutex_unlock(&rcu_gp_lock);
 }
 
 /*
  * library wrappers to be used by non-LGPL compatible source code.
  */
 
+#ifdef RCU_READ_IFUNC
+/*
+ * Variants of _rcu_read_lock() and _rcu_read_unlock() where
+ * smp_mb_slave() is the barrier matching the sys_membarrier detection,
+ * sparing the readers the test of rcu_has_sys_membarrier.
+ */
+#define DEFINE_READ_WRAPPERS(prefix, mb_slave)				\
+static void prefix##_read_lock(void)					\
+{									\
+	unsigned long tmp;						\
+									\
+	cmm_barrier();							\
+	tmp = _URCU_READER_CTR;						\
+	if (caa_likely(!(tmp & RCU_GP_CTR_NEST_MASK))) {		\
+		_CMM_STORE_SHARED(_URCU_READER_CTR,			\
+			_CMM_LOAD_SHARED(rcu_gp.ctr));			\
+		mb_slave();						\
+	} else								\
+		_CMM_STORE_SHARED(_URCU_READER_CTR, tmp + RCU_GP_COUNT); \
+	_rcu_read_profile_lock(tmp);					\
+}									\
+									\
+static void prefix##_read_unlock(void)					\
+{									\
+	unsigned long tmp;						\
+									\
+	tmp = _URCU_READER_CTR;						\
+	_rcu_read_profile_unlock(tmp);					\
+	if (caa_likely((tmp & RCU_GP_CTR_NEST_MASK) == RCU_GP_COUNT)) {	\
+		mb_slave();						\
+		_CMM_STORE_SHARED(_URCU_READER_CTR, tmp - RCU_GP_COUNT); \
+		mb_slave();						\
+		wake_up_gp_countdown(tmp);				\
+	} else								\
+		_CMM_STORE_SHARED(_URCU_READER_CTR, tmp - RCU_GP_COUNT); \
+	cmm_barrier();							\
+}
+
+DEFINE_READ_WRAPPERS(membarrier, cmm_barrier)
+DEFINE_READ_WRAPPERS(fence, cmm_smp_mb)
+
+/*
+ * ifunc resolvers run while the dynamic linker relocates the library,
+ * possibly before the relocations of its own calls and global variable
+ * accesses are processed: issue the system call directly, and only
+ * access static variables.
+ */
+static long resolver_membarrier(int cmd)
+{
+#if defined(__x86_64__)
+	long ret;
+
+	__asm__ __volatile__ ("syscall"
+		: "=a" (ret)
+		: "0" ((long) SYS_membarrier), "D" ((long) cmd), "S" (0L)
+		: "rcx", "r11", "memory");
+	return ret;
+#elif defined(__aarch64__)
+	register long x8 __asm__ ("x8") = SYS_membarrier;
+	register long x0 __asm__ ("x0") = cmd;
+	register long x1 __asm__ ("x1") = 0;
+
+	__asm__ __volatile__ ("svc #0"
+		: "+r" (x0)
+		: "r" (x8), "r" (x1)
+		: "memory");
+	return x0;
+#endif
+}
+
+static int resolve_membarrier(void)
+{
+	static int resolved;
+	long mask;
+
+	if (resolved)
+		return read_ifunc_membarrier;
+	resolved = 1;
+	/*
+	 * The private expedited command is only registered by
+	 * rcu_init(), on the first reader registration, which precedes
+	 * the first read-side critical section.
+	 */
+	mask = resolver_membarrier(MEMBARRIER_CMD_QUERY);
+	if (mask >= 0 && (mask & MEMBARRIER_CMD_PRIVATE_EXPEDITED))
+		read_ifunc_membarrier = 1;
+	return read_ifunc_membarrier;
+}
+
+static void (*resolve_read_lock(void))(void)
+{
+	return resolve_membarrier() ? membarrier_read_lock : fence_read_lock;
+}
+
+static void (*resolve_read_unlock(void))(void)
+{
+	return resolve_membarrier() ?
+		membarrier_read_unlock : fence_read_unlock;
+}
+
+void rcu_read_lock(void) __attribute__((ifunc("resolve_read_lock")));
+void rcu_read_unlock(void) __attribute__((ifunc("resolve_read_unlock")));
+#else /* #ifdef RCU_READ_IFUNC */
 void rcu_read_lock(void)
 {
 	_rcu_read_lock();
@@ -435,39 +1320,257 @@ void rcu_read_unlock(void)
 {
 	_rcu_read_unlock();
 }
+#endif /* #else #ifdef RCU_READ_IFUNC */
 
 int rcu_read_ongoing(void)
 {
 	return _rcu_read_ongoing();
 }
 
-void rcu_register_thread(void)
+void rcu_read_lock_ctx(struct rcu_reader_ctx *ctx)
+{
+	_rcu_read_lock_ctx(ctx);
+}
+
+void rcu_read_unlock_ctx(struct rcu_reader_ctx *ctx)
 {
+	_rcu_read_unlock_ctx(ctx);
+}
+
+int rcu_read_ongoing_ctx(struct rcu_reader_ctx *ctx)
+{
+	return _rcu_read_ongoing_ctx(ctx);
+}
+
+/*
+ * Quiescent-state readers stay in an outer read-side critical section
+ * while online, so their rcu_read_lock() and rcu_read_unlock() only
+ * update the nesting count, and report Q.S. by observing the current
+ * parity, with memory barriers on both sides as urcu-qsbr readers.
+ */
+void rcu_quiescent_state(void)
+{
+	unsigned long tmp;
+
+	if (!URCU_TLS(rcu_reader).quiescent)
+		return;
+	tmp = _URCU_READER_CTR;
+	assert((tmp & RCU_GP_CTR_NEST_MASK) == RCU_GP_COUNT);
+	cmm_smp_mb();
+	_CMM_STORE_SHARED(_URCU_READER_CTR, _CMM_LOAD_SHARED(rcu_gp.ctr));
+	cmm_smp_mb();	/* write ctr before read futex */
+	wake_up_gp_countdown(tmp);
+}
+
+void rcu_thread_offline(void)
+{
+	unsigned long tmp;
+
+	if (!URCU_TLS(rcu_reader).quiescent)
+		return;
+	tmp = _URCU_READER_CTR;
+	cmm_smp_mb();
+	_CMM_STORE_SHARED(_URCU_READER_CTR, 0);
+	cmm_smp_mb();	/* write ctr before read futex */
+	if (tmp & RCU_GP_CTR_NEST_MASK)
+		wake_up_gp_countdown(tmp);
+}
+
+void rcu_thread_online(void)
+{
+	if (!URCU_TLS(rcu_reader).quiescent)
+		return;
+	_CMM_STORE_SHARED(_URCU_READER_CTR, _CMM_LOAD_SHARED(rcu_gp.ctr));
+	cmm_smp_mb();
+}
+
+/* Whether registration may skip rcu_init(). */
+static int rcu_init_done(void)
+{
+#ifdef RCU_MB
+	return 1;
+#else
+	return CMM_LOAD_SHARED(init_done);
+#endif
+}
+
+/*
+ * Take rcu_gp_lock to register a barrier-based reader, unless a grace
+ * period holds it: rather push the reader on the pending stack of its
+ * shard, for the next grace period to merge it, so registration does
+ * not wait for the grace period, and return 1. With
+ * CONFIG_RCU_READER_ARRAY, registration allocates a counter slot of
+ * the shard, and always takes the lock.
+ */
+static int register_lock_or_pend(void)
+{
+#ifndef CONFIG_RCU_READER_ARRAY
+	int ret;
+
+	if (rcu_init_done()) {
+		ret = pthread_mutex_trylock(&rcu_gp_lock);
+		if (!ret) {
+			rcu_lock_stats_acquired(rcu_lock_stats_of(&rcu_gp_lock,
+					&rcu_gp_lock, RCU_LOCK_GP), 0);
+			return 0;
+		}
+		if (ret != EBUSY)
+			urcu_die(ret);
+		rcu_registry_add_pending(rcu_registry_local_shard(registry),
+				&URCU_TLS(rcu_reader).node);
+		return 1;
+	}
+#endif
+	mutex_lock(&rcu_gp_lock);
+	return 0;
+}
+
+static void register_thread(int quiescent)
+{
+	struct rcu_registry_shard *shard;
+
 	URCU_TLS(rcu_reader).tid = pthread_self();
 	assert(URCU_TLS(rcu_reader).need_mb == 0);
+	rcu_read_profile_init();
+#ifdef CONFIG_RCU_READER_ARRAY
+	assert(!URCU_TLS(rcu_reader).ctr);
+#else
 	assert(!(URCU_TLS(rcu_reader).ctr & RCU_GP_CTR_NEST_MASK));
+#endif
 
-	mutex_lock(&rcu_gp_lock);
-	rcu_init();	/* In case gcc does not support constructor attribute */
-	cds_list_add(&URCU_TLS(rcu_reader).node, &registry);
+	if (!quiescent) {
+#ifdef URCU_HAVE_RSEQ
+		if (__rseq_size)
+			URCU_TLS(rcu_reader).rseq_cpu_id =
+				&urcu_rseq_area()->cpu_id;
+#endif
+		if (register_lock_or_pend())
+			return;
+	} else {
+		mutex_lock(&rcu_gp_lock);
+	}
+	rcu_init_locked();	/* First registration initializes the library. */
+	shard = rcu_registry_local_shard(registry);
+#ifdef CONFIG_RCU_READER_ARRAY
+	URCU_TLS(rcu_reader).ctr = rcu_registry_slot_alloc(shard,
+			&URCU_TLS(rcu_reader));
+	if (!URCU_TLS(rcu_reader).ctr)
+		urcu_die(ENOMEM);
+#endif
+	cds_list_add(&URCU_TLS(rcu_reader).node, &shard->head);
+	if (quiescent) {
+		URCU_TLS(rcu_reader).quiescent = 1;
+		nr_quiescent_readers++;
+#if defined(RCU_MEMBARRIER) || defined(RCU_SIGNAL)
+		membarrier_cpu_register();
+#endif
+		/* Online, observing the current parity. */
+		_CMM_STORE_SHARED(_URCU_READER_CTR,
+				_CMM_LOAD_SHARED(rcu_gp.ctr));
+		cmm_smp_mb();
+	} else {
+		cds_list_add(&URCU_TLS(rcu_reader).barrier_node,
+				&barrier_readers);
+	}
 	mutex_unlock(&rcu_gp_lock);
 }
 
+void rcu_register_thread(void)
+{
+	register_thread(0);
+}
+
+void rcu_register_thread_quiescent(void)
+{
+	register_thread(1);
+}
+
 void rcu_unregister_thread(void)
 {
+	if (URCU_TLS(rcu_reader).quiescent)
+		rcu_thread_offline();
 	mutex_lock(&rcu_gp_lock);
+	merge_pending_readers();	/* In case we are still pending */
 	cds_list_del(&URCU_TLS(rcu_reader).node);
+	if (URCU_TLS(rcu_reader).quiescent) {
+		URCU_TLS(rcu_reader).quiescent = 0;
+		nr_quiescent_readers--;
+	} else {
+		cds_list_del(&URCU_TLS(rcu_reader).barrier_node);
+		URCU_TLS(rcu_reader).rseq_cpu_id = NULL;
+	}
+#ifdef CONFIG_RCU_READER_ARRAY
+	assert(!(*URCU_TLS(rcu_reader).ctr & RCU_GP_CTR_NEST_MASK));
+	rcu_registry_slot_free(registry, URCU_TLS(rcu_reader).ctr);
+	URCU_TLS(rcu_reader).ctr = NULL;
+#endif
+	mutex_unlock(&rcu_gp_lock);
+}
+
+/*
+ * Reader contexts are registered as quiescent-state readers, which the
+ * grace periods do not interrupt as they issue their own barriers, but
+ * start offline: their ctr is only set within read-side critical
+ * sections.
+ */
+struct rcu_reader_ctx *rcu_register_ctx(void)
+{
+	struct rcu_reader_ctx *ctx;
+	struct rcu_registry_shard *shard;
+
+	ctx = caa_cacheline_zalloc(sizeof(*ctx));
+	if (!ctx)
+		return NULL;
+	ctx->reader.tid = pthread_self();
+	ctx->reader.quiescent = 1;
+	mutex_lock(&rcu_gp_lock);
+	rcu_init_locked();	/* First registration initializes the library. */
+	shard = rcu_registry_local_shard(registry);
+#ifdef CONFIG_RCU_READER_ARRAY
+	ctx->reader.ctr = rcu_registry_slot_alloc(shard, &ctx->reader);
+	if (!ctx->reader.ctr) {
+		mutex_unlock(&rcu_gp_lock);
+		free(ctx);
+		return NULL;
+	}
+#endif
+	cds_list_add(&ctx->reader.node, &shard->head);
+	nr_quiescent_readers++;
+#if defined(RCU_MEMBARRIER) || defined(RCU_SIGNAL)
+	membarrier_cpu_register();
+#endif
 	mutex_unlock(&rcu_gp_lock);
+	return ctx;
+}
+
+void rcu_unregister_ctx(struct rcu_reader_ctx *ctx)
+{
+	assert(!_rcu_read_ongoing_ctx(ctx));
+	mutex_lock(&rcu_gp_lock);
+	cds_list_del(&ctx->reader.node);
+	nr_quiescent_readers--;
+#ifdef CONFIG_RCU_READER_ARRAY
+	rcu_registry_slot_free(registry, ctx->reader.ctr);
+#endif
+	mutex_unlock(&rcu_gp_lock);
+	free(ctx);
 }
 
 #ifdef RCU_MEMBARRIER
-void rcu_init(void)
+/* Called with rcu_gp_lock held. */
+static void rcu_init_locked(void)
 {
 	if (init_done)
 		return;
-	init_done = 1;
-	if (!membarrier(MEMBARRIER_EXPEDITED | MEMBARRIER_QUERY))
+	rcu_membarrier_mode = membarrier_detect(1);
+#ifdef RCU_READ_IFUNC
+	/* The read-side wrappers already rely on sys_membarrier. */
+	if (read_ifunc_membarrier && rcu_membarrier_mode == RCU_MEMBARRIER_NONE)
+		urcu_die(ENOSYS);
+#endif
+	if (rcu_membarrier_mode != RCU_MEMBARRIER_NONE)
 		rcu_has_sys_membarrier = 1;
+	CMM_STORE_SHARED(init_done, 1);
 }
 #endif
 
@@ -480,26 +1583,26 @@ static void sigrcu_handler(int signo, siginfo_t *siginfo, void *context)
 	 * executed on.
 	 */
 	cmm_smp_mb();
+	if (!_CMM_LOAD_SHARED(URCU_TLS(rcu_reader).need_mb))
+		return;		/* Already acknowledged. */
 	_CMM_STORE_SHARED(URCU_TLS(rcu_reader).need_mb, 0);
+	if (uatomic_add_return(&force_mb_pending, -1) == 0)
+		futex_async(&force_mb_pending, FUTEX_WAKE, 1,
+			NULL, NULL, 0);
 	cmm_smp_mb();
 }
 
 /*
- * rcu_init constructor. Called when the library is linked, but also when
- * reader threads are calling rcu_register_thread().
- * Should only be called by a single thread at a given time. This is ensured by
- * holing the rcu_gp_lock from rcu_register_thread() or by running at library
- * load time, which should not be executed by multiple threads nor concurrently
- * with rcu_register_thread() anyway.
+ * Install the SIGRCU handler. Called with rcu_gp_lock held, by the first
+ * reader registration or by rcu_init().
  */
-void rcu_init(void)
+static void rcu_init_locked(void)
 {
 	struct sigaction act;
 	int ret;
 
 	if (init_done)
 		return;
-	init_done = 1;
 
 	act.sa_sigaction = sigrcu_handler;
 	act.sa_flags = SA_SIGINFO | SA_RESTART;
@@ -507,6 +1610,14 @@ void rcu_init(void)
 	ret = sigaction(SIGRCU, &act, NULL);
 	if (ret)
 		urcu_die(errno);
+
+	/*
+	 * Readers only issue compiler barriers: sys_membarrier promotes
+	 * them to memory barriers without signaling each reader. The
+	 * shared command is slower than signaling the readers.
+	 */
+	rcu_membarrier_mode = membarrier_detect(0);
+	CMM_STORE_SHARED(init_done, 1);
 }
 
 void rcu_exit(void)
@@ -517,13 +1628,37 @@ void rcu_exit(void)
 	 * application exits.
 	 * Assertion disabled because call_rcu threads are now rcu
 	 * readers, and left running at exit.
-	 * assert(cds_list_empty(&registry));
+	 * assert(rcu_registry_empty(registry));
 	 */
 }
 
 #endif /* #ifdef RCU_SIGNAL */
 
+#if defined(RCU_MEMBARRIER) || defined(RCU_SIGNAL)
+/*
+ * The library is initialized by the first reader registration rather
+ * than by a constructor, so processes linking it without using RCU do
+ * not pay for the sys_membarrier detection nor the signal handler.
+ * Grace periods without registered readers do not need it.
+ */
+void rcu_init(void)
+{
+	if (rcu_init_done())
+		return;
+	mutex_lock(&rcu_gp_lock);
+	rcu_init_locked();
+	mutex_unlock(&rcu_gp_lock);
+}
+#endif
+
 DEFINE_RCU_FLAVOR(rcu_flavor);
 
 #include "urcu-call-rcu-impl.h"
 #include "urcu-defer-impl.h"
+
+/*
+ * Each reader scan increments rcu_gp_seq twice, and a grace period
+ * completes at the end of the second scan starting after the request.
+ */
+#define URCU_GP_SEQ_SNAP(seq)		(((seq) + 5) & ~1UL)
+#include "urcu-poll-impl.h"
@@ -75,14 +75,23 @@ extern "C" {
 #define rcu_read_lock_memb		_rcu_read_lock
 #define rcu_read_unlock_memb		_rcu_read_unlock
 #define rcu_read_ongoing_memb		_rcu_read_ongoing
+#define rcu_read_lock_ctx_memb		_rcu_read_lock_ctx
+#define rcu_read_unlock_ctx_memb		_rcu_read_unlock_ctx
+#define rcu_read_ongoing_ctx_memb		_rcu_read_ongoing_ctx
 #elif defined(RCU_SIGNAL)
 #define rcu_read_lock_sig		_rcu_read_lock
 #define rcu_read_unlock_sig		_rcu_read_unlock
 #define rcu_read_ongoing_sig		_rcu_read_ongoing
+#define rcu_read_lock_ctx_sig		_rcu_read_lock_ctx
+#define rcu_read_unlock_ctx_sig		_rcu_read_unlock_ctx
+#define rcu_read_ongoing_ctx_sig		_rcu_read_ongoing_ctx
 #elif defined(RCU_MB)
 #define rcu_read_lock_mb		_rcu_read_lock
 #define rcu_read_unlock_mb		_rcu_read_unlock
 #define rcu_read_ongoing_mb		_rcu_read_ongoing
+#define rcu_read_lock_ctx_mb		_rcu_read_lock_ctx
+#define rcu_read_unlock_ctx_mb		_rcu_read_unlock_ctx
+#define rcu_read_ongoing_ctx_mb		_rcu_read_ongoing_ctx
 #endif
 
 #else /* !_LGPL_SOURCE */
@@ -96,10 +105,38 @@ extern void rcu_read_lock(void);
 extern void rcu_read_unlock(void);
 extern int rcu_read_ongoing(void);
 
+struct rcu_reader_ctx;
+
+extern void rcu_read_lock_ctx(struct rcu_reader_ctx *ctx);
+extern void rcu_read_unlock_ctx(struct rcu_reader_ctx *ctx);
+extern int rcu_read_ongoing_ctx(struct rcu_reader_ctx *ctx);
+
 #endif /* !_LGPL_SOURCE */
 
 extern void synchronize_rcu(void);
 
+/*
+ * synchronize_rcu_expedited() waits for a grace period like
+ * synchronize_rcu(), busy-waiting on readers rather than sleeping.
+ * Lowers grace period latency at the expense of CPU time.
+ */
+extern void synchronize_rcu_expedited(void);
+
+/*
+ * Grace period batching statistics. synchronize_rcu() callers are
+ * batched, and batches are pipelined, so a single reader scan can
+ * complete the grace period of many callers.
+ */
+struct rcu_gp_batch_stats {
+	unsigned long nr_gp;			/* Batches completed */
+	unsigned long nr_waiters;		/* synchronize_rcu() calls served */
+	unsigned long nr_reader_scans;		/* Reader registry scans */
+	unsigned long last_batch_waiters;	/* Waiters in last batch */
+	unsigned long max_batch_waiters;	/* Waiters in largest batch */
+};
+
+extern void rcu_gp_get_batch_stats(struct rcu_gp_batch_stats *stats);
+
 /*
  * Reader thread registration.
  */
@@ -112,25 +149,73 @@ extern void rcu_unregister_thread(void);
 extern void rcu_init(void);
 
 /*
- * Q.S. reporting are no-ops for these URCU flavors.
+ * sys_membarrier command used by the grace periods to promote the
+ * read-side compiler barriers to memory barriers, as detected by
+ * rcu_init(). The private expedited command only interrupts the CPUs
+ * running threads of the process, whereas the shared command waits for
+ * a scheduler grace period. Without sys_membarrier, the urcu flavor
+ * falls back on read-side memory barriers and the urcu-signal flavor on
+ * signals. The urcu-mb flavor never uses sys_membarrier.
  */
-static inline void rcu_quiescent_state(void)
-{
-}
+enum rcu_membarrier_mode {
+	RCU_MEMBARRIER_NONE = 0,
+	RCU_MEMBARRIER_SHARED,
+	RCU_MEMBARRIER_PRIVATE_EXPEDITED,
+};
 
-static inline void rcu_thread_offline(void)
-{
-}
+extern enum rcu_membarrier_mode rcu_get_membarrier_mode(void);
 
-static inline void rcu_thread_online(void)
-{
-}
+/*
+ * Threads registered with rcu_register_thread_quiescent() rather than
+ * rcu_register_thread() report quiescent states like urcu-qsbr readers,
+ * so that synchronize_rcu() never needs to interrupt them, e.g. threads
+ * running alone on isolated (nohz_full) CPUs. Their read-side critical
+ * sections issue no memory barrier, and they must call
+ * rcu_quiescent_state() periodically, or be put offline with
+ * rcu_thread_offline() while they block. They must be online when they
+ * enter read-side critical sections or unregister.
+ *
+ * While such threads are registered, the grace periods of the flavors
+ * relying on sys_membarrier only interrupt the CPUs running the other
+ * readers, when the kernel supports targeting CPUs, and never signal
+ * them with the urcu-signal flavor.
+ *
+ * Q.S. reporting are no-ops for threads registered with
+ * rcu_register_thread().
+ */
+extern void rcu_register_thread_quiescent(void);
+extern void rcu_quiescent_state(void);
+extern void rcu_thread_offline(void);
+extern void rcu_thread_online(void);
+
+/*
+ * Reader contexts, for runtimes migrating read-side critical sections
+ * between threads, e.g. M:N fiber schedulers. rcu_register_ctx()
+ * returns a registered reader context, or NULL on allocation failure,
+ * which rcu_read_lock_ctx() and rcu_read_unlock_ctx() use instead of
+ * the reader state of the calling thread: a fiber holding a context
+ * can yield within a read-side critical section and resume it on
+ * another thread. Those threads need not be registered. The
+ * context read-side critical sections issue memory barriers, and the
+ * grace periods wait for them as for thread ones.
+ * rcu_unregister_ctx() frees a context, outside of read-side critical
+ * sections.
+ */
+extern struct rcu_reader_ctx *rcu_register_ctx(void);
+extern void rcu_unregister_ctx(struct rcu_reader_ctx *ctx);
 
 #ifdef __cplusplus 
 }
 #endif
 
 #include <urcu-call-rcu.h>
+#ifdef _LGPL_SOURCE
+#include <urcu/static/urcu-call-rcu.h>
+#endif
+#include <urcu-poll.h>
+#include <urcu-stall.h>
+#include <urcu-stats.h>
+#include <urcu-read-profile.h>
 #include <urcu-defer.h>
 #include <urcu-flavor.h>
 
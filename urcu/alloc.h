@@ -0,0 +1,122 @@
+#ifndef _URCU_ALLOC_H
+#define _URCU_ALLOC_H
+
+/*
+ * urcu/alloc.h
+ *
+ * Userspace RCU library - Allocator hooks of the library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+#include <urcu/compiler.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The memory the library allocates for its own structures is taken
+ * from a process-wide allocator, malloc() and posix_memalign() by
+ * default, which urcu_alloc_set_ops() can replace, e.g. to use NUMA
+ * local arenas or huge page pools. Allocations are tagged with the
+ * subsystem they are made for, and the bytes in use are accounted per
+ * subsystem, including the memory the subsystems map directly (which
+ * the allocator does not provide). Memory handed to the library by the
+ * application, e.g. nodes or call_rcu heads, is never allocated nor
+ * freed through the allocator.
+ */
+enum urcu_alloc_subsys {
+	URCU_ALLOC_CALL_RCU = 0,	/* call_rcu workers and batches */
+	URCU_ALLOC_DEFER,		/* defer_rcu queues */
+	URCU_ALLOC_LFQUEUE,		/* rculfqueue dummy nodes */
+	URCU_ALLOC_LFHT,		/* hash tables and bucket tables */
+	URCU_ALLOC_BP_ARENA,		/* urcu-bp reader registry (mapped) */
+	NR_URCU_ALLOC_SUBSYS,
+};
+
+struct urcu_alloc_ops {
+	/*
+	 * Return size bytes aligned on align, or NULL. align is 0 for
+	 * the alignment of malloc(), or a power of two multiple of
+	 * sizeof(void *).
+	 */
+	void *(*alloc)(size_t size, size_t align,
+			enum urcu_alloc_subsys subsys, void *priv);
+	/* Free memory returned by alloc for size bytes of subsys. */
+	void (*free)(void *ptr, size_t size,
+			enum urcu_alloc_subsys subsys, void *priv);
+	void *priv;
+};
+
+struct urcu_alloc_stats {
+	unsigned long bytes;		/* in use */
+	unsigned long nr_allocs;	/* through the allocator */
+	unsigned long nr_frees;
+};
+
+/*
+ * urcu_alloc_set_ops: use ops (kept by reference) for the following
+ * allocations, or the default allocator if ops is NULL. Meant to be
+ * called before the library allocates anything, e.g. before the first
+ * call_rcu(): return -EBUSY if memory allocated through the current
+ * allocator is still in use, 0 on success.
+ */
+extern int urcu_alloc_set_ops(const struct urcu_alloc_ops *ops);
+
+/*
+ * urcu_alloc: allocate size bytes for subsys, with the alignment of
+ * malloc(). Return NULL on allocation error.
+ * urcu_zalloc: same, with the memory zeroed.
+ * urcu_alloc_aligned: allocate size bytes aligned on align, a power of
+ * two multiple of sizeof(void *).
+ */
+extern void *urcu_alloc(enum urcu_alloc_subsys subsys, size_t size);
+extern void *urcu_zalloc(enum urcu_alloc_subsys subsys, size_t size);
+extern void *urcu_alloc_aligned(enum urcu_alloc_subsys subsys, size_t size,
+		size_t align);
+
+/*
+ * urcu_free: free memory allocated for subsys, with the size passed at
+ * allocation. NULL is ignored.
+ */
+extern void urcu_free(enum urcu_alloc_subsys subsys, void *ptr, size_t size);
+
+/*
+ * urcu_cacheline_zalloc: zeroed allocation for subsys aligned and
+ * padded as caa_cacheline_zalloc(). Release with urcu_cacheline_free()
+ * and the same size.
+ */
+extern void *urcu_cacheline_zalloc(enum urcu_alloc_subsys subsys,
+		size_t size);
+extern void urcu_cacheline_free(enum urcu_alloc_subsys subsys, void *ptr,
+		size_t size);
+
+/*
+ * urcu_alloc_account: account bytes (negative when released) that
+ * subsys maps without the allocator.
+ */
+extern void urcu_alloc_account(enum urcu_alloc_subsys subsys, long bytes);
+
+extern void urcu_alloc_get_stats(enum urcu_alloc_subsys subsys,
+		struct urcu_alloc_stats *stats);
+extern const char *urcu_alloc_subsys_name(enum urcu_alloc_subsys subsys);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_ALLOC_H */
@@ -29,17 +29,42 @@
 extern "C" {
 #endif 
 
-#ifdef CONFIG_RCU_ARM_HAVE_DMB
+#if defined(CONFIG_RCU_ARM_HAVE_DMB) && !defined(__aarch64__)
 #define cmm_mb()	__asm__ __volatile__ ("dmb":::"memory")
 #define cmm_rmb()	__asm__ __volatile__ ("dmb":::"memory")
 #define cmm_wmb()	__asm__ __volatile__ ("dmb":::"memory")
-#endif /* CONFIG_RCU_ARM_HAVE_DMB */
+#endif /* CONFIG_RCU_ARM_HAVE_DMB && !__aarch64__ */
 
 #include <stdlib.h>
 #include <sys/time.h>
 
 typedef unsigned long long cycles_t;
 
+#ifdef __aarch64__
+
+/* Virtual count of the generic timer, readable from user-space. */
+static inline cycles_t caa_get_cycles(void)
+{
+	cycles_t cval;
+
+	__asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (cval));
+	return cval;
+}
+
+/* isb keeps the counter read from being performed early. */
+static inline cycles_t __caa_get_cycles_ordered(void)
+{
+	cycles_t cval;
+
+	__asm__ __volatile__ ("isb; mrs %0, cntvct_el0; isb"
+		: "=r" (cval) : : "memory");
+	return cval;
+}
+
+#define caa_get_cycles_ordered()	__caa_get_cycles_ordered()
+
+#else /* #ifdef __aarch64__ */
+
 static inline cycles_t caa_get_cycles (void)
 {
 	cycles_t thetime;
@@ -51,6 +76,8 @@ static inline cycles_t caa_get_cycles (void)
 	return (cycles_t)thetime;
 }
 
+#endif /* #else #ifdef __aarch64__ */
+
 #ifdef __cplusplus 
 }
 #endif
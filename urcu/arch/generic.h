@@ -43,8 +43,12 @@ extern "C" {
  */
 
 #ifndef cmm_mb
+#ifdef CONFIG_RCU_USE_ATOMIC_BUILTINS
+#define cmm_mb()	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
 #define cmm_mb()    __sync_synchronize()
 #endif
+#endif
 
 #ifndef cmm_rmb
 #define cmm_rmb()	cmm_mb()
@@ -99,6 +103,23 @@ extern "C" {
 #define cmm_read_barrier_depends()
 #endif
 
+#ifdef CONFIG_RCU_USE_ATOMIC_BUILTINS
+/*
+ * Let the compiler emit the barriers between threads: the read and
+ * write barriers become acquire and release fences, which are cheaper
+ * than a full barrier on some architectures. The cmm_mb/cmm_rmb/cmm_wmb
+ * barriers of the architecture are kept for I/O ordering.
+ */
+#undef cmm_smp_mb
+#undef cmm_smp_rmb
+#undef cmm_smp_wmb
+#ifdef CONFIG_RCU_SMP
+#define cmm_smp_mb()	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define cmm_smp_rmb()	__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define cmm_smp_wmb()	__atomic_thread_fence(__ATOMIC_RELEASE)
+#endif
+#endif
+
 #ifdef CONFIG_RCU_SMP
 #ifndef cmm_smp_mb
 #define cmm_smp_mb()	cmm_mb()
@@ -149,6 +170,24 @@ extern "C" {
 #define caa_cpu_relax()		cmm_barrier()
 #endif
 
+/*
+ * caa_get_cycles_ordered: read the cycle counter after the prior
+ * instructions complete, and before the later ones start, for timing
+ * short sections of code. Architectures without a serializing read
+ * order the plain read with compiler barriers only.
+ */
+#ifndef caa_get_cycles_ordered
+#define caa_get_cycles_ordered()					\
+	__extension__ ({						\
+		cycles_t __cycles;					\
+									\
+		cmm_barrier();						\
+		__cycles = caa_get_cycles();				\
+		cmm_barrier();						\
+		__cycles;						\
+	})
+#endif
+
 #ifdef __cplusplus
 }
 #endif
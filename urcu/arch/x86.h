@@ -86,6 +86,23 @@ static inline cycles_t caa_get_cycles(void)
         return ret;
 }
 
+#ifdef CONFIG_RCU_HAVE_FENCE
+/*
+ * lfence waits for the prior instructions to complete before rdtsc
+ * reads the counter, and keeps the later ones from starting before.
+ */
+static inline cycles_t __caa_get_cycles_ordered(void)
+{
+	unsigned int __a, __d;
+
+	__asm__ __volatile__ ("lfence; rdtsc; lfence"
+		: "=a" (__a), "=d" (__d) : : "memory");
+	return ((cycles_t) __a) | (((cycles_t) __d) << 32);
+}
+
+#define caa_get_cycles_ordered()	__caa_get_cycles_ordered()
+#endif
+
 #ifdef __cplusplus 
 }
 #endif
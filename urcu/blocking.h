@@ -0,0 +1,90 @@
+#ifndef _URCU_BLOCKING_H
+#define _URCU_BLOCKING_H
+
+/*
+ * urcu/blocking.h
+ *
+ * Userspace RCU library - Quiescent states around blocking waits
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <urcu/compiler.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A thread blocked in a library wait (a contended wfcqueue dequeue
+ * mutex, cds_wfcq_wait_nonempty(), urcu_adaptative_busy_wait() or a
+ * compat futex wait) is in an extended quiescent state for flavors such
+ * as QSBR, where being online while sleeping delays all grace periods.
+ * A flavor may register, for the calling thread, operations taking it
+ * offline and back online: the library waits then call them around the
+ * blocking part of the wait. urcu-qsbr registers them for threads
+ * calling rcu_thread_set_auto_offline(1).
+ *
+ * offline() returns non-zero if the thread was online and went
+ * offline, in which case online() is called once the wait is over.
+ */
+struct urcu_blocking_ops {
+	int (*offline)(void);
+	void (*online)(void);
+};
+
+/*
+ * urcu_blocking_set_ops: set the operations of the calling thread, or
+ * clear them with NULL.
+ */
+extern void urcu_blocking_set_ops(const struct urcu_blocking_ops *ops);
+
+/*
+ * Called by the library waits. Weak references, so the inline waits do
+ * not require linking with liburcu-common: without it, no flavor can
+ * register operations anyway.
+ */
+#ifdef __ELF__
+extern int urcu_blocking_offline(void) __attribute__((weak));
+extern void urcu_blocking_online(void) __attribute__((weak));
+#else
+extern int urcu_blocking_offline(void);
+extern void urcu_blocking_online(void);
+#endif
+
+/*
+ * urcu_blocking_begin: start a blocking wait, and return the value to
+ * pass to urcu_blocking_end() when it is over.
+ */
+static inline
+int urcu_blocking_begin(void)
+{
+	if (!urcu_blocking_offline)
+		return 0;
+	return urcu_blocking_offline();
+}
+
+static inline
+void urcu_blocking_end(int was_online)
+{
+	if (was_online)
+		urcu_blocking_online();
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_BLOCKING_H */
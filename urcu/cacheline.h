@@ -0,0 +1,90 @@
+#ifndef _URCU_CACHELINE_H
+#define _URCU_CACHELINE_H
+
+/*
+ * urcu/cacheline.h
+ *
+ * Userspace RCU library - Run time cache line size and aligned allocation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CAA_CACHE_LINE_SIZE is chosen when building, and aligns the
+ * structures whose layout is part of the ABI. Memory allocated at run
+ * time can instead follow the cache line size of the host the program
+ * runs on, when it is larger.
+ */
+
+/*
+ * caa_cache_line_size: return the L1 data cache line size of the host,
+ * read from sysconf(_SC_LEVEL1_DCACHE_LINESIZE) or from sysfs, or
+ * CAA_CACHE_LINE_SIZE if neither reports a power of two.
+ */
+extern size_t caa_cache_line_size(void);
+
+/*
+ * caa_cacheline_align: alignment of the memory returned by
+ * caa_cacheline_alloc(), the largest of CAA_CACHE_LINE_SIZE and of the
+ * host cache line size.
+ */
+static inline
+size_t caa_cacheline_align(void)
+{
+	size_t size = caa_cache_line_size();
+
+	return size > CAA_CACHE_LINE_SIZE ? size : CAA_CACHE_LINE_SIZE;
+}
+
+/*
+ * caa_cacheline_stride: size rounded up to caa_cacheline_align(). Used
+ * as the stride of arrays whose elements must not share cache lines,
+ * e.g. per-CPU counters.
+ */
+static inline
+size_t caa_cacheline_stride(size_t size)
+{
+	size_t align = caa_cacheline_align();
+
+	return (size + align - 1) & ~(align - 1);
+}
+
+/*
+ * caa_cacheline_alloc: allocate size bytes aligned on
+ * caa_cacheline_align(), with the size rounded up to a multiple of the
+ * alignment so no other allocation shares the last cache line.
+ * Returns NULL on allocation error. Release with free().
+ */
+extern void *caa_cacheline_alloc(size_t size);
+
+/*
+ * caa_cacheline_zalloc: same as caa_cacheline_alloc(), with the
+ * memory zeroed.
+ */
+extern void *caa_cacheline_zalloc(size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_CACHELINE_H */
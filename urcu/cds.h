@@ -30,9 +30,21 @@
 #include <urcu/rculfqueue.h>
 #include <urcu/rculfstack.h>
 #include <urcu/rculfhash.h>
+#include <urcu/rculflist.h>
+#include <urcu/rcuskiplist.h>
+#include <urcu/rcuprioq.h>
+#include <urcu/rcuradix.h>
+#include <urcu/rcubtree.h>
+#include <urcu/rcuvec.h>
+#include <urcu/rcuhtable.h>
+#include <urcu/rcuswht.h>
+#include <urcu/wsdeque.h>
 #include <urcu/wfqueue.h>
 #include <urcu/wfcqueue.h>
+#include <urcu/wfcqlanes.h>
 #include <urcu/wfstack.h>
 #include <urcu/lfstack.h>
+#include <urcu/lfring.h>
+#include <urcu/spscring.h>
 
 #endif /* _URCU_CDS_H */
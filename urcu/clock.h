@@ -0,0 +1,60 @@
+#ifndef _URCU_CLOCK_H
+#define _URCU_CLOCK_H
+
+/*
+ * urcu/clock.h
+ *
+ * Userspace RCU library - Cycle counter calibrated in nanoseconds
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The unit of caa_get_cycles() depends on the architecture: CPU
+ * cycles (x86 rdtsc), timebase or generic timer ticks (PowerPC,
+ * AArch64), or microseconds when it falls back on gettimeofday(). The
+ * counter is calibrated against CLOCK_MONOTONIC on first use, during
+ * about 10 ms, to convert its values to nanoseconds.
+ */
+
+/*
+ * caa_cycles_to_ns: convert a difference of caa_get_cycles() values
+ * to nanoseconds. Returns 0 if the counter does not advance.
+ */
+extern uint64_t caa_cycles_to_ns(cycles_t cycles);
+
+/*
+ * caa_clock_ns: monotonic timestamp in nanoseconds. Read from the
+ * calibrated cycle counter with caa_get_cycles_ordered() when its
+ * resolution is finer than 100 ns, and from clock_gettime() with
+ * CLOCK_MONOTONIC otherwise. Timestamps of different threads are only
+ * comparable if the cycle counters of the CPUs are synchronized, as
+ * with the invariant TSC of recent x86 processors.
+ */
+extern uint64_t caa_clock_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_CLOCK_H */
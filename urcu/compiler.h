@@ -24,6 +24,9 @@
 #define caa_likely(x)	__builtin_expect(!!(x), 1)
 #define caa_unlikely(x)	__builtin_expect(!!(x), 0)
 
+/* Hint the CPU to fetch the cache line containing x for reading. */
+#define caa_prefetch(x)	__builtin_prefetch(x)
+
 #define	cmm_barrier()	__asm__ __volatile__ ("" : : : "memory")
 
 /*
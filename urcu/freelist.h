@@ -0,0 +1,111 @@
+#ifndef _URCU_FREELIST_H
+#define _URCU_FREELIST_H
+
+/*
+ * urcu/freelist.h
+ *
+ * Userspace RCU library - scalable free list over lock-free stacks
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Free list of objects, a magazine front-end of a depot of lock-free
+ * stacks. Each thread caches two magazines of objects, so that
+ * cds_freelist_get() and cds_freelist_put() only touch thread-local
+ * memory, without atomic operation, until both magazines are empty
+ * (respectively full). The thread then exchanges a whole magazine with
+ * the depot: a stack of non-empty magazines, and a stack of empty
+ * ones. Magazines are pushed with cds_lfs_push() and taken with
+ * __cds_lfs_pop_all(), which needs neither lock nor RCU (the rest of
+ * the stack is pushed back at once), so the depot does not serialize
+ * the threads on a lock either.
+ *
+ * Objects are opaque pointers: the free list never dereferences them,
+ * nor allocates them. Each free list uses one pthread key.
+ */
+
+/* Default number of objects per magazine. */
+#define CDS_FREELIST_MAGAZINE_SIZE	64
+
+struct cds_freelist;
+
+/*
+ * Depot statistics. Magazine counts are approximate while the free
+ * list is in use.
+ */
+struct cds_freelist_stats {
+	unsigned long nr_full;		/* non-empty magazines in the depot */
+	unsigned long nr_empty;		/* empty magazines in the depot */
+	unsigned long nr_magazines;	/* magazines allocated */
+	unsigned long nr_depot_get;	/* non-empty magazines taken */
+	unsigned long nr_depot_put;	/* non-empty magazines given */
+	unsigned long nr_depot_miss;	/* gets finding the depot empty */
+};
+
+/*
+ * cds_freelist_create - create an empty free list.
+ * @magazine_size: objects per magazine, 0 for
+ *                 CDS_FREELIST_MAGAZINE_SIZE.
+ *
+ * Return NULL on allocation error.
+ */
+extern struct cds_freelist *cds_freelist_create(unsigned int magazine_size);
+
+/*
+ * cds_freelist_destroy - destroy a free list.
+ * @free_obj: called for each object left in the free list, including
+ *            the magazines of the threads. Can be NULL.
+ * @priv: passed to free_obj.
+ *
+ * The free list must not be used concurrently nor afterwards.
+ */
+extern void cds_freelist_destroy(struct cds_freelist *fl,
+		void (*free_obj)(void *obj, void *priv), void *priv);
+
+/*
+ * cds_freelist_get - take an object from the free list.
+ *
+ * Return NULL if the magazines of the thread and the depot are empty.
+ */
+extern void *cds_freelist_get(struct cds_freelist *fl);
+
+/*
+ * cds_freelist_put - give an object to the free list.
+ *
+ * Return 0, or -ENOMEM if a magazine cannot be allocated, in which
+ * case the object is left to the caller.
+ */
+extern int cds_freelist_put(struct cds_freelist *fl, void *obj);
+
+/*
+ * cds_freelist_flush - give the magazines of the calling thread back
+ * to the depot, so other threads can take their objects. Done when the
+ * thread exits.
+ */
+extern void cds_freelist_flush(struct cds_freelist *fl);
+
+extern void cds_freelist_get_stats(struct cds_freelist *fl,
+		struct cds_freelist_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_FREELIST_H */
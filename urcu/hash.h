@@ -0,0 +1,280 @@
+#ifndef _URCU_HASH_H
+#define _URCU_HASH_H
+
+/*
+ * urcu/hash.h
+ *
+ * Userspace RCU library - hash functions for the hash tables
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <urcu/compiler.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define CDS_HASH_HAVE_HW_CRC32C	1
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CDS_HASH_HAVE_HW_CRC32C	1
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hash functions returning an unsigned long for cds_lfht and the other
+ * hash tables of the library.
+ *
+ * Split-ordered lists pick the bucket of a node from the low bits of
+ * its hash, but order the nodes of a bucket chain by the bit-reversed
+ * hash, and cds_lfht_shard_of() picks shards from the high bits: every
+ * bit of the result must therefore depend on every bit of the key,
+ * which all the functions below ensure, including on the upper half of
+ * a 64-bit unsigned long for the 32-bit CRC32C.
+ *
+ * Results depend on the endianness and word size, and must not be
+ * stored or exchanged between machines. None of these hashes is
+ * cryptographic: tables exposed to keys chosen by an attacker should
+ * use a secret, per-table seed.
+ */
+
+/* Fold a 64-bit hash into an unsigned long. */
+static inline
+unsigned long _cds_hash_fold(uint64_t h)
+{
+#if (CAA_BITS_PER_LONG == 32)
+	return (unsigned long) (h ^ (h >> 32));
+#else
+	return (unsigned long) h;
+#endif
+}
+
+/*
+ * cds_hash_u64 - hash a 64-bit integer.
+ *
+ * Finalizer of MurmurHash3: each bit of the key changes each bit of the
+ * result with a probability close to 1/2, for two multiplications.
+ */
+static inline
+unsigned long cds_hash_u64(uint64_t key, unsigned long seed)
+{
+	uint64_t h = key ^ (uint64_t) seed;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return _cds_hash_fold(h);
+}
+
+/*
+ * cds_hash_ptr - hash a pointer, e.g. the address of an object used as
+ * key.
+ */
+static inline
+unsigned long cds_hash_ptr(const void *ptr, unsigned long seed)
+{
+	return cds_hash_u64((uint64_t) (uintptr_t) ptr, seed);
+}
+
+#define _CDS_HASH_P0	0xa0761d6478bd642fULL
+#define _CDS_HASH_P1	0xe7037ed1a0b428dbULL
+#define _CDS_HASH_P2	0x8ebc6af09c88c6e3ULL
+#define _CDS_HASH_P3	0x589965cc75374cc3ULL
+
+/* 64x64 -> 128-bit multiplication, both halves of the result. */
+static inline
+void _cds_hash_mul128(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = (__uint128_t) *a * *b;
+
+	*a = (uint64_t) r;
+	*b = (uint64_t) (r >> 64);
+#else
+	uint64_t ha = *a >> 32, hb = *b >> 32;
+	uint64_t la = (uint32_t) *a, lb = (uint32_t) *b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+/* Multiply and fold: the mixing step of the byte hash. */
+static inline
+uint64_t _cds_hash_mum(uint64_t a, uint64_t b)
+{
+	_cds_hash_mul128(&a, &b);
+	return a ^ b;
+}
+
+static inline
+uint64_t _cds_hash_r64(const unsigned char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline
+uint64_t _cds_hash_r32(const unsigned char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/*
+ * cds_hash_bytes - hash a byte string.
+ * @key: the bytes to hash, with no alignment requirement.
+ * @len: number of bytes.
+ * @seed: seed of the hash.
+ *
+ * The wyhash construction: 16 bytes folded per 64x64 -> 128-bit
+ * multiplication, three independent lanes for keys longer than
+ * 48 bytes, and keys up to 16 bytes read with two to four possibly
+ * overlapping loads, without any byte loop.
+ */
+static inline
+unsigned long cds_hash_bytes(const void *key, size_t len, unsigned long seed)
+{
+	const unsigned char *p = (const unsigned char *) key;
+	uint64_t s = (uint64_t) seed, a, b;
+
+	s ^= _cds_hash_mum(s ^ _CDS_HASH_P0, _CDS_HASH_P1);
+	if (caa_likely(len <= 16)) {
+		if (caa_likely(len >= 4)) {
+			size_t off = (len >> 3) << 2;
+
+			a = (_cds_hash_r32(p) << 32) | _cds_hash_r32(p + off);
+			b = (_cds_hash_r32(p + len - 4) << 32)
+				| _cds_hash_r32(p + len - 4 - off);
+		} else if (caa_likely(len > 0)) {
+			a = ((uint64_t) p[0] << 16)
+				| ((uint64_t) p[len >> 1] << 8) | p[len - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t i = len;
+
+		if (caa_unlikely(i > 48)) {
+			uint64_t s1 = s, s2 = s;
+
+			do {
+				s = _cds_hash_mum(_cds_hash_r64(p) ^ _CDS_HASH_P1,
+					_cds_hash_r64(p + 8) ^ s);
+				s1 = _cds_hash_mum(_cds_hash_r64(p + 16) ^ _CDS_HASH_P2,
+					_cds_hash_r64(p + 24) ^ s1);
+				s2 = _cds_hash_mum(_cds_hash_r64(p + 32) ^ _CDS_HASH_P3,
+					_cds_hash_r64(p + 40) ^ s2);
+				p += 48;
+				i -= 48;
+			} while (caa_likely(i > 48));
+			s ^= s1 ^ s2;
+		}
+		while (caa_unlikely(i > 16)) {
+			s = _cds_hash_mum(_cds_hash_r64(p) ^ _CDS_HASH_P1,
+				_cds_hash_r64(p + 8) ^ s);
+			i -= 16;
+			p += 16;
+		}
+		/* Last 16 bytes, overlapping the previous ones. */
+		a = _cds_hash_r64(p + i - 16);
+		b = _cds_hash_r64(p + i - 8);
+	}
+	a ^= _CDS_HASH_P1;
+	b ^= s;
+	_cds_hash_mul128(&a, &b);
+	return _cds_hash_fold(_cds_hash_mum(a ^ _CDS_HASH_P0 ^ len,
+			b ^ _CDS_HASH_P1));
+}
+
+/*
+ * cds_crc32c - update a CRC32C (Castagnoli) checksum.
+ * @crc: checksum of the previous bytes, or 0.
+ *
+ * Uses the CRC32 instructions of SSE4.2 or ARMv8 when the build enables
+ * them (CDS_HASH_HAVE_HW_CRC32C is then defined, e.g. with
+ * -msse4.2 or -march=armv8-a+crc), 8 bytes per instruction, and a bit
+ * by bit loop otherwise, which is much slower than cds_hash_bytes().
+ */
+static inline
+uint32_t cds_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char *) buf;
+
+	crc = ~crc;
+#if defined(__SSE4_2__)
+# if (CAA_BITS_PER_LONG == 64)
+	for (; len >= 8; len -= 8, p += 8)
+		crc = (uint32_t) _mm_crc32_u64(crc, _cds_hash_r64(p));
+# endif
+	for (; len >= 4; len -= 4, p += 4)
+		crc = _mm_crc32_u32(crc, (uint32_t) _cds_hash_r32(p));
+	for (; len; len--, p++)
+		crc = _mm_crc32_u8(crc, *p);
+#elif defined(__ARM_FEATURE_CRC32)
+	for (; len >= 8; len -= 8, p += 8)
+		crc = __crc32cd(crc, _cds_hash_r64(p));
+	for (; len; len--, p++)
+		crc = __crc32cb(crc, *p);
+#else
+	for (; len; len--, p++) {
+		int k;
+
+		crc ^= *p;
+		for (k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0x82f63b78U & -(crc & 1));
+	}
+#endif
+	return ~crc;
+}
+
+/*
+ * cds_hash_crc32c - hash a byte string with CRC32C.
+ *
+ * Faster than cds_hash_bytes() on short keys with hardware CRC32C, but
+ * of weaker quality: only 32 bits, spread over the unsigned long by a
+ * multiplication for the bit-reversed ordering and the shards.
+ */
+static inline
+unsigned long cds_hash_crc32c(const void *key, size_t len, unsigned long seed)
+{
+	uint64_t h = cds_crc32c((uint32_t) seed, key, len);
+
+	/* Upper bits from all bits of the CRC, lower bits kept as is. */
+	h = (h * 0x9e3779b97f4a7c15ULL) ^ h;
+	return _cds_hash_fold(h);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_HASH_H */
@@ -0,0 +1,127 @@
+#ifndef _URCU_LFRING_H
+#define _URCU_LFRING_H
+
+/*
+ * lfring.h
+ *
+ * Userspace RCU library - Bounded Lock-Free MPMC Ring Buffer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdbool.h>
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bounded lock-free multi-producer/multi-consumer ring buffer.
+ *
+ * Fixed-size array of cells, each carrying a sequence number which
+ * tells producers and consumers whether the cell is free for the
+ * current lap of the ring (Dmitry Vyukov's bounded MPMC queue).
+ * Enqueue and dequeue each perform a single compare-and-swap on their
+ * own position counter, and do not require per-item nodes: the ring
+ * stores user pointers directly. NULL pointers cannot be enqueued.
+ *
+ * cds_lfring_enqueue and cds_lfring_dequeue can be called concurrently
+ * from any number of threads without external synchronization. The
+ * ring is FIFO: items are dequeued in the order their enqueue claimed
+ * a position. The ring is lock-free but not wait-free: a producer or
+ * consumer preempted between claiming a position and publishing its
+ * cell delays consumers (respectively producers) of that cell only.
+ */
+
+struct cds_lfring_cell {
+	unsigned long seq;
+	void *data;
+};
+
+struct cds_lfring {
+	/* Producer and consumer positions on separate cache lines. */
+	unsigned long enqueue_pos __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+	unsigned long dequeue_pos __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+	unsigned long mask __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+	struct cds_lfring_cell *cells;
+};
+
+#ifdef _LGPL_SOURCE
+
+#include <urcu/static/lfring.h>
+
+#define cds_lfring_init			_cds_lfring_init
+#define cds_lfring_destroy		_cds_lfring_destroy
+#define cds_lfring_enqueue		_cds_lfring_enqueue
+#define cds_lfring_dequeue		_cds_lfring_dequeue
+#define cds_lfring_empty		_cds_lfring_empty
+#define cds_lfring_size			_cds_lfring_size
+
+#else /* !_LGPL_SOURCE */
+
+/*
+ * cds_lfring_init: allocate the cells of a ring able to hold "size"
+ * items. "size" must be a power of two, at least 2.
+ *
+ * Returns 0 on success, -EINVAL if size is invalid, -ENOMEM if the
+ * cells cannot be allocated.
+ */
+extern int cds_lfring_init(struct cds_lfring *ring, unsigned long size);
+
+/*
+ * cds_lfring_destroy: free the cells of a ring. Items still present in
+ * the ring are not freed. No concurrent access is allowed.
+ */
+extern void cds_lfring_destroy(struct cds_lfring *ring);
+
+/*
+ * cds_lfring_enqueue: enqueue a non-NULL pointer into the ring.
+ *
+ * Returns true on success, false if the ring is full. Stores to the
+ * item performed before enqueue are visible to the thread dequeuing
+ * it. No mutual exclusion is required.
+ */
+extern bool cds_lfring_enqueue(struct cds_lfring *ring, void *data);
+
+/*
+ * cds_lfring_dequeue: dequeue a pointer from the ring.
+ *
+ * Returns the oldest pointer, or NULL if the ring is empty. No mutual
+ * exclusion is required.
+ */
+extern void *cds_lfring_dequeue(struct cds_lfring *ring);
+
+/*
+ * cds_lfring_empty: return whether the ring appears empty.
+ *
+ * The result is only a snapshot when producers or consumers run
+ * concurrently. No memory barrier is issued.
+ */
+extern bool cds_lfring_empty(struct cds_lfring *ring);
+
+/*
+ * cds_lfring_size: return the number of cells of the ring.
+ */
+extern unsigned long cds_lfring_size(struct cds_lfring *ring);
+
+#endif /* !_LGPL_SOURCE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_LFRING_H */
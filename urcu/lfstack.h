@@ -29,6 +29,7 @@ extern "C" {
 
 #include <stdbool.h>
 #include <pthread.h>
+#include <urcu/uatomic.h>
 
 /*
  * Lock-free stack.
@@ -89,12 +90,27 @@ typedef union __attribute__((__transparent_union__)) {
 	struct cds_lfs_stack *s;
 } cds_lfs_stack_ptr_t;
 
+#ifdef UATOMIC_HAS_CMPXCHG_DOUBLE
+/*
+ * Tagged lock-free stack, available on architectures providing
+ * uatomic_cmpxchg_double(). The tag is incremented by each pop and
+ * pop_all, and compared together with the head pointer, which protects
+ * cds_lfs_tagged_pop() against ABA without any lock nor RCU read-side
+ * critical section.
+ */
+struct cds_lfs_tagged_stack {
+	struct cds_lfs_head *head;
+	unsigned long tag;
+} __attribute__((aligned(2 * sizeof(unsigned long))));
+#endif
+
 #ifdef _LGPL_SOURCE
 
 #include <urcu/static/lfstack.h>
 
 #define cds_lfs_node_init		_cds_lfs_node_init
 #define cds_lfs_init			_cds_lfs_init
+#define __cds_lfs_init			___cds_lfs_init
 #define cds_lfs_empty			_cds_lfs_empty
 #define cds_lfs_push			_cds_lfs_push
 
@@ -110,6 +126,15 @@ typedef union __attribute__((__transparent_union__)) {
 #define __cds_lfs_pop			___cds_lfs_pop
 #define __cds_lfs_pop_all		___cds_lfs_pop_all
 
+#ifdef UATOMIC_HAS_CMPXCHG_DOUBLE
+/* Tagged stack: no synchronization required. */
+#define cds_lfs_tagged_init		_cds_lfs_tagged_init
+#define cds_lfs_tagged_empty		_cds_lfs_tagged_empty
+#define cds_lfs_tagged_push		_cds_lfs_tagged_push
+#define cds_lfs_tagged_pop		_cds_lfs_tagged_pop
+#define cds_lfs_tagged_pop_all		_cds_lfs_tagged_pop_all
+#endif
+
 #else /* !_LGPL_SOURCE */
 
 /*
@@ -206,6 +231,51 @@ extern struct cds_lfs_node *__cds_lfs_pop(cds_lfs_stack_ptr_t s);
  */
 extern struct cds_lfs_head *__cds_lfs_pop_all(cds_lfs_stack_ptr_t s);
 
+#ifdef UATOMIC_HAS_CMPXCHG_DOUBLE
+/*
+ * cds_lfs_tagged_init: initialize tagged lock-free stack.
+ */
+extern void cds_lfs_tagged_init(struct cds_lfs_tagged_stack *s);
+
+/*
+ * cds_lfs_tagged_empty: return whether tagged lock-free stack is empty.
+ *
+ * No memory barrier is issued. No mutual exclusion is required.
+ */
+extern bool cds_lfs_tagged_empty(struct cds_lfs_tagged_stack *s);
+
+/*
+ * cds_lfs_tagged_push: push a node into the tagged stack.
+ *
+ * Does not require any synchronization with other push nor pop.
+ *
+ * Returns 0 if the stack was empty prior to adding the node.
+ * Returns non-zero otherwise.
+ */
+extern bool cds_lfs_tagged_push(struct cds_lfs_tagged_stack *s,
+			struct cds_lfs_node *node);
+
+/*
+ * cds_lfs_tagged_pop: pop a node from the tagged stack.
+ *
+ * Returns NULL if stack is empty. Does not require any synchronization
+ * with other push, pop nor pop_all: neither mutex nor RCU read-side
+ * critical section. The memory of popped nodes may still be read by
+ * concurrent poppers, so it must stay mapped and must not be reused
+ * for anything but a cds_lfs_node while the stack is in use (e.g.
+ * nodes of a freelist).
+ */
+extern struct cds_lfs_node *cds_lfs_tagged_pop(struct cds_lfs_tagged_stack *s);
+
+/*
+ * cds_lfs_tagged_pop_all: pop all nodes from the tagged stack.
+ *
+ * Does not require any synchronization with other push, pop nor
+ * pop_all.
+ */
+extern struct cds_lfs_head *cds_lfs_tagged_pop_all(struct cds_lfs_tagged_stack *s);
+#endif
+
 #endif /* !_LGPL_SOURCE */
 
 /*
@@ -45,6 +45,14 @@
 #define rcu_init			rcu_init_bp
 #define rcu_exit			rcu_exit_bp
 #define synchronize_rcu			synchronize_rcu_bp
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_bp
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_bp
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_bp
+#define start_poll_synchronize_rcu_notify	start_poll_synchronize_rcu_notify_bp
+#define synchronize_rcu_timeout		synchronize_rcu_timeout_bp
+#define rcu_set_stall_detector		rcu_set_stall_detector_bp
+#define rcu_get_stats			rcu_get_stats_bp
+#define rcu_get_lock_stats		rcu_get_lock_stats_bp
 #define rcu_reader			rcu_reader_bp
 #define rcu_gp				rcu_gp_bp
 
@@ -57,13 +65,41 @@
 #define get_thread_call_rcu_data	get_thread_call_rcu_data_bp
 #define set_thread_call_rcu_data	set_thread_call_rcu_data_bp
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_bp
+#define create_all_node_call_rcu_data	create_all_node_call_rcu_data_bp
+#define create_all_llc_call_rcu_data	create_all_llc_call_rcu_data_bp
 #define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_bp
 #define call_rcu			call_rcu_bp
+#define call_rcu_expedited		call_rcu_expedited_bp
 #define call_rcu_data_free		call_rcu_data_free_bp
+#define call_rcu_data_set_high_watermark \
+		call_rcu_data_set_high_watermark_bp
+#define call_rcu_data_set_qlen_limit	call_rcu_data_set_qlen_limit_bp
+#define call_rcu_data_set_rt_delay	call_rcu_data_set_rt_delay_bp
+#define call_rcu_memory_pressure	call_rcu_memory_pressure_bp
+#define call_rcu_set_memory_pressure_qlen	call_rcu_set_memory_pressure_qlen_bp
+#define call_rcu_memory_pressure_monitor_start	call_rcu_memory_pressure_monitor_start_bp
+#define call_rcu_memory_pressure_monitor_stop	call_rcu_memory_pressure_monitor_stop_bp
+#define call_rcu_data_get_stats		call_rcu_data_get_stats_bp
+#define call_rcu_data_create_pool	call_rcu_data_create_pool_bp
+#define call_rcu_data_poll		call_rcu_data_poll_bp
+#define call_rcu_data_queue_work		call_rcu_data_queue_work_bp
+#define call_rcu_typed_queue_create		call_rcu_typed_queue_create_bp
+#define call_rcu_typed_queue_destroy		call_rcu_typed_queue_destroy_bp
+#define call_rcu_typed		call_rcu_typed_bp
+#define call_rcu_typed_barrier		call_rcu_typed_barrier_bp
+#define call_rcu_set_local_batch	call_rcu_set_local_batch_bp
+#define call_rcu_local_flush		call_rcu_local_flush_bp
+#define call_rcu_cache			call_rcu_cache_bp
+#define call_rcu_cache_queued		call_rcu_cache_queued_bp
+#define free_rcu			free_rcu_bp
+#define free_rcu_flush			free_rcu_flush_bp
 #define call_rcu_before_fork		call_rcu_before_fork_bp
 #define call_rcu_after_fork_parent	call_rcu_after_fork_parent_bp
 #define call_rcu_after_fork_child	call_rcu_after_fork_child_bp
 #define rcu_barrier			rcu_barrier_bp
+#define rcu_barrier_timeout		rcu_barrier_timeout_bp
+#define call_rcu_data_barrier		call_rcu_data_barrier_bp
+#define rcu_barrier_thread		rcu_barrier_thread_bp
 
 #define defer_rcu			defer_rcu_bp
 #define rcu_defer_register_thread	rcu_defer_register_thread_bp
@@ -77,4 +113,6 @@
 #define rcu_yield_active		rcu_yield_active_bp
 #define rcu_rand_yield			rcu_rand_yield_bp
 
+#define rcu_has_sys_membarrier		rcu_has_sys_membarrier_bp
+
 #endif /* _URCU_BP_MAP_H */
@@ -42,12 +42,23 @@
 #define _rcu_read_ongoing		_rcu_read_ongoing_qsbr
 #define rcu_quiescent_state		rcu_quiescent_state_qsbr
 #define _rcu_quiescent_state		_rcu_quiescent_state_qsbr
+#define rcu_quiescent_state_maybe	rcu_quiescent_state_maybe_qsbr
+#define _rcu_quiescent_state_maybe	_rcu_quiescent_state_maybe_qsbr
 #define rcu_thread_offline		rcu_thread_offline_qsbr
 #define rcu_thread_online		rcu_thread_online_qsbr
+#define rcu_thread_set_auto_offline	rcu_thread_set_auto_offline_qsbr
 #define rcu_register_thread		rcu_register_thread_qsbr
 #define rcu_unregister_thread		rcu_unregister_thread_qsbr
 #define rcu_exit			rcu_exit_qsbr
 #define synchronize_rcu			synchronize_rcu_qsbr
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_qsbr
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_qsbr
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_qsbr
+#define start_poll_synchronize_rcu_notify	start_poll_synchronize_rcu_notify_qsbr
+#define synchronize_rcu_timeout		synchronize_rcu_timeout_qsbr
+#define rcu_set_stall_detector		rcu_set_stall_detector_qsbr
+#define rcu_get_stats			rcu_get_stats_qsbr
+#define rcu_get_lock_stats		rcu_get_lock_stats_qsbr
 #define rcu_reader			rcu_reader_qsbr
 #define rcu_gp				rcu_gp_qsbr
 
@@ -60,12 +71,40 @@
 #define get_thread_call_rcu_data	get_thread_call_rcu_data_qsbr
 #define set_thread_call_rcu_data	set_thread_call_rcu_data_qsbr
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_qsbr
+#define create_all_node_call_rcu_data	create_all_node_call_rcu_data_qsbr
+#define create_all_llc_call_rcu_data	create_all_llc_call_rcu_data_qsbr
 #define call_rcu			call_rcu_qsbr
+#define call_rcu_expedited		call_rcu_expedited_qsbr
 #define call_rcu_data_free		call_rcu_data_free_qsbr
+#define call_rcu_data_set_high_watermark \
+		call_rcu_data_set_high_watermark_qsbr
+#define call_rcu_data_set_qlen_limit	call_rcu_data_set_qlen_limit_qsbr
+#define call_rcu_data_set_rt_delay	call_rcu_data_set_rt_delay_qsbr
+#define call_rcu_memory_pressure	call_rcu_memory_pressure_qsbr
+#define call_rcu_set_memory_pressure_qlen	call_rcu_set_memory_pressure_qlen_qsbr
+#define call_rcu_memory_pressure_monitor_start	call_rcu_memory_pressure_monitor_start_qsbr
+#define call_rcu_memory_pressure_monitor_stop	call_rcu_memory_pressure_monitor_stop_qsbr
+#define call_rcu_data_get_stats		call_rcu_data_get_stats_qsbr
+#define call_rcu_data_create_pool	call_rcu_data_create_pool_qsbr
+#define call_rcu_data_poll		call_rcu_data_poll_qsbr
+#define call_rcu_data_queue_work		call_rcu_data_queue_work_qsbr
+#define call_rcu_typed_queue_create		call_rcu_typed_queue_create_qsbr
+#define call_rcu_typed_queue_destroy		call_rcu_typed_queue_destroy_qsbr
+#define call_rcu_typed		call_rcu_typed_qsbr
+#define call_rcu_typed_barrier		call_rcu_typed_barrier_qsbr
+#define call_rcu_set_local_batch	call_rcu_set_local_batch_qsbr
+#define call_rcu_local_flush		call_rcu_local_flush_qsbr
+#define call_rcu_cache			call_rcu_cache_qsbr
+#define call_rcu_cache_queued		call_rcu_cache_queued_qsbr
+#define free_rcu			free_rcu_qsbr
+#define free_rcu_flush			free_rcu_flush_qsbr
 #define call_rcu_before_fork		call_rcu_before_fork_qsbr
 #define call_rcu_after_fork_parent	call_rcu_after_fork_parent_qsbr
 #define call_rcu_after_fork_child	call_rcu_after_fork_child_qsbr
 #define rcu_barrier			rcu_barrier_qsbr
+#define rcu_barrier_timeout		rcu_barrier_timeout_qsbr
+#define call_rcu_data_barrier		call_rcu_data_barrier_qsbr
+#define rcu_barrier_thread		rcu_barrier_thread_qsbr
 
 #define defer_rcu			defer_rcu_qsbr
 #define rcu_defer_register_thread	rcu_defer_register_thread_qsbr
@@ -76,4 +115,7 @@
 
 #define rcu_flavor			rcu_flavor_qsbr
 
+#define rcu_has_sys_membarrier		rcu_has_sys_membarrier_qsbr
+#define rcu_qs_report			rcu_qs_report_qsbr
+
 #endif /* _URCU_QSBR_MAP_H */
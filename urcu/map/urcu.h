@@ -48,9 +48,35 @@
 #define _rcu_read_ongoing		_rcu_read_ongoing_memb
 #define rcu_register_thread		rcu_register_thread_memb
 #define rcu_unregister_thread		rcu_unregister_thread_memb
+#define rcu_register_thread_quiescent	rcu_register_thread_quiescent_memb
+#define rcu_quiescent_state		rcu_quiescent_state_memb
+#define rcu_thread_offline		rcu_thread_offline_memb
+#define rcu_thread_online		rcu_thread_online_memb
+#define rcu_read_lock_ctx		rcu_read_lock_ctx_memb
+#define _rcu_read_lock_ctx		_rcu_read_lock_ctx_memb
+#define rcu_read_unlock_ctx		rcu_read_unlock_ctx_memb
+#define _rcu_read_unlock_ctx		_rcu_read_unlock_ctx_memb
+#define rcu_read_ongoing_ctx		rcu_read_ongoing_ctx_memb
+#define _rcu_read_ongoing_ctx		_rcu_read_ongoing_ctx_memb
+#define rcu_register_ctx		rcu_register_ctx_memb
+#define rcu_unregister_ctx		rcu_unregister_ctx_memb
 #define rcu_init			rcu_init_memb
 #define rcu_exit			rcu_exit_memb
 #define synchronize_rcu			synchronize_rcu_memb
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_memb
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_memb
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_memb
+#define start_poll_synchronize_rcu_notify	start_poll_synchronize_rcu_notify_memb
+#define synchronize_rcu_timeout		synchronize_rcu_timeout_memb
+#define rcu_set_stall_detector		rcu_set_stall_detector_memb
+#define rcu_get_stats			rcu_get_stats_memb
+#define rcu_get_lock_stats		rcu_get_lock_stats_memb
+#define rcu_set_read_profile		rcu_set_read_profile_memb
+#define rcu_read_profile_for_each	rcu_read_profile_for_each_memb
+#define rcu_read_profile_start		rcu_read_profile_start_memb
+#define rcu_read_profile_record		rcu_read_profile_record_memb
+#define rcu_gp_get_batch_stats		rcu_gp_get_batch_stats_memb
+#define rcu_get_membarrier_mode		rcu_get_membarrier_mode_memb
 #define rcu_reader			rcu_reader_memb
 #define rcu_gp				rcu_gp_memb
 
@@ -63,13 +89,41 @@
 #define get_thread_call_rcu_data	get_thread_call_rcu_data_memb
 #define set_thread_call_rcu_data	set_thread_call_rcu_data_memb
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_memb
+#define create_all_node_call_rcu_data	create_all_node_call_rcu_data_memb
+#define create_all_llc_call_rcu_data	create_all_llc_call_rcu_data_memb
 #define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_memb
 #define call_rcu			call_rcu_memb
+#define call_rcu_expedited		call_rcu_expedited_memb
 #define call_rcu_data_free		call_rcu_data_free_memb
+#define call_rcu_data_set_high_watermark \
+		call_rcu_data_set_high_watermark_memb
+#define call_rcu_data_set_qlen_limit	call_rcu_data_set_qlen_limit_memb
+#define call_rcu_data_set_rt_delay	call_rcu_data_set_rt_delay_memb
+#define call_rcu_memory_pressure	call_rcu_memory_pressure_memb
+#define call_rcu_set_memory_pressure_qlen	call_rcu_set_memory_pressure_qlen_memb
+#define call_rcu_memory_pressure_monitor_start	call_rcu_memory_pressure_monitor_start_memb
+#define call_rcu_memory_pressure_monitor_stop	call_rcu_memory_pressure_monitor_stop_memb
+#define call_rcu_data_get_stats		call_rcu_data_get_stats_memb
+#define call_rcu_data_create_pool	call_rcu_data_create_pool_memb
+#define call_rcu_data_poll		call_rcu_data_poll_memb
+#define call_rcu_data_queue_work		call_rcu_data_queue_work_memb
+#define call_rcu_typed_queue_create		call_rcu_typed_queue_create_memb
+#define call_rcu_typed_queue_destroy		call_rcu_typed_queue_destroy_memb
+#define call_rcu_typed		call_rcu_typed_memb
+#define call_rcu_typed_barrier		call_rcu_typed_barrier_memb
+#define call_rcu_set_local_batch	call_rcu_set_local_batch_memb
+#define call_rcu_local_flush		call_rcu_local_flush_memb
+#define call_rcu_cache			call_rcu_cache_memb
+#define call_rcu_cache_queued		call_rcu_cache_queued_memb
+#define free_rcu			free_rcu_memb
+#define free_rcu_flush			free_rcu_flush_memb
 #define call_rcu_before_fork		call_rcu_before_fork_memb
 #define call_rcu_after_fork_parent	call_rcu_after_fork_parent_memb
 #define call_rcu_after_fork_child	call_rcu_after_fork_child_memb
 #define rcu_barrier			rcu_barrier_memb
+#define rcu_barrier_timeout		rcu_barrier_timeout_memb
+#define call_rcu_data_barrier		call_rcu_data_barrier_memb
+#define rcu_barrier_thread		rcu_barrier_thread_memb
 
 #define defer_rcu			defer_rcu_memb
 #define rcu_defer_register_thread	rcu_defer_register_thread_memb
@@ -93,9 +147,35 @@
 #define _rcu_read_ongoing		_rcu_read_ongoing_sig
 #define rcu_register_thread		rcu_register_thread_sig
 #define rcu_unregister_thread		rcu_unregister_thread_sig
+#define rcu_register_thread_quiescent	rcu_register_thread_quiescent_sig
+#define rcu_quiescent_state		rcu_quiescent_state_sig
+#define rcu_thread_offline		rcu_thread_offline_sig
+#define rcu_thread_online		rcu_thread_online_sig
+#define rcu_read_lock_ctx		rcu_read_lock_ctx_sig
+#define _rcu_read_lock_ctx		_rcu_read_lock_ctx_sig
+#define rcu_read_unlock_ctx		rcu_read_unlock_ctx_sig
+#define _rcu_read_unlock_ctx		_rcu_read_unlock_ctx_sig
+#define rcu_read_ongoing_ctx		rcu_read_ongoing_ctx_sig
+#define _rcu_read_ongoing_ctx		_rcu_read_ongoing_ctx_sig
+#define rcu_register_ctx		rcu_register_ctx_sig
+#define rcu_unregister_ctx		rcu_unregister_ctx_sig
 #define rcu_init			rcu_init_sig
 #define rcu_exit			rcu_exit_sig
 #define synchronize_rcu			synchronize_rcu_sig
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_sig
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_sig
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_sig
+#define start_poll_synchronize_rcu_notify	start_poll_synchronize_rcu_notify_sig
+#define synchronize_rcu_timeout		synchronize_rcu_timeout_sig
+#define rcu_set_stall_detector		rcu_set_stall_detector_sig
+#define rcu_get_stats			rcu_get_stats_sig
+#define rcu_get_lock_stats		rcu_get_lock_stats_sig
+#define rcu_set_read_profile		rcu_set_read_profile_sig
+#define rcu_read_profile_for_each	rcu_read_profile_for_each_sig
+#define rcu_read_profile_start		rcu_read_profile_start_sig
+#define rcu_read_profile_record		rcu_read_profile_record_sig
+#define rcu_gp_get_batch_stats		rcu_gp_get_batch_stats_sig
+#define rcu_get_membarrier_mode		rcu_get_membarrier_mode_sig
 #define rcu_reader			rcu_reader_sig
 #define rcu_gp				rcu_gp_sig
 
@@ -108,13 +188,41 @@
 #define get_thread_call_rcu_data	get_thread_call_rcu_data_sig
 #define set_thread_call_rcu_data	set_thread_call_rcu_data_sig
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_sig
+#define create_all_node_call_rcu_data	create_all_node_call_rcu_data_sig
+#define create_all_llc_call_rcu_data	create_all_llc_call_rcu_data_sig
 #define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_sig
 #define call_rcu			call_rcu_sig
+#define call_rcu_expedited		call_rcu_expedited_sig
 #define call_rcu_data_free		call_rcu_data_free_sig
+#define call_rcu_data_set_high_watermark \
+		call_rcu_data_set_high_watermark_sig
+#define call_rcu_data_set_qlen_limit	call_rcu_data_set_qlen_limit_sig
+#define call_rcu_data_set_rt_delay	call_rcu_data_set_rt_delay_sig
+#define call_rcu_memory_pressure	call_rcu_memory_pressure_sig
+#define call_rcu_set_memory_pressure_qlen	call_rcu_set_memory_pressure_qlen_sig
+#define call_rcu_memory_pressure_monitor_start	call_rcu_memory_pressure_monitor_start_sig
+#define call_rcu_memory_pressure_monitor_stop	call_rcu_memory_pressure_monitor_stop_sig
+#define call_rcu_data_get_stats		call_rcu_data_get_stats_sig
+#define call_rcu_data_create_pool	call_rcu_data_create_pool_sig
+#define call_rcu_data_poll		call_rcu_data_poll_sig
+#define call_rcu_data_queue_work		call_rcu_data_queue_work_sig
+#define call_rcu_typed_queue_create		call_rcu_typed_queue_create_sig
+#define call_rcu_typed_queue_destroy		call_rcu_typed_queue_destroy_sig
+#define call_rcu_typed		call_rcu_typed_sig
+#define call_rcu_typed_barrier		call_rcu_typed_barrier_sig
+#define call_rcu_set_local_batch	call_rcu_set_local_batch_sig
+#define call_rcu_local_flush		call_rcu_local_flush_sig
+#define call_rcu_cache			call_rcu_cache_sig
+#define call_rcu_cache_queued		call_rcu_cache_queued_sig
+#define free_rcu			free_rcu_sig
+#define free_rcu_flush			free_rcu_flush_sig
 #define call_rcu_before_fork		call_rcu_before_fork_sig
 #define call_rcu_after_fork_parent	call_rcu_after_fork_parent_sig
 #define call_rcu_after_fork_child	call_rcu_after_fork_child_sig
 #define rcu_barrier			rcu_barrier_sig
+#define rcu_barrier_timeout		rcu_barrier_timeout_sig
+#define call_rcu_data_barrier		call_rcu_data_barrier_sig
+#define rcu_barrier_thread		rcu_barrier_thread_sig
 
 #define defer_rcu			defer_rcu_sig
 #define rcu_defer_register_thread	rcu_defer_register_thread_sig
@@ -135,9 +243,35 @@
 #define _rcu_read_ongoing		_rcu_read_ongoing_mb
 #define rcu_register_thread		rcu_register_thread_mb
 #define rcu_unregister_thread		rcu_unregister_thread_mb
+#define rcu_register_thread_quiescent	rcu_register_thread_quiescent_mb
+#define rcu_quiescent_state		rcu_quiescent_state_mb
+#define rcu_thread_offline		rcu_thread_offline_mb
+#define rcu_thread_online		rcu_thread_online_mb
+#define rcu_read_lock_ctx		rcu_read_lock_ctx_mb
+#define _rcu_read_lock_ctx		_rcu_read_lock_ctx_mb
+#define rcu_read_unlock_ctx		rcu_read_unlock_ctx_mb
+#define _rcu_read_unlock_ctx		_rcu_read_unlock_ctx_mb
+#define rcu_read_ongoing_ctx		rcu_read_ongoing_ctx_mb
+#define _rcu_read_ongoing_ctx		_rcu_read_ongoing_ctx_mb
+#define rcu_register_ctx		rcu_register_ctx_mb
+#define rcu_unregister_ctx		rcu_unregister_ctx_mb
 #define rcu_init			rcu_init_mb
 #define rcu_exit			rcu_exit_mb
 #define synchronize_rcu			synchronize_rcu_mb
+#define synchronize_rcu_expedited	synchronize_rcu_expedited_mb
+#define start_poll_synchronize_rcu	start_poll_synchronize_rcu_mb
+#define poll_state_synchronize_rcu	poll_state_synchronize_rcu_mb
+#define start_poll_synchronize_rcu_notify	start_poll_synchronize_rcu_notify_mb
+#define synchronize_rcu_timeout		synchronize_rcu_timeout_mb
+#define rcu_set_stall_detector		rcu_set_stall_detector_mb
+#define rcu_get_stats			rcu_get_stats_mb
+#define rcu_get_lock_stats		rcu_get_lock_stats_mb
+#define rcu_set_read_profile		rcu_set_read_profile_mb
+#define rcu_read_profile_for_each	rcu_read_profile_for_each_mb
+#define rcu_read_profile_start		rcu_read_profile_start_mb
+#define rcu_read_profile_record		rcu_read_profile_record_mb
+#define rcu_gp_get_batch_stats		rcu_gp_get_batch_stats_mb
+#define rcu_get_membarrier_mode		rcu_get_membarrier_mode_mb
 #define rcu_reader			rcu_reader_mb
 #define rcu_gp				rcu_gp_mb
 
@@ -150,13 +284,41 @@
 #define get_thread_call_rcu_data	get_thread_call_rcu_data_mb
 #define set_thread_call_rcu_data	set_thread_call_rcu_data_mb
 #define create_all_cpu_call_rcu_data	create_all_cpu_call_rcu_data_mb
+#define create_all_node_call_rcu_data	create_all_node_call_rcu_data_mb
+#define create_all_llc_call_rcu_data	create_all_llc_call_rcu_data_mb
 #define free_all_cpu_call_rcu_data	free_all_cpu_call_rcu_data_mb
 #define call_rcu			call_rcu_mb
+#define call_rcu_expedited		call_rcu_expedited_mb
 #define call_rcu_data_free		call_rcu_data_free_mb
+#define call_rcu_data_set_high_watermark \
+		call_rcu_data_set_high_watermark_mb
+#define call_rcu_data_set_qlen_limit	call_rcu_data_set_qlen_limit_mb
+#define call_rcu_data_set_rt_delay	call_rcu_data_set_rt_delay_mb
+#define call_rcu_memory_pressure	call_rcu_memory_pressure_mb
+#define call_rcu_set_memory_pressure_qlen	call_rcu_set_memory_pressure_qlen_mb
+#define call_rcu_memory_pressure_monitor_start	call_rcu_memory_pressure_monitor_start_mb
+#define call_rcu_memory_pressure_monitor_stop	call_rcu_memory_pressure_monitor_stop_mb
+#define call_rcu_data_get_stats		call_rcu_data_get_stats_mb
+#define call_rcu_data_create_pool	call_rcu_data_create_pool_mb
+#define call_rcu_data_poll		call_rcu_data_poll_mb
+#define call_rcu_data_queue_work		call_rcu_data_queue_work_mb
+#define call_rcu_typed_queue_create		call_rcu_typed_queue_create_mb
+#define call_rcu_typed_queue_destroy		call_rcu_typed_queue_destroy_mb
+#define call_rcu_typed		call_rcu_typed_mb
+#define call_rcu_typed_barrier		call_rcu_typed_barrier_mb
+#define call_rcu_set_local_batch	call_rcu_set_local_batch_mb
+#define call_rcu_local_flush		call_rcu_local_flush_mb
+#define call_rcu_cache			call_rcu_cache_mb
+#define call_rcu_cache_queued		call_rcu_cache_queued_mb
+#define free_rcu			free_rcu_mb
+#define free_rcu_flush			free_rcu_flush_mb
 #define call_rcu_before_fork		call_rcu_before_fork_mb
 #define call_rcu_after_fork_parent	call_rcu_after_fork_parent_mb
 #define call_rcu_after_fork_child	call_rcu_after_fork_child_mb
 #define rcu_barrier			rcu_barrier_mb
+#define rcu_barrier_timeout		rcu_barrier_timeout_mb
+#define call_rcu_data_barrier		call_rcu_data_barrier_mb
+#define rcu_barrier_thread		rcu_barrier_thread_mb
 
 #define defer_rcu			defer_rcu_mb
 #define rcu_defer_register_thread	rcu_defer_register_thread_mb
@@ -0,0 +1,127 @@
+#ifndef _URCU_PERCPU_REF_H
+#define _URCU_PERCPU_REF_H
+
+/*
+ * urcu/percpu-ref.h
+ *
+ * Userspace RCU library - per-CPU reference counter
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <stdbool.h>
+#include <urcu/compiler.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Reference counter for objects shared by many CPUs, modelled on the
+ * Linux kernel percpu_ref. While live, urcu_percpu_ref_get() and
+ * urcu_percpu_ref_put() only update a counter of the current CPU, so
+ * they do not bounce a shared cache line. urcu_percpu_ref_kill() drops
+ * the initial reference and switches the counter to a single atomic
+ * count. The switch is made safe by performing get/put within RCU
+ * read-side critical sections of the flavor, and by folding the
+ * per-CPU counts into the atomic count from a call_rcu callback, after
+ * a grace period. The release function is called when the count
+ * reaches zero, which can only happen after kill.
+ *
+ * Threads calling get, tryget_live, put and kill must be registered
+ * RCU reader threads of the flavor (urcu-bp registers them
+ * automatically). The per-CPU counters use one cache line per possible
+ * CPU for each counter.
+ */
+
+struct urcu_percpu_ref_count;
+
+struct urcu_percpu_ref {
+	struct urcu_percpu_ref_count *percpu_count;
+	unsigned long atomic_count;
+	int dead;
+	void (*release)(struct urcu_percpu_ref *ref);
+	const struct rcu_flavor_struct *flavor;
+	struct rcu_head rcu_head;
+};
+
+/*
+ * _urcu_percpu_ref_init: initialize a counter holding one reference.
+ * Returns 0 on success, -ENOMEM if the per-CPU counters cannot be
+ * allocated.
+ */
+extern int _urcu_percpu_ref_init(struct urcu_percpu_ref *ref,
+		void (*release)(struct urcu_percpu_ref *ref),
+		const struct rcu_flavor_struct *flavor);
+
+/*
+ * urcu_percpu_ref_init: initialize a counter holding one reference,
+ * for the RCU flavor included before this header.
+ */
+static inline
+int urcu_percpu_ref_init(struct urcu_percpu_ref *ref,
+		void (*release)(struct urcu_percpu_ref *ref))
+{
+	return _urcu_percpu_ref_init(ref, release, &rcu_flavor);
+}
+
+/*
+ * urcu_percpu_ref_exit: free the per-CPU counters. Must be called after
+ * release, or on a counter never used concurrently.
+ */
+extern void urcu_percpu_ref_exit(struct urcu_percpu_ref *ref);
+
+/*
+ * urcu_percpu_ref_get: take a reference. The caller must already hold
+ * a reference, or know the object is live.
+ */
+extern void urcu_percpu_ref_get(struct urcu_percpu_ref *ref);
+
+/*
+ * urcu_percpu_ref_tryget_live: take a reference unless
+ * urcu_percpu_ref_kill() was called. Returns true if a reference was
+ * taken.
+ */
+extern bool urcu_percpu_ref_tryget_live(struct urcu_percpu_ref *ref);
+
+/*
+ * urcu_percpu_ref_put: drop a reference. Calls the release function,
+ * outside of RCU read-side critical section, if it was the last one.
+ */
+extern void urcu_percpu_ref_put(struct urcu_percpu_ref *ref);
+
+/*
+ * urcu_percpu_ref_kill: switch the counter to atomic mode and drop the
+ * initial reference. Must be called once. Concurrent get and put keep
+ * working; tryget_live fails from now on. The counter can only reach
+ * zero once the switch has completed, after a grace period.
+ */
+extern void urcu_percpu_ref_kill(struct urcu_percpu_ref *ref);
+
+/*
+ * urcu_percpu_ref_is_dying: return whether urcu_percpu_ref_kill() was
+ * called.
+ */
+extern bool urcu_percpu_ref_is_dying(struct urcu_percpu_ref *ref);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_PERCPU_REF_H */
@@ -0,0 +1,108 @@
+#ifndef _URCU_PERCPU_RWSEM_H
+#define _URCU_PERCPU_RWSEM_H
+
+/*
+ * urcu/percpu-rwsem.h
+ *
+ * Userspace RCU library - per-CPU reader/writer semaphore
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <pthread.h>
+#include <urcu/compiler.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Reader/writer semaphore for data updated in place, modelled on the
+ * Linux kernel percpu_rw_semaphore and its rcu_sync fast path switch.
+ * While no writer is present, urcu_percpu_rwsem_down_read() and
+ * urcu_percpu_rwsem_up_read() only update a counter of the current CPU,
+ * within an RCU read-side critical section of the flavor. A writer
+ * switches the readers to the slow path, where they serialize on a
+ * mutex with the writers, waits for a grace period so that no reader
+ * still uses the fast path, then waits for the per-CPU counts to sum
+ * to zero. The last writer switches the readers back to the fast path
+ * from a call_rcu callback, after a grace period, so back-to-back
+ * writers only wait for the first one.
+ *
+ * Threads calling the read side must be registered RCU reader threads
+ * of the flavor (urcu-bp registers them automatically). The read side
+ * sleeps while a writer holds the semaphore. urcu_percpu_rwsem_down_write()
+ * waits for a grace period: it must not be called within a read-side
+ * critical section. The per-CPU counters use one cache line per
+ * possible CPU.
+ */
+
+struct urcu_percpu_rwsem_count;
+
+struct urcu_percpu_rwsem {
+	struct urcu_percpu_rwsem_count *read_count;
+	int slow;			/* readers use the slow path */
+	int writer;			/* a writer holds the semaphore */
+	/* rcu_sync state of the fast path switch, protected by sync_lock. */
+	int gp_state;
+	unsigned long nr_writers;	/* holding or waiting */
+	pthread_mutex_t sync_lock;
+	pthread_cond_t sync_cond;
+	pthread_mutex_t writer_lock;	/* serializes writers */
+	pthread_mutex_t wait_lock;	/* slow path of readers */
+	pthread_cond_t reader_cond;	/* writer released */
+	pthread_cond_t drain_cond;	/* slow path reader released */
+	const struct rcu_flavor_struct *flavor;
+	struct rcu_head rcu_head;
+};
+
+/*
+ * _urcu_percpu_rwsem_init: initialize an unlocked semaphore. Returns 0
+ * on success, -ENOMEM if the per-CPU counters cannot be allocated.
+ */
+extern int _urcu_percpu_rwsem_init(struct urcu_percpu_rwsem *sem,
+		const struct rcu_flavor_struct *flavor);
+
+/*
+ * urcu_percpu_rwsem_init: initialize an unlocked semaphore, for the RCU
+ * flavor included before this header.
+ */
+static inline
+int urcu_percpu_rwsem_init(struct urcu_percpu_rwsem *sem)
+{
+	return _urcu_percpu_rwsem_init(sem, &rcu_flavor);
+}
+
+/*
+ * urcu_percpu_rwsem_destroy: free the semaphore, which must be
+ * unlocked. Waits for the switch back to the fast path if still
+ * pending.
+ */
+extern void urcu_percpu_rwsem_destroy(struct urcu_percpu_rwsem *sem);
+
+extern void urcu_percpu_rwsem_down_read(struct urcu_percpu_rwsem *sem);
+extern void urcu_percpu_rwsem_up_read(struct urcu_percpu_rwsem *sem);
+extern void urcu_percpu_rwsem_down_write(struct urcu_percpu_rwsem *sem);
+extern void urcu_percpu_rwsem_up_write(struct urcu_percpu_rwsem *sem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_PERCPU_RWSEM_H */
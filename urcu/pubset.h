@@ -0,0 +1,158 @@
+#ifndef _URCU_PUBSET_H
+#define _URCU_PUBSET_H
+
+/*
+ * urcu/pubset.h
+ *
+ * Userspace RCU library - atomic publication of a set of RCU pointers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <urcu/compiler.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A publish set holds a fixed number of RCU-protected pointers, such as
+ * the objects of a configuration, which are updated together. The
+ * pointers live in a generation, and an update builds a new generation,
+ * changes any number of its pointers, and publishes it with a single
+ * rcu_assign_pointer(). Readers dereference the generation once, and
+ * see either all the pointers of an update or none of them. The
+ * previous generation and the objects the update replaced are freed
+ * together by a single call_rcu callback of the flavor, after one grace
+ * period. An object moved to another slot of the new generation is not
+ * freed. An object may be stored in several slots: it is freed once,
+ * with the first of its slots.
+ */
+struct cds_pubset_gen {
+	struct rcu_head head;
+	struct cds_pubset *set;
+	unsigned long version;		/* incremented by each update */
+	unsigned int nr;
+	void *ptr[];			/* followed by a writer-only area */
+};
+
+/*
+ * cds_pubset_free_fct - free an object of slot @slot once replaced and
+ * no reader can access it anymore.
+ */
+typedef void (*cds_pubset_free_fct)(unsigned int slot, void *p);
+
+struct cds_pubset {
+	struct cds_pubset_gen *gen;	/* RCU-protected */
+	unsigned int nr;
+	cds_pubset_free_fct free_ptr;
+	const struct rcu_flavor_struct *flavor;
+	pthread_mutex_t lock;		/* serializes updates */
+};
+
+/*
+ * _cds_pubset_init - initialize a publish set of @nr NULL pointers.
+ * @free_ptr: frees the replaced objects, may be NULL.
+ * @flavor: flavor of the read-side critical sections of the readers.
+ *
+ * Returns 0 on success, -ENOMEM on allocation error.
+ */
+extern int _cds_pubset_init(struct cds_pubset *set, unsigned int nr,
+		cds_pubset_free_fct free_ptr,
+		const struct rcu_flavor_struct *flavor);
+
+/*
+ * cds_pubset_init - initialize a publish set for the RCU flavor
+ *                   included before this header.
+ */
+static inline
+int cds_pubset_init(struct cds_pubset *set, unsigned int nr,
+		cds_pubset_free_fct free_ptr)
+{
+	return _cds_pubset_init(set, nr, free_ptr, &rcu_flavor);
+}
+
+/*
+ * cds_pubset_destroy - free the current generation and its objects. No
+ * reader nor updater may access the set anymore, and the call_rcu
+ * callbacks of its updates must have been invoked (e.g.
+ * rcu_barrier()).
+ */
+extern void cds_pubset_destroy(struct cds_pubset *set);
+
+/*
+ * cds_pubset_read - return the current generation.
+ *
+ * Call within a read-side critical section of the flavor: the
+ * generation and the objects it points to are valid until its end.
+ */
+static inline
+struct cds_pubset_gen *cds_pubset_read(struct cds_pubset *set)
+{
+	return rcu_dereference(set->gen);
+}
+
+/*
+ * cds_pubset_get - return the pointer of slot @slot of a generation.
+ */
+static inline
+void *cds_pubset_get(struct cds_pubset_gen *gen, unsigned int slot)
+{
+	assert(slot < gen->nr);
+	return gen->ptr[slot];
+}
+
+/*
+ * cds_pubset_update_begin - start an update.
+ *
+ * Returns a private copy of the current generation, to change with
+ * cds_pubset_update_set() and pass to cds_pubset_update_commit() or
+ * cds_pubset_update_abort(), or NULL on allocation error. Updates are
+ * serialized: other updaters wait until the commit or abort.
+ */
+extern struct cds_pubset_gen *cds_pubset_update_begin(struct cds_pubset *set);
+
+static inline
+void cds_pubset_update_set(struct cds_pubset_gen *gen, unsigned int slot,
+		void *p)
+{
+	assert(slot < gen->nr);
+	gen->ptr[slot] = p;
+}
+
+/*
+ * cds_pubset_update_commit - publish the generation, and free the
+ * previous one and the objects it replaced after a grace period.
+ */
+extern void cds_pubset_update_commit(struct cds_pubset_gen *gen);
+
+/*
+ * cds_pubset_update_abort - drop the generation, leaving the set
+ * unchanged. The objects it points to which are not in the current
+ * generation are not freed.
+ */
+extern void cds_pubset_update_abort(struct cds_pubset_gen *gen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_PUBSET_H */
@@ -0,0 +1,576 @@
+#ifndef _URCU_RCU_HPP
+#define _URCU_RCU_HPP
+
+/*
+ * urcu/rcu.hpp
+ *
+ * Userspace RCU library - C++ typed wrappers
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * TO BE INCLUDED ONLY IN LGPL-COMPATIBLE CODE, as it inlines the lookups
+ * of urcu/static/rculfhash.h.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor, and define
+ * _LGPL_SOURCE for the read-side primitives of the flavor to be inlined.
+ * Requires C++11.
+ */
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define URCU_HAVE_PMR	1
+#endif
+#endif
+#include <urcu/static/urcu-pointer.h>
+#include <urcu/rculfhash.h>
+#include <urcu/static/rculfhash.h>
+
+namespace rcu {
+
+/*
+ * read_guard: RCU read-side critical section for the lifetime of the
+ * object. Guards can be nested.
+ */
+class read_guard {
+public:
+	read_guard() { rcu_read_lock(); }
+	~read_guard() { rcu_read_unlock(); }
+	read_guard(const read_guard &) = delete;
+	read_guard &operator=(const read_guard &) = delete;
+};
+
+/*
+ * ptr<T>: RCU-protected pointer. load() is rcu_dereference(), to be
+ * called within a read_guard, and the object it returns is valid until
+ * the guard is destroyed. Updaters publish objects with store(), and
+ * wait for a grace period before freeing the objects they replaced.
+ */
+template<typename T>
+class ptr {
+public:
+	constexpr ptr() noexcept : p_(nullptr) {}
+	explicit ptr(T *p) noexcept : p_(p) {}
+	ptr(const ptr &) = delete;
+	ptr &operator=(const ptr &) = delete;
+
+	T *load() const noexcept
+	{
+		return _rcu_dereference(p_);
+	}
+
+	/* Publish @p, ordering its initialization before the store. */
+	void store(T *p) noexcept
+	{
+		_rcu_assign_pointer(p_, p);
+	}
+
+	/* Publish @p and return the replaced object. */
+	T *exchange(T *p) noexcept
+	{
+		return _rcu_xchg_pointer(&p_, p);
+	}
+
+	/* Publish @p if the pointer is @old. Return the previous object. */
+	T *compare_exchange(T *old, T *p) noexcept
+	{
+		return _rcu_cmpxchg_pointer(&p_, old, p);
+	}
+
+private:
+	T *p_;
+};
+
+namespace detail {
+
+/*
+ * Deallocations deferred after a grace period are collected per thread
+ * in batches, each queued with a single call_rcu, as free_rcu() does.
+ * A batch only holds deallocations queued to the same call_rcu_data.
+ */
+struct retire_entry {
+	void (*free)(void *p, std::size_t bytes, std::size_t align,
+			void *ctx);
+	void *p;
+	std::size_t bytes, align;
+	void *ctx;
+};
+
+struct retire_batch {
+	enum { max_entries = 128 };
+
+	struct rcu_head head;
+	struct call_rcu_data *crdp;	/* NULL for the thread default */
+	unsigned long nr;
+	struct retire_entry entries[max_entries];
+};
+
+inline void retire_flush_local();
+
+inline void retire_batch_cb(struct rcu_head *head)
+{
+	struct retire_batch *batch =
+		caa_container_of(head, struct retire_batch, head);
+	unsigned long i;
+
+	for (i = 0; i < batch->nr; i++) {
+		const struct retire_entry &e = batch->entries[i];
+
+		e.free(e.p, e.bytes, e.align, e.ctx);
+	}
+	delete batch;
+	/* Deallocations retired by the callbacks, e.g. of members. */
+	retire_flush_local();
+}
+
+inline void retire_queue(struct retire_batch *batch)
+{
+	struct call_rcu_data *prev = NULL;
+
+	if (batch->crdp) {
+		prev = get_thread_call_rcu_data();
+		set_thread_call_rcu_data(batch->crdp);
+	}
+	call_rcu(&batch->head, retire_batch_cb);
+	if (batch->crdp)
+		set_thread_call_rcu_data(prev);
+}
+
+/* Queues the partial batch of exiting threads. */
+struct retire_local {
+	struct retire_batch *batch;
+
+	~retire_local()
+	{
+		if (batch)
+			retire_queue(batch);
+	}
+};
+
+inline struct retire_local &retire_local_get()
+{
+	static thread_local struct retire_local local = { NULL };
+
+	return local;
+}
+
+inline void retire_flush_local()
+{
+	struct retire_local &local = retire_local_get();
+	struct retire_batch *batch = local.batch;
+
+	if (!batch)
+		return;
+	local.batch = NULL;
+	retire_queue(batch);
+}
+
+/* Call @free(p, bytes, align, ctx) after a grace period. */
+inline void retire(void (*free)(void *p, std::size_t bytes,
+			std::size_t align, void *ctx),
+		void *p, std::size_t bytes, std::size_t align, void *ctx,
+		struct call_rcu_data *crdp)
+{
+	struct retire_local &local = retire_local_get();
+	struct retire_batch *batch = local.batch;
+
+	if (batch && batch->crdp != crdp) {
+		retire_flush_local();
+		batch = NULL;
+	}
+	if (!batch) {
+		batch = new retire_batch;
+		batch->crdp = crdp;
+		batch->nr = 0;
+		local.batch = batch;
+	}
+	batch->entries[batch->nr++] = { free, p, bytes, align, ctx };
+	if (batch->nr == retire_batch::max_entries)
+		retire_flush_local();
+}
+
+template<typename T>
+void retire_delete_fct(void *p, std::size_t, std::size_t, void *)
+{
+	delete static_cast<T *>(p);
+}
+
+} /* namespace detail */
+
+/*
+ * Deferred reclamation without a rcu_head per object: retire_delete(),
+ * retire_allocator and retire_resource queue the deletions and
+ * deallocations they receive in per-thread batches, each handed to
+ * call_rcu at once. retire_flush() queues the partial batch of the
+ * current thread, e.g. before rcu_barrier(), and the partial batch of
+ * exiting threads is queued when they exit. Must be called by
+ * registered RCU read-side threads.
+ *
+ * With copy-on-write, the updater publishes a modified copy of an
+ * object with ptr<T>::exchange(), then passes the old copy to
+ * retire_delete(): it is destroyed after a grace period, from the
+ * call_rcu worker thread. Memory its destructor releases through a
+ * retiring allocator waits for one more grace period, and for one more
+ * rcu_barrier().
+ */
+inline void retire_flush()
+{
+	detail::retire_flush_local();
+}
+
+/* Delete @p after a grace period. */
+template<typename T>
+void retire_delete(T *p)
+{
+	detail::retire(detail::retire_delete_fct<T>,
+		const_cast<void *>(static_cast<const void *>(p)), 0, 0,
+		NULL, NULL);
+}
+
+/*
+ * retire_allocator<T, Alloc>: allocator adaptor deferring the
+ * deallocations of Alloc after a grace period, so that readers can
+ * still access the memory released by containers within read_guards.
+ * Only the memory is deferred: the destructors of the elements run
+ * right away, and must leave them readable (e.g. only release memory
+ * through a retiring allocator). Alloc must be default constructible,
+ * and all its instances must be able to free each other's allocations.
+ */
+template<typename T, typename Alloc = std::allocator<T>>
+class retire_allocator {
+	typedef std::allocator_traits<Alloc> alloc_traits;
+
+public:
+	typedef T value_type;
+
+	template<typename U>
+	struct rebind {
+		typedef retire_allocator<U, typename alloc_traits::template
+			rebind_alloc<U>> other;
+	};
+
+	retire_allocator() noexcept {}
+
+	template<typename U, typename A>
+	retire_allocator(const retire_allocator<U, A> &) noexcept {}
+
+	T *allocate(std::size_t n)
+	{
+		Alloc alloc;
+
+		return alloc_traits::allocate(alloc, n);
+	}
+
+	void deallocate(T *p, std::size_t n)
+	{
+		detail::retire(free_fct, p, n, 0, NULL, NULL);
+	}
+
+private:
+	static void free_fct(void *p, std::size_t n, std::size_t, void *)
+	{
+		Alloc alloc;
+
+		alloc_traits::deallocate(alloc, static_cast<T *>(p), n);
+	}
+};
+
+template<typename T, typename A, typename U, typename B>
+bool operator==(const retire_allocator<T, A> &,
+		const retire_allocator<U, B> &) noexcept
+{
+	return true;
+}
+
+template<typename T, typename A, typename U, typename B>
+bool operator!=(const retire_allocator<T, A> &,
+		const retire_allocator<U, B> &) noexcept
+{
+	return false;
+}
+
+#ifdef URCU_HAVE_PMR
+/*
+ * retire_resource: memory resource deferring the deallocations of its
+ * upstream resource after a grace period, queued to @crdp (NULL for the
+ * call_rcu_data of the deallocating thread). Same constraints on element
+ * destructors as retire_allocator. The upstream resource and @crdp must
+ * outlive the deallocations still queued, e.g. until rcu_barrier()
+ * after retire_flush() in each thread which deallocated memory.
+ */
+class retire_resource : public std::pmr::memory_resource {
+public:
+	explicit retire_resource(
+			std::pmr::memory_resource *upstream =
+				std::pmr::get_default_resource(),
+			struct call_rcu_data *crdp = NULL) noexcept
+		: upstream_(upstream), crdp_(crdp) {}
+
+	std::pmr::memory_resource *upstream_resource() const noexcept
+	{
+		return upstream_;
+	}
+
+private:
+	void *do_allocate(std::size_t bytes, std::size_t align) override
+	{
+		return upstream_->allocate(bytes, align);
+	}
+
+	void do_deallocate(void *p, std::size_t bytes,
+			std::size_t align) override
+	{
+		detail::retire(free_fct, p, bytes, align, upstream_, crdp_);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource &other)
+		const noexcept override
+	{
+		return this == &other;
+	}
+
+	static void free_fct(void *p, std::size_t bytes, std::size_t align,
+			void *upstream)
+	{
+		static_cast<std::pmr::memory_resource *>(upstream)
+			->deallocate(p, bytes, align);
+	}
+
+	std::pmr::memory_resource *upstream_;
+	struct call_rcu_data *crdp_;
+};
+#endif /* URCU_HAVE_PMR */
+
+/*
+ * lfht<Key, Value, Hash, Eq, Alloc>: typed map of unique keys over a
+ * struct cds_lfht. The key comparison is inlined in the lookup chain
+ * walk of urcu/static/rculfhash.h, rather than called through a match
+ * function pointer. Nodes hold the key and the value, and are allocated
+ * with Alloc rebound to the node type.
+ *
+ * Lookups, traversals and updates must be performed within a
+ * read_guard, by registered RCU read-side threads. Removed and replaced
+ * nodes are freed after a grace period through the reclaim callback of
+ * the table (see cds_lfht_set_reclaim()), from the call_rcu worker
+ * thread, possibly after the table is destroyed: Alloc must be default
+ * constructible, and all its instances must be able to free each
+ * other's allocations. The values returned by lookups are valid until
+ * the read_guard is destroyed, and must not be modified, as concurrent
+ * readers may access them.
+ */
+template<typename Key, typename Value, typename Hash = std::hash<Key>,
+	typename Eq = std::equal_to<Key>,
+	typename Alloc = std::allocator<Value>>
+class lfht {
+	struct node : cds_lfht_node {
+		template<typename K, typename... Args>
+		node(K &&k, Args &&... args)
+			: cds_lfht_node(), key(std::forward<K>(k)),
+			  value(std::forward<Args>(args)...) {}
+
+		Key key;
+		Value value;
+	};
+
+	typedef typename std::allocator_traits<Alloc>::template
+		rebind_alloc<node> node_alloc;
+	typedef std::allocator_traits<node_alloc> node_alloc_traits;
+
+public:
+	/*
+	 * See cds_lfht_new() for the parameters. Throws std::bad_alloc if
+	 * the table cannot be allocated.
+	 */
+	explicit lfht(unsigned long init_size = 1,
+			int flags = CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING,
+			unsigned long min_nr_alloc_buckets = 1,
+			unsigned long max_nr_buckets = 0)
+	{
+		ht_ = cds_lfht_new(init_size, min_nr_alloc_buckets,
+				max_nr_buckets, flags, NULL);
+		if (!ht_)
+			throw std::bad_alloc();
+		cds_lfht_set_reclaim(ht_, reclaim_node, NULL);
+	}
+
+	/*
+	 * No reader nor updater may access the table anymore, e.g. after
+	 * a grace period following its unpublication. Same calling
+	 * context requirements as cds_lfht_destroy().
+	 */
+	~lfht()
+	{
+		(void) cds_lfht_destroy_free(ht_, reclaim_node, NULL, NULL);
+	}
+
+	lfht(const lfht &) = delete;
+	lfht &operator=(const lfht &) = delete;
+
+	/* Return the value of @key, or NULL if not found. */
+	const Value *find(const Key &key) const
+	{
+		struct cds_lfht_iter iter;
+
+		lookup(key, Hash()(key), &iter);
+		if (!iter.node)
+			return NULL;
+		return &static_cast<node *>(iter.node)->value;
+	}
+
+	/*
+	 * Add @key with a value constructed from @args, if not present.
+	 * Return true if added.
+	 */
+	template<typename K, typename... Args>
+	bool emplace(K &&key, Args &&... args)
+	{
+		node *n = make_node(std::forward<K>(key),
+				std::forward<Args>(args)...);
+		unsigned long hash = Hash()(n->key);
+		struct cds_lfht_iter iter;
+
+		lookup(n->key, hash, &iter);
+		if (!iter.node) {
+			iter.node = cds_lfht_add_unique(ht_, hash, match_fct,
+					&n->key, n);
+			if (iter.node == n)
+				return true;
+		}
+		/* Never published, can be freed right away. */
+		free_node(n);
+		return false;
+	}
+
+	bool insert(const Key &key, const Value &value)
+	{
+		return emplace(key, value);
+	}
+
+	/*
+	 * Add @key with a value constructed from @args, replacing the
+	 * existing value if present. Return true if added, false if
+	 * replaced.
+	 */
+	template<typename K, typename... Args>
+	bool insert_or_assign(K &&key, Args &&... args)
+	{
+		node *n = make_node(std::forward<K>(key),
+				std::forward<Args>(args)...);
+
+		return !cds_lfht_add_replace(ht_, Hash()(n->key), match_fct,
+				&n->key, n);
+	}
+
+	/* Remove @key. Return true if removed. */
+	bool erase(const Key &key)
+	{
+		struct cds_lfht_iter iter;
+
+		lookup(key, Hash()(key), &iter);
+		return iter.node && !cds_lfht_del(ht_, iter.node);
+	}
+
+	/* Call @f(key, value) for each entry of the table. */
+	template<typename F>
+	void for_each(F f) const
+	{
+		struct cds_lfht_iter iter;
+		struct cds_lfht_node *n;
+
+		cds_lfht_for_each(ht_, &iter, n) {
+			const node *entry = static_cast<node *>(n);
+
+			f(entry->key, entry->value);
+		}
+	}
+
+	/* Approximate number of entries, see cds_lfht_size_approx(). */
+	unsigned long size_approx() const
+	{
+		unsigned long approx = 0;
+
+		(void) cds_lfht_size_approx(ht_, &approx);
+		return approx;
+	}
+
+	/* The underlying table, for the C API. */
+	struct cds_lfht *native_handle() const noexcept
+	{
+		return ht_;
+	}
+
+private:
+	static bool match(struct cds_lfht_node *n, const Key &key)
+	{
+		return Eq()(static_cast<node *>(n)->key, key);
+	}
+
+	static int match_fct(struct cds_lfht_node *n, const void *key)
+	{
+		return match(n, *static_cast<const Key *>(key));
+	}
+
+	void lookup(const Key &key, unsigned long hash,
+			struct cds_lfht_iter *iter) const
+	{
+		struct cds_lfht_node *n;
+		unsigned long reverse_hash;
+
+		n = _cds_lfht_lookup_chain(ht_, hash, &reverse_hash);
+		_CDS_LFHT_CHAIN_WALK(n, reverse_hash, match, key, iter);
+	}
+
+	template<typename... Args>
+	static node *make_node(Args &&... args)
+	{
+		node_alloc alloc;
+		node *n = node_alloc_traits::allocate(alloc, 1);
+
+		try {
+			node_alloc_traits::construct(alloc, n,
+					std::forward<Args>(args)...);
+		} catch (...) {
+			node_alloc_traits::deallocate(alloc, n, 1);
+			throw;
+		}
+		return n;
+	}
+
+	static void free_node(node *n)
+	{
+		node_alloc alloc;
+
+		node_alloc_traits::destroy(alloc, n);
+		node_alloc_traits::deallocate(alloc, n, 1);
+	}
+
+	static void reclaim_node(struct cds_lfht_node *n, void *)
+	{
+		free_node(static_cast<node *>(n));
+	}
+
+	struct cds_lfht *ht_;
+};
+
+} /* namespace rcu */
+
+#endif /* _URCU_RCU_HPP */
@@ -0,0 +1,186 @@
+#ifndef _URCU_RCUBTREE_H
+#define _URCU_RCUBTREE_H
+
+/*
+ * urcu/rcubtree.h
+ *
+ * Userspace RCU library - RCU B-tree (ordered map)
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <pthread.h>
+#include <urcu/compiler.h>
+#include <urcu-call-rcu.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Ordered map of unique unsigned long keys, kept as a B+tree of wide
+ * nodes (up to CDS_BT_ORDER keys each) for cache-friendly lookups on
+ * large read-mostly indexes. Keys are stored in the tree nodes, so a
+ * lookup only touches one cache-line sized key array per level.
+ *
+ * Tree nodes are never modified once published: updates are serialized
+ * by a mutex of the tree, copy the nodes of the path they change,
+ * publish the new root with rcu_assign_pointer(), and free the old
+ * nodes with call_rcu. Lookups, lower bound and range traversals are
+ * lock-free RCU read-side operations, and a traversal sees a consistent
+ * snapshot of the tree: the one of the root it started from.
+ *
+ * Entries are intrusive: struct cds_bt_node is embedded in the user
+ * structure, and holds its key.
+ */
+#define CDS_BT_ORDER		32
+#define CDS_BT_MAX_HEIGHT	24
+
+struct cds_bt_inode;
+
+struct cds_bt_node {
+	unsigned long key;
+};
+
+struct cds_bt {
+	struct cds_bt_inode *root;
+	pthread_mutex_t lock;		/* serializes updates */
+	void (*bt_call_rcu)(struct rcu_head *head,
+		void (*func)(struct rcu_head *head));
+};
+
+/*
+ * Traversal position, from the root of the snapshot to the leaf.
+ */
+struct cds_bt_iter {
+	struct cds_bt_inode *inode[CDS_BT_MAX_HEIGHT];
+	unsigned int pos[CDS_BT_MAX_HEIGHT];
+	unsigned int height;
+};
+
+/*
+ * cds_bt_init - initialize an empty B-tree.
+ * @bt: the B-tree.
+ * @bt_call_rcu: call_rcu of the RCU flavor used with the B-tree.
+ *
+ * Return 0 on success, -ENOMEM if the root node cannot be allocated.
+ */
+extern
+int cds_bt_init(struct cds_bt *bt,
+		void bt_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)));
+
+/*
+ * cds_bt_destroy - destroy a B-tree.
+ *
+ * The B-tree should be emptied before calling destroy, and a grace
+ * period waited for (e.g. with rcu_barrier()) after the last update.
+ * Return 0 on success, -EPERM if B-tree is not empty.
+ */
+extern
+int cds_bt_destroy(struct cds_bt *bt);
+
+/*
+ * cds_bt_lookup - get the node of a key.
+ *
+ * Return NULL if not found.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_bt_node *cds_bt_lookup(struct cds_bt *bt, unsigned long key);
+
+/*
+ * cds_bt_lower_bound - get the node of the smallest key not smaller
+ *                      than key.
+ * @iter: filled with the traversal position, for cds_bt_next().
+ *
+ * Return NULL if no such node exists.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_bt_node *cds_bt_lower_bound(struct cds_bt *bt, unsigned long key,
+		struct cds_bt_iter *iter);
+
+/*
+ * cds_bt_next - get the node following the traversal position.
+ *
+ * Return NULL at the end of the snapshot of the traversal.
+ * Call with the rcu_read_lock held since the traversal started.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_bt_node *cds_bt_next(struct cds_bt_iter *iter);
+
+/*
+ * cds_bt_add - add a node to the B-tree.
+ * @bt: the B-tree.
+ * @key: the key of node.
+ * @node: the node to add.
+ *
+ * Return 0 on success, -EEXIST if a node with the same key is already
+ * present, or -ENOMEM if tree nodes cannot be allocated.
+ * Threads calling this API need to be registered RCU read-side threads,
+ * holding the read-side lock or not.
+ */
+extern
+int cds_bt_add(struct cds_bt *bt, unsigned long key,
+		struct cds_bt_node *node);
+
+/*
+ * cds_bt_del - remove the node of a key from the B-tree.
+ * @node: set to the removed node on success.
+ *
+ * Return 0 on success, -ENOENT if not found, or -ENOMEM if tree nodes
+ * cannot be allocated, in which case the B-tree is unchanged.
+ * After removal, a grace period must be waited for before freeing or
+ * re-adding the node.
+ * Threads calling this API need to be registered RCU read-side threads,
+ * holding the read-side lock or not.
+ */
+extern
+int cds_bt_del(struct cds_bt *bt, unsigned long key,
+		struct cds_bt_node **node);
+
+static inline
+struct cds_bt_node *cds_bt_first(struct cds_bt *bt, struct cds_bt_iter *iter)
+{
+	return cds_bt_lower_bound(bt, 0, iter);
+}
+
+/*
+ * Traversals in key order, from the first node, or from the first node
+ * whose key is not smaller than key. Call with rcu_read_lock held.
+ */
+#define cds_bt_for_each(bt, iter, node)					\
+	for (node = cds_bt_first(bt, iter);				\
+		node != NULL;						\
+		node = cds_bt_next(iter))
+
+#define cds_bt_for_each_from(bt, key, iter, node)			\
+	for (node = cds_bt_lower_bound(bt, key, iter);			\
+		node != NULL;						\
+		node = cds_bt_next(iter))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCUBTREE_H */
@@ -0,0 +1,183 @@
+#ifndef _URCU_RCUCACHE_H
+#define _URCU_RCUCACHE_H
+
+/*
+ * urcu/rcucache.h
+ *
+ * Userspace RCU library - RCU bounded cache on top of the lock-free
+ * resizable hash table
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <stddef.h>
+#include <urcu/compiler.h>
+#include <urcu/list.h>
+#include <urcu/wfcqueue.h>
+#include <urcu/rculfhash.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Cache of nodes indexed by a cds_lfht, bounded by a number of nodes
+ * and by a number of bytes, with CLOCK (second chance) eviction.
+ *
+ * Lookups are cds_lfht lookups: they take no lock, and only set the
+ * referenced bit of the node found, if not already set, so hits on a
+ * hot node do not write its cache line. Additions insert into the hash
+ * table without lock, and queue the node onto a wait-free queue. Once
+ * a limit is exceeded, the adding thread takes the cache mutex, unless
+ * eviction is already ongoing, moves the queued nodes into the clock
+ * ring, and sweeps the clock hand: referenced nodes get their bit
+ * cleared, the others are removed from the hash table, until the cache
+ * is back below 31/32 of its limits. A sweep goes at most twice around
+ * the ring before evicting nodes regardless of their bit. Evicted and
+ * removed nodes are handed to the free_node callback of the cache
+ * through the call_rcu of the flavor, so readers may use the nodes they
+ * found until the end of their read-side critical section.
+ *
+ * Limits are soft: the cache exceeds them while additions race with an
+ * eviction in progress.
+ */
+
+struct cds_lfht_cache;
+
+struct cds_lfht_cache_node {
+	struct cds_lfht_node node;	/* hash table index */
+	struct cds_wfcq_node pending;	/* queued by cds_lfht_cache_add() */
+	struct cds_list_head clock;	/* ring swept by eviction */
+	struct rcu_head head;
+	struct cds_lfht_cache *cache;
+	size_t size;
+	int referenced;
+	int state;
+};
+
+/*
+ * cds_lfht_cache_match_fct - returns non-zero if @node has key @key.
+ */
+typedef int (*cds_lfht_cache_match_fct)(struct cds_lfht_cache_node *node,
+		const void *key);
+
+/*
+ * cds_lfht_cache_free_fct - free a node evicted or removed from the
+ * cache. Invoked after a grace period, from a call_rcu worker thread.
+ */
+typedef void (*cds_lfht_cache_free_fct)(struct cds_lfht_cache_node *node);
+
+struct cds_lfht_cache_stats {
+	unsigned long count;		/* nodes in the cache */
+	unsigned long bytes;		/* sum of the node sizes */
+	unsigned long nr_evictions;	/* nodes evicted so far */
+};
+
+/*
+ * _cds_lfht_cache_new - allocate a cache holding at most max_count
+ * nodes and max_bytes bytes of nodes, 0 meaning no limit. Returns NULL
+ * on error.
+ */
+extern struct cds_lfht_cache *_cds_lfht_cache_new(unsigned long max_count,
+		unsigned long max_bytes,
+		cds_lfht_cache_match_fct match,
+		cds_lfht_cache_free_fct free_node,
+		const struct rcu_flavor_struct *flavor);
+
+/*
+ * cds_lfht_cache_new - allocate a cache for the RCU flavor included
+ * before this header.
+ */
+static inline
+struct cds_lfht_cache *cds_lfht_cache_new(unsigned long max_count,
+		unsigned long max_bytes,
+		cds_lfht_cache_match_fct match,
+		cds_lfht_cache_free_fct free_node)
+{
+	return _cds_lfht_cache_new(max_count, max_bytes, match, free_node,
+			&rcu_flavor);
+}
+
+/*
+ * cds_lfht_cache_destroy - remove all nodes, wait for their free_node
+ * callbacks (with the flavor rcu_barrier), and free the cache. The
+ * cache must not be used concurrently. Same calling context
+ * requirements as cds_lfht_destroy(). Returns 0 on success, negative
+ * error value on error.
+ */
+extern int cds_lfht_cache_destroy(struct cds_lfht_cache *cache);
+
+/*
+ * cds_lfht_cache_node_init - initialize a node accounted for @size
+ * bytes, before adding it.
+ */
+extern void cds_lfht_cache_node_init(struct cds_lfht_cache_node *node,
+		size_t size);
+
+/*
+ * cds_lfht_cache_lookup - look up a node by key, and mark it
+ * referenced. Returns NULL if not found.
+ * Call with rcu_read_lock held: the node stays valid until
+ * rcu_read_unlock.
+ */
+extern struct cds_lfht_cache_node *cds_lfht_cache_lookup(
+		struct cds_lfht_cache *cache, unsigned long hash,
+		const void *key);
+
+/*
+ * cds_lfht_cache_add - add a node unless a node with the same key is
+ * already in the cache, and evict nodes if a limit is exceeded.
+ * Returns @node if it was added, or the node already in the cache, in
+ * which case @node is left to the caller.
+ * Call with rcu_read_lock held: the returned node stays valid until
+ * rcu_read_unlock, even if it is evicted meanwhile.
+ */
+extern struct cds_lfht_cache_node *cds_lfht_cache_add(
+		struct cds_lfht_cache *cache, unsigned long hash,
+		const void *key, struct cds_lfht_cache_node *node);
+
+/*
+ * cds_lfht_cache_del - remove a node found in the cache, and hand it to
+ * free_node after a grace period. Returns 0 on success, -ENOENT if the
+ * node was already removed or evicted.
+ * Call with rcu_read_lock held. Takes the cache mutex.
+ */
+extern int cds_lfht_cache_del(struct cds_lfht_cache *cache,
+		struct cds_lfht_cache_node *node);
+
+/*
+ * cds_lfht_cache_set_capacity - change the limits of the cache, with 0
+ * meaning no limit, and evict nodes down to the new limits.
+ * Call with rcu_read_lock held. Takes the cache mutex.
+ */
+extern void cds_lfht_cache_set_capacity(struct cds_lfht_cache *cache,
+		unsigned long max_count, unsigned long max_bytes);
+
+/*
+ * cds_lfht_cache_get_stats - read the cache counters. Each counter is
+ * read on its own, without synchronization with updates.
+ */
+extern void cds_lfht_cache_get_stats(struct cds_lfht_cache *cache,
+		struct cds_lfht_cache_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCUCACHE_H */
@@ -50,6 +50,56 @@ void cds_hlist_del_rcu(struct cds_hlist_node *elem)
 	CMM_STORE_SHARED(elem->prev->next, elem->next);
 }
 
+/*
+ * Join a private list at the head of an RCU list. The elements of @add
+ * must not be visible to readers yet: they are linked privately, then
+ * published with a single rcu_assign_pointer(), so readers either see
+ * none or all of them. Finding the last element of @add is O(n). @add
+ * is left unchanged and must be reinitialized before reuse. Mutual
+ * exclusion against concurrent updates is required.
+ */
+static inline
+void cds_hlist_splice_rcu(struct cds_hlist_head *add,
+		struct cds_hlist_head *head)
+{
+	struct cds_hlist_node *first = add->next, *last;
+
+	if (!first)
+		return;
+	for (last = first; last->next; last = last->next)
+		;
+	last->next = head->next;
+	first->prev = (struct cds_hlist_node *) head;
+	if (head->next)
+		head->next->prev = last;
+	rcu_assign_pointer(head->next, first);
+}
+
+/*
+ * Replace all elements of the RCU list @head with the elements of the
+ * private list @newlist, published with a single rcu_assign_pointer().
+ * Readers see either the old or the new elements, never a mix of both.
+ * The old elements are moved to the list @old: the readers still
+ * traversing them end at the same NULL pointer, so no grace period is
+ * needed before iterating on @old, but one is needed before freeing
+ * its elements. @newlist is left unchanged and must be reinitialized
+ * before reuse. Mutual exclusion against concurrent updates is
+ * required.
+ */
+static inline
+void cds_hlist_replace_list_rcu(struct cds_hlist_head *head,
+		struct cds_hlist_head *newlist, struct cds_hlist_head *old)
+{
+	struct cds_hlist_node *first = head->next;
+
+	if (newlist->next)
+		newlist->next->prev = (struct cds_hlist_node *) head;
+	rcu_assign_pointer(head->next, newlist->next);
+	old->next = first;
+	if (first)
+		first->prev = (struct cds_hlist_node *) old;
+}
+
 /*
  * Iterate through elements of the list.
  * This must be done while rcu_read_lock() is held.
@@ -0,0 +1,240 @@
+#ifndef _URCU_RCUHTABLE_H
+#define _URCU_RCUHTABLE_H
+
+/*
+ * urcu/rcuhtable.h
+ *
+ * Userspace RCU library - RCU fixed-size hash table over hlists
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <sched.h>
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+#include <urcu/hlist.h>
+#include <urcu/rcuhlist.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hash table of a fixed number of buckets, each an RCU hlist. For
+ * tables whose size is known up front, it avoids the split-ordered
+ * list machinery of cds_lfht: a lookup walks a plain bucket list.
+ * Readers traverse buckets within RCU read-side critical sections.
+ * Updaters serialize on a spinlock shared by the buckets of a stripe
+ * (bucket index modulo the number of locks), so updates of different
+ * stripes proceed in parallel. Removed nodes must wait for a grace
+ * period before being freed or re-added.
+ *
+ * Nodes are struct cds_hlist_node embedded in the user structure. The
+ * caller provides the hash of the key to each operation.
+ */
+struct cds_hlist_ht_lock {
+	int locked;
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+struct cds_hlist_ht {
+	unsigned long bucket_mask;
+	unsigned long lock_mask;
+	struct cds_hlist_head *buckets;
+	struct cds_hlist_ht_lock *locks;
+};
+
+/*
+ * Return 1 if node matches key, 0 otherwise.
+ */
+typedef int (*cds_hlist_ht_match_fct)(struct cds_hlist_node *node,
+		const void *key);
+
+/*
+ * cds_hlist_ht_new - allocate a hash table.
+ * @nr_buckets: number of buckets, rounded up to a power of 2.
+ * @nr_locks: number of bucket lock stripes, rounded up to a power of 2,
+ *            and at most nr_buckets. 0 selects one per possible CPU.
+ *
+ * Return NULL on error.
+ */
+extern
+struct cds_hlist_ht *cds_hlist_ht_new(unsigned long nr_buckets,
+		unsigned long nr_locks);
+
+/*
+ * cds_hlist_ht_destroy - free a hash table.
+ *
+ * Return 0 on success, -EPERM if the hash table is not empty.
+ */
+extern
+int cds_hlist_ht_destroy(struct cds_hlist_ht *ht);
+
+static inline
+struct cds_hlist_head *cds_hlist_ht_bucket(struct cds_hlist_ht *ht,
+		unsigned long hash)
+{
+	return &ht->buckets[hash & ht->bucket_mask];
+}
+
+/*
+ * Stripe lock of the bucket of hash: buckets share the lock of their
+ * index modulo the number of locks. The test and test-and-set spins
+ * briefly, then yields the CPU, since the holder may be preempted.
+ */
+static inline
+void cds_hlist_ht_lock(struct cds_hlist_ht *ht, unsigned long hash)
+{
+	struct cds_hlist_ht_lock *lock =
+		&ht->locks[hash & ht->lock_mask];
+	unsigned int spin = 0;
+
+	while (uatomic_xchg(&lock->locked, 1)) {
+		while (CMM_LOAD_SHARED(lock->locked)) {
+			if (++spin < 128) {
+				caa_cpu_relax();
+			} else {
+				(void) sched_yield();
+				spin = 0;
+			}
+		}
+	}
+}
+
+static inline
+void cds_hlist_ht_unlock(struct cds_hlist_ht *ht, unsigned long hash)
+{
+	struct cds_hlist_ht_lock *lock =
+		&ht->locks[hash & ht->lock_mask];
+
+	/* Bucket updates before releasing the lock. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(lock->locked, 0);
+}
+
+/*
+ * cds_hlist_ht_lookup - get the first node of the bucket of hash
+ *                       matching key.
+ *
+ * Return NULL if not found.
+ * Call with rcu_read_lock held.
+ */
+static inline
+struct cds_hlist_node *cds_hlist_ht_lookup(struct cds_hlist_ht *ht,
+		unsigned long hash, cds_hlist_ht_match_fct match,
+		const void *key)
+{
+	struct cds_hlist_node *pos;
+
+	cds_hlist_for_each_rcu(pos, cds_hlist_ht_bucket(ht, hash)) {
+		if (match(pos, key))
+			return pos;
+	}
+	return NULL;
+}
+
+/*
+ * cds_hlist_ht_add - add node to the bucket of hash, allowing
+ *                    duplicate keys.
+ */
+static inline
+void cds_hlist_ht_add(struct cds_hlist_ht *ht, unsigned long hash,
+		struct cds_hlist_node *node)
+{
+	cds_hlist_ht_lock(ht, hash);
+	cds_hlist_add_head_rcu(node, cds_hlist_ht_bucket(ht, hash));
+	cds_hlist_ht_unlock(ht, hash);
+}
+
+/*
+ * cds_hlist_ht_add_unique - add node unless a node matching key is
+ *                           already present.
+ *
+ * Return node if it was added, or the node already present.
+ * Call with rcu_read_lock held if the returned node is used.
+ */
+static inline
+struct cds_hlist_node *cds_hlist_ht_add_unique(struct cds_hlist_ht *ht,
+		unsigned long hash, cds_hlist_ht_match_fct match,
+		const void *key, struct cds_hlist_node *node)
+{
+	struct cds_hlist_head *head = cds_hlist_ht_bucket(ht, hash);
+	struct cds_hlist_node *pos;
+
+	cds_hlist_ht_lock(ht, hash);
+	cds_hlist_for_each(pos, head) {
+		if (match(pos, key)) {
+			cds_hlist_ht_unlock(ht, hash);
+			return pos;
+		}
+	}
+	cds_hlist_add_head_rcu(node, head);
+	cds_hlist_ht_unlock(ht, hash);
+	return node;
+}
+
+/*
+ * cds_hlist_ht_del - remove node from the bucket of hash.
+ */
+static inline
+void cds_hlist_ht_del(struct cds_hlist_ht *ht, unsigned long hash,
+		struct cds_hlist_node *node)
+{
+	cds_hlist_ht_lock(ht, hash);
+	cds_hlist_del_rcu(node);
+	cds_hlist_ht_unlock(ht, hash);
+}
+
+/*
+ * cds_hlist_ht_del_key - remove the first node matching key from the
+ *                        bucket of hash.
+ *
+ * Return the removed node, or NULL if not found.
+ */
+static inline
+struct cds_hlist_node *cds_hlist_ht_del_key(struct cds_hlist_ht *ht,
+		unsigned long hash, cds_hlist_ht_match_fct match,
+		const void *key)
+{
+	struct cds_hlist_node *pos;
+
+	cds_hlist_ht_lock(ht, hash);
+	cds_hlist_for_each(pos, cds_hlist_ht_bucket(ht, hash)) {
+		if (match(pos, key)) {
+			cds_hlist_del_rcu(pos);
+			break;
+		}
+	}
+	cds_hlist_ht_unlock(ht, hash);
+	return pos;
+}
+
+/*
+ * Iterate over the entries of the bucket of hash, which may hold other
+ * keys. Call with rcu_read_lock held.
+ */
+#define cds_hlist_ht_for_each_entry_rcu(ht, hash, entry, pos, member)	\
+	cds_hlist_for_each_entry_rcu(entry, pos,			\
+		cds_hlist_ht_bucket(ht, hash), member)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCUHTABLE_H */
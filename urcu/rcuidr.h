@@ -0,0 +1,120 @@
+#ifndef _URCU_RCUIDR_H
+#define _URCU_RCUIDR_H
+
+/*
+ * urcu/rcuidr.h
+ *
+ * Userspace RCU library - RCU integer ID allocator
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <urcu/compiler.h>
+#include <urcu/rcuradix.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Allocator of integer IDs, mapping each allocated ID to a node, as
+ * the Linux kernel IDR. The map is a cds_rdx radix tree keyed on the
+ * ID: lookups are wait-free RCU read-side operations walking one slot
+ * per level, without hashing. IDs are allocated lowest first from a
+ * multi-level bitmap, protected by a mutex of the allocator, in
+ * batches: each thread keeps a cache of reserved IDs, and of the IDs it
+ * removed, which it allocates from without lock.
+ *
+ * Nodes are struct cds_rdx_node, embedded in the user structure, and
+ * hold their ID as key. Removed nodes must wait for a grace period
+ * before being freed, e.g. with call_rcu. Their ID can be allocated
+ * again right away, to a node which concurrent lookups of the ID may
+ * then find instead.
+ *
+ * IDs held by the caches of the threads are not allocated by other
+ * threads: allocation can fail while up to CDS_IDR_CACHE_SIZE IDs per
+ * thread are free. Each allocator uses one pthread key.
+ */
+
+/* Maximum number of free IDs cached per thread. */
+#define CDS_IDR_CACHE_SIZE	64
+
+/* Maximum number of ID bits. The bitmap takes 2^id_bits bits. */
+#define CDS_IDR_MAX_BITS	32
+
+struct cds_idr;
+
+/*
+ * _cds_idr_create: create an allocator of IDs from 0 to
+ * 2^id_bits - 1, id_bits being between 1 and CDS_IDR_MAX_BITS. Returns
+ * NULL if id_bits is out of range, or on allocation error.
+ */
+extern struct cds_idr *_cds_idr_create(unsigned int id_bits,
+		const struct rcu_flavor_struct *flavor);
+
+/*
+ * cds_idr_create: create an allocator for the RCU flavor included
+ * before this header.
+ */
+static inline
+struct cds_idr *cds_idr_create(unsigned int id_bits)
+{
+	return _cds_idr_create(id_bits, &rcu_flavor);
+}
+
+/*
+ * cds_idr_destroy: free the allocator. Returns 0 on success, -EPERM if
+ * IDs are still allocated. As for cds_rdx_destroy(), a grace period
+ * must be waited for after the last removal. The allocator must not be
+ * used concurrently.
+ */
+extern int cds_idr_destroy(struct cds_idr *idr);
+
+/*
+ * cds_idr_alloc: allocate an ID, and map it to @node. The ID is stored
+ * in node->key, and in @id if not NULL.
+ *
+ * Returns 0 on success, -ENOSPC if no ID is free, or -ENOMEM.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern int cds_idr_alloc(struct cds_idr *idr, struct cds_rdx_node *node,
+		unsigned long *id);
+
+/*
+ * cds_idr_find: get the node mapped to an ID, or NULL.
+ * Call with rcu_read_lock held.
+ */
+extern struct cds_rdx_node *cds_idr_find(struct cds_idr *idr,
+		unsigned long id);
+
+/*
+ * cds_idr_remove: unmap an ID and free it. Returns the node it was
+ * mapped to, to free after a grace period, or NULL if the ID is not
+ * allocated.
+ * Call with rcu_read_lock held.
+ */
+extern struct cds_rdx_node *cds_idr_remove(struct cds_idr *idr,
+		unsigned long id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCUIDR_H */
@@ -0,0 +1,167 @@
+#ifndef _URCU_RCUITREE_H
+#define _URCU_RCUITREE_H
+
+/*
+ * urcu/rcuitree.h
+ *
+ * Userspace RCU library - RCU interval tree
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <pthread.h>
+#include <urcu/compiler.h>
+#include <urcu-call-rcu.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Set of closed intervals [start, last] of unsigned long, such as
+ * address ranges or time ranges, finding all the intervals overlapping
+ * a query interval. The intervals are kept in an AVL tree ordered by
+ * start, each tree node augmented with the largest last of its subtree,
+ * so that queries skip the subtrees ending before the query.
+ *
+ * Tree nodes are never modified once published: updates are serialized
+ * by a mutex of the tree, copy the nodes of the path they change and
+ * the nodes they rotate, publish the new root with rcu_assign_pointer(),
+ * and free the replaced nodes with call_rcu. Overlap queries are
+ * lock-free RCU read-side operations, and see a consistent snapshot of
+ * the tree: the one of the root they started from.
+ *
+ * Entries are intrusive: struct cds_itree_node is embedded in the user
+ * structure, and holds its interval. Several nodes may have the same
+ * interval.
+ */
+#define CDS_ITREE_MAX_HEIGHT	96	/* AVL tree of 2^64 nodes */
+
+struct cds_itree_inode;
+
+struct cds_itree_node {
+	unsigned long start, last;
+};
+
+struct cds_itree {
+	struct cds_itree_inode *root;
+	pthread_mutex_t lock;		/* serializes updates */
+	void (*it_call_rcu)(struct rcu_head *head,
+		void (*func)(struct rcu_head *head));
+};
+
+/*
+ * Query position: the tree nodes left to visit, and the query interval.
+ */
+struct cds_itree_iter {
+	struct cds_itree_inode *stack[CDS_ITREE_MAX_HEIGHT];
+	unsigned int depth;
+	unsigned long start, last;
+};
+
+/*
+ * cds_itree_init - initialize an empty interval tree.
+ * @it: the interval tree.
+ * @it_call_rcu: call_rcu of the RCU flavor used with the tree.
+ */
+extern
+void cds_itree_init(struct cds_itree *it,
+		void it_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)));
+
+/*
+ * cds_itree_destroy - destroy an interval tree.
+ *
+ * The tree should be emptied before calling destroy, and a grace period
+ * waited for (e.g. with rcu_barrier()) after the last update.
+ * Return 0 on success, -EPERM if the tree is not empty.
+ */
+extern
+int cds_itree_destroy(struct cds_itree *it);
+
+/*
+ * cds_itree_add - add a node to the interval tree.
+ * @it: the interval tree.
+ * @node: the node to add, not already in the tree.
+ * @start: first value of the interval.
+ * @last: last value of the interval, included.
+ *
+ * Return 0 on success, -EINVAL if start is larger than last, or -ENOMEM
+ * if tree nodes cannot be allocated.
+ * Threads calling this API need to be registered RCU read-side threads,
+ * holding the read-side lock or not.
+ */
+extern
+int cds_itree_add(struct cds_itree *it, struct cds_itree_node *node,
+		unsigned long start, unsigned long last);
+
+/*
+ * cds_itree_del - remove a node from the interval tree.
+ *
+ * Return 0 on success, -ENOENT if node is not in the tree, or -ENOMEM
+ * if tree nodes cannot be allocated, in which case the tree is
+ * unchanged.
+ * After removal, a grace period must be waited for before freeing or
+ * re-adding the node.
+ * Threads calling this API need to be registered RCU read-side threads,
+ * holding the read-side lock or not.
+ */
+extern
+int cds_itree_del(struct cds_itree *it, struct cds_itree_node *node);
+
+/*
+ * cds_itree_first_overlap - get the first node overlapping [start, last].
+ * @iter: filled with the query position, for cds_itree_next_overlap().
+ *
+ * Nodes are returned by increasing start. Return NULL if no node
+ * overlaps the interval.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_itree_node *cds_itree_first_overlap(struct cds_itree *it,
+		unsigned long start, unsigned long last,
+		struct cds_itree_iter *iter);
+
+/*
+ * cds_itree_next_overlap - get the next node overlapping the query
+ *                          interval.
+ *
+ * Return NULL at the end of the snapshot of the query.
+ * Call with the rcu_read_lock held since the query started.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_itree_node *cds_itree_next_overlap(struct cds_itree_iter *iter);
+
+/*
+ * Traversal of the nodes overlapping [start, last], or containing a
+ * point. Call with rcu_read_lock held.
+ */
+#define cds_itree_for_each_overlap(it, start, last, iter, node)		\
+	for (node = cds_itree_first_overlap(it, start, last, iter);	\
+		node != NULL;						\
+		node = cds_itree_next_overlap(iter))
+
+#define cds_itree_for_each_stab(it, point, iter, node)			\
+	cds_itree_for_each_overlap(it, point, point, iter, node)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCUITREE_H */
@@ -0,0 +1,291 @@
+#ifndef _URCU_RCULFHASH_SHARD_H
+#define _URCU_RCULFHASH_SHARD_H
+
+/*
+ * urcu/rculfhash-shard.h
+ *
+ * Userspace RCU library - Sharded Lock-Free RCU Hash Table
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <errno.h>
+#include <urcu/rculfhash.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hash table split in independent cds_lfht shards, chosen by the high
+ * bits of the hash. Each shard has its own resize mutex and resize
+ * worker, so a table growing by several orders is resized one shard at
+ * a time, each resize copying a fraction of the buckets, while the
+ * updates of the other shards go on with short chains.
+ *
+ * Nodes are struct cds_lfht_node, and the hashed operations have the
+ * semantic of their cds_lfht counterpart within the shard of the hash.
+ * Iterations and counts walk the shards in turn: they are not atomic
+ * with respect to concurrent updates of different shards.
+ */
+struct cds_lfht_shard {
+	unsigned long mask;		/* number of shards - 1 */
+	unsigned int order;		/* log2 of the number of shards */
+	struct cds_lfht *ht[];
+};
+
+/*
+ * cds_lfht_shard_iter: iterator over all shards, see
+ * cds_lfht_shard_first().
+ */
+struct cds_lfht_shard_iter {
+	unsigned long index;		/* current shard */
+	struct cds_lfht_iter iter;
+};
+
+/*
+ * _cds_lfht_shard_new - API used by cds_lfht_shard_new wrapper. Do not
+ * use directly.
+ */
+extern
+struct cds_lfht_shard *_cds_lfht_shard_new(unsigned long nr_shards,
+			unsigned long init_size,
+			unsigned long min_nr_alloc_buckets,
+			unsigned long max_nr_buckets,
+			int flags,
+			const struct cds_lfht_mm_type *mm,
+			const struct rcu_flavor_struct *flavor,
+			pthread_attr_t *attr);
+
+/*
+ * cds_lfht_shard_new - allocate a sharded hash table.
+ * @nr_shards: number of shards, a power of two, at most
+ *             CAA_BITS_PER_LONG bits of them.
+ *
+ * Other parameters are those of cds_lfht_new(), for each shard: the
+ * sizes are per-shard bucket counts. Return NULL on error.
+ */
+static inline
+struct cds_lfht_shard *cds_lfht_shard_new(unsigned long nr_shards,
+			unsigned long init_size,
+			unsigned long min_nr_alloc_buckets,
+			unsigned long max_nr_buckets,
+			int flags,
+			pthread_attr_t *attr)
+{
+	return _cds_lfht_shard_new(nr_shards, init_size,
+			min_nr_alloc_buckets, max_nr_buckets, flags, NULL,
+			&rcu_flavor, attr);
+}
+
+/*
+ * cds_lfht_shard_destroy - destroy a sharded hash table.
+ * @attr: (output) resize worker thread attributes, as received by
+ *        cds_lfht_shard_new(). Can be NULL.
+ *
+ * Same requirements as cds_lfht_destroy(). Return 0 on success, or
+ * the error of the first shard failing to be destroyed, e.g. -EPERM if
+ * it is not empty: the shards before it are destroyed, and the call
+ * can be retried once the others are emptied.
+ */
+extern
+int cds_lfht_shard_destroy(struct cds_lfht_shard *sh, pthread_attr_t **attr);
+
+/*
+ * cds_lfht_shard_of - get the shard of a hash.
+ */
+static inline
+struct cds_lfht *cds_lfht_shard_of(struct cds_lfht_shard *sh,
+		unsigned long hash)
+{
+	unsigned long index = 0;
+	unsigned int i;
+
+	/*
+	 * The low bits of the reverse hash of the nodes, so that
+	 * cds_lfht_shard_of_node() needs no hash.
+	 */
+	for (i = 0; i < sh->order; i++)
+		index |= ((hash >> (CAA_BITS_PER_LONG - 1 - i)) & 1) << i;
+	return sh->ht[index];
+}
+
+/*
+ * cds_lfht_shard_of_node - get the shard of a node added to the table.
+ */
+static inline
+struct cds_lfht *cds_lfht_shard_of_node(struct cds_lfht_shard *sh,
+		struct cds_lfht_node *node)
+{
+	return sh->ht[node->reverse_hash & sh->mask];
+}
+
+/*
+ * cds_lfht_shard_lookup - same as cds_lfht_lookup().
+ */
+static inline
+void cds_lfht_shard_lookup(struct cds_lfht_shard *sh, unsigned long hash,
+		cds_lfht_match_fct match, const void *key,
+		struct cds_lfht_iter *iter)
+{
+	cds_lfht_lookup(cds_lfht_shard_of(sh, hash), hash, match, key, iter);
+}
+
+/*
+ * cds_lfht_shard_next_duplicate - same as cds_lfht_next_duplicate().
+ */
+static inline
+void cds_lfht_shard_next_duplicate(struct cds_lfht_shard *sh,
+		cds_lfht_match_fct match, const void *key,
+		struct cds_lfht_iter *iter)
+{
+	if (!iter->node)
+		return;
+	cds_lfht_next_duplicate(cds_lfht_shard_of_node(sh, iter->node),
+			match, key, iter);
+}
+
+/*
+ * cds_lfht_shard_add - same as cds_lfht_add().
+ */
+static inline
+void cds_lfht_shard_add(struct cds_lfht_shard *sh, unsigned long hash,
+		struct cds_lfht_node *node)
+{
+	cds_lfht_add(cds_lfht_shard_of(sh, hash), hash, node);
+}
+
+/*
+ * cds_lfht_shard_add_unique - same as cds_lfht_add_unique().
+ */
+static inline
+struct cds_lfht_node *cds_lfht_shard_add_unique(struct cds_lfht_shard *sh,
+		unsigned long hash,
+		cds_lfht_match_fct match,
+		const void *key,
+		struct cds_lfht_node *node)
+{
+	return cds_lfht_add_unique(cds_lfht_shard_of(sh, hash), hash, match,
+			key, node);
+}
+
+/*
+ * cds_lfht_shard_add_replace - same as cds_lfht_add_replace().
+ */
+static inline
+struct cds_lfht_node *cds_lfht_shard_add_replace(struct cds_lfht_shard *sh,
+		unsigned long hash,
+		cds_lfht_match_fct match,
+		const void *key,
+		struct cds_lfht_node *node)
+{
+	return cds_lfht_add_replace(cds_lfht_shard_of(sh, hash), hash, match,
+			key, node);
+}
+
+/*
+ * cds_lfht_shard_replace - same as cds_lfht_replace().
+ */
+static inline
+int cds_lfht_shard_replace(struct cds_lfht_shard *sh,
+		struct cds_lfht_iter *old_iter,
+		unsigned long hash,
+		cds_lfht_match_fct match,
+		const void *key,
+		struct cds_lfht_node *new_node)
+{
+	return cds_lfht_replace(cds_lfht_shard_of(sh, hash), old_iter, hash,
+			match, key, new_node);
+}
+
+/*
+ * cds_lfht_shard_del - same as cds_lfht_del().
+ */
+static inline
+int cds_lfht_shard_del(struct cds_lfht_shard *sh, struct cds_lfht_node *node)
+{
+	if (!node)
+		return -ENOENT;
+	return cds_lfht_del(cds_lfht_shard_of_node(sh, node), node);
+}
+
+/*
+ * cds_lfht_shard_first - get the first node of the table.
+ * @iter: iterator over the shards. iter->iter.node is set to NULL if
+ *        the table is empty.
+ *
+ * Output in "*iter". Call with rcu_read_lock held. The shards are
+ * walked in index order.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+void cds_lfht_shard_first(struct cds_lfht_shard *sh,
+		struct cds_lfht_shard_iter *iter);
+
+/*
+ * cds_lfht_shard_next - get the next node of the table.
+ *
+ * Input/Output in "*iter". iter->iter.node is set to NULL at the end
+ * of the table. Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+void cds_lfht_shard_next(struct cds_lfht_shard *sh,
+		struct cds_lfht_shard_iter *iter);
+
+#define cds_lfht_shard_for_each(sh, shard_iter, node)			\
+	for (cds_lfht_shard_first(sh, shard_iter),			\
+			node = cds_lfht_iter_get_node(&(shard_iter)->iter); \
+		node != NULL;						\
+		cds_lfht_shard_next(sh, shard_iter),			\
+			node = cds_lfht_iter_get_node(&(shard_iter)->iter))
+
+/*
+ * cds_lfht_shard_count_nodes - sum of cds_lfht_count_nodes() over the
+ * shards.
+ *
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+void cds_lfht_shard_count_nodes(struct cds_lfht_shard *sh,
+		long *split_count_before,
+		unsigned long *count,
+		long *split_count_after);
+
+/*
+ * cds_lfht_shard_size_approx - sum of cds_lfht_size_approx() over the
+ * shards. Return 0, or -EINVAL if the shards have no accounting.
+ */
+extern
+int cds_lfht_shard_size_approx(struct cds_lfht_shard *sh,
+		unsigned long *approx);
+
+/*
+ * cds_lfht_shard_resize - resize each shard to new_size buckets, one
+ * after the other.
+ *
+ * Same requirements as cds_lfht_resize().
+ */
+extern
+void cds_lfht_shard_resize(struct cds_lfht_shard *sh, unsigned long new_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCULFHASH_SHARD_H */
@@ -0,0 +1,209 @@
+#ifndef _URCU_RCULFHASH_SNAPSHOT_H
+#define _URCU_RCULFHASH_SNAPSHOT_H
+
+/*
+ * urcu/rculfhash-snapshot.h
+ *
+ * Userspace RCU library - Versioned Lock-Free RCU Hash Table snapshots
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <pthread.h>
+#include <urcu/system.h>
+#include <urcu/list.h>
+#include <urcu/rculfhash.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Versioned mode of a cds_lfht, for consistent traversals (e.g.
+ * checkpoints) without stopping the updaters. Nodes are struct
+ * cds_lfht_vnode, tagged with the generation of their insertion and of
+ * their deletion. A snapshot closes the current generation: its
+ * traversal yields exactly the nodes inserted at or before it and not
+ * deleted at or before it, whatever the concurrent updates.
+ *
+ * cds_lfht_vdel() only tags the node while a snapshot may still need
+ * it: it stays linked in the table, skipped by cds_lfht_vlookup(),
+ * cds_lfht_vadd_unique() and snapshots of later generations, and is
+ * removed with cds_lfht_del() once the snapshots older than its
+ * deletion are released. Without snapshot, cds_lfht_vdel() removes the
+ * node at once. Either way, the removal hands the node to the reclaim
+ * callback of the table, which must be set (cds_lfht_set_reclaim()) to
+ * free the nodes.
+ *
+ * All updates of the table must go through the cds_lfht_v* functions,
+ * and lookups must use cds_lfht_vlookup() (plain lookups may return
+ * deleted nodes not yet removed).
+ */
+struct cds_lfht_vnode {
+	struct cds_lfht_node node;
+	unsigned long ins_gen;
+	unsigned long del_gen;		/* 0 until deleted */
+	struct cds_lfht_vnode *retired_next;	/* private */
+};
+
+struct cds_lfht_versioned {
+	struct cds_lfht *ht;
+	const struct rcu_flavor_struct *flavor;
+	unsigned long gen;		/* tags the updates */
+	unsigned long nr_snapshots;
+	pthread_mutex_t lock;		/* protects the fields below */
+	struct cds_list_head snapshots;
+	struct cds_lfht_vnode *retired;	/* deleted while needed */
+	unsigned long nr_retired;
+};
+
+struct cds_lfht_snapshot {
+	struct cds_list_head node;
+	unsigned long gen;
+};
+
+/*
+ * _cds_lfht_versioned_init - API used by cds_lfht_versioned_init
+ * wrapper. Do not use directly.
+ */
+extern
+void _cds_lfht_versioned_init(struct cds_lfht_versioned *vt,
+		struct cds_lfht *ht, const struct rcu_flavor_struct *flavor);
+
+/*
+ * cds_lfht_versioned_init - use an empty hash table in versioned mode.
+ * @vt: the versioned mode state.
+ * @ht: the hash table, with a reclaim callback.
+ */
+static inline
+void cds_lfht_versioned_init(struct cds_lfht_versioned *vt,
+		struct cds_lfht *ht)
+{
+	_cds_lfht_versioned_init(vt, ht, &rcu_flavor);
+}
+
+/*
+ * cds_lfht_versioned_fini - leave versioned mode.
+ *
+ * Removes the deleted nodes still linked. Return 0 on success, or
+ * -EBUSY if a snapshot is still held.
+ * Threads calling this API need to be registered RCU read-side threads,
+ * outside of read-side critical section.
+ */
+extern
+int cds_lfht_versioned_fini(struct cds_lfht_versioned *vt);
+
+/*
+ * cds_lfht_vadd - add a node, as cds_lfht_add().
+ */
+extern
+void cds_lfht_vadd(struct cds_lfht_versioned *vt, unsigned long hash,
+		struct cds_lfht_vnode *vnode);
+
+/*
+ * cds_lfht_vadd_unique - add a node unless a node matching the key is
+ * present, as cds_lfht_add_unique(). Deleted nodes not yet removed do
+ * not count as present.
+ */
+extern
+struct cds_lfht_node *cds_lfht_vadd_unique(struct cds_lfht_versioned *vt,
+		unsigned long hash, cds_lfht_match_fct match, const void *key,
+		struct cds_lfht_vnode *vnode);
+
+/*
+ * cds_lfht_vlookup - lookup a node not deleted, as cds_lfht_lookup().
+ */
+extern
+void cds_lfht_vlookup(struct cds_lfht_versioned *vt, unsigned long hash,
+		cds_lfht_match_fct match, const void *key,
+		struct cds_lfht_iter *iter);
+
+/*
+ * cds_lfht_vdel - delete a node.
+ *
+ * Return 0 on success, or -ENOENT if the node was already deleted.
+ * Same calling context requirements as cds_lfht_del().
+ */
+extern
+int cds_lfht_vdel(struct cds_lfht_versioned *vt, struct cds_lfht_vnode *vnode);
+
+/*
+ * cds_lfht_snapshot_take - take a snapshot of the current generation.
+ *
+ * Waits for a grace period, so that the updates of the generation are
+ * all visible in the table.
+ * Threads calling this API need to be registered RCU read-side threads,
+ * outside of read-side critical section.
+ */
+extern
+void cds_lfht_snapshot_take(struct cds_lfht_versioned *vt,
+		struct cds_lfht_snapshot *snap);
+
+/*
+ * cds_lfht_snapshot_release - release a snapshot, and remove the
+ * deleted nodes no snapshot needs anymore.
+ * Threads calling this API need to be registered RCU read-side threads,
+ * outside of read-side critical section.
+ */
+extern
+void cds_lfht_snapshot_release(struct cds_lfht_versioned *vt,
+		struct cds_lfht_snapshot *snap);
+
+/*
+ * cds_lfht_snapshot_visible - whether a node belongs to a snapshot.
+ */
+static inline
+int cds_lfht_snapshot_visible(const struct cds_lfht_snapshot *snap,
+		struct cds_lfht_vnode *vnode)
+{
+	unsigned long del_gen = CMM_LOAD_SHARED(vnode->del_gen);
+
+	return vnode->ins_gen <= snap->gen
+		&& (!del_gen || del_gen > snap->gen);
+}
+
+/*
+ * cds_lfht_snapshot_first - get the first node of a snapshot.
+ * cds_lfht_snapshot_next - get the next node of a snapshot.
+ *
+ * Traverse the table as cds_lfht_first() and cds_lfht_next(), skipping
+ * the nodes not in the snapshot. The whole traversal must be performed
+ * within a single RCU read-side critical section for the snapshot to be
+ * exact.
+ */
+extern
+void cds_lfht_snapshot_first(struct cds_lfht_versioned *vt,
+		const struct cds_lfht_snapshot *snap,
+		struct cds_lfht_iter *iter);
+
+extern
+void cds_lfht_snapshot_next(struct cds_lfht_versioned *vt,
+		const struct cds_lfht_snapshot *snap,
+		struct cds_lfht_iter *iter);
+
+#define cds_lfht_for_each_snapshot(vt, snap, iter, node)		\
+	for (cds_lfht_snapshot_first(vt, snap, iter),			\
+			node = cds_lfht_iter_get_node(iter);		\
+		node != NULL;						\
+		cds_lfht_snapshot_next(vt, snap, iter),			\
+			node = cds_lfht_iter_get_node(iter))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCULFHASH_SNAPSHOT_H */
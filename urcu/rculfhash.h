@@ -24,12 +24,24 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  *
  * Include this file _after_ including your URCU flavor.
+ *
+ * liburcu-cds accepts hash tables of any flavor, calling the flavor
+ * primitives through struct rcu_flavor_struct. The liburcu-cds-memb,
+ * -qsbr, -mb, -signal and -bp libraries export the same API, but are
+ * built for a single flavor, with its primitives inlined: link against
+ * the one matching your flavor instead of liburcu-cds. cds_lfht_new()
+ * returns NULL if the flavor does not match.
  */
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <urcu/compiler.h>
 #include <urcu-call-rcu.h>
 #include <urcu-flavor.h>
+#include <urcu-domain.h>
+#include <urcu-stats.h>
+#include <urcu/rculist.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -56,23 +68,167 @@ extern "C" {
  * The structure which embeds it typically holds the key (or key-value
  * pair) of the object. The caller code is responsible for calculation
  * of the hash value for cds_lfht APIs.
+ *
+ * There is no 32-bit reverse_hash mode on 64-bit architectures. It
+ * would not make the nodes smaller: the next pointer keeps its 8-byte
+ * alignment, so the node would still be padded to 16 bytes. Packing it
+ * to 12 bytes would make the next pointers of bucket node tables
+ * straddle cache lines, and the atomic operations on them split locks.
+ * Bucket tables are arrays of this same structure, so they would not
+ * shrink either. They could only shrink by dropping the reverse_hash
+ * of the bucket nodes, which is the bit-reversed bucket index. Every
+ * chain walk, including the inlined _cds_lfht_lookup(), would then
+ * need to find the index of each bucket node it meets from the bucket
+ * table which holds it. Tables never holding more than 2^32 buckets
+ * only need a max_nr_buckets of at most 2^32 at creation: their bucket
+ * tables never grow past that order, whatever MAX_TABLE_ORDER is, and
+ * the unused entries of the per-order table pointer array cost 256
+ * bytes per table.
  */
 struct cds_lfht_node {
 	struct cds_lfht_node *next;	/* ptr | REMOVAL_OWNER_FLAG | BUCKET_FLAG | REMOVED_FLAG */
 	unsigned long reverse_hash;
 } __attribute__((aligned(8)));
 
+/*
+ * cds_lfht_node_u64: Hash table node with an inline 64-bit key, used
+ * by the *_u64 functions. These compare the key stored next to the
+ * node instead of calling a match function.
+ */
+struct cds_lfht_node_u64 {
+	struct cds_lfht_node node;
+	uint64_t key;
+};
+
+/*
+ * cds_lfht_dup_node: Node of a multimap, added with cds_lfht_add_dup().
+ * The duplicates of a key are kept in a RCU list of a single group
+ * node of the hash chain, struct cds_lfht_dup_group, so lookups of
+ * other keys step over one node per distinct key.
+ */
+struct cds_lfht_dup_group;
+
+struct cds_lfht_dup_node {
+	struct cds_list_head list;	/* duplicates of the group */
+	struct cds_lfht_dup_group *group;	/* private */
+};
+
+struct cds_lfht_dup_group {
+	struct cds_lfht_node node;
+	struct cds_list_head dups;	/* RCU list of duplicates */
+	/* Private fields, protected by lock. */
+	struct cds_lfht_dup_node *key_node;	/* compared by lookups */
+	pthread_mutex_t lock;
+	unsigned long nr_dups;
+	int dead;
+	struct rcu_domain *domain;
+	struct rcu_head head;
+};
+
+/*
+ * cds_lfht_frozen: Immutable open-addressed copy of the nodes of a hash
+ * table, built by cds_lfht_freeze(). Nodes are found at the slot of
+ * their hash, or after it with linear probing, and the match function
+ * is only called for slots holding the same hash.
+ */
+struct cds_lfht_frozen_slot {
+	unsigned long hash;
+	struct cds_lfht_node *node;	/* NULL for an empty slot */
+};
+
+struct cds_lfht_frozen {
+	unsigned long mask;		/* number of slots - 1 */
+	unsigned long nr_nodes;
+	struct cds_lfht_frozen_slot slots[];
+};
+
+/* cds_lfht_frozen_iter: Used to traverse the duplicates of a key. */
+struct cds_lfht_frozen_iter {
+	struct cds_lfht_node *node;
+	unsigned long pos;
+};
+
 /* cds_lfht_iter: Used to track state while traversing a hash chain. */
 struct cds_lfht_iter {
 	struct cds_lfht_node *node, *next;
 };
 
+/*
+ * cds_lfht_prefetch_iter: Used to traverse the whole table while
+ * prefetching the buckets ahead, see cds_lfht_prefetch_first().
+ */
+struct cds_lfht_prefetch_iter {
+	struct cds_lfht_iter iter;
+	unsigned long size;	/* table size when the traversal started */
+	unsigned long rank;	/* rank of the current bucket in the list */
+	unsigned long distance;	/* in buckets */
+	long offset;		/* of the object data to prefetch */
+};
+
+/*
+ * cds_lfht_partition_iter: Used to traverse one partition of the table,
+ * see cds_lfht_partition_first().
+ */
+struct cds_lfht_partition_iter {
+	struct cds_lfht_iter iter;
+	unsigned long end;	/* first reverse hash past the partition */
+	int last;		/* last partition, no upper bound */
+};
+
+/*
+ * cds_lfht_cursor: Position within the table, kept across RCU read-side
+ * critical sections, see cds_lfht_cursor_first().
+ */
+struct cds_lfht_cursor {
+	unsigned long reverse_hash;	/* reverse hash of the next node */
+	unsigned long skip;	/* nodes already visited with that hash */
+	int end;		/* traversal completed */
+};
+
+/* Kind of step of a merge traversal, see cds_lfht_merge_first(). */
+enum cds_lfht_merge_kind {
+	CDS_LFHT_MERGE_END = 0,		/* traversal completed */
+	CDS_LFHT_MERGE_LEFT,		/* node only in the left table */
+	CDS_LFHT_MERGE_RIGHT,		/* node only in the right table */
+	CDS_LFHT_MERGE_BOTH,		/* matching nodes in both tables */
+};
+
+/* Return non-zero if the keys of @left and @right are equal. */
+typedef int (*cds_lfht_merge_match_fct)(struct cds_lfht_node *left,
+		struct cds_lfht_node *right);
+
+/*
+ * cds_lfht_merge_iter: Used to traverse two tables in parallel, see
+ * cds_lfht_merge_first(). The nodes of the current step are in @left
+ * and @right.
+ */
+struct cds_lfht_merge_iter {
+	struct cds_lfht_node *left, *right;	/* current step */
+	struct cds_lfht *left_ht, *right_ht;
+	cds_lfht_merge_match_fct match;
+	struct cds_lfht_iter l, r;		/* next nodes of each table */
+	struct cds_lfht_iter l_run, r_run;	/* first nodes of a hash run */
+	unsigned long run_hash;			/* reverse hash of the run */
+	int phase;
+};
+
 static inline
 struct cds_lfht_node *cds_lfht_iter_get_node(struct cds_lfht_iter *iter)
 {
 	return iter->node;
 }
 
+/*
+ * cds_lfht_cursor_init - position a cursor on the first node of a table.
+ */
+static inline
+void cds_lfht_cursor_init(struct cds_lfht_cursor *cursor)
+{
+	cursor->reverse_hash = 0;
+	cursor->skip = 0;
+	cursor->end = 0;
+}
+
 struct cds_lfht;
 
 /*
@@ -100,6 +256,11 @@ void cds_lfht_node_init(struct cds_lfht_node *node)
 enum {
 	CDS_LFHT_AUTO_RESIZE = (1U << 0),
 	CDS_LFHT_ACCOUNTING = (1U << 1),
+	CDS_LFHT_INCREMENTAL_RESIZE = (1U << 2),
+	CDS_LFHT_LAZY_ACCOUNTING = (1U << 3),
+	CDS_LFHT_FILTER = (1U << 4),
+	CDS_LFHT_LOOKUP_CACHE = (1U << 5),
+	CDS_LFHT_ASYNC_INIT = (1U << 6),
 };
 
 struct cds_lfht_mm_type {
@@ -114,6 +275,53 @@ struct cds_lfht_mm_type {
 extern const struct cds_lfht_mm_type cds_lfht_mm_order;
 extern const struct cds_lfht_mm_type cds_lfht_mm_chunk;
 extern const struct cds_lfht_mm_type cds_lfht_mm_mmap;
+extern const struct cds_lfht_mm_type cds_lfht_mm_hugepage;
+extern const struct cds_lfht_mm_type cds_lfht_mm_numa;
+extern const struct cds_lfht_mm_type cds_lfht_mm_file;
+
+/*
+ * cds_lfht_mm_file_set_dir - set the directory of cds_lfht_mm_file.
+ * @dir: directory the bucket tables of the tables created next with
+ *       cds_lfht_mm_file are mapped from, each from an unlinked file,
+ *       e.g. on a DAX file system. NULL for anonymous memory, the
+ *       default.
+ *
+ * Return 0, or -ENOMEM. The file of a table is created when the table
+ * is, and is not kept across restarts: bucket and node pointers are
+ * process addresses.
+ */
+extern
+int cds_lfht_mm_file_set_dir(const char *dir);
+
+/*
+ * Automatic resize policy, used with CDS_LFHT_AUTO_RESIZE.
+ * Loads are expressed in nodes per bucket and must be powers of 2.
+ * Fields left to 0 take their default value.
+ *
+ * @target_load: load the table is resized to (default 1).
+ * @grow_load: grow the table when its load reaches this value
+ *             (default 8).
+ * @shrink_load: on removal, resize the table to the target load when
+ *               its load is below this value (default 8). Must be
+ *               smaller than or equal to grow_load. Lowering it below
+ *               the target load adds hysteresis between grow and
+ *               shrink. Shrinking requires CDS_LFHT_ACCOUNTING.
+ * @grow_chain_len: grow the table when a chain reaches this length
+ *                  while the table is small or has no accounting
+ *                  (default 3).
+ * @max_grow_order: grow at most (1 << max_grow_order) times per
+ *                  resize (default: unlimited).
+ * @max_shrink_order: shrink at most (1 << max_shrink_order) times per
+ *                    resize (default: unlimited).
+ */
+struct cds_lfht_resize_policy {
+	unsigned long target_load;
+	unsigned long grow_load;
+	unsigned long shrink_load;
+	unsigned int grow_chain_len;
+	unsigned int max_grow_order;
+	unsigned int max_shrink_order;
+};
 
 /*
  * _cds_lfht_new - API used by cds_lfht_new wrapper. Do not use directly.
@@ -127,6 +335,20 @@ struct cds_lfht *_cds_lfht_new(unsigned long init_size,
 			const struct rcu_flavor_struct *flavor,
 			pthread_attr_t *attr);
 
+/*
+ * _cds_lfht_new_policy - API used by cds_lfht_new_policy wrapper. Do not
+ * use directly.
+ */
+extern
+struct cds_lfht *_cds_lfht_new_policy(unsigned long init_size,
+			unsigned long min_nr_alloc_buckets,
+			unsigned long max_nr_buckets,
+			int flags,
+			const struct cds_lfht_mm_type *mm,
+			const struct rcu_flavor_struct *flavor,
+			const struct cds_lfht_resize_policy *policy,
+			pthread_attr_t *attr);
+
 /*
  * cds_lfht_new - allocate a hash table.
  * @init_size: number of buckets to allocate initially. Must be power of two.
@@ -140,6 +362,46 @@ struct cds_lfht *_cds_lfht_new(unsigned long init_size,
  *           CDS_LFHT_AUTO_RESIZE: automatically resize hash table.
  *           CDS_LFHT_ACCOUNTING: count the number of node addition
  *                                and removal in the table
+ *           CDS_LFHT_INCREMENTAL_RESIZE: resize in small slices from
+ *                                the resize worker, without resize
+ *                                worker pool, yielding between
+ *                                slices. As for all tables, add/del
+ *                                operations each populate one slice
+ *                                of the buckets being added.
+ *           CDS_LFHT_LAZY_ACCOUNTING: implies CDS_LFHT_ACCOUNTING, count
+ *                                additions and removals with plain
+ *                                per-CPU increments instead of atomic
+ *                                ones. The count may miss updates
+ *                                preempted or migrated between the
+ *                                load and store of the increment,
+ *                                which is fine for resize heuristics
+ *                                but makes cds_lfht_size_approx()
+ *                                drift. Restartable sequences, when
+ *                                available, keep the count exact.
+ *           CDS_LFHT_FILTER: keep a counting Bloom filter of the hashes
+ *                                of the nodes, checked by the lookups
+ *                                before walking the hash chain: most
+ *                                lookups of absent keys only load one
+ *                                cache line of the filter. Additions
+ *                                and removals update the filter, and
+ *                                each resize rebuilds it for the new
+ *                                size, with four grace periods. It
+ *                                takes 8 bytes per bucket.
+ *           CDS_LFHT_LOOKUP_CACHE: cds_lfht_lookup() first checks a
+ *                                per-thread direct-mapped cache of the
+ *                                nodes it last found, by hash, and
+ *                                only walks the hash chain on a miss.
+ *                                Each removal from the table
+ *                                invalidates all the cached nodes of
+ *                                the table. Suits read-mostly tables
+ *                                with a few hot keys.
+ *           CDS_LFHT_ASYNC_INIT: only populate min_nr_alloc_buckets
+ *                                buckets before returning, and grow
+ *                                the table to init_size in the
+ *                                background, as cds_lfht_resize_async().
+ *                                The table is usable meanwhile. The
+ *                                calling thread needs to be a
+ *                                registered RCU read-side thread.
  * @attr: optional resize worker thread attributes. NULL for default.
  *
  * Return NULL on error.
@@ -167,6 +429,26 @@ struct cds_lfht *cds_lfht_new(unsigned long init_size,
 			flags, NULL, &rcu_flavor, attr);
 }
 
+/*
+ * cds_lfht_new_policy - allocate a hash table with a resize policy.
+ * @policy: automatic resize policy, copied by the hash table. NULL for
+ *          default.
+ *
+ * Other parameters are the same as for cds_lfht_new(). Return NULL on
+ * error, including invalid policy values.
+ */
+static inline
+struct cds_lfht *cds_lfht_new_policy(unsigned long init_size,
+			unsigned long min_nr_alloc_buckets,
+			unsigned long max_nr_buckets,
+			int flags,
+			const struct cds_lfht_resize_policy *policy,
+			pthread_attr_t *attr)
+{
+	return _cds_lfht_new_policy(init_size, min_nr_alloc_buckets,
+			max_nr_buckets, flags, NULL, &rcu_flavor, policy, attr);
+}
+
 /*
  * cds_lfht_destroy - destroy a hash table.
  * @ht: the hash table to destroy.
@@ -184,6 +466,57 @@ struct cds_lfht *cds_lfht_new(unsigned long init_size,
 extern
 int cds_lfht_destroy(struct cds_lfht *ht, pthread_attr_t **attr);
 
+/*
+ * cds_lfht_destroy_free - destroy a hash table and its nodes.
+ * @ht: the hash table to destroy.
+ * @free_node: called for each node left in the table.
+ * @priv: private data passed to free_node.
+ * @attr: (output) resize worker thread attributes, see cds_lfht_destroy().
+ *
+ * Same as cds_lfht_destroy(), except that the table does not need to
+ * be empty: every node left in the table is passed to free_node, which
+ * can free it right away. The caller must therefore guarantee that no
+ * reader can still hold a reference to the nodes, e.g. by waiting for
+ * a grace period after the table has been made unreachable. Large
+ * tables are split across the resize worker threads, so free_node may
+ * be called concurrently from several threads.
+ * Return 0 on success, negative error value on error.
+ * Same calling context requirements as cds_lfht_destroy().
+ */
+extern
+int cds_lfht_destroy_free(struct cds_lfht *ht,
+		void (*free_node)(struct cds_lfht_node *node, void *priv),
+		void *priv, pthread_attr_t **attr);
+
+/*
+ * cds_lfht_destroy_done_fct - called once a cds_lfht_destroy_async()
+ * table is freed, with the resize worker thread attributes received by
+ * cds_lfht_new().
+ */
+typedef void (*cds_lfht_destroy_done_fct)(pthread_attr_t *attr, void *priv);
+
+/*
+ * cds_lfht_destroy_async - destroy a hash table after a grace period.
+ * @ht: the hash table to destroy, empty.
+ * @done: called from the call_rcu worker once the table is freed. Can
+ *        be NULL.
+ * @priv: passed to @done.
+ *
+ * Marks the table as being destroyed, which makes its pending lazy and
+ * asynchronous resizes bail out, and queues the freeing of the table
+ * with call_rcu, after the end of the resizes in progress. No update
+ * can be issued on the table once called, but readers which found it
+ * before may still traverse it until the end of their read-side
+ * critical section.
+ * Return 0, -EPERM if the table is not empty, or -ENOMEM if the
+ * destroy cannot be queued; the table is left untouched on error.
+ * Unlike cds_lfht_destroy(), it does not wait, and can be called from
+ * a RCU read-side critical section or a call_rcu callback.
+ */
+extern
+int cds_lfht_destroy_async(struct cds_lfht *ht,
+		cds_lfht_destroy_done_fct done, void *priv);
+
 /*
  * cds_lfht_count_nodes - count the number of nodes in the hash table.
  * @ht: the hash table.
@@ -200,6 +533,181 @@ void cds_lfht_count_nodes(struct cds_lfht *ht,
 		unsigned long *count,
 		long *split_count_after);
 
+/*
+ * Hash table statistics, see cds_lfht_get_stats().
+ *
+ * chain_len_hist[i] counts the buckets holding i nodes, the last entry
+ * counting the buckets holding CDS_LFHT_STATS_CHAIN_HIST - 1 nodes or
+ * more. buckets_per_order[i] counts the bucket nodes of order i found
+ * in the table (bucket 0 is order 0, bucket j is order fls(j)).
+ */
+#define CDS_LFHT_STATS_CHAIN_HIST	16
+
+struct cds_lfht_stats {
+	unsigned long size;		/* current number of buckets */
+	unsigned long resize_target;	/* number of buckets targeted */
+	unsigned long nr_nodes;		/* nodes in the table */
+	unsigned long nr_removed;	/* removed nodes not unlinked yet */
+	unsigned long nr_buckets;	/* bucket nodes in the table */
+	unsigned long max_chain_len;	/* longest chain, in nodes */
+	unsigned long chain_len_hist[CDS_LFHT_STATS_CHAIN_HIST];
+	unsigned long buckets_per_order[CAA_BITS_PER_LONG + 1];
+};
+
+/*
+ * cds_lfht_get_stats - scan the hash table and gather statistics.
+ * @ht: the hash table.
+ * @stats: (output) the statistics.
+ *
+ * Traverses the whole table, counting the nodes linked between each
+ * bucket node and the next. With concurrent updates, the statistics
+ * are approximate. A skewed chain length histogram for a table at its
+ * target size reveals a poor hash function.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+void cds_lfht_get_stats(struct cds_lfht *ht, struct cds_lfht_stats *stats);
+
+/*
+ * cds_lfht_bucket_memory - memory allocated for the bucket nodes.
+ * @ht: the hash table.
+ *
+ * Return the number of bytes of bucket tables currently allocated by
+ * the memory management plugin, whether resident or not (see
+ * cds_lfht_bucket_resident_memory()). Bucket tables of the orders
+ * removed by a shrink are returned to the system (unmapped or freed)
+ * after a grace period, and stop being accounted then.
+ * Does not need to be called with rcu_read_lock held.
+ */
+extern
+unsigned long cds_lfht_bucket_memory(struct cds_lfht *ht);
+
+/*
+ * cds_lfht_bucket_resident_memory - resident memory of the bucket nodes.
+ * @ht: the hash table.
+ *
+ * Return the number of bytes of the allocated bucket tables which are
+ * resident in memory, as reported by mincore(2) with page granularity.
+ * Pages also holding other data (e.g. small tables allocated from the
+ * heap) only count for their bytes within the bucket tables. Walks the
+ * bucket tables with one system call per contiguous range: bucket
+ * table, or chunk with the chunk and numa plugins (one system call for
+ * all tables with the mmap, file and hugepage plugins). Approximate
+ * while a resize is in progress. Returns cds_lfht_bucket_memory() on
+ * systems lacking mincore(2).
+ * Does not need to be called with rcu_read_lock held.
+ */
+extern
+unsigned long cds_lfht_bucket_resident_memory(struct cds_lfht *ht);
+
+/*
+ * Resize statistics, see cds_lfht_get_resize_stats().
+ *
+ * A resize changes the table size once, possibly by several orders.
+ * Each order grown or shrunk is one level, populated or removed by
+ * the resize worker and its partition helpers, which also free the
+ * nodes on cds_lfht_destroy_free().
+ */
+struct cds_lfht_resize_stats {
+	unsigned long nr_resizes;	/* completed size changes */
+	unsigned long nr_levels;	/* levels processed */
+	uint64_t helper_ns;		/* time spent processing levels */
+};
+
+/*
+ * cds_lfht_resize_in_progress - whether a resize is pending or running.
+ * @ht: the hash table.
+ *
+ * Return non-zero from the time a resize is queued until the resize
+ * worker completes it. Does not need to be called with rcu_read_lock
+ * held.
+ */
+extern
+int cds_lfht_resize_in_progress(struct cds_lfht *ht);
+
+/*
+ * cds_lfht_get_resize_stats - resize statistics since table creation.
+ * @ht: the hash table.
+ * @stats: (output) the statistics.
+ *
+ * helper_ns is the wall-clock time of the bucket population and
+ * removal passes, including the time their partition workers wait for
+ * each other. Does not need to be called with rcu_read_lock held.
+ */
+extern
+void cds_lfht_get_resize_stats(struct cds_lfht *ht,
+		struct cds_lfht_resize_stats *stats);
+
+/*
+ * cds_lfht_get_resize_lock_stats - contention statistics of the resize
+ * mutex, serializing resizes and cds_lfht_set_resize_workers().
+ * @ht: the hash table.
+ * @stats: (output) the statistics.
+ *
+ * Return 0 on success, or -ENOSYS if the library is not configured
+ * with --enable-rcu-lock-stats, in which case @stats is zeroed. Does
+ * not need to be called with rcu_read_lock held.
+ */
+extern
+int cds_lfht_get_resize_lock_stats(struct cds_lfht *ht,
+		struct rcu_lock_stats *stats);
+
+/*
+ * Operation statistics, see cds_lfht_get_op_stats().
+ *
+ * nr_lookup_nodes counts the nodes compared by the lookups, so
+ * nr_lookup_nodes / nr_lookups is the average chain walk. nr_adds and
+ * nr_dels count the nodes added and removed, including by replacements
+ * and sweeps. nr_cas_retries counts the insertions restarted after
+ * losing a compare-and-swap race, including the insertions of bucket
+ * nodes by resizes. nr_gc_passes counts the garbage collection passes
+ * of removals, and nr_gc_helps the removed nodes unlinked by insertions
+ * on their way, on behalf of a concurrent removal (completing its pass).
+ */
+struct cds_lfht_op_stats {
+	unsigned long nr_lookups;
+	unsigned long nr_lookup_nodes;
+	unsigned long nr_adds;
+	unsigned long nr_dels;
+	unsigned long nr_cas_retries;
+	unsigned long nr_gc_passes;
+	unsigned long nr_gc_helps;
+};
+
+/*
+ * cds_lfht_get_op_stats - operation statistics since table creation.
+ * @ht: the hash table.
+ * @stats: (output) the statistics.
+ *
+ * The operations are counted per CPU, and summed by this call. Only
+ * the lookups of the library functions are counted, not those of the
+ * static inline lookups of urcu/static/rculfhash.h. The resize work is
+ * reported by cds_lfht_get_resize_stats().
+ * Return 0 on success, -ENOMEM if the counters could not be allocated
+ * at table creation, or -ENOSYS if the library is not configured with
+ * --enable-rcu-lfht-stats, in which case the operations are not
+ * counted at all. @stats is zeroed on error. Does not need to be
+ * called with rcu_read_lock held.
+ */
+extern
+int cds_lfht_get_op_stats(struct cds_lfht *ht, struct cds_lfht_op_stats *stats);
+
+/*
+ * cds_lfht_size_approx - approximate number of nodes in the hash table.
+ * @ht: the hash table.
+ * @approx: (output) sum of the node count split-counters.
+ *
+ * Sums the per-CPU split-counters without traversing the table, in
+ * O(number of CPUs). The result is exact when no add or removal is
+ * in progress, and approximate otherwise.
+ * Return 0 on success, -EINVAL if the table has been created without
+ * CDS_LFHT_ACCOUNTING.
+ * Does not need to be called with rcu_read_lock held.
+ */
+extern
+int cds_lfht_size_approx(struct cds_lfht *ht, unsigned long *approx);
+
 /*
  * cds_lfht_lookup - lookup a node by key.
  * @ht: the hash table.
@@ -217,6 +725,61 @@ void cds_lfht_lookup(struct cds_lfht *ht, unsigned long hash,
 		cds_lfht_match_fct match, const void *key,
 		struct cds_lfht_iter *iter);
 
+/*
+ * cds_lfht_lookup_u64 - lookup a node with an inline 64-bit key.
+ * @ht: the hash table.
+ * @hash: the key hash.
+ * @key: the key to lookup.
+ * @iter: node, if found (output). *iter->node set to NULL if not found.
+ *
+ * Same as cds_lfht_lookup() for tables of struct cds_lfht_node_u64
+ * nodes, comparing the inline keys without any match function call.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * This function acts as a rcu_dereference() to read the node pointer.
+ */
+extern
+void cds_lfht_lookup_u64(struct cds_lfht *ht, unsigned long hash,
+		uint64_t key, struct cds_lfht_iter *iter);
+
+/*
+ * cds_lfht_next_duplicate_u64 - get the next node with the same key.
+ * @ht: the hash table.
+ * @key: the current node key.
+ * @iter: input: current iterator.
+ *        output: node, if found. *iter->node set to NULL if not found.
+ *
+ * Same as cds_lfht_next_duplicate() for struct cds_lfht_node_u64 nodes.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * This function acts as a rcu_dereference() to read the node pointer.
+ */
+extern
+void cds_lfht_next_duplicate_u64(struct cds_lfht *ht, uint64_t key,
+		struct cds_lfht_iter *iter);
+
+/*
+ * cds_lfht_lookup_multi - lookup several keys in the hash table.
+ * @ht: the hash table.
+ * @nr: the number of keys to lookup.
+ * @hashes: the key hashes, hashes[i] being the hash of keys[i].
+ * @match: the key match function.
+ * @keys: the keys to lookup.
+ * @iters: lookup results (output), iters[i] being the result of the
+ *         lookup of keys[i].
+ *
+ * Same as calling cds_lfht_lookup() for each key, but the hash chains
+ * of the keys are walked interleaved, prefetching the next node of each
+ * chain, so the cache misses of the lookups overlap.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * This function acts as a rcu_dereference() to read the node pointers.
+ */
+extern
+void cds_lfht_lookup_multi(struct cds_lfht *ht, unsigned long nr,
+		const unsigned long *hashes, cds_lfht_match_fct match,
+		const void * const *keys, struct cds_lfht_iter *iters);
+
 /*
  * cds_lfht_next_duplicate - get the next item with same key, after iterator.
  * @ht: the hash table.
@@ -270,6 +833,187 @@ void cds_lfht_first(struct cds_lfht *ht, struct cds_lfht_iter *iter);
 extern
 void cds_lfht_next(struct cds_lfht *ht, struct cds_lfht_iter *iter);
 
+/*
+ * cds_lfht_prefetch_first - get the first node of a prefetching traversal.
+ * @ht: the hash table.
+ * @piter: the traversal state, the current node is in @piter->iter.
+ * @distance: number of buckets prefetched ahead of the current node
+ *            (at least 1).
+ * @offset: offset from the nodes of the data to prefetch, e.g. the
+ *          fields of the object containing the node that the traversal
+ *          reads.
+ *
+ * Same traversal as cds_lfht_first() and cds_lfht_next(), for full
+ * scans bound by memory latency. Following the next pointers fetches
+ * one node at a time, but the list visits the buckets in bit-reversed
+ * index order, so the buckets ahead are known without walking the
+ * list: when reaching a bucket, the first node of the bucket @distance
+ * buckets ahead in the list, and its data at @offset, are prefetched,
+ * as well as the bucket node itself twice as far ahead. With the load
+ * of about one node per bucket kept by resizes, this has about
+ * @distance nodes in flight. @piter->iter can be passed to
+ * cds_lfht_del() and cds_lfht_replace().
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+void cds_lfht_prefetch_first(struct cds_lfht *ht,
+		struct cds_lfht_prefetch_iter *piter, unsigned long distance,
+		long offset);
+
+/*
+ * cds_lfht_prefetch_next - get the next node of a prefetching traversal.
+ * @ht: the hash table.
+ * @piter: the traversal state, from cds_lfht_prefetch_first().
+ *
+ * @piter->iter.node set to NULL past the last table node.
+ * Call with rcu_read_lock held.
+ */
+extern
+void cds_lfht_prefetch_next(struct cds_lfht *ht,
+		struct cds_lfht_prefetch_iter *piter);
+
+/*
+ * cds_lfht_partition_first - get the first node of a table partition.
+ * @ht: the hash table.
+ * @index: the partition index, lower than @nr_partitions.
+ * @nr_partitions: the number of partitions the table is split into.
+ * @piter: First node of the partition, if exists (output).
+ *
+ * The table nodes are split into @nr_partitions disjoint partitions of
+ * contiguous buckets, which can be traversed concurrently by different
+ * threads (e.g. thread i traversing partition i) with
+ * cds_lfht_partition_next(). Each node is part of exactly one partition,
+ * whatever the number of buckets of the table, so concurrent resizes
+ * do not affect the partitioning. As with cds_lfht_next(), nodes added
+ * or removed concurrently may or may not be observed.
+ * Output in "*piter". piter->iter.node set to NULL if the partition is
+ * empty.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * This function acts as a rcu_dereference() to read the node pointer.
+ */
+extern
+void cds_lfht_partition_first(struct cds_lfht *ht, unsigned long index,
+		unsigned long nr_partitions,
+		struct cds_lfht_partition_iter *piter);
+
+/*
+ * cds_lfht_partition_next - get the next node of a table partition.
+ * @ht: the hash table.
+ * @piter: input: current partition iterator.
+ *         output: next node, if exists. piter->iter.node set to NULL if
+ *         not found.
+ *
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * This function acts as a rcu_dereference() to read the node pointer.
+ */
+extern
+void cds_lfht_partition_next(struct cds_lfht *ht,
+		struct cds_lfht_partition_iter *piter);
+
+/*
+ * cds_lfht_count_nodes_partition - count the nodes of a table partition.
+ * @ht: the hash table.
+ * @index: the partition index, lower than @nr_partitions.
+ * @nr_partitions: the number of partitions the table is split into.
+ * @count: the number of nodes in the partition (output).
+ *
+ * Counting each partition from a different thread and summing the
+ * results gives the same count as cds_lfht_count_nodes().
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+void cds_lfht_count_nodes_partition(struct cds_lfht *ht, unsigned long index,
+		unsigned long nr_partitions, unsigned long *count);
+
+/*
+ * cds_lfht_cursor_first - resume a traversal from a cursor.
+ * @ht: the hash table.
+ * @cursor: the cursor position, updated when nodes have been removed.
+ * @iter: the node at the cursor position, if exists (output).
+ *
+ * Get the first node sorting at or after the cursor position, looked up
+ * through the bucket index. Unlike iterators, cursors remain valid
+ * outside of RCU read-side critical sections, so a long traversal can
+ * be split in many critical sections: advance with
+ * cds_lfht_cursor_next(), and resume with cds_lfht_cursor_first() in
+ * the next critical section. Nodes are sorted by reverse hash, which
+ * does not depend on the table size, so the traversal is not affected
+ * by concurrent resize: each node present in the table during the
+ * whole traversal is visited exactly once. Adding or removing nodes
+ * with the same hash as the cursor position while the traversal is
+ * suspended may cause nodes of that hash to be skipped or visited
+ * twice.
+ * Output in "*iter". iter->node set to NULL if the traversal is
+ * completed.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+void cds_lfht_cursor_first(struct cds_lfht *ht,
+		struct cds_lfht_cursor *cursor,
+		struct cds_lfht_iter *iter);
+
+/*
+ * cds_lfht_cursor_next - advance a cursor to the next node.
+ * @ht: the hash table.
+ * @cursor: the cursor, positioned on iter->node.
+ * @iter: input: current node (not NULL), output: next node (NULL if
+ *        the traversal is completed).
+ *
+ * Call with rcu_read_lock held, within the same critical section as
+ * the cds_lfht_cursor_first() call which returned the current node.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+void cds_lfht_cursor_next(struct cds_lfht *ht,
+		struct cds_lfht_cursor *cursor,
+		struct cds_lfht_iter *iter);
+
+/*
+ * cds_lfht_merge_first - get the first step of a merge traversal.
+ * @left: the left hash table.
+ * @right: the right hash table.
+ * @match: key comparison of a left and a right node.
+ * @miter: the traversal state (output).
+ *
+ * Both tables keep their nodes sorted by reverse hash, whatever their
+ * size, so walking them side by side compares them in a single linear
+ * pass, without lookup: each step returns CDS_LFHT_MERGE_LEFT with a
+ * node of @left whose key is not in @right (miter->left),
+ * CDS_LFHT_MERGE_RIGHT with a node of @right whose key is not in @left
+ * (miter->right), or CDS_LFHT_MERGE_BOTH with two nodes of equal keys
+ * (both), until CDS_LFHT_MERGE_END. Set differences, intersections and
+ * the updates synchronizing a table with another are made from these
+ * steps. The keys of both tables must be hashed by the same function,
+ * with the same seed. @match is only called on nodes of equal hash,
+ * which are paired with a nested loop: each node of @left is returned
+ * once, along with the first node of @right of equal key, if any.
+ * As with cds_lfht_next(), nodes added or removed concurrently may or
+ * may not be observed, and the current nodes can be passed to
+ * cds_lfht_del() on their table.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * This function acts as a rcu_dereference() to read the node pointers.
+ */
+extern
+enum cds_lfht_merge_kind cds_lfht_merge_first(struct cds_lfht *left,
+		struct cds_lfht *right, cds_lfht_merge_match_fct match,
+		struct cds_lfht_merge_iter *miter);
+
+/*
+ * cds_lfht_merge_next - get the next step of a merge traversal.
+ * @miter: the traversal state, from cds_lfht_merge_first().
+ *
+ * Call with rcu_read_lock held, within the same critical section as
+ * the cds_lfht_merge_first() call.
+ */
+extern
+enum cds_lfht_merge_kind cds_lfht_merge_next(struct cds_lfht_merge_iter *miter);
+
 /*
  * cds_lfht_add - add a node to the hash table.
  * @ht: the hash table.
@@ -286,6 +1030,118 @@ extern
 void cds_lfht_add(struct cds_lfht *ht, unsigned long hash,
 		struct cds_lfht_node *node);
 
+/*
+ * cds_lfht_add_bulk - add an array of nodes to the hash table.
+ * @ht: the hash table.
+ * @hashes: the hashes of the nodes, hashes[i] being the hash of nodes[i].
+ * @nodes: the nodes to add.
+ * @nr: the number of nodes.
+ *
+ * Equivalent to calling cds_lfht_add() for each node, but the nodes
+ * array is first sorted by reverse hash (the order of its elements is
+ * modified), so the nodes sharing an insertion point in the table are
+ * linked together and added with a single atomic commit.
+ * This function supports adding redundant keys into the table.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * This function issues a full memory barrier before and after each of
+ * its atomic commits.
+ */
+extern
+void cds_lfht_add_bulk(struct cds_lfht *ht, const unsigned long *hashes,
+		struct cds_lfht_node **nodes, unsigned long nr);
+
+/*
+ * cds_lfht_bulk_load - populate a hash table not yet visible to others.
+ * @ht: the hash table.
+ * @hashes: the hashes of the nodes, hashes[i] being the hash of nodes[i].
+ * @nodes: the nodes to add.
+ * @nr: the number of nodes.
+ *
+ * Same as cds_lfht_add_bulk(), except that the nodes are merged into
+ * the table in a single pass without any atomic operation. Hash tables
+ * created with CDS_LFHT_AUTO_RESIZE are first resized for the number of
+ * nodes added. The caller must guarantee that no other thread accesses
+ * the hash table concurrently, e.g. because the table has not been
+ * published yet.
+ * Call without rcu_read_lock held (resize is synchronous).
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+void cds_lfht_bulk_load(struct cds_lfht *ht, const unsigned long *hashes,
+		struct cds_lfht_node **nodes, unsigned long nr);
+
+/*
+ * Hash table snapshot file header, followed by nr_nodes records. Each
+ * record holds the 64-bit node hash followed by record_len bytes of
+ * user data, padded to 8 bytes. Records are sorted in split-ordered
+ * list order. Snapshots are only portable across machines with the
+ * same byte order and long size.
+ */
+struct cds_lfht_snapshot_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t long_size;
+	uint32_t padding;
+	uint64_t record_len;
+	uint64_t nr_nodes;
+	uint64_t nr_buckets;
+};
+
+/*
+ * Fill the record_len bytes of record with the content of node.
+ * Return 0 on success, negative error value to abort the save.
+ */
+typedef int (*cds_lfht_snapshot_save_fct)(struct cds_lfht_node *node,
+		void *record, void *priv);
+
+/*
+ * Return a node initialized from the record_len bytes of record, or
+ * NULL to abort the load. The node may point into the snapshot image.
+ */
+typedef struct cds_lfht_node *(*cds_lfht_snapshot_load_fct)(
+		const void *record, void *priv);
+
+/*
+ * cds_lfht_snapshot_save - save the hash table content to a file.
+ * @ht: the hash table.
+ * @fp: the file to write the snapshot to.
+ * @record_len: size of the user data saved for each node.
+ * @save: fills the user data of each node.
+ * @priv: private data passed to save.
+ *
+ * The table must not be modified during the save, otherwise -EBUSY is
+ * returned. Return 0 on success, -EIO on write error, -ENOMEM, or the
+ * value returned by save if non-zero.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+int cds_lfht_snapshot_save(struct cds_lfht *ht, FILE *fp, size_t record_len,
+		cds_lfht_snapshot_save_fct save, void *priv);
+
+/*
+ * cds_lfht_snapshot_load - populate a hash table from a snapshot image.
+ * @ht: the hash table.
+ * @image: the snapshot, e.g. the mmap()ed snapshot file.
+ * @len: length of the image.
+ * @load: creates the nodes from the user data of the records.
+ * @priv: private data passed to load.
+ *
+ * The table is first resized to the number of buckets it had when the
+ * snapshot was saved, then the nodes are merged in a single linear pass
+ * in the order of the image, as done by cds_lfht_bulk_load().
+ * Return 0 on success, -EINVAL if the image is invalid (nothing is
+ * loaded then), -ENOMEM if load returns NULL (the nodes loaded before
+ * it stay in the table).
+ * Same requirements as cds_lfht_bulk_load(): no other thread must
+ * access the table concurrently, call without rcu_read_lock held.
+ */
+extern
+int cds_lfht_snapshot_load(struct cds_lfht *ht, const void *image,
+		size_t len, cds_lfht_snapshot_load_fct load, void *priv);
+
 /*
  * cds_lfht_add_unique - add a node to hash table, if key is not present.
  * @ht: the hash table.
@@ -320,6 +1176,46 @@ struct cds_lfht_node *cds_lfht_add_unique(struct cds_lfht *ht,
 		const void *key,
 		struct cds_lfht_node *node);
 
+/*
+ * Node constructor and destructor of cds_lfht_lookup_or_add().
+ */
+typedef struct cds_lfht_node *(*cds_lfht_create_fct)(const void *key,
+		void *priv);
+typedef void (*cds_lfht_discard_fct)(struct cds_lfht_node *node, void *priv);
+
+/*
+ * cds_lfht_lookup_or_add - get a node by key, adding it if absent.
+ * @ht: the hash table.
+ * @hash: the key hash.
+ * @match: the key match function.
+ * @key: the current node key.
+ * @create: creates the node to add for @key, or returns NULL on error.
+ * @discard: destroys a node returned by @create which could not be
+ *           added because a node with the same key was added
+ *           concurrently. The node has never been visible to others,
+ *           it can be freed right away.
+ * @priv: private data passed to @create and @discard.
+ *
+ * Return the node matching the key if found. Otherwise, create is
+ * called at most once and the created node is added and returned, with
+ * a single chain traversal in the common case. Return NULL if create
+ * returns NULL. Has the same semantic as cds_lfht_add_unique() with
+ * respect to concurrent lookups and adds. create is called within the
+ * RCU read-side critical section, and must not wait for a grace period.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * This function issues a full memory barrier before and after its
+ * atomic commit.
+ */
+extern
+struct cds_lfht_node *cds_lfht_lookup_or_add(struct cds_lfht *ht,
+		unsigned long hash,
+		cds_lfht_match_fct match,
+		const void *key,
+		cds_lfht_create_fct create,
+		cds_lfht_discard_fct discard,
+		void *priv);
+
 /*
  * cds_lfht_add_replace - replace or add a node within hash table.
  * @ht: the hash table.
@@ -335,6 +1231,8 @@ struct cds_lfht_node *cds_lfht_add_unique(struct cds_lfht *ht,
  * Threads calling this API need to be registered RCU read-side threads.
  * After successful replacement, a grace period must be waited for before
  * freeing the memory reserved for the returned node.
+ * Tables with a reclaim callback (see cds_lfht_set_reclaim()) hand it
+ * to the callback themselves.
  *
  * The semantic of replacement vs lookups and traversals is the
  * following: if lookups and traversals are performed between a key
@@ -357,6 +1255,254 @@ struct cds_lfht_node *cds_lfht_add_replace(struct cds_lfht *ht,
 		const void *key,
 		struct cds_lfht_node *node);
 
+/*
+ * cds_lfht_add_unique_u64 - add a node with an inline key, if not present.
+ * @ht: the hash table.
+ * @hash: the node's hash.
+ * @node: the node to add, its key already set.
+ *
+ * Same as cds_lfht_add_unique() for struct cds_lfht_node_u64 nodes.
+ */
+extern
+struct cds_lfht_node *cds_lfht_add_unique_u64(struct cds_lfht *ht,
+		unsigned long hash,
+		struct cds_lfht_node_u64 *node);
+
+/*
+ * cds_lfht_add_replace_u64 - replace or add a node with an inline key.
+ * @ht: the hash table.
+ * @hash: the node's hash.
+ * @node: the node to add, its key already set.
+ *
+ * Same as cds_lfht_add_replace() for struct cds_lfht_node_u64 nodes.
+ */
+extern
+struct cds_lfht_node *cds_lfht_add_replace_u64(struct cds_lfht *ht,
+		unsigned long hash,
+		struct cds_lfht_node_u64 *node);
+
+/*
+ * cds_lfht_dup_match_fct - match function of multimap nodes.
+ * @node: a duplicate of the group being compared.
+ * @key: the key being looked up.
+ *
+ * Returns non-zero if the key of @node is @key.
+ */
+typedef int (*cds_lfht_dup_match_fct)(struct cds_lfht_dup_node *node,
+		const void *key);
+
+/*
+ * cds_lfht_add_dup - add a duplicate to the group of its key.
+ * @ht: the hash table.
+ * @hash: the node's hash.
+ * @match: the key match function.
+ * @key: the node's key.
+ * @node: the node to add.
+ *
+ * Adds @node at the tail of the duplicates of @key, creating the group
+ * of the key in the hash table if it does not exist yet. Nodes of a
+ * table must either all be added with cds_lfht_add_dup(), or none.
+ * Returns 0 on success, -ENOMEM if the group cannot be allocated.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * Duplicates of a key are serialized by a mutex of their group.
+ */
+extern
+int cds_lfht_add_dup(struct cds_lfht *ht, unsigned long hash,
+		cds_lfht_dup_match_fct match, const void *key,
+		struct cds_lfht_dup_node *node);
+
+/*
+ * cds_lfht_del_dup - remove a duplicate from its group.
+ * @ht: the hash table.
+ * @node: the node to remove.
+ *
+ * Removing the last duplicate of a key removes its group from the hash
+ * table, and the group is freed after a grace period.
+ * Returns 0 on success, -ENOENT if the node is already removed.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * After successful removal, a grace period must be waited for before
+ * freeing or re-using the memory reserved for @node.
+ */
+extern
+int cds_lfht_del_dup(struct cds_lfht *ht, struct cds_lfht_dup_node *node);
+
+/*
+ * cds_lfht_lookup_group - lookup the duplicates of a key.
+ * @ht: the hash table.
+ * @hash: the key hash.
+ * @match: the key match function.
+ * @key: the current node key.
+ *
+ * Returns the group of @key, or NULL if it has no duplicate. Traverse
+ * the duplicates with cds_lfht_for_each_dup().
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_lfht_dup_group *cds_lfht_lookup_group(struct cds_lfht *ht,
+		unsigned long hash, cds_lfht_dup_match_fct match,
+		const void *key);
+
+/*
+ * cds_lfht_freeze - build an immutable lookup snapshot of a hash table.
+ * @ht: the hash table.
+ *
+ * Returns a snapshot of the nodes of @ht sized for a load factor of at
+ * most 1/2, or NULL on allocation failure. The snapshot holds the nodes
+ * seen by a cds_lfht_for_each() traversal: freeze the table between
+ * batches of updates for it to be consistent. It can be published to
+ * readers with rcu_assign_pointer() and rebuilt after updates, the
+ * replaced snapshot being freed with cds_lfht_frozen_destroy() after a
+ * grace period. Nodes removed from @ht must not be reclaimed before no
+ * published snapshot references them anymore.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_lfht_frozen *cds_lfht_freeze(struct cds_lfht *ht);
+
+/*
+ * cds_lfht_frozen_destroy - free a snapshot built by cds_lfht_freeze().
+ */
+extern
+void cds_lfht_frozen_destroy(struct cds_lfht_frozen *frozen);
+
+/*
+ * cds_lfht_frozen_lookup - lookup a key in a hash table snapshot.
+ * @frozen: the snapshot.
+ * @hash: the key hash.
+ * @match: the key match function.
+ * @key: the current node key.
+ * @iter: node, if found (output). *iter->node set to NULL if not found.
+ *
+ * The snapshot never changes, so no RCU read-side lock is needed
+ * besides the one protecting its publication.
+ */
+extern
+void cds_lfht_frozen_lookup(const struct cds_lfht_frozen *frozen,
+		unsigned long hash, cds_lfht_match_fct match, const void *key,
+		struct cds_lfht_frozen_iter *iter);
+
+/*
+ * cds_lfht_frozen_next_duplicate - get the next duplicate of a key.
+ * @frozen: the snapshot.
+ * @hash: the key hash.
+ * @match: the key match function.
+ * @key: the current node key.
+ * @iter: input: current node, output: next duplicate, node set to NULL
+ *        if there is none.
+ */
+extern
+void cds_lfht_frozen_next_duplicate(const struct cds_lfht_frozen *frozen,
+		unsigned long hash, cds_lfht_match_fct match, const void *key,
+		struct cds_lfht_frozen_iter *iter);
+
+/*
+ * Online rehash: cds_lfht_rehash_run() moves the nodes of a table into
+ * another one, typically created to change the seed of the hash
+ * function, while readers keep looking up both tables with
+ * cds_lfht_rehash_lookup(). A node can only be in one table, so objects
+ * hold another node for the new table, returned by the rehash function.
+ */
+struct cds_lfht_rehash;
+
+/*
+ * cds_lfht_rehash_fct - map a node of the old table to the new table.
+ * @node: the node of the old table.
+ * @hash: the hash of the node for the new table (output).
+ * @priv: private data given to cds_lfht_rehash_start().
+ *
+ * Returns the node to add to the new table in place of @node, e.g.
+ * another struct cds_lfht_node embedded in the same object. Must
+ * always return the same node and hash for @node.
+ */
+typedef struct cds_lfht_node *(*cds_lfht_rehash_fct)(
+		struct cds_lfht_node *node, unsigned long *hash, void *priv);
+
+/* cds_lfht_rehash_iter: Lookup result, with the table holding the node. */
+struct cds_lfht_rehash_iter {
+	struct cds_lfht_iter iter;
+	struct cds_lfht *ht;
+};
+
+/*
+ * cds_lfht_rehash_start - prepare moving the nodes of a table to another.
+ * @old_ht: the table holding the nodes.
+ * @new_ht: the table the nodes are moved to.
+ * @rehash: the function mapping the nodes of @old_ht to @new_ht.
+ * @priv: private data passed to @rehash.
+ *
+ * Once started, nodes must only be added to @new_ht, and removed with
+ * cds_lfht_rehash_del(). Each object must be removed at most once.
+ * Returns NULL on allocation failure.
+ */
+extern
+struct cds_lfht_rehash *cds_lfht_rehash_start(struct cds_lfht *old_ht,
+		struct cds_lfht *new_ht, cds_lfht_rehash_fct rehash,
+		void *priv);
+
+/*
+ * cds_lfht_rehash_run - move all the nodes of the old table.
+ * @rh: the rehash started with cds_lfht_rehash_start().
+ *
+ * Walks the old table partition by partition, adding the node returned
+ * by the rehash function to the new table before removing each node
+ * from the old one. Returns the number of nodes moved. Lookups then only
+ * consult the new table: the old one can be destroyed, and @rh freed
+ * with cds_lfht_rehash_destroy(), once a grace period has elapsed.
+ * Threads calling this API need to be registered RCU read-side threads,
+ * and must not be within a RCU read-side critical section.
+ */
+extern
+long cds_lfht_rehash_run(struct cds_lfht_rehash *rh);
+
+/*
+ * cds_lfht_rehash_lookup - lookup a key in the tables of a rehash.
+ * @rh: the rehash.
+ * @old_hash: the key hash for the old table.
+ * @old_match: the key match function for nodes of the old table.
+ * @new_hash: the key hash for the new table.
+ * @new_match: the key match function for nodes of the new table.
+ * @key: the current node key.
+ * @iter: node and table holding it, if found (output).
+ *
+ * Consults the old table before the new one, so nodes being moved are
+ * found in at least one of them.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+void cds_lfht_rehash_lookup(struct cds_lfht_rehash *rh,
+		unsigned long old_hash, cds_lfht_match_fct old_match,
+		unsigned long new_hash, cds_lfht_match_fct new_match,
+		const void *key, struct cds_lfht_rehash_iter *iter);
+
+/*
+ * cds_lfht_rehash_del - remove a node found by cds_lfht_rehash_lookup().
+ * @rh: the rehash.
+ * @iter: the lookup result.
+ *
+ * Removes the node, or the node it was moved to in the new table.
+ * Returns 0 on success, negative value otherwise.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ * After successful removal, a grace period must be waited for before
+ * freeing the object.
+ */
+extern
+int cds_lfht_rehash_del(struct cds_lfht_rehash *rh,
+		struct cds_lfht_rehash_iter *iter);
+
+/*
+ * cds_lfht_rehash_destroy - free a rehash.
+ *
+ * Call once no thread can use @rh anymore.
+ */
+extern
+void cds_lfht_rehash_destroy(struct cds_lfht_rehash *rh);
+
 /*
  * cds_lfht_replace - replace a node pointed to by iter within hash table.
  * @ht: the hash table.
@@ -378,6 +1524,8 @@ struct cds_lfht_node *cds_lfht_add_replace(struct cds_lfht *ht,
  * After successful replacement, a grace period must be waited for before
  * freeing the memory reserved for the old node (which can be accessed
  * with cds_lfht_iter_get_node).
+ * Tables with a reclaim callback (see cds_lfht_set_reclaim()) hand it
+ * to the callback themselves.
  *
  * The semantic of replacement vs lookups is the same as
  * cds_lfht_add_replace().
@@ -411,6 +1559,8 @@ int cds_lfht_replace(struct cds_lfht *ht,
  * After successful removal, a grace period must be waited for before
  * freeing the memory reserved for old node (which can be accessed with
  * cds_lfht_iter_get_node).
+ * Tables with a reclaim callback (see cds_lfht_set_reclaim()) hand it
+ * to the callback themselves.
  * Upon success, this function issues a full memory barrier before and
  * after its atomic commit. Upon failure, this function does not issue
  * any memory barrier.
@@ -418,6 +1568,149 @@ int cds_lfht_replace(struct cds_lfht *ht,
 extern
 int cds_lfht_del(struct cds_lfht *ht, struct cds_lfht_node *node);
 
+/*
+ * Predicate and reclaim callbacks of cds_lfht_sweep().
+ */
+typedef int (*cds_lfht_sweep_fct)(struct cds_lfht_node *node, void *priv);
+typedef void (*cds_lfht_reclaim_fct)(struct cds_lfht_node *node, void *priv);
+
+/*
+ * cds_lfht_sweep - remove all nodes of a table partition matching a
+ *                  predicate.
+ * @ht: the hash table.
+ * @index: the partition index, lower than @nr_partitions.
+ * @nr_partitions: the number of partitions the table is split into
+ *                 (1 to sweep the whole table), as for
+ *                 cds_lfht_partition_first().
+ * @match: called on each node of the partition, returns non-zero for
+ *         the nodes to remove.
+ * @reclaim: called on each removed node, after a grace period.
+ * @priv: private data passed to @match and @reclaim.
+ *
+ * Walks the partition once, logically removing the matching nodes, and
+ * unlinking them with a single pass over each bucket, rather than one
+ * per node as with cds_lfht_del(). The removed nodes are handed to
+ * call_rcu as a single batch: @reclaim is invoked from the call_rcu
+ * worker thread, and can free the nodes right away.
+ * Return the number of nodes removed, or -ENOMEM if the batch could not
+ * be grown, in which case the sweep stops early, and the nodes removed
+ * so far are still reclaimed.
+ * Same calling context requirements as cds_lfht_del(). Sweeping each
+ * partition from a different thread is allowed.
+ */
+extern
+long cds_lfht_sweep(struct cds_lfht *ht, unsigned long index,
+		unsigned long nr_partitions, cds_lfht_sweep_fct match,
+		cds_lfht_reclaim_fct reclaim, void *priv);
+
+/*
+ * cds_lfht_gc - unlink the logically removed nodes of a table partition.
+ * @ht: the hash table.
+ * @index: the partition index, lower than @nr_partitions.
+ * @nr_partitions: the number of partitions the table is split into
+ *                 (1 for the whole table), as for
+ *                 cds_lfht_partition_first().
+ *
+ * Walks the partition in bucket order, and unlinks the nodes still
+ * linked after being logically removed, e.g. by a cds_lfht_del() or
+ * cds_lfht_replace() preempted before unlinking them, with a single
+ * pass over each bucket holding some. Removal ownership and reclaim
+ * are left to the operation which removed each node.
+ * Return the number of logically removed nodes found.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+long cds_lfht_gc(struct cds_lfht *ht, unsigned long index,
+		unsigned long nr_partitions);
+
+/*
+ * cds_lfht_gc_async - garbage collect the whole table in the background.
+ * @ht: the hash table.
+ *
+ * Queues a cds_lfht_gc() pass over the whole table, run by a call_rcu
+ * worker thread of the flavor, one partition of about a thousand
+ * buckets per read-side critical section. The table destruction waits
+ * for pending passes, which stop early once it starts.
+ * Return 0, -ENOMEM, or -EBUSY if the table is being destroyed.
+ * Can be called from any context, including read-side critical
+ * sections and call_rcu callbacks.
+ */
+extern
+int cds_lfht_gc_async(struct cds_lfht *ht);
+
+/*
+ * cds_lfht_set_domain - bind a hash table to a RCU domain.
+ * @ht: the hash table.
+ * @domain: the RCU domain, see urcu-domain.h.
+ *
+ * The table then relies on read-side critical sections of @domain
+ * instead of the flavor ones: lookups, traversals and updates must be
+ * performed within rcu_read_lock_domain(), and nodes must be reclaimed
+ * after synchronize_rcu_domain(). Table resize waits for grace periods
+ * of @domain, and cds_lfht_sweep() waits for both a flavor and a domain
+ * grace period before reclaiming nodes. Automatic resize is still
+ * deferred to the call_rcu worker threads of the flavor.
+ * Must be called right after the table creation, before it is used.
+ */
+extern
+void cds_lfht_set_domain(struct cds_lfht *ht, struct rcu_domain *domain);
+
+/*
+ * cds_lfht_set_reclaim - reclaim the removed nodes of a hash table.
+ * @ht: the hash table.
+ * @reclaim: called on each node removed by cds_lfht_del() or replaced
+ *           by cds_lfht_replace() and cds_lfht_add_replace(), after a
+ *           grace period. NULL to let the caller reclaim the nodes.
+ * @priv: private data passed to @reclaim.
+ *
+ * The removed nodes are collected per thread in batches, each handed
+ * to the call_rcu of the table flavor at once: @reclaim is invoked from
+ * the call_rcu worker thread, and can free the nodes right away. The
+ * caller must not reclaim the nodes itself anymore, but can use them
+ * until the end of its RCU read-side critical section, e.g. the node
+ * returned by cds_lfht_add_replace(). The nodes removed by
+ * cds_lfht_sweep() and cds_lfht_destroy_free() are still handed to the
+ * callbacks given to these functions.
+ * Must be called right after the table creation, before it is used.
+ */
+extern
+void cds_lfht_set_reclaim(struct cds_lfht *ht, cds_lfht_reclaim_fct reclaim,
+		void *priv);
+
+/*
+ * cds_lfht_reclaim_flush - queue the nodes removed by the current thread.
+ *
+ * Hands the partial batch of nodes removed by the current thread from
+ * tables with a reclaim callback (see cds_lfht_set_reclaim()) to
+ * call_rcu. Call it before rcu_barrier() to wait for their reclaim.
+ * The partial batch of exiting threads is queued automatically.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+void cds_lfht_reclaim_flush(void);
+
+/*
+ * cds_lfht_set_resize_workers - configure the hash table resize workers.
+ * @ht: the hash table.
+ * @max_workers: maximum number of threads processing a resize,
+ *               including the thread performing it. 0 means one per
+ *               possible CPU (the default), 1 disables the workers.
+ * @cpus: CPUs the workers are pinned to, worker k on
+ *        cpus[k % nr_cpus]. NULL for no affinity.
+ * @nr_cpus: number of entries in @cpus.
+ *
+ * Resize workers are created with the resize_attr of the table on the
+ * first resize needing them, and wait for the next resize afterwards
+ * rather than exiting. Changing the settings stops the current workers.
+ * Returns 0 on success, -EINVAL if a CPU is negative or if called from
+ * a RCU read-side critical section, -ENOMEM on allocation failure.
+ * Same calling context requirements as cds_lfht_resize().
+ */
+extern
+int cds_lfht_set_resize_workers(struct cds_lfht *ht, unsigned int max_workers,
+		const int *cpus, unsigned int nr_cpus);
+
 /*
  * cds_lfht_is_node_deleted - query whether a node is removed from hash table.
  *
@@ -447,6 +1740,35 @@ int cds_lfht_is_node_deleted(struct cds_lfht_node *node);
 extern
 void cds_lfht_resize(struct cds_lfht *ht, unsigned long new_size);
 
+/*
+ * cds_lfht_resize_done_fct - called when a cds_lfht_resize_async() resize
+ * is over, with the table size reached. The size can differ from the
+ * requested one if other resizes were requested meanwhile, or if the
+ * table is being destroyed.
+ */
+typedef void (*cds_lfht_resize_done_fct)(struct cds_lfht *ht,
+		unsigned long size, void *priv);
+
+/*
+ * cds_lfht_resize_async - Resize a hash table in the background
+ * @ht: the hash table.
+ * @new_size: update to this hash table size.
+ * @done: called from the resize worker when the resize is over. Can
+ *        be NULL.
+ * @priv: passed to @done.
+ *
+ * Same as cds_lfht_resize(), but queues the resize to the resize worker
+ * of the table and returns at once. A large grow is populated by the
+ * partition workers of the table. cds_lfht_destroy() waits for the
+ * pending resizes and their callbacks.
+ * Return 0, -ENOMEM if the resize cannot be queued, or -EBUSY if the
+ * table is being destroyed.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+int cds_lfht_resize_async(struct cds_lfht *ht, unsigned long new_size,
+		cds_lfht_resize_done_fct done, void *priv);
+
 /*
  * Note: it is safe to perform element removal (del), replacement, or
  * any hash table update operation during any of the following hash
@@ -460,6 +1782,18 @@ void cds_lfht_resize(struct cds_lfht *ht, unsigned long new_size);
 		cds_lfht_next(ht, iter),				\
 			node = cds_lfht_iter_get_node(iter))
 
+#define cds_lfht_for_each_partition(ht, index, nr_partitions, piter, node) \
+	for (cds_lfht_partition_first(ht, index, nr_partitions, piter),	\
+			node = cds_lfht_iter_get_node(&(piter)->iter);	\
+		node != NULL;						\
+		cds_lfht_partition_next(ht, piter),			\
+			node = cds_lfht_iter_get_node(&(piter)->iter))
+
+#define cds_lfht_for_each_merge(left, right, match, miter, kind)	\
+	for (kind = cds_lfht_merge_first(left, right, match, miter);	\
+		kind != CDS_LFHT_MERGE_END;				\
+		kind = cds_lfht_merge_next(miter))
+
 #define cds_lfht_for_each_duplicate(ht, hash, match, key, iter, node)	\
 	for (cds_lfht_lookup(ht, hash, match, key, iter),		\
 			node = cds_lfht_iter_get_node(iter);		\
@@ -476,6 +1810,24 @@ void cds_lfht_resize(struct cds_lfht *ht, unsigned long new_size);
 			pos = caa_container_of(cds_lfht_iter_get_node(iter), \
 					__typeof__(*(pos)), member))
 
+/*
+ * Traverse the table as cds_lfht_for_each_entry(), prefetching @field of
+ * the objects about @distance nodes ahead of @pos.
+ */
+#define cds_lfht_for_each_entry_prefetch(ht, piter, distance, pos,	\
+				member, field)				\
+	for (cds_lfht_prefetch_first(ht, piter, distance,		\
+			(long) offsetof(__typeof__(*(pos)), field)	\
+			- (long) offsetof(__typeof__(*(pos)), member)),	\
+			pos = caa_container_of(				\
+				cds_lfht_iter_get_node(&(piter)->iter),	\
+				__typeof__(*(pos)), member);		\
+		cds_lfht_iter_get_node(&(piter)->iter) != NULL;		\
+		cds_lfht_prefetch_next(ht, piter),			\
+			pos = caa_container_of(				\
+				cds_lfht_iter_get_node(&(piter)->iter),	\
+				__typeof__(*(pos)), member))
+
 #define cds_lfht_for_each_entry_duplicate(ht, hash, match, key,		\
 				iter, pos, member)			\
 	for (cds_lfht_lookup(ht, hash, match, key, iter),		\
@@ -486,6 +1838,13 @@ void cds_lfht_resize(struct cds_lfht *ht, unsigned long new_size);
 			pos = caa_container_of(cds_lfht_iter_get_node(iter), \
 					__typeof__(*(pos)), member))
 
+/*
+ * Traverse the duplicates of a group returned by cds_lfht_lookup_group(),
+ * in insertion order. Call with rcu_read_lock held.
+ */
+#define cds_lfht_for_each_dup(group, node)				\
+	cds_list_for_each_entry_rcu(node, &(group)->dups, list)
+
 #ifdef __cplusplus
 }
 #endif
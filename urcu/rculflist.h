@@ -0,0 +1,219 @@
+#ifndef _URCU_RCULFLIST_H
+#define _URCU_RCULFLIST_H
+
+/*
+ * urcu/rculflist.h
+ *
+ * Userspace RCU library - Lock-Free RCU Ordered List
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <urcu/compiler.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lock-free sorted linked list (Harris list), the algorithm of the
+ * split-ordered lists of urcu/rculfhash.h without bucket tables, for
+ * small ordered sets. Lookups and traversals are wait-free RCU
+ * read-side operations. Additions link the node with a cmpxchg on the
+ * next pointer of its predecessor. Removals first set the removal flag
+ * of the next pointer of the node (logical removal, freezing it), then
+ * unlink it with a cmpxchg on its predecessor, and any walk crossing a
+ * logically removed node helps unlinking it.
+ *
+ * Nodes are intrusive: struct cds_lflist_node is embedded in the user
+ * structure, which holds the key, with an ordering defined by the
+ * comparison function of the list. Walks are linear: the list is meant
+ * for up to a few thousand nodes.
+ */
+struct cds_lflist_node {
+	struct cds_lflist_node *next;	/* low bits hold removal flags */
+};
+
+/*
+ * Compare a node key with a key: return a negative value, 0, or a
+ * positive value if the node key is respectively smaller than, equal
+ * to, or greater than key.
+ */
+typedef int (*cds_lflist_cmp_fct)(struct cds_lflist_node *node,
+		const void *key);
+
+struct cds_lflist {
+	struct cds_lflist_node head;	/* never removed */
+	cds_lflist_cmp_fct cmp;
+};
+
+static inline
+void cds_lflist_node_init(struct cds_lflist_node *node)
+{
+	node->next = NULL;
+}
+
+/*
+ * cds_lflist_init - initialize an empty list.
+ * @list: the list.
+ * @cmp: the key comparison function.
+ */
+extern
+void cds_lflist_init(struct cds_lflist *list, cds_lflist_cmp_fct cmp);
+
+/*
+ * cds_lflist_destroy - destroy a list.
+ *
+ * The list should be emptied before calling destroy.
+ * Return 0 on success, -EPERM if the list is not empty.
+ */
+extern
+int cds_lflist_destroy(struct cds_lflist *list);
+
+/*
+ * cds_lflist_lookup - get the first node of a key.
+ *
+ * Return NULL if not found.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_lflist_node *cds_lflist_lookup(struct cds_lflist *list,
+		const void *key);
+
+/*
+ * cds_lflist_lower_bound - get the first node whose key is not smaller
+ *                          than key.
+ *
+ * Return NULL if no such node exists.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_lflist_node *cds_lflist_lower_bound(struct cds_lflist *list,
+		const void *key);
+
+/*
+ * cds_lflist_first - get the node of the smallest key.
+ *
+ * Return NULL if the list is empty.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_lflist_node *cds_lflist_first(struct cds_lflist *list);
+
+/*
+ * cds_lflist_next - get the node following node in key order.
+ *
+ * Return NULL if node is the last node. Can be called on a node removed
+ * within the current read-side critical section: nodes added after its
+ * removal may then be missed.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_lflist_node *cds_lflist_next(struct cds_lflist_node *node);
+
+/*
+ * cds_lflist_add - add a node, after the nodes of the same key.
+ * @list: the list.
+ * @key: the key of node.
+ * @node: the node to add.
+ *
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+void cds_lflist_add(struct cds_lflist *list, const void *key,
+		struct cds_lflist_node *node);
+
+/*
+ * cds_lflist_add_unique - add a node, unless a node of the same key is
+ * present.
+ *
+ * Return node if it was added, or the node of the same key. Only
+ * cds_lflist_add_unique() guarantees that a key has a single node.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_lflist_node *cds_lflist_add_unique(struct cds_lflist *list,
+		const void *key, struct cds_lflist_node *node);
+
+/*
+ * cds_lflist_del - remove a node from the list.
+ * @list: the list.
+ * @key: the key of node.
+ * @node: the node to remove.
+ *
+ * Return 0 if the node is removed by this call, or -ENOENT if it was
+ * already removed. After removal, a grace period must be waited for
+ * before freeing or re-adding the node.
+ * Call with rcu_read_lock held, the node having been found within the
+ * same read-side critical section.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+int cds_lflist_del(struct cds_lflist *list, const void *key,
+		struct cds_lflist_node *node);
+
+/*
+ * cds_lflist_is_node_deleted - whether a node is removed from its list.
+ * Call with rcu_read_lock held, the node having been found within the
+ * same read-side critical section.
+ */
+extern
+int cds_lflist_is_node_deleted(struct cds_lflist_node *node);
+
+/*
+ * Traversals in key order, from the first node, or from the first node
+ * whose key is not smaller than key. Call with rcu_read_lock held.
+ */
+#define cds_lflist_for_each(list, node)					\
+	for (node = cds_lflist_first(list);				\
+		node != NULL;						\
+		node = cds_lflist_next(node))
+
+#define cds_lflist_for_each_from(list, key, node)			\
+	for (node = cds_lflist_lower_bound(list, key);			\
+		node != NULL;						\
+		node = cds_lflist_next(node))
+
+#define cds_lflist_for_each_entry(list, node, pos, member)		\
+	for (node = cds_lflist_first(list),				\
+			pos = caa_container_of(node,			\
+				__typeof__(*(pos)), member);		\
+		node != NULL;						\
+		node = cds_lflist_next(node),				\
+			pos = caa_container_of(node,			\
+				__typeof__(*(pos)), member))
+
+#define cds_lflist_for_each_entry_from(list, key, node, pos, member)	\
+	for (node = cds_lflist_lower_bound(list, key),			\
+			pos = caa_container_of(node,			\
+				__typeof__(*(pos)), member);		\
+		node != NULL;						\
+		node = cds_lflist_next(node),				\
+			pos = caa_container_of(node,			\
+				__typeof__(*(pos)), member))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCULFLIST_H */
@@ -31,6 +31,7 @@ extern "C" {
 #endif
 
 struct cds_lfq_queue_rcu;
+struct cds_lfq_dummy_pool;
 
 struct cds_lfq_node_rcu {
 	struct cds_lfq_node_rcu *next;
@@ -41,6 +42,8 @@ struct cds_lfq_queue_rcu {
 	struct cds_lfq_node_rcu *head, *tail;
 	void (*queue_call_rcu)(struct rcu_head *head,
 		void (*func)(struct rcu_head *head));
+	/* Dummy nodes recycled after a grace period. */
+	struct cds_lfq_dummy_pool *dummy_pool;
 };
 
 #ifdef _LGPL_SOURCE
@@ -52,6 +55,7 @@ struct cds_lfq_queue_rcu {
 #define cds_lfq_destroy_rcu		_cds_lfq_destroy_rcu
 #define cds_lfq_enqueue_rcu		_cds_lfq_enqueue_rcu
 #define cds_lfq_dequeue_rcu		_cds_lfq_dequeue_rcu
+#define cds_lfq_dequeue_bulk_rcu	_cds_lfq_dequeue_bulk_rcu
 
 #else /* !_LGPL_SOURCE */
 
@@ -82,6 +86,19 @@ extern void cds_lfq_enqueue_rcu(struct cds_lfq_queue_rcu *q,
 extern
 struct cds_lfq_node_rcu *cds_lfq_dequeue_rcu(struct cds_lfq_queue_rcu *q);
 
+/*
+ * Should be called under rcu read lock critical section.
+ *
+ * Dequeue up to @max nodes into @nodes, in queue order, with a single
+ * move of the queue head. Returns the number of nodes dequeued, 0 if
+ * the queue is empty. The caller must wait for a grace period to pass
+ * before freeing the returned nodes or modifying their cds_lfq_node_rcu
+ * structure.
+ */
+extern
+unsigned int cds_lfq_dequeue_bulk_rcu(struct cds_lfq_queue_rcu *q,
+		struct cds_lfq_node_rcu **nodes, unsigned int max);
+
 #endif /* !_LGPL_SOURCE */
 
 #ifdef __cplusplus
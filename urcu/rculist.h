@@ -72,6 +72,85 @@ void cds_list_del_rcu(struct cds_list_head *elem)
 	CMM_STORE_SHARED(elem->prev->next, elem->next);
 }
 
+/*
+ * Join a private list at the head of an RCU list. The elements of @add
+ * must not be visible to readers yet: they are linked privately, then
+ * published with a single rcu_assign_pointer(), so readers either see
+ * none or all of them. @add is left unchanged and must be
+ * reinitialized before reuse. Mutual exclusion against concurrent
+ * updates is required.
+ */
+static inline
+void cds_list_splice_rcu(struct cds_list_head *add, struct cds_list_head *head)
+{
+	struct cds_list_head *first = add->next, *last = add->prev;
+
+	/* Do nothing if the list which gets added is empty. */
+	if (add == first)
+		return;
+	last->next = head->next;
+	first->prev = head;
+	head->next->prev = last;
+	rcu_assign_pointer(head->next, first);
+}
+
+/*
+ * Join a private list at the tail of an RCU list, with a single
+ * rcu_assign_pointer(). Same requirements as cds_list_splice_rcu().
+ */
+static inline
+void cds_list_splice_tail_rcu(struct cds_list_head *add,
+		struct cds_list_head *head)
+{
+	struct cds_list_head *first = add->next, *last = add->prev;
+
+	if (add == first)
+		return;
+	last->next = head;
+	first->prev = head->prev;
+	rcu_assign_pointer(head->prev->next, first);
+	head->prev = last;
+}
+
+/*
+ * Replace all elements of the RCU list @head with the elements of the
+ * private list @newlist, published with a single rcu_assign_pointer().
+ * Readers see either the old or the new elements, never a mix of both.
+ *
+ * The readers still traversing the old elements reach @head through
+ * the last old element, so the old elements can only be relinked after
+ * a grace period: @sync (e.g. synchronize_rcu of the flavor used by the
+ * readers) is called before moving them to the list @old, unless the
+ * list was empty. @newlist is left unchanged and must be reinitialized
+ * before reuse. Mutual exclusion against concurrent updates is
+ * required.
+ */
+static inline
+void cds_list_replace_list_rcu(struct cds_list_head *head,
+		struct cds_list_head *newlist, struct cds_list_head *old,
+		void (*sync)(void))
+{
+	struct cds_list_head *first = head->next, *last = head->prev;
+
+	if (cds_list_empty(newlist)) {
+		head->prev = head;
+		CMM_STORE_SHARED(head->next, head);
+	} else {
+		newlist->prev->next = head;
+		newlist->next->prev = head;
+		head->prev = newlist->prev;
+		rcu_assign_pointer(head->next, newlist->next);
+	}
+	CDS_INIT_LIST_HEAD(old);
+	if (first == head)
+		return;
+	sync();
+	first->prev = old;
+	last->next = old;
+	old->next = first;
+	old->prev = last;
+}
+
 /*
  * Iteration through all elements of the list must be done while rcu_read_lock()
  * is held.
@@ -0,0 +1,130 @@
+#ifndef _URCU_RCULPM_H
+#define _URCU_RCULPM_H
+
+/*
+ * urcu/rculpm.h
+ *
+ * Userspace RCU library - RCU longest-prefix-match trie
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <stdint.h>
+#include <urcu/compiler.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Map of bit-string prefixes, such as IPv4 or IPv6 routes, finding the
+ * longest prefix of a key in a single walk. The trie is indexed by 8
+ * bits of the key per level, with the prefixes expanded to the slots of
+ * their level, as a multibit trie. Each trie node is compressed as a
+ * poptrie node: a bitmap of the slots having a child, and a bitmap of
+ * the slots starting a run of slots of the same longest prefix, index
+ * arrays of the children and of one prefix per run by population count.
+ * The bitmaps of a node fill one cache line.
+ *
+ * Lookups are wait-free RCU read-side operations, reading the bitmaps
+ * and two array entries per level: at most 4 levels for IPv4, 16 for
+ * IPv6. Updates are serialized by a mutex of the trie, and copy the
+ * trie nodes they modify, publishing the copy in place of the original,
+ * which is freed with call_rcu.
+ *
+ * Nodes are intrusive: struct cds_lpm_node is embedded in the user
+ * structure, and holds its prefix. Keys and prefixes are byte strings,
+ * most significant bit first, as IP addresses in network byte order.
+ */
+
+/* Maximum number of key bits. */
+#define CDS_LPM_MAX_BITS	128
+
+struct cds_lpm_node {
+	uint8_t prefix[CDS_LPM_MAX_BITS / 8];	/* bits past len cleared */
+	unsigned int len;			/* prefix length, in bits */
+};
+
+struct cds_lpm;
+
+/*
+ * _cds_lpm_create: create a trie of keys of key_bits bits, between 1
+ * and CDS_LPM_MAX_BITS (32 for IPv4, 128 for IPv6). Returns NULL if
+ * key_bits is out of range, or on allocation error.
+ */
+extern struct cds_lpm *_cds_lpm_create(unsigned int key_bits,
+		const struct rcu_flavor_struct *flavor);
+
+/*
+ * cds_lpm_create: create a trie for the RCU flavor included before
+ * this header.
+ */
+static inline
+struct cds_lpm *cds_lpm_create(unsigned int key_bits)
+{
+	return _cds_lpm_create(key_bits, &rcu_flavor);
+}
+
+/*
+ * cds_lpm_destroy: free the trie. Returns 0 on success, -EPERM if
+ * prefixes are still present. A grace period must be waited for after
+ * the last removal (e.g. with rcu_barrier()), and the trie must not be
+ * used concurrently.
+ */
+extern int cds_lpm_destroy(struct cds_lpm *lpm);
+
+/*
+ * cds_lpm_add: add the prefix of len bits of @prefix, mapped to @node.
+ * The prefix is copied to node, with the bits past len cleared. A zero
+ * len adds the default prefix, matching all keys.
+ *
+ * Returns 0 on success, -EEXIST if the prefix is already present,
+ * -EINVAL if len is larger than the key bits of the trie, or -ENOMEM.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern int cds_lpm_add(struct cds_lpm *lpm, struct cds_lpm_node *node,
+		const void *prefix, unsigned int len);
+
+/*
+ * cds_lpm_del: remove the prefix of len bits of @prefix. Returns the
+ * node it was mapped to, to free after a grace period, or NULL if the
+ * prefix is not present. Never fails for lack of memory: the trie
+ * nodes are then updated in place, and those left empty are kept.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern struct cds_lpm_node *cds_lpm_del(struct cds_lpm *lpm,
+		const void *prefix, unsigned int len);
+
+/*
+ * cds_lpm_lookup: get the node of the longest prefix of @key, of the
+ * key bits of the trie, or NULL if no prefix matches. Concurrently with
+ * updates, returns the longest prefix either before or after each
+ * update, possibly a node removed within the current read-side
+ * critical section.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern struct cds_lpm_node *cds_lpm_lookup(struct cds_lpm *lpm,
+		const void *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCULPM_H */
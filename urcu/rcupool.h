@@ -0,0 +1,120 @@
+#ifndef _URCU_RCUPOOL_H
+#define _URCU_RCUPOOL_H
+
+/*
+ * urcu/rcupool.h
+ *
+ * Userspace RCU library - RCU object pool
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <stddef.h>
+#include <urcu/compiler.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Cache of fixed-size objects recycled after a grace period, rather
+ * than freed and allocated again. Each thread keeps a magazine of
+ * objects to allocate from and a magazine of retired objects. A full
+ * retired magazine is queued with a single call_rcu of the flavor: its
+ * callback, run by the call_rcu worker thread after a grace period,
+ * hands the whole magazine back to the pool depot, from which threads
+ * refill their allocation magazine.
+ *
+ * Objects are only given back to free() when the depot holds more
+ * than max_cached objects, or when the pool is destroyed, so memory
+ * handed out by a pool stays an object of that pool while the pool
+ * exists.
+ *
+ * Each pool uses one pthread key. Threads calling urcu_pool_free_rcu()
+ * must be registered RCU reader threads of the flavor.
+ */
+
+/* Number of objects per magazine. */
+#define URCU_POOL_MAGAZINE_SIZE	64
+
+struct urcu_pool;
+
+/*
+ * _urcu_pool_create: create a pool of objects of obj_size bytes.
+ * max_cached limits the number of free objects kept in the depot, 0
+ * meaning no limit. Returns NULL on allocation error.
+ */
+extern struct urcu_pool *_urcu_pool_create(size_t obj_size,
+		unsigned long max_cached,
+		const struct rcu_flavor_struct *flavor);
+
+/*
+ * urcu_pool_create: create a pool of objects of obj_size bytes, for
+ * the RCU flavor included before this header.
+ */
+static inline
+struct urcu_pool *urcu_pool_create(size_t obj_size,
+		unsigned long max_cached)
+{
+	return _urcu_pool_create(obj_size, max_cached, &rcu_flavor);
+}
+
+/*
+ * urcu_pool_destroy: wait for the objects retired to the pool with
+ * urcu_pool_free_rcu() to be recycled (with the flavor rcu_barrier),
+ * then free all the objects cached by the pool and by the threads.
+ * Objects still allocated must not be given back to the pool
+ * afterwards. The pool must not be used concurrently, and this must
+ * not be called from a call_rcu callback.
+ */
+extern void urcu_pool_destroy(struct urcu_pool *pool);
+
+/*
+ * urcu_pool_alloc: allocate an object from the pool. Returns NULL if
+ * the pool is empty and malloc() fails. The content of recycled
+ * objects is left as is.
+ */
+extern void *urcu_pool_alloc(struct urcu_pool *pool);
+
+/*
+ * urcu_pool_free: give an object back to the pool immediately. Only
+ * valid if no RCU reader can still hold a reference to the object,
+ * e.g. an object which was never published.
+ */
+extern void urcu_pool_free(struct urcu_pool *pool, void *obj);
+
+/*
+ * urcu_pool_free_rcu: give an object back to the pool after a grace
+ * period. Retired objects accumulate in a per-thread magazine, queued
+ * to call_rcu once full: call urcu_pool_flush() to queue a partial
+ * magazine.
+ */
+extern void urcu_pool_free_rcu(struct urcu_pool *pool, void *obj);
+
+/*
+ * urcu_pool_flush: queue the objects retired by the current thread so
+ * far for recycling after a grace period.
+ */
+extern void urcu_pool_flush(struct urcu_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCUPOOL_H */
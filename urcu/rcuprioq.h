@@ -0,0 +1,178 @@
+#ifndef _URCU_RCUPRIOQ_H
+#define _URCU_RCUPRIOQ_H
+
+/*
+ * urcu/rcuprioq.h
+ *
+ * Userspace RCU library - RCU skip list priority queue
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <pthread.h>
+#include <urcu/compiler.h>
+#include <urcu-call-rcu.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Min-priority queue kept as a skip list ordered by priority, e.g. of
+ * timer expiry times. Nodes of equal priority are dequeued in insertion
+ * order.
+ *
+ * cds_prioq_delete_min() does not take any lock: it walks the bottom
+ * level from the head, and claims the first node not claimed yet with
+ * an atomic exchange of its deleted flag (logical deletion). Claimed
+ * nodes stay linked, and are unlinked in batches: when a walk skips at
+ * least the batch size of claimed nodes, its thread unlinks the whole
+ * claimed prefix of the queue with one store per level, if it gets the
+ * mutex of the queue at once (otherwise the next walk does). Unlinked
+ * nodes are handed to call_rcu, and to the free function of the queue
+ * after a grace period. cds_prioq_peek_min() is a read-side walk to the
+ * first unclaimed node, past at most about a batch of claimed nodes.
+ * Insertions are serialized by the mutex (they only race with claims),
+ * and publish the node bottom-up, as cds_skl_add().
+ *
+ * Nodes are intrusive: struct cds_prioq_node is embedded in the user
+ * structure, which holds the priority. Levels above the first one are
+ * kept in a tower allocated on insertion (3 nodes out of 4 have none).
+ */
+#define CDS_PRIOQ_MAX_LEVEL	16
+
+/* Default number of claimed nodes skipped before unlinking them. */
+#define CDS_PRIOQ_UNLINK_BATCH	32
+
+struct cds_prioq_tower;
+
+struct cds_prioq_node {
+	struct cds_prioq_node *next;	/* level 0 */
+	struct cds_prioq_tower *tower;	/* levels 1 and up, NULL if none */
+	int deleted;			/* claimed */
+	int unlinking;			/* in the prefix being unlinked */
+	struct rcu_head head;		/* passed to the free function */
+};
+
+/*
+ * Compare the priorities of two nodes: return a negative value, 0, or a
+ * positive value if the priority of a is respectively smaller than,
+ * equal to, or greater than the priority of b.
+ */
+typedef int (*cds_prioq_cmp_fct)(struct cds_prioq_node *a,
+		struct cds_prioq_node *b);
+
+struct cds_prioq {
+	struct cds_prioq_node *head[CDS_PRIOQ_MAX_LEVEL];
+	unsigned int level;		/* levels in use, never decreases */
+	cds_prioq_cmp_fct cmp;
+	unsigned int batch;
+	pthread_mutex_t lock;		/* serializes insertion and unlink */
+	unsigned long seed;		/* random levels, protected by lock */
+	void (*prioq_call_rcu)(struct rcu_head *head,
+		void (*func)(struct rcu_head *head));
+	void (*free_node)(struct rcu_head *head);
+};
+
+static inline
+void cds_prioq_node_init(struct cds_prioq_node *node)
+{
+	node->next = NULL;
+	node->tower = NULL;
+	node->deleted = 0;
+	node->unlinking = 0;
+}
+
+/*
+ * cds_prioq_init - initialize an empty priority queue.
+ * @q: the priority queue.
+ * @cmp: the priority comparison function.
+ * @batch: claimed nodes skipped before unlinking them, 0 for
+ *         CDS_PRIOQ_UNLINK_BATCH.
+ * @prioq_call_rcu: call_rcu of the RCU flavor used with the queue.
+ * @free_node: called through prioq_call_rcu with the head of each node
+ *             unlinked from the queue.
+ */
+extern
+void cds_prioq_init(struct cds_prioq *q, cds_prioq_cmp_fct cmp,
+		unsigned int batch,
+		void prioq_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)),
+		void (*free_node)(struct rcu_head *head));
+
+/*
+ * cds_prioq_destroy - destroy a priority queue.
+ *
+ * Hands the claimed nodes still linked to the free function. The queue
+ * must not be used concurrently nor afterwards.
+ * Return 0 on success, -EPERM if the queue holds unclaimed nodes.
+ */
+extern
+int cds_prioq_destroy(struct cds_prioq *q);
+
+/*
+ * cds_prioq_insert - insert a node, after the nodes of equal priority.
+ *
+ * Return 0 on success, or -ENOMEM if the node tower cannot be
+ * allocated.
+ * Threads calling this API need to be registered RCU read-side threads,
+ * holding the read-side lock or not.
+ */
+extern
+int cds_prioq_insert(struct cds_prioq *q, struct cds_prioq_node *node);
+
+/*
+ * cds_prioq_delete_min - claim the node of smallest priority.
+ *
+ * Return NULL if the queue is empty. The node is freed through the free
+ * function after it is unlinked: it can only be accessed until the end
+ * of the read-side critical section, and must not be inserted again.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_prioq_node *cds_prioq_delete_min(struct cds_prioq *q);
+
+/*
+ * cds_prioq_peek_min - get the node of smallest priority, without
+ * claiming it.
+ *
+ * Return NULL if the queue is empty. The node may be claimed
+ * concurrently.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_prioq_node *cds_prioq_peek_min(struct cds_prioq *q);
+
+/*
+ * cds_prioq_delete - claim a node, e.g. to cancel a timer.
+ *
+ * Return 0 on success, or -ENOENT if the node was already claimed. The
+ * node stays linked until it reaches the front of the queue, then is
+ * unlinked and freed as those claimed by cds_prioq_delete_min().
+ * Call with rcu_read_lock held, the node having been found within the
+ * same read-side critical section, or not yet claimed.
+ */
+extern
+int cds_prioq_delete(struct cds_prioq *q, struct cds_prioq_node *node);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCUPRIOQ_H */
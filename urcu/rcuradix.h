@@ -0,0 +1,187 @@
+#ifndef _URCU_RCURADIX_H
+#define _URCU_RCURADIX_H
+
+/*
+ * urcu/rcuradix.h
+ *
+ * Userspace RCU library - RCU Radix Tree (integer keys)
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <urcu/compiler.h>
+#include <urcu-call-rcu.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Map of unique unsigned long keys, kept as a radix tree of fixed
+ * height, indexed by CDS_RDX_BITS bits of the key per level. It suits
+ * dense keyspaces: there are no per-key bucket nor dummy nodes, and a
+ * lookup is one slot load per level. Lookups, lower bound and traversals
+ * in key order are wait-free RCU read-side operations.
+ *
+ * Updates lock the interior node they modify, so updates of distinct
+ * subtrees proceed in parallel. Interior nodes are allocated on demand,
+ * and the ones left empty by a removal are unlinked and freed with
+ * call_rcu.
+ *
+ * Nodes are intrusive: struct cds_rdx_node is embedded in the user
+ * structure, and holds its key.
+ */
+#define CDS_RDX_BITS		6
+
+struct cds_rdx_inode;
+
+struct cds_rdx_node {
+	unsigned long key;
+};
+
+struct cds_rdx {
+	struct cds_rdx_inode *root;
+	unsigned int height;		/* levels of interior nodes */
+	unsigned long max_key;
+	void (*rdx_call_rcu)(struct rcu_head *head,
+		void (*func)(struct rcu_head *head));
+};
+
+/*
+ * cds_rdx_init - initialize an empty radix tree.
+ * @rdx: the radix tree.
+ * @key_bits: number of significant bits of the keys, between 1 and
+ *            CAA_BITS_PER_LONG. The tree height is key_bits divided by
+ *            CDS_RDX_BITS, rounded up.
+ * @rdx_call_rcu: call_rcu of the RCU flavor used with the radix tree.
+ *
+ * Return 0 on success, -EINVAL if key_bits is out of range, or -ENOMEM
+ * if the root node cannot be allocated.
+ */
+extern
+int cds_rdx_init(struct cds_rdx *rdx, unsigned int key_bits,
+		void rdx_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)));
+
+/*
+ * cds_rdx_destroy - destroy a radix tree.
+ *
+ * The radix tree should be emptied before calling destroy, and a grace
+ * period waited for (e.g. with rcu_barrier()) after the last removal.
+ * Return 0 on success, -EPERM if radix tree is not empty.
+ */
+extern
+int cds_rdx_destroy(struct cds_rdx *rdx);
+
+/*
+ * cds_rdx_lookup - get the node of a key.
+ *
+ * Return NULL if not found.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_rdx_node *cds_rdx_lookup(struct cds_rdx *rdx, unsigned long key);
+
+/*
+ * cds_rdx_lower_bound - get the node of the smallest key not smaller
+ *                       than key.
+ *
+ * Return NULL if no such node exists.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_rdx_node *cds_rdx_lower_bound(struct cds_rdx *rdx,
+		unsigned long key);
+
+/*
+ * cds_rdx_next - get the node following node in key order.
+ *
+ * Return NULL if node is the last node. Can be called on a node removed
+ * within the current read-side critical section.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_rdx_node *cds_rdx_next(struct cds_rdx *rdx,
+		struct cds_rdx_node *node);
+
+/*
+ * cds_rdx_add - add a node to the radix tree.
+ * @rdx: the radix tree.
+ * @key: the key of node.
+ * @node: the node to add.
+ *
+ * Return 0 on success, -EEXIST if a node with the same key is already
+ * present, -EINVAL if key is larger than the keys of the tree, or
+ * -ENOMEM if an interior node cannot be allocated.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+int cds_rdx_add(struct cds_rdx *rdx, unsigned long key,
+		struct cds_rdx_node *node);
+
+/*
+ * cds_rdx_del - remove the node of a key from the radix tree.
+ *
+ * Return the removed node, or NULL if not found.
+ * After removal, a grace period must be waited for before freeing or
+ * re-adding the node.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_rdx_node *cds_rdx_del(struct cds_rdx *rdx, unsigned long key);
+
+static inline
+struct cds_rdx_node *cds_rdx_first(struct cds_rdx *rdx)
+{
+	return cds_rdx_lower_bound(rdx, 0);
+}
+
+/*
+ * Traversals in key order, from the first node, or from the first node
+ * whose key is not smaller than key. Call with rcu_read_lock held.
+ */
+#define cds_rdx_for_each(rdx, node)					\
+	for (node = cds_rdx_first(rdx);					\
+		node != NULL;						\
+		node = cds_rdx_next(rdx, node))
+
+#define cds_rdx_for_each_from(rdx, key, node)				\
+	for (node = cds_rdx_lower_bound(rdx, key);			\
+		node != NULL;						\
+		node = cds_rdx_next(rdx, node))
+
+#define cds_rdx_for_each_entry(rdx, node, pos, member)			\
+	for (node = cds_rdx_first(rdx),					\
+			pos = caa_container_of(node,			\
+				__typeof__(*(pos)), member);		\
+		node != NULL;						\
+		node = cds_rdx_next(rdx, node),				\
+			pos = caa_container_of(node,			\
+				__typeof__(*(pos)), member))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCURADIX_H */
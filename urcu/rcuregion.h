@@ -0,0 +1,121 @@
+#ifndef _URCU_RCUREGION_H
+#define _URCU_RCUREGION_H
+
+/*
+ * urcu/rcuregion.h
+ *
+ * Userspace RCU library - RCU region allocator
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <stddef.h>
+#include <urcu/compiler.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Region allocator for small RCU-protected objects which die in bulk,
+ * e.g. the nodes replaced by a batch of updates. Objects are carved
+ * with a bump pointer out of arenas of arena_size bytes, without any
+ * per-object header: each thread allocates from its own arena of the
+ * current epoch. An arena is retired when it is full, or when its
+ * thread allocates again after urcu_region_new_epoch(), so objects of
+ * different epochs never share an arena. Each arena counts its live
+ * objects: once it is retired and its last object went through
+ * urcu_region_free_rcu(), a single call_rcu of the flavor hands the
+ * whole arena back to the region after a grace period, to be reused
+ * by the next arena allocation.
+ *
+ * Memory is only recycled a whole arena at a time: an object living
+ * much longer than the others of its epoch keeps its arena allocated.
+ * Arenas are only given back to free() when the region caches more
+ * than max_cached of them, or when the region is destroyed.
+ *
+ * Each region uses one pthread key. Threads calling urcu_region_alloc()
+ * and urcu_region_free_rcu() must be registered RCU reader threads of
+ * the flavor.
+ */
+
+/* Default arena size, in bytes. */
+#define URCU_REGION_ARENA_SIZE	65536
+
+/* Alignment of the objects, and granularity of their size. */
+#define URCU_REGION_ALIGN	(2 * sizeof(void *))
+
+struct urcu_region;
+
+/*
+ * _urcu_region_create: create a region of arenas of arena_size bytes,
+ * rounded up to a power of two (0 for URCU_REGION_ARENA_SIZE).
+ * max_cached limits the number of free arenas kept by the region, 0
+ * meaning no limit. Returns NULL on allocation error.
+ */
+extern struct urcu_region *_urcu_region_create(size_t arena_size,
+		unsigned long max_cached,
+		const struct rcu_flavor_struct *flavor);
+
+/*
+ * urcu_region_create: create a region of arenas of arena_size bytes,
+ * for the RCU flavor included before this header.
+ */
+static inline
+struct urcu_region *urcu_region_create(size_t arena_size,
+		unsigned long max_cached)
+{
+	return _urcu_region_create(arena_size, max_cached, &rcu_flavor);
+}
+
+/*
+ * urcu_region_destroy: wait for the arenas queued to call_rcu to be
+ * recycled (with the flavor rcu_barrier), then free all the arenas,
+ * along with the objects still allocated from them. The region must
+ * not be used concurrently, and this must not be called from a
+ * call_rcu callback.
+ */
+extern void urcu_region_destroy(struct urcu_region *region);
+
+/*
+ * urcu_region_alloc: allocate size bytes from the arena of the current
+ * thread, aligned on URCU_REGION_ALIGN. Returns NULL if size does not
+ * fit in an arena, or if a new arena cannot be allocated. The content
+ * of the object is left as is.
+ */
+extern void *urcu_region_alloc(struct urcu_region *region, size_t size);
+
+/*
+ * urcu_region_free_rcu: retire an object allocated from the region.
+ * Its memory is reused once the whole arena holding it is recycled,
+ * after a grace period.
+ */
+extern void urcu_region_free_rcu(struct urcu_region *region, void *obj);
+
+/*
+ * urcu_region_new_epoch: start a new epoch: each thread allocates from
+ * a new arena from now on, retiring the arena of the previous epoch.
+ */
+extern void urcu_region_new_epoch(struct urcu_region *region);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCUREGION_H */
@@ -0,0 +1,209 @@
+#ifndef _URCU_RCUSKIPLIST_H
+#define _URCU_RCUSKIPLIST_H
+
+/*
+ * urcu/rcuskiplist.h
+ *
+ * Userspace RCU library - RCU Skip List (ordered map)
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <pthread.h>
+#include <urcu/compiler.h>
+#include <urcu-call-rcu.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Ordered map of unique keys, kept as a skip list. Lookups, lower bound
+ * and range traversals are RCU read-side operations, and never block.
+ * Updates are serialized by a mutex of the skip list, and unlink the
+ * nodes from each level without modifying them, so concurrent readers
+ * can keep traversing removed nodes until the end of their read-side
+ * critical section.
+ *
+ * Nodes are intrusive: struct cds_skl_node is embedded in the user
+ * structure, which holds the key. Levels above the first one are kept
+ * in a tower allocated when the node is added (3 nodes out of 4 have
+ * none), and freed with call_rcu when the node is removed.
+ */
+#define CDS_SKL_MAX_LEVEL	16
+
+struct cds_skl_tower;
+
+struct cds_skl_node {
+	struct cds_skl_node *next;	/* level 0 */
+	struct cds_skl_tower *tower;	/* levels 1 and up, NULL if none */
+};
+
+/*
+ * Compare a node key with a key: return a negative value, 0, or a
+ * positive value if the node key is respectively smaller than, equal
+ * to, or greater than key.
+ */
+typedef int (*cds_skl_cmp_fct)(struct cds_skl_node *node, const void *key);
+
+struct cds_skl {
+	struct cds_skl_node *head[CDS_SKL_MAX_LEVEL];
+	unsigned int level;		/* levels in use, never decreases */
+	cds_skl_cmp_fct cmp;
+	pthread_mutex_t lock;		/* serializes updates */
+	unsigned long seed;		/* random levels, protected by lock */
+	void (*skl_call_rcu)(struct rcu_head *head,
+		void (*func)(struct rcu_head *head));
+};
+
+static inline
+void cds_skl_node_init(struct cds_skl_node *node)
+{
+	node->next = NULL;
+	node->tower = NULL;
+}
+
+/*
+ * cds_skl_init - initialize an empty skip list.
+ * @skl: the skip list.
+ * @cmp: the key comparison function.
+ * @skl_call_rcu: call_rcu of the RCU flavor used with the skip list.
+ */
+extern
+void cds_skl_init(struct cds_skl *skl, cds_skl_cmp_fct cmp,
+		void skl_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)));
+
+/*
+ * cds_skl_destroy - destroy a skip list.
+ *
+ * The skip list should be emptied before calling destroy.
+ * Return 0 on success, -EPERM if skip list is not empty.
+ */
+extern
+int cds_skl_destroy(struct cds_skl *skl);
+
+/*
+ * cds_skl_lookup - get the node of a key.
+ *
+ * Return NULL if not found.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_skl_node *cds_skl_lookup(struct cds_skl *skl, const void *key);
+
+/*
+ * cds_skl_lower_bound - get the first node whose key is not smaller
+ *                       than key.
+ *
+ * Return NULL if no such node exists.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_skl_node *cds_skl_lower_bound(struct cds_skl *skl,
+		const void *key);
+
+/*
+ * cds_skl_first - get the node of the smallest key.
+ *
+ * Return NULL if the skip list is empty.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_skl_node *cds_skl_first(struct cds_skl *skl);
+
+/*
+ * cds_skl_next - get the node following node in key order.
+ *
+ * Return NULL if node is the last node. Can be called on a node removed
+ * within the current read-side critical section: nodes added after its
+ * removal may then be missed.
+ * Call with rcu_read_lock held.
+ * Threads calling this API need to be registered RCU read-side threads.
+ */
+extern
+struct cds_skl_node *cds_skl_next(struct cds_skl_node *node);
+
+/*
+ * cds_skl_add - add a node to the skip list.
+ * @skl: the skip list.
+ * @key: the key of node.
+ * @node: the node to add.
+ *
+ * Return 0 on success, -EEXIST if a node with the same key is already
+ * present, or -ENOMEM if the node tower cannot be allocated.
+ * Threads calling this API need to be registered RCU read-side threads,
+ * holding the read-side lock or not.
+ */
+extern
+int cds_skl_add(struct cds_skl *skl, const void *key,
+		struct cds_skl_node *node);
+
+/*
+ * cds_skl_del - remove the node of a key from the skip list.
+ *
+ * Return the removed node, or NULL if not found.
+ * After removal, a grace period must be waited for before freeing or
+ * re-adding the node.
+ * Threads calling this API need to be registered RCU read-side threads,
+ * holding the read-side lock or not.
+ */
+extern
+struct cds_skl_node *cds_skl_del(struct cds_skl *skl, const void *key);
+
+/*
+ * Traversals in key order, from the first node, or from the first node
+ * whose key is not smaller than key. Call with rcu_read_lock held.
+ */
+#define cds_skl_for_each(skl, node)					\
+	for (node = cds_skl_first(skl);					\
+		node != NULL;						\
+		node = cds_skl_next(node))
+
+#define cds_skl_for_each_from(skl, key, node)				\
+	for (node = cds_skl_lower_bound(skl, key);			\
+		node != NULL;						\
+		node = cds_skl_next(node))
+
+#define cds_skl_for_each_entry(skl, node, pos, member)			\
+	for (node = cds_skl_first(skl),					\
+			pos = caa_container_of(node,			\
+				__typeof__(*(pos)), member);		\
+		node != NULL;						\
+		node = cds_skl_next(node),				\
+			pos = caa_container_of(node,			\
+				__typeof__(*(pos)), member))
+
+#define cds_skl_for_each_entry_from(skl, key, node, pos, member)	\
+	for (node = cds_skl_lower_bound(skl, key),			\
+			pos = caa_container_of(node,			\
+				__typeof__(*(pos)), member);		\
+		node != NULL;						\
+		node = cds_skl_next(node),				\
+			pos = caa_container_of(node,			\
+				__typeof__(*(pos)), member))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCUSKIPLIST_H */
@@ -0,0 +1,145 @@
+#ifndef _URCU_RCUSWHT_H
+#define _URCU_RCUSWHT_H
+
+/*
+ * urcu/rcuswht.h
+ *
+ * Userspace RCU library - RCU open-addressing hash map probed by groups
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <urcu-flavor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Open-addressing hash map of item pointers, for read-dominated
+ * caches. Slots are grouped by 16, each with a control byte holding 7
+ * bits of the hash of its item, or marking it empty or deleted. Lookups
+ * compare the control bytes of a whole group at once (with SSE2 or NEON
+ * when available), and probe the groups quadratically until one has an
+ * empty slot. They are wait-free RCU read-side operations, and only
+ * call the match function for slots holding the same hash.
+ *
+ * Updates are serialized by a mutex of the map. Removal marks the slot
+ * deleted, leaving the item in place for concurrent readers, so probe
+ * sequences never shorten under a reader. When deleted and used slots
+ * fill 7/8 of the table, it is rebuilt at a size fitting its items,
+ * published with rcu_assign_pointer(), and the old table is freed with
+ * the call_rcu of the flavor given at creation. Removed items must wait
+ * for a grace period before being freed.
+ *
+ * The caller provides the hash of the key to each operation.
+ */
+struct cds_swht;
+
+/*
+ * cds_swht_match_fct - returns non-zero if @item has key @key.
+ */
+typedef int (*cds_swht_match_fct)(void *item, const void *key);
+
+/*
+ * _cds_swht_new - allocate a hash map.
+ * @init_size: number of items to size the initial table for.
+ * @flavor: flavor of the RCU read-side critical sections of the
+ *          lookups, whose call_rcu frees replaced tables.
+ *
+ * Return NULL on allocation error.
+ */
+extern
+struct cds_swht *_cds_swht_new(unsigned long init_size,
+		const struct rcu_flavor_struct *flavor);
+
+/*
+ * cds_swht_new - allocate a hash map for the RCU flavor included
+ *                before this header.
+ */
+static inline
+struct cds_swht *cds_swht_new(unsigned long init_size)
+{
+	return _cds_swht_new(init_size, &rcu_flavor);
+}
+
+/*
+ * cds_swht_destroy - free a hash map, without freeing its items.
+ *
+ * No reader nor updater may access the map anymore, and the call_rcu
+ * callbacks freeing its replaced tables must have been invoked (e.g.
+ * rcu_barrier()).
+ */
+extern
+void cds_swht_destroy(struct cds_swht *ht);
+
+/*
+ * cds_swht_lookup - lookup an item.
+ * @ht: the hash map.
+ * @hash: the key hash.
+ * @match: the key match function.
+ * @key: the key.
+ *
+ * Returns the item, or NULL if not found. Call with rcu_read_lock held:
+ * the item is valid until rcu_read_unlock().
+ */
+extern
+void *cds_swht_lookup(struct cds_swht *ht, unsigned long hash,
+		cds_swht_match_fct match, const void *key);
+
+/*
+ * cds_swht_add - add an item if its key is not present.
+ * @ht: the hash map.
+ * @hash: the key hash.
+ * @match: the key match function.
+ * @key: the key of @item.
+ * @item: the item, not NULL.
+ *
+ * Returns 0 on success, -EEXIST if an item with key @key is present,
+ * -ENOMEM if the table needed to grow and could not be allocated.
+ */
+extern
+int cds_swht_add(struct cds_swht *ht, unsigned long hash,
+		cds_swht_match_fct match, const void *key, void *item);
+
+/*
+ * cds_swht_del - remove an item.
+ * @ht: the hash map.
+ * @hash: the key hash.
+ * @match: the key match function.
+ * @key: the key.
+ *
+ * Returns the removed item, or NULL if not found. A grace period must
+ * be waited for before freeing it.
+ */
+extern
+void *cds_swht_del(struct cds_swht *ht, unsigned long hash,
+		cds_swht_match_fct match, const void *key);
+
+/*
+ * cds_swht_count - number of items in the hash map.
+ */
+extern
+unsigned long cds_swht_count(struct cds_swht *ht);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCUSWHT_H */
@@ -0,0 +1,187 @@
+#ifndef _URCU_RCUVEC_H
+#define _URCU_RCUVEC_H
+
+/*
+ * urcu/rcuvec.h
+ *
+ * Userspace RCU library - RCU vector (read-mostly array)
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <pthread.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+#include <urcu-pointer.h>
+#include <urcu-call-rcu.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Read-mostly array of pointers. Readers index a snapshot of the array
+ * without taking any lock. Updates are serialized by a mutex of the
+ * vector: appends store into the current array while it has spare
+ * capacity, and publish the new length after the element. Other
+ * updates, and appends to a full array, publish a new array with
+ * rcu_xchg_pointer(), and free the old one with call_rcu, so readers
+ * of a snapshot never see elements move.
+ */
+struct cds_vec_array {
+	unsigned long len;		/* published elements */
+	unsigned long capacity;
+	struct rcu_head head;
+	void *elem[];
+};
+
+struct cds_vec {
+	struct cds_vec_array *array;	/* NULL if empty */
+	pthread_mutex_t lock;		/* serializes updates */
+	void (*vec_call_rcu)(struct rcu_head *head,
+		void (*func)(struct rcu_head *head));
+};
+
+/*
+ * cds_vec_init - initialize an empty vector.
+ * @vec: the vector.
+ * @vec_call_rcu: call_rcu of the RCU flavor used with the vector.
+ */
+extern
+void cds_vec_init(struct cds_vec *vec,
+		void vec_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)));
+
+/*
+ * cds_vec_destroy - destroy a vector and free its array.
+ *
+ * No reader nor updater may access the vector anymore, and a grace
+ * period must have elapsed since the last update (e.g. rcu_barrier()).
+ */
+extern
+void cds_vec_destroy(struct cds_vec *vec);
+
+/*
+ * cds_vec_append - append elem at the end of the vector.
+ *
+ * Return 0 on success, or -ENOMEM if a larger array cannot be
+ * allocated.
+ */
+extern
+int cds_vec_append(struct cds_vec *vec, void *elem);
+
+/*
+ * cds_vec_set - replace element index in place.
+ *
+ * Return the previous element, or NULL if index is out of range.
+ * The previous element may still be used by readers until a grace
+ * period has elapsed.
+ */
+extern
+void *cds_vec_set(struct cds_vec *vec, unsigned long index, void *elem);
+
+/*
+ * cds_vec_del - remove element index, moving the following elements
+ *               down by one in a new array.
+ *
+ * Return 0 on success, -EINVAL if index is out of range, or -ENOMEM if
+ * the new array cannot be allocated.
+ */
+extern
+int cds_vec_del(struct cds_vec *vec, unsigned long index);
+
+/*
+ * cds_vec_replace - replace the whole vector content by the len
+ *                   elements of elems, in a single publication.
+ *
+ * Return 0 on success, or -ENOMEM if the new array cannot be
+ * allocated. An empty content (len 0) frees the array.
+ */
+extern
+int cds_vec_replace(struct cds_vec *vec, void * const *elems,
+		unsigned long len);
+
+/*
+ * Read-side accessors. Call with rcu_read_lock held: the snapshot
+ * returned by cds_vec_read() is valid until rcu_read_unlock().
+ */
+static inline
+struct cds_vec_array *cds_vec_read(struct cds_vec *vec)
+{
+	return rcu_dereference(vec->array);
+}
+
+static inline
+unsigned long cds_vec_array_len(struct cds_vec_array *array)
+{
+	unsigned long len;
+
+	if (!array)
+		return 0;
+	len = CMM_LOAD_SHARED(array->len);
+	/* Read the length before the elements it covers. */
+	cmm_smp_rmb();
+	return len;
+}
+
+/*
+ * Element index of a snapshot, for index smaller than the length read
+ * with cds_vec_array_len().
+ */
+static inline
+void *cds_vec_array_get(struct cds_vec_array *array, unsigned long index)
+{
+	return rcu_dereference(array->elem[index]);
+}
+
+/*
+ * Element index, or NULL if index is out of range.
+ */
+static inline
+void *cds_vec_get(struct cds_vec *vec, unsigned long index)
+{
+	struct cds_vec_array *array = cds_vec_read(vec);
+
+	if (index >= cds_vec_array_len(array))
+		return NULL;
+	return cds_vec_array_get(array, index);
+}
+
+/*
+ * cds_vec_for_each - iterate over the elements of a snapshot.
+ * @vec: the vector.
+ * @array: struct cds_vec_array pointer, set to the snapshot.
+ * @len: unsigned long, set to the snapshot length.
+ * @index: unsigned long index.
+ * @elem: element pointer.
+ *
+ * Call with rcu_read_lock held.
+ */
+#define cds_vec_for_each(vec, array, len, index, elem)			\
+	for (array = cds_vec_read(vec),					\
+			len = cds_vec_array_len(array), index = 0;	\
+		index < len						\
+			&& ((elem = cds_vec_array_get(array, index)), 1); \
+		index++)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCUVEC_H */
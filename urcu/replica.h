@@ -0,0 +1,167 @@
+#ifndef _URCU_REPLICA_H
+#define _URCU_REPLICA_H
+
+/*
+ * urcu/replica.h
+ *
+ * Userspace RCU library - NUMA-replicated RCU pointer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <stddef.h>
+#include <pthread.h>
+#include <urcu/compiler.h>
+#include <urcu/rseq.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * RCU pointer to a read-mostly object replicated on each NUMA node.
+ * Updates build one replica per node, typically allocated on that node
+ * with rcu_replica_alloc(), publish them all, and wait for a single
+ * grace period of the flavor before freeing the previous replicas.
+ * rcu_dereference_replica() returns the replica of the node the caller
+ * runs on, so readers only touch node-local memory, at the cost of one
+ * copy of the object per node. While an update publishes its replicas,
+ * readers on different nodes may see different versions.
+ *
+ * Only nodes with CPUs get a replica. Without NUMA information, there
+ * is a single replica, as for a plain RCU pointer.
+ */
+
+struct rcu_replica_node {
+	void *ptr;
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+struct rcu_replica {
+	struct rcu_replica_node *node;	/* one per replica */
+	unsigned int nr_nodes;
+	unsigned int nr_cpus;
+	const unsigned int *cpu_node;	/* replica index of each CPU */
+	void (*free_replica)(void *p);
+	const struct rcu_flavor_struct *flavor;
+	pthread_mutex_t lock;		/* serializes updates */
+};
+
+/*
+ * rcu_replica_copy_fct - build the replica of a node.
+ * @node: NUMA node id of the replica.
+ * @priv: private data of the update.
+ *
+ * Returns the replica, or NULL on allocation error.
+ */
+typedef void *(*rcu_replica_copy_fct)(int node, void *priv);
+
+/*
+ * _rcu_replica_init - initialize a replicated pointer to NULL.
+ * @free_replica: frees a replica once no reader can access it.
+ * @flavor: flavor of the read-side critical sections of the readers.
+ *
+ * Returns 0 on success, -ENOMEM on allocation error.
+ */
+extern int _rcu_replica_init(struct rcu_replica *r,
+		void (*free_replica)(void *p),
+		const struct rcu_flavor_struct *flavor);
+
+/*
+ * rcu_replica_init - initialize a replicated pointer for the RCU flavor
+ *                    included before this header.
+ */
+static inline
+int rcu_replica_init(struct rcu_replica *r, void (*free_replica)(void *p))
+{
+	return _rcu_replica_init(r, free_replica, &rcu_flavor);
+}
+
+/*
+ * rcu_replica_exit - free the current replicas and the per-node
+ * pointers. No reader nor updater may access the pointer anymore.
+ */
+extern void rcu_replica_exit(struct rcu_replica *r);
+
+/*
+ * rcu_replica_nr_nodes - number of replicas, one per NUMA node with
+ * CPUs.
+ */
+static inline
+unsigned int rcu_replica_nr_nodes(struct rcu_replica *r)
+{
+	return r->nr_nodes;
+}
+
+/*
+ * rcu_replica_update - replace all replicas.
+ * @copy: builds the replica of each node.
+ * @priv: passed to @copy.
+ *
+ * Builds all new replicas, publishes them, waits for a grace period and
+ * frees the previous replicas. If a replica cannot be built, those
+ * already built are freed and the replicas are left unchanged. Must
+ * not be called from within a read-side critical section.
+ *
+ * Returns 0 on success, -ENOMEM if @copy failed.
+ */
+extern int rcu_replica_update(struct rcu_replica *r,
+		rcu_replica_copy_fct copy, void *priv);
+
+/*
+ * rcu_replica_alloc - allocate zeroed memory on a NUMA node.
+ * @len: size of the allocation.
+ * @node: NUMA node id, as passed to the copy function.
+ *
+ * The allocation covers whole pages, so it is bound to the node
+ * separately from other allocations (preferred policy: falls back on
+ * other nodes when the node is out of memory). Free with free().
+ * Returns NULL on allocation error.
+ */
+extern void *rcu_replica_alloc(size_t len, int node);
+
+/* CPU number of the caller when the rseq area is unavailable. */
+extern int rcu_replica_current_cpu(void);
+
+/*
+ * rcu_dereference_replica - return the replica of the current node.
+ *
+ * Call within a read-side critical section of the flavor: the replica
+ * is valid until its end.
+ */
+static inline
+void *rcu_dereference_replica(struct rcu_replica *r)
+{
+	unsigned int node = 0;
+	int cpu;
+
+	if (r->nr_nodes == 1)
+		return rcu_dereference(r->node[0].ptr);
+	cpu = urcu_rseq_cpu_id();
+	if (caa_unlikely(cpu < 0))
+		cpu = rcu_replica_current_cpu();
+	if (caa_likely((unsigned int) cpu < r->nr_cpus))
+		node = r->cpu_node[cpu];
+	return rcu_dereference(r->node[node].ptr);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_REPLICA_H */
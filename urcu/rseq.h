@@ -0,0 +1,165 @@
+#ifndef _URCU_RSEQ_H
+#define _URCU_RSEQ_H
+
+/*
+ * urcu/rseq.h
+ *
+ * Userspace RCU library - restartable sequences helpers
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Uses the rseq area registered by the C library for each thread
+ * (glibc 2.35 and later) to read the current CPU number without system
+ * call, and, on x86-64, to update per-CPU data without atomic
+ * instruction.
+ *
+ * URCU_HAVE_RSEQ: urcu_rseq_cpu_id() is available.
+ * URCU_HAVE_RSEQ_PERCPU: urcu_rseq_add_return() is available.
+ */
+
+#include <stdint.h>
+#include <urcu/config.h>
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+
+#if defined(CONFIG_RCU_HAVE_RSEQ) && defined(__linux__) \
+		&& (defined(__x86_64__) || defined(__i386__) \
+			|| defined(__aarch64__))
+#include <sys/rseq.h>
+#define URCU_HAVE_RSEQ
+#if defined(__x86_64__) && defined(RSEQ_SIG)
+#define URCU_HAVE_RSEQ_PERCPU
+#endif
+#endif
+
+#ifdef URCU_HAVE_RSEQ
+
+static inline
+struct rseq *urcu_rseq_area(void)
+{
+	char *tp;
+
+#if defined(__x86_64__)
+	__asm__ ("movq %%fs:0, %0" : "=r" (tp));
+#elif defined(__i386__)
+	__asm__ ("movl %%gs:0, %0" : "=r" (tp));
+#else
+	tp = __builtin_thread_pointer();
+#endif
+	return (struct rseq *) (tp + __rseq_offset);
+}
+
+/*
+ * Return the current CPU number, or -1 if the C library has not
+ * registered a rseq area.
+ */
+static inline
+int urcu_rseq_cpu_id(void)
+{
+	int32_t cpu;
+
+	if (caa_unlikely(!__rseq_size))
+		return -1;
+	cpu = (int32_t) CMM_LOAD_SHARED(urcu_rseq_area()->cpu_id);
+	return cpu < 0 ? -1 : cpu;
+}
+
+#else /* #ifdef URCU_HAVE_RSEQ */
+
+static inline
+int urcu_rseq_cpu_id(void)
+{
+	return -1;
+}
+
+#endif /* #else #ifdef URCU_HAVE_RSEQ */
+
+#ifdef URCU_HAVE_RSEQ_PERCPU
+
+#define _URCU_RSEQ_STR(x)	#x
+#define URCU_RSEQ_STR(x)	_URCU_RSEQ_STR(x)
+
+/*
+ * Return the CPU number to pass to urcu_rseq_add_return(), or -1 if the
+ * C library has not registered a rseq area.
+ */
+static inline
+int urcu_rseq_cpu_start(void)
+{
+	if (caa_unlikely(!__rseq_size))
+		return -1;
+	return CMM_LOAD_SHARED(urcu_rseq_area()->cpu_id_start);
+}
+
+/*
+ * Add count to *v and store the result in *newv, within a restartable
+ * sequence which only commits if the thread is still running on cpu,
+ * without being preempted or migrated. *v must only be updated by
+ * threads running on cpu, with this function. Return 0 on success, or
+ * -1 if the sequence has been aborted before its commit, in which case
+ * the caller retries, with a new urcu_rseq_cpu_start() value.
+ */
+static inline
+int urcu_rseq_add_return(unsigned long *v, unsigned long count, int cpu,
+		unsigned long *newv)
+{
+	struct rseq *rs = urcu_rseq_area();
+
+	__asm__ __volatile__ goto (
+		".pushsection __rseq_cs, \"aw\"\n\t"
+		".balign 32\n\t"
+		"3:\n\t"
+		/* struct rseq_cs: version, flags, start, post-commit, abort */
+		".long 0x0, 0x0\n\t"
+		".quad 1f, (2f - 1f), 4f\n\t"
+		".popsection\n\t"
+		"leaq 3b(%%rip), %%rax\n\t"
+		"movq %%rax, %[rseq_cs]\n\t"
+		"1:\n\t"
+		"cmpl %[cpu_id], %[current_cpu_id]\n\t"
+		"jnz %l[abort]\n\t"
+		"movq %[v], %%rax\n\t"
+		"addq %[count], %%rax\n\t"
+		"movq %%rax, %[v]\n\t"	/* commit */
+		"2:\n\t"
+		"movq %%rax, %[newv]\n\t"
+		".pushsection __rseq_failure, \"ax\"\n\t"
+		/* Signature expected by the kernel before the abort handler. */
+		".byte 0x0f, 0xb9, 0x3d\n\t"
+		".long " URCU_RSEQ_STR(RSEQ_SIG) "\n\t"
+		"4:\n\t"
+		"jmp %l[abort]\n\t"
+		".popsection\n\t"
+		: /* no output */
+		: [cpu_id] "r" (cpu),
+		  [current_cpu_id] "m" (rs->cpu_id),
+		  [rseq_cs] "m" (rs->rseq_cs),
+		  [v] "m" (*v),
+		  [newv] "m" (*newv),
+		  [count] "er" (count)
+		: "memory", "cc", "rax"
+		: abort);
+	return 0;
+abort:
+	return -1;
+}
+
+#endif /* #ifdef URCU_HAVE_RSEQ_PERCPU */
+
+#endif /* _URCU_RSEQ_H */
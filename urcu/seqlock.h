@@ -0,0 +1,207 @@
+#ifndef _URCU_SEQLOCK_H
+#define _URCU_SEQLOCK_H
+
+/*
+ * urcu/seqlock.h
+ *
+ * Userspace RCU library - sequence counters and locks
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Include this file _after_ including your URCU flavor.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <urcu/arch.h>
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu-call-rcu.h>
+#include <urcu-flavor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Sequence counter, for small values written often, such as counters
+ * and timestamps, which RCU would copy and publish on each write.
+ * Writers, serialized by the caller, make the counter odd while they
+ * update the value in place. Readers copy the value between
+ * cds_seqcount_read_begin() and cds_seqcount_read_retry(), and retry if
+ * the counter changed meanwhile: the copy may be torn, and must not be
+ * used (e.g. dereferenced) before the retry check passes.
+ */
+struct cds_seqcount {
+	unsigned long seq;
+};
+
+#define CDS_SEQCOUNT_INIT	{ 0 }
+
+static inline
+void cds_seqcount_init(struct cds_seqcount *sc)
+{
+	sc->seq = 0;
+}
+
+/*
+ * cds_seqcount_read_begin - wait for writers in progress, and return the
+ * counter to pass to cds_seqcount_read_retry().
+ */
+static inline
+unsigned long cds_seqcount_read_begin(struct cds_seqcount *sc)
+{
+	unsigned long seq;
+
+	while (caa_unlikely((seq = CMM_LOAD_SHARED(sc->seq)) & 1))
+		caa_cpu_relax();
+	/* Read the counter before the value. */
+	cmm_smp_rmb();
+	return seq;
+}
+
+/*
+ * cds_seqcount_read_retry - return non-zero if a writer updated the
+ * value since cds_seqcount_read_begin() returned @start.
+ */
+static inline
+int cds_seqcount_read_retry(struct cds_seqcount *sc, unsigned long start)
+{
+	/* Read the value before the counter. */
+	cmm_smp_rmb();
+	return CMM_LOAD_SHARED(sc->seq) != start;
+}
+
+static inline
+void cds_seqcount_write_begin(struct cds_seqcount *sc)
+{
+	CMM_STORE_SHARED(sc->seq, sc->seq + 1);
+	/* Make the counter odd before updating the value. */
+	cmm_smp_wmb();
+}
+
+static inline
+void cds_seqcount_write_end(struct cds_seqcount *sc)
+{
+	/* Update the value before making the counter even. */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(sc->seq, sc->seq + 1);
+}
+
+/*
+ * Sequence lock: a sequence counter with a mutex serializing writers.
+ * Readers use cds_seqcount_read_begin() and cds_seqcount_read_retry()
+ * on its seq field.
+ */
+struct cds_seqlock {
+	struct cds_seqcount seq;
+	pthread_mutex_t lock;
+};
+
+#define CDS_SEQLOCK_INIT	{ CDS_SEQCOUNT_INIT, PTHREAD_MUTEX_INITIALIZER }
+
+static inline
+void cds_seqlock_write_lock(struct cds_seqlock *sl)
+{
+	(void) pthread_mutex_lock(&sl->lock);
+	cds_seqcount_write_begin(&sl->seq);
+}
+
+static inline
+void cds_seqlock_write_unlock(struct cds_seqlock *sl)
+{
+	cds_seqcount_write_end(&sl->seq);
+	(void) pthread_mutex_unlock(&sl->lock);
+}
+
+/*
+ * Sequence-counted value with an RCU fallback. Readers first read the
+ * value in place like sequence counter readers. After max_retries
+ * failed attempts, they ask the writers for a copy, and read the copy
+ * published with rcu_assign_pointer() by the next write instead, so a
+ * burst of writes cannot starve them. Writers only allocate a copy when
+ * a reader asked for one, and free the previous copy with the call_rcu
+ * of the flavor. The value read by a reader is always a value the
+ * variable held since that reader started.
+ */
+struct cds_seqval_copy;
+
+struct cds_seqval {
+	struct cds_seqcount seq;
+	int32_t want_copy;		/* readers wait for a copy */
+	unsigned int max_retries;
+	size_t len;
+	void *data;
+	struct cds_seqval_copy *copy;	/* RCU-protected */
+	pthread_mutex_t lock;		/* serializes writers */
+	const struct rcu_flavor_struct *flavor;
+};
+
+/*
+ * _cds_seqval_init - initialize a zeroed value.
+ * @len: size of the value.
+ * @max_retries: failed in-place reads before readers fall back to a
+ *               copy.
+ * @flavor: flavor of the read-side critical sections of the readers.
+ *
+ * Returns 0 on success, -ENOMEM on allocation error.
+ */
+extern int _cds_seqval_init(struct cds_seqval *v, size_t len,
+		unsigned int max_retries,
+		const struct rcu_flavor_struct *flavor);
+
+/*
+ * cds_seqval_init - initialize a value for the RCU flavor included
+ *                   before this header.
+ */
+static inline
+int cds_seqval_init(struct cds_seqval *v, size_t len,
+		unsigned int max_retries)
+{
+	return _cds_seqval_init(v, len, max_retries, &rcu_flavor);
+}
+
+/*
+ * cds_seqval_destroy - free a value. No reader nor writer may access it
+ * anymore, and the call_rcu callbacks freeing its copies must have been
+ * invoked (e.g. rcu_barrier()).
+ */
+extern void cds_seqval_destroy(struct cds_seqval *v);
+
+/*
+ * cds_seqval_read - copy the value into @buf.
+ *
+ * Call within a read-side critical section of the flavor.
+ */
+extern void cds_seqval_read(struct cds_seqval *v, void *buf);
+
+/*
+ * cds_seqval_write_begin - start updating the value, and return it for
+ * update in place until cds_seqval_write_end().
+ */
+extern void *cds_seqval_write_begin(struct cds_seqval *v);
+extern void cds_seqval_write_end(struct cds_seqval *v);
+
+/*
+ * cds_seqval_write - set the value to the @len bytes at @val.
+ */
+extern void cds_seqval_write(struct cds_seqval *v, const void *val);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_SEQLOCK_H */
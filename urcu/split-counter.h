@@ -0,0 +1,117 @@
+#ifndef _URCU_SPLIT_COUNTER_H
+#define _URCU_SPLIT_COUNTER_H
+
+/*
+ * urcu/split-counter.h
+ *
+ * Userspace RCU library - scalable split counter
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdbool.h>
+#include <urcu/arch.h>
+#include <urcu/compiler.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Counter updated concurrently by many threads, such as the number of
+ * items of a hash table. Additions and subtractions only update a slot
+ * of the current CPU, padded to its own cache line (with a restartable
+ * sequence rather than an atomic instruction when available). Each
+ * time the additions, or the subtractions, of a slot cross a multiple
+ * of the batch (1 << batch_order), the batch is committed to a global
+ * approximate count, shared by all slots.
+ *
+ * The approximate count is off by less than one batch per slot, in
+ * either direction, and is read in constant time. The exact count sums
+ * all the slots. There is one slot per possible CPU, rounded up to a
+ * power of two, or a default number of slots when the number of CPUs is
+ * unknown.
+ */
+
+/* Non-atomic slot updates: faster, but concurrent updates may be lost. */
+#define CDS_SPLIT_COUNTER_LAZY		(1U << 0)
+
+struct cds_split_counter_slot;
+
+struct cds_split_counter {
+	struct cds_split_counter_slot *slots;
+	unsigned long mask;		/* number of slots - 1 */
+	unsigned int batch_order;
+	unsigned int flags;
+	/* Committed batches, written concurrently. */
+	long count __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+};
+
+/*
+ * cds_split_counter_init: initialize a counter to zero, committing
+ * batches of 1 << batch_order. Returns 0 on success, -EINVAL if
+ * batch_order is too large, or -ENOMEM.
+ */
+extern int cds_split_counter_init(struct cds_split_counter *counter,
+		unsigned int batch_order, unsigned int flags);
+
+/*
+ * cds_split_counter_destroy: free the slots of the counter. It must no
+ * longer be used concurrently.
+ */
+extern void cds_split_counter_destroy(struct cds_split_counter *counter);
+
+/*
+ * cds_split_counter_add: add v to the counter. Returns true if a batch
+ * was committed, in which case the new approximate count is stored in
+ * *count, if not NULL.
+ */
+extern bool cds_split_counter_add(struct cds_split_counter *counter,
+		unsigned long v, long *count);
+
+/*
+ * cds_split_counter_sub: subtract v from the counter. Returns true if
+ * a batch was committed, as cds_split_counter_add().
+ */
+extern bool cds_split_counter_sub(struct cds_split_counter *counter,
+		unsigned long v, long *count);
+
+/*
+ * cds_split_counter_read_approx: read the approximate count, that is
+ * the batches committed.
+ */
+extern long cds_split_counter_read_approx(struct cds_split_counter *counter);
+
+/*
+ * cds_split_counter_read: sum the slots. Exact when no update runs
+ * concurrently, and without CDS_SPLIT_COUNTER_LAZY.
+ */
+extern long cds_split_counter_read(struct cds_split_counter *counter);
+
+/*
+ * cds_split_counter_nr_slots: number of slots of the counter, always a
+ * power of two.
+ */
+static inline
+unsigned long cds_split_counter_nr_slots(struct cds_split_counter *counter)
+{
+	return counter->mask + 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_SPLIT_COUNTER_H */
@@ -0,0 +1,161 @@
+#ifndef _URCU_SPSCRING_H
+#define _URCU_SPSCRING_H
+
+/*
+ * spscring.h
+ *
+ * Userspace RCU library - Single-Producer/Single-Consumer Ring Buffer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Single-producer/single-consumer ring buffer of fixed-size slots.
+ *
+ * The producer writes payloads directly into ring slots:
+ * cds_spsc_ring_reserve() returns the next free slot,
+ * cds_spsc_ring_commit() marks it filled. Committed slots are made
+ * visible to the consumer in batches, with a single store to the
+ * shared head index, either explicitly with cds_spsc_ring_publish() or
+ * automatically every "batch" commits. The consumer symmetrically
+ * reads slots in place with cds_spsc_ring_peek() and hands them back
+ * with cds_spsc_ring_release(), publishing its tail index every
+ * "batch" releases.
+ *
+ * Each side keeps a cached copy of the other side's index on its own
+ * cache line, and only reads the shared index when the cached copy
+ * says the ring is full (producer) or empty (consumer). No atomic
+ * read-modify-write operation is used. The producer publishes pending
+ * commits when it finds the ring full, and the consumer publishes
+ * pending releases when it finds the ring empty, so neither side can
+ * wait on entries the other side has not published.
+ *
+ * All producer operations must be performed by a single thread at a
+ * time, as must all consumer operations.
+ */
+
+struct cds_spsc_ring {
+	/* Shared indexes, each written by one side only. */
+	unsigned long head __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+	unsigned long tail __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+	/* Producer-private state. */
+	unsigned long prod_next __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+	unsigned long prod_published;	/* Last value stored to head. */
+	unsigned long prod_tail_cache;
+	/* Consumer-private state. */
+	unsigned long cons_next __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+	unsigned long cons_released;	/* Last value stored to tail. */
+	unsigned long cons_head_cache;
+	/* Read-only after init. */
+	unsigned long mask __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+	unsigned long batch;
+	size_t slot_size;
+	char *slots;
+};
+
+#ifdef _LGPL_SOURCE
+
+#include <urcu/static/spscring.h>
+
+#define cds_spsc_ring_init		_cds_spsc_ring_init
+#define cds_spsc_ring_destroy		_cds_spsc_ring_destroy
+#define cds_spsc_ring_reserve		_cds_spsc_ring_reserve
+#define cds_spsc_ring_commit		_cds_spsc_ring_commit
+#define cds_spsc_ring_publish		_cds_spsc_ring_publish
+#define cds_spsc_ring_peek		_cds_spsc_ring_peek
+#define cds_spsc_ring_release		_cds_spsc_ring_release
+#define cds_spsc_ring_release_publish	_cds_spsc_ring_release_publish
+
+#else /* !_LGPL_SOURCE */
+
+/*
+ * cds_spsc_ring_init: allocate a ring of "size" slots of "slot_size"
+ * bytes each. "size" must be a power of two, at least 2. Slots are
+ * aligned on pointer size. Committed slots are published every
+ * "batch" commits, and released slots every "batch" releases (0 or 1:
+ * publish on each commit/release, clamped to size).
+ *
+ * Returns 0 on success, -EINVAL if size or slot_size is invalid,
+ * -ENOMEM if the slots cannot be allocated.
+ */
+extern int cds_spsc_ring_init(struct cds_spsc_ring *ring, unsigned long size,
+		size_t slot_size, unsigned long batch);
+
+/*
+ * cds_spsc_ring_destroy: free the slots of a ring. No concurrent
+ * access is allowed.
+ */
+extern void cds_spsc_ring_destroy(struct cds_spsc_ring *ring);
+
+/*
+ * cds_spsc_ring_reserve: return the next free slot for the producer,
+ * or NULL if the ring is full.
+ *
+ * The slot stays reserved, and cds_spsc_ring_reserve() keeps returning
+ * it, until cds_spsc_ring_commit() is called. Producer-only.
+ */
+extern void *cds_spsc_ring_reserve(struct cds_spsc_ring *ring);
+
+/*
+ * cds_spsc_ring_commit: mark the reserved slot as filled.
+ *
+ * The slot becomes visible to the consumer at the next publication,
+ * which happens automatically every "batch" commits. Producer-only.
+ */
+extern void cds_spsc_ring_commit(struct cds_spsc_ring *ring);
+
+/*
+ * cds_spsc_ring_publish: make all committed slots visible to the
+ * consumer. Stores to the slots are ordered before publication.
+ * Producer-only.
+ */
+extern void cds_spsc_ring_publish(struct cds_spsc_ring *ring);
+
+/*
+ * cds_spsc_ring_peek: return the oldest published slot, or NULL if
+ * none is available. The slot can be read in place until
+ * cds_spsc_ring_release() is called. Consumer-only.
+ */
+extern void *cds_spsc_ring_peek(struct cds_spsc_ring *ring);
+
+/*
+ * cds_spsc_ring_release: hand the slot returned by
+ * cds_spsc_ring_peek() back to the producer. Released slots are
+ * published to the producer every "batch" releases. Consumer-only.
+ */
+extern void cds_spsc_ring_release(struct cds_spsc_ring *ring);
+
+/*
+ * cds_spsc_ring_release_publish: make all released slots available to
+ * the producer. Consumer-only.
+ */
+extern void cds_spsc_ring_release_publish(struct cds_spsc_ring *ring);
+
+#endif /* !_LGPL_SOURCE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_SPSCRING_H */
@@ -0,0 +1,167 @@
+#ifndef _URCU_STATIC_LFRING_H
+#define _URCU_STATIC_LFRING_H
+
+/*
+ * urcu/static/lfring.h
+ *
+ * Userspace RCU library - Bounded Lock-Free MPMC Ring Buffer
+ *
+ * TO BE INCLUDED ONLY IN LGPL-COMPATIBLE CODE. See urcu/lfring.h for
+ * linking dynamically with the userspace rcu library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+#include <urcu/compiler.h>
+#include <urcu/uatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Cell sequence protocol, for a position "pos" claimed on the ring:
+ *
+ * - seq == pos: the cell is free for the producer claiming pos.
+ * - seq == pos + 1: the cell holds the item enqueued at pos, ready for
+ *   the consumer claiming pos.
+ * - seq == pos + size: the consumer released the cell, which is free
+ *   for the producer of the next lap.
+ *
+ * Positions are free-running unsigned long counters: comparisons use
+ * signed differences so wrap-around is harmless.
+ */
+
+static inline int _cds_lfring_init(struct cds_lfring *ring,
+		unsigned long size)
+{
+	unsigned long i;
+
+	if (size < 2 || (size & (size - 1)))
+		return -EINVAL;
+	ring->cells = (struct cds_lfring_cell *)
+		calloc(size, sizeof(*ring->cells));
+	if (!ring->cells)
+		return -ENOMEM;
+	for (i = 0; i < size; i++)
+		ring->cells[i].seq = i;
+	ring->mask = size - 1;
+	ring->enqueue_pos = 0;
+	ring->dequeue_pos = 0;
+	return 0;
+}
+
+static inline void _cds_lfring_destroy(struct cds_lfring *ring)
+{
+	free(ring->cells);
+	ring->cells = NULL;
+}
+
+static inline unsigned long _cds_lfring_size(struct cds_lfring *ring)
+{
+	return ring->mask + 1;
+}
+
+static inline bool _cds_lfring_enqueue(struct cds_lfring *ring, void *data)
+{
+	struct cds_lfring_cell *cell;
+	unsigned long pos, seq, old;
+	long diff;
+
+	assert(data);
+	pos = CMM_LOAD_SHARED(ring->enqueue_pos);
+	for (;;) {
+		cell = &ring->cells[pos & ring->mask];
+		seq = CMM_LOAD_SHARED(cell->seq);
+		diff = (long) (seq - pos);
+		if (diff == 0) {
+			/*
+			 * Implicit memory barrier of uatomic_cmpxchg()
+			 * orders the load of cell->seq before the store
+			 * to cell->data.
+			 */
+			old = uatomic_cmpxchg(&ring->enqueue_pos, pos, pos + 1);
+			if (old == pos)
+				break;
+			pos = old;
+		} else if (diff < 0) {
+			/* Cell not released by the previous lap: full. */
+			return false;
+		} else {
+			/* Another producer claimed pos, move on. */
+			pos = CMM_LOAD_SHARED(ring->enqueue_pos);
+		}
+	}
+	CMM_STORE_SHARED(cell->data, data);
+	/* Publish data before handing the cell over to the consumer. */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(cell->seq, pos + 1);
+	return true;
+}
+
+static inline void *_cds_lfring_dequeue(struct cds_lfring *ring)
+{
+	struct cds_lfring_cell *cell;
+	unsigned long pos, seq, old;
+	void *data;
+	long diff;
+
+	pos = CMM_LOAD_SHARED(ring->dequeue_pos);
+	for (;;) {
+		cell = &ring->cells[pos & ring->mask];
+		seq = CMM_LOAD_SHARED(cell->seq);
+		diff = (long) (seq - (pos + 1));
+		if (diff == 0) {
+			/*
+			 * Implicit memory barrier of uatomic_cmpxchg()
+			 * orders the load of cell->seq before the load of
+			 * cell->data.
+			 */
+			old = uatomic_cmpxchg(&ring->dequeue_pos, pos, pos + 1);
+			if (old == pos)
+				break;
+			pos = old;
+		} else if (diff < 0) {
+			/* Cell not filled for this lap: empty. */
+			return NULL;
+		} else {
+			/* Another consumer claimed pos, move on. */
+			pos = CMM_LOAD_SHARED(ring->dequeue_pos);
+		}
+	}
+	data = CMM_LOAD_SHARED(cell->data);
+	/* Order the load of data before releasing the cell. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(cell->seq, pos + ring->mask + 1);
+	return data;
+}
+
+static inline bool _cds_lfring_empty(struct cds_lfring *ring)
+{
+	unsigned long pos = CMM_LOAD_SHARED(ring->dequeue_pos);
+
+	return (long) (CMM_LOAD_SHARED(ring->cells[pos & ring->mask].seq)
+			- (pos + 1)) < 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_STATIC_LFRING_H */
@@ -292,6 +292,141 @@ _cds_lfs_pop_all_blocking(struct cds_lfs_stack *s)
 	return rethead;
 }
 
+#ifdef UATOMIC_HAS_CMPXCHG_DOUBLE
+
+/*
+ * Tagged stack.
+ *
+ * The head pointer and tag are updated together with
+ * uatomic_cmpxchg_double() by pop and pop_all, which increment the tag.
+ * A popper which read head A and A->next gets its compare-and-swap
+ * rejected if any pop happened in between, even if A was pushed back
+ * since, so A->next is known to still be the successor of A. Push only
+ * replaces the head pointer: it does not need to change the tag, since
+ * it never removes a node which a concurrent pop may have read.
+ */
+
+/*
+ * cds_lfs_tagged_init: initialize tagged lock-free stack.
+ */
+static inline
+void _cds_lfs_tagged_init(struct cds_lfs_tagged_stack *s)
+{
+	s->head = NULL;
+	s->tag = 0;
+}
+
+/*
+ * cds_lfs_tagged_empty: return whether tagged lock-free stack is empty.
+ *
+ * No memory barrier is issued. No mutual exclusion is required.
+ */
+static inline
+bool _cds_lfs_tagged_empty(struct cds_lfs_tagged_stack *s)
+{
+	return ___cds_lfs_empty_head(CMM_LOAD_SHARED(s->head));
+}
+
+/*
+ * cds_lfs_tagged_push: push a node into the tagged stack.
+ *
+ * Same algorithm as cds_lfs_push, see its description.
+ *
+ * Returns 0 if the stack was empty prior to adding the node.
+ * Returns non-zero otherwise.
+ */
+static inline
+bool _cds_lfs_tagged_push(struct cds_lfs_tagged_stack *s,
+		struct cds_lfs_node *node)
+{
+	struct cds_lfs_head *head = NULL;
+	struct cds_lfs_head *new_head =
+		caa_container_of(node, struct cds_lfs_head, node);
+
+	for (;;) {
+		struct cds_lfs_head *old_head = head;
+
+		node->next = &head->node;
+		/*
+		 * uatomic_cmpxchg() implicit memory barrier orders earlier
+		 * stores to node before publication.
+		 */
+		head = uatomic_cmpxchg(&s->head, old_head, new_head);
+		if (old_head == head)
+			break;
+	}
+	return ___cds_lfs_empty_head(head);
+}
+
+/*
+ * cds_lfs_tagged_pop: pop a node from the tagged stack.
+ *
+ * Returns NULL if stack is empty. No synchronization is required, but
+ * popped nodes may still be read by concurrent poppers: their memory
+ * must stay mapped and type-stable while the stack is in use.
+ */
+static inline
+struct cds_lfs_node *_cds_lfs_tagged_pop(struct cds_lfs_tagged_stack *s)
+{
+	for (;;) {
+		struct cds_lfs_head *head, *next_head;
+		struct cds_lfs_node *next;
+		unsigned long tag;
+
+		/*
+		 * Tag and head are compared together by the
+		 * uatomic_cmpxchg_double() below, so an inconsistent
+		 * snapshot only makes it fail.
+		 */
+		tag = CMM_LOAD_SHARED(s->tag);
+		cmm_smp_rmb();
+		head = CMM_LOAD_SHARED(s->head);
+		if (___cds_lfs_empty_head(head))
+			return NULL;	/* Empty stack */
+
+		/*
+		 * Read head before head->next. Matches the implicit
+		 * memory barrier before uatomic_cmpxchg() in
+		 * cds_lfs_tagged_push.
+		 */
+		cmm_smp_read_barrier_depends();
+		next = CMM_LOAD_SHARED(head->node.next);
+		next_head = caa_container_of(next,
+				struct cds_lfs_head, node);
+		if (uatomic_cmpxchg_double((unsigned long *) s,
+				head, tag, next_head, tag + 1))
+			return &head->node;
+		/* busy-loop if head or tag changed under us */
+	}
+}
+
+/*
+ * cds_lfs_tagged_pop_all: pop all nodes from the tagged stack.
+ *
+ * Does not require any synchronization. The full memory barrier
+ * implied by uatomic_cmpxchg_double() ensures that all nodes of the
+ * returned list are consistent, as for __cds_lfs_pop_all.
+ */
+static inline
+struct cds_lfs_head *_cds_lfs_tagged_pop_all(struct cds_lfs_tagged_stack *s)
+{
+	for (;;) {
+		struct cds_lfs_head *head;
+		unsigned long tag;
+
+		tag = CMM_LOAD_SHARED(s->tag);
+		cmm_smp_rmb();
+		head = CMM_LOAD_SHARED(s->head);
+		if (___cds_lfs_empty_head(head))
+			return NULL;
+		if (uatomic_cmpxchg_double((unsigned long *) s,
+				head, tag, NULL, tag + 1))
+			return head;
+	}
+}
+
+#endif /* UATOMIC_HAS_CMPXCHG_DOUBLE */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,196 @@
+#ifndef _URCU_RCULFHASH_STATIC_H
+#define _URCU_RCULFHASH_STATIC_H
+
+/*
+ * urcu/static/rculfhash.h
+ *
+ * Userspace RCU library - Lock-Free RCU Hash Table, lookups specialized
+ * at compile time
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * TO BE INCLUDED ONLY IN LGPL-COMPATIBLE CODE. See rculfhash.h for linking
+ * dynamically with the userspace rcu library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <urcu/compiler.h>
+#include <urcu/rculfhash.h>
+#include <urcu/static/urcu-pointer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Node pointer flags, see rculfhash.c.
+ */
+#define _CDS_LFHT_REMOVED_FLAG		(1UL << 0)
+#define _CDS_LFHT_BUCKET_FLAG		(1UL << 1)
+#define _CDS_LFHT_REMOVAL_OWNER_FLAG	(1UL << 2)
+#define _CDS_LFHT_FLAGS_MASK		((1UL << 3) - 1)
+
+/*
+ * _cds_lfht_lookup_chain - get the first node of a hash chain.
+ *
+ * Returns the node following the bucket node of @hash (flags cleared,
+ * possibly the end of the table, i.e. NULL), and sets *reverse_hash to
+ * the bit-reversed @hash. Call with rcu_read_lock held.
+ */
+extern
+struct cds_lfht_node *_cds_lfht_lookup_chain(struct cds_lfht *ht,
+		unsigned long hash, unsigned long *reverse_hash);
+
+static inline
+struct cds_lfht_node *_cds_lfht_clear_flag(struct cds_lfht_node *node)
+{
+	return (struct cds_lfht_node *)
+		(((unsigned long) node) & ~_CDS_LFHT_FLAGS_MASK);
+}
+
+/*
+ * Walk the chain from node, returning the first node for which
+ * match(node, key) is true in *iter, or NULL if not found. Same steps
+ * as cds_lfht_lookup() and cds_lfht_next_duplicate().
+ */
+#define _CDS_LFHT_CHAIN_WALK(_node, _reverse_hash, _match, _key, _iter)	\
+	do {								\
+		struct cds_lfht_node *__node = (_node), *__next;	\
+									\
+		for (;;) {						\
+			if (caa_unlikely(!__node)) {			\
+				__node = __next = NULL;			\
+				break;					\
+			}						\
+			if (caa_unlikely(__node->reverse_hash		\
+					> (_reverse_hash))) {		\
+				__node = __next = NULL;			\
+				break;					\
+			}						\
+			__next = _rcu_dereference(__node->next);	\
+			if (caa_likely(!((unsigned long) __next		\
+				& (_CDS_LFHT_REMOVED_FLAG		\
+					| _CDS_LFHT_BUCKET_FLAG)))	\
+			    && __node->reverse_hash == (_reverse_hash)	\
+			    && caa_likely(_match(__node, _key)))	\
+				break;					\
+			__node = _cds_lfht_clear_flag(__next);		\
+		}							\
+		(_iter)->node = __node;					\
+		(_iter)->next = __next;					\
+	} while (0)
+
+/*
+ * CDS_LFHT_DEFINE_STATIC(prefix, key_type, match) - define lookup
+ * functions specialized for a key type and match function.
+ *
+ * @match is a function or macro taking a struct cds_lfht_node pointer
+ * and a key of type @key_type, which returns non-zero if the node's key
+ * is equal to the key. It is inlined in the lookup loops, without any
+ * indirect call. Defines the following static inline functions, which
+ * have the same semantic as their cds_lfht_ counterparts:
+ *
+ * void prefix_lookup(struct cds_lfht *ht, unsigned long hash,
+ *		key_type key, struct cds_lfht_iter *iter);
+ * void prefix_next_duplicate(struct cds_lfht *ht, key_type key,
+ *		struct cds_lfht_iter *iter);
+ * struct cds_lfht_node *prefix_add_unique(struct cds_lfht *ht,
+ *		unsigned long hash, key_type key, struct cds_lfht_node *node);
+ * struct cds_lfht_node *prefix_add_replace(struct cds_lfht *ht,
+ *		unsigned long hash, key_type key, struct cds_lfht_node *node);
+ * void prefix_frozen_lookup(const struct cds_lfht_frozen *frozen,
+ *		unsigned long hash, key_type key,
+ *		struct cds_lfht_frozen_iter *iter);
+ *
+ * prefix_add_unique() looks for an existing node with the inlined match
+ * before calling the library. The library add functions only call
+ * match for nodes with the same hash.
+ */
+#define CDS_LFHT_DEFINE_STATIC(prefix, key_type, match)			\
+static inline								\
+void prefix##_lookup(struct cds_lfht *ht, unsigned long hash,		\
+		key_type key, struct cds_lfht_iter *iter)		\
+{									\
+	struct cds_lfht_node *node;					\
+	unsigned long reverse_hash;					\
+									\
+	node = _cds_lfht_lookup_chain(ht, hash, &reverse_hash);		\
+	_CDS_LFHT_CHAIN_WALK(node, reverse_hash, match, key, iter);	\
+}									\
+									\
+static inline								\
+void prefix##_next_duplicate(struct cds_lfht *ht, key_type key,		\
+		struct cds_lfht_iter *iter)				\
+{									\
+	_CDS_LFHT_CHAIN_WALK(_cds_lfht_clear_flag(iter->next),		\
+		iter->node->reverse_hash, match, key, iter);		\
+}									\
+									\
+static int prefix##_match_fct(struct cds_lfht_node *node,		\
+		const void *key)					\
+{									\
+	return match(node, *(const key_type *) key);			\
+}									\
+									\
+static inline								\
+struct cds_lfht_node *prefix##_add_unique(struct cds_lfht *ht,		\
+		unsigned long hash, key_type key,			\
+		struct cds_lfht_node *node)				\
+{									\
+	struct cds_lfht_iter iter;					\
+									\
+	prefix##_lookup(ht, hash, key, &iter);				\
+	if (iter.node)							\
+		return iter.node;					\
+	return cds_lfht_add_unique(ht, hash, prefix##_match_fct, &key,	\
+			node);						\
+}									\
+									\
+static inline								\
+struct cds_lfht_node *prefix##_add_replace(struct cds_lfht *ht,		\
+		unsigned long hash, key_type key,			\
+		struct cds_lfht_node *node)				\
+{									\
+	return cds_lfht_add_replace(ht, hash, prefix##_match_fct, &key,	\
+			node);						\
+}									\
+									\
+static inline								\
+void prefix##_frozen_lookup(const struct cds_lfht_frozen *frozen,	\
+		unsigned long hash, key_type key,			\
+		struct cds_lfht_frozen_iter *iter)			\
+{									\
+	const struct cds_lfht_frozen_slot *slot;			\
+	unsigned long pos;						\
+									\
+	for (pos = hash & frozen->mask;; pos = (pos + 1) & frozen->mask) { \
+		slot = &frozen->slots[pos];				\
+		if (!slot->node)					\
+			break;						\
+		if (slot->hash == hash && match(slot->node, key)) {	\
+			iter->node = slot->node;			\
+			iter->pos = pos;				\
+			return;						\
+		}							\
+	}								\
+	iter->node = NULL;						\
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_RCULFHASH_STATIC_H */
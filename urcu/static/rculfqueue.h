@@ -29,6 +29,10 @@
 #include <urcu-call-rcu.h>
 #include <urcu/uatomic.h>
 #include <urcu-pointer.h>
+#include <urcu/ref.h>
+#include <urcu/lfstack.h>
+#include <urcu/static/lfstack.h>
+#include <urcu/alloc.h>
 #include <assert.h>
 #include <errno.h>
 
@@ -40,6 +44,19 @@ struct cds_lfq_node_rcu_dummy {
 	struct cds_lfq_node_rcu parent;
 	struct rcu_head head;
 	struct cds_lfq_queue_rcu *q;
+	struct cds_lfq_dummy_pool *pool;
+	struct cds_lfs_node pool_node;
+};
+
+/*
+ * Dummy nodes whose grace period has elapsed, ready for reuse. The
+ * pool is referenced by its queue and by each dummy waiting for its
+ * grace period, so call_rcu callbacks running after
+ * cds_lfq_destroy_rcu() can still return their dummy to it.
+ */
+struct cds_lfq_dummy_pool {
+	struct __cds_lfs_stack free;
+	struct urcu_ref ref;
 };
 
 /*
@@ -55,22 +72,60 @@ struct cds_lfq_node_rcu_dummy {
  * (it means a dummy node dequeue-requeue is in progress). This ensures
  * that there is always at least one node in the queue.
  *
- * In the dequeue operation, we internally reallocate the dummy node
- * upon dequeue/requeue and use call_rcu to free the old one after a
- * grace period.
+ * In the dequeue operation, we internally replace the dummy node upon
+ * dequeue/requeue and use call_rcu to retire the old one after a grace
+ * period. Retired dummies are kept in a per-queue pool and reused by
+ * later dequeue/requeue, so a queue oscillating around empty does not
+ * allocate nor free memory in steady state. Reuse after a grace period
+ * provides the same ABA protection as reallocation. The pool holds at
+ * most as many dummies as were retired during one grace period.
  */
 
 static inline
+void release_dummy_pool(struct urcu_ref *ref)
+{
+	struct cds_lfq_dummy_pool *pool =
+		caa_container_of(ref, struct cds_lfq_dummy_pool, ref);
+	struct cds_lfs_head *head;
+	struct cds_lfs_node *node, *n;
+
+	head = ___cds_lfs_pop_all(&pool->free);
+	if (head) {
+		cds_lfs_for_each_safe(head, node, n)
+			urcu_free(URCU_ALLOC_LFQUEUE,
+				caa_container_of(node,
+					struct cds_lfq_node_rcu_dummy,
+					pool_node),
+				sizeof(struct cds_lfq_node_rcu_dummy));
+	}
+	urcu_free(URCU_ALLOC_LFQUEUE, pool, sizeof(*pool));
+}
+
+/*
+ * Called within RCU read-side critical section (or before the queue is
+ * published): a pooled dummy can only be pushed back to the pool after
+ * a grace period, which protects the pool pop from ABA.
+ */
+static inline
 struct cds_lfq_node_rcu *make_dummy(struct cds_lfq_queue_rcu *q,
 				    struct cds_lfq_node_rcu *next)
 {
 	struct cds_lfq_node_rcu_dummy *dummy;
+	struct cds_lfs_node *snode;
 
-	dummy = malloc(sizeof(struct cds_lfq_node_rcu_dummy));
-	assert(dummy);
+	snode = ___cds_lfs_pop(&q->dummy_pool->free);
+	if (snode) {
+		dummy = caa_container_of(snode,
+			struct cds_lfq_node_rcu_dummy, pool_node);
+	} else {
+		dummy = urcu_alloc(URCU_ALLOC_LFQUEUE,
+				sizeof(struct cds_lfq_node_rcu_dummy));
+		assert(dummy);
+	}
 	dummy->parent.next = next;
 	dummy->parent.dummy = 1;
 	dummy->q = q;
+	dummy->pool = q->dummy_pool;
 	return &dummy->parent;
 }
 
@@ -79,7 +134,10 @@ void free_dummy_cb(struct rcu_head *head)
 {
 	struct cds_lfq_node_rcu_dummy *dummy =
 		caa_container_of(head, struct cds_lfq_node_rcu_dummy, head);
-	free(dummy);
+	struct cds_lfq_dummy_pool *pool = dummy->pool;
+
+	(void) _cds_lfs_push(&pool->free, &dummy->pool_node);
+	urcu_ref_put(&pool->ref, release_dummy_pool);
 }
 
 static inline
@@ -89,6 +147,7 @@ void rcu_free_dummy(struct cds_lfq_node_rcu *node)
 
 	assert(node->dummy);
 	dummy = caa_container_of(node, struct cds_lfq_node_rcu_dummy, parent);
+	urcu_ref_get(&dummy->pool->ref);
 	dummy->q->queue_call_rcu(&dummy->head, free_dummy_cb);
 }
 
@@ -99,7 +158,7 @@ void free_dummy(struct cds_lfq_node_rcu *node)
 
 	assert(node->dummy);
 	dummy = caa_container_of(node, struct cds_lfq_node_rcu_dummy, parent);
-	free(dummy);
+	urcu_free(URCU_ALLOC_LFQUEUE, dummy, sizeof(*dummy));
 }
 
 static inline
@@ -114,6 +173,11 @@ void _cds_lfq_init_rcu(struct cds_lfq_queue_rcu *q,
 		       void queue_call_rcu(struct rcu_head *head,
 				void (*func)(struct rcu_head *head)))
 {
+	q->dummy_pool = urcu_alloc(URCU_ALLOC_LFQUEUE,
+			sizeof(*q->dummy_pool));
+	assert(q->dummy_pool);
+	___cds_lfs_init(&q->dummy_pool->free);
+	urcu_ref_init(&q->dummy_pool->ref);
 	q->tail = make_dummy(q, NULL);
 	q->head = q->tail;
 	q->queue_call_rcu = queue_call_rcu;
@@ -133,6 +197,9 @@ int _cds_lfq_destroy_rcu(struct cds_lfq_queue_rcu *q)
 	if (!(head->dummy && head->next == NULL))
 		return -EPERM;	/* not empty */
 	free_dummy(head);
+	/* Dummies still waiting for a grace period keep the pool alive. */
+	urcu_ref_put(&q->dummy_pool->ref, release_dummy_pool);
+	q->dummy_pool = NULL;
 	return 0;
 }
 
@@ -177,7 +244,10 @@ void enqueue_dummy(struct cds_lfq_queue_rcu *q)
 {
 	struct cds_lfq_node_rcu *node;
 
-	/* We need to reallocate to protect from ABA. */
+	/*
+	 * We need a dummy which went through a grace period to protect
+	 * from ABA.
+	 */
 	node = make_dummy(q, NULL);
 	_cds_lfq_enqueue_rcu(q, node);
 }
@@ -213,7 +283,7 @@ struct cds_lfq_node_rcu *_cds_lfq_dequeue_rcu(struct cds_lfq_queue_rcu *q)
 		if (uatomic_cmpxchg(&q->head, head, next) != head)
 			continue;	/* Concurrently pushed. */
 		if (head->dummy) {
-			/* Free dummy after grace period. */
+			/* Recycle dummy after grace period. */
 			rcu_free_dummy(head);
 			continue;	/* try again */
 		}
@@ -221,6 +291,60 @@ struct cds_lfq_node_rcu *_cds_lfq_dequeue_rcu(struct cds_lfq_queue_rcu *q)
 	}
 }
 
+/*
+ * Should be called under rcu read lock critical section.
+ *
+ * Dequeue up to @max nodes into @nodes, in queue order, with a single
+ * move of the queue head. Returns the number of nodes dequeued, 0 if
+ * the queue is empty. The caller must wait for a grace period to pass
+ * before freeing the returned nodes or modifying their cds_lfq_node_rcu
+ * structure.
+ */
+static inline
+unsigned int _cds_lfq_dequeue_bulk_rcu(struct cds_lfq_queue_rcu *q,
+		struct cds_lfq_node_rcu **nodes, unsigned int max)
+{
+	if (!max)
+		return 0;
+	for (;;) {
+		struct cds_lfq_node_rcu *head, *node, *next;
+		unsigned int count = 0;
+
+		head = rcu_dereference(q->head);
+		node = head;
+		/*
+		 * Walk the nodes to detach, leaving at least one node in
+		 * the queue, as _cds_lfq_dequeue_rcu() does. Next
+		 * pointers are only set once, so the walk is stable
+		 * while q->head is unchanged.
+		 */
+		while (count < max) {
+			next = rcu_dereference(node->next);
+			if (!next) {
+				if (node->dummy)
+					break;
+				enqueue_dummy(q);
+				next = rcu_dereference(node->next);
+			}
+			if (!node->dummy)
+				nodes[count++] = node;
+			node = next;
+		}
+		if (node == head)
+			return 0;	/* empty */
+		if (uatomic_cmpxchg(&q->head, head, node) != head)
+			continue;	/* Concurrently dequeued. */
+		/* Recycle the detached dummies after grace period. */
+		while (head != node) {
+			next = head->next;
+			if (head->dummy)
+				rcu_free_dummy(head);
+			head = next;
+		}
+		return count;
+	}
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,165 @@
+#ifndef _URCU_STATIC_SPSCRING_H
+#define _URCU_STATIC_SPSCRING_H
+
+/*
+ * urcu/static/spscring.h
+ *
+ * Userspace RCU library - Single-Producer/Single-Consumer Ring Buffer
+ *
+ * TO BE INCLUDED ONLY IN LGPL-COMPATIBLE CODE. See urcu/spscring.h for
+ * linking dynamically with the userspace rcu library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu/arch.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Indexes are free-running unsigned long counters, masked to access
+ * the slots. head - tail is the number of published entries. Each side
+ * keeps a private copy of the shared index it last stored, so the
+ * fast paths only touch its private cache line and the slots.
+ */
+
+static inline int _cds_spsc_ring_init(struct cds_spsc_ring *ring,
+		unsigned long size, size_t slot_size, unsigned long batch)
+{
+	size_t stride;
+
+	if (size < 2 || (size & (size - 1)) || !slot_size)
+		return -EINVAL;
+	stride = (slot_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	if (stride > (size_t) -1 / size)
+		return -EINVAL;
+	if (posix_memalign((void **) &ring->slots, CAA_CACHE_LINE_SIZE,
+			stride * size))
+		return -ENOMEM;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->prod_next = 0;
+	ring->prod_published = 0;
+	ring->prod_tail_cache = 0;
+	ring->cons_next = 0;
+	ring->cons_released = 0;
+	ring->cons_head_cache = 0;
+	ring->mask = size - 1;
+	if (!batch)
+		batch = 1;
+	ring->batch = batch > size ? size : batch;
+	ring->slot_size = stride;
+	return 0;
+}
+
+static inline void _cds_spsc_ring_destroy(struct cds_spsc_ring *ring)
+{
+	free(ring->slots);
+	ring->slots = NULL;
+}
+
+static inline void *___cds_spsc_ring_slot(struct cds_spsc_ring *ring,
+		unsigned long index)
+{
+	return ring->slots + (index & ring->mask) * ring->slot_size;
+}
+
+static inline void _cds_spsc_ring_publish(struct cds_spsc_ring *ring)
+{
+	if (ring->prod_next == ring->prod_published)
+		return;
+	/* Order stores to the slots before publication of head. */
+	cmm_smp_wmb();
+	ring->prod_published = ring->prod_next;
+	CMM_STORE_SHARED(ring->head, ring->prod_next);
+}
+
+static inline void *_cds_spsc_ring_reserve(struct cds_spsc_ring *ring)
+{
+	unsigned long next = ring->prod_next;
+
+	if (caa_unlikely(next - ring->prod_tail_cache > ring->mask)) {
+		/*
+		 * Looks full: let the consumer see what is already
+		 * committed, then refresh our view of its tail.
+		 */
+		_cds_spsc_ring_publish(ring);
+		ring->prod_tail_cache = CMM_LOAD_SHARED(ring->tail);
+		if (next - ring->prod_tail_cache > ring->mask)
+			return NULL;
+		/*
+		 * Order the consumer's reads of released slots before
+		 * our stores into them.
+		 */
+		cmm_smp_mb();
+	}
+	return ___cds_spsc_ring_slot(ring, next);
+}
+
+static inline void _cds_spsc_ring_commit(struct cds_spsc_ring *ring)
+{
+	ring->prod_next++;
+	if (ring->prod_next - ring->prod_published >= ring->batch)
+		_cds_spsc_ring_publish(ring);
+}
+
+static inline void _cds_spsc_ring_release_publish(struct cds_spsc_ring *ring)
+{
+	if (ring->cons_next == ring->cons_released)
+		return;
+	/* Order reads of the slots before handing them back. */
+	cmm_smp_mb();
+	ring->cons_released = ring->cons_next;
+	CMM_STORE_SHARED(ring->tail, ring->cons_next);
+}
+
+static inline void *_cds_spsc_ring_peek(struct cds_spsc_ring *ring)
+{
+	unsigned long next = ring->cons_next;
+
+	if (caa_unlikely(next == ring->cons_head_cache)) {
+		/*
+		 * Looks empty: give the producer the slots we are done
+		 * with, then refresh our view of its head.
+		 */
+		_cds_spsc_ring_release_publish(ring);
+		ring->cons_head_cache = CMM_LOAD_SHARED(ring->head);
+		if (next == ring->cons_head_cache)
+			return NULL;
+		/* Order load of head before reads of the slots. */
+		cmm_smp_rmb();
+	}
+	return ___cds_spsc_ring_slot(ring, next);
+}
+
+static inline void _cds_spsc_ring_release(struct cds_spsc_ring *ring)
+{
+	ring->cons_next++;
+	if (ring->cons_next - ring->cons_released >= ring->batch)
+		_cds_spsc_ring_release_publish(ring);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_STATIC_SPSCRING_H */
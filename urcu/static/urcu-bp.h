@@ -91,6 +91,21 @@ struct rcu_gp {
 
 extern struct rcu_gp rcu_gp;
 
+/*
+ * Without sys_membarrier, read-side memory barriers pair with the
+ * write-side memory barriers. With sys_membarrier, the writer promotes
+ * the read-side compiler barriers to memory barriers.
+ */
+extern int rcu_has_sys_membarrier;
+
+static inline void smp_mb_slave(void)
+{
+	if (caa_likely(rcu_has_sys_membarrier))
+		cmm_barrier();
+	else
+		cmm_smp_mb();
+}
+
 struct rcu_reader {
 	/* Data used by both reader and synchronize_rcu() */
 	unsigned long ctr;
@@ -136,7 +151,7 @@ static inline void _rcu_read_lock_update(unsigned long tmp)
 {
 	if (caa_likely(!(tmp & RCU_GP_CTR_NEST_MASK))) {
 		_CMM_STORE_SHARED(URCU_TLS(rcu_reader)->ctr, _CMM_LOAD_SHARED(rcu_gp.ctr));
-		cmm_smp_mb();
+		smp_mb_slave();
 	} else
 		_CMM_STORE_SHARED(URCU_TLS(rcu_reader)->ctr, tmp + RCU_GP_COUNT);
 }
@@ -172,7 +187,7 @@ static inline void _rcu_read_unlock(void)
 	/*
 	 * Finish using rcu before decrementing the pointer.
 	 */
-	cmm_smp_mb();
+	smp_mb_slave();
 	_CMM_STORE_SHARED(URCU_TLS(rcu_reader)->ctr, URCU_TLS(rcu_reader)->ctr - RCU_GP_COUNT);
 	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
 }
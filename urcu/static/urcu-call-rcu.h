@@ -0,0 +1,132 @@
+#ifndef _URCU_CALL_RCU_STATIC_H
+#define _URCU_CALL_RCU_STATIC_H
+
+/*
+ * urcu/static/urcu-call-rcu.h
+ *
+ * Userspace RCU header - inline call_rcu() fast path
+ *
+ * TO BE INCLUDED ONLY IN LGPL-COMPATIBLE CODE. See urcu-call-rcu.h for
+ * linking dynamically with the userspace rcu library. Included by the
+ * flavor headers (urcu.h, urcu-qsbr.h, urcu-bp.h, urcu-percpu.h) when
+ * _LGPL_SOURCE is defined.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+#include <urcu/tls-compat.h>
+#include <urcu/rseq.h>
+#include <urcu/wfcqueue.h>
+#include <urcu-call-rcu.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The call_rcu_data the last call_rcu() of the thread resolved, with
+ * pointers to the fields of its queue, so that _call_rcu() enqueues
+ * without any call into the library. Filled by call_rcu() and used by
+ * _call_rcu() only while *gen equals gen_val: the library changes *gen
+ * when the call_rcu_data of a CPU is replaced (the caller then waits
+ * for a grace period before freeing the previous one) and when a
+ * call_rcu_data is freed. A cache filled for a per-CPU call_rcu_data
+ * only applies on that CPU, as reported by rseq. gen is NULL while the
+ * cache is empty. Private to the library, the layout is not part of
+ * the API.
+ */
+struct urcu_call_rcu_cache {
+	const unsigned long *gen;
+	unsigned long gen_val;
+	int cpu;			/* -1: any CPU */
+	struct call_rcu_data *crdp;
+	struct cds_wfcq_head *head;
+	struct cds_wfcq_tail *tail;
+	unsigned long *nr_queued;
+	unsigned long *nr_invoked;
+	unsigned long *qlen_max;
+	unsigned long *qlen_limit;
+	int32_t *futex;
+	unsigned long *ticket_seq;	/* rcu_barrier_thread() ticket */
+};
+
+extern DECLARE_URCU_TLS(struct urcu_call_rcu_cache, call_rcu_cache);
+
+/*
+ * Wake up the call_rcu thread of crdp and track the queue length
+ * high-water mark, after _call_rcu() brought its queue length to qlen.
+ */
+extern void call_rcu_cache_queued(struct call_rcu_data *crdp,
+		unsigned long qlen);
+
+/*
+ * _call_rcu: inline call_rcu().
+ *
+ * Queues the callback on the call_rcu_data cached by the previous
+ * call_rcu() of the thread, with the nr_queued increment and the
+ * enqueue inlined, and calls into the library only to wake up the
+ * call_rcu thread when it sleeps or to raise the queue length
+ * high-water mark. Falls back to call_rcu() to fill the cache, when it
+ * is stale, and when the callback would bring the queue length above
+ * its limit, so that the caller is throttled. Threads with local
+ * batching enabled always use call_rcu(). Same requirements as
+ * call_rcu().
+ */
+static inline
+void _call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head))
+{
+	struct urcu_call_rcu_cache *cache = &URCU_TLS(call_rcu_cache);
+	unsigned long seq, qlen, limit;
+
+	rcu_read_lock();
+	if (caa_unlikely(!cache->gen
+			|| CMM_LOAD_SHARED(*cache->gen) != cache->gen_val
+			|| (cache->cpu >= 0
+				&& urcu_rseq_cpu_id() != cache->cpu)))
+		goto slow;
+	limit = CMM_LOAD_SHARED(*cache->qlen_limit);
+	if (caa_unlikely(limit && uatomic_read(cache->nr_queued) + 1
+			- uatomic_read(cache->nr_invoked) > limit))
+		goto slow;
+
+	cds_wfcq_node_init(&head->next);
+	head->func = func;
+	/* Counted before being enqueued, see rcu_barrier(). */
+	seq = uatomic_add_return(cache->nr_queued, 1);
+	*cache->ticket_seq = seq;
+	qlen = seq - uatomic_read(cache->nr_invoked);
+	(void) cds_wfcq_enqueue(cache->head, cache->tail, &head->next);
+	/* Write to call_rcu list before reading the futex. */
+	cmm_smp_mb();
+	if (caa_unlikely(uatomic_read(cache->futex) == -1
+			|| qlen > CMM_LOAD_SHARED(*cache->qlen_max)))
+		call_rcu_cache_queued(cache->crdp, qlen);
+	rcu_read_unlock();
+	return;
+
+slow:
+	rcu_read_unlock();
+	call_rcu(head, func);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_CALL_RCU_STATIC_H */
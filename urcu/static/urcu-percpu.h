@@ -0,0 +1,218 @@
+#ifndef _URCU_PERCPU_STATIC_H
+#define _URCU_PERCPU_STATIC_H
+
+/*
+ * urcu-percpu-static.h
+ *
+ * Userspace RCU header.
+ *
+ * TO BE INCLUDED ONLY IN CODE THAT IS TO BE RECOMPILED ON EACH LIBURCU
+ * RELEASE. See urcu-percpu.h for linking dynamically with the userspace
+ * rcu library.
+ *
+ * Copyright (c) 2013 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
+#include <urcu/tls-compat.h>
+#include <urcu/rseq.h>
+
+/*
+ * This code section can only be included in LGPL 2.1 compatible source code.
+ * See below for the function call wrappers which can be used in code meant to
+ * be only linked with the Userspace RCU library. This comes with a small
+ * performance degradation on the read-side due to the added function calls.
+ * This is required to permit relinking with newer versions of the library.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef DEBUG_RCU
+#define rcu_assert(args...)	assert(args)
+#else
+#define rcu_assert(args...)
+#endif
+
+/*
+ * The per-thread rcu_reader holds the phase of the outermost read-side
+ * critical section in its low-order bit, and the nesting count in the
+ * other bits.
+ */
+#define RCU_GP_CTR_PHASE	(1UL << 0)
+#define RCU_GP_COUNT		(1UL << 1)
+
+/*
+ * Read-side critical sections of phase i increment lock[i] when they
+ * begin and unlock[i] when they end, on the counters of the CPU they
+ * are running on. Both counters of a CPU are only updated by threads
+ * running on that CPU, within a restartable sequence when available.
+ */
+struct rcu_percpu_count {
+	unsigned long lock[2];
+	unsigned long unlock[2];
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+struct rcu_percpu_counts {
+	unsigned int nr_cpus;
+	struct rcu_percpu_count cpu[];
+};
+
+struct rcu_gp {
+	/*
+	 * Global grace period counter, containing the current
+	 * RCU_GP_CTR_PHASE. Written to only by writer with mutex taken.
+	 * Read by both writer and readers.
+	 */
+	unsigned long ctr;
+	/* Set at initialization if the writer issues sys_membarrier. */
+	int has_membarrier;
+	/* Per-CPU counters, allocated at initialization. */
+	struct rcu_percpu_counts *counts;
+	/*
+	 * Updated with atomic operations by readers without per-CPU
+	 * counter: before initialization, or when the CPU number is
+	 * unknown.
+	 */
+	struct rcu_percpu_count shared;
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+extern struct rcu_gp rcu_gp;
+
+/*
+ * Per-thread state does not need registration: readers only account
+ * themselves in the per-CPU counters.
+ */
+extern DECLARE_URCU_TLS(unsigned long, rcu_reader);
+
+/*
+ * Without sys_membarrier, read-side memory barriers pair with the
+ * write-side memory barriers. With sys_membarrier, the writer promotes
+ * the read-side compiler barriers to memory barriers.
+ */
+static inline void smp_mb_slave(void)
+{
+	if (caa_likely(rcu_gp.has_membarrier))
+		cmm_barrier();
+	else
+		cmm_smp_mb();
+}
+
+/*
+ * Increment the counter at offset in struct rcu_percpu_count, on the
+ * counters of the current CPU.
+ */
+static inline void _rcu_percpu_inc(size_t offset)
+{
+	struct rcu_percpu_counts *counts;
+	int cpu;
+
+	counts = CMM_LOAD_SHARED(rcu_gp.counts);
+	cmm_smp_read_barrier_depends();
+#ifdef URCU_HAVE_RSEQ_PERCPU
+	if (caa_likely(counts)) {
+		unsigned long newv;
+
+		for (;;) {
+			cpu = urcu_rseq_cpu_start();
+			if (caa_unlikely((unsigned int) cpu >= counts->nr_cpus))
+				break;
+			if (caa_likely(!urcu_rseq_add_return((unsigned long *)
+					((char *) &counts->cpu[cpu] + offset),
+					1, cpu, &newv)))
+				return;
+		}
+	}
+#else
+	if (caa_likely(counts)) {
+		cpu = urcu_rseq_cpu_id();
+		if (caa_likely((unsigned int) cpu < counts->nr_cpus)) {
+			uatomic_inc((unsigned long *)
+				((char *) &counts->cpu[cpu] + offset));
+			return;
+		}
+	}
+#endif
+	uatomic_inc((unsigned long *) ((char *) &rcu_gp.shared + offset));
+}
+
+/*
+ * Enter an RCU read-side critical section.
+ *
+ * The outermost critical section only stores its phase and nesting
+ * count once accounted for in the per-CPU counters, so a signal handler
+ * interrupting it performs its own outermost critical section.
+ */
+static inline void _rcu_read_lock(void)
+{
+	unsigned long tmp, phase;
+
+	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
+	tmp = URCU_TLS(rcu_reader);
+	if (caa_likely(!tmp)) {
+		phase = CMM_LOAD_SHARED(rcu_gp.ctr) & RCU_GP_CTR_PHASE;
+		_rcu_percpu_inc(offsetof(struct rcu_percpu_count, lock)
+			+ phase * sizeof(unsigned long));
+		smp_mb_slave();
+		_CMM_STORE_SHARED(URCU_TLS(rcu_reader), RCU_GP_COUNT | phase);
+	} else {
+		_CMM_STORE_SHARED(URCU_TLS(rcu_reader), tmp + RCU_GP_COUNT);
+	}
+}
+
+/*
+ * Exit an RCU read-side critical section.
+ */
+static inline void _rcu_read_unlock(void)
+{
+	unsigned long tmp;
+
+	tmp = URCU_TLS(rcu_reader);
+	if (caa_likely((tmp & ~RCU_GP_CTR_PHASE) == RCU_GP_COUNT)) {
+		/* Finish using rcu before incrementing the unlock count. */
+		smp_mb_slave();
+		_CMM_STORE_SHARED(URCU_TLS(rcu_reader), 0);
+		cmm_barrier();
+		_rcu_percpu_inc(offsetof(struct rcu_percpu_count, unlock)
+			+ (tmp & RCU_GP_CTR_PHASE) * sizeof(unsigned long));
+	} else {
+		_CMM_STORE_SHARED(URCU_TLS(rcu_reader), tmp - RCU_GP_COUNT);
+	}
+	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
+}
+
+/*
+ * Returns whether within a RCU read-side critical section.
+ */
+static inline int _rcu_read_ongoing(void)
+{
+	return URCU_TLS(rcu_reader) != 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_PERCPU_STATIC_H */
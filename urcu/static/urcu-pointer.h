@@ -94,7 +94,10 @@ extern "C" {
 /**
  * _rcu_xchg_pointer - same as rcu_assign_pointer, but returns the previous
  * pointer to the data structure, which can be safely freed after waiting for a
- * quiescent state using synchronize_rcu().
+ * quiescent state using synchronize_rcu(). The exchange has acquire and
+ * release semantic, which orders both the initialization of the new data
+ * structure before its publication and the accesses to the previous one
+ * after the exchange: it does not imply a full memory barrier.
  *
  * This macro is less than 10 lines long.  The intent is that this macro
  * meets the 10-line criterion in LGPL, allowing this function to be
@@ -103,10 +106,7 @@ extern "C" {
 #define _rcu_xchg_pointer(p, v)				\
 	({						\
 		__typeof__(*p) _________pv = (v);	\
-		if (!__builtin_constant_p(v) ||		\
-		    ((v) != NULL))			\
-			cmm_wmb();				\
-		uatomic_xchg(p, _________pv);		\
+		uatomic_xchg_mo(p, _________pv, CMM_ACQ_REL); \
 	})
 
 
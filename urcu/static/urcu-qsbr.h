@@ -89,26 +89,41 @@ struct rcu_reader {
 	unsigned long ctr;
 	/* Data used for registry */
 	struct cds_list_head node __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
-	int waiting;
+	int waiting;		/* Grace period waits for our quiescent state */
 	pthread_t tid;
+	unsigned int qs_leaf;	/* Quiescent state reporting group */
 };
 
 extern DECLARE_URCU_TLS(struct rcu_reader, rcu_reader);
 
 /*
- * Wake-up waiting synchronize_rcu(). Called from many concurrent threads.
+ * Without sys_membarrier, the memory barriers of quiescent state
+ * announcements pair with the write-side memory barriers. With
+ * sys_membarrier, the writer promotes the read-side compiler barriers
+ * to memory barriers, so that announcing a quiescent state while a
+ * grace period is pending does not cost memory barriers either.
  */
-static inline void wake_up_gp(void)
+extern int rcu_has_sys_membarrier;
+
+extern void rcu_qs_report(void);
+
+static inline void smp_mb_slave(void)
 {
-	if (caa_unlikely(_CMM_LOAD_SHARED(URCU_TLS(rcu_reader).waiting))) {
-		_CMM_STORE_SHARED(URCU_TLS(rcu_reader).waiting, 0);
+	if (caa_likely(rcu_has_sys_membarrier))
+		cmm_barrier();
+	else
 		cmm_smp_mb();
-		if (uatomic_read(&rcu_gp.futex) != -1)
-			return;
-		uatomic_set(&rcu_gp.futex, 0);
-		futex_noasync(&rcu_gp.futex, FUTEX_WAKE, 1,
-		      NULL, NULL, 0);
-	}
+}
+
+/*
+ * Report our quiescent state to the grace period waiting for it, if
+ * any. Only touches shared cache lines while a grace period is pending.
+ * Called from many concurrent threads.
+ */
+static inline void wake_up_gp(void)
+{
+	if (caa_unlikely(_CMM_LOAD_SHARED(URCU_TLS(rcu_reader).waiting)))
+		rcu_qs_report();
 }
 
 static inline enum rcu_state rcu_reader_state(unsigned long *ctr)
@@ -160,7 +175,7 @@ static inline int _rcu_read_ongoing(void)
 
 /*
  * This is a helper function for _rcu_quiescent_state().
- * The first cmm_smp_mb() ensures memory accesses in the prior read-side
+ * The first smp_mb_slave() ensures memory accesses in the prior read-side
  * critical sections are not reordered with store to
  * URCU_TLS(rcu_reader).ctr, and ensures that mutexes held within an
  * offline section that would happen to end with this
@@ -169,11 +184,11 @@ static inline int _rcu_read_ongoing(void)
  */
 static inline void _rcu_quiescent_state_update_and_wakeup(unsigned long gp_ctr)
 {
-	cmm_smp_mb();
+	smp_mb_slave();
 	_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, gp_ctr);
-	cmm_smp_mb();	/* write URCU_TLS(rcu_reader).ctr before read futex */
+	smp_mb_slave();	/* write URCU_TLS(rcu_reader).ctr before read futex */
 	wake_up_gp();
-	cmm_smp_mb();
+	smp_mb_slave();
 }
 
 /*
@@ -197,6 +212,25 @@ static inline void _rcu_quiescent_state(void)
 	_rcu_quiescent_state_update_and_wakeup(gp_ctr);
 }
 
+/*
+ * Inform RCU of a quiescent state only if a grace period waits for it.
+ *
+ * This function is less than 10 lines long.  The intent is that this
+ * function meets the 10-line criterion for LGPL, allowing this function
+ * to be invoked directly from non-LGPL code.
+ *
+ * Checkpoint for long loops: only reads the waiting flag that the grace
+ * period sets on each reader it waits for, without touching rcu_gp.ctr.
+ * A new grace period is seen once it arms this thread, rather than as
+ * soon as it starts.
+ */
+static inline void _rcu_quiescent_state_maybe(void)
+{
+	if (caa_likely(!CMM_LOAD_SHARED(URCU_TLS(rcu_reader).waiting)))
+		return;
+	_rcu_quiescent_state();
+}
+
 /*
  * Take a thread offline, prohibiting it from entering further RCU
  * read-side critical sections.
@@ -207,9 +241,9 @@ static inline void _rcu_quiescent_state(void)
  */
 static inline void _rcu_thread_offline(void)
 {
-	cmm_smp_mb();
+	smp_mb_slave();
 	CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, 0);
-	cmm_smp_mb();	/* write URCU_TLS(rcu_reader).ctr before read futex */
+	smp_mb_slave();	/* write URCU_TLS(rcu_reader).ctr before read futex */
 	wake_up_gp();
 	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
 }
@@ -226,7 +260,7 @@ static inline void _rcu_thread_online(void)
 {
 	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
 	_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, CMM_LOAD_SHARED(rcu_gp.ctr));
-	cmm_smp_mb();
+	smp_mb_slave();
 }
 
 #ifdef __cplusplus 
@@ -42,6 +42,9 @@
 #include <urcu/futex.h>
 #include <urcu/tls-compat.h>
 #include <urcu/rand-compat.h>
+#ifdef CONFIG_RCU_READ_PROFILE
+#include <urcu-read-profile.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -146,21 +149,52 @@ struct rcu_gp {
 	unsigned long ctr;
 
 	int32_t futex;
+	/*
+	 * Readers still blocking the sleeping synchronize_rcu(), counted
+	 * down by the departing ones: only the last one wakes it up.
+	 */
+	long countdown;
 } __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 
 extern struct rcu_gp rcu_gp;
 
 struct rcu_reader {
 	/* Data used by both reader and synchronize_rcu() */
+#ifdef CONFIG_RCU_READER_ARRAY
+	unsigned long *ctr;	/* Slot of the registry reader array */
+#else
 	unsigned long ctr;
+#endif
 	char need_mb;
+	char quiescent;		/* Registered with rcu_register_thread_quiescent() */
+#ifdef CONFIG_RCU_READ_PROFILE
+	unsigned long profile_countdown;	/* Sections until the next sample */
+	uint64_t profile_start;		/* Start of the sampled section, or 0 */
+#endif
 	/* Data used for registry */
 	struct cds_list_head node __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 	pthread_t tid;
+	/* Readers needing barriers from synchronize_rcu(), and their CPU */
+	struct cds_list_head barrier_node;
+	uint32_t *rseq_cpu_id;
+#ifdef CONFIG_RCU_READ_PROFILE
+	struct rcu_read_profile profile;	/* Written by the thread only */
+#endif
 };
 
 extern DECLARE_URCU_TLS(struct rcu_reader, rcu_reader);
 
+/*
+ * With CONFIG_RCU_READER_ARRAY, the reader counter is kept in a slot of
+ * an array owned by the reader registry, assigned on thread
+ * registration, so grace periods scan the counters with a linear sweep.
+ */
+#ifdef CONFIG_RCU_READER_ARRAY
+#define _URCU_READER_CTR	(*URCU_TLS(rcu_reader).ctr)
+#else
+#define _URCU_READER_CTR	(URCU_TLS(rcu_reader).ctr)
+#endif
+
 /*
  * Wake-up waiting synchronize_rcu(). Called from many concurrent threads.
  */
@@ -173,6 +207,21 @@ static inline void wake_up_gp(void)
 	}
 }
 
+/*
+ * Wake-up waiting synchronize_rcu() if we were the last reader it waits
+ * for. ctr is our reader counter before leaving: only readers using the
+ * old parity block the grace period, and count down.
+ */
+static inline void wake_up_gp_countdown(unsigned long ctr)
+{
+	if (caa_likely(uatomic_read(&rcu_gp.futex) != -1))
+		return;
+	if (!((ctr ^ CMM_LOAD_SHARED(rcu_gp.ctr)) & RCU_GP_CTR_PHASE))
+		return;
+	if (!uatomic_add_return(&rcu_gp.countdown, -1))
+		wake_up_gp();
+}
+
 static inline enum rcu_state rcu_reader_state(unsigned long *ctr)
 {
 	unsigned long v;
@@ -189,6 +238,39 @@ static inline enum rcu_state rcu_reader_state(unsigned long *ctr)
 	return RCU_READER_ACTIVE_OLD;
 }
 
+#ifdef CONFIG_RCU_READ_PROFILE
+extern void rcu_read_profile_start(void);
+extern void rcu_read_profile_record(void);
+
+/*
+ * Sample one outermost read-side critical section out of the period set
+ * by rcu_set_read_profile(): the countdown is the only cost of the
+ * sections not sampled.
+ */
+static inline void _rcu_read_profile_lock(unsigned long tmp)
+{
+	if (caa_likely(tmp & RCU_GP_CTR_NEST_MASK))
+		return;
+	if (caa_unlikely(!URCU_TLS(rcu_reader).profile_countdown--))
+		rcu_read_profile_start();
+}
+
+static inline void _rcu_read_profile_unlock(unsigned long tmp)
+{
+	if (caa_unlikely(URCU_TLS(rcu_reader).profile_start)
+			&& (tmp & RCU_GP_CTR_NEST_MASK) == RCU_GP_COUNT)
+		rcu_read_profile_record();
+}
+#else /* #ifdef CONFIG_RCU_READ_PROFILE */
+static inline void _rcu_read_profile_lock(unsigned long tmp)
+{
+}
+
+static inline void _rcu_read_profile_unlock(unsigned long tmp)
+{
+}
+#endif /* #else #ifdef CONFIG_RCU_READ_PROFILE */
+
 /*
  * Helper for _rcu_read_lock().  The format of rcu_gp.ctr (as well as
  * the per-thread rcu_reader.ctr) has the upper bits containing a count of
@@ -199,10 +281,10 @@ static inline enum rcu_state rcu_reader_state(unsigned long *ctr)
 static inline void _rcu_read_lock_update(unsigned long tmp)
 {
 	if (caa_likely(!(tmp & RCU_GP_CTR_NEST_MASK))) {
-		_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, _CMM_LOAD_SHARED(rcu_gp.ctr));
+		_CMM_STORE_SHARED(_URCU_READER_CTR, _CMM_LOAD_SHARED(rcu_gp.ctr));
 		smp_mb_slave(RCU_MB_GROUP);
 	} else
-		_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, tmp + RCU_GP_COUNT);
+		_CMM_STORE_SHARED(_URCU_READER_CTR, tmp + RCU_GP_COUNT);
 }
 
 /*
@@ -220,8 +302,9 @@ static inline void _rcu_read_lock(void)
 	unsigned long tmp;
 
 	cmm_barrier();
-	tmp = URCU_TLS(rcu_reader).ctr;
+	tmp = _URCU_READER_CTR;
 	_rcu_read_lock_update(tmp);
+	_rcu_read_profile_lock(tmp);
 }
 
 /*
@@ -230,17 +313,17 @@ static inline void _rcu_read_lock(void)
  * The first smp_mb_slave() call ensures that the critical section is
  * seen to precede the store to rcu_reader.ctr.
  * The second smp_mb_slave() call ensures that we write to rcu_reader.ctr
- * before reading the update-side futex.
+ * before reading the update-side futex and countdown.
  */
 static inline void _rcu_read_unlock_update_and_wakeup(unsigned long tmp)
 {
 	if (caa_likely((tmp & RCU_GP_CTR_NEST_MASK) == RCU_GP_COUNT)) {
 		smp_mb_slave(RCU_MB_GROUP);
-		_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, URCU_TLS(rcu_reader).ctr - RCU_GP_COUNT);
+		_CMM_STORE_SHARED(_URCU_READER_CTR, _URCU_READER_CTR - RCU_GP_COUNT);
 		smp_mb_slave(RCU_MB_GROUP);
-		wake_up_gp();
+		wake_up_gp_countdown(tmp);
 	} else
-		_CMM_STORE_SHARED(URCU_TLS(rcu_reader).ctr, URCU_TLS(rcu_reader).ctr - RCU_GP_COUNT);
+		_CMM_STORE_SHARED(_URCU_READER_CTR, _URCU_READER_CTR - RCU_GP_COUNT);
 }
 
 /*
@@ -252,7 +335,8 @@ static inline void _rcu_read_unlock(void)
 {
 	unsigned long tmp;
 
-	tmp = URCU_TLS(rcu_reader).ctr;
+	tmp = _URCU_READER_CTR;
+	_rcu_read_profile_unlock(tmp);
 	_rcu_read_unlock_update_and_wakeup(tmp);
 	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
 }
@@ -266,7 +350,68 @@ static inline void _rcu_read_unlock(void)
  */
 static inline int _rcu_read_ongoing(void)
 {
-	return URCU_TLS(rcu_reader).ctr & RCU_GP_CTR_NEST_MASK;
+	unsigned long nest;
+
+#ifdef CONFIG_RCU_READER_ARRAY
+	if (caa_unlikely(!URCU_TLS(rcu_reader).ctr))
+		return 0;	/* Unregistered thread. */
+#endif
+	nest = _URCU_READER_CTR & RCU_GP_CTR_NEST_MASK;
+	/* Online quiescent-state threads keep one nesting level. */
+	if (caa_unlikely(URCU_TLS(rcu_reader).quiescent) && nest)
+		nest -= RCU_GP_COUNT;
+	return nest;
+}
+
+/*
+ * Reader context registered with rcu_register_ctx(), carried by the
+ * caller rather than found in TLS, e.g. by a fiber migrating between
+ * threads while in a read-side critical section. As the grace periods
+ * cannot tell which thread uses it, its read-side critical sections
+ * issue their own memory barriers, as the urcu-mb flavor.
+ */
+struct rcu_reader_ctx {
+	struct rcu_reader reader;
+};
+
+#ifdef CONFIG_RCU_READER_ARRAY
+#define _URCU_CTX_CTR(ctx)	(*(ctx)->reader.ctr)
+#else
+#define _URCU_CTX_CTR(ctx)	((ctx)->reader.ctr)
+#endif
+
+static inline void _rcu_read_lock_ctx(struct rcu_reader_ctx *ctx)
+{
+	unsigned long tmp;
+
+	cmm_barrier();
+	tmp = _URCU_CTX_CTR(ctx);
+	if (caa_likely(!(tmp & RCU_GP_CTR_NEST_MASK))) {
+		_CMM_STORE_SHARED(_URCU_CTX_CTR(ctx),
+				_CMM_LOAD_SHARED(rcu_gp.ctr));
+		cmm_smp_mb();
+	} else
+		_CMM_STORE_SHARED(_URCU_CTX_CTR(ctx), tmp + RCU_GP_COUNT);
+}
+
+static inline void _rcu_read_unlock_ctx(struct rcu_reader_ctx *ctx)
+{
+	unsigned long tmp;
+
+	tmp = _URCU_CTX_CTR(ctx);
+	if (caa_likely((tmp & RCU_GP_CTR_NEST_MASK) == RCU_GP_COUNT)) {
+		cmm_smp_mb();
+		_CMM_STORE_SHARED(_URCU_CTX_CTR(ctx), tmp - RCU_GP_COUNT);
+		cmm_smp_mb();	/* write ctr before read futex */
+		wake_up_gp_countdown(tmp);
+	} else
+		_CMM_STORE_SHARED(_URCU_CTX_CTR(ctx), tmp - RCU_GP_COUNT);
+	cmm_barrier();	/* Ensure the compiler does not reorder us with mutex */
+}
+
+static inline int _rcu_read_ongoing_ctx(struct rcu_reader_ctx *ctx)
+{
+	return _URCU_CTX_CTR(ctx) & RCU_GP_CTR_NEST_MASK;
 }
 
 #ifdef __cplusplus
@@ -31,8 +31,12 @@
 #include <assert.h>
 #include <poll.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
 #include <urcu/compiler.h>
 #include <urcu/uatomic.h>
+#include <urcu/futex.h>
+#include <urcu/blocking.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -55,7 +59,7 @@ extern "C" {
  * required between pairs marked with "-".
  *
  * Legend:
- * [1] cds_wfcq_enqueue
+ * [1] cds_wfcq_enqueue, cds_wfcq_enqueue_chain
  * [2] __cds_wfcq_splice (destination queue)
  * [3] __cds_wfcq_dequeue
  * [4] __cds_wfcq_splice (source queue)
@@ -147,10 +151,16 @@ static inline bool _cds_wfcq_empty(cds_wfcq_head_ptr_t u_head,
 static inline void _cds_wfcq_dequeue_lock(struct cds_wfcq_head *head,
 		struct cds_wfcq_tail *tail)
 {
-	int ret;
+	int ret, was_online;
 
+	ret = pthread_mutex_trylock(&head->lock);
+	if (caa_likely(!ret))
+		return;
+	/* Contended: the wait may be long. */
+	was_online = urcu_blocking_begin();
 	ret = pthread_mutex_lock(&head->lock);
 	assert(!ret);
+	urcu_blocking_end(was_online);
 }
 
 static inline void _cds_wfcq_dequeue_unlock(struct cds_wfcq_head *head,
@@ -162,31 +172,37 @@ static inline void _cds_wfcq_dequeue_unlock(struct cds_wfcq_head *head,
 	assert(!ret);
 }
 
+/*
+ * Append new_head..new_tail to the queue. The exchange on the tail
+ * uses memory order mo: it needs at least CMM_ACQ_REL, to publish the
+ * nodes and to order the store to the previous tail's next pointer
+ * after its initialization by the concurrent enqueuer which exchanged
+ * it. CMM_SEQ_CST_FENCE makes the append a full memory barrier.
+ */
 static inline bool ___cds_wfcq_append(cds_wfcq_head_ptr_t u_head,
 		struct cds_wfcq_tail *tail,
 		struct cds_wfcq_node *new_head,
-		struct cds_wfcq_node *new_tail)
+		struct cds_wfcq_node *new_tail,
+		enum cmm_memorder mo)
 {
 	struct __cds_wfcq_head *head = u_head._h;
 	struct cds_wfcq_node *old_tail;
 
 	/*
-	 * Implicit memory barrier before uatomic_xchg() orders earlier
-	 * stores to data structure containing node and setting
-	 * node->next to NULL before publication.
+	 * Release semantic of the exchange orders earlier stores to
+	 * data structure containing node and setting node->next to NULL
+	 * before publication.
 	 */
-	old_tail = uatomic_xchg(&tail->p, new_tail);
+	old_tail = uatomic_xchg_mo(&tail->p, new_tail, mo);
 
 	/*
-	 * Implicit memory barrier after uatomic_xchg() orders store to
-	 * q->tail before store to old_tail->next.
-	 *
 	 * At this point, dequeuers see a NULL tail->p->next, which
 	 * indicates that the queue is being appended to. The following
 	 * store will append "node" to the queue from a dequeuer
-	 * perspective.
+	 * perspective. Its release semantic orders the initialization
+	 * of the nodes before dequeuers can reach them.
 	 */
-	CMM_STORE_SHARED(old_tail->next, new_head);
+	uatomic_store(&old_tail->next, new_head, CMM_RELEASE);
 	/*
 	 * Return false if queue was empty prior to adding the node,
 	 * else return true.
@@ -197,7 +213,9 @@ static inline bool ___cds_wfcq_append(cds_wfcq_head_ptr_t u_head,
 /*
  * cds_wfcq_enqueue: enqueue a node into a wait-free queue.
  *
- * Issues a full memory barrier before enqueue. No mutual exclusion is
+ * Memory accesses before the enqueue are ordered before it (release
+ * semantic). This is not a full memory barrier: later loads may be
+ * performed before the enqueue is visible. No mutual exclusion is
  * required.
  *
  * Returns false if the queue was empty prior to adding the node.
@@ -207,7 +225,209 @@ static inline bool _cds_wfcq_enqueue(cds_wfcq_head_ptr_t head,
 		struct cds_wfcq_tail *tail,
 		struct cds_wfcq_node *new_tail)
 {
-	return ___cds_wfcq_append(head, tail, new_tail, new_tail);
+	return ___cds_wfcq_append(head, tail, new_tail, new_tail, CMM_ACQ_REL);
+}
+
+/*
+ * cds_wfcq_chain_init: initialize a local chain of nodes.
+ */
+static inline void _cds_wfcq_chain_init(struct cds_wfcq_chain *chain)
+{
+	chain->first = NULL;
+	chain->last = NULL;
+}
+
+/*
+ * cds_wfcq_chain_empty: return whether a local chain is empty.
+ */
+static inline bool _cds_wfcq_chain_empty(struct cds_wfcq_chain *chain)
+{
+	return chain->first == NULL;
+}
+
+/*
+ * cds_wfcq_chain_add: append a node at the end of a local chain.
+ *
+ * The chain is private to the caller: no atomic operation nor memory
+ * barrier is issued. The node next pointer is reset.
+ */
+static inline void _cds_wfcq_chain_add(struct cds_wfcq_chain *chain,
+		struct cds_wfcq_node *node)
+{
+	node->next = NULL;
+	if (chain->last)
+		chain->last->next = node;
+	else
+		chain->first = node;
+	chain->last = node;
+}
+
+/*
+ * cds_wfcq_enqueue_chain: enqueue all nodes of a local chain into a
+ * wait-free queue with a single exchange on the queue tail.
+ *
+ * Same memory ordering as cds_wfcq_enqueue(). No mutual exclusion is
+ * required. The chain is re-initialized and can be reused by the
+ * caller. Nodes of the chain appear in the queue in the order they
+ * were added to the chain, and are never interleaved with nodes
+ * enqueued concurrently by other threads.
+ *
+ * Returns false if the queue was empty prior to adding the nodes.
+ * Returns true otherwise. Enqueuing an empty chain does not modify the
+ * queue and returns whether the queue is non-empty.
+ */
+static inline bool ___cds_wfcq_enqueue_chain(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_chain *chain,
+		enum cmm_memorder mo)
+{
+	struct cds_wfcq_node *first = chain->first, *last = chain->last;
+
+	if (!first)
+		return !_cds_wfcq_empty(head, tail);
+	_cds_wfcq_chain_init(chain);
+	return ___cds_wfcq_append(head, tail, first, last, mo);
+}
+
+static inline bool _cds_wfcq_enqueue_chain(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_chain *chain)
+{
+	return ___cds_wfcq_enqueue_chain(head, tail, chain, CMM_ACQ_REL);
+}
+
+/*
+ * cds_wfcq_wait_init: initialize the consumer wait state of a queue.
+ */
+static inline void _cds_wfcq_wait_init(struct cds_wfcq_wait *wait)
+{
+	wait->futex = 0;
+	wait->nr_waiters = 0;
+}
+
+static inline void ___cds_wfcq_wake_waiters(struct cds_wfcq_wait *wait)
+{
+	if (caa_likely(!CMM_LOAD_SHARED(wait->nr_waiters)))
+		return;
+	uatomic_inc(&wait->futex);
+	(void) futex_noasync(&wait->futex, FUTEX_WAKE, INT_MAX,
+			NULL, NULL, 0);
+}
+
+/*
+ * cds_wfcq_wake: wake up consumers waiting for the queue to become
+ * non-empty.
+ *
+ * Meant to be called after nodes were added to the queue by other
+ * means than cds_wfcq_enqueue_wake() or cds_wfcq_enqueue_chain_wake(),
+ * e.g. by splicing into it. Issues a full memory barrier. Only issues
+ * a FUTEX_WAKE system call if a consumer is waiting.
+ */
+static inline void _cds_wfcq_wake(struct cds_wfcq_wait *wait)
+{
+	/* Order queue updates before load of nr_waiters. */
+	cmm_smp_mb();
+	___cds_wfcq_wake_waiters(wait);
+}
+
+/*
+ * cds_wfcq_enqueue_wake: enqueue a node into a wait-free queue and wake
+ * up consumers waiting in cds_wfcq_wait_nonempty().
+ *
+ * Same semantic as cds_wfcq_enqueue(), but issues a full memory barrier
+ * before and after the enqueue. The FUTEX_WAKE system call is only
+ * issued when a consumer is actually waiting. Not signal-safe.
+ */
+static inline bool _cds_wfcq_enqueue_wake(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_node *new_tail,
+		struct cds_wfcq_wait *wait)
+{
+	bool ret;
+
+	/*
+	 * The fully ordered exchange on the tail orders the enqueue
+	 * before the load of nr_waiters.
+	 */
+	ret = ___cds_wfcq_append(head, tail, new_tail, new_tail,
+			CMM_SEQ_CST_FENCE);
+	___cds_wfcq_wake_waiters(wait);
+	return ret;
+}
+
+/*
+ * cds_wfcq_enqueue_chain_wake: enqueue a local chain of nodes into a
+ * wait-free queue and wake up consumers waiting in
+ * cds_wfcq_wait_nonempty().
+ *
+ * Same semantic as cds_wfcq_enqueue_chain(), but issues a full memory
+ * barrier before and after the enqueue. The FUTEX_WAKE system call is
+ * only issued when a consumer is actually waiting. Not signal-safe.
+ */
+static inline bool _cds_wfcq_enqueue_chain_wake(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_chain *chain,
+		struct cds_wfcq_wait *wait)
+{
+	bool ret;
+
+	if (_cds_wfcq_chain_empty(chain))
+		return !_cds_wfcq_empty(head, tail);
+	/* Full memory barrier implied by the exchange on the tail. */
+	ret = ___cds_wfcq_enqueue_chain(head, tail, chain, CMM_SEQ_CST_FENCE);
+	___cds_wfcq_wake_waiters(wait);
+	return ret;
+}
+
+/*
+ * cds_wfcq_wait_nonempty: wait for a wait-free queue to become
+ * non-empty.
+ *
+ * Returns immediately if the queue is non-empty. Otherwise, sleeps on
+ * the wait state futex until a producer using cds_wfcq_enqueue_wake(),
+ * cds_wfcq_enqueue_chain_wake() or cds_wfcq_wake() adds nodes to the
+ * queue. Several consumers may wait concurrently: they are all woken
+ * up. The queue may be found empty again by the time the caller
+ * dequeues, if other consumers took the nodes first. No mutual
+ * exclusion is required.
+ */
+static inline void _cds_wfcq_wait_nonempty(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_wait *wait)
+{
+	int32_t seq;
+	int was_online;
+
+	if (!_cds_wfcq_empty(head, tail))
+		return;
+	was_online = urcu_blocking_begin();
+	uatomic_inc(&wait->nr_waiters);
+	cmm_smp_mb__after_uatomic_inc();
+	for (;;) {
+		seq = uatomic_read(&wait->futex);
+		/*
+		 * Order load of the futex sequence before the empty
+		 * check. Pairs with the barrier between enqueue and the
+		 * load of nr_waiters on the producer side.
+		 */
+		cmm_smp_mb();
+		if (!_cds_wfcq_empty(head, tail))
+			break;
+		if (futex_noasync(&wait->futex, FUTEX_WAIT, seq,
+				NULL, NULL, 0)) {
+			switch (errno) {
+			case EWOULDBLOCK:
+			case EINTR:
+				break;
+			default:
+				/* Unexpected error: fall back on polling. */
+				(void) poll(NULL, 0, WFCQ_WAIT);
+			}
+		}
+	}
+	cmm_smp_mb__before_uatomic_dec();
+	uatomic_dec(&wait->nr_waiters);
+	urcu_blocking_end(was_online);
 }
 
 /*
@@ -221,7 +441,10 @@ ___cds_wfcq_busy_wait(int *attempt, int blocking)
 	if (!blocking)
 		return 1;
 	if (++(*attempt) >= WFCQ_ADAPT_ATTEMPTS) {
+		int was_online = urcu_blocking_begin();
+
 		poll(NULL, 0, WFCQ_WAIT);	/* Wait for 10ms */
+		urcu_blocking_end(was_online);
 		*attempt = 0;
 	} else {
 		caa_cpu_relax();
@@ -243,7 +466,7 @@ ___cds_wfcq_node_sync_next(struct cds_wfcq_node *node, int blocking)
 	 */
 	while ((next = CMM_LOAD_SHARED(node->next)) == NULL) {
 		if (___cds_wfcq_busy_wait(&attempt, blocking))
-			return CDS_WFCQ_WOULDBLOCK;
+			return (struct cds_wfcq_node *) CDS_WFCQ_WOULDBLOCK;
 	}
 
 	return next;
@@ -381,7 +604,7 @@ ___cds_wfcq_dequeue_with_state(cds_wfcq_head_ptr_t u_head,
 
 	node = ___cds_wfcq_node_sync_next(&head->node, blocking);
 	if (!blocking && node == CDS_WFCQ_WOULDBLOCK) {
-		return CDS_WFCQ_WOULDBLOCK;
+		return (struct cds_wfcq_node *) CDS_WFCQ_WOULDBLOCK;
 	}
 
 	if ((next = CMM_LOAD_SHARED(node->next)) == NULL) {
@@ -413,7 +636,7 @@ ___cds_wfcq_dequeue_with_state(cds_wfcq_head_ptr_t u_head,
 		 */
 		if (!blocking && next == CDS_WFCQ_WOULDBLOCK) {
 			head->node.next = node;
-			return CDS_WFCQ_WOULDBLOCK;
+			return (struct cds_wfcq_node *) CDS_WFCQ_WOULDBLOCK;
 		}
 	}
 
@@ -482,6 +705,105 @@ ___cds_wfcq_dequeue_nonblocking(cds_wfcq_head_ptr_t head,
 	return ___cds_wfcq_dequeue_with_state_nonblocking(head, tail, NULL);
 }
 
+static inline unsigned int
+___cds_wfcq_dequeue_bulk(cds_wfcq_head_ptr_t u_head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_node **nodes,
+		unsigned int max,
+		int blocking)
+{
+	struct __cds_wfcq_head *head = u_head._h;
+	struct cds_wfcq_node *node, *next;
+	unsigned int count = 0;
+
+	if (!max)
+		return 0;
+	node = ___cds_wfcq_first(head, tail, blocking);
+	if (!node || node == CDS_WFCQ_WOULDBLOCK)
+		return 0;
+
+	/*
+	 * Collect up to @max nodes, stopping at the node which appears
+	 * to be the tail. In nonblocking mode, a node whose next
+	 * pointer is not set yet stays in the queue.
+	 */
+	for (;;) {
+		nodes[count++] = node;
+		if (count == max) {
+			next = CMM_LOAD_SHARED(node->next);
+			break;
+		}
+		next = ___cds_wfcq_next(head, tail, node, blocking);
+		if (!next)
+			break;
+		if (next == CDS_WFCQ_WOULDBLOCK) {
+			next = node;
+			count--;
+			goto end;
+		}
+		node = next;
+	}
+
+	if (!next) {
+		/*
+		 * @node is probably the last node in the queue: same
+		 * tail move as ___cds_wfcq_dequeue_with_state(), done
+		 * once for the whole batch.
+		 */
+		_cds_wfcq_node_init(&head->node);
+		if (uatomic_cmpxchg(&tail->p, node, &head->node) == node)
+			return count;
+		next = ___cds_wfcq_node_sync_next(node, blocking);
+		if (!blocking && next == CDS_WFCQ_WOULDBLOCK) {
+			next = node;
+			count--;
+		}
+	}
+end:
+	/*
+	 * Move queue head forward past the batch.
+	 */
+	head->node.next = next;
+	return count;
+}
+
+/*
+ * __cds_wfcq_dequeue_bulk_blocking: dequeue up to @max nodes.
+ *
+ * Detach up to @max nodes from the head of the queue and store them in
+ * @nodes, in queue order, moving the queue head a single time. Returns
+ * the number of nodes dequeued, 0 if the queue is empty.
+ * Content written into the nodes before enqueue is guaranteed to be
+ * consistent, but no other memory ordering is ensured.
+ * It is valid to reuse and free the dequeued nodes immediately.
+ * Dequeue/splice/iteration mutual exclusion should be ensured by the
+ * caller.
+ */
+static inline unsigned int
+___cds_wfcq_dequeue_bulk_blocking(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_node **nodes,
+		unsigned int max)
+{
+	return ___cds_wfcq_dequeue_bulk(head, tail, nodes, max, 1);
+}
+
+/*
+ * __cds_wfcq_dequeue_bulk_nonblocking: dequeue up to @max nodes.
+ *
+ * Same as __cds_wfcq_dequeue_bulk_blocking, but stops before a node it
+ * would need to block for. Returns 0 if the queue is empty or if it
+ * would need to block to dequeue the first node.
+ */
+static inline unsigned int
+___cds_wfcq_dequeue_bulk_nonblocking(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_node **nodes,
+		unsigned int max)
+{
+	return ___cds_wfcq_dequeue_bulk(head, tail, nodes, max, 0);
+}
+
 /*
  * __cds_wfcq_splice: enqueue all src_q nodes at the end of dest_q.
  *
@@ -539,7 +861,8 @@ ___cds_wfcq_splice(
 	 * Append the spliced content of src_q into dest_q. Does not
 	 * require mutual exclusion on dest_q (wait-free).
 	 */
-	if (___cds_wfcq_append(dest_q_head, dest_q_tail, head, tail))
+	if (___cds_wfcq_append(dest_q_head, dest_q_tail, head, tail,
+			CMM_SEQ_CST_FENCE))
 		return CDS_WFCQ_RET_DEST_NON_EMPTY;
 	else
 		return CDS_WFCQ_RET_DEST_EMPTY;
@@ -616,6 +939,28 @@ _cds_wfcq_dequeue_blocking(struct cds_wfcq_head *head,
 	return _cds_wfcq_dequeue_with_state_blocking(head, tail, NULL);
 }
 
+/*
+ * cds_wfcq_dequeue_bulk_blocking: dequeue up to @max nodes.
+ *
+ * Same as __cds_wfcq_dequeue_bulk_blocking, holding the dequeue lock
+ * once for the whole batch.
+ * Mutual exclusion with cds_wfcq_splice_blocking and dequeue lock is
+ * ensured.
+ */
+static inline unsigned int
+_cds_wfcq_dequeue_bulk_blocking(struct cds_wfcq_head *head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_node **nodes,
+		unsigned int max)
+{
+	unsigned int retval;
+
+	_cds_wfcq_dequeue_lock(head, tail);
+	retval = ___cds_wfcq_dequeue_bulk_blocking(head, tail, nodes, max);
+	_cds_wfcq_dequeue_unlock(head, tail);
+	return retval;
+}
+
 /*
  * cds_wfcq_splice_blocking: enqueue all src_q nodes at the end of dest_q.
  *
@@ -144,6 +144,78 @@ int _cds_wfs_push(cds_wfs_stack_ptr_t u_stack, struct cds_wfs_node *node)
 	return !___cds_wfs_end(old_head);
 }
 
+/*
+ * cds_wfs_chain_init: initialize a local chain of nodes.
+ */
+static inline void _cds_wfs_chain_init(struct cds_wfs_chain *chain)
+{
+	chain->top = NULL;
+	chain->bottom = NULL;
+}
+
+/*
+ * cds_wfs_chain_empty: return whether a local chain is empty.
+ */
+static inline bool _cds_wfs_chain_empty(struct cds_wfs_chain *chain)
+{
+	return chain->top == NULL;
+}
+
+/*
+ * cds_wfs_chain_add: add a node on top of a local chain.
+ *
+ * The chain is private to the caller: no atomic operation nor memory
+ * barrier is issued. The node next pointer is overwritten.
+ */
+static inline void _cds_wfs_chain_add(struct cds_wfs_chain *chain,
+		struct cds_wfs_node *node)
+{
+	node->next = chain->top;
+	if (!chain->bottom)
+		chain->bottom = node;
+	chain->top = node;
+}
+
+/*
+ * cds_wfs_push_chain: push all nodes of a local chain into the stack
+ * with a single exchange on the stack head.
+ *
+ * Same memory ordering as cds_wfs_push(). No mutual exclusion is
+ * required. The stack then looks as if the nodes had been pushed one
+ * by one, in the order they were added to the chain, and they are
+ * never interleaved with nodes pushed concurrently by other threads.
+ * The chain is re-initialized and can be reused by the caller.
+ *
+ * Returns 0 if the stack was empty prior to adding the nodes.
+ * Returns non-zero otherwise. Pushing an empty chain does not modify
+ * the stack and returns whether the stack is non-empty.
+ */
+static inline
+int _cds_wfs_push_chain(cds_wfs_stack_ptr_t u_stack,
+		struct cds_wfs_chain *chain)
+{
+	struct __cds_wfs_stack *s = u_stack._s;
+	struct cds_wfs_head *old_head, *new_head;
+	struct cds_wfs_node *bottom = chain->bottom;
+
+	if (!chain->top)
+		return !_cds_wfs_empty(u_stack);
+	assert(bottom->next == NULL);
+	new_head = caa_container_of(chain->top, struct cds_wfs_head, node);
+	_cds_wfs_chain_init(chain);
+	/*
+	 * uatomic_xchg() implicit memory barrier orders earlier stores
+	 * to the chain nodes before publication.
+	 */
+	old_head = uatomic_xchg(&s->head, new_head);
+	/*
+	 * Nodes above the bottom of the chain are already linked:
+	 * dequeuers only busy-wait on the bottom node next pointer.
+	 */
+	CMM_STORE_SHARED(bottom->next, &old_head->node);
+	return !___cds_wfs_end(old_head);
+}
+
 /*
  * Waiting for push to complete enqueue and return the next node.
  */
@@ -301,6 +373,48 @@ ___cds_wfs_pop_all(cds_wfs_stack_ptr_t u_stack)
 	return head;
 }
 
+/*
+ * cds_wfs_reverse_blocking: reverse a popped stack in place.
+ *
+ * Takes a stack head returned by __cds_wfs_pop_all or
+ * cds_wfs_pop_all_blocking, and returns the head of the same nodes in
+ * push order, the oldest node first. Blocks until the pushes of the
+ * popped nodes are complete. Returns NULL if @head is NULL.
+ */
+static inline
+struct cds_wfs_head *
+_cds_wfs_reverse_blocking(struct cds_wfs_head *head)
+{
+	struct cds_wfs_node *node, *next, *prev = CDS_WFS_END;
+
+	if (!head)
+		return NULL;
+	node = &head->node;
+	for (;;) {
+		next = ___cds_wfs_node_sync_next(node, 1);
+		CMM_STORE_SHARED(node->next, prev);
+		if (___cds_wfs_end(next))
+			break;
+		prev = node;
+		node = next;
+	}
+	return caa_container_of(node, struct cds_wfs_head, node);
+}
+
+/*
+ * __cds_wfs_pop_all_reverse_blocking: pop all nodes from a stack, in
+ * push order.
+ *
+ * Same as __cds_wfs_pop_all followed by cds_wfs_reverse_blocking.
+ * Requires the same synchronization as __cds_wfs_pop_all.
+ */
+static inline
+struct cds_wfs_head *
+___cds_wfs_pop_all_reverse_blocking(cds_wfs_stack_ptr_t u_stack)
+{
+	return _cds_wfs_reverse_blocking(___cds_wfs_pop_all(u_stack));
+}
+
 /*
  * cds_wfs_pop_lock: lock stack pop-protection mutex.
  */
@@ -363,6 +477,25 @@ _cds_wfs_pop_all_blocking(struct cds_wfs_stack *s)
 	return rethead;
 }
 
+/*
+ * cds_wfs_pop_all_reverse_blocking: pop all nodes from a stack, in
+ * push order.
+ *
+ * Calls __cds_wfs_pop_all_reverse_blocking with an internal pop mutex
+ * held.
+ */
+static inline
+struct cds_wfs_head *
+_cds_wfs_pop_all_reverse_blocking(struct cds_wfs_stack *s)
+{
+	struct cds_wfs_head *rethead;
+
+	_cds_wfs_pop_lock(s);
+	rethead = ___cds_wfs_pop_all_reverse_blocking(s);
+	_cds_wfs_pop_unlock(s);
+	return rethead;
+}
+
 /*
  * cds_wfs_first: get first node of a popped stack.
  *
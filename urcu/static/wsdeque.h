@@ -0,0 +1,186 @@
+#ifndef _URCU_WSDEQUE_STATIC_H
+#define _URCU_WSDEQUE_STATIC_H
+
+/*
+ * wsdeque-static.h
+ *
+ * Userspace RCU library - Work-Stealing Deque
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * TO BE INCLUDED ONLY IN LGPL-COMPATIBLE CODE. See wsdeque.h for linking
+ * dynamically with the userspace rcu library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <urcu-call-rcu.h>
+#include <urcu-pointer.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Size of the first buffer. */
+#define CDS_WSDQ_INIT_SIZE	64
+
+/*
+ * The owner stores elements in [top, bottom) of the buffer, bottom
+ * being written only by the owner, and top only advanced by a
+ * successful steal, or by the owner popping the last element. The
+ * store of bottom which removes an element from the bottom, and the load
+ * of top, are ordered by a full barrier on both sides, so the owner and
+ * a thief racing for the last element both see the conflict and settle
+ * it with a compare-and-swap on top.
+ */
+
+static inline
+void _cds_wsdq_init(struct cds_wsdq *q,
+		void wsdq_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)))
+{
+	q->top = 0;
+	q->bottom = 0;
+	q->array = NULL;
+	q->wsdq_call_rcu = wsdq_call_rcu;
+}
+
+static inline
+int _cds_wsdq_destroy(struct cds_wsdq *q)
+{
+	if (q->bottom - q->top > 0)
+		return -EPERM;
+	free(q->array);
+	return 0;
+}
+
+static inline
+bool _cds_wsdq_empty(struct cds_wsdq *q)
+{
+	return CMM_LOAD_SHARED(q->bottom) - CMM_LOAD_SHARED(q->top) <= 0;
+}
+
+static inline
+void _cds_wsdq_free_array_cb(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct cds_wsdq_array, head));
+}
+
+/*
+ * Replace the buffer by one twice as large holding the same elements.
+ * Called by the owner.
+ */
+static inline
+struct cds_wsdq_array *_cds_wsdq_grow(struct cds_wsdq *q,
+		struct cds_wsdq_array *old, long top, long bottom)
+{
+	struct cds_wsdq_array *array;
+	unsigned long size = old ? (old->mask + 1) << 1 : CDS_WSDQ_INIT_SIZE;
+	long i;
+
+	array = malloc(sizeof(*array) + size * sizeof(array->buf[0]));
+	if (!array)
+		return NULL;
+	array->mask = size - 1;
+	for (i = top; i < bottom; i++)
+		array->buf[i & array->mask] = old->buf[i & old->mask];
+	/* Thieves reading the old buffer still find [top, bottom) in it. */
+	rcu_assign_pointer(q->array, array);
+	if (old)
+		q->wsdq_call_rcu(&old->head, _cds_wsdq_free_array_cb);
+	return array;
+}
+
+static inline
+int _cds_wsdq_push(struct cds_wsdq *q, void *elem)
+{
+	struct cds_wsdq_array *array = q->array;
+	long bottom = q->bottom, top = CMM_LOAD_SHARED(q->top);
+
+	if (caa_unlikely(!array
+			|| bottom - top > (long) array->mask)) {
+		array = _cds_wsdq_grow(q, array, top, bottom);
+		if (!array)
+			return -ENOMEM;
+	}
+	CMM_STORE_SHARED(array->buf[bottom & array->mask], elem);
+	/* Store the element before publishing it to thieves. */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(q->bottom, bottom + 1);
+	return 0;
+}
+
+static inline
+void *_cds_wsdq_pop(struct cds_wsdq *q)
+{
+	struct cds_wsdq_array *array = q->array;
+	long bottom = q->bottom - 1, top;
+	void *elem;
+
+	CMM_STORE_SHARED(q->bottom, bottom);
+	/* Take the element before checking for thieves. */
+	cmm_smp_mb();
+	top = CMM_LOAD_SHARED(q->top);
+	if (bottom - top < 0) {
+		/* Empty. */
+		CMM_STORE_SHARED(q->bottom, bottom + 1);
+		return NULL;
+	}
+	elem = CMM_LOAD_SHARED(array->buf[bottom & array->mask]);
+	if (bottom != top)
+		return elem;
+	/* Last element: race with thieves. */
+	if (uatomic_cmpxchg(&q->top, top, top + 1) != top)
+		elem = NULL;
+	CMM_STORE_SHARED(q->bottom, bottom + 1);
+	return elem;
+}
+
+static inline
+void *_cds_wsdq_steal(struct cds_wsdq *q)
+{
+	struct cds_wsdq_array *array;
+	long top, bottom;
+	void *elem;
+
+	for (;;) {
+		top = CMM_LOAD_SHARED(q->top);
+		/* Load top before bottom. Pairs with the barrier of pop. */
+		cmm_smp_mb();
+		bottom = CMM_LOAD_SHARED(q->bottom);
+		if (bottom - top <= 0)
+			return NULL;
+		/* Load bottom before the buffer holding its elements. */
+		cmm_smp_rmb();
+		array = rcu_dereference(q->array);
+		elem = CMM_LOAD_SHARED(array->buf[top & array->mask]);
+		if (uatomic_cmpxchg(&q->top, top, top + 1) == top)
+			return elem;
+		/* Lost the race with another thief or the owner. */
+		caa_cpu_relax();
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_WSDEQUE_STATIC_H */
@@ -64,11 +64,21 @@ extern "C" {
  * handlers setup with with sigaltstack(2).
  */
 
+/*
+ * With --enable-tls-initial-exec, TLS variables are accessed at a
+ * fixed offset from the thread pointer, even from shared libraries.
+ */
+# ifdef CONFIG_RCU_TLS_INITIAL_EXEC
+#  define URCU_TLS_MODEL	__attribute__((tls_model("initial-exec")))
+# else
+#  define URCU_TLS_MODEL
+# endif
+
 # define DECLARE_URCU_TLS(type, name)	\
-	CONFIG_RCU_TLS type name
+	CONFIG_RCU_TLS type name URCU_TLS_MODEL
 
 # define DEFINE_URCU_TLS(type, name)	\
-	CONFIG_RCU_TLS type name
+	CONFIG_RCU_TLS type name URCU_TLS_MODEL
 
 # define URCU_TLS(name)		(name)
 
@@ -76,6 +86,11 @@ extern "C" {
 
 /*
  * The *_1() macros ensure macro parameters are expanded.
+ *
+ * The accessor always returns the same address within a thread, and
+ * is declared const, like __errno_location(): the compiler calls it
+ * once per function rather than for each URCU_TLS() of the read-side
+ * fast paths, keeping the TLS block pointer in a register.
  */
 
 # include <pthread.h>
@@ -87,7 +102,7 @@ struct urcu_tls {
 };
 
 # define DECLARE_URCU_TLS_1(type, name)				\
-	type *__tls_access_ ## name(void)
+	__attribute__((const)) type *__tls_access_ ## name(void)
 # define DECLARE_URCU_TLS(type, name)				\
 	DECLARE_URCU_TLS_1(type, name)
 
@@ -96,7 +111,7 @@ struct urcu_tls {
  * with by the OS.
  */
 # define DEFINE_URCU_TLS_1(type, name)				\
-	type *__tls_access_ ## name(void)			\
+	__attribute__((const)) type *__tls_access_ ## name(void) \
 	{							\
 		static struct urcu_tls __tls_ ## name = {	\
 			.init_mutex = PTHREAD_MUTEX_INITIALIZER,\
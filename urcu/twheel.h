@@ -0,0 +1,165 @@
+#ifndef _URCU_TWHEEL_H
+#define _URCU_TWHEEL_H
+
+/*
+ * urcu/twheel.h
+ *
+ * Userspace RCU library - Hierarchical timer wheel
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu/list.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Timer wheel for the expiry of intrusive nodes, such as the entries of
+ * a cds_lfht with a time to live. Time is counted in ticks of a unit
+ * chosen by the caller (e.g. milliseconds), as an unsigned long which
+ * may wrap around.
+ *
+ * The wheel has CDS_TWHEEL_DEPTH levels of CDS_TWHEEL_LVL_SIZE slots,
+ * as the Linux kernel timer wheel: each level has a granularity 8
+ * times coarser than the previous one, and a node is linked into the
+ * slot of the level fitting the delay until its expiry. Nodes are
+ * never moved to a finer level as time passes, so they expire late by
+ * up to 1/8 of their initial delay, and never early. Expiry processing
+ * only visits the slots due, skipping empty slots with a bitmap per
+ * level.
+ *
+ * Additions, cancellations and expiry processing are serialized by a
+ * mutex of the wheel, which the lookups of the indexed nodes never
+ * take. cds_twheel_touch() postpones the expiry of a node without
+ * lock: the node is requeued when its slot is processed, rather than
+ * moved at each access.
+ *
+ * The expire callback is invoked without the wheel mutex held,
+ * typically to remove the node from its hash table and free it with
+ * call_rcu. To free nodes also removed from their table by other
+ * threads, call cds_twheel_advance() within an RCU read-side critical
+ * section, and let the thread whose cds_lfht_del() succeeds call
+ * call_rcu: a callback racing with its removal still sees a valid
+ * node.
+ */
+
+#define CDS_TWHEEL_LVL_CLK_SHIFT	3
+#define CDS_TWHEEL_LVL_BITS		6
+#define CDS_TWHEEL_LVL_SIZE		(1U << CDS_TWHEEL_LVL_BITS)
+#define CDS_TWHEEL_DEPTH		8
+#define CDS_TWHEEL_NR_SLOTS		(CDS_TWHEEL_DEPTH * CDS_TWHEEL_LVL_SIZE)
+
+struct cds_twheel_node {
+	struct cds_list_head list;
+	unsigned long expires;		/* tick, postponed by touch */
+	unsigned int slot;		/* protected by the wheel mutex */
+};
+
+struct cds_twheel {
+	pthread_mutex_t lock;		/* protects the fields below */
+	unsigned long clk;		/* next tick to process */
+	uint64_t pending_map[CDS_TWHEEL_DEPTH];
+	struct cds_list_head expired;	/* due nodes, not yet called back */
+	struct cds_list_head slots[CDS_TWHEEL_NR_SLOTS];
+};
+
+/*
+ * cds_twheel_expire_fct - invoked for each node expired by
+ * cds_twheel_advance(), without the wheel mutex held. The node is no
+ * longer pending: the callback may add it again.
+ */
+typedef void (*cds_twheel_expire_fct)(struct cds_twheel_node *node,
+		void *priv);
+
+/*
+ * cds_twheel_init: initialize an empty wheel, whose next tick to
+ * process is @now.
+ */
+extern void cds_twheel_init(struct cds_twheel *wheel, unsigned long now);
+
+/*
+ * cds_twheel_destroy: destroy the wheel mutex. Nodes still pending are
+ * left as is. The wheel must no longer be used concurrently.
+ */
+extern void cds_twheel_destroy(struct cds_twheel *wheel);
+
+/*
+ * cds_twheel_node_init: initialize a node, not pending.
+ */
+extern void cds_twheel_node_init(struct cds_twheel_node *node);
+
+/*
+ * cds_twheel_pending: return whether the node waits for its expiry.
+ * Only stable with external synchronization.
+ */
+extern bool cds_twheel_pending(struct cds_twheel_node *node);
+
+/*
+ * cds_twheel_add: schedule the node to expire at tick @expires,
+ * moving it if already pending. Takes the wheel mutex. Expiries in the
+ * past expire at the next tick processed.
+ */
+extern void cds_twheel_add(struct cds_twheel *wheel,
+		struct cds_twheel_node *node, unsigned long expires);
+
+/*
+ * cds_twheel_cancel: cancel the expiry of the node. Returns true if it
+ * was pending, false if it was not, or if its expire callback is
+ * already called or about to be. Takes the wheel mutex.
+ */
+extern bool cds_twheel_cancel(struct cds_twheel *wheel,
+		struct cds_twheel_node *node);
+
+/*
+ * cds_twheel_touch: postpone the expiry of a pending node to tick
+ * @expires, without lock. Only later expiries are honored: use
+ * cds_twheel_add() to expire a node earlier. Concurrent touches of the
+ * same node keep the last one stored.
+ */
+static inline
+void cds_twheel_touch(struct cds_twheel_node *node, unsigned long expires)
+{
+	CMM_STORE_SHARED(node->expires, expires);
+}
+
+/*
+ * cds_twheel_advance: process the ticks up to @now included, and invoke
+ * @expire for each node expired. Returns the number of nodes expired.
+ * Takes the wheel mutex, released across each callback. Concurrent
+ * callers share the due nodes.
+ */
+extern unsigned long cds_twheel_advance(struct cds_twheel *wheel,
+		unsigned long now, cds_twheel_expire_fct expire, void *priv);
+
+/*
+ * cds_twheel_next_expiry: get the tick at which cds_twheel_advance()
+ * will expire the first pending node, not accounting for touches.
+ * Returns false if no node is pending. Takes the wheel mutex.
+ */
+extern bool cds_twheel_next_expiry(struct cds_twheel *wheel,
+		unsigned long *next);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_TWHEEL_H */
@@ -31,9 +31,99 @@
 extern "C" {
 #endif 
 
+#ifdef __aarch64__
+
+/*
+ * 64-bit ARM. When compiling for ARMv8.1 or better (e.g. with
+ * -march=armv8.1-a, or -mcpu=neoverse-n1), __ARM_FEATURE_ATOMICS is
+ * defined and the sequentially consistent __atomic builtins are the
+ * LSE instructions ldaddal, swpal and casal. They are fully ordered,
+ * so no barrier is added, except when casal fails: it then performs
+ * no store, and has no release semantic.
+ *
+ * Otherwise, the builtins are either LL/SC loops, or calls to the
+ * outline atomics of the compiler runtime (-moutline-atomics, default
+ * with GCC 10 and better), which pick the LSE instructions at run time
+ * when the HWCAP_ATOMICS hardware capability is set. A full barrier
+ * then follows each operation, as for the __sync builtins.
+ */
+#define UATOMIC_HAS_ATOMIC_BYTE
+#define UATOMIC_HAS_ATOMIC_SHORT
+
+#define _uatomic_arm64_mb()	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#ifdef __ARM_FEATURE_ATOMICS
+#define _uatomic_arm64_fence()	cmm_barrier()
+#else
+#define _uatomic_arm64_fence()	_uatomic_arm64_mb()
+#endif
+
+#define uatomic_xchg(addr, v)						\
+	__extension__ ({						\
+		__typeof__(*(addr)) _______old;				\
+		_______old = __atomic_exchange_n(addr,			\
+				(__typeof__(*(addr))) (v),		\
+				__ATOMIC_SEQ_CST);			\
+		_uatomic_arm64_fence();					\
+		_______old;						\
+	})
+
+#define uatomic_cmpxchg(addr, old, _new)				\
+	__extension__ ({						\
+		__typeof__(*(addr)) _______old =			\
+			(__typeof__(*(addr))) (old);			\
+		if (__atomic_compare_exchange_n(addr, &_______old,	\
+				(__typeof__(*(addr))) (_new), 0,	\
+				__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))	\
+			_uatomic_arm64_fence();				\
+		else							\
+			_uatomic_arm64_mb();				\
+		_______old;						\
+	})
+
+#define uatomic_add_return(addr, v)					\
+	__extension__ ({						\
+		__typeof__(*(addr)) _______ret;				\
+		_______ret = __atomic_add_fetch(addr, v,		\
+				__ATOMIC_SEQ_CST);			\
+		_uatomic_arm64_fence();					\
+		_______ret;						\
+	})
+
+/*
+ * Operations which do not imply memory barriers are relaxed (stadd,
+ * stclr and stset with LSE), and the explicit barriers are dmb ish.
+ */
+#define uatomic_and(addr, mask)						\
+	((void) __atomic_and_fetch(addr, mask, __ATOMIC_RELAXED))
+#define cmm_smp_mb__before_uatomic_and()	_uatomic_arm64_mb()
+#define cmm_smp_mb__after_uatomic_and()		_uatomic_arm64_mb()
+
+#define uatomic_or(addr, mask)						\
+	((void) __atomic_or_fetch(addr, mask, __ATOMIC_RELAXED))
+#define cmm_smp_mb__before_uatomic_or()		_uatomic_arm64_mb()
+#define cmm_smp_mb__after_uatomic_or()		_uatomic_arm64_mb()
+
+#define uatomic_add(addr, v)						\
+	((void) __atomic_add_fetch(addr, v, __ATOMIC_RELAXED))
+#define cmm_smp_mb__before_uatomic_add()	_uatomic_arm64_mb()
+#define cmm_smp_mb__after_uatomic_add()		_uatomic_arm64_mb()
+
+#define uatomic_inc(addr)		uatomic_add((addr), 1)
+#define cmm_smp_mb__before_uatomic_inc()	cmm_smp_mb__before_uatomic_add()
+#define cmm_smp_mb__after_uatomic_inc()		cmm_smp_mb__after_uatomic_add()
+
+#define uatomic_dec(addr)		uatomic_add((addr), -1)
+#define cmm_smp_mb__before_uatomic_dec()	cmm_smp_mb__before_uatomic_add()
+#define cmm_smp_mb__after_uatomic_dec()		cmm_smp_mb__after_uatomic_add()
+
+#else /* #ifdef __aarch64__ */
+
 /* xchg */
 #define uatomic_xchg(addr, v) __sync_lock_test_and_set(addr, v)
 
+#endif /* #else #ifdef __aarch64__ */
+
 #ifdef __cplusplus 
 }
 #endif
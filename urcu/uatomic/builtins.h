@@ -0,0 +1,115 @@
+#ifndef _URCU_UATOMIC_BUILTINS_H
+#define _URCU_UATOMIC_BUILTINS_H
+
+/*
+ * urcu/uatomic/builtins.h
+ *
+ * Atomic operations implemented with the compiler __atomic builtins,
+ * selected with the --enable-compiler-atomic-builtins configure option.
+ *
+ * Copyright (c) 2009      Mathieu Desnoyers
+ *
+ * THIS MATERIAL IS PROVIDED AS IS, WITH ABSOLUTELY NO WARRANTY EXPRESSED
+ * OR IMPLIED.  ANY USE IS AT YOUR OWN RISK.
+ *
+ * Permission is hereby granted to use or copy this program
+ * for any purpose,  provided the above notices are retained on all copies.
+ * Permission to modify the code and to distribute modified code is granted,
+ * provided the above notices are retained, and a notice that the code was
+ * modified is included with the above copyright notice.
+ */
+
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UATOMIC_HAS_ATOMIC_BYTE
+#define UATOMIC_HAS_ATOMIC_SHORT
+
+/*
+ * The operations documented as implying a full memory barrier are
+ * sequentially consistent read-modify-write operations followed by a
+ * full fence, the same sequence the compiler emits for the legacy
+ * __sync builtins: a seq_cst operation alone does not order later
+ * relaxed and non-atomic accesses on weakly ordered architectures.
+ * Locked instructions already are full barriers on x86.
+ */
+#if defined(__i386__) || defined(__x86_64__)
+#define _uatomic_full_fence()	cmm_barrier()
+#else
+#define _uatomic_full_fence()	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+#define uatomic_set(addr, v)						\
+	__atomic_store_n(addr, v, __ATOMIC_RELAXED)
+
+#define uatomic_read(addr)						\
+	__atomic_load_n(addr, __ATOMIC_RELAXED)
+
+#define uatomic_cmpxchg(addr, old, _new)				\
+	__extension__ ({						\
+		__typeof__(*(addr)) _______old =			\
+			(__typeof__(*(addr))) (old);			\
+		(void) __atomic_compare_exchange_n(addr, &_______old,	\
+			(__typeof__(*(addr))) (_new), 0,		\
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);		\
+		_uatomic_full_fence();					\
+		_______old;						\
+	})
+
+#define uatomic_xchg(addr, v)						\
+	__extension__ ({						\
+		__typeof__(*(addr)) _______old;				\
+		_______old = __atomic_exchange_n(addr,			\
+				(__typeof__(*(addr))) (v),		\
+				__ATOMIC_SEQ_CST);			\
+		_uatomic_full_fence();					\
+		_______old;						\
+	})
+
+#define uatomic_add_return(addr, v)					\
+	__extension__ ({						\
+		__typeof__(*(addr)) _______ret;				\
+		_______ret = __atomic_add_fetch(addr, v,		\
+				__ATOMIC_SEQ_CST);			\
+		_uatomic_full_fence();					\
+		_______ret;						\
+	})
+
+/*
+ * Operations which do not imply memory barriers are relaxed, and the
+ * explicit barriers are full fences (compiler barriers on x86).
+ */
+#define uatomic_and(addr, mask)						\
+	((void) __atomic_and_fetch(addr, mask, __ATOMIC_RELAXED))
+#define cmm_smp_mb__before_uatomic_and()	_uatomic_full_fence()
+#define cmm_smp_mb__after_uatomic_and()		_uatomic_full_fence()
+
+#define uatomic_or(addr, mask)						\
+	((void) __atomic_or_fetch(addr, mask, __ATOMIC_RELAXED))
+#define cmm_smp_mb__before_uatomic_or()		_uatomic_full_fence()
+#define cmm_smp_mb__after_uatomic_or()		_uatomic_full_fence()
+
+#define uatomic_add(addr, v)						\
+	((void) __atomic_add_fetch(addr, v, __ATOMIC_RELAXED))
+#define cmm_smp_mb__before_uatomic_add()	_uatomic_full_fence()
+#define cmm_smp_mb__after_uatomic_add()		_uatomic_full_fence()
+
+#define uatomic_inc(addr)		uatomic_add((addr), 1)
+#define cmm_smp_mb__before_uatomic_inc()	cmm_smp_mb__before_uatomic_add()
+#define cmm_smp_mb__after_uatomic_inc()		cmm_smp_mb__after_uatomic_add()
+
+#define uatomic_dec(addr)		uatomic_add((addr), -1)
+#define cmm_smp_mb__before_uatomic_dec()	cmm_smp_mb__before_uatomic_add()
+#define cmm_smp_mb__after_uatomic_dec()		cmm_smp_mb__after_uatomic_add()
+
+#ifdef __cplusplus
+}
+#endif
+
+#include <urcu/uatomic/generic.h>
+
+#endif /* _URCU_UATOMIC_BUILTINS_H */
@@ -55,6 +55,49 @@ void _uatomic_link_error(void)
 extern void _uatomic_link_error(void);
 #endif /* #else #if !defined __OPTIMIZE__  || defined UATOMIC_NO_LINK_ERROR */
 
+/*
+ * uatomic_cmpxchg_double: compare-and-swap two adjacent unsigned longs
+ * as a single atomic operation. "addr" points to an array of two
+ * unsigned longs aligned on 2 * sizeof(unsigned long). Returns non-zero
+ * if both words matched old0/old1 and were replaced by new0/new1.
+ * Implies a full memory barrier. UATOMIC_HAS_CMPXCHG_DOUBLE is defined
+ * when the architecture provides it.
+ */
+#ifndef uatomic_cmpxchg_double
+#if ((CAA_BITS_PER_LONG == 64) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)) \
+	|| ((CAA_BITS_PER_LONG == 32) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8))
+#define UATOMIC_HAS_CMPXCHG_DOUBLE
+
+#if (CAA_BITS_PER_LONG == 64)
+typedef unsigned __int128 __uatomic_double_t;
+#else
+typedef unsigned long long __uatomic_double_t;
+#endif
+
+static inline __attribute__((always_inline))
+int _uatomic_cmpxchg_double(void *addr, unsigned long old0,
+		unsigned long old1, unsigned long new0, unsigned long new1)
+{
+	union {
+		unsigned long v[2];
+		__uatomic_double_t d;
+	} old, _new;
+
+	old.v[0] = old0;
+	old.v[1] = old1;
+	_new.v[0] = new0;
+	_new.v[1] = new1;
+	return __sync_bool_compare_and_swap((__uatomic_double_t *) addr,
+			old.d, _new.d);
+}
+
+#define uatomic_cmpxchg_double(addr, old0, old1, new0, new1)		      \
+	_uatomic_cmpxchg_double((addr),					      \
+				(unsigned long) (old0), (unsigned long) (old1), \
+				(unsigned long) (new0), (unsigned long) (new1))
+#endif
+#endif /* #ifndef uatomic_cmpxchg_double */
+
 /* cmpxchg */
 
 #ifndef uatomic_cmpxchg
@@ -597,6 +640,166 @@ unsigned long _uatomic_exchange(void *addr, unsigned long val, int len)
 #define cmm_smp_mb__after_uatomic_dec()		cmm_smp_mb__after_uatomic_add()
 #endif
 
+
+/*
+ * Memory-order variants of the atomic operations.
+ *
+ * uatomic_load(), uatomic_store() and the *_mo() operations take the
+ * memory ordering of the access as last argument, with the semantic of
+ * the C11 memory orders. They are meant for algorithms needing only
+ * one-sided ordering, where the fully ordered operations and the
+ * cmm_smp_mb__before/after_uatomic_*() barriers are stronger than
+ * required (e.g. two "dmb" around an exchange on ARM). CMM_SEQ_CST_FENCE
+ * maps to the fully ordered operation: it implies a full memory
+ * barrier before and after the operation, also with respect to
+ * non-atomic and relaxed accesses, like uatomic_xchg() does.
+ *
+ * The memory order should be a constant. When the compiler lacks the
+ * __atomic builtins, all variants use the fully ordered operations.
+ */
+#ifdef __ATOMIC_RELAXED
+
+enum cmm_memorder {
+	CMM_RELAXED = __ATOMIC_RELAXED,
+	CMM_CONSUME = __ATOMIC_CONSUME,
+	CMM_ACQUIRE = __ATOMIC_ACQUIRE,
+	CMM_RELEASE = __ATOMIC_RELEASE,
+	CMM_ACQ_REL = __ATOMIC_ACQ_REL,
+	CMM_SEQ_CST = __ATOMIC_SEQ_CST,
+	CMM_SEQ_CST_FENCE = __ATOMIC_SEQ_CST + 1,
+};
+
+#define _cmm_atomic_mo(mo)					\
+	((mo) == CMM_SEQ_CST_FENCE ? __ATOMIC_SEQ_CST : (int) (mo))
+
+#define uatomic_load(addr, mo)						\
+	((mo) == CMM_SEQ_CST_FENCE ?					\
+		__extension__ ({					\
+			__typeof__(*(addr)) _______v;			\
+			cmm_smp_mb();					\
+			_______v = __atomic_load_n(addr, __ATOMIC_SEQ_CST); \
+			cmm_smp_mb();					\
+			_______v;					\
+		}) :							\
+		__atomic_load_n(addr, _cmm_atomic_mo(mo)))
+
+#define uatomic_store(addr, v, mo)					\
+	((mo) == CMM_SEQ_CST_FENCE ?					\
+		__extension__ ({					\
+			cmm_smp_mb();					\
+			__atomic_store_n(addr, v, __ATOMIC_SEQ_CST);	\
+			cmm_smp_mb();					\
+		}) :							\
+		__atomic_store_n(addr, v, _cmm_atomic_mo(mo)))
+
+#define uatomic_xchg_mo(addr, v, mo)					\
+	((mo) == CMM_SEQ_CST_FENCE ?					\
+		uatomic_xchg(addr, v) :					\
+		__atomic_exchange_n(addr, v, _cmm_atomic_mo(mo)))
+
+/*
+ * mof is the memory order when the comparison fails: it can neither
+ * be CMM_RELEASE nor CMM_ACQ_REL, nor be stronger than mos.
+ */
+#define uatomic_cmpxchg_mo(addr, old, _new, mos, mof)			\
+	((mos) == CMM_SEQ_CST_FENCE ?					\
+		uatomic_cmpxchg(addr, old, _new) :			\
+		__extension__ ({					\
+			__typeof__(*(addr)) _______old =		\
+				(__typeof__(*(addr))) (old);		\
+			(void) __atomic_compare_exchange_n(addr,	\
+				&_______old,				\
+				(__typeof__(*(addr))) (_new), 0,	\
+				_cmm_atomic_mo(mos),			\
+				_cmm_atomic_mo(mof));			\
+			_______old;					\
+		}))
+
+#define uatomic_add_return_mo(addr, v, mo)				\
+	((mo) == CMM_SEQ_CST_FENCE ?					\
+		uatomic_add_return(addr, v) :				\
+		__atomic_add_fetch(addr, v, _cmm_atomic_mo(mo)))
+
+#define uatomic_and_mo(addr, mask, mo)					\
+	((mo) == CMM_SEQ_CST_FENCE ?					\
+		__extension__ ({					\
+			cmm_smp_mb__before_uatomic_and();		\
+			uatomic_and(addr, mask);			\
+			cmm_smp_mb__after_uatomic_and();		\
+		}) :							\
+		(void) __atomic_and_fetch(addr, mask, _cmm_atomic_mo(mo)))
+
+#define uatomic_or_mo(addr, mask, mo)					\
+	((mo) == CMM_SEQ_CST_FENCE ?					\
+		__extension__ ({					\
+			cmm_smp_mb__before_uatomic_or();		\
+			uatomic_or(addr, mask);				\
+			cmm_smp_mb__after_uatomic_or();			\
+		}) :							\
+		(void) __atomic_or_fetch(addr, mask, _cmm_atomic_mo(mo)))
+
+#else /* #ifdef __ATOMIC_RELAXED */
+
+enum cmm_memorder {
+	CMM_RELAXED,
+	CMM_CONSUME,
+	CMM_ACQUIRE,
+	CMM_RELEASE,
+	CMM_ACQ_REL,
+	CMM_SEQ_CST,
+	CMM_SEQ_CST_FENCE,
+};
+
+#define uatomic_load(addr, mo)						\
+	__extension__ ({						\
+		__typeof__(*(addr)) _______v;				\
+		if ((mo) != CMM_RELAXED)				\
+			cmm_smp_mb();					\
+		_______v = uatomic_read(addr);				\
+		if ((mo) != CMM_RELAXED)				\
+			cmm_smp_mb();					\
+		_______v;						\
+	})
+
+#define uatomic_store(addr, v, mo)					\
+	do {								\
+		if ((mo) != CMM_RELAXED)				\
+			cmm_smp_mb();					\
+		uatomic_set(addr, v);					\
+		if ((mo) != CMM_RELAXED)				\
+			cmm_smp_mb();					\
+	} while (0)
+
+#define uatomic_xchg_mo(addr, v, mo)	uatomic_xchg(addr, v)
+#define uatomic_cmpxchg_mo(addr, old, _new, mos, mof)			\
+	uatomic_cmpxchg(addr, old, _new)
+#define uatomic_add_return_mo(addr, v, mo)	uatomic_add_return(addr, v)
+
+#define uatomic_and_mo(addr, mask, mo)					\
+	do {								\
+		cmm_smp_mb__before_uatomic_and();			\
+		uatomic_and(addr, mask);				\
+		cmm_smp_mb__after_uatomic_and();			\
+	} while (0)
+
+#define uatomic_or_mo(addr, mask, mo)					\
+	do {								\
+		cmm_smp_mb__before_uatomic_or();			\
+		uatomic_or(addr, mask);					\
+		cmm_smp_mb__after_uatomic_or();				\
+	} while (0)
+
+#endif /* #else #ifdef __ATOMIC_RELAXED */
+
+#define uatomic_add_mo(addr, v, mo)					\
+	((void) uatomic_add_return_mo(addr, v, mo))
+#define uatomic_sub_return_mo(addr, v, mo)				\
+	uatomic_add_return_mo(addr, -(caa_cast_long_keep_sign(v)), mo)
+#define uatomic_sub_mo(addr, v, mo)					\
+	uatomic_add_mo(addr, -(caa_cast_long_keep_sign(v)), mo)
+#define uatomic_inc_mo(addr, mo)	uatomic_add_mo(addr, 1, mo)
+#define uatomic_dec_mo(addr, mo)	uatomic_add_mo(addr, -1, mo)
+
 #ifdef __cplusplus
 }
 #endif
@@ -109,6 +109,41 @@ unsigned long __uatomic_cmpxchg(void *addr, unsigned long old,
 						caa_cast_long_keep_sign(_new),\
 						sizeof(*(addr))))
 
+/* cmpxchg_double: not available on i386 compat (pre-Pentium). */
+
+#if ((CAA_BITS_PER_LONG == 64) || !defined(CONFIG_RCU_COMPAT_ARCH))
+#define UATOMIC_HAS_CMPXCHG_DOUBLE
+
+struct __uatomic_double_dummy {
+	unsigned long v[2];
+};
+
+static inline __attribute__((always_inline))
+int _uatomic_cmpxchg_double(void *addr, unsigned long old0,
+		unsigned long old1, unsigned long new0, unsigned long new1)
+{
+	unsigned char ret;
+
+	__asm__ __volatile__(
+#if (CAA_BITS_PER_LONG == 64)
+	"lock; cmpxchg16b %1\n\t"
+#else
+	"lock; cmpxchg8b %1\n\t"
+#endif
+	"sete %0"
+		: "=q"(ret), "+m"(*(struct __uatomic_double_dummy *) addr),
+		  "+a"(old0), "+d"(old1)
+		: "b"(new0), "c"(new1)
+		: "memory");
+	return ret;
+}
+
+#define uatomic_cmpxchg_double(addr, old0, old1, new0, new1)		      \
+	_uatomic_cmpxchg_double((addr),					      \
+				(unsigned long) (old0), (unsigned long) (old1), \
+				(unsigned long) (new0), (unsigned long) (new1))
+#endif
+
 /* xchg */
 
 static inline __attribute__((always_inline))
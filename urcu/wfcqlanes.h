@@ -0,0 +1,142 @@
+#ifndef _URCU_WFCQLANES_H
+#define _URCU_WFCQLANES_H
+
+/*
+ * urcu/wfcqlanes.h
+ *
+ * Userspace RCU library - Sharded concurrent queue with per-CPU lanes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdbool.h>
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
+#include <urcu/wfcqueue.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Queue made of several wait-free concurrent queues (lanes), for many
+ * producers. Producers enqueue onto the lane of the CPU they run on,
+ * so concurrent enqueues from different CPUs do not exchange the same
+ * tail pointer. Consumers dequeue from the lane of their CPU, and
+ * steal from the other lanes, in turn, when it is empty.
+ *
+ * There is no global FIFO order: nodes enqueued on a lane are
+ * dequeued in order, but nodes of different lanes are dequeued in any
+ * order. A producer migrated to another CPU enqueues onto another
+ * lane, so even the order of the nodes of a single producer is only
+ * kept while it runs on the same CPU.
+ *
+ * The dequeue and splice operations take the dequeue lock of each
+ * lane they access, so they need no external synchronization. This
+ * queue does _not_ specifically rely on RCU.
+ */
+
+struct cds_wfcq_lane {
+	struct cds_wfcq_head head;
+	struct cds_wfcq_tail tail __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+struct cds_wfcq_lanes {
+	struct cds_wfcq_lane *lane;
+	unsigned long nr_lanes;		/* power of 2 */
+};
+
+/*
+ * cds_wfcq_lanes_init: initialize an empty queue.
+ * @nr_lanes: number of lanes, rounded up to a power of 2. 0 for one
+ *            lane per possible CPU.
+ *
+ * Returns 0 on success, -ENOMEM on allocation error.
+ */
+extern int cds_wfcq_lanes_init(struct cds_wfcq_lanes *q,
+		unsigned long nr_lanes);
+
+/*
+ * cds_wfcq_lanes_destroy: free the lanes. The queue must be empty, and
+ * no longer used concurrently.
+ */
+extern void cds_wfcq_lanes_destroy(struct cds_wfcq_lanes *q);
+
+/*
+ * cds_wfcq_lanes_current: index of the lane of the current CPU.
+ */
+extern unsigned long cds_wfcq_lanes_current(struct cds_wfcq_lanes *q);
+
+/*
+ * cds_wfcq_lanes_empty: return whether all lanes are empty.
+ *
+ * No memory barrier is issued. No mutual exclusion is required.
+ */
+extern bool cds_wfcq_lanes_empty(struct cds_wfcq_lanes *q);
+
+/*
+ * cds_wfcq_lanes_enqueue: enqueue a node onto the lane of the current
+ * CPU.
+ *
+ * Same ordering as cds_wfcq_enqueue() (release semantic). No mutual
+ * exclusion is required. Returns false if the lane was empty prior to
+ * adding the node, true otherwise.
+ */
+extern bool cds_wfcq_lanes_enqueue(struct cds_wfcq_lanes *q,
+		struct cds_wfcq_node *node);
+
+/*
+ * cds_wfcq_lanes_enqueue_chain: enqueue a chain of nodes onto the lane
+ * of the current CPU, with a single exchange, and reinitialize the
+ * chain. Returns as cds_wfcq_lanes_enqueue().
+ */
+extern bool cds_wfcq_lanes_enqueue_chain(struct cds_wfcq_lanes *q,
+		struct cds_wfcq_chain *chain);
+
+/*
+ * cds_wfcq_lanes_dequeue_blocking: dequeue a node from the lane of the
+ * current CPU or, if it is empty, from the next non-empty lane.
+ *
+ * Returns NULL if all lanes were found empty. Lanes emptied by a
+ * concurrent dequeue while the others are scanned may make it return
+ * NULL although nodes were enqueued meanwhile. Takes the dequeue lock
+ * of the lanes it dequeues from. May block while an enqueue on a lane
+ * completes.
+ */
+extern struct cds_wfcq_node *cds_wfcq_lanes_dequeue_blocking(
+		struct cds_wfcq_lanes *q);
+
+/*
+ * cds_wfcq_lanes_splice_blocking: move the nodes of all lanes to the
+ * destination queue, appending the lanes in turn. The order of the
+ * nodes of each lane is kept.
+ *
+ * Returns CDS_WFCQ_RET_SRC_EMPTY if all lanes were empty,
+ * CDS_WFCQ_RET_DEST_EMPTY if the destination queue was empty before
+ * the first lane was appended, CDS_WFCQ_RET_DEST_NON_EMPTY otherwise.
+ * Takes the dequeue lock of each lane. The destination queue needs the
+ * same mutual exclusion as for the destination of
+ * cds_wfcq_splice_blocking().
+ */
+extern enum cds_wfcq_ret cds_wfcq_lanes_splice_blocking(
+		cds_wfcq_head_ptr_t dest_q_head,
+		struct cds_wfcq_tail *dest_q_tail,
+		struct cds_wfcq_lanes *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_WFCQLANES_H */
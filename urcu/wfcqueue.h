@@ -27,6 +27,7 @@
 #include <pthread.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <urcu/compiler.h>
 #include <urcu/arch.h>
 
@@ -77,17 +78,49 @@ struct cds_wfcq_head {
 /*
  * The transparent union allows calling functions that work on both
  * struct cds_wfcq_head and struct __cds_wfcq_head on any of those two
- * types.
+ * types. C++ has no transparent unions: converting constructors give
+ * the same implicit conversions, and the union is still passed as a
+ * pointer.
  */
+#ifndef __cplusplus
 typedef union __attribute__((__transparent_union__)) {
 	struct __cds_wfcq_head *_h;
 	struct cds_wfcq_head *h;
 } cds_wfcq_head_ptr_t;
+#else
+typedef union cds_wfcq_head_ptr {
+	struct __cds_wfcq_head *_h;
+	struct cds_wfcq_head *h;
+
+	cds_wfcq_head_ptr(struct __cds_wfcq_head *head) : _h(head) {}
+	cds_wfcq_head_ptr(struct cds_wfcq_head *head) : h(head) {}
+} cds_wfcq_head_ptr_t;
+#endif
 
 struct cds_wfcq_tail {
 	struct cds_wfcq_node *p;
 };
 
+/*
+ * Local chain of nodes, built privately by a producer and enqueued as
+ * a whole with cds_wfcq_enqueue_chain().
+ */
+struct cds_wfcq_chain {
+	struct cds_wfcq_node *first;
+	struct cds_wfcq_node *last;
+};
+
+/*
+ * Consumer wait state, associated by the user with a queue. Consumers
+ * sleep in cds_wfcq_wait_nonempty() until producers enqueue with the
+ * *_wake() variants, which only issue a FUTEX_WAKE system call when
+ * nr_waiters is non-zero.
+ */
+struct cds_wfcq_wait {
+	int32_t futex;
+	int32_t nr_waiters;
+};
+
 #ifdef _LGPL_SOURCE
 
 #include <urcu/static/wfcqueue.h>
@@ -96,6 +129,17 @@ struct cds_wfcq_tail {
 #define cds_wfcq_init			_cds_wfcq_init
 #define cds_wfcq_empty			_cds_wfcq_empty
 #define cds_wfcq_enqueue		_cds_wfcq_enqueue
+#define cds_wfcq_chain_init		_cds_wfcq_chain_init
+#define cds_wfcq_chain_empty		_cds_wfcq_chain_empty
+#define cds_wfcq_chain_add		_cds_wfcq_chain_add
+#define cds_wfcq_enqueue_chain		_cds_wfcq_enqueue_chain
+
+/* Blocking consumers */
+#define cds_wfcq_wait_init		_cds_wfcq_wait_init
+#define cds_wfcq_wake			_cds_wfcq_wake
+#define cds_wfcq_enqueue_wake		_cds_wfcq_enqueue_wake
+#define cds_wfcq_enqueue_chain_wake	_cds_wfcq_enqueue_chain_wake
+#define cds_wfcq_wait_nonempty		_cds_wfcq_wait_nonempty
 
 /* Dequeue locking */
 #define cds_wfcq_dequeue_lock		_cds_wfcq_dequeue_lock
@@ -105,6 +149,7 @@ struct cds_wfcq_tail {
 #define cds_wfcq_dequeue_blocking	_cds_wfcq_dequeue_blocking
 #define cds_wfcq_dequeue_with_state_blocking	\
 					_cds_wfcq_dequeue_with_state_blocking
+#define cds_wfcq_dequeue_bulk_blocking	_cds_wfcq_dequeue_bulk_blocking
 #define cds_wfcq_splice_blocking	_cds_wfcq_splice_blocking
 #define cds_wfcq_first_blocking		_cds_wfcq_first_blocking
 #define cds_wfcq_next_blocking		_cds_wfcq_next_blocking
@@ -113,6 +158,7 @@ struct cds_wfcq_tail {
 #define __cds_wfcq_dequeue_blocking	___cds_wfcq_dequeue_blocking
 #define __cds_wfcq_dequeue_with_state_blocking	\
 					___cds_wfcq_dequeue_with_state_blocking
+#define __cds_wfcq_dequeue_bulk_blocking	___cds_wfcq_dequeue_bulk_blocking
 #define __cds_wfcq_splice_blocking	___cds_wfcq_splice_blocking
 #define __cds_wfcq_first_blocking	___cds_wfcq_first_blocking
 #define __cds_wfcq_next_blocking	___cds_wfcq_next_blocking
@@ -125,6 +171,8 @@ struct cds_wfcq_tail {
 #define __cds_wfcq_dequeue_nonblocking	___cds_wfcq_dequeue_nonblocking
 #define __cds_wfcq_dequeue_with_state_nonblocking	\
 				___cds_wfcq_dequeue_with_state_nonblocking
+#define __cds_wfcq_dequeue_bulk_nonblocking	\
+				___cds_wfcq_dequeue_bulk_nonblocking
 #define __cds_wfcq_splice_nonblocking	___cds_wfcq_splice_nonblocking
 #define __cds_wfcq_first_nonblocking	___cds_wfcq_first_nonblocking
 #define __cds_wfcq_next_nonblocking	___cds_wfcq_next_nonblocking
@@ -141,7 +189,7 @@ struct cds_wfcq_tail {
  * required between pairs marked with "-".
  *
  * Legend:
- * [1] cds_wfcq_enqueue
+ * [1] cds_wfcq_enqueue, cds_wfcq_enqueue_chain
  * [2] __cds_wfcq_splice (destination queue)
  * [3] __cds_wfcq_dequeue
  * [4] __cds_wfcq_splice (source queue)
@@ -206,7 +254,9 @@ extern void cds_wfcq_dequeue_unlock(struct cds_wfcq_head *head,
 /*
  * cds_wfcq_enqueue: enqueue a node into a wait-free queue.
  *
- * Issues a full memory barrier before enqueue. No mutual exclusion is
+ * Memory accesses before the enqueue are ordered before it (release
+ * semantic). This is not a full memory barrier: later loads may be
+ * performed before the enqueue is visible. No mutual exclusion is
  * required.
  *
  * Returns false if the queue was empty prior to adding the node.
@@ -216,6 +266,102 @@ extern bool cds_wfcq_enqueue(cds_wfcq_head_ptr_t head,
 		struct cds_wfcq_tail *tail,
 		struct cds_wfcq_node *node);
 
+/*
+ * cds_wfcq_chain_init: initialize a local chain of nodes.
+ */
+extern void cds_wfcq_chain_init(struct cds_wfcq_chain *chain);
+
+/*
+ * cds_wfcq_chain_empty: return whether a local chain is empty.
+ */
+extern bool cds_wfcq_chain_empty(struct cds_wfcq_chain *chain);
+
+/*
+ * cds_wfcq_chain_add: append a node at the end of a local chain.
+ *
+ * The chain is private to the caller: no atomic operation nor memory
+ * barrier is issued. The node next pointer is reset.
+ */
+extern void cds_wfcq_chain_add(struct cds_wfcq_chain *chain,
+		struct cds_wfcq_node *node);
+
+/*
+ * cds_wfcq_enqueue_chain: enqueue all nodes of a local chain into a
+ * wait-free queue with a single exchange on the queue tail.
+ *
+ * Same memory ordering as cds_wfcq_enqueue(). No mutual exclusion is
+ * required. The chain is re-initialized and can be reused by the
+ * caller. Nodes of the chain appear in the queue in the order they
+ * were added to the chain, and are never interleaved with nodes
+ * enqueued concurrently by other threads.
+ *
+ * Returns false if the queue was empty prior to adding the nodes.
+ * Returns true otherwise. Enqueuing an empty chain does not modify the
+ * queue and returns whether the queue is non-empty.
+ */
+extern bool cds_wfcq_enqueue_chain(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_chain *chain);
+
+/*
+ * cds_wfcq_wait_init: initialize the consumer wait state of a queue.
+ */
+extern void cds_wfcq_wait_init(struct cds_wfcq_wait *wait);
+
+/*
+ * cds_wfcq_wake: wake up consumers waiting for the queue to become
+ * non-empty.
+ *
+ * Meant to be called after nodes were added to the queue by other
+ * means than cds_wfcq_enqueue_wake() or cds_wfcq_enqueue_chain_wake(),
+ * e.g. by splicing into it. Issues a full memory barrier. Only issues
+ * a FUTEX_WAKE system call if a consumer is waiting.
+ */
+extern void cds_wfcq_wake(struct cds_wfcq_wait *wait);
+
+/*
+ * cds_wfcq_enqueue_wake: enqueue a node into a wait-free queue and wake
+ * up consumers waiting in cds_wfcq_wait_nonempty().
+ *
+ * Same semantic as cds_wfcq_enqueue(), but issues a full memory barrier
+ * before and after the enqueue. The FUTEX_WAKE system call is only
+ * issued when a consumer is actually waiting. Not signal-safe.
+ */
+extern bool cds_wfcq_enqueue_wake(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_node *node,
+		struct cds_wfcq_wait *wait);
+
+/*
+ * cds_wfcq_enqueue_chain_wake: enqueue a local chain of nodes into a
+ * wait-free queue and wake up consumers waiting in
+ * cds_wfcq_wait_nonempty().
+ *
+ * Same semantic as cds_wfcq_enqueue_chain(), but issues a full memory
+ * barrier before and after the enqueue. The FUTEX_WAKE system call is
+ * only issued when a consumer is actually waiting. Not signal-safe.
+ */
+extern bool cds_wfcq_enqueue_chain_wake(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_chain *chain,
+		struct cds_wfcq_wait *wait);
+
+/*
+ * cds_wfcq_wait_nonempty: wait for a wait-free queue to become
+ * non-empty.
+ *
+ * Returns immediately if the queue is non-empty. Otherwise, sleeps on
+ * the wait state futex until a producer using cds_wfcq_enqueue_wake(),
+ * cds_wfcq_enqueue_chain_wake() or cds_wfcq_wake() adds nodes to the
+ * queue. Several consumers may wait concurrently: they are all woken
+ * up. The queue may be found empty again by the time the caller
+ * dequeues, if other consumers took the nodes first. No mutual
+ * exclusion is required.
+ */
+extern void cds_wfcq_wait_nonempty(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_wait *wait);
+
 /*
  * cds_wfcq_dequeue_blocking: dequeue a node from a wait-free queue.
  *
@@ -240,6 +386,20 @@ extern struct cds_wfcq_node *cds_wfcq_dequeue_with_state_blocking(
 		struct cds_wfcq_tail *tail,
 		int *state);
 
+/*
+ * cds_wfcq_dequeue_bulk_blocking: dequeue up to @max nodes.
+ *
+ * Same as __cds_wfcq_dequeue_bulk_blocking, holding the dequeue lock
+ * once for the whole batch.
+ * Mutual exclusion with cds_wfcq_splice_blocking and dequeue lock is
+ * ensured.
+ */
+extern unsigned int cds_wfcq_dequeue_bulk_blocking(
+		struct cds_wfcq_head *head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_node **nodes,
+		unsigned int max);
+
 /*
  * cds_wfcq_splice_blocking: enqueue all src_q nodes at the end of dest_q.
  *
@@ -304,6 +464,37 @@ extern struct cds_wfcq_node *__cds_wfcq_dequeue_with_state_nonblocking(
 		struct cds_wfcq_tail *tail,
 		int *state);
 
+/*
+ * __cds_wfcq_dequeue_bulk_blocking: dequeue up to @max nodes.
+ *
+ * Detach up to @max nodes from the head of the queue and store them in
+ * @nodes, in queue order, moving the queue head a single time. Returns
+ * the number of nodes dequeued, 0 if the queue is empty.
+ * Content written into the nodes before enqueue is guaranteed to be
+ * consistent, but no other memory ordering is ensured.
+ * It is valid to reuse and free the dequeued nodes immediately.
+ * Dequeue/splice/iteration mutual exclusion should be ensured by the
+ * caller.
+ */
+extern unsigned int __cds_wfcq_dequeue_bulk_blocking(
+		cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_node **nodes,
+		unsigned int max);
+
+/*
+ * __cds_wfcq_dequeue_bulk_nonblocking: dequeue up to @max nodes.
+ *
+ * Same as __cds_wfcq_dequeue_bulk_blocking, but stops before a node it
+ * would need to block for. Returns 0 if the queue is empty or if it
+ * would need to block to dequeue the first node.
+ */
+extern unsigned int __cds_wfcq_dequeue_bulk_nonblocking(
+		cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_node **nodes,
+		unsigned int max);
+
 /*
  * __cds_wfcq_splice_blocking: enqueue all src_q nodes at the end of dest_q.
  *
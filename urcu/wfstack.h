@@ -92,6 +92,15 @@ struct cds_wfs_stack {
 	pthread_mutex_t lock;
 };
 
+/*
+ * Local chain of nodes, built privately by a producer and pushed as a
+ * whole with cds_wfs_push_chain().
+ */
+struct cds_wfs_chain {
+	struct cds_wfs_node *top;
+	struct cds_wfs_node *bottom;
+};
+
 /*
  * The transparent union allows calling functions that work on both
  * struct cds_wfs_stack and struct __cds_wfs_stack on any of those two
@@ -110,11 +119,17 @@ typedef union __attribute__((__transparent_union__)) {
 #define cds_wfs_init			_cds_wfs_init
 #define cds_wfs_empty			_cds_wfs_empty
 #define cds_wfs_push			_cds_wfs_push
+#define cds_wfs_chain_init		_cds_wfs_chain_init
+#define cds_wfs_chain_empty		_cds_wfs_chain_empty
+#define cds_wfs_chain_add		_cds_wfs_chain_add
+#define cds_wfs_push_chain		_cds_wfs_push_chain
 
 /* Locking performed internally */
 #define cds_wfs_pop_blocking		_cds_wfs_pop_blocking
 #define cds_wfs_pop_with_state_blocking	_cds_wfs_pop_with_state_blocking
 #define cds_wfs_pop_all_blocking	_cds_wfs_pop_all_blocking
+#define cds_wfs_pop_all_reverse_blocking	\
+					_cds_wfs_pop_all_reverse_blocking
 
 /*
  * For iteration on cds_wfs_head returned by __cds_wfs_pop_all or
@@ -123,6 +138,7 @@ typedef union __attribute__((__transparent_union__)) {
 #define cds_wfs_first			_cds_wfs_first
 #define cds_wfs_next_blocking		_cds_wfs_next_blocking
 #define cds_wfs_next_nonblocking	_cds_wfs_next_nonblocking
+#define cds_wfs_reverse_blocking	_cds_wfs_reverse_blocking
 
 /* Pop locking with internal mutex */
 #define cds_wfs_pop_lock		_cds_wfs_pop_lock
@@ -136,6 +152,8 @@ typedef union __attribute__((__transparent_union__)) {
 #define __cds_wfs_pop_with_state_nonblocking	\
 					___cds_wfs_pop_with_state_nonblocking
 #define __cds_wfs_pop_all		___cds_wfs_pop_all
+#define __cds_wfs_pop_all_reverse_blocking	\
+					___cds_wfs_pop_all_reverse_blocking
 
 #else /* !_LGPL_SOURCE */
 
@@ -172,6 +190,42 @@ extern bool cds_wfs_empty(cds_wfs_stack_ptr_t u_stack);
  */
 extern int cds_wfs_push(cds_wfs_stack_ptr_t u_stack, struct cds_wfs_node *node);
 
+/*
+ * cds_wfs_chain_init: initialize a local chain of nodes.
+ */
+extern void cds_wfs_chain_init(struct cds_wfs_chain *chain);
+
+/*
+ * cds_wfs_chain_empty: return whether a local chain is empty.
+ */
+extern bool cds_wfs_chain_empty(struct cds_wfs_chain *chain);
+
+/*
+ * cds_wfs_chain_add: add a node on top of a local chain.
+ *
+ * The chain is private to the caller: no atomic operation nor memory
+ * barrier is issued. The node next pointer is overwritten.
+ */
+extern void cds_wfs_chain_add(struct cds_wfs_chain *chain,
+		struct cds_wfs_node *node);
+
+/*
+ * cds_wfs_push_chain: push all nodes of a local chain into the stack
+ * with a single exchange on the stack head.
+ *
+ * Same memory ordering as cds_wfs_push(). No mutual exclusion is
+ * required. The stack then looks as if the nodes had been pushed one
+ * by one, in the order they were added to the chain, and they are
+ * never interleaved with nodes pushed concurrently by other threads.
+ * The chain is re-initialized and can be reused by the caller.
+ *
+ * Returns 0 if the stack was empty prior to adding the nodes.
+ * Returns non-zero otherwise. Pushing an empty chain does not modify
+ * the stack and returns whether the stack is non-empty.
+ */
+extern int cds_wfs_push_chain(cds_wfs_stack_ptr_t u_stack,
+		struct cds_wfs_chain *chain);
+
 /*
  * cds_wfs_pop_blocking: pop a node from the stack.
  *
@@ -195,6 +249,16 @@ extern struct cds_wfs_node *
  */
 extern struct cds_wfs_head *cds_wfs_pop_all_blocking(struct cds_wfs_stack *s);
 
+/*
+ * cds_wfs_pop_all_reverse_blocking: pop all nodes from a stack, in
+ * push order.
+ *
+ * Calls __cds_wfs_pop_all_reverse_blocking with an internal pop mutex
+ * held.
+ */
+extern struct cds_wfs_head *
+	cds_wfs_pop_all_reverse_blocking(struct cds_wfs_stack *s);
+
 /*
  * cds_wfs_first: get first node of a popped stack.
  *
@@ -232,6 +296,17 @@ extern struct cds_wfs_node *cds_wfs_next_blocking(struct cds_wfs_node *node);
  */
 extern struct cds_wfs_node *cds_wfs_next_nonblocking(struct cds_wfs_node *node);
 
+/*
+ * cds_wfs_reverse_blocking: reverse a popped stack in place.
+ *
+ * Takes a stack head returned by __cds_wfs_pop_all or
+ * cds_wfs_pop_all_blocking, and returns the head of the same nodes in
+ * push order, the oldest node first. Blocks until the pushes of the
+ * popped nodes are complete. Returns NULL if @head is NULL.
+ */
+extern struct cds_wfs_head *
+	cds_wfs_reverse_blocking(struct cds_wfs_head *head);
+
 /*
  * cds_wfs_pop_lock: lock stack pop-protection mutex.
  */
@@ -306,6 +381,16 @@ extern struct cds_wfs_node *
  */
 extern struct cds_wfs_head *__cds_wfs_pop_all(struct cds_wfs_stack *s);
 
+/*
+ * __cds_wfs_pop_all_reverse_blocking: pop all nodes from a stack, in
+ * push order.
+ *
+ * Same as __cds_wfs_pop_all followed by cds_wfs_reverse_blocking.
+ * Requires the same synchronization as __cds_wfs_pop_all.
+ */
+extern struct cds_wfs_head *
+	__cds_wfs_pop_all_reverse_blocking(struct cds_wfs_stack *s);
+
 #endif /* !_LGPL_SOURCE */
 
 #ifdef __cplusplus
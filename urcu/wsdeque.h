@@ -0,0 +1,108 @@
+#ifndef _URCU_WSDEQUE_H
+#define _URCU_WSDEQUE_H
+
+/*
+ * wsdeque.h
+ *
+ * Userspace RCU library - Work-Stealing Deque
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdbool.h>
+#include <urcu/compiler.h>
+#include <urcu-call-rcu.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Chase-Lev work-stealing deque of non-NULL pointers. A single owner
+ * thread pushes and pops at the bottom, in LIFO order, without atomic
+ * operations (pop only needs a memory barrier). Any number of thieves
+ * steal from the top, in FIFO order, with a compare-and-swap.
+ *
+ * The circular buffer is allocated on the first push, and doubled when
+ * full. Replaced buffers are freed with call_rcu, since thieves may
+ * still read them: steal must be called within a RCU read-side
+ * critical section.
+ */
+struct cds_wsdq_array {
+	unsigned long mask;		/* size - 1 */
+	struct rcu_head head;
+	void *buf[];
+};
+
+struct cds_wsdq {
+	long top __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+	long bottom __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+	struct cds_wsdq_array *array;
+	void (*wsdq_call_rcu)(struct rcu_head *head,
+		void (*func)(struct rcu_head *head));
+};
+
+#ifdef _LGPL_SOURCE
+
+#include <urcu/static/wsdeque.h>
+
+#define cds_wsdq_init		_cds_wsdq_init
+#define cds_wsdq_destroy	_cds_wsdq_destroy
+#define cds_wsdq_empty		_cds_wsdq_empty
+#define cds_wsdq_push		_cds_wsdq_push
+#define cds_wsdq_pop		_cds_wsdq_pop
+#define cds_wsdq_steal		_cds_wsdq_steal
+
+#else /* !_LGPL_SOURCE */
+
+extern void cds_wsdq_init(struct cds_wsdq *q,
+		void wsdq_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)));
+/*
+ * The deque should be emptied before calling destroy, and a grace
+ * period waited for since the last buffer growth.
+ *
+ * Return 0 on success, -EPERM if deque is not empty.
+ */
+extern int cds_wsdq_destroy(struct cds_wsdq *q);
+extern bool cds_wsdq_empty(struct cds_wsdq *q);
+
+/*
+ * Owner only. Return 0 on success, -ENOMEM if the buffer cannot grow.
+ */
+extern int cds_wsdq_push(struct cds_wsdq *q, void *elem);
+
+/*
+ * Owner only. Return the most recently pushed element, or NULL if
+ * empty.
+ */
+extern void *cds_wsdq_pop(struct cds_wsdq *q);
+
+/*
+ * Should be called under rcu read lock critical section.
+ *
+ * Return the least recently pushed element, or NULL if empty.
+ */
+extern void *cds_wsdq_steal(struct cds_wsdq *q);
+
+#endif /* !_LGPL_SOURCE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _URCU_WSDEQUE_H */
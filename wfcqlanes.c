@@ -0,0 +1,163 @@
+/*
+ * wfcqlanes.c
+ *
+ * Userspace RCU library - Sharded concurrent queue with per-CPU lanes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "config.h"
+#include <urcu/rseq.h>
+#include <urcu/wfcqlanes.h>
+#include <urcu/static/wfcqueue.h>
+
+#define WFCQ_LANES_DEFAULT	16
+
+static unsigned long wfcq_lanes_nr_cpus(void)
+{
+	long maxcpus = -1;
+
+#if defined(HAVE_SYSCONF)
+	maxcpus = sysconf(_SC_NPROCESSORS_CONF);
+#endif
+	if (maxcpus <= 0)
+		return WFCQ_LANES_DEFAULT;
+	return maxcpus;
+}
+
+int cds_wfcq_lanes_init(struct cds_wfcq_lanes *q, unsigned long nr_lanes)
+{
+	unsigned long size = 1, i;
+	void *lane;
+
+	if (!nr_lanes)
+		nr_lanes = wfcq_lanes_nr_cpus();
+	while (size < nr_lanes)
+		size <<= 1;
+	if (posix_memalign(&lane, CAA_CACHE_LINE_SIZE,
+			size * sizeof(*q->lane)))
+		return -ENOMEM;
+	q->lane = lane;
+	q->nr_lanes = size;
+	for (i = 0; i < size; i++)
+		_cds_wfcq_init(&q->lane[i].head, &q->lane[i].tail);
+	return 0;
+}
+
+void cds_wfcq_lanes_destroy(struct cds_wfcq_lanes *q)
+{
+	unsigned long i;
+
+	for (i = 0; i < q->nr_lanes; i++)
+		(void) pthread_mutex_destroy(&q->lane[i].head.lock);
+	free(q->lane);
+	q->lane = NULL;
+	q->nr_lanes = 0;
+}
+
+unsigned long cds_wfcq_lanes_current(struct cds_wfcq_lanes *q)
+{
+	int cpu;
+
+	cpu = urcu_rseq_cpu_id();
+#if defined(HAVE_SCHED_GETCPU)
+	if (caa_unlikely(cpu < 0))
+		cpu = sched_getcpu();
+#endif
+	if (caa_unlikely(cpu < 0))
+		return ((unsigned long) pthread_self() >> 8) & (q->nr_lanes - 1);
+	return (unsigned long) cpu & (q->nr_lanes - 1);
+}
+
+bool cds_wfcq_lanes_empty(struct cds_wfcq_lanes *q)
+{
+	unsigned long i;
+
+	for (i = 0; i < q->nr_lanes; i++) {
+		if (!_cds_wfcq_empty(&q->lane[i].head, &q->lane[i].tail))
+			return false;
+	}
+	return true;
+}
+
+bool cds_wfcq_lanes_enqueue(struct cds_wfcq_lanes *q,
+		struct cds_wfcq_node *node)
+{
+	struct cds_wfcq_lane *lane = &q->lane[cds_wfcq_lanes_current(q)];
+
+	return _cds_wfcq_enqueue(&lane->head, &lane->tail, node);
+}
+
+bool cds_wfcq_lanes_enqueue_chain(struct cds_wfcq_lanes *q,
+		struct cds_wfcq_chain *chain)
+{
+	struct cds_wfcq_lane *lane = &q->lane[cds_wfcq_lanes_current(q)];
+
+	return _cds_wfcq_enqueue_chain(&lane->head, &lane->tail, chain);
+}
+
+struct cds_wfcq_node *cds_wfcq_lanes_dequeue_blocking(
+		struct cds_wfcq_lanes *q)
+{
+	unsigned long start, i;
+
+	/* Local lane first, then steal from the following lanes. */
+	start = cds_wfcq_lanes_current(q);
+	for (i = 0; i < q->nr_lanes; i++) {
+		struct cds_wfcq_lane *lane;
+		struct cds_wfcq_node *node;
+
+		lane = &q->lane[(start + i) & (q->nr_lanes - 1)];
+		/* Skip empty lanes without taking their lock. */
+		if (_cds_wfcq_empty(&lane->head, &lane->tail))
+			continue;
+		node = _cds_wfcq_dequeue_blocking(&lane->head, &lane->tail);
+		if (node)
+			return node;
+	}
+	return NULL;
+}
+
+enum cds_wfcq_ret cds_wfcq_lanes_splice_blocking(
+		cds_wfcq_head_ptr_t dest_q_head,
+		struct cds_wfcq_tail *dest_q_tail,
+		struct cds_wfcq_lanes *q)
+{
+	enum cds_wfcq_ret ret = CDS_WFCQ_RET_SRC_EMPTY;
+	unsigned long i;
+
+	for (i = 0; i < q->nr_lanes; i++) {
+		struct cds_wfcq_lane *lane = &q->lane[i];
+		enum cds_wfcq_ret lane_ret;
+
+		if (_cds_wfcq_empty(&lane->head, &lane->tail))
+			continue;
+		_cds_wfcq_dequeue_lock(&lane->head, &lane->tail);
+		lane_ret = ___cds_wfcq_splice_blocking(dest_q_head, dest_q_tail,
+				&lane->head, &lane->tail);
+		_cds_wfcq_dequeue_unlock(&lane->head, &lane->tail);
+		/* The first lane appended tells whether dest was empty. */
+		if (ret == CDS_WFCQ_RET_SRC_EMPTY)
+			ret = lane_ret;
+	}
+	return ret;
+}
@@ -60,6 +60,62 @@ bool cds_wfcq_enqueue(cds_wfcq_head_ptr_t head,
 	return _cds_wfcq_enqueue(head, tail, node);
 }
 
+void cds_wfcq_chain_init(struct cds_wfcq_chain *chain)
+{
+	_cds_wfcq_chain_init(chain);
+}
+
+bool cds_wfcq_chain_empty(struct cds_wfcq_chain *chain)
+{
+	return _cds_wfcq_chain_empty(chain);
+}
+
+void cds_wfcq_chain_add(struct cds_wfcq_chain *chain,
+		struct cds_wfcq_node *node)
+{
+	_cds_wfcq_chain_add(chain, node);
+}
+
+bool cds_wfcq_enqueue_chain(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_chain *chain)
+{
+	return _cds_wfcq_enqueue_chain(head, tail, chain);
+}
+
+void cds_wfcq_wait_init(struct cds_wfcq_wait *wait)
+{
+	_cds_wfcq_wait_init(wait);
+}
+
+void cds_wfcq_wake(struct cds_wfcq_wait *wait)
+{
+	_cds_wfcq_wake(wait);
+}
+
+bool cds_wfcq_enqueue_wake(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_node *node,
+		struct cds_wfcq_wait *wait)
+{
+	return _cds_wfcq_enqueue_wake(head, tail, node, wait);
+}
+
+bool cds_wfcq_enqueue_chain_wake(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_chain *chain,
+		struct cds_wfcq_wait *wait)
+{
+	return _cds_wfcq_enqueue_chain_wake(head, tail, chain, wait);
+}
+
+void cds_wfcq_wait_nonempty(cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_wait *wait)
+{
+	_cds_wfcq_wait_nonempty(head, tail, wait);
+}
+
 void cds_wfcq_dequeue_lock(struct cds_wfcq_head *head,
 		struct cds_wfcq_tail *tail)
 {
@@ -87,6 +143,15 @@ struct cds_wfcq_node *cds_wfcq_dequeue_with_state_blocking(
 	return _cds_wfcq_dequeue_with_state_blocking(head, tail, state);
 }
 
+unsigned int cds_wfcq_dequeue_bulk_blocking(
+		struct cds_wfcq_head *head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_node **nodes,
+		unsigned int max)
+{
+	return _cds_wfcq_dequeue_bulk_blocking(head, tail, nodes, max);
+}
+
 enum cds_wfcq_ret cds_wfcq_splice_blocking(
 		struct cds_wfcq_head *dest_q_head,
 		struct cds_wfcq_tail *dest_q_tail,
@@ -127,6 +192,24 @@ struct cds_wfcq_node *__cds_wfcq_dequeue_with_state_nonblocking(
 	return ___cds_wfcq_dequeue_with_state_nonblocking(head, tail, state);
 }
 
+unsigned int __cds_wfcq_dequeue_bulk_blocking(
+		cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_node **nodes,
+		unsigned int max)
+{
+	return ___cds_wfcq_dequeue_bulk_blocking(head, tail, nodes, max);
+}
+
+unsigned int __cds_wfcq_dequeue_bulk_nonblocking(
+		cds_wfcq_head_ptr_t head,
+		struct cds_wfcq_tail *tail,
+		struct cds_wfcq_node **nodes,
+		unsigned int max)
+{
+	return ___cds_wfcq_dequeue_bulk_nonblocking(head, tail, nodes, max);
+}
+
 enum cds_wfcq_ret __cds_wfcq_splice_blocking(
 		cds_wfcq_head_ptr_t dest_q_head,
 		struct cds_wfcq_tail *dest_q_tail,
@@ -53,6 +53,28 @@ int cds_wfs_push(struct cds_wfs_stack *s, struct cds_wfs_node *node)
 	return _cds_wfs_push(s, node);
 }
 
+void cds_wfs_chain_init(struct cds_wfs_chain *chain)
+{
+	_cds_wfs_chain_init(chain);
+}
+
+bool cds_wfs_chain_empty(struct cds_wfs_chain *chain)
+{
+	return _cds_wfs_chain_empty(chain);
+}
+
+void cds_wfs_chain_add(struct cds_wfs_chain *chain,
+		struct cds_wfs_node *node)
+{
+	_cds_wfs_chain_add(chain, node);
+}
+
+int cds_wfs_push_chain(cds_wfs_stack_ptr_t u_stack,
+		struct cds_wfs_chain *chain)
+{
+	return _cds_wfs_push_chain(u_stack, chain);
+}
+
 struct cds_wfs_node *cds_wfs_pop_blocking(struct cds_wfs_stack *s)
 {
 	return _cds_wfs_pop_blocking(s);
@@ -69,6 +91,12 @@ struct cds_wfs_head *cds_wfs_pop_all_blocking(struct cds_wfs_stack *s)
 	return _cds_wfs_pop_all_blocking(s);
 }
 
+struct cds_wfs_head *
+	cds_wfs_pop_all_reverse_blocking(struct cds_wfs_stack *s)
+{
+	return _cds_wfs_pop_all_reverse_blocking(s);
+}
+
 struct cds_wfs_node *cds_wfs_first(struct cds_wfs_head *head)
 {
 	return _cds_wfs_first(head);
@@ -84,6 +112,11 @@ struct cds_wfs_node *cds_wfs_next_nonblocking(struct cds_wfs_node *node)
 	return _cds_wfs_next_nonblocking(node);
 }
 
+struct cds_wfs_head *cds_wfs_reverse_blocking(struct cds_wfs_head *head)
+{
+	return _cds_wfs_reverse_blocking(head);
+}
+
 void cds_wfs_pop_lock(struct cds_wfs_stack *s)
 {
 	_cds_wfs_pop_lock(s);
@@ -121,3 +154,9 @@ struct cds_wfs_head *__cds_wfs_pop_all(cds_wfs_stack_ptr_t u_stack)
 {
 	return ___cds_wfs_pop_all(u_stack);
 }
+
+struct cds_wfs_head *
+	__cds_wfs_pop_all_reverse_blocking(cds_wfs_stack_ptr_t u_stack)
+{
+	return ___cds_wfs_pop_all_reverse_blocking(u_stack);
+}
@@ -0,0 +1,63 @@
+/*
+ * wsdeque.c
+ *
+ * Userspace RCU library - Work-Stealing Deque
+ *
+ * Copyright 2013 - Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
+#undef _LGPL_SOURCE
+#include "urcu/wsdeque.h"
+#define _LGPL_SOURCE
+#include "urcu/static/wsdeque.h"
+
+/*
+ * library wrappers to be used by non-LGPL compatible source code.
+ */
+
+void cds_wsdq_init(struct cds_wsdq *q,
+		void wsdq_call_rcu(struct rcu_head *head,
+			void (*func)(struct rcu_head *head)))
+{
+	_cds_wsdq_init(q, wsdq_call_rcu);
+}
+
+int cds_wsdq_destroy(struct cds_wsdq *q)
+{
+	return _cds_wsdq_destroy(q);
+}
+
+bool cds_wsdq_empty(struct cds_wsdq *q)
+{
+	return _cds_wsdq_empty(q);
+}
+
+int cds_wsdq_push(struct cds_wsdq *q, void *elem)
+{
+	return _cds_wsdq_push(q, elem);
+}
+
+void *cds_wsdq_pop(struct cds_wsdq *q)
+{
+	return _cds_wsdq_pop(q);
+}
+
+void *cds_wsdq_steal(struct cds_wsdq *q)
+{
+	return _cds_wsdq_steal(q);
+}